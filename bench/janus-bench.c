@@ -0,0 +1,817 @@
+/*! \file    janus-bench.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Microbenchmarks for the core RTP/RTCP/SDP primitives
+ * \details  Simple tool to measure how long the primitives Janus uses on
+ * each packet (or each negotiation) take, so that regressions can be
+ * spotted across upgrades. The inputs are the same corpora the fuzzers
+ * use (fuzzers/corpora), which are made of real RTP, RTCP and SDP samples,
+ * plus a few synthetic ones (large multistream SDPs and plugin configurations).
+ * Each benchmark runs over all the inputs it applies to for (at least) the
+ * provided amount of time, and the results are written as a JSON document,
+ * e.g.:
+ *
+\verbatim
+./bench/janus-bench -c ./fuzzers/corpora -d 500 -o results.json
+\endverbatim
+ *
+ * Skew compensation is fed a synthetic source whose clock drifts from
+ * ours, and the number of packets it drops or skips is part of the results
+ * too, so that changes in its behaviour can be spotted as well.
+ *
+ * The cost of reference counting is measured as well, both for a plain
+ * increase/decrease (which depends on whether the build strips the
+ * debugging checks or not) and for reading the members next to a counter
+ * that another thread keeps updating, with and without padding.
+ *
+ * \note Functions that modify the packets they process are fed a copy of
+ * the input at each iteration, and the time spent copying it is included
+ * in the results.
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+#include <jansson.h>
+
+#include "../src/debug.h"
+#include "../src/utils.h"
+#include "../src/rtp.h"
+#include "../src/rtpsrtp.h"
+#include "../src/rtcp.h"
+#include "../src/sdp-utils.h"
+#include "../src/config.h"
+#include "../src/refcount.h"
+#include "../src/version.h"
+
+int janus_log_level = LOG_WARN;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+/* Max UDP payload with MTU=1500, as in the fuzzers */
+#define JANUS_BENCH_MAX_PACKET	1472
+/* How many packets we protect at a time, before unprotecting them */
+#define JANUS_BENCH_SRTP_BATCH	256
+/* How many packets of a synthetic source we feed to the skew compensation (10 minutes of audio) */
+#define JANUS_BENCH_SKEW_PACKETS	30000
+
+static const char *corpora = NULL, *output = NULL, *filter = NULL;
+static int duration = 200;
+
+static GOptionEntry opt_entries[] = {
+	{ "corpora", 'c', 0, G_OPTION_ARG_STRING, &corpora, "Folder containing the fuzzers corpora (default=./fuzzers/corpora)", "path" },
+	{ "duration", 'd', 0, G_OPTION_ARG_INT, &duration, "Minimum duration of each benchmark, in milliseconds (default=200)", "ms" },
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run the benchmarks whose name contains this string", "string" },
+	{ "output", 'o', 0, G_OPTION_ARG_STRING, &output, "File to write the JSON results to (default=stdout)", "path" },
+	{ NULL, 0, 0, 0, NULL, NULL, NULL },
+};
+
+/* Inputs, as loaded from the corpora */
+static GPtrArray *rtp_packets = NULL, *rtcp_packets = NULL, *sdps = NULL;
+static GPtrArray *payloads = NULL, *parsed_sdps = NULL, *requests = NULL;
+static GPtrArray *multistream_sdps = NULL, *multistream_parsed_sdps = NULL;
+static GPtrArray *configs = NULL;
+
+/* Used to make sure the compiler doesn't optimize our calls away */
+static volatile guint64 janus_bench_sink = 0;
+
+static gint64 janus_bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec*G_GINT64_CONSTANT(1000000000)) + ts.tv_nsec;
+}
+
+/* Load all the files in a corpus folder (and its subfolders) that pass the provided check */
+static void janus_bench_load_corpus(GPtrArray *inputs, const char *path, gboolean (*check)(GBytes *input)) {
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(dir == NULL)
+		return;
+	const char *name = NULL;
+	while((name = g_dir_read_name(dir)) != NULL) {
+		if(strstr(name, "LICENSE"))
+			continue;
+		char *file = g_build_filename(path, name, NULL);
+		if(g_file_test(file, G_FILE_TEST_IS_DIR)) {
+			janus_bench_load_corpus(inputs, file, check);
+		} else {
+			gchar *content = NULL;
+			gsize size = 0;
+			if(g_file_get_contents(file, &content, &size, NULL)) {
+				GBytes *input = g_bytes_new_take(content, size);
+				if(check == NULL || check(input))
+					g_ptr_array_add(inputs, input);
+				else
+					g_bytes_unref(input);
+			}
+		}
+		g_free(file);
+	}
+	g_dir_close(dir);
+}
+
+static gboolean janus_bench_check_rtp(GBytes *input) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	return size > 0 && size <= JANUS_BENCH_MAX_PACKET && janus_is_rtp(data, size);
+}
+
+static gboolean janus_bench_check_rtcp(GBytes *input) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	return size > 0 && size <= JANUS_BENCH_MAX_PACKET && janus_is_rtcp(data, size);
+}
+
+static gboolean janus_bench_check_sdp(GBytes *input) {
+	gsize size = 0;
+	const char *data = (const char *)g_bytes_get_data(input, &size);
+	return size > 0 && memchr(data, '\0', size) == NULL;
+}
+
+/* Run a benchmark function over all inputs until the provided duration
+ * is reached, and add the results to the provided array */
+typedef guint64 (*janus_bench_function)(GBytes *input, char *scratch);
+static void janus_bench_run(json_t *results, const char *name, GPtrArray *inputs, janus_bench_function function) {
+	if(filter != NULL && strstr(name, filter) == NULL)
+		return;
+	if(inputs == NULL || inputs->len == 0) {
+		JANUS_LOG(LOG_WARN, "No inputs for benchmark '%s', skipping\n", name);
+		return;
+	}
+	char scratch[JANUS_BENCH_MAX_PACKET + SRTP_MAX_TRAILER_LEN];
+	guint64 ops = 0, sink = 0;
+	gint64 limit = (gint64)duration * G_GINT64_CONSTANT(1000000), elapsed = 0;
+	gint64 start = janus_bench_now();
+	while(elapsed < limit) {
+		guint i = 0;
+		for(i=0; i<inputs->len; i++)
+			sink += function(g_ptr_array_index(inputs, i), scratch);
+		ops += inputs->len;
+		elapsed = janus_bench_now() - start;
+	}
+	janus_bench_sink += sink;
+	json_t *result = json_object();
+	json_object_set_new(result, "name", json_string(name));
+	json_object_set_new(result, "inputs", json_integer(inputs->len));
+	json_object_set_new(result, "ops", json_integer(ops));
+	json_object_set_new(result, "total_ns", json_integer(elapsed));
+	json_object_set_new(result, "ns_per_op", json_real((double)elapsed/(double)ops));
+	json_array_append_new(results, result);
+	JANUS_LOG(LOG_INFO, "%-40s %10.1f ns/op (%"SCNu64" ops)\n", name, (double)elapsed/(double)ops, ops);
+}
+
+/* RTP extensions (we look for the same ID the fuzzers use) */
+static guint64 janus_bench_rtp_ext_audio_level(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	gboolean vad = FALSE;
+	int level = 0;
+	return janus_rtp_header_extension_parse_audio_level(data, size, 1, &vad, &level) + level;
+}
+
+static guint64 janus_bench_rtp_ext_mid(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	char sdes_item[16];
+	return janus_rtp_header_extension_parse_mid(data, size, 1, sdes_item, sizeof(sdes_item));
+}
+
+static guint64 janus_bench_rtp_ext_rid(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	char sdes_item[16];
+	return janus_rtp_header_extension_parse_rid(data, size, 1, sdes_item, sizeof(sdes_item));
+}
+
+static guint64 janus_bench_rtp_ext_transport_wide_cc(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	uint16_t seq = 0;
+	return janus_rtp_header_extension_parse_transport_wide_cc(data, size, 1, &seq) + seq;
+}
+
+static guint64 janus_bench_rtp_ext_abs_send_time(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	uint32_t abs_ts = 0;
+	return janus_rtp_header_extension_parse_abs_sent_time(data, size, 1, &abs_ts) + abs_ts;
+}
+
+static guint64 janus_bench_rtp_ext_dependency_desc(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	uint8_t dd[256];
+	int dd_len = sizeof(dd);
+	return janus_rtp_header_extension_parse_dependency_desc(data, size, 1, dd, &dd_len) + dd_len;
+}
+
+static guint64 janus_bench_rtp_ext_replace_id(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	memcpy(scratch, data, size);
+	return janus_rtp_header_extension_replace_id(scratch, size, 1, 2);
+}
+
+/* RTCP */
+static guint64 janus_bench_rtcp_parse(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	memcpy(scratch, data, size);
+	janus_rtcp_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	return janus_rtcp_parse(&ctx, scratch, size);
+}
+
+static guint64 janus_bench_rtcp_fix_ssrc(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	memcpy(scratch, data, size);
+	janus_rtcp_context ctx;
+	memset(&ctx, 0, sizeof(ctx));
+	return janus_rtcp_fix_ssrc(&ctx, scratch, size, 1, 0x4A414E55, 0x55534A41);
+}
+
+/* Simulcast: each packet is processed as the base substream of a VP8 simulcast publisher */
+static guint64 janus_bench_simulcasting_process_rtp(GBytes *input, char *scratch) {
+	gsize size = 0;
+	char *data = (char *)g_bytes_get_data(input, &size);
+	janus_rtp_header *header = (janus_rtp_header *)data;
+	uint32_t ssrcs[3] = { ntohl(header->ssrc), 0, 0 };
+	janus_rtp_simulcasting_context context;
+	janus_rtp_simulcasting_context_reset(&context);
+	context.substream_target = 2;
+	context.templayer_target = 2;
+	janus_rtp_switching_context sc;
+	janus_rtp_switching_context_reset(&sc);
+	return janus_rtp_simulcasting_context_process_rtp(&context, data, size,
+		NULL, 0, ssrcs, NULL, JANUS_VIDEOCODEC_VP8, &sc, NULL);
+}
+
+/* VP8 keyframe detection, on the payload of the RTP packets */
+static guint64 janus_bench_vp8_is_keyframe(GBytes *input, char *scratch) {
+	gsize size = 0;
+	const char *data = (const char *)g_bytes_get_data(input, &size);
+	return janus_vp8_is_keyframe(data, size);
+}
+
+/* SDP */
+static guint64 janus_bench_sdp_parse(GBytes *input, char *scratch) {
+	const char *data = (const char *)g_bytes_get_data(input, NULL);
+	char error_str[512];
+	janus_sdp *parsed = janus_sdp_parse(data, error_str, sizeof(error_str));
+	if(parsed == NULL)
+		return 0;
+	janus_sdp_destroy(parsed);
+	return 1;
+}
+
+static guint64 janus_bench_sdp_write(GBytes *input, char *scratch) {
+	janus_sdp *parsed = *(janus_sdp **)g_bytes_get_data(input, NULL);
+	char *sdp = janus_sdp_write(parsed);
+	guint64 len = sdp ? strlen(sdp) : 0;
+	g_free(sdp);
+	return len;
+}
+
+/* JSON requests, as they'd be received by a transport and handled by the core */
+static guint64 janus_bench_json_request(GBytes *input, char *scratch) {
+	gsize size = 0;
+	const char *data = (const char *)g_bytes_get_data(input, &size);
+	json_error_t error;
+	json_t *root = json_loadb(data, size, 0, &error);
+	if(root == NULL)
+		return 0;
+	guint64 res = 0;
+	const char *request = json_string_value(json_object_get(root, "janus"));
+	const char *transaction = json_string_value(json_object_get(root, "transaction"));
+	json_t *jsep = json_object_get(root, "jsep");
+	const char *sdp = jsep ? json_string_value(json_object_get(jsep, "sdp")) : NULL;
+	if(request && transaction)
+		res += strlen(request) + strlen(transaction) + (sdp ? strlen(sdp) : 0);
+	json_decref(root);
+	return res;
+}
+
+/* SRTP: same profile Janus negotiates by default, the key doesn't matter */
+static srtp_t srtp_out = NULL, srtp_in = NULL;
+static uint16_t srtp_seq = 0;
+static void janus_bench_srtp_rewrite(char *buffer) {
+	janus_rtp_header *header = (janus_rtp_header *)buffer;
+	header->ssrc = htonl(0x4A414E55);
+	header->seq_number = htons(srtp_seq++);
+}
+
+static guint64 janus_bench_srtp_protect(GBytes *input, char *scratch) {
+	gsize size = 0;
+	const char *data = (const char *)g_bytes_get_data(input, &size);
+	memcpy(scratch, data, size);
+	janus_bench_srtp_rewrite(scratch);
+	int len = size;
+	if(srtp_protect(srtp_out, scratch, &len) != srtp_err_status_ok)
+		return 0;
+	return len;
+}
+
+/* Inputs for the unprotect benchmark are batches of packets we protect
+ * on the fly: only the time spent unprotecting them is measured */
+typedef struct janus_bench_srtp_batch {
+	char buffers[JANUS_BENCH_SRTP_BATCH][JANUS_BENCH_MAX_PACKET + SRTP_MAX_TRAILER_LEN];
+	int lengths[JANUS_BENCH_SRTP_BATCH];
+	guint64 elapsed;
+} janus_bench_srtp_batch;
+
+static void janus_bench_srtp_unprotect(json_t *results, const char *name) {
+	if(filter != NULL && strstr(name, filter) == NULL)
+		return;
+	if(rtp_packets->len == 0) {
+		JANUS_LOG(LOG_WARN, "No inputs for benchmark '%s', skipping\n", name);
+		return;
+	}
+	janus_bench_srtp_batch *batch = g_malloc(sizeof(janus_bench_srtp_batch));
+	guint64 ops = 0, failed = 0;
+	gint64 limit = (gint64)duration * G_GINT64_CONSTANT(1000000), elapsed = 0, start = 0;
+	guint next = 0;
+	while(elapsed < limit) {
+		int i = 0;
+		for(i=0; i<JANUS_BENCH_SRTP_BATCH; i++) {
+			GBytes *input = g_ptr_array_index(rtp_packets, next);
+			next = (next + 1) % rtp_packets->len;
+			gsize size = 0;
+			const char *data = (const char *)g_bytes_get_data(input, &size);
+			memcpy(batch->buffers[i], data, size);
+			janus_bench_srtp_rewrite(batch->buffers[i]);
+			batch->lengths[i] = size;
+			if(srtp_protect(srtp_out, batch->buffers[i], &batch->lengths[i]) != srtp_err_status_ok)
+				batch->lengths[i] = 0;
+		}
+		start = janus_bench_now();
+		for(i=0; i<JANUS_BENCH_SRTP_BATCH; i++) {
+			if(batch->lengths[i] == 0)
+				continue;
+			if(srtp_unprotect(srtp_in, batch->buffers[i], &batch->lengths[i]) != srtp_err_status_ok)
+				failed++;
+			ops++;
+		}
+		elapsed += janus_bench_now() - start;
+	}
+	g_free(batch);
+	if(failed > 0)
+		JANUS_LOG(LOG_WARN, "%"SCNu64" packets failed to be unprotected\n", failed);
+	if(ops == 0)
+		return;
+	json_t *result = json_object();
+	json_object_set_new(result, "name", json_string(name));
+	json_object_set_new(result, "inputs", json_integer(rtp_packets->len));
+	json_object_set_new(result, "ops", json_integer(ops));
+	json_object_set_new(result, "total_ns", json_integer(elapsed));
+	json_object_set_new(result, "ns_per_op", json_real((double)elapsed/(double)ops));
+	json_array_append_new(results, result);
+	JANUS_LOG(LOG_INFO, "%-40s %10.1f ns/op (%"SCNu64" ops)\n", name, (double)elapsed/(double)ops, ops);
+}
+
+static gboolean janus_bench_srtp_setup(void) {
+	if(srtp_init() != srtp_err_status_ok) {
+		JANUS_LOG(LOG_ERR, "Error initializing libsrtp\n");
+		return FALSE;
+	}
+	srtp_policy_t policy;
+	memset(&policy, 0, sizeof(policy));
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+	srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);
+	unsigned char key[SRTP_MASTER_LENGTH];
+	memset(key, 0x42, sizeof(key));
+	policy.key = key;
+	policy.window_size = 128;
+	policy.next = NULL;
+	policy.ssrc.type = ssrc_any_outbound;
+	if(srtp_create(&srtp_out, &policy) != srtp_err_status_ok) {
+		JANUS_LOG(LOG_ERR, "Error creating outbound SRTP session\n");
+		return FALSE;
+	}
+	policy.ssrc.type = ssrc_any_inbound;
+	if(srtp_create(&srtp_in, &policy) != srtp_err_status_ok) {
+		JANUS_LOG(LOG_ERR, "Error creating inbound SRTP session\n");
+		srtp_dealloc(srtp_out);
+		srtp_out = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Derived inputs */
+static void janus_bench_prepare_inputs(void) {
+	guint i = 0;
+	/* Payloads of the RTP packets, for codec specific functions */
+	payloads = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	for(i=0; i<rtp_packets->len; i++) {
+		gsize size = 0;
+		char *data = (char *)g_bytes_get_data(g_ptr_array_index(rtp_packets, i), &size);
+		int plen = 0;
+		char *payload = janus_rtp_payload(data, size, &plen);
+		if(payload != NULL && plen > 0)
+			g_ptr_array_add(payloads, g_bytes_new(payload, plen));
+	}
+	/* Pre-parsed SDPs (for janus_sdp_write), and JSON requests that contain them */
+	parsed_sdps = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	requests = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	for(i=0; i<sdps->len; i++) {
+		const char *sdp = (const char *)g_bytes_get_data(g_ptr_array_index(sdps, i), NULL);
+		char error_str[512];
+		janus_sdp *parsed = janus_sdp_parse(sdp, error_str, sizeof(error_str));
+		if(parsed == NULL)
+			continue;
+		g_ptr_array_add(parsed_sdps, g_bytes_new(&parsed, sizeof(parsed)));
+		json_t *request = json_pack("{sssssIsIs{ssss}s{ssss}}",
+			"janus", "message", "transaction", "abcdefghijkl",
+			"session_id", G_GINT64_CONSTANT(4738128371647678), "handle_id", G_GINT64_CONSTANT(1347819237681474),
+			"body", "request", "configure", "display", "Benchmark",
+			"jsep", "type", "offer", "sdp", sdp);
+		char *text = json_dumps(request, JSON_PRESERVE_ORDER);
+		json_decref(request);
+		if(text != NULL)
+			g_ptr_array_add(requests, g_bytes_new_take(text, strlen(text)));
+	}
+	/* A couple of lightweight requests as well */
+	const char *simple[] = {
+		"{\"janus\":\"keepalive\",\"session_id\":4738128371647678,\"transaction\":\"abcdefghijkl\"}",
+		"{\"janus\":\"attach\",\"session_id\":4738128371647678,\"plugin\":\"janus.plugin.videoroom\",\"transaction\":\"abcdefghijkl\"}",
+		"{\"janus\":\"trickle\",\"session_id\":4738128371647678,\"handle_id\":1347819237681474,\"transaction\":\"abcdefghijkl\","
+			"\"candidate\":{\"candidate\":\"candidate:1 1 udp 2122260223 192.168.1.2 54321 typ host\",\"sdpMid\":\"0\",\"sdpMLineIndex\":0}}",
+		NULL
+	};
+	for(i=0; simple[i] != NULL; i++)
+		g_ptr_array_add(requests, g_bytes_new_static(simple[i], strlen(simple[i])));
+}
+
+/* Synthetic offers with many m-lines, like the ones multistream subscribers get */
+#define JANUS_BENCH_MULTISTREAM_MLINES	32
+static void janus_bench_prepare_multistream(void) {
+	multistream_sdps = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	multistream_parsed_sdps = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	janus_sdp *offer = janus_sdp_generate_offer("Benchmark", "0.0.0.0", JANUS_SDP_OA_DONE);
+	char mid[16], msid[32], mstid[32];
+	int i = 0;
+	for(i=0; i<JANUS_BENCH_MULTISTREAM_MLINES; i++) {
+		gboolean video = (i % 2);
+		g_snprintf(mid, sizeof(mid), "%d", i);
+		g_snprintf(msid, sizeof(msid), "janus%d", i/2);
+		g_snprintf(mstid, sizeof(mstid), "janus%d%s", i/2, video ? "v" : "a");
+		janus_sdp_generate_offer_mline(offer,
+			JANUS_SDP_OA_MLINE, video ? JANUS_SDP_VIDEO : JANUS_SDP_AUDIO,
+			JANUS_SDP_OA_MID, mid,
+			JANUS_SDP_OA_MSID, msid, mstid,
+			JANUS_SDP_OA_PT, video ? 96 : 111,
+			JANUS_SDP_OA_CODEC, video ? "vp8" : "opus",
+			JANUS_SDP_OA_FMTP, video ? NULL : "useinbandfec=1",
+			JANUS_SDP_OA_DIRECTION, JANUS_SDP_SENDONLY,
+			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_MID, 1,
+			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_AUDIO_LEVEL, video ? 0 : 2,
+			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC, video ? 3 : 0,
+			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_ABS_SEND_TIME, video ? 4 : 0,
+			JANUS_SDP_OA_DONE);
+		/* Add what the core would add to each m-line when merging */
+		janus_sdp_mline *m = janus_sdp_mline_find_by_index(offer, i);
+		if(m == NULL)
+			continue;
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("ice-ufrag", "abcd"));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("ice-pwd", "abcdefghijklmnopqrstuv"));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("setup", "actpass"));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("rtcp-mux", NULL));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("ssrc", "%d cname:janus", 1000+i));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("candidate",
+			"1 1 udp 2015363327 192.168.1.2 %d typ host", 40000+i));
+		janus_sdp_attribute_add_to_mline(m, janus_sdp_attribute_create("end-of-candidates", NULL));
+	}
+	char *text = janus_sdp_write(offer);
+	if(text != NULL)
+		g_ptr_array_add(multistream_sdps, g_bytes_new_take(text, strlen(text) + 1));
+	g_ptr_array_add(multistream_parsed_sdps, g_bytes_new(&offer, sizeof(offer)));
+}
+
+/* A large plugin configuration, like the ones with thousands of static rooms */
+#define JANUS_BENCH_CONFIG_CATEGORIES	10000
+static const char *janus_bench_config_items[] = {
+	"description", "secret", "publishers", "bitrate", "fir_freq",
+	"audiocodec", "videocodec", "record", "pin", "is_private", NULL
+};
+static void janus_bench_prepare_config(void) {
+	configs = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	char *path = NULL;
+	GError *error = NULL;
+	int fd = g_file_open_tmp("janus-bench-XXXXXX.jcfg", &path, &error);
+	if(fd < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't create temporary configuration file: %s\n", error ? error->message : "??");
+		g_clear_error(&error);
+		return;
+	}
+	GString *text = g_string_new("general: {\n\tstring_ids = false\n}\n");
+	int i = 0;
+	for(i=1; i<=JANUS_BENCH_CONFIG_CATEGORIES; i++) {
+		g_string_append_printf(text, "room-%d: {\n\tdescription = \"Room %d\"\n\tsecret = \"adminpwd\"\n"
+			"\tpublishers = 6\n\tbitrate = 128000\n\tfir_freq = 10\n"
+			"\taudiocodec = \"opus\"\n\tvideocodec = \"vp8\"\n\trecord = false\n}\n", i, i);
+	}
+	gboolean written = (write(fd, text->str, text->len) == (ssize_t)text->len);
+	close(fd);
+	g_string_free(text, TRUE);
+	if(!written) {
+		JANUS_LOG(LOG_WARN, "Couldn't write temporary configuration file %s\n", path);
+		unlink(path);
+		g_free(path);
+		return;
+	}
+	g_ptr_array_add(configs, g_bytes_new_take(path, strlen(path) + 1));
+}
+
+/* Parse the configuration, and get all the properties we know of, as plugins do */
+static guint64 janus_bench_config_load(GBytes *input, char *scratch) {
+	janus_config *config = janus_config_parse((const char *)g_bytes_get_data(input, NULL));
+	if(config == NULL)
+		return 0;
+	guint64 found = 0;
+	GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
+	while(cl) {
+		janus_config_category *cat = (janus_config_category *)cl->data;
+		int i = 0;
+		for(i=0; janus_bench_config_items[i] != NULL; i++) {
+			if(janus_config_get(config, cat, janus_config_type_item, janus_bench_config_items[i]) != NULL)
+				found++;
+		}
+		/* Look the category up by name too, as done when saving permanent changes */
+		if(janus_config_get(config, NULL, janus_config_type_category, cat->name) != NULL)
+			found++;
+		cl = cl->next;
+	}
+	g_list_free(clist);
+	janus_config_destroy(config);
+	return found;
+}
+
+/* Reference counters: objects with the counter right after the members
+ * we read, and with the counter padded as JANUS_REFCOUNT_HOT does */
+typedef struct janus_bench_refcount_packed {
+	volatile guint64 members[4];
+	janus_refcount ref;
+} janus_bench_refcount_packed;
+typedef struct janus_bench_refcount_padded {
+	volatile guint64 members[4];
+	JANUS_REFCOUNT_HOT(ref);
+} janus_bench_refcount_padded;
+static volatile gint janus_bench_refcount_stop = 0;
+
+static void janus_bench_refcount_free(const janus_refcount *ref) {
+	/* Never invoked, as we never get to 0 */
+}
+
+static gpointer janus_bench_refcount_thread(gpointer data) {
+	janus_refcount *ref = (janus_refcount *)data;
+	while(!g_atomic_int_get(&janus_bench_refcount_stop)) {
+		janus_refcount_increase(ref);
+		janus_refcount_decrease(ref);
+	}
+	return NULL;
+}
+
+/* If contended, another thread keeps on updating the counter while we
+ * read the other members, otherwise we update the counter ourselves */
+static void janus_bench_refcount(json_t *results, const char *name, volatile guint64 *members, janus_refcount *ref, gboolean contended) {
+	if(filter != NULL && strstr(name, filter) == NULL)
+		return;
+	janus_refcount_init(ref, janus_bench_refcount_free);
+	GThread *thread = NULL;
+	if(contended) {
+		g_atomic_int_set(&janus_bench_refcount_stop, 0);
+		thread = g_thread_new("bench refcount", janus_bench_refcount_thread, ref);
+	}
+	guint64 ops = 0, sink = 0;
+	gint64 limit = (gint64)duration * G_GINT64_CONSTANT(1000000), elapsed = 0;
+	gint64 start = janus_bench_now();
+	while(elapsed < limit) {
+		int i = 0;
+		for(i=0; i<1024; i++) {
+			if(contended) {
+				sink += members[i & 3];
+			} else {
+				janus_refcount_increase(ref);
+				janus_refcount_decrease(ref);
+			}
+		}
+		ops += 1024;
+		elapsed = janus_bench_now() - start;
+	}
+	if(thread != NULL) {
+		g_atomic_int_set(&janus_bench_refcount_stop, 1);
+		g_thread_join(thread);
+	}
+	janus_bench_sink += sink;
+	json_t *result = json_object();
+	json_object_set_new(result, "name", json_string(name));
+	json_object_set_new(result, "inputs", json_integer(1));
+	json_object_set_new(result, "ops", json_integer(ops));
+	json_object_set_new(result, "total_ns", json_integer(elapsed));
+	json_object_set_new(result, "ns_per_op", json_real((double)elapsed/(double)ops));
+	json_array_append_new(results, result);
+	JANUS_LOG(LOG_INFO, "%-40s %10.1f ns/op (%"SCNu64" ops)\n", name, (double)elapsed/(double)ops, ops);
+}
+
+/* Skew compensation, on a synthetic source whose clock drifts from ours: the
+ * arrival times are simulated, so the drops and jumps the compensation
+ * results in are the same at each run, and can be compared across versions */
+static void janus_bench_skew(json_t *results, const char *name, gboolean video, int drift_ppm) {
+	if(filter != NULL && strstr(name, filter) == NULL)
+		return;
+	/* 20ms Opus packets, or 30fps video frames */
+	guint32 ts_step = video ? 3000 : 960;
+	gint64 interval = video ? 33333 : 20000;
+	interval = interval * (1000000 - drift_ppm) / 1000000;
+	char buffer[12];
+	janus_rtp_header *header = (janus_rtp_header *)buffer;
+	guint64 ops = 0, drops = 0, jumps = 0;
+	gint64 limit = (gint64)duration * G_GINT64_CONSTANT(1000000), elapsed = 0;
+	gint64 start = janus_bench_now();
+	gboolean first = TRUE;
+	while(elapsed < limit) {
+		janus_rtp_switching_context context;
+		janus_rtp_switching_context_reset(&context);
+		gint64 now = 1;
+		guint i = 0;
+		for(i=0; i<JANUS_BENCH_SKEW_PACKETS; i++) {
+			memset(buffer, 0, sizeof(buffer));
+			header->version = 2;
+			header->type = video ? 96 : 111;
+			header->seq_number = htons((uint16_t)i);
+			header->timestamp = htonl(i * ts_step);
+			header->ssrc = htonl(0x4A414E55);
+			janus_rtp_header_update(header, &context, video, 0);
+			int ret = video ? janus_rtp_skew_compensate_video(header, &context, now) :
+				janus_rtp_skew_compensate_audio(header, &context, now);
+			if(first && ret < 0)
+				drops += -ret;
+			else if(first && ret > 0)
+				jumps += ret;
+			now += interval;
+		}
+		first = FALSE;
+		ops += JANUS_BENCH_SKEW_PACKETS;
+		elapsed = janus_bench_now() - start;
+	}
+	json_t *result = json_object();
+	json_object_set_new(result, "name", json_string(name));
+	json_object_set_new(result, "inputs", json_integer(JANUS_BENCH_SKEW_PACKETS));
+	json_object_set_new(result, "ops", json_integer(ops));
+	json_object_set_new(result, "total_ns", json_integer(elapsed));
+	json_object_set_new(result, "ns_per_op", json_real((double)elapsed/(double)ops));
+	json_object_set_new(result, "drops", json_integer(drops));
+	json_object_set_new(result, "jumps", json_integer(jumps));
+	json_array_append_new(results, result);
+	JANUS_LOG(LOG_INFO, "%-40s %10.1f ns/op (%"SCNu64" ops, %"SCNu64" drops, %"SCNu64" jumps)\n",
+		name, (double)elapsed/(double)ops, ops, drops, jumps);
+}
+
+static void janus_bench_free_parsed_sdp(gpointer data) {
+	janus_sdp_destroy(*(janus_sdp **)g_bytes_get_data((GBytes *)data, NULL));
+}
+
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	janus_log_init(FALSE, TRUE, NULL);
+	atexit(janus_log_destroy);
+
+	GError *error = NULL;
+	GOptionContext *opts = g_option_context_new("");
+	g_option_context_set_help_enabled(opts, TRUE);
+	g_option_context_add_main_entries(opts, opt_entries, NULL);
+	if(!g_option_context_parse(opts, &argc, &argv, &error)) {
+		g_print("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(opts);
+		exit(1);
+	}
+	g_option_context_free(opts);
+	if(duration <= 0) {
+		JANUS_LOG(LOG_ERR, "Invalid duration %d\n", duration);
+		exit(1);
+	}
+	if(corpora == NULL)
+		corpora = "./fuzzers/corpora";
+
+	/* Load the inputs */
+	rtp_packets = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	rtcp_packets = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	sdps = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+	char *path = g_build_filename(corpora, "rtp_fuzzer", NULL);
+	janus_bench_load_corpus(rtp_packets, path, janus_bench_check_rtp);
+	g_free(path);
+	path = g_build_filename(corpora, "rtcp_fuzzer", NULL);
+	janus_bench_load_corpus(rtcp_packets, path, janus_bench_check_rtcp);
+	g_free(path);
+	path = g_build_filename(corpora, "sdp_fuzzer", NULL);
+	janus_bench_load_corpus(sdps, path, janus_bench_check_sdp);
+	g_free(path);
+	/* SDP inputs must be strings */
+	guint i = 0;
+	for(i=0; i<sdps->len; i++) {
+		gsize size = 0;
+		const char *data = (const char *)g_bytes_get_data(g_ptr_array_index(sdps, i), &size);
+		GBytes *sdp = g_bytes_new_take(g_strndup(data, size), size + 1);
+		g_bytes_unref(g_ptr_array_index(sdps, i));
+		g_ptr_array_index(sdps, i) = sdp;
+	}
+	if(rtp_packets->len == 0 && rtcp_packets->len == 0 && sdps->len == 0) {
+		JANUS_LOG(LOG_ERR, "No inputs found in %s\n", corpora);
+		exit(1);
+	}
+	JANUS_LOG(LOG_INFO, "Loaded %u RTP packets, %u RTCP packets and %u SDPs from %s\n",
+		rtp_packets->len, rtcp_packets->len, sdps->len, corpora);
+	janus_bench_prepare_inputs();
+	janus_bench_prepare_multistream();
+	janus_bench_prepare_config();
+	gboolean srtp = janus_bench_srtp_setup();
+
+	/* Run the benchmarks */
+	json_t *results = json_array();
+	janus_bench_run(results, "rtp_ext_audio_level", rtp_packets, janus_bench_rtp_ext_audio_level);
+	janus_bench_run(results, "rtp_ext_mid", rtp_packets, janus_bench_rtp_ext_mid);
+	janus_bench_run(results, "rtp_ext_rid", rtp_packets, janus_bench_rtp_ext_rid);
+	janus_bench_run(results, "rtp_ext_transport_wide_cc", rtp_packets, janus_bench_rtp_ext_transport_wide_cc);
+	janus_bench_run(results, "rtp_ext_abs_send_time", rtp_packets, janus_bench_rtp_ext_abs_send_time);
+	janus_bench_run(results, "rtp_ext_dependency_desc", rtp_packets, janus_bench_rtp_ext_dependency_desc);
+	janus_bench_run(results, "rtp_ext_replace_id", rtp_packets, janus_bench_rtp_ext_replace_id);
+	janus_bench_run(results, "rtcp_parse", rtcp_packets, janus_bench_rtcp_parse);
+	janus_bench_run(results, "rtcp_fix_ssrc", rtcp_packets, janus_bench_rtcp_fix_ssrc);
+	janus_bench_run(results, "simulcasting_process_rtp", rtp_packets, janus_bench_simulcasting_process_rtp);
+	janus_bench_run(results, "vp8_is_keyframe", payloads, janus_bench_vp8_is_keyframe);
+	janus_bench_skew(results, "skew_compensate_audio_fast", FALSE, 2000);
+	janus_bench_skew(results, "skew_compensate_audio_slow", FALSE, -2000);
+	janus_bench_skew(results, "skew_compensate_video_fast", TRUE, 2000);
+	janus_bench_skew(results, "skew_compensate_video_slow", TRUE, -2000);
+	janus_bench_run(results, "sdp_parse", sdps, janus_bench_sdp_parse);
+	janus_bench_run(results, "sdp_write", parsed_sdps, janus_bench_sdp_write);
+	janus_bench_run(results, "sdp_parse_multistream", multistream_sdps, janus_bench_sdp_parse);
+	janus_bench_run(results, "sdp_write_multistream", multistream_parsed_sdps, janus_bench_sdp_write);
+	janus_bench_run(results, "json_request", requests, janus_bench_json_request);
+	janus_bench_run(results, "config_load_10k", configs, janus_bench_config_load);
+	if(srtp) {
+		janus_bench_run(results, "srtp_protect", rtp_packets, janus_bench_srtp_protect);
+		janus_bench_srtp_unprotect(results, "srtp_unprotect");
+		srtp_dealloc(srtp_out);
+		srtp_dealloc(srtp_in);
+	}
+	janus_bench_refcount_packed *packed = g_malloc0(sizeof(janus_bench_refcount_packed));
+	janus_bench_refcount_padded *padded = g_malloc0(sizeof(janus_bench_refcount_padded));
+	janus_bench_refcount(results, "refcount_increase_decrease", packed->members, &packed->ref, FALSE);
+	janus_bench_refcount(results, "refcount_neighbours_packed", packed->members, &packed->ref, TRUE);
+	janus_bench_refcount(results, "refcount_neighbours_padded", padded->members, &padded->ref, TRUE);
+	g_free(packed);
+	g_free(padded);
+
+	/* Write the results */
+	json_t *report = json_object();
+	json_object_set_new(report, "version", json_string(janus_version_string));
+	json_object_set_new(report, "commit", json_string(janus_build_git_sha));
+	json_object_set_new(report, "duration_ms", json_integer(duration));
+#ifdef REFCOUNT_NODEBUG
+	json_object_set_new(report, "refcount_debug_checks", json_false());
+#else
+	json_object_set_new(report, "refcount_debug_checks", json_true());
+#endif
+	json_object_set_new(report, "benchmarks", results);
+	int res = 0;
+	if(output != NULL) {
+		if(json_dump_file(report, output, JSON_INDENT(2) | JSON_PRESERVE_ORDER) < 0) {
+			JANUS_LOG(LOG_ERR, "Error writing results to %s\n", output);
+			res = 1;
+		}
+	} else {
+		json_dumpf(report, stdout, JSON_INDENT(2) | JSON_PRESERVE_ORDER);
+		fprintf(stdout, "\n");
+	}
+	json_decref(report);
+
+	for(i=0; i<parsed_sdps->len; i++)
+		janus_bench_free_parsed_sdp(g_ptr_array_index(parsed_sdps, i));
+	g_ptr_array_free(parsed_sdps, TRUE);
+	for(i=0; i<multistream_parsed_sdps->len; i++)
+		janus_bench_free_parsed_sdp(g_ptr_array_index(multistream_parsed_sdps, i));
+	g_ptr_array_free(multistream_parsed_sdps, TRUE);
+	g_ptr_array_free(multistream_sdps, TRUE);
+	for(i=0; i<configs->len; i++)
+		unlink((const char *)g_bytes_get_data(g_ptr_array_index(configs, i), NULL));
+	g_ptr_array_free(configs, TRUE);
+	g_ptr_array_free(requests, TRUE);
+	g_ptr_array_free(payloads, TRUE);
+	g_ptr_array_free(sdps, TRUE);
+	g_ptr_array_free(rtcp_packets, TRUE);
+	g_ptr_array_free(rtp_packets, TRUE);
+	return res;
+}
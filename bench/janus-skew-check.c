@@ -0,0 +1,432 @@
+/*! \file    janus-skew-check.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Equivalence checks for the RTP skew compensation
+ * \details  Simple tool to make sure the skew compensation in rtp.c still
+ * behaves exactly like the original algorithm, which is kept here as a
+ * reference implementation. Both are fed the same synthetic streams, with
+ * clocks drifting from ours, arrival times jittered, and packets lost or
+ * reordered, and after each packet the return values, the rewritten RTP
+ * headers and the state of the switching contexts are compared. The tool
+ * exits with an error as soon as a difference is found, e.g.:
+ *
+\verbatim
+./bench/janus-skew-check -p 60000
+\endverbatim
+ *
+ * \ingroup tools
+ * \ref tools
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include "../src/debug.h"
+#include "../src/rtp.h"
+
+int janus_log_level = LOG_INFO;
+gboolean janus_log_timestamps = FALSE;
+gboolean janus_log_colors = FALSE;
+char *janus_log_global_prefix = NULL;
+int lock_debug = 0;
+int refcount_debug = 0;
+
+static int packets = 60000, seed = 42;
+
+static GOptionEntry opt_entries[] = {
+	{ "packets", 'p', 0, G_OPTION_ARG_INT, &packets, "Number of packets in each stream (default=60000)", "number" },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &seed, "Seed for the jitter, losses and reordering (default=42)", "number" },
+	{ NULL, 0, 0, 0, NULL, NULL, NULL },
+};
+
+/* Reference implementation: these are the audio and video skew compensation
+ * functions as they were before they shared the same code, copied verbatim
+ * (apart from the names), and must NOT be changed, as they're what the
+ * version in rtp.c is compared to */
+static int janus_skew_check_reference_audio(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
+	/* Reset values if a new ssrc has been detected */
+	if(context->new_ssrc) {
+		JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" resetting status\n", context->last_ssrc);
+		context->reference_time = now;
+		context->start_time = 0;
+		context->evaluating_start_time = 0;
+		context->start_ts = 0;
+		context->active_delay = 0;
+		context->prev_delay = 0;
+		context->seq_offset = 0;
+		context->ts_offset = 0;
+		context->target_ts = 0;
+		context->new_ssrc = FALSE;
+	}
+
+	/* N 	: a N sequence number jump has been performed */
+	/* 0  	: any new skew compensation has been applied */
+	/* -N  	: a N packet drop must be performed */
+	int exit_status = 0;
+
+	/* Do not execute skew analysis in the first seconds */
+	if(now-context->reference_time < SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
+		return 0;
+	} else if(!context->start_time) {
+		JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase start\n", context->last_ssrc);
+		context->start_time = now;
+		context->evaluating_start_time = now;
+		context->start_ts = context->last_ts;
+	}
+
+	/* Skew analysis */
+	/* Are we waiting for a target timestamp? (a negative skew has been evaluated in a previous iteration) */
+	if(context->target_ts > 0 && (gint32)(context->target_ts - context->last_ts) > 0) {
+		context->seq_offset--;
+		exit_status = -1;
+	} else {
+		context->target_ts = 0;
+		/* Do not execute analysis for out of order packets or multi-packets frame */
+		if(context->last_seq == context->prev_seq + 1 && context->last_ts != context->prev_ts) {
+			/* Set the sample rate according to the header */
+			guint32 akhz = 48; /* 48khz for Opus */
+			if(header->type == 0 || header->type == 8 || header->type == 9)
+				akhz = 8;
+			/* Evaluate the local RTP timestamp according to the local clock */
+			guint32 expected_ts = ((now - context->start_time)*akhz)/1000 + context->start_ts;
+			/* Evaluate current delay */
+			gint32 delay_now = context->last_ts - expected_ts;
+			/* Exponentially weighted moving average estimation */
+			gint32 delay_estimate = (63*context->prev_delay + delay_now)/64;
+			/* Save previous delay for the next iteration*/
+			context->prev_delay = delay_estimate;
+			/* Evaluate the distance between active delay and current delay estimate */
+			gint32 offset = context->active_delay - delay_estimate;
+			JANUS_LOG(LOG_HUGE, "audio skew status SSRC=%"SCNu32" RECVD_TS=%"SCNu32" EXPTD_TS=%"SCNu32" OFFSET=%"SCNi32" TS_OFFSET=%"SCNi32" SEQ_OFFSET=%"SCNi16"\n", context->last_ssrc, context->last_ts, expected_ts, offset, context->ts_offset, context->seq_offset);
+			gint32 skew_th = RTP_AUDIO_SKEW_TH_MS*akhz;
+			/* Evaluation phase */
+			if(context->evaluating_start_time > 0) {
+				/* Check if the offset has surpassed half the threshold during the evaluating phase */
+				if(now-context->evaluating_start_time <= SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
+					if(abs(offset) <= skew_th/2) {
+						JANUS_LOG(LOG_HUGE, "audio skew SSRC=%"SCNu32" evaluation phase continue\n", context->last_ssrc);
+					} else {
+						JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase reset\n", context->last_ssrc);
+						context->start_time = now;
+						context->evaluating_start_time = now;
+						context->start_ts = context->last_ts;
+					}
+				} else {
+					JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase stop\n", context->last_ssrc);
+					context->evaluating_start_time = 0;
+				}
+				return 0;
+			}
+			/* Check if the offset has surpassed the threshold */
+			if(offset >= skew_th) {
+				/* The source is slowing down */
+				/* Update active delay */
+				context->active_delay = delay_estimate;
+				/* Adjust ts offset */
+				context->ts_offset += skew_th;
+				/* Calculate last ts increase */
+				guint32 ts_incr = context->last_ts-context->prev_ts;
+				/* Evaluate sequence number jump */
+				guint16 jump = (skew_th+ts_incr-1)/ts_incr;
+				/* Adjust seq num offset */
+				context->seq_offset += jump;
+				exit_status = jump;
+			} else if(offset <= -skew_th) {
+				/* The source is speeding up*/
+				/* Update active delay */
+				context->active_delay = delay_estimate;
+				/* Adjust ts offset */
+				context->ts_offset -= skew_th;
+				/* Set target ts */
+				context->target_ts = context->last_ts + skew_th;
+				if (context->target_ts == 0)
+					context->target_ts = 1;
+				/* Adjust seq num offset */
+				context->seq_offset--;
+				exit_status = -1;
+			}
+		}
+	}
+
+	/* Skew compensation */
+	/* Fix header timestamp considering the active offset */
+	guint32 fixed_rtp_ts = context->last_ts + context->ts_offset;
+	header->timestamp = htonl(fixed_rtp_ts);
+	/* Fix header sequence number considering the total offset */
+	guint16 fixed_rtp_seq = context->last_seq + context->seq_offset;
+	header->seq_number = htons(fixed_rtp_seq);
+
+	return exit_status;
+}
+
+static int janus_skew_check_reference_video(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
+	/* Reset values if a new ssrc has been detected */
+	if(context->new_ssrc) {
+		JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" resetting status\n", context->last_ssrc);
+		context->reference_time = now;
+		context->start_time = 0;
+		context->evaluating_start_time = 0;
+		context->start_ts = 0;
+		context->active_delay = 0;
+		context->prev_delay = 0;
+		context->seq_offset = 0;
+		context->ts_offset = 0;
+		context->target_ts = 0;
+		context->new_ssrc = FALSE;
+	}
+
+	/* N 	: a N sequence numbers jump has been performed */
+	/* 0  	: any new skew compensation has been applied */
+	/* -N  	: a N packets drop must be performed */
+	int exit_status = 0;
+
+	/* Do not execute skew analysis in the first seconds */
+	if(now-context->reference_time < SKEW_DETECTION_WAIT_TIME_SECS/2 *G_USEC_PER_SEC) {
+		return 0;
+	} else if(!context->start_time) {
+		JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase start\n", context->last_ssrc);
+		context->start_time = now;
+		context->evaluating_start_time = now;
+		context->start_ts = context->last_ts;
+	}
+
+	/* Skew analysis */
+	/* Are we waiting for a target timestamp? (a negative skew has been evaluated in a previous iteration) */
+	if(context->target_ts > 0 && (gint32)(context->target_ts - context->last_ts) > 0) {
+		context->seq_offset--;
+		exit_status = -1;
+	} else {
+		context->target_ts = 0;
+		/* Do not execute analysis for out of order packets or multi-packets frame */
+		if(context->last_seq == context->prev_seq + 1 && context->last_ts != context->prev_ts) {
+			/* Set the sample rate */
+			guint32 vkhz = 90; /* 90khz */
+			/* Evaluate the local RTP timestamp according to the local clock */
+			guint32 expected_ts = ((now - context->start_time)*vkhz)/1000 + context->start_ts;
+			/* Evaluate current delay */
+			gint32 delay_now = context->last_ts - expected_ts;
+			/* Exponentially weighted moving average estimation */
+			gint32 delay_estimate = (63*context->prev_delay + delay_now)/64;
+			/* Save previous delay for the next iteration*/
+			context->prev_delay = delay_estimate;
+			/* Evaluate the distance between active delay and current delay estimate */
+			gint32 offset = context->active_delay - delay_estimate;
+			JANUS_LOG(LOG_HUGE, "video skew status SSRC=%"SCNu32" RECVD_TS=%"SCNu32" EXPTD_TS=%"SCNu32" OFFSET=%"SCNi32" TS_OFFSET=%"SCNi32" SEQ_OFFSET=%"SCNi16"\n", context->last_ssrc, context->last_ts, expected_ts, offset, context->ts_offset, context->seq_offset);
+			gint32 skew_th = RTP_VIDEO_SKEW_TH_MS*vkhz;
+			/* Evaluation phase */
+			if(context->evaluating_start_time > 0) {
+				/* Check if the offset has surpassed half the threshold during the evaluating phase */
+				if(now-context->evaluating_start_time <= SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
+					if(abs(offset) <= skew_th/2) {
+						JANUS_LOG(LOG_HUGE, "video skew SSRC=%"SCNu32" evaluation phase continue\n", context->last_ssrc);
+					} else {
+						JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase reset\n", context->last_ssrc);
+						context->start_time = now;
+						context->evaluating_start_time = now;
+						context->start_ts = context->last_ts;
+					}
+				} else {
+					JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase stop\n", context->last_ssrc);
+					context->evaluating_start_time = 0;
+				}
+				return 0;
+			}
+			/* Check if the offset has surpassed the threshold */
+			if(offset >= skew_th) {
+				/* The source is slowing down */
+				/* Update active delay */
+				context->active_delay = delay_estimate;
+				/* Adjust ts offset */
+				context->ts_offset += skew_th;
+				/* Calculate last ts increase */
+				guint32 ts_incr = context->last_ts-context->prev_ts;
+				/* Evaluate sequence number jump */
+				guint16 jump = (skew_th+ts_incr-1)/ts_incr;
+				/* Adjust seq num offset */
+				context->seq_offset += jump;
+				exit_status = jump;
+			} else if(offset <= -skew_th) {
+				/* The source is speeding up*/
+				/* Update active delay */
+				context->active_delay = delay_estimate;
+				/* Adjust ts offset */
+				context->ts_offset -= skew_th;
+				/* Set target ts */
+				context->target_ts = context->last_ts + skew_th;
+				if(context->target_ts == 0)
+					context->target_ts = 1;
+				/* Adjust seq num offset */
+				context->seq_offset--;
+				exit_status = -1;
+			}
+		}
+	}
+
+	/* Skew compensation */
+	/* Fix header timestamp considering the active offset */
+	guint32 fixed_rtp_ts = context->last_ts + context->ts_offset;
+	header->timestamp = htonl(fixed_rtp_ts);
+	/* Fix header sequence number considering the total offset */
+	guint16 fixed_rtp_seq = context->last_seq + context->seq_offset;
+	header->seq_number = htons(fixed_rtp_seq);
+
+	return exit_status;
+}
+
+/* Compare the state of two switching contexts, field by field: last_time is
+ * skipped, as janus_rtp_header_update() sets it to the actual current time */
+static gboolean janus_skew_check_same_context(janus_rtp_switching_context *a, janus_rtp_switching_context *b) {
+	return a->last_ssrc == b->last_ssrc && a->last_ts == b->last_ts && a->base_ts == b->base_ts &&
+		a->base_ts_prev == b->base_ts_prev && a->prev_ts == b->prev_ts && a->target_ts == b->target_ts &&
+		a->start_ts == b->start_ts && a->last_seq == b->last_seq && a->prev_seq == b->prev_seq &&
+		a->base_seq == b->base_seq && a->base_seq_prev == b->base_seq_prev &&
+		a->ts_reset == b->ts_reset && a->seq_reset == b->seq_reset && a->new_ssrc == b->new_ssrc &&
+		a->seq_offset == b->seq_offset && a->prev_delay == b->prev_delay &&
+		a->active_delay == b->active_delay && a->ts_offset == b->ts_offset &&
+		a->reference_time == b->reference_time &&
+		a->start_time == b->start_time && a->evaluating_start_time == b->evaluating_start_time;
+}
+
+/* A synthetic stream: the source clock drifts from ours by drift_ppm, arrival
+ * times are jittered by up to jitter_us, a few packets are lost or swapped
+ * with the next one, and halfway through the source changes its SSRC */
+typedef struct janus_skew_check_stream {
+	const char *name;
+	gboolean video;
+	int pt;
+	guint32 ts_step;
+	gint64 interval;
+	int packets_per_frame;
+	int drift_ppm;
+	int jitter_us;
+	int loss_permille;
+	int reorder_permille;
+} janus_skew_check_stream;
+
+static gboolean janus_skew_check_run(janus_skew_check_stream *stream, guint64 *events) {
+	janus_rtp_switching_context ref_context, context;
+	janus_rtp_switching_context_reset(&ref_context);
+	janus_rtp_switching_context_reset(&context);
+	GRand *rand = g_rand_new_with_seed(seed);
+	gint64 interval = stream->interval * (1000000 - stream->drift_ppm) / 1000000;
+	char ref_buffer[sizeof(janus_rtp_header)], buffer[sizeof(janus_rtp_header)], swapped[sizeof(janus_rtp_header)];
+	janus_rtp_header *ref_header = (janus_rtp_header *)ref_buffer, *header = (janus_rtp_header *)buffer;
+	gboolean has_swapped = FALSE, ok = TRUE;
+	guint32 ssrc = 0x4A414E55;
+	int i = 0;
+	for(i=0; i<packets && ok; i++) {
+		if(i == packets/2)
+			ssrc++;
+		/* Prepare the packet, as the source sent it */
+		int frame = i / stream->packets_per_frame;
+		memset(buffer, 0, sizeof(buffer));
+		header->version = 2;
+		header->type = stream->pt;
+		header->markerbit = ((i + 1) % stream->packets_per_frame == 0);
+		header->seq_number = htons((uint16_t)i);
+		header->timestamp = htonl((guint32)frame * stream->ts_step);
+		header->ssrc = htonl(ssrc);
+		if(g_rand_int_range(rand, 0, 1000) < stream->loss_permille)
+			continue;
+		if(!has_swapped && g_rand_int_range(rand, 0, 1000) < stream->reorder_permille) {
+			/* Send this packet after the next one */
+			memcpy(swapped, buffer, sizeof(buffer));
+			has_swapped = TRUE;
+			continue;
+		}
+		/* When did it arrive? (a possibly swapped packet comes right after) */
+		gint64 now = 1 + frame * interval;
+		if(stream->jitter_us > 0)
+			now += g_rand_int_range(rand, 0, stream->jitter_us);
+		int round = 0;
+		for(round=0; round<(has_swapped ? 2 : 1) && ok; round++) {
+			if(round == 1) {
+				memcpy(buffer, swapped, sizeof(buffer));
+				has_swapped = FALSE;
+			}
+			memcpy(ref_buffer, buffer, sizeof(buffer));
+			janus_rtp_header_update(ref_header, &ref_context, stream->video, 0);
+			janus_rtp_header_update(header, &context, stream->video, 0);
+			int ref_ret = stream->video ? janus_skew_check_reference_video(ref_header, &ref_context, now) :
+				janus_skew_check_reference_audio(ref_header, &ref_context, now);
+			int ret = stream->video ? janus_rtp_skew_compensate_video(header, &context, now) :
+				janus_rtp_skew_compensate_audio(header, &context, now);
+			if(ret != 0)
+				(*events)++;
+			if(ret != ref_ret) {
+				JANUS_LOG(LOG_ERR, "[%s] Packet #%d: returned %d, expected %d\n", stream->name, i, ret, ref_ret);
+				ok = FALSE;
+			} else if(memcmp(buffer, ref_buffer, RTP_HEADER_SIZE)) {
+				JANUS_LOG(LOG_ERR, "[%s] Packet #%d: header is seq=%"SCNu16"/ts=%"SCNu32", expected seq=%"SCNu16"/ts=%"SCNu32"\n",
+					stream->name, i, ntohs(header->seq_number), ntohl(header->timestamp),
+					ntohs(ref_header->seq_number), ntohl(ref_header->timestamp));
+				ok = FALSE;
+			} else if(!janus_skew_check_same_context(&context, &ref_context)) {
+				JANUS_LOG(LOG_ERR, "[%s] Packet #%d: context state differs\n", stream->name, i);
+				ok = FALSE;
+			}
+		}
+	}
+	g_rand_free(rand);
+	return ok;
+}
+
+
+/* Main Code */
+int main(int argc, char *argv[]) {
+	janus_log_init(FALSE, TRUE, NULL);
+	atexit(janus_log_destroy);
+
+	GError *error = NULL;
+	GOptionContext *opts = g_option_context_new("");
+	g_option_context_set_help_enabled(opts, TRUE);
+	g_option_context_add_main_entries(opts, opt_entries, NULL);
+	if(!g_option_context_parse(opts, &argc, &argv, &error)) {
+		g_print("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(opts);
+		exit(1);
+	}
+	g_option_context_free(opts);
+	if(packets <= 0) {
+		JANUS_LOG(LOG_ERR, "Invalid number of packets %d\n", packets);
+		exit(1);
+	}
+
+	janus_skew_check_stream streams[] = {
+		/* name, video, pt, ts_step, interval, packets per frame, drift, jitter, loss, reorder */
+		{ "opus_fast", FALSE, 111, 960, 20000, 1, 2000, 0, 0, 0 },
+		{ "opus_slow", FALSE, 111, 960, 20000, 1, -2000, 0, 0, 0 },
+		{ "opus_fast_jittered", FALSE, 111, 960, 20000, 1, 3000, 15000, 5, 5 },
+		{ "opus_slow_jittered", FALSE, 111, 960, 20000, 1, -3000, 15000, 5, 5 },
+		{ "pcmu_fast_jittered", FALSE, 0, 160, 20000, 1, 2500, 10000, 2, 2 },
+		{ "pcma_slow_jittered", FALSE, 8, 160, 20000, 1, -2500, 10000, 2, 2 },
+		{ "g722_slow", FALSE, 9, 160, 20000, 1, -1000, 5000, 0, 0 },
+		{ "video_fast", TRUE, 96, 3000, 33333, 1, 2000, 0, 0, 0 },
+		{ "video_slow", TRUE, 96, 3000, 33333, 1, -2000, 0, 0, 0 },
+		{ "video_fast_jittered", TRUE, 96, 3000, 33333, 4, 3000, 20000, 5, 10 },
+		{ "video_slow_jittered", TRUE, 96, 3000, 33333, 4, -3000, 20000, 5, 10 },
+	};
+	guint64 total = 0;
+	gboolean ok = TRUE;
+	guint i = 0;
+	for(i=0; i<G_N_ELEMENTS(streams); i++) {
+		guint64 events = 0;
+		if(!janus_skew_check_run(&streams[i], &events)) {
+			ok = FALSE;
+			continue;
+		}
+		JANUS_LOG(LOG_INFO, "[%s] %d packets, %"SCNu64" compensation events, same results\n",
+			streams[i].name, packets, events);
+		total += events;
+	}
+	if(!ok) {
+		JANUS_LOG(LOG_ERR, "The skew compensation doesn't match the reference implementation\n");
+		exit(1);
+	}
+	JANUS_LOG(LOG_INFO, "All streams match the reference implementation (%"SCNu64" compensation events)\n", total);
+	exit(0);
+}
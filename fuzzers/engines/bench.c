@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Benchmarking engine: instead of just running the fuzzer entrypoint once
+ * for each input, like the standalone engine, it runs it in a timed loop,
+ * and reports how long each call takes and how many allocations it makes.
+ * Results can be saved, and then used as a baseline for later runs:
+ *
+ *   ./rtp_fuzzer -output=rtp.bench corpus_folder/file1 ...
+ *   ./rtp_fuzzer -baseline=rtp.bench -threshold=20 corpus_folder/file1 ...
+ *
+ * The second run exits with an error if any input got slower by more than
+ * the threshold (percentage), or needs more allocations than before. Build
+ * without sanitizers, or the numbers will mostly measure their overhead. */
+
+extern int LLVMFuzzerTestOneInput(const unsigned char *data, size_t size);
+
+/* Count allocations by wrapping the glibc allocator: this can't be done
+ * when a sanitizer provides its own, in which case we only report times */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+#define BENCH_NO_ALLOCS
+#endif
+#endif
+#if !defined(__GLIBC__) || defined(__SANITIZE_ADDRESS__)
+#define BENCH_NO_ALLOCS
+#endif
+
+static unsigned long long allocations = 0;
+#ifndef BENCH_NO_ALLOCS
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+void *calloc(size_t nmemb, size_t size) {
+	allocations++;
+	return __libc_calloc(nmemb, size);
+}
+void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+typedef struct bench_result {
+	char name[256];
+	double ns_op;
+	double allocs_op;
+} bench_result;
+
+static double now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static const char *basename_of(const char *path) {
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+static int load_baseline(const char *path, bench_result **results, int *count) {
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Couldn't open baseline %s\n", path);
+		return -1;
+	}
+	char line[512];
+	int size = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (*count == size) {
+			size = size ? size * 2 : 64;
+			*results = (bench_result *)realloc(*results, size * sizeof(bench_result));
+		}
+		bench_result *r = &(*results)[*count];
+		if (sscanf(line, "%255s %lf %lf", r->name, &r->ns_op, &r->allocs_op) == 3)
+			(*count)++;
+	}
+	fclose(f);
+	return 0;
+}
+
+static bench_result *find_result(bench_result *results, int count, const char *name) {
+	for (int i = 0; i < count; i++) {
+		if (!strcmp(results[i].name, name))
+			return &results[i];
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv) {
+	double duration = 100, threshold = 20;
+	const char *baseline_path = NULL, *output_path = NULL;
+	bench_result *baseline = NULL;
+	int baseline_count = 0, regressions = 0;
+	FILE *output = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		if (!strncmp(argv[i], "-duration=", 10))
+			duration = atof(argv[i] + 10);
+		else if (!strncmp(argv[i], "-threshold=", 11))
+			threshold = atof(argv[i] + 11);
+		else if (!strncmp(argv[i], "-baseline=", 10))
+			baseline_path = argv[i] + 10;
+		else if (!strncmp(argv[i], "-output=", 8))
+			output_path = argv[i] + 8;
+		else
+			fprintf(stderr, "Ignoring unknown option %s\n", argv[i]);
+	}
+	if (baseline_path && load_baseline(baseline_path, &baseline, &baseline_count) < 0)
+		return 1;
+	if (output_path) {
+		output = fopen(output_path, "w");
+		if (!output) {
+			fprintf(stderr, "Couldn't open output %s\n", output_path);
+			return 1;
+		}
+		fprintf(output, "# input ns/op allocs/op\n");
+	}
+#ifdef BENCH_NO_ALLOCS
+	fprintf(stderr, "Allocations can't be counted in this build\n");
+#endif
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-')
+			continue;
+		FILE *f = fopen(argv[i], "r");
+		if (!f) {
+			fprintf(stderr, "Couldn't open %s\n", argv[i]);
+			continue;
+		}
+		fseek(f, 0, SEEK_END);
+		size_t len = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		unsigned char *buf = (unsigned char*)malloc(len);
+		size_t n_read = fread(buf, 1, len, f);
+		fclose(f);
+		/* Warm up, and count the allocations of a single call */
+		LLVMFuzzerTestOneInput(buf, n_read);
+		unsigned long long before = allocations;
+		LLVMFuzzerTestOneInput(buf, n_read);
+		double allocs_op = (double)(allocations - before);
+		/* Run in batches, until we've been running for long enough */
+		unsigned long long iterations = 0, batch = 16;
+		double start = now_ns(), elapsed = 0;
+		while (elapsed < duration * 1e6) {
+			for (unsigned long long n = 0; n < batch; n++)
+				LLVMFuzzerTestOneInput(buf, n_read);
+			iterations += batch;
+			batch *= 2;
+			elapsed = now_ns() - start;
+		}
+		free(buf);
+		double ns_op = elapsed / (double)iterations;
+		const char *name = basename_of(argv[i]);
+		if (output)
+			fprintf(output, "%s %.1f %.2f\n", name, ns_op, allocs_op);
+		bench_result *base = find_result(baseline, baseline_count, name);
+		if (!base) {
+			printf("%-64s %12.1f ns/op %8.2f allocs/op\n", name, ns_op, allocs_op);
+			continue;
+		}
+		double change = base->ns_op > 0 ? (ns_op - base->ns_op) * 100 / base->ns_op : 0;
+		int regression = change > threshold || allocs_op > base->allocs_op + 0.005;
+		printf("%-64s %12.1f ns/op %8.2f allocs/op (baseline %.1f ns/op %.2f allocs/op, %+.1f%%)%s\n",
+			name, ns_op, allocs_op, base->ns_op, base->allocs_op, change, regression ? " REGRESSION" : "");
+		if (regression)
+			regressions++;
+	}
+	if (output)
+		fclose(output);
+	free(baseline);
+	if (regressions > 0) {
+		fprintf(stderr, "%d input(s) regressed\n", regressions);
+		return 1;
+	}
+	return 0;
+}
@@ -78,7 +78,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 	janus_rtp_header_extension_parse_transport_wide_cc((char *)data, size, 1, &transport_seq_num);
 	janus_rtp_header_extension_parse_abs_sent_time((char *)data, size, 1, NULL);
 	janus_rtp_header_extension_parse_video_orientation((char * )data, size, 1, &c, &f, &r1, &r0);
-	janus_rtp_header_extension_parse_dependency_desc((char *)data, size, 1, (uint8_t *)&dd, &sizedd);
+	gboolean has_dd = (janus_rtp_header_extension_parse_dependency_desc((char *)data, size, 1, (uint8_t *)&dd, &sizedd) == 0);
 
 	/* Extract codec payload */
 	int plen = 0;
@@ -107,6 +107,16 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 	janus_vp9_is_keyframe(payload, plen);
 	janus_vp9_parse_svc(payload, plen, &found, &info);
 
+	/* AV1 targets */
+	janus_av1_is_keyframe(payload, plen);
+	if (has_dd) {
+		janus_av1_svc_context av1_context;
+		memset(&av1_context, 0, sizeof(janus_av1_svc_context));
+		uint8_t template_id = 0, ebit = 0;
+		janus_av1_svc_context_process_dd(&av1_context, dd, sizedd, &template_id, &ebit);
+		janus_av1_svc_context_reset(&av1_context);
+	}
+
 	/* Free resources */
 
 	return 0;
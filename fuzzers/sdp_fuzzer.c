@@ -35,9 +35,15 @@ int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
 	/* Regenerate the SDP blog */
 	char *generated_sdp = janus_sdp_write(parsed_sdp);
 
+	/* Do the same with the arena-backed parser */
+	janus_sdp *arena_sdp = janus_sdp_parse_arena((const char *)sdp_string, error_str, sizeof(error_str));
+	char *arena_generated_sdp = arena_sdp ? janus_sdp_write(arena_sdp) : NULL;
+
 	/* Free resources */
 	janus_sdp_destroy(parsed_sdp);
 	g_free(generated_sdp);
+	janus_sdp_destroy(arena_sdp);
+	g_free(arena_generated_sdp);
 
 	return 0;
 }
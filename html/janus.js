@@ -710,8 +710,9 @@ function Janus(gatewayCallbacks) {
 		retries = 0;
 		if(!websockets && typeof sessionId !== 'undefined' && sessionId !== null && skipTimeout !== true)
 			eventHandler();
-		if(!websockets && Janus.isArray(json)) {
-			// We got an array: it means we passed a maxev > 1, iterate on all objects
+		if(Janus.isArray(json)) {
+			// We got an array: it means we passed a maxev > 1 (HTTP), or the
+			// server coalesced multiple messages in a frame (WebSockets)
 			for(let i=0; i<json.length; i++) {
 				handleEvent(json[i], true);
 			}
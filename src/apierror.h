@@ -66,6 +66,8 @@
 #define JANUS_ERROR_WEBRTC_STATE				471
 /*! \brief The server is currently configured not to accept new sessions */
 #define JANUS_ERROR_NOT_ACCEPTING_SESSIONS		472
+/*! \brief The server is being drained, and doesn't accept new sessions or handles */
+#define JANUS_ERROR_DRAINING					473
 
 
 /*! \brief Helper method to get a string representation of an API error code
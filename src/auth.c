@@ -19,7 +19,16 @@
  * However, if a secret is set, the Signed-token mode is used.
  * In this mode, no direct communication between the controlling
  * application and Janus is necessary. Instead, the application signs
- * tokens that Janus can verify using the secret key.
+ * tokens that Janus can verify using the secret key. As the same token
+ * is usually presented over and over (e.g., in each keepalive), tokens
+ * whose signature was verified are kept in a bounded LRU cache until
+ * they expire, so that we don't have to parse them and compute the
+ * HMAC again each time.
+ *
+ * Checking tokens is something we do for pretty much every request, while
+ * tokens (or the plugins they can access) are seldom changed, so stored
+ * tokens are protected by a read-write lock: requests never contend with
+ * each other, and only have to wait for the Admin API to update them.
  *
  * \ingroup core
  * \ref core
@@ -36,9 +45,26 @@
 /* Hash table to contain the tokens to match */
 static GHashTable *tokens = NULL, *allowed_plugins = NULL;
 static gboolean auth_enabled = FALSE;
-static janus_mutex mutex;
+static GRWLock tokens_lock;
 static char *auth_secret = NULL;
 
+/* Signed tokens we verified already, in a bounded LRU cache */
+#define JANUS_AUTH_SIGNED_CACHE_MAX	4096
+typedef struct janus_auth_signed_token {
+	/* The data part of the token (expiry, realm and descriptors) */
+	gchar **data;
+	gint64 expiry;
+	/* Monotonic time of the last check, updated with relaxed atomics */
+	gint64 used;
+} janus_auth_signed_token;
+static GHashTable *signed_tokens = NULL;
+static GRWLock signed_tokens_lock;
+
+static void janus_auth_signed_token_free(janus_auth_signed_token *st) {
+	g_strfreev(st->data);
+	g_free(st);
+}
+
 static void janus_auth_free_token(char *token) {
 	g_free(token);
 }
@@ -54,12 +80,15 @@ void janus_auth_init(gboolean enabled, const char *secret) {
 		} else {
 			JANUS_LOG(LOG_INFO, "Signed-Token based authentication enabled\n");
 			auth_secret = g_strdup(secret);
+			signed_tokens = g_hash_table_new_full(g_str_hash, g_str_equal,
+				(GDestroyNotify)g_free, (GDestroyNotify)janus_auth_signed_token_free);
 			auth_enabled = TRUE;
 		}
 	} else {
 		JANUS_LOG(LOG_INFO, "Token based authentication disabled\n");
 	}
-	janus_mutex_init(&mutex);
+	g_rw_lock_init(&tokens_lock);
+	g_rw_lock_init(&signed_tokens_lock);
 }
 
 gboolean janus_auth_is_enabled(void) {
@@ -75,7 +104,7 @@ gboolean janus_auth_is_signed_mode(void) {
 }
 
 void janus_auth_deinit(void) {
-	janus_mutex_lock(&mutex);
+	g_rw_lock_writer_lock(&tokens_lock);
 	if(tokens != NULL)
 		g_hash_table_destroy(tokens);
 	tokens = NULL;
@@ -84,52 +113,85 @@ void janus_auth_deinit(void) {
 	allowed_plugins = NULL;
 	g_free(auth_secret);
 	auth_secret = NULL;
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&tokens_lock);
+	g_rw_lock_writer_lock(&signed_tokens_lock);
+	if(signed_tokens != NULL)
+		g_hash_table_destroy(signed_tokens);
+	signed_tokens = NULL;
+	g_rw_lock_writer_unlock(&signed_tokens_lock);
 }
 
-gboolean janus_auth_check_signature(const char *token, const char *realm) {
-	if (!auth_enabled || auth_secret == NULL)
-		return FALSE;
-	gchar **parts = g_strsplit(token, ":", 2);
-	gchar **data = NULL;
-	/* Token should have exactly one data and one hash part */
-	if(!parts[0] || !parts[1] || parts[2])
-		goto fail;
-	data = g_strsplit(parts[0], ",", 3);
-	/* Need at least an expiry timestamp and realm */
-	if(!data[0] || !data[1])
-		goto fail;
+/* Check the expiry, realm and (optionally) descriptor of a signed token */
+static gboolean janus_auth_signed_token_matches(gchar **data, gint64 expiry, const char *realm, const char *desc) {
 	/* Verify timestamp */
-	gint64 expiry_time = strtoll(data[0], NULL, 10);
 	gint64 real_time = janus_get_real_time() / 1000000;
-	if(expiry_time < 0 || real_time > expiry_time)
-		goto fail;
+	if(expiry < 0 || real_time > expiry)
+		return FALSE;
 	/* Verify realm */
 	if(strcmp(data[1], realm))
-		goto fail;
-	/* Verify HMAC-SHA1 */
-	unsigned char signature[EVP_MAX_MD_SIZE] = "";
-	unsigned int len;
-	HMAC(EVP_sha1(), auth_secret, strlen(auth_secret), (const unsigned char*)parts[0], strlen(parts[0]), signature, &len);
-	gchar *base64 = g_base64_encode(signature, len);
-	gboolean result = janus_strcmp_const_time(parts[1], base64);
-	g_strfreev(data);
-	g_strfreev(parts);
-	g_free(base64);
-	return result;
-
-fail:
-	g_strfreev(data);
-	g_strfreev(parts);
+		return FALSE;
+	if(desc == NULL)
+		return TRUE;
+	/* Find descriptor */
+	int i = 2;
+	for(i = 2; data[i]; i++) {
+		if(!strcmp(desc, data[i]))
+			return TRUE;
+	}
 	return FALSE;
 }
 
-gboolean janus_auth_check_signature_contains(const char *token, const char *realm, const char *desc) {
-	if (!auth_enabled || auth_secret == NULL) {
-		return TRUE;
+static void janus_auth_signed_token_cache(const char *token, gchar **data, gint64 expiry) {
+	g_rw_lock_writer_lock(&signed_tokens_lock);
+	if(signed_tokens == NULL || g_hash_table_contains(signed_tokens, token)) {
+		g_rw_lock_writer_unlock(&signed_tokens_lock);
+		g_strfreev(data);
+		return;
 	}
+	if(g_hash_table_size(signed_tokens) >= JANUS_AUTH_SIGNED_CACHE_MAX) {
+		/* Get rid of expired tokens and, if that's not enough, of the least recently used one */
+		gint64 real_time = janus_get_real_time() / 1000000;
+		const char *lru = NULL;
+		gint64 lru_used = 0;
+		GHashTableIter iter;
+		gpointer key, value;
+		g_hash_table_iter_init(&iter, signed_tokens);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			janus_auth_signed_token *st = (janus_auth_signed_token *)value;
+			if(real_time > st->expiry) {
+				g_hash_table_iter_remove(&iter);
+				continue;
+			}
+			gint64 used = __atomic_load_n(&st->used, __ATOMIC_RELAXED);
+			if(lru == NULL || used < lru_used) {
+				lru = (const char *)key;
+				lru_used = used;
+			}
+		}
+		if(lru != NULL && g_hash_table_size(signed_tokens) >= JANUS_AUTH_SIGNED_CACHE_MAX)
+			g_hash_table_remove(signed_tokens, lru);
+	}
+	janus_auth_signed_token *st = g_malloc(sizeof(janus_auth_signed_token));
+	st->data = data;
+	st->expiry = expiry;
+	st->used = janus_get_monotonic_time();
+	g_hash_table_insert(signed_tokens, g_strdup(token), st);
+	g_rw_lock_writer_unlock(&signed_tokens_lock);
+}
+
+static gboolean janus_auth_check_signed_token(const char *token, const char *realm, const char *desc) {
 	if(token == NULL)
 		return FALSE;
+	/* Check if we verified this token already */
+	g_rw_lock_reader_lock(&signed_tokens_lock);
+	janus_auth_signed_token *st = signed_tokens ? g_hash_table_lookup(signed_tokens, token) : NULL;
+	if(st != NULL) {
+		__atomic_store_n(&st->used, janus_get_monotonic_time(), __ATOMIC_RELAXED);
+		gboolean result = janus_auth_signed_token_matches(st->data, st->expiry, realm, desc);
+		g_rw_lock_reader_unlock(&signed_tokens_lock);
+		return result;
+	}
+	g_rw_lock_reader_unlock(&signed_tokens_lock);
 	gchar **parts = g_strsplit(token, ":", 2);
 	gchar **data = NULL;
 	/* Token should have exactly one data and one hash part */
@@ -139,34 +201,22 @@ gboolean janus_auth_check_signature_contains(const char *token, const char *real
 	/* Need at least an expiry timestamp and realm */
 	if(!data[0] || !data[1])
 		goto fail;
-	/* Verify timestamp */
 	gint64 expiry_time = strtoll(data[0], NULL, 10);
-	gint64 real_time = janus_get_real_time() / 1000000;
-	if(expiry_time < 0 || real_time > expiry_time)
-		goto fail;
-	/* Verify realm */
-	if(strcmp(data[1], realm))
-		goto fail;
-	/* Find descriptor */
-	gboolean result = FALSE;
-	int i = 2;
-	for(i = 2; data[i]; i++) {
-		if (!strcmp(desc, data[i])) {
-			result = TRUE;
-			break;
-		}
-	}
-	if (!result)
+	if(!janus_auth_signed_token_matches(data, expiry_time, realm, desc))
 		goto fail;
 	/* Verify HMAC-SHA1 */
 	unsigned char signature[EVP_MAX_MD_SIZE] = "";
 	unsigned int len;
 	HMAC(EVP_sha1(), auth_secret, strlen(auth_secret), (const unsigned char*)parts[0], strlen(parts[0]), signature, &len);
 	gchar *base64 = g_base64_encode(signature, len);
-	result = janus_strcmp_const_time(parts[1], base64);
-	g_strfreev(data);
+	gboolean result = janus_strcmp_const_time(parts[1], base64);
 	g_strfreev(parts);
 	g_free(base64);
+	/* If the signature is valid, cache the token until it expires */
+	if(result)
+		janus_auth_signed_token_cache(token, data, expiry_time);
+	else
+		g_strfreev(data);
 	return result;
 
 fail:
@@ -175,6 +225,21 @@ fail:
 	return FALSE;
 }
 
+gboolean janus_auth_check_signature(const char *token, const char *realm) {
+	if (!auth_enabled || auth_secret == NULL)
+		return FALSE;
+	return janus_auth_check_signed_token(token, realm, NULL);
+}
+
+gboolean janus_auth_check_signature_contains(const char *token, const char *realm, const char *desc) {
+	if (!auth_enabled || auth_secret == NULL) {
+		return TRUE;
+	}
+	if(desc == NULL)
+		return FALSE;
+	return janus_auth_check_signed_token(token, realm, desc);
+}
+
 /* Tokens manipulation */
 gboolean janus_auth_add_token(const char *token) {
 	if(!auth_enabled || tokens == NULL) {
@@ -183,15 +248,15 @@ gboolean janus_auth_add_token(const char *token) {
 	}
 	if(token == NULL)
 		return FALSE;
-	janus_mutex_lock(&mutex);
+	g_rw_lock_writer_lock(&tokens_lock);
 	if(g_hash_table_lookup(tokens, token)) {
 		JANUS_LOG(LOG_VERB, "Token already validated\n");
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_writer_unlock(&tokens_lock);
 		return TRUE;
 	}
 	char *new_token = g_strdup(token);
 	g_hash_table_insert(tokens, new_token, new_token);
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&tokens_lock);
 	return TRUE;
 }
 
@@ -201,12 +266,12 @@ gboolean janus_auth_check_token(const char *token) {
 		return TRUE;
 	if (tokens == NULL)
 		return janus_auth_check_signature(token, "janus");
-	janus_mutex_lock(&mutex);
+	g_rw_lock_reader_lock(&tokens_lock);
 	if(token && g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_reader_unlock(&tokens_lock);
 		return TRUE;
 	}
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_reader_unlock(&tokens_lock);
 	return FALSE;
 }
 
@@ -214,7 +279,7 @@ GList *janus_auth_list_tokens(void) {
 	/* Always NULL if the mechanism is disabled, of course */
 	if(!auth_enabled || tokens == NULL)
 		return NULL;
-	janus_mutex_lock(&mutex);
+	g_rw_lock_reader_lock(&tokens_lock);
 	GList *list = NULL;
 	if(g_hash_table_size(tokens) > 0) {
 		GHashTableIter iter;
@@ -225,7 +290,7 @@ GList *janus_auth_list_tokens(void) {
 			list = g_list_append(list, g_strdup(token));
 		}
 	}
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_reader_unlock(&tokens_lock);
 	return list;
 }
 
@@ -234,7 +299,7 @@ gboolean janus_auth_remove_token(const char *token) {
 		JANUS_LOG(LOG_ERR, "Can't remove token, stored-authentication mechanism is disabled\n");
 		return FALSE;
 	}
-	janus_mutex_lock(&mutex);
+	g_rw_lock_writer_lock(&tokens_lock);
 	gboolean ok = token && g_hash_table_remove(tokens, token);
 	/* Also clear the allowed plugins mapping */
 	GList *list = g_hash_table_lookup(allowed_plugins, token);
@@ -242,7 +307,7 @@ gboolean janus_auth_remove_token(const char *token) {
 	if(list != NULL)
 		g_list_free(list);
 	/* Done */
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&tokens_lock);
 	return ok;
 }
 
@@ -254,9 +319,9 @@ gboolean janus_auth_allow_plugin(const char *token, janus_plugin *plugin) {
 	}
 	if(token == NULL || plugin == NULL)
 		return FALSE;
-	janus_mutex_lock(&mutex);
+	g_rw_lock_writer_lock(&tokens_lock);
 	if(!g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_writer_unlock(&tokens_lock);
 		return FALSE;
 	}
 	GList *list = g_hash_table_lookup(allowed_plugins, token);
@@ -265,19 +330,19 @@ gboolean janus_auth_allow_plugin(const char *token, janus_plugin *plugin) {
 		list = g_list_append(list, plugin);
 		char *new_token = g_strdup(token);
 		g_hash_table_insert(allowed_plugins, new_token, list);
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_writer_unlock(&tokens_lock);
 		return TRUE;
 	}
 	/* We already have a list, update it if needed */
 	if(g_list_find(list, plugin) != NULL) {
 		JANUS_LOG(LOG_VERB, "Plugin access already allowed for token\n");
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_writer_unlock(&tokens_lock);
 		return TRUE;
 	}
 	list = g_list_append(list, plugin);
 	char *new_token = g_strdup(token);
 	g_hash_table_insert(allowed_plugins, new_token, list);
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&tokens_lock);
 	return TRUE;
 }
 
@@ -287,17 +352,17 @@ gboolean janus_auth_check_plugin(const char *token, janus_plugin *plugin) {
 		return TRUE;
 	if (allowed_plugins == NULL)
 		return janus_auth_check_signature_contains(token, "janus", plugin->get_package());
-	janus_mutex_lock(&mutex);
+	g_rw_lock_reader_lock(&tokens_lock);
 	if(!g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_reader_unlock(&tokens_lock);
 		return FALSE;
 	}
 	GList *list = g_hash_table_lookup(allowed_plugins, token);
 	if(g_list_find(list, plugin) == NULL) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_reader_unlock(&tokens_lock);
 		return FALSE;
 	}
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_reader_unlock(&tokens_lock);
 	return TRUE;
 }
 
@@ -305,16 +370,16 @@ GList *janus_auth_list_plugins(const char *token) {
 	/* Always NULL if the mechanism is disabled, of course */
 	if(!auth_enabled || allowed_plugins == NULL)
 		return NULL;
-	janus_mutex_lock(&mutex);
+	g_rw_lock_reader_lock(&tokens_lock);
 	if(!g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_reader_unlock(&tokens_lock);
 		return FALSE;
 	}
 	GList *list = NULL;
 	GList *plugins_list = g_hash_table_lookup(allowed_plugins, token);
 	if(plugins_list != NULL)
 		list = g_list_copy(plugins_list);
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_reader_unlock(&tokens_lock);
 	return list;
 }
 
@@ -323,9 +388,9 @@ gboolean janus_auth_disallow_plugin(const char *token, janus_plugin *plugin) {
 		JANUS_LOG(LOG_ERR, "Can't disallow access to plugin, authentication mechanism is disabled\n");
 		return FALSE;
 	}
-	janus_mutex_lock(&mutex);
+	g_rw_lock_writer_lock(&tokens_lock);
 	if(!g_hash_table_lookup(tokens, token)) {
-		janus_mutex_unlock(&mutex);
+		g_rw_lock_writer_unlock(&tokens_lock);
 		return FALSE;
 	}
 	GList *list = g_hash_table_lookup(allowed_plugins, token);
@@ -335,6 +400,6 @@ gboolean janus_auth_disallow_plugin(const char *token, janus_plugin *plugin) {
 		char *new_token = g_strdup(token);
 		g_hash_table_insert(allowed_plugins, new_token, list);
 	}
-	janus_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&tokens_lock);
 	return TRUE;
 }
@@ -0,0 +1,264 @@
+/*! \file    bwe.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation
+ * \details  Implementation of a send-side bandwidth estimator, based on
+ * the transport-wide CC feedback peers send us for the packets we send
+ * them. Check the bwe.h header for more details.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#include <math.h>
+
+#include "bwe.h"
+#include "debug.h"
+
+/* Boundaries and starting point of the estimate */
+#define JANUS_BWE_START_BITRATE		500000
+#define JANUS_BWE_MIN_BITRATE		30000
+#define JANUS_BWE_MAX_BITRATE		20000000
+/* We don't probe, so we allow the estimate to grow this much above what we send */
+#define JANUS_BWE_HEADROOM			500000
+/* Packets sent within this interval (us) are considered a single group */
+#define JANUS_BWE_GROUP_INTERVAL	5000
+/* Trendline filter settings */
+#define JANUS_BWE_SMOOTHING			0.9
+#define JANUS_BWE_THRESHOLD_GAIN	4.0
+#define JANUS_BWE_THRESHOLD_INIT	12.5
+#define JANUS_BWE_THRESHOLD_MIN		6.0
+#define JANUS_BWE_THRESHOLD_MAX		600.0
+#define JANUS_BWE_OVERUSE_TIME		10.0
+/* Rate control settings */
+#define JANUS_BWE_DECREASE_FACTOR	0.85
+#define JANUS_BWE_INCREASE_FACTOR	0.08
+#define JANUS_BWE_DECREASE_INTERVAL	(200*G_TIME_SPAN_MILLISECOND)
+#define JANUS_BWE_ACKED_INTERVAL	(500*G_TIME_SPAN_MILLISECOND)
+/* Loss-based controller settings */
+#define JANUS_BWE_LOSS_MIN_PACKETS	20
+#define JANUS_BWE_LOSS_HIGH			0.10
+#define JANUS_BWE_LOSS_LOW			0.02
+/* Notification settings */
+#define JANUS_BWE_NOTIFY_CHANGE		0.05
+#define JANUS_BWE_NOTIFY_INTERVAL	(200*G_TIME_SPAN_MILLISECOND)
+
+static const char *janus_bwe_usage_str(janus_bwe_usage usage) {
+	switch(usage) {
+		case janus_bwe_usage_normal:
+			return "normal";
+		case janus_bwe_usage_overuse:
+			return "overuse";
+		case janus_bwe_usage_underuse:
+			return "underuse";
+		default:
+			break;
+	}
+	return NULL;
+}
+
+janus_bwe_context *janus_bwe_context_create(void) {
+	janus_bwe_context *bwe = g_malloc0(sizeof(janus_bwe_context));
+	bwe->threshold = JANUS_BWE_THRESHOLD_INIT;
+	bwe->delay_estimate = JANUS_BWE_START_BITRATE;
+	bwe->loss_estimate = JANUS_BWE_MAX_BITRATE;
+	bwe->estimate = JANUS_BWE_START_BITRATE;
+	return bwe;
+}
+
+void janus_bwe_context_destroy(janus_bwe_context *bwe) {
+	g_free(bwe);
+}
+
+void janus_bwe_context_packet_sent(janus_bwe_context *bwe, guint16 seq, guint16 size, gint64 now) {
+	if(bwe == NULL)
+		return;
+	janus_bwe_sent_packet *p = &bwe->packets[seq & (JANUS_BWE_WINDOW-1)];
+	p->seq = seq;
+	p->size = size;
+	p->sent = now;
+}
+
+/* Feed the trendline filter with the delay variation of a new group */
+static void janus_bwe_trendline_update(janus_bwe_context *bwe, double gradient, double arrival) {
+	bwe->accumulated_delay += gradient;
+	bwe->smoothed_delay = JANUS_BWE_SMOOTHING * bwe->smoothed_delay +
+		(1.0 - JANUS_BWE_SMOOTHING) * bwe->accumulated_delay;
+	if(bwe->samples_total == 0)
+		bwe->first_arrival = arrival;
+	bwe->samples_x[bwe->samples_next] = arrival - bwe->first_arrival;
+	bwe->samples_y[bwe->samples_next] = bwe->smoothed_delay;
+	bwe->samples_next = (bwe->samples_next + 1) % JANUS_BWE_TRENDLINE_SAMPLES;
+	if(bwe->samples_count < JANUS_BWE_TRENDLINE_SAMPLES)
+		bwe->samples_count++;
+	bwe->samples_total++;
+	if(bwe->samples_count < JANUS_BWE_TRENDLINE_SAMPLES)
+		return;
+	/* Compute the slope of the delay with a linear regression */
+	double xavg = 0, yavg = 0, num = 0, den = 0;
+	guint i = 0;
+	for(i=0; i<bwe->samples_count; i++) {
+		xavg += bwe->samples_x[i];
+		yavg += bwe->samples_y[i];
+	}
+	xavg /= bwe->samples_count;
+	yavg /= bwe->samples_count;
+	for(i=0; i<bwe->samples_count; i++) {
+		num += (bwe->samples_x[i] - xavg) * (bwe->samples_y[i] - yavg);
+		den += (bwe->samples_x[i] - xavg) * (bwe->samples_x[i] - xavg);
+	}
+	double slope = den != 0 ? num/den : 0;
+	double prev_trend = bwe->trend;
+	bwe->trend = slope * MIN(bwe->samples_total, 60) * JANUS_BWE_THRESHOLD_GAIN;
+	/* Detect the network usage */
+	if(bwe->trend > bwe->threshold) {
+		if(bwe->overuse_since == 0)
+			bwe->overuse_since = arrival;
+		if(arrival - bwe->overuse_since >= JANUS_BWE_OVERUSE_TIME && bwe->trend >= prev_trend)
+			bwe->usage = janus_bwe_usage_overuse;
+	} else {
+		bwe->overuse_since = 0;
+		bwe->usage = (bwe->trend < -bwe->threshold) ? janus_bwe_usage_underuse : janus_bwe_usage_normal;
+	}
+	/* Adapt the threshold, so that we're not too sensitive, nor starved by concurrent TCP flows */
+	double modified = fabs(bwe->trend);
+	if(bwe->threshold_updated == 0)
+		bwe->threshold_updated = arrival;
+	if(modified - bwe->threshold <= 15.0) {
+		double k = modified < bwe->threshold ? 0.039 : 0.0087;
+		double elapsed = MIN(arrival - bwe->threshold_updated, 100.0);
+		bwe->threshold += k * (modified - bwe->threshold) * elapsed;
+		if(bwe->threshold < JANUS_BWE_THRESHOLD_MIN)
+			bwe->threshold = JANUS_BWE_THRESHOLD_MIN;
+		else if(bwe->threshold > JANUS_BWE_THRESHOLD_MAX)
+			bwe->threshold = JANUS_BWE_THRESHOLD_MAX;
+	}
+	bwe->threshold_updated = arrival;
+}
+
+void janus_bwe_context_packet_feedback(janus_bwe_context *bwe, guint16 seq, gint64 arrival) {
+	if(bwe == NULL)
+		return;
+	janus_bwe_sent_packet *p = &bwe->packets[seq & (JANUS_BWE_WINDOW-1)];
+	if(p->sent == 0 || p->seq != seq) {
+		/* We don't know about this packet (any more) */
+		return;
+	}
+	if(arrival < 0) {
+		bwe->lost++;
+		return;
+	}
+	bwe->received++;
+	bwe->acked_bytes += p->size;
+	gint64 sent = p->sent;
+	p->sent = 0;
+	if(!bwe->group_started) {
+		bwe->group_started = TRUE;
+		bwe->group_first_sent = sent;
+		bwe->group_last_sent = sent;
+		bwe->group_last_arrival = arrival;
+		return;
+	}
+	if(sent - bwe->group_first_sent <= JANUS_BWE_GROUP_INTERVAL) {
+		/* Same group */
+		if(sent > bwe->group_last_sent)
+			bwe->group_last_sent = sent;
+		if(arrival > bwe->group_last_arrival)
+			bwe->group_last_arrival = arrival;
+		return;
+	}
+	if(sent < bwe->group_first_sent) {
+		/* Reordered packet from an older group, ignore */
+		return;
+	}
+	/* The group is complete: compare it to the previous one */
+	if(bwe->have_prev) {
+		gint64 send_delta = bwe->group_last_sent - bwe->prev_sent;
+		gint64 arrival_delta = bwe->group_last_arrival - bwe->prev_arrival;
+		janus_bwe_trendline_update(bwe, (double)(arrival_delta - send_delta)/1000.0,
+			(double)bwe->group_last_arrival/1000.0);
+	}
+	bwe->prev_sent = bwe->group_last_sent;
+	bwe->prev_arrival = bwe->group_last_arrival;
+	bwe->have_prev = TRUE;
+	/* Start a new group with this packet */
+	bwe->group_first_sent = sent;
+	bwe->group_last_sent = sent;
+	bwe->group_last_arrival = arrival;
+}
+
+gboolean janus_bwe_context_update(janus_bwe_context *bwe, gint64 now) {
+	if(bwe == NULL)
+		return FALSE;
+	if(bwe->last_update == 0)
+		bwe->last_update = now;
+	if(bwe->acked_start == 0)
+		bwe->acked_start = now;
+	/* Update the bitrate that was acknowledged */
+	if(now - bwe->acked_start >= JANUS_BWE_ACKED_INTERVAL) {
+		guint32 rate = (guint32)(bwe->acked_bytes * 8 * G_USEC_PER_SEC / (now - bwe->acked_start));
+		bwe->acked_bitrate = bwe->acked_bitrate ? (guint32)(0.7*bwe->acked_bitrate + 0.3*rate) : rate;
+		bwe->acked_bytes = 0;
+		bwe->acked_start = now;
+	}
+	/* Delay-based controller */
+	double elapsed = (double)(now - bwe->last_update) / G_USEC_PER_SEC;
+	if(bwe->usage == janus_bwe_usage_overuse) {
+		if(now - bwe->last_decrease >= JANUS_BWE_DECREASE_INTERVAL) {
+			guint32 base = bwe->acked_bitrate ? MIN(bwe->acked_bitrate, bwe->delay_estimate) : bwe->delay_estimate;
+			bwe->delay_estimate = (guint32)(JANUS_BWE_DECREASE_FACTOR * base);
+			bwe->last_decrease = now;
+		}
+	} else if(bwe->usage == janus_bwe_usage_normal && elapsed > 0) {
+		double increased = bwe->delay_estimate * (1.0 + JANUS_BWE_INCREASE_FACTOR * MIN(elapsed, 1.0));
+		if(bwe->acked_bitrate > 0 && increased > 1.5*bwe->acked_bitrate + JANUS_BWE_HEADROOM)
+			increased = MAX(bwe->delay_estimate, 1.5*bwe->acked_bitrate + JANUS_BWE_HEADROOM);
+		bwe->delay_estimate = (guint32)MIN(increased, JANUS_BWE_MAX_BITRATE);
+	}
+	/* Underuse means queues are draining: we hold the estimate */
+	if(bwe->delay_estimate < JANUS_BWE_MIN_BITRATE)
+		bwe->delay_estimate = JANUS_BWE_MIN_BITRATE;
+	/* Loss-based controller */
+	guint total = bwe->received + bwe->lost;
+	if(total >= JANUS_BWE_LOSS_MIN_PACKETS) {
+		double loss = (double)bwe->lost / total;
+		bwe->loss_ratio = 0.8*bwe->loss_ratio + 0.2*loss;
+		if(loss > JANUS_BWE_LOSS_HIGH) {
+			bwe->loss_estimate = (guint32)(bwe->estimate * (1.0 - 0.5*loss));
+		} else if(loss < JANUS_BWE_LOSS_LOW) {
+			bwe->loss_estimate = (guint32)MIN((double)bwe->loss_estimate * 1.05, JANUS_BWE_MAX_BITRATE);
+		}
+		if(bwe->loss_estimate < JANUS_BWE_MIN_BITRATE)
+			bwe->loss_estimate = JANUS_BWE_MIN_BITRATE;
+		bwe->received = 0;
+		bwe->lost = 0;
+	}
+	bwe->estimate = MIN(bwe->delay_estimate, bwe->loss_estimate);
+	bwe->last_update = now;
+	/* Check if this is worth a notification */
+	if(bwe->notified > 0) {
+		double change = fabs((double)bwe->estimate - bwe->notified) / bwe->notified;
+		if(change < JANUS_BWE_NOTIFY_CHANGE || now - bwe->last_notified < JANUS_BWE_NOTIFY_INTERVAL)
+			return FALSE;
+	}
+	JANUS_LOG(LOG_HUGE, "[BWE] Estimate: %"SCNu32" (delay=%"SCNu32", loss=%"SCNu32", acked=%"SCNu32", %s)\n",
+		bwe->estimate, bwe->delay_estimate, bwe->loss_estimate, bwe->acked_bitrate, janus_bwe_usage_str(bwe->usage));
+	bwe->notified = bwe->estimate;
+	bwe->last_notified = now;
+	return TRUE;
+}
+
+json_t *janus_bwe_context_summary(janus_bwe_context *bwe) {
+	if(bwe == NULL)
+		return NULL;
+	json_t *info = json_object();
+	json_object_set_new(info, "estimate", json_integer(bwe->estimate));
+	json_object_set_new(info, "delay-estimate", json_integer(bwe->delay_estimate));
+	json_object_set_new(info, "loss-estimate", json_integer(bwe->loss_estimate));
+	json_object_set_new(info, "acked-bitrate", json_integer(bwe->acked_bitrate));
+	json_object_set_new(info, "usage", json_string(janus_bwe_usage_str(bwe->usage)));
+	json_object_set_new(info, "trend", json_real(bwe->trend));
+	json_object_set_new(info, "threshold", json_real(bwe->threshold));
+	json_object_set_new(info, "loss-ratio", json_real(bwe->loss_ratio));
+	return info;
+}
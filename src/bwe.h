@@ -0,0 +1,125 @@
+/*! \file    bwe.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Send-side bandwidth estimation (headers)
+ * \details  Implementation of a send-side bandwidth estimator, based on
+ * the transport-wide CC feedback peers send us for the packets we send
+ * them. The estimator is loosely modelled after Google Congestion Control:
+ * a delay-based controller looks at how the one-way delay variation of
+ * groups of packets evolves over time (using a trendline filter), in
+ * order to detect when queues start building up on the path, and adapts
+ * the estimate using an AIMD approach; a loss-based controller lowers
+ * the estimate when too many packets are reported as lost. The estimate
+ * is the minimum of the two.
+ *
+ * \note Janus doesn't probe for bandwidth (e.g., via padding), which
+ * means that when it's not sending much, the estimate can only grow up
+ * to some headroom above what's actually being sent.
+ *
+ * \ingroup protocols
+ * \ref protocols
+ */
+
+#ifndef JANUS_BWE_H
+#define JANUS_BWE_H
+
+#include <glib.h>
+#include <jansson.h>
+
+/*! \brief Number of sent packets we keep track of (a power of two) */
+#define JANUS_BWE_WINDOW		4096
+/*! \brief Number of samples the trendline filter uses */
+#define JANUS_BWE_TRENDLINE_SAMPLES	20
+
+/*! \brief Packet we sent, and that we're waiting feedback for */
+typedef struct janus_bwe_sent_packet {
+	/*! \brief When the packet was sent (0 if the slot is empty) */
+	gint64 sent;
+	/*! \brief Transport-wide sequence number of the packet */
+	guint16 seq;
+	/*! \brief Size of the packet */
+	guint16 size;
+} janus_bwe_sent_packet;
+
+/*! \brief Network usage, as detected by the delay-based controller */
+typedef enum janus_bwe_usage {
+	janus_bwe_usage_normal = 0,
+	janus_bwe_usage_overuse,
+	janus_bwe_usage_underuse
+} janus_bwe_usage;
+
+/*! \brief Send-side bandwidth estimation context */
+typedef struct janus_bwe_context {
+	/*! \brief Packets we sent, indexed by transport-wide sequence number */
+	janus_bwe_sent_packet packets[JANUS_BWE_WINDOW];
+	/*! \brief Send and arrival times of the packet group we're building, and of the previous one */
+	gint64 group_first_sent, group_last_sent, group_last_arrival;
+	gint64 prev_sent, prev_arrival;
+	/*! \brief Whether we have a group in progress, and a previous group to compare it to */
+	gboolean group_started, have_prev;
+	/*! \brief Accumulated and smoothed delay variation (in ms) */
+	double accumulated_delay, smoothed_delay;
+	/*! \brief Arrival time of the first group (in ms), as a base for the trendline samples */
+	double first_arrival;
+	/*! \brief Trendline samples (arrival time and smoothed delay, in ms) */
+	double samples_x[JANUS_BWE_TRENDLINE_SAMPLES], samples_y[JANUS_BWE_TRENDLINE_SAMPLES];
+	/*! \brief Number of samples in the filter, index of the next one, and total number of samples */
+	guint samples_count, samples_next, samples_total;
+	/*! \brief Latest (modified) trend, and adaptive threshold it's compared to */
+	double trend, threshold;
+	/*! \brief When the threshold was last updated, and since when we see an overuse (arrival times, in ms) */
+	double threshold_updated, overuse_since;
+	/*! \brief Current network usage */
+	janus_bwe_usage usage;
+	/*! \brief Packets reported as received and lost since the last loss-based update */
+	guint received, lost;
+	/*! \brief Smoothed ratio of lost packets */
+	double loss_ratio;
+	/*! \brief Bytes acknowledged since acked_start, and resulting bitrate */
+	guint64 acked_bytes;
+	gint64 acked_start;
+	guint32 acked_bitrate;
+	/*! \brief Delay-based and loss-based estimates, and the resulting one */
+	guint32 delay_estimate, loss_estimate, estimate;
+	/*! \brief When the estimate was last updated, and last decreased */
+	gint64 last_update, last_decrease;
+	/*! \brief Last estimate we notified, and when */
+	guint32 notified;
+	gint64 last_notified;
+} janus_bwe_context;
+
+/*! \brief Create a new bandwidth estimation context
+ * @returns A new janus_bwe_context instance */
+janus_bwe_context *janus_bwe_context_create(void);
+
+/*! \brief Destroy a bandwidth estimation context
+ * @param[in] bwe The janus_bwe_context instance to destroy */
+void janus_bwe_context_destroy(janus_bwe_context *bwe);
+
+/*! \brief Take note of a packet we sent, that we'll get feedback for later
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] seq The transport-wide sequence number of the packet
+ * @param[in] size The size of the packet
+ * @param[in] now The monotonic time the packet was sent at */
+void janus_bwe_context_packet_sent(janus_bwe_context *bwe, guint16 seq, guint16 size, gint64 now);
+
+/*! \brief Process the feedback for a packet, as reported in a transport-wide CC message
+ * \note Feedback must be provided in sequence number order, as it appears
+ * in the feedback messages: call janus_bwe_context_update when done with a message
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] seq The transport-wide sequence number of the packet
+ * @param[in] arrival The arrival time of the packet (in us, on the peer's clock), or a negative value if lost */
+void janus_bwe_context_packet_feedback(janus_bwe_context *bwe, guint16 seq, gint64 arrival);
+
+/*! \brief Update the estimate after a transport-wide CC feedback message has been processed
+ * @param[in] bwe The janus_bwe_context instance to update
+ * @param[in] now The current monotonic time
+ * @returns TRUE if the estimate changed enough that it should be notified, FALSE otherwise */
+gboolean janus_bwe_context_update(janus_bwe_context *bwe, gint64 now);
+
+/*! \brief Get a summary of the state of a bandwidth estimation context
+ * @param[in] bwe The janus_bwe_context instance to query
+ * @returns A JSON object with the summary */
+json_t *janus_bwe_context_summary(janus_bwe_context *bwe);
+
+#endif
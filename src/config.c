@@ -14,6 +14,8 @@
 #include <ctype.h>
 #include <errno.h>
 #include <libgen.h>
+#include <dirent.h>
+#include <unistd.h>
 
 #include <libconfig.h>
 
@@ -361,27 +363,62 @@ void janus_config_container_destroy(janus_config_container *container) {
 			g_free((gpointer)container->name);
 		if(container->value)
 			g_free((gpointer)container->value);
+		if(container->index)
+			g_hash_table_destroy(container->index);
 		if(container->list)
 			g_list_free_full(container->list, (GDestroyNotify)janus_config_container_destroy);
 		g_free(container);
 	}
 }
 
+/* Each container (and the root) indexes its children by name, which are
+ * case insensitive, so that we don't need to walk the list on lookups: as
+ * adding an element replaces any existing one with the same name, names
+ * are unique, and the index maps each name to the list link it's in */
+static guint janus_config_name_hash(gconstpointer v) {
+	const signed char *p = v;
+	guint32 h = 5381;
+	for(; *p != '\0'; p++)
+		h = (h << 5) + h + g_ascii_tolower(*p);
+	return h;
+}
+
+static gboolean janus_config_name_equal(gconstpointer v1, gconstpointer v2) {
+	return !g_ascii_strcasecmp((const char *)v1, (const char *)v2);
+}
+
+/* Get the list, last link and index involved, creating the index if needed */
+static GHashTable *janus_config_children(janus_config *config, janus_config_container *parent,
+		GList ***list, GList ***last) {
+	GHashTable **index = parent ? &parent->index : &config->index;
+	*list = parent ? &parent->list : &config->list;
+	*last = parent ? &parent->last : &config->last;
+	if(*index == NULL) {
+		*index = g_hash_table_new(janus_config_name_hash, janus_config_name_equal);
+		GList *l = **list;
+		while(l) {
+			janus_config_container *c = (janus_config_container *)l->data;
+			if(c && c->name && !g_hash_table_contains(*index, c->name))
+				g_hash_table_insert(*index, (gpointer)c->name, l);
+			**last = l;
+			l = l->next;
+		}
+	}
+	return *index;
+}
+
 static janus_config_container *janus_config_get_internal(janus_config *config,
 		janus_config_container *parent, janus_config_type type, const char *name, gboolean create) {
 	if(config == NULL || name == NULL)
 		return NULL;
 	if(parent != NULL && parent->type != janus_config_type_category && parent->type != janus_config_type_array)
 		return NULL;
-	janus_config_container *c = NULL;
-	GList *l = parent ? parent->list : config->list;
-	while(l) {
-		c = (janus_config_container *)l->data;
-		if(c && c->name && !strcasecmp(name, c->name) &&
-				(type == janus_config_type_any || c->type == type))
-			return c;
-		l = l->next;
-	}
+	GList **list = NULL, **last = NULL;
+	GHashTable *index = janus_config_children(config, parent, &list, &last);
+	GList *l = g_hash_table_lookup(index, name);
+	janus_config_container *c = l ? (janus_config_container *)l->data : NULL;
+	if(c && (type == janus_config_type_any || c->type == type))
+		return c;
 	/* If we got here, it doesn't exist, should we create it? */
 	c = NULL;
 	if(create) {
@@ -453,13 +490,18 @@ int janus_config_add(janus_config *config, janus_config_container *container, ja
 		/* Remove any existing property with the same name in that container first, if any */
 		janus_config_remove(config, container, item->name);
 	}
-	if(container) {
-		/* Add to parent */
-		container->list = g_list_append(container->list, item);
+	/* Add to parent (or root), starting from the last link to avoid walking the list */
+	GList **list = NULL, **last = NULL;
+	GHashTable *index = janus_config_children(config, container, &list, &last);
+	if(*list == NULL) {
+		*list = g_list_append(NULL, item);
+		*last = *list;
 	} else {
-		/* Add to root */
-		config->list = g_list_append(config->list, item);
+		/* Appending to the last link returns it, and the new one is next */
+		*last = g_list_append(*last, item)->next;
 	}
+	if(item->name)
+		g_hash_table_insert(index, (gpointer)item->name, *last);
 	return 0;
 }
 
@@ -468,16 +510,17 @@ int janus_config_remove(janus_config *config, janus_config_container *container,
 		return -1;
 	if(container != NULL && container->type != janus_config_type_category && container->type != janus_config_type_array)
 		return -2;
-	janus_config_container *item = janus_config_get(config, container, janus_config_type_any, name);
-	if(item == NULL)
+	GList **list = NULL, **last = NULL;
+	GHashTable *index = janus_config_children(config, container, &list, &last);
+	GList *l = g_hash_table_lookup(index, name);
+	if(l == NULL)
 		return -3;
-	if(container) {
-		/* Remove from parent */
-		container->list = g_list_remove(container->list, item);
-	} else {
-		/* Remove from root */
-		config->list = g_list_remove(config->list, item);
-	}
+	janus_config_container *item = (janus_config_container *)l->data;
+	/* Remove from parent (or root) */
+	g_hash_table_remove(index, item->name);
+	if(*last == l)
+		*last = l->prev;
+	*list = g_list_delete_link(*list, l);
 	janus_config_container_destroy(item);
 	return 0;
 }
@@ -490,10 +533,10 @@ GList *janus_config_get_items(janus_config *config, janus_config_container *pare
 	while(clist) {
 		janus_config_container *c = (janus_config_container *)clist->data;
 		if(c && c->type == janus_config_type_item)
-			list = g_list_append(list, c);
+			list = g_list_prepend(list, c);
 		clist = clist->next;
 	}
-	return list;
+	return g_list_reverse(list);
 }
 
 GList *janus_config_get_categories(janus_config *config, janus_config_container *parent) {
@@ -504,10 +547,10 @@ GList *janus_config_get_categories(janus_config *config, janus_config_container
 	while(clist) {
 		janus_config_container *c = (janus_config_container *)clist->data;
 		if(c && c->type == janus_config_type_category)
-			list = g_list_append(list, c);
+			list = g_list_prepend(list, c);
 		clist = clist->next;
 	}
-	return list;
+	return g_list_reverse(list);
 }
 
 GList *janus_config_get_arrays(janus_config *config, janus_config_container *parent) {
@@ -518,10 +561,10 @@ GList *janus_config_get_arrays(janus_config *config, janus_config_container *par
 	while(clist) {
 		janus_config_container *c = (janus_config_container *)clist->data;
 		if(c && c->type == janus_config_type_array)
-			list = g_list_append(list, c);
+			list = g_list_prepend(list, c);
 		clist = clist->next;
 	}
-	return list;
+	return g_list_reverse(list);
 }
 
 
@@ -700,6 +743,10 @@ gboolean janus_config_save(janus_config *config, const char *folder, const char
 void janus_config_destroy(janus_config *config) {
 	if(config == NULL)
 		return;
+	if(config->index) {
+		g_hash_table_destroy(config->index);
+		config->index = NULL;
+	}
 	if(config->list) {
 		g_list_free_full(config->list, (GDestroyNotify)janus_config_container_destroy);
 		config->list = NULL;
@@ -708,3 +755,134 @@ void janus_config_destroy(janus_config *config) {
 	g_free((gpointer)config);
 	config = NULL;
 }
+
+
+/* Folders of configuration files, one per category */
+static gboolean janus_config_folder_valid_name(const char *name) {
+	/* Names end up in file names, so we only accept what libconfig would
+	 * accept as a group name anyway, which means no path separators */
+	if(name == NULL || *name == '\0' || !isalpha(*name))
+		return FALSE;
+	const char *c = name;
+	while(*c != '\0') {
+		if(!isalnum(*c) && *c != '-' && *c != '_')
+			return FALSE;
+		c++;
+	}
+	return TRUE;
+}
+
+janus_config_folder *janus_config_folder_open(const char *path) {
+	if(path == NULL)
+		return NULL;
+	if(janus_mkdir(path, 0755) < 0) {
+		JANUS_LOG(LOG_ERR, "Couldn't create configuration folder '%s'...\n", path);
+		return NULL;
+	}
+	DIR *dir = opendir(path);
+	if(dir == NULL) {
+		JANUS_LOG(LOG_ERR, "Couldn't open configuration folder '%s': %s\n", path, g_strerror(errno));
+		return NULL;
+	}
+	janus_config_folder *folder = g_malloc0(sizeof(janus_config_folder));
+	folder->path = g_strdup(path);
+	folder->names = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+	struct dirent *entry = NULL;
+	while((entry = readdir(dir))) {
+		size_t len = strlen(entry->d_name);
+		if(len <= 5 || strcmp(entry->d_name + len - 5, ".jcfg"))
+			continue;
+		char *name = g_strndup(entry->d_name, len - 5);
+		if(!janus_config_folder_valid_name(name)) {
+			g_free(name);
+			continue;
+		}
+		g_hash_table_add(folder->names, name);
+	}
+	closedir(dir);
+	JANUS_LOG(LOG_VERB, "Indexed %u configuration files in '%s'\n", g_hash_table_size(folder->names), path);
+	return folder;
+}
+
+gboolean janus_config_folder_contains(janus_config_folder *folder, const char *name) {
+	if(folder == NULL || name == NULL)
+		return FALSE;
+	return g_hash_table_contains(folder->names, name);
+}
+
+GList *janus_config_folder_get_names(janus_config_folder *folder) {
+	if(folder == NULL)
+		return NULL;
+	return g_hash_table_get_keys(folder->names);
+}
+
+janus_config *janus_config_folder_load(janus_config_folder *folder, const char *name) {
+	if(!janus_config_folder_contains(folder, name))
+		return NULL;
+	char path[1024];
+	g_snprintf(path, sizeof(path), "%s/%s.jcfg", folder->path, name);
+	janus_config *config = janus_config_parse(path);
+	if(config == NULL || janus_config_get(config, NULL, janus_config_type_category, name) == NULL) {
+		JANUS_LOG(LOG_ERR, "Configuration file '%s' doesn't contain category '%s'...\n", path, name);
+		janus_config_destroy(config);
+		return NULL;
+	}
+	return config;
+}
+
+int janus_config_folder_save(janus_config_folder *folder, janus_config *config, janus_config_category *category) {
+	if(folder == NULL || config == NULL || category == NULL || category->type != janus_config_type_category)
+		return -1;
+	if(!janus_config_folder_valid_name(category->name)) {
+		JANUS_LOG(LOG_ERR, "Can't save category '%s' to a file of its own, invalid name\n", category->name);
+		return -1;
+	}
+	/* Save a configuration that only links the category to a temporary file */
+	janus_config single = { 0 };
+	single.is_jcfg = TRUE;
+	single.name = category->name;
+	single.list = g_list_append(NULL, category);
+	char tmpname[512], tmppath[1024], path[1024];
+	g_snprintf(tmpname, sizeof(tmpname), "%s.tmp", category->name);
+	int res = janus_config_save(&single, folder->path, tmpname);
+	g_list_free(single.list);
+	if(res < 0)
+		return res;
+	/* Now replace the existing file, if any */
+	g_snprintf(tmppath, sizeof(tmppath), "%s/%s.jcfg", folder->path, tmpname);
+	g_snprintf(path, sizeof(path), "%s/%s.jcfg", folder->path, category->name);
+	if(rename(tmppath, path) < 0) {
+		JANUS_LOG(LOG_ERR, "Couldn't save configuration file '%s': %s\n", path, g_strerror(errno));
+		unlink(tmppath);
+		return -4;
+	}
+	g_hash_table_add(folder->names, g_strdup(category->name));
+	return 0;
+}
+
+int janus_config_folder_remove(janus_config_folder *folder, const char *name) {
+	if(folder == NULL || !janus_config_folder_valid_name(name))
+		return -1;
+	g_hash_table_remove(folder->names, name);
+	char path[1024];
+	g_snprintf(path, sizeof(path), "%s/%s.jcfg", folder->path, name);
+	if(unlink(path) < 0 && errno != ENOENT) {
+		JANUS_LOG(LOG_ERR, "Couldn't remove configuration file '%s': %s\n", path, g_strerror(errno));
+		return -2;
+	}
+	return 0;
+}
+
+void janus_config_folder_forget(janus_config_folder *folder, const char *name) {
+	if(folder == NULL || name == NULL)
+		return;
+	g_hash_table_remove(folder->names, name);
+}
+
+void janus_config_folder_destroy(janus_config_folder *folder) {
+	if(folder == NULL)
+		return;
+	g_hash_table_destroy(folder->names);
+	g_free(folder->path);
+	g_free(folder);
+}
@@ -35,6 +35,10 @@ typedef struct janus_config_container {
 	const char *value;
 	/*! \brief Linked list of contained items/categories/arrays (category and array only) */
 	GList *list;
+	/*! \brief Index of the contained items/categories/arrays by name, and last element of the list
+	 * \note These are managed internally: only modify the list using the janus_config methods */
+	GHashTable *index;
+	GList *last;
 } janus_config_container;
 
 /*! \brief Configuration item (defined for backwards compatibility) */
@@ -54,6 +58,10 @@ typedef struct janus_config {
 	const char *name;
 	/*! \brief Linked list of items/categories/arrays */
 	GList *list;
+	/*! \brief Index of the items/categories/arrays by name, and last element of the list
+	 * \note These are managed internally: only modify the list using the janus_config methods */
+	GHashTable *index;
+	GList *last;
 } janus_config;
 
 
@@ -167,4 +175,62 @@ GList *janus_config_get_categories(janus_config *config, janus_config_container
  * @returns A pointer to the categories GLib linked list of arrays if successful, NULL otherwise */
 GList *janus_config_get_arrays(janus_config *config, janus_config_container *parent);
 
+/*! \brief Folder of configuration files, each containing a single category
+ * \details This can be used by plugins that persist a lot of resources (e.g.,
+ * permanent rooms) to save each of them to a file of its own, named after
+ * the category: this way, changing a resource only means writing a small file,
+ * rather than rewriting a huge configuration file each time, and resources
+ * can be loaded when they're first needed, instead of all at startup.
+ * \note The folder instance is not thread safe: it's up to the caller to
+ * serialize access to it */
+typedef struct janus_config_folder {
+	/*! \brief Path to the folder */
+	char *path;
+	/*! \brief Names of the categories we have a file for */
+	GHashTable *names;
+} janus_config_folder;
+
+/*! \brief Method to open (and create, if needed) a folder of configuration files,
+ * and index the categories it contains (files are not parsed at this stage)
+ * @param[in] path Path to the folder
+ * @returns A pointer to a valid janus_config_folder instance if successful, NULL otherwise */
+janus_config_folder *janus_config_folder_open(const char *path);
+/*! \brief Check whether a folder has a file for the specified category
+ * @param[in] folder The janus_config_folder instance
+ * @param[in] name The name of the category
+ * @returns TRUE if it does, FALSE otherwise */
+gboolean janus_config_folder_contains(janus_config_folder *folder, const char *name);
+/*! \brief Helper method to return the names of the categories in a folder
+ * @note The method returns a new GList: it's up to the caller to free it, but not its data
+ * @param[in] folder The janus_config_folder instance
+ * @returns A GLib linked list of category names */
+GList *janus_config_folder_get_names(janus_config_folder *folder);
+/*! \brief Parse the file of a specific category in a folder
+ * @param[in] folder The janus_config_folder instance
+ * @param[in] name The name of the category
+ * @returns A pointer to a valid janus_config instance containing the category if successful, NULL otherwise */
+janus_config *janus_config_folder_load(janus_config_folder *folder, const char *name);
+/*! \brief Save a category to its own file in a folder, replacing the existing one, if any
+ * \note The file is written to a temporary file first, and then renamed, so
+ * that a failure can never leave a truncated file behind
+ * @param[in] folder The janus_config_folder instance
+ * @param[in] config The configuration the category belongs to
+ * @param[in] category The category to save
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_config_folder_save(janus_config_folder *folder, janus_config *config, janus_config_category *category);
+/*! \brief Remove the file of a specific category from a folder
+ * @param[in] folder The janus_config_folder instance
+ * @param[in] name The name of the category
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_config_folder_remove(janus_config_folder *folder, const char *name);
+/*! \brief Remove a category from the folder index, without removing its file
+ * @note This is useful when a resource is destroyed but not permanently, and so
+ * shouldn't be loaded again until a restart
+ * @param[in] folder The janus_config_folder instance
+ * @param[in] name The name of the category */
+void janus_config_folder_forget(janus_config_folder *folder, const char *name);
+/*! \brief Destroy a janus_config_folder instance (files are left untouched)
+ * @param[in] folder The janus_config_folder instance to destroy */
+void janus_config_folder_destroy(janus_config_folder *folder);
+
 #endif
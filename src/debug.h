@@ -85,6 +85,8 @@ static const char *janus_log_prefix[] = {
 ///@{
 /*! \brief Simple wrapper to g_print/printf */
 #define JANUS_PRINT janus_vprintf
+/*! \brief Same as JANUS_PRINT, but formatting may be deferred to the logger thread */
+#define JANUS_PRINT_DEFERRED janus_vprintf_deferred
 /*! \brief Logger based on different levels, which can either be displayed
  * or not according to the configuration of the server.
  * The format must be a string literal. */
@@ -104,7 +106,7 @@ do { \
 			snprintf(janus_log_src, sizeof(janus_log_src), \
 			         "[%s:%s:%d] ", __FILE__, __FUNCTION__, __LINE__); \
 		} \
-		JANUS_PRINT("%s%s%s%s" format, \
+		JANUS_PRINT_DEFERRED("%s%s%s%s" format, \
 			janus_log_global_prefix ? janus_log_global_prefix : "", \
 			janus_log_ts, \
 			janus_log_prefix[level | ((int)janus_log_colors << 3)], \
@@ -14,6 +14,7 @@
 #include "debug.h"
 #include "ice.h"
 #include "mutex.h"
+#include "metrics.h"
 
 /* Starting MTU value for the DTLS BIO agent writer */
 static int mtu = 1200;
@@ -147,7 +148,7 @@ static int janus_dtls_bio_agent_write(BIO *bio, const char *in, int inl) {
 		/* FIXME Just a warning for now, this will need to be solved with proper fragmentation */
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] The DTLS stack is trying to send a packet of %d bytes, this may be larger than the MTU and get dropped!\n", handle->handle_id, inl);
 	}
-	int bytes = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, inl, in);
+	int bytes = janus_ice_peerconnection_send(handle, pc, in, inl);
 	if(bytes < inl) {
 		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error sending DTLS message on component %d of stream %d (%d)\n", handle->handle_id, pc->component_id, pc->stream_id, bytes);
 	} else {
@@ -158,6 +159,8 @@ static int janus_dtls_bio_agent_write(BIO *bio, const char *in, int inl) {
 	if(bytes > 0) {
 		pc->dtls_out_stats.info[0].packets++;
 		pc->dtls_out_stats.info[0].bytes += bytes;
+		janus_metrics_inc(JANUS_METRICS_PACKETS_OUT);
+		janus_metrics_add(JANUS_METRICS_BYTES_OUT, bytes);
 		/* If there's a datachannel medium, update the stats there too */
 		janus_ice_peerconnection_medium *medium = g_hash_table_lookup(pc->media_bytype, GINT_TO_POINTER(JANUS_MEDIA_DATA));
 		if(medium) {
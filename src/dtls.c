@@ -122,10 +122,199 @@ gboolean janus_dtls_are_selfsigned_certs_ok(void) {
  * that value cannot be modified (it will in OpenSSL v1.1.1) */
 static guint16 dtls_timeout_base = 1000;
 
+/* DTLS handshakes can optionally be offloaded to a pool of crypto workers,
+ * rather than performed on the loop the handle belongs to: each worker has
+ * its own queue, and the same worker always handles the same stack */
+typedef struct janus_dtls_worker {
+	guint id;
+	GAsyncQueue *jobs;
+	GThread *thread;
+} janus_dtls_worker;
+static janus_dtls_worker *dtls_workers = NULL;
+static guint dtls_workers_count = 0;
+static void janus_dtls_workers_cleanup(void);
+static void janus_dtls_pool_cleanup(void);
+/* An incoming DTLS message for a worker, or a completed handshake for a loop */
+typedef struct janus_dtls_job {
+	janus_dtls_srtp *dtls;
+	janus_ice_peerconnection *pc;
+	janus_ice_handle *handle;
+	gint64 queued;
+	char *buf;
+	uint16_t len;
+} janus_dtls_job;
+static janus_dtls_job exit_job;
+/* Handshake and workers statistics */
+static struct {
+	guint64 jobs, handshakes;
+	gint64 wait_total, wait_max;
+	gint64 handshake_total, handshake_max;
+	gint queue_max;
+	/* Handshake times histogram */
+	guint64 histogram[8];
+} dtls_stats;
+/* Upper bounds (in ms) of the buckets of the handshake times histogram, the last one being unbounded */
+static const gint64 dtls_histogram_buckets[] = { 50, 100, 250, 500, 1000, 2000, 5000, 0 };
+static janus_mutex dtls_stats_mutex = JANUS_MUTEX_INITIALIZER;
+
 static SSL_CTX *ssl_ctx = NULL;
 static X509 *ssl_cert = NULL;
 static EVP_PKEY *ssl_key = NULL;
 
+/* Cost of protecting/unprotecting packets with the SRTP profiles we support,
+ * as measured by a quick benchmark when starting: profiles are listed in
+ * order of preference, which is what we advertise in the DTLS handshake */
+typedef struct janus_dtls_srtp_benchmark {
+	int profile;
+	gint64 protect_ns, unprotect_ns;
+} janus_dtls_srtp_benchmark;
+static janus_dtls_srtp_benchmark srtp_benchmarks[] = {
+#ifdef HAVE_SRTP_AESGCM
+	{ .profile = SRTP_AEAD_AES_256_GCM },
+	{ .profile = SRTP_AEAD_AES_128_GCM },
+#endif
+	{ .profile = SRTP_AES128_CM_SHA1_80 },
+	{ .profile = SRTP_AES128_CM_SHA1_32 }
+};
+#define JANUS_DTLS_SRTP_BENCHMARK_PACKETS	2000
+#define JANUS_DTLS_SRTP_BENCHMARK_SIZE		1100
+
+static gint64 janus_dtls_srtp_benchmark_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec*G_GINT64_CONSTANT(1000000000)) + ts.tv_nsec;
+}
+
+static void janus_dtls_srtp_benchmark_profile(janus_dtls_srtp_benchmark *benchmark) {
+	srtp_policy_t policy;
+	memset(&policy, 0, sizeof(policy));
+	switch(benchmark->profile) {
+		case SRTP_AES128_CM_SHA1_80:
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtp);
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);
+			break;
+		case SRTP_AES128_CM_SHA1_32:
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&policy.rtp);
+			srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&policy.rtcp);
+			break;
+#ifdef HAVE_SRTP_AESGCM
+		case SRTP_AEAD_AES_256_GCM:
+			srtp_crypto_policy_set_aes_gcm_256_16_auth(&policy.rtp);
+			srtp_crypto_policy_set_aes_gcm_256_16_auth(&policy.rtcp);
+			break;
+		case SRTP_AEAD_AES_128_GCM:
+			srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+			srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+			break;
+#endif
+		default:
+			return;
+	}
+	/* The key doesn't matter here */
+	unsigned char key[SRTP_AESGCM256_MASTER_LENGTH];
+	memset(key, 0x42, sizeof(key));
+	policy.key = key;
+	policy.next = NULL;
+	srtp_t out = NULL, in = NULL;
+	policy.ssrc.type = ssrc_any_outbound;
+	if(srtp_create(&out, &policy) != srtp_err_status_ok)
+		return;
+	policy.ssrc.type = ssrc_any_inbound;
+	if(srtp_create(&in, &policy) != srtp_err_status_ok) {
+		srtp_dealloc(out);
+		return;
+	}
+	/* Protect and unprotect a bunch of video-sized packets */
+	char buffer[JANUS_DTLS_SRTP_BENCHMARK_SIZE + SRTP_MAX_TRAILER_LEN];
+	gint64 protect = 0, unprotect = 0, start = 0;
+	int i = 0, failed = 0;
+	for(i=0; i<JANUS_DTLS_SRTP_BENCHMARK_PACKETS; i++) {
+		memset(buffer, i & 0xFF, JANUS_DTLS_SRTP_BENCHMARK_SIZE);
+		janus_rtp_header *header = (janus_rtp_header *)buffer;
+		header->version = 2;
+		header->padding = 0;
+		header->extension = 0;
+		header->csrccount = 0;
+		header->markerbit = 0;
+		header->type = 96;
+		header->seq_number = htons(i+1);
+		header->timestamp = htonl(i*3000);
+		header->ssrc = htonl(0x4A414E55);
+		int len = JANUS_DTLS_SRTP_BENCHMARK_SIZE;
+		start = janus_dtls_srtp_benchmark_now();
+		if(srtp_protect(out, buffer, &len) != srtp_err_status_ok)
+			failed++;
+		protect += janus_dtls_srtp_benchmark_now() - start;
+		start = janus_dtls_srtp_benchmark_now();
+		if(srtp_unprotect(in, buffer, &len) != srtp_err_status_ok)
+			failed++;
+		unprotect += janus_dtls_srtp_benchmark_now() - start;
+	}
+	srtp_dealloc(out);
+	srtp_dealloc(in);
+	if(failed > 0) {
+		JANUS_LOG(LOG_WARN, "Errors benchmarking SRTP profile %s\n", janus_get_dtls_srtp_profile(benchmark->profile));
+		return;
+	}
+	benchmark->protect_ns = protect / JANUS_DTLS_SRTP_BENCHMARK_PACKETS;
+	benchmark->unprotect_ns = unprotect / JANUS_DTLS_SRTP_BENCHMARK_PACKETS;
+}
+
+static void janus_dtls_srtp_benchmark_all(void) {
+	guint i = 0;
+	for(i=0; i<G_N_ELEMENTS(srtp_benchmarks); i++) {
+		janus_dtls_srtp_benchmark_profile(&srtp_benchmarks[i]);
+		JANUS_LOG(LOG_VERB, "SRTP profile %s: %"SCNi64"ns to protect, %"SCNi64"ns to unprotect (%d bytes)\n",
+			janus_get_dtls_srtp_profile(srtp_benchmarks[i].profile),
+			srtp_benchmarks[i].protect_ns, srtp_benchmarks[i].unprotect_ns, JANUS_DTLS_SRTP_BENCHMARK_SIZE);
+	}
+}
+
+static gint janus_dtls_srtp_benchmark_compare(gconstpointer a, gconstpointer b) {
+	const janus_dtls_srtp_benchmark *ba = a, *bb = b;
+	/* Profiles we couldn't measure go last */
+	gint64 ca = ba->protect_ns + ba->unprotect_ns, cb = bb->protect_ns + bb->unprotect_ns;
+	if(ca == 0 || cb == 0)
+		return (ca == 0) - (cb == 0);
+	return (ca > cb) - (ca < cb);
+}
+
+/* Advertise the SRTP profiles in the DTLS handshake, in our order of preference */
+static void janus_dtls_srtp_set_profiles(void) {
+	GString *profiles = g_string_new(NULL);
+	guint i = 0;
+	for(i=0; i<G_N_ELEMENTS(srtp_benchmarks); i++) {
+		if(i > 0)
+			g_string_append_c(profiles, ':');
+		g_string_append(profiles, janus_get_dtls_srtp_profile(srtp_benchmarks[i].profile));
+	}
+	SSL_CTX_set_tlsext_use_srtp(ssl_ctx, profiles->str);
+	JANUS_LOG(LOG_INFO, "SRTP profiles: %s\n", profiles->str);
+	g_string_free(profiles, TRUE);
+}
+
+void janus_dtls_srtp_prefer_fastest(void) {
+	if(ssl_ctx == NULL)
+		return;
+	/* The stable sort keeps the default order for profiles that cost the same */
+	g_qsort_with_data(srtp_benchmarks, G_N_ELEMENTS(srtp_benchmarks), sizeof(janus_dtls_srtp_benchmark),
+		(GCompareDataFunc)janus_dtls_srtp_benchmark_compare, NULL);
+	janus_dtls_srtp_set_profiles();
+}
+
+json_t *janus_dtls_srtp_benchmarks_info(void) {
+	json_t *list = json_array();
+	guint i = 0;
+	for(i=0; i<G_N_ELEMENTS(srtp_benchmarks); i++) {
+		json_t *profile = json_object();
+		json_object_set_new(profile, "profile", json_string(janus_get_dtls_srtp_profile(srtp_benchmarks[i].profile)));
+		json_object_set_new(profile, "protect_ns", json_integer(srtp_benchmarks[i].protect_ns));
+		json_object_set_new(profile, "unprotect_ns", json_integer(srtp_benchmarks[i].unprotect_ns));
+		json_array_append_new(list, profile);
+	}
+	return list;
+}
+
 static gchar local_fingerprint[160];
 gchar *janus_dtls_get_local_fingerprint(void) {
 	return (gchar *)local_fingerprint;
@@ -438,12 +627,7 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 		return -1;
 	}
 	SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, janus_dtls_verify_callback);
-	SSL_CTX_set_tlsext_use_srtp(ssl_ctx,
-#ifdef HAVE_SRTP_AESGCM
-		"SRTP_AEAD_AES_256_GCM:SRTP_AEAD_AES_128_GCM:SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
-#else
-		"SRTP_AES128_CM_SHA1_80:SRTP_AES128_CM_SHA1_32");
-#endif
+	janus_dtls_srtp_set_profiles();
 
 	if(!server_pem && !server_key) {
 		JANUS_LOG(LOG_INFO, "No cert/key specified, autogenerating some...\n");
@@ -510,6 +694,8 @@ gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const
 		JANUS_LOG(LOG_FATAL, "Ops, error setting up libsrtp?\n");
 		return -10;
 	}
+	/* Check how expensive each SRTP profile is on this machine */
+	janus_dtls_srtp_benchmark_all();
 
 	/* Finally, let's set our policy with respect to DTLS self signed certificates */
 	dtls_selfsigned_certs_ok = accept_selfsigned;
@@ -542,11 +728,14 @@ static void janus_dtls_srtp_free(const janus_refcount *dtls_ref) {
 		}
 		/* FIXME What about dtls->remote_policy and dtls->local_policy? */
 	}
+	janus_mutex_destroy(&dtls->mutex);
 	g_free(dtls);
 	dtls = NULL;
 }
 
 void janus_dtls_srtp_cleanup(void) {
+	janus_dtls_workers_cleanup();
+	janus_dtls_pool_cleanup();
 	if(ssl_cert != NULL) {
 		X509_free(ssl_cert);
 		ssl_cert = NULL;
@@ -565,26 +754,18 @@ void janus_dtls_srtp_cleanup(void) {
 }
 
 
-janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
-	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)ice_pc;
-	if(pc == NULL) {
-		JANUS_LOG(LOG_ERR, "No WebRTC PeerConnection, no DTLS...\n");
-		return NULL;
-	}
-	janus_ice_handle *handle = pc->handle;
-	if(!handle || !handle->agent) {
-		JANUS_LOG(LOG_ERR, "No handle/agent, no DTLS...\n");
-		return NULL;
-	}
+/* Allocate a DTLS-SRTP stack, which isn't bound to any PeerConnection yet */
+static janus_dtls_srtp *janus_dtls_srtp_alloc(void) {
 	janus_dtls_srtp *dtls = g_malloc0(sizeof(janus_dtls_srtp));
 	g_atomic_int_set(&dtls->destroyed, 0);
 	janus_refcount_init(&dtls->ref, janus_dtls_srtp_free);
+	janus_mutex_init(&dtls->mutex);
 	/* Create SSL context, at last */
 	dtls->srtp_valid = 0;
 	dtls->ssl = SSL_new(ssl_ctx);
 	if(!dtls->ssl) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"]     Error creating DTLS session! (%s)\n",
-			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+		JANUS_LOG(LOG_ERR, "Error creating DTLS session! (%s)\n",
+			ERR_reason_error_string(ERR_get_error()));
 		janus_refcount_decrease(&dtls->ref);
 		return NULL;
 	}
@@ -592,22 +773,20 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 	SSL_set_info_callback(dtls->ssl, janus_dtls_callback);
 	dtls->read_bio = BIO_new(BIO_s_mem());
 	if(!dtls->read_bio) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating read BIO! (%s)\n",
-			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+		JANUS_LOG(LOG_ERR, "Error creating read BIO! (%s)\n",
+			ERR_reason_error_string(ERR_get_error()));
 		janus_refcount_decrease(&dtls->ref);
 		return NULL;
 	}
 	BIO_set_mem_eof_return(dtls->read_bio, -1);
 	dtls->write_bio = BIO_janus_dtls_agent_new(dtls);
 	if(!dtls->write_bio) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating write BIO! (%s)\n",
-			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+		JANUS_LOG(LOG_ERR, "Error creating write BIO! (%s)\n",
+			ERR_reason_error_string(ERR_get_error()));
 		janus_refcount_decrease(&dtls->ref);
 		return NULL;
 	}
 	SSL_set_bio(dtls->ssl, dtls->read_bio, dtls->write_bio);
-	/* The role may change later, depending on the negotiation */
-	dtls->dtls_role = role;
 	/* https://code.google.com/p/chromium/issues/detail?id=406458
 	 * Specify an ECDH group for ECDHE ciphers, otherwise they cannot be
 	 * negotiated when acting as the server. Use NIST's P-256 which is
@@ -616,8 +795,8 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 #ifndef OPENSSL_VERSION_MAJOR
 	EC_KEY *ecdh = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
 	if(ecdh == NULL) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"]   Error creating ECDH group! (%s)\n",
-			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+		JANUS_LOG(LOG_ERR, "Error creating ECDH group! (%s)\n",
+			ERR_reason_error_string(ERR_get_error()));
 		janus_refcount_decrease(&dtls->ref);
 		return NULL;
 	}
@@ -630,7 +809,7 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 	const long flags = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION | SSL_OP_SINGLE_ECDH_USE;
 	SSL_set_options(dtls->ssl, flags);
 #ifdef HAVE_DTLS_SETTIMEOUT
-	JANUS_LOG(LOG_VERB, "[%"SCNu64"]   Setting DTLS initial timeout: %"SCNu16"ms\n", handle->handle_id, dtls_timeout_base);
+	JANUS_LOG(LOG_HUGE, "Setting DTLS initial timeout: %"SCNu16"ms\n", dtls_timeout_base);
 	DTLSv1_set_initial_timeout_duration(dtls->ssl, dtls_timeout_base);
 #endif
 	dtls->ready = 0;
@@ -638,8 +817,120 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 #ifdef HAVE_SCTP
 	dtls->sctp = NULL;
 #endif
-	/* Done */
 	dtls->dtls_connected = 0;
+	return dtls;
+}
+
+
+/* Pool of pre-allocated DTLS-SRTP stacks, refilled in the background */
+static GQueue dtls_pool = G_QUEUE_INIT;
+static guint dtls_pool_size = 0;
+static guint64 dtls_pool_hits = 0, dtls_pool_misses = 0;
+static gboolean dtls_pool_stopping = FALSE;
+static janus_mutex dtls_pool_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition dtls_pool_cond;
+static GThread *dtls_pool_thread = NULL;
+
+static void *janus_dtls_pool_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining DTLS pool thread\n");
+	janus_mutex_lock(&dtls_pool_mutex);
+	while(!dtls_pool_stopping) {
+		if(g_queue_get_length(&dtls_pool) >= dtls_pool_size) {
+			janus_condition_wait(&dtls_pool_cond, &dtls_pool_mutex);
+			continue;
+		}
+		janus_mutex_unlock(&dtls_pool_mutex);
+		janus_dtls_srtp *dtls = janus_dtls_srtp_alloc();
+		janus_mutex_lock(&dtls_pool_mutex);
+		if(dtls == NULL) {
+			/* Try again later */
+			gint64 end = g_get_monotonic_time() + G_USEC_PER_SEC;
+			janus_condition_wait_until(&dtls_pool_cond, &dtls_pool_mutex, end);
+			continue;
+		}
+		g_queue_push_tail(&dtls_pool, dtls);
+	}
+	janus_mutex_unlock(&dtls_pool_mutex);
+	JANUS_LOG(LOG_VERB, "Leaving DTLS pool thread\n");
+	return NULL;
+}
+
+int janus_dtls_pool_init(guint size) {
+	if(size == 0 || dtls_pool_thread != NULL)
+		return 0;
+	dtls_pool_size = size;
+	janus_condition_init(&dtls_pool_cond);
+	GError *error = NULL;
+	dtls_pool_thread = g_thread_try_new("dtls pool", janus_dtls_pool_thread, NULL, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the DTLS pool thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		dtls_pool_size = 0;
+		return -1;
+	}
+	JANUS_LOG(LOG_INFO, "Keeping a pool of %u pre-allocated DTLS stacks\n", dtls_pool_size);
+	return 0;
+}
+
+json_t *janus_dtls_pool_info(void) {
+	json_t *info = json_object();
+	janus_mutex_lock(&dtls_pool_mutex);
+	json_object_set_new(info, "size", json_integer(dtls_pool_size));
+	json_object_set_new(info, "available", json_integer(g_queue_get_length(&dtls_pool)));
+	json_object_set_new(info, "hits", json_integer(dtls_pool_hits));
+	json_object_set_new(info, "misses", json_integer(dtls_pool_misses));
+	janus_mutex_unlock(&dtls_pool_mutex);
+	return info;
+}
+
+static void janus_dtls_pool_cleanup(void) {
+	if(dtls_pool_thread == NULL)
+		return;
+	janus_mutex_lock(&dtls_pool_mutex);
+	dtls_pool_stopping = TRUE;
+	janus_condition_signal(&dtls_pool_cond);
+	janus_mutex_unlock(&dtls_pool_mutex);
+	g_thread_join(dtls_pool_thread);
+	dtls_pool_thread = NULL;
+	janus_dtls_srtp *dtls = NULL;
+	while((dtls = g_queue_pop_head(&dtls_pool)) != NULL)
+		janus_refcount_decrease(&dtls->ref);
+	janus_condition_destroy(&dtls_pool_cond);
+}
+
+janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)ice_pc;
+	if(pc == NULL) {
+		JANUS_LOG(LOG_ERR, "No WebRTC PeerConnection, no DTLS...\n");
+		return NULL;
+	}
+	janus_ice_handle *handle = pc->handle;
+	if(!handle || !handle->agent) {
+		JANUS_LOG(LOG_ERR, "No handle/agent, no DTLS...\n");
+		return NULL;
+	}
+	janus_dtls_srtp *dtls = NULL;
+	if(dtls_pool_size > 0) {
+		/* Take a stack from the pool, if there's any left, and have it refilled */
+		janus_mutex_lock(&dtls_pool_mutex);
+		dtls = g_queue_pop_head(&dtls_pool);
+		if(dtls != NULL)
+			dtls_pool_hits++;
+		else
+			dtls_pool_misses++;
+		janus_condition_signal(&dtls_pool_cond);
+		janus_mutex_unlock(&dtls_pool_mutex);
+	}
+	if(dtls == NULL)
+		dtls = janus_dtls_srtp_alloc();
+	if(dtls == NULL) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error creating DTLS stack\n", handle->handle_id);
+		return NULL;
+	}
+	/* The role may change later, depending on the negotiation */
+	dtls->dtls_role = role;
+	/* Done */
 	dtls->pc = pc;
 	return dtls;
 }
@@ -647,6 +938,7 @@ janus_dtls_srtp *janus_dtls_srtp_create(void *ice_pc, janus_dtls_role role) {
 void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
 	if(dtls == NULL || dtls->ssl == NULL)
 		return;
+	janus_mutex_lock(&dtls->mutex);
 	if(dtls->dtls_state == JANUS_DTLS_STATE_CREATED) {
 		/* Starting the handshake now: enforce the role */
 		dtls->dtls_started = janus_get_monotonic_time();
@@ -658,6 +950,7 @@ void janus_dtls_srtp_handshake(janus_dtls_srtp *dtls) {
 		dtls->dtls_state = JANUS_DTLS_STATE_TRYING;
 	}
 	SSL_do_handshake(dtls->ssl);
+	janus_mutex_unlock(&dtls->mutex);
 
 	/* Notify event handlers */
 	janus_dtls_notify_state_change(dtls);
@@ -687,33 +980,301 @@ int janus_dtls_srtp_create_sctp(janus_dtls_srtp *dtls) {
 #endif
 }
 
-void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
-	if(dtls == NULL) {
-		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no incoming message...\n");
-		return;
-	}
+/* Complete the DTLS-SRTP setup once the handshake is over: must be called with the DTLS mutex locked */
+static void janus_dtls_srtp_established(janus_dtls_srtp *dtls) {
 	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
-	if(pc == NULL) {
-		JANUS_LOG(LOG_ERR, "No WebRTC PeerConnection, no DTLS...\n");
+	if(pc == NULL)
 		return;
-	}
 	janus_ice_handle *handle = pc->handle;
-	if(!handle || !handle->agent) {
-		JANUS_LOG(LOG_ERR, "No handle/agent, no DTLS...\n");
+	if(!handle || !handle->agent)
 		return;
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] DTLS established, yay!\n", handle->handle_id);
+	/* Check the remote fingerprint */
+	X509 *rcert = SSL_get_peer_certificate(dtls->ssl);
+	if(!rcert) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] No remote certificate?? (%s)\n",
+			handle->handle_id, ERR_reason_error_string(ERR_get_error()));
+	} else {
+		unsigned int rsize;
+		unsigned char rfingerprint[EVP_MAX_MD_SIZE];
+		char remote_fingerprint[160];
+		char *rfp = (char *)&remote_fingerprint;
+		if(pc->remote_hashing && !strcasecmp(pc->remote_hashing, "sha-1")) {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-1 fingerprint of remote certificate...\n", handle->handle_id);
+			X509_digest(rcert, EVP_sha1(), (unsigned char *)rfingerprint, &rsize);
+		} else {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-256 fingerprint of remote certificate...\n", handle->handle_id);
+			X509_digest(rcert, EVP_sha256(), (unsigned char *)rfingerprint, &rsize);
+		}
+		X509_free(rcert);
+		rcert = NULL;
+		unsigned int i = 0;
+		for(i = 0; i < rsize; i++) {
+			g_snprintf(rfp, 4, "%.2X:", rfingerprint[i]);
+			rfp += 3;
+		}
+		*(rfp-1) = 0;
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Remote fingerprint (%s) of the client is %s\n",
+			handle->handle_id, pc->remote_hashing ? pc->remote_hashing : "sha-256", remote_fingerprint);
+		if(!strcasecmp(remote_fingerprint, pc->remote_fingerprint ? pc->remote_fingerprint : "(none)")) {
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"]  Fingerprint is a match!\n", handle->handle_id);
+			dtls->dtls_state = JANUS_DTLS_STATE_CONNECTED;
+			dtls->dtls_connected = janus_get_monotonic_time();
+			gint64 duration = dtls->dtls_connected - dtls->dtls_started;
+			janus_mutex_lock(&dtls_stats_mutex);
+			dtls_stats.handshakes++;
+			dtls_stats.handshake_total += duration;
+			if(duration > dtls_stats.handshake_max)
+				dtls_stats.handshake_max = duration;
+			guint bucket = 0;
+			while(bucket < G_N_ELEMENTS(dtls_histogram_buckets)-1 && duration >= dtls_histogram_buckets[bucket]*1000)
+				bucket++;
+			dtls_stats.histogram[bucket]++;
+			janus_mutex_unlock(&dtls_stats_mutex);
+			/* Notify event handlers */
+			janus_dtls_notify_state_change(dtls);
+		} else {
+			/* FIXME NOT a match! MITM? */
+			JANUS_LOG(LOG_ERR, "[%"SCNu64"]  Fingerprint is NOT a match! got %s, expected %s\n", handle->handle_id, remote_fingerprint, pc->remote_fingerprint);
+			dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
+			/* Notify event handlers */
+			janus_dtls_notify_state_change(dtls);
+			goto done;
+		}
+		if(dtls->dtls_state == JANUS_DTLS_STATE_CONNECTED) {
+			/* Which SRTP profile is being negotiated? */
+			const SRTP_PROTECTION_PROFILE *srtp_profile = SSL_get_selected_srtp_profile(dtls->ssl);
+			if(srtp_profile == NULL) {
+				/* Should never happen, but just in case... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] No SRTP profile selected...\n", handle->handle_id);
+				dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
+				/* Notify event handlers */
+				janus_dtls_notify_state_change(dtls);
+				goto done;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] %s\n", handle->handle_id, srtp_profile->name);
+			int key_length = 0, salt_length = 0, master_length = 0;
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+				case SRTP_AES128_CM_SHA1_32:
+					key_length = SRTP_MASTER_KEY_LENGTH;
+					salt_length = SRTP_MASTER_SALT_LENGTH;
+					master_length = SRTP_MASTER_LENGTH;
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					key_length = SRTP_AESGCM256_MASTER_KEY_LENGTH;
+					salt_length = SRTP_AESGCM256_MASTER_SALT_LENGTH;
+					master_length = SRTP_AESGCM256_MASTER_LENGTH;
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					key_length = SRTP_AESGCM128_MASTER_KEY_LENGTH;
+					salt_length = SRTP_AESGCM128_MASTER_SALT_LENGTH;
+					master_length = SRTP_AESGCM128_MASTER_LENGTH;
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %lu\n", handle->handle_id, srtp_profile->id);
+					break;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Key/Salt/Master: %d/%d/%d\n",
+				handle->handle_id, master_length, key_length, salt_length);
+			/* Complete with SRTP setup */
+			unsigned char material[master_length*2];
+			unsigned char *local_key, *local_salt, *remote_key, *remote_salt;
+			/* Export keying material for SRTP */
+			if(!SSL_export_keying_material(dtls->ssl, material, master_length*2, "EXTRACTOR-dtls_srtp", 19, NULL, 0, 0)) {
+				/* Oops... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, couldn't extract SRTP keying material for component %d in stream %d?? (%s)\n",
+					handle->handle_id, pc->component_id, pc->stream_id, ERR_reason_error_string(ERR_get_error()));
+				goto done;
+			}
+			/* Key derivation (http://tools.ietf.org/html/rfc5764#section-4.2) */
+			if(dtls->dtls_role == JANUS_DTLS_ROLE_CLIENT) {
+				local_key = material;
+				remote_key = local_key + key_length;
+				local_salt = remote_key + key_length;
+				remote_salt = local_salt + salt_length;
+			} else {
+				remote_key = material;
+				local_key = remote_key + key_length;
+				remote_salt = local_key + key_length;
+				local_salt = remote_salt + salt_length;
+			}
+			/* Build master keys and set SRTP policies */
+				/* Remote (inbound) */
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
+					break;
+				case SRTP_AES128_CM_SHA1_32:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtcp));
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtcp));
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
+					break;
+			}
+			dtls->remote_policy.ssrc.type = ssrc_any_inbound;
+			unsigned char remote_policy_key[master_length];
+			dtls->remote_policy.key = (unsigned char *)&remote_policy_key;
+			memcpy(dtls->remote_policy.key, remote_key, key_length);
+			memcpy(dtls->remote_policy.key + key_length, remote_salt, salt_length);
+#if HAS_DTLS_WINDOW_SIZE
+			dtls->remote_policy.window_size = 128;
+			dtls->remote_policy.allow_repeat_tx = 0;
+#endif
+			dtls->remote_policy.next = NULL;
+				/* Local (outbound) */
+			switch(srtp_profile->id) {
+				case SRTP_AES128_CM_SHA1_80:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
+					break;
+				case SRTP_AES128_CM_SHA1_32:
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
+					break;
+#ifdef HAVE_SRTP_AESGCM
+				case SRTP_AEAD_AES_256_GCM:
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtcp));
+					break;
+				case SRTP_AEAD_AES_128_GCM:
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtp));
+					srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtcp));
+					break;
+#endif
+				default:
+					/* Will never happen? */
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
+					break;
+			}
+			dtls->local_policy.ssrc.type = ssrc_any_outbound;
+			unsigned char local_policy_key[master_length];
+			dtls->local_policy.key = (unsigned char *)&local_policy_key;
+			memcpy(dtls->local_policy.key, local_key, key_length);
+			memcpy(dtls->local_policy.key + key_length, local_salt, salt_length);
+#if HAS_DTLS_WINDOW_SIZE
+			dtls->local_policy.window_size = 128;
+			dtls->local_policy.allow_repeat_tx = 0;
+#endif
+			dtls->local_policy.next = NULL;
+			/* Create SRTP sessions */
+			srtp_err_status_t res = srtp_create(&(dtls->srtp_in), &(dtls->remote_policy));
+			if(res != srtp_err_status_ok) {
+				/* Something went wrong... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating inbound SRTP session for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
+				goto done;
+			}
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created inbound SRTP session for component %d in stream %d\n", handle->handle_id, pc->component_id, pc->stream_id);
+			res = srtp_create(&(dtls->srtp_out), &(dtls->local_policy));
+			if(res != srtp_err_status_ok) {
+				/* Something went wrong... */
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating outbound SRTP session for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
+				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
+				goto done;
+			}
+			dtls->srtp_profile = srtp_profile->id;
+			dtls->srtp_valid = 1;
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created outbound SRTP session for component %d in stream %d\n", handle->handle_id, pc->component_id, pc->stream_id);
+#ifdef HAVE_SCTP
+			if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS) && !janus_sctp_is_lazy()) {
+				/* Create SCTP association as well */
+				janus_dtls_srtp_create_sctp(dtls);
+			}
+#endif
+			dtls->ready = 1;
+		}
+done:
+		if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && dtls->srtp_valid) {
+			/* Handshake successfully completed */
+			janus_ice_dtls_handshake_done(handle);
+		} else {
+			/* Something went wrong in either DTLS or SRTP... tell the plugin about it */
+			janus_dtls_callback(dtls->ssl, SSL_CB_ALERT, 0);
+			janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING);
+		}
 	}
-	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT)) {
-		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Alert already triggered, clearing up...\n", handle->handle_id);
+}
+
+static janus_dtls_job *janus_dtls_job_new(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
+	if(pc == NULL || pc->handle == NULL)
+		return NULL;
+	janus_dtls_job *job = g_malloc0(sizeof(janus_dtls_job));
+	janus_refcount_increase(&dtls->ref);
+	job->dtls = dtls;
+	janus_refcount_increase(&pc->ref);
+	job->pc = pc;
+	janus_refcount_increase(&pc->handle->ref);
+	job->handle = pc->handle;
+	job->queued = janus_get_monotonic_time();
+	if(buf != NULL && len > 0) {
+		job->buf = g_malloc(len);
+		memcpy(job->buf, buf, len);
+		job->len = len;
+	}
+	return job;
+}
+
+static void janus_dtls_job_free(janus_dtls_job *job) {
+	if(job == NULL || job == &exit_job)
 		return;
-	}
-	if(!dtls->ssl || !dtls->read_bio) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"] No DTLS stuff for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
+	janus_refcount_decrease(&job->handle->ref);
+	janus_refcount_decrease(&job->pc->ref);
+	janus_refcount_decrease(&job->dtls->ref);
+	g_free(job->buf);
+	g_free(job);
+}
+
+/* Invoked on the loop of the handle, when a worker completed a handshake */
+static gboolean janus_dtls_srtp_established_cb(gpointer user_data) {
+	janus_dtls_job *job = (janus_dtls_job *)user_data;
+	janus_dtls_srtp *dtls = job->dtls;
+	if(!g_atomic_int_get(&dtls->destroyed) &&
+			!janus_flags_is_set(&job->handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT)) {
+		janus_mutex_lock(&dtls->mutex);
+		if(!dtls->ready)
+			janus_dtls_srtp_established(dtls);
+		janus_mutex_unlock(&dtls->mutex);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void janus_dtls_srtp_post_established(janus_dtls_srtp *dtls) {
+	janus_dtls_job *job = janus_dtls_job_new(dtls, NULL, 0);
+	if(job == NULL)
 		return;
-	}
-	if(dtls->dtls_started == 0) {
-		/* Handshake not started yet: maybe we're still waiting for the answer and the DTLS role? */
+	GSource *source = g_idle_source_new();
+	g_source_set_priority(source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(source, janus_dtls_srtp_established_cb, job, (GDestroyNotify)janus_dtls_job_free);
+	g_source_attach(source, job->handle->mainctx);
+	g_source_unref(source);
+}
+
+/* Feed the DTLS stack with an incoming message: must be called with the DTLS mutex locked */
+static void janus_dtls_srtp_process(janus_dtls_srtp *dtls, char *buf, uint16_t len, gboolean offloaded) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
+	if(pc == NULL)
+		return;
+	janus_ice_handle *handle = pc->handle;
+	if(!handle || !handle->agent || !dtls->ssl || !dtls->read_bio)
 		return;
-	}
 	int written = BIO_write(dtls->read_bio, buf, len);
 	if(written != len) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"]     Only written %d/%d of those bytes on the read BIO...\n", handle->handle_id, written, len);
@@ -748,6 +1309,13 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 		/* There's data to be read? */
 		JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Any data available?\n", handle->handle_id);
 #ifdef HAVE_SCTP
+		if(dtls->sctp == NULL && read > 0 && janus_sctp_is_lazy() &&
+				janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
+			/* The peer is talking SCTP, create the association now */
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Got SCTP data, creating the association\n", handle->handle_id);
+			if(janus_dtls_srtp_create_sctp(dtls) == 0)
+				janus_sctp_lazy_created();
+		}
 		if(dtls->sctp != NULL && read > 0) {
 			JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Sending data (%d bytes) to the SCTP stack...\n", handle->handle_id, read);
 			janus_sctp_data_from_dtls(dtls->sctp, data, read);
@@ -757,219 +1325,161 @@ void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len
 			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Data available but Data Channels support disabled...\n", handle->handle_id);
 		}
 #endif
-	} else {
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] DTLS established, yay!\n", handle->handle_id);
-		/* Check the remote fingerprint */
-		X509 *rcert = SSL_get_peer_certificate(dtls->ssl);
-		if(!rcert) {
-			JANUS_LOG(LOG_ERR, "[%"SCNu64"] No remote certificate?? (%s)\n",
-				handle->handle_id, ERR_reason_error_string(ERR_get_error()));
-		} else {
-			unsigned int rsize;
-			unsigned char rfingerprint[EVP_MAX_MD_SIZE];
-			char remote_fingerprint[160];
-			char *rfp = (char *)&remote_fingerprint;
-			if(pc->remote_hashing && !strcasecmp(pc->remote_hashing, "sha-1")) {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-1 fingerprint of remote certificate...\n", handle->handle_id);
-				X509_digest(rcert, EVP_sha1(), (unsigned char *)rfingerprint, &rsize);
-			} else {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Computing sha-256 fingerprint of remote certificate...\n", handle->handle_id);
-				X509_digest(rcert, EVP_sha256(), (unsigned char *)rfingerprint, &rsize);
-			}
-			X509_free(rcert);
-			rcert = NULL;
-			unsigned int i = 0;
-			for(i = 0; i < rsize; i++) {
-				g_snprintf(rfp, 4, "%.2X:", rfingerprint[i]);
-				rfp += 3;
-			}
-			*(rfp-1) = 0;
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Remote fingerprint (%s) of the client is %s\n",
-				handle->handle_id, pc->remote_hashing ? pc->remote_hashing : "sha-256", remote_fingerprint);
-			if(!strcasecmp(remote_fingerprint, pc->remote_fingerprint ? pc->remote_fingerprint : "(none)")) {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"]  Fingerprint is a match!\n", handle->handle_id);
-				dtls->dtls_state = JANUS_DTLS_STATE_CONNECTED;
-				dtls->dtls_connected = janus_get_monotonic_time();
-				/* Notify event handlers */
-				janus_dtls_notify_state_change(dtls);
-			} else {
-				/* FIXME NOT a match! MITM? */
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"]  Fingerprint is NOT a match! got %s, expected %s\n", handle->handle_id, remote_fingerprint, pc->remote_fingerprint);
-				dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
-				/* Notify event handlers */
-				janus_dtls_notify_state_change(dtls);
-				goto done;
-			}
-			if(dtls->dtls_state == JANUS_DTLS_STATE_CONNECTED) {
-				/* Which SRTP profile is being negotiated? */
-				const SRTP_PROTECTION_PROFILE *srtp_profile = SSL_get_selected_srtp_profile(dtls->ssl);
-				if(srtp_profile == NULL) {
-					/* Should never happen, but just in case... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] No SRTP profile selected...\n", handle->handle_id);
-					dtls->dtls_state = JANUS_DTLS_STATE_FAILED;
-					/* Notify event handlers */
-					janus_dtls_notify_state_change(dtls);
-					goto done;
-				}
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] %s\n", handle->handle_id, srtp_profile->name);
-				int key_length = 0, salt_length = 0, master_length = 0;
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-					case SRTP_AES128_CM_SHA1_32:
-						key_length = SRTP_MASTER_KEY_LENGTH;
-						salt_length = SRTP_MASTER_SALT_LENGTH;
-						master_length = SRTP_MASTER_LENGTH;
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						key_length = SRTP_AESGCM256_MASTER_KEY_LENGTH;
-						salt_length = SRTP_AESGCM256_MASTER_SALT_LENGTH;
-						master_length = SRTP_AESGCM256_MASTER_LENGTH;
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						key_length = SRTP_AESGCM128_MASTER_KEY_LENGTH;
-						salt_length = SRTP_AESGCM128_MASTER_SALT_LENGTH;
-						master_length = SRTP_AESGCM128_MASTER_LENGTH;
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %lu\n", handle->handle_id, srtp_profile->id);
-						break;
-				}
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Key/Salt/Master: %d/%d/%d\n",
-					handle->handle_id, master_length, key_length, salt_length);
-				/* Complete with SRTP setup */
-				unsigned char material[master_length*2];
-				unsigned char *local_key, *local_salt, *remote_key, *remote_salt;
-				/* Export keying material for SRTP */
-				if(!SSL_export_keying_material(dtls->ssl, material, master_length*2, "EXTRACTOR-dtls_srtp", 19, NULL, 0, 0)) {
-					/* Oops... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, couldn't extract SRTP keying material for component %d in stream %d?? (%s)\n",
-						handle->handle_id, pc->component_id, pc->stream_id, ERR_reason_error_string(ERR_get_error()));
-					goto done;
-				}
-				/* Key derivation (http://tools.ietf.org/html/rfc5764#section-4.2) */
-				if(dtls->dtls_role == JANUS_DTLS_ROLE_CLIENT) {
-					local_key = material;
-					remote_key = local_key + key_length;
-					local_salt = remote_key + key_length;
-					remote_salt = local_salt + salt_length;
-				} else {
-					remote_key = material;
-					local_key = remote_key + key_length;
-					remote_salt = local_key + key_length;
-					local_salt = remote_salt + salt_length;
-				}
-				/* Build master keys and set SRTP policies */
-					/* Remote (inbound) */
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
-						break;
-					case SRTP_AES128_CM_SHA1_32:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->remote_policy.rtcp));
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->remote_policy.rtcp));
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->remote_policy.rtcp));
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
-						break;
-				}
-				dtls->remote_policy.ssrc.type = ssrc_any_inbound;
-				unsigned char remote_policy_key[master_length];
-				dtls->remote_policy.key = (unsigned char *)&remote_policy_key;
-				memcpy(dtls->remote_policy.key, remote_key, key_length);
-				memcpy(dtls->remote_policy.key + key_length, remote_salt, salt_length);
-#if HAS_DTLS_WINDOW_SIZE
-				dtls->remote_policy.window_size = 128;
-				dtls->remote_policy.allow_repeat_tx = 0;
-#endif
-				dtls->remote_policy.next = NULL;
-					/* Local (outbound) */
-				switch(srtp_profile->id) {
-					case SRTP_AES128_CM_SHA1_80:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
-						break;
-					case SRTP_AES128_CM_SHA1_32:
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(&(dtls->local_policy.rtcp));
-						break;
-#ifdef HAVE_SRTP_AESGCM
-					case SRTP_AEAD_AES_256_GCM:
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_256_16_auth(&(dtls->local_policy.rtcp));
-						break;
-					case SRTP_AEAD_AES_128_GCM:
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtp));
-						srtp_crypto_policy_set_aes_gcm_128_16_auth(&(dtls->local_policy.rtcp));
-						break;
-#endif
-					default:
-						/* Will never happen? */
-						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Unsupported SRTP profile %s\n", handle->handle_id, srtp_profile->name);
-						break;
-				}
-				dtls->local_policy.ssrc.type = ssrc_any_outbound;
-				unsigned char local_policy_key[master_length];
-				dtls->local_policy.key = (unsigned char *)&local_policy_key;
-				memcpy(dtls->local_policy.key, local_key, key_length);
-				memcpy(dtls->local_policy.key + key_length, local_salt, salt_length);
-#if HAS_DTLS_WINDOW_SIZE
-				dtls->local_policy.window_size = 128;
-				dtls->local_policy.allow_repeat_tx = 0;
-#endif
-				dtls->local_policy.next = NULL;
-				/* Create SRTP sessions */
-				srtp_err_status_t res = srtp_create(&(dtls->srtp_in), &(dtls->remote_policy));
-				if(res != srtp_err_status_ok) {
-					/* Something went wrong... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating inbound SRTP session for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
-					goto done;
-				}
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created inbound SRTP session for component %d in stream %d\n", handle->handle_id, pc->component_id, pc->stream_id);
-				res = srtp_create(&(dtls->srtp_out), &(dtls->local_policy));
-				if(res != srtp_err_status_ok) {
-					/* Something went wrong... */
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"] Oops, error creating outbound SRTP session for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
-					JANUS_LOG(LOG_ERR, "[%"SCNu64"]  -- %d (%s)\n", handle->handle_id, res, janus_srtp_error_str(res));
-					goto done;
-				}
-				dtls->srtp_profile = srtp_profile->id;
-				dtls->srtp_valid = 1;
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Created outbound SRTP session for component %d in stream %d\n", handle->handle_id, pc->component_id, pc->stream_id);
-#ifdef HAVE_SCTP
-				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_DATA_CHANNELS)) {
-					/* Create SCTP association as well */
-					janus_dtls_srtp_create_sctp(dtls);
-				}
-#endif
-				dtls->ready = 1;
-			}
-done:
-			if(!janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT) && dtls->srtp_valid) {
-				/* Handshake successfully completed */
-				janus_ice_dtls_handshake_done(handle);
-			} else {
-				/* Something went wrong in either DTLS or SRTP... tell the plugin about it */
-				janus_dtls_callback(dtls->ssl, SSL_CB_ALERT, 0);
-				janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING);
-			}
+	} else if(!offloaded) {
+		janus_dtls_srtp_established(dtls);
+	} else if(g_atomic_int_compare_and_exchange(&dtls->established, 0, 1)) {
+		/* The handshake is over: the rest of the setup (SRTP contexts, SCTP,
+		 * notifications) must happen on the loop the handle belongs to */
+		janus_dtls_srtp_post_established(dtls);
+	}
+}
+
+void janus_dtls_srtp_incoming_msg(janus_dtls_srtp *dtls, char *buf, uint16_t len) {
+	if(dtls == NULL) {
+		JANUS_LOG(LOG_ERR, "No DTLS-SRTP stack, no incoming message...\n");
+		return;
+	}
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)dtls->pc;
+	if(pc == NULL) {
+		JANUS_LOG(LOG_ERR, "No WebRTC PeerConnection, no DTLS...\n");
+		return;
+	}
+	janus_ice_handle *handle = pc->handle;
+	if(!handle || !handle->agent) {
+		JANUS_LOG(LOG_ERR, "No handle/agent, no DTLS...\n");
+		return;
+	}
+	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT)) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Alert already triggered, clearing up...\n", handle->handle_id);
+		return;
+	}
+	if(!dtls->ssl || !dtls->read_bio) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] No DTLS stuff for component %d in stream %d??\n", handle->handle_id, pc->component_id, pc->stream_id);
+		return;
+	}
+	if(dtls->dtls_started == 0) {
+		/* Handshake not started yet: maybe we're still waiting for the answer and the DTLS role? */
+		return;
+	}
+	if(dtls_workers != NULL && !dtls->ready) {
+		/* Still handshaking: let one of the crypto workers take care of this,
+		 * always the same one for the same stack, to preserve the order */
+		janus_dtls_job *job = janus_dtls_job_new(dtls, buf, len);
+		if(job == NULL)
+			return;
+		janus_dtls_worker *worker = &dtls_workers[(GPOINTER_TO_UINT(dtls) >> 4) % dtls_workers_count];
+		g_async_queue_push(worker->jobs, job);
+		gint depth = g_async_queue_length(worker->jobs);
+		janus_mutex_lock(&dtls_stats_mutex);
+		if(depth > dtls_stats.queue_max)
+			dtls_stats.queue_max = depth;
+		janus_mutex_unlock(&dtls_stats_mutex);
+		return;
+	}
+	janus_mutex_lock(&dtls->mutex);
+	janus_dtls_srtp_process(dtls, buf, len, FALSE);
+	janus_mutex_unlock(&dtls->mutex);
+}
+
+static void *janus_dtls_worker_thread(void *data) {
+	janus_dtls_worker *worker = (janus_dtls_worker *)data;
+	JANUS_LOG(LOG_VERB, "Joining DTLS worker #%u\n", worker->id);
+	janus_dtls_job *job = NULL;
+	while((job = g_async_queue_pop(worker->jobs)) != &exit_job) {
+		gint64 wait = janus_get_monotonic_time() - job->queued;
+		janus_mutex_lock(&dtls_stats_mutex);
+		dtls_stats.jobs++;
+		dtls_stats.wait_total += wait;
+		if(wait > dtls_stats.wait_max)
+			dtls_stats.wait_max = wait;
+		janus_mutex_unlock(&dtls_stats_mutex);
+		janus_dtls_srtp *dtls = job->dtls;
+		if(!g_atomic_int_get(&dtls->destroyed) &&
+				!janus_flags_is_set(&job->handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT)) {
+			janus_mutex_lock(&dtls->mutex);
+			janus_dtls_srtp_process(dtls, job->buf, job->len, TRUE);
+			janus_mutex_unlock(&dtls->mutex);
+		}
+		janus_dtls_job_free(job);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving DTLS worker #%u\n", worker->id);
+	return NULL;
+}
+
+int janus_dtls_workers_init(guint workers) {
+	if(workers == 0 || dtls_workers != NULL)
+		return 0;
+	dtls_workers = g_malloc0(workers * sizeof(janus_dtls_worker));
+	guint i = 0;
+	for(i=0; i<workers; i++) {
+		janus_dtls_worker *worker = &dtls_workers[i];
+		worker->id = i+1;
+		worker->jobs = g_async_queue_new_full((GDestroyNotify)janus_dtls_job_free);
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "dtls %u", worker->id);
+		worker->thread = g_thread_try_new(tname, janus_dtls_worker_thread, worker, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch DTLS worker #%u...\n",
+				error->code, error->message ? error->message : "??", worker->id);
+			g_error_free(error);
+			g_async_queue_unref(worker->jobs);
+			worker->jobs = NULL;
+			break;
 		}
 	}
+	dtls_workers_count = i;
+	if(dtls_workers_count == 0) {
+		g_free(dtls_workers);
+		dtls_workers = NULL;
+		return -1;
+	}
+	JANUS_LOG(LOG_INFO, "DTLS handshakes will be offloaded to %u worker(s)\n", dtls_workers_count);
+	return 0;
+}
+
+json_t *janus_dtls_workers_info(void) {
+	json_t *info = json_object();
+	guint i = 0;
+	gint depth = 0;
+	for(i=0; i<dtls_workers_count; i++)
+		depth += g_async_queue_length(dtls_workers[i].jobs);
+	json_object_set_new(info, "workers", json_integer(dtls_workers_count));
+	json_object_set_new(info, "queue_depth", json_integer(depth));
+	janus_mutex_lock(&dtls_stats_mutex);
+	json_object_set_new(info, "max_queue_depth", json_integer(dtls_stats.queue_max));
+	json_object_set_new(info, "jobs", json_integer(dtls_stats.jobs));
+	json_object_set_new(info, "avg_queue_wait", json_integer(dtls_stats.jobs ? dtls_stats.wait_total/(gint64)dtls_stats.jobs : 0));
+	json_object_set_new(info, "max_queue_wait", json_integer(dtls_stats.wait_max));
+	json_object_set_new(info, "handshakes", json_integer(dtls_stats.handshakes));
+	json_object_set_new(info, "avg_handshake_time",
+		json_integer(dtls_stats.handshakes ? dtls_stats.handshake_total/(gint64)dtls_stats.handshakes/1000 : 0));
+	json_object_set_new(info, "max_handshake_time", json_integer(dtls_stats.handshake_max/1000));
+	json_t *histogram = json_object();
+	for(i=0; i<G_N_ELEMENTS(dtls_histogram_buckets); i++) {
+		char bucket[16];
+		if(dtls_histogram_buckets[i] > 0)
+			g_snprintf(bucket, sizeof(bucket), "<%"SCNi64, dtls_histogram_buckets[i]);
+		else
+			g_snprintf(bucket, sizeof(bucket), ">=%"SCNi64, dtls_histogram_buckets[i-1]);
+		json_object_set_new(histogram, bucket, json_integer(dtls_stats.histogram[i]));
+	}
+	json_object_set_new(info, "handshake_histogram", histogram);
+	janus_mutex_unlock(&dtls_stats_mutex);
+	return info;
+}
+
+static void janus_dtls_workers_cleanup(void) {
+	guint i = 0;
+	for(i=0; i<dtls_workers_count; i++)
+		g_async_queue_push(dtls_workers[i].jobs, &exit_job);
+	for(i=0; i<dtls_workers_count; i++) {
+		g_thread_join(dtls_workers[i].thread);
+		g_async_queue_unref(dtls_workers[i].jobs);
+	}
+	g_free(dtls_workers);
+	dtls_workers = NULL;
+	dtls_workers_count = 0;
 }
 
 void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls) {
@@ -977,9 +1487,11 @@ void janus_dtls_srtp_send_alert(janus_dtls_srtp *dtls) {
 		return;
 	/* Send alert */
 	janus_refcount_increase(&dtls->ref);
+	janus_mutex_lock(&dtls->mutex);
 	if(dtls != NULL && dtls->ssl != NULL) {
 		SSL_shutdown(dtls->ssl);
 	}
+	janus_mutex_unlock(&dtls->mutex);
 	janus_refcount_decrease(&dtls->ref);
 }
 
@@ -1059,7 +1571,14 @@ void janus_dtls_sctp_data_ready(janus_dtls_srtp *dtls) {
 }
 
 void janus_dtls_wrap_sctp_data(janus_dtls_srtp *dtls, char *label, char *protocol, gboolean textdata, char *buf, int len) {
-	if(dtls == NULL || !dtls->ready || dtls->sctp == NULL || buf == NULL || len < 1)
+	if(dtls == NULL || !dtls->ready || buf == NULL || len < 1)
+		return;
+	if(dtls->sctp == NULL && janus_sctp_is_lazy()) {
+		/* First message from a plugin, create the association now */
+		if(janus_dtls_srtp_create_sctp(dtls) == 0)
+			janus_sctp_lazy_created();
+	}
+	if(dtls->sctp == NULL)
 		return;
 	janus_refcount_increase(&dtls->sctp->ref);
 	janus_sctp_send_data(dtls->sctp, label, protocol, textdata, buf, len);
@@ -1117,9 +1636,13 @@ gboolean janus_dtls_retry(gpointer stack) {
 		janus_ice_webrtc_hangup(handle, "DTLS timeout");
 		goto stoptimer;
 	}
+	/* If a DTLS worker is busy with this stack, we'll check again on the next iteration */
+	if(!janus_mutex_trylock(&dtls->mutex))
+		return TRUE;
 	struct timeval timeout = {0};
 	if(DTLSv1_get_timeout(dtls->ssl, &timeout) == 0) {
 		/* failed to get timeout. try again on next iter */
+		janus_mutex_unlock(&dtls->mutex);
 		return TRUE;
 	}
 	guint64 timeout_value = timeout.tv_sec*1000 + timeout.tv_usec/1000;
@@ -1134,11 +1657,13 @@ gboolean janus_dtls_retry(gpointer stack) {
 		if(res == -1 && SSL_get_error(dtls->ssl, res) != SSL_ERROR_WANT_WRITE) {
 			/* DTLSv1_handle_timeout returned an unrecoverable error, fail right away
 			 * Ref.: https://webrtc-review.googlesource.com/c/src/+/260100 */
+			janus_mutex_unlock(&dtls->mutex);
 			JANUS_LOG(LOG_ERR, "[%"SCNu64"] DTLSv1_handle_timeout failed...\n", handle->handle_id);
 			janus_ice_webrtc_hangup(handle, "DTLS error");
 			goto stoptimer;
 		}
 	}
+	janus_mutex_unlock(&dtls->mutex);
 	return TRUE;
 
 stoptimer:
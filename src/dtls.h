@@ -17,6 +17,7 @@
 
 #include <inttypes.h>
 #include <glib.h>
+#include <jansson.h>
 
 #include "rtp.h"
 #include "rtpsrtp.h"
@@ -39,6 +40,32 @@ const char *janus_get_ssl_version(void);
  * @returns 0 in case of success, a negative integer on errors */
 gint janus_dtls_srtp_init(const char *server_pem, const char *server_key, const char *password,
 	const char *ciphers, guint16 timeout, gboolean rsa_private_key, gboolean accept_selfsigned);
+/*! \brief Method to advertise the SRTP profiles in order of cost, as measured when starting
+ * \note By default, AEAD-AES-GCM profiles (when supported) are advertised first. This
+ * method reorders them according to the protect/unprotect costs measured on this machine,
+ * which means that, e.g., AES-GCM profiles will only be preferred if they're hardware-accelerated */
+void janus_dtls_srtp_prefer_fastest(void);
+/*! \brief Method to get the results of the SRTP profiles benchmark, for the info request
+ * @returns A JSON array with the per-packet protect/unprotect cost of each profile, in order of preference */
+json_t *janus_dtls_srtp_benchmarks_info(void);
+/*! \brief Method to offload DTLS handshakes to a pool of crypto workers
+ * \note Only the handshakes are offloaded: once a handshake is over, the
+ * SRTP setup and everything else happens on the loop of the handle
+ * @param[in] workers Number of workers to start (0 keeps handshakes on the loops)
+ * @returns 0 in case of success, a negative integer on errors */
+int janus_dtls_workers_init(guint workers);
+/*! \brief Method to get info on the DTLS workers and handshakes, for the Admin API
+ * @returns A JSON object with queue depth and handshake time statistics (including a histogram) */
+json_t *janus_dtls_workers_info(void);
+/*! \brief Method to keep a pool of pre-allocated DTLS stacks, refilled in the background
+ * \note When a PeerConnection needs a DTLS stack, one is taken from the pool
+ * if available, which means the SSL object and the BIOs are ready to be used
+ * @param[in] size Number of DTLS stacks to keep in the pool (0 disables the pool)
+ * @returns 0 in case of success, a negative integer on errors */
+int janus_dtls_pool_init(guint size);
+/*! \brief Method to get info on the pool of pre-allocated DTLS stacks, for the Admin API
+ * @returns A JSON object with the pool size, the stacks available and the pool hits/misses */
+json_t *janus_dtls_pool_info(void);
 /*! \brief Method to cleanup DTLS stuff before exiting */
 void janus_dtls_srtp_cleanup(void);
 /*! \brief Method to return a string representation (SHA-256) of the certificate fingerprint */
@@ -100,6 +127,10 @@ typedef struct janus_dtls_srtp {
 	/*! \brief SCTP association, if DataChannels are involved */
 	janus_sctp_association *sctp;
 #endif
+	/*! \brief Whether a DTLS worker completed the handshake, and notified the loop about it */
+	volatile gint established;
+	/*! \brief Mutex to serialize access to the SSL context, as handshakes may happen in a DTLS worker */
+	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
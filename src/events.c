@@ -35,62 +35,166 @@ static struct janus_event_types {
 
 static gboolean eventsenabled = FALSE;
 static char *server = NULL;
-static GHashTable *eventhandlers = NULL;
 
-static GAsyncQueue *events = NULL;
+/* Registered event handlers: handlers that didn't opt in to parallel
+ * delivery get their events serialized on a per-handler mutex */
+typedef struct janus_events_handler {
+	janus_eventhandler *handler;
+	janus_mutex mutex;
+} janus_events_handler;
+static janus_events_handler *handlers_list = NULL;
+static guint handlers_count = 0;
+
+/* Dispatchers: events are sharded by session ID, so that all the events
+ * related to the same session are always delivered in order, by the same thread */
+typedef struct janus_events_dispatcher {
+	guint id;
+	GAsyncQueue *events;
+	GThread *thread;
+} janus_events_dispatcher;
+#define JANUS_EVENTS_MAX_THREADS	16
+static janus_events_dispatcher *dispatchers = NULL;
+static guint dispatchers_count = 0;
 static json_t exit_event;
 
-static GThread *events_thread;
 void *janus_events_thread(void *data);
 
-int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers) {
+int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers, int threads) {
 	eventsenabled = enabled;
 	if(eventsenabled) {
-		events = g_async_queue_new();
 		if(server_name != NULL)
 			server = g_strdup(server_name);
-		eventhandlers = handlers;
-		/* We setup a thread for passing events to the handlers */
-		GError *error = NULL;
-		events_thread = g_thread_try_new("janus events thread", janus_events_thread, NULL, &error);
-		if(error != NULL) {
-			eventsenabled = FALSE;
-			g_free(server);
-			g_async_queue_unref(events);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Events handler thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
-			return -1;
+		/* Keep track of the handlers in an array, which is faster to go through */
+		handlers_count = handlers ? g_hash_table_size(handlers) : 0;
+		handlers_list = g_malloc0(sizeof(janus_events_handler) * (handlers_count ? handlers_count : 1));
+		if(handlers_count > 0) {
+			guint i = 0;
+			GHashTableIter iter;
+			gpointer value;
+			g_hash_table_iter_init(&iter, handlers);
+			while(g_hash_table_iter_next(&iter, NULL, &value)) {
+				handlers_list[i].handler = (janus_eventhandler *)value;
+				janus_mutex_init(&handlers_list[i].mutex);
+				i++;
+			}
+		}
+		/* We setup one or more threads for passing events to the handlers */
+		if(threads < 1)
+			threads = 1;
+		if(threads > JANUS_EVENTS_MAX_THREADS) {
+			JANUS_LOG(LOG_WARN, "Too many event dispatcher threads (%d), using %d\n", threads, JANUS_EVENTS_MAX_THREADS);
+			threads = JANUS_EVENTS_MAX_THREADS;
+		}
+		dispatchers = g_malloc0(sizeof(janus_events_dispatcher) * threads);
+		guint i = 0;
+		for(i=0; i<(guint)threads; i++) {
+			janus_events_dispatcher *dispatcher = &dispatchers[i];
+			dispatcher->id = i;
+			dispatcher->events = g_async_queue_new();
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "janus events %u", i);
+			GError *error = NULL;
+			dispatcher->thread = g_thread_try_new(tname, janus_events_thread, dispatcher, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Events handler thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				dispatchers_count = i+1;
+				janus_events_deinit();
+				return -1;
+			}
 		}
+		dispatchers_count = threads;
+		JANUS_LOG(LOG_INFO, "Dispatching events to handlers using %u thread(s)\n", dispatchers_count);
 	}
 	return 0;
 }
 
 void janus_events_deinit(void) {
 	eventsenabled = FALSE;
-	if(events != NULL) {
-		g_async_queue_push(events, &exit_event);
-	}
-	if(events_thread != NULL) {
-		g_thread_join(events_thread);
-		events_thread = NULL;
+	guint i = 0;
+	for(i=0; i<dispatchers_count; i++) {
+		if(dispatchers[i].thread != NULL) {
+			g_async_queue_push(dispatchers[i].events, &exit_event);
+			g_thread_join(dispatchers[i].thread);
+			dispatchers[i].thread = NULL;
+		}
+		if(dispatchers[i].events != NULL)
+			g_async_queue_unref(dispatchers[i].events);
+		dispatchers[i].events = NULL;
 	}
-	if(events != NULL)
-		g_async_queue_unref(events);
+	g_free(dispatchers);
+	dispatchers = NULL;
+	dispatchers_count = 0;
+	for(i=0; i<handlers_count; i++)
+		janus_mutex_destroy(&handlers_list[i].mutex);
+	g_free(handlers_list);
+	handlers_list = NULL;
+	handlers_count = 0;
 	g_free(server);
+	server = NULL;
 }
 
 gboolean janus_events_is_enabled(void) {
 	return eventsenabled;
 }
 
+gboolean janus_events_is_type_enabled(int type) {
+	if(!eventsenabled)
+		return FALSE;
+	guint i = 0;
+	for(i=0; i<handlers_count; i++) {
+		if(janus_flags_is_set(&handlers_list[i].handler->events_mask, type))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+void janus_events_media_stats_consumers(gboolean *json, gboolean *compact) {
+	gboolean want_json = FALSE, want_compact = FALSE;
+	guint i = 0;
+	for(i=0; eventsenabled && i<handlers_count; i++) {
+		janus_eventhandler *e = handlers_list[i].handler;
+		if(!janus_flags_is_set(&e->events_mask, JANUS_EVENT_TYPE_MEDIA))
+			continue;
+		if(e->incoming_media_stats != NULL)
+			want_compact = TRUE;
+		else
+			want_json = TRUE;
+	}
+	if(json)
+		*json = want_json;
+	if(compact)
+		*compact = want_compact;
+}
+
+void janus_events_notify_media_stats(const janus_eventhandler_media_stats *stats) {
+	if(!eventsenabled || stats == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<handlers_count; i++) {
+		janus_events_handler *h = &handlers_list[i];
+		janus_eventhandler *e = h->handler;
+		if(e->incoming_media_stats == NULL || !janus_flags_is_set(&e->events_mask, JANUS_EVENT_TYPE_MEDIA))
+			continue;
+		if(e->parallel_delivery) {
+			e->incoming_media_stats(stats);
+		} else {
+			janus_mutex_lock(&h->mutex);
+			e->incoming_media_stats(stats);
+			janus_mutex_unlock(&h->mutex);
+		}
+	}
+}
+
 void janus_events_notify_handlers(int type, int subtype, guint64 session_id, ...) {
 	/* This method has a variable list of arguments, depending on the event type */
 	va_list args;
 	va_start(args, session_id);
 
-	if(!eventsenabled || eventhandlers == NULL || g_hash_table_size(eventhandlers) == 0) {
-		/* Event handlers disabled, or no event handler plugins available: free resources, if needed */
+	if(!janus_events_is_type_enabled(type)) {
+		/* Event handlers disabled, or no event handler plugin interested in this
+		 * type of event: don't bother preparing it, and free resources, if needed */
 		if(type == JANUS_EVENT_TYPE_MEDIA || type == JANUS_EVENT_TYPE_WEBRTC) {
 			/* These events allocate a json_t object for their data, skip some arguments and unref it */
 			va_arg(args, guint64);
@@ -270,42 +374,47 @@ void janus_events_notify_handlers(int type, int subtype, guint64 session_id, ...
 		json_decref(event);
 		return;
 	}
-	/* Enqueue the event */
-	g_async_queue_push(events, event);
+	/* Enqueue the event on the dispatcher responsible for this session */
+	g_async_queue_push(dispatchers[session_id % dispatchers_count].events, event);
 }
 
 void *janus_events_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining Events handler thread\n");
+	janus_events_dispatcher *dispatcher = (janus_events_dispatcher *)data;
+	JANUS_LOG(LOG_VERB, "Joining Events handler thread #%u\n", dispatcher->id);
 	json_t *event = NULL;
 
 	while(eventsenabled) {
 		/* Any event in queue? */
-		event = g_async_queue_pop(events);
+		event = g_async_queue_pop(dispatcher->events);
 		if(event == &exit_event)
 			break;
 
 		/* Notify all interested handlers, increasing the event reference to make sure it's not lost because of errors */
 		int type = json_integer_value(json_object_get(event, "type"));
-		guint count = g_hash_table_size(eventhandlers);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, eventhandlers);
+		int subtype = json_integer_value(json_object_get(event, "subtype"));
+		guint i = 0;
 		json_incref(event);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_eventhandler *e = value;
+		for(i=0; i<handlers_count; i++) {
+			janus_events_handler *h = &handlers_list[i];
+			janus_eventhandler *e = h->handler;
 			if(e == NULL)
 				continue;
 			if(!janus_flags_is_set(&e->events_mask, type))
 				continue;
-			if(count == 1) {
-				/* Single event handler: pass this instance directly */
-				e->incoming_event(event);
+			if(type == JANUS_EVENT_TYPE_MEDIA && subtype == JANUS_EVENT_SUBTYPE_MEDIA_STATS && e->incoming_media_stats != NULL)
+				continue;	/* This handler gets media stats via janus_events_notify_media_stats */
+			/* With multiple event handlers, that may modify the event, we pass a copy */
+			json_t *target = (handlers_count == 1) ? event : json_deep_copy(event);
+			if(e->parallel_delivery) {
+				/* This handler can receive events from different threads at the same time */
+				e->incoming_event(target);
 			} else {
-				/* Multiple event handlers, that may modify the event: pass a copy */
-				json_t *copy = json_deep_copy(event);
-				e->incoming_event(copy);
-				json_decref(copy);
+				janus_mutex_lock(&h->mutex);
+				e->incoming_event(target);
+				janus_mutex_unlock(&h->mutex);
 			}
+			if(target != event)
+				json_decref(target);
 		}
 		json_decref(event);
 
@@ -314,12 +423,12 @@ void *janus_events_thread(void *data) {
 	}
 
 	/* Cleanup pending events */
-	while((event = g_async_queue_try_pop(events)) != NULL) {
+	while((event = g_async_queue_try_pop(dispatcher->events)) != NULL) {
 		if(event != &exit_event)
 			json_decref(event);
 	}
 
-	JANUS_LOG(LOG_VERB, "Leaving Events handler thread\n");
+	JANUS_LOG(LOG_VERB, "Leaving Events handler thread #%u\n", dispatcher->id);
 	return NULL;
 }
 
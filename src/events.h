@@ -20,8 +20,11 @@
  * @param[in] enabled Whether broadcasting events should be supported at all
  * @param[in] server_name The name of this server, to be added to all events
  * @param[in] handlers Map of all registered event handlers
+ * @param[in] threads Number of threads to dispatch events to handlers with:
+ * events are sharded on threads by session ID, so all events related to
+ * the same session are still always notified in order
  * @returns 0 on success, a negative integer otherwise */
-int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers);
+int janus_events_init(gboolean enabled, char *server_name, GHashTable *handlers, int threads);
 
 /*! \brief De-initialize the event handlers broadcaster */
 void janus_events_deinit(void);
@@ -30,6 +33,23 @@ void janus_events_deinit(void);
  * @returns TRUE if they're enabled, FALSE if not */
 gboolean janus_events_is_enabled(void);
 
+/*! \brief Quick method to check whether any event handler is interested in a specific type of event
+ * @note This can be used to avoid preparing events that no handler would receive anyway
+ * @param[in] type Type of the event
+ * @returns TRUE if at least one handler is interested, FALSE if not (or if event handlers are disabled) */
+gboolean janus_events_is_type_enabled(int type);
+
+/*! \brief Check how media statistics should be prepared for handlers interested in them
+ * @param[out] json Whether any handler needs media stats events as JSON objects
+ * @param[out] compact Whether any handler supports compact media stats via janus_events_notify_media_stats */
+void janus_events_media_stats_consumers(gboolean *json, gboolean *compact);
+
+/*! \brief Notify compact media statistics to all the handlers that support them
+ * @note Handlers that don't support compact statistics won't receive anything:
+ * for them, a media stats event must be notified via janus_events_notify_handlers
+ * @param[in] stats The media statistics to notify */
+void janus_events_notify_media_stats(const janus_eventhandler_media_stats *stats);
+
 /*! \brief Notify an event to all interested handlers
  * @note According to the type of event to notify, different arguments may
  * be required and used in order to prepare the actual object to pass to handlers.
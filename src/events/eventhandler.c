@@ -0,0 +1,275 @@
+/*! \file   eventhandler.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Modular Janus event handlers
+ * \details  This file contains helpers event handler plugins can use to
+ * queue events and deliver them in batches, without blocking the Janus
+ * core when the backend they send events to can't keep up.
+ *
+ * \ingroup eventhandlerapi
+ * \ref eventhandlerapi
+ */
+
+#include "eventhandler.h"
+#include "../debug.h"
+
+/* Defaults, which match how handlers used to group events */
+#define JANUS_EVENTHANDLER_QUEUE_BATCH_SIZE		100
+
+struct janus_eventhandler_queue {
+	/* Name of the owner of the queue, for logging purposes */
+	char *name;
+	/* Queued events */
+	GQueue events;
+	/* Settings: 0 means unbounded queue/no linger */
+	guint max_size;
+	janus_eventhandler_queue_policy policy;
+	guint batch_size;
+	gint64 linger;
+	/* Statistics */
+	guint64 queued, dropped, batches;
+	/* Whether the queue has been stopped */
+	gboolean stopped;
+	janus_mutex mutex;
+	janus_condition cond;
+};
+
+static const char *janus_eventhandler_queue_policy_str(janus_eventhandler_queue_policy policy) {
+	switch(policy) {
+		case JANUS_EVENTHANDLER_QUEUE_DROP_OLDEST:
+			return "drop_oldest";
+		case JANUS_EVENTHANDLER_QUEUE_DROP_NEWEST:
+			return "drop_newest";
+		default:
+			break;
+	}
+	return NULL;
+}
+
+static gboolean janus_eventhandler_queue_policy_parse(const char *value, janus_eventhandler_queue_policy *policy) {
+	if(value == NULL || policy == NULL)
+		return FALSE;
+	if(!strcasecmp(value, "drop_oldest")) {
+		*policy = JANUS_EVENTHANDLER_QUEUE_DROP_OLDEST;
+		return TRUE;
+	} else if(!strcasecmp(value, "drop_newest")) {
+		*policy = JANUS_EVENTHANDLER_QUEUE_DROP_NEWEST;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* Get rid of the oldest events until we're within the provided limit: must be called with the mutex locked */
+static guint janus_eventhandler_queue_trim_locked(janus_eventhandler_queue *queue, guint max) {
+	guint dropped = 0;
+	while(g_queue_get_length(&queue->events) > max) {
+		json_decref((json_t *)g_queue_pop_head(&queue->events));
+		dropped++;
+	}
+	queue->dropped += dropped;
+	return dropped;
+}
+
+janus_eventhandler_queue *janus_eventhandler_queue_new(const char *name) {
+	janus_eventhandler_queue *queue = g_malloc0(sizeof(janus_eventhandler_queue));
+	queue->name = g_strdup(name ? name : "eventhandler");
+	g_queue_init(&queue->events);
+	queue->policy = JANUS_EVENTHANDLER_QUEUE_DROP_OLDEST;
+	queue->batch_size = JANUS_EVENTHANDLER_QUEUE_BATCH_SIZE;
+	janus_mutex_init(&queue->mutex);
+	janus_condition_init(&queue->cond);
+	return queue;
+}
+
+void janus_eventhandler_queue_configure(janus_eventhandler_queue *queue, janus_config *config, janus_config_container *category) {
+	if(queue == NULL || config == NULL)
+		return;
+	janus_mutex_lock(&queue->mutex);
+	janus_config_item *item = janus_config_get(config, category, janus_config_type_item, "queue_size");
+	if(item && item->value) {
+		int size = atoi(item->value);
+		if(size < 0) {
+			JANUS_LOG(LOG_WARN, "%s: invalid queue_size value '%s', the queue will be unbounded\n", queue->name, item->value);
+			size = 0;
+		}
+		queue->max_size = size;
+	}
+	item = janus_config_get(config, category, janus_config_type_item, "queue_policy");
+	if(item && item->value && !janus_eventhandler_queue_policy_parse(item->value, &queue->policy)) {
+		JANUS_LOG(LOG_WARN, "%s: invalid queue_policy value '%s', using '%s'\n", queue->name,
+			item->value, janus_eventhandler_queue_policy_str(queue->policy));
+	}
+	item = janus_config_get(config, category, janus_config_type_item, "batch_size");
+	if(item && item->value) {
+		int size = atoi(item->value);
+		if(size <= 0) {
+			JANUS_LOG(LOG_WARN, "%s: invalid batch_size value '%s', using %d\n", queue->name,
+				item->value, JANUS_EVENTHANDLER_QUEUE_BATCH_SIZE);
+			size = JANUS_EVENTHANDLER_QUEUE_BATCH_SIZE;
+		}
+		queue->batch_size = size;
+	}
+	item = janus_config_get(config, category, janus_config_type_item, "batch_linger");
+	if(item && item->value) {
+		int linger = atoi(item->value);
+		if(linger < 0) {
+			JANUS_LOG(LOG_WARN, "%s: invalid batch_linger value '%s', disabling it\n", queue->name, item->value);
+			linger = 0;
+		}
+		queue->linger = (gint64)linger * G_TIME_SPAN_MILLISECOND;
+	}
+	if(queue->max_size > 0)
+		janus_eventhandler_queue_trim_locked(queue, queue->max_size);
+	JANUS_LOG(LOG_VERB, "%s: queue size %u (%s), batches of up to %u events, %"SCNi64"ms linger\n", queue->name,
+		queue->max_size, janus_eventhandler_queue_policy_str(queue->policy), queue->batch_size,
+		queue->linger / G_TIME_SPAN_MILLISECOND);
+	janus_mutex_unlock(&queue->mutex);
+}
+
+void janus_eventhandler_queue_tweak(janus_eventhandler_queue *queue, json_t *request) {
+	if(queue == NULL || request == NULL)
+		return;
+	janus_mutex_lock(&queue->mutex);
+	json_t *value = json_object_get(request, "queue_size");
+	if(value && json_is_integer(value) && json_integer_value(value) >= 0)
+		queue->max_size = json_integer_value(value);
+	value = json_object_get(request, "queue_policy");
+	if(value && !janus_eventhandler_queue_policy_parse(json_string_value(value), &queue->policy)) {
+		JANUS_LOG(LOG_WARN, "%s: invalid queue_policy value, using '%s'\n", queue->name,
+			janus_eventhandler_queue_policy_str(queue->policy));
+	}
+	value = json_object_get(request, "batch_size");
+	if(value && json_is_integer(value) && json_integer_value(value) > 0)
+		queue->batch_size = json_integer_value(value);
+	value = json_object_get(request, "batch_linger");
+	if(value && json_is_integer(value) && json_integer_value(value) >= 0)
+		queue->linger = json_integer_value(value) * G_TIME_SPAN_MILLISECOND;
+	if(queue->max_size > 0)
+		janus_eventhandler_queue_trim_locked(queue, queue->max_size);
+	/* The settings may affect a batch that's lingering */
+	janus_condition_signal(&queue->cond);
+	janus_mutex_unlock(&queue->mutex);
+}
+
+gboolean janus_eventhandler_queue_push(janus_eventhandler_queue *queue, json_t *event) {
+	if(queue == NULL || event == NULL)
+		return FALSE;
+	janus_mutex_lock(&queue->mutex);
+	if(queue->stopped) {
+		janus_mutex_unlock(&queue->mutex);
+		json_decref(event);
+		return FALSE;
+	}
+	if(queue->max_size > 0 && g_queue_get_length(&queue->events) >= queue->max_size) {
+		if(queue->policy == JANUS_EVENTHANDLER_QUEUE_DROP_NEWEST) {
+			queue->dropped++;
+			janus_mutex_unlock(&queue->mutex);
+			json_decref(event);
+			return FALSE;
+		}
+		janus_eventhandler_queue_trim_locked(queue, queue->max_size - 1);
+	}
+	g_queue_push_tail(&queue->events, event);
+	queue->queued++;
+	/* Only wake the consumer up when it may be waiting for this: that is,
+	 * when the queue was empty, or when a lingering batch is now complete */
+	guint length = g_queue_get_length(&queue->events);
+	if(length == 1 || length >= queue->batch_size)
+		janus_condition_signal(&queue->cond);
+	janus_mutex_unlock(&queue->mutex);
+	return TRUE;
+}
+
+/* Dequeue events, in a batch or not: must be called with the mutex locked */
+static json_t *janus_eventhandler_queue_dequeue_locked(janus_eventhandler_queue *queue, gboolean batch) {
+	if(g_queue_is_empty(&queue->events))
+		return NULL;
+	if(!batch)
+		return (json_t *)g_queue_pop_head(&queue->events);
+	json_t *events = json_array();
+	guint count = 0;
+	json_t *event = NULL;
+	while(count < queue->batch_size && (event = g_queue_pop_head(&queue->events)) != NULL) {
+		json_array_append_new(events, event);
+		count++;
+	}
+	queue->batches++;
+	return events;
+}
+
+json_t *janus_eventhandler_queue_pop(janus_eventhandler_queue *queue, gboolean batch) {
+	if(queue == NULL)
+		return NULL;
+	janus_mutex_lock(&queue->mutex);
+	while(!queue->stopped && g_queue_is_empty(&queue->events))
+		janus_condition_wait(&queue->cond, &queue->mutex);
+	if(batch && queue->linger > 0) {
+		/* Give the batch some time to fill, unless it's full already */
+		gint64 end = g_get_monotonic_time() + queue->linger;
+		while(!queue->stopped && g_queue_get_length(&queue->events) < queue->batch_size) {
+			janus_condition_wait_until(&queue->cond, &queue->mutex, end);
+			if(g_get_monotonic_time() >= end)
+				break;
+		}
+	}
+	json_t *events = queue->stopped ? NULL : janus_eventhandler_queue_dequeue_locked(queue, batch);
+	janus_mutex_unlock(&queue->mutex);
+	return events;
+}
+
+json_t *janus_eventhandler_queue_try_pop(janus_eventhandler_queue *queue, gboolean batch) {
+	if(queue == NULL)
+		return NULL;
+	janus_mutex_lock(&queue->mutex);
+	json_t *events = queue->stopped ? NULL : janus_eventhandler_queue_dequeue_locked(queue, batch);
+	janus_mutex_unlock(&queue->mutex);
+	return events;
+}
+
+guint janus_eventhandler_queue_trim(janus_eventhandler_queue *queue, guint max) {
+	if(queue == NULL)
+		return 0;
+	janus_mutex_lock(&queue->mutex);
+	guint dropped = janus_eventhandler_queue_trim_locked(queue, max);
+	janus_mutex_unlock(&queue->mutex);
+	return dropped;
+}
+
+json_t *janus_eventhandler_queue_stats(janus_eventhandler_queue *queue) {
+	if(queue == NULL)
+		return NULL;
+	json_t *stats = json_object();
+	janus_mutex_lock(&queue->mutex);
+	json_object_set_new(stats, "queue_size", json_integer(queue->max_size));
+	json_object_set_new(stats, "queue_policy", json_string(janus_eventhandler_queue_policy_str(queue->policy)));
+	json_object_set_new(stats, "batch_size", json_integer(queue->batch_size));
+	json_object_set_new(stats, "batch_linger", json_integer(queue->linger / G_TIME_SPAN_MILLISECOND));
+	json_object_set_new(stats, "pending", json_integer(g_queue_get_length(&queue->events)));
+	json_object_set_new(stats, "queued", json_integer(queue->queued));
+	json_object_set_new(stats, "dropped", json_integer(queue->dropped));
+	json_object_set_new(stats, "batches", json_integer(queue->batches));
+	janus_mutex_unlock(&queue->mutex);
+	return stats;
+}
+
+void janus_eventhandler_queue_stop(janus_eventhandler_queue *queue) {
+	if(queue == NULL)
+		return;
+	janus_mutex_lock(&queue->mutex);
+	queue->stopped = TRUE;
+	janus_condition_broadcast(&queue->cond);
+	janus_mutex_unlock(&queue->mutex);
+}
+
+void janus_eventhandler_queue_destroy(janus_eventhandler_queue *queue) {
+	if(queue == NULL)
+		return;
+	janus_eventhandler_queue_stop(queue);
+	janus_mutex_lock(&queue->mutex);
+	janus_eventhandler_queue_trim_locked(queue, 0);
+	janus_mutex_unlock(&queue->mutex);
+	janus_mutex_destroy(&queue->mutex);
+	janus_condition_destroy(&queue->cond);
+	g_free(queue->name);
+	g_free(queue);
+}
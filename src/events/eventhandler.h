@@ -79,6 +79,18 @@ janus_eventhandler *create(void) {
  * uses (relying on the \c janus_config helpers for the purpose) but
  * again, if you prefer a different format (XML, JSON, etc.) that's up to you.
  *
+ * Since events must not be handled in the \c incoming_event() callback,
+ * handlers will typically queue them and deliver them from a thread of
+ * their own. To make this easier, a \c janus_eventhandler_queue helper
+ * is available: it's a queue that can be bounded (dropping events
+ * according to a configurable policy when the backend can't keep up,
+ * rather than growing forever), and that returns events in batches of
+ * a configurable size, optionally waiting a little for a batch to fill
+ * up. All the event handler plugins we made available use it, and can
+ * be configured via the \c queue_size , \c queue_policy , \c batch_size
+ * and \c batch_linger properties: the queue settings and counters for
+ * queued and dropped events can be retrieved with a \c stats request.
+ *
  * \ingroup eventhandlerapi
  * \ref eventhandlerapi
  */
@@ -97,11 +109,13 @@ janus_eventhandler *create(void) {
 #include <glib.h>
 #include <jansson.h>
 
+#include "../config.h"
+#include "../mutex.h"
 #include "../utils.h"
 
 
 /*! \brief Version of the API, to match the one event handler plugins were compiled against */
-#define JANUS_EVENTHANDLER_API_VERSION	3
+#define JANUS_EVENTHANDLER_API_VERSION	4
 
 /*! \brief Initialization of all event handler plugin properties to NULL
  *
@@ -171,6 +185,12 @@ static janus_eventhandler janus_fake_eventhandler_plugin =
 #define JANUS_EVENT_SUBTYPE_CORE_STARTUP	1
 /*! \brief Core event subtypes: shutdown */
 #define JANUS_EVENT_SUBTYPE_CORE_SHUTDOWN	2
+/*! \brief Core event subtypes: static event loop statistics */
+#define JANUS_EVENT_SUBTYPE_CORE_LOOP_STATS	3
+/*! \brief Core event subtypes: packet tracing statistics */
+#define JANUS_EVENT_SUBTYPE_CORE_PACKET_TRACE	4
+/*! \brief Core event subtypes: drain status */
+#define JANUS_EVENT_SUBTYPE_CORE_DRAIN	5
 /*! \brief WebRTC event subtypes: ICE state */
 #define JANUS_EVENT_SUBTYPE_WEBRTC_ICE		1
 /*! \brief WebRTC event subtypes: local candidate */
@@ -203,9 +223,52 @@ static janus_eventhandler janus_fake_eventhandler_plugin =
 		.get_package = NULL,					\
 		.incoming_event = NULL,					\
 		.events_mask = JANUS_EVENT_TYPE_NONE,	\
+		.parallel_delivery = FALSE,				\
+		.incoming_media_stats = NULL,			\
 		## __VA_ARGS__ }
 
 
+/*! \brief Media statistics, as notified to handlers that implement \c incoming_media_stats
+ * \details These are the same statistics media stats events contain, but
+ * in a compact form that doesn't require any JSON object to be prepared */
+typedef struct janus_eventhandler_media_stats {
+	/*! \brief Janus session and handle identifiers these statistics refer to */
+	guint64 session_id, handle_id;
+	/*! \brief Opaque ID of the handle, if any */
+	const char *opaque_id;
+	/*! \brief Media ID and index of the media these statistics refer to */
+	const char *mid;
+	int mindex;
+	/*! \brief Type of media ("audio", "video", "data", or "video-sim1" and "video-sim2" for simulcast substreams) */
+	const char *media;
+	/*! \brief Simulcast substream (0 for the base substream, or if simulcast isn't used) */
+	int substream;
+	/*! \brief Whether this is an audio or video stream: if not, only the packets and bytes counters are valid */
+	gboolean rtp;
+	/*! \brief Codec in use, if known */
+	const char *codec;
+	/*! \brief RTP timebase */
+	uint32_t base;
+	/*! \brief Round trip time, and related values (only for the base substream, 0 otherwise) */
+	uint32_t rtt, rtt_ntp, rtt_lsr, rtt_dlsr;
+	/*! \brief Lost packets, locally and as reported by the peer */
+	int32_t lost, lost_by_remote;
+	/*! \brief Jitter, locally and as reported by the peer */
+	uint32_t jitter_local, jitter_remote;
+	/*! \brief Link quality indicators */
+	uint32_t in_link_quality, in_media_link_quality, out_link_quality, out_media_link_quality;
+	/*! \brief Packets and bytes counters */
+	guint32 packets_received, packets_sent;
+	guint64 bytes_received, bytes_sent;
+	/*! \brief Bytes exchanged in the last second */
+	guint32 bytes_received_lastsec, bytes_sent_lastsec;
+	/*! \brief NACKs and retransmissions */
+	guint32 nacks_received, nacks_sent, retransmissions_received;
+	/*! \brief Last REMB bitrate, if any (0 otherwise) */
+	uint32_t remb_bitrate;
+} janus_eventhandler_media_stats;
+
+
 /*! \brief The event handler plugin session and callbacks interface */
 typedef struct janus_eventhandler janus_eventhandler;
 
@@ -272,9 +335,101 @@ struct janus_eventhandler {
 
 	/*! \brief Mask of events this handler is interested in, as a janus_flags object */
 	janus_flags events_mask;
+	/*! \brief Whether \c incoming_event can be invoked by different threads at the same time
+	 * \details The core may dispatch events using multiple threads (events related to the
+	 * same session are always notified in order by the same thread, though): unless this
+	 * is set to TRUE, the core will make sure \c incoming_event is never called concurrently */
+	gboolean parallel_delivery;
+	/*! \brief Optional method to receive media statistics in a compact form
+	 * \details If implemented, handlers interested in media events will get
+	 * statistics this way, rather than as media stats events via \c incoming_event,
+	 * which saves the core from preparing a JSON object for them. Notice that this
+	 * is called from the thread handling the PeerConnection: as such, just copy
+	 * what you need and handle it somewhere else, as \c stats is only valid
+	 * for the duration of the call.
+	 * @param[in] stats The media statistics */
+	void (* const incoming_media_stats)(const janus_eventhandler_media_stats *stats);
 };
 
 /*! \brief The hook that event handler plugins need to implement to be created from the Janus core */
 typedef janus_eventhandler* create_e(void);
 
+/*! \brief What to do when an event handler queue is full */
+typedef enum janus_eventhandler_queue_policy {
+	/*! \brief Drop the oldest queued event to make room for the new one */
+	JANUS_EVENTHANDLER_QUEUE_DROP_OLDEST = 0,
+	/*! \brief Drop the new event, and keep what's already queued */
+	JANUS_EVENTHANDLER_QUEUE_DROP_NEWEST,
+} janus_eventhandler_queue_policy;
+
+/*! \brief Bounded queue of events, with batching support
+ * \details Event handler plugins can use this queue to decouple the
+ * \c incoming_event callback from their own delivery thread. The queue
+ * can be bounded, in which case events are dropped according to the
+ * configured policy when the delivery thread can't keep up, and can
+ * return events in batches: a batch is returned as soon as \c batch_size
+ * events are available, or when the \c linger time since the first
+ * event of the batch was dequeued is elapsed, whichever comes first.
+ * All settings can be changed at runtime (e.g., via an Admin API tweak request).
+ * \note The structure is opaque: use the helpers below to interact with it. */
+typedef struct janus_eventhandler_queue janus_eventhandler_queue;
+
+/*! \brief Create a new event handler queue
+ * \details The queue is created unbounded, with batches of up to 100 events
+ * and no linger time, which mimics the way handlers used to group events.
+ * @param[in] name Name of the owner of the queue, for logging purposes
+ * @returns A pointer to the new queue */
+janus_eventhandler_queue *janus_eventhandler_queue_new(const char *name);
+/*! \brief Configure an event handler queue using the \c queue_size ,
+ * \c queue_policy , \c batch_size and \c batch_linger properties
+ * in the provided category of an event handler configuration
+ * @param[in] queue The queue to configure
+ * @param[in] config The event handler configuration
+ * @param[in] category The category containing the properties */
+void janus_eventhandler_queue_configure(janus_eventhandler_queue *queue, janus_config *config, janus_config_container *category);
+/*! \brief Change the settings of an event handler queue using the \c queue_size ,
+ * \c queue_policy , \c batch_size and \c batch_linger properties of
+ * an Admin API request, if present
+ * @param[in] queue The queue to update
+ * @param[in] request Jansson object containing the request */
+void janus_eventhandler_queue_tweak(janus_eventhandler_queue *queue, json_t *request);
+/*! \brief Add an event to the queue, dropping events if the queue is full
+ * \note The queue takes ownership of the reference to the event, so make
+ * sure you \c json_incref it first if it's the one passed by the core
+ * @param[in] queue The queue to add the event to
+ * @param[in] event The event to add
+ * @returns TRUE if the event was queued, FALSE if it was dropped */
+gboolean janus_eventhandler_queue_push(janus_eventhandler_queue *queue, json_t *event);
+/*! \brief Wait for events to be available in the queue, and return them
+ * \details If \c batch is TRUE, a Jansson array of up to \c batch_size events
+ * is returned, waiting up to the linger time for the batch to fill; otherwise,
+ * a single event is returned
+ * @param[in] queue The queue to get events from
+ * @param[in] batch Whether a batch of events should be returned, rather than a single event
+ * @returns The event (or array of events), or NULL if the queue was stopped */
+json_t *janus_eventhandler_queue_pop(janus_eventhandler_queue *queue, gboolean batch);
+/*! \brief Same as janus_eventhandler_queue_pop, but without waiting:
+ * the linger time is ignored, and whatever is queued is returned
+ * @param[in] queue The queue to get events from
+ * @param[in] batch Whether a batch of events should be returned, rather than a single event
+ * @returns The event (or array of events), or NULL if the queue is empty or was stopped */
+json_t *janus_eventhandler_queue_try_pop(janus_eventhandler_queue *queue, gboolean batch);
+/*! \brief Drop the oldest events until the queue contains at most \c max events
+ * @note Dropped events are accounted for in the queue statistics
+ * @param[in] queue The queue to trim
+ * @param[in] max The maximum number of events to keep
+ * @returns The number of events that were dropped */
+guint janus_eventhandler_queue_trim(janus_eventhandler_queue *queue, guint max);
+/*! \brief Get the current settings and statistics of a queue
+ * @param[in] queue The queue to inspect
+ * @returns A Jansson object with the settings and statistics */
+json_t *janus_eventhandler_queue_stats(janus_eventhandler_queue *queue);
+/*! \brief Stop a queue, waking up the thread waiting on it, if any: after
+ * this, the queue will drop new events, and popping will always return NULL
+ * @param[in] queue The queue to stop */
+void janus_eventhandler_queue_stop(janus_eventhandler_queue *queue);
+/*! \brief Destroy a queue, getting rid of all the events still in it
+ * @param[in] queue The queue to destroy */
+void janus_eventhandler_queue_destroy(janus_eventhandler_queue *queue);
+
 #endif
@@ -74,7 +74,9 @@ static janus_eventhandler janus_gelfevh =
 		.incoming_event = janus_gelfevh_incoming_event,
 		.handle_request = janus_gelfevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
 /* Plugin creator */
@@ -97,13 +99,7 @@ static janus_mutex evh_mutex;
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
 
 /* Queue of events to handle */
-static GAsyncQueue *events = NULL;
-static json_t exit_event;
-static void janus_gelfevh_event_free(json_t *event) {
-	if(!event || event == &exit_event)
-		return;
-	json_decref(event);
-}
+static janus_eventhandler_queue *events = NULL;
 
 /* GELF backend to send the events to */
 static char *backend = NULL;
@@ -127,7 +123,11 @@ static struct janus_json_parameter tweak_parameters[] = {
 	{"backend", JSON_STRING, 0},
 	{"port", JSON_STRING, 0},
 	{"max_gelf_msg_len", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
-	{"janus_gelfevh_socket_type", JSON_STRING, 0}
+	{"janus_gelfevh_socket_type", JSON_STRING, 0},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_GELFEVH_ERROR_INVALID_REQUEST		411
@@ -343,6 +343,9 @@ int janus_gelfevh_init(const char *config_path) {
 		item = janus_config_get(config, config_general, janus_config_type_item, "events");
 		if(item && item->value)
 			janus_events_edit_events_mask(item->value, &janus_gelfevh.events_mask);
+		/* Queue and batching settings */
+		events = janus_eventhandler_queue_new(JANUS_GELFEVH_NAME);
+		janus_eventhandler_queue_configure(events, config, config_general);
 		/* Compact, so no spaces between separators */
 		json_format = JSON_COMPACT | JSON_PRESERVE_ORDER;
 
@@ -379,11 +382,11 @@ done:
 
 	/* Check if connection failed. Error is logged in janus_gelfevh_connect function */
 	if(janus_gelfevh_connect() < 0 ) {
+		janus_eventhandler_queue_destroy(events);
+		events = NULL;
 		return -1;
 	}
 
-	/* Initialize the events queue */
-	events = g_async_queue_new_full((GDestroyNotify) janus_gelfevh_event_free);
 	janus_mutex_init(&evh_mutex);
 
 	g_atomic_int_set(&initialized, 1);
@@ -407,13 +410,13 @@ void janus_gelfevh_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(events, &exit_event);
+	janus_eventhandler_queue_stop(events);
 	if(handler_thread != NULL) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
 
-	g_async_queue_unref(events);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 
 	g_free(backend);
@@ -469,7 +472,7 @@ void janus_gelfevh_incoming_event(json_t *event) {
 	 * when the event actually happened on this machine, so that, if relevant, we can compute
 	 * any delay in the actual event processing ourselves. */
 	json_incref(event);
-	g_async_queue_push(events, event);
+	janus_eventhandler_queue_push(events, event);
 
 }
 
@@ -480,6 +483,7 @@ json_t *janus_gelfevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_GELFEVH_ERROR_MISSING_ELEMENT, JANUS_GELFEVH_ERROR_INVALID_ELEMENT);
@@ -547,6 +551,11 @@ json_t *janus_gelfevh_handle_request(json_t *request) {
 			port = g_strdup(req_port);
 		}
 		janus_mutex_unlock(&evh_mutex);
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_GELFEVH_ERROR_INVALID_REQUEST;
@@ -559,6 +568,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -571,17 +582,17 @@ plugin_response:
 /* Thread to handle incoming events */
 static void *janus_gelfevh_handler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining GelfEventHandler handler thread\n");
-	json_t *event = NULL;
+	json_t *batch = NULL, *event = NULL;
+	size_t index = 0;
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		event = g_async_queue_pop(events);
-		if(event == NULL)
-			continue;
-		if(event == &exit_event)
+		/* GELF messages contain a single event, but we still dequeue them in batches */
+		batch = janus_eventhandler_queue_pop(events, TRUE);
+		if(batch == NULL)
 			break;
 
-		/* Handle event */
-		while(TRUE) {
+		/* Handle events */
+		json_array_foreach(batch, index, event) {
 			/* Add custom fields */
 			json_t *output = json_object();
 
@@ -607,10 +618,8 @@ static void *janus_gelfevh_handler(void *data) {
 			json_decref(output);
 			free(message);
 			output = NULL;
-
-			break;
 		}
-		json_decref(event);
+		json_decref(batch);
 	}
 	JANUS_LOG(LOG_VERB, "Leaving GELF Event handler thread\n");
 	return NULL;
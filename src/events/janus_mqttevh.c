@@ -63,21 +63,13 @@ static janus_eventhandler janus_mqttevh =
 		.incoming_event = janus_mqttevh_incoming_event,
 		.handle_request = janus_mqttevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
-/* Fix an exit event */
-static json_t exit_event;
-
-/* Destruction of events */
-static void janus_mqttevh_event_free(json_t *event) {
-	if(!event || event == &exit_event)
-		return;
-	json_decref(event);
-}
-
 /* Queue of events to handle */
-static GAsyncQueue *events = NULL;
+static janus_eventhandler_queue *events = NULL;
 
 /* Plugin creator */
 janus_eventhandler *create(void) {
@@ -125,7 +117,11 @@ static struct janus_json_parameter request_parameters[] = {
 	{"request", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
 };
 static struct janus_json_parameter tweak_parameters[] = {
-	{"events", JSON_STRING, 0}
+	{"events", JSON_STRING, 0},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_MQTTEVH_ERROR_INVALID_REQUEST		411
@@ -499,6 +495,8 @@ static void janus_mqttevh_client_disconnect_success_impl(void *context) {
 
 	JANUS_LOG(LOG_INFO, "MQTT EVH client has been successfully disconnected from %s. Destroying the client...\n", ctx->connect.url);
 	janus_mqttevh_client_destroy_context(&ctx);
+	janus_eventhandler_queue_destroy(events);
+	events = NULL;
 }
 
 /* Callback for MQTT disconnect failure */
@@ -800,6 +798,10 @@ static int janus_mqttevh_init(const char *config_path) {
 	if(item && item->value)
 		janus_events_edit_events_mask(item->value, &janus_mqttevh.events_mask);
 
+	/* Queue and batching settings */
+	events = janus_eventhandler_queue_new(JANUS_MQTTEVH_NAME);
+	janus_eventhandler_queue_configure(events, config, config_general);
+
 	/* Connect configuration */
 	keep_alive_interval_item = janus_config_get(config, config_general, janus_config_type_item, "keep_alive_interval");
 	ctx->connect.keep_alive_interval = (keep_alive_interval_item && keep_alive_interval_item->value) ?
@@ -1053,8 +1055,6 @@ static int janus_mqttevh_init(const char *config_path) {
 		goto error;
 	}
 
-	/* Initialize the events queue */
-	events = g_async_queue_new_full((GDestroyNotify)janus_mqttevh_event_free);
 	g_atomic_int_set(&initialized, 1);
 
 	/* Create the event handler thread */
@@ -1094,15 +1094,15 @@ static void janus_mqttevh_destroy(void) {
 	}
 	g_atomic_int_set(&stopping, 1);
 
-	/* Put the exit event on the queue to stop the other thread */
-	g_async_queue_push(events, &exit_event);
+	/* Stop the queue, so that the other thread wakes up and leaves */
+	janus_eventhandler_queue_stop(events);
 
 	if(handler_thread != NULL) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
 
-	g_async_queue_unref(events);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 
 	/* Shut down the MQTT connection now */
@@ -1119,7 +1119,7 @@ static void janus_mqttevh_incoming_event(json_t *event) {
 		return;
 	}
 	json_incref(event);
-	g_async_queue_push(events, event);
+	janus_eventhandler_queue_push(events, event);
 }
 
 json_t *janus_mqttevh_handle_request(json_t *request) {
@@ -1128,6 +1128,7 @@ json_t *janus_mqttevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_MQTTEVH_ERROR_MISSING_ELEMENT, JANUS_MQTTEVH_ERROR_INVALID_ELEMENT);
@@ -1145,6 +1146,11 @@ json_t *janus_mqttevh_handle_request(json_t *request) {
 		/* Events */
 		if(json_object_get(request, "events"))
 			janus_events_edit_events_mask(json_string_value(json_object_get(request, "events")), &janus_mqttevh.events_mask);
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_MQTTEVH_ERROR_INVALID_REQUEST;
@@ -1157,6 +1163,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -1173,47 +1181,52 @@ plugin_response:
  * event will be published to "/janus/events/handle" */
 static void *janus_mqttevh_handler(void *data) {
 	janus_mqttevh_context *ctx = (janus_mqttevh_context *)data;
-	json_t *event = NULL;
+	json_t *batch = NULL, *event = NULL;
+	size_t index = 0;
 	char topicbuf[512];
 	topicbuf[0] = '\0';
 
 	JANUS_LOG(LOG_VERB, "Joining MqttEventHandler handler thread\n");
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		/* Get event from queue */
-		event = g_async_queue_pop(events);
-		if(event == &exit_event) break;
-
-		/* Handle event: just for fun, let's see how long it took for us to take care of this */
-		json_t *created = json_object_get(event, "timestamp");
-		if(created && json_is_integer(created)) {
-			gint64 then = json_integer_value(created);
-			gint64 now = janus_get_monotonic_time();
-			JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
-		}
+		/* Get the next batch of events from the queue */
+		batch = janus_eventhandler_queue_pop(events, TRUE);
+		if(batch == NULL)
+			break;
 
-		int type = json_integer_value(json_object_get(event, "type"));
-		const char *elabel = janus_events_type_to_label(type);
-		const char *ename = janus_events_type_to_name(type);
+		json_array_foreach(batch, index, event) {
+			/* Handle event: just for fun, let's see how long it took for us to take care of this */
+			json_t *created = json_object_get(event, "timestamp");
+			if(created && json_is_integer(created)) {
+				gint64 then = json_integer_value(created);
+				gint64 now = janus_get_monotonic_time();
+				JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
+			}
 
-		/* Hack to test new functions */
-		if(elabel && ename) {
-			JANUS_LOG(LOG_HUGE, "Event label %s, name %s\n", elabel, ename);
-			json_object_set_new(event, "eventtype", json_string(ename));
-		} else {
-			JANUS_LOG(LOG_WARN, "Can't get event label or name\n");
-		}
+			int type = json_integer_value(json_object_get(event, "type"));
+			const char *elabel = janus_events_type_to_label(type);
+			const char *ename = janus_events_type_to_name(type);
 
-		if(!g_atomic_int_get(&stopping)) {
-			/* Convert event to string */
-			if(ctx->addevent) {
-				g_snprintf(topicbuf, sizeof(topicbuf), "%s/%s", ctx->publish.topic, janus_events_type_to_label(type));
-				JANUS_LOG(LOG_DBG, "Debug: MQTT Publish event on %s\n", topicbuf);
-				janus_mqttevh_send_message(ctx, topicbuf, event);
+			/* Hack to test new functions */
+			if(elabel && ename) {
+				JANUS_LOG(LOG_HUGE, "Event label %s, name %s\n", elabel, ename);
+				json_object_set_new(event, "eventtype", json_string(ename));
 			} else {
-				janus_mqttevh_send_message(ctx, ctx->publish.topic, event);
+				JANUS_LOG(LOG_WARN, "Can't get event label or name\n");
+			}
+
+			if(!g_atomic_int_get(&stopping)) {
+				/* Convert event to string */
+				if(ctx->addevent) {
+					g_snprintf(topicbuf, sizeof(topicbuf), "%s/%s", ctx->publish.topic, janus_events_type_to_label(type));
+					JANUS_LOG(LOG_DBG, "Debug: MQTT Publish event on %s\n", topicbuf);
+					janus_mqttevh_send_message(ctx, topicbuf, json_incref(event));
+				} else {
+					janus_mqttevh_send_message(ctx, ctx->publish.topic, json_incref(event));
+				}
 			}
 		}
+		json_decref(batch);
 
 		JANUS_LOG(LOG_VERB, "Debug: Thread done publishing MQTT Publish event on %s\n", topicbuf);
 	}
@@ -64,7 +64,9 @@ static janus_eventhandler janus_nanomsgevh =
 		.incoming_event = janus_nanomsgevh_incoming_event,
 		.handle_request = janus_nanomsgevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
 /* Plugin creator */
@@ -81,14 +83,9 @@ static void *janus_nanomsgevh_thread(void *data);
 static void *janus_nanomsgevh_handler(void *data);
 
 /* Queue of events to handle */
-static GAsyncQueue *events = NULL, *nfd_queue = NULL;
+static janus_eventhandler_queue *events = NULL;
+static GAsyncQueue *nfd_queue = NULL;
 static gboolean group_events = TRUE;
-static json_t exit_event;
-static void janus_nanomsgevh_event_free(json_t *event) {
-	if(!event || event == &exit_event)
-		return;
-	json_decref(event);
-}
 
 /* JSON serialization options */
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
@@ -103,7 +100,11 @@ static struct janus_json_parameter request_parameters[] = {
 };
 static struct janus_json_parameter tweak_parameters[] = {
 	{"events", JSON_STRING, 0},
-	{"grouping", JANUS_JSON_BOOL, 0}
+	{"grouping", JANUS_JSON_BOOL, 0},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_NANOMSGEVH_ERROR_INVALID_REQUEST		411
@@ -173,6 +174,10 @@ int janus_nanomsgevh_init(const char *config_path) {
 	if(item && item->value)
 		group_events = janus_is_true(item->value);
 
+	/* Queue and batching settings */
+	events = janus_eventhandler_queue_new(JANUS_NANOMSGEVH_NAME);
+	janus_eventhandler_queue_configure(events, config, config_general);
+
 	/* First of all, initialize the pipeline for writeable notifications */
 	write_nfd[0] = nn_socket(AF_SP, NN_PULL);
 	write_nfd[1] = nn_socket(AF_SP, NN_PUSH);
@@ -218,8 +223,7 @@ int janus_nanomsgevh_init(const char *config_path) {
 		goto error;
 	}
 
-	/* Initialize the events queue */
-	events = g_async_queue_new_full((GDestroyNotify) janus_nanomsgevh_event_free);
+	/* Initialize the queue of serialized events for the Nanomsg thread */
 	nfd_queue = g_async_queue_new_full((GDestroyNotify) g_free);
 	g_atomic_int_set(&initialized, 1);
 
@@ -250,6 +254,8 @@ int janus_nanomsgevh_init(const char *config_path) {
 error:
 	/* If we got here, something went wrong */
 	success = FALSE;
+	janus_eventhandler_queue_destroy(events);
+	events = NULL;
 	if(write_nfd[0] > -1)
 		nn_close(write_nfd[0]);
 	if(write_nfd[1] > -1)
@@ -274,7 +280,7 @@ void janus_nanomsgevh_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(events, &exit_event);
+	janus_eventhandler_queue_stop(events);
 	(void)nn_send(write_nfd[1], "x", 1, 0);
 	if(pub_thread != NULL) {
 		g_thread_join(pub_thread);
@@ -285,7 +291,7 @@ void janus_nanomsgevh_destroy(void) {
 		handler_thread = NULL;
 	}
 
-	g_async_queue_unref(events);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 	g_async_queue_unref(nfd_queue);
 	nfd_queue = NULL;
@@ -338,7 +344,7 @@ void janus_nanomsgevh_incoming_event(json_t *event) {
 	 * when the event actually happened on this machine, so that, if relevant, we can compute
 	 * any delay in the actual event processing ourselves. */
 	json_incref(event);
-	g_async_queue_push(events, event);
+	janus_eventhandler_queue_push(events, event);
 }
 
 json_t *janus_nanomsgevh_handle_request(json_t *request) {
@@ -348,6 +354,7 @@ json_t *janus_nanomsgevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_NANOMSGEVH_ERROR_MISSING_ELEMENT, JANUS_NANOMSGEVH_ERROR_INVALID_ELEMENT);
@@ -368,6 +375,11 @@ json_t *janus_nanomsgevh_handle_request(json_t *request) {
 		/* Grouping */
 		if(json_object_get(request, "grouping"))
 			group_events = json_is_true(json_object_get(request, "grouping"));
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_NANOMSGEVH_ERROR_INVALID_REQUEST;
@@ -380,6 +392,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -392,42 +406,20 @@ plugin_response:
 /* Thread to handle incoming events */
 static void *janus_nanomsgevh_handler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining NanomsgEventHandler handler thread\n");
-	json_t *event = NULL, *output = NULL;
+	json_t *output = NULL;
 	char *event_text = NULL;
-	int count = 0, max = group_events ? 100 : 1;
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-
-		event = g_async_queue_pop(events);
-		if(event == &exit_event)
+		/* Wait for the next event, or batch of events if we're grouping */
+		output = janus_eventhandler_queue_pop(events, group_events);
+		if(output == NULL)
 			break;
-		count = 0;
-		output = NULL;
-
-		while(TRUE) {
-			/* Handle event: just for fun, let's see how long it took for us to take care of this */
-			json_t *created = json_object_get(event, "timestamp");
-			if(created && json_is_integer(created)) {
-				gint64 then = json_integer_value(created);
-				gint64 now = janus_get_monotonic_time();
-				JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
-			}
-			if(!group_events) {
-				/* We're done here, we just need a single event */
-				output = event;
-				break;
-			}
-			/* If we got here, we're grouping */
-			if(output == NULL)
-				output = json_array();
-			json_array_append_new(output, event);
-			/* Never group more than a maximum number of events, though, or we might stay here forever */
-			count++;
-			if(count == max)
-				break;
-			event = g_async_queue_try_pop(events);
-			if(event == NULL || event == &exit_event)
-				break;
+		/* Handle event: just for fun, let's see how long it took for us to take care of this */
+		json_t *created = json_object_get(json_is_array(output) ? json_array_get(output, 0) : output, "timestamp");
+		if(created && json_is_integer(created)) {
+			gint64 then = json_integer_value(created);
+			gint64 now = janus_get_monotonic_time();
+			JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
 		}
 
 		if(!g_atomic_int_get(&stopping)) {
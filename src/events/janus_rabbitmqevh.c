@@ -71,7 +71,9 @@ static janus_eventhandler janus_rabbitmqevh =
 		.incoming_event = janus_rabbitmqevh_incoming_event,
 		.handle_request = janus_rabbitmqevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
 /* Plugin creator */
@@ -90,14 +92,8 @@ static void *jns_rmqevh_hrtbt(void *data);
 int janus_rabbitmqevh_connect(void);
 
 /* Queue of events to handle */
-static GAsyncQueue *events = NULL;
+static janus_eventhandler_queue *events = NULL;
 static gboolean group_events = TRUE;
-static json_t exit_event;
-static void janus_rabbitmqevh_event_free(json_t *event) {
-	if(!event || event == &exit_event)
-		return;
-	json_decref(event);
-}
 
 /* JSON serialization options */
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
@@ -130,7 +126,11 @@ static struct janus_json_parameter request_parameters[] = {
 };
 static struct janus_json_parameter tweak_parameters[] = {
 	{"events", JSON_STRING, 0},
-	{"grouping", JANUS_JSON_BOOL, 0}
+	{"grouping", JANUS_JSON_BOOL, 0},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_RABBITMQEVH_ERROR_INVALID_REQUEST		411
@@ -200,6 +200,10 @@ int janus_rabbitmqevh_init(const char *config_path) {
 	if(item && item->value)
 		group_events = janus_is_true(item->value);
 
+	/* Queue and batching settings */
+	events = janus_eventhandler_queue_new(JANUS_RABBITMQEVH_NAME);
+	janus_eventhandler_queue_configure(events, config, config_general);
+
 	/* Handle configuration, starting from the server details */
 	item = janus_config_get(config, config_general, janus_config_type_item, "host");
 	if(item && item->value)
@@ -300,8 +304,6 @@ int janus_rabbitmqevh_init(const char *config_path) {
 
 	janus_mutex_init(&mutex);
 
-	/* Initialize the events queue */
-	events = g_async_queue_new_full((GDestroyNotify) janus_rabbitmqevh_event_free);
 	g_atomic_int_set(&initialized, 1);
 
 	GError *error = NULL;
@@ -331,6 +333,8 @@ int janus_rabbitmqevh_init(const char *config_path) {
 error:
 	/* If we got here, something went wrong */
 	success = FALSE;
+	janus_eventhandler_queue_destroy(events);
+	events = NULL;
 	g_free(route_key);
 	g_free(exchange);
 	/* Fall through */
@@ -435,7 +439,7 @@ void janus_rabbitmqevh_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(events, &exit_event);
+	janus_eventhandler_queue_stop(events);
 	if(handler_thread != NULL) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
@@ -445,7 +449,7 @@ void janus_rabbitmqevh_destroy(void) {
 		in_thread = NULL;
 	}
 
-	g_async_queue_unref(events);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 
 	if(rmq_conn) {
@@ -509,7 +513,7 @@ void janus_rabbitmqevh_incoming_event(json_t *event) {
 	 * when the event actually happened on this machine, so that, if relevant, we can compute
 	 * any delay in the actual event processing ourselves. */
 	json_incref(event);
-	g_async_queue_push(events, event);
+	janus_eventhandler_queue_push(events, event);
 }
 
 json_t *janus_rabbitmqevh_handle_request(json_t *request) {
@@ -519,6 +523,7 @@ json_t *janus_rabbitmqevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_RABBITMQEVH_ERROR_MISSING_ELEMENT, JANUS_RABBITMQEVH_ERROR_INVALID_ELEMENT);
@@ -539,6 +544,11 @@ json_t *janus_rabbitmqevh_handle_request(json_t *request) {
 		/* Grouping */
 		if(json_object_get(request, "grouping"))
 			group_events = json_is_true(json_object_get(request, "grouping"));
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "RabbitMQEventHandler: Unknown request '%s'\n", request_text);
 		error_code = JANUS_RABBITMQEVH_ERROR_INVALID_REQUEST;
@@ -551,6 +561,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -563,42 +575,20 @@ plugin_response:
 /* Thread to handle incoming events */
 static void *jns_rmqevh_hdlr(void *data) {
 	JANUS_LOG(LOG_VERB, "RabbitMQEventHandler: joining handler thread\n");
-	json_t *event = NULL, *output = NULL;
+	json_t *output = NULL;
 	char *event_text = NULL;
-	int count = 0, max = group_events ? 100 : 1;
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-
-		event = g_async_queue_pop(events);
-		if(event == &exit_event)
+		/* Wait for the next event, or batch of events if we're grouping */
+		output = janus_eventhandler_queue_pop(events, group_events);
+		if(output == NULL)
 			break;
-		count = 0;
-		output = NULL;
-
-		while(TRUE) {
-			/* Handle event: just for fun, let's see how long it took for us to take care of this */
-			json_t *created = json_object_get(event, "timestamp");
-			if(created && json_is_integer(created)) {
-				gint64 then = json_integer_value(created);
-				gint64 now = janus_get_monotonic_time();
-				JANUS_LOG(LOG_DBG, "RabbitMQEventHandler: Handled event after %"SCNu64" us\n", now-then);
-			}
-			if(!group_events) {
-				/* We're done here, we just need a single event */
-				output = event;
-				break;
-			}
-			/* If we got here, we're grouping */
-			if(output == NULL)
-				output = json_array();
-			json_array_append_new(output, event);
-			/* Never group more than a maximum number of events, though, or we might stay here forever */
-			count++;
-			if(count == max)
-				break;
-			event = g_async_queue_try_pop(events);
-			if(event == NULL || event == &exit_event)
-				break;
+		/* Handle event: just for fun, let's see how long it took for us to take care of this */
+		json_t *created = json_object_get(json_is_array(output) ? json_array_get(output, 0) : output, "timestamp");
+		if(created && json_is_integer(created)) {
+			gint64 then = json_integer_value(created);
+			gint64 now = janus_get_monotonic_time();
+			JANUS_LOG(LOG_DBG, "RabbitMQEventHandler: Handled event after %"SCNu64" us\n", now-then);
 		}
 
 		if(!g_atomic_int_get(&stopping)) {
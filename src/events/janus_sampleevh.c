@@ -62,7 +62,9 @@ static janus_eventhandler janus_sampleevh =
 		.incoming_event = janus_sampleevh_incoming_event,
 		.handle_request = janus_sampleevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
 /* Plugin creator */
@@ -86,14 +88,8 @@ static gboolean compress = FALSE;
 static int compression = 6;		/* Z_DEFAULT_COMPRESSION */
 
 /* Queue of events to handle */
-static GAsyncQueue *events = NULL;
+static janus_eventhandler_queue *events = NULL;
 static gboolean group_events = TRUE;
-static json_t exit_event;
-static void janus_sampleevh_event_free(json_t *event) {
-	if(!event || event == &exit_event)
-		return;
-	json_decref(event);
-}
 
 /* Retransmission management */
 static int max_retransmissions = 5;
@@ -118,7 +114,11 @@ static struct janus_json_parameter tweak_parameters[] = {
 	{"backend_user", JSON_STRING, 0},
 	{"backend_pwd", JSON_STRING, 0},
 	{"max_retransmissions", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
-	{"retransmissions_backoff", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"retransmissions_backoff", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_SAMPLEEVH_ERROR_INVALID_REQUEST		411
@@ -201,6 +201,9 @@ int janus_sampleevh_init(const char *config_path) {
 				item = janus_config_get(config, config_general, janus_config_type_item, "grouping");
 				if(item && item->value)
 					group_events = janus_is_true(item->value);
+				/* Queue and batching settings */
+				events = janus_eventhandler_queue_new(JANUS_SAMPLEEVH_NAME);
+				janus_eventhandler_queue_configure(events, config, config_general);
 				/* Check the JSON indentation */
 				item = janus_config_get(config, config_general, janus_config_type_item, "json");
 				if(item && item->value) {
@@ -250,8 +253,6 @@ int janus_sampleevh_init(const char *config_path) {
 	/* Initialize libcurl, needed for forwarding events via HTTP POST */
 	curl_global_init(CURL_GLOBAL_ALL);
 
-	/* Initialize the events queue */
-	events = g_async_queue_new_full((GDestroyNotify) janus_sampleevh_event_free);
 	janus_mutex_init(&evh_mutex);
 
 	g_atomic_int_set(&initialized, 1);
@@ -275,13 +276,13 @@ void janus_sampleevh_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(events, &exit_event);
+	janus_eventhandler_queue_stop(events);
 	if(handler_thread != NULL) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
 
-	g_async_queue_unref(events);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 
 	g_free(backend);
@@ -334,7 +335,7 @@ void janus_sampleevh_incoming_event(json_t *event) {
 	 * when the event actually happened on this machine, so that, if relevant, we can compute
 	 * any delay in the actual event processing ourselves. */
 	json_incref(event);
-	g_async_queue_push(events, event);
+	janus_eventhandler_queue_push(events, event);
 
 }
 
@@ -345,6 +346,7 @@ json_t *janus_sampleevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_SAMPLEEVH_ERROR_MISSING_ELEMENT, JANUS_SAMPLEEVH_ERROR_INVALID_ELEMENT);
@@ -422,6 +424,11 @@ json_t *janus_sampleevh_handle_request(json_t *request) {
 		if(req_backoff > -1)
 			retransmissions_backoff = req_backoff;
 		janus_mutex_unlock(&evh_mutex);
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_SAMPLEEVH_ERROR_INVALID_REQUEST;
@@ -434,6 +441,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -450,17 +459,18 @@ static void *janus_sampleevh_handler(void *data) {
 	char *event_text = NULL;
 	char compressed_text[8192];
 	size_t compressed_len = 0;
-	int count = 0, max = group_events ? 100 : 1;
+	size_t index = 0, count = 0;
 	int retransmit = 0;
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
 		if(!retransmit) {
-			event = g_async_queue_pop(events);
-			if(event == &exit_event)
+			/* Wait for the next event, or batch of events if we're grouping */
+			output = janus_eventhandler_queue_pop(events, group_events);
+			if(output == NULL)
 				break;
-			count = 0;
-			output = NULL;
+			count = json_is_array(output) ? json_array_size(output) : 1;
 
-			while(TRUE) {
+			for(index = 0; index < count; index++) {
+				event = json_is_array(output) ? json_array_get(output, index) : output;
 				/* Handle event: just for fun, let's see how long it took for us to take care of this */
 				json_t *created = json_object_get(event, "timestamp");
 				if(created && json_is_integer(created)) {
@@ -689,22 +699,6 @@ static void *janus_sampleevh_handler(void *data) {
 						JANUS_LOG(LOG_WARN, "Unknown type of event '%d'\n", type);
 						break;
 				}
-				if(!group_events) {
-					/* We're done here, we just need a single event */
-					output = event;
-					break;
-				}
-				/* If we got here, we're grouping */
-				if(output == NULL)
-					output = json_array();
-				json_array_append_new(output, event);
-				/* Never group more than a maximum number of events, though, or we might stay here forever */
-				count++;
-				if(count == max)
-					break;
-				event = g_async_queue_try_pop(events);
-				if(event == NULL || event == &exit_event)
-					break;
 			}
 
 			/* Since this a simple plugin, it does the same for all events: so just convert to string... */
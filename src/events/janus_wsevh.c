@@ -62,7 +62,9 @@ static janus_eventhandler janus_wsevh =
 		.incoming_event = janus_wsevh_incoming_event,
 		.handle_request = janus_wsevh_handle_request,
 
-		.events_mask = JANUS_EVENT_TYPE_NONE
+		.events_mask = JANUS_EVENT_TYPE_NONE,
+		/* Events are only queued in incoming_event, which is thread-safe */
+		.parallel_delivery = TRUE
 	);
 
 /* Plugin creator */
@@ -86,13 +88,9 @@ static void janus_wsevh_calculate_reconnect_delay_on_fail(void);
 static void janus_wsevh_connect_attempt(lws_sorted_usec_list_t *sul);
 
 /* Queue of events to handle */
-static GQueue *events = NULL;
-static janus_mutex events_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_eventhandler_queue *events = NULL;
 static gboolean group_events = TRUE;
 static volatile gint events_cap_on_reconnect = 0, dropped = 0;
-static void janus_wsevh_event_free(json_t *event) {
-	json_decref(event);
-}
 
 /* JSON serialization options */
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
@@ -105,7 +103,11 @@ static struct janus_json_parameter request_parameters[] = {
 static struct janus_json_parameter tweak_parameters[] = {
 	{"events", JSON_STRING, 0},
 	{"grouping", JANUS_JSON_BOOL, 0},
-	{"events_cap_on_reconnect", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"events_cap_on_reconnect", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"queue_policy", JSON_STRING, 0},
+	{"batch_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"batch_linger", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 /* Error codes (for the tweaking via Admin API */
 #define JANUS_WSEVH_ERROR_INVALID_REQUEST		411
@@ -353,6 +355,10 @@ int janus_wsevh_init(const char *config_path) {
 	if(item && item->value)
 		group_events = janus_is_true(item->value);
 
+	/* Queue and batching settings */
+	events = janus_eventhandler_queue_new(JANUS_WSEVH_NAME);
+	janus_eventhandler_queue_configure(events, config, config_general);
+
 	/* Do we need to cap the number of queued events when reconnecting */
 	item = janus_config_get(config, config_general, janus_config_type_item, "events_cap_on_reconnect");
 	if(item && item->value)
@@ -412,8 +418,6 @@ int janus_wsevh_init(const char *config_path) {
 	}
 	janus_mutex_init(&writable_mutex);
 
-	/* Initialize the events queue */
-	events = g_queue_new();
 	g_atomic_int_set(&initialized, 1);
 
 	/* Start a thread to handle the WebSockets event loop */
@@ -434,6 +438,8 @@ int janus_wsevh_init(const char *config_path) {
 error:
 	/* If we got here, something went wrong */
 	success = FALSE;
+	janus_eventhandler_queue_destroy(events);
+	events = NULL;
 	/* Fall through */
 done:
 	if(config)
@@ -458,7 +464,7 @@ void janus_wsevh_destroy(void) {
 		ws_thread = NULL;
 	}
 
-	g_queue_free_full(events, (GDestroyNotify)janus_wsevh_event_free);
+	janus_eventhandler_queue_destroy(events);
 	events = NULL;
 
 	g_atomic_int_set(&initialized, 0);
@@ -509,22 +515,16 @@ void janus_wsevh_incoming_event(json_t *event) {
 	 * when the event actually happened on this machine, so that, if relevant, we can compute
 	 * any delay in the actual event processing ourselves. */
 	json_incref(event);
-	janus_mutex_lock(&events_mutex);
-	g_queue_push_tail(events, event);
+	if(!janus_eventhandler_queue_push(events, event))
+		return;
 	if(g_atomic_int_get(&reconnect)) {
 		/* We're reconnecting: check if there's a cap to how many events to keep in the buffer */
 		guint cap = g_atomic_int_get(&events_cap_on_reconnect);
-		if(cap > 0 && g_queue_get_length(events) > cap) {
+		if(cap > 0) {
 			/* Get rid of older events, we won't need them anymore */
-			json_t *drop = NULL;
-			while(g_queue_get_length(events) > cap) {
-				drop = g_queue_pop_head(events);
-				json_decref(drop);
-				g_atomic_int_inc(&dropped);
-			}
+			g_atomic_int_add(&dropped, janus_eventhandler_queue_trim(events, cap));
 		}
 	}
-	janus_mutex_unlock(&events_mutex);
 	/* We notify the websocket thread so that it can be handled */
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 		if(context != NULL)
@@ -545,6 +545,7 @@ json_t *janus_wsevh_handle_request(json_t *request) {
 	/* We can use this requests to apply tweaks to the logic */
 	int error_code = 0;
 	char error_cause[512];
+	json_t *stats = NULL;
 	JANUS_VALIDATE_JSON_OBJECT(request, request_parameters,
 		error_code, error_cause, TRUE,
 		JANUS_WSEVH_ERROR_MISSING_ELEMENT, JANUS_WSEVH_ERROR_INVALID_ELEMENT);
@@ -568,6 +569,11 @@ json_t *janus_wsevh_handle_request(json_t *request) {
 		/* Whether we should put a cap on queued events when reconnecting */
 		if(json_object_get(request, "events_cap_on_reconnect"))
 			g_atomic_int_set(&events_cap_on_reconnect, json_integer_value(json_object_get(request, "events_cap_on_reconnect")));
+		/* Queue and batching settings */
+		janus_eventhandler_queue_tweak(events, request);
+	} else if(!strcasecmp(request_text, "stats")) {
+		/* Return the current state of the events queue */
+		stats = janus_eventhandler_queue_stats(events);
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
 		error_code = JANUS_WSEVH_ERROR_INVALID_REQUEST;
@@ -580,6 +586,8 @@ plugin_response:
 			if(error_code == 0) {
 				/* Return a success */
 				json_object_set_new(response, "result", json_integer(200));
+				if(stats)
+					json_object_set_new(response, "stats", stats);
 			} else {
 				/* Prepare JSON error event */
 				json_object_set_new(response, "error_code", json_integer(error_code));
@@ -644,50 +652,20 @@ static void *janus_wsevh_thread(void *data) {
 static char *janus_wsevh_stringify_events(void) {
 	if(!g_atomic_int_get(&initialized) || g_atomic_int_get(&stopping))
 		return NULL;
-	json_t *event = NULL, *output = NULL;
+	json_t *output = NULL;
 	char *event_text = NULL;
-	int count = 0, max = group_events ? 100 : 1;
-
-	/* Pop the first queued event */
-	janus_mutex_lock(&events_mutex);
-	event = g_queue_peek_head(events);
-	if(event != NULL)
-		(void)g_queue_pop_head(events);
-	janus_mutex_unlock(&events_mutex);
-	if(event == NULL)
+
+	/* Pop the queued events, grouping them if required */
+	output = janus_eventhandler_queue_try_pop(events, group_events);
+	if(output == NULL)
 		return NULL;
 
-	/* Start with the stringification, grouping if required */
-	count = 0;
-	output = NULL;
-	while(TRUE) {
-		/* Handle event: just for fun, let's see how long it took for us to take care of this */
-		json_t *created = json_object_get(event, "timestamp");
-		if(created && json_is_integer(created)) {
-			gint64 then = json_integer_value(created);
-			gint64 now = janus_get_monotonic_time();
-			JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
-		}
-		if(!group_events) {
-			/* We're done here, we just need a single event */
-			output = event;
-			break;
-		}
-		/* If we got here, we're grouping */
-		if(output == NULL)
-			output = json_array();
-		json_array_append_new(output, event);
-		/* Never group more than a maximum number of events, though, or we might stay here forever */
-		count++;
-		if(count == max)
-			break;
-		janus_mutex_lock(&events_mutex);
-		event = g_queue_peek_head(events);
-		if(event != NULL)
-			(void)g_queue_pop_head(events);
-		janus_mutex_unlock(&events_mutex);
-		if(event == NULL)
-			break;
+	/* Handle event: just for fun, let's see how long it took for us to take care of this */
+	json_t *created = json_object_get(json_is_array(output) ? json_array_get(output, 0) : output, "timestamp");
+	if(created && json_is_integer(created)) {
+		gint64 then = json_integer_value(created);
+		gint64 now = janus_get_monotonic_time();
+		JANUS_LOG(LOG_DBG, "Handled event after %"SCNu64" us\n", now-then);
 	}
 
 	if(!g_atomic_int_get(&stopping)) {
@@ -18,15 +18,25 @@
  * \ref protocols
  */
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include <ifaddrs.h>
 #include <poll.h>
 #include <net/if.h>
 #include <sys/socket.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
 #include <sys/time.h>
 #include <netdb.h>
 #include <fcntl.h>
 #include <stun/usages/bind.h>
+#include <stun/usages/ice.h>
 #include <nice/debug.h>
+#include <glib-unix.h>
 
 #include "janus.h"
 #include "debug.h"
@@ -38,6 +48,7 @@
 #include "apierror.h"
 #include "ip-utils.h"
 #include "events.h"
+#include "metrics.h"
 
 /* STUN server/port, if any */
 static char *janus_stun_server = NULL;
@@ -74,6 +85,19 @@ char *janus_ice_get_turn_rest_api(void) {
 #endif
 }
 
+#ifdef HAVE_TURNRESTAPI
+/* When using the TURN REST API, we use the handle's opaque_id as a username
+ * by default, and fall back to the session_id when it's missing: this fills
+ * the buffer with the latter, when needed */
+static void janus_ice_turnrest_username(janus_ice_handle *handle, char *buffer, size_t len) {
+	*buffer = '\0';
+	if(handle->opaque_id == NULL) {
+		janus_session *session = (janus_session *)handle->session;
+		g_snprintf(buffer, len, "%"SCNu64, session->session_id);
+	}
+}
+#endif
+
 /* Force relay settings */
 static gboolean force_relay_allowed = FALSE;
 void janus_ice_allow_force_relay(void) {
@@ -186,16 +210,102 @@ gboolean janus_is_opaqueid_in_api_enabled(void) {
 	return opaqueid_in_api;
 }
 
+/* Pool of preallocated outgoing packets (see below) */
+typedef struct janus_ice_packet_pool janus_ice_packet_pool;
+static janus_ice_packet_pool *janus_ice_packet_pool_create(void);
+static void janus_ice_packet_pool_destroy(janus_ice_packet_pool *pool);
+static json_t *janus_ice_packet_pool_info(janus_ice_packet_pool *pool);
+static janus_ice_packet_pool *shared_packet_pool = NULL;
+
+/* RTCP reports are sent every second on average, but the interval is randomized
+ * (as RFC 3550 suggests, between 0.5 and 1.5 times that) to spread the load */
+#define JANUS_ICE_RTCP_INTERVAL		G_USEC_PER_SEC
+static gint64 janus_ice_rtcp_next_report(gint64 now) {
+	return now + JANUS_ICE_RTCP_INTERVAL/2 + g_random_int_range(0, JANUS_ICE_RTCP_INTERVAL);
+}
+static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data);
+/* Static loops serve the RTCP of all their handles from a single timing wheel:
+ * the wheel has a slot every 50ms, and covers more than the maximum interval */
+#define JANUS_ICE_RTCP_WHEEL_TICK	50000
+#define JANUS_ICE_RTCP_WHEEL_SLOTS	32
+
+/* Dispatch and queue wait times of static loops are tracked in buckets of powers of two (in us) */
+#define JANUS_ICE_LOOP_HISTOGRAM_BUCKETS	24
+typedef struct janus_ice_loop_histogram {
+	guint32 buckets[JANUS_ICE_LOOP_HISTOGRAM_BUCKETS];
+	guint32 count;
+	gint64 max;
+} janus_ice_loop_histogram;
+static void janus_ice_loop_histogram_add(janus_ice_loop_histogram *histogram, gint64 value) {
+	guint bucket = 0;
+	while(bucket < JANUS_ICE_LOOP_HISTOGRAM_BUCKETS-1 && (G_GINT64_CONSTANT(1) << bucket) <= value)
+		bucket++;
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	if(value > histogram->max)
+		histogram->max = value;
+}
+/* The percentile is the upper bound of the bucket it's in, so it's never lower than the actual value */
+static gint64 janus_ice_loop_histogram_percentile(janus_ice_loop_histogram *histogram, guint percentile) {
+	if(histogram->count == 0)
+		return 0;
+	guint64 target = ((guint64)histogram->count * percentile + 99) / 100, seen = 0;
+	guint bucket = 0;
+	for(bucket=0; bucket<JANUS_ICE_LOOP_HISTOGRAM_BUCKETS; bucket++) {
+		seen += histogram->buckets[bucket];
+		if(seen >= target)
+			break;
+	}
+	return MIN(histogram->max, G_GINT64_CONSTANT(1) << bucket);
+}
+
 /* Only needed in case we're using static event loops spawned at startup (disabled by default) */
 typedef struct janus_ice_static_event_loop {
 	int id;
+	/* CPU the loop thread is pinned to, and its NUMA node (-1 if not pinned/unknown) */
+	int cpu, numa_node;
+	/* Whether this loop was created for a single busy handle, rather than shared */
+	gboolean dedicated;
 	GMainContext *mainctx;
 	GMainLoop *mainloop;
 	GThread *thread;
 	uint16_t handles;
+	janus_ice_packet_pool *pool;
+	/* Batched receive counters, only updated by the loop thread itself */
+	guint64 recv_batches, recv_batch_packets;
+	/* Load metrics: counters are only updated by the loop thread itself, while the
+	 * resulting rates are updated every second, and read when placing handles */
+	guint64 load_packets, load_last_packets;
+	gint64 load_busy, load_last_busy, load_last_update;
+	guint load_queued_max;
+	volatile gint load_pps, load_utilization, load_queued;
+	/* Instrumentation: totals are since the loop was started, while the dispatch and
+	 * queue wait times are summarized every second, like the load metrics above */
+	gint64 stats_started, stats_wait_total;
+	guint64 stats_dispatches, stats_waits;
+	janus_ice_loop_histogram stats_dispatch, stats_wait;
+	volatile gint stats_dispatch_max, stats_dispatch_p99, stats_wait_max, stats_wait_p99;
+	gint stats_last_event;
+	/* Loop-level RTCP scheduler: handles are spread on the slots of a timing wheel */
+	GQueue rtcp_wheel[JANUS_ICE_RTCP_WHEEL_SLOTS];
+	gint64 rtcp_tick;
+	GSource *rtcp_source;
+	janus_mutex rtcp_mutex;
+	/* Single-port mode: socket shared by all the PeerConnections on this loop, and
+	 * the PeerConnections it serves, indexed by local ufrag and by remote address */
+	int mux_fd;
+	uint16_t mux_port;
+	GSource *mux_source;
+	StunAgent mux_stun;
+	GHashTable *mux_ufrags, *mux_addresses;
+	/* Candidates of the shared socket, encoded once for all PeerConnections (per component) */
+	GHashTable *mux_candidates;
+	struct janus_ice_mux_batch *mux_batch;
+	janus_mutex mux_mutex;
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_ice_static_event_loop;
+static void janus_ice_mux_close(janus_ice_static_event_loop *loop);
 static void janus_ice_static_event_loop_destroy(janus_ice_static_event_loop *loop) {
 	if(!g_atomic_int_compare_and_exchange(&loop->destroyed, 0, 1))
 		return;
@@ -203,12 +313,200 @@ static void janus_ice_static_event_loop_destroy(janus_ice_static_event_loop *loo
 }
 static void janus_ice_static_event_loop_free(const janus_refcount *loop_ref) {
 	janus_ice_static_event_loop *loop = janus_refcount_containerof(loop_ref, janus_ice_static_event_loop, ref);
+	int i = 0;
+	for(i=0; i<JANUS_ICE_RTCP_WHEEL_SLOTS; i++) {
+		GList *link = NULL;
+		while((link = g_queue_pop_head_link(&loop->rtcp_wheel[i])) != NULL) {
+			janus_ice_handle *handle = (janus_ice_handle *)link->data;
+			handle->rtcp_link = NULL;
+			janus_refcount_decrease(&handle->ref);
+			g_list_free_1(link);
+		}
+	}
+	if(loop->rtcp_source)
+		g_source_unref(loop->rtcp_source);
+	janus_mutex_destroy(&loop->rtcp_mutex);
+	janus_ice_mux_close(loop);
+	janus_mutex_destroy(&loop->mux_mutex);
+	janus_ice_packet_pool_destroy(loop->pool);
 	g_free(loop);
 }
+/* Turn the load counters of a loop to rates (packets per second, busy time in permille) */
+static void janus_ice_static_event_loop_update_load(janus_ice_static_event_loop *loop, gint64 now) {
+	gint64 elapsed = now - loop->load_last_update;
+	if(loop->load_last_update > 0 && elapsed > 0) {
+		g_atomic_int_set(&loop->load_pps, (loop->load_packets - loop->load_last_packets) * G_USEC_PER_SEC / elapsed);
+		g_atomic_int_set(&loop->load_utilization, MIN(1000, (loop->load_busy - loop->load_last_busy) * 1000 / elapsed));
+		g_atomic_int_set(&loop->load_queued, loop->load_queued_max);
+	}
+	loop->load_last_packets = loop->load_packets;
+	loop->load_last_busy = loop->load_busy;
+	loop->load_queued_max = 0;
+	loop->load_last_update = now;
+	/* Summarize the dispatch and queue wait times of the last window, and start a new one */
+	g_atomic_int_set(&loop->stats_dispatch_max, loop->stats_dispatch.max);
+	g_atomic_int_set(&loop->stats_dispatch_p99, janus_ice_loop_histogram_percentile(&loop->stats_dispatch, 99));
+	g_atomic_int_set(&loop->stats_wait_max, loop->stats_wait.max);
+	g_atomic_int_set(&loop->stats_wait_p99, janus_ice_loop_histogram_percentile(&loop->stats_wait, 99));
+	memset(&loop->stats_dispatch, 0, sizeof(loop->stats_dispatch));
+	memset(&loop->stats_wait, 0, sizeof(loop->stats_wait));
+}
+/* Take note of how long an iteration of the loop took, and how many packets it served:
+ * we keep track of that for the handle it was for too, to find the busiest ones. Work
+ * nested in another iteration (e.g., packets sent right away while relaying an incoming
+ * one) only counts for its handle and the loop packets: its time is part of that iteration */
+static void janus_ice_static_event_loop_dispatched(janus_ice_static_event_loop *loop, janus_ice_handle *handle,
+		guint packets, gint64 started, gboolean nested) {
+	gint64 now = janus_get_monotonic_time(), duration = now - started;
+	loop->load_packets += packets;
+	if(!nested) {
+		loop->load_busy += duration;
+		loop->stats_dispatches++;
+		janus_ice_loop_histogram_add(&loop->stats_dispatch, duration);
+	}
+	if(handle == NULL)
+		return;
+	handle->load_packets += packets;
+	handle->load_busy += duration;
+	gint64 elapsed = now - handle->load_last_update;
+	if(elapsed < G_USEC_PER_SEC)
+		return;
+	if(handle->load_last_update > 0) {
+		g_atomic_int_set(&handle->load_pps, (handle->load_packets - handle->load_last_packets) * G_USEC_PER_SEC / elapsed);
+		g_atomic_int_set(&handle->load_utilization, MIN(1000, (handle->load_busy - handle->load_last_busy) * 1000 / elapsed));
+	}
+	handle->load_last_packets = handle->load_packets;
+	handle->load_last_busy = handle->load_busy;
+	handle->load_last_update = now;
+}
+/* Take note of how long a packet waited in the queue before we sent it */
+static void janus_ice_static_event_loop_waited(janus_ice_static_event_loop *loop, gint64 wait) {
+	loop->stats_waits++;
+	loop->stats_wait_total += wait;
+	janus_ice_loop_histogram_add(&loop->stats_wait, wait);
+}
+/* Summary of the instrumentation of a loop, for the Admin API and event handlers */
+static json_t *janus_ice_static_event_loop_stats(janus_ice_static_event_loop *loop) {
+	json_t *stats = json_object();
+	gint64 uptime = janus_get_monotonic_time() - loop->stats_started;
+	gint64 busy = loop->load_busy;
+	json_object_set_new(stats, "dispatches", json_integer(loop->stats_dispatches));
+	json_object_set_new(stats, "busy-time", json_integer(busy));
+	json_object_set_new(stats, "idle-time", json_integer(MAX(0, uptime - busy)));
+	json_object_set_new(stats, "dispatch-max", json_integer(g_atomic_int_get(&loop->stats_dispatch_max)));
+	json_object_set_new(stats, "dispatch-p99", json_integer(g_atomic_int_get(&loop->stats_dispatch_p99)));
+	guint64 waits = loop->stats_waits;
+	json_object_set_new(stats, "queue-wait-avg", json_integer(waits ? loop->stats_wait_total / waits : 0));
+	json_object_set_new(stats, "queue-wait-max", json_integer(g_atomic_int_get(&loop->stats_wait_max)));
+	json_object_set_new(stats, "queue-wait-p99", json_integer(g_atomic_int_get(&loop->stats_wait_p99)));
+	return stats;
+}
+/* Serve the handles whose RTCP reports are due: we get here every tick of the wheel */
+static gboolean janus_ice_static_event_loop_rtcp(gpointer user_data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)user_data;
+	gint64 now = janus_get_monotonic_time();
+	/* We use the same tick to keep the load metrics of the loop updated */
+	if(now - loop->load_last_update >= G_USEC_PER_SEC) {
+		janus_ice_static_event_loop_update_load(loop, now);
+		/* Notify event handlers about the loop instrumentation as often as we do for media stats */
+		int period = janus_ice_get_event_stats_period();
+		if(period > 0 && !loop->dedicated && janus_events_is_enabled() && ++loop->stats_last_event >= period) {
+			loop->stats_last_event = 0;
+			json_t *info = json_object();
+			json_object_set_new(info, "loop", json_integer(loop->id));
+			json_object_set_new(info, "handles", json_integer(loop->handles));
+			json_object_set_new(info, "utilization", json_real((double)g_atomic_int_get(&loop->load_utilization)/10.0));
+			json_object_set_new(info, "stats", janus_ice_static_event_loop_stats(loop));
+			janus_events_notify_handlers(JANUS_EVENT_TYPE_CORE, JANUS_EVENT_SUBTYPE_CORE_LOOP_STATS, 0, info);
+		}
+	}
+	gint64 tick = now / JANUS_ICE_RTCP_WHEEL_TICK;
+	janus_mutex_lock(&loop->rtcp_mutex);
+	/* Serve all the slots we went past since last time, but each one only once */
+	if(loop->rtcp_tick == 0 || tick - loop->rtcp_tick > JANUS_ICE_RTCP_WHEEL_SLOTS)
+		loop->rtcp_tick = tick - 1;
+	while(loop->rtcp_tick < tick) {
+		loop->rtcp_tick++;
+		GQueue *slot = &loop->rtcp_wheel[loop->rtcp_tick % JANUS_ICE_RTCP_WHEEL_SLOTS];
+		guint due = g_queue_get_length(slot);
+		while(due > 0) {
+			due--;
+			GList *link = g_queue_pop_head_link(slot);
+			janus_ice_handle *handle = (janus_ice_handle *)link->data;
+			if(handle->pc == NULL || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY)) {
+				/* The PeerConnection is gone, stop serving this handle */
+				handle->rtcp_link = NULL;
+				janus_refcount_decrease(&handle->ref);
+				g_list_free_1(link);
+				continue;
+			}
+			janus_ice_outgoing_rtcp_handle(handle);
+			/* Reschedule the handle: the jitter keeps it away from the slot we're serving */
+			gint64 next = (janus_ice_rtcp_next_report(now) - now) / JANUS_ICE_RTCP_WHEEL_TICK;
+			handle->rtcp_slot = (loop->rtcp_tick + next) % JANUS_ICE_RTCP_WHEEL_SLOTS;
+			g_queue_push_tail_link(&loop->rtcp_wheel[handle->rtcp_slot], link);
+		}
+	}
+	janus_mutex_unlock(&loop->rtcp_mutex);
+	return G_SOURCE_CONTINUE;
+}
+static void janus_ice_static_event_loop_rtcp_add(janus_ice_static_event_loop *loop, janus_ice_handle *handle) {
+	janus_mutex_lock(&loop->rtcp_mutex);
+	if(handle->rtcp_link == NULL) {
+		janus_refcount_increase(&handle->ref);
+		gint64 now = janus_get_monotonic_time();
+		gint64 next = (janus_ice_rtcp_next_report(now) - now) / JANUS_ICE_RTCP_WHEEL_TICK;
+		handle->rtcp_slot = (now / JANUS_ICE_RTCP_WHEEL_TICK + next) % JANUS_ICE_RTCP_WHEEL_SLOTS;
+		handle->rtcp_link = g_list_alloc();
+		handle->rtcp_link->data = handle;
+		g_queue_push_tail_link(&loop->rtcp_wheel[handle->rtcp_slot], handle->rtcp_link);
+	}
+	janus_mutex_unlock(&loop->rtcp_mutex);
+}
+static void janus_ice_static_event_loop_rtcp_remove(janus_ice_static_event_loop *loop, janus_ice_handle *handle) {
+	janus_mutex_lock(&loop->rtcp_mutex);
+	if(handle->rtcp_link != NULL) {
+		g_queue_delete_link(&loop->rtcp_wheel[handle->rtcp_slot], handle->rtcp_link);
+		handle->rtcp_link = NULL;
+		janus_refcount_decrease(&handle->ref);
+	}
+	janus_mutex_unlock(&loop->rtcp_mutex);
+}
 static int static_event_loops = 0;
 static gboolean allow_loop_indication = FALSE;
 static GSList *event_loops = NULL;
 static janus_mutex event_loops_mutex = JANUS_MUTEX_INITIALIZER;
+/* How new handles are placed on static loops, and groups of handles to co-locate */
+static janus_ice_loop_placement event_loops_placement = JANUS_ICE_LOOP_PLACEMENT_HANDLES;
+typedef struct janus_ice_loop_group {
+	janus_ice_static_event_loop *loop;
+	guint handles;
+} janus_ice_loop_group;
+static GHashTable *loop_groups = NULL;
+/* Handles of a group stay on the same loop, unless the loop is busier than this (permille) */
+#define JANUS_ICE_LOOP_GROUP_MAX_UTILIZATION	800
+/* Handles can move to a less loaded loop before a new PeerConnection is set up, if
+ * the utilization of their loop exceeds the lowest one by this much (permille, 0=never) */
+static gint event_loops_rebalance = 0;
+/* Hybrid mode: before a new PeerConnection is set up, handles busier than this (packets
+ * per second, or permille of a loop's time, 0=ignore) get a dedicated loop, and handles
+ * on a dedicated loop go back to a shared one when they're below half of that */
+static gint event_loops_promote_pps = 0, event_loops_promote_busy = 0;
+static guint event_loops_dedicated_max = 0;
+static GSList *dedicated_loops = NULL;
+/* Moving handles between loops is rare, so we use a single lock/condition for that */
+static janus_mutex migrate_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition migrate_cond;
+/* How long we wait for the current loop of a handle to let it go */
+#define JANUS_ICE_MIGRATE_TIMEOUT	G_USEC_PER_SEC
+/* The static loop the current thread is running, if any: plugins relaying packets
+ * to a handle from the thread of its own loop can skip the outgoing queue */
+static GPrivate current_event_loop = G_PRIVATE_INIT(NULL);
+/* CPUs to pin the static loops to, if any (loops are assigned them in order) */
+static GArray *event_loops_cpus = NULL;
+/* How many packets a pinned loop preallocates for its pool, from its own thread */
+#define JANUS_ICE_PACKET_POOL_PREWARM	256
+static void janus_ice_packet_pool_prewarm(janus_ice_packet_pool *pool, guint count);
 static void *janus_ice_static_event_loop_thread(void *data) {
 	janus_ice_static_event_loop *loop = data;
 	JANUS_LOG(LOG_VERB, "[loop#%d] Event loop thread started\n", loop->id);
@@ -218,8 +516,21 @@ static void *janus_ice_static_event_loop_thread(void *data) {
 		janus_refcount_decrease(&loop->ref);
 		return NULL;
 	}
+	if(loop->cpu >= 0) {
+		if(janus_thread_set_cpu(loop->cpu) < 0) {
+			loop->cpu = -1;
+			loop->numa_node = -1;
+		} else {
+			JANUS_LOG(LOG_VERB, "[loop#%d] Pinned to CPU %d (NUMA node %d)\n", loop->id, loop->cpu, loop->numa_node);
+			/* Allocate (and touch) part of the packet pool from here, so that
+			 * the memory is local to the NUMA node the loop is running on */
+			janus_ice_packet_pool_prewarm(loop->pool, JANUS_ICE_PACKET_POOL_PREWARM);
+		}
+	}
 	JANUS_LOG(LOG_DBG, "[loop#%d] Looping...\n", loop->id);
+	g_private_set(&current_event_loop, loop);
 	g_main_loop_run(loop->mainloop);
+	g_private_set(&current_event_loop, NULL);
 	/* When the loop quits, we can unref it */
 	g_main_loop_unref(loop->mainloop);
 	g_main_context_unref(loop->mainctx);
@@ -233,6 +544,210 @@ int janus_ice_get_static_event_loops(void) {
 gboolean janus_ice_is_loop_indication_allowed(void) {
 	return allow_loop_indication;
 }
+int janus_ice_set_static_event_loops_placement(const char *placement) {
+	if(placement == NULL)
+		return -1;
+	if(!strcasecmp(placement, "handles")) {
+		event_loops_placement = JANUS_ICE_LOOP_PLACEMENT_HANDLES;
+	} else if(!strcasecmp(placement, "load")) {
+		event_loops_placement = JANUS_ICE_LOOP_PLACEMENT_LOAD;
+	} else {
+		JANUS_LOG(LOG_WARN, "Invalid event loops placement policy '%s', using 'handles'\n", placement);
+		event_loops_placement = JANUS_ICE_LOOP_PLACEMENT_HANDLES;
+		return -1;
+	}
+	return 0;
+}
+void janus_ice_set_static_event_loops_rebalance(int threshold) {
+	if(threshold < 0 || threshold > 100) {
+		JANUS_LOG(LOG_WARN, "Invalid event loops rebalance threshold %d, disabling\n", threshold);
+		threshold = 0;
+	}
+	event_loops_rebalance = threshold * 10;
+	if(event_loops_rebalance > 0) {
+		JANUS_LOG(LOG_INFO, "Handles will move to another static loop when theirs is %d%% busier\n", threshold);
+	}
+}
+/* How loaded a loop is: how much of the time it's busy matters most, while the
+ * packet rate and backlog tell loops apart before their utilization adds up,
+ * and the number of handles breaks the ties between idle loops */
+static gint64 janus_ice_static_event_loop_score(janus_ice_static_event_loop *loop) {
+	return (gint64)g_atomic_int_get(&loop->load_utilization) * 1000 +
+		g_atomic_int_get(&loop->load_pps) / 10 + g_atomic_int_get(&loop->load_queued) * 10 + loop->handles;
+}
+/* Pick the least loaded loop, according to the placement policy: must be called with the event_loops_mutex locked */
+static janus_ice_static_event_loop *janus_ice_static_event_loop_pick(void) {
+	janus_ice_static_event_loop *loop = NULL;
+	gint64 best = -1;
+	GSList *l = event_loops;
+	while(l) {
+		janus_ice_static_event_loop *el = (janus_ice_static_event_loop *)l->data;
+		gint64 score = (event_loops_placement == JANUS_ICE_LOOP_PLACEMENT_LOAD) ?
+			janus_ice_static_event_loop_score(el) : el->handles;
+		if(score == 0) {
+			/* Best option, stop here */
+			return el;
+		}
+		if(best == -1 || score < best) {
+			best = score;
+			loop = el;
+		}
+		l = l->next;
+	}
+	return loop;
+}
+/* Take note of the handle leaving its group: must be called with the event_loops_mutex locked */
+static void janus_ice_loop_group_leave(janus_ice_handle *handle) {
+	if(handle->loop_group == NULL)
+		return;
+	janus_ice_loop_group *group = loop_groups ? g_hash_table_lookup(loop_groups, handle->loop_group) : NULL;
+	if(group != NULL) {
+		group->handles--;
+		if(group->handles == 0)
+			g_hash_table_remove(loop_groups, handle->loop_group);
+	}
+	g_free(handle->loop_group);
+	handle->loop_group = NULL;
+}
+int janus_ice_set_static_event_loops_affinity(const char *affinity) {
+	if(affinity == NULL || static_event_loops > 0)
+		return -1;
+	if(event_loops_cpus != NULL) {
+		g_array_free(event_loops_cpus, TRUE);
+		event_loops_cpus = NULL;
+	}
+	if(!strcasecmp(affinity, "auto")) {
+		/* Use all the CPUs, alternating NUMA nodes, so that loops are spread evenly */
+		int cpus = janus_cpu_count(), i = 0, node = 0, max_node = 0;
+		int *nodes = g_malloc(cpus * sizeof(int));
+		for(i=0; i<cpus; i++) {
+			nodes[i] = janus_cpu_numa_node(i);
+			if(nodes[i] < 0)
+				nodes[i] = 0;
+			if(nodes[i] > max_node)
+				max_node = nodes[i];
+		}
+		event_loops_cpus = g_array_sized_new(FALSE, FALSE, sizeof(int), cpus);
+		while(event_loops_cpus->len < (guint)cpus) {
+			for(node=0; node<=max_node; node++) {
+				for(i=0; i<cpus; i++) {
+					if(nodes[i] == node) {
+						g_array_append_val(event_loops_cpus, i);
+						nodes[i] = -1;
+						break;
+					}
+				}
+			}
+		}
+		g_free(nodes);
+	} else {
+		event_loops_cpus = janus_cpu_list_parse(affinity);
+		if(event_loops_cpus == NULL) {
+			JANUS_LOG(LOG_WARN, "Invalid event loops affinity '%s', loops won't be pinned\n", affinity);
+			return -1;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Static event loops will be pinned to %u CPUs\n", event_loops_cpus->len);
+	return 0;
+}
+/* Create a new event loop, and spawn the thread it will run on */
+static janus_ice_static_event_loop *janus_ice_static_event_loop_create(int id, int cpu, const char *tname) {
+	janus_ice_static_event_loop *loop = g_malloc0(sizeof(janus_ice_static_event_loop));
+	loop->id = id;
+	loop->cpu = cpu;
+	loop->numa_node = cpu >= 0 ? janus_cpu_numa_node(cpu) : -1;
+	loop->mainctx = g_main_context_new();
+	loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
+	loop->pool = janus_ice_packet_pool_create();
+	loop->stats_started = janus_get_monotonic_time();
+	int slot = 0;
+	for(slot=0; slot<JANUS_ICE_RTCP_WHEEL_SLOTS; slot++)
+		g_queue_init(&loop->rtcp_wheel[slot]);
+	janus_mutex_init(&loop->rtcp_mutex);
+	loop->mux_fd = -1;
+	janus_mutex_init(&loop->mux_mutex);
+	loop->rtcp_source = g_timeout_source_new(JANUS_ICE_RTCP_WHEEL_TICK/1000);
+	g_source_set_priority(loop->rtcp_source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(loop->rtcp_source, janus_ice_static_event_loop_rtcp, loop, NULL);
+	g_source_attach(loop->rtcp_source, loop->mainctx);
+	janus_refcount_init(&loop->ref, janus_ice_static_event_loop_free);
+	/* Now spawn a thread for this loop */
+	GError *error = NULL;
+	janus_refcount_increase(&loop->ref);
+	loop->thread = g_thread_try_new(tname, &janus_ice_static_event_loop_thread, loop, &error);
+	if(error != NULL) {
+		g_main_loop_unref(loop->mainloop);
+		g_main_context_unref(loop->mainctx);
+		janus_refcount_decrease(&loop->ref);
+		janus_ice_static_event_loop_destroy(loop);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a new event loop thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		return NULL;
+	}
+	return loop;
+}
+void janus_ice_set_static_event_loops_promotion(int pps, int busy, int max_dedicated) {
+	if(pps < 0 || busy < 0 || busy > 100 || max_dedicated < 0) {
+		JANUS_LOG(LOG_WARN, "Invalid event loops promotion thresholds (%d pps, %d%%, %d loops), disabling\n",
+			pps, busy, max_dedicated);
+		pps = 0;
+		busy = 0;
+		max_dedicated = 0;
+	}
+	event_loops_promote_pps = pps;
+	event_loops_promote_busy = busy * 10;
+	event_loops_dedicated_max = max_dedicated;
+	if(event_loops_promote_pps > 0 || event_loops_promote_busy > 0) {
+		JANUS_LOG(LOG_INFO, "Handles above %d pps or %d%% busy will be promoted to a dedicated loop (max %d, 0=no limit)\n",
+			pps, busy, max_dedicated);
+	}
+}
+/* Check whether a handle is busy enough for a dedicated loop (divider=1), or still busy
+ * enough to keep it (divider=2, so that handles don't bounce back and forth) */
+static gboolean janus_ice_handle_is_busy(janus_ice_handle *handle, int divider) {
+	return (event_loops_promote_pps > 0 && g_atomic_int_get(&handle->load_pps) >= event_loops_promote_pps / divider) ||
+		(event_loops_promote_busy > 0 && g_atomic_int_get(&handle->load_utilization) >= event_loops_promote_busy / divider);
+}
+/* Create a loop for a single busy handle: it will be retired when the handle leaves it */
+static janus_ice_static_event_loop *janus_ice_dedicated_event_loop_create(janus_ice_handle *handle) {
+	janus_mutex_lock(&event_loops_mutex);
+	if(event_loops_dedicated_max > 0 && g_slist_length(dedicated_loops) >= event_loops_dedicated_max) {
+		janus_mutex_unlock(&event_loops_mutex);
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Too many dedicated loops already, not promoting handle\n", handle->handle_id);
+		return NULL;
+	}
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "hloop %"SCNu64, handle->handle_id);
+	janus_ice_static_event_loop *loop = janus_ice_static_event_loop_create(-1, -1, tname);
+	if(loop != NULL) {
+		/* Nobody will join the thread, so we don't need the reference */
+		loop->dedicated = TRUE;
+		g_thread_unref(loop->thread);
+		loop->thread = NULL;
+		dedicated_loops = g_slist_append(dedicated_loops, loop);
+		janus_refcount_increase(&loop->ref);
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	return loop;
+}
+static gboolean janus_ice_dedicated_event_loop_quit(gpointer user_data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)user_data;
+	g_main_loop_quit(loop->mainloop);
+	return G_SOURCE_REMOVE;
+}
+/* Stop a dedicated loop if its handle left it: must be called with the event_loops_mutex locked */
+static void janus_ice_dedicated_event_loop_retire(janus_ice_static_event_loop *loop) {
+	if(loop == NULL || g_slist_find(dedicated_loops, loop) == NULL || loop->handles > 0)
+		return;
+	dedicated_loops = g_slist_remove(dedicated_loops, loop);
+	/* The thread may not be running the loop yet, so we quit it from there */
+	GSource *source = g_idle_source_new();
+	g_source_set_callback(source, janus_ice_dedicated_event_loop_quit, loop, NULL);
+	g_source_attach(source, loop->mainctx);
+	g_source_unref(source);
+	janus_ice_static_event_loop_destroy(loop);
+}
 void janus_ice_set_static_event_loops(int loops, gboolean allow_api) {
 	if(loops == 0)
 		return;
@@ -243,26 +758,11 @@ void janus_ice_set_static_event_loops(int loops, gboolean allow_api) {
 	/* Create a pool of new event loops */
 	int i = 0;
 	for(i=0; i<loops; i++) {
-		janus_ice_static_event_loop *loop = g_malloc0(sizeof(janus_ice_static_event_loop));
-		loop->id = static_event_loops;
-		loop->mainctx = g_main_context_new();
-		loop->mainloop = g_main_loop_new(loop->mainctx, FALSE);
-		janus_refcount_init(&loop->ref, janus_ice_static_event_loop_free);
-		/* Now spawn a thread for this loop */
-		GError *error = NULL;
+		int cpu = event_loops_cpus ? g_array_index(event_loops_cpus, int, i % event_loops_cpus->len) : -1;
 		char tname[16];
-		g_snprintf(tname, sizeof(tname), "hloop %d", loop->id);
-		janus_refcount_increase(&loop->ref);
-		loop->thread = g_thread_try_new(tname, &janus_ice_static_event_loop_thread, loop, &error);
-		if(error != NULL) {
-			g_main_loop_unref(loop->mainloop);
-			g_main_context_unref(loop->mainctx);
-			janus_refcount_decrease(&loop->ref);
-			janus_ice_static_event_loop_destroy(loop);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a new event loop thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
-		} else {
+		g_snprintf(tname, sizeof(tname), "hloop %d", static_event_loops);
+		janus_ice_static_event_loop *loop = janus_ice_static_event_loop_create(static_event_loops, cpu, tname);
+		if(loop != NULL) {
 			event_loops = g_slist_append(event_loops, loop);
 			static_event_loops++;
 		}
@@ -284,12 +784,84 @@ json_t *janus_ice_static_event_loops_info(void) {
 		json_t *info = json_object();
 		json_object_set_new(info, "id", json_integer(loop->id));
 		json_object_set_new(info, "handles", json_integer(loop->handles));
+		json_object_set_new(info, "utilization", json_real((double)g_atomic_int_get(&loop->load_utilization)/10.0));
+		json_object_set_new(info, "packets-per-sec", json_integer(g_atomic_int_get(&loop->load_pps)));
+		json_object_set_new(info, "queued", json_integer(g_atomic_int_get(&loop->load_queued)));
+		if(loop->cpu >= 0) {
+			json_object_set_new(info, "cpu", json_integer(loop->cpu));
+			if(loop->numa_node >= 0)
+				json_object_set_new(info, "numa-node", json_integer(loop->numa_node));
+		}
+		if(loop->recv_batches > 0) {
+			json_object_set_new(info, "recv-batches", json_integer(loop->recv_batches));
+			json_object_set_new(info, "recv-batch-avg", json_real((double)loop->recv_batch_packets/(double)loop->recv_batches));
+		}
+		if(loop->mux_port > 0)
+			json_object_set_new(info, "single-port", json_integer(loop->mux_port));
+		json_object_set_new(info, "packet-pool", janus_ice_packet_pool_info(loop->pool));
+		json_object_set_new(info, "stats", janus_ice_static_event_loop_stats(loop));
+		guint rtcp_handles = 0;
+		int slot = 0;
+		janus_mutex_lock(&loop->rtcp_mutex);
+		for(slot=0; slot<JANUS_ICE_RTCP_WHEEL_SLOTS; slot++)
+			rtcp_handles += g_queue_get_length(&loop->rtcp_wheel[slot]);
+		janus_mutex_unlock(&loop->rtcp_mutex);
+		json_object_set_new(info, "rtcp-handles", json_integer(rtcp_handles));
 		json_array_append_new(list, info);
 		l = l->next;
 	}
 	janus_mutex_unlock(&event_loops_mutex);
 	return list;
 }
+void janus_ice_static_event_loops_metrics(GString *out) {
+	if(static_event_loops < 1 || out == NULL)
+		return;
+	/* Take a snapshot first, as samples of the same family must be printed together */
+	typedef struct janus_ice_loop_metrics {
+		int id;
+		guint handles;
+		gint64 busy;
+		gint utilization, queued;
+	} janus_ice_loop_metrics;
+	janus_mutex_lock(&event_loops_mutex);
+	guint count = g_slist_length(event_loops), i = 0;
+	janus_ice_loop_metrics *loops = g_malloc0(count * sizeof(janus_ice_loop_metrics));
+	GSList *l = event_loops;
+	for(i=0; l && i<count; i++, l = l->next) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
+		loops[i].id = loop->id;
+		loops[i].handles = loop->handles;
+		loops[i].busy = loop->load_busy;
+		loops[i].utilization = g_atomic_int_get(&loop->load_utilization);
+		loops[i].queued = g_atomic_int_get(&loop->load_queued);
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	char labels[32];
+	janus_metrics_print_family(out, "janus_loop_handles", "gauge", "Handles served by each static event loop");
+	for(i=0; i<count; i++) {
+		g_snprintf(labels, sizeof(labels), "loop=\"%d\"", loops[i].id);
+		janus_metrics_print_sample(out, "janus_loop_handles", labels, loops[i].handles);
+	}
+	janus_metrics_print_family(out, "janus_loop_busy_seconds", "counter", "Time each static event loop spent serving packets and timers");
+	for(i=0; i<count; i++) {
+		g_snprintf(labels, sizeof(labels), "loop=\"%d\"", loops[i].id);
+		janus_metrics_print_sample(out, "janus_loop_busy_seconds_total", labels, (double)loops[i].busy/G_USEC_PER_SEC);
+	}
+	janus_metrics_print_family(out, "janus_loop_utilization_ratio", "gauge", "Fraction of the last second each static event loop was busy");
+	for(i=0; i<count; i++) {
+		g_snprintf(labels, sizeof(labels), "loop=\"%d\"", loops[i].id);
+		janus_metrics_print_sample(out, "janus_loop_utilization_ratio", labels, (double)loops[i].utilization/1000);
+	}
+	janus_metrics_print_family(out, "janus_loop_queued_packets", "gauge", "Most packets waiting to be sent on each static event loop in the last second");
+	for(i=0; i<count; i++) {
+		g_snprintf(labels, sizeof(labels), "loop=\"%d\"", loops[i].id);
+		janus_metrics_print_sample(out, "janus_loop_queued_packets", labels, loops[i].queued);
+	}
+	g_free(loops);
+}
+json_t *janus_ice_shared_packet_pool_info(void) {
+	return janus_ice_packet_pool_info(shared_packet_pool);
+}
 void janus_ice_stop_static_event_loops(void) {
 	if(static_event_loops < 1)
 		return;
@@ -304,6 +876,20 @@ void janus_ice_stop_static_event_loops(void) {
 		l = l->next;
 	}
 	g_slist_free_full(event_loops, (GDestroyNotify)janus_ice_static_event_loop_destroy);
+	/* Dedicated loops have no thread to join, we just quit them */
+	while(dedicated_loops != NULL) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)dedicated_loops->data;
+		loop->handles = 0;
+		janus_ice_dedicated_event_loop_retire(loop);
+	}
+	if(loop_groups != NULL) {
+		g_hash_table_destroy(loop_groups);
+		loop_groups = NULL;
+	}
+	if(event_loops_cpus != NULL) {
+		g_array_free(event_loops_cpus, TRUE);
+		event_loops_cpus = NULL;
+	}
 	janus_mutex_unlock(&event_loops_mutex);
 }
 
@@ -399,6 +985,130 @@ gboolean janus_ice_is_ignored(const char *ip) {
 	return false;
 }
 
+/* Local addresses to gather candidates on: enumerating and filtering the interfaces
+ * for each PeerConnection is expensive on hosts with many of them, so we keep a copy
+ * of the result, which we only build again when the kernel tells us (via netlink)
+ * that a link or address changed, or periodically where netlink isn't available */
+#define JANUS_ICE_LOCAL_ADDRESSES_TTL	(10*G_USEC_PER_SEC)
+static GArray *local_addresses = NULL;
+static gint64 local_addresses_updated = 0;
+static int local_addresses_netlink = -1;
+static janus_mutex local_addresses_mutex = JANUS_MUTEX_INITIALIZER;
+static void janus_ice_local_addresses_watch(void) {
+#ifdef __linux__
+	int fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if(fd < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't create netlink socket, local addresses will be refreshed periodically: %s\n",
+			g_strerror(errno));
+		return;
+	}
+	struct sockaddr_nl address = { 0 };
+	address.nl_family = AF_NETLINK;
+	address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if(bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't bind netlink socket, local addresses will be refreshed periodically: %s\n",
+			g_strerror(errno));
+		close(fd);
+		return;
+	}
+	local_addresses_netlink = fd;
+#endif
+}
+/* Check if the local addresses may have changed: must be called with the local_addresses_mutex locked */
+static gboolean janus_ice_local_addresses_changed(void) {
+	gboolean changed = (local_addresses == NULL);
+	if(local_addresses_netlink < 0)
+		return changed || (janus_get_monotonic_time() - local_addresses_updated >= JANUS_ICE_LOCAL_ADDRESSES_TTL);
+	/* We don't care what the notifications say, only that there are some */
+	char buffer[4096];
+	while(TRUE) {
+		ssize_t len = recv(local_addresses_netlink, buffer, sizeof(buffer), MSG_DONTWAIT);
+		if(len > 0 || (len < 0 && errno == ENOBUFS)) {
+			/* If the socket overflowed we lost some notifications, which means something changed anyway */
+			changed = TRUE;
+			continue;
+		} else if(len < 0 && errno == EINTR) {
+			continue;
+		}
+		break;
+	}
+	return changed;
+}
+static GArray *janus_ice_local_addresses_enumerate(void) {
+	struct ifaddrs *ifaddr, *ifa;
+	int family, s;
+	char host[NI_MAXHOST];
+	if(getifaddrs(&ifaddr) == -1) {
+		JANUS_LOG(LOG_ERR, "Error getting list of interfaces... %d (%s)\n", errno, g_strerror(errno));
+		return NULL;
+	}
+	GArray *addresses = g_array_new(FALSE, FALSE, sizeof(NiceAddress));
+	for(ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+		if(ifa->ifa_addr == NULL)
+			continue;
+		/* Skip interfaces which are not up and running */
+		if(!((ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING)))
+			continue;
+		/* Skip loopback interfaces */
+		if(ifa->ifa_flags & IFF_LOOPBACK)
+			continue;
+		family = ifa->ifa_addr->sa_family;
+		if(family != AF_INET && family != AF_INET6)
+			continue;
+		/* We only add IPv6 addresses if support for them has been explicitly enabled */
+		if(family == AF_INET6 && !janus_ipv6_enabled)
+			continue;
+		/* Check the interface name first, we can ignore that as well: enforce list would be checked later */
+		if(janus_ice_enforce_list == NULL && ifa->ifa_name != NULL && janus_ice_is_ignored(ifa->ifa_name))
+			continue;
+		s = getnameinfo(ifa->ifa_addr,
+				(family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6),
+				host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
+		if(s != 0) {
+			JANUS_LOG(LOG_ERR, "getnameinfo() failed: %s\n", gai_strerror(s));
+			continue;
+		}
+		/* Skip 0.0.0.0, :: and, unless otherwise configured, local scoped addresses  */
+		if(!strcmp(host, "0.0.0.0") || !strcmp(host, "::") || (!janus_ipv6_linklocal_enabled && !strncmp(host, "fe80:", 5)))
+			continue;
+		/* Check if this IP address is in the ignore/enforce list: the enforce list has the precedence but the ignore list can then discard candidates */
+		if(janus_ice_enforce_list != NULL) {
+			if(ifa->ifa_name != NULL && !janus_ice_is_enforced(ifa->ifa_name) && !janus_ice_is_enforced(host))
+				continue;
+		}
+		if(janus_ice_is_ignored(host))
+			continue;
+		/* Ok, we'll gather candidates on this address */
+		NiceAddress addr_local;
+		nice_address_init (&addr_local);
+		if(!nice_address_set_from_string (&addr_local, host)) {
+			JANUS_LOG(LOG_WARN, "Skipping invalid address %s\n", host);
+			continue;
+		}
+		JANUS_LOG(LOG_VERB, "Adding %s to the addresses to gather candidates for\n", host);
+		g_array_append_val(addresses, addr_local);
+	}
+	freeifaddrs(ifaddr);
+	return addresses;
+}
+/* Get a reference to the current list of local addresses (to unref when done) */
+static GArray *janus_ice_local_addresses_get(void) {
+	janus_mutex_lock(&local_addresses_mutex);
+	if(janus_ice_local_addresses_changed()) {
+		GArray *addresses = janus_ice_local_addresses_enumerate();
+		if(addresses != NULL) {
+			if(local_addresses != NULL)
+				g_array_unref(local_addresses);
+			local_addresses = addresses;
+			local_addresses_updated = janus_get_monotonic_time();
+			JANUS_LOG(LOG_VERB, "Updated the list of local addresses (%u)\n", local_addresses->len);
+		}
+	}
+	GArray *addresses = local_addresses ? g_array_ref(local_addresses) : NULL;
+	janus_mutex_unlock(&local_addresses_mutex);
+	return addresses;
+}
+
 
 /* Frequency of statistics via event handlers (one second by default) */
 static int janus_ice_event_stats_period = 1;
@@ -463,6 +1173,13 @@ typedef struct janus_ice_queued_packet {
 	gboolean retransmission;
 	gboolean encrypted;
 	gint64 added;
+	/* If this packet was taken from a pool, where it should go back to */
+	janus_ice_packet_pool *pool;
+	/* If set, data only contains the RTP header, and the payload is here */
+	janus_plugin_rtp_shared *shared;
+	gint shared_offset;
+	/* If this packet is being traced, when it went through the previous stages */
+	struct janus_ice_packet_trace *trace;
 } janus_ice_queued_packet;
 /* A few static, fake, messages we use as a trigger: e.g., to start a
  * new DTLS handshake, hangup a PeerConnection or close a handle */
@@ -473,7 +1190,8 @@ static janus_ice_queued_packet
 	janus_ice_media_stopped,
 	janus_ice_hangup_peerconnection,
 	janus_ice_detach_handle,
-	janus_ice_data_ready;
+	janus_ice_data_ready,
+	janus_ice_migrate_handle;
 
 /* Janus NACKed packet we're tracking (to avoid duplicates) */
 typedef struct janus_ice_nacked_packet {
@@ -518,32 +1236,225 @@ static void janus_ice_plugin_session_free(const janus_refcount *app_handle_ref);
 static void janus_ice_peerconnection_free(const janus_refcount *pc_ref);
 static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_ref);
 
+/* Size of the lock-free queues of outgoing packets for each handle, one per lane:
+ * video needs room for keyframe bursts, the other lanes see far fewer packets */
+static const gsize janus_ice_lane_sizes[JANUS_ICE_LANES] = { 256, 256, 512, 1024, 512 };
+static const char *janus_ice_lane_names[JANUS_ICE_LANES] = { "control", "audio", "retransmission", "video", "data" };
+const char *janus_ice_lane_str(janus_ice_lane lane) {
+	return (lane >= JANUS_ICE_LANE_CONTROL && lane < JANUS_ICE_LANES) ? janus_ice_lane_names[lane] : NULL;
+}
+
 /* Custom GSource for outgoing traffic */
 typedef struct janus_ice_outgoing_traffic {
 	GSource parent;
 	janus_ice_handle *handle;
 	GDestroyNotify destroy;
+	/* Whether the handle moved to another loop, and so this source is done */
+	gboolean migrated;
+	/* How many times in a row we were dispatched with a higher priority (low-latency handles) */
+	guint high_dispatches;
 } janus_ice_outgoing_traffic;
-static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_stats_handle(gpointer user_data);
 static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janus_ice_queued_packet *pkt);
+static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint component_id, guint len, gchar *buf, gpointer ice);
+static void janus_ice_recv_batch_stop(janus_ice_handle *handle, janus_ice_peerconnection *pc, gboolean reattach);
+static void janus_ice_mux_unregister(janus_ice_peerconnection *pc);
+static void janus_ice_send_batch_flush(void);
+static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt);
+static gint64 janus_ice_pacer_wait(janus_ice_pacer *pacer, gint64 now);
+static gboolean janus_ice_pacer_is_paced(janus_ice_queued_packet *pkt);
+static gint janus_ice_pacer_packet_size(janus_ice_queued_packet *pkt);
+static void janus_ice_pacer_prepare(janus_ice_handle *handle, gint64 now);
+static gboolean janus_ice_pacer_drain(janus_ice_handle *handle, gint64 now);
+/* Low-latency handles get a higher priority on their loop, so that their
+ * packets are sent before those of bulk handles woken up at the same time.
+ * GLib doesn't dispatch lower priority sources at all (libnice, timers,
+ * other handles) as long as a higher priority one is ready, though, so busy
+ * low-latency handles could starve the whole loop: that's why they only
+ * keep the higher priority for a limited number of dispatches in a row */
+#define JANUS_ICE_LOW_LATENCY_BUDGET	16
+static gint janus_ice_outgoing_traffic_priority(janus_ice_handle *handle) {
+	return g_atomic_int_get(&handle->low_latency) ? G_PRIORITY_HIGH : G_PRIORITY_DEFAULT;
+}
+static gint janus_ice_outgoing_traffic_next_priority(janus_ice_outgoing_traffic *t, gint current) {
+	if(!g_atomic_int_get(&t->handle->low_latency)) {
+		t->high_dispatches = 0;
+		return G_PRIORITY_DEFAULT;
+	}
+	if(current != G_PRIORITY_HIGH) {
+		/* We were dispatched with the default priority, so everything
+		 * else that was ready had its turn: we can go back up again */
+		t->high_dispatches = 0;
+		return G_PRIORITY_HIGH;
+	}
+	/* Spent our budget? Let the other sources through at least once */
+	t->high_dispatches++;
+	return t->high_dispatches < JANUS_ICE_LOW_LATENCY_BUDGET ? G_PRIORITY_HIGH : G_PRIORITY_DEFAULT;
+}
+guint janus_ice_handle_queued_packets(janus_ice_handle *handle, janus_ice_lane lane) {
+	if(handle == NULL)
+		return 0;
+	janus_ring *ring = NULL;
+	if(lane >= JANUS_ICE_LANE_CONTROL && lane < JANUS_ICE_LANES) {
+		ring = g_atomic_pointer_get(&handle->outgoing_lanes[lane]);
+		return ring ? janus_ring_length(ring) : 0;
+	}
+	guint queued = 0;
+	int i = 0;
+	for(i=0; i<JANUS_ICE_LANES; i++) {
+		ring = g_atomic_pointer_get(&handle->outgoing_lanes[i]);
+		if(ring != NULL)
+			queued += janus_ring_length(ring);
+	}
+	return queued;
+}
+/* Lanes are only allocated when the first packet is queued in them: audio-only
+ * or idle handles never pay for the video and data rings, for instance */
+static janus_ring *janus_ice_outgoing_lane_get(janus_ice_handle *handle, janus_ice_lane lane) {
+	janus_ring *ring = g_atomic_pointer_get(&handle->outgoing_lanes[lane]);
+	if(ring != NULL)
+		return ring;
+	ring = janus_ring_new(janus_ice_lane_sizes[lane]);
+	if(!g_atomic_pointer_compare_and_exchange(&handle->outgoing_lanes[lane], NULL, ring)) {
+		/* Another thread got there first */
+		janus_ring_destroy(ring);
+		ring = g_atomic_pointer_get(&handle->outgoing_lanes[lane]);
+	}
+	return ring;
+}
+/* Lane a packet must be queued in: the order of the lanes is their priority */
+static janus_ice_lane janus_ice_packet_lane(janus_ice_queued_packet *pkt) {
+	if(pkt->control)
+		return JANUS_ICE_LANE_CONTROL;
+	if(pkt->retransmission)
+		return JANUS_ICE_LANE_RETRANSMISSION;
+	if(pkt->type == JANUS_ICE_PACKET_AUDIO)
+		return JANUS_ICE_LANE_AUDIO;
+	if(pkt->type == JANUS_ICE_PACKET_VIDEO)
+		return JANUS_ICE_LANE_VIDEO;
+	return JANUS_ICE_LANE_DATA;
+}
+/* Strict priority: a packet from a lane is only sent when all the lanes
+ * before it are empty, which we check again for each packet, as other
+ * threads may be queueing more while we're sending */
+static janus_ice_queued_packet *janus_ice_outgoing_lanes_pop(janus_ice_handle *handle) {
+	janus_ice_queued_packet *pkt = NULL;
+	janus_ring *ring = NULL;
+	int i = 0;
+	for(i=0; i<JANUS_ICE_LANES; i++) {
+		ring = g_atomic_pointer_get(&handle->outgoing_lanes[i]);
+		if(ring != NULL && (pkt = janus_ring_pop(ring)) != NULL)
+			return pkt;
+	}
+	return NULL;
+}
+static gboolean janus_ice_outgoing_traffic_ready(janus_ice_outgoing_traffic *t, gint *timeout) {
+	if(g_async_queue_length(t->handle->queued_packets) > 0 ||
+			janus_ice_handle_queued_packets(t->handle, JANUS_ICE_LANES) > 0)
+		return TRUE;
+	/* If we're pacing, check whether it's time to send more packets */
+	janus_ice_pacer *pacer = t->handle->pacer;
+	if(pacer == NULL || g_queue_is_empty(&pacer->packets))
+		return FALSE;
+	gint64 wait = janus_ice_pacer_wait(pacer, janus_get_monotonic_time());
+	if(wait <= 0)
+		return TRUE;
+	if(timeout != NULL)
+		*timeout = (wait + 999) / 1000;
+	return FALSE;
+}
 static gboolean janus_ice_outgoing_traffic_prepare(GSource *source, gint *timeout) {
-	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
-	return (g_async_queue_length(t->handle->queued_packets) > 0);
+	return janus_ice_outgoing_traffic_ready((janus_ice_outgoing_traffic *)source, timeout);
+}
+static gboolean janus_ice_outgoing_traffic_check(GSource *source) {
+	return janus_ice_outgoing_traffic_ready((janus_ice_outgoing_traffic *)source, NULL);
 }
 static gboolean janus_ice_outgoing_traffic_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
 	int ret = G_SOURCE_CONTINUE;
 	janus_ice_queued_packet *pkt = NULL;
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)t->handle->static_event_loop;
+	gint64 started = loop ? janus_get_monotonic_time() : 0;
+	guint handled = 0;
+	/* Check if the priority of this handle should change (e.g., low-latency mode) */
+	gint current = g_source_get_priority(source);
+	gint priority = janus_ice_outgoing_traffic_next_priority(t, current);
+	if(current != priority)
+		g_source_set_priority(source, priority);
+	/* Events and high priority packets first */
 	while((pkt = g_async_queue_try_pop(t->handle->queued_packets)) != NULL) {
+		handled++;
 		if(janus_ice_outgoing_traffic_handle(t->handle, pkt) == G_SOURCE_REMOVE)
 			ret = G_SOURCE_REMOVE;
+		if(t->migrated) {
+			/* The handle moved to another loop, which will take care of the rest:
+			 * send what we batched so far first, as that loop has a batch of its own */
+			janus_ice_send_batch_flush();
+			return G_SOURCE_REMOVE;
+		}
+	}
+	/* Then the packets plugins asked us to send: from now on, new packets
+	 * will need to wake us up again, in case we go back to sleep */
+	g_atomic_int_set(&t->handle->outgoing_wakeup, 0);
+	guint queued = 0, lane_queued = 0;
+	int lane = 0;
+	for(lane=0; lane<JANUS_ICE_LANES; lane++) {
+		lane_queued = janus_ice_handle_queued_packets(t->handle, lane);
+		if(lane_queued > t->handle->outgoing_lanes_max[lane])
+			t->handle->outgoing_lanes_max[lane] = lane_queued;
+		queued += lane_queued;
+	}
+	if(queued > t->handle->outgoing_packets_max)
+		t->handle->outgoing_packets_max = queued;
+	if(loop != NULL && queued > loop->load_queued_max)
+		loop->load_queued_max = queued;
+	handled += queued;
+	/* Video packets may have to go through the pacer first: we also cache
+	 * the time, so that it's not read again for each packet we send */
+	gint64 now = janus_get_monotonic_time();
+	janus_monotonic_time_cache_set(now);
+	janus_ice_pacer_prepare(t->handle, now);
+	janus_ice_pacer *pacer = t->handle->pacer;
+	while((pkt = janus_ice_outgoing_lanes_pop(t->handle)) != NULL) {
+		if(pacer != NULL && pacer->rate > 0 && janus_ice_pacer_is_paced(pkt)) {
+			gint size = janus_ice_pacer_packet_size(pkt);
+			if(!g_queue_is_empty(&pacer->packets) || pacer->budget <= 0) {
+				/* Wait for our turn */
+				g_queue_push_tail(&pacer->packets, pkt);
+				pacer->bytes += size;
+				pacer->paced++;
+				if(g_queue_get_length(&pacer->packets) > pacer->max_packets)
+					pacer->max_packets = g_queue_get_length(&pacer->packets);
+				continue;
+			}
+			pacer->budget -= size;
+		}
+		if(janus_ice_outgoing_traffic_handle(t->handle, pkt) == G_SOURCE_REMOVE)
+			ret = G_SOURCE_REMOVE;
+	}
+	if(t->handle->pacer != NULL && janus_ice_pacer_drain(t->handle, now) == G_SOURCE_REMOVE)
+		ret = G_SOURCE_REMOVE;
+	/* Packets queued while we were draining the lanes may have set the flag
+	 * again: clear it, so that the next packet wakes us up. Anything that was
+	 * queued before this point is seen by prepare, and dispatched right away */
+	g_atomic_int_set(&t->handle->outgoing_wakeup, 0);
+	/* If we're batching, send what we protected in this iteration */
+	janus_ice_send_batch_flush();
+	janus_monotonic_time_cache_set(0);
+	if(loop != NULL) {
+		/* Keep track of how busy the loop is */
+		janus_ice_static_event_loop_dispatched(loop, t->handle, handled, started, FALSE);
 	}
 	return ret;
 }
 static void janus_ice_outgoing_traffic_finalize(GSource *source) {
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Finalizing loop source\n", t->handle->handle_id);
+	if(t->migrated) {
+		/* The handle moved to another loop, and has a new source there */
+		janus_refcount_decrease(&t->handle->ref);
+		return;
+	}
 	if(static_event_loops > 0) {
 		/* This handle was sharing an event loop with others */
 		janus_ice_webrtc_free(t->handle);
@@ -556,11 +1467,47 @@ static void janus_ice_outgoing_traffic_finalize(GSource *source) {
 }
 static GSourceFuncs janus_ice_outgoing_traffic_funcs = {
 	janus_ice_outgoing_traffic_prepare,
-	NULL,	/* We don't need check */
+	janus_ice_outgoing_traffic_check,
 	janus_ice_outgoing_traffic_dispatch,
 	janus_ice_outgoing_traffic_finalize,
 	NULL, NULL
 };
+/* Custom GSource for the RTCP reports of handles with a dedicated loop */
+typedef struct janus_ice_rtcp_timer {
+	GSource parent;
+	gint64 next;
+} janus_ice_rtcp_timer;
+static gboolean janus_ice_rtcp_timer_prepare(GSource *source, gint *timeout) {
+	janus_ice_rtcp_timer *t = (janus_ice_rtcp_timer *)source;
+	gint64 now = g_source_get_time(source);
+	if(now >= t->next) {
+		*timeout = 0;
+		return TRUE;
+	}
+	*timeout = (t->next - now + 999) / 1000;
+	return FALSE;
+}
+static gboolean janus_ice_rtcp_timer_check(GSource *source) {
+	janus_ice_rtcp_timer *t = (janus_ice_rtcp_timer *)source;
+	return g_source_get_time(source) >= t->next;
+}
+static gboolean janus_ice_rtcp_timer_dispatch(GSource *source, GSourceFunc callback, gpointer user_data) {
+	janus_ice_rtcp_timer *t = (janus_ice_rtcp_timer *)source;
+	t->next = janus_ice_rtcp_next_report(g_source_get_time(source));
+	return callback ? callback(user_data) : G_SOURCE_REMOVE;
+}
+static GSourceFuncs janus_ice_rtcp_timer_funcs = {
+	janus_ice_rtcp_timer_prepare,
+	janus_ice_rtcp_timer_check,
+	janus_ice_rtcp_timer_dispatch,
+	NULL, NULL, NULL
+};
+static GSource *janus_ice_rtcp_timer_create(void) {
+	GSource *source = g_source_new(&janus_ice_rtcp_timer_funcs, sizeof(janus_ice_rtcp_timer));
+	janus_ice_rtcp_timer *t = (janus_ice_rtcp_timer *)source;
+	t->next = janus_ice_rtcp_next_report(g_get_monotonic_time());
+	return source;
+}
 static GSource *janus_ice_outgoing_traffic_create(janus_ice_handle *handle, GDestroyNotify destroy) {
 	GSource *source = g_source_new(&janus_ice_outgoing_traffic_funcs, sizeof(janus_ice_outgoing_traffic));
 	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)source;
@@ -634,14 +1581,423 @@ int janus_get_dscp(void) {
 	return dscp_ef;
 }
 
-
-static inline void janus_ice_free_rtp_packet(janus_rtp_packet *pkt) {
-	if(pkt == NULL) {
+/* Batched receive: when enabled, once a pair has been selected we detach the
+ * libnice receive callback, and drain the socket ourselves in batches */
+#define JANUS_ICE_MAX_RECV_BATCH	64
+#define JANUS_ICE_RECV_BUFSIZE		2048
+static uint16_t recv_batch_size = 0;
+void janus_ice_set_recv_batch_size(uint16_t size) {
+	if(size > JANUS_ICE_MAX_RECV_BATCH) {
+		JANUS_LOG(LOG_WARN, "Batched receive size %"SCNu16" too large, capping to %d\n", size, JANUS_ICE_MAX_RECV_BATCH);
+		size = JANUS_ICE_MAX_RECV_BATCH;
+	}
+	recv_batch_size = (size == 1 ? 0 : size);
+	if(recv_batch_size == 0)
+		JANUS_LOG(LOG_VERB, "Batched receive disabled\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting batched receive size to %"SCNu16" packets\n", recv_batch_size);
+}
+uint16_t janus_ice_get_recv_batch_size(void) {
+	return recv_batch_size;
+}
+/* The buffers are shared by all the PeerConnections served by the same loop thread */
+typedef struct janus_ice_recv_batch {
+	NiceInputMessage messages[JANUS_ICE_MAX_RECV_BATCH];
+	GInputVector buffers[JANUS_ICE_MAX_RECV_BATCH];
+	char data[JANUS_ICE_MAX_RECV_BATCH][JANUS_ICE_RECV_BUFSIZE];
+} janus_ice_recv_batch;
+static GPrivate recv_batch_buffers = G_PRIVATE_INIT(g_free);
+
+/* Batched send: when enabled, the SRTP packets protected in a single dispatch
+ * of the outgoing traffic source are sent with a single call, at the end */
+#define JANUS_ICE_MAX_SEND_BATCH	64
+static uint16_t send_batch_size = 0;
+void janus_ice_set_send_batch_size(uint16_t size) {
+	if(size > JANUS_ICE_MAX_SEND_BATCH) {
+		JANUS_LOG(LOG_WARN, "Batched send size %"SCNu16" too large, capping to %d\n", size, JANUS_ICE_MAX_SEND_BATCH);
+		size = JANUS_ICE_MAX_SEND_BATCH;
+	}
+	send_batch_size = (size == 1 ? 0 : size);
+	if(send_batch_size == 0)
+		JANUS_LOG(LOG_VERB, "Batched send disabled\n");
+	else
+		JANUS_LOG(LOG_VERB, "Setting batched send size to %"SCNu16" packets\n", send_batch_size);
+}
+uint16_t janus_ice_get_send_batch_size(void) {
+	return send_batch_size;
+}
+/* As dispatches never overlap on the same thread, the batch is per loop thread too:
+ * it keeps a reference to the handle and agent the packets were protected for, so
+ * that they can only be sent by the PeerConnection they belong to */
+typedef struct janus_ice_send_batch {
+	janus_ice_handle *handle;
+	NiceAgent *agent;
+	guint stream_id, component_id;
+	guint count;
+	NiceOutputMessage messages[JANUS_ICE_MAX_SEND_BATCH];
+	GOutputVector buffers[JANUS_ICE_MAX_SEND_BATCH];
+	char data[JANUS_ICE_MAX_SEND_BATCH][JANUS_ICE_RECV_BUFSIZE];
+} janus_ice_send_batch;
+static GPrivate send_batch_buffers = G_PRIVATE_INIT(g_free);
+static void janus_ice_send_batch_flush(void) {
+	if(send_batch_size == 0)
+		return;
+	janus_ice_send_batch *batch = g_private_get(&send_batch_buffers);
+	if(batch == NULL || batch->count == 0)
+		return;
+	guint count = batch->count;
+	janus_ice_handle *handle = batch->handle;
+	NiceAgent *agent = batch->agent;
+	batch->count = 0;
+	batch->handle = NULL;
+	batch->agent = NULL;
+	if(handle->agent != agent || handle->pc == NULL || handle->pc->stream_id != batch->stream_id) {
+		/* The PeerConnection went away in the meanwhile */
+		g_object_unref(agent);
+		janus_refcount_decrease(&handle->ref);
 		return;
 	}
-
-	g_free(pkt->data);
-	g_free(pkt);
+	GError *error = NULL;
+	gint sent = nice_agent_send_messages_nonblocking(agent, batch->stream_id, batch->component_id,
+		batch->messages, count, NULL, &error);
+	if(sent < (gint)count) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d packets in batch? (was %u, %s)\n", handle->handle_id,
+			sent, count, error && error->message ? error->message : "no error");
+	}
+	g_clear_error(&error);
+	g_object_unref(agent);
+	janus_refcount_decrease(&handle->ref);
+}
+/* Helper to send an SRTP packet, either right away or as part of a batch */
+static int janus_ice_send_rtp(janus_ice_handle *handle, janus_ice_peerconnection *pc, char *buf, int len) {
+	if(send_batch_size == 0 || len > JANUS_ICE_RECV_BUFSIZE || pc->mux != NULL || handle->agent == NULL) {
+		int sent = janus_ice_peerconnection_send(handle, pc, buf, len);
+		if(sent > 0) {
+			janus_metrics_inc(JANUS_METRICS_PACKETS_OUT);
+			janus_metrics_add(JANUS_METRICS_BYTES_OUT, sent);
+		}
+		return sent;
+	}
+	janus_ice_send_batch *batch = g_private_get(&send_batch_buffers);
+	if(batch == NULL) {
+		batch = g_malloc0(sizeof(janus_ice_send_batch));
+		g_private_set(&send_batch_buffers, batch);
+	}
+	if(batch->count > 0 && (batch->handle != handle || batch->agent != handle->agent ||
+			batch->stream_id != pc->stream_id || batch->component_id != pc->component_id))
+		janus_ice_send_batch_flush();
+	if(batch->count == 0) {
+		janus_refcount_increase(&handle->ref);
+		batch->handle = handle;
+		batch->agent = g_object_ref(handle->agent);
+		batch->stream_id = pc->stream_id;
+		batch->component_id = pc->component_id;
+	}
+	guint index = batch->count;
+	memcpy(batch->data[index], buf, len);
+	batch->buffers[index].buffer = batch->data[index];
+	batch->buffers[index].size = len;
+	batch->messages[index].buffers = &batch->buffers[index];
+	batch->messages[index].n_buffers = 1;
+	batch->count++;
+	janus_metrics_inc(JANUS_METRICS_PACKETS_OUT);
+	janus_metrics_add(JANUS_METRICS_BYTES_OUT, len);
+	if(batch->count >= send_batch_size)
+		janus_ice_send_batch_flush();
+	return len;
+}
+
+
+/* To avoid a malloc/free for each outgoing packet, we keep pools of preallocated
+ * packets, one per static event loop (or one shared by all handles otherwise):
+ * the buffer of pooled packets is large enough for a full MTU and SRTP overhead */
+#define JANUS_ICE_PACKET_POOL_SIZE		4096
+#define JANUS_ICE_PACKET_POOL_BUFSIZE	(1500+SRTP_MAX_TAG_LEN+4)
+typedef struct janus_ice_pooled_packet {
+	janus_ice_queued_packet pkt;
+	char buffer[JANUS_ICE_PACKET_POOL_BUFSIZE];
+} janus_ice_pooled_packet;
+struct janus_ice_packet_pool {
+	janus_ring *packets;
+	volatile gssize hits, misses;
+	volatile gint destroyed;
+	janus_refcount ref;
+};
+static void janus_ice_packet_pool_free(const janus_refcount *pool_ref) {
+	janus_ice_packet_pool *pool = janus_refcount_containerof(pool_ref, janus_ice_packet_pool, ref);
+	janus_ice_pooled_packet *pp = NULL;
+	while((pp = janus_ring_pop_mc(pool->packets)) != NULL)
+		g_free(pp);
+	janus_ring_destroy(pool->packets);
+	g_free(pool);
+}
+static janus_ice_packet_pool *janus_ice_packet_pool_create(void) {
+	janus_ice_packet_pool *pool = g_malloc0(sizeof(janus_ice_packet_pool));
+	pool->packets = janus_ring_new(JANUS_ICE_PACKET_POOL_SIZE);
+	janus_refcount_init(&pool->ref, janus_ice_packet_pool_free);
+	return pool;
+}
+static void janus_ice_packet_pool_prewarm(janus_ice_packet_pool *pool, guint count) {
+	if(pool == NULL)
+		return;
+	while(count > 0 && janus_ring_length(pool->packets) < JANUS_ICE_PACKET_POOL_SIZE) {
+		janus_ice_pooled_packet *pp = g_malloc0(sizeof(janus_ice_pooled_packet));
+		if(!janus_ring_push(pool->packets, pp)) {
+			g_free(pp);
+			break;
+		}
+		count--;
+	}
+}
+static void janus_ice_packet_pool_destroy(janus_ice_packet_pool *pool) {
+	if(pool == NULL || !g_atomic_int_compare_and_exchange(&pool->destroyed, 0, 1))
+		return;
+	janus_refcount_decrease(&pool->ref);
+}
+static json_t *janus_ice_packet_pool_info(janus_ice_packet_pool *pool) {
+	json_t *info = json_object();
+	if(pool == NULL)
+		return info;
+	gsize cached = janus_ring_length(pool->packets);
+	json_object_set_new(info, "hits", json_integer(g_atomic_pointer_get(&pool->hits)));
+	json_object_set_new(info, "misses", json_integer(g_atomic_pointer_get(&pool->misses)));
+	json_object_set_new(info, "cached", json_integer(cached));
+	json_object_set_new(info, "resident-bytes", json_integer(cached * sizeof(janus_ice_pooled_packet)));
+	return info;
+}
+/* Helper to allocate a new outgoing packet: if the data fits, it comes from a pool */
+/* Packet tracing: when enabled, one incoming packet out of N is stamped at each
+ * stage of the media pipeline (received, passed to the plugin, relayed by the
+ * plugin, queued, sent), and the time spent in each stage is added to histograms
+ * per plugin and per loop. As the plugin relays packets on the same thread it got
+ * them on, what's being traced is kept in a thread-local context: this means that
+ * packets plugins relay from threads of their own (e.g., a mixer) are not traced */
+#define JANUS_ICE_TRACE_STAGES	5
+static const char *janus_ice_trace_stages[JANUS_ICE_TRACE_STAGES] = {
+	"core-in", "plugin", "core-out", "queue", "total"
+};
+typedef struct janus_ice_packet_trace {
+	gint64 received, plugin, relayed;
+	const char *package;
+} janus_ice_packet_trace;
+typedef struct janus_ice_trace_context {
+	guint packets;
+	gboolean active;
+	janus_ice_packet_trace trace;
+} janus_ice_trace_context;
+static GPrivate janus_ice_trace_thread = G_PRIVATE_INIT(g_free);
+static volatile gint packet_tracing = 0;
+/* Histograms since tracing was (re)started, and since the last event we sent */
+typedef struct janus_ice_trace_stats {
+	janus_ice_loop_histogram total[JANUS_ICE_TRACE_STAGES], window[JANUS_ICE_TRACE_STAGES];
+} janus_ice_trace_stats;
+static GHashTable *trace_plugins = NULL, *trace_loops = NULL;
+static gint64 trace_last_event = 0;
+static janus_mutex trace_mutex = JANUS_MUTEX_INITIALIZER;
+
+void janus_ice_set_packet_tracing(int sampling) {
+	g_atomic_int_set(&packet_tracing, sampling > 0 ? sampling : 0);
+}
+int janus_ice_get_packet_tracing(void) {
+	return g_atomic_int_get(&packet_tracing);
+}
+/* A packet was received: check if it's its turn to be traced */
+static janus_ice_trace_context *janus_ice_trace_start(void) {
+	int sampling = g_atomic_int_get(&packet_tracing);
+	if(sampling == 0)
+		return NULL;
+	janus_ice_trace_context *ctx = g_private_get(&janus_ice_trace_thread);
+	if(ctx == NULL) {
+		ctx = g_malloc0(sizeof(janus_ice_trace_context));
+		g_private_set(&janus_ice_trace_thread, ctx);
+	}
+	if(++ctx->packets % sampling != 0)
+		return NULL;
+	memset(&ctx->trace, 0, sizeof(ctx->trace));
+	ctx->trace.received = janus_get_monotonic_time();
+	ctx->active = TRUE;
+	return ctx;
+}
+static void janus_ice_trace_stop(janus_ice_trace_context *ctx) {
+	if(ctx != NULL)
+		ctx->active = FALSE;
+}
+/* The packet being traced is about to be passed to a plugin */
+static void janus_ice_trace_plugin(janus_plugin *plugin) {
+	if(!g_atomic_int_get(&packet_tracing))
+		return;
+	janus_ice_trace_context *ctx = g_private_get(&janus_ice_trace_thread);
+	if(ctx == NULL || !ctx->active)
+		return;
+	ctx->trace.package = plugin->get_package();
+	ctx->trace.plugin = janus_get_monotonic_time();
+}
+/* The plugin is relaying a packet: if it's the one being traced, the new packet carries the trace on */
+static janus_ice_packet_trace *janus_ice_trace_relayed(void) {
+	if(!g_atomic_int_get(&packet_tracing))
+		return NULL;
+	janus_ice_trace_context *ctx = g_private_get(&janus_ice_trace_thread);
+	if(ctx == NULL || !ctx->active || ctx->trace.plugin == 0)
+		return NULL;
+	janus_ice_packet_trace *trace = g_malloc(sizeof(janus_ice_packet_trace));
+	*trace = ctx->trace;
+	trace->relayed = janus_get_monotonic_time();
+	return trace;
+}
+static void janus_ice_trace_stats_add(GHashTable *table, gpointer key, gint64 *values) {
+	janus_ice_trace_stats *stats = g_hash_table_lookup(table, key);
+	if(stats == NULL) {
+		stats = g_malloc0(sizeof(janus_ice_trace_stats));
+		g_hash_table_insert(table, key, stats);
+	} else if(table == trace_plugins) {
+		/* We already have a copy of the key */
+		g_free(key);
+	}
+	int i = 0;
+	for(i=0; i<JANUS_ICE_TRACE_STAGES; i++) {
+		janus_ice_loop_histogram_add(&stats->total[i], values[i]);
+		janus_ice_loop_histogram_add(&stats->window[i], values[i]);
+	}
+}
+static json_t *janus_ice_trace_stats_summary(janus_ice_loop_histogram *stages) {
+	json_t *summary = json_object();
+	int i = 0;
+	for(i=0; i<JANUS_ICE_TRACE_STAGES; i++) {
+		json_t *stage = json_object();
+		json_object_set_new(stage, "count", json_integer(stages[i].count));
+		json_object_set_new(stage, "p50", json_integer(janus_ice_loop_histogram_percentile(&stages[i], 50)));
+		json_object_set_new(stage, "p99", json_integer(janus_ice_loop_histogram_percentile(&stages[i], 99)));
+		json_object_set_new(stage, "max", json_integer(stages[i].max));
+		json_object_set_new(summary, janus_ice_trace_stages[i], stage);
+	}
+	return summary;
+}
+/* Summary of the traced packets, either since tracing was (re)started or since the last event */
+static json_t *janus_ice_packet_tracing_info(gboolean window) {
+	json_t *info = json_object();
+	json_object_set_new(info, "sampling", json_integer(g_atomic_int_get(&packet_tracing)));
+	json_t *plugins = json_object(), *loops = json_object();
+	janus_mutex_lock(&trace_mutex);
+	GHashTableIter iter;
+	gpointer key, value;
+	if(trace_plugins != NULL) {
+		g_hash_table_iter_init(&iter, trace_plugins);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			janus_ice_trace_stats *stats = (janus_ice_trace_stats *)value;
+			json_object_set_new(plugins, (const char *)key,
+				janus_ice_trace_stats_summary(window ? stats->window : stats->total));
+			if(window)
+				memset(stats->window, 0, sizeof(stats->window));
+		}
+	}
+	if(trace_loops != NULL) {
+		char id[16];
+		g_hash_table_iter_init(&iter, trace_loops);
+		while(g_hash_table_iter_next(&iter, &key, &value)) {
+			janus_ice_trace_stats *stats = (janus_ice_trace_stats *)value;
+			/* Handles with a loop of their own are all grouped together */
+			int loop = GPOINTER_TO_INT(key) - 1;
+			if(loop < 0)
+				g_snprintf(id, sizeof(id), "none");
+			else
+				g_snprintf(id, sizeof(id), "%d", loop);
+			json_object_set_new(loops, id, janus_ice_trace_stats_summary(window ? stats->window : stats->total));
+			if(window)
+				memset(stats->window, 0, sizeof(stats->window));
+		}
+	}
+	janus_mutex_unlock(&trace_mutex);
+	json_object_set_new(info, "plugins", plugins);
+	json_object_set_new(info, "loops", loops);
+	return info;
+}
+json_t *janus_ice_packet_tracing_summary(gboolean reset) {
+	json_t *info = janus_ice_packet_tracing_info(FALSE);
+	if(reset) {
+		janus_mutex_lock(&trace_mutex);
+		g_clear_pointer(&trace_plugins, g_hash_table_destroy);
+		g_clear_pointer(&trace_loops, g_hash_table_destroy);
+		janus_mutex_unlock(&trace_mutex);
+	}
+	return info;
+}
+/* A traced packet was sent: update the histograms */
+static void janus_ice_trace_sent(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
+	janus_ice_packet_trace *trace = pkt->trace;
+	gint64 now = janus_get_monotonic_time();
+	gint64 values[JANUS_ICE_TRACE_STAGES] = {
+		trace->plugin - trace->received,
+		trace->relayed - trace->plugin,
+		MAX(0, pkt->added - trace->relayed),
+		now - pkt->added,
+		now - trace->received
+	};
+	int loop = handle->static_event_loop ? ((janus_ice_static_event_loop *)handle->static_event_loop)->id : -1;
+	gboolean notify = FALSE;
+	janus_mutex_lock(&trace_mutex);
+	if(trace_plugins == NULL) {
+		trace_plugins = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+		trace_loops = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+	}
+	janus_ice_trace_stats_add(trace_plugins, g_strdup(trace->package ? trace->package : "unknown"), values);
+	janus_ice_trace_stats_add(trace_loops, GINT_TO_POINTER(loop + 1), values);
+	/* Check if we should notify event handlers (as often as we do for media stats) */
+	int period = janus_ice_get_event_stats_period();
+	if(period > 0 && janus_events_is_enabled() && now - trace_last_event >= period * G_USEC_PER_SEC) {
+		notify = (trace_last_event > 0);
+		trace_last_event = now;
+	}
+	janus_mutex_unlock(&trace_mutex);
+	if(notify) {
+		json_t *info = janus_ice_packet_tracing_info(TRUE);
+		janus_events_notify_handlers(JANUS_EVENT_TYPE_CORE, JANUS_EVENT_SUBTYPE_CORE_PACKET_TRACE, 0, info);
+	}
+}
+
+static janus_ice_queued_packet *janus_ice_queued_packet_new(janus_ice_handle *handle, gint size) {
+	janus_ice_packet_pool *pool = NULL;
+	if(handle != NULL && handle->static_event_loop != NULL)
+		pool = ((janus_ice_static_event_loop *)handle->static_event_loop)->pool;
+	else
+		pool = shared_packet_pool;
+	if(pool == NULL || size > JANUS_ICE_PACKET_POOL_BUFSIZE || g_atomic_int_get(&pool->destroyed)) {
+		janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+		pkt->data = g_malloc(size);
+		pkt->pool = NULL;
+		pkt->shared = NULL;
+		pkt->shared_offset = 0;
+		pkt->trace = NULL;
+		return pkt;
+	}
+	janus_ice_pooled_packet *pp = janus_ring_pop_mc(pool->packets);
+	if(pp != NULL) {
+		g_atomic_pointer_add(&pool->hits, 1);
+	} else {
+		g_atomic_pointer_add(&pool->misses, 1);
+		pp = g_malloc(sizeof(janus_ice_pooled_packet));
+	}
+	janus_refcount_increase(&pool->ref);
+	pp->pkt.pool = pool;
+	pp->pkt.data = pp->buffer;
+	pp->pkt.shared = NULL;
+	pp->pkt.shared_offset = 0;
+	pp->pkt.trace = NULL;
+	return &pp->pkt;
+}
+/* Helper to make sure the packet buffer can contain at least size bytes */
+static void janus_ice_queued_packet_resize(janus_ice_queued_packet *pkt, gint size) {
+	if(pkt->pool == NULL) {
+		pkt->data = g_realloc(pkt->data, size);
+		return;
+	}
+	janus_ice_pooled_packet *pp = (janus_ice_pooled_packet *)pkt;
+	if(pkt->data != pp->buffer) {
+		pkt->data = g_realloc(pkt->data, size);
+	} else if(size > JANUS_ICE_PACKET_POOL_BUFSIZE) {
+		/* Doesn't fit in the pooled buffer anymore */
+		pkt->data = g_malloc(size);
+		memcpy(pkt->data, pp->buffer, pkt->length);
+	}
 }
 
 static void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt) {
@@ -651,20 +2007,209 @@ static void janus_ice_free_queued_packet(janus_ice_queued_packet *pkt) {
 			pkt == &janus_ice_media_stopped ||
 			pkt == &janus_ice_hangup_peerconnection ||
 			pkt == &janus_ice_detach_handle ||
-			pkt == &janus_ice_data_ready) {
+			pkt == &janus_ice_data_ready ||
+			pkt == &janus_ice_migrate_handle) {
 		return;
 	}
-	g_free(pkt->data);
 	g_free(pkt->label);
 	g_free(pkt->protocol);
+	g_free(pkt->trace);
+	if(pkt->shared != NULL)
+		janus_refcount_decrease(&pkt->shared->ref);
+	if(pkt->pool != NULL) {
+		janus_ice_packet_pool *pool = pkt->pool;
+		janus_ice_pooled_packet *pp = (janus_ice_pooled_packet *)pkt;
+		if(pkt->data != pp->buffer)
+			g_free(pkt->data);
+		/* Put the packet back in the pool, unless it's full */
+		if(g_atomic_int_get(&pool->destroyed) || !janus_ring_push(pool->packets, pp))
+			g_free(pp);
+		janus_refcount_decrease(&pool->ref);
+		return;
+	}
+	g_free(pkt->data);
 	g_free(pkt);
 }
 
+/* Pacing: when enabled, outgoing video packets are spread over time with a
+ * leaky bucket, whose rate is a multiple of the bandwidth estimate (as the
+ * estimate is what the media should use on average, not a hard limit) and/or
+ * a configured cap. To keep latency bounded, packets that waited too long
+ * are sent anyway, and the budget never grows past a few ms worth of data */
+#define JANUS_ICE_PACING_FACTOR		2.5
+#define JANUS_ICE_PACER_BURST		5000
+#define JANUS_ICE_PACER_MAX_DELAY	100000
+static gboolean pacing_enabled = FALSE;
+static uint32_t pacing_bitrate = 0;
+void janus_ice_set_pacing(gboolean enabled, uint32_t max_bitrate) {
+	pacing_enabled = enabled;
+	pacing_bitrate = max_bitrate;
+	if(!pacing_enabled)
+		JANUS_LOG(LOG_VERB, "Pacing disabled\n");
+	else if(pacing_bitrate == 0)
+		JANUS_LOG(LOG_VERB, "Pacing enabled, using the bandwidth estimate\n");
+	else
+		JANUS_LOG(LOG_VERB, "Pacing enabled, up to %"SCNu32" bps\n", pacing_bitrate);
+}
+gboolean janus_ice_is_pacing_enabled(void) {
+	return pacing_enabled;
+}
+uint32_t janus_ice_get_pacing_bitrate(void) {
+	return pacing_bitrate;
+}
+/* We only pace the video packets plugins send, not RTCP or retransmissions */
+static gboolean janus_ice_pacer_is_paced(janus_ice_queued_packet *pkt) {
+	return (pkt->type == JANUS_ICE_PACKET_VIDEO && !pkt->control && !pkt->retransmission);
+}
+static gint janus_ice_pacer_packet_size(janus_ice_queued_packet *pkt) {
+	return pkt->length + (pkt->shared ? (pkt->shared->length - pkt->shared_offset) : 0);
+}
+static void janus_ice_pacer_refill(janus_ice_pacer *pacer, gint64 now) {
+	if(pacer->rate == 0 || pacer->last_refill == 0) {
+		pacer->last_refill = now;
+		return;
+	}
+	gint64 added = (gint64)pacer->rate * (now - pacer->last_refill) / (8 * G_USEC_PER_SEC);
+	if(added <= 0)
+		return;
+	pacer->budget += added;
+	gint64 burst = (gint64)pacer->rate * JANUS_ICE_PACER_BURST / (8 * G_USEC_PER_SEC);
+	if(burst < JANUS_ICE_PACKET_POOL_BUFSIZE)
+		burst = JANUS_ICE_PACKET_POOL_BUFSIZE;
+	if(pacer->budget > burst)
+		pacer->budget = burst;
+	pacer->last_refill = now;
+}
+/* How long (in us) until the pacer can send the next packet: 0 if now, -1 if there's nothing to send */
+static gint64 janus_ice_pacer_wait(janus_ice_pacer *pacer, gint64 now) {
+	janus_ice_queued_packet *pkt = g_queue_peek_head(&pacer->packets);
+	if(pkt == NULL)
+		return -1;
+	gint64 deadline = pkt->added + JANUS_ICE_PACER_MAX_DELAY - now;
+	if(pacer->rate == 0 || deadline <= 0)
+		return 0;
+	gint64 budget = pacer->budget + (gint64)pacer->rate * (now - pacer->last_refill) / (8 * G_USEC_PER_SEC);
+	if(budget > 0)
+		return 0;
+	gint64 wait = (1 - budget) * 8 * G_USEC_PER_SEC / pacer->rate;
+	return MIN(wait, deadline);
+}
+/* Update the rate of the pacer of a handle, creating it if needed */
+static void janus_ice_pacer_prepare(janus_ice_handle *handle, gint64 now) {
+	if(!pacing_enabled && handle->pacer == NULL)
+		return;
+	if(handle->pacer == NULL)
+		handle->pacer = g_malloc0(sizeof(janus_ice_pacer));
+	janus_ice_pacer *pacer = handle->pacer;
+	/* Low-latency handles are never paced: a rate of 0 sends what's left right away */
+	gboolean paced = pacing_enabled && !g_atomic_int_get(&handle->low_latency);
+	guint32 rate = paced ? pacing_bitrate : 0;
+	janus_ice_peerconnection *pc = handle->pc;
+	if(paced && pc != NULL && pc->bwe != NULL) {
+		guint64 paced = (guint64)(pc->bwe->estimate * JANUS_ICE_PACING_FACTOR);
+		if(rate == 0 || paced < rate)
+			rate = paced;
+	}
+	/* Refill the budget at the old rate before switching */
+	janus_ice_pacer_refill(pacer, now);
+	pacer->rate = rate;
+}
+/* Send the packets the pacer has budget for, or that waited too long */
+static gboolean janus_ice_pacer_drain(janus_ice_handle *handle, gint64 now) {
+	int ret = G_SOURCE_CONTINUE;
+	janus_ice_pacer *pacer = handle->pacer;
+	janus_ice_pacer_refill(pacer, now);
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_peek_head(&pacer->packets)) != NULL) {
+		gint64 delay = now - pkt->added;
+		gboolean forced = (pacer->rate > 0 && pacer->budget <= 0);
+		if(forced && delay < JANUS_ICE_PACER_MAX_DELAY)
+			break;
+		g_queue_pop_head(&pacer->packets);
+		gint size = janus_ice_pacer_packet_size(pkt);
+		pacer->bytes -= size;
+		if(forced)
+			pacer->flushed++;
+		else
+			pacer->budget -= size;
+		if(delay > pacer->max_delay)
+			pacer->max_delay = delay;
+		if(janus_ice_outgoing_traffic_handle(handle, pkt) == G_SOURCE_REMOVE)
+			ret = G_SOURCE_REMOVE;
+	}
+	return ret;
+}
+/* Get rid of the pacer of a handle and of the packets it was holding */
+static void janus_ice_pacer_clear(janus_ice_handle *handle) {
+	if(handle->pacer == NULL)
+		return;
+	janus_ice_queued_packet *pkt = NULL;
+	while((pkt = g_queue_pop_head(&handle->pacer->packets)) != NULL)
+		janus_ice_free_queued_packet(pkt);
+	handle->pacer->bytes = 0;
+}
+
 /* Minimum and maximum value, in milliseconds, for the NACK queue/retransmissions (default=200ms/1000ms) */
 #define DEFAULT_MIN_NACK_QUEUE	200
 #define DEFAULT_MAX_NACK_QUEUE	1000
 /* Maximum ignore count after retransmission (200ms) */
 #define MAX_NACK_IGNORE			200000
+/* Maximum number of sequence numbers we handle from a single incoming NACK */
+#define MAX_NACKED_SEQS			512
+
+/* Retransmission budget: NACKed packets are only retransmitted as long as the
+ * PeerConnection has budget for them, which is refilled at the configured
+ * bitrate and/or a percentage of the media we send, and can burst up to 250ms */
+#define JANUS_ICE_RETRANSMIT_BURST		250000
+#define JANUS_ICE_RETRANSMIT_MIN_RATE	64000
+static uint32_t retransmit_budget_bitrate = 0;
+static uint16_t retransmit_budget_ratio = 0;
+void janus_set_retransmit_budget(uint32_t bitrate, uint16_t ratio) {
+	retransmit_budget_bitrate = bitrate;
+	retransmit_budget_ratio = ratio;
+	if(bitrate == 0 && ratio == 0)
+		JANUS_LOG(LOG_VERB, "No retransmission budget\n");
+	else
+		JANUS_LOG(LOG_VERB, "Retransmission budget: %"SCNu32" bps, %"SCNu16"%% of the media\n", bitrate, ratio);
+}
+uint32_t janus_get_retransmit_budget_bitrate(void) {
+	return retransmit_budget_bitrate;
+}
+uint16_t janus_get_retransmit_budget_ratio(void) {
+	return retransmit_budget_ratio;
+}
+/* Refill the retransmission budget of a PeerConnection, and return the current one (-1 if unlimited) */
+static gint64 janus_ice_retransmit_budget_update(janus_ice_peerconnection *pc, gint64 now) {
+	if(retransmit_budget_bitrate == 0 && retransmit_budget_ratio == 0)
+		return -1;
+	guint64 rate = retransmit_budget_bitrate;
+	if(retransmit_budget_ratio > 0) {
+		/* Check how much media we're sending right now */
+		guint64 media = 0;
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, pc->media);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_ice_peerconnection_medium *m = value;
+			media += (guint64)m->out_stats.info[0].bytes_lastsec * 8;
+		}
+		guint64 relative = media * retransmit_budget_ratio / 100;
+		if(relative < JANUS_ICE_RETRANSMIT_MIN_RATE)
+			relative = JANUS_ICE_RETRANSMIT_MIN_RATE;
+		if(rate == 0 || relative < rate)
+			rate = relative;
+	}
+	gint64 burst = rate * JANUS_ICE_RETRANSMIT_BURST / (8 * G_USEC_PER_SEC);
+	if(pc->retransmit_budget_refill == 0) {
+		pc->retransmit_budget = burst;
+	} else {
+		pc->retransmit_budget += rate * (now - pc->retransmit_budget_refill) / (8 * G_USEC_PER_SEC);
+		if(pc->retransmit_budget > burst)
+			pc->retransmit_budget = burst;
+	}
+	pc->retransmit_budget_refill = now;
+	return pc->retransmit_budget;
+}
 
 static gboolean nack_optimizations = FALSE;
 void janus_set_nack_optimizations_enabled(gboolean optimize) {
@@ -685,6 +2230,143 @@ void janus_set_min_nack_queue(uint16_t mnq) {
 uint16_t janus_get_min_nack_queue(void) {
 	return min_nack_queue;
 }
+/* Packets we send are kept in a ring indexed by sequence number, whose slots
+ * (and their buffers) are reused, so that keeping a packet for NACKs doesn't
+ * need any allocation. The ring is sized according to how many packets we
+ * expect to send in a NACK queue window, and doubled (up to half the sequence
+ * number space) if a packet that hasn't expired yet would be overwritten */
+#define JANUS_ICE_RETRANSMIT_RING_MIN	256
+#define JANUS_ICE_RETRANSMIT_RING_MAX	32768
+/* When estimating how many packets we'll send, we assume this average size */
+#define JANUS_ICE_RETRANSMIT_PACKET_SIZE	1000
+/* How long a ring must stay empty (e.g., a muted or idle medium) before we free it */
+#define JANUS_ICE_RETRANSMIT_RING_IDLE	(10*G_USEC_PER_SEC)
+static guint janus_ice_retransmit_ring_size(janus_ice_peerconnection_medium *medium) {
+	guint window = MAX(medium->nack_queue_ms, min_nack_queue);
+	guint64 packets = (guint64)medium->out_stats.info[0].bytes_lastsec / JANUS_ICE_RETRANSMIT_PACKET_SIZE;
+	/* Leave some headroom for bursts (e.g., keyframes) */
+	guint64 needed = 2 * packets * window / 1000;
+	guint size = JANUS_ICE_RETRANSMIT_RING_MIN;
+	while(size < needed && size < JANUS_ICE_RETRANSMIT_RING_MAX)
+		size <<= 1;
+	return size;
+}
+
+static janus_ice_retransmit_ring *janus_ice_retransmit_ring_new(guint size) {
+	janus_ice_retransmit_ring *ring = g_malloc0(sizeof(janus_ice_retransmit_ring));
+	ring->slots = g_malloc0(size * sizeof(janus_ice_retransmit_slot));
+	ring->size = size;
+	ring->mask = size - 1;
+	return ring;
+}
+
+static void janus_ice_retransmit_ring_free(janus_ice_retransmit_ring *ring) {
+	if(ring == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<ring->size; i++)
+		g_free(ring->slots[i].packet.data);
+	g_free(ring->slots);
+	g_free(ring);
+}
+
+static void janus_ice_retransmit_ring_grow(janus_ice_peerconnection_medium *medium) {
+	/* Packets can't collide in the new ring, as they didn't in the old one */
+	janus_ice_retransmit_ring *ring = medium->retransmit_ring;
+	guint size = ring->size << 1, i = 0;
+	janus_ice_retransmit_slot *slots = g_malloc0(size * sizeof(janus_ice_retransmit_slot));
+	medium->retransmit_bytes += ring->size * sizeof(janus_ice_retransmit_slot);
+	for(i=0; i<ring->size; i++) {
+		janus_ice_retransmit_slot *slot = &ring->slots[i];
+		if(slot->used) {
+			slots[slot->seq & (size-1)] = *slot;
+		} else {
+			g_free(slot->packet.data);
+			medium->retransmit_bytes -= slot->allocated;
+		}
+	}
+	g_free(ring->slots);
+	ring->slots = slots;
+	ring->size = size;
+	ring->mask = size - 1;
+}
+
+static janus_rtp_packet *janus_ice_retransmit_ring_lookup(janus_ice_retransmit_ring *ring, guint16 seq) {
+	if(ring == NULL)
+		return NULL;
+	janus_ice_retransmit_slot *slot = &ring->slots[seq & ring->mask];
+	return (slot->used && slot->seq == seq) ? &slot->packet : NULL;
+}
+
+/* Get a slot for a packet we're about to send, with a buffer large enough for it */
+static janus_ice_retransmit_slot *janus_ice_retransmit_ring_reserve(janus_ice_peerconnection_medium *medium, guint16 seq, gint length) {
+	gint64 now = janus_get_monotonic_time();
+	if(medium->retransmit_ring == NULL) {
+		medium->retransmit_ring = janus_ice_retransmit_ring_new(janus_ice_retransmit_ring_size(medium));
+		medium->retransmit_bytes = sizeof(janus_ice_retransmit_ring) +
+			medium->retransmit_ring->size * sizeof(janus_ice_retransmit_slot);
+	}
+	janus_ice_retransmit_ring *ring = medium->retransmit_ring;
+	janus_ice_retransmit_slot *slot = &ring->slots[seq & ring->mask];
+	while(slot->used && slot->seq != seq && ring->size < JANUS_ICE_RETRANSMIT_RING_MAX &&
+			now - slot->packet.created < (gint64)medium->nack_queue_ms*1000) {
+		/* We'd overwrite a packet we may still need, make room */
+		janus_ice_retransmit_ring_grow(medium);
+		slot = &ring->slots[seq & ring->mask];
+	}
+	if(slot->used) {
+		/* Overwrite the old packet */
+		slot->used = FALSE;
+		ring->count--;
+	}
+	if(slot->allocated < length) {
+		g_free(slot->packet.data);
+		medium->retransmit_bytes -= slot->allocated;
+		slot->allocated = MAX(length, JANUS_ICE_PACKET_POOL_BUFSIZE+2);
+		medium->retransmit_bytes += slot->allocated;
+		slot->packet.data = g_malloc(slot->allocated);
+	}
+	slot->packet.length = length;
+	slot->packet.created = now;
+	slot->packet.last_retransmit = 0;
+	janus_plugin_rtp_extensions_reset(&slot->packet.extensions);
+	slot->seq = seq;
+	slot->used = TRUE;
+	if(ring->count == 0) {
+		ring->oldest = seq;
+		ring->newest = seq;
+	} else if((gint16)(seq - ring->newest) > 0) {
+		ring->newest = seq;
+	} else if((gint16)(seq - ring->oldest) < 0) {
+		ring->oldest = seq;
+	}
+	ring->count++;
+	return slot;
+}
+
+static void janus_ice_retransmit_ring_release(janus_ice_retransmit_ring *ring, janus_ice_retransmit_slot *slot) {
+	if(ring == NULL || slot == NULL || !slot->used)
+		return;
+	slot->used = FALSE;
+	ring->count--;
+}
+
+/* Get rid of packets older than the provided age, or all of them if now is 0 */
+static void janus_ice_retransmit_ring_expire(janus_ice_retransmit_ring *ring, gint64 now, gint64 age) {
+	while(ring->count > 0) {
+		janus_ice_retransmit_slot *slot = &ring->slots[ring->oldest & ring->mask];
+		if(slot->used && slot->seq == ring->oldest) {
+			if(now && now - slot->packet.created < age)
+				break;
+			slot->used = FALSE;
+			ring->count--;
+		}
+		if(ring->oldest == ring->newest)
+			break;
+		ring->oldest++;
+	}
+}
+
 /* Helper to clean old NACK packets in the buffer when they exceed the queue time limit */
 static void janus_cleanup_nack_buffer(gint64 now, janus_ice_peerconnection *pc, gboolean audio, gboolean video) {
 	/* Iterate on all media */
@@ -696,19 +2378,20 @@ static void janus_cleanup_nack_buffer(gint64 now, janus_ice_peerconnection *pc,
 			continue;
 		if((medium->type == JANUS_MEDIA_AUDIO && !audio) || (medium->type == JANUS_MEDIA_VIDEO && !video))
 			continue;
-		if(medium->retransmit_buffer) {
-			janus_rtp_packet *p = (janus_rtp_packet *)g_queue_peek_head(medium->retransmit_buffer);
-			while(p && (!now || (now - p->created >= (gint64)medium->nack_queue_ms*1000))) {
-				/* Packet is too old, get rid of it */
-				g_queue_pop_head(medium->retransmit_buffer);
-				/* Remove from hashtable too */
-				janus_rtp_header *header = (janus_rtp_header *)p->data;
-				guint16 seq = ntohs(header->seq_number);
-				g_hash_table_remove(medium->retransmit_seqs, GUINT_TO_POINTER(seq));
-				/* Free the packet */
-				janus_ice_free_rtp_packet(p);
-				p = (janus_rtp_packet *)g_queue_peek_head(medium->retransmit_buffer);
-			}
+		if(medium->retransmit_ring == NULL)
+			continue;
+		janus_ice_retransmit_ring_expire(medium->retransmit_ring, now, (gint64)medium->nack_queue_ms*1000);
+		if(now == 0 || medium->retransmit_ring->count > 0) {
+			medium->retransmit_empty_since = 0;
+		} else if(medium->retransmit_empty_since == 0) {
+			medium->retransmit_empty_since = now;
+		} else if(now - medium->retransmit_empty_since >= JANUS_ICE_RETRANSMIT_RING_IDLE) {
+			/* We haven't sent anything in a while, give the memory back:
+			 * if the medium becomes active again, we'll create a new ring */
+			janus_ice_retransmit_ring_free(medium->retransmit_ring);
+			medium->retransmit_ring = NULL;
+			medium->retransmit_bytes = 0;
+			medium->retransmit_empty_since = 0;
 		}
 	}
 }
@@ -716,52 +2399,81 @@ static void janus_cleanup_nack_buffer(gint64 now, janus_ice_peerconnection *pc,
 
 #define SEQ_MISSING_WAIT 12000 /*  12ms */
 #define SEQ_NACKED_WAIT 155000 /* 155ms */
-/* janus_seq_info list functions */
-static void janus_seq_append(janus_seq_info **head, janus_seq_info *new_seq) {
-	if(*head == NULL) {
-		new_seq->prev = new_seq;
-		new_seq->next = new_seq;
-		*head = new_seq;
-	} else {
-		janus_seq_info *last_seq = (*head)->prev;
-		new_seq->prev = last_seq;
-		new_seq->next = *head;
-		(*head)->prev = new_seq;
-		last_seq->next = new_seq;
-	}
-}
-static janus_seq_info *janus_seq_pop_head(janus_seq_info **head) {
-	janus_seq_info *pop_seq = *head;
-	if(pop_seq) {
-		janus_seq_info *new_head = pop_seq->next;
-		if(pop_seq == new_head || new_head == NULL) {
-			*head = NULL;
-		} else {
-			*head = new_head;
-			new_head->prev = pop_seq->prev;
-			new_head->prev->next = new_head;
+/* Loss tracker functions: sequence numbers are mapped to slots of a ring, and their state to bits */
+#define JANUS_ICE_LOSS_SLOT(seq) ((guint16)(seq) & (JANUS_ICE_LOSS_TRACKER_SIZE-1))
+static inline gboolean janus_ice_loss_bit_test(const guint32 *bitmap, guint16 seq) {
+	guint slot = JANUS_ICE_LOSS_SLOT(seq);
+	return (bitmap[slot/32] & (1U << (slot%32))) != 0;
+}
+static inline void janus_ice_loss_bit_set(guint32 *bitmap, guint16 seq) {
+	guint slot = JANUS_ICE_LOSS_SLOT(seq);
+	bitmap[slot/32] |= (1U << (slot%32));
+}
+static inline void janus_ice_loss_bit_unset(guint32 *bitmap, guint16 seq) {
+	guint slot = JANUS_ICE_LOSS_SLOT(seq);
+	bitmap[slot/32] &= ~(1U << (slot%32));
+}
+void janus_ice_loss_tracker_reset(janus_ice_loss_tracker *tracker) {
+	if(tracker == NULL)
+		return;
+	tracker->started = FALSE;
+	tracker->highest = 0;
+	tracker->count = 0;
+	tracker->missing_count = 0;
+	memset(tracker->missing, 0, sizeof(tracker->missing));
+	memset(tracker->nacked, 0, sizeof(tracker->nacked));
+}
+/* Stop tracking a missing sequence number, because we received it or gave up on it */
+static void janus_ice_loss_tracker_forget(janus_ice_loss_tracker *tracker, guint16 seq) {
+	if(!janus_ice_loss_bit_test(tracker->missing, seq))
+		return;
+	janus_ice_loss_bit_unset(tracker->missing, seq);
+	janus_ice_loss_bit_unset(tracker->nacked, seq);
+	tracker->missing_count--;
+}
+/* Take note of a received sequence number: returns 1 if it was a missing
+ * packet, -1 if the jump was too big and we started fresh, 0 otherwise */
+static int janus_ice_loss_tracker_update(janus_ice_loss_tracker *tracker, guint16 seq, gint64 now) {
+	if(!tracker->started) {
+		tracker->started = TRUE;
+		tracker->highest = seq;
+		tracker->count = 1;
+		return 0;
+	}
+	/* Supports wrapping sequence numbers */
+	int16_t diff = (int16_t)(seq - tracker->highest);
+	if(diff > 0 && diff < LAST_SEQS_MAX_LEN) {
+		/* Move forward, marking the sequence numbers we skipped as missing */
+		guint16 cur = tracker->highest;
+		while(cur != seq) {
+			cur++;
+			/* The oldest sequence number we tracked is now out of the window */
+			janus_ice_loss_tracker_forget(tracker, cur - LAST_SEQS_MAX_LEN);
+			if(cur != seq) {
+				janus_ice_loss_bit_set(tracker->missing, cur);
+				tracker->ts[JANUS_ICE_LOSS_SLOT(cur)] = now;
+				tracker->missing_count++;
+			}
 		}
+		tracker->highest = seq;
+		tracker->count = MIN(tracker->count + diff, LAST_SEQS_MAX_LEN);
+		return 0;
+	} else if(diff <= 0 && -diff < tracker->count) {
+		/* Older packet, check if it's one we were missing */
+		if(!janus_ice_loss_bit_test(tracker->missing, seq))
+			return 0;
+		janus_ice_loss_tracker_forget(tracker, seq);
+		return 1;
+	} else if(diff > 0 || diff <= -1000) {
+		/* Jump too big, start fresh */
+		janus_ice_loss_tracker_reset(tracker);
+		tracker->started = TRUE;
+		tracker->highest = seq;
+		tracker->count = 1;
+		return -1;
 	}
-	return pop_seq;
-}
-void janus_seq_list_free(janus_seq_info **head) {
-	if(!*head)
-		return;
-	janus_seq_info *cur = *head;
-	do {
-		janus_seq_info *next = cur->next;
-		g_free(cur);
-		cur = next;
-	} while(cur != *head);
-	*head = NULL;
-}
-static int janus_seq_in_range(guint16 seqn, guint16 start, guint16 len) {
-	/* Supports wrapping sequence (easier with int range) */
-	int n = seqn;
-	int nh = (1<<16) + n;
-	int s = start;
-	int e = s + len;
-	return (s <= n && n < e) || (s <= nh && nh < e);
+	/* Older packet we're not tracking anymore */
+	return 0;
 }
 
 
@@ -810,6 +2522,14 @@ static void janus_ice_clear_queued_packets(janus_ice_handle *handle) {
 		pkt = g_async_queue_try_pop(handle->queued_packets);
 		janus_ice_free_queued_packet(pkt);
 	}
+	int lane = 0;
+	for(lane=0; lane<JANUS_ICE_LANES; lane++) {
+		if(handle->outgoing_lanes[lane] == NULL)
+			continue;
+		while((pkt = janus_ring_pop(handle->outgoing_lanes[lane])) != NULL)
+			janus_ice_free_queued_packet(pkt);
+	}
+	janus_ice_pacer_clear(handle);
 }
 
 
@@ -870,7 +2590,7 @@ static void janus_ice_notify_media(janus_ice_handle *handle, char *mid, gboolean
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Sending event to transport...\n", handle->handle_id);
 	janus_session_notify_event(session, event);
 	/* Notify event handlers as well */
-	if(janus_events_is_enabled()) {
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_MEDIA)) {
 		json_t *info = json_object();
 		json_object_set_new(info, "media", json_string(video ? "video" : "audio"));
 		json_object_set_new(info, "mid", json_string(mid));
@@ -923,7 +2643,7 @@ void janus_ice_notify_hangup(janus_ice_handle *handle, const char *reason) {
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Sending event to transport...; %p\n", handle->handle_id, handle);
 	janus_session_notify_event(session, event);
 	/* Notify event handlers as well */
-	if(janus_events_is_enabled()) {
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
 		json_t *info = json_object();
 		json_object_set_new(info, "connection", json_string("hangup"));
 		if(reason != NULL)
@@ -1025,6 +2745,10 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 		gboolean ipv6, gboolean ipv6_linklocal, uint16_t rtp_min_port, uint16_t rtp_max_port) {
 	janus_ice_lite_enabled = ice_lite;
 	janus_ice_tcp_enabled = ice_tcp;
+	/* Static event loops have their own pool of packets, the other handles share this one */
+	if(shared_packet_pool == NULL)
+		shared_packet_pool = janus_ice_packet_pool_create();
+	janus_condition_init(&migrate_cond);
 	janus_full_trickle_enabled = full_trickle;
 	janus_mdns_enabled = !ignore_mdns;
 	janus_ipv6_enabled = ipv6;
@@ -1075,9 +2799,21 @@ void janus_ice_init(gboolean ice_lite, gboolean ice_tcp, gboolean full_trickle,
 	janus_turnrest_init();
 #endif
 
+	/* Start watching for changes to the local addresses before we enumerate them */
+	janus_ice_local_addresses_watch();
 }
 
 void janus_ice_deinit(void) {
+	janus_ice_packet_pool_destroy(shared_packet_pool);
+	shared_packet_pool = NULL;
+	janus_mutex_lock(&local_addresses_mutex);
+	if(local_addresses_netlink >= 0)
+		close(local_addresses_netlink);
+	local_addresses_netlink = -1;
+	if(local_addresses != NULL)
+		g_array_unref(local_addresses);
+	local_addresses = NULL;
+	janus_mutex_unlock(&local_addresses_mutex);
 #ifdef HAVE_TURNRESTAPI
 	janus_turnrest_deinit();
 #endif
@@ -1400,10 +3136,307 @@ janus_ice_handle *janus_ice_handle_create(void *core_session, const char *opaque
 	handle->queued_packets = g_async_queue_new();
 	janus_mutex_init(&handle->mutex);
 	janus_session_handles_insert(session, handle);
+#ifdef HAVE_TURNRESTAPI
+	/* If we'll need TURN credentials, start getting them now, so that
+	 * setting up the PeerConnection later won't have to wait for them */
+	if(janus_turnrest_get_backend() != NULL) {
+		char turnrest_username[20];
+		janus_ice_turnrest_username(handle, turnrest_username, sizeof(turnrest_username));
+		janus_turnrest_prefetch(handle->opaque_id ? handle->opaque_id : turnrest_username);
+	}
+#endif
 	return handle;
 }
 
-gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle, janus_plugin *plugin, int loop_index) {
+/* Move a handle to the loop it's been asked to move to: this is called by the
+ * loop the handle is on right now, so that its source can't be running elsewhere */
+static void janus_ice_handle_migrate_internal(janus_ice_handle *handle) {
+	janus_mutex_lock(&migrate_mutex);
+	janus_ice_static_event_loop *target = (janus_ice_static_event_loop *)handle->migrate_to;
+	janus_ice_static_event_loop *from = (janus_ice_static_event_loop *)handle->static_event_loop;
+	if(target == NULL) {
+		/* Whoever asked for this gave up waiting */
+		janus_mutex_unlock(&migrate_mutex);
+		return;
+	}
+	handle->migrate_to = NULL;
+	if(from == NULL || target == from || handle->agent != NULL || handle->rtcp_link != NULL || handle->rtp_source == NULL) {
+		/* We can't move the handle (anymore) */
+		janus_refcount_decrease(&target->ref);
+		janus_condition_broadcast(&migrate_cond);
+		janus_mutex_unlock(&migrate_mutex);
+		return;
+	}
+	janus_mutex_lock(&event_loops_mutex);
+	from->handles--;
+	target->handles++;
+	handle->mainctx = target->mainctx;
+	handle->mainloop = target->mainloop;
+	handle->static_event_loop = target;
+	/* The handle doesn't share the loop with its group anymore */
+	janus_ice_loop_group_leave(handle);
+	/* If it was on a loop of its own, that loop isn't needed anymore */
+	janus_ice_dedicated_event_loop_retire(from);
+	janus_mutex_unlock(&event_loops_mutex);
+	/* Sources can't move to another context, so we create a new one there */
+	janus_ice_outgoing_traffic *t = (janus_ice_outgoing_traffic *)handle->rtp_source;
+	t->migrated = TRUE;
+	handle->rtp_source = janus_ice_outgoing_traffic_create(handle, (GDestroyNotify)g_free);
+	g_source_set_priority(handle->rtp_source, janus_ice_outgoing_traffic_priority(handle));
+	g_source_attach(handle->rtp_source, handle->mainctx);
+	g_source_unref((GSource *)t);
+	handle->migrations++;
+	if(!from->dedicated && !target->dedicated)
+		JANUS_LOG(LOG_INFO, "[%"SCNu64"] Moved handle from loop #%d to loop #%d\n", handle->handle_id, from->id, target->id);
+	janus_refcount_decrease(&from->ref);
+	janus_condition_broadcast(&migrate_cond);
+	janus_mutex_unlock(&migrate_mutex);
+	/* In case there's something queued already, the new loop will take care of it */
+	g_main_context_wakeup(handle->mainctx);
+}
+/* Ask the loop of a handle to move it to another loop, and wait for that to happen */
+static int janus_ice_handle_migrate_now(janus_ice_handle *handle, janus_ice_static_event_loop *target) {
+	if(handle->queued_packets == NULL || handle->static_event_loop == NULL || target == handle->static_event_loop)
+		return -1;
+	janus_mutex_lock(&migrate_mutex);
+	if(handle->migrate_to != NULL) {
+		/* Already moving */
+		janus_mutex_unlock(&migrate_mutex);
+		return -2;
+	}
+	janus_refcount_increase(&target->ref);
+	handle->migrate_to = target;
+#if GLIB_CHECK_VERSION(2, 46, 0)
+	g_async_queue_push_front(handle->queued_packets, &janus_ice_migrate_handle);
+#else
+	g_async_queue_push(handle->queued_packets, &janus_ice_migrate_handle);
+#endif
+	g_main_context_wakeup(handle->mainctx);
+	gint64 end = g_get_monotonic_time() + JANUS_ICE_MIGRATE_TIMEOUT;
+	while(handle->migrate_to == target && g_get_monotonic_time() < end)
+		janus_condition_wait_until(&migrate_cond, &migrate_mutex, end);
+	int res = (handle->static_event_loop == target) ? 0 : -3;
+	if(handle->migrate_to == target) {
+		/* The loop didn't get to it in time, give up */
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Timeout moving handle to loop #%d\n", handle->handle_id, target->id);
+		handle->migrate_to = NULL;
+		janus_refcount_decrease(&target->ref);
+	}
+	janus_mutex_unlock(&migrate_mutex);
+	return res;
+}
+/* Before a new PeerConnection is set up, check if the handle should move to another loop */
+static void janus_ice_handle_check_migration(janus_ice_handle *handle) {
+	if(handle->static_event_loop == NULL || handle->agent != NULL)
+		return;
+	janus_ice_static_event_loop *current = (janus_ice_static_event_loop *)handle->static_event_loop;
+	janus_ice_static_event_loop *target = NULL;
+	janus_mutex_lock(&migrate_mutex);
+	if(handle->migrate_pending != NULL) {
+		/* The Admin API asked us to move it */
+		target = (janus_ice_static_event_loop *)handle->migrate_pending;
+		handle->migrate_pending = NULL;
+	}
+	janus_mutex_unlock(&migrate_mutex);
+	gboolean promoting = FALSE, demoting = FALSE;
+	if(target == NULL && !current->dedicated && janus_ice_handle_is_busy(handle, 1)) {
+		/* Hybrid mode: the handle is busy enough for a loop of its own */
+		target = janus_ice_dedicated_event_loop_create(handle);
+		promoting = (target != NULL);
+	} else if(target == NULL && current->dedicated && !janus_ice_handle_is_busy(handle, 2)) {
+		/* Hybrid mode: the handle isn't that busy anymore, go back to a shared loop */
+		janus_mutex_lock(&event_loops_mutex);
+		target = janus_ice_static_event_loop_pick();
+		if(target != NULL)
+			janus_refcount_increase(&target->ref);
+		janus_mutex_unlock(&event_loops_mutex);
+		demoting = (target != NULL);
+	}
+	if(target == NULL && event_loops_rebalance > 0 && !current->dedicated && !handle->colocated) {
+		/* Check if the current loop is much busier than the least loaded one */
+		janus_mutex_lock(&event_loops_mutex);
+		gint utilization = g_atomic_int_get(&current->load_utilization);
+		GSList *l = event_loops;
+		while(l) {
+			janus_ice_static_event_loop *el = (janus_ice_static_event_loop *)l->data;
+			gint el_utilization = g_atomic_int_get(&el->load_utilization);
+			if(utilization - el_utilization > event_loops_rebalance) {
+				target = el;
+				utilization = el_utilization + event_loops_rebalance;
+			}
+			l = l->next;
+		}
+		if(target != NULL)
+			janus_refcount_increase(&target->ref);
+		janus_mutex_unlock(&event_loops_mutex);
+	}
+	if(target == NULL)
+		return;
+	if(target != current && janus_ice_handle_migrate_now(handle, target) == 0 && (promoting || demoting)) {
+		gint pps = g_atomic_int_get(&handle->load_pps), busy = g_atomic_int_get(&handle->load_utilization);
+		if(promoting) {
+			JANUS_LOG(LOG_INFO, "[%"SCNu64"] Promoted handle from loop #%d to a dedicated loop (%d pps, %d.%d%% busy)\n",
+				handle->handle_id, current->id, pps, busy/10, busy%10);
+		} else {
+			JANUS_LOG(LOG_INFO, "[%"SCNu64"] Demoted handle from its dedicated loop to loop #%d (%d pps, %d.%d%% busy)\n",
+				handle->handle_id, target->id, pps, busy/10, busy%10);
+		}
+	}
+	if(promoting) {
+		/* In case the handle couldn't move there, get rid of the new loop */
+		janus_mutex_lock(&event_loops_mutex);
+		janus_ice_dedicated_event_loop_retire(target);
+		janus_mutex_unlock(&event_loops_mutex);
+	}
+	janus_refcount_decrease(&target->ref);
+}
+/* Move a handle to a specific loop, now or before its next PeerConnection: releases the reference to the loop */
+static int janus_ice_handle_migrate_to(janus_ice_handle *handle, janus_ice_static_event_loop *target) {
+	if(target == handle->static_event_loop) {
+		janus_refcount_decrease(&target->ref);
+		return 0;
+	}
+	if(handle->agent == NULL && !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AGENT)) {
+		/* No PeerConnection, we can move the handle right away */
+		int res = janus_ice_handle_migrate_now(handle, target);
+		janus_refcount_decrease(&target->ref);
+		return res < 0 ? -3 : 0;
+	}
+	/* The ICE agent can't move, so we'll do that before the next PeerConnection is set up */
+	janus_mutex_lock(&migrate_mutex);
+	if(handle->migrate_pending != NULL)
+		janus_refcount_decrease(&((janus_ice_static_event_loop *)handle->migrate_pending)->ref);
+	handle->migrate_pending = target;
+	janus_mutex_unlock(&migrate_mutex);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle will move to loop #%d when the PeerConnection is gone\n", handle->handle_id, target->id);
+	return 1;
+}
+int janus_ice_handle_migrate(janus_ice_handle *handle, int loop_index) {
+	if(handle == NULL || static_event_loops < 1 || handle->static_event_loop == NULL)
+		return -1;
+	janus_mutex_lock(&event_loops_mutex);
+	janus_ice_static_event_loop *target = loop_index >= 0 ? g_slist_nth_data(event_loops, loop_index) : NULL;
+	if(target != NULL)
+		janus_refcount_increase(&target->ref);
+	janus_mutex_unlock(&event_loops_mutex);
+	if(target == NULL)
+		return -2;
+	return janus_ice_handle_migrate_to(handle, target);
+}
+int janus_ice_handle_colocate(janus_ice_handle *handle, janus_ice_handle *peer) {
+	if(handle == NULL || peer == NULL || handle == peer || static_event_loops < 1 ||
+			handle->static_event_loop == NULL || peer->static_event_loop == NULL)
+		return -1;
+	janus_mutex_lock(&event_loops_mutex);
+	janus_ice_static_event_loop *target = (janus_ice_static_event_loop *)peer->static_event_loop;
+	if(target->dedicated) {
+		/* The peer has a loop of its own because it's busy, leave it alone */
+		janus_mutex_unlock(&event_loops_mutex);
+		return -2;
+	}
+	janus_refcount_increase(&target->ref);
+	janus_mutex_unlock(&event_loops_mutex);
+	int res = janus_ice_handle_migrate_to(handle, target);
+	if(res >= 0) {
+		/* Rebalancing shouldn't split the two handles up again */
+		handle->colocated = TRUE;
+		peer->colocated = TRUE;
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Handle %s on the same loop as %"SCNu64"\n", handle->handle_id,
+			res == 0 ? "is now" : "will be", peer->handle_id);
+	}
+	return res;
+}
+void janus_ice_handle_set_low_latency(janus_ice_handle *handle, gboolean enabled) {
+	if(handle == NULL)
+		return;
+	if(!g_atomic_int_compare_and_exchange(&handle->low_latency, enabled ? 0 : 1, enabled ? 1 : 0))
+		return;
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Low-latency mode %s\n", handle->handle_id, enabled ? "enabled" : "disabled");
+	/* The loop picks the new priority (and pacing rate) up the next time it sends something */
+}
+json_t *janus_ice_handle_placement_info(janus_ice_handle *handle) {
+	if(handle == NULL)
+		return NULL;
+	json_t *info = json_object();
+	if(static_event_loops == 0) {
+		/* Each handle has its own loop */
+		json_object_set_new(info, "placement", json_string("dedicated"));
+		return info;
+	}
+	janus_mutex_lock(&event_loops_mutex);
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)handle->static_event_loop;
+	if(loop != NULL) {
+		json_object_set_new(info, "placement", json_string(loop->dedicated ? "dedicated" : "shared"));
+		if(!loop->dedicated)
+			json_object_set_new(info, "loop", json_integer(loop->id));
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	json_object_set_new(info, "packets-per-sec", json_integer(g_atomic_int_get(&handle->load_pps)));
+	json_object_set_new(info, "utilization", json_real((double)g_atomic_int_get(&handle->load_utilization)/10.0));
+	return info;
+}
+
+/* Rough size of a GLib hash table: GLib doesn't tell, so we assume the arrays
+ * of keys, values and hashes are twice as large as the number of entries */
+static guint64 janus_ice_hash_table_bytes(GHashTable *table) {
+	if(table == NULL)
+		return 0;
+	guint slots = MAX(8, 2 * g_hash_table_size(table));
+	return 64 + (guint64)slots * (2 * sizeof(gpointer) + sizeof(guint));
+}
+json_t *janus_ice_handle_memory_info(janus_ice_handle *handle) {
+	if(handle == NULL)
+		return NULL;
+	guint64 queues = 0, pacer = 0, pc_bytes = 0, media = 0, retransmissions = 0;
+	int lane = 0;
+	for(lane=0; lane<JANUS_ICE_LANES; lane++) {
+		janus_ring *ring = g_atomic_pointer_get(&handle->outgoing_lanes[lane]);
+		if(ring != NULL)
+			queues += sizeof(janus_ring) + ring->size * sizeof(janus_ring_slot);
+	}
+	if(handle->pacer != NULL)
+		pacer = sizeof(janus_ice_pacer) + handle->pacer->bytes;
+	janus_ice_peerconnection *pc = handle->pc;
+	if(pc != NULL) {
+		pc_bytes = sizeof(janus_ice_peerconnection) + janus_ice_hash_table_bytes(pc->media) +
+			janus_ice_hash_table_bytes(pc->media_byssrc) + janus_ice_hash_table_bytes(pc->media_bymid) +
+			janus_ice_hash_table_bytes(pc->media_bytype) + janus_ice_hash_table_bytes(pc->payload_types) +
+			janus_ice_hash_table_bytes(pc->clock_rates) + janus_ice_hash_table_bytes(pc->rtx_payload_types) +
+			janus_ice_hash_table_bytes(pc->rtx_payload_types_rev);
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, pc->media);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_ice_peerconnection_medium *medium = value;
+			media += sizeof(janus_ice_peerconnection_medium) + janus_ice_hash_table_bytes(medium->rtx_payload_types) +
+				janus_ice_hash_table_bytes(medium->clock_rates) + janus_ice_hash_table_bytes(medium->pending_nacked_cleanup);
+			int i = 0;
+			for(i=0; i<3; i++) {
+				if(medium->rtcp_ctx[i] != NULL)
+					media += sizeof(janus_rtcp_context);
+				if(medium->loss_trackers[i] != NULL)
+					media += sizeof(janus_ice_loss_tracker);
+				media += janus_ice_hash_table_bytes(medium->rtx_nacked[i]);
+			}
+			retransmissions += medium->retransmit_bytes;
+		}
+	}
+	json_t *info = json_object();
+	json_object_set_new(info, "handle", json_integer(sizeof(janus_ice_handle)));
+	json_object_set_new(info, "queues", json_integer(queues));
+	if(pacer > 0)
+		json_object_set_new(info, "pacer", json_integer(pacer));
+	if(pc != NULL) {
+		json_object_set_new(info, "peerconnection", json_integer(pc_bytes));
+		json_object_set_new(info, "media", json_integer(media));
+		json_object_set_new(info, "retransmissions", json_integer(retransmissions));
+	}
+	json_object_set_new(info, "total", json_integer(sizeof(janus_ice_handle) +
+		queues + pacer + pc_bytes + media + retransmissions));
+	return info;
+}
+
+gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle, janus_plugin *plugin, int loop_index, const char *loop_group) {
 	if(core_session == NULL)
 		return JANUS_ERROR_SESSION_NOT_FOUND;
 	janus_session *session = (janus_session *)core_session;
@@ -1458,27 +3491,35 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 				automatic_selection = FALSE;
 				handle->mainctx = loop->mainctx;
 				handle->mainloop = loop->mainloop;
+				handle->static_event_loop = loop;
 				loop->handles++;
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Manually added handle to loop #%d\n", handle->handle_id, loop->id);
 			}
 		}
 		if(automatic_selection) {
-			/* Pick an available loop automatically (least loaded) */
-			int handles = -1;
 			janus_ice_static_event_loop *loop = NULL;
-			GSList *l = event_loops;
-			while(l) {
-				janus_ice_static_event_loop *el = (janus_ice_static_event_loop *)l->data;
-				if(el->handles == 0) {
-					/* Best option, stop here */
-					loop = el;
-					break;
+			janus_ice_loop_group *group = NULL;
+			if(loop_group != NULL) {
+				/* Handles of the same group should share a loop, if it's not too busy */
+				if(loop_groups == NULL)
+					loop_groups = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+				group = g_hash_table_lookup(loop_groups, loop_group);
+				if(group == NULL) {
+					group = g_malloc0(sizeof(janus_ice_loop_group));
+					g_hash_table_insert(loop_groups, g_strdup(loop_group), group);
+				} else if(g_atomic_int_get(&group->loop->load_utilization) < JANUS_ICE_LOOP_GROUP_MAX_UTILIZATION) {
+					loop = group->loop;
 				}
-				if(handles == -1 || el->handles < handles) {
-					handles = el->handles;
-					loop = el;
+				group->handles++;
+				handle->loop_group = g_strdup(loop_group);
+			}
+			if(loop == NULL) {
+				/* Pick an available loop automatically (least loaded) */
+				loop = janus_ice_static_event_loop_pick();
+				if(group != NULL) {
+					/* Next handles of this group will join it there */
+					group->loop = loop;
 				}
-				l = l->next;
 			}
 			janus_refcount_increase(&loop->ref);
 			loop->handles++;
@@ -1490,7 +3531,7 @@ gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle
 		janus_mutex_unlock(&event_loops_mutex);
 	}
 	handle->rtp_source = janus_ice_outgoing_traffic_create(handle, (GDestroyNotify)g_free);
-	g_source_set_priority(handle->rtp_source, G_PRIORITY_DEFAULT);
+	g_source_set_priority(handle->rtp_source, janus_ice_outgoing_traffic_priority(handle));
 	g_source_attach(handle->rtp_source, handle->mainctx);
 	if(static_event_loops == 0) {
 		/* Now spawn a thread for this loop */
@@ -1540,6 +3581,7 @@ gint janus_ice_handle_destroy(void *core_session, janus_ice_handle *handle) {
 	if(handle->static_event_loop != NULL) {
 		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)handle->static_event_loop;
 		loop->handles--;
+		janus_ice_loop_group_leave(handle);
 		janus_refcount_decrease(&loop->ref);
 		JANUS_LOG(LOG_VERB, "[%"SCNu64"] Manually removed handle from loop #%d\n", handle->handle_id, loop->id);
 	}
@@ -1592,6 +3634,14 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 		janus_ice_clear_queued_packets(handle);
 		g_async_queue_unref(handle->queued_packets);
 	}
+	int lane = 0;
+	for(lane=0; lane<JANUS_ICE_LANES; lane++) {
+		janus_ring_destroy(handle->outgoing_lanes[lane]);
+		handle->outgoing_lanes[lane] = NULL;
+	}
+	janus_ice_pacer_clear(handle);
+	g_free(handle->pacer);
+	handle->pacer = NULL;
 	if(static_event_loops == 0 && handle->mainloop != NULL) {
 		g_main_loop_unref(handle->mainloop);
 		handle->mainloop = NULL;
@@ -1602,6 +3652,12 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 	}
 	janus_mutex_unlock(&handle->mutex);
 	janus_ice_webrtc_free(handle);
+	if(handle->static_event_loop != NULL) {
+		/* If the handle had a dedicated loop, nothing needs it anymore */
+		janus_mutex_lock(&event_loops_mutex);
+		janus_ice_dedicated_event_loop_retire((janus_ice_static_event_loop *)handle->static_event_loop);
+		janus_mutex_unlock(&event_loops_mutex);
+	}
 	JANUS_LOG(LOG_INFO, "[%"SCNu64"] Handle and related resources freed; %p %p\n", handle->handle_id, handle, handle->session);
 	/* Finally, unref the session and free the handle */
 	if(handle->session != NULL) {
@@ -1609,6 +3665,9 @@ static void janus_ice_handle_free(const janus_refcount *handle_ref) {
 		janus_refcount_decrease(&session->ref);
 	}
 	g_free(handle->opaque_id);
+	g_free(handle->loop_group);
+	if(handle->migrate_pending != NULL)
+		janus_refcount_decrease(&((janus_ice_static_event_loop *)handle->migrate_pending)->ref);
 	g_free(handle->token);
 	g_free(handle);
 }
@@ -1642,6 +3701,8 @@ void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason) {
 	if(handle == NULL)
 		return;
 	g_atomic_int_set(&handle->closepc, 0);
+	/* Whatever the handle was colocated for is over, so it can be rebalanced again */
+	handle->colocated = FALSE;
 	if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
 		return;
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT);
@@ -1755,6 +3816,10 @@ void janus_ice_peerconnection_destroy(janus_ice_peerconnection *pc) {
 	g_hash_table_remove_all(pc->media_byssrc);
 	g_hash_table_remove_all(pc->media_bymid);
 	g_hash_table_remove_all(pc->media_bytype);
+	/* Stop draining the socket, if we were doing batched receive */
+	janus_ice_recv_batch_stop(pc->handle, pc, FALSE);
+	/* If we were using the shared socket of the loop, it won't know about us anymore */
+	janus_ice_mux_unregister(pc);
 	/* Get rid of the DTLS stack */
 	if(pc->dtlsrt_source != NULL) {
 		g_source_destroy(pc->dtlsrt_source);
@@ -1795,8 +3860,10 @@ static void janus_ice_peerconnection_free(const janus_refcount *pc_ref) {
 	pc->ruser = NULL;
 	g_free(pc->rpass);
 	pc->rpass = NULL;
-	g_slist_free_full(pc->transport_wide_received_seq_nums, (GDestroyNotify)g_free);
-	pc->transport_wide_received_seq_nums = NULL;
+	g_free(pc->transport_wide_received);
+	pc->transport_wide_received = NULL;
+	janus_bwe_context_destroy(pc->bwe);
+	pc->bwe = NULL;
 	if(pc->candidates != NULL) {
 		GSList *i = NULL, *candidates = pc->candidates;
 		for(i = candidates; i; i = i->next) {
@@ -1957,29 +4024,20 @@ static void janus_ice_peerconnection_medium_free(const janus_refcount *medium_re
 		g_hash_table_destroy(medium->pending_nacked_cleanup);
 	}
 	medium->pending_nacked_cleanup = NULL;
-	if(medium->retransmit_buffer != NULL) {
-		janus_rtp_packet *p = NULL;
-		while((p = (janus_rtp_packet *)g_queue_pop_head(medium->retransmit_buffer)) != NULL) {
-			/* Remove from hashtable too */
-			janus_rtp_header *header = (janus_rtp_header *)p->data;
-			guint16 seq = ntohs(header->seq_number);
-			g_hash_table_remove(medium->retransmit_seqs, GUINT_TO_POINTER(seq));
-			/* Free the packet */
-			janus_ice_free_rtp_packet(p);
-		}
-		g_queue_free(medium->retransmit_buffer);
-		g_hash_table_destroy(medium->retransmit_seqs);
-	}
-	if(medium->last_seqs[0])
-		janus_seq_list_free(&medium->last_seqs[0]);
-	if(medium->last_seqs[1])
-		janus_seq_list_free(&medium->last_seqs[1]);
-	if(medium->last_seqs[2])
-		janus_seq_list_free(&medium->last_seqs[2]);
+	janus_ice_retransmit_ring_free(medium->retransmit_ring);
+	medium->retransmit_ring = NULL;
+	g_free(medium->loss_trackers[0]);
+	g_free(medium->loss_trackers[1]);
+	g_free(medium->loss_trackers[2]);
 	g_free(medium);
 	//~ janus_mutex_unlock(&handle->mutex);
 }
 
+/* Feed the bandwidth estimator with the transport wide cc feedback we received */
+static void janus_ice_bwe_feedback(guint16 seq, gint64 arrival, gpointer user_data) {
+	janus_bwe_context_packet_feedback((janus_bwe_context *)user_data, seq, arrival);
+}
+
 /* Call plugin slow_link callback if a minimum of lost packets are detected within a second */
 static void
 janus_slow_link_update(janus_ice_peerconnection_medium *medium, janus_ice_handle *handle,
@@ -2011,7 +4069,7 @@ janus_slow_link_update(janus_ice_peerconnection_medium *medium, janus_ice_handle
 			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Sending event to transport...; %p\n", handle->handle_id, handle);
 			janus_session_notify_event(session, event);
 			/* Finally, notify event handlers */
-			if(janus_events_is_enabled()) {
+			if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_MEDIA)) {
 				json_t *info = json_object();
 				json_object_set_new(info, "mid", json_string(medium->mid));
 				json_object_set_new(info, "media", json_string(video ? "video" : "audio"));
@@ -2076,13 +4134,611 @@ static gboolean janus_ice_check_failed(gpointer data) {
 		alert_set ? "set" : "not set");
 	return TRUE;
 
-stoptimer:
-	if(pc && pc->icestate_source != NULL) {
-		g_source_destroy(pc->icestate_source);
-		g_source_unref(pc->icestate_source);
-		pc->icestate_source = NULL;
+stoptimer:
+	if(pc && pc->icestate_source != NULL) {
+		g_source_destroy(pc->icestate_source);
+		g_source_unref(pc->icestate_source);
+		pc->icestate_source = NULL;
+	}
+	return FALSE;
+}
+
+/* Batched receive */
+static gboolean janus_ice_recv_batch_cb(GSocket *socket, GIOCondition condition, gpointer user_data) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)user_data;
+	janus_ice_handle *handle = pc ? pc->handle : NULL;
+	if(!handle || !handle->agent)
+		return G_SOURCE_REMOVE;
+	janus_ice_recv_batch *batch = g_private_get(&recv_batch_buffers);
+	if(batch == NULL) {
+		batch = g_malloc(sizeof(janus_ice_recv_batch));
+		g_private_set(&recv_batch_buffers, batch);
+	}
+	uint16_t size = recv_batch_size ? recv_batch_size : 1, i = 0;
+	for(i=0; i<size; i++) {
+		batch->buffers[i].buffer = batch->data[i];
+		batch->buffers[i].size = JANUS_ICE_RECV_BUFSIZE;
+		batch->messages[i].buffers = &batch->buffers[i];
+		batch->messages[i].n_buffers = 1;
+		batch->messages[i].from = NULL;
+		batch->messages[i].length = 0;
+	}
+	/* Connectivity checks and consent freshness are handled by libnice internally */
+	GError *error = NULL;
+	gint num = nice_agent_recv_messages_nonblocking(handle->agent, pc->stream_id, pc->component_id,
+		batch->messages, size, NULL, &error);
+	if(num < 0) {
+		if(error != NULL && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK)) {
+			JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Error receiving batch: %d (%s)\n",
+				handle->handle_id, error->code, error->message ? error->message : "??");
+		}
+		g_clear_error(&error);
+		return G_SOURCE_CONTINUE;
+	}
+	if(num == 0)
+		return G_SOURCE_CONTINUE;
+	pc->recv_batches++;
+	pc->recv_batch_packets += num;
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)handle->static_event_loop;
+	if(loop != NULL) {
+		loop->recv_batches++;
+		loop->recv_batch_packets += num;
+	}
+	/* Pass all the datagrams we got through the usual demultiplexing: they
+	 * all arrived at the same time, so they can share the same clock read */
+	janus_monotonic_time_cache_set(janus_get_monotonic_time());
+	for(i=0; i<num; i++) {
+		if(batch->messages[i].length == 0)
+			continue;
+		janus_ice_cb_nice_recv(handle->agent, pc->stream_id, pc->component_id,
+			batch->messages[i].length, batch->data[i], pc);
+		if(pc->handle == NULL)
+			break;
+	}
+	janus_monotonic_time_cache_set(0);
+	return G_SOURCE_CONTINUE;
+}
+
+static void janus_ice_recv_batch_start(janus_ice_handle *handle, janus_ice_peerconnection *pc) {
+	if(!handle || !handle->agent || !pc || recv_batch_size == 0)
+		return;
+	GSocket *socket = nice_agent_get_selected_socket(handle->agent, pc->stream_id, pc->component_id);
+	if(socket == NULL) {
+		/* Probably a TCP pair: keep on using the libnice callback */
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] No socket for the selected pair, not using batched receive\n", handle->handle_id);
+		janus_ice_recv_batch_stop(handle, pc, TRUE);
+		return;
+	}
+	if(pc->recv_batch_source != NULL) {
+		/* The selected pair changed, so we need to watch a different socket */
+		g_source_destroy(pc->recv_batch_source);
+		g_source_unref(pc->recv_batch_source);
+		pc->recv_batch_source = NULL;
+	} else {
+		/* Detach the per-datagram callback: from now on we'll read ourselves */
+		nice_agent_attach_recv(handle->agent, pc->stream_id, pc->component_id,
+			g_main_loop_get_context(handle->mainloop), NULL, NULL);
+	}
+	pc->recv_batch_source = g_socket_create_source(socket, G_IO_IN, NULL);
+	g_source_set_priority(pc->recv_batch_source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(pc->recv_batch_source, (GSourceFunc)janus_ice_recv_batch_cb, pc, NULL);
+	g_source_attach(pc->recv_batch_source, handle->mainctx);
+	g_object_unref(socket);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Using batched receive (up to %"SCNu16" packets)\n", handle->handle_id, recv_batch_size);
+}
+
+static void janus_ice_recv_batch_stop(janus_ice_handle *handle, janus_ice_peerconnection *pc, gboolean reattach) {
+	if(!pc || pc->recv_batch_source == NULL)
+		return;
+	g_source_destroy(pc->recv_batch_source);
+	g_source_unref(pc->recv_batch_source);
+	pc->recv_batch_source = NULL;
+	if(reattach && handle && handle->agent) {
+		/* Go back to the libnice callback */
+		nice_agent_attach_recv(handle->agent, pc->stream_id, pc->component_id,
+			g_main_loop_get_context(handle->mainloop), janus_ice_cb_nice_recv, pc);
+	}
+}
+
+/* A PeerConnection is connected: start the DTLS handshake, unless we did already */
+static void janus_ice_peerconnection_connected(janus_ice_handle *handle, janus_ice_peerconnection *pc) {
+	/* Have we been here before? (might happen, when trickling) */
+	if(pc->connected > 0)
+		return;
+	/* FIXME Clear the queue */
+	janus_ice_clear_queued_packets(handle);
+	/* Now we can start the DTLS handshake (FIXME This was on the 'connected' state notification, before) */
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"]   Component is ready enough, starting DTLS handshake...\n", handle->handle_id);
+	pc->connected = janus_get_monotonic_time();
+	/* Start the DTLS handshake, at last */
+#if GLIB_CHECK_VERSION(2, 46, 0)
+	g_async_queue_push_front(handle->queued_packets, &janus_ice_dtls_handshake);
+#else
+	g_async_queue_push(handle->queued_packets, &janus_ice_dtls_handshake);
+#endif
+	g_main_context_wakeup(handle->mainctx);
+}
+
+/* Single-port mode: in ICE Lite, all the PeerConnections served by a static loop can
+ * share a single UDP socket, rather than having libnice bind ports for each of them.
+ * Connectivity checks from peers are answered here, and they're also how we find out
+ * which PeerConnection a datagram is for: the USERNAME of a valid check tells us the
+ * PeerConnection, and the address the check came from is then mapped to it. Each loop
+ * has a port of its own, so that datagrams always land on the loop their handle is on */
+#define JANUS_ICE_MUX_MAX_ADDRESSES	8
+static uint16_t single_port = 0;
+typedef struct janus_ice_mux_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr messages[JANUS_ICE_MAX_RECV_BATCH];
+	struct iovec iovecs[JANUS_ICE_MAX_RECV_BATCH];
+#endif
+	struct sockaddr_storage remote[JANUS_ICE_MAX_RECV_BATCH];
+	int length[JANUS_ICE_MAX_RECV_BATCH];
+	char data[JANUS_ICE_MAX_RECV_BATCH][JANUS_ICE_RECV_BUFSIZE];
+} janus_ice_mux_batch;
+/* Remote IPv4 addresses and ports are indexed as a single integer */
+static guint64 janus_ice_mux_key(const struct sockaddr_in *address) {
+	return ((guint64)ntohl(address->sin_addr.s_addr) << 16) | ntohs(address->sin_port);
+}
+static void janus_ice_mux_pc_unref(gpointer data) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)data;
+	janus_refcount_decrease(&pc->ref);
+}
+
+/* Look for the PeerConnection a connectivity check is for, and provide its password */
+typedef struct janus_ice_mux_check {
+	janus_ice_static_event_loop *loop;
+	janus_ice_peerconnection *pc;
+	char pwd[257];
+} janus_ice_mux_check;
+static bool janus_ice_mux_check_credentials(StunAgent *agent, StunMessage *message,
+		uint8_t *username, uint16_t username_len, uint8_t **password, size_t *password_len, void *user_data) {
+	janus_ice_mux_check *check = (janus_ice_mux_check *)user_data;
+	/* The username is "<our ufrag>:<their ufrag>", and we only need the former */
+	uint16_t ufrag_len = 0;
+	while(ufrag_len < username_len && username[ufrag_len] != ':')
+		ufrag_len++;
+	if(check->pc != NULL || ufrag_len == 0 || ufrag_len == username_len || ufrag_len > 256)
+		return false;
+	char ufrag[257];
+	memcpy(ufrag, username, ufrag_len);
+	ufrag[ufrag_len] = '\0';
+	janus_mutex_lock(&check->loop->mux_mutex);
+	janus_ice_peerconnection *pc = g_hash_table_lookup(check->loop->mux_ufrags, ufrag);
+	if(pc != NULL && pc->mux_pwd != NULL && strlen(pc->mux_pwd) < sizeof(check->pwd)) {
+		g_strlcpy(check->pwd, pc->mux_pwd, sizeof(check->pwd));
+		janus_refcount_increase(&pc->ref);
+		check->pc = pc;
+	}
+	janus_mutex_unlock(&check->loop->mux_mutex);
+	if(check->pc == NULL)
+		return false;
+	*password = (uint8_t *)check->pwd;
+	*password_len = strlen(check->pwd);
+	return true;
+}
+
+/* Forget about an address a PeerConnection was reachable at: must be called with the mux_mutex locked */
+static void janus_ice_mux_forget_address(janus_ice_peerconnection *pc, guint64 key) {
+	guint i = 0;
+	for(i=0; pc->mux_addresses != NULL && i<pc->mux_addresses->len; i++) {
+		if(g_array_index(pc->mux_addresses, guint64, i) == key) {
+			g_array_remove_index(pc->mux_addresses, i);
+			break;
+		}
+	}
+	if(pc->mux_remote == key)
+		pc->mux_remote = 0;
+}
+/* Map an address a valid check came from to a PeerConnection */
+static void janus_ice_mux_add_address(janus_ice_static_event_loop *loop, janus_ice_peerconnection *pc, guint64 key) {
+	janus_mutex_lock(&loop->mux_mutex);
+	janus_ice_peerconnection *owner = g_hash_table_lookup(loop->mux_addresses, &key);
+	if(owner == pc || pc->mux != loop) {
+		janus_mutex_unlock(&loop->mux_mutex);
+		return;
+	}
+	if(owner != NULL) {
+		/* Another PeerConnection used this address before (e.g., a NAT reused the port) */
+		janus_ice_mux_forget_address(owner, key);
+	}
+	if(pc->mux_addresses == NULL)
+		pc->mux_addresses = g_array_new(FALSE, FALSE, sizeof(guint64));
+	if(pc->mux_addresses->len >= JANUS_ICE_MUX_MAX_ADDRESSES) {
+		/* Too many addresses, get rid of the oldest one we're not using */
+		guint64 oldest = g_array_index(pc->mux_addresses, guint64, 0);
+		if(oldest == pc->mux_remote)
+			oldest = g_array_index(pc->mux_addresses, guint64, 1);
+		janus_ice_mux_forget_address(pc, oldest);
+		g_hash_table_remove(loop->mux_addresses, &oldest);
+	}
+	g_array_append_val(pc->mux_addresses, key);
+	guint64 *address = g_malloc(sizeof(guint64));
+	*address = key;
+	janus_refcount_increase(&pc->ref);
+	g_hash_table_insert(loop->mux_addresses, address, pc);
+	janus_mutex_unlock(&loop->mux_mutex);
+}
+
+/* The peer nominated an address: use it from now on */
+static void janus_ice_mux_nominated(janus_ice_handle *handle, janus_ice_peerconnection *pc, struct sockaddr_in *remote) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	pc->mux_remote = janus_ice_mux_key(remote);
+	char laddress[INET_ADDRSTRLEN], raddress[INET_ADDRSTRLEN];
+	g_strlcpy(laddress, janus_get_local_ip(), sizeof(laddress));
+	inet_ntop(AF_INET, &remote->sin_addr, raddress, sizeof(raddress));
+	int lport = loop->mux_port, rport = ntohs(remote->sin_port);
+	char sp[200];
+	g_snprintf(sp, sizeof(sp), "%s:%d [host,udp] <-> %s:%d [prflx,udp]", laddress, lport, raddress, rport);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] New selected pair on the single port: %s\n", handle->handle_id, sp);
+	gchar *prev_selected_pair = pc->selected_pair;
+	pc->selected_pair = g_strdup(sp);
+	g_clear_pointer(&prev_selected_pair, g_free);
+	/* There's no libnice state machine involved, so we notify the state change ourselves */
+	janus_session *session = (janus_session *)handle->session;
+	if(pc->state != NICE_COMPONENT_STATE_READY) {
+		pc->state = NICE_COMPONENT_STATE_READY;
+		if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
+			json_t *info = json_object();
+			json_object_set_new(info, "ice", json_string(janus_get_ice_state_name(pc->state)));
+			json_object_set_new(info, "stream_id", json_integer(pc->stream_id));
+			json_object_set_new(info, "component_id", json_integer(pc->component_id));
+			janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_ICE,
+				session->session_id, handle->handle_id, handle->opaque_id, info);
+		}
+	}
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
+		json_t *info = json_object();
+		json_object_set_new(info, "selected-pair", json_string(sp));
+		json_t *candidates = json_object();
+		json_t *lcand = json_object();
+		json_object_set_new(lcand, "address", json_string(laddress));
+		json_object_set_new(lcand, "port", json_integer(lport));
+		json_object_set_new(lcand, "type", json_string("host"));
+		json_object_set_new(lcand, "transport", json_string("udp"));
+		json_object_set_new(lcand, "family", json_integer(4));
+		json_object_set_new(candidates, "local", lcand);
+		json_t *rcand = json_object();
+		json_object_set_new(rcand, "address", json_string(raddress));
+		json_object_set_new(rcand, "port", json_integer(rport));
+		json_object_set_new(rcand, "type", json_string("prflx"));
+		json_object_set_new(rcand, "transport", json_string("udp"));
+		json_object_set_new(rcand, "family", json_integer(4));
+		json_object_set_new(candidates, "remote", rcand);
+		json_object_set_new(info, "candidates", candidates);
+		json_object_set_new(info, "stream_id", json_integer(pc->stream_id));
+		json_object_set_new(info, "component_id", json_integer(pc->component_id));
+		janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_PAIR,
+			session->session_id, handle->handle_id, handle->opaque_id, info);
+	}
+	janus_ice_peerconnection_connected(handle, pc);
+}
+
+/* Answer a connectivity check received on the shared socket */
+static void janus_ice_mux_incoming_stun(janus_ice_static_event_loop *loop, char *buf, guint len, struct sockaddr_in *remote) {
+	StunMessage msg;
+	janus_ice_mux_check check = { .loop = loop, .pc = NULL };
+	StunValidationStatus status = stun_agent_validate(&loop->mux_stun, &msg, (uint8_t *)buf, len,
+		janus_ice_mux_check_credentials, &check);
+	janus_ice_peerconnection *pc = check.pc;
+	if(status != STUN_VALIDATION_SUCCESS || pc == NULL ||
+			stun_message_get_class(&msg) != STUN_REQUEST || stun_message_get_method(&msg) != STUN_BINDING) {
+		/* Not a valid check for any of our PeerConnections */
+		JANUS_LOG(LOG_HUGE, "Ignoring STUN message on single port %"SCNu16" (validation status %d)\n",
+			loop->mux_port, status);
+		if(pc != NULL)
+			janus_refcount_decrease(&pc->ref);
+		return;
+	}
+	janus_ice_handle *handle = pc->handle;
+	if(handle == NULL || pc->mux != loop || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)) {
+		janus_refcount_decrease(&pc->ref);
+		return;
+	}
+	/* Send a Binding response, signed with the same password */
+	StunMessage response;
+	uint8_t rbuf[JANUS_ICE_RECV_BUFSIZE];
+	size_t rbuf_len = sizeof(rbuf);
+	bool control = FALSE;
+	StunUsageIceReturn ret = stun_usage_ice_conncheck_create_reply(&loop->mux_stun, &msg, &response,
+		rbuf, &rbuf_len, (struct sockaddr_storage *)remote, sizeof(struct sockaddr_in),
+		&control, 0, STUN_USAGE_ICE_COMPATIBILITY_RFC5245);
+	if(ret != STUN_USAGE_ICE_RETURN_SUCCESS || rbuf_len == 0) {
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Error creating the response to a connectivity check (%d)\n", handle->handle_id, ret);
+		janus_refcount_decrease(&pc->ref);
+		return;
+	}
+	if(sendto(loop->mux_fd, rbuf, rbuf_len, 0, (struct sockaddr *)remote, sizeof(struct sockaddr_in)) < 0) {
+		JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Error sending the response to a connectivity check: %s\n",
+			handle->handle_id, g_strerror(errno));
+	}
+	/* Datagrams from this address are for this PeerConnection, now */
+	janus_ice_mux_add_address(loop, pc, janus_ice_mux_key(remote));
+	if(stun_usage_ice_conncheck_use_candidate(&msg) && pc->mux_remote != janus_ice_mux_key(remote))
+		janus_ice_mux_nominated(handle, pc, remote);
+	janus_refcount_decrease(&pc->ref);
+}
+
+/* Pass a datagram received on the shared socket to the PeerConnection it's for */
+static void janus_ice_mux_incoming(janus_ice_static_event_loop *loop, char *buf, guint len, struct sockaddr_in *remote) {
+	if(len >= 20 && (guint8)buf[0] < 4 && stun_message_validate_buffer_length((uint8_t *)buf, len, TRUE) == (int)len) {
+		janus_ice_mux_incoming_stun(loop, buf, len, remote);
+		return;
+	}
+	guint64 key = janus_ice_mux_key(remote);
+	janus_mutex_lock(&loop->mux_mutex);
+	janus_ice_peerconnection *pc = g_hash_table_lookup(loop->mux_addresses, &key);
+	if(pc != NULL)
+		janus_refcount_increase(&pc->ref);
+	janus_mutex_unlock(&loop->mux_mutex);
+	if(pc == NULL) {
+		JANUS_LOG(LOG_HUGE, "Ignoring datagram from unknown address on single port %"SCNu16"\n", loop->mux_port);
+		return;
+	}
+	janus_ice_handle *handle = pc->handle;
+	if(handle != NULL && handle->agent != NULL)
+		janus_ice_cb_nice_recv(handle->agent, pc->stream_id, pc->component_id, len, buf, pc);
+	janus_refcount_decrease(&pc->ref);
+}
+
+/* Drain the shared socket of a loop, in batches */
+static gboolean janus_ice_mux_recv_cb(gint fd, GIOCondition condition, gpointer user_data) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)user_data;
+	janus_ice_mux_batch *batch = loop->mux_batch;
+	if(batch == NULL)
+		return G_SOURCE_REMOVE;
+	int max = recv_batch_size > 0 ? recv_batch_size : JANUS_ICE_MAX_RECV_BATCH, num = 0, i = 0;
+#ifdef HAVE_RECVMMSG
+	for(i=0; i<max; i++) {
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = JANUS_ICE_RECV_BUFSIZE;
+		memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+		batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->messages[i].msg_hdr.msg_iovlen = 1;
+		batch->messages[i].msg_hdr.msg_name = &batch->remote[i];
+		batch->messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+	}
+	num = recvmmsg(fd, batch->messages, max, MSG_DONTWAIT, NULL);
+	for(i=0; i<num; i++)
+		batch->length[i] = batch->messages[i].msg_len;
+#else
+	/* No recvmmsg, read what's there one datagram at a time */
+	for(num=0; num<max; num++) {
+		socklen_t addrlen = sizeof(struct sockaddr_storage);
+		batch->length[num] = recvfrom(fd, batch->data[num], JANUS_ICE_RECV_BUFSIZE, MSG_DONTWAIT,
+			(struct sockaddr *)&batch->remote[num], &addrlen);
+		if(batch->length[num] < 0)
+			break;
+	}
+	if(num == 0)
+		num = -1;
+#endif
+	if(num < 0) {
+		if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			JANUS_LOG(LOG_HUGE, "Error receiving on single port %"SCNu16": %s\n", loop->mux_port, g_strerror(errno));
+		return G_SOURCE_CONTINUE;
+	}
+	loop->recv_batches++;
+	loop->recv_batch_packets += num;
+	for(i=0; i<num; i++) {
+		if(batch->length[i] <= 0 || batch->remote[i].ss_family != AF_INET)
+			continue;
+		janus_ice_mux_incoming(loop, batch->data[i], batch->length[i], (struct sockaddr_in *)&batch->remote[i]);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+/* Open the shared socket of a loop */
+static int janus_ice_mux_open(janus_ice_static_event_loop *loop, uint16_t port) {
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(fd < 0) {
+		JANUS_LOG(LOG_ERR, "Error creating single-port socket: %s\n", g_strerror(errno));
+		return -1;
+	}
+	struct sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if(bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		JANUS_LOG(LOG_ERR, "Error binding single-port socket to port %"SCNu16": %s\n", port, g_strerror(errno));
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	/* Many PeerConnections share this socket, so ask for larger buffers (failures aren't fatal) */
+	int size = 4*1024*1024;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	if(dscp_ef > 0) {
+		int tos = dscp_ef << 2;
+		if(setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) < 0)
+			JANUS_LOG(LOG_WARN, "Error setting DSCP on single-port socket: %s\n", g_strerror(errno));
+	}
+	stun_agent_init(&loop->mux_stun, STUN_ALL_KNOWN_ATTRIBUTES, STUN_COMPATIBILITY_RFC5389,
+		STUN_AGENT_USAGE_SHORT_TERM_CREDENTIALS | STUN_AGENT_USAGE_USE_FINGERPRINT);
+	janus_mutex_lock(&loop->mux_mutex);
+	loop->mux_ufrags = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, janus_ice_mux_pc_unref);
+	loop->mux_addresses = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, janus_ice_mux_pc_unref);
+	loop->mux_candidates = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_ptr_array_unref);
+	loop->mux_batch = g_malloc0(sizeof(janus_ice_mux_batch));
+	loop->mux_fd = fd;
+	loop->mux_port = port;
+	janus_mutex_unlock(&loop->mux_mutex);
+	loop->mux_source = g_unix_fd_source_new(fd, G_IO_IN);
+	g_source_set_priority(loop->mux_source, G_PRIORITY_DEFAULT);
+	g_source_set_callback(loop->mux_source, (GSourceFunc)janus_ice_mux_recv_cb, loop, NULL);
+	g_source_attach(loop->mux_source, loop->mainctx);
+	return 0;
+}
+static void janus_ice_mux_close(janus_ice_static_event_loop *loop) {
+	if(loop->mux_source != NULL) {
+		g_source_destroy(loop->mux_source);
+		g_source_unref(loop->mux_source);
+		loop->mux_source = NULL;
+	}
+	janus_mutex_lock(&loop->mux_mutex);
+	if(loop->mux_fd >= 0)
+		close(loop->mux_fd);
+	loop->mux_fd = -1;
+	loop->mux_port = 0;
+	g_clear_pointer(&loop->mux_ufrags, g_hash_table_destroy);
+	g_clear_pointer(&loop->mux_addresses, g_hash_table_destroy);
+	g_clear_pointer(&loop->mux_candidates, g_hash_table_destroy);
+	g_clear_pointer(&loop->mux_batch, g_free);
+	janus_mutex_unlock(&loop->mux_mutex);
+}
+
+int janus_ice_set_single_port(uint16_t port) {
+	if(port == 0)
+		return 0;
+	if(!janus_ice_lite_enabled || janus_full_trickle_enabled || static_event_loops < 1) {
+		JANUS_LOG(LOG_WARN, "Single-port mode needs ICE Lite, half-trickle and static event loops, disabling\n");
+		return -1;
+	}
+	if((int)port + static_event_loops - 1 > 65535) {
+		JANUS_LOG(LOG_WARN, "Invalid single port %"SCNu16" (one port per loop is needed), disabling\n", port);
+		return -1;
+	}
+	const char *local_ip = janus_get_local_ip();
+	if(local_ip == NULL || strchr(local_ip, ':') != NULL) {
+		JANUS_LOG(LOG_WARN, "Single-port mode needs an IPv4 local address, disabling\n");
+		return -1;
+	}
+	gboolean failed = FALSE;
+	janus_mutex_lock(&event_loops_mutex);
+	GSList *l = event_loops;
+	while(l && !failed) {
+		janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)l->data;
+		if(janus_ice_mux_open(loop, port + loop->id) < 0)
+			failed = TRUE;
+		l = l->next;
+	}
+	if(failed) {
+		/* Go back to a port (or more) per PeerConnection */
+		for(l = event_loops; l; l = l->next)
+			janus_ice_mux_close((janus_ice_static_event_loop *)l->data);
+	}
+	janus_mutex_unlock(&event_loops_mutex);
+	if(failed) {
+		JANUS_LOG(LOG_WARN, "Couldn't open the single-port sockets, disabling\n");
+		return -1;
+	}
+	single_port = port;
+	JANUS_LOG(LOG_INFO, "Single-port mode: PeerConnections will share UDP ports %"SCNu16"-%d (one per loop)\n",
+		port, port + static_event_loops - 1);
+	return 0;
+}
+uint16_t janus_ice_get_single_port(void) {
+	return single_port;
+}
+
+/* Make a PeerConnection reachable on the shared socket of its loop: as libnice ufrags
+ * are short and may clash among thousands of PeerConnections, we pick a longer one */
+static void janus_ice_mux_register(janus_ice_handle *handle, janus_ice_peerconnection *pc) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	if(loop == NULL || handle->agent == NULL)
+		return;
+	gchar *ufrag = NULL, *pwd = NULL;
+	if(!nice_agent_get_local_credentials(handle->agent, pc->stream_id, &ufrag, &pwd)) {
+		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Couldn't retrieve the local ICE credentials\n", handle->handle_id);
+		return;
+	}
+	g_free(ufrag);
+	janus_mutex_lock(&loop->mux_mutex);
+	if(pc->mux_ufrag != NULL && g_hash_table_lookup(loop->mux_ufrags, pc->mux_ufrag) == pc)
+		g_hash_table_remove(loop->mux_ufrags, pc->mux_ufrag);
+	do {
+		ufrag = g_strdup_printf("%08"SCNx32, janus_random_uint32());
+		if(g_hash_table_lookup(loop->mux_ufrags, ufrag) == NULL)
+			break;
+		g_free(ufrag);
+	} while(TRUE);
+	if(!nice_agent_set_local_credentials(handle->agent, pc->stream_id, ufrag, pwd))
+		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Couldn't set the local ICE credentials\n", handle->handle_id);
+	g_free(pc->mux_ufrag);
+	g_free(pc->mux_pwd);
+	pc->mux_ufrag = ufrag;
+	pc->mux_pwd = pwd;
+	janus_refcount_increase(&pc->ref);
+	g_hash_table_insert(loop->mux_ufrags, g_strdup(ufrag), pc);
+	janus_mutex_unlock(&loop->mux_mutex);
+	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Using single port %"SCNu16" (ufrag %s)\n", handle->handle_id, loop->mux_port, ufrag);
+}
+static void janus_ice_mux_unregister(janus_ice_peerconnection *pc) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	if(loop == NULL)
+		return;
+	janus_mutex_lock(&loop->mux_mutex);
+	if(loop->mux_ufrags != NULL && pc->mux_ufrag != NULL && g_hash_table_lookup(loop->mux_ufrags, pc->mux_ufrag) == pc)
+		g_hash_table_remove(loop->mux_ufrags, pc->mux_ufrag);
+	guint i = 0;
+	for(i=0; loop->mux_addresses != NULL && pc->mux_addresses != NULL && i<pc->mux_addresses->len; i++) {
+		guint64 key = g_array_index(pc->mux_addresses, guint64, i);
+		if(g_hash_table_lookup(loop->mux_addresses, &key) == pc)
+			g_hash_table_remove(loop->mux_addresses, &key);
+	}
+	if(pc->mux_addresses != NULL)
+		g_array_free(pc->mux_addresses, TRUE);
+	pc->mux_addresses = NULL;
+	g_clear_pointer(&pc->mux_ufrag, g_free);
+	g_clear_pointer(&pc->mux_pwd, g_free);
+	pc->mux_remote = 0;
+	pc->mux = NULL;
+	janus_mutex_unlock(&loop->mux_mutex);
+	janus_refcount_decrease(&loop->ref);
+}
+
+/* The only local candidate of a PeerConnection in single-port mode */
+static GSList *janus_ice_mux_local_candidates(janus_ice_peerconnection *pc, guint component_id) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	if(loop == NULL)
+		return NULL;
+	NiceCandidate *c = nice_candidate_new(NICE_CANDIDATE_TYPE_HOST);
+	c->transport = NICE_CANDIDATE_TRANSPORT_UDP;
+	c->stream_id = pc->stream_id;
+	c->component_id = component_id;
+	/* Host type preference (126), and the highest local preference */
+	c->priority = (126 << 24) | (65535 << 8) | (256 - component_id);
+	g_strlcpy(c->foundation, "1", NICE_CANDIDATE_MAX_FOUNDATION);
+	if(!nice_address_set_from_string(&c->addr, janus_get_local_ip())) {
+		nice_candidate_free(c);
+		return NULL;
 	}
-	return FALSE;
+	nice_address_set_port(&c->addr, loop->mux_port);
+	c->base_addr = c->addr;
+	return g_slist_append(NULL, c);
+}
+
+/* Get the encoded candidates of the shared socket for a component (a new reference), or store them if provided */
+static GPtrArray *janus_ice_mux_prebuilt_candidates(janus_ice_static_event_loop *loop, guint component_id, GPtrArray *built) {
+	GPtrArray *candidates = NULL;
+	janus_mutex_lock(&loop->mux_mutex);
+	if(loop->mux_candidates != NULL && built != NULL) {
+		if(built->len > 0 && g_hash_table_lookup(loop->mux_candidates, GUINT_TO_POINTER(component_id)) == NULL)
+			g_hash_table_insert(loop->mux_candidates, GUINT_TO_POINTER(component_id), g_ptr_array_ref(built));
+	} else if(loop->mux_candidates != NULL) {
+		candidates = g_hash_table_lookup(loop->mux_candidates, GUINT_TO_POINTER(component_id));
+		if(candidates != NULL)
+			g_ptr_array_ref(candidates);
+	}
+	janus_mutex_unlock(&loop->mux_mutex);
+	return candidates;
+}
+
+int janus_ice_peerconnection_send(janus_ice_handle *handle, janus_ice_peerconnection *pc, const char *buf, int len) {
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	if(loop == NULL)
+		return nice_agent_send(handle->agent, pc->stream_id, pc->component_id, len, buf);
+	guint64 remote = pc->mux_remote;
+	if(remote == 0) {
+		/* The peer didn't nominate an address yet */
+		return -1;
+	}
+	struct sockaddr_in address = { 0 };
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl((guint32)(remote >> 16));
+	address.sin_port = htons((uint16_t)(remote & 0xFFFF));
+	return sendto(loop->mux_fd, buf, len, 0, (struct sockaddr *)&address, sizeof(address));
 }
 
 /* Callbacks */
@@ -2124,7 +4780,7 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 	guint prev_state = pc->state;
 	pc->state = state;
 	/* Notify event handlers */
-	if(janus_events_is_enabled()) {
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
 		janus_session *session = (janus_session *)handle->session;
 		json_t *info = json_object();
 		json_object_set_new(info, "ice", json_string(janus_get_ice_state_name(state)));
@@ -2133,6 +4789,17 @@ static void janus_ice_cb_component_state_changed(NiceAgent *agent, guint stream_
 		janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_ICE,
 			session->session_id, handle->handle_id, handle->opaque_id, info);
 	}
+	/* Batched receive only watches the socket of the selected pair, which means
+	 * checks arriving on other local sockets would go unnoticed: we only use it
+	 * when the component is ready, and as soon as it isn't anymore (e.g., new
+	 * pairs to check, or consent freshness failing after a network change) we
+	 * let libnice read from all sockets again, until it's ready once more */
+	if(recv_batch_size > 0) {
+		if(state == NICE_COMPONENT_STATE_READY && pc->selected_pair != NULL)
+			janus_ice_recv_batch_start(handle, pc);
+		else if(state != NICE_COMPONENT_STATE_READY)
+			janus_ice_recv_batch_stop(handle, pc, TRUE);
+	}
 	/* FIXME Even in case the state is 'connected', we wait for the 'new-selected-pair' callback to do anything */
 	if(state == NICE_COMPONENT_STATE_FAILED) {
 		/* Failed doesn't mean necessarily we need to give up: we may be trickling */
@@ -2239,7 +4906,7 @@ static void janus_ice_cb_new_selected_pair (NiceAgent *agent, guint stream_id, g
 		g_clear_pointer(&prev_selected_pair, g_free);
 	}
 	/* Notify event handlers */
-	if(newpair && janus_events_is_enabled()) {
+	if(newpair && janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
 		janus_session *session = (janus_session *)handle->session;
 		json_t *info = json_object();
 		json_object_set_new(info, "selected-pair", json_string(sp));
@@ -2266,25 +4933,30 @@ static void janus_ice_cb_new_selected_pair (NiceAgent *agent, guint stream_id, g
 		janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_PAIR,
 			session->session_id, handle->handle_id, handle->opaque_id, info);
 	}
-	/* Have we been here before? (might happen, when trickling) */
-	if(pc->connected > 0)
-		return;
-	/* FIXME Clear the queue */
-	janus_ice_clear_queued_packets(handle);
-	/* Now we can start the DTLS handshake (FIXME This was on the 'connected' state notification, before) */
-	JANUS_LOG(LOG_VERB, "[%"SCNu64"]   Component is ready enough, starting DTLS handshake...\n", handle->handle_id);
-	pc->connected = janus_get_monotonic_time();
-	/* Start the DTLS handshake, at last */
-#if GLIB_CHECK_VERSION(2, 46, 0)
-	g_async_queue_push_front(handle->queued_packets, &janus_ice_dtls_handshake);
-#else
-	g_async_queue_push(handle->queued_packets, &janus_ice_dtls_handshake);
-#endif
-	g_main_context_wakeup(handle->mainctx);
+	/* If configured, switch to (or update) batched receive on the selected socket,
+	 * but only if the component is ready: if not, we'll do that when it is */
+	if(newpair && recv_batch_size > 0 && pc->state == NICE_COMPONENT_STATE_READY)
+		janus_ice_recv_batch_start(handle, pc);
+	janus_ice_peerconnection_connected(handle, pc);
 }
 
 /* Candidates management */
 static int janus_ice_candidate_to_string(janus_ice_handle *handle, NiceCandidate *c, char *buffer, int buflen, gboolean log_candidate, gboolean force_private, guint public_ip_index);
+/* Take note of a local candidate we advertised */
+static void janus_ice_local_candidate_notify(janus_ice_handle *handle, janus_ice_peerconnection *pc, const char *buffer) {
+	/* Save for the summary, in case we need it */
+	pc->local_candidates = g_slist_append(pc->local_candidates, g_strdup(buffer));
+	/* Notify event handlers */
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
+		janus_session *session = (janus_session *)handle->session;
+		json_t *info = json_object();
+		json_object_set_new(info, "local-candidate", json_string(buffer));
+		json_object_set_new(info, "stream_id", json_integer(pc->stream_id));
+		json_object_set_new(info, "component_id", json_integer(pc->component_id));
+		janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_LCAND,
+			session->session_id, handle->handle_id, handle->opaque_id, info);
+	}
+}
 #ifndef HAVE_LIBNICE_TCP
 static void janus_ice_cb_new_local_candidate (NiceAgent *agent, guint stream_id, guint component_id, gchar *foundation, gpointer ice) {
 #else
@@ -2537,7 +5209,25 @@ candidatedone:
 	return;
 }
 
+static void janus_ice_cb_nice_recv_internal(NiceAgent *agent, guint stream_id, guint component_id, guint len, gchar *buf, gpointer ice);
 static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint component_id, guint len, gchar *buf, gpointer ice) {
+	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)ice;
+	janus_metrics_inc(JANUS_METRICS_PACKETS_IN);
+	janus_metrics_add(JANUS_METRICS_BYTES_IN, len);
+	janus_ice_trace_context *trace = janus_ice_trace_start();
+	janus_ice_static_event_loop *loop = (pc && pc->handle) ? (janus_ice_static_event_loop *)pc->handle->static_event_loop : NULL;
+	if(loop == NULL) {
+		janus_ice_cb_nice_recv_internal(agent, stream_id, component_id, len, buf, ice);
+		janus_ice_trace_stop(trace);
+		return;
+	}
+	/* Incoming packets (and what plugins do with them) are part of the loop load too */
+	gint64 started = janus_get_monotonic_time();
+	janus_ice_cb_nice_recv_internal(agent, stream_id, component_id, len, buf, ice);
+	janus_ice_static_event_loop_dispatched(loop, pc->handle, 1, started, FALSE);
+	janus_ice_trace_stop(trace);
+}
+static void janus_ice_cb_nice_recv_internal(NiceAgent *agent, guint stream_id, guint component_id, guint len, gchar *buf, gpointer ice) {
 	janus_ice_peerconnection *pc = (janus_ice_peerconnection *)ice;
 	if(!pc) {
 		JANUS_LOG(LOG_ERR, "No component %d in stream %d??\n", component_id, stream_id);
@@ -2694,6 +5384,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 			srtp_err_status_t res = janus_is_webrtc_encryption_enabled() ?
 				srtp_unprotect(pc->dtls->srtp_in, buf, &buflen) : srtp_err_status_ok;
 			if(res != srtp_err_status_ok) {
+				janus_metrics_inc(JANUS_METRICS_SRTP_ERRORS_IN);
 				if(res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
 					/* Only print the error if it's not a 'replay fail' or 'replay old' (which is probably just the result of us NACKing a packet) */
 					guint32 timestamp = ntohl(header->timestamp);
@@ -2709,7 +5400,8 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						medium->ssrc_peer[0]);
 				}
 				/* Do we need to dump this packet for debugging? */
-				if(g_atomic_int_get(&handle->dump_packets))
+				if(g_atomic_int_get(&handle->dump_packets) &&
+						janus_text2pcap_media_enabled(handle->text2pcap, medium->type == JANUS_MEDIA_VIDEO))
 					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, TRUE, buf, buflen,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
 				/* If this is a retransmission using RFC4588, we have to do something first to get the original packet */
@@ -2739,16 +5431,30 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						}
 					}
 				}
+				/* Prepare the data to pass to the responsible plugin, and parse
+				 * all the RTP extensions we negotiated with a single pass */
+				janus_plugin_rtp rtp = { .mindex = medium->mindex, .video = video, .buffer = buf, .length = buflen };
+				janus_plugin_rtp_extensions_reset(&rtp.extensions);
+				janus_rtp_extension_ids ext_ids = {
+					.audio_level = video ? -1 : pc->audiolevel_ext_id,
+					.video_orientation = video ? pc->videoorientation_ext_id : -1,
+					.playout_delay = video ? pc->playoutdelay_ext_id : -1,
+					.mid = pc->mid_ext_id,
+					.rid = pc->rid_ext_id,
+					.repaired_rid = pc->ridrtx_ext_id,
+					.transport_wide_cc = pc->do_transport_wide_cc ? pc->transport_wide_cc_ext_id : -1,
+					.abs_send_time = pc->abs_send_time_ext_id,
+					.dependency_desc = video ? pc->dependencydesc_ext_id : -1
+				};
+				janus_rtp_header_extensions_parse(buf, buflen, &ext_ids, &rtp.extensions);
 				/* Check if we need to handle transport wide cc */
 				if(pc->do_transport_wide_cc) {
-					guint16 transport_seq_num;
 					/* Get transport wide seq num */
-					if(janus_rtp_header_extension_parse_transport_wide_cc(buf, buflen, pc->transport_wide_cc_ext_id, &transport_seq_num) == 0) {
+					if(rtp.extensions.transport_seq_num >= 0) {
+						guint16 transport_seq_num = rtp.extensions.transport_seq_num;
 						/* Get current timestamp */
 						struct timeval now;
 						gettimeofday(&now,0);
-						/* Create <seq num, time> pair */
-						janus_rtcp_transport_wide_cc_stats *stats = g_malloc0(sizeof(janus_rtcp_transport_wide_cc_stats));
 						/* Check if we have a sequence wrap */
 						if(transport_seq_num<0x0FFF && (pc->transport_wide_cc_last_seq_num&0xFFFF)>0xF000) {
 							/* Increase cycles */
@@ -2758,12 +5464,21 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						guint32 transport_ext_seq_num = pc->transport_wide_cc_cycles<<16 | transport_seq_num;
 						/* Store last received transport seq num */
 						pc->transport_wide_cc_last_seq_num = transport_seq_num;
-						/* Set stats values */
-						stats->transport_seq_num = transport_ext_seq_num;
-						stats->timestamp = (((guint64)now.tv_sec)*1E6+now.tv_usec);
-						/* Lock and append to received list */
-						janus_mutex_lock(&pc->mutex);
-						pc->transport_wide_received_seq_nums = g_slist_prepend(pc->transport_wide_received_seq_nums, stats);
+						/* Lock and take note of when we received it, unless it was already reported */
+						janus_mutex_lock_adaptive(&pc->mutex);
+						if(!pc->transport_wide_cc_last_feedback_seq_num || transport_ext_seq_num > pc->transport_wide_cc_last_feedback_seq_num) {
+							if(pc->transport_wide_received == NULL)
+								pc->transport_wide_received = g_malloc0(sizeof(janus_ice_twcc_window));
+							janus_ice_twcc_window *window = pc->transport_wide_received;
+							guint index = transport_ext_seq_num & (JANUS_ICE_TWCC_WINDOW-1);
+							window->seqs[index] = transport_ext_seq_num;
+							window->timestamps[index] = (((guint64)now.tv_sec)*1E6+now.tv_usec);
+							if(window->pending == 0 || transport_ext_seq_num < window->lowest)
+								window->lowest = transport_ext_seq_num;
+							if(window->pending == 0 || transport_ext_seq_num > window->highest)
+								window->highest = transport_ext_seq_num;
+							window->pending++;
+						}
 						janus_mutex_unlock(&pc->mutex);
 					}
 				}
@@ -2810,7 +5525,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							handle->handle_id, medium->rtx_payload_type);
 					}
 					if(medium->codec == NULL) {
-						janus_mutex_lock(&handle->mutex);
+						janus_mutex_lock_adaptive(&handle->mutex);
 						const char *codec = janus_get_codec_from_pt(handle->local_sdp, medium->payload_type);
 						janus_mutex_unlock(&handle->mutex);
 						if(codec != NULL)
@@ -2829,63 +5544,19 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							medium->video_is_keyframe = &janus_h265_is_keyframe;
 					}
 				}
-				/* Prepare the data to pass to the responsible plugin */
-				janus_plugin_rtp rtp = { .mindex = medium->mindex, .video = video, .buffer = buf, .length = buflen };
-				janus_plugin_rtp_extensions_reset(&rtp.extensions);
-				/* Parse RTP extensions before involving the plugin */
-				if(!video && pc->audiolevel_ext_id != -1) {
-					gboolean vad = FALSE;
-					int level = -1;
-					if(janus_rtp_header_extension_parse_audio_level(buf, buflen,
-							pc->audiolevel_ext_id, &vad, &level) == 0) {
-						rtp.extensions.audio_level = level;
-						rtp.extensions.audio_level_vad = vad;
-					}
-				}
-				if(video && pc->videoorientation_ext_id != -1) {
-					gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-					if(janus_rtp_header_extension_parse_video_orientation(buf, buflen,
-							pc->videoorientation_ext_id, &c, &f, &r1, &r0) == 0) {
-						rtp.extensions.video_rotation = 0;
-						if(r1 && r0)
-							rtp.extensions.video_rotation = 270;
-						else if(r1)
-							rtp.extensions.video_rotation = 180;
-						else if(r0)
-							rtp.extensions.video_rotation = 90;
-						rtp.extensions.video_back_camera = c;
-						rtp.extensions.video_flipped = f;
-					}
-				}
-				if(video && pc->playoutdelay_ext_id != -1) {
-					uint16_t min = 0, max = 0;
-					if(janus_rtp_header_extension_parse_playout_delay(buf, buflen,
-							pc->playoutdelay_ext_id, &min, &max) == 0) {
-						rtp.extensions.min_delay = min;
-						rtp.extensions.max_delay = max;
-					}
-				}
-				if(video && pc->dependencydesc_ext_id != -1) {
-					uint8_t dd[256];
-					int len = sizeof(dd);
-					if(janus_rtp_header_extension_parse_dependency_desc(buf, buflen,
-							pc->dependencydesc_ext_id, dd, &len) == 0 && len > 0) {
-						/* We copy the DD bytes as they are: it's up to plugins to parse it, if needed */
-						rtp.extensions.dd_len = len;
-						memcpy(rtp.extensions.dd_content, dd, len);
-					}
-				}
 				/* Pass the packet to the plugin */
 				janus_plugin *plugin = (janus_plugin *)handle->app;
 				if(plugin && plugin->incoming_rtp && handle->app_handle &&
 						!g_atomic_int_get(&handle->app_handle->stopped) &&
-						!g_atomic_int_get(&handle->destroyed))
+						!g_atomic_int_get(&handle->destroyed)) {
+					janus_ice_trace_plugin(plugin);
 					plugin->incoming_rtp(handle->app_handle, &rtp);
+				}
 				/* Restore the header for the stats (plugins may have messed with it) */
 				*header = backup;
 				/* Update stats (overall data received, and data received in the last second) */
 				if(buflen > 0) {
-					gint64 now = janus_get_monotonic_time();
+					gint64 now = janus_get_monotonic_time_cached();
 					if(medium->in_stats.info[vindex].bytes == 0 || medium->in_stats.info[vindex].notified_lastsec) {
 						/* We either received our first packet, or we started receiving it again after missing more than a second */
 						medium->in_stats.info[vindex].notified_lastsec = FALSE;
@@ -2922,76 +5593,58 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					return;
 				}
 				guint16 new_seqn = ntohs(header->seq_number);
+				janus_mutex_lock(&medium->mutex);
+				if(medium->loss_trackers[vindex] == NULL) {
+					/* First packet we may have to NACK on this stream */
+					medium->loss_trackers[vindex] = g_malloc0(sizeof(janus_ice_loss_tracker));
+				}
+				janus_ice_loss_tracker *tracker = medium->loss_trackers[vindex];
 				/* If this is video, check if this is a keyframe: if so, we empty our NACK queue */
 				if(video && medium->video_is_keyframe) {
 					if(medium->video_is_keyframe(payload, plen)) {
 						if(rtcp_ctx && (int16_t)(new_seqn - rtcp_ctx->max_seq_nr) > 0) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Keyframe received with a highest sequence number, resetting NACK queue\n", handle->handle_id);
-							janus_seq_list_free(&medium->last_seqs[vindex]);
+							janus_ice_loss_tracker_reset(tracker);
 						}
 					}
 				}
-				guint16 cur_seqn;
-				int last_seqs_len = 0;
-				janus_mutex_lock(&medium->mutex);
-				janus_seq_info **last_seqs = &medium->last_seqs[vindex];
-				janus_seq_info *cur_seq = *last_seqs;
-				if(cur_seq) {
-					cur_seq = cur_seq->prev;
-					cur_seqn = cur_seq->seq;
-				} else {
-					/* First seq, set up to add one seq */
-					cur_seqn = new_seqn - (guint16)1; /* Can wrap */
-				}
-				if(!janus_seq_in_range(new_seqn, cur_seqn, LAST_SEQS_MAX_LEN) &&
-						!janus_seq_in_range(cur_seqn, new_seqn, 1000)) {
-					/* Jump too big, start fresh */
+				guint16 prev_seqn = tracker->highest;
+				gint64 now = janus_get_monotonic_time_cached();
+				int tracked = janus_ice_loss_tracker_update(tracker, new_seqn, now);
+				if(tracked < 0) {
 					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Big sequence number jump %hu -> %hu (%s stream #%d)\n",
-						handle->handle_id, cur_seqn, new_seqn, video ? "video" : "audio", vindex);
-					janus_seq_list_free(last_seqs);
-					cur_seq = NULL;
-					cur_seqn = new_seqn - (guint16)1;
+						handle->handle_id, prev_seqn, new_seqn, video ? "video" : "audio", vindex);
+				} else if(tracked > 0) {
+					JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Received missed sequence number %"SCNu16" (%s stream #%d)\n",
+						handle->handle_id, new_seqn, video ? "video" : "audio", vindex);
 				}
 
-				GSList *nacks = NULL;
-				gint64 now = janus_get_monotonic_time();
-
-				if(janus_seq_in_range(new_seqn, cur_seqn, LAST_SEQS_MAX_LEN)) {
-					/* Add new seq objs forward */
-					while(cur_seqn != new_seqn) {
-						cur_seqn += (guint16)1; /* can wrap */
-						janus_seq_info *seq_obj = g_malloc0(sizeof(janus_seq_info));
-						seq_obj->seq = cur_seqn;
-						seq_obj->ts = now;
-						seq_obj->state = (cur_seqn == new_seqn) ? SEQ_RECVED : SEQ_MISSING;
-						janus_seq_append(last_seqs, seq_obj);
-						last_seqs_len++;
-					}
-				}
-				if(cur_seq) {
-					/* Scan old seq objs backwards */
-					while(cur_seq != NULL) {
-						last_seqs_len++;
-						if(cur_seq->seq == new_seqn) {
-							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Received missed sequence number %"SCNu16" (%s stream #%d)\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							cur_seq->state = SEQ_RECVED;
-						} else if(cur_seq->state == SEQ_MISSING && now - cur_seq->ts > SEQ_MISSING_WAIT) {
+				guint16 nacks[LAST_SEQS_MAX_LEN];
+				guint nacks_count = 0;
+				if(tracker->missing_count > 0) {
+					/* Scan the window from the oldest sequence number, so that NACKs are in order */
+					guint16 seqn = tracker->highest - tracker->count + 1;
+					guint16 i = 0;
+					for(i=0; i<tracker->count; i++, seqn++) {
+						if(!janus_ice_loss_bit_test(tracker->missing, seqn))
+							continue;
+						gint64 ts = tracker->ts[JANUS_ICE_LOSS_SLOT(seqn)];
+						if(!janus_ice_loss_bit_test(tracker->nacked, seqn) && now - ts > SEQ_MISSING_WAIT) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Missed sequence number %"SCNu16" (%s stream #%d), sending 1st NACK\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							nacks = g_slist_prepend(nacks, GUINT_TO_POINTER(cur_seq->seq));
-							cur_seq->state = SEQ_NACKED;
+								handle->handle_id, seqn, video ? "video" : "audio", vindex);
+							nacks[nacks_count++] = seqn;
+							janus_ice_loss_bit_set(tracker->nacked, seqn);
 							if(video && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
 								/* Keep track of this sequence number, we need to avoid duplicates */
 								JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Tracking NACKed packet %"SCNu16" (SSRC %"SCNu32", vindex %d)...\n",
-									handle->handle_id, cur_seq->seq, packet_ssrc, vindex);
+									handle->handle_id, seqn, packet_ssrc, vindex);
 								if(medium->rtx_nacked[vindex] == NULL)
 									medium->rtx_nacked[vindex] = g_hash_table_new(NULL, NULL);
-								g_hash_table_insert(medium->rtx_nacked[vindex], GUINT_TO_POINTER(cur_seq->seq), GINT_TO_POINTER(1));
+								g_hash_table_insert(medium->rtx_nacked[vindex], GUINT_TO_POINTER(seqn), GINT_TO_POINTER(1));
 								/* We don't track it forever, though: add a timed source to remove it in a few seconds */
 								janus_ice_nacked_packet *np = g_malloc(sizeof(janus_ice_nacked_packet));
 								np->medium = medium;
-								np->seq_number = cur_seq->seq;
+								np->seq_number = seqn;
 								np->vindex = vindex;
 								if(medium->pending_nacked_cleanup == NULL)
 									medium->pending_nacked_cleanup = g_hash_table_new(NULL, NULL);
@@ -3001,32 +5654,21 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 								g_source_unref(timeout_source);
 								g_hash_table_insert(medium->pending_nacked_cleanup, GUINT_TO_POINTER(np->source_id), timeout_source);
 							}
-						} else if(cur_seq->state == SEQ_NACKED  && now - cur_seq->ts > SEQ_NACKED_WAIT) {
+						} else if(janus_ice_loss_bit_test(tracker->nacked, seqn) && now - ts > SEQ_NACKED_WAIT) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Missed sequence number %"SCNu16" (%s stream #%d), sending 2nd NACK\n",
-								handle->handle_id, cur_seq->seq, video ? "video" : "audio", vindex);
-							nacks = g_slist_prepend(nacks, GUINT_TO_POINTER(cur_seq->seq));
-							cur_seq->state = SEQ_GIVEUP;
-						}
-						if(cur_seq == *last_seqs) {
-							/* Just processed head */
-							break;
+								handle->handle_id, seqn, video ? "video" : "audio", vindex);
+							nacks[nacks_count++] = seqn;
+							/* We give up on this one */
+							janus_ice_loss_tracker_forget(tracker, seqn);
 						}
-						cur_seq = cur_seq->prev;
 					}
 				}
-				while(last_seqs_len > LAST_SEQS_MAX_LEN) {
-					janus_seq_info *node = janus_seq_pop_head(last_seqs);
-					g_free(node);
-					last_seqs_len--;
-				}
-
-				guint nacks_count = g_slist_length(nacks);
 				if(nacks_count) {
 					/* Generate a NACK and send it */
 					JANUS_LOG(LOG_DBG, "[%"SCNu64"] Now sending NACK for %u missed packets (%s stream #%d)\n",
 						handle->handle_id, nacks_count, video ? "video" : "audio", vindex);
 					char nackbuf[120];
-					int res = janus_rtcp_nacks(nackbuf, sizeof(nackbuf), nacks);
+					int res = janus_rtcp_nacks_array(nackbuf, sizeof(nackbuf), nacks, nacks_count);
 					if(res > 0) {
 						/* Set the right local and remote SSRC in the RTCP packet */
 						janus_rtcp_fix_ssrc(NULL, nackbuf, res, 1,
@@ -3037,6 +5679,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					/* Update stats */
 					medium->nack_sent_recent_cnt += nacks_count;
 					medium->out_stats.info[vindex].nacks += nacks_count;
+					janus_metrics_add(JANUS_METRICS_NACKS_OUT, nacks_count);
 				}
 				if(medium->nack_sent_recent_cnt &&
 						(now - medium->nack_sent_log_ts) > 5*G_USEC_PER_SEC) {
@@ -3046,8 +5689,6 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					medium->nack_sent_log_ts = now;
 				}
 				janus_mutex_unlock(&medium->mutex);
-				g_slist_free(nacks);
-				nacks = NULL;
 			}
 		}
 		return;
@@ -3061,14 +5702,18 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 			srtp_err_status_t res = janus_is_webrtc_encryption_enabled() ?
 				srtp_unprotect_rtcp(pc->dtls->srtp_in, buf, &buflen) : srtp_err_status_ok;
 			if(res != srtp_err_status_ok) {
+				janus_metrics_inc(JANUS_METRICS_SRTP_ERRORS_IN);
 				JANUS_LOG(LOG_ERR, "[%"SCNu64"]     SRTCP unprotect error: %s (len=%d-->%d)\n", handle->handle_id, janus_srtp_error_str(res), len, buflen);
 			} else {
 				/* Do we need to dump this packet for debugging? */
 				if(g_atomic_int_get(&handle->dump_packets))
 					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, TRUE, buf, buflen,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
+				/* Traverse the compound packet once to see what's in there */
+				janus_rtcp_summary summary;
+				janus_rtcp_summarize(buf, buflen, &summary);
 				/* Check if there's an RTCP BYE: in case, let's log it */
-				if(janus_rtcp_has_bye(buf, buflen)) {
+				if(summary.has_bye) {
 					/* Note: we used to use this as a trigger to close the PeerConnection, but not anymore
 					 * Discussion here, https://groups.google.com/forum/#!topic/meetecho-janus/4XtfbYB7Jvc */
 					JANUS_LOG(LOG_VERB, "[%"SCNu64"] Got RTCP BYE on stream %u (component %u)\n", handle->handle_id, stream_id, component_id);
@@ -3076,13 +5721,13 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				/* Is this audio or video? */
 				int video = 0, vindex = 0;
 				/* Bundled streams, should we check the SSRCs? */
-				guint32 rtcp_ssrc = janus_rtcp_get_sender_ssrc(buf, buflen);
+				guint32 rtcp_ssrc = summary.sender_ssrc;
 				janus_ice_peerconnection_medium *medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(rtcp_ssrc));
 				if(medium == NULL) {
 					/* We don't know the remote SSRC: this can happen for recvonly clients
 					 * (see https://groups.google.com/forum/#!topic/discuss-webrtc/5yuZjV7lkNc)
 					 * Check the local SSRC, compare it to what we have */
-					rtcp_ssrc = janus_rtcp_get_receiver_ssrc(buf, buflen);
+					rtcp_ssrc = summary.receiver_ssrc;
 					medium = g_hash_table_lookup(pc->media_byssrc, GINT_TO_POINTER(rtcp_ssrc));
 					if(medium == NULL) {
 						if(rtcp_ssrc > 0) {
@@ -3092,7 +5737,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 						return;
 					}
 				}
-				if(janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
+				if(summary.report_blocks > 0 && janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
 					janus_rtcp_swap_report_blocks(buf, buflen, medium->ssrc_rtx);
 				}
 				video = (medium->type == JANUS_MEDIA_VIDEO);
@@ -3130,44 +5775,69 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 				}
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] Got %s RTCP (%d bytes)\n", handle->handle_id, video ? "video" : "audio", buflen);
 				/* See if there's any REMB bitrate to track */
-				uint32_t bitrate = janus_rtcp_get_remb(buf, buflen);
-				if(bitrate > 0)
-					pc->remb_bitrate = bitrate;
+				if(summary.has_pli || summary.has_fir)
+					janus_metrics_inc(JANUS_METRICS_PLIS_IN);
+				if(summary.remb > 0)
+					pc->remb_bitrate = summary.remb;
+				/* If we have a bandwidth estimator, feed it any transport wide cc feedback */
+				if(pc->bwe != NULL && summary.twcc > 0 &&
+						janus_rtcp_get_transport_cc(buf, buflen, janus_ice_bwe_feedback, pc->bwe) > 0 &&
+						janus_bwe_context_update(pc->bwe, janus_get_monotonic_time_cached())) {
+					/* The estimate changed enough, tell the plugin */
+					janus_plugin *plugin = (janus_plugin *)handle->app;
+					if(plugin && plugin->estimated_bandwidth && janus_plugin_session_is_alive(handle->app_handle) &&
+							!g_atomic_int_get(&handle->destroyed))
+						plugin->estimated_bandwidth(handle->app_handle, pc->bwe->estimate);
+				}
 
 				/* Now let's see if there are any NACKs to handle */
-				gint64 now = janus_get_monotonic_time();
-				GSList *nacks = janus_rtcp_get_nacks(buf, buflen);
-				guint nacks_count = g_slist_length(nacks);
+				gint64 now = janus_get_monotonic_time_cached();
+				guint16 nacks[MAX_NACKED_SEQS];
+				int nacks_res = summary.has_nacks ? janus_rtcp_get_nacks_array(buf, buflen, nacks, MAX_NACKED_SEQS) : 0;
+				guint nacks_count = nacks_res > 0 ? nacks_res : 0;
 				if(nacks_count && medium->do_nacks) {
 					/* Handle NACK */
 					JANUS_LOG(LOG_HUGE, "[%"SCNu64"]     Just got some NACKS (%d) we should handle...\n", handle->handle_id, nacks_count);
-					GHashTable *retransmit_seqs = medium->retransmit_seqs;
-					GSList *list = (retransmit_seqs != NULL ? nacks : NULL);
+					janus_ice_retransmit_ring *retransmit_ring = medium->retransmit_ring;
+					guint nacks_handled = (retransmit_ring != NULL ? nacks_count : 0);
 					int retransmits_cnt = 0;
+					/* Duplicate NACKs are ignored for at least one RTT after a retransmission */
+					gint64 ignore = MAX_NACK_IGNORE;
+					gint64 rtt = (gint64)janus_rtcp_context_get_rtt(rtcp_ctx) * 1000;
+					if(rtt + rtt/4 > ignore)
+						ignore = rtt + rtt/4;
+					gint64 budget = janus_ice_retransmit_budget_update(pc, now);
 					janus_mutex_lock(&medium->mutex);
-					while(list) {
-						unsigned int seqnr = GPOINTER_TO_UINT(list->data);
+					guint i = 0;
+					for(i=0; i<nacks_handled; i++) {
+						unsigned int seqnr = nacks[i];
 						JANUS_LOG(LOG_DBG, "[%"SCNu64"]   >> %u\n", handle->handle_id, seqnr);
 						int in_rb = 0;
 						/* Check if we have the packet */
-						janus_rtp_packet *p = g_hash_table_lookup(retransmit_seqs, GUINT_TO_POINTER(seqnr));
+						janus_rtp_packet *p = janus_ice_retransmit_ring_lookup(retransmit_ring, seqnr);
 						if(p == NULL) {
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Can't retransmit packet %u, we don't have it...\n", handle->handle_id, seqnr);
 						} else {
 							/* Should we retransmit this packet? */
-							if((p->last_retransmit > 0) && (now-p->last_retransmit < MAX_NACK_IGNORE)) {
+							if((p->last_retransmit > 0) && (now-p->last_retransmit < ignore)) {
 								JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Packet %u was retransmitted just %"SCNi64"ms ago, skipping\n", handle->handle_id, seqnr, now-p->last_retransmit);
-								list = list->next;
+								pc->retransmit_duplicates++;
+								continue;
+							}
+							if(budget >= 0 && pc->retransmit_budget < p->length) {
+								JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> No budget to retransmit packet %u, skipping\n", handle->handle_id, seqnr);
+								pc->retransmit_denied++;
 								continue;
 							}
+							if(budget >= 0)
+								pc->retransmit_budget -= p->length;
 							in_rb = 1;
 							JANUS_LOG(LOG_HUGE, "[%"SCNu64"]   >> >> Scheduling %u for retransmission due to NACK\n", handle->handle_id, seqnr);
 							p->last_retransmit = now;
 							retransmits_cnt++;
 							/* Enqueue it */
-							janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+							janus_ice_queued_packet *pkt = janus_ice_queued_packet_new(handle, p->length+SRTP_MAX_TAG_LEN);
 							pkt->mindex = medium->mindex;
-							pkt->data = g_malloc(p->length+SRTP_MAX_TAG_LEN);
 							memcpy(pkt->data, p->data, p->length);
 							pkt->length = p->length;
 							pkt->type = video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
@@ -3176,7 +5846,7 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 							pkt->retransmission = TRUE;
 							pkt->label = NULL;
 							pkt->protocol = NULL;
-							pkt->added = janus_get_monotonic_time();
+							pkt->added = janus_get_monotonic_time_cached();
 							/* What to send and how depends on whether we're doing RFC4588 or not */
 							if(!video || !janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
 								/* We're not: just clarify the packet was already encrypted before */
@@ -3190,30 +5860,21 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 								medium->rtx_seq_number++;
 								header->seq_number = htons(medium->rtx_seq_number);
 							}
-							if(handle->queued_packets != NULL) {
-#if GLIB_CHECK_VERSION(2, 46, 0)
-								g_async_queue_push_front(handle->queued_packets, pkt);
-#else
-								g_async_queue_push(handle->queued_packets, pkt);
-#endif
-								g_main_context_wakeup(handle->mainctx);
-							} else {
-								janus_ice_free_queued_packet(pkt);
-							}
+							/* Retransmissions have a lane of their own, after RTCP and audio */
+							janus_ice_queue_packet(handle, pkt);
 						}
 						if(rtcp_ctx != NULL && in_rb) {
 							g_atomic_int_inc(&rtcp_ctx->nack_count);
 						}
-						list = list->next;
 					}
 					medium->retransmit_recent_cnt += retransmits_cnt;
+					janus_metrics_add(JANUS_METRICS_RETRANSMISSIONS, retransmits_cnt);
 					/* FIXME Remove the NACK compound packet, we've handled it */
 					buflen = janus_rtcp_remove_nacks(buf, buflen);
 					/* Update stats */
 					medium->in_stats.info[vindex].nacks += nacks_count;
+					janus_metrics_add(JANUS_METRICS_NACKS_IN, nacks_count);
 					janus_mutex_unlock(&medium->mutex);
-					g_slist_free(nacks);
-					nacks = NULL;
 				}
 				if(medium->retransmit_recent_cnt &&
 						now - medium->retransmit_log_ts > 5*G_USEC_PER_SEC) {
@@ -3237,7 +5898,9 @@ static void janus_ice_cb_nice_recv(NiceAgent *agent, guint stream_id, guint comp
 					return;
 				}
 
-				janus_plugin_rtcp rtcp = { .mindex = medium->mindex, .video = video, .buffer = buf, .length = buflen };
+				/* Pass the summary along, so that the plugin doesn't need to parse the packet again */
+				janus_plugin_rtcp rtcp = { .mindex = medium->mindex, .video = video, .buffer = buf, .length = buflen,
+					.summarized = TRUE, .has_pli = summary.has_pli, .has_fir = summary.has_fir, .remb = summary.remb };
 				janus_plugin *plugin = (janus_plugin *)handle->app;
 				if(plugin && plugin->incoming_rtcp && handle->app_handle &&
 						!g_atomic_int_get(&handle->app_handle->stopped) &&
@@ -3416,20 +6079,8 @@ static int janus_ice_candidate_to_string(janus_ice_handle *handle, NiceCandidate
 		}
 	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"]     %s\n", handle->handle_id, buffer);
-	if(log_candidate) {
-		/* Save for the summary, in case we need it */
-		pc->local_candidates = g_slist_append(pc->local_candidates, g_strdup(buffer));
-		/* Notify event handlers */
-		if(janus_events_is_enabled()) {
-			janus_session *session = (janus_session *)handle->session;
-			json_t *info = json_object();
-			json_object_set_new(info, "local-candidate", json_string(buffer));
-			json_object_set_new(info, "stream_id", json_integer(pc->stream_id));
-			json_object_set_new(info, "component_id", json_integer(pc->component_id));
-			janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_LCAND,
-				session->session_id, handle->handle_id, handle->opaque_id, info);
-		}
-	}
+	if(log_candidate)
+		janus_ice_local_candidate_notify(handle, pc, buffer);
 	return 0;
 }
 
@@ -3442,12 +6093,31 @@ void janus_ice_candidates_to_sdp(janus_ice_handle *handle, janus_sdp_mline *mlin
 		return;
 	}
 	NiceAgent *agent = handle->agent;
+	gboolean log_candidates = (pc->local_candidates == NULL);
+	/* In single-port mode, all PeerConnections on a loop have the same candidates */
+	janus_ice_static_event_loop *loop = (janus_ice_static_event_loop *)pc->mux;
+	GPtrArray *prebuilt = loop ? janus_ice_mux_prebuilt_candidates(loop, component_id, NULL) : NULL;
+	if(prebuilt != NULL) {
+		guint pi = 0;
+		for(pi=0; pi<prebuilt->len; pi++) {
+			const char *candidate = (const char *)g_ptr_array_index(prebuilt, pi);
+			janus_sdp_attribute *a = janus_sdp_attribute_create("candidate", "%s", candidate);
+			mline->attributes = g_list_append(mline->attributes, a);
+			if(log_candidates)
+				janus_ice_local_candidate_notify(handle, pc, candidate);
+		}
+		g_ptr_array_unref(prebuilt);
+		return;
+	}
+	GPtrArray *built = loop ? g_ptr_array_new_with_free_func((GDestroyNotify)g_free) : NULL;
 	/* Iterate on all */
 	gchar buffer[200];
 	GSList *candidates, *i;
-	candidates = nice_agent_get_local_candidates (agent, stream_id, component_id);
+	if(loop != NULL)
+		candidates = janus_ice_mux_local_candidates(pc, component_id);
+	else
+		candidates = nice_agent_get_local_candidates (agent, stream_id, component_id);
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] We have %d candidates for Stream #%d, Component #%d\n", handle->handle_id, g_slist_length(candidates), stream_id, component_id);
-	gboolean log_candidates = (pc->local_candidates == NULL);
 	for(i = candidates; i; i = i->next) {
 		NiceCandidate *c = (NiceCandidate *) i->data;
 		gboolean ipv6 = (nice_address_ip_version(&c->addr) == 6);
@@ -3462,6 +6132,8 @@ void janus_ice_candidates_to_sdp(janus_ice_handle *handle, janus_sdp_mline *mlin
 					if(strlen(buffer) > 0) {
 						janus_sdp_attribute *a = janus_sdp_attribute_create("candidate", "%s", buffer);
 						mline->attributes = g_list_append(mline->attributes, a);
+						if(built != NULL)
+							g_ptr_array_add(built, g_strdup(buffer));
 					}
 					if(nat_1_1_enabled && public_ip_index == 0 && (keep_private_host || !same_family) &&
 							janus_ice_candidate_to_string(handle, c, buffer, sizeof(buffer), log_candidates, TRUE, public_ip_index) == 0) {
@@ -3471,6 +6143,8 @@ void janus_ice_candidates_to_sdp(janus_ice_handle *handle, janus_sdp_mline *mlin
 						} else if(strlen(buffer) > 0) {
 							janus_sdp_attribute *a = janus_sdp_attribute_create("candidate", "%s", buffer);
 							mline->attributes = g_list_append(mline->attributes, a);
+							if(built != NULL)
+								g_ptr_array_add(built, g_strdup(buffer));
 						}
 					}
 				}
@@ -3485,6 +6159,11 @@ void janus_ice_candidates_to_sdp(janus_ice_handle *handle, janus_sdp_mline *mlin
 	}
 	/* Done */
 	g_slist_free(candidates);
+	if(built != NULL) {
+		/* Keep the encoded candidates for the next PeerConnections on this loop */
+		janus_ice_mux_prebuilt_candidates(loop, component_id, built);
+		g_ptr_array_unref(built);
+	}
 }
 
 void janus_ice_add_remote_candidate(janus_ice_handle *handle, NiceCandidate *c) {
@@ -3551,6 +6230,12 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 		return -2;
 	}
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Setting ICE locally: got %s\n", handle->handle_id, offer ? "OFFER" : "ANSWER");
+	/* The ICE agent can't move once it's created, so if the handle should be on another loop, we move it now */
+	janus_ice_handle_check_migration(handle);
+	/* In single-port mode, PeerConnections on shared loops use the socket of the loop */
+	janus_ice_static_event_loop *mux = (janus_ice_static_event_loop *)handle->static_event_loop;
+	if(single_port == 0 || mux == NULL || mux->dedicated || mux->mux_port == 0)
+		mux = NULL;
 	g_atomic_int_set(&handle->closepc, 0);
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_HAS_AGENT);
 	janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_START);
@@ -3611,10 +6296,7 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 	 * by default, and fall back to the session_id when it's missing. Refer to this
 	 * issue for more context: https://github.com/meetecho/janus-gateway/issues/2199 */
 	char turnrest_username[20];
-	if(handle->opaque_id == NULL) {
-		janus_session *session = (janus_session *)handle->session;
-		g_snprintf(turnrest_username, sizeof(turnrest_username), "%"SCNu64, session->session_id);
-	}
+	janus_ice_turnrest_username(handle, turnrest_username, sizeof(turnrest_username));
 	janus_turnrest_response *turnrest_credentials = janus_turnrest_request((const char *)(handle->opaque_id ?
 		handle->opaque_id : turnrest_username));
 	if(turnrest_credentials != NULL) {
@@ -3659,61 +6341,15 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 #endif
 		G_CALLBACK (janus_ice_cb_new_remote_candidate), handle);
 
-	/* Add all local addresses, except those in the ignore list */
-	struct ifaddrs *ifaddr, *ifa;
-	int family, s, n;
-	char host[NI_MAXHOST];
-	if(getifaddrs(&ifaddr) == -1) {
-		JANUS_LOG(LOG_ERR, "[%"SCNu64"] Error getting list of interfaces... %d (%s)\n",
-			handle->handle_id, errno, g_strerror(errno));
-	} else {
-		for(ifa = ifaddr, n = 0; ifa != NULL; ifa = ifa->ifa_next, n++) {
-			if(ifa->ifa_addr == NULL)
-				continue;
-			/* Skip interfaces which are not up and running */
-			if(!((ifa->ifa_flags & IFF_UP) && (ifa->ifa_flags & IFF_RUNNING)))
-				continue;
-			/* Skip loopback interfaces */
-			if(ifa->ifa_flags & IFF_LOOPBACK)
-				continue;
-			family = ifa->ifa_addr->sa_family;
-			if(family != AF_INET && family != AF_INET6)
-				continue;
-			/* We only add IPv6 addresses if support for them has been explicitly enabled */
-			if(family == AF_INET6 && !janus_ipv6_enabled)
-				continue;
-			/* Check the interface name first, we can ignore that as well: enforce list would be checked later */
-			if(janus_ice_enforce_list == NULL && ifa->ifa_name != NULL && janus_ice_is_ignored(ifa->ifa_name))
-				continue;
-			s = getnameinfo(ifa->ifa_addr,
-					(family == AF_INET) ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6),
-					host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
-			if(s != 0) {
-				JANUS_LOG(LOG_ERR, "[%"SCNu64"] getnameinfo() failed: %s\n", handle->handle_id, gai_strerror(s));
-				continue;
-			}
-			/* Skip 0.0.0.0, :: and, unless otherwise configured, local scoped addresses  */
-			if(!strcmp(host, "0.0.0.0") || !strcmp(host, "::") || (!janus_ipv6_linklocal_enabled && !strncmp(host, "fe80:", 5)))
-				continue;
-			/* Check if this IP address is in the ignore/enforce list: the enforce list has the precedence but the ignore list can then discard candidates */
-			if(janus_ice_enforce_list != NULL) {
-				if(ifa->ifa_name != NULL && !janus_ice_is_enforced(ifa->ifa_name) && !janus_ice_is_enforced(host))
-					continue;
-			}
-			if(janus_ice_is_ignored(host))
-				continue;
-			/* Ok, add interface to the ICE agent */
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Adding %s to the addresses to gather candidates for\n", handle->handle_id, host);
-			NiceAddress addr_local;
-			nice_address_init (&addr_local);
-			if(!nice_address_set_from_string (&addr_local, host)) {
-				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Skipping invalid address %s\n", handle->handle_id, host);
-				continue;
-			}
-			nice_agent_add_local_address (handle->agent, &addr_local);
-		}
-		freeifaddrs(ifaddr);
-	}
+	/* Add all local addresses, except those in the ignore list (unless we're
+	 * in single-port mode, where there's nothing to gather): we enumerate them
+	 * only when they change, rather than for each new PeerConnection */
+	GArray *addresses = mux ? NULL : janus_ice_local_addresses_get();
+	guint ai = 0;
+	for(ai=0; addresses != NULL && ai<addresses->len; ai++)
+		nice_agent_add_local_address(handle->agent, &g_array_index(addresses, NiceAddress, ai));
+	if(addresses != NULL)
+		g_array_unref(addresses);
 
 	handle->cdone = 0;
 	handle->stream_id = 0;
@@ -3769,10 +6405,16 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 	pc->media_bytype = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_ice_peerconnection_medium_dereference);
 #ifdef HAVE_PORTRANGE
 	/* FIXME: libnice supports this since 0.1.0, but the 0.1.3 on Fedora fails with an undefined reference! */
-	nice_agent_set_port_range(handle->agent, handle->stream_id, 1, rtp_range_min, rtp_range_max);
+	if(mux == NULL)
+		nice_agent_set_port_range(handle->agent, handle->stream_id, 1, rtp_range_min, rtp_range_max);
 #endif
-	/* Gather now only if we're doing hanf-trickle */
-	if(!janus_full_trickle_enabled && !nice_agent_gather_candidates(handle->agent, handle->stream_id)) {
+	/* Gather now only if we're doing hanf-trickle, and not using the socket of the loop */
+	if(mux != NULL) {
+		/* Single-port mode: there's nothing to gather, the peer will reach us on the shared socket */
+		janus_refcount_increase(&mux->ref);
+		pc->mux = mux;
+		janus_ice_mux_register(handle, pc);
+	} else if(!janus_full_trickle_enabled && !nice_agent_gather_candidates(handle->agent, handle->stream_id)) {
 #ifdef HAVE_TURNRESTAPI
 		if(turnrest_credentials != NULL) {
 			janus_turnrest_response_destroy(turnrest_credentials);
@@ -3784,8 +6426,10 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 		janus_ice_webrtc_hangup(handle, "Gathering error");
 		return -1;
 	}
-	nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context(handle->mainloop),
-		janus_ice_cb_nice_recv, pc);
+	if(mux == NULL) {
+		nice_agent_attach_recv(handle->agent, handle->stream_id, 1, g_main_loop_get_context(handle->mainloop),
+			janus_ice_cb_nice_recv, pc);
+	}
 #ifdef HAVE_TURNRESTAPI
 	if(turnrest_credentials != NULL) {
 		janus_turnrest_response_destroy(turnrest_credentials);
@@ -3802,6 +6446,9 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 		return -1;
 	}
 	janus_refcount_increase(&pc->dtls->ref);
+	/* In single-port mode, we have our only candidate already */
+	if(mux != NULL)
+		janus_ice_cb_candidate_gathering_done(handle->agent, handle->stream_id, handle);
 	/* If we're doing full-tricke, start gathering asynchronously */
 	if(janus_full_trickle_enabled) {
 #if GLIB_CHECK_VERSION(2, 46, 0)
@@ -3817,9 +6464,14 @@ int janus_ice_setup_local(janus_ice_handle *handle, gboolean offer, gboolean tri
 void janus_ice_restart(janus_ice_handle *handle) {
 	if(!handle || !handle->agent || !handle->pc)
 		return;
+	/* New pairs will be checked, so let libnice read from all sockets again */
+	janus_ice_recv_batch_stop(handle, handle->pc, TRUE);
 	/* Restart ICE */
 	if(nice_agent_restart(handle->agent) == FALSE) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] ICE restart failed...\n", handle->handle_id);
+	} else if(handle->pc->mux != NULL) {
+		/* libnice generated new credentials, so the shared socket needs to know */
+		janus_ice_mux_register(handle, handle->pc);
 	}
 	janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ICE_RESTART);
 }
@@ -3865,15 +6517,76 @@ void janus_ice_resend_trickles(janus_ice_handle *handle) {
 	janus_ice_notify_trickle(handle, NULL);
 }
 
+/* Get the precompiled layout of the extensions we always add, (re)building it if the negotiation changed */
+static janus_ice_extension_plan *janus_ice_extension_plan_get(janus_ice_peerconnection *pc,
+		janus_ice_peerconnection_medium *medium, gboolean video) {
+	janus_ice_extension_plan *plan = &medium->extension_plan;
+	if(plan->ready && plan->video == video && plan->mid == medium->mid && plan->mid_ext_id == pc->mid_ext_id &&
+			plan->abs_send_time_ext_id == pc->abs_send_time_ext_id &&
+			plan->transport_wide_cc_ext_id == pc->transport_wide_cc_ext_id)
+		return plan;
+	plan->video = video;
+	plan->mid = medium->mid;
+	plan->mid_ext_id = pc->mid_ext_id;
+	plan->abs_send_time_ext_id = pc->abs_send_time_ext_id;
+	plan->transport_wide_cc_ext_id = pc->transport_wide_cc_ext_id;
+	plan->abs_send_time_offset = -1;
+	plan->transport_wide_cc_offset = -1;
+	memset(plan->data, 0, sizeof(plan->data));
+	char *index = plan->data;
+	if(video && pc->abs_send_time_ext_id > 0) {
+		*index = (pc->abs_send_time_ext_id << 4) + 2;
+		plan->abs_send_time_offset = (index + 1) - plan->data;
+		index += 4;
+	}
+	if(video && pc->transport_wide_cc_ext_id > 0) {
+		*index = (pc->transport_wide_cc_ext_id << 4) + 1;
+		plan->transport_wide_cc_offset = (index + 1) - plan->data;
+		index += 3;
+	}
+	if(pc->mid_ext_id > 0 && medium->mid != NULL) {
+		size_t midlen = strlen(medium->mid) & 0x0F;
+		*index = (pc->mid_ext_id << 4) + (midlen ? midlen-1 : 0);
+		memcpy(index+1, medium->mid, midlen);
+		index += (midlen + 1);
+	}
+	plan->length = index - plan->data;
+	plan->ready = TRUE;
+	return plan;
+}
+
+/* Get the next transport-wide sequence number, and keep track of the packet for the bandwidth estimation */
+static uint16_t janus_ice_transport_wide_cc_next(janus_ice_handle *handle, uint16_t size) {
+	handle->pc->transport_wide_cc_out_seq_num++;
+	if(handle->pc->bwe == NULL) {
+		/* Only estimate the bandwidth if we pace or the plugin wants to know about it */
+		janus_plugin *plugin = (janus_plugin *)handle->app;
+		if(pacing_enabled || (plugin && plugin->estimated_bandwidth))
+			handle->pc->bwe = janus_bwe_context_create();
+	}
+	if(handle->pc->bwe != NULL) {
+		janus_bwe_context_packet_sent(handle->pc->bwe, handle->pc->transport_wide_cc_out_seq_num,
+			size, janus_get_monotonic_time_cached());
+	}
+	return htons(handle->pc->transport_wide_cc_out_seq_num);
+}
+
 static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_peerconnection_medium *medium, janus_ice_queued_packet *packet) {
 	if(handle == NULL || handle->pc == NULL || medium == NULL || packet == NULL || packet->data == NULL)
 		return;
 	uint16_t totlen = RTP_HEADER_SIZE;
 	/* Check how large the payload is */
 	int plen = 0;
-	char *payload = janus_rtp_payload(packet->data, packet->length, &plen);
-	if(payload != NULL)
+	char *payload = NULL;
+	if(packet->shared != NULL) {
+		/* The payload is in the shared copy, we'll only copy it once at the end */
+		plen = packet->shared->length - packet->shared_offset;
 		totlen += plen;
+	} else {
+		payload = janus_rtp_payload(packet->data, packet->length, &plen);
+		if(payload != NULL)
+			totlen += plen;
+	}
 	/* We need to strip extensions, here, and add those that need to be there manually */
 	uint16_t extlen = 0;
 	char extensions[300];
@@ -3892,15 +6605,31 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 		gboolean use_2byte = (video && packet->extensions.dd_len > 16 && handle->pc->dependencydesc_ext_id > 0);
 		/* Write the extension(s) */
 		header->extension = 1;
-		memset(extensions, 0, sizeof(extensions));
 		janus_rtp_header_extension *extheader = (janus_rtp_header_extension *)extensions;
 		extheader->type = htons(use_2byte ? 0x1000 : 0xBEDE);
 		extheader->length = 0;
 		/* Iterate on all extensions we need */
 		char *index = extensions + 4;
 		extbufsize -= 4;
+		/* The extensions we always add have a fixed layout, unless we need 2-byte extensions */
+		janus_ice_extension_plan *plan = use_2byte ? NULL : janus_ice_extension_plan_get(handle->pc, medium, video);
+		if(plan != NULL) {
+			memcpy(index, plan->data, plan->length);
+			if(plan->abs_send_time_offset >= 0) {
+				int64_t now = (((janus_get_monotonic_time()/1000) << 18) + 500) / 1000;
+				uint32_t abs24 = htonl((uint32_t)now & 0x00FFFFFF) >> 8;
+				memcpy(index + plan->abs_send_time_offset, &abs24, 3);
+			}
+			if(plan->transport_wide_cc_offset >= 0) {
+				uint16_t transSeqNum = janus_ice_transport_wide_cc_next(handle, totlen);
+				memcpy(index + plan->transport_wide_cc_offset, &transSeqNum, 2);
+			}
+			index += plan->length;
+			extlen += plan->length;
+			extbufsize -= plan->length;
+		}
 		/* Check if we need to add the abs-send-time extension */
-		if(video && handle->pc->abs_send_time_ext_id > 0) {
+		if(plan == NULL && video && handle->pc->abs_send_time_ext_id > 0) {
 			int64_t now = (((janus_get_monotonic_time()/1000) << 18) + 500) / 1000;
 			uint32_t abs_ts = (uint32_t)now & 0x00FFFFFF;
 			uint32_t abs24 = htonl(abs_ts) >> 8;
@@ -3920,9 +6649,8 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 			}
 		}
 		/* Check if we need to add the transport-wide CC extension */
-		if(video && handle->pc->transport_wide_cc_ext_id > 0) {
-			handle->pc->transport_wide_cc_out_seq_num++;
-			uint16_t transSeqNum = htons(handle->pc->transport_wide_cc_out_seq_num);
+		if(plan == NULL && video && handle->pc->transport_wide_cc_ext_id > 0) {
+			uint16_t transSeqNum = janus_ice_transport_wide_cc_next(handle, totlen);
 			if(!use_2byte) {
 				*index = (handle->pc->transport_wide_cc_ext_id << 4) + 1;
 				memcpy(index+1, &transSeqNum, 2);
@@ -4016,7 +6744,7 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 			}
 		}
 		/* Check if we need to add the mid extension */
-		if(handle->pc->mid_ext_id > 0) {
+		if(plan == NULL && handle->pc->mid_ext_id > 0) {
 			char *mid = medium->mid;
 			if(mid != NULL) {
 				if(!use_2byte) {
@@ -4070,19 +6798,33 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 				}
 			}
 		}
-		/* Calculate the whole length */
+		/* Calculate the whole length, and zero the padding */
 		uint16_t words = extlen/4;
 		if(extlen%4 != 0)
 			words++;
+		memset(extensions + 4 + extlen, 0, words*4 - extlen);
 		extheader->length = htons(words);
 		/* Update lengths (taking into account the RFC5285 header) */
 		extlen = 4 + (words*4);
 		totlen += extlen;
 	}
+	if(packet->shared != NULL) {
+		/* Copy the payload from the shared copy right where it needs to be */
+		janus_ice_queued_packet_resize(packet, totlen + SRTP_MAX_TAG_LEN);
+		if(extlen > 0)
+			memcpy(packet->data + RTP_HEADER_SIZE, extensions, extlen);
+		if(plen > 0)
+			memcpy(packet->data + RTP_HEADER_SIZE + extlen, packet->shared->buffer + packet->shared_offset, plen);
+		janus_refcount_decrease(&packet->shared->ref);
+		packet->shared = NULL;
+		packet->shared_offset = 0;
+		packet->length = totlen;
+		return;
+	}
 	/* Check if we need to resize this packet buffer first */
 	uint16_t payload_start = payload ? (payload - packet->data) : 0;
 	if(packet->length < totlen)
-		packet->data = g_realloc(packet->data, totlen + SRTP_MAX_TAG_LEN);
+		janus_ice_queued_packet_resize(packet, totlen + SRTP_MAX_TAG_LEN);
 	/* Now check if we need to move the payload */
 	payload = payload_start ? (packet->data + payload_start) : NULL;
 	if(payload != NULL && plen > 0 && packet->length != totlen)
@@ -4095,9 +6837,6 @@ static void janus_ice_rtp_extension_update(janus_ice_handle *handle, janus_ice_p
 	packet->length = totlen;
 }
 
-static gint rtcp_transport_wide_cc_stats_comparator(gconstpointer item1, gconstpointer item2) {
-	return ((rtcp_transport_wide_cc_stats*)item1)->transport_seq_num - ((rtcp_transport_wide_cc_stats*)item2)->transport_seq_num;
-}
 static gboolean janus_ice_outgoing_transport_wide_cc_feedback(gpointer user_data) {
 	janus_ice_handle *handle = (janus_ice_handle *)user_data;
 	janus_ice_peerconnection *pc = handle->pc;
@@ -4141,90 +6880,81 @@ static gboolean janus_ice_outgoing_transport_wide_cc_feedback(gpointer user_data
 		/* Create a transport wide feedback message */
 		size_t size = 1300;
 		char rtcpbuf[1300];
-		/* Order packet list */
-		pc->transport_wide_received_seq_nums = g_slist_sort(pc->transport_wide_received_seq_nums,
-			rtcp_transport_wide_cc_stats_comparator);
-		/* Create full stats queue */
-		GQueue *packets = g_queue_new();
-		/* For all packets */
-		GSList *it = NULL;
-		for(it = pc->transport_wide_received_seq_nums; it; it = it->next) {
-			/* Get stat */
-			janus_rtcp_transport_wide_cc_stats *stats = (janus_rtcp_transport_wide_cc_stats *)it->data;
-			/* Get transport seq */
-			guint32 transport_seq_num = stats->transport_seq_num;
-			/* Check if it is an out of order  */
-			if(transport_seq_num < pc->transport_wide_cc_last_feedback_seq_num) {
-				/* Skip, it was already reported as lost */
-				g_free(stats);
-				continue;
-			}
-			/* If not first */
-			if(pc->transport_wide_cc_last_feedback_seq_num) {
-				/* For each lost */
-				guint32 i = 0;
-				for(i = pc->transport_wide_cc_last_feedback_seq_num+1; i<transport_seq_num; ++i) {
-					/* Create new stat */
-					janus_rtcp_transport_wide_cc_stats *missing = g_malloc(sizeof(janus_rtcp_transport_wide_cc_stats));
-					/* Add missing packet */
-					missing->transport_seq_num = i;
-					missing->timestamp = 0;
-					/* Add it */
-					g_queue_push_tail(packets, missing);
-				}
-			}
-			/* Store last */
-			pc->transport_wide_cc_last_feedback_seq_num = transport_seq_num;
-			/* Add this one */
-			g_queue_push_tail(packets, stats);
-		}
-		/* Free and reset stats list */
-		g_slist_free(pc->transport_wide_received_seq_nums);
-		pc->transport_wide_received_seq_nums = NULL;
-		/* Create and enqueue RTCP packets */
-		guint packets_len = 0;
-		while((packets_len = g_queue_get_length(packets)) > 0) {
-			GQueue *packets_to_process;
-			/* If we have more than 400 packets to acknowledge, let's send more than one message */
-			if(packets_len > 400) {
-				/* Split the queue into two */
-				GList *new_head = g_queue_peek_nth_link(packets, 400);
-				GList *new_tail = new_head->prev;
-				new_head->prev = NULL;
-				new_tail->next = NULL;
-				packets_to_process = g_queue_new();
-				packets_to_process->head = packets->head;
-				packets_to_process->tail = new_tail;
-				packets_to_process->length = 400;
-				packets->head = new_head;
-				/* packets->tail is unchanged */
-				packets->length = packets_len - 400;
-			} else {
-				packets_to_process = packets;
+		/* Check which packets we need to report on: all the ones following
+		 * those we reported last time, up to the most recent one we got */
+		janus_mutex_lock(&pc->mutex);
+		janus_ice_twcc_window *window = pc->transport_wide_received;
+		if(window == NULL || window->pending == 0) {
+			janus_mutex_unlock(&pc->mutex);
+			return G_SOURCE_CONTINUE;
+		}
+		guint32 first = pc->transport_wide_cc_last_feedback_seq_num ?
+			pc->transport_wide_cc_last_feedback_seq_num+1 : window->lowest;
+		guint32 last = window->highest;
+		/* Packets too old to still be in the window are reported as lost */
+		if(last - first >= JANUS_ICE_TWCC_WINDOW)
+			first = last - JANUS_ICE_TWCC_WINDOW + 1;
+		pc->transport_wide_cc_last_feedback_seq_num = last;
+		window->pending = 0;
+		/* Create and enqueue RTCP packets: if we have more than
+		 * JANUS_RTCP_TWCC_MAX_PACKETS to acknowledge, we send more than one */
+		guint64 timestamps[JANUS_RTCP_TWCC_MAX_PACKETS];
+		guint32 seq = first;
+		while(seq <= last && seq >= first) {
+			guint count = 0;
+			guint16 base_seq_num = seq;
+			while(count < JANUS_RTCP_TWCC_MAX_PACKETS && seq <= last && seq >= first) {
+				guint index = seq & (JANUS_ICE_TWCC_WINDOW-1);
+				timestamps[count++] = window->seqs[index] == seq ? window->timestamps[index] : 0;
+				window->timestamps[index] = 0;
+				seq++;
 			}
 			/* Get feedback packet count and increase it for next one */
 			guint8 feedback_packet_count = pc->transport_wide_cc_feedback_count++;
 			/* Create RTCP packet */
 			int len = janus_rtcp_transport_wide_cc_feedback(rtcpbuf, size,
-				medium->ssrc, ssrc_peer, feedback_packet_count, packets_to_process);
+				medium->ssrc, ssrc_peer, feedback_packet_count, base_seq_num, timestamps, count);
 			/* Enqueue it, we'll send it later */
 			if(len > 0) {
 				janus_plugin_rtcp rtcp = { .mindex = medium->mindex, .video = TRUE, .buffer = rtcpbuf, .length = len };
 				janus_ice_relay_rtcp_internal(handle, medium, &rtcp, FALSE);
 			}
-			if(packets_to_process != packets) {
-				g_queue_free(packets_to_process);
-			}
 		}
-		/* Free mem */
-		g_queue_free(packets);
+		janus_mutex_unlock(&pc->mutex);
 	}
 	return G_SOURCE_CONTINUE;
 }
 
+/* Reports for all media of a PeerConnection are aggregated in compound packets:
+ * the reports come first, and the SDES packets with our CNAMEs at the end */
+#define JANUS_ICE_RTCP_COMPOUND_MAX	1200
+#define JANUS_ICE_RTCP_MEDIUM_MAX	(28+8+3*24)
+#define JANUS_ICE_RTCP_SDES_LEN		16
+typedef struct janus_ice_rtcp_compound {
+	janus_ice_peerconnection_medium *medium;
+	char reports[JANUS_ICE_RTCP_COMPOUND_MAX];
+	int reports_len;
+	char sdes[JANUS_ICE_RTCP_COMPOUND_MAX/2];
+	int sdes_len;
+} janus_ice_rtcp_compound;
+static void janus_ice_rtcp_compound_flush(janus_ice_handle *handle, janus_ice_rtcp_compound *compound) {
+	if(compound->medium != NULL && compound->reports_len > 0) {
+		memcpy(compound->reports + compound->reports_len, compound->sdes, compound->sdes_len);
+		/* Enqueue it, we'll send it later */
+		janus_plugin_rtcp rtcp = { .mindex = compound->medium->mindex,
+			.video = (compound->medium->type == JANUS_MEDIA_VIDEO), .buffer = compound->reports,
+			.length = compound->reports_len + compound->sdes_len };
+		janus_ice_relay_rtcp_internal(handle, compound->medium, &rtcp, FALSE);
+	}
+	compound->medium = NULL;
+	compound->reports_len = 0;
+	compound->sdes_len = 0;
+}
+
 static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 	janus_ice_handle *handle = (janus_ice_handle *)user_data;
 	janus_ice_peerconnection *pc = handle->pc;
+	janus_ice_rtcp_compound compound = { 0 };
 	/* Iterate on all media */
 	janus_ice_peerconnection_medium *medium = NULL;
 	uint mi=0;
@@ -4232,13 +6962,16 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 		medium = g_hash_table_lookup(pc->media, GUINT_TO_POINTER(mi));
 		if(!medium || (medium->type != JANUS_MEDIA_AUDIO && medium->type != JANUS_MEDIA_VIDEO))
 			continue;
+		if(compound.reports_len + compound.sdes_len + JANUS_ICE_RTCP_MEDIUM_MAX + JANUS_ICE_RTCP_SDES_LEN > JANUS_ICE_RTCP_COMPOUND_MAX) {
+			/* No room for the reports of this medium, send what we have */
+			janus_ice_rtcp_compound_flush(handle, &compound);
+		}
 		if(medium->out_stats.info[0].packets > 0) {
-			/* Create a SR/SDES compound */
+			/* Create a SR, and the SDES for its SSRC */
 			int srlen = 28;
-			int sdeslen = 16;
-			char rtcpbuf[sizeof(janus_rtcp_sr)+sdeslen];
-			memset(rtcpbuf, 0, sizeof(rtcpbuf));
-			rtcp_sr *sr = (rtcp_sr *)&rtcpbuf;
+			char *rtcpbuf = compound.reports + compound.reports_len;
+			memset(rtcpbuf, 0, srlen);
+			rtcp_sr *sr = (rtcp_sr *)rtcpbuf;
 			sr->header.version = 2;
 			sr->header.type = RTCP_SR;
 			sr->header.rc = 0;
@@ -4262,39 +6995,31 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 			}
 			sr->si.s_packets = htonl(medium->out_stats.info[0].packets);
 			sr->si.s_octets = htonl(medium->out_stats.info[0].bytes);
-			rtcp_sdes *sdes = (rtcp_sdes *)&rtcpbuf[srlen];
-			janus_rtcp_sdes_cname((char *)sdes, sdeslen, "janus", 5);
+			compound.reports_len += srlen;
+			rtcp_sdes *sdes = (rtcp_sdes *)(compound.sdes + compound.sdes_len);
+			janus_rtcp_sdes_cname((char *)sdes, JANUS_ICE_RTCP_SDES_LEN, "janus", 5);
 			sdes->chunk.ssrc = htonl(medium->ssrc);
-			/* Enqueue it, we'll send it later */
-			janus_plugin_rtcp rtcp = { .mindex = medium->mindex,
-				.video = (medium->type == JANUS_MEDIA_VIDEO), .buffer = rtcpbuf, .length = srlen+sdeslen };
-			janus_ice_relay_rtcp_internal(handle, medium, &rtcp, FALSE);
+			compound.sdes_len += JANUS_ICE_RTCP_SDES_LEN;
+			if(compound.medium == NULL)
+				compound.medium = medium;
 			/* Check if we detected too many losses, and send a slowlink event in case */
 			gint lost = janus_rtcp_context_get_lost_all(rtcp_ctx, TRUE);
 			lost = lost > 0 ? lost : 0;
 			janus_slow_link_update(medium, handle, TRUE, lost);
 		}
 		if(medium->recv) {
-			/* Create a RR too (for each SSRC, if we're simulcasting) */
-			int vindex=0;
+			/* Create a RR too, with a report block for each SSRC if we're simulcasting */
+			char *rtcpbuf = compound.reports + compound.reports_len;
+			int rrlen = 8, vindex = 0;
+			memset(rtcpbuf, 0, JANUS_ICE_RTCP_MEDIUM_MAX-28);
+			rtcp_rr *rr = (rtcp_rr *)rtcpbuf;
 			for(vindex=0; vindex<3; vindex++) {
 				if(medium->rtcp_ctx[vindex] && medium->rtcp_ctx[vindex]->rtp_recvd) {
-					/* Create a RR */
-					int rrlen = 32;
-					char rtcpbuf[32];
-					memset(rtcpbuf, 0, sizeof(rtcpbuf));
-					rtcp_rr *rr = (rtcp_rr *)&rtcpbuf;
-					rr->header.version = 2;
-					rr->header.type = RTCP_RR;
-					rr->header.rc = 1;
-					rr->header.length = htons((rrlen/4)-1);
-					rr->ssrc = htonl(medium->ssrc);
-					janus_rtcp_report_block(medium->rtcp_ctx[vindex], &rr->rb[0]);
-					rr->rb[0].ssrc = htonl(medium->ssrc_peer[vindex]);
-					/* Enqueue it, we'll send it later */
-					janus_plugin_rtcp rtcp = { .mindex = medium->mindex,
-						.video = (medium->type == JANUS_MEDIA_VIDEO), .buffer = rtcpbuf, .length = 32 };
-					janus_ice_relay_rtcp_internal(handle, medium, &rtcp, FALSE);
+					janus_report_block *rb = (janus_report_block *)(rtcpbuf + rrlen);
+					janus_rtcp_report_block(medium->rtcp_ctx[vindex], rb);
+					rb->ssrc = htonl(medium->ssrc_peer[vindex]);
+					rrlen += sizeof(janus_report_block);
+					rr->header.rc++;
 					if(vindex == 0) {
 						/* Check if we detected too many losses, and send a slowlink event in case */
 						gint lost = janus_rtcp_context_get_lost_all(medium->rtcp_ctx[vindex], FALSE);
@@ -4303,8 +7028,19 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 					}
 				}
 			}
+			if(rr->header.rc > 0) {
+				rr->header.version = 2;
+				rr->header.type = RTCP_RR;
+				rr->header.length = htons((rrlen/4)-1);
+				rr->ssrc = htonl(medium->ssrc);
+				compound.reports_len += rrlen;
+				if(compound.medium == NULL)
+					compound.medium = medium;
+			}
 		}
 	}
+	/* Send the compound packet with all the reports */
+	janus_ice_rtcp_compound_flush(handle, &compound);
 	if(twcc_period == 1000) {
 		/* The Transport Wide CC feedback period is 1s as well, send it here */
 		janus_ice_outgoing_transport_wide_cc_feedback(handle);
@@ -4312,6 +7048,51 @@ static gboolean janus_ice_outgoing_rtcp_handle(gpointer user_data) {
 	return G_SOURCE_CONTINUE;
 }
 
+/* Helper to turn media statistics to the JSON format media stats events use */
+static json_t *janus_ice_media_stats_json(const janus_eventhandler_media_stats *stats) {
+	json_t *info = json_object();
+	json_object_set_new(info, "mid", json_string(stats->mid));
+	json_object_set_new(info, "mindex", json_integer(stats->mindex));
+	json_object_set_new(info, "media", json_string(stats->media));
+	if(stats->rtp) {
+		if(stats->codec)
+			json_object_set_new(info, "codec", json_string(stats->codec));
+		json_object_set_new(info, "base", json_integer(stats->base));
+		if(stats->substream == 0) {
+			json_object_set_new(info, "rtt", json_integer(stats->rtt));
+			if(stats->rtt > 0) {
+				json_t *rtt_vals = json_object();
+				json_object_set_new(rtt_vals, "ntp", json_integer(stats->rtt_ntp));
+				json_object_set_new(rtt_vals, "lsr", json_integer(stats->rtt_lsr));
+				json_object_set_new(rtt_vals, "dlsr", json_integer(stats->rtt_dlsr));
+				json_object_set_new(info, "rtt-values", rtt_vals);
+			}
+		}
+		json_object_set_new(info, "lost", json_integer(stats->lost));
+		json_object_set_new(info, "lost-by-remote", json_integer(stats->lost_by_remote));
+		json_object_set_new(info, "jitter-local", json_integer(stats->jitter_local));
+		json_object_set_new(info, "jitter-remote", json_integer(stats->jitter_remote));
+		json_object_set_new(info, "in-link-quality", json_integer(stats->in_link_quality));
+		json_object_set_new(info, "in-media-link-quality", json_integer(stats->in_media_link_quality));
+		json_object_set_new(info, "out-link-quality", json_integer(stats->out_link_quality));
+		json_object_set_new(info, "out-media-link-quality", json_integer(stats->out_media_link_quality));
+	}
+	json_object_set_new(info, "packets-received", json_integer(stats->packets_received));
+	json_object_set_new(info, "packets-sent", json_integer(stats->packets_sent));
+	json_object_set_new(info, "bytes-received", json_integer(stats->bytes_received));
+	json_object_set_new(info, "bytes-sent", json_integer(stats->bytes_sent));
+	if(stats->rtp) {
+		json_object_set_new(info, "bytes-received-lastsec", json_integer(stats->bytes_received_lastsec));
+		json_object_set_new(info, "bytes-sent-lastsec", json_integer(stats->bytes_sent_lastsec));
+		json_object_set_new(info, "nacks-received", json_integer(stats->nacks_received));
+		json_object_set_new(info, "nacks-sent", json_integer(stats->nacks_sent));
+		json_object_set_new(info, "retransmissions-received", json_integer(stats->retransmissions_received));
+	}
+	if(stats->remb_bitrate > 0)
+		json_object_set_new(info, "remb-bitrate", json_integer(stats->remb_bitrate));
+	return info;
+}
+
 static gboolean janus_ice_outgoing_stats_handle(gpointer user_data) {
 	janus_ice_handle *handle = (janus_ice_handle *)user_data;
 	/* This callback is for stats and other things we need to do on a regular basis (typically called once per second) */
@@ -4323,6 +7104,11 @@ static gboolean janus_ice_outgoing_stats_handle(gpointer user_data) {
 		return G_SOURCE_CONTINUE;
 	/* Iterate on all media */
 	handle->last_event_stats++;
+	/* Check if it's time to send live stats to event handlers, and in what format:
+	 * if no handler is interested in media events, we don't prepare anything at all */
+	gboolean stats_json = FALSE, stats_compact = FALSE;
+	if(janus_ice_event_stats_period > 0 && handle->last_event_stats >= janus_ice_event_stats_period)
+		janus_events_media_stats_consumers(&stats_json, &stats_compact);
 	janus_ice_peerconnection_medium *medium = NULL;
 	json_t *combined_event = NULL;
 	uint mi=0;
@@ -4366,66 +7152,68 @@ static gboolean janus_ice_outgoing_stats_handle(gpointer user_data) {
 			}
 		}
 		/* We also send live stats to event handlers every tot-seconds (configurable) */
-		if(janus_ice_event_stats_period > 0 && handle->last_event_stats >= janus_ice_event_stats_period) {
-			if(janus_events_is_enabled()) {
-				/* Check if we should send dedicated events per media, or one per peerConnection */
-				if(janus_events_is_enabled() && janus_ice_event_get_combine_media_stats() && combined_event == NULL)
-					combined_event = json_array();
-				int vindex=0;
-				for(vindex=0; vindex<3; vindex++) {
-					if(medium && ((medium->type == JANUS_MEDIA_DATA && vindex == 0) || medium->rtcp_ctx[vindex])) {
-						json_t *info = json_object();
-						json_object_set_new(info, "mid", json_string(medium->mid));
-						json_object_set_new(info, "mindex", json_integer(medium->mindex));
-						if(vindex == 0)
-							json_object_set_new(info, "media", json_string(janus_media_type_str(medium->type)));
-						else if(vindex == 1)
-							json_object_set_new(info, "media", json_string("video-sim1"));
-						else
-							json_object_set_new(info, "media", json_string("video-sim2"));
-						if(medium->type == JANUS_MEDIA_AUDIO || medium->type == JANUS_MEDIA_VIDEO) {
-							if(medium->codec)
-								json_object_set_new(info, "codec", json_string(medium->codec));
-							json_object_set_new(info, "base", json_integer(medium->rtcp_ctx[vindex]->tb));
-							if(vindex == 0) {
-								uint32_t rtt = janus_rtcp_context_get_rtt(medium->rtcp_ctx[vindex]);
-								json_object_set_new(info, "rtt", json_integer(rtt));
-								if(rtt > 0 && medium->rtcp_ctx[vindex]) {
-									json_t *rtt_vals = json_object();
-									json_object_set_new(rtt_vals, "ntp", json_integer(medium->rtcp_ctx[vindex]->rtt_ntp));
-									json_object_set_new(rtt_vals, "lsr", json_integer(medium->rtcp_ctx[vindex]->rtt_lsr));
-									json_object_set_new(rtt_vals, "dlsr", json_integer(medium->rtcp_ctx[vindex]->rtt_dlsr));
-									json_object_set_new(info, "rtt-values", rtt_vals);
-								}
-							}
-							json_object_set_new(info, "lost", json_integer(janus_rtcp_context_get_lost_all(medium->rtcp_ctx[vindex], FALSE)));
-							json_object_set_new(info, "lost-by-remote", json_integer(janus_rtcp_context_get_lost_all(medium->rtcp_ctx[vindex], TRUE)));
-							json_object_set_new(info, "jitter-local", json_integer(janus_rtcp_context_get_jitter(medium->rtcp_ctx[vindex], FALSE)));
-							json_object_set_new(info, "jitter-remote", json_integer(janus_rtcp_context_get_jitter(medium->rtcp_ctx[vindex], TRUE)));
-							json_object_set_new(info, "in-link-quality", json_integer(janus_rtcp_context_get_in_link_quality(medium->rtcp_ctx[vindex])));
-							json_object_set_new(info, "in-media-link-quality", json_integer(janus_rtcp_context_get_in_media_link_quality(medium->rtcp_ctx[vindex])));
-							json_object_set_new(info, "out-link-quality", json_integer(janus_rtcp_context_get_out_link_quality(medium->rtcp_ctx[vindex])));
-							json_object_set_new(info, "out-media-link-quality", json_integer(janus_rtcp_context_get_out_media_link_quality(medium->rtcp_ctx[vindex])));
-						}
-						json_object_set_new(info, "packets-received", json_integer(medium->in_stats.info[vindex].packets));
-						json_object_set_new(info, "packets-sent", json_integer(medium->out_stats.info[vindex].packets));
-						json_object_set_new(info, "bytes-received", json_integer(medium->in_stats.info[vindex].bytes));
-						json_object_set_new(info, "bytes-sent", json_integer(medium->out_stats.info[vindex].bytes));
-						if(medium->type == JANUS_MEDIA_AUDIO || medium->type == JANUS_MEDIA_VIDEO) {
-							json_object_set_new(info, "bytes-received-lastsec", json_integer(medium->in_stats.info[vindex].bytes_lastsec));
-							json_object_set_new(info, "bytes-sent-lastsec", json_integer(medium->out_stats.info[vindex].bytes_lastsec));
-							json_object_set_new(info, "nacks-received", json_integer(medium->in_stats.info[vindex].nacks));
-							json_object_set_new(info, "nacks-sent", json_integer(medium->out_stats.info[vindex].nacks));
-							json_object_set_new(info, "retransmissions-received", json_integer(medium->rtcp_ctx[vindex]->retransmitted));
-						}
-						if(medium->mindex == 0 && pc->remb_bitrate > 0)
-							json_object_set_new(info, "remb-bitrate", json_integer(pc->remb_bitrate));
-						if(combined_event != NULL) {
-							json_array_append_new(combined_event, info);
-						} else {
-							janus_events_notify_handlers(JANUS_EVENT_TYPE_MEDIA, JANUS_EVENT_SUBTYPE_MEDIA_STATS,
-								session->session_id, handle->handle_id, handle->opaque_id, info);
+		if(stats_json || stats_compact) {
+			/* Check if we should send dedicated events per media, or one per peerConnection */
+			if(stats_json && janus_ice_event_get_combine_media_stats() && combined_event == NULL)
+				combined_event = json_array();
+			int vindex=0;
+			for(vindex=0; vindex<3; vindex++) {
+				if(medium && ((medium->type == JANUS_MEDIA_DATA && vindex == 0) || medium->rtcp_ctx[vindex])) {
+					janus_eventhandler_media_stats stats = { 0 };
+					stats.session_id = session->session_id;
+					stats.handle_id = handle->handle_id;
+					stats.opaque_id = handle->opaque_id;
+					stats.mid = medium->mid;
+					stats.mindex = medium->mindex;
+					stats.substream = vindex;
+					if(vindex == 0)
+						stats.media = janus_media_type_str(medium->type);
+					else if(vindex == 1)
+						stats.media = "video-sim1";
+					else
+						stats.media = "video-sim2";
+					if(medium->type == JANUS_MEDIA_AUDIO || medium->type == JANUS_MEDIA_VIDEO) {
+						janus_rtcp_context *rtcp_ctx = medium->rtcp_ctx[vindex];
+						stats.rtp = TRUE;
+						stats.codec = medium->codec;
+						stats.base = rtcp_ctx->tb;
+						if(vindex == 0) {
+							stats.rtt = janus_rtcp_context_get_rtt(rtcp_ctx);
+							stats.rtt_ntp = rtcp_ctx->rtt_ntp;
+							stats.rtt_lsr = rtcp_ctx->rtt_lsr;
+							stats.rtt_dlsr = rtcp_ctx->rtt_dlsr;
 						}
+						stats.lost = janus_rtcp_context_get_lost_all(rtcp_ctx, FALSE);
+						stats.lost_by_remote = janus_rtcp_context_get_lost_all(rtcp_ctx, TRUE);
+						stats.jitter_local = janus_rtcp_context_get_jitter(rtcp_ctx, FALSE);
+						stats.jitter_remote = janus_rtcp_context_get_jitter(rtcp_ctx, TRUE);
+						stats.in_link_quality = janus_rtcp_context_get_in_link_quality(rtcp_ctx);
+						stats.in_media_link_quality = janus_rtcp_context_get_in_media_link_quality(rtcp_ctx);
+						stats.out_link_quality = janus_rtcp_context_get_out_link_quality(rtcp_ctx);
+						stats.out_media_link_quality = janus_rtcp_context_get_out_media_link_quality(rtcp_ctx);
+						stats.bytes_received_lastsec = medium->in_stats.info[vindex].bytes_lastsec;
+						stats.bytes_sent_lastsec = medium->out_stats.info[vindex].bytes_lastsec;
+						stats.nacks_received = medium->in_stats.info[vindex].nacks;
+						stats.nacks_sent = medium->out_stats.info[vindex].nacks;
+						stats.retransmissions_received = rtcp_ctx->retransmitted;
+					}
+					stats.packets_received = medium->in_stats.info[vindex].packets;
+					stats.packets_sent = medium->out_stats.info[vindex].packets;
+					stats.bytes_received = medium->in_stats.info[vindex].bytes;
+					stats.bytes_sent = medium->out_stats.info[vindex].bytes;
+					if(medium->mindex == 0)
+						stats.remb_bitrate = pc->remb_bitrate;
+					/* Handlers that support compact stats get them right away */
+					if(stats_compact)
+						janus_events_notify_media_stats(&stats);
+					if(!stats_json)
+						continue;
+					json_t *info = janus_ice_media_stats_json(&stats);
+					if(combined_event != NULL) {
+						json_array_append_new(combined_event, info);
+					} else {
+						janus_events_notify_handlers(JANUS_EVENT_TYPE_MEDIA, JANUS_EVENT_SUBTYPE_MEDIA_STATS,
+							session->session_id, handle->handle_id, handle->opaque_id, info);
 					}
 				}
 			}
@@ -4479,13 +7267,23 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		if(pc != NULL && count > 0) {
 			if(handle->agent_started == 0)
 				handle->agent_started = janus_get_monotonic_time();
-			int added = nice_agent_set_remote_candidates(handle->agent, pc->stream_id, pc->component_id, candidates);
-			if(added < 0 || (guint)added != count) {
-				JANUS_LOG(LOG_WARN, "[%"SCNu64"] Failed to add some remote candidates (added %u, expected %u)\n",
-					handle->handle_id, added, count);
-			} else {
-				JANUS_LOG(LOG_VERB, "[%"SCNu64"] %d remote %s added\n", handle->handle_id,
+			if(pc->mux != NULL) {
+				/* In single-port mode we wait for the peer's checks, so we don't need these */
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Single-port mode, ignoring %d remote %s\n", handle->handle_id,
 					count, (count > 1 ? "candidates" : "candidate"));
+			} else {
+				int added = nice_agent_set_remote_candidates(handle->agent, pc->stream_id, pc->component_id, candidates);
+				if(added < 0 || (guint)added != count) {
+					JANUS_LOG(LOG_WARN, "[%"SCNu64"] Failed to add some remote candidates (added %u, expected %u)\n",
+						handle->handle_id, added, count);
+				} else {
+					JANUS_LOG(LOG_VERB, "[%"SCNu64"] %d remote %s added\n", handle->handle_id,
+						count, (count > 1 ? "candidates" : "candidate"));
+				}
+				/* New pairs will be checked, possibly on sockets other than the
+				 * one we're reading in batches from, so let libnice handle them */
+				if(added > 0)
+					janus_ice_recv_batch_stop(handle, pc, TRUE);
 			}
 		}
 		g_slist_free(candidates);
@@ -4541,6 +7339,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 			plugin->hangup_media(handle->app_handle);
 		}
 		/* Get rid of the attached sources */
+		if(handle->rtcp_link != NULL)
+			janus_ice_static_event_loop_rtcp_remove((janus_ice_static_event_loop *)handle->static_event_loop, handle);
 		if(handle->rtcp_source) {
 			g_source_destroy(handle->rtcp_source);
 			g_source_unref(handle->rtcp_source);
@@ -4595,6 +7395,10 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				session->session_id, handle->handle_id, "detached",
 				plugin ? plugin->get_package() : NULL, handle->opaque_id, handle->token);
 		return G_SOURCE_REMOVE;
+	} else if(pkt == &janus_ice_migrate_handle) {
+		/* We've been asked to move this handle to another loop */
+		janus_ice_handle_migrate_internal(handle);
+		return G_SOURCE_CONTINUE;
 	} else if(pkt == &janus_ice_data_ready) {
 		/* Data is writable on this PeerConnection, notify the plugin */
 		janus_plugin *plugin = (janus_plugin *)handle->app;
@@ -4616,6 +7420,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		return G_SOURCE_CONTINUE;
 	}
 	gint64 age = (janus_get_monotonic_time() - pkt->added);
+	if(handle->static_event_loop != NULL)
+		janus_ice_static_event_loop_waited((janus_ice_static_event_loop *)handle->static_event_loop, age);
 	if(age > G_USEC_PER_SEC) {
 		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Discarding too old outgoing packet (age=%"SCNi64"us)\n", handle->handle_id, age);
 		janus_ice_free_queued_packet(pkt);
@@ -4657,24 +7463,30 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 		medium->noerrorlog = FALSE;
 		if(pkt->encrypted) {
 			/* Already SRTCP */
-			int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
+			int sent = janus_ice_peerconnection_send(handle, pc, pkt->data, pkt->length);
 			if(sent < pkt->length) {
 				JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
 			}
+			if(sent > 0) {
+				janus_metrics_inc(JANUS_METRICS_PACKETS_OUT);
+				janus_metrics_add(JANUS_METRICS_BYTES_OUT, sent);
+			}
 		} else {
 			/* Check if there's anything we need to do before sending */
 			uint32_t bitrate = janus_rtcp_get_remb(pkt->data, pkt->length);
 			if(bitrate > 0) {
 				/* There's a REMB, prepend a RR as it won't work otherwise */
 				int rrlen = 8;
-				char *rtcpbuf = g_malloc0(rrlen+pkt->length+SRTP_MAX_TAG_LEN+4);
+				janus_ice_queued_packet_resize(pkt, rrlen+pkt->length+SRTP_MAX_TAG_LEN+4);
+				char *rtcpbuf = pkt->data;
+				/* Move the REMB after the space for the RR */
+				memmove(rtcpbuf+rrlen, pkt->data, pkt->length);
+				memset(rtcpbuf, 0, rrlen);
 				rtcp_rr *rr = (rtcp_rr *)rtcpbuf;
 				rr->header.version = 2;
 				rr->header.type = RTCP_RR;
 				rr->header.rc = 0;
 				rr->header.length = htons((rrlen/4)-1);
-				/* Append REMB */
-				memcpy(rtcpbuf+rrlen, pkt->data, pkt->length);
 				/* If we're simulcasting, set the extra SSRCs (the first one will be set by janus_rtcp_fix_ssrc) */
 				if(medium->ssrc_peer[1] && pkt->length >= 28) {
 					rtcp_fb *rtcpfb = (rtcp_fb *)(rtcpbuf+rrlen);
@@ -4684,14 +7496,12 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						remb->ssrc[2] = htonl(medium->ssrc_peer[2]);
 					}
 				}
-				/* Free old packet and update */
-				char *prev_data = pkt->data;
-				pkt->data = rtcpbuf;
+				/* Update the length */
 				pkt->length = rrlen+pkt->length;
-				g_clear_pointer(&prev_data, g_free);
 			}
 			/* Do we need to dump this packet for debugging? */
-			if(g_atomic_int_get(&handle->dump_packets))
+			if(g_atomic_int_get(&handle->dump_packets) &&
+					janus_text2pcap_media_enabled(handle->text2pcap, medium->type == JANUS_MEDIA_VIDEO))
 				janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTCP, FALSE, pkt->data, pkt->length,
 					"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
 			/* Encrypt SRTCP */
@@ -4701,15 +7511,20 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 			if(res != srtp_err_status_ok) {
 				/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
 				handle->srtp_errors_count++;
+				janus_metrics_inc(JANUS_METRICS_SRTP_ERRORS_OUT);
 				handle->last_srtp_error = res;
 				/* If we're debugging, though, print every occurrence */
 				JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTCP protect error... %s (len=%d-->%d)...\n", handle->handle_id, janus_srtp_error_str(res), pkt->length, protected);
 			} else {
 				/* Shoot! */
-				int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
+				int sent = janus_ice_peerconnection_send(handle, pc, pkt->data, protected);
 				if(sent < protected) {
 					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
 				}
+				if(sent > 0) {
+					janus_metrics_inc(JANUS_METRICS_PACKETS_OUT);
+					janus_metrics_add(JANUS_METRICS_BYTES_OUT, sent);
+				}
 			}
 		}
 		janus_ice_free_queued_packet(pkt);
@@ -4736,7 +7551,7 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				/* Already RTP (probably a retransmission?) */
 				janus_rtp_header *header = (janus_rtp_header *)pkt->data;
 				JANUS_LOG(LOG_HUGE, "[%"SCNu64"] ... Retransmitting seq.nr %"SCNu16"\n\n", handle->handle_id, ntohs(header->seq_number));
-				int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, pkt->length, (const gchar *)pkt->data);
+				int sent = janus_ice_send_rtp(handle, pc, pkt->data, pkt->length);
 				if(sent < pkt->length) {
 					JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, pkt->length);
 				}
@@ -4759,7 +7574,7 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 							handle->handle_id, medium->rtx_payload_type);
 					}
 					if(medium->codec == NULL) {
-						janus_mutex_lock(&handle->mutex);
+						janus_mutex_lock_adaptive(&handle->mutex);
 						const char *codec = janus_get_codec_from_pt(handle->local_sdp, medium->payload_type);
 						janus_mutex_unlock(&handle->mutex);
 						if(codec != NULL)
@@ -4779,7 +7594,8 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					}
 				}
 				/* Do we need to dump this packet for debugging? */
-				if(g_atomic_int_get(&handle->dump_packets))
+				if(g_atomic_int_get(&handle->dump_packets) &&
+						janus_text2pcap_media_enabled(handle->text2pcap, medium->type == JANUS_MEDIA_VIDEO))
 					janus_text2pcap_dump(handle->text2pcap, JANUS_TEXT2PCAP_RTP, FALSE, pkt->data, pkt->length,
 						"[session=%"SCNu64"][handle=%"SCNu64"]", session->session_id, handle->handle_id);
 				/* If this is video and NACK optimizations are enabled, check if this is
@@ -4793,25 +7609,24 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					}
 				}
 				/* Before encrypting, check if we need to copy the unencrypted payload (e.g., for rtx/90000) */
+				janus_ice_retransmit_slot *slot = NULL;
 				janus_rtp_packet *p = NULL;
 				if(medium->nack_queue_ms > 0 && !pkt->retransmission && pkt->type == JANUS_ICE_PACKET_VIDEO && medium->do_nacks &&
 						janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX)) {
-					/* Save the packet for retransmissions that may be needed later: start by
-					 * making room for two more bytes to store the original sequence number */
-					p = g_malloc(sizeof(janus_rtp_packet));
-					janus_rtp_header *header = (janus_rtp_header *)pkt->data;
-					guint16 original_seq = header->seq_number;
-					p->data = g_malloc(pkt->length+2);
-					p->length = pkt->length+2;
 					/* Check where the payload starts */
 					int plen = 0;
 					char *payload = janus_rtp_payload(pkt->data, pkt->length, &plen);
 					if(plen == 0) {
 						JANUS_LOG(LOG_WARN, "[%"SCNu64"] Discarding outgoing empty RTP packet\n", handle->handle_id);
-						janus_ice_free_rtp_packet(p);
 						janus_ice_free_queued_packet(pkt);
 						return G_SOURCE_CONTINUE;
 					}
+					/* Save the packet for retransmissions that may be needed later: start by
+					 * making room for two more bytes to store the original sequence number */
+					janus_rtp_header *header = (janus_rtp_header *)pkt->data;
+					guint16 original_seq = header->seq_number;
+					slot = janus_ice_retransmit_ring_reserve(medium, ntohs(original_seq), pkt->length+2);
+					p = &slot->packet;
 					size_t hsize = payload - pkt->data;
 					/* Copy the header first */
 					memcpy(p->data, pkt->data, hsize);
@@ -4829,6 +7644,7 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 				if(res != srtp_err_status_ok) {
 					/* We don't spam the logs for every SRTP error: just take note of this, and print a summary later */
 					handle->srtp_errors_count++;
+					janus_metrics_inc(JANUS_METRICS_SRTP_ERRORS_OUT);
 					handle->last_srtp_error = res;
 					/* If we're debugging, though, print every occurrence */
 					janus_rtp_header *header = (janus_rtp_header *)pkt->data;
@@ -4836,22 +7652,24 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 					guint16 seq = ntohs(header->seq_number);
 					JANUS_LOG(LOG_DBG, "[%"SCNu64"] ... SRTP protect error... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 						handle->handle_id, janus_srtp_error_str(res), pkt->length, protected, timestamp, seq);
-					janus_ice_free_rtp_packet(p);
+					janus_ice_retransmit_ring_release(medium->retransmit_ring, slot);
 				} else {
 					/* Shoot! */
-					int sent = nice_agent_send(handle->agent, pc->stream_id, pc->component_id, protected, pkt->data);
+					int sent = janus_ice_send_rtp(handle, pc, pkt->data, protected);
 					if(sent < protected) {
 						JANUS_LOG(LOG_ERR, "[%"SCNu64"] ... only sent %d bytes? (was %d)\n", handle->handle_id, sent, protected);
 					}
 					/* Update stats */
 					if(sent > 0) {
+						if(pkt->trace != NULL)
+							janus_ice_trace_sent(handle, pkt);
 						/* Update the RTCP context as well */
 						janus_rtp_header *header = (janus_rtp_header *)pkt->data;
 						guint32 timestamp = ntohl(header->timestamp);
 						medium->out_stats.info[0].packets++;
 						medium->out_stats.info[0].bytes += pkt->length;
 						/* Last second outgoing media */
-						gint64 now = janus_get_monotonic_time();
+						gint64 now = janus_get_monotonic_time_cached();
 						if(medium->out_stats.info[0].updated == 0)
 							medium->out_stats.info[0].updated = now;
 						if(now > medium->out_stats.info[0].updated &&
@@ -4894,25 +7712,10 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 						}
 						if(p == NULL) {
 							/* If we're not doing RFC4588, we're saving the SRTP packet as it is */
-							p = g_malloc(sizeof(janus_rtp_packet));
-							p->data = g_malloc(protected);
-							memcpy(p->data, pkt->data, protected);
-							p->length = protected;
-							janus_plugin_rtp_extensions_reset(&p->extensions);
+							janus_rtp_header *header = (janus_rtp_header *)pkt->data;
+							slot = janus_ice_retransmit_ring_reserve(medium, ntohs(header->seq_number), protected);
+							memcpy(slot->packet.data, pkt->data, protected);
 						}
-						p->created = janus_get_monotonic_time();
-						p->last_retransmit = 0;
-						janus_rtp_header *header = (janus_rtp_header *)pkt->data;
-						guint16 seq = ntohs(header->seq_number);
-						if(medium->retransmit_buffer == NULL) {
-							medium->retransmit_buffer = g_queue_new();
-							medium->retransmit_seqs = g_hash_table_new(NULL, NULL);
-						}
-						g_queue_push_tail(medium->retransmit_buffer, p);
-						/* Insert in the table too, for quick lookup */
-						g_hash_table_insert(medium->retransmit_seqs, GUINT_TO_POINTER(seq), p);
-					} else {
-						janus_ice_free_rtp_packet(p);
 					}
 				}
 			}
@@ -4963,27 +7766,97 @@ static gboolean janus_ice_outgoing_traffic_handle(janus_ice_handle *handle, janu
 	return G_SOURCE_CONTINUE;
 }
 
-static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
+/* Add a packet to the outgoing ring, without waking the loop up */
+static gboolean janus_ice_enqueue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
 	/* TODO: There is a potential race condition where the "queued_packets"
 	 * could get released between the condition and pushing the packet. */
-	if(handle->queued_packets != NULL) {
-		g_async_queue_push(handle->queued_packets, pkt);
-		g_main_context_wakeup(handle->mainctx);
-	} else {
+	janus_ice_lane lane = janus_ice_packet_lane(pkt);
+	janus_ring *ring = janus_ice_outgoing_lane_get(handle, lane);
+	if(!janus_ring_push(ring, pkt)) {
+		/* The loop can't keep up, drop the packet */
+		/* Several threads may be queueing packets for this handle */
+		g_atomic_int_inc(&handle->outgoing_lanes_dropped[lane]);
+		gint dropped = g_atomic_int_add(&handle->outgoing_packets_dropped, 1);
+		if(dropped % 1000 == 0) {
+			JANUS_LOG(LOG_WARN, "[%"SCNu64"] Outgoing queue full, dropping packets (%d so far)\n",
+				handle->handle_id, dropped+1);
+		}
 		janus_ice_free_queued_packet(pkt);
+		return FALSE;
 	}
+	return TRUE;
 }
 
-void janus_ice_relay_rtp(janus_ice_handle *handle, janus_plugin_rtp *packet) {
-	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL ||
-			!janus_is_rtp(packet->buffer, packet->length))
+static void janus_ice_wakeup_loop(janus_ice_handle *handle) {
+	/* Only wake the loop up if nobody did already */
+	if(g_atomic_int_compare_and_exchange(&handle->outgoing_wakeup, 0, 1))
+		g_main_context_wakeup(handle->mainctx);
+}
+
+static void janus_ice_queue_packet(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
+	if(janus_ice_enqueue_packet(handle, pkt))
+		janus_ice_wakeup_loop(handle);
+}
+
+/* Wake the loops up after queueing packets for several handles: handles
+ * that share the same loop (e.g., with static event loops) only cost a
+ * single wakeup, which is where most of the overhead of a fan-out is */
+static void janus_ice_relay_batch_add(janus_ice_relay_batch *batch, janus_ice_handle *handle) {
+	if(!g_atomic_int_compare_and_exchange(&handle->outgoing_wakeup, 0, 1))
+		return;
+	GMainContext *mainctx = handle->mainctx;
+	if(mainctx == NULL)
 		return;
+	int i = 0;
+	for(i=0; i<batch->count; i++) {
+		if(batch->handles[i]->mainctx == mainctx)
+			return;
+	}
+	if(batch->count == JANUS_ICE_RELAY_BATCH_CONTEXTS) {
+		/* Too many different loops involved, wake this one up right away */
+		g_main_context_wakeup(mainctx);
+		return;
+	}
+	/* We keep track of the handle, rather than its loop, as it may move to another
+	 * loop before the wakeup (a handle that moves wakes its new loop up itself) */
+	janus_refcount_increase(&handle->ref);
+	batch->handles[batch->count++] = handle;
+}
+
+void janus_ice_relay_batch_wakeup(janus_ice_relay_batch *batch) {
+	if(batch == NULL)
+		return;
+	int i = 0;
+	for(i=0; i<batch->count; i++) {
+		GMainContext *mainctx = batch->handles[i]->mainctx;
+		if(mainctx != NULL)
+			g_main_context_wakeup(mainctx);
+		janus_refcount_decrease(&batch->handles[i]->ref);
+		batch->handles[i] = NULL;
+	}
+	batch->count = 0;
+}
+
+static janus_ice_queued_packet *janus_ice_rtp_packet_new(janus_ice_handle *handle, janus_plugin_rtp *packet) {
 	/* Queue this packet as it is (we'll prune/update/set extensions later) */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_new(handle, packet->length + SRTP_MAX_TAG_LEN);
 	pkt->mindex = packet->mindex;
-	pkt->data = g_malloc(packet->length + SRTP_MAX_TAG_LEN);
-	memcpy(pkt->data, packet->buffer, packet->length);
-	pkt->length = packet->length;
+	int plen = 0;
+	char *payload = (packet->shared != NULL && packet->shared->length == packet->length) ?
+		janus_rtp_payload(packet->buffer, packet->length, &plen) : NULL;
+	if(payload != NULL) {
+		/* The plugin gave us a shared copy of the packet: only copy the
+		 * RTP header for now, we'll get the payload from there later */
+		gint hsize = payload - packet->buffer;
+		memcpy(pkt->data, packet->buffer, hsize);
+		pkt->length = hsize;
+		janus_refcount_increase(&packet->shared->ref);
+		pkt->shared = packet->shared;
+		pkt->shared_offset = hsize;
+	} else {
+		memcpy(pkt->data, packet->buffer, packet->length);
+		pkt->length = packet->length;
+	}
 	pkt->type = packet->video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
 	pkt->extensions = packet->extensions;
 	pkt->control = FALSE;
@@ -4991,8 +7864,59 @@ void janus_ice_relay_rtp(janus_ice_handle *handle, janus_plugin_rtp *packet) {
 	pkt->retransmission = FALSE;
 	pkt->label = NULL;
 	pkt->protocol = NULL;
+	pkt->trace = janus_ice_trace_relayed();
 	pkt->added = janus_get_monotonic_time();
-	janus_ice_queue_packet(handle, pkt);
+	return pkt;
+}
+
+/* When a plugin relays a packet from the thread of the loop the handle is on
+ * (e.g., forwarding between two handles colocated on the same loop), we can
+ * send it right away, rather than queueing it and waking the loop up */
+static gboolean janus_ice_send_direct(janus_ice_handle *handle, janus_ice_queued_packet *pkt) {
+	janus_ice_static_event_loop *loop = g_private_get(&current_event_loop);
+	if(loop == NULL || loop != handle->static_event_loop)
+		return FALSE;
+	/* Don't overtake packets that are queued already, or that the pacer is holding */
+	if(g_async_queue_length(handle->queued_packets) > 0 || janus_ice_handle_queued_packets(handle, JANUS_ICE_LANES) > 0)
+		return FALSE;
+	janus_ice_pacer *pacer = handle->pacer;
+	if(pacer != NULL && pacer->rate > 0 && janus_ice_pacer_is_paced(pkt))
+		return FALSE;
+	if(send_batch_size > 0) {
+		/* Don't mix our packet with a batched send in progress on this thread */
+		janus_ice_send_batch *batch = g_private_get(&send_batch_buffers);
+		if(batch != NULL && batch->count > 0)
+			return FALSE;
+	}
+	handle->outgoing_packets_direct++;
+	gint64 started = janus_get_monotonic_time();
+	janus_ice_outgoing_traffic_handle(handle, pkt);
+	janus_ice_send_batch_flush();
+	/* This is part of the iteration that is serving another handle, but it was for this one */
+	janus_ice_static_event_loop_dispatched(loop, handle, 1, started, TRUE);
+	return TRUE;
+}
+
+void janus_ice_relay_rtp(janus_ice_handle *handle, janus_plugin_rtp *packet) {
+	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL ||
+			!janus_is_rtp(packet->buffer, packet->length))
+		return;
+	janus_ice_queued_packet *pkt = janus_ice_rtp_packet_new(handle, packet);
+	if(!janus_ice_send_direct(handle, pkt))
+		janus_ice_queue_packet(handle, pkt);
+}
+
+void janus_ice_relay_rtp_batched(janus_ice_relay_batch *batch, janus_ice_handle *handle, janus_plugin_rtp *packet) {
+	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL ||
+			!janus_is_rtp(packet->buffer, packet->length))
+		return;
+	if(!janus_ice_enqueue_packet(handle, janus_ice_rtp_packet_new(handle, packet)))
+		return;
+	/* Low-latency handles don't wait for the rest of the batch to be queued */
+	if(g_atomic_int_get(&handle->low_latency))
+		janus_ice_wakeup_loop(handle);
+	else
+		janus_ice_relay_batch_add(batch, handle);
 }
 
 void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, janus_ice_peerconnection_medium *medium,
@@ -5021,9 +7945,8 @@ void janus_ice_relay_rtcp_internal(janus_ice_handle *handle, janus_ice_peerconne
 			medium->ssrc, medium->ssrc_peer[0]);
 	}
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_new(handle, rtcp_len+SRTP_MAX_TAG_LEN+4);
 	pkt->mindex = medium->mindex;
-	pkt->data = g_malloc(rtcp_len+SRTP_MAX_TAG_LEN+4);
 	memcpy(pkt->data, rtcp_buf, rtcp_len);
 	pkt->length = rtcp_len;
 	pkt->type = packet->video ? JANUS_ICE_PACKET_VIDEO : JANUS_ICE_PACKET_AUDIO;
@@ -5045,7 +7968,7 @@ void janus_ice_relay_rtcp(janus_ice_handle *handle, janus_plugin_rtcp *packet) {
 	if(!handle || packet == NULL || packet->buffer == NULL)
 		return;
 	/* Find the right medium instance */
-	janus_mutex_lock(&handle->mutex);
+	janus_mutex_lock_adaptive(&handle->mutex);
 	if(!handle->pc || !handle->pc->media || !handle->pc->media_bytype) {
 		janus_mutex_unlock(&handle->mutex);
 		return;
@@ -5063,6 +7986,7 @@ void janus_ice_relay_rtcp(janus_ice_handle *handle, janus_plugin_rtcp *packet) {
 	janus_ice_relay_rtcp_internal(handle, medium, packet, TRUE);
 	/* If this is a PLI and we're simulcasting, send a PLI on other layers as well */
 	if(packet->video && janus_rtcp_has_pli(packet->buffer, packet->length)) {
+		janus_metrics_inc(JANUS_METRICS_PLIS_OUT);
 		if(medium->ssrc_peer[1]) {
 			char plibuf[12];
 			memset(plibuf, 0, 12);
@@ -5117,11 +8041,8 @@ void janus_ice_send_remb(janus_ice_handle *handle, uint32_t bitrate) {
 }
 
 #ifdef HAVE_SCTP
-void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet) {
-	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
-		return;
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(packet->length);
+static janus_ice_queued_packet *janus_ice_data_packet_new(janus_ice_handle *handle, janus_plugin_data *packet) {
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_new(handle, packet->length);
 	pkt->mindex = -1;
 	memcpy(pkt->data, packet->buffer, packet->length);
 	pkt->length = packet->length;
@@ -5133,7 +8054,37 @@ void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet) {
 	pkt->label = packet->label ? g_strdup(packet->label) : NULL;
 	pkt->protocol = packet->protocol ? g_strdup(packet->protocol) : NULL;
 	pkt->added = janus_get_monotonic_time();
-	janus_ice_queue_packet(handle, pkt);
+	return pkt;
+}
+
+void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet) {
+	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
+		return;
+	janus_ice_queue_packet(handle, janus_ice_data_packet_new(handle, packet));
+}
+
+void janus_ice_relay_data_batch(janus_ice_handle *handle, janus_plugin_data *packets, int count) {
+	if(!handle || !handle->pc || handle->queued_packets == NULL || packets == NULL || count < 1)
+		return;
+	/* Queue all the messages first, and only wake the loop up once at the end */
+	gboolean queued = FALSE;
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_plugin_data *packet = &packets[i];
+		if(packet->buffer == NULL || packet->length < 1)
+			continue;
+		if(janus_ice_enqueue_packet(handle, janus_ice_data_packet_new(handle, packet)))
+			queued = TRUE;
+	}
+	if(queued)
+		janus_ice_wakeup_loop(handle);
+}
+
+void janus_ice_relay_data_batched(janus_ice_relay_batch *batch, janus_ice_handle *handle, janus_plugin_data *packet) {
+	if(!handle || !handle->pc || handle->queued_packets == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
+		return;
+	if(janus_ice_enqueue_packet(handle, janus_ice_data_packet_new(handle, packet)))
+		janus_ice_relay_batch_add(batch, handle);
 }
 #endif
 
@@ -5146,9 +8097,16 @@ void janus_ice_relay_sctp(janus_ice_handle *handle, char *buffer, int length) {
 		GINT_TO_POINTER(JANUS_MEDIA_DATA));
 	if(!medium)	/* Queue this packet */
 		return;
+	janus_ice_peerconnection *pc = handle->pc;
+	if(pc->dtls != NULL && g_main_context_is_owner(handle->mainctx)) {
+		/* We're in the handle loop, which means the SCTP stack is handling a
+		 * message we just passed it: there's no need to copy and queue the
+		 * result again, as we can encrypt and send it right away */
+		janus_dtls_send_sctp_data(pc->dtls, buffer, length);
+		return;
+	}
 	/* Queue this packet */
-	janus_ice_queued_packet *pkt = g_malloc(sizeof(janus_ice_queued_packet));
-	pkt->data = g_malloc(length);
+	janus_ice_queued_packet *pkt = janus_ice_queued_packet_new(handle, length);
 	pkt->mindex = medium->mindex;
 	memcpy(pkt->data, buffer, length);
 	pkt->length = length;
@@ -5203,11 +8161,15 @@ void janus_ice_dtls_handshake_done(janus_ice_handle *handle) {
 		return;
 	}
 	janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_READY);
-	/* Create a source for RTCP and one for stats */
-	handle->rtcp_source = g_timeout_source_new_seconds(1);
-	g_source_set_priority(handle->rtcp_source, G_PRIORITY_DEFAULT);
-	g_source_set_callback(handle->rtcp_source, janus_ice_outgoing_rtcp_handle, handle, NULL);
-	g_source_attach(handle->rtcp_source, handle->mainctx);
+	/* Create a source for RTCP (unless the static loop serves it) and one for stats */
+	if(handle->static_event_loop != NULL) {
+		janus_ice_static_event_loop_rtcp_add((janus_ice_static_event_loop *)handle->static_event_loop, handle);
+	} else {
+		handle->rtcp_source = janus_ice_rtcp_timer_create();
+		g_source_set_priority(handle->rtcp_source, G_PRIORITY_DEFAULT);
+		g_source_set_callback(handle->rtcp_source, janus_ice_outgoing_rtcp_handle, handle, NULL);
+		g_source_attach(handle->rtcp_source, handle->mainctx);
+	}
 	if(twcc_period != 1000) {
 		/* The Transport Wide CC feedback period is different, create another source */
 		handle->twcc_source = g_timeout_source_new(twcc_period);
@@ -5244,7 +8206,7 @@ void janus_ice_dtls_handshake_done(janus_ice_handle *handle) {
 	JANUS_LOG(LOG_VERB, "[%"SCNu64"] Sending event to transport...; %p\n", handle->handle_id, handle);
 	janus_session_notify_event(session, event);
 	/* Notify event handlers as well */
-	if(janus_events_is_enabled()) {
+	if(janus_events_is_type_enabled(JANUS_EVENT_TYPE_WEBRTC)) {
 		json_t *info = json_object();
 		json_object_set_new(info, "connection", json_string("webrtcup"));
 		janus_events_notify_handlers(JANUS_EVENT_TYPE_WEBRTC, JANUS_EVENT_SUBTYPE_WEBRTC_STATE,
@@ -28,10 +28,12 @@
 #include "dtls.h"
 #include "sctp.h"
 #include "rtcp.h"
+#include "bwe.h"
 #include "text2pcap.h"
 #include "utils.h"
 #include "ip-utils.h"
 #include "refcount.h"
+#include "ring.h"
 #include "plugins/plugin.h"
 
 
@@ -174,6 +176,18 @@ void janus_set_min_nack_queue(uint16_t mnq);
 /*! \brief Method to get the current min NACK value (i.e., the minimum time window of packets per handle to store for retransmissions)
  * @returns The current min NACK value */
 uint16_t janus_get_min_nack_queue(void);
+/*! \brief Method to configure the retransmission budget of PeerConnections: when set,
+ * retransmissions requested via NACK that exceed the budget are not sent, which
+ * prevents peers on bad links from starving the others served by the same loop
+ * @param[in] bitrate Maximum bitrate retransmissions can use, in bits per second (0 for no limit)
+ * @param[in] ratio Maximum bitrate retransmissions can use, as a percentage of the media we send (0 for no limit) */
+void janus_set_retransmit_budget(uint32_t bitrate, uint16_t ratio);
+/*! \brief Method to get the maximum bitrate retransmissions can use (see above)
+ * @returns The maximum bitrate, in bits per second (0 if there's no limit) */
+uint32_t janus_get_retransmit_budget_bitrate(void);
+/*! \brief Method to get the maximum bitrate retransmissions can use, relative to the media we send (see above)
+ * @returns The maximum percentage (0 if there's no limit) */
+uint16_t janus_get_retransmit_budget_ratio(void);
 /*! \brief Method to enable/disable the NACK optimizations on outgoing keyframes: when
  * enabled, the NACK buffer for a PeerConnection is cleaned any time Janus sends a
  * keyframe, as any missing packet won't be needed since the keyframe will allow the
@@ -208,12 +222,63 @@ void janus_set_dscp(int dscp);
 /*! \brief Method to get the current DSCP value (see above)
  * @returns The current DSCP value (0 if disabled) */
 int janus_get_dscp(void);
+/*! \brief Method to enable batched receive on PeerConnections, and set the batch size:
+ * when enabled, once a pair is selected the component socket is drained with
+ * vectored reads instead of one libnice callback per datagram (disabled by default)
+ * @param[in] size The maximum number of datagrams to read at once (0 to disable) */
+void janus_ice_set_recv_batch_size(uint16_t size);
+/*! \brief Method to get the current batched receive size (see above)
+ * @returns The current batch size (0 if disabled) */
+uint16_t janus_ice_get_recv_batch_size(void);
+/*! \brief Method to enable batched send on PeerConnections, and set the batch size:
+ * when enabled, the SRTP packets protected in a single iteration of the handle loop
+ * are sent at the end with a single call, rather than one by one (disabled by default)
+ * @param[in] size The maximum number of packets to send at once (0 to disable) */
+void janus_ice_set_send_batch_size(uint16_t size);
+/*! \brief Method to get the current batched send size (see above)
+ * @returns The current batch size (0 if disabled) */
+uint16_t janus_ice_get_send_batch_size(void);
+/*! \brief Method to enable the single-port mode: rather than having libnice bind ports
+ * for each PeerConnection, all the PeerConnections served by a static event loop share
+ * a single UDP socket, and datagrams are demultiplexed by ICE username and remote address
+ * \note Only available in ICE Lite mode, with half-trickle, static event loops and an IPv4
+ * local address: each loop listens on a port of its own, starting from the provided one,
+ * while handles on a dedicated loop keep on using libnice sockets
+ * @param[in] port The port the first static event loop should listen on (0 to disable)
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_ice_set_single_port(uint16_t port);
+/*! \brief Method to get the first port used in single-port mode (see above)
+ * @returns The first port, or 0 if the single-port mode is disabled */
+uint16_t janus_ice_get_single_port(void);
+/*! \brief Method to enable or disable pacing of outgoing video packets: when enabled,
+ * video packets are spread over time using a leaky bucket, whose rate is derived
+ * from the bandwidth estimate of the PeerConnection and/or the configured cap
+ * @param[in] enabled Whether pacing should be enabled or not
+ * @param[in] max_bitrate Maximum bitrate to pace at, in bits per second (0 to only use the estimate) */
+void janus_ice_set_pacing(gboolean enabled, uint32_t max_bitrate);
+/*! \brief Method to check whether pacing is enabled (see above)
+ * @returns TRUE if pacing is enabled, FALSE otherwise */
+gboolean janus_ice_is_pacing_enabled(void);
+/*! \brief Method to get the maximum bitrate to pace at (see above)
+ * @returns The maximum bitrate, in bits per second (0 if only the estimate is used) */
+uint32_t janus_ice_get_pacing_bitrate(void);
 /*! \brief Method to modify the event handler statistics period (i.e., the number of seconds that should pass before Janus notifies event handlers about media statistics for a PeerConnection)
  * @param[in] period The new period value, in seconds */
 void janus_ice_set_event_stats_period(int period);
 /*! \brief Method to get the current event handler statistics period (see above)
  * @returns The current event handler stats period */
 int janus_ice_get_event_stats_period(void);
+/*! \brief Method to enable or disable packet tracing, i.e., sampling one incoming
+ * packet out of N and tracking how long it spends in each stage of the media pipeline
+ * @param[in] sampling How many packets to sample one out of (0 disables tracing) */
+void janus_ice_set_packet_tracing(int sampling);
+/*! \brief Method to get the current packet tracing sampling (see above)
+ * @returns The current sampling, or 0 if packet tracing is disabled */
+int janus_ice_get_packet_tracing(void);
+/*! \brief Method to get a summary of the stage latencies of traced packets, per plugin and per loop
+ * @param[in] reset Whether the collected statistics should be reset after returning them
+ * @returns A JSON object with the percentiles of each stage, in microseconds */
+json_t *janus_ice_packet_tracing_summary(gboolean reset);
 /*! \brief Method to get the number of active PeerConnection (for stats)
  * @returns The current number of active PeerConnections */
 int janus_ice_get_peerconnection_num(void);
@@ -327,22 +392,71 @@ void janus_ice_notify_hangup(janus_ice_handle *handle, const char *reason);
 gboolean janus_plugin_session_is_alive(janus_plugin_session *plugin_session);
 
 
-/*! \brief A helper struct for determining when to send NACKs */
-typedef struct janus_seq_info {
-	gint64 ts;
-	guint16 seq;
-	guint16 state;
-	struct janus_seq_info *next;
-	struct janus_seq_info *prev;
-} janus_seq_info;
-void janus_seq_list_free(janus_seq_info **head);
-enum {
-	SEQ_MISSING,
-	SEQ_NACKED,
-	SEQ_GIVEUP,
-	SEQ_RECVED
-};
+/*! \brief Number of sequence numbers the loss tracker has room for (a power of two, larger than LAST_SEQS_MAX_LEN) */
+#define JANUS_ICE_LOSS_TRACKER_SIZE	256
+/*! \brief A helper struct for determining when to send NACKs
+ * \details Sequence numbers are mapped to slots of a ring, and their state
+ * is tracked in bitmaps, so that no allocation is needed when packets are lost */
+typedef struct janus_ice_loss_tracker {
+	/*! \brief Whether we received any packet yet */
+	gboolean started;
+	/*! \brief Highest sequence number received so far */
+	guint16 highest;
+	/*! \brief How many sequence numbers (up to LAST_SEQS_MAX_LEN, and ending with highest) we're tracking */
+	guint16 count;
+	/*! \brief How many of the sequence numbers we're tracking are still missing */
+	guint16 missing_count;
+	/*! \brief Bitmap of the sequence numbers that are missing */
+	guint32 missing[JANUS_ICE_LOSS_TRACKER_SIZE/32];
+	/*! \brief Bitmap of the missing sequence numbers we sent a first NACK for already */
+	guint32 nacked[JANUS_ICE_LOSS_TRACKER_SIZE/32];
+	/*! \brief When each missing sequence number was detected as such */
+	gint64 ts[JANUS_ICE_LOSS_TRACKER_SIZE];
+} janus_ice_loss_tracker;
+/*! \brief Reset a loss tracker, e.g., after a keyframe or an SSRC change
+ * @param[in] tracker The janus_ice_loss_tracker instance to reset */
+void janus_ice_loss_tracker_reset(janus_ice_loss_tracker *tracker);
+
+
+/*! \brief Leaky bucket pacer for the outgoing video packets of a handle */
+typedef struct janus_ice_pacer {
+	/*! \brief Packets waiting to be sent */
+	GQueue packets;
+	/*! \brief Size of the packets waiting to be sent */
+	guint bytes;
+	/*! \brief Bytes we can send right now (negative if we're in debt) */
+	gint64 budget;
+	/*! \brief When the budget was last refilled */
+	gint64 last_refill;
+	/*! \brief Current pacing rate, in bits per second (0 if we're not pacing) */
+	guint32 rate;
+	/*! \brief Packets that had to wait in the queue, and packets we sent ahead of time because they waited too long */
+	guint64 paced, flushed;
+	/*! \brief Highest number of packets we've seen waiting in the queue, and longest time one waited */
+	guint max_packets;
+	gint64 max_delay;
+} janus_ice_pacer;
 
+/*! \brief Lanes of the outgoing queue of a handle, in order of priority: the loop
+ * always sends what's in a lane before looking at the ones that come after it */
+typedef enum janus_ice_lane {
+	/*! \brief RTCP (feedback, reports) */
+	JANUS_ICE_LANE_CONTROL = 0,
+	/*! \brief Audio packets */
+	JANUS_ICE_LANE_AUDIO,
+	/*! \brief Retransmissions (NACK responses) */
+	JANUS_ICE_LANE_RETRANSMISSION,
+	/*! \brief Video packets */
+	JANUS_ICE_LANE_VIDEO,
+	/*! \brief Data channel messages */
+	JANUS_ICE_LANE_DATA,
+	/*! \brief Number of lanes */
+	JANUS_ICE_LANES
+} janus_ice_lane;
+/*! \brief Helper method to get a string representation of an outgoing queue lane
+ * @param[in] lane The lane
+ * @returns A string representation of the lane */
+const char *janus_ice_lane_str(janus_ice_lane lane);
 
 /*! \brief Janus ICE handle */
 struct janus_ice_handle {
@@ -370,10 +484,29 @@ struct janus_ice_handle {
 	GMainLoop *mainloop;
 	/*! \brief In case static event loops are used, opaque pointer to the loop */
 	void *static_event_loop;
+	/*! \brief In case static event loops are used, group of handles this handle shares the loop with, if any */
+	char *loop_group;
+	/*! \brief In case static event loops are used, loop the handle will move to when it has no PeerConnection, and loop it's moving to right now */
+	void *migrate_pending, *migrate_to;
+	/*! \brief How many times the handle moved to a different static event loop */
+	guint migrations;
+	/*! \brief Whether a plugin asked for this handle to share the loop with another one, and so it shouldn't be rebalanced */
+	gboolean colocated;
+	/*! \brief Whether a plugin asked for this handle to be served with as little latency as possible
+	 * (no pacing, and its outgoing packets dispatched before those of other handles on the same loop) */
+	volatile gint low_latency;
+	/*! \brief In case static event loops are used, load counters of the handle (only updated by its loop),
+	 * and the resulting rates (packets per second, busy time in permille), updated every second */
+	guint64 load_packets, load_last_packets;
+	gint64 load_busy, load_last_busy, load_last_update;
+	volatile gint load_pps, load_utilization;
 	/*! \brief GLib thread for the handle and libnice */
 	GThread *thread;
 	/*! \brief GLib sources for outgoing traffic, recurring RTCP, and stats (and optionally TWCC) */
 	GSource *rtp_source, *rtcp_source, *stats_source, *twcc_source;
+	/*! \brief In case static event loops are used, link and slot of the handle in the loop RTCP scheduler */
+	GList *rtcp_link;
+	gint rtcp_slot;
 	/*! \brief libnice ICE agent */
 	NiceAgent *agent;
 	/*! \brief Monotonic time of when the ICE agent has been created */
@@ -400,8 +533,21 @@ struct janus_ice_handle {
 	GList *pending_trickles;
 	/*! \brief Queue of remote candidates that still need to be processed */
 	GAsyncQueue *queued_candidates;
-	/*! \brief Queue of events in the loop and outgoing packets to send */
+	/*! \brief Queue of events in the loop, that are handled before any outgoing packet */
 	GAsyncQueue *queued_packets;
+	/*! \brief Lock-free queues of outgoing packets from plugins (and retransmissions), that the loop will send,
+	 * one per lane (each is only allocated when the first packet for that lane is queued) */
+	janus_ring *outgoing_lanes[JANUS_ICE_LANES];
+	/*! \brief Atomic flag to avoid waking up the loop for every packet pushed to the queue */
+	volatile gint outgoing_wakeup;
+	/*! \brief Highest number of packets we've seen waiting in the outgoing queue, overall and in each lane */
+	guint outgoing_packets_max, outgoing_lanes_max[JANUS_ICE_LANES];
+	/*! \brief Number of outgoing packets we dropped because the queue was full, overall and in each lane */
+	volatile gint outgoing_packets_dropped, outgoing_lanes_dropped[JANUS_ICE_LANES];
+	/*! \brief Number of outgoing packets sent right away, as the plugin relayed them from the loop of the handle */
+	guint64 outgoing_packets_direct;
+	/*! \brief Pacer for outgoing video packets, if pacing is enabled */
+	janus_ice_pacer *pacer;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
 	guint srtp_errors_count;
 	/*! \brief Count of the recent SRTP replay errors, in order to avoid spamming the logs */
@@ -420,10 +566,25 @@ struct janus_ice_handle {
 	volatile gint closepc;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
-	/*! \brief Reference counter for this instance */
-	janus_refcount ref;
+	/*! \brief Reference counter for this instance (in a cache line of its own,
+	 * as both the event loop and plugin threads update it all the time) */
+	JANUS_REFCOUNT_HOT(ref);
 };
 
+/*! \brief Number of transport wide sequence numbers we can track between two feedbacks (a power of two) */
+#define JANUS_ICE_TWCC_WINDOW	2048
+/*! \brief Reception times of incoming packets, indexed by (extended) transport wide sequence number */
+typedef struct janus_ice_twcc_window {
+	/*! \brief Extended sequence number of the packet whose time is in each slot */
+	guint32 seqs[JANUS_ICE_TWCC_WINDOW];
+	/*! \brief Reception time of the packet in each slot */
+	guint64 timestamps[JANUS_ICE_TWCC_WINDOW];
+	/*! \brief Lowest and highest sequence numbers received since the last feedback */
+	guint32 lowest, highest;
+	/*! \brief Number of packets received since the last feedback */
+	guint pending;
+} janus_ice_twcc_window;
+
 /*! \brief Janus handle WebRTC PeerConnection */
 struct janus_ice_peerconnection {
 	/*! \brief Janus ICE handle this stream belongs to */
@@ -458,6 +619,18 @@ struct janus_ice_peerconnection {
 	GSource *dtlsrt_source;
 	/*! \brief DTLS-SRTP stack */
 	janus_dtls_srtp *dtls;
+	/*! \brief Source draining the selected socket in batches, if batched receive is enabled */
+	GSource *recv_batch_source;
+	/*! \brief Number of batched reads performed, and of the datagrams they returned */
+	guint64 recv_batches, recv_batch_packets;
+	/*! \brief Static event loop whose socket this PeerConnection shares, in single-port mode (NULL otherwise) */
+	void *mux;
+	/*! \brief Local ICE credentials the shared socket knows this PeerConnection by */
+	gchar *mux_ufrag, *mux_pwd;
+	/*! \brief Remote addresses the peer sent valid connectivity checks from */
+	GArray *mux_addresses;
+	/*! \brief Remote address the peer nominated, as an integer (IPv4 address and port) */
+	guint64 mux_remote;
 	/*! \brief SDES mid RTP extension ID */
 	gint mid_ext_id;
 	/*! \brief RTP Stream extension ID, and the related rtx one */
@@ -486,10 +659,17 @@ struct janus_ice_peerconnection {
 	guint16 transport_wide_cc_cycles;
 	/*! \brief Transport wide cc rtp ext ID */
 	guint transport_wide_cc_feedback_count;
-	/*! \brief GLib list of transport wide cc stats in reverse received order */
-	GSList *transport_wide_received_seq_nums;
+	/*! \brief Reception times of the packets received since the last transport wide cc feedback */
+	janus_ice_twcc_window *transport_wide_received;
+	/*! \brief Send-side bandwidth estimator fed by the transport wide cc feedback we receive
+	 * \note Only created when the plugin is interested in the estimate */
+	janus_bwe_context *bwe;
 	/*! \brief Latest REMB feedback we received */
 	uint32_t remb_bitrate;
+	/*! \brief Bytes we can still retransmit, and when the retransmission budget was last refilled */
+	gint64 retransmit_budget, retransmit_budget_refill;
+	/*! \brief Retransmissions we didn't send because of the budget, and duplicate NACKs we ignored */
+	guint64 retransmit_denied, retransmit_duplicates;
 	/*! \brief DTLS role of the server for this stream */
 	janus_dtls_role dtls_role;
 	/*! \brief Data exchanged for DTLS handshakes and messages */
@@ -531,6 +711,46 @@ struct janus_ice_peerconnection {
 	janus_refcount ref;
 };
 
+/*! \brief Slot in the ring of packets sent on a medium, in case we receive NACKs */
+typedef struct janus_ice_retransmit_slot {
+	/*! \brief The packet: its buffer is allocated once, and reused for the packets that take this slot after it */
+	janus_rtp_packet packet;
+	/*! \brief Size of the buffer allocated for the slot */
+	gint allocated;
+	/*! \brief Sequence number of the packet in the slot */
+	guint16 seq;
+	/*! \brief Whether the slot contains a packet */
+	gboolean used;
+} janus_ice_retransmit_slot;
+/*! \brief Ring of packets sent on a medium, indexed by sequence number, in case we receive NACKs */
+typedef struct janus_ice_retransmit_ring {
+	/*! \brief The slots (a power of two), where a packet with sequence number N is at N & mask */
+	janus_ice_retransmit_slot *slots;
+	/*! \brief Number of slots, and mask to find the slot of a sequence number */
+	guint size, mask;
+	/*! \brief Number of slots currently in use */
+	guint count;
+	/*! \brief Sequence numbers of the oldest and most recent packets in the ring */
+	guint16 oldest, newest;
+} janus_ice_retransmit_ring;
+/*! \brief Precompiled layout of the RTP extensions the core adds to all the outgoing
+ * packets of a medium (abs-send-time, transport-wide CC and mid), using one-byte headers */
+typedef struct janus_ice_extension_plan {
+	/*! \brief Whether the plan has been computed */
+	gboolean ready;
+	/*! \brief Whether this plan is for video packets */
+	gboolean video;
+	/*! \brief Extension IDs and mid the plan was computed for, to detect renegotiations */
+	int mid_ext_id, abs_send_time_ext_id, transport_wide_cc_ext_id;
+	const char *mid;
+	/*! \brief Template of the extensions (without the RFC5285 header) */
+	char data[32];
+	/*! \brief Length of the template */
+	uint8_t length;
+	/*! \brief Offsets of the dynamic values in the template (-1 if not there) */
+	int8_t abs_send_time_offset, transport_wide_cc_offset;
+} janus_ice_extension_plan;
+
 #define LAST_SEQS_MAX_LEN 160
 /*! \brief A single media in a PeerConnection */
 struct janus_ice_peerconnection_medium {
@@ -570,6 +790,10 @@ struct janus_ice_peerconnection_medium {
 	GHashTable *rtx_payload_types;
 	/*! \brief Mapping of payload types to their clock rates, as advertised in the SDP */
 	GHashTable *clock_rates;
+	/*! \brief Hash of the remote m-line we last processed (0 if it must be processed again in renegotiations) */
+	guint64 remote_mline_hash;
+	/*! \brief Whether the remote m-line we last processed negotiated RFC4588 */
+	gboolean remote_mline_rtx;
 	/*! \brief RTP payload types for this medium */
 	gint payload_type, rtx_payload_type;
 	/*! \brief Codec used in this medium */
@@ -596,10 +820,13 @@ struct janus_ice_peerconnection_medium {
 	guint32 last_rtp_ts;
 	/*! \brief Whether we should do NACKs (in or out) for this medium */
 	gboolean do_nacks;
-	/*! \brief List of previously sent janus_rtp_packet RTP packets, in case we receive NACKs */
-	GQueue *retransmit_buffer;
-	/*! \brief HashTable of retransmittable sequence numbers, in case we receive NACKs */
-	GHashTable *retransmit_seqs;
+	/*! \brief Ring of previously sent RTP packets, in case we receive NACKs (freed again when it stays empty for a while) */
+	janus_ice_retransmit_ring *retransmit_ring;
+	/*! \brief Memory the ring of sent packets is using (only updated by the loop), and since when it's been empty */
+	guint64 retransmit_bytes;
+	gint64 retransmit_empty_since;
+	/*! \brief Precompiled layout of the RTP extensions we add to outgoing packets */
+	janus_ice_extension_plan extension_plan;
 	/*! \brief Current sequence number for the RFC4588 rtx SSRC session */
 	guint16 rtx_seq_number;
 	/*! \brief Last time a log message about sending retransmits was printed */
@@ -610,8 +837,9 @@ struct janus_ice_peerconnection_medium {
 	gint64 nack_sent_log_ts;
 	/*! \brief Number of NACKs sent since last log message */
 	guint nack_sent_recent_cnt;
-	/*! \brief List of recently received sequence numbers (as a support to NACK generation, for each simulcast SSRC) */
-	janus_seq_info *last_seqs[3];
+	/*! \brief Trackers of recently received sequence numbers (as a support to NACK generation, for each simulcast SSRC),
+	 * only allocated when we start receiving packets we may have to NACK */
+	janus_ice_loss_tracker *loss_trackers[3];
 	/*! \brief Stats for incoming data (audio/video/data) */
 	janus_ice_stats in_stats;
 	/*! \brief Stats for outgoing data (audio/video/data) */
@@ -622,8 +850,9 @@ struct janus_ice_peerconnection_medium {
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
-	/*! \brief Reference counter for this instance */
-	janus_refcount ref;
+	/*! \brief Reference counter for this instance (in a cache line of its own,
+	 * as it's updated for each packet by both the event loop and plugins) */
+	JANUS_REFCOUNT_HOT(ref);
 };
 /*! \brief Method to quickly create a medium to be added to a handle PeerConnection
  * @note This will autogenerate SSRCs, if needed
@@ -680,8 +909,50 @@ janus_ice_handle *janus_ice_handle_create(void *core_session, const char *opaque
  * @param[in] plugin The plugin the ICE handle needs to be attached to
  * @param[in] loop_index In case static event loops are used, an indication on which loop to use for this handle
  * (-1 will let the core pick one; in case API selection is disabled in the settings, this value is ignored)
+ * @param[in] loop_group In case static event loops are used and the core picks the loop, an optional
+ * group (e.g., a room) whose handles should share the same loop, as long as it's not too busy
  * @returns 0 in case of success, a negative integer otherwise */
-gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle, janus_plugin *plugin, int loop_index);
+gint janus_ice_handle_attach_plugin(void *core_session, janus_ice_handle *handle, janus_plugin *plugin, int loop_index, const char *loop_group);
+/*! \brief Method to move a Janus ICE handle to a different static event loop
+ * \note Since an ICE agent can't be moved once created, handles with a PeerConnection
+ * are only moved when the next one is set up: if the handle is idle, it's moved right away
+ * @param[in] handle The Janus ICE handle to move
+ * @param[in] loop_index Index of the static event loop to move the handle to
+ * @returns 0 if the handle was moved, 1 if it will be moved later, a negative integer otherwise */
+int janus_ice_handle_migrate(janus_ice_handle *handle, int loop_index);
+/*! \brief Method to move a Janus ICE handle to the static event loop another handle is on
+ * \note This is meant for plugins bridging two handles (e.g., a 1:1 call): when both
+ * are on the same loop, the packets one receives can be relayed to the other one
+ * right away, from the same thread, without going through the outgoing queue. As
+ * for janus_ice_handle_migrate, handles with a PeerConnection are moved later
+ * @param[in] handle The Janus ICE handle to move
+ * @param[in] peer The Janus ICE handle whose loop we should move to
+ * @returns 0 if the handle was moved (or was there already), 1 if it will be moved later, a negative integer otherwise */
+int janus_ice_handle_colocate(janus_ice_handle *handle, janus_ice_handle *peer);
+/*! \brief Method to get how many packets are waiting in the outgoing queue of a Janus ICE handle
+ * @param[in] handle The Janus ICE handle to check
+ * @param[in] lane The lane to check, or JANUS_ICE_LANES for all of them
+ * @returns The number of packets waiting to be sent */
+guint janus_ice_handle_queued_packets(janus_ice_handle *handle, janus_ice_lane lane);
+/*! \brief Method to enable or disable the low-latency mode of a Janus ICE handle
+ * \note Low-latency handles are never paced, and their outgoing source has a higher
+ * priority on the loop they're on: when several handles have packets to send in the
+ * same iteration, the low-latency ones are served first. To avoid starving the other
+ * sources on the loop, the higher priority is only kept for a few dispatches in a row
+ * @param[in] handle The Janus ICE handle to update
+ * @param[in] enabled Whether the low-latency mode should be enabled or not */
+void janus_ice_handle_set_low_latency(janus_ice_handle *handle, gboolean enabled);
+/*! \brief Method to describe where a Janus ICE handle is running, and how busy it is
+ * @note This is only used by the Admin API
+ * @param[in] handle The Janus ICE handle to describe
+ * @returns a json_t object with the placement ("shared" or "dedicated") and the load of the handle */
+json_t *janus_ice_handle_placement_info(janus_ice_handle *handle);
+/*! \brief Method to estimate how much memory the core is using for a Janus ICE handle
+ * @note This is only used by the Admin API, and only accounts for what the core allocates
+ * for the handle, its PeerConnection and its media (not libnice, OpenSSL, libsrtp or plugins)
+ * @param[in] handle The Janus ICE handle to describe
+ * @returns a json_t object with the estimated size, in bytes, of the different parts of the handle */
+json_t *janus_ice_handle_memory_info(janus_ice_handle *handle);
 /*! \brief Method to destroy a Janus ICE handle
  * @param[in] core_session The core/peer session this ICE handle belongs to
  * @param[in] handle The Janus ICE handle to destroy
@@ -694,6 +965,13 @@ void janus_ice_webrtc_hangup(janus_ice_handle *handle, const char *reason);
 /*! \brief Method to only free resources related to a specific Webrtc PeerConnection allocated by a Janus ICE handle
  * @param[in] component The Janus ICE component instance to free */
 void janus_ice_peerconnection_destroy(janus_ice_peerconnection *pc);
+/*! \brief Helper to send a datagram on a PeerConnection, via libnice or via the shared socket in single-port mode
+ * @param[in] handle The Janus ICE handle the PeerConnection belongs to
+ * @param[in] pc The Janus PeerConnection to send the datagram on
+ * @param[in] buf The datagram to send
+ * @param[in] len The size of the datagram
+ * @returns The number of bytes sent, or a negative integer in case of errors */
+int janus_ice_peerconnection_send(janus_ice_handle *handle, janus_ice_peerconnection *pc, const char *buf, int len);
 ///@}
 
 
@@ -712,6 +990,38 @@ void janus_ice_relay_rtcp(janus_ice_handle *handle, janus_plugin_rtcp *packet);
  * @param[in] handle The Janus ICE handle associated with the peer
  * @param[in] packet The message to send */
 void janus_ice_relay_data(janus_ice_handle *handle, janus_plugin_data *packet);
+/*! \brief Core SCTP/DataChannel callback, called when a plugin has several messages to send to a peer at once
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] packets The messages to send, in order
+ * @param[in] count The number of messages */
+void janus_ice_relay_data_batch(janus_ice_handle *handle, janus_plugin_data *packets, int count);
+/*! \brief Maximum number of different loops a janus_ice_relay_batch keeps track of:
+ * loops beyond this number are woken up right away, rather than at the end */
+#define JANUS_ICE_RELAY_BATCH_CONTEXTS	16
+/*! \brief Loops to wake up after relaying packets to several handles at once */
+typedef struct janus_ice_relay_batch {
+	/*! \brief Handles whose loops need a wakeup (one per loop), with a reference each */
+	janus_ice_handle *handles[JANUS_ICE_RELAY_BATCH_CONTEXTS];
+	/*! \brief Number of handles in the array */
+	int count;
+} janus_ice_relay_batch;
+/*! \brief Core RTP callback, called when a plugin relays an RTP packet as part of a batch
+ * @note The packet is queued right away, but the loop of the handle is only woken
+ * up when janus_ice_relay_batch_wakeup is called on the batch
+ * @param[in] batch The batch to add the loop of the handle to
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] packet The RTP packet to send */
+void janus_ice_relay_rtp_batched(janus_ice_relay_batch *batch, janus_ice_handle *handle, janus_plugin_rtp *packet);
+/*! \brief Core SCTP/DataChannel callback, called when a plugin relays a message as part of a batch
+ * @note The message is queued right away, but the loop of the handle is only woken
+ * up when janus_ice_relay_batch_wakeup is called on the batch
+ * @param[in] batch The batch to add the loop of the handle to
+ * @param[in] handle The Janus ICE handle associated with the peer
+ * @param[in] packet The message to send */
+void janus_ice_relay_data_batched(janus_ice_relay_batch *batch, janus_ice_handle *handle, janus_plugin_data *packet);
+/*! \brief Wake up all the loops packets were queued to as part of a batch, and reset it
+ * @param[in] batch The batch to complete */
+void janus_ice_relay_batch_wakeup(janus_ice_relay_batch *batch);
 /*! \brief Helper core callback, called when a plugin wants to send a RTCP PLI to a peer
  * @param[in] handle The Janus ICE handle associated with the peer */
 void janus_ice_send_pli(janus_ice_handle *handle);
@@ -732,6 +1042,9 @@ void janus_ice_send_remb(janus_ice_handle *handle, uint32_t bitrate);
  * @param[in] length The buffer length */
 void janus_ice_incoming_data(janus_ice_handle *handle, char *label, char *protocol, gboolean textdata, char *buffer, int length);
 /*! \brief Core SCTP/DataChannel callback, called by the SCTP stack when when there's data to send.
+ * @note When called from the handle loop (i.e., while the loop itself is pushing
+ * a message to the SCTP stack), the data is encrypted and sent right away,
+ * rather than being copied and queued again
  * @param[in] handle The Janus ICE handle associated with the peer
  * @param[in] buffer The message data (buffer)
  * @param[in] length The buffer length */
@@ -789,6 +1102,34 @@ void janus_ice_resend_trickles(janus_ice_handle *handle);
  * @param[in] loops The number of static event loops to start (0 to disable the feature)
  * @param[in] allow_api Whether allocation on a specific loop driven via API should be allowed or not (false by default) */
 void janus_ice_set_static_event_loops(int loops, gboolean allow_api);
+/*! \brief Policies to place new handles on static event loops */
+typedef enum janus_ice_loop_placement {
+	/*! \brief Pick the loop with the fewest handles (default) */
+	JANUS_ICE_LOOP_PLACEMENT_HANDLES = 0,
+	/*! \brief Pick the least loaded loop, according to its utilization, packet rate and backlog */
+	JANUS_ICE_LOOP_PLACEMENT_LOAD
+} janus_ice_loop_placement;
+/*! \brief Method to configure how new handles are placed on static event loops
+ * @note Check the \c event_loops_placement property in the \c janus.jcfg configuration
+ * @param[in] placement Either "handles" (the default) or "load"
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_ice_set_static_event_loops_placement(const char *placement);
+/*! \brief Method to have handles move to a less loaded static event loop before a new PeerConnection is set up
+ * @note Check the \c event_loops_rebalance property in the \c janus.jcfg configuration
+ * @param[in] threshold How much busier (percentage points of utilization) a loop must be than the least loaded one (0 disables it) */
+void janus_ice_set_static_event_loops_rebalance(int threshold);
+/*! \brief Method to have busy handles promoted from a shared static event loop to one of their own
+ * (and back, when they're not busy anymore) before a new PeerConnection is set up
+ * @note Check the \c event_loops_promote_pps and related properties in the \c janus.jcfg configuration
+ * @param[in] pps Packets per second that make a handle busy (0 to ignore the packet rate)
+ * @param[in] busy Percentage of a loop's time that makes a handle busy (0 to ignore the dispatch cost)
+ * @param[in] max_dedicated How many dedicated loops can exist at the same time (0 means no limit) */
+void janus_ice_set_static_event_loops_promotion(int pps, int busy, int max_dedicated);
+/*! \brief Method to pin the static event loops to CPUs, to be called before janus_ice_set_static_event_loops
+ * @note Check the \c event_loops_affinity property in the \c janus.jcfg configuration
+ * @param[in] affinity Either "auto" (spread the loops on all CPUs, alternating NUMA nodes), or a list of CPUs (e.g., "0-3,8")
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_ice_set_static_event_loops_affinity(const char *affinity);
 /*! \brief Method to return the number of static event loops, if enabled
  * @returns The number of static event loops, if configured, or 0 if the feature is disabled */
 int janus_ice_get_static_event_loops(void);
@@ -799,6 +1140,15 @@ gboolean janus_ice_is_loop_indication_allowed(void);
  * @note This is only used by the Admin API
  * @returns a json_t array with the required info */
 json_t *janus_ice_static_event_loops_info(void);
+/*! \brief Helper method to add the static loops metrics (handles, busy time, utilization,
+ * queued packets) in the OpenMetrics text format
+ * @param[in] out The buffer to append the metrics to */
+void janus_ice_static_event_loops_metrics(GString *out);
+/*! \brief Helper method to return a summary of the pool of outgoing packets shared
+ * by handles that don't use static loops (static loops have their own, see above)
+ * @note This is only used by the Admin API
+ * @returns a json_t object with the pool hits, misses and resident size */
+json_t *janus_ice_shared_packet_pool_info(void);
 /*! \brief Method to stop all the static event loops, if enabled
  * @note This will wait for the related threads to exit, and so may delay the shutdown process */
 void janus_ice_stop_static_event_loops(void);
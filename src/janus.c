@@ -43,6 +43,7 @@
 #include "auth.h"
 #include "record.h"
 #include "events.h"
+#include "metrics.h"
 
 
 #define JANUS_NAME				"Janus WebRTC Server"
@@ -100,10 +101,14 @@ static struct janus_json_parameter incoming_request_parameters[] = {
 	{"janus", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"id", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
+static struct janus_json_parameter batch_parameters[] = {
+	{"requests", JANUS_JSON_ARRAY, JANUS_JSON_PARAM_REQUIRED}
+};
 static struct janus_json_parameter attach_parameters[] = {
 	{"plugin", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"opaque_id", JSON_STRING, 0},
 	{"loop_index", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"loop_group", JSON_STRING, 0},
 };
 static struct janus_json_parameter body_parameters[] = {
 	{"body", JSON_OBJECT, JANUS_JSON_PARAM_REQUIRED}
@@ -130,6 +135,21 @@ static struct janus_json_parameter admin_parameters[] = {
 static struct janus_json_parameter debug_parameters[] = {
 	{"debug", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter lockprof_parameters[] = {
+	{"enabled", JANUS_JSON_BOOL, 0},
+	{"sampling", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"reset", JANUS_JSON_BOOL, 0}
+};
+static struct janus_json_parameter getlockprof_parameters[] = {
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter pkttrace_parameters[] = {
+	{"sampling", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"reset", JANUS_JSON_BOOL, 0}
+};
+static struct janus_json_parameter getpkttrace_parameters[] = {
+	{"reset", JANUS_JSON_BOOL, 0}
+};
 static struct janus_json_parameter timeout_parameters[] = {
 	{"timeout", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
@@ -160,6 +180,10 @@ static struct janus_json_parameter st_parameters[] = {
 static struct janus_json_parameter ans_parameters[] = {
 	{"accept", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED}
 };
+static struct janus_json_parameter drain_parameters[] = {
+	{"drain", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED},
+	{"notify_plugins", JANUS_JSON_BOOL, 0}
+};
 static struct janus_json_parameter querytransport_parameters[] = {
 	{"transport", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"request", JSON_OBJECT, 0}
@@ -187,10 +211,26 @@ static struct janus_json_parameter customlogline_parameters[] = {
 static struct janus_json_parameter text2pcap_parameters[] = {
 	{"folder", JSON_STRING, 0},
 	{"filename", JSON_STRING, 0},
-	{"truncate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"truncate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"pcapng", JANUS_JSON_BOOL, 0},
+	{"headers_only", JANUS_JSON_BOOL, 0},
+	{"max_rate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"direction", JSON_STRING, 0},
+	{"media", JSON_STRING, 0},
+	{"ssrc", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"rtcp_only", JANUS_JSON_BOOL, 0},
+	{"sampling", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter migrate_parameters[] = {
+	{"loop_index", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter handleinfo_parameters[] = {
-	{"plugin_only", JANUS_JSON_BOOL, 0}
+	{"plugin_only", JANUS_JSON_BOOL, 0},
+	{"fields", JSON_ARRAY, 0}
+};
+static struct janus_json_parameter listing_parameters[] = {
+	{"limit", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"after", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter resaddr_parameters[] = {
 	{"address", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
@@ -202,8 +242,11 @@ static struct janus_json_parameter teststun_parameters[] = {
 };
 
 /* Admin/Monitor helpers */
-json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc);
-json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_medium *medium);
+json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc, gboolean stats_only);
+json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_medium *medium, gboolean stats_only);
+static json_t *janus_admin_peerconnection_media_summary(janus_ice_peerconnection *pc, gboolean stats_only);
+static void janus_admin_ids_page(json_t *reply, const char *name, GArray *ids, json_t *root);
+static gboolean janus_admin_wants_field(json_t *fields, const char *name);
 
 
 /* IP addresses */
@@ -297,6 +340,13 @@ static uint reclaim_session_timeout = DEFAULT_RECLAIM_SESSION_TIMEOUT;
  * change that in some cases, e.g., if we don't want the load on this
  * server to grow too much, or because we're draining the server. */
 static gboolean accept_new_sessions = TRUE;
+/* Draining goes further than that: new handles are rejected as well, and
+ * event handlers are kept posted on how many sessions and handles are left,
+ * so that an orchestrator knows when it's safe to shut the server down */
+static volatile gint draining = 0;
+static gint64 drain_started = 0;
+static gint drain_last_sessions = -1, drain_last_handles = -1;
+static janus_mutex drain_mutex = JANUS_MUTEX_INITIALIZER;
 
 /* We don't hold (trickle) candidates indefinitely either: by default, we
  * only store them for 45 seconds. After that, they're discarded, in order
@@ -313,6 +363,15 @@ static gboolean hide_dependencies = FALSE;
 /* By default we do not exit if a shared library cannot be loaded or is missing an expected symbol */
 static gboolean exit_on_dl_error = FALSE;
 
+/* Plugins and transports are initialized one after the other by default:
+ * as they don't depend on each other, though, we can optionally initialize
+ * them in parallel, which can speed up startups considerably when some of
+ * them (e.g., VideoRoom and Streaming) have a lot of static resources to
+ * create. We keep track of when all of them are loaded, and notify it */
+static gboolean parallel_init = FALSE;
+static volatile gint server_ready = 0;
+static gint64 startup_time = 0;
+
 /* WebRTC encryption is obviously enabled by default. In the rare cases
  * you want to disable it for debugging purposes, though, you can do
  * that either via command line (-w) or in the main configuration file */
@@ -340,7 +399,11 @@ static json_t *janus_info(const char *transaction) {
 #else
 	json_object_set_new(info, "data_channels", json_false());
 #endif
+	json_object_set_new(info, "ready", g_atomic_int_get(&server_ready) ? json_true() : json_false());
+	if(g_atomic_int_get(&server_ready))
+		json_object_set_new(info, "startup-time", json_integer(startup_time / 1000));
 	json_object_set_new(info, "accepting-new-sessions", accept_new_sessions ? json_true() : json_false());
+	json_object_set_new(info, "draining", g_atomic_int_get(&draining) ? json_true() : json_false());
 	json_object_set_new(info, "session-timeout", json_integer(global_session_timeout));
 	json_object_set_new(info, "reclaim-session-timeout", json_integer(reclaim_session_timeout));
 	json_object_set_new(info, "candidates-timeout", json_integer(candidates_timeout));
@@ -363,6 +426,8 @@ static json_t *janus_info(const char *transaction) {
 		json_object_set_new(info, "ipv6-link-local", janus_ice_is_ipv6_linklocal_enabled() ? json_true() : json_false());
 	json_object_set_new(info, "ice-lite", janus_ice_is_ice_lite_enabled() ? json_true() : json_false());
 	json_object_set_new(info, "ice-tcp", janus_ice_is_ice_tcp_enabled() ? json_true() : json_false());
+	if(janus_ice_get_single_port() > 0)
+		json_object_set_new(info, "ice-single-port", json_integer(janus_ice_get_single_port()));
 #ifdef HAVE_ICE_NOMINATION
 	json_object_set_new(info, "ice-nomination", json_string(janus_ice_get_nomination_mode()));
 #endif
@@ -372,7 +437,20 @@ static json_t *janus_info(const char *transaction) {
 	json_object_set_new(info, "mdns-enabled", janus_ice_is_mdns_enabled() ? json_true() : json_false());
 	json_object_set_new(info, "min-nack-queue", json_integer(janus_get_min_nack_queue()));
 	json_object_set_new(info, "nack-optimizations", janus_is_nack_optimizations_enabled() ? json_true() : json_false());
+	if(janus_get_retransmit_budget_bitrate() > 0)
+		json_object_set_new(info, "retransmit-budget", json_integer(janus_get_retransmit_budget_bitrate()));
+	if(janus_get_retransmit_budget_ratio() > 0)
+		json_object_set_new(info, "retransmit-ratio", json_integer(janus_get_retransmit_budget_ratio()));
 	json_object_set_new(info, "twcc-period", json_integer(janus_get_twcc_period()));
+	if(janus_ice_get_recv_batch_size() > 0)
+		json_object_set_new(info, "recv-batch-size", json_integer(janus_ice_get_recv_batch_size()));
+	if(janus_ice_get_send_batch_size() > 0)
+		json_object_set_new(info, "send-batch-size", json_integer(janus_ice_get_send_batch_size()));
+	if(janus_ice_is_pacing_enabled()) {
+		json_object_set_new(info, "pacing", json_true());
+		if(janus_ice_get_pacing_bitrate() > 0)
+			json_object_set_new(info, "pacing-bitrate", json_integer(janus_ice_get_pacing_bitrate()));
+	}
 	if(janus_get_dscp() > 0)
 		json_object_set_new(info, "dscp", json_integer(janus_get_dscp()));
 	json_object_set_new(info, "dtls-mtu", json_integer(janus_dtls_bio_agent_get_mtu()));
@@ -413,6 +491,7 @@ static json_t *janus_info(const char *transaction) {
 	#endif
 		json_object_set_new(deps, "crypto", json_string(janus_get_ssl_version()));
 		json_object_set_new(info, "dependencies", deps);
+		json_object_set_new(info, "srtp_profiles", janus_dtls_srtp_benchmarks_info());
 	}
 	/* Available transports */
 	json_t *t_data = json_object();
@@ -578,6 +657,7 @@ gboolean janus_transport_is_api_secret_valid(janus_transport *plugin, const char
 gboolean janus_transport_is_auth_token_needed(janus_transport *plugin);
 gboolean janus_transport_is_auth_token_valid(janus_transport *plugin, const char *token);
 void janus_transport_notify_event(janus_transport *plugin, void *transport, json_t *event);
+char *janus_transport_get_metrics(void);
 
 static janus_transport_callbacks janus_handler_transport =
 	{
@@ -589,11 +669,46 @@ static janus_transport_callbacks janus_handler_transport =
 		.is_auth_token_valid = janus_transport_is_auth_token_valid,
 		.events_is_enabled = janus_events_is_enabled,
 		.notify_event = janus_transport_notify_event,
+		.get_metrics = janus_transport_get_metrics,
 	};
-static GAsyncQueue *requests = NULL;
 static janus_request exit_message;
 static GThreadPool *tasks = NULL;
 void janus_transport_task(gpointer data, gpointer user_data);
+/* Incoming requests are dispatched to worker threads, each with its own
+ * queue. By default there's a single worker, that hands messages for
+ * plugins to the tasks pool; when more workers are configured, requests
+ * are hashed by session ID (or transport instance, if there's no session
+ * yet) and always processed in order by the worker they're assigned to */
+#define JANUS_REQUESTS_MAX_WORKERS	64
+static const char *janus_requests_types[] = {
+	"info", "ping", "create", "keepalive", "attach", "destroy", "detach",
+	"hangup", "claim", "message", "trickle", "batch", "admin", "other", NULL
+};
+#define JANUS_REQUESTS_TYPES		14
+static const gint64 janus_requests_buckets[] = {
+	100, 1000, 10000, 100000, 1000000, 0
+};
+static const char *janus_requests_buckets_names[] = {
+	"100us", "1ms", "10ms", "100ms", "1s", "more", NULL
+};
+#define JANUS_REQUESTS_BUCKETS		6
+typedef struct janus_requests_stats {
+	guint64 count;
+	gint64 max;
+	guint64 buckets[JANUS_REQUESTS_BUCKETS];
+} janus_requests_stats;
+typedef struct janus_requests_worker {
+	guint id;
+	GAsyncQueue *queue;
+	GThread *thread;
+	janus_requests_stats stats[JANUS_REQUESTS_TYPES];
+	janus_mutex mutex;
+} janus_requests_worker;
+static janus_requests_worker *requests_workers = NULL;
+static guint requests_workers_num = 0;
+static gboolean requests_ordered = FALSE;
+static janus_requests_worker *janus_requests_get_worker(janus_request *request);
+static json_t *janus_requests_info(void);
 ///@}
 
 
@@ -608,11 +723,16 @@ json_t *janus_plugin_handle_sdp(janus_plugin_session *plugin_session, janus_plug
 void janus_plugin_relay_rtp(janus_plugin_session *plugin_session, janus_plugin_rtp *packet);
 void janus_plugin_relay_rtcp(janus_plugin_session *plugin_session, janus_plugin_rtcp *packet);
 void janus_plugin_relay_data(janus_plugin_session *plugin_session, janus_plugin_data *message);
+void janus_plugin_relay_data_batch(janus_plugin_session *plugin_session, janus_plugin_data *messages, int count);
+void janus_plugin_relay_rtp_batch(janus_plugin_rtp_target *targets, int count);
+void janus_plugin_relay_data_batch_targets(janus_plugin_data_target *targets, int count);
 void janus_plugin_send_pli(janus_plugin_session *plugin_session);
 void janus_plugin_send_pli_stream(janus_plugin_session *plugin_session, int mindex);
 void janus_plugin_send_remb(janus_plugin_session *plugin_session, uint32_t bitrate);
 void janus_plugin_close_pc(janus_plugin_session *plugin_session);
 void janus_plugin_end_session(janus_plugin_session *plugin_session);
+int janus_plugin_colocate(janus_plugin_session *plugin_session, janus_plugin_session *peer_session);
+void janus_plugin_set_low_latency(janus_plugin_session *plugin_session, gboolean enabled);
 void janus_plugin_notify_event(janus_plugin *plugin, janus_plugin_session *plugin_session, json_t *event);
 gboolean janus_plugin_auth_is_signed(void);
 gboolean janus_plugin_auth_is_signature_valid(janus_plugin *plugin, const char *token);
@@ -623,11 +743,16 @@ static janus_callbacks janus_handler_plugin =
 		.relay_rtp = janus_plugin_relay_rtp,
 		.relay_rtcp = janus_plugin_relay_rtcp,
 		.relay_data = janus_plugin_relay_data,
+		.relay_data_batch = janus_plugin_relay_data_batch,
+		.relay_rtp_batch = janus_plugin_relay_rtp_batch,
+		.relay_data_batch_targets = janus_plugin_relay_data_batch_targets,
 		.send_pli = janus_plugin_send_pli,
 		.send_pli_stream = janus_plugin_send_pli_stream,
 		.send_remb = janus_plugin_send_remb,
 		.close_pc = janus_plugin_close_pc,
 		.end_session = janus_plugin_end_session,
+		.colocate = janus_plugin_colocate,
+		.set_low_latency = janus_plugin_set_low_latency,
 		.events_is_enabled = janus_events_is_enabled,
 		.notify_event = janus_plugin_notify_event,
 		.auth_is_signed = janus_plugin_auth_is_signed,
@@ -637,20 +762,74 @@ static janus_callbacks janus_handler_plugin =
 ///@}
 
 
-/* Core Sessions */
-static janus_mutex sessions_mutex;
-static GHashTable *sessions = NULL;
+/* Core Sessions: the registry is split in shards, indexed by session ID,
+ * each with its own lock, so that lookups and updates on different
+ * sessions don't all contend on the same mutex. Lookups only need a
+ * reader lock, while timeouts are tracked separately (see below) */
+#define JANUS_SESSIONS_SHARDS		64
+typedef struct janus_sessions_shard {
+	GRWLock lock;
+	GHashTable *table;
+} janus_sessions_shard;
+static janus_sessions_shard sessions[JANUS_SESSIONS_SHARDS];
 static GMainContext *sessions_watchdog_context = NULL;
 
+static janus_sessions_shard *janus_sessions_get_shard(guint64 session_id) {
+	/* Mix the bits, as session IDs may have been picked by applications */
+	session_id ^= session_id >> 33;
+	session_id *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+	session_id ^= session_id >> 33;
+	return &sessions[session_id % JANUS_SESSIONS_SHARDS];
+}
+
 /* Counters */
 static volatile gint sessions_num = 0;
 static volatile gint handles_num = 0;
 
+/* Drain status */
+static void janus_drain_notify(const char *status) {
+	if(!janus_events_is_enabled())
+		return;
+	json_t *info = json_object();
+	json_object_set_new(info, "status", json_string(status));
+	json_object_set_new(info, "sessions", json_integer(g_atomic_int_get(&sessions_num)));
+	json_object_set_new(info, "handles", json_integer(g_atomic_int_get(&handles_num)));
+	janus_mutex_lock(&drain_mutex);
+	if(drain_started > 0)
+		json_object_set_new(info, "draining-since", json_integer((janus_get_monotonic_time() - drain_started) / G_USEC_PER_SEC));
+	janus_mutex_unlock(&drain_mutex);
+	janus_events_notify_handlers(JANUS_EVENT_TYPE_CORE, JANUS_EVENT_SUBTYPE_CORE_DRAIN, 0, info);
+}
+/* Called by the sessions watchdog, to report how many sessions and handles are left */
+static void janus_drain_check(void) {
+	if(!g_atomic_int_get(&draining))
+		return;
+	gint sessions_left = g_atomic_int_get(&sessions_num), handles_left = g_atomic_int_get(&handles_num);
+	janus_mutex_lock(&drain_mutex);
+	gboolean changed = (sessions_left != drain_last_sessions || handles_left != drain_last_handles);
+	drain_last_sessions = sessions_left;
+	drain_last_handles = handles_left;
+	janus_mutex_unlock(&drain_mutex);
+	if(!changed)
+		return;
+	if(sessions_left == 0 && handles_left == 0) {
+		JANUS_LOG(LOG_INFO, "Janus has been drained, no sessions left\n");
+		janus_drain_notify("drained");
+	} else {
+		janus_drain_notify("draining");
+	}
+}
+
 static void janus_ice_handle_dereference(janus_ice_handle *handle) {
 	if(handle)
 		janus_refcount_decrease(&handle->ref);
 }
 
+static void janus_session_dereference(janus_session *session) {
+	if(session)
+		janus_refcount_decrease(&session->ref);
+}
+
 static void janus_session_free(const janus_refcount *session_ref) {
 	janus_session *session = janus_refcount_containerof(session_ref, janus_session, ref);
 	/* This session can be destroyed, free all the resources */
@@ -683,58 +862,235 @@ static void janus_request_unref(janus_request *request) {
 		janus_refcount_decrease(&request->ref);
 }
 
-static gboolean janus_check_sessions(gpointer user_data) {
-	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_session *session = (janus_session *) value;
-			if(!session || g_atomic_int_get(&session->destroyed))
-				continue;
-			gint64 now = janus_get_monotonic_time();
-			/* Use either session-specific timeout or global. */
-			gint64 timeout = (gint64)session->timeout;
-			if(timeout == -1)
-				timeout = (gint64)global_session_timeout;
-			if((timeout > 0 && (now - session->last_activity >= timeout * G_USEC_PER_SEC)) ||
-					((g_atomic_int_get(&session->transport_gone) && now - session->last_activity >= (gint64)reclaim_session_timeout * G_USEC_PER_SEC))) {
-				if(g_atomic_int_compare_and_exchange(&session->timedout, 0, 1)) {
-					JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session->session_id);
-					/* Mark the session as over, we'll deal with it later */
-					janus_session_handles_clear(session);
-					/* Notify the transport */
-					janus_request *source = janus_session_get_request(session);
-					if(source) {
-						json_t *event = janus_create_message("timeout", session->session_id, NULL);
-						/* Send this to the transport client and notify the session's over */
-						source->transport->send_message(source->instance, NULL, FALSE, event);
-						source->transport->session_over(source->instance, session->session_id, TRUE, FALSE);
-					}
-					janus_request_unref(source);
-					/* Notify event handlers as well */
-					if(janus_events_is_enabled())
-						janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, JANUS_EVENT_SUBTYPE_NONE,
-							session->session_id, "timeout", NULL);
-					/* FIXME Is this safe? apparently it causes hash table errors on the console */
-					g_hash_table_iter_remove(&iter);
-					janus_session_destroy(session);
-				}
-			}
+/* Removes a session from the registry, without destroying it */
+static void janus_session_remove(janus_session *session) {
+	janus_sessions_shard *shard = janus_sessions_get_shard(session->session_id);
+	g_rw_lock_writer_lock(&shard->lock);
+	if(g_hash_table_remove(shard->table, &session->session_id))
+		g_atomic_int_dec_and_test(&sessions_num);
+	g_rw_lock_writer_unlock(&shard->lock);
+}
+
+/* Session timeouts are tracked in a hierarchical timing wheel: each level
+ * has JANUS_SESSIONS_WHEEL_SLOTS slots, and each slot on a level covers as
+ * many ticks (seconds) as a whole lower level. Requests and keepalives only
+ * update the last activity of a session: its deadline is only checked again
+ * when its slot is reached, in which case it either expires or is moved to
+ * the slot of its new deadline. This way, the watchdog only needs to touch
+ * the sessions that are about to expire, rather than all of them */
+#define JANUS_SESSIONS_WHEEL_BITS	6
+#define JANUS_SESSIONS_WHEEL_SLOTS	(1 << JANUS_SESSIONS_WHEEL_BITS)
+#define JANUS_SESSIONS_WHEEL_MASK	(JANUS_SESSIONS_WHEEL_SLOTS - 1)
+#define JANUS_SESSIONS_WHEEL_LEVELS	3
+static struct janus_sessions_wheel {
+	janus_mutex mutex;
+	GQueue slots[JANUS_SESSIONS_WHEEL_LEVELS * JANUS_SESSIONS_WHEEL_SLOTS];
+	gint64 start;
+	guint64 current;
+	guint armed;
+	guint64 rearmed, expired;
+} sessions_wheel;
+
+/* Returns when a session should expire, or 0 if it never does */
+static gint64 janus_session_get_deadline(janus_session *session) {
+	gint64 deadline = 0;
+	gint64 timeout = (gint64)session->timeout;
+	if(timeout == -1)
+		timeout = (gint64)global_session_timeout;
+	if(timeout > 0)
+		deadline = session->last_activity + timeout * G_USEC_PER_SEC;
+	if(g_atomic_int_get(&session->transport_gone)) {
+		gint64 reclaim = session->last_activity + (gint64)reclaim_session_timeout * G_USEC_PER_SEC;
+		if(deadline == 0 || reclaim < deadline)
+			deadline = reclaim;
+	}
+	return deadline;
+}
+
+/* Must be called with the wheel mutex locked */
+static void janus_sessions_wheel_insert(janus_session *session, gint64 deadline) {
+	guint64 tick = deadline > sessions_wheel.start ?
+		(guint64)((deadline - sessions_wheel.start + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC) : 0;
+	if(tick <= sessions_wheel.current)
+		tick = sessions_wheel.current + 1;
+	guint64 delta = tick - sessions_wheel.current;
+	int level = 0;
+	while(level < JANUS_SESSIONS_WHEEL_LEVELS-1 && delta >= ((guint64)1 << (JANUS_SESSIONS_WHEEL_BITS * (level+1))))
+		level++;
+	if(delta >= ((guint64)1 << (JANUS_SESSIONS_WHEEL_BITS * JANUS_SESSIONS_WHEEL_LEVELS))) {
+		/* Too far in the future, park it as far as we can: we'll check again later */
+		tick = sessions_wheel.current + ((guint64)1 << (JANUS_SESSIONS_WHEEL_BITS * JANUS_SESSIONS_WHEEL_LEVELS)) - 1;
+	}
+	int slot = level * JANUS_SESSIONS_WHEEL_SLOTS +
+		((tick >> (JANUS_SESSIONS_WHEEL_BITS * level)) & JANUS_SESSIONS_WHEEL_MASK);
+	g_queue_push_tail_link(&sessions_wheel.slots[slot], &session->timer_link);
+	session->timer_slot = slot;
+}
+
+/* Must be called with the wheel mutex locked */
+static void janus_sessions_wheel_unlink(janus_session *session) {
+	g_queue_unlink(&sessions_wheel.slots[session->timer_slot], &session->timer_link);
+	session->timer_slot = -1;
+}
+
+/* (Re)arms the timer of a session according to its current deadline */
+static void janus_session_timer_arm(janus_session *session) {
+	janus_mutex_lock(&sessions_wheel.mutex);
+	if(g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&sessions_wheel.mutex);
+		return;
+	}
+	gint64 deadline = janus_session_get_deadline(session);
+	if(session->timer_slot != -1) {
+		janus_sessions_wheel_unlink(session);
+		if(deadline == 0) {
+			/* No timeout anymore */
+			sessions_wheel.armed--;
+			janus_mutex_unlock(&sessions_wheel.mutex);
+			janus_refcount_decrease(&session->ref);
+			return;
 		}
+	} else if(deadline > 0) {
+		/* The wheel keeps a reference for as long as the timer is armed */
+		janus_refcount_increase(&session->ref);
+		sessions_wheel.armed++;
+	}
+	if(deadline > 0)
+		janus_sessions_wheel_insert(session, deadline);
+	janus_mutex_unlock(&sessions_wheel.mutex);
+}
+
+/* Disarms the timer of a session, if any */
+static void janus_session_timer_disarm(janus_session *session) {
+	janus_mutex_lock(&sessions_wheel.mutex);
+	if(session->timer_slot == -1) {
+		janus_mutex_unlock(&sessions_wheel.mutex);
+		return;
 	}
-	janus_mutex_unlock(&sessions_mutex);
+	janus_sessions_wheel_unlink(session);
+	sessions_wheel.armed--;
+	janus_mutex_unlock(&sessions_wheel.mutex);
+	janus_refcount_decrease(&session->ref);
+}
+
+/* Re-evaluates all the sessions in a slot: the ones that expired are moved
+ * to the provided list (which inherits their reference), the others are
+ * moved to the slot of their current deadline. Must be called with the
+ * wheel mutex locked */
+static void janus_sessions_wheel_process(int slot, gint64 now, GList **expired, GList **released) {
+	GQueue pending = G_QUEUE_INIT;
+	GList *link = NULL;
+	/* Take all the sessions out of the slot first, in case some end up there again */
+	while((link = g_queue_pop_head_link(&sessions_wheel.slots[slot])) != NULL)
+		g_queue_push_tail_link(&pending, link);
+	while((link = g_queue_pop_head_link(&pending)) != NULL) {
+		janus_session *session = (janus_session *)link->data;
+		session->timer_slot = -1;
+		gint64 deadline = janus_session_get_deadline(session);
+		if(g_atomic_int_get(&session->destroyed) || deadline == 0) {
+			sessions_wheel.armed--;
+			*released = g_list_prepend(*released, session);
+		} else if(deadline <= now) {
+			sessions_wheel.armed--;
+			sessions_wheel.expired++;
+			*expired = g_list_prepend(*expired, session);
+		} else {
+			sessions_wheel.rearmed++;
+			janus_sessions_wheel_insert(session, deadline);
+		}
+	}
+}
+
+static void janus_session_expire(janus_session *session) {
+	if(g_atomic_int_get(&session->destroyed) || !g_atomic_int_compare_and_exchange(&session->timedout, 0, 1))
+		return;
+	JANUS_LOG(LOG_INFO, "Timeout expired for session %"SCNu64"...\n", session->session_id);
+	/* Mark the session as over, we'll deal with it later */
+	janus_session_handles_clear(session);
+	/* Notify the transport */
+	janus_request *source = janus_session_get_request(session);
+	if(source) {
+		json_t *event = janus_create_message("timeout", session->session_id, NULL);
+		/* Send this to the transport client and notify the session's over */
+		source->transport->send_message(source->instance, NULL, FALSE, event);
+		source->transport->session_over(source->instance, session->session_id, TRUE, FALSE);
+	}
+	janus_request_unref(source);
+	/* Notify event handlers as well */
+	if(janus_events_is_enabled())
+		janus_events_notify_handlers(JANUS_EVENT_TYPE_SESSION, JANUS_EVENT_SUBTYPE_NONE,
+			session->session_id, "timeout", NULL);
+	janus_session_remove(session);
+	janus_session_destroy(session);
+}
+
+static gboolean janus_check_sessions(gpointer user_data) {
+	GList *expired = NULL, *released = NULL;
+	gint64 now = janus_get_monotonic_time();
+	janus_mutex_lock(&sessions_wheel.mutex);
+	guint64 target = (guint64)((now - sessions_wheel.start) / G_USEC_PER_SEC);
+	while(sessions_wheel.current < target) {
+		sessions_wheel.current++;
+		/* When a lower level wraps, cascade the next slot of the level above */
+		int level = 1;
+		while(level < JANUS_SESSIONS_WHEEL_LEVELS &&
+				(sessions_wheel.current & (((guint64)1 << (JANUS_SESSIONS_WHEEL_BITS * level)) - 1)) == 0) {
+			level++;
+		}
+		while(--level > 0) {
+			janus_sessions_wheel_process(level * JANUS_SESSIONS_WHEEL_SLOTS +
+				((sessions_wheel.current >> (JANUS_SESSIONS_WHEEL_BITS * level)) & JANUS_SESSIONS_WHEEL_MASK),
+				now, &expired, &released);
+		}
+		janus_sessions_wheel_process(sessions_wheel.current & JANUS_SESSIONS_WHEEL_MASK, now, &expired, &released);
+	}
+	janus_mutex_unlock(&sessions_wheel.mutex);
+	/* Now that the wheel is unlocked, get rid of the sessions that expired */
+	GList *temp = expired;
+	while(temp) {
+		janus_session_expire((janus_session *)temp->data);
+		temp = temp->next;
+	}
+	g_list_free_full(expired, (GDestroyNotify)janus_session_dereference);
+	g_list_free_full(released, (GDestroyNotify)janus_session_dereference);
+	/* If we're draining, check how many sessions are left */
+	janus_drain_check();
 
 	return G_SOURCE_CONTINUE;
 }
 
+static json_t *janus_sessions_wheel_info(void) {
+	json_t *info = json_object();
+	janus_mutex_lock(&sessions_wheel.mutex);
+	json_object_set_new(info, "armed", json_integer(sessions_wheel.armed));
+	json_t *levels = json_array();
+	int level = 0, slot = 0;
+	for(level=0; level<JANUS_SESSIONS_WHEEL_LEVELS; level++) {
+		guint occupancy = 0, used = 0;
+		for(slot=0; slot<JANUS_SESSIONS_WHEEL_SLOTS; slot++) {
+			guint len = g_queue_get_length(&sessions_wheel.slots[level * JANUS_SESSIONS_WHEEL_SLOTS + slot]);
+			occupancy += len;
+			if(len > 0)
+				used++;
+		}
+		json_t *l = json_object();
+		json_object_set_new(l, "sessions", json_integer(occupancy));
+		json_object_set_new(l, "slots_used", json_integer(used));
+		json_array_append_new(levels, l);
+	}
+	json_object_set_new(info, "levels", levels);
+	json_object_set_new(info, "rearmed", json_integer(sessions_wheel.rearmed));
+	json_object_set_new(info, "expired", json_integer(sessions_wheel.expired));
+	janus_mutex_unlock(&sessions_wheel.mutex);
+	return info;
+}
+
 static gpointer janus_sessions_watchdog(gpointer user_data) {
 	GMainLoop *loop = (GMainLoop *) user_data;
 	GMainContext *watchdog_context = g_main_loop_get_context(loop);
 	GSource *timeout_source;
 
-	timeout_source = g_timeout_source_new_seconds(2);
+	timeout_source = g_timeout_source_new_seconds(1);
 	g_source_set_callback(timeout_source, janus_check_sessions, watchdog_context, NULL);
 	g_source_attach(timeout_source, watchdog_context);
 	g_source_unref(timeout_source);
@@ -785,25 +1141,32 @@ janus_session *janus_session_create(guint64 session_id) {
 	g_atomic_int_set(&session->destroyed, 0);
 	g_atomic_int_set(&session->timedout, 0);
 	g_atomic_int_set(&session->transport_gone, 0);
-	session->last_activity = janus_get_monotonic_time();
+	session->last_activity = janus_get_monotonic_time_coarse();
 	session->ice_handles = NULL;
+	session->timer_link.data = session;
+	session->timer_link.next = NULL;
+	session->timer_link.prev = NULL;
+	session->timer_slot = -1;
 	janus_mutex_init(&session->mutex);
-	janus_mutex_lock(&sessions_mutex);
-	g_hash_table_insert(sessions, janus_uint64_dup(session->session_id), session);
+	janus_sessions_shard *shard = janus_sessions_get_shard(session->session_id);
+	g_rw_lock_writer_lock(&shard->lock);
+	g_hash_table_insert(shard->table, janus_uint64_dup(session->session_id), session);
 	g_atomic_int_inc(&sessions_num);
-	janus_mutex_unlock(&sessions_mutex);
+	g_rw_lock_writer_unlock(&shard->lock);
+	janus_session_timer_arm(session);
 	return session;
 }
 
 janus_session *janus_session_find(guint64 session_id) {
-	janus_mutex_lock(&sessions_mutex);
-	janus_session *session = g_hash_table_lookup(sessions, &session_id);
+	janus_sessions_shard *shard = janus_sessions_get_shard(session_id);
+	g_rw_lock_reader_lock(&shard->lock);
+	janus_session *session = g_hash_table_lookup(shard->table, &session_id);
 	if(session != NULL) {
 		/* A successful find automatically increases the reference counter:
 		 * it's up to the caller to decrease it again when done */
 		janus_refcount_increase(&session->ref);
 	}
-	janus_mutex_unlock(&sessions_mutex);
+	g_rw_lock_reader_unlock(&shard->lock);
 	return session;
 }
 
@@ -832,6 +1195,7 @@ gint janus_session_destroy(janus_session *session) {
 	JANUS_LOG(LOG_INFO, "Destroying session %"SCNu64"; %p\n", session_id, session);
 	if(!g_atomic_int_compare_and_exchange(&session->destroyed, 0, 1))
 		return 0;
+	janus_session_timer_disarm(session);
 	janus_session_handles_clear(session);
 	/* The session will actually be destroyed when the counter gets to 0 */
 	janus_refcount_decrease(&session->ref);
@@ -943,6 +1307,9 @@ janus_request *janus_request_new(janus_transport *transport, janus_transport_ses
 	} else {
 		request->error = NULL;
 	}
+	request->received = janus_get_monotonic_time();
+	request->batch = NULL;
+	request->authorized = FALSE;
 	g_atomic_int_set(&request->destroyed, 0);
 	janus_refcount_init(&request->ref, janus_request_free);
 	return request;
@@ -954,14 +1321,13 @@ void janus_request_destroy(janus_request *request) {
 	janus_refcount_decrease(&request->ref);
 }
 
-static int janus_request_check_secret(janus_request *request, guint64 session_id, const gchar *transaction_text) {
+static int janus_message_check_secret(json_t *root) {
 	gboolean secret_authorized = FALSE, token_authorized = FALSE;
 	if(api_secret == NULL && !janus_auth_is_enabled()) {
 		/* Nothing to check */
 		secret_authorized = TRUE;
 		token_authorized = TRUE;
 	} else {
-		json_t *root = request->message;
 		if(api_secret != NULL) {
 			/* There's an API secret, check that the client provided it */
 			json_t *secret = json_object_get(root, "apisecret");
@@ -983,6 +1349,12 @@ static int janus_request_check_secret(janus_request *request, guint64 session_id
 	return 0;
 }
 
+static int janus_request_check_secret(janus_request *request, guint64 session_id, const gchar *transaction_text) {
+	if(request->authorized)
+		return 0;
+	return janus_message_check_secret(request->message);
+}
+
 static void janus_request_ice_handle_answer(janus_ice_handle *handle, char *jsep_sdp) {
 	/* We got our answer */
 	janus_flags_clear(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_PROCESSING_OFFER);
@@ -1045,6 +1417,71 @@ static void janus_request_ice_handle_answer(janus_ice_handle *handle, char *jsep
 	}
 }
 
+/* Processes all the requests in a batch, and sends a single response with
+ * all the individual responses, in the same order. Requests in the batch
+ * inherit the identifiers and credentials of the batch, if they have none */
+#define JANUS_BATCH_MAX_REQUESTS	1024
+static int janus_process_batch(janus_request *request, const gchar *transaction_text) {
+	json_t *root = request->message;
+	int error_code = 0;
+	char error_cause[100];
+	JANUS_VALIDATE_JSON_OBJECT(root, batch_parameters,
+		error_code, error_cause, FALSE,
+		JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+	if(error_code != 0)
+		return janus_process_error_string(request, 0, transaction_text, error_code, error_cause);
+	json_t *requests = json_object_get(root, "requests");
+	if(json_array_size(requests) > JANUS_BATCH_MAX_REQUESTS) {
+		return janus_process_error(request, 0, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE,
+			"Too many requests in batch (max %d)", JANUS_BATCH_MAX_REQUESTS);
+	}
+	/* Check the credentials once for the whole batch */
+	if(janus_request_check_secret(request, 0, transaction_text) != 0)
+		return janus_process_error(request, 0, transaction_text, JANUS_ERROR_UNAUTHORIZED, NULL);
+	static const char *inherited[] = { "session_id", "handle_id", "apisecret", "token", NULL };
+	json_t *responses = json_array();
+	size_t i = 0;
+	for(i=0; i<json_array_size(requests); i++) {
+		json_t *message = json_array_get(requests, i);
+		if(!json_is_object(message)) {
+			json_t *reply = janus_create_message("error", 0, NULL);
+			json_t *error_data = json_object();
+			json_object_set_new(error_data, "code", json_integer(JANUS_ERROR_INVALID_JSON_OBJECT));
+			json_object_set_new(error_data, "reason", json_string("Batched request is not an object"));
+			json_object_set_new(reply, "error", error_data);
+			json_array_append_new(responses, reply);
+			continue;
+		}
+		const char *type = json_string_value(json_object_get(message, "janus"));
+		if(type && !strcasecmp(type, "batch")) {
+			const char *transaction = json_string_value(json_object_get(message, "transaction"));
+			json_t *reply = janus_create_message("error", 0, transaction);
+			json_t *error_data = json_object();
+			json_object_set_new(error_data, "code", json_integer(JANUS_ERROR_INVALID_REQUEST_PATH));
+			json_object_set_new(error_data, "reason", json_string("Nested batches are not supported"));
+			json_object_set_new(reply, "error", error_data);
+			json_array_append_new(responses, reply);
+			continue;
+		}
+		int j = 0;
+		for(j=0; inherited[j] != NULL; j++) {
+			json_t *value = json_object_get(root, inherited[j]);
+			if(value && !json_object_get(message, inherited[j]))
+				json_object_set(message, inherited[j], value);
+		}
+		json_incref(message);
+		janus_request *sub = janus_request_new(request->transport, request->instance, NULL, FALSE, message, NULL);
+		sub->batch = responses;
+		sub->authorized = TRUE;
+		janus_process_incoming_request(sub);
+		janus_request_destroy(sub);
+	}
+	/* Send all the responses at once */
+	json_t *reply = janus_create_message("success", 0, transaction_text);
+	json_object_set_new(reply, "responses", responses);
+	return janus_process_success(request, reply);
+}
+
 int janus_process_incoming_request(janus_request *request) {
 	int ret = -1;
 	if(request == NULL) {
@@ -1093,6 +1530,11 @@ int janus_process_incoming_request(janus_request *request) {
 	json_t *message = json_object_get(root, "janus");
 	const gchar *message_text = json_string_value(message);
 
+	if(!strcasecmp(message_text, "batch")) {
+		/* Multiple requests at once, each with its own path */
+		ret = janus_process_batch(request, transaction_text);
+		goto jsondone;
+	}
 	if(session_id == 0 && handle_id == 0) {
 		/* Can only be a 'Create new session', a 'Get info' or a 'Ping/Pong' request */
 		if(!strcasecmp(message_text, "info")) {
@@ -1110,6 +1552,10 @@ int janus_process_incoming_request(janus_request *request) {
 			goto jsondone;
 		}
 		/* Make sure we're accepting new sessions */
+		if(g_atomic_int_get(&draining)) {
+			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_DRAINING, NULL);
+			goto jsondone;
+		}
 		if(!accept_new_sessions) {
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_NOT_ACCEPTING_SESSIONS, NULL);
 			goto jsondone;
@@ -1195,7 +1641,7 @@ int janus_process_incoming_request(janus_request *request) {
 		goto jsondone;
 	}
 	/* Update the last activity timer */
-	session->last_activity = janus_get_monotonic_time();
+	session->last_activity = janus_get_monotonic_time_coarse();
 	handle = NULL;
 	if(handle_id > 0) {
 		handle = janus_session_handles_find(session, handle_id);
@@ -1219,6 +1665,11 @@ int janus_process_incoming_request(janus_request *request) {
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_REQUEST_PATH, "Unhandled request '%s' at this path", message_text);
 			goto jsondone;
 		}
+		if(g_atomic_int_get(&draining)) {
+			/* We're being drained, so no new handles either */
+			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_DRAINING, NULL);
+			goto jsondone;
+		}
 		JANUS_VALIDATE_JSON_OBJECT(root, attach_parameters,
 			error_code, error_cause, FALSE,
 			JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
@@ -1250,6 +1701,8 @@ int janus_process_incoming_request(janus_request *request) {
 		const char *opaque_id = opaque ? json_string_value(opaque) : NULL;
 		json_t *loop = json_object_get(root, "loop_index");
 		int loop_index = loop ? json_integer_value(loop) : -1;
+		json_t *group = json_object_get(root, "loop_group");
+		const char *loop_group = group ? json_string_value(group) : NULL;
 		/* Create handle */
 		handle = janus_ice_handle_create(session, opaque_id, token_value);
 		if(handle == NULL) {
@@ -1261,7 +1714,7 @@ int janus_process_incoming_request(janus_request *request) {
 		janus_refcount_increase(&handle->ref);
 		/* Attach to the plugin */
 		int error = 0;
-		if((error = janus_ice_handle_attach_plugin(session, handle, plugin_t, loop_index)) != 0) {
+		if((error = janus_ice_handle_attach_plugin(session, handle, plugin_t, loop_index, loop_group)) != 0) {
 			/* TODO Make error struct to pass verbose information */
 			janus_session_handles_remove(session, handle);
 			JANUS_LOG(LOG_ERR, "Couldn't attach to plugin '%s', error '%d'\n", plugin_text, error);
@@ -1281,10 +1734,7 @@ int janus_process_incoming_request(janus_request *request) {
 			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_REQUEST_PATH, "Unhandled request '%s' at this path", message_text);
 			goto jsondone;
 		}
-		janus_mutex_lock(&sessions_mutex);
-		if(g_hash_table_remove(sessions, &session->session_id))
-			g_atomic_int_dec_and_test(&sessions_num);
-		janus_mutex_unlock(&sessions_mutex);
+		janus_session_remove(session);
 		/* Notify the source that the session has been destroyed */
 		janus_request *source = janus_session_get_request(session);
 		if(source && source->transport)
@@ -2174,13 +2624,22 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(status, "log_level", json_integer(janus_log_level));
 			json_object_set_new(status, "log_timestamps", janus_log_timestamps ? json_true() : json_false());
 			json_object_set_new(status, "log_colors", janus_log_colors ? json_true() : json_false());
+			json_object_set_new(status, "log_deferred_format", janus_log_is_deferred() ? json_true() : json_false());
 			json_object_set_new(status, "locking_debug", lock_debug ? json_true() : json_false());
 			json_object_set_new(status, "refcount_debug", refcount_debug ? json_true() : json_false());
 			json_object_set_new(status, "libnice_debug", janus_ice_is_ice_debugging_enabled() ? json_true() : json_false());
 			json_object_set_new(status, "min_nack_queue", json_integer(janus_get_min_nack_queue()));
+			json_object_set_new(status, "draining", g_atomic_int_get(&draining) ? json_true() : json_false());
+			json_object_set_new(status, "packet_tracing", json_integer(janus_ice_get_packet_tracing()));
 			json_object_set_new(status, "nack-optimizations", janus_is_nack_optimizations_enabled() ? json_true() : json_false());
 			json_object_set_new(status, "no_media_timer", json_integer(janus_get_no_media_timer()));
 			json_object_set_new(status, "slowlink_threshold", json_integer(janus_get_slowlink_threshold()));
+			json_object_set_new(status, "session_timers", janus_sessions_wheel_info());
+			json_object_set_new(status, "dtls_workers", janus_dtls_workers_info());
+			json_object_set_new(status, "dtls_pool", janus_dtls_pool_info());
+#ifdef HAVE_SCTP
+			json_object_set_new(status, "sctp", janus_sctp_info());
+#endif
 			json_object_set_new(reply, "status", status);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
@@ -2200,8 +2659,19 @@ int janus_process_incoming_admin_request(janus_request *request) {
 				goto jsondone;
 			}
 
-			/* Set global session timeout */
+			/* Set global session timeout, and re-arm the timers accordingly */
 			global_session_timeout = timeout_num;
+			int i = 0;
+			for(i=0; i<JANUS_SESSIONS_SHARDS; i++) {
+				janus_sessions_shard *shard = &sessions[i];
+				g_rw_lock_reader_lock(&shard->lock);
+				GHashTableIter iter;
+				gpointer value;
+				g_hash_table_iter_init(&iter, shard->table);
+				while(g_hash_table_iter_next(&iter, NULL, &value))
+					janus_session_timer_arm((janus_session *)value);
+				g_rw_lock_reader_unlock(&shard->lock);
+			}
 
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
@@ -2251,6 +2721,114 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "set_lock_profiling")) {
+			/* Enable/disable the lock contention profiling, and/or reset the collected data */
+			JANUS_VALIDATE_JSON_OBJECT(root, lockprof_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+#ifndef LOCK_PROFILING
+			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+				"Lock profiling was disabled at compile time");
+			goto jsondone;
+#else
+			json_t *enabled = json_object_get(root, "enabled");
+			json_t *sampling = json_object_get(root, "sampling");
+			gboolean profiling = enabled ? json_is_true(enabled) : (g_atomic_int_get(&janus_lock_profiling) == 1);
+			janus_lock_profiling_set(profiling, sampling ? json_integer_value(sampling) : 0);
+			if(json_is_true(json_object_get(root, "reset")))
+				janus_lock_profiling_reset();
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "lock_profiling", profiling ? json_true() : json_false());
+			json_object_set_new(reply, "sampling", json_integer(janus_lock_profiling_get_sampling()));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+#endif
+		} else if(!strcasecmp(message_text, "get_lock_profiling")) {
+			/* Return the lock sites sorted by how long threads have waited on them */
+			JANUS_VALIDATE_JSON_OBJECT(root, getlockprof_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+#ifndef LOCK_PROFILING
+			ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+				"Lock profiling was disabled at compile time");
+			goto jsondone;
+#else
+			json_t *limit = json_object_get(root, "limit");
+			guint max = limit ? json_integer_value(limit) : 0;
+			int sampling = janus_lock_profiling_get_sampling();
+			json_t *list = json_array();
+			GList *sites = janus_lock_profiling_get(), *temp = sites;
+			while(temp && (max == 0 || json_array_size(list) < max)) {
+				janus_lock_site *site = (janus_lock_site *)temp->data;
+				json_t *s = json_object();
+				json_object_set_new(s, "file", json_string(site->file));
+				json_object_set_new(s, "line", json_integer(site->line));
+				json_object_set_new(s, "contentions", json_integer(site->contentions));
+				json_object_set_new(s, "wait_ns", json_integer(site->wait_ns));
+				json_object_set_new(s, "wait_max_ns", json_integer(site->wait_max_ns));
+				json_object_set_new(s, "samples", json_integer(site->samples));
+				/* Hold times are only sampled, so acquisitions are an estimate */
+				json_object_set_new(s, "acquisitions", json_integer(site->samples * sampling));
+				json_object_set_new(s, "hold_ns", json_integer(site->hold_ns));
+				json_object_set_new(s, "hold_max_ns", json_integer(site->hold_max_ns));
+				json_array_append_new(list, s);
+				temp = temp->next;
+			}
+			g_list_free_full(sites, (GDestroyNotify)g_free);
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "lock_profiling", g_atomic_int_get(&janus_lock_profiling) ? json_true() : json_false());
+			json_object_set_new(reply, "sampling", json_integer(sampling));
+			json_object_set_new(reply, "sites", list);
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+#endif
+		} else if(!strcasecmp(message_text, "set_packet_tracing")) {
+			/* Change how many incoming packets we trace through the media pipeline (0 disables tracing) */
+			JANUS_VALIDATE_JSON_OBJECT(root, pkttrace_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			json_t *sampling = json_object_get(root, "sampling");
+			janus_ice_set_packet_tracing(json_integer_value(sampling));
+			if(json_is_true(json_object_get(root, "reset")))
+				json_decref(janus_ice_packet_tracing_summary(TRUE));
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "packet_tracing", json_integer(janus_ice_get_packet_tracing()));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "get_packet_tracing")) {
+			/* Return the stage latencies of the packets we traced, per plugin and per loop */
+			JANUS_VALIDATE_JSON_OBJECT(root, getpkttrace_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			gboolean reset = json_is_true(json_object_get(root, "reset"));
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "packet_tracing", janus_ice_packet_tracing_summary(reset));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "set_refcount_debug")) {
 			/* Enable/disable the reference counter debug (would show a message on the console for every increase/decrease) */
 			JANUS_VALIDATE_JSON_OBJECT(root, debug_parameters,
@@ -2261,6 +2839,14 @@ int janus_process_incoming_admin_request(janus_request *request) {
 				goto jsondone;
 			}
 			json_t *debug = json_object_get(root, "debug");
+#ifdef REFCOUNT_NODEBUG
+			if(json_is_true(debug)) {
+				/* The debugging branches have been stripped at compile time */
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Reference counters debugging was disabled at compile time");
+				goto jsondone;
+			}
+#endif
 			if(json_is_true(debug)) {
 				refcount_debug = TRUE;
 			} else {
@@ -2421,6 +3007,47 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "drain")) {
+			/* Start or stop draining this server, e.g., before rotating it */
+			JANUS_VALIDATE_JSON_OBJECT(root, drain_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			gboolean drain = json_is_true(json_object_get(root, "drain"));
+			gboolean notify_plugins = json_is_true(json_object_get(root, "notify_plugins"));
+			gboolean changed = (g_atomic_int_compare_and_exchange(&draining, drain ? 0 : 1, drain ? 1 : 0));
+			if(changed) {
+				janus_mutex_lock(&drain_mutex);
+				drain_started = drain ? janus_get_monotonic_time() : 0;
+				drain_last_sessions = -1;
+				drain_last_handles = -1;
+				janus_mutex_unlock(&drain_mutex);
+				JANUS_LOG(LOG_INFO, "%s draining (%d sessions, %d handles)\n", drain ? "Started" : "Stopped",
+					g_atomic_int_get(&sessions_num), g_atomic_int_get(&handles_num));
+				janus_drain_notify(drain ? "draining" : "stopped");
+				if(notify_plugins && plugins != NULL) {
+					/* Let plugins know, in case they want to tell their users */
+					GHashTableIter iter;
+					gpointer value;
+					g_hash_table_iter_init(&iter, plugins);
+					while(g_hash_table_iter_next(&iter, NULL, &value)) {
+						janus_plugin *plugin = (janus_plugin *)value;
+						if(plugin != NULL && plugin->drain != NULL)
+							plugin->drain(drain);
+					}
+				}
+			}
+			/* Prepare JSON reply */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "draining", g_atomic_int_get(&draining) ? json_true() : json_false());
+			json_object_set_new(reply, "sessions", json_integer(g_atomic_int_get(&sessions_num)));
+			json_object_set_new(reply, "handles", json_integer(g_atomic_int_get(&handles_num)));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		} else if(!strcasecmp(message_text, "message_plugin")) {
 			/* Contact a plugin and expect a response */
 			JANUS_VALIDATE_JSON_OBJECT(root, messageplugin_parameters,
@@ -2609,26 +3236,36 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			ret = janus_process_success(request, reply);
 			goto jsondone;
 		} else if(!strcasecmp(message_text, "list_sessions")) {
-			/* List sessions */
+			/* List sessions (optionally a page at a time, on busy instances) */
 			session_id = 0;
-			json_t *list = json_array();
-			if(sessions != NULL && g_hash_table_size(sessions) > 0) {
-				janus_mutex_lock(&sessions_mutex);
+			JANUS_VALIDATE_JSON_OBJECT(root, listing_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint64));
+			int i = 0;
+			for(i=0; i<JANUS_SESSIONS_SHARDS; i++) {
+				janus_sessions_shard *shard = &sessions[i];
+				g_rw_lock_reader_lock(&shard->lock);
 				GHashTableIter iter;
 				gpointer value;
-				g_hash_table_iter_init(&iter, sessions);
+				g_hash_table_iter_init(&iter, shard->table);
 				while (g_hash_table_iter_next(&iter, NULL, &value)) {
 					janus_session *session = value;
 					if(session == NULL) {
 						continue;
 					}
-					json_array_append_new(list, json_integer(session->session_id));
+					g_array_append_val(ids, session->session_id);
 				}
-				janus_mutex_unlock(&sessions_mutex);
+				g_rw_lock_reader_unlock(&shard->lock);
 			}
 			/* Prepare JSON reply */
 			json_t *reply = janus_create_message("success", 0, transaction_text);
-			json_object_set_new(reply, "sessions", list);
+			janus_admin_ids_page(reply, "sessions", ids, root);
+			g_array_free(ids, TRUE);
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
@@ -2797,6 +3434,16 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Prepare JSON reply */
 			json_t *reply = janus_create_message("success", 0, transaction_text);
 			json_object_set_new(reply, "loops", list);
+			if(janus_ice_get_static_event_loops() == 0)
+				json_object_set_new(reply, "packet-pool", janus_ice_shared_packet_pool_info());
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
+		} else if(!strcasecmp(message_text, "requests_info")) {
+			/* Query the Janus core for the depth of the requests queues,
+			 * and how long each type of request took to be served */
+			json_t *reply = janus_create_message("success", 0, transaction_text);
+			json_object_set_new(reply, "requests", janus_requests_info());
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
@@ -2848,10 +3495,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 	if(handle == NULL) {
 		/* Session-related */
 		if(!strcasecmp(message_text, "destroy_session")) {
-			janus_mutex_lock(&sessions_mutex);
-			if(g_hash_table_remove(sessions, &session->session_id))
-				g_atomic_int_dec_and_test(&sessions_num);
-			janus_mutex_unlock(&sessions_mutex);
+			janus_session_remove(session);
 			/* Notify the source that the session has been destroyed */
 			janus_request *source = janus_session_get_request(session);
 			if(source && source->transport)
@@ -2891,6 +3535,7 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			janus_mutex_lock(&session->mutex);
 			session->timeout = timeout_num;
 			janus_mutex_unlock(&session->mutex);
+			janus_session_timer_arm(session);
 
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
@@ -2908,11 +3553,31 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			goto jsondone;
 		}
 
-		/* List handles */
-		json_t *list = janus_session_handles_list_json(session);
+		/* List handles (optionally a page at a time, on busy sessions) */
+		JANUS_VALIDATE_JSON_OBJECT(root, listing_parameters,
+			error_code, error_cause, FALSE,
+			JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+		if(error_code != 0) {
+			ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+			goto jsondone;
+		}
+		GArray *ids = g_array_new(FALSE, FALSE, sizeof(guint64));
+		janus_mutex_lock(&session->mutex);
+		if(session->ice_handles != NULL) {
+			GHashTableIter iter;
+			gpointer value;
+			g_hash_table_iter_init(&iter, session->ice_handles);
+			while(g_hash_table_iter_next(&iter, NULL, &value)) {
+				janus_ice_handle *h = value;
+				if(h != NULL)
+					g_array_append_val(ids, h->handle_id);
+			}
+		}
+		janus_mutex_unlock(&session->mutex);
 		/* Prepare JSON reply */
 		json_t *reply = janus_create_message("success", session_id, transaction_text);
-		json_object_set_new(reply, "handles", list);
+		janus_admin_ids_page(reply, "handles", ids, root);
+		g_array_free(ids, TRUE);
 		/* Send the success reply */
 		ret = janus_process_success(request, reply);
 		goto jsondone;
@@ -2959,17 +3624,55 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			const char *folder = json_string_value(json_object_get(root, "folder"));
 			const char *filename = json_string_value(json_object_get(root, "filename"));
 			int truncate = json_integer_value(json_object_get(root, "truncate"));
+			gboolean pcapng = json_is_true(json_object_get(root, "pcapng"));
+			gboolean headers_only = json_is_true(json_object_get(root, "headers_only"));
+			int max_rate = json_integer_value(json_object_get(root, "max_rate"));
+			/* Check if we only need to capture some of the packets */
+			janus_text2pcap_filter filter = {
+				.incoming = TRUE, .outgoing = TRUE,
+				.audio = TRUE, .video = TRUE,
+				.rtp = TRUE, .rtcp = TRUE
+			};
+			const char *direction = json_string_value(json_object_get(root, "direction"));
+			if(direction != NULL) {
+				if(!strcasecmp(direction, "incoming")) {
+					filter.outgoing = FALSE;
+				} else if(!strcasecmp(direction, "outgoing")) {
+					filter.incoming = FALSE;
+				} else if(strcasecmp(direction, "both")) {
+					ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE,
+						"Invalid direction (should be incoming, outgoing or both)");
+					goto jsondone;
+				}
+			}
+			const char *media = json_string_value(json_object_get(root, "media"));
+			if(media != NULL) {
+				if(!strcasecmp(media, "audio")) {
+					filter.video = FALSE;
+				} else if(!strcasecmp(media, "video")) {
+					filter.audio = FALSE;
+				} else if(strcasecmp(media, "all")) {
+					ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE,
+						"Invalid media (should be audio, video or all)");
+					goto jsondone;
+				}
+			}
+			if(json_is_true(json_object_get(root, "rtcp_only")))
+				filter.rtp = FALSE;
+			filter.ssrc = json_integer_value(json_object_get(root, "ssrc"));
+			filter.sampling = json_integer_value(json_object_get(root, "sampling"));
 			if(handle->text2pcap != NULL) {
 				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
 					text ? "text2pcap already started" : "pcap already started");
 				goto jsondone;
 			}
-			handle->text2pcap = janus_text2pcap_create(folder, filename, truncate, text);
+			handle->text2pcap = janus_text2pcap_create_full(folder, filename, truncate, text, pcapng, headers_only, max_rate);
 			if(handle->text2pcap == NULL) {
 				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
 					text ? "Error starting text2pcap dump" : "Error starting pcap dump");
 				goto jsondone;
 			}
+			janus_text2pcap_set_filter(handle->text2pcap, &filter);
 			g_atomic_int_set(&handle->dump_packets, 1);
 			/* Prepare JSON reply */
 			json_t *reply = json_object();
@@ -2996,6 +3699,35 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			/* Send the success reply */
 			ret = janus_process_success(request, reply);
 			goto jsondone;
+		} else if(!strcasecmp(message_text, "migrate_handle")) {
+			/* Move the handle to a different static event loop */
+			JANUS_VALIDATE_JSON_OBJECT(root, migrate_parameters,
+				error_code, error_cause, FALSE,
+				JANUS_ERROR_MISSING_MANDATORY_ELEMENT, JANUS_ERROR_INVALID_ELEMENT_TYPE);
+			if(error_code != 0) {
+				ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
+				goto jsondone;
+			}
+			if(janus_ice_get_static_event_loops() == 0) {
+				ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_UNKNOWN,
+					"Static event loops not enabled");
+				goto jsondone;
+			}
+			int loop_index = json_integer_value(json_object_get(root, "loop_index"));
+			int res = janus_ice_handle_migrate(handle, loop_index);
+			if(res < 0) {
+				ret = janus_process_error(request, session_id, transaction_text, res == -2 ? JANUS_ERROR_INVALID_ELEMENT_TYPE : JANUS_ERROR_UNKNOWN,
+					res == -2 ? "Invalid loop index %d" : "Error moving handle to loop %d", loop_index);
+				goto jsondone;
+			}
+			/* Prepare JSON reply */
+			json_t *reply = json_object();
+			json_object_set_new(reply, "janus", json_string("success"));
+			json_object_set_new(reply, "transaction", json_string(transaction_text));
+			json_object_set_new(reply, "migration", json_string(res == 0 ? "migrated" : "pending"));
+			/* Send the success reply */
+			ret = janus_process_success(request, reply);
+			goto jsondone;
 		}
 		/* If this is not a request to start/stop debugging to text2pcap, it must be a handle_info */
 		if(strcasecmp(message_text, "handle_info")) {
@@ -3009,8 +3741,18 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			ret = janus_process_error_string(request, session_id, transaction_text, error_code, error_cause);
 			goto jsondone;
 		}
-		/* Check if we should limit the response to the plugin-specific info */
+		/* Check if we should limit the response to the plugin-specific info, or to some sections */
 		gboolean plugin_only = json_is_true(json_object_get(root, "plugin_only"));
+		json_t *fields = json_object_get(root, "fields");
+		if(fields != NULL) {
+			size_t fi = 0;
+			for(fi=0; fi<json_array_size(fields); fi++) {
+				if(!json_is_string(json_array_get(fields, fi))) {
+					ret = janus_process_error(request, session_id, transaction_text, JANUS_ERROR_INVALID_ELEMENT_TYPE, "Invalid element type (fields should be an array of strings)");
+					goto jsondone;
+				}
+			}
+		}
 		/* Prepare info */
 		json_t *info = json_object();
 		json_object_set_new(info, "session_id", json_integer(session_id));
@@ -3028,12 +3770,19 @@ int janus_process_incoming_admin_request(janus_request *request) {
 			json_object_set_new(info, "token", json_string(handle->token));
 		json_object_set_new(info, "loop-running", (handle->mainloop != NULL &&
 			g_main_loop_is_running(handle->mainloop)) ? json_true() : json_false());
+		if(handle->loop_group)
+			json_object_set_new(info, "loop_group", json_string(handle->loop_group));
+		if(handle->migrations > 0)
+			json_object_set_new(info, "loop-migrations", json_integer(handle->migrations));
+		json_t *placement = janus_ice_handle_placement_info(handle);
+		if(placement != NULL)
+			json_object_set_new(info, "loop-placement", placement);
 		json_object_set_new(info, "created", json_integer(handle->created));
 		json_object_set_new(info, "current_time", json_integer(janus_get_monotonic_time()));
 		if(handle->app && janus_plugin_session_is_alive(handle->app_handle)) {
 			janus_plugin *plugin = (janus_plugin *)handle->app;
 			json_object_set_new(info, "plugin", json_string(plugin->get_package()));
-			if(plugin->query_session) {
+			if(plugin->query_session && janus_admin_wants_field(fields, "plugin")) {
 				/* FIXME This check will NOT work with legacy plugins that were compiled BEFORE the method was specified in plugin.h */
 				json_t *query = plugin->query_session(handle->app_handle);
 				if(query != NULL) {
@@ -3050,6 +3799,8 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		}
 		if(plugin_only)
 			goto info_done;
+		if(!janus_admin_wants_field(fields, "flags"))
+			goto info_ice;
 		json_t *flags = json_object();
 		json_object_set_new(flags, "got-offer", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_GOT_OFFER) ? json_true() : json_false());
 		json_object_set_new(flags, "got-answer", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_GOT_ANSWER) ? json_true() : json_false());
@@ -3072,26 +3823,70 @@ int janus_process_incoming_admin_request(janus_request *request) {
 		json_object_set_new(flags, "cleaning", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_CLEANING) ? json_true() : json_false());
 		json_object_set_new(flags, "e2ee", janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_E2EE) ? json_true() : json_false());
 		json_object_set_new(info, "flags", flags);
-		if(handle->agent) {
+info_ice:
+		if(handle->agent && janus_admin_wants_field(fields, "ice")) {
 			json_object_set_new(info, "agent-created", json_integer(handle->agent_created));
 			if(handle->agent_started > 0)
 				json_object_set_new(info, "agent-started", json_integer(handle->agent_started));
 			json_object_set_new(info, "ice-mode", json_string(janus_ice_is_ice_lite_enabled() ? "lite" : "full"));
 			json_object_set_new(info, "ice-role", json_string(handle->controlling ? "controlling" : "controlled"));
 		}
-		json_t *sdps = json_object();
-		if(handle->rtp_profile)
-			json_object_set_new(sdps, "profile", json_string(handle->rtp_profile));
-		if(handle->local_sdp)
-			json_object_set_new(sdps, "local", json_string(handle->local_sdp));
-		if(handle->remote_sdp)
-			json_object_set_new(sdps, "remote", json_string(handle->remote_sdp));
-		json_object_set_new(info, "sdps", sdps);
+		if(janus_admin_wants_field(fields, "sdps")) {
+			json_t *sdps = json_object();
+			if(handle->rtp_profile)
+				json_object_set_new(sdps, "profile", json_string(handle->rtp_profile));
+			if(handle->local_sdp)
+				json_object_set_new(sdps, "local", json_string(handle->local_sdp));
+			if(handle->remote_sdp)
+				json_object_set_new(sdps, "remote", json_string(handle->remote_sdp));
+			json_object_set_new(info, "sdps", sdps);
+		}
+		if(!janus_admin_wants_field(fields, "queues"))
+			goto info_dump;
 		if(handle->pending_trickles)
 			json_object_set_new(info, "pending-trickles", json_integer(g_list_length(handle->pending_trickles)));
-		if(handle->queued_packets)
-			json_object_set_new(info, "queued-packets", json_integer(g_async_queue_length(handle->queued_packets)));
-		if(g_atomic_int_get(&handle->dump_packets) && handle->text2pcap) {
+		if(handle->queued_packets) {
+			json_object_set_new(info, "queued-packets", json_integer(g_async_queue_length(handle->queued_packets) +
+				janus_ice_handle_queued_packets(handle, JANUS_ICE_LANES)));
+			json_object_set_new(info, "queued-packets-max", json_integer(handle->outgoing_packets_max));
+			if(g_atomic_int_get(&handle->outgoing_packets_dropped) > 0)
+				json_object_set_new(info, "queued-packets-dropped", json_integer(g_atomic_int_get(&handle->outgoing_packets_dropped)));
+			if(handle->outgoing_packets_direct > 0)
+				json_object_set_new(info, "direct-packets", json_integer(handle->outgoing_packets_direct));
+			if(g_atomic_int_get(&handle->low_latency))
+				json_object_set_new(info, "low-latency", json_true());
+			/* Same for each lane of the outgoing queue, in order of priority */
+			json_t *lanes = json_object();
+			int lane = 0;
+			for(lane=0; lane<JANUS_ICE_LANES; lane++) {
+				json_t *l = json_object();
+				json_object_set_new(l, "queued", json_integer(janus_ice_handle_queued_packets(handle, lane)));
+				json_object_set_new(l, "max", json_integer(handle->outgoing_lanes_max[lane]));
+				if(g_atomic_int_get(&handle->outgoing_lanes_dropped[lane]) > 0)
+					json_object_set_new(l, "dropped", json_integer(g_atomic_int_get(&handle->outgoing_lanes_dropped[lane])));
+				json_object_set_new(lanes, janus_ice_lane_str(lane), l);
+			}
+			json_object_set_new(info, "queued-lanes", lanes);
+		}
+		if(handle->pacer) {
+			janus_ice_pacer *pacer = handle->pacer;
+			json_t *pstats = json_object();
+			json_object_set_new(pstats, "rate", json_integer(pacer->rate));
+			json_object_set_new(pstats, "queued-packets", json_integer(g_queue_get_length(&pacer->packets)));
+			json_object_set_new(pstats, "queued-bytes", json_integer(pacer->bytes));
+			json_object_set_new(pstats, "queued-packets-max", json_integer(pacer->max_packets));
+			json_object_set_new(pstats, "max-delay", json_integer(pacer->max_delay));
+			json_object_set_new(pstats, "paced", json_integer(pacer->paced));
+			json_object_set_new(pstats, "flushed", json_integer(pacer->flushed));
+			json_object_set_new(info, "pacer", pstats);
+		}
+info_dump:
+		if(janus_admin_wants_field(fields, "memory")) {
+			json_t *memory = janus_ice_handle_memory_info(handle);
+			if(memory != NULL)
+				json_object_set_new(info, "memory", memory);
+		}
+		if(g_atomic_int_get(&handle->dump_packets) && handle->text2pcap && janus_admin_wants_field(fields, "dump")) {
 			if(handle->text2pcap->text) {
 				json_object_set_new(info, "dump-to-text2pcap", json_true());
 				json_object_set_new(info, "text2pcap-file", json_string(handle->text2pcap->filename));
@@ -3099,9 +3894,19 @@ int janus_process_incoming_admin_request(janus_request *request) {
 				json_object_set_new(info, "dump-to-pcap", json_true());
 				json_object_set_new(info, "pcap-file", json_string(handle->text2pcap->filename));
 			}
+			json_t *dump = json_object();
+			json_object_set_new(dump, "captured", json_integer(g_atomic_int_get(&handle->text2pcap->captured)));
+			json_object_set_new(dump, "dropped-ring-full", json_integer(g_atomic_int_get(&handle->text2pcap->dropped_full)));
+			json_object_set_new(dump, "dropped-rate-limit", json_integer(g_atomic_int_get(&handle->text2pcap->dropped_rate)));
+			json_object_set_new(info, "dump-stats", dump);
 		}
-		if(handle->pc) {
-			json_t *p = janus_admin_peerconnection_summary(handle->pc);
+		if(handle->pc && janus_admin_wants_field(fields, "webrtc")) {
+			json_t *p = janus_admin_peerconnection_summary(handle->pc, FALSE);
+			if(p)
+				json_object_set_new(info, "webrtc", p);
+		} else if(handle->pc && fields != NULL && janus_admin_wants_field(fields, "stats")) {
+			/* Only the media statistics, without all the ICE/DTLS/SDP details */
+			json_t *p = janus_admin_peerconnection_summary(handle->pc, TRUE);
 			if(p)
 				json_object_set_new(info, "webrtc", p);
 		}
@@ -3129,6 +3934,11 @@ int janus_process_success(janus_request *request, json_t *payload)
 {
 	if(!request || !payload)
 		return -1;
+	if(request->batch != NULL) {
+		/* Part of a batch, the response will be sent with the others */
+		json_array_append_new(request->batch, payload);
+		return 0;
+	}
 	/* Pass to the right transport plugin */
 	JANUS_LOG(LOG_HUGE, "Sending %s API response to %s (%p)\n", request->admin ? "admin" : "Janus", request->transport->get_package(), request->instance);
 	return request->transport->send_message(request->instance, request->request_id, request->admin, payload);
@@ -3146,6 +3956,11 @@ static int janus_process_error_string(janus_request *request, uint64_t session_i
 	json_object_set_new(error_data, "code", json_integer(error));
 	json_object_set_new(error_data, "reason", json_string(error_string));
 	json_object_set_new(reply, "error", error_data);
+	if(request->batch != NULL) {
+		/* Part of a batch, the response will be sent with the others */
+		json_array_append_new(request->batch, reply);
+		return 0;
+	}
 	/* Pass to the right transport plugin */
 	return request->transport->send_message(request->instance, request->request_id, request->admin, reply);
 }
@@ -3171,10 +3986,61 @@ int janus_process_error(janus_request *request, uint64_t session_id, const char
 }
 
 /* Admin/monitor helpers */
-json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc) {
+static gint janus_admin_ids_compare(gconstpointer a, gconstpointer b) {
+	guint64 ia = *(const guint64 *)a, ib = *(const guint64 *)b;
+	return ia < ib ? -1 : (ia > ib ? 1 : 0);
+}
+/* Add a page of IDs to a reply: IDs are sorted, so that the last one we return can be used
+ * as a cursor ("after") for the next request, whatever was created or destroyed in the meanwhile */
+static void janus_admin_ids_page(json_t *reply, const char *name, GArray *ids, json_t *root) {
+	json_t *limit = json_object_get(root, "limit"), *after = json_object_get(root, "after");
+	guint max = limit ? json_integer_value(limit) : 0;
+	guint64 cursor = after ? json_integer_value(after) : 0;
+	json_t *list = json_array();
+	guint i = 0;
+	if(limit != NULL || after != NULL) {
+		g_array_sort(ids, janus_admin_ids_compare);
+		/* Skip what the requester already got */
+		guint lo = 0, hi = ids->len;
+		while(lo < hi) {
+			guint mid = lo + (hi - lo)/2;
+			if(g_array_index(ids, guint64, mid) <= cursor)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		i = lo;
+	}
+	for(; i<ids->len && (max == 0 || json_array_size(list) < max); i++)
+		json_array_append_new(list, json_integer(g_array_index(ids, guint64, i)));
+	json_object_set_new(reply, name, list);
+	if(limit != NULL || after != NULL) {
+		json_object_set_new(reply, "total", json_integer(ids->len));
+		if(i < ids->len && i > 0)
+			json_object_set_new(reply, "next", json_integer(g_array_index(ids, guint64, i-1)));
+	}
+}
+/* Check if a section of handle_info was asked for (all of them are, if no list was provided) */
+static gboolean janus_admin_wants_field(json_t *fields, const char *name) {
+	if(fields == NULL)
+		return TRUE;
+	size_t i = 0;
+	for(i=0; i<json_array_size(fields); i++) {
+		const char *field = json_string_value(json_array_get(fields, i));
+		if(field != NULL && !strcasecmp(field, name))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc, gboolean stats_only) {
 	if(pc == NULL)
 		return NULL;
 	json_t *w = json_object();
+	if(stats_only) {
+		json_object_set_new(w, "media", janus_admin_peerconnection_media_summary(pc, TRUE));
+		return w;
+	}
 	json_t *i = json_object();
 	json_object_set_new(i, "stream_id", json_integer(pc->stream_id));
 	json_object_set_new(i, "component_id", json_integer(pc->component_id));
@@ -3211,6 +4077,10 @@ json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc) {
 		json_object_set_new(i, "selected-pair", json_string(pc->selected_pair));
 	}
 	json_object_set_new(i, "ready", json_integer(pc->cdone));
+	if(pc->recv_batches > 0) {
+		json_object_set_new(i, "recv-batches", json_integer(pc->recv_batches));
+		json_object_set_new(i, "recv-batch-avg", json_real((double)pc->recv_batch_packets/(double)pc->recv_batches));
+	}
 	json_object_set_new(w, "ice", i);
 	json_t *d = json_object();
 	if(pc->dtls) {
@@ -3271,22 +4141,37 @@ json_t *janus_admin_peerconnection_summary(janus_ice_peerconnection *pc) {
 	json_object_set_new(bwe, "twcc", pc->do_transport_wide_cc ? json_true() : json_false());
 	if(pc->transport_wide_cc_ext_id >= 0)
 		json_object_set_new(bwe, "twcc-ext-id", json_integer(pc->transport_wide_cc_ext_id));
+	if(pc->bwe != NULL)
+		json_object_set_new(bwe, "estimator", janus_bwe_context_summary(pc->bwe));
 	json_object_set_new(w, "bwe", bwe);
+	if(pc->retransmit_budget_refill > 0 || pc->retransmit_duplicates > 0) {
+		json_t *rtx = json_object();
+		if(pc->retransmit_budget_refill > 0) {
+			json_object_set_new(rtx, "budget", json_integer(pc->retransmit_budget));
+			json_object_set_new(rtx, "budget-denied", json_integer(pc->retransmit_denied));
+		}
+		json_object_set_new(rtx, "duplicates", json_integer(pc->retransmit_duplicates));
+		json_object_set_new(w, "retransmissions", rtx);
+	}
+	json_object_set_new(w, "media", janus_admin_peerconnection_media_summary(pc, FALSE));
+	return w;
+}
+
+static json_t *janus_admin_peerconnection_media_summary(janus_ice_peerconnection *pc, gboolean stats_only) {
 	json_t *media = json_object();
 	/* Iterate on all media */
 	janus_ice_peerconnection_medium *medium = NULL;
 	uint mi=0;
 	for(mi=0; mi<g_hash_table_size(pc->media); mi++) {
 		medium = g_hash_table_lookup(pc->media, GUINT_TO_POINTER(mi));
-		json_t *m = janus_admin_peerconnection_medium_summary(medium);
+		json_t *m = janus_admin_peerconnection_medium_summary(medium, stats_only);
 		if(m)
 			json_object_set_new(media, medium->mid, m);
 	}
-	json_object_set_new(w, "media", media);
-	return w;
+	return media;
 }
 
-json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_medium *medium) {
+json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_medium *medium, gboolean stats_only) {
 	if(medium == NULL)
 		return NULL;
 	/* SSRCs */
@@ -3299,6 +4184,9 @@ json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_mediu
 		json_object_set_new(m, "type", json_string("data"));
 	json_object_set_new(m, "mindex", json_integer(medium->mindex));
 	json_object_set_new(m, "mid", json_string(medium->mid));
+	int vindex = 0;
+	if(stats_only)
+		goto media_stats;
 	if(medium->msid || medium->remote_msid) {
 		json_t *mm = json_object();
 		if(medium->msid) {
@@ -3374,8 +4262,8 @@ json_t *janus_admin_peerconnection_medium_summary(janus_ice_peerconnection_mediu
 			json_object_set_new(sc, "codec", json_string(medium->codec));
 		json_object_set_new(m, "codecs", sc);
 	}
+media_stats:
 	/* RTCP stats */
-	int vindex=0;
 	if(medium->type != JANUS_MEDIA_DATA) {
 		json_t *rtcp_stats = NULL;
 		for(vindex=0; vindex<3; vindex++) {
@@ -3458,22 +4346,59 @@ void janus_transportso_close(gpointer key, gpointer value, gpointer user_data) {
 }
 
 /* Transport callback interface */
+/* Keepalives are the bulk of the Janus API traffic, and all they do is
+ * updating the last activity of a session: as such, well formed ones
+ * for existing sessions are handled right away on the transport thread,
+ * instead of going through a worker. Anything else (including keepalives
+ * that would need an error to be returned) takes the regular path */
+static volatile gint keepalives_inline = 0;
+static gboolean janus_transport_keepalive(janus_transport *plugin, janus_transport_session *transport, void *request_id, json_t *message) {
+	if(!json_is_object(message))
+		return FALSE;
+	const char *type = json_string_value(json_object_get(message, "janus"));
+	if(type == NULL || strcasecmp(type, "keepalive"))
+		return FALSE;
+	const char *transaction = json_string_value(json_object_get(message, "transaction"));
+	json_t *s = json_object_get(message, "session_id");
+	json_t *h = json_object_get(message, "handle_id");
+	if(transaction == NULL || !json_is_integer(s) || json_integer_value(s) < 1 || (h != NULL && !json_is_null(h)))
+		return FALSE;
+	if(janus_message_check_secret(message) != 0)
+		return FALSE;
+	guint64 session_id = json_integer_value(s);
+	janus_session *session = janus_session_find(session_id);
+	if(session == NULL)
+		return FALSE;
+	__atomic_store_n(&session->last_activity, janus_get_monotonic_time_coarse(), __ATOMIC_RELAXED);
+	janus_refcount_decrease(&session->ref);
+	JANUS_LOG(LOG_VERB, "Got a keep-alive on session %"SCNu64"\n", session_id);
+	json_t *reply = janus_create_message("ack", session_id, transaction);
+	plugin->send_message(transport, request_id, FALSE, reply);
+	json_decref(message);
+	g_atomic_int_inc(&keepalives_inline);
+	return TRUE;
+}
+
 void janus_transport_incoming_request(janus_transport *plugin, janus_transport_session *transport, void *request_id, gboolean admin, json_t *message, json_error_t *error) {
 	JANUS_LOG(LOG_VERB, "Got %s API request from %s (%p)\n", admin ? "an admin" : "a Janus", plugin->get_package(), transport);
+	if(!admin && message != NULL && janus_transport_keepalive(plugin, transport, request_id, message))
+		return;
 	/* Create a janus_request instance to handle the request */
 	janus_request *request = janus_request_new(plugin, transport, request_id, admin, message, message ? NULL : error);
-	/* Enqueue the request, the thread will pick it up */
-	g_async_queue_push(requests, request);
+	/* Enqueue the request, the worker thread will pick it up */
+	g_async_queue_push(janus_requests_get_worker(request)->queue, request);
 }
 
 void janus_transport_gone(janus_transport *plugin, janus_transport_session *transport) {
 	/* Get rid of sessions this transport was handling */
 	JANUS_LOG(LOG_VERB, "A %s transport instance has gone away (%p)\n", plugin->get_package(), transport);
-	janus_mutex_lock(&sessions_mutex);
-	if(sessions && g_hash_table_size(sessions) > 0) {
+	int i = 0;
+	for(i=0; i<JANUS_SESSIONS_SHARDS; i++) {
+		janus_sessions_shard *shard = &sessions[i];
+		g_rw_lock_writer_lock(&shard->lock);
 		GHashTableIter iter;
 		gpointer value;
-		g_hash_table_iter_init(&iter, sessions);
+		g_hash_table_iter_init(&iter, shard->table);
 		while(g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_session *session = (janus_session *) value;
 			if(!session || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->timedout) || session->last_activity == 0)
@@ -3485,14 +4410,16 @@ void janus_transport_gone(janus_transport *plugin, janus_transport_session *tran
 					/* Mark the session as destroyed */
 					janus_session_destroy(session);
 					g_hash_table_iter_remove(&iter);
+					g_atomic_int_dec_and_test(&sessions_num);
 				} else {
 					/* Set flag for transport_gone. The Janus sessions watchdog will clean this up if not reclaimed */
 					g_atomic_int_set(&session->transport_gone, 1);
+					janus_session_timer_arm(session);
 				}
 			}
 		}
+		g_rw_lock_writer_unlock(&shard->lock);
 	}
-	janus_mutex_unlock(&sessions_mutex);
 }
 
 gboolean janus_transport_is_api_secret_needed(janus_transport *plugin) {
@@ -3528,37 +4455,146 @@ void janus_transport_notify_event(janus_transport *plugin, void *transport, json
 	}
 }
 
-void janus_transport_task(gpointer data, gpointer user_data) {
-	JANUS_LOG(LOG_VERB, "Transport task pool, serving request\n");
-	janus_request *request = (janus_request *)data;
-	if(request == NULL) {
-		JANUS_LOG(LOG_ERR, "Missing request\n");
-		return;
+char *janus_transport_get_metrics(void) {
+	if(janus_is_stopping())
+		return NULL;
+	GString *out = g_string_sized_new(4096);
+	/* Counters on the media path, summed up from all threads */
+	janus_metrics_print_counters(out);
+	/* Gauges */
+	janus_metrics_print_family(out, "janus_sessions", "gauge", "Active Janus sessions");
+	janus_metrics_print_sample(out, "janus_sessions", NULL, g_atomic_int_get(&sessions_num));
+	janus_metrics_print_family(out, "janus_handles", "gauge", "Active handles");
+	janus_metrics_print_sample(out, "janus_handles", NULL, g_atomic_int_get(&handles_num));
+	char labels[256];
+	guint i = 0;
+	janus_metrics_print_family(out, "janus_requests_queued", "gauge", "Requests waiting to be processed by each worker");
+	for(i=0; i<requests_workers_num; i++) {
+		g_snprintf(labels, sizeof(labels), "worker=\"%u\"", requests_workers[i].id);
+		janus_metrics_print_sample(out, "janus_requests_queued", labels, g_async_queue_length(requests_workers[i].queue));
+	}
+	if(tasks != NULL) {
+		janus_metrics_print_family(out, "janus_tasks_queued", "gauge", "Plugin messages waiting for a thread of the tasks pool");
+		janus_metrics_print_sample(out, "janus_tasks_queued", NULL, g_thread_pool_unprocessed(tasks));
+	}
+	janus_ice_static_event_loops_metrics(out);
+	janus_sdp_mdns_cache_metrics(out);
+	/* Plugin-specific gauges: the same name may be used by different plugins,
+	 * so we group the samples by name before printing them */
+	if(plugins != NULL) {
+		GHashTable *families = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+		GList *names = NULL;
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, plugins);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_plugin *plugin = (janus_plugin *)value;
+			if(plugin == NULL || plugin->query_metrics == NULL)
+				continue;
+			json_t *metrics = plugin->query_metrics();
+			if(metrics == NULL)
+				continue;
+			g_snprintf(labels, sizeof(labels), "plugin=\"%s\"", plugin->get_package());
+			const char *key = NULL;
+			json_t *metric = NULL;
+			json_object_foreach(metrics, key, metric) {
+				if(!json_is_number(metric))
+					continue;
+				char *sanitized = janus_metrics_sanitize_name(key);
+				char *name = g_strdup_printf("janus_plugin_%s", sanitized);
+				g_free(sanitized);
+				GString *samples = g_hash_table_lookup(families, name);
+				gboolean added = FALSE;
+				if(samples == NULL) {
+					/* The table owns the name, the list just keeps the order */
+					samples = g_string_new(NULL);
+					g_hash_table_insert(families, name, samples);
+					names = g_list_append(names, name);
+					added = TRUE;
+				}
+				janus_metrics_print_sample(samples, name, labels, json_number_value(metric));
+				if(!added)
+					g_free(name);
+			}
+			json_decref(metrics);
+		}
+		GList *temp = names;
+		while(temp) {
+			char *name = (char *)temp->data;
+			GString *samples = g_hash_table_lookup(families, name);
+			janus_metrics_print_family(out, name, "gauge", NULL);
+			g_string_append_len(out, samples->str, samples->len);
+			g_string_free(samples, TRUE);
+			temp = temp->next;
+		}
+		g_list_free(names);
+		g_hash_table_destroy(families);
 	}
+	g_string_append(out, "# EOF\n");
+	return g_string_free(out, FALSE);
+}
+
+static int janus_requests_get_type(janus_request *request) {
+	if(request->admin)
+		return JANUS_REQUESTS_TYPES-2;
+	const char *message_text = json_string_value(json_object_get(request->message, "janus"));
+	int i = 0;
+	if(message_text != NULL) {
+		for(i=0; i<JANUS_REQUESTS_TYPES-2; i++) {
+			if(!strcasecmp(message_text, janus_requests_types[i]))
+				return i;
+		}
+	}
+	return JANUS_REQUESTS_TYPES-1;
+}
+
+/* Processes a request, updating the latency statistics of the worker */
+static void janus_requests_process(janus_requests_worker *worker, janus_request *request) {
+	int type = janus_requests_get_type(request);
 	if(!request->admin)
 		janus_process_incoming_request(request);
 	else
 		janus_process_incoming_admin_request(request);
+	gint64 latency = janus_get_monotonic_time() - request->received;
+	int bucket = 0;
+	while(bucket < JANUS_REQUESTS_BUCKETS-1 && latency >= janus_requests_buckets[bucket])
+		bucket++;
+	janus_mutex_lock(&worker->mutex);
+	janus_requests_stats *stats = &worker->stats[type];
+	stats->count++;
+	stats->buckets[bucket]++;
+	if(latency > stats->max)
+		stats->max = latency;
+	janus_mutex_unlock(&worker->mutex);
 	/* Done */
 	janus_request_destroy(request);
 }
 
+void janus_transport_task(gpointer data, gpointer user_data) {
+	JANUS_LOG(LOG_VERB, "Transport task pool, serving request\n");
+	janus_request *request = (janus_request *)data;
+	if(request == NULL) {
+		JANUS_LOG(LOG_ERR, "Missing request\n");
+		return;
+	}
+	/* The tasks pool is only used when there's a single worker */
+	janus_requests_process(&requests_workers[0], request);
+}
+
 
 /* Thread to handle incoming requests: may involve an asynchronous task for plugin messaging */
 static void *janus_transport_requests(void *data) {
-	JANUS_LOG(LOG_INFO, "Joining Janus requests handler thread\n");
+	janus_requests_worker *worker = (janus_requests_worker *)data;
+	JANUS_LOG(LOG_INFO, "Joining Janus requests handler thread #%u\n", worker->id);
 	janus_request *request = NULL;
-	gboolean destroy = FALSE;
 	while(!g_atomic_int_get(&stop)) {
-		request = g_async_queue_pop(requests);
+		request = g_async_queue_pop(worker->queue);
 		if(request == &exit_message)
 			break;
 		/* Should we process the request synchronously or with a task from the thread pool? */
-		destroy = TRUE;
-		/* Process the request synchronously only it's not a message for a plugin */
 		json_t *message = json_object_get(request->message, "janus");
 		const gchar *message_text = json_string_value(message);
-		if(message_text && !strcasecmp(message_text, request->admin ? "message_plugin" : "message")) {
+		if(!requests_ordered && message_text && !strcasecmp(message_text, request->admin ? "message_plugin" : "message")) {
 			/* Spawn a task thread */
 			GError *tperror = NULL;
 			g_thread_pool_push(tasks, request, &tperror);
@@ -3570,24 +4606,80 @@ static void *janus_transport_requests(void *data) {
 				json_t *transaction = json_object_get(message, "transaction");
 				const char *transaction_text = json_is_string(transaction) ? json_string_value(transaction) : NULL;
 				janus_process_error(request, 0, transaction_text, JANUS_ERROR_UNKNOWN, "Thread pool error");
-			} else {
-				/* Don't destroy the request now, the task will take care of that */
-				destroy = FALSE;
+				janus_request_destroy(request);
 			}
+			/* If the push succeeded, the task will take care of the request */
 		} else {
-			if(!request->admin)
-				janus_process_incoming_request(request);
-			else
-				janus_process_incoming_admin_request(request);
+			/* Process the request synchronously: if workers are ordered,
+			 * this includes messages for plugins too */
+			janus_requests_process(worker, request);
 		}
-		/* Done */
-		if(destroy)
-			janus_request_destroy(request);
 	}
-	JANUS_LOG(LOG_INFO, "Leaving Janus requests handler thread\n");
+	JANUS_LOG(LOG_INFO, "Leaving Janus requests handler thread #%u\n", worker->id);
 	return NULL;
 }
 
+/* Picks the worker a request should be dispatched to */
+static janus_requests_worker *janus_requests_get_worker(janus_request *request) {
+	if(requests_workers_num == 1)
+		return &requests_workers[0];
+	guint64 key = 0;
+	json_t *s = json_object_get(request->message, "session_id");
+	if(s && json_is_integer(s))
+		key = json_integer_value(s);
+	if(key == 0) {
+		/* No session yet, keep the requests from the same transport instance together */
+		key = (guint64)(uintptr_t)request->instance;
+	}
+	key ^= key >> 33;
+	key *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+	key ^= key >> 33;
+	return &requests_workers[key % requests_workers_num];
+}
+
+static json_t *janus_requests_info(void) {
+	json_t *info = json_object();
+	json_object_set_new(info, "ordered", requests_ordered ? json_true() : json_false());
+	json_t *workers = json_array();
+	janus_requests_stats totals[JANUS_REQUESTS_TYPES];
+	memset(totals, 0, sizeof(totals));
+	guint i = 0;
+	int t = 0, b = 0;
+	for(i=0; i<requests_workers_num; i++) {
+		janus_requests_worker *worker = &requests_workers[i];
+		json_t *w = json_object();
+		json_object_set_new(w, "id", json_integer(worker->id));
+		json_object_set_new(w, "queue", json_integer(g_async_queue_length(worker->queue)));
+		json_array_append_new(workers, w);
+		janus_mutex_lock(&worker->mutex);
+		for(t=0; t<JANUS_REQUESTS_TYPES; t++) {
+			totals[t].count += worker->stats[t].count;
+			if(worker->stats[t].max > totals[t].max)
+				totals[t].max = worker->stats[t].max;
+			for(b=0; b<JANUS_REQUESTS_BUCKETS; b++)
+				totals[t].buckets[b] += worker->stats[t].buckets[b];
+		}
+		janus_mutex_unlock(&worker->mutex);
+	}
+	json_object_set_new(info, "workers", workers);
+	json_t *latency = json_object();
+	for(t=0; t<JANUS_REQUESTS_TYPES; t++) {
+		if(totals[t].count == 0)
+			continue;
+		json_t *l = json_object();
+		json_object_set_new(l, "count", json_integer(totals[t].count));
+		json_object_set_new(l, "max", json_integer(totals[t].max));
+		json_t *buckets = json_object();
+		for(b=0; b<JANUS_REQUESTS_BUCKETS; b++)
+			json_object_set_new(buckets, janus_requests_buckets_names[b], json_integer(totals[t].buckets[b]));
+		json_object_set_new(l, "histogram", buckets);
+		json_object_set_new(latency, janus_requests_types[t], l);
+	}
+	json_object_set_new(info, "latency", latency);
+	json_object_set_new(info, "keepalives-inline", json_integer(g_atomic_int_get(&keepalives_inline)));
+	return info;
+}
+
 
 /* Event handlers */
 void janus_eventhandler_close(gpointer key, gpointer value, gpointer user_data) {
@@ -3695,6 +4787,8 @@ int janus_plugin_push_event(janus_plugin_session *plugin_session, janus_plugin *
 	}
 	/* Reference the payload, as the plugin may still need it and will do a decref itself */
 	json_incref(message);
+	/* The same payload may be sent to other recipients as well, keep track of it */
+	janus_json_shared_track(message);
 	/* Prepare JSON event */
 	json_t *event = janus_create_message("event", session->session_id, transaction);
 	json_object_set_new(event, "sender", json_integer(ice_handle->handle_id));
@@ -4223,6 +5317,82 @@ void janus_plugin_relay_data(janus_plugin_session *plugin_session, janus_plugin_
 #endif
 }
 
+void janus_plugin_relay_data_batch(janus_plugin_session *plugin_session, janus_plugin_data *messages, int count) {
+	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped) ||
+			messages == NULL || count < 1)
+		return;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return;
+#ifdef HAVE_SCTP
+	janus_ice_relay_data_batch(handle, messages, count);
+#else
+	JANUS_LOG(LOG_WARN, "Asked to relay data, but Data Channels support has not been compiled...\n");
+#endif
+}
+
+/* Helper to validate a plugin session when relaying to several peers at once:
+ * targets for the same peer are usually next to each other (e.g., audio and
+ * video for the same subscriber), so we remember the last one we checked */
+static janus_ice_handle *janus_plugin_relay_target_handle(janus_plugin_session *plugin_session,
+		janus_plugin_session **last_session, janus_ice_handle **last_handle) {
+	if(plugin_session == *last_session)
+		return *last_handle;
+	*last_session = plugin_session;
+	*last_handle = NULL;
+	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped))
+		return NULL;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(!handle || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP)
+			|| janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_ALERT))
+		return NULL;
+	*last_handle = handle;
+	return handle;
+}
+
+void janus_plugin_relay_rtp_batch(janus_plugin_rtp_target *targets, int count) {
+	if(targets == NULL || count < 1)
+		return;
+	/* Queue all the packets first, and only wake the loops up once at the end */
+	janus_ice_relay_batch batch = { 0 };
+	janus_plugin_session *last_session = NULL;
+	janus_ice_handle *last_handle = NULL;
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_plugin_rtp *packet = targets[i].packet;
+		if(packet == NULL || packet->buffer == NULL || packet->length < 1)
+			continue;
+		janus_ice_handle *handle = janus_plugin_relay_target_handle(targets[i].handle, &last_session, &last_handle);
+		if(handle != NULL)
+			janus_ice_relay_rtp_batched(&batch, handle, packet);
+	}
+	janus_ice_relay_batch_wakeup(&batch);
+}
+
+void janus_plugin_relay_data_batch_targets(janus_plugin_data_target *targets, int count) {
+	if(targets == NULL || count < 1)
+		return;
+#ifdef HAVE_SCTP
+	/* Queue all the messages first, and only wake the loops up once at the end */
+	janus_ice_relay_batch batch = { 0 };
+	janus_plugin_session *last_session = NULL;
+	janus_ice_handle *last_handle = NULL;
+	int i = 0;
+	for(i=0; i<count; i++) {
+		janus_plugin_data *packet = targets[i].packet;
+		if(packet == NULL || packet->buffer == NULL || packet->length < 1)
+			continue;
+		janus_ice_handle *handle = janus_plugin_relay_target_handle(targets[i].handle, &last_session, &last_handle);
+		if(handle != NULL)
+			janus_ice_relay_data_batched(&batch, handle, packet);
+	}
+	janus_ice_relay_batch_wakeup(&batch);
+#else
+	JANUS_LOG(LOG_WARN, "Asked to relay data, but Data Channels support has not been compiled...\n");
+#endif
+}
+
 void janus_plugin_send_pli(janus_plugin_session *plugin_session) {
 	if((plugin_session < (janus_plugin_session *)0x1000) || g_atomic_int_get(&plugin_session->stopped))
 		return;
@@ -4330,6 +5500,27 @@ void janus_plugin_end_session(janus_plugin_session *plugin_session) {
 	g_source_unref(timeout_source);
 }
 
+int janus_plugin_colocate(janus_plugin_session *plugin_session, janus_plugin_session *peer_session) {
+	/* A plugin asked us to move a handle to the loop of another one */
+	if(!janus_plugin_session_is_alive(plugin_session) || !janus_plugin_session_is_alive(peer_session))
+		return -1;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	janus_ice_handle *peer = (janus_ice_handle *)peer_session->gateway_handle;
+	if(handle == NULL || peer == NULL || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP))
+		return -1;
+	return janus_ice_handle_colocate(handle, peer);
+}
+
+void janus_plugin_set_low_latency(janus_plugin_session *plugin_session, gboolean enabled) {
+	/* A plugin asked us to favour latency for a handle (or to stop doing that) */
+	if(!janus_plugin_session_is_alive(plugin_session))
+		return;
+	janus_ice_handle *handle = (janus_ice_handle *)plugin_session->gateway_handle;
+	if(handle == NULL || janus_flags_is_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_STOP))
+		return;
+	janus_ice_handle_set_low_latency(handle, enabled);
+}
+
 void janus_plugin_notify_event(janus_plugin *plugin, janus_plugin_session *plugin_session, json_t *event) {
 	/* A plugin asked to notify an event to the handlers */
 	if(!plugin || !event || !json_is_object(event))
@@ -4377,8 +5568,71 @@ gboolean janus_plugin_auth_signature_contains(janus_plugin *plugin, const char *
 }
 
 
+/* Helpers to initialize plugins and transports, possibly in parallel */
+typedef struct janus_module_init {
+	/* Shared object, and plugin or transport instance */
+	void *so;
+	janus_plugin *plugin;
+	janus_transport *transport;
+	/* Result of the init callback, and how long it took */
+	int result;
+	gint64 duration;
+	GThread *thread;
+} janus_module_init;
+
+static gpointer janus_module_init_thread(gpointer data) {
+	janus_module_init *module = (janus_module_init *)data;
+	gint64 start = janus_get_monotonic_time();
+	if(module->plugin != NULL)
+		module->result = module->plugin->init(&janus_handler_plugin, configs_folder);
+	else
+		module->result = module->transport->init(&janus_handler_transport, configs_folder);
+	module->duration = janus_get_monotonic_time() - start;
+	return NULL;
+}
+
+static void janus_modules_init(GList *modules, const char *what) {
+	gint64 start = janus_get_monotonic_time();
+	GList *temp = modules;
+	while(temp) {
+		janus_module_init *module = (janus_module_init *)temp->data;
+		if(parallel_init) {
+			GError *error = NULL;
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "init %s", module->plugin ?
+				module->plugin->get_package() : module->transport->get_package());
+			module->thread = g_thread_try_new(tname, janus_module_init_thread, module, &error);
+			if(error != NULL) {
+				/* Fallback to initializing it here */
+				JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the init thread, initializing it synchronously\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				module->thread = NULL;
+				janus_module_init_thread(module);
+			}
+		} else {
+			janus_module_init_thread(module);
+		}
+		temp = temp->next;
+	}
+	temp = modules;
+	while(temp) {
+		janus_module_init *module = (janus_module_init *)temp->data;
+		if(module->thread != NULL)
+			g_thread_join(module->thread);
+		module->thread = NULL;
+		JANUS_LOG(LOG_VERB, "The '%s' %s took %"SCNi64"ms to initialize\n", module->plugin ?
+			module->plugin->get_package() : module->transport->get_package(), what, module->duration/1000);
+		temp = temp->next;
+	}
+	JANUS_LOG(LOG_INFO, "Initialized %u %ss in %"SCNi64"ms%s\n", g_list_length(modules), what,
+		(janus_get_monotonic_time() - start)/1000, parallel_init ? " (in parallel)" : "");
+}
+
+
 /* Main */
 gint main(int argc, char *argv[]) {
+	gint64 start_time = janus_get_monotonic_time();
 	/* Core dumps may be disallowed by parent of this process; change that */
 	struct rlimit core_limits;
 	core_limits.rlim_cur = core_limits.rlim_max = RLIM_INFINITY;
@@ -4579,6 +5833,37 @@ gint main(int argc, char *argv[]) {
 	if(item && item->value && janus_is_true(item->value))
 		exit_on_dl_error = TRUE;
 
+	/* Check if plugins and transports should be initialized in parallel */
+	item = janus_config_get(config, config_general, janus_config_type_item, "parallel_init");
+	if(item && item->value && janus_is_true(item->value))
+		parallel_init = TRUE;
+
+	/* Check how the per-thread log rings should be configured */
+	guint log_ring_size = 128;
+	gboolean log_ring_block = FALSE;
+	item = janus_config_get(config, config_general, janus_config_type_item, "log_ring_size");
+	if(item && item->value) {
+		int size = atoi(item->value);
+		if(size <= 0) {
+			JANUS_LOG(LOG_WARN, "Invalid log_ring_size value '%s', using %u\n", item->value, log_ring_size);
+		} else {
+			log_ring_size = size;
+		}
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "log_ring_policy");
+	if(item && item->value) {
+		if(!strcasecmp(item->value, "wait")) {
+			log_ring_block = TRUE;
+		} else if(strcasecmp(item->value, "drop")) {
+			JANUS_LOG(LOG_WARN, "Invalid log_ring_policy value '%s', using 'drop'\n", item->value);
+		}
+	}
+	janus_log_set_ring_options(log_ring_size, log_ring_block);
+	/* Check if formatting log lines should be deferred to the logger thread */
+	item = janus_config_get(config, config_general, janus_config_type_item, "log_deferred_format");
+	if(item && item->value && janus_is_true(item->value))
+		janus_log_set_deferred(TRUE);
+
 	/* Initialize logger */
 	if(janus_log_init(daemonize, use_stdout, logfile) < 0)
 		exit(1);
@@ -4868,6 +6153,22 @@ gint main(int argc, char *argv[]) {
 	if(lock_debug) {
 		JANUS_PRINT("Lock/mutex debugging is enabled\n");
 	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "lock_profiling");
+	if(item && item->value && janus_is_true(item->value)) {
+#ifdef LOCK_PROFILING
+		uint32_t sampling = 0;
+		janus_config_item *s = janus_config_get(config, config_general, janus_config_type_item, "lock_profiling_sampling");
+		if(s && s->value && janus_string_to_uint32(s->value, &sampling) < 0) {
+			JANUS_PRINT("Invalid lock profiling sampling value '%s', using default\n", s->value);
+			sampling = 0;
+		}
+		janus_lock_profiling_set(TRUE, sampling);
+		JANUS_PRINT("Lock contention profiling is enabled (hold time sampled every %d acquisitions)\n",
+			janus_lock_profiling_get_sampling());
+#else
+		JANUS_PRINT("Lock contention profiling was disabled at compile time, ignoring\n");
+#endif
+	}
 
 	/* First of all, let's check if we're disabling WebRTC encryption for debugging purposes */
 	item = janus_config_get(config, config_general, janus_config_type_item, "no_webrtc_encryption");
@@ -5010,7 +6311,38 @@ gint main(int argc, char *argv[]) {
 	if(item && item->value && janus_is_true(item->value))
 		janus_enable_opaqueid_in_api();
 
-	/* Initialize the recorder code */
+	/* Initialize the recorder code: check if we need a pool of writer threads first */
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_writer_threads");
+	if(item && item->value) {
+		int threads = atoi(item->value);
+		int flush_interval = 0;
+		janus_config_item *fi = janus_config_get(config, config_general, janus_config_type_item, "recordings_flush_interval");
+		if(fi && fi->value) {
+			flush_interval = atoi(fi->value);
+			if(flush_interval <= 0) {
+				JANUS_LOG(LOG_WARN, "Invalid recordings flush interval (%s), using default\n", fi->value);
+				flush_interval = 0;
+			}
+		}
+		if(threads < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid number of recordings writer threads (%s), writing synchronously\n", item->value);
+		} else {
+			janus_recorder_set_async(threads, flush_interval);
+		}
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_index");
+	if(item && item->value)
+		janus_recorder_set_index(janus_is_true(item->value));
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_backend");
+	if(item && item->value && janus_recorder_set_backend(item->value) < 0)
+		JANUS_LOG(LOG_WARN, "Unsupported recordings backend '%s', using stdio\n", item->value);
+	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_encryption_key");
+	if(item && item->value && janus_recorder_set_encryption(item->value) < 0) {
+		/* Better not to record at all than to record in clear when we shouldn't */
+		JANUS_LOG(LOG_FATAL, "Couldn't load the recordings encryption key\n");
+		janus_options_destroy();
+		exit(1);
+	}
 	item = janus_config_get(config, config_general, janus_config_type_item, "recordings_tmp_ext");
 	if(item && item->value) {
 		janus_recorder_init(TRUE, item->value);
@@ -5173,6 +6505,37 @@ gint main(int argc, char *argv[]) {
 		item = janus_config_get(config, config_general, janus_config_type_item, "allow_loop_indication");
 		if(item && item->value)
 			loops_api = janus_is_true(item->value);
+		/* Check how new handles should be placed on the loops */
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_placement");
+		if(item && item->value)
+			janus_ice_set_static_event_loops_placement(item->value);
+		/* Check if handles should move away from loops that are much busier than others */
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_rebalance");
+		if(item && item->value) {
+			int threshold = atoi(item->value);
+			if(threshold < 0) {
+				JANUS_LOG(LOG_WARN, "Ignoring event_loops_rebalance value as it's not a positive integer\n");
+			} else {
+				janus_ice_set_static_event_loops_rebalance(threshold);
+			}
+		}
+		/* Check if busy handles should be promoted to a loop of their own (hybrid mode) */
+		int promote_pps = 0, promote_busy = 0, dedicated_max = 0;
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_promote_pps");
+		if(item && item->value)
+			promote_pps = atoi(item->value);
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_promote_busy");
+		if(item && item->value)
+			promote_busy = atoi(item->value);
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_dedicated_max");
+		if(item && item->value)
+			dedicated_max = atoi(item->value);
+		if(promote_pps != 0 || promote_busy != 0)
+			janus_ice_set_static_event_loops_promotion(promote_pps, promote_busy, dedicated_max);
+		/* Check if the loops should be pinned to specific CPUs */
+		item = janus_config_get(config, config_general, janus_config_type_item, "event_loops_affinity");
+		if(item && item->value)
+			janus_ice_set_static_event_loops_affinity(item->value);
 		janus_ice_set_static_event_loops(loops, loops_api);
 	}
 	/* Also check if we need a cap on the size of the task pool (default is no limit) */
@@ -5183,6 +6546,21 @@ gint main(int argc, char *argv[]) {
 		if(task_pool_size <= 0)
 			task_pool_size = -1;
 	}
+	/* Check if we should dispatch requests to multiple ordered workers */
+	item = janus_config_get(config, config_general, janus_config_type_item, "request_workers");
+	if(item && item->value) {
+		int workers = atoi(item->value);
+		if(workers < 0 || workers > JANUS_REQUESTS_MAX_WORKERS) {
+			JANUS_LOG(LOG_WARN, "Invalid request_workers value (should be between 0 and %d), ignoring\n",
+				JANUS_REQUESTS_MAX_WORKERS);
+		} else if(workers > 0) {
+			requests_workers_num = workers;
+			requests_ordered = TRUE;
+		}
+	}
+	if(requests_workers_num == 0)
+		requests_workers_num = 1;
+	janus_metrics_init();
 	/* Initialize the ICE stack now */
 	janus_ice_init(ice_lite, ice_tcp, full_trickle, ignore_mdns, ipv6, ipv6_linklocal, rtp_min_port, rtp_max_port);
 	if(janus_ice_set_stun_server(stun_server, stun_port) < 0) {
@@ -5296,11 +6674,42 @@ gint main(int argc, char *argv[]) {
 			janus_set_min_nack_queue(mnq);
 		}
 	}
+	item = janus_config_get(config, config_media, janus_config_type_item, "packet_tracing");
+	if(item && item->value) {
+		int sampling = atoi(item->value);
+		if(sampling < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring packet_tracing value as it's not a positive integer\n");
+		} else {
+			janus_ice_set_packet_tracing(sampling);
+		}
+	}
 	item = janus_config_get(config, config_media, janus_config_type_item, "nack_optimizations");
 	if(item && item->value) {
 		gboolean optimize = janus_is_true(item->value);
 		janus_set_nack_optimizations_enabled(optimize);
 	}
+	uint32_t retransmit_bitrate = 0;
+	uint16_t retransmit_ratio = 0;
+	item = janus_config_get(config, config_media, janus_config_type_item, "retransmit_budget");
+	if(item && item->value) {
+		int rb = atoi(item->value);
+		if(rb < 0) {
+			JANUS_LOG(LOG_WARN, "Ignoring retransmit_budget value as it's not a positive integer\n");
+		} else {
+			retransmit_bitrate = rb;
+		}
+	}
+	item = janus_config_get(config, config_media, janus_config_type_item, "retransmit_ratio");
+	if(item && item->value) {
+		int rr = atoi(item->value);
+		if(rr < 0 || rr > G_MAXUINT16) {
+			JANUS_LOG(LOG_WARN, "Ignoring retransmit_ratio value as it's not a valid positive integer\n");
+		} else {
+			retransmit_ratio = rr;
+		}
+	}
+	if(retransmit_bitrate > 0 || retransmit_ratio > 0)
+		janus_set_retransmit_budget(retransmit_bitrate, retransmit_ratio);
 	/* no-media timer */
 	item = janus_config_get(config, config_media, janus_config_type_item, "no_media_timer");
 	if(item && item->value) {
@@ -5331,6 +6740,51 @@ gint main(int argc, char *argv[]) {
 			janus_set_twcc_period(tp);
 		}
 	}
+	/* Batched receive */
+	item = janus_config_get(config, config_media, janus_config_type_item, "recv_batch_size");
+	if(item && item->value) {
+		int rbs = atoi(item->value);
+		if(rbs < 0 || rbs > G_MAXUINT16) {
+			JANUS_LOG(LOG_WARN, "Ignoring recv_batch_size value as it's not a valid positive integer\n");
+		} else {
+			janus_ice_set_recv_batch_size(rbs);
+		}
+	}
+	/* Batched send */
+	item = janus_config_get(config, config_media, janus_config_type_item, "send_batch_size");
+	if(item && item->value) {
+		int sbs = atoi(item->value);
+		if(sbs < 0 || sbs > G_MAXUINT16) {
+			JANUS_LOG(LOG_WARN, "Ignoring send_batch_size value as it's not a valid positive integer\n");
+		} else {
+			janus_ice_set_send_batch_size(sbs);
+		}
+	}
+	/* Single-port mode (needs the static event loops to be there already) */
+	item = janus_config_get(config, config_nat, janus_config_type_item, "ice_single_port");
+	if(item && item->value) {
+		int port = atoi(item->value);
+		if(port < 0 || port > G_MAXUINT16) {
+			JANUS_LOG(LOG_WARN, "Ignoring ice_single_port value as it's not a valid port\n");
+		} else {
+			janus_ice_set_single_port(port);
+		}
+	}
+	/* Pacing */
+	item = janus_config_get(config, config_media, janus_config_type_item, "pacing");
+	if(item && item->value && janus_is_true(item->value)) {
+		uint32_t pacing_bitrate = 0;
+		item = janus_config_get(config, config_media, janus_config_type_item, "pacing_bitrate");
+		if(item && item->value) {
+			int pb = atoi(item->value);
+			if(pb < 0) {
+				JANUS_LOG(LOG_WARN, "Ignoring pacing_bitrate value as it's not a valid positive integer\n");
+			} else {
+				pacing_bitrate = pb;
+			}
+		}
+		janus_ice_set_pacing(TRUE, pacing_bitrate);
+	}
 
 	/* Setup OpenSSL stuff */
 	const char *server_pem;
@@ -5388,10 +6842,34 @@ gint main(int argc, char *argv[]) {
 		janus_options_destroy();
 		exit(1);
 	}
+	/* Check if we should advertise the cheapest SRTP profiles first */
+	item = janus_config_get(config, config_media, janus_config_type_item, "srtp_prefer_fastest");
+	if(item && item->value && janus_is_true(item->value))
+		janus_dtls_srtp_prefer_fastest();
 	/* Check if there's any custom value for the starting MTU to use in the BIO filter */
 	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_mtu");
 	if(item && item->value)
 		janus_dtls_bio_agent_set_mtu(atoi(item->value));
+	/* Check if we should keep a pool of pre-allocated DTLS stacks */
+	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_pool_size");
+	if(item && item->value) {
+		int dtls_pool_size = atoi(item->value);
+		if(dtls_pool_size < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid DTLS pool size: %s (no pool will be used)\n", item->value);
+		} else if(dtls_pool_size > 0 && janus_dtls_pool_init(dtls_pool_size) < 0) {
+			JANUS_LOG(LOG_WARN, "Error starting the DTLS pool, DTLS stacks will be allocated on demand\n");
+		}
+	}
+	/* Check if DTLS handshakes should be offloaded to a pool of crypto workers */
+	item = janus_config_get(config, config_media, janus_config_type_item, "dtls_workers");
+	if(item && item->value) {
+		int dtls_workers = atoi(item->value);
+		if(dtls_workers < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid DTLS workers value: %s (handshakes will not be offloaded)\n", item->value);
+		} else if(dtls_workers > 0 && janus_dtls_workers_init(dtls_workers) < 0) {
+			JANUS_LOG(LOG_WARN, "Error starting the DTLS workers, handshakes will not be offloaded\n");
+		}
+	}
 
 #ifdef HAVE_SCTP
 	/* Initialize SCTP for DataChannels */
@@ -5399,19 +6877,40 @@ gint main(int argc, char *argv[]) {
 		janus_options_destroy();
 		exit(1);
 	}
+	/* Check if SCTP associations should only be created when needed */
+	item = janus_config_get(config, config_media, janus_config_type_item, "sctp_lazy");
+	if(item && item->value)
+		janus_sctp_set_lazy(janus_is_true(item->value));
 #else
 	JANUS_LOG(LOG_WARN, "Data Channels support not compiled\n");
 #endif
 
-	/* Initialize the RTP forwarders functionality */
+	/* Initialize the RTP forwarders functionality: check if we need a pool of sender threads first */
+	item = janus_config_get(config, config_general, janus_config_type_item, "rtp_forwarder_threads");
+	if(item && item->value) {
+		int threads = atoi(item->value);
+		if(threads < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid number of RTP forwarder threads (%s), sending synchronously\n", item->value);
+		} else {
+			janus_rtp_forwarders_set_async(threads);
+		}
+	}
 	if(janus_rtp_forwarders_init() < 0) {
 		janus_options_destroy();
 		exit(1);
 	}
 
 	/* Sessions */
-	sessions = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
-	janus_mutex_init(&sessions_mutex);
+	int shard = 0;
+	for(shard=0; shard<JANUS_SESSIONS_SHARDS; shard++) {
+		g_rw_lock_init(&sessions[shard].lock);
+		sessions[shard].table = g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, NULL);
+	}
+	janus_mutex_init(&sessions_wheel.mutex);
+	int slot = 0;
+	for(slot=0; slot<JANUS_SESSIONS_WHEEL_LEVELS * JANUS_SESSIONS_WHEEL_SLOTS; slot++)
+		g_queue_init(&sessions_wheel.slots[slot]);
+	sessions_wheel.start = janus_get_monotonic_time();
 	/* Start the sessions timeout watchdog */
 	sessions_watchdog_context = g_main_context_new();
 	GMainLoop *watchdog_loop = g_main_loop_new(sessions_watchdog_context, FALSE);
@@ -5424,16 +6923,28 @@ gint main(int argc, char *argv[]) {
 		janus_options_destroy();
 		exit(1);
 	}
-	/* Start the thread that will dispatch incoming requests */
-	requests = g_async_queue_new_full((GDestroyNotify)janus_request_destroy);
-	GThread *requests_thread = g_thread_try_new("sessions requests", &janus_transport_requests, NULL, &error);
-	if(error != NULL) {
-		JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start requests thread...\n",
-			error->code, error->message ? error->message : "??");
-		g_error_free(error);
-		janus_options_destroy();
-		exit(1);
+	/* Start the threads that will handle incoming requests */
+	requests_workers = g_malloc0(requests_workers_num * sizeof(janus_requests_worker));
+	guint w = 0;
+	for(w=0; w<requests_workers_num; w++) {
+		janus_requests_worker *worker = &requests_workers[w];
+		worker->id = w+1;
+		worker->queue = g_async_queue_new_full((GDestroyNotify)janus_request_destroy);
+		janus_mutex_init(&worker->mutex);
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "requests %u", worker->id);
+		worker->thread = g_thread_try_new(requests_workers_num == 1 ? "sessions requests" : tname,
+			&janus_transport_requests, worker, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_FATAL, "Got error %d (%s) trying to start requests thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_options_destroy();
+			exit(1);
+		}
 	}
+	if(requests_ordered)
+		JANUS_LOG(LOG_INFO, "Dispatching requests to %u ordered workers\n", requests_workers_num);
 	/* Create a thread pool to handle asynchronous requests, no matter what the transport */
 	error = NULL;
 	tasks = g_thread_pool_new(janus_transport_task, NULL, task_pool_size, FALSE, &error);
@@ -5456,6 +6967,16 @@ gint main(int argc, char *argv[]) {
 	gboolean enable_events = FALSE;
 	if(item && item->value)
 		enable_events = janus_is_true(item->value);
+	/* How many threads should we use to dispatch events to handlers? */
+	int events_threads = 1;
+	item = janus_config_get(config, config_events, janus_config_type_item, "dispatch_threads");
+	if(item && item->value) {
+		events_threads = atoi(item->value);
+		if(events_threads < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid number of event dispatcher threads, using default value (1)\n");
+			events_threads = 1;
+		}
+	}
 	if(!enable_events) {
 		JANUS_LOG(LOG_INFO, "Event handlers support disabled\n");
 	} else {
@@ -5609,7 +7130,7 @@ gint main(int argc, char *argv[]) {
 			g_strfreev(disabled_eventhandlers);
 		disabled_eventhandlers = NULL;
 		/* Initialize the event broadcaster */
-		if(janus_events_init(enable_events, (server_name ? server_name : (char *)JANUS_SERVER_NAME), eventhandlers) < 0) {
+		if(janus_events_init(enable_events, (server_name ? server_name : (char *)JANUS_SERVER_NAME), eventhandlers, events_threads) < 0) {
 			JANUS_LOG(LOG_FATAL, "Error initializing the Event handlers mechanism...\n");
 			janus_options_destroy();
 			exit(1);
@@ -5639,6 +7160,7 @@ gint main(int argc, char *argv[]) {
 	if(item && item->value)
 		disabled_plugins = g_strsplit(item->value, ",", -1);
 	/* Open the shared objects */
+	GList *plugins_init = NULL;
 	struct dirent *pluginent = NULL;
 	char pluginpath[1024];
 	while((pluginent = readdir(dir))) {
@@ -5718,11 +7240,29 @@ gint main(int argc, char *argv[]) {
 					janus_plugin->get_package(), janus_plugin->get_api_compatibility(), JANUS_PLUGIN_API_VERSION);
 				continue;
 			}
-			if(janus_plugin->init(&janus_handler_plugin, configs_folder) < 0) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_plugin->get_package());
-				dlclose(plugin);
-				continue;
-			}
+			/* We'll initialize the plugin later, when we know about all of them */
+			janus_module_init *module = g_malloc0(sizeof(janus_module_init));
+			module->so = plugin;
+			module->plugin = janus_plugin;
+			plugins_init = g_list_append(plugins_init, module);
+		}
+	}
+	closedir(dir);
+	if(disabled_plugins != NULL)
+		g_strfreev(disabled_plugins);
+	disabled_plugins = NULL;
+	/* Initialize the plugins we found */
+	janus_modules_init(plugins_init, "plugin");
+	GList *temp = plugins_init;
+	while(temp) {
+		janus_module_init *module = (janus_module_init *)temp->data;
+		void *plugin = module->so;
+		janus_plugin *janus_plugin = module->plugin;
+		temp = temp->next;
+		if(module->result < 0) {
+			JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_plugin->get_package());
+			dlclose(plugin);
+		} else {
 			JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_plugin->get_version(), janus_plugin->get_version_string());
 			JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_plugin->get_package(), janus_plugin->get_name());
 			JANUS_LOG(LOG_VERB, "\t   %s\n", janus_plugin->get_description());
@@ -5743,10 +7283,8 @@ gint main(int argc, char *argv[]) {
 			g_hash_table_insert(plugins_so, (gpointer)janus_plugin->get_package(), plugin);
 		}
 	}
-	closedir(dir);
-	if(disabled_plugins != NULL)
-		g_strfreev(disabled_plugins);
-	disabled_plugins = NULL;
+	g_list_free_full(plugins_init, (GDestroyNotify)g_free);
+	plugins_init = NULL;
 
 	/* Load transports */
 	gboolean janus_api_enabled = FALSE, admin_api_enabled = FALSE;
@@ -5767,6 +7305,7 @@ gint main(int argc, char *argv[]) {
 	if(item && item->value)
 		disabled_transports = g_strsplit(item->value, ",", -1);
 	/* Open the shared objects */
+	GList *transports_init = NULL;
 	struct dirent *transportent = NULL;
 	char transportpath[1024];
 	while((transportent = readdir(dir))) {
@@ -5846,11 +7385,29 @@ gint main(int argc, char *argv[]) {
 					janus_transport->get_package(), janus_transport->get_api_compatibility(), JANUS_TRANSPORT_API_VERSION);
 				continue;
 			}
-			if(janus_transport->init(&janus_handler_transport, configs_folder) < 0) {
-				JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_transport->get_package());
-				dlclose(transport);
-				continue;
-			}
+			/* We'll initialize the transport later, when we know about all of them */
+			janus_module_init *module = g_malloc0(sizeof(janus_module_init));
+			module->so = transport;
+			module->transport = janus_transport;
+			transports_init = g_list_append(transports_init, module);
+		}
+	}
+	closedir(dir);
+	if(disabled_transports != NULL)
+		g_strfreev(disabled_transports);
+	disabled_transports = NULL;
+	/* Initialize the transports we found */
+	janus_modules_init(transports_init, "transport plugin");
+	temp = transports_init;
+	while(temp) {
+		janus_module_init *module = (janus_module_init *)temp->data;
+		void *transport = module->so;
+		janus_transport *janus_transport = module->transport;
+		temp = temp->next;
+		if(module->result < 0) {
+			JANUS_LOG(LOG_WARN, "The '%s' plugin could not be initialized\n", janus_transport->get_package());
+			dlclose(transport);
+		} else {
 			JANUS_LOG(LOG_VERB, "\tVersion: %d (%s)\n", janus_transport->get_version(), janus_transport->get_version_string());
 			JANUS_LOG(LOG_VERB, "\t   [%s] %s\n", janus_transport->get_package(), janus_transport->get_name());
 			JANUS_LOG(LOG_VERB, "\t   %s\n", janus_transport->get_description());
@@ -5867,10 +7424,8 @@ gint main(int argc, char *argv[]) {
 			g_hash_table_insert(transports_so, (gpointer)janus_transport->get_package(), transport);
 		}
 	}
-	closedir(dir);
-	if(disabled_transports != NULL)
-		g_strfreev(disabled_transports);
-	disabled_transports = NULL;
+	g_list_free_full(transports_init, (GDestroyNotify)g_free);
+	transports_init = NULL;
 	/* Make sure at least a Janus API transport is available */
 	if(!janus_api_enabled) {
 		JANUS_LOG(LOG_FATAL, "No Janus API transport is available... enable at least one and restart Janus\n");
@@ -5902,6 +7457,11 @@ gint main(int argc, char *argv[]) {
 		} while(res == -1 && errno == EINTR);
 	}
 
+	/* Everything has been loaded and initialized */
+	startup_time = janus_get_monotonic_time() - start_time;
+	g_atomic_int_set(&server_ready, 1);
+	JANUS_LOG(LOG_INFO, "Janus is ready (startup took %"SCNi64"ms)\n", startup_time/1000);
+
 	/* If the Event Handlers mechanism is enabled, notify handlers that Janus just started */
 	if(janus_events_is_enabled()) {
 		json_t *info = json_object();
@@ -5945,15 +7505,28 @@ gint main(int argc, char *argv[]) {
 	}
 	/* Get rid of requests tasks and thread too */
 	g_thread_pool_free(tasks, FALSE, FALSE);
-	JANUS_LOG(LOG_INFO, "Ending requests thread...\n");
-	g_async_queue_push(requests, &exit_message);
-	g_thread_join(requests_thread);
-	requests_thread = NULL;
-	g_async_queue_unref(requests);
+	JANUS_LOG(LOG_INFO, "Ending requests threads...\n");
+	for(w=0; w<requests_workers_num; w++) {
+		janus_requests_worker *worker = &requests_workers[w];
+		g_async_queue_push(worker->queue, &exit_message);
+		g_thread_join(worker->thread);
+		worker->thread = NULL;
+		g_async_queue_unref(worker->queue);
+		janus_mutex_destroy(&worker->mutex);
+	}
+	g_free(requests_workers);
+	requests_workers = NULL;
+
+	janus_json_shared_deinit();
 
 	JANUS_LOG(LOG_INFO, "Destroying sessions...\n");
-	g_clear_pointer(&sessions, g_hash_table_destroy);
+	for(shard=0; shard<JANUS_SESSIONS_SHARDS; shard++) {
+		g_clear_pointer(&sessions[shard].table, g_hash_table_destroy);
+		g_rw_lock_clear(&sessions[shard].lock);
+	}
+	janus_sdp_mdns_cache_deinit();
 	janus_ice_deinit();
+	janus_metrics_deinit();
 	JANUS_LOG(LOG_INFO, "Freeing crypto resources...\n");
 	janus_dtls_srtp_cleanup();
 	EVP_cleanup();
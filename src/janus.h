@@ -56,6 +56,10 @@ typedef struct janus_session {
 	gint timeout;
 	/*! \brief Flag to notify that transport is gone */
 	volatile gint transport_gone;
+	/*! \brief Link to this session in the timeouts wheel */
+	GList timer_link;
+	/*! \brief Slot of the timeouts wheel this session is in, or -1 if there's no timer armed */
+	gint timer_slot;
 	/*! \brief Mutex to lock/unlock this session */
 	janus_mutex mutex;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
@@ -129,6 +133,12 @@ struct janus_request {
 	json_t *message;
 	/*! \brief Pointer to any JSON errors parsing the original request */
 	json_error_t *error;
+	/*! \brief Monotonic time of when the request was received */
+	gint64 received;
+	/*! \brief If this request is part of a batch, array where to add the response, rather than send it */
+	json_t *batch;
+	/*! \brief Whether credentials have already been checked (e.g., for the batch this request is part of) */
+	gboolean authorized;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -3,16 +3,22 @@
  * \copyright GNU General Public License v3
  * \brief     Buffered logging
  * \details   Implementation of a simple buffered logger designed to remove
- * I/O wait from threads that may be sensitive to such delays. Buffers are
- * saved and reused to reduce allocation calls. The logger output can then
- * be printed to stdout and/or a log file. If external loggers are added
- * to the core, the logger output is passed to those as well.
+ * I/O wait from threads that may be sensitive to such delays. Each thread
+ * writes its lines to a lock-free ring of its own, whose buffers are saved
+ * and reused to reduce allocation calls, and a print thread drains all the
+ * rings in batches: when a ring is full, lines are either dropped (and
+ * counted) or the thread waits for some room, depending on the configured
+ * policy. The logger output can then be printed to stdout and/or a log file.
+ * If external loggers are added to the core, the logger output is passed
+ * to those as well, as a whole batch when they support it.
  *
  * \ingroup core
  * \ref core
  */
 
 #include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -26,13 +32,72 @@ typedef struct janus_log_buffer janus_log_buffer;
 struct janus_log_buffer {
 	int64_t timestamp;
 	size_t allocated;
-	janus_log_buffer *next;
+	/* If not NULL, the line still needs to be formatted, and str
+	 * contains the arguments that were captured (see below) */
+	const char *format;
+	guint nargs;
 	/* str is grown by allocating beyond the struct */
 	char str[1];
 };
 
 #define INITIAL_BUFSZ		2000
 
+/* When deferred formatting is enabled, lines logged via JANUS_LOG are not
+ * formatted by the thread logging them: the format (which is a string
+ * literal) and the arguments are saved instead, and the print thread takes
+ * care of the formatting. Strings are copied, as they may not be there
+ * anymore by the time the line is printed. Lines we can't handle this way
+ * (e.g., too many arguments, or unusual conversions) are formatted as usual. */
+typedef struct janus_log_arg {
+	/* 'i' (signed), 'u' (unsigned), 'd' (double), 'D' (long double),
+	 * 'p' (pointer), 's' (string) or 'n' (NULL string) */
+	char type;
+	union {
+		intmax_t i;
+		uintmax_t u;
+		double d;
+		long double ld;
+		const void *p;
+		/* For strings, where they start in the strings area */
+		size_t offset;
+	} value;
+} janus_log_arg;
+#define JANUS_LOG_MAX_ARGS	32
+
+/* A conversion in a format string */
+typedef struct janus_log_spec {
+	/* Length of the whole conversion, and of the flags/width/precision
+	 * part that follows the '%' */
+	size_t len, modifiers;
+	gboolean star_width, star_precision;
+	/* Literal precision, if any (-1 otherwise) */
+	int precision;
+	/* 'H' (hh), 'h', 'l', 'L' (ll), 'q' (L), 'j', 'z', 't' or 0 */
+	char length;
+	char conversion;
+} janus_log_spec;
+
+/* Each thread writes its log lines to a ring of its own, that the print
+ * thread drains: for every slot, the producer thread owns the buffer
+ * until it publishes it by moving the tail forward, and the print thread
+ * owns it until it gives it back by moving the head forward, so no lock
+ * is needed on either side. Buffers are kept in the slots for reuse. */
+typedef struct janus_log_ring janus_log_ring;
+struct janus_log_ring {
+	janus_log_buffer **slots;
+	guint size;
+	/* Free running indexes, masked when accessing slots */
+	volatile gint head, tail;
+	/* Lines dropped because the ring was full */
+	volatile gint dropped;
+	/* Whether the thread owning the ring is gone */
+	volatile gint orphaned;
+	janus_log_ring *next;
+};
+
+/* Default size of the rings (must be a power of two) */
+#define JANUS_LOG_RING_SIZE		128
+
 static gboolean janus_log_console = TRUE;
 static char *janus_log_filepath = NULL;
 static FILE *janus_log_file = NULL;
@@ -41,16 +106,21 @@ static GHashTable *external_loggers = NULL;
 
 static volatile gint initialized = 0;
 static gint stopping = 0;
-static gint poolsz = 0;
-static gint maxpoolsz = 32;
 /* Buffers over this size will be freed */
 static size_t maxbuffersz = 8000;
 static GMutex lock;
 static GCond cond;
+static volatile gint sleeping = 0;
 static GThread *printthread = NULL;
-static janus_log_buffer *printhead = NULL;
-static janus_log_buffer *printtail = NULL;
-static janus_log_buffer *bufferpool = NULL;
+
+/* Rings of all threads, and how new rings should behave */
+static GMutex rings_lock;
+static janus_log_ring *rings = NULL;
+static guint ring_size = JANUS_LOG_RING_SIZE;
+static gboolean ring_block = FALSE;
+static volatile gint deferred = 0;
+static void janus_log_ring_orphan(gpointer data);
+static GPrivate janus_log_current_ring = G_PRIVATE_INIT(janus_log_ring_orphan);
 
 
 gboolean janus_log_is_stdout_enabled(void) {
@@ -65,116 +135,487 @@ char *janus_log_get_logfile_path(void) {
 	return janus_log_filepath;
 }
 
+void janus_log_set_ring_options(guint size, gboolean block) {
+	/* Round the size up to a power of two, so that we can mask indexes */
+	guint rounded = 2;
+	while(rounded < size && rounded < (1 << 16))
+		rounded <<= 1;
+	ring_size = rounded;
+	ring_block = block;
+}
 
-static void janus_log_freebuffers(janus_log_buffer **list) {
-	janus_log_buffer *b, *head = *list;
 
-	while (head) {
-		b = head;
-		head = b->next;
-		g_free(b);
-	}
-	*list = NULL;
+void janus_log_set_deferred(gboolean enabled) {
+	g_atomic_int_set(&deferred, enabled ? 1 : 0);
 }
 
-static janus_log_buffer *janus_log_getbuf(void) {
-	janus_log_buffer *b;
+gboolean janus_log_is_deferred(void) {
+	return g_atomic_int_get(&deferred);
+}
 
-	g_mutex_lock(&lock);
-	b = bufferpool;
-	if (b) {
-		bufferpool = b->next;
-		b->next = NULL;
-	} else {
-		poolsz++;
-	}
-	g_mutex_unlock(&lock);
-	if (b == NULL) {
-		b = g_malloc(INITIAL_BUFSZ + sizeof(*b));
-		b->allocated = INITIAL_BUFSZ;
-		b->next = NULL;
-	}
-	return b;
+
+static janus_log_ring *janus_log_ring_get(void) {
+	janus_log_ring *ring = g_private_get(&janus_log_current_ring);
+	if(ring != NULL)
+		return ring;
+	/* First time this thread logs something, create a ring for it */
+	ring = g_malloc0(sizeof(janus_log_ring));
+	ring->size = ring_size;
+	ring->slots = g_malloc0(ring->size * sizeof(janus_log_buffer *));
+	g_private_set(&janus_log_current_ring, ring);
+	g_mutex_lock(&rings_lock);
+	ring->next = rings;
+	rings = ring;
+	g_mutex_unlock(&rings_lock);
+	return ring;
 }
 
-static void *janus_log_thread(void *ctx) {
-	janus_log_buffer *head, *b, *tofree = NULL;
+static void janus_log_ring_orphan(gpointer data) {
+	/* The thread is going away: the print thread will get rid of the ring once it's drained */
+	janus_log_ring *ring = (janus_log_ring *)data;
+	if(ring != NULL)
+		g_atomic_int_set(&ring->orphaned, 1);
+}
 
-	while (!g_atomic_int_get(&stopping)) {
+static void janus_log_ring_free(janus_log_ring *ring) {
+	guint i = 0;
+	for(i=0; i<ring->size; i++)
+		g_free(ring->slots[i]);
+	g_free(ring->slots);
+	g_free(ring);
+}
+
+static void janus_log_wakeup(void) {
+	/* Only bother the print thread if it's waiting for something to do */
+	if(g_atomic_int_get(&sleeping) && g_atomic_int_compare_and_exchange(&sleeping, 1, 0)) {
 		g_mutex_lock(&lock);
-		if (!printhead) {
-			g_cond_wait(&cond, &lock);
-		}
-		head = printhead;
-		printhead = printtail = NULL;
+		g_cond_signal(&cond);
 		g_mutex_unlock(&lock);
+	}
+}
 
-		if (head) {
-			for (b = head; b; b = b->next) {
-				if(janus_log_console)
-					fputs(b->str, stdout);
-				if(janus_log_file)
-					fputs(b->str, janus_log_file);
-				if(external_loggers != NULL) {
-					GHashTableIter iter;
-					gpointer value;
-					g_hash_table_iter_init(&iter, external_loggers);
-					while(g_hash_table_iter_next(&iter, NULL, &value)) {
-						janus_logger *l = value;
-						if(l == NULL)
-							continue;
-						l->incoming_logline(b->timestamp, b->str);
-					}
-				}
+/* Parse the conversion starting at the provided '%': returns FALSE if it's
+ * not one we know how to defer (e.g., positional arguments or wide chars) */
+static gboolean janus_log_parse_spec(const char *start, janus_log_spec *spec) {
+	const char *p = start+1;
+	memset(spec, 0, sizeof(*spec));
+	spec->precision = -1;
+	while(*p && strchr("-+ #0'", *p))
+		p++;
+	if(*p == '*') {
+		spec->star_width = TRUE;
+		p++;
+	} else {
+		while(g_ascii_isdigit(*p))
+			p++;
+	}
+	if(*p == '.') {
+		p++;
+		if(*p == '*') {
+			spec->star_precision = TRUE;
+			p++;
+		} else {
+			spec->precision = 0;
+			while(g_ascii_isdigit(*p)) {
+				if(spec->precision < 100000)
+					spec->precision = spec->precision*10 + (*p - '0');
+				p++;
 			}
-			g_mutex_lock(&lock);
-			while (head) {
-				b = head;
-				head = b->next;
-				if (poolsz >= maxpoolsz || b->allocated > maxbuffersz) {
-					b->next = tofree;
-					tofree = b;
-					poolsz--;
+		}
+	}
+	spec->modifiers = p - (start+1);
+	if(*p == 'h') {
+		p++;
+		spec->length = 'h';
+		if(*p == 'h') {
+			spec->length = 'H';
+			p++;
+		}
+	} else if(*p == 'l') {
+		p++;
+		spec->length = 'l';
+		if(*p == 'l') {
+			spec->length = 'L';
+			p++;
+		}
+	} else if(*p == 'L') {
+		spec->length = 'q';
+		p++;
+	} else if(*p == 'j' || *p == 'z' || *p == 't') {
+		spec->length = *p;
+		p++;
+	}
+	spec->conversion = *p;
+	if(*p == '\0' || !strchr("diouxXeEfFgGaAcsp%", *p))
+		return FALSE;
+	if(strchr("diouxX", *p) && spec->length == 'q')
+		return FALSE;
+	if(strchr("eEfFgGaA", *p) && spec->length != 0 && spec->length != 'l' && spec->length != 'q')
+		return FALSE;
+	if(strchr("csp%", *p) && spec->length != 0)
+		return FALSE;
+	if(*p == '%' && p != start+1)
+		return FALSE;
+	spec->len = p+1 - start;
+	return TRUE;
+}
+
+/* Save the arguments for a format string, so that it can be formatted later */
+static gboolean janus_log_capture(const char *format, va_list *ap,
+		janus_log_arg *args, const char **strings, int *lengths, guint *nargs) {
+	janus_log_spec spec;
+	guint n = 0;
+	const char *p = format;
+	while((p = strchr(p, '%')) != NULL) {
+		if(!janus_log_parse_spec(p, &spec))
+			return FALSE;
+		p += spec.len;
+		if(spec.conversion == '%')
+			continue;
+		if(n + 1 + spec.star_width + spec.star_precision > JANUS_LOG_MAX_ARGS)
+			return FALSE;
+		if(spec.star_width) {
+			args[n].type = 'i';
+			args[n].value.i = va_arg(*ap, int);
+			n++;
+		}
+		if(spec.star_precision) {
+			args[n].type = 'i';
+			args[n].value.i = va_arg(*ap, int);
+			spec.precision = args[n].value.i < 0 ? -1 : (int)args[n].value.i;
+			n++;
+		}
+		janus_log_arg *arg = &args[n];
+		switch(spec.conversion) {
+			case 'd':
+			case 'i':
+				arg->type = 'i';
+				if(spec.length == 'H')
+					arg->value.i = (signed char)va_arg(*ap, int);
+				else if(spec.length == 'h')
+					arg->value.i = (short)va_arg(*ap, int);
+				else if(spec.length == 'l')
+					arg->value.i = va_arg(*ap, long);
+				else if(spec.length == 'L')
+					arg->value.i = va_arg(*ap, long long);
+				else if(spec.length == 'j')
+					arg->value.i = va_arg(*ap, intmax_t);
+				else if(spec.length == 'z')
+					arg->value.i = va_arg(*ap, ssize_t);
+				else if(spec.length == 't')
+					arg->value.i = va_arg(*ap, ptrdiff_t);
+				else
+					arg->value.i = va_arg(*ap, int);
+				break;
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				arg->type = 'u';
+				if(spec.length == 'H')
+					arg->value.u = (unsigned char)va_arg(*ap, unsigned int);
+				else if(spec.length == 'h')
+					arg->value.u = (unsigned short)va_arg(*ap, unsigned int);
+				else if(spec.length == 'l')
+					arg->value.u = va_arg(*ap, unsigned long);
+				else if(spec.length == 'L')
+					arg->value.u = va_arg(*ap, unsigned long long);
+				else if(spec.length == 'j')
+					arg->value.u = va_arg(*ap, uintmax_t);
+				else if(spec.length == 'z')
+					arg->value.u = va_arg(*ap, size_t);
+				else if(spec.length == 't')
+					arg->value.u = (uintmax_t)va_arg(*ap, ptrdiff_t);
+				else
+					arg->value.u = va_arg(*ap, unsigned int);
+				break;
+			case 'c':
+				arg->type = 'i';
+				arg->value.i = va_arg(*ap, int);
+				break;
+			case 'p':
+				arg->type = 'p';
+				arg->value.p = va_arg(*ap, void *);
+				break;
+			case 's':
+				strings[n] = va_arg(*ap, const char *);
+				arg->type = strings[n] ? 's' : 'n';
+				if(strings[n] != NULL)
+					lengths[n] = spec.precision < 0 ? (int)strlen(strings[n]) : (int)strnlen(strings[n], spec.precision);
+				break;
+			default:
+				/* Floating point */
+				if(spec.length == 'q') {
+					arg->type = 'D';
+					arg->value.ld = va_arg(*ap, long double);
 				} else {
-					b->next = bufferpool;
-					bufferpool = b;
+					arg->type = 'd';
+					arg->value.d = va_arg(*ap, double);
 				}
+				break;
+		}
+		n++;
+	}
+	*nargs = n;
+	return TRUE;
+}
+
+/* Format a line whose arguments were captured: the format string is not a
+ * literal here, but it is one at the call site, where it has been checked */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static void janus_log_render(GString *out, const char *format, const janus_log_arg *args, const char *strings) {
+	janus_log_spec spec;
+	guint n = 0;
+	const char *p = format, *next = NULL;
+	char conv[64];
+	while((next = strchr(p, '%')) != NULL) {
+		g_string_append_len(out, p, next - p);
+		janus_log_parse_spec(next, &spec);
+		p = next + spec.len;
+		if(spec.conversion == '%') {
+			g_string_append_c(out, '%');
+			continue;
+		}
+		if(spec.modifiers > sizeof(conv) - 32) {
+			/* Way too long to be real, just print the conversion as it is */
+			g_string_append_len(out, next, spec.len);
+			n += 1 + spec.star_width + spec.star_precision;
+			continue;
+		}
+		/* Rebuild the conversion, resolving stars and normalizing the length */
+		size_t clen = 0;
+		const char *q = NULL;
+		conv[clen++] = '%';
+		for(q = next+1; q < next+1+spec.modifiers; q++) {
+			if(*q != '*') {
+				conv[clen++] = *q;
+				continue;
 			}
-			g_mutex_unlock(&lock);
-			if(janus_log_console)
-				fflush(stdout);
-			if(janus_log_file)
-				fflush(janus_log_file);
-			janus_log_freebuffers(&tofree);
+			int value = (int)args[n++].value.i;
+			if(value < 0 && q > next+1 && *(q-1) == '.') {
+				/* Negative precision, same as no precision at all */
+				clen--;
+				continue;
+			}
+			clen += g_snprintf(conv+clen, sizeof(conv)-clen, "%d", value);
+		}
+		const janus_log_arg *arg = &args[n++];
+		if(arg->type == 'i' && spec.conversion != 'c')
+			conv[clen++] = 'j';
+		else if(arg->type == 'u')
+			conv[clen++] = 'j';
+		else if(arg->type == 'D')
+			conv[clen++] = 'L';
+		conv[clen++] = spec.conversion;
+		conv[clen] = '\0';
+		switch(arg->type) {
+			case 'i':
+				if(spec.conversion == 'c')
+					g_string_append_printf(out, conv, (int)arg->value.i);
+				else
+					g_string_append_printf(out, conv, arg->value.i);
+				break;
+			case 'u':
+				g_string_append_printf(out, conv, arg->value.u);
+				break;
+			case 'd':
+				g_string_append_printf(out, conv, arg->value.d);
+				break;
+			case 'D':
+				g_string_append_printf(out, conv, arg->value.ld);
+				break;
+			case 'p':
+				g_string_append_printf(out, conv, arg->value.p);
+				break;
+			case 's':
+				g_string_append_printf(out, conv, strings + arg->value.offset);
+				break;
+			case 'n':
+			default:
+				g_string_append_printf(out, conv, "(null)");
+				break;
 		}
 	}
-	/* print any remaining messages, stdout flushed on exit */
-	for (b = printhead; b; b = b->next) {
+	g_string_append(out, p);
+}
+#pragma GCC diagnostic pop
+
+/* Format a deferred line in place, which may need a bigger buffer */
+static janus_log_buffer *janus_log_buffer_render(janus_log_buffer *b, GString *scratch) {
+	janus_log_arg args[JANUS_LOG_MAX_ARGS];
+	memcpy(args, b->str, b->nargs * sizeof(janus_log_arg));
+	g_string_truncate(scratch, 0);
+	janus_log_render(scratch, b->format, args, b->str + b->nargs * sizeof(janus_log_arg));
+	if(scratch->len + 1 > b->allocated) {
+		b = g_realloc(b, scratch->len + 1 + sizeof(*b));
+		b->allocated = scratch->len + 1;
+	}
+	memcpy(b->str, scratch->str, scratch->len + 1);
+	b->format = NULL;
+	b->nargs = 0;
+	return b;
+}
+
+/* Portion of a ring that is being drained */
+typedef struct janus_log_drain {
+	janus_log_ring *ring;
+	guint head, tail;
+} janus_log_drain;
+
+static gint janus_log_buffer_compare(gconstpointer a, gconstpointer b, gpointer user_data) {
+	const janus_log_buffer *ba = *(janus_log_buffer * const *)a, *bb = *(janus_log_buffer * const *)b;
+	return (ba->timestamp > bb->timestamp) - (ba->timestamp < bb->timestamp);
+}
+
+static guint janus_log_print_batch(GArray *drains, GPtrArray *batch, GArray *lines, GString *scratch) {
+	janus_log_buffer *b = NULL;
+	guint i = 0, j = 0, dropped = 0;
+	g_array_set_size(drains, 0);
+	g_ptr_array_set_size(batch, 0);
+	/* Take note of what each ring has for us, getting rid of the rings of threads that are gone */
+	g_mutex_lock(&rings_lock);
+	janus_log_ring *ring = rings, *prev = NULL;
+	while(ring) {
+		janus_log_ring *next = ring->next;
+		gboolean orphaned = g_atomic_int_get(&ring->orphaned);
+		janus_log_drain drain = { .ring = ring };
+		drain.head = (guint)g_atomic_int_get(&ring->head);
+		drain.tail = (guint)g_atomic_int_get(&ring->tail);
+		gint lost = g_atomic_int_get(&ring->dropped);
+		if(lost > 0) {
+			g_atomic_int_add(&ring->dropped, -lost);
+			dropped += lost;
+		}
+		if(drain.head != drain.tail) {
+			for(i=drain.head; i!=drain.tail; i++) {
+				janus_log_buffer **slot = &ring->slots[i & (ring->size-1)];
+				if((*slot)->format != NULL)
+					*slot = janus_log_buffer_render(*slot, scratch);
+				g_ptr_array_add(batch, *slot);
+			}
+			g_array_append_val(drains, drain);
+		} else if(orphaned) {
+			if(prev)
+				prev->next = next;
+			else
+				rings = next;
+			janus_log_ring_free(ring);
+			ring = next;
+			continue;
+		}
+		prev = ring;
+		ring = next;
+	}
+	g_mutex_unlock(&rings_lock);
+	if(batch->len == 0 && dropped == 0)
+		return 0;
+	/* Lines from different threads may be interleaved: sort them by timestamp
+	 * (the sort is stable, so lines from the same thread keep their order) */
+	if(drains->len > 1)
+		g_ptr_array_sort_with_data(batch, janus_log_buffer_compare, NULL);
+	char dropped_line[100];
+	if(dropped > 0) {
+		g_snprintf(dropped_line, sizeof(dropped_line),
+			"[WARN] %u log lines dropped, as the log buffers were full\n", dropped);
+	}
+	for(i=0; i<batch->len; i++) {
+		b = g_ptr_array_index(batch, i);
 		if(janus_log_console)
 			fputs(b->str, stdout);
 		if(janus_log_file)
 			fputs(b->str, janus_log_file);
-		if(external_loggers != NULL) {
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, external_loggers);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_logger *l = value;
-				if(l == NULL)
-					continue;
-				l->incoming_logline(b->timestamp, b->str);
+	}
+	if(dropped > 0) {
+		if(janus_log_console)
+			fputs(dropped_line, stdout);
+		if(janus_log_file)
+			fputs(dropped_line, janus_log_file);
+	}
+	if(external_loggers != NULL) {
+		/* Pass the whole batch to external loggers that support it, one line at a time to others */
+		g_array_set_size(lines, 0);
+		for(i=0; i<batch->len; i++) {
+			b = g_ptr_array_index(batch, i);
+			janus_logger_line line = { .timestamp = b->timestamp, .line = b->str };
+			g_array_append_val(lines, line);
+		}
+		if(dropped > 0) {
+			janus_logger_line line = { .timestamp = janus_get_real_time(), .line = dropped_line };
+			g_array_append_val(lines, line);
+		}
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, external_loggers);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_logger *l = value;
+			if(l == NULL)
+				continue;
+			if(l->incoming_loglines != NULL) {
+				l->incoming_loglines((janus_logger_line *)lines->data, lines->len);
+			} else {
+				for(j=0; j<lines->len; j++) {
+					janus_logger_line *line = &g_array_index(lines, janus_logger_line, j);
+					l->incoming_logline(line->timestamp, line->line);
+				}
 			}
 		}
 	}
+	if(janus_log_console)
+		fflush(stdout);
+	if(janus_log_file)
+		fflush(janus_log_file);
+	/* Give the slots back to the threads, freeing buffers that grew too much */
+	for(i=0; i<drains->len; i++) {
+		janus_log_drain *drain = &g_array_index(drains, janus_log_drain, i);
+		ring = drain->ring;
+		for(j=drain->head; j!=drain->tail; j++) {
+			janus_log_buffer **slot = &ring->slots[j & (ring->size-1)];
+			if((*slot)->allocated > maxbuffersz) {
+				g_free(*slot);
+				*slot = NULL;
+			}
+		}
+		g_atomic_int_set(&ring->head, (gint)drain->tail);
+	}
+	return batch->len + (dropped > 0 ? 1 : 0);
+}
+
+static void *janus_log_thread(void *ctx) {
+	GArray *drains = g_array_new(FALSE, FALSE, sizeof(janus_log_drain));
+	GPtrArray *batch = g_ptr_array_new();
+	GArray *lines = g_array_new(FALSE, FALSE, sizeof(janus_logger_line));
+	GString *scratch = g_string_sized_new(INITIAL_BUFSZ);
+
+	while (!g_atomic_int_get(&stopping)) {
+		if(janus_log_print_batch(drains, batch, lines, scratch) > 0)
+			continue;
+		/* Nothing to print: wait for a thread to wake us up, checking
+		 * once more after announcing it to avoid missing any line */
+		g_mutex_lock(&lock);
+		g_atomic_int_set(&sleeping, 1);
+		g_mutex_unlock(&lock);
+		if(janus_log_print_batch(drains, batch, lines, scratch) > 0) {
+			g_atomic_int_set(&sleeping, 0);
+			continue;
+		}
+		g_mutex_lock(&lock);
+		if(g_atomic_int_get(&sleeping) && !g_atomic_int_get(&stopping))
+			g_cond_wait_until(&cond, &lock, g_get_monotonic_time() + 100*G_TIME_SPAN_MILLISECOND);
+		g_atomic_int_set(&sleeping, 0);
+		g_mutex_unlock(&lock);
+	}
+	/* print any remaining messages, stdout flushed on exit */
+	while(janus_log_print_batch(drains, batch, lines, scratch) > 0);
 	janus_log_set_loggers(NULL);
 	if(janus_log_console)
 		fflush(stdout);
 	if(janus_log_file)
 		fflush(janus_log_file);
-	janus_log_freebuffers(&printhead);
-	janus_log_freebuffers(&bufferpool);
-	g_mutex_clear(&lock);
-	g_cond_clear(&cond);
+	g_array_free(drains, TRUE);
+	g_ptr_array_free(batch, TRUE);
+	g_array_free(lines, TRUE);
+	g_string_free(scratch, TRUE);
 
 	if(janus_log_file)
 		fclose(janus_log_file);
@@ -185,42 +626,103 @@ static void *janus_log_thread(void *ctx) {
 	return NULL;
 }
 
-void janus_vprintf(const char *format, ...) {
+static void janus_log_vwrite(gboolean deferrable, const char *format, va_list ap) G_GNUC_PRINTF(2, 0);
+static void janus_log_vwrite(gboolean deferrable, const char *format, va_list ap) {
 	int len;
-	va_list ap, ap2;
-	janus_log_buffer *b = janus_log_getbuf();
+	va_list ap2;
+	janus_log_ring *ring = janus_log_ring_get();
+	guint tail = (guint)g_atomic_int_get(&ring->tail);
+	while(tail - (guint)g_atomic_int_get(&ring->head) >= ring->size) {
+		/* The ring is full */
+		if(!ring_block || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
+			g_atomic_int_inc(&ring->dropped);
+			janus_log_wakeup();
+			return;
+		}
+		janus_log_wakeup();
+		g_usleep(100);
+	}
+	janus_log_buffer **slot = &ring->slots[tail & (ring->size-1)];
+	janus_log_buffer *b = *slot;
+	if(b == NULL) {
+		b = g_malloc(INITIAL_BUFSZ + sizeof(*b));
+		b->allocated = INITIAL_BUFSZ;
+	}
 	b->timestamp = janus_get_real_time();
+	b->format = NULL;
+	b->nargs = 0;
 
+	gboolean done = FALSE;
+	if(deferrable && g_atomic_int_get(&deferred)) {
+		/* Only save the arguments, the print thread will do the formatting */
+		janus_log_arg args[JANUS_LOG_MAX_ARGS];
+		const char *strings[JANUS_LOG_MAX_ARGS];
+		int lengths[JANUS_LOG_MAX_ARGS];
+		guint nargs = 0, i = 0;
+		va_copy(ap2, ap);
+		if(janus_log_capture(format, &ap2, args, strings, lengths, &nargs)) {
+			size_t size = nargs * sizeof(janus_log_arg), offset = 0;
+			for(i=0; i<nargs; i++) {
+				if(args[i].type == 's')
+					size += lengths[i] + 1;
+			}
+			if(size > b->allocated) {
+				b = g_realloc(b, size + sizeof(*b));
+				b->allocated = size;
+			}
+			char *area = b->str + nargs * sizeof(janus_log_arg);
+			for(i=0; i<nargs; i++) {
+				if(args[i].type != 's')
+					continue;
+				memcpy(area + offset, strings[i], lengths[i]);
+				area[offset + lengths[i]] = '\0';
+				args[i].value.offset = offset;
+				offset += lengths[i] + 1;
+			}
+			memcpy(b->str, args, nargs * sizeof(janus_log_arg));
+			b->format = format;
+			b->nargs = nargs;
+			done = TRUE;
+		}
+		va_end(ap2);
+	}
+	if(!done) {
+		va_copy(ap2, ap);
+		/* first try */
+		len = vsnprintf(b->str, b->allocated, format, ap);
+		if (len >= (int) b->allocated) {
+			/* buffer wasn't big enough */
+			b = g_realloc(b, len + 1 + sizeof(*b));
+			b->allocated = len + 1;
+			vsnprintf(b->str, b->allocated, format, ap2);
+		}
+		va_end(ap2);
+	}
+	*slot = b;
+
+	/* Publish the line, and let the print thread know */
+	g_atomic_int_set(&ring->tail, (gint)(tail + 1));
+	janus_log_wakeup();
+}
+
+void janus_vprintf(const char *format, ...) {
+	va_list ap;
 	va_start(ap, format);
-	va_copy(ap2, ap);
-	/* first try */
-	len = vsnprintf(b->str, b->allocated, format, ap);
+	janus_log_vwrite(FALSE, format, ap);
 	va_end(ap);
-	if (len >= (int) b->allocated) {
-		/* buffer wasn't big enough */
-		b = g_realloc(b, len + 1 + sizeof(*b));
-		b->allocated = len + 1;
-		vsnprintf(b->str, b->allocated, format, ap2);
-	}
-	va_end(ap2);
+}
 
-	g_mutex_lock(&lock);
-	if (!printhead) {
-		printhead = printtail = b;
-	} else {
-		printtail->next = b;
-		printtail = b;
-	}
-	g_cond_signal(&cond);
-	g_mutex_unlock(&lock);
+void janus_vprintf_deferred(const char *format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	janus_log_vwrite(TRUE, format, ap);
+	va_end(ap);
 }
 
 int janus_log_init(gboolean daemon, gboolean console, const char *logfile) {
 	if (!g_atomic_int_compare_and_exchange(&initialized, 0, 1)) {
 		return 0;
 	}
-	g_mutex_init(&lock);
-	g_cond_init(&cond);
 	if(console) {
 		/* Set stdout to block buffering, see BUFSIZ in stdio.h */
 		setvbuf(stdout, NULL, _IOFBF, 0);
@@ -270,6 +772,7 @@ void janus_log_destroy(void) {
 	g_atomic_int_set(&stopping, 1);
 	g_mutex_lock(&lock);
 	/* Signal print thread to print any remaining message */
+	g_atomic_int_set(&sleeping, 0);
 	g_cond_signal(&cond);
 	g_mutex_unlock(&lock);
 	g_thread_join(printthread);
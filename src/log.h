@@ -23,15 +23,37 @@
 * optional parameters to insert into formatted string (printf style)
 * \note This output is buffered and may not appear immediately on stdout. */
 void janus_vprintf(const char *format, ...) G_GNUC_PRINTF(1, 2);
+/*! \brief Buffered vprintf that may defer the formatting to the logger thread
+* @param[in] format Format string, which MUST be a string literal, followed
+* by the optional parameters to insert into formatted string (printf style)
+* \note When deferred formatting is enabled, only the format and a copy of
+* the arguments are saved, and the logger thread takes care of formatting
+* the line later: this is what JANUS_LOG uses. If not enabled, or if the
+* format can't be deferred, this behaves exactly like janus_vprintf. */
+void janus_vprintf_deferred(const char *format, ...) G_GNUC_PRINTF(1, 2);
 
 /*! \brief Log initialization
-* \note This should be called before attempting to use the logger. A buffer
-* pool and processing thread are created.
+* \note This should be called before attempting to use the logger. The
+* processing thread that drains the per-thread log rings is created.
 * @param daemon Whether the Janus is running as a daemon or not
 * @param console Whether the output should be printed on stdout or not
 * @param logfile Log file to save the output to, if any
 * @returns 0 in case of success, a negative integer otherwise */
 int janus_log_init(gboolean daemon, gboolean console, const char *logfile);
+/*! \brief Method to configure the per-thread log rings
+* \note Only affects rings created after this call, which is why it should
+* be called as early as possible, and before janus_log_init.
+* @param size Number of lines each ring can hold (rounded up to a power of two)
+* @param block Whether threads should wait for room when their ring is full,
+* rather than dropping the line (the default) */
+void janus_log_set_ring_options(guint size, gboolean block);
+/*! \brief Method to enable or disable deferred formatting of log lines
+* @param enabled Whether lines printed via janus_vprintf_deferred should be
+* formatted by the logger thread, rather than by the thread printing them */
+void janus_log_set_deferred(gboolean enabled);
+/*! \brief Method to check whether deferred formatting of log lines is enabled
+* @returns TRUE if deferred formatting is enabled, FALSE otherwise */
+gboolean janus_log_is_deferred(void);
 /*! \brief Method to add a list of external loggers to the log management
  * @param loggers Hash table of external loggers registered in the core */
 void janus_log_set_loggers(GHashTable *loggers);
@@ -40,6 +40,7 @@ const char *janus_jsonlog_get_name(void);
 const char *janus_jsonlog_get_author(void);
 const char *janus_jsonlog_get_package(void);
 void janus_jsonlog_incoming_logline(int64_t timestamp, const char *line);
+void janus_jsonlog_incoming_loglines(const janus_logger_line *lines, guint count);
 json_t *janus_jsonlog_handle_request(json_t *request);
 
 /* Logger setup */
@@ -57,6 +58,7 @@ static janus_logger janus_jsonlog =
 		.get_package = janus_jsonlog_get_package,
 
 		.incoming_logline = janus_jsonlog_incoming_logline,
+		.incoming_loglines = janus_jsonlog_incoming_loglines,
 		.handle_request = janus_jsonlog_handle_request,
 	);
 
@@ -278,6 +280,25 @@ void janus_jsonlog_incoming_logline(int64_t timestamp, const char *line) {
 
 }
 
+void janus_jsonlog_incoming_loglines(const janus_logger_line *lines, guint count) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized) || lines == NULL) {
+		/* Janus is closing or the plugin is */
+		return;
+	}
+	/* Same as above, but we enqueue the whole batch with a single lock */
+	guint i = 0;
+	g_async_queue_lock(loglines);
+	for(i=0; i<count; i++) {
+		if(lines[i].line == NULL)
+			continue;
+		janus_jsonlog_line *l = g_malloc(sizeof(janus_jsonlog_line));
+		l->timestamp = lines[i].timestamp;
+		l->line = g_strdup(lines[i].line);
+		g_async_queue_push_unlocked(loglines, l);
+	}
+	g_async_queue_unlock(loglines);
+}
+
 json_t *janus_jsonlog_handle_request(json_t *request) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
 		return NULL;
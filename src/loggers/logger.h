@@ -49,6 +49,9 @@ janus_logger *create(void) {
  *
  * All the above methods and callbacks are mandatory: the Janus core will
  * reject al logger plugin that doesn't implement any of the mandatory callbacks.
+ * Logger plugins can optionally implement \c incoming_loglines() as well,
+ * in which case the core will pass them whole batches of log lines at
+ * once, rather than invoking \c incoming_logline() for each of them.
  *
  * Unlike other kind of modules (transports, plugins), the \c init() method
  * here only passes the path to the configurations files folder, as loggers
@@ -84,7 +87,7 @@ janus_logger *create(void) {
 
 
 /*! \brief Version of the API, to match the one logger plugins were compiled against */
-#define JANUS_LOGGER_API_VERSION	3
+#define JANUS_LOGGER_API_VERSION	4
 
 /*! \brief Initialization of all logger plugin properties to NULL
  *
@@ -112,12 +115,21 @@ static janus_logger janus_fake_logger_plugin =
 		.get_author = NULL,						\
 		.get_package = NULL,					\
 		.incoming_logline = NULL,				\
+		.incoming_loglines = NULL,				\
 		## __VA_ARGS__ }
 
 
 /*! \brief The logger plugin session and callbacks interface */
 typedef struct janus_logger janus_logger;
 
+/*! \brief A log line, as passed to logger plugins in batches */
+typedef struct janus_logger_line {
+	/*! \brief Timestamp of when the log line was printed */
+	int64_t timestamp;
+	/*! \brief String containing the log line */
+	const char *line;
+} janus_logger_line;
+
 
 /*! \brief The logger plugin session and callbacks interface */
 struct janus_logger {
@@ -170,6 +182,15 @@ struct janus_logger {
 	 * @param[in] request Jansson object containing the request
 	 * @returns A Jansson object containing the response for the client */
 	json_t *(* const handle_request)(json_t *request);
+
+	/*! \brief Optional callback to receive a batch of log lines at once
+	 * \details If implemented, the core invokes this callback instead of
+	 * \c incoming_logline for each batch of lines the logger processes,
+	 * in the order they were printed. As for \c incoming_logline, the
+	 * lines are NOT copies, and are only valid until the callback returns.
+	 * @param[in] lines Array of log lines
+	 * @param[in] count Number of log lines in the array */
+	void (* const incoming_loglines)(const janus_logger_line *lines, guint count);
 };
 
 /*! \brief The hook that logger plugins need to implement to be created from the Janus core */
@@ -0,0 +1,159 @@
+/*! \file    metrics.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Native metrics
+ * \details  Implementation of the core metrics. Each thread that updates a
+ * counter gets its own shard (aligned to a cache line, so that threads don't
+ * invalidate each other's caches), which is registered in a list that readers
+ * walk to sum up the values. When a thread exits, its counts are moved to a
+ * separate set of totals, so that they're not lost.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "mutex.h"
+#include "refcount.h"
+
+/* Names, types and descriptions of the core counters */
+static const struct {
+	const char *family, *labels, *help;
+} janus_metrics_counters_info[JANUS_METRICS_COUNTERS] = {
+	{ "janus_packets", "direction=\"in\"", "Packets received from and sent to peers" },
+	{ "janus_bytes", "direction=\"in\"", "Bytes received from and sent to peers" },
+	{ "janus_packets", "direction=\"out\"", NULL },
+	{ "janus_bytes", "direction=\"out\"", NULL },
+	{ "janus_nacks", "direction=\"in\"", "Packets NACKed by peers (in) and by Janus (out)" },
+	{ "janus_nacks", "direction=\"out\"", NULL },
+	{ "janus_retransmissions", NULL, "Packets retransmitted in response to a NACK" },
+	{ "janus_keyframe_requests", "direction=\"in\"", "Keyframe requests (PLI/FIR) received from and sent to peers" },
+	{ "janus_keyframe_requests", "direction=\"out\"", NULL },
+	{ "janus_srtp_errors", "direction=\"in\"", "SRTP/SRTCP unprotect (in) and protect (out) errors" },
+	{ "janus_srtp_errors", "direction=\"out\"", NULL },
+};
+/* Order in which the counters are printed, so that samples of the same family are together */
+static const janus_metrics_counter janus_metrics_counters_order[JANUS_METRICS_COUNTERS] = {
+	JANUS_METRICS_PACKETS_IN, JANUS_METRICS_PACKETS_OUT,
+	JANUS_METRICS_BYTES_IN, JANUS_METRICS_BYTES_OUT,
+	JANUS_METRICS_NACKS_IN, JANUS_METRICS_NACKS_OUT,
+	JANUS_METRICS_RETRANSMISSIONS,
+	JANUS_METRICS_PLIS_IN, JANUS_METRICS_PLIS_OUT,
+	JANUS_METRICS_SRTP_ERRORS_IN, JANUS_METRICS_SRTP_ERRORS_OUT
+};
+
+/* Shards of the threads that are still alive, and totals of those that are gone */
+static GList *shards = NULL;
+static guint64 retired[JANUS_METRICS_COUNTERS];
+static janus_mutex shards_mutex = JANUS_MUTEX_INITIALIZER;
+
+static void janus_metrics_shard_free(gpointer data) {
+	janus_metrics_shard *shard = (janus_metrics_shard *)data;
+	janus_mutex_lock(&shards_mutex);
+	int i = 0;
+	for(i=0; i<JANUS_METRICS_COUNTERS; i++)
+		retired[i] += shard->counters[i];
+	shards = g_list_remove(shards, shard);
+	janus_mutex_unlock(&shards_mutex);
+	free(shard);
+}
+static GPrivate janus_metrics_thread_shard = G_PRIVATE_INIT(janus_metrics_shard_free);
+
+void janus_metrics_init(void) {
+	janus_mutex_lock(&shards_mutex);
+	memset(retired, 0, sizeof(retired));
+	janus_mutex_unlock(&shards_mutex);
+}
+
+void janus_metrics_deinit(void) {
+	/* Shards are owned by their threads, so we only get rid of the list */
+	janus_mutex_lock(&shards_mutex);
+	g_list_free(shards);
+	shards = NULL;
+	janus_mutex_unlock(&shards_mutex);
+}
+
+janus_metrics_shard *janus_metrics_get_shard(void) {
+	janus_metrics_shard *shard = g_private_get(&janus_metrics_thread_shard);
+	if(G_LIKELY(shard != NULL))
+		return shard;
+	/* First counter this thread updates: allocate a shard on its own cache line(s) */
+	size_t size = (sizeof(janus_metrics_shard) + JANUS_CACHELINE_SIZE - 1) & ~(JANUS_CACHELINE_SIZE - 1);
+	if(posix_memalign((void **)&shard, JANUS_CACHELINE_SIZE, size) != 0)
+		g_error("Error allocating the metrics shard");
+	memset(shard, 0, size);
+	janus_mutex_lock(&shards_mutex);
+	shards = g_list_prepend(shards, shard);
+	janus_mutex_unlock(&shards_mutex);
+	g_private_set(&janus_metrics_thread_shard, shard);
+	return shard;
+}
+
+void janus_metrics_get_counters(guint64 *totals) {
+	if(totals == NULL)
+		return;
+	janus_mutex_lock(&shards_mutex);
+	int i = 0;
+	for(i=0; i<JANUS_METRICS_COUNTERS; i++)
+		totals[i] = retired[i];
+	GList *temp = shards;
+	while(temp) {
+		janus_metrics_shard *shard = (janus_metrics_shard *)temp->data;
+		for(i=0; i<JANUS_METRICS_COUNTERS; i++)
+			totals[i] += __atomic_load_n(&shard->counters[i], __ATOMIC_RELAXED);
+		temp = temp->next;
+	}
+	janus_mutex_unlock(&shards_mutex);
+}
+
+void janus_metrics_print_family(GString *out, const char *name, const char *type, const char *help) {
+	if(out == NULL || name == NULL || type == NULL)
+		return;
+	g_string_append_printf(out, "# TYPE %s %s\n", name, type);
+	if(help != NULL)
+		g_string_append_printf(out, "# HELP %s %s\n", name, help);
+}
+
+void janus_metrics_print_sample(GString *out, const char *name, const char *labels, double value) {
+	if(out == NULL || name == NULL)
+		return;
+	char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+	/* Use the C locale, whatever the configured one is */
+	g_ascii_dtostr(buffer, sizeof(buffer), value);
+	if(labels != NULL)
+		g_string_append_printf(out, "%s{%s} %s\n", name, labels, buffer);
+	else
+		g_string_append_printf(out, "%s %s\n", name, buffer);
+}
+
+void janus_metrics_print_counters(GString *out) {
+	guint64 totals[JANUS_METRICS_COUNTERS];
+	janus_metrics_get_counters(totals);
+	char name[64];
+	int i = 0;
+	for(i=0; i<JANUS_METRICS_COUNTERS; i++) {
+		janus_metrics_counter counter = janus_metrics_counters_order[i];
+		if(janus_metrics_counters_info[counter].help != NULL) {
+			janus_metrics_print_family(out, janus_metrics_counters_info[counter].family,
+				"counter", janus_metrics_counters_info[counter].help);
+		}
+		g_snprintf(name, sizeof(name), "%s_total", janus_metrics_counters_info[counter].family);
+		janus_metrics_print_sample(out, name, janus_metrics_counters_info[counter].labels, (double)totals[counter]);
+	}
+}
+
+char *janus_metrics_sanitize_name(const char *name) {
+	if(name == NULL)
+		return NULL;
+	char *sanitized = g_strdup(name), *c = NULL;
+	for(c = sanitized; *c != '\0'; c++) {
+		if(!g_ascii_isalnum(*c) && *c != '_' && *c != ':')
+			*c = '_';
+	}
+	if(g_ascii_isdigit(*sanitized))
+		*sanitized = '_';
+	return sanitized;
+}
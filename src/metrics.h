@@ -0,0 +1,96 @@
+/*! \file    metrics.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Native metrics (headers)
+ * \details  Implementation of the core metrics, that can be scraped in the
+ * Prometheus/OpenMetrics text format (e.g., via the HTTP transport) without
+ * having to poll the Admin API for each session and handle. Counters on the
+ * media path (packets, bytes, NACKs, PLIs, SRTP errors) are kept per thread,
+ * so that updating them never needs a lock or an atomic read-modify-write:
+ * each thread only ever writes its own shard, and all shards are summed up
+ * when the metrics are read. Gauges (sessions, handles, queue depths, event
+ * loops) and plugin-specific metrics are, instead, collected on read.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_METRICS_H
+#define JANUS_METRICS_H
+
+#include <glib.h>
+
+/*! \brief Core counters */
+typedef enum janus_metrics_counter {
+	/*! \brief Packets and bytes received from and sent to peers */
+	JANUS_METRICS_PACKETS_IN = 0,
+	JANUS_METRICS_BYTES_IN,
+	JANUS_METRICS_PACKETS_OUT,
+	JANUS_METRICS_BYTES_OUT,
+	/*! \brief Packets NACKed by peers, and NACKed by us */
+	JANUS_METRICS_NACKS_IN,
+	JANUS_METRICS_NACKS_OUT,
+	/*! \brief Packets retransmitted because of a NACK */
+	JANUS_METRICS_RETRANSMISSIONS,
+	/*! \brief Keyframe requests (PLI/FIR) received from and sent to peers */
+	JANUS_METRICS_PLIS_IN,
+	JANUS_METRICS_PLIS_OUT,
+	/*! \brief SRTP/SRTCP unprotect and protect errors */
+	JANUS_METRICS_SRTP_ERRORS_IN,
+	JANUS_METRICS_SRTP_ERRORS_OUT,
+	/*! \brief Number of counters (not a counter itself) */
+	JANUS_METRICS_COUNTERS
+} janus_metrics_counter;
+
+/*! \brief Per-thread set of counters */
+typedef struct janus_metrics_shard {
+	guint64 counters[JANUS_METRICS_COUNTERS];
+} janus_metrics_shard;
+
+/*! \brief Initialize the metrics subsystem */
+void janus_metrics_init(void);
+/*! \brief De-initialize the metrics subsystem */
+void janus_metrics_deinit(void);
+
+/*! \brief Get the counters shard of the current thread, creating it if needed
+ * @returns The shard of the current thread */
+janus_metrics_shard *janus_metrics_get_shard(void);
+/*! \brief Add a value to one of the core counters
+ * \note Only the current thread writes its shard, so a relaxed store is enough,
+ * and only serves the purpose of not having readers see a torn value
+ * @param[in] counter The counter to update
+ * @param[in] value The value to add */
+static inline void janus_metrics_add(janus_metrics_counter counter, guint64 value) {
+	janus_metrics_shard *shard = janus_metrics_get_shard();
+	__atomic_store_n(&shard->counters[counter], shard->counters[counter] + value, __ATOMIC_RELAXED);
+}
+/*! \brief Increase one of the core counters by one */
+#define janus_metrics_inc(counter) janus_metrics_add(counter, 1)
+/*! \brief Sum the counters of all threads
+ * @param[out] totals Array of JANUS_METRICS_COUNTERS values to fill */
+void janus_metrics_get_counters(guint64 *totals);
+
+/*! \brief Helpers to render metrics in the OpenMetrics text format */
+///@{
+/*! \brief Add the metadata of a metric family
+ * @param[in] out The buffer to append to
+ * @param[in] name The name of the family (e.g., \c janus_sessions)
+ * @param[in] type The OpenMetrics type (e.g., \c gauge or \c counter)
+ * @param[in] help A short description of the metric */
+void janus_metrics_print_family(GString *out, const char *name, const char *type, const char *help);
+/*! \brief Add a sample of a metric
+ * @param[in] out The buffer to append to
+ * @param[in] name The name of the sample (e.g., \c janus_packets_received_total for counters)
+ * @param[in] labels Labels of the sample, without braces (e.g., \c loop="1"), or NULL
+ * @param[in] value The value of the sample */
+void janus_metrics_print_sample(GString *out, const char *name, const char *labels, double value);
+/*! \brief Add the core counters
+ * @param[in] out The buffer to append to */
+void janus_metrics_print_counters(GString *out);
+/*! \brief Turn a string in a valid metric name (any character that's not allowed is replaced by an underscore)
+ * @param[in] name The string to convert
+ * @returns A new string (to free with g_free) */
+char *janus_metrics_sanitize_name(const char *name);
+///@}
+
+#endif
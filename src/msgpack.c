@@ -0,0 +1,305 @@
+/*! \file    msgpack.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    MessagePack encoding of JSON messages
+ * \details  Implementation of a simple MessagePack (https://msgpack.org)
+ * encoder and decoder for Jansson objects, that transports can use to
+ * exchange Janus API messages in a compact binary format rather than as
+ * JSON text, when clients negotiate that. Only the subset of MessagePack
+ * that maps to JSON is supported: maps must have string keys, binary
+ * values are decoded as strings, and extension types are rejected.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+
+#include "msgpack.h"
+
+/* Encoding */
+static void janus_msgpack_put(GByteArray *buffer, guint8 type, guint64 value, int size) {
+	guint8 data[9];
+	data[0] = type;
+	int i = 0;
+	for(i=0; i<size; i++)
+		data[1+i] = (value >> (8*(size-1-i))) & 0xFF;
+	g_byte_array_append(buffer, data, 1+size);
+}
+
+static void janus_msgpack_put_length(GByteArray *buffer, size_t len, guint8 fix, size_t fixmax, guint8 type8, guint8 type16, guint8 type32) {
+	if(len <= fixmax)
+		janus_msgpack_put(buffer, fix | len, 0, 0);
+	else if(type8 && len <= 0xFF)
+		janus_msgpack_put(buffer, type8, len, 1);
+	else if(len <= 0xFFFF)
+		janus_msgpack_put(buffer, type16, len, 2);
+	else
+		janus_msgpack_put(buffer, type32, len, 4);
+}
+
+static void janus_msgpack_put_string(GByteArray *buffer, const char *str, size_t len) {
+	janus_msgpack_put_length(buffer, len, 0xa0, 31, 0xd9, 0xda, 0xdb);
+	g_byte_array_append(buffer, (const guint8 *)str, len);
+}
+
+int janus_msgpack_encode(json_t *json, GByteArray *buffer) {
+	if(json == NULL || buffer == NULL)
+		return -1;
+	switch(json_typeof(json)) {
+		case JSON_NULL:
+			janus_msgpack_put(buffer, 0xc0, 0, 0);
+			break;
+		case JSON_FALSE:
+			janus_msgpack_put(buffer, 0xc2, 0, 0);
+			break;
+		case JSON_TRUE:
+			janus_msgpack_put(buffer, 0xc3, 0, 0);
+			break;
+		case JSON_INTEGER: {
+			json_int_t value = json_integer_value(json);
+			if(value >= 0) {
+				if(value <= 0x7F)
+					janus_msgpack_put(buffer, value, 0, 0);
+				else if(value <= 0xFF)
+					janus_msgpack_put(buffer, 0xcc, value, 1);
+				else if(value <= 0xFFFF)
+					janus_msgpack_put(buffer, 0xcd, value, 2);
+				else if(value <= 0xFFFFFFFFLL)
+					janus_msgpack_put(buffer, 0xce, value, 4);
+				else
+					janus_msgpack_put(buffer, 0xcf, value, 8);
+			} else {
+				if(value >= -32)
+					janus_msgpack_put(buffer, (guint8)(gint8)value, 0, 0);
+				else if(value >= G_MININT8)
+					janus_msgpack_put(buffer, 0xd0, (guint64)value & 0xFF, 1);
+				else if(value >= G_MININT16)
+					janus_msgpack_put(buffer, 0xd1, (guint64)value & 0xFFFF, 2);
+				else if(value >= G_MININT32)
+					janus_msgpack_put(buffer, 0xd2, (guint64)value & 0xFFFFFFFF, 4);
+				else
+					janus_msgpack_put(buffer, 0xd3, (guint64)value, 8);
+			}
+			break;
+		}
+		case JSON_REAL: {
+			double value = json_real_value(json);
+			guint64 bits = 0;
+			memcpy(&bits, &value, sizeof(bits));
+			janus_msgpack_put(buffer, 0xcb, bits, 8);
+			break;
+		}
+		case JSON_STRING:
+			janus_msgpack_put_string(buffer, json_string_value(json), strlen(json_string_value(json)));
+			break;
+		case JSON_ARRAY: {
+			size_t i = 0, size = json_array_size(json);
+			janus_msgpack_put_length(buffer, size, 0x90, 15, 0, 0xdc, 0xdd);
+			for(i=0; i<size; i++) {
+				if(janus_msgpack_encode(json_array_get(json, i), buffer) < 0)
+					return -1;
+			}
+			break;
+		}
+		case JSON_OBJECT: {
+			const char *key = NULL;
+			json_t *value = NULL;
+			janus_msgpack_put_length(buffer, json_object_size(json), 0x80, 15, 0, 0xde, 0xdf);
+			json_object_foreach(json, key, value) {
+				janus_msgpack_put_string(buffer, key, strlen(key));
+				if(janus_msgpack_encode(value, buffer) < 0)
+					return -1;
+			}
+			break;
+		}
+		default:
+			return -1;
+	}
+	return 0;
+}
+
+/* Decoding */
+typedef struct janus_msgpack_reader {
+	const guint8 *data;
+	size_t len, offset;
+	json_error_t *error;
+} janus_msgpack_reader;
+
+static void janus_msgpack_error(janus_msgpack_reader *reader, const char *text) {
+	if(reader->error == NULL)
+		return;
+	reader->error->line = -1;
+	reader->error->column = -1;
+	reader->error->position = reader->offset;
+	g_strlcpy(reader->error->source, "<msgpack>", sizeof(reader->error->source));
+	g_strlcpy(reader->error->text, text, sizeof(reader->error->text));
+}
+
+static gboolean janus_msgpack_get(janus_msgpack_reader *reader, int size, guint64 *value) {
+	if(reader->len - reader->offset < (size_t)size) {
+		janus_msgpack_error(reader, "Truncated MessagePack value");
+		return FALSE;
+	}
+	*value = 0;
+	int i = 0;
+	for(i=0; i<size; i++)
+		*value = (*value << 8) | reader->data[reader->offset++];
+	return TRUE;
+}
+
+static json_t *janus_msgpack_read_string(janus_msgpack_reader *reader, size_t len) {
+	if(reader->len - reader->offset < len) {
+		janus_msgpack_error(reader, "Truncated MessagePack string");
+		return NULL;
+	}
+	const char *str = (const char *)reader->data + reader->offset;
+	if(memchr(str, '\0', len) != NULL) {
+		janus_msgpack_error(reader, "MessagePack string contains NUL characters");
+		return NULL;
+	}
+	char *copy = g_strndup(str, len);
+	json_t *json = json_string(copy);
+	g_free(copy);
+	if(json == NULL)
+		janus_msgpack_error(reader, "Invalid UTF-8 in MessagePack string");
+	reader->offset += len;
+	return json;
+}
+
+static json_t *janus_msgpack_read(janus_msgpack_reader *reader, int depth);
+
+static json_t *janus_msgpack_read_array(janus_msgpack_reader *reader, size_t size, int depth) {
+	json_t *array = json_array();
+	size_t i = 0;
+	for(i=0; i<size; i++) {
+		json_t *value = janus_msgpack_read(reader, depth+1);
+		if(value == NULL) {
+			json_decref(array);
+			return NULL;
+		}
+		json_array_append_new(array, value);
+	}
+	return array;
+}
+
+static json_t *janus_msgpack_read_map(janus_msgpack_reader *reader, size_t size, int depth) {
+	json_t *object = json_object();
+	size_t i = 0;
+	for(i=0; i<size; i++) {
+		json_t *key = janus_msgpack_read(reader, depth+1);
+		if(key == NULL || !json_is_string(key)) {
+			if(key != NULL)
+				janus_msgpack_error(reader, "MessagePack map keys must be strings");
+			json_decref(key);
+			json_decref(object);
+			return NULL;
+		}
+		json_t *value = janus_msgpack_read(reader, depth+1);
+		if(value == NULL) {
+			json_decref(key);
+			json_decref(object);
+			return NULL;
+		}
+		json_object_set_new(object, json_string_value(key), value);
+		json_decref(key);
+	}
+	return object;
+}
+
+static json_t *janus_msgpack_read(janus_msgpack_reader *reader, int depth) {
+	if(depth > JANUS_MSGPACK_MAX_DEPTH) {
+		janus_msgpack_error(reader, "MessagePack value nested too deeply");
+		return NULL;
+	}
+	guint64 type = 0, value = 0;
+	if(!janus_msgpack_get(reader, 1, &type))
+		return NULL;
+	if(type <= 0x7f)
+		return json_integer(type);
+	if(type >= 0xe0)
+		return json_integer((gint8)type);
+	if((type & 0xf0) == 0x80)
+		return janus_msgpack_read_map(reader, type & 0x0f, depth);
+	if((type & 0xf0) == 0x90)
+		return janus_msgpack_read_array(reader, type & 0x0f, depth);
+	if((type & 0xe0) == 0xa0)
+		return janus_msgpack_read_string(reader, type & 0x1f);
+	switch(type) {
+		case 0xc0:
+			return json_null();
+		case 0xc2:
+			return json_false();
+		case 0xc3:
+			return json_true();
+		case 0xc4: case 0xd9:
+			return janus_msgpack_get(reader, 1, &value) ? janus_msgpack_read_string(reader, value) : NULL;
+		case 0xc5: case 0xda:
+			return janus_msgpack_get(reader, 2, &value) ? janus_msgpack_read_string(reader, value) : NULL;
+		case 0xc6: case 0xdb:
+			return janus_msgpack_get(reader, 4, &value) ? janus_msgpack_read_string(reader, value) : NULL;
+		case 0xca: {
+			if(!janus_msgpack_get(reader, 4, &value))
+				return NULL;
+			guint32 bits = value;
+			float f = 0;
+			memcpy(&f, &bits, sizeof(f));
+			return json_real(f);
+		}
+		case 0xcb: {
+			if(!janus_msgpack_get(reader, 8, &value))
+				return NULL;
+			double d = 0;
+			memcpy(&d, &value, sizeof(d));
+			return json_real(d);
+		}
+		case 0xcc:
+			return janus_msgpack_get(reader, 1, &value) ? json_integer(value) : NULL;
+		case 0xcd:
+			return janus_msgpack_get(reader, 2, &value) ? json_integer(value) : NULL;
+		case 0xce:
+			return janus_msgpack_get(reader, 4, &value) ? json_integer(value) : NULL;
+		case 0xcf:
+			if(!janus_msgpack_get(reader, 8, &value))
+				return NULL;
+			if(value > G_MAXINT64) {
+				janus_msgpack_error(reader, "MessagePack integer out of range");
+				return NULL;
+			}
+			return json_integer(value);
+		case 0xd0:
+			return janus_msgpack_get(reader, 1, &value) ? json_integer((gint8)value) : NULL;
+		case 0xd1:
+			return janus_msgpack_get(reader, 2, &value) ? json_integer((gint16)value) : NULL;
+		case 0xd2:
+			return janus_msgpack_get(reader, 4, &value) ? json_integer((gint32)value) : NULL;
+		case 0xd3:
+			return janus_msgpack_get(reader, 8, &value) ? json_integer((gint64)value) : NULL;
+		case 0xdc:
+			return janus_msgpack_get(reader, 2, &value) ? janus_msgpack_read_array(reader, value, depth) : NULL;
+		case 0xdd:
+			return janus_msgpack_get(reader, 4, &value) ? janus_msgpack_read_array(reader, value, depth) : NULL;
+		case 0xde:
+			return janus_msgpack_get(reader, 2, &value) ? janus_msgpack_read_map(reader, value, depth) : NULL;
+		case 0xdf:
+			return janus_msgpack_get(reader, 4, &value) ? janus_msgpack_read_map(reader, value, depth) : NULL;
+		default:
+			break;
+	}
+	/* Extension types, or never used values */
+	reader->offset--;
+	janus_msgpack_error(reader, "Unsupported MessagePack type");
+	return NULL;
+}
+
+json_t *janus_msgpack_decode(const guint8 *data, size_t len, size_t *consumed, json_error_t *error) {
+	janus_msgpack_reader reader = { .data = data, .len = len, .offset = 0, .error = error };
+	if(data == NULL || len == 0) {
+		janus_msgpack_error(&reader, "Empty MessagePack buffer");
+		return NULL;
+	}
+	json_t *json = janus_msgpack_read(&reader, 0);
+	if(consumed)
+		*consumed = reader.offset;
+	return json;
+}
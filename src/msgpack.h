@@ -0,0 +1,41 @@
+/*! \file    msgpack.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    MessagePack encoding of JSON messages (headers)
+ * \details  Implementation of a simple MessagePack (https://msgpack.org)
+ * encoder and decoder for Jansson objects, that transports can use to
+ * exchange Janus API messages in a compact binary format rather than as
+ * JSON text, when clients negotiate that. Only the subset of MessagePack
+ * that maps to JSON is supported: maps must have string keys, binary
+ * values are decoded as strings, and extension types are rejected.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_MSGPACK_H
+#define JANUS_MSGPACK_H
+
+#include <glib.h>
+#include <jansson.h>
+
+/*! \brief Maximum nesting level of decoded messages */
+#define JANUS_MSGPACK_MAX_DEPTH	64
+
+/*! \brief Encode a JSON value to MessagePack
+ * @param[in] json The JSON value to encode
+ * @param[in] buffer The buffer to append the encoded value to
+ * @returns 0 in case of success, a negative integer otherwise */
+int janus_msgpack_encode(json_t *json, GByteArray *buffer);
+
+/*! \brief Decode a MessagePack value to JSON
+ * \note A buffer may contain more than one value: \c consumed can be
+ * used to know where the next one starts
+ * @param[in] data The buffer containing the encoded value
+ * @param[in] len The size of the buffer
+ * @param[out] consumed How many bytes were used to decode the value
+ * @param[out] error Details on what went wrong, in case of errors
+ * @returns The decoded JSON value in case of success, NULL otherwise */
+json_t *janus_msgpack_decode(const guint8 *data, size_t len, size_t *consumed, json_error_t *error);
+
+#endif
@@ -0,0 +1,284 @@
+/*! \file    mutex.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Semaphors, Mutexes and Conditions
+ * \details  Implementation of the adaptive spinning for busy mutexes and,
+ * when built with \c LOCK_PROFILING, of the lock contention profiling.
+ * Profiling data is kept in a fixed size table of lock sites, indexed
+ * by file and line, that is updated atomically without any lock, so that
+ * profiling doesn't introduce contention of its own: in the unlikely
+ * event the same site ends up in different slots, they're merged when
+ * the statistics are retrieved.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mutex.h"
+
+/* Max number of spins before blocking (the same glibc uses for adaptive mutexes) */
+#define JANUS_MUTEX_SPINS_MAX	100
+
+#if defined(__x86_64__) || defined(__i386__)
+#define janus_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define janus_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define janus_cpu_relax() do { } while(0)
+#endif
+
+static volatile gint janus_mutex_cpus = 0;
+
+void janus_mutex_lock_spin(janus_mutex *mutex, volatile gint *spins) {
+	gint cpus = g_atomic_int_get(&janus_mutex_cpus);
+	if(cpus == 0) {
+		cpus = g_get_num_processors();
+		g_atomic_int_set(&janus_mutex_cpus, cpus);
+	}
+	if(cpus < 2) {
+		/* Spinning is pointless if the owner can't run in the meanwhile */
+		janus_mutex_lock_nodebug(mutex);
+		return;
+	}
+	gint estimate = g_atomic_int_get(spins);
+	gint max = MIN(JANUS_MUTEX_SPINS_MAX, estimate*2 + 10), count = 0;
+	gboolean locked = FALSE;
+	while(count < max) {
+		count++;
+		janus_cpu_relax();
+		if(janus_mutex_trylock_raw(mutex)) {
+			locked = TRUE;
+			break;
+		}
+	}
+	if(!locked)
+		janus_mutex_lock_nodebug(mutex);
+	/* Move the estimate towards what this acquisition needed */
+	g_atomic_int_set(spins, estimate + (count - estimate)/8);
+}
+
+#ifdef LOCK_PROFILING
+/* Lock sites (a power of two) */
+#define JANUS_LOCK_PROFILING_SITES	4096
+/* How many sampled locks per thread we can track at the same time */
+#define JANUS_LOCK_PROFILING_HELD	16
+
+volatile gint janus_lock_profiling = 0;
+static volatile gint janus_lock_profiling_sampling = 64;
+static volatile gint janus_lock_profiling_generation = 0;
+static janus_lock_site janus_lock_sites[JANUS_LOCK_PROFILING_SITES];
+
+/* Locks whose hold time a thread is sampling */
+typedef struct janus_lock_held {
+	janus_mutex *mutex;
+	janus_lock_site *site;
+	gint64 locked;
+	gint generation;
+} janus_lock_held;
+typedef struct janus_lock_thread {
+	guint acquisitions;
+	guint count;
+	janus_lock_held held[JANUS_LOCK_PROFILING_HELD];
+} janus_lock_thread;
+static GPrivate janus_lock_thread_info = G_PRIVATE_INIT(g_free);
+
+static gint64 janus_lock_profiling_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec*G_GINT64_CONSTANT(1000000000)) + ts.tv_nsec;
+}
+
+/* Counters are updated with relaxed atomics, as we only need them not to get lost */
+static void janus_lock_profiling_add(guint64 *counter, guint64 value) {
+	__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+static void janus_lock_profiling_max(guint64 *counter, guint64 value) {
+	guint64 current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	while(value > current && !__atomic_compare_exchange_n(counter, &current, value,
+		TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static janus_lock_site *janus_lock_profiling_site(const char *file, int line) {
+	guint hash = (guint)(GPOINTER_TO_SIZE(file) >> 3) * 31 + (guint)line;
+	guint i = 0;
+	for(i=0; i<JANUS_LOCK_PROFILING_SITES; i++) {
+		janus_lock_site *site = &janus_lock_sites[(hash + i) & (JANUS_LOCK_PROFILING_SITES-1)];
+		const char *site_file = g_atomic_pointer_get(&site->file);
+		if(site_file == NULL) {
+			if(g_atomic_pointer_compare_and_exchange(&site->file, NULL, file)) {
+				g_atomic_int_set(&site->line, line);
+				return site;
+			}
+			site_file = g_atomic_pointer_get(&site->file);
+		}
+		if(site_file == file && g_atomic_int_get(&site->line) == line)
+			return site;
+	}
+	/* Table full */
+	return NULL;
+}
+
+/* Locks sampled before profiling was last disabled may have been released
+ * without us noticing (unlocks are only tracked while profiling), so we
+ * get rid of them as soon as we see a newer generation */
+static void janus_lock_profiling_clear_held(janus_lock_thread *thread) {
+	gint generation = g_atomic_int_get(&janus_lock_profiling_generation);
+	guint i = 0, count = 0;
+	for(i=0; i<thread->count; i++) {
+		if(thread->held[i].generation != generation)
+			continue;
+		if(count != i)
+			thread->held[count] = thread->held[i];
+		count++;
+	}
+	thread->count = count;
+}
+
+void janus_mutex_lock_profiled(janus_mutex *mutex, const char *file, int line, volatile gint *spins) {
+	janus_lock_site *site = NULL;
+	if(!janus_mutex_trylock_raw(mutex)) {
+		/* Contended: take note of how long we have to wait */
+		gint64 start = janus_lock_profiling_now();
+		if(spins != NULL)
+			janus_mutex_lock_spin(mutex, spins);
+		else
+			janus_mutex_lock_nodebug(mutex);
+		guint64 waited = janus_lock_profiling_now() - start;
+		site = janus_lock_profiling_site(file, line);
+		if(site != NULL) {
+			janus_lock_profiling_add(&site->contentions, 1);
+			janus_lock_profiling_add(&site->wait_ns, waited);
+			janus_lock_profiling_max(&site->wait_max_ns, waited);
+		}
+	}
+	/* Check if we should sample the hold time of this acquisition */
+	janus_lock_thread *thread = g_private_get(&janus_lock_thread_info);
+	if(thread == NULL) {
+		thread = g_malloc0(sizeof(janus_lock_thread));
+		g_private_set(&janus_lock_thread_info, thread);
+	}
+	thread->acquisitions++;
+	if(thread->count > 0 && thread->held[0].generation != g_atomic_int_get(&janus_lock_profiling_generation))
+		janus_lock_profiling_clear_held(thread);
+	if(thread->acquisitions % (guint)g_atomic_int_get(&janus_lock_profiling_sampling) != 0 ||
+			thread->count == JANUS_LOCK_PROFILING_HELD)
+		return;
+	if(site == NULL)
+		site = janus_lock_profiling_site(file, line);
+	if(site == NULL)
+		return;
+	janus_lock_held *held = &thread->held[thread->count];
+	held->mutex = mutex;
+	held->site = site;
+	held->generation = g_atomic_int_get(&janus_lock_profiling_generation);
+	held->locked = janus_lock_profiling_now();
+	thread->count++;
+}
+
+void janus_mutex_unlock_profiled(janus_mutex *mutex) {
+	janus_lock_thread *thread = g_private_get(&janus_lock_thread_info);
+	if(thread == NULL || thread->count == 0)
+		return;
+	/* Locks are usually released in reverse order, start from the last one */
+	gint i = 0;
+	for(i=thread->count-1; i>=0; i--) {
+		janus_lock_held *held = &thread->held[i];
+		if(held->mutex != mutex)
+			continue;
+		if(held->generation == g_atomic_int_get(&janus_lock_profiling_generation)) {
+			guint64 hold = janus_lock_profiling_now() - held->locked;
+			janus_lock_profiling_add(&held->site->samples, 1);
+			janus_lock_profiling_add(&held->site->hold_ns, hold);
+			janus_lock_profiling_max(&held->site->hold_max_ns, hold);
+		}
+		/* Remove it from the list */
+		thread->count--;
+		if(i < (gint)thread->count)
+			memmove(&thread->held[i], &thread->held[i+1], (thread->count-i)*sizeof(janus_lock_held));
+		break;
+	}
+}
+
+void janus_lock_profiling_set(gboolean enabled, int sampling) {
+	if(sampling > 0)
+		g_atomic_int_set(&janus_lock_profiling_sampling, sampling);
+	/* Sampled acquisitions from a previous session are ignored when unlocked,
+	 * and cleared by each thread the next time it takes a profiled lock */
+	g_atomic_int_inc(&janus_lock_profiling_generation);
+	g_atomic_int_set(&janus_lock_profiling, enabled ? 1 : 0);
+	if(!enabled) {
+		/* Clear the locks this thread was sampling right away */
+		janus_lock_thread *thread = g_private_get(&janus_lock_thread_info);
+		if(thread != NULL)
+			janus_lock_profiling_clear_held(thread);
+	}
+}
+
+int janus_lock_profiling_get_sampling(void) {
+	return g_atomic_int_get(&janus_lock_profiling_sampling);
+}
+
+void janus_lock_profiling_reset(void) {
+	guint i = 0;
+	for(i=0; i<JANUS_LOCK_PROFILING_SITES; i++) {
+		janus_lock_site *site = &janus_lock_sites[i];
+		__atomic_store_n(&site->contentions, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->wait_ns, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->wait_max_ns, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->samples, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->hold_ns, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&site->hold_max_ns, 0, __ATOMIC_RELAXED);
+	}
+}
+
+static gint janus_lock_profiling_compare(gconstpointer a, gconstpointer b) {
+	const janus_lock_site *sa = (const janus_lock_site *)a, *sb = (const janus_lock_site *)b;
+	if(sa->wait_ns != sb->wait_ns)
+		return sa->wait_ns > sb->wait_ns ? -1 : 1;
+	if(sa->hold_ns != sb->hold_ns)
+		return sa->hold_ns > sb->hold_ns ? -1 : 1;
+	return 0;
+}
+
+GList *janus_lock_profiling_get(void) {
+	GList *list = NULL;
+	guint i = 0;
+	for(i=0; i<JANUS_LOCK_PROFILING_SITES; i++) {
+		janus_lock_site *site = &janus_lock_sites[i];
+		const char *file = g_atomic_pointer_get(&site->file);
+		gint line = g_atomic_int_get(&site->line);
+		if(file == NULL || line == 0)
+			continue;
+		guint64 contentions = __atomic_load_n(&site->contentions, __ATOMIC_RELAXED);
+		guint64 samples = __atomic_load_n(&site->samples, __ATOMIC_RELAXED);
+		if(contentions == 0 && samples == 0)
+			continue;
+		/* Merge slots referring to the same site */
+		janus_lock_site *copy = NULL;
+		GList *item = NULL;
+		for(item = list; item != NULL; item = item->next) {
+			janus_lock_site *s = (janus_lock_site *)item->data;
+			if(s->file == file && s->line == line) {
+				copy = s;
+				break;
+			}
+		}
+		if(copy == NULL) {
+			copy = g_malloc0(sizeof(janus_lock_site));
+			copy->file = file;
+			copy->line = line;
+			list = g_list_prepend(list, copy);
+		}
+		copy->contentions += contentions;
+		copy->wait_ns += __atomic_load_n(&site->wait_ns, __ATOMIC_RELAXED);
+		copy->wait_max_ns = MAX(copy->wait_max_ns, __atomic_load_n(&site->wait_max_ns, __ATOMIC_RELAXED));
+		copy->samples += samples;
+		copy->hold_ns += __atomic_load_n(&site->hold_ns, __ATOMIC_RELAXED);
+		copy->hold_max_ns = MAX(copy->hold_max_ns, __atomic_load_n(&site->hold_max_ns, __ATOMIC_RELAXED));
+	}
+	return g_list_sort(list, janus_lock_profiling_compare);
+}
+#endif
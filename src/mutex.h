@@ -2,6 +2,14 @@
  * \author   Lorenzo Miniero <lorenzo@meetecho.com>
  * \brief    Semaphors, Mutexes and Conditions
  * \details  Implementation (based on GMutex or pthread_mutex) of a locking mechanism based on mutexes and conditions.
+ * Short critical sections that are hit for each packet can use janus_mutex_lock_adaptive()
+ * instead of janus_mutex_lock(): in case the mutex is busy, the thread spins for a while
+ * before blocking, and how long it spins adapts to how long the same lock site waited before.
+ * When building with \c LOCK_PROFILING defined (which \c --enable-lock-profiling does),
+ * locking can also be profiled at runtime: when enabled, contended locks are tracked per
+ * lock site (file and line), with how long they had to wait, while the time locks are
+ * held for is sampled (one acquisition every N per thread). Notice that hold times for
+ * mutexes used with conditions include the time spent waiting on the condition.
  *
  * \ingroup core
  * \ref core
@@ -31,8 +39,8 @@ typedef pthread_mutex_t janus_mutex;
 #define janus_mutex_lock_nodebug(a) pthread_mutex_lock(a)
 /*! \brief Janus mutex lock with debug (prints the line that locked a mutex) */
 #define janus_mutex_lock_debug(a) { JANUS_PRINT("[%s:%s:%d:lock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); pthread_mutex_lock(a); }
-/*! \brief Janus mutex lock wrapper (selective locking debug) */
-#define janus_mutex_lock(a) { if(!lock_debug) { janus_mutex_lock_nodebug(a); } else { janus_mutex_lock_debug(a); } }
+/*! \brief Janus mutex try lock without debug, returning whether the mutex was locked */
+#define janus_mutex_trylock_raw(a) (!pthread_mutex_trylock(a))
 /*! \brief Janus mutex try lock without debug */
 #define janus_mutex_trylock_nodebug(a) { ret = !pthread_mutex_trylock(a); }
 /*! \brief Janus mutex try lock with debug (prints the line that tried to lock a mutex) */
@@ -43,8 +51,6 @@ typedef pthread_mutex_t janus_mutex;
 #define janus_mutex_unlock_nodebug(a) pthread_mutex_unlock(a)
 /*! \brief Janus mutex unlock with debug (prints the line that unlocked a mutex) */
 #define janus_mutex_unlock_debug(a) { JANUS_PRINT("[%s:%s:%d:unlock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); pthread_mutex_unlock(a); }
-/*! \brief Janus mutex unlock wrapper (selective locking debug) */
-#define janus_mutex_unlock(a) { if(!lock_debug) { janus_mutex_unlock_nodebug(a); } else { janus_mutex_unlock_debug(a); } }
 
 /*! \brief Janus condition implementation */
 typedef pthread_cond_t janus_condition;
@@ -81,8 +87,8 @@ typedef GMutex janus_mutex;
 #define janus_mutex_lock_nodebug(a) g_mutex_lock(a)
 /*! \brief Janus mutex lock with debug (prints the line that locked a mutex) */
 #define janus_mutex_lock_debug(a) { JANUS_PRINT("[%s:%s:%d:lock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); g_mutex_lock(a); }
-/*! \brief Janus mutex lock wrapper (selective locking debug) */
-#define janus_mutex_lock(a) { if(!lock_debug) { janus_mutex_lock_nodebug(a); } else { janus_mutex_lock_debug(a); } }
+/*! \brief Janus mutex try lock without debug, returning whether the mutex was locked */
+#define janus_mutex_trylock_raw(a) g_mutex_trylock(a)
 /*! \brief Janus mutex try lock without debug */
 #define janus_mutex_trylock_nodebug(a) { ret = g_mutex_trylock(a); }
 /*! \brief Janus mutex try lock with debug (prints the line that tried to lock a mutex) */
@@ -93,8 +99,6 @@ typedef GMutex janus_mutex;
 #define janus_mutex_unlock_nodebug(a) g_mutex_unlock(a)
 /*! \brief Janus mutex unlock with debug (prints the line that unlocked a mutex) */
 #define janus_mutex_unlock_debug(a) { JANUS_PRINT("[%s:%s:%d:unlock] %p\n", __FILE__, __FUNCTION__, __LINE__, a); g_mutex_unlock(a); }
-/*! \brief Janus mutex unlock wrapper (selective locking debug) */
-#define janus_mutex_unlock(a) { if(!lock_debug) { janus_mutex_unlock_nodebug(a); } else { janus_mutex_unlock_debug(a); } }
 
 /*! \brief Janus condition implementation */
 typedef GCond janus_condition;
@@ -113,4 +117,62 @@ typedef GCond janus_condition;
 
 #endif
 
+/*! \brief Spin on a busy mutex for a while, and then block if still busy
+ * @param mutex The mutex to lock
+ * @param spins Pointer to the estimate of how many spins this lock site needs */
+void janus_mutex_lock_spin(janus_mutex *mutex, volatile gint *spins);
+
+#ifdef LOCK_PROFILING
+/*! \brief Whether lock profiling is currently enabled */
+extern volatile gint janus_lock_profiling;
+/*! \brief Lock a mutex, keeping track of contention and (sampled) hold time
+ * @param mutex The mutex to lock
+ * @param file The file of the lock site
+ * @param line The line of the lock site
+ * @param spins Pointer to the spins estimate, if this is an adaptive lock, NULL otherwise */
+void janus_mutex_lock_profiled(janus_mutex *mutex, const char *file, int line, volatile gint *spins);
+/*! \brief Take note of a mutex being unlocked, if its hold time is being sampled
+ * @param mutex The mutex that is about to be unlocked */
+void janus_mutex_unlock_profiled(janus_mutex *mutex);
+
+/*! \brief Janus mutex lock wrapper (selective locking debug and profiling) */
+#define janus_mutex_lock(a) { if(lock_debug) { janus_mutex_lock_debug(a); } else if(g_atomic_int_get(&janus_lock_profiling)) { janus_mutex_lock_profiled(a, __FILE__, __LINE__, NULL); } else { janus_mutex_lock_nodebug(a); } }
+/*! \brief Janus adaptive mutex lock wrapper (selective locking debug and profiling) */
+#define janus_mutex_lock_adaptive(a) { static volatile gint janus_mutex_spins = 0; if(lock_debug) { janus_mutex_lock_debug(a); } else if(g_atomic_int_get(&janus_lock_profiling)) { janus_mutex_lock_profiled(a, __FILE__, __LINE__, &janus_mutex_spins); } else if(!janus_mutex_trylock_raw(a)) { janus_mutex_lock_spin(a, &janus_mutex_spins); } }
+/*! \brief Janus mutex unlock wrapper (selective locking debug and profiling) */
+#define janus_mutex_unlock(a) { if(lock_debug) { janus_mutex_unlock_debug(a); } else { if(g_atomic_int_get(&janus_lock_profiling)) { janus_mutex_unlock_profiled(a); } janus_mutex_unlock_nodebug(a); } }
+
+/*! \brief Lock profiling statistics for a lock site */
+typedef struct janus_lock_site {
+	/*! \brief File and line of the lock site */
+	const char *file;
+	volatile gint line;
+	/*! \brief How many times the lock was found busy, and how long we waited for it (ns) */
+	guint64 contentions, wait_ns, wait_max_ns;
+	/*! \brief How many acquisitions were sampled, and how long the lock was held for (ns) */
+	guint64 samples, hold_ns, hold_max_ns;
+} janus_lock_site;
+/*! \brief Enable or disable lock profiling
+ * @param enabled Whether lock profiling should be enabled
+ * @param sampling Sample the hold time of one acquisition every these many (per thread), 0 to keep the current value */
+void janus_lock_profiling_set(gboolean enabled, int sampling);
+/*! \brief Get the current sampling rate for hold times */
+int janus_lock_profiling_get_sampling(void);
+/*! \brief Reset the lock profiling statistics */
+void janus_lock_profiling_reset(void);
+/*! \brief Get a snapshot of the lock profiling statistics
+ * @returns A list of janus_lock_site copies (to free with g_free), sorted by total wait time */
+GList *janus_lock_profiling_get(void);
+
+#else
+
+/*! \brief Janus mutex lock wrapper (selective locking debug) */
+#define janus_mutex_lock(a) { if(!lock_debug) { janus_mutex_lock_nodebug(a); } else { janus_mutex_lock_debug(a); } }
+/*! \brief Janus adaptive mutex lock wrapper (selective locking debug) */
+#define janus_mutex_lock_adaptive(a) { static volatile gint janus_mutex_spins = 0; if(lock_debug) { janus_mutex_lock_debug(a); } else if(!janus_mutex_trylock_raw(a)) { janus_mutex_lock_spin(a, &janus_mutex_spins); } }
+/*! \brief Janus mutex unlock wrapper (selective locking debug) */
+#define janus_mutex_unlock(a) { if(!lock_debug) { janus_mutex_unlock_nodebug(a); } else { janus_mutex_unlock_debug(a); } }
+
+#endif
+
 #endif
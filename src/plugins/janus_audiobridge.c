@@ -39,11 +39,14 @@ room-<unique room ID>: {
 	audio_active_packets = 100 (number of packets with audio level, default=100, 2 seconds)
 	audio_level_average = 25 (average value of audio level, 127=muted, 0='too loud', default=25)
 	default_prebuffering = number of packets to buffer before decoding each participant (default=DEFAULT_PREBUFFERING)
+	mix_speakers = only decode and mix the N loudest participants, as reported by the audio level extension (default=0, mix everybody)
+	mix_threads = number of threads mixing the room in parallel, for very large rooms (default=1, max=16)
 	default_expectedloss = percent of packets we expect participants may miss, to help with FEC (default=0, max=20; automatically used for forwarders too)
 	default_bitrate = default bitrate in bps to use for the all participants (default=0, which means libopus decides; automatically used for forwarders too)
 	record = true|false (whether this room should be recorded, default=false)
 	record_file = /path/to/recording.wav (where to save the recording)
 	record_dir = /path/to/ (path to save the recording to, makes record_file a relative path if provided)
+	record_format = wav|opus (format of the recording, default=wav; opus needs libogg support)
 	mjrs = true|false (whether all participants in the room should be individually recorded to mjr files, default=false)
 	mjrs_dir = "/path/to/" (path to save the mjr files to)
 	allow_rtp_participants = true|false (whether participants should be allowed to join
@@ -110,6 +113,45 @@ room-<unique room ID>: {
  * different one without having to tear down the PeerConnection and
  * recreate it again (useful for sidebars and "waiting rooms"); finally,
  * \c leave allows you to leave an audio conference bridge for good.
+ *
+ * Asynchronous requests are processed by a configurable number of handler
+ * threads (see \c handler_threads in the plugin settings): requests are
+ * routed by room, so that requests addressed to the same room are still
+ * processed in order, while different rooms can proceed in parallel. To
+ * check how those threads are doing, the Admin API supports an additional
+ * \c query_handler request, which has to be formatted as follows:
+ *
+\verbatim
+{
+	"request" : "query_handler"
+}
+\endverbatim
+ *
+ * The response lists the handler threads, and how long each type of
+ * asynchronous request took so far (times are in microseconds):
+ *
+\verbatim
+{
+	"audiobridge" : "handler",
+	"handler_threads" : <number of handler threads>,
+	"handlers" : [
+		{
+			"id" : <ID of the handler thread>,
+			"queued" : <number of messages waiting to be processed>,
+			"processed" : <number of messages processed so far>
+		},
+		// Other handler threads
+	],
+	"requests" : {
+		"<request name, e.g., join>" : {
+			"count" : <number of requests processed>,
+			"avg_time" : <average processing time>,
+			"max_time" : <longest processing time>
+		},
+		// Other requests
+	}
+}
+\endverbatim
  *
  * The AudioBridge plugin also allows you to forward the mix to an
  * external listener, e.g., a gstreamer/ffmpeg pipeline waiting to
@@ -142,11 +184,14 @@ room-<unique room ID>: {
 	"audio_active_packets" : <number of packets with audio level (default=100, 2 seconds)>,
 	"audio_level_average" : <average value of audio level (127=muted, 0='too loud', default=25)>,
 	"default_prebuffering" : <number of packets to buffer before decoding each participant (default=DEFAULT_PREBUFFERING)>,
+	"mix_speakers" : <only decode and mix the N loudest participants, as reported by the audio level extension (default=0, mix everybody)>,
+	"mix_threads" : <number of threads mixing the room in parallel, for very large rooms (default=1, max=16)>,
 	"default_expectedloss" : <percent of packets we expect participants may miss, to help with FEC (default=0, max=20; automatically used for forwarders too)>,
 	"default_bitrate" : <bitrate in bps to use for the all participants (default=0, which means libopus decides; automatically used for forwarders too)>,
 	"record" : <true|false, whether to record the room or not, default=false>,
 	"record_file" : "</path/to/the/recording.wav, optional>",
 	"record_dir" : "</path/to/, optional; makes record_file a relative path, if provided>",
+	"record_format" : "<wav|opus, format of the recording (default=wav; opus needs libogg support)>",
 	"mjrs" : <true|false (whether all participants in the room should be individually recorded to mjr files, default=false)>,
 	"mjrs_dir" : "</path/to/, optional>",
 	"allow_rtp_participants" : <true|false, whether participants should be allowed to join via plain RTP as well, default=false>,
@@ -166,6 +211,9 @@ room-<unique room ID>: {
  *
  * If you requested a permanent room but a \c false value is returned
  * instead, good chances are that there are permission problems.
+ * Notice that, if a \c rooms_folder is configured, permanent rooms are
+ * saved there (one file per room) rather than in the configuration file,
+ * and are only loaded when they're first needed.
  *
  * An error instead (and the same applies to all other requests, so this
  * won't be repeated) would provide both an error code and a more verbose
@@ -262,9 +310,16 @@ room-<unique room ID>: {
 	"secret" : "<room secret; mandatory if configured>"
 	"record" : <true|false, whether this room should be automatically recorded or not>,
 	"record_file" : "<file where audio recording should be saved (optional)>",
-	"record_dir" : "<path where audio recording file should be saved (optional)>"
+	"record_dir" : "<path where audio recording file should be saved (optional)>",
+	"record_format" : "<wav|opus, format of the recording (optional)>"
 }
 \endverbatim
+ *
+ * Notice that the mixer never writes to disk itself: frames of the mix are
+ * queued to a separate thread, which saves them as they are (WAV) or encodes
+ * them first (Opus), which means much less data is written. If the disk is
+ * so slow that too many frames are queued, new ones are dropped rather than
+ * delaying the mix for participants.
  *
  * A room can also be recorded by saving the individual contributions of
  * participants to separate MJR files instead, in a format compatible with
@@ -402,7 +457,24 @@ room-<unique room ID>: {
 			"sampling_rate" : <sampling rate of the mixer>,
 			"spatial_audio" : <true|false, whether the mix has spatial audio (stereo)>,
 			"record" : <true|false, whether the room is being recorded>,
-			"num_participants" : <count of the participants>
+			"num_participants" : <count of the participants>,
+			"mixing" : {
+				"threads" : <number of threads mixing the room>,
+				"ticks" : <number of mixer ticks so far>,
+				"overruns" : <how many of them took the mixer longer than 20ms>,
+				"p50" : <median time, in microseconds, it took the mixer to prepare a tick>,
+				"p90" : <90th percentile of the same>,
+				"p99" : <99th percentile of the same>,
+				"max" : <slowest tick among the most recent ones>
+			},
+			"encoding" : {	// Only present if a pool of encoding threads is used
+				"ticks" : <number of mixer ticks encoded so far>,
+				"late" : <how many of them took longer than 20ms to be encoded>,
+				"p50" : <median time, in microseconds, it took to encode all frames in a tick>,
+				"p90" : <90th percentile of the same>,
+				"p99" : <99th percentile of the same>,
+				"max" : <slowest tick among the most recent ones>
+			}
 		},
 		// Other rooms
 	]
@@ -474,9 +546,22 @@ room-<unique room ID>: {
 	"port" : <port to forward the RTP packets to>,
 	"srtp_suite" : <length of authentication tag (32 or 80); optional>,
 	"srtp_crypto" : "<key to use as crypto (base64 encoded key as in SDES); optional>",
-	"always_on" : <true|false, whether silence should be forwarded when the room is empty>
+	"always_on" : <true|false, whether silence should be forwarded when the room is empty>,
+	"mirrors" : [	// Optional
+		{
+			"host" : "<IP address of an additional recipient of the same packets>",
+			"port" : <port of the additional recipient>
+		},
+		.. other mirrors, if needed..
+	]
 }
 \endverbatim
+ *
+ * The \c mirrors array allows you to send the same mix to more recipients
+ * without creating a separate forwarder for each of them: packets are
+ * encoded (and, if SRTP is used, encrypted) only once, and the very same
+ * packets are then sent to all of them. Mirrors must be numeric IP
+ * addresses (multicast addresses are fine too).
  *
  * The concept of "groups" is particularly important, here, in case groups were
  * enabled when creating a room. By default, in fact, if a room has groups disabled,
@@ -517,9 +602,20 @@ room-<unique room ID>: {
 {
 	"request" : "stop_rtp_forward",
 	"room" : <unique numeric ID of the room to remove the forwarder from>,
-	"stream_id" : <unique numeric ID of the RTP forwarder>
+	"stream_id" : <unique numeric ID of the RTP forwarder>,
+	"mirrors" : [	// Optional
+		{
+			"host" : "<IP address of the mirror to remove>",
+			"port" : <port of the mirror to remove>
+		},
+		.. other mirrors, if needed..
+	]
 }
 \endverbatim
+ *
+ * In case a \c mirrors array is provided, the forwarder is not stopped:
+ * only the listed mirrors are removed from it, while the forwarder keeps
+ * on sending packets to its main recipient and to the other mirrors.
  *
  * A successful request will result in a \c success response:
  *
@@ -559,6 +655,13 @@ room-<unique room ID>: {
 			"codec" : <codec this forwarder is using, if any>,
 			"ptype" : <payload type this forwarder is using, if any>,
 			"srtp" : <true|false, whether the RTP stream is encrypted>,
+			"mirrors" : [	// Only if the forwarder has mirrors
+				{
+					"host" : "<IP address of the mirror, as provided in rtp_forward>",
+					"port" : <port of the mirror>
+				},
+				// Other mirrors
+			],
 			"always_on" : <true|false, whether this forwarder works even when no participant is in or not>
 		},
 		// Other forwarders
@@ -1023,6 +1126,9 @@ room-<unique room ID>: {
  *
  */
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include "plugin.h"
 #ifdef __FreeBSD__
 #include <sys/socket.h>
@@ -1040,6 +1146,9 @@ room-<unique room ID>: {
 #include <netdb.h>
 #include <sys/time.h>
 #include <poll.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include "../debug.h"
 #include "../apierror.h"
@@ -1053,6 +1162,10 @@ room-<unique room ID>: {
 #include "../sdp-utils.h"
 #include "../utils.h"
 #include "../ip-utils.h"
+#include "janus_audiobridge_mix.h"
+#include "janus_audiobridge_jb.h"
+#include "janus_audiobridge_resampler.h"
+#include "janus_audiobridge_rec.h"
 
 
 /* Plugin information */
@@ -1088,6 +1201,7 @@ void janus_audiobridge_incoming_rtcp(janus_plugin_session *handle, janus_plugin_
 void janus_audiobridge_hangup_media(janus_plugin_session *handle);
 void janus_audiobridge_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_audiobridge_query_session(janus_plugin_session *handle);
+void janus_audiobridge_drain(gboolean draining);
 
 /* Plugin setup */
 static janus_plugin janus_audiobridge_plugin =
@@ -1112,6 +1226,7 @@ static janus_plugin janus_audiobridge_plugin =
 		.hangup_media = janus_audiobridge_hangup_media,
 		.destroy_session = janus_audiobridge_destroy_session,
 		.query_session = janus_audiobridge_query_session,
+		.drain = janus_audiobridge_drain,
 	);
 
 /* Plugin creator */
@@ -1166,6 +1281,7 @@ static struct janus_json_parameter create_parameters[] = {
 	{"record", JANUS_JSON_BOOL, 0},
 	{"record_file", JSON_STRING, 0},
 	{"record_dir", JSON_STRING, 0},
+	{"record_format", JSON_STRING, 0},
 	{"mjrs", JANUS_JSON_BOOL, 0},
 	{"mjrs_dir", JSON_STRING, 0},
 	{"allow_rtp_participants", JANUS_JSON_BOOL, 0},
@@ -1175,6 +1291,8 @@ static struct janus_json_parameter create_parameters[] = {
 	{"audio_active_packets", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"audio_level_average", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"default_prebuffering", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mix_speakers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mix_threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"default_expectedloss", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"default_bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"groups", JSON_ARRAY, 0}
@@ -1223,7 +1341,8 @@ static struct janus_json_parameter join_parameters[] = {
 static struct janus_json_parameter record_parameters[] = {
 	{"record", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED},
 	{"record_file", JSON_STRING, 0},
-	{"record_dir", JSON_STRING, 0}
+	{"record_dir", JSON_STRING, 0},
+	{"record_format", JSON_STRING, 0}
 };
 static struct janus_json_parameter mjrs_parameters[] = {
 	{"mjrs", JANUS_JSON_BOOL, JANUS_JSON_PARAM_REQUIRED},
@@ -1261,10 +1380,16 @@ static struct janus_json_parameter rtp_forward_parameters[] = {
 	{"host_family", JSON_STRING, 0},
 	{"srtp_suite", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"srtp_crypto", JSON_STRING, 0},
-	{"always_on", JANUS_JSON_BOOL, 0}
+	{"always_on", JANUS_JSON_BOOL, 0},
+	{"mirrors", JANUS_JSON_ARRAY, 0}
+};
+static struct janus_json_parameter rtp_forward_mirror_parameters[] = {
+	{"host", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"port", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter stop_rtp_forward_parameters[] = {
-	{"stream_id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
+	{"stream_id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"mirrors", JANUS_JSON_ARRAY, 0}
 };
 static struct janus_json_parameter play_file_parameters[] = {
 	{"filename", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
@@ -1280,20 +1405,27 @@ static struct janus_json_parameter checkstop_file_parameters[] = {
 static janus_config *config = NULL;
 static const char *config_folder = NULL;
 static janus_mutex config_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_config_folder *rooms_folder = NULL;
 
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
 static gboolean string_ids = FALSE;
+static gboolean shared_encoding = FALSE;
 static gboolean ipv6_disabled = FALSE;
 static janus_callbacks *gateway = NULL;
-static GThread *handler_thread;
 static void *janus_audiobridge_handler(void *data);
 static void janus_audiobridge_relay_rtp_packet(gpointer data, gpointer user_data);
 static void *janus_audiobridge_mixer_thread(void *data);
 static void *janus_audiobridge_participant_thread(void *data);
 static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle);
 
+/* Pool of threads to encode the mixed frames for participants, if enabled
+ * (by default, each participant has its own encoding thread instead) */
+static GThreadPool *encoders = NULL;
+static int encoding_threads = 0;
+static void janus_audiobridge_encoder_task(gpointer data, gpointer user_data);
+
 /* Extension to add while recording (e.g., "tmp" --> ".wav.tmp") */
 static char *rec_tempext = NULL;
 
@@ -1312,11 +1444,37 @@ typedef struct janus_audiobridge_message {
 	json_t *message;
 	json_t *jsep;
 } janus_audiobridge_message;
-static GAsyncQueue *messages = NULL;
 static janus_audiobridge_message exit_message;
 
+/* Asynchronous requests are processed by one or more handler threads, each
+ * with its own queue: messages are routed by room (or by session, when no
+ * room is specified), so that requests addressed to the same room are still
+ * processed in order, while different rooms can proceed in parallel */
+#define JANUS_AUDIOBRIDGE_DEFAULT_HANDLER_THREADS	1
+#define JANUS_AUDIOBRIDGE_MAX_HANDLER_THREADS		32
+typedef struct janus_audiobridge_handler_thread {
+	guint id;					/* Handler thread ID */
+	GThread *thread;			/* Handler thread */
+	GAsyncQueue *messages;		/* Queue of messages to process */
+	volatile gint processed;	/* How many messages this thread processed so far */
+} janus_audiobridge_handler_thread;
+static janus_audiobridge_handler_thread *handlers = NULL;
+static guint handler_threads = JANUS_AUDIOBRIDGE_DEFAULT_HANDLER_THREADS;
+static volatile gint handler_next = 0;
+
+/* Timing of asynchronous requests, per request type (see "query_handler") */
+typedef struct janus_audiobridge_request_stats {
+	guint64 count;			/* How many requests of this type were processed */
+	gint64 total_time;		/* Time spent processing them, in microseconds */
+	gint64 max_time;		/* Longest time spent on a single request, in microseconds */
+} janus_audiobridge_request_stats;
+static GHashTable *request_stats = NULL;
+static janus_mutex request_stats_mutex = JANUS_MUTEX_INITIALIZER;
+
 
 /* Structs */
+#define JANUS_AUDIOBRIDGE_ENCODING_SAMPLES	250
+#define JANUS_AUDIOBRIDGE_MAX_MIX_THREADS	16
 typedef struct janus_audiobridge_room {
 	guint64 room_id;			/* Unique room ID (when using integers) */
 	gchar *room_id_str;			/* Unique room ID (when using strings) */
@@ -1330,6 +1488,8 @@ typedef struct janus_audiobridge_room {
 	gboolean audiolevel_ext;	/* Whether the ssrc-audio-level extension must be negotiated or not for new joins */
 	gboolean audiolevel_event;	/* Whether to emit event to other users about audiolevel */
 	uint default_prebuffering;	/* Number of packets to buffer before decoding each participant */
+	uint mix_speakers;			/* If not 0, only the N loudest participants are decoded and mixed */
+	uint mix_threads;			/* Number of threads mixing this room (more than one means cascaded mixing) */
 	uint default_expectedloss;	/* Percent of packets we expect participants may miss, to help with FEC: can be overridden per-participant */
 	int32_t default_bitrate;	/* Default bitrate to use for all Opus streams when encoding */
 	int audio_active_packets;	/* Amount of packets with audio level for checkup */
@@ -1339,9 +1499,8 @@ typedef struct janus_audiobridge_room {
 	gchar *record_dir;			/* Folder to save the recording file to */
 	gboolean mjrs;				/* Whether all participants in the room should be individually recorded to mjr files or not */
 	gchar *mjrs_dir;			/* Folder to save the mjrs file to */
-	FILE *recording;			/* File to record the room into */
-	gint64 record_lastupdate;	/* Time when we last updated the wav header */
-	volatile gint wav_header_added;	/* If wav header is added in recording file */
+	janus_audiobridge_rec_format record_format;	/* Format to record the room in (WAV or Opus) */
+	janus_audiobridge_rec *recording;	/* Recorder writing the mix to file, if any */
 	gint64 rec_start_time;		/* Time when recording started for generating file name */
 	gboolean allow_plainrtp;	/* Whether plain RTP participants are allowed*/
 	gboolean destroy;			/* Value to flag the room for destruction */
@@ -1360,10 +1519,27 @@ typedef struct janus_audiobridge_room {
 	OpusEncoder *rtp_encoder;	/* Opus encoder instance to use for all RTP forwarders */
 	janus_mutex rtp_mutex;		/* Mutex to lock the RTP forwarders list */
 	int rtp_udp_sock;			/* UDP socket to use to forward RTP packets */
+	/* Time it took to encode all frames in the latest mixer ticks, if a pool of encoders is used */
+	gint64 encoding_latency[JANUS_AUDIOBRIDGE_ENCODING_SAMPLES];
+	guint encoding_samples, encoding_index;
+	guint64 encoding_ticks, encoding_late;
+	/* Time it took the mixer to prepare the latest ticks, whether or not a pool of encoders is used */
+	gint64 mixing_time[JANUS_AUDIOBRIDGE_ENCODING_SAMPLES];
+	guint mixing_samples, mixing_index;
+	guint64 mixing_ticks, mixing_overruns;
+	janus_mutex encoding_mutex;	/* Mutex to lock the encoding and mixing statistics */
 	janus_refcount ref;			/* Reference counter for this room */
 } janus_audiobridge_room;
 static GHashTable *rooms;
 static janus_mutex rooms_mutex = JANUS_MUTEX_INITIALIZER;
+
+/* Snapshots of the rooms list (public rooms only, and all rooms), so that
+ * frequent "list" requests don't need to iterate on all rooms every time */
+#define JANUS_AUDIOBRIDGE_DEFAULT_LIST_REFRESH	1000
+static guint list_refresh = JANUS_AUDIOBRIDGE_DEFAULT_LIST_REFRESH;
+static json_t *rooms_list_public = NULL, *rooms_list_all = NULL;
+static gint64 rooms_list_updated = 0;
+static janus_mutex rooms_list_mutex = JANUS_MUTEX_INITIALIZER;
 static char *admin_key = NULL;
 static gboolean lock_rtpfwd = FALSE;
 static gboolean lock_playfile = FALSE;
@@ -1377,6 +1553,8 @@ typedef struct janus_audiobridge_session {
 	volatile gint started;
 	volatile gint hangingup;
 	volatile gint destroyed;
+	volatile gint handler_index;	/* Handler thread this session's messages are routed to */
+	volatile gint pending_messages;	/* How many messages are still queued or being processed */
 	janus_refcount ref;
 } janus_audiobridge_session;
 static GHashTable *sessions;
@@ -1546,11 +1724,44 @@ typedef struct janus_audiobridge_plainrtp_media {
 	janus_rtp_switching_context context;
 	int pipefd[2];
 	GThread *thread;
+	struct janus_audiobridge_reactor *reactor;	/* Reactor thread serving this participant, if any */
 } janus_audiobridge_plainrtp_media;
 static void janus_audiobridge_plainrtp_media_cleanup(janus_audiobridge_plainrtp_media *media);
 static int janus_audiobridge_plainrtp_allocate_port(janus_audiobridge_plainrtp_media *media);
 static void *janus_audiobridge_plainrtp_relay_thread(void *data);
 
+/* Reactor threads, if enabled: rather than having a dedicated thread for
+ * each plain RTP participant, a fixed number of threads serves all of them */
+#define JANUS_AUDIOBRIDGE_MAX_REACTOR_THREADS	64
+static int reactor_threads = 0;
+#ifdef HAVE_EPOLL
+typedef struct janus_audiobridge_reactor {
+	guint id;
+	int epfd;
+	GThread *thread;
+	volatile gint stop;
+	GList *participants;	/* List of janus_audiobridge_reactor_participant instances */
+	guint count;			/* How many participants this reactor is serving */
+	janus_mutex mutex;
+} janus_audiobridge_reactor;
+static void janus_audiobridge_reactors_start(int num);
+static void janus_audiobridge_reactors_stop(void);
+struct janus_audiobridge_participant;
+static int janus_audiobridge_reactor_add(struct janus_audiobridge_participant *participant);
+#endif
+
+/* Plain RTP packets are read in batches, where supported (recvmmsg) */
+#define JANUS_AUDIOBRIDGE_RECV_BATCH	16
+typedef struct janus_audiobridge_recv_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr messages[JANUS_AUDIOBRIDGE_RECV_BATCH];
+	struct iovec iovecs[JANUS_AUDIOBRIDGE_RECV_BATCH];
+#endif
+	int length[JANUS_AUDIOBRIDGE_RECV_BATCH];
+	char data[JANUS_AUDIOBRIDGE_RECV_BATCH][1500];
+} janus_audiobridge_recv_batch;
+static int janus_audiobridge_recv_batch_read(janus_audiobridge_recv_batch *batch, int fd);
+
 /* AudioBridge participant */
 typedef struct janus_audiobridge_participant {
 	janus_audiobridge_session *session;
@@ -1559,10 +1770,10 @@ typedef struct janus_audiobridge_participant {
 	gchar *user_id_str;		/* Unique ID in the room (when using strings) */
 	gchar *display;			/* Display name (opaque value, only meaningful to application) */
 	gboolean admin;			/* If the participant is an admin (can't be globally muted) */
-	gboolean prebuffering;	/* Whether this participant needs pre-buffering of a few packets (just joined) */
 	uint prebuffer_count;	/* Number of packets to buffer before decoding this participant */
 	volatile gint active;	/* Whether this participant can receive media at all */
 	volatile gint encoding;	/* Whether this participant is currently encoding */
+	volatile gint encoder_scheduled;	/* Whether the pool of encoders has been asked to encode for this participant */
 	volatile gint decoding;	/* Whether this participant is currently decoding */
 	gboolean muted;			/* Whether this participant is muted */
 	int volume_gain;		/* Gain to apply to the input audio (in percentage) */
@@ -1571,10 +1782,11 @@ typedef struct janus_audiobridge_participant {
 	gboolean stereo;		/* Whether stereo will be used for spatial audio */
 	int spatial_position;	/* Panning of this participant in the mix */
 	/* RTP stuff */
-	GList *inbuf;			/* Incoming audio from this participant, as an ordered list of packets */
+	janus_audiobridge_jb *jb;	/* Incoming audio from this participant, in a jitter buffer */
+	janus_audiobridge_resampler *upsampler;		/* Resampler for the incoming audio, if G.711 */
+	janus_audiobridge_resampler *downsampler;	/* Resampler for the mixed audio, if G.711 */
 	GAsyncQueue *outbuf;	/* Mixed audio for this participant */
-	gint64 last_drop;		/* When we last dropped a packet because the imcoming queue was full */
-	janus_mutex qmutex;		/* Incoming queue mutex */
+	janus_mutex qmutex;		/* Mutex to reset the participant state */
 	int opus_pt;			/* Opus payload type */
 	int extmap_id;			/* Audio level RTP extension id, if any */
 	int dBov_level;			/* Value in dBov of the audio level (last value from extension) */
@@ -1583,6 +1795,11 @@ typedef struct janus_audiobridge_participant {
 	int user_audio_active_packets; /* Participant's number of audio packets to evaluate */
 	int user_audio_level_average;	 /* Participant's average level of dBov value */
 	gboolean talking;		/* Whether this participant is currently talking (uses audio levels extension) */
+	volatile gint speaker_level;	/* Smoothed audio level, used to pick the loudest speakers if only those are mixed */
+	volatile gint speaker;	/* Whether this participant is one of the loudest speakers (set by the mixer) */
+	gboolean skipping;		/* Whether we're currently not decoding this participant, as not a speaker */
+	unsigned char *warmup;	/* Latest Opus packet we didn't decode, to warm up the decoder when we start again */
+	int warmup_len;			/* Size of the latest Opus packet we didn't decode */
 	janus_rtp_switching_context context;	/* Needed in case the participant changes room */
 	janus_audiocodec codec;	/* Codec this participant is using (most often Opus, but G.711 is supported too) */
 	/* Plain RTP, in case this is not a WebRTC participant */
@@ -1591,6 +1808,7 @@ typedef struct janus_audiobridge_participant {
 	janus_mutex pmutex;
 	/* Opus stuff */
 	OpusEncoder *encoder;		/* Opus encoder instance */
+	gboolean shared_encoded;	/* Whether the last frame we sent was encoded by a shared encoder, rather than ours */
 	OpusDecoder *decoder;		/* Opus decoder instance */
 	gboolean fec;				/* Opus FEC status */
 	int expected_loss;			/* Percentage of expected loss, to configure libopus FEC behaviour (default=0, no FEC even if negotiated) */
@@ -1618,8 +1836,167 @@ typedef struct janus_audiobridge_rtp_relay_packet {
 	uint32_t timestamp;
 	uint16_t seq_number;
 	gboolean silence;
+	gboolean encoded;	/* Whether this mixed frame has already been encoded to Opus */
+	struct janus_audiobridge_shared_frame *shared;	/* Only used for mixed frames encoded by a shared encoder */
+	struct janus_audiobridge_encode_tick *tick;	/* Only used for mixed frames, if a pool of encoders is used */
+	janus_plugin_rtp_batch *batch;	/* Only used for outgoing packets, if several frames are sent at once */
 } janus_audiobridge_rtp_relay_packet;
 
+static void janus_audiobridge_encoder_schedule(janus_audiobridge_participant *participant);
+
+/* When a pool of encoders is used, we keep track of how long it takes
+ * to encode all the frames the mixer prepared in a specific tick */
+typedef struct janus_audiobridge_encode_tick {
+	janus_audiobridge_room *room;
+	gint64 started;
+	volatile gint pending;
+} janus_audiobridge_encode_tick;
+static void janus_audiobridge_encode_tick_done(janus_audiobridge_encode_tick *tick) {
+	if(tick == NULL || !g_atomic_int_dec_and_test(&tick->pending))
+		return;
+	/* All frames have been encoded, take note of how long it took */
+	janus_audiobridge_room *audiobridge = tick->room;
+	gint64 latency = janus_get_monotonic_time() - tick->started;
+	janus_mutex_lock(&audiobridge->encoding_mutex);
+	audiobridge->encoding_latency[audiobridge->encoding_index] = latency;
+	audiobridge->encoding_index = (audiobridge->encoding_index + 1) % JANUS_AUDIOBRIDGE_ENCODING_SAMPLES;
+	if(audiobridge->encoding_samples < JANUS_AUDIOBRIDGE_ENCODING_SAMPLES)
+		audiobridge->encoding_samples++;
+	audiobridge->encoding_ticks++;
+	if(latency > 20000)
+		audiobridge->encoding_late++;
+	janus_mutex_unlock(&audiobridge->encoding_mutex);
+	janus_refcount_decrease(&audiobridge->ref);
+	g_free(tick);
+}
+/* When shared encoding is enabled, the frame encoded once by the mixer
+ * is shared by all the listeners it's queued to, rather than copied */
+typedef struct janus_audiobridge_shared_frame {
+	int length;
+	janus_refcount ref;
+	uint8_t payload[];
+} janus_audiobridge_shared_frame;
+static void janus_audiobridge_shared_frame_free(const janus_refcount *frame_ref) {
+	janus_audiobridge_shared_frame *frame = janus_refcount_containerof(frame_ref, janus_audiobridge_shared_frame, ref);
+	g_free(frame);
+}
+static void janus_audiobridge_mixed_packet_free(janus_audiobridge_rtp_relay_packet *pkt) {
+	if(pkt == NULL)
+		return;
+	janus_audiobridge_encode_tick_done(pkt->tick);
+	if(pkt->shared != NULL)
+		janus_refcount_decrease(&pkt->shared->ref);
+	g_free(pkt->data);
+	g_free(pkt);
+}
+/* Helper to free decoded frames (e.g., when discarded by the jitter buffer) */
+static void janus_audiobridge_decoded_packet_free(janus_audiobridge_rtp_relay_packet *pkt) {
+	if(pkt == NULL)
+		return;
+	g_free(pkt->data);
+	g_free(pkt);
+}
+/* When shared encoding is enabled, muted participants all get the same
+ * audio: in that case, the mixer encodes it once per group of participants
+ * with the same Opus settings. We only do that for muted participants, and
+ * not for those who just happen to be silent in a tick, to avoid having
+ * participants switch back and forth between encoders all the time */
+typedef struct janus_audiobridge_shared_encoder {
+	OpusEncoder *encoder;
+	guint32 last_tick;		/* Last mixer tick the frame was encoded for */
+	janus_audiobridge_shared_frame *frame;	/* Frame encoded in the last tick, if any */
+	uint8_t payload[1500-12];
+} janus_audiobridge_shared_encoder;
+static guint64 janus_audiobridge_shared_encoder_key(janus_audiobridge_participant *participant) {
+	return ((guint64)(guint32)participant->opus_bitrate << 32) | ((guint64)(participant->opus_complexity & 0xFF) << 16) |
+		((guint64)(participant->fec ? 1 : 0) << 8) | (guint64)(participant->expected_loss & 0xFF);
+}
+static janus_audiobridge_shared_encoder *janus_audiobridge_shared_encoder_new(janus_audiobridge_room *audiobridge,
+		janus_audiobridge_participant *participant) {
+	int error = 0;
+	OpusEncoder *encoder = opus_encoder_create(audiobridge->sampling_rate,
+		audiobridge->spatial_audio ? 2 : 1, OPUS_APPLICATION_VOIP, &error);
+	if(error != OPUS_OK) {
+		JANUS_LOG(LOG_ERR, "Error creating shared Opus encoder (room %s)\n", audiobridge->room_id_str);
+		return NULL;
+	}
+	if(audiobridge->sampling_rate == 8000) {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_NARROWBAND));
+	} else if(audiobridge->sampling_rate == 12000) {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_MEDIUMBAND));
+	} else if(audiobridge->sampling_rate == 16000) {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+	} else if(audiobridge->sampling_rate == 24000) {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_SUPERWIDEBAND));
+	} else if(audiobridge->sampling_rate == 48000) {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_FULLBAND));
+	} else {
+		opus_encoder_ctl(encoder, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+	}
+	opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(participant->fec));
+	opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(participant->expected_loss));
+	opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(participant->opus_complexity));
+	opus_encoder_ctl(encoder, OPUS_SET_BITRATE(participant->opus_bitrate ? participant->opus_bitrate : OPUS_AUTO));
+	janus_audiobridge_shared_encoder *se = g_malloc0(sizeof(janus_audiobridge_shared_encoder));
+	se->encoder = encoder;
+	return se;
+}
+static void janus_audiobridge_shared_encoder_free(gpointer data) {
+	janus_audiobridge_shared_encoder *se = (janus_audiobridge_shared_encoder *)data;
+	if(se == NULL)
+		return;
+	opus_encoder_destroy(se->encoder);
+	if(se->frame != NULL)
+		janus_refcount_decrease(&se->frame->ref);
+	g_free(se);
+}
+static gboolean janus_audiobridge_shared_encoder_unused(gpointer key, gpointer value, gpointer user_data) {
+	janus_audiobridge_shared_encoder *se = (janus_audiobridge_shared_encoder *)value;
+	guint32 tick = GPOINTER_TO_UINT(user_data);
+	/* Get rid of encoders nobody used in the last second */
+	return (tick - se->last_tick) > 50;
+}
+
+static gint janus_audiobridge_latency_compare(gconstpointer a, gconstpointer b) {
+	gint64 la = *(const gint64 *)a, lb = *(const gint64 *)b;
+	return (la > lb) - (la < lb);
+}
+static void janus_audiobridge_latency_info(json_t *info, gint64 *latency, guint samples) {
+	if(samples == 0)
+		return;
+	/* Latency percentiles (in microseconds) of the most recent ticks */
+	qsort(latency, samples, sizeof(gint64), janus_audiobridge_latency_compare);
+	json_object_set_new(info, "p50", json_integer(latency[(samples*50)/100]));
+	json_object_set_new(info, "p90", json_integer(latency[(samples*90)/100]));
+	json_object_set_new(info, "p99", json_integer(latency[(samples*99)/100]));
+	json_object_set_new(info, "max", json_integer(latency[samples-1]));
+}
+static json_t *janus_audiobridge_encoding_info(janus_audiobridge_room *audiobridge) {
+	gint64 latency[JANUS_AUDIOBRIDGE_ENCODING_SAMPLES];
+	janus_mutex_lock(&audiobridge->encoding_mutex);
+	guint samples = audiobridge->encoding_samples;
+	memcpy(latency, audiobridge->encoding_latency, samples*sizeof(gint64));
+	json_t *info = json_object();
+	json_object_set_new(info, "ticks", json_integer(audiobridge->encoding_ticks));
+	json_object_set_new(info, "late", json_integer(audiobridge->encoding_late));
+	janus_mutex_unlock(&audiobridge->encoding_mutex);
+	janus_audiobridge_latency_info(info, latency, samples);
+	return info;
+}
+static json_t *janus_audiobridge_mixing_info(janus_audiobridge_room *audiobridge) {
+	gint64 latency[JANUS_AUDIOBRIDGE_ENCODING_SAMPLES];
+	janus_mutex_lock(&audiobridge->encoding_mutex);
+	guint samples = audiobridge->mixing_samples;
+	memcpy(latency, audiobridge->mixing_time, samples*sizeof(gint64));
+	json_t *info = json_object();
+	json_object_set_new(info, "threads", json_integer(audiobridge->mix_threads));
+	json_object_set_new(info, "ticks", json_integer(audiobridge->mixing_ticks));
+	json_object_set_new(info, "overruns", json_integer(audiobridge->mixing_overruns));
+	janus_mutex_unlock(&audiobridge->encoding_mutex);
+	janus_audiobridge_latency_info(info, latency, samples);
+	return info;
+}
+
 
 static void janus_audiobridge_participant_destroy(janus_audiobridge_participant *participant) {
 	if(!participant)
@@ -1646,19 +2023,14 @@ static void janus_audiobridge_participant_free(const janus_refcount *participant
 		opus_encoder_destroy(participant->encoder);
 	if(participant->decoder)
 		opus_decoder_destroy(participant->decoder);
-	while(participant->inbuf) {
-		GList *first = g_list_first(participant->inbuf);
-		janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-		participant->inbuf = g_list_delete_link(participant->inbuf, first);
-		if(pkt)
-			g_free(pkt->data);
-		g_free(pkt);
-	}
+	janus_audiobridge_jb_destroy(participant->jb);
+	janus_audiobridge_resampler_destroy(participant->upsampler);
+	janus_audiobridge_resampler_destroy(participant->downsampler);
+	g_free(participant->warmup);
 	if(participant->outbuf != NULL) {
 		while(g_async_queue_length(participant->outbuf) > 0) {
 			janus_audiobridge_rtp_relay_packet *pkt = g_async_queue_pop(participant->outbuf);
-			g_free(pkt->data);
-			g_free(pkt);
+			janus_audiobridge_mixed_packet_free(pkt);
 		}
 		g_async_queue_unref(participant->outbuf);
 	}
@@ -1784,41 +2156,6 @@ static guint32 janus_audiobridge_rtp_forwarder_add_helper(janus_audiobridge_room
 }
 
 
-/* Helper to sort incoming RTP packets by sequence numbers */
-static gint janus_audiobridge_rtp_sort(gconstpointer a, gconstpointer b) {
-	janus_audiobridge_rtp_relay_packet *pkt1 = (janus_audiobridge_rtp_relay_packet *)a;
-	janus_audiobridge_rtp_relay_packet *pkt2 = (janus_audiobridge_rtp_relay_packet *)b;
-	if(pkt1->seq_number < 100 && pkt2->seq_number > 65000) {
-		/* Sequence number was probably reset, pkt2 is older */
-		return 1;
-	} else if(pkt2->seq_number < 100 && pkt1->seq_number > 65000) {
-		/* Sequence number was probably reset, pkt1 is older */
-		return -1;
-	}
-	/* Simply compare timestamps */
-	if(pkt1->seq_number < pkt2->seq_number)
-		return -1;
-	else if(pkt1->seq_number > pkt2->seq_number)
-		return 1;
-	return 0;
-}
-
-/* Helper struct to generate and parse WAVE headers */
-typedef struct wav_header {
-	char riff[4];
-	uint32_t len;
-	char wave[4];
-	char fmt[4];
-	uint32_t formatsize;
-	uint16_t format;
-	uint16_t channels;
-	uint32_t samplerate;
-	uint32_t avgbyterate;
-	uint16_t samplebytes;
-	uint16_t channelbits;
-	char data[4];
-	uint32_t blocksize;
-} wav_header;
 
 
 /* In case we need mu-Law/a-Law support, these tables help us transcode */
@@ -1956,45 +2293,15 @@ static uint8_t janus_audiobridge_g711_alaw_encode(int16_t sample) {
 	return encoded;
 }
 
-/* Ugly helper code to quickly resample (in case we're using G.711 anywhere) */
-static int janus_audiobridge_resample(int16_t *input, int input_num, int input_rate, int16_t *output, int output_rate) {
-	if(input == NULL || output == NULL)
-		return 0;
-	if((input_rate != 8000 && input_rate != 16000 && input_rate != 24000 && input_rate != 48000) ||
-			(output_rate != 8000 && output_rate != 16000 && output_rate != 24000 && output_rate != 48000)) {
-		/* Invalid sampling rate */
-		return 0;
-	}
-	if(input_rate != 8000 && output_rate != 8000) {
-		/* We only use this for G.711, so one of the two MUST be 8000 */
-		return 0;
-	}
-	if(input_rate == output_rate) {
-		/* Easy enough */
-		memcpy(output, input, input_num*sizeof(int16_t));
-		return input_num;
-	} else if(input_rate < output_rate) {
-		/* Upsample */
-		int up = output_rate/input_rate, i = 0;
-		memset(output, 0, input_num*up);
-		for(i=0; i<input_num; i++) {
-			*(output + i*up) = *(input + i);
-		}
-		return input_num*up;
-	} else {
-		/* Downsample */
-		int down = input_rate/output_rate, i = 0;
-		for(i=0; i<input_num; i++) {
-			*(output + i) = *(input + i*down);
-		}
-		return input_num/down;
-	}
-}
-
 
 /* Mixer settings */
 #define DEFAULT_PREBUFFERING	6
 #define MAX_PREBUFFERING		50
+/* When only the loudest speakers are mixed, how often (in mixer ticks)
+ * we pick them, and how much louder (in dBov) somebody must be than one
+ * of the current speakers to take their place */
+#define SPEAKERS_SELECTION_TICKS	5
+#define SPEAKERS_HYSTERESIS			6
 
 
 /* Opus settings */
@@ -2085,9 +2392,9 @@ static int janus_audiobridge_create_opus_encoder_if_needed(janus_audiobridge_roo
 	return 0;
 }
 
-static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *cat, janus_audiobridge_room *audiobridge) {
+static int janus_audiobridge_create_static_rtp_forwarder(janus_config *room_config, janus_config_category *cat, janus_audiobridge_room *audiobridge, gboolean locked) {
 	guint32 forwarder_id = 0;
-	janus_config_item *forwarder_id_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_id");
+	janus_config_item *forwarder_id_item = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_id");
 	if(forwarder_id_item != NULL && forwarder_id_item->value != NULL &&
 			janus_string_to_uint32(forwarder_id_item->value, &forwarder_id) < 0) {
 		JANUS_LOG(LOG_ERR, "Invalid forwarder ID\n");
@@ -2095,14 +2402,14 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 	}
 
 	guint32 ssrc_value = 0;
-	janus_config_item *ssrc = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_ssrc");
+	janus_config_item *ssrc = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_ssrc");
 	if(ssrc != NULL && ssrc->value != NULL && janus_string_to_uint32(ssrc->value, &ssrc_value) < 0) {
 		JANUS_LOG(LOG_ERR, "Invalid SSRC (%s)\n", ssrc->value);
 		return 0;
 	}
 
 	janus_audiocodec codec = JANUS_AUDIOCODEC_OPUS;
-	janus_config_item *rfcodec = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_codec");
+	janus_config_item *rfcodec = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_codec");
 	if(rfcodec != NULL && rfcodec->value != NULL) {
 		codec = janus_audiocodec_from_name(rfcodec->value);
 		if(codec != JANUS_AUDIOCODEC_OPUS && codec != JANUS_AUDIOCODEC_PCMA && codec != JANUS_AUDIOCODEC_PCMU) {
@@ -2112,7 +2419,7 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 	}
 
 	int ptype = 100;
-	janus_config_item *pt = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_ptype");
+	janus_config_item *pt = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_ptype");
 	if(pt != NULL && pt->value != NULL) {
 		ptype = atoi(pt->value);
 		if(ptype < 0 || ptype > 127) {
@@ -2124,7 +2431,7 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 	/* If this room uses groups, check if a valid group name was provided */
 	uint group = 0;
 	if(audiobridge->groups != NULL) {
-		janus_config_item *group_name = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_group");
+		janus_config_item *group_name = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_group");
 		if(group_name != NULL && group_name->value != NULL) {
 			group = GPOINTER_TO_UINT(g_hash_table_lookup(audiobridge->groups, group_name->value));
 			if(group == 0) {
@@ -2134,7 +2441,7 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 		}
 	}
 
-	janus_config_item *port_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_port");
+	janus_config_item *port_item = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_port");
 	uint16_t port = 0;
 	if(port_item != NULL && port_item->value != NULL && janus_string_to_uint16(port_item->value, &port) < 0) {
 		JANUS_LOG(LOG_ERR, "Invalid port (%s)\n", port_item->value);
@@ -2144,13 +2451,13 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 		return 0;
 	}
 
-	janus_config_item *host_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_host");
+	janus_config_item *host_item = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_host");
 	if(host_item == NULL || host_item->value == NULL || strlen(host_item->value) == 0) {
 		return 0;
 	}
 	const char *host = host_item->value, *resolved_host = NULL;
 	int family = 0;
-	janus_config_item *host_family_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_host_family");
+	janus_config_item *host_family_item = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_host_family");
 	if(host_family_item != NULL && host_family_item->value != NULL) {
 		const char *host_family = host_family_item->value;
 		if(host_family) {
@@ -2197,8 +2504,8 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 	/* We may need to SRTP-encrypt this stream */
 	int srtp_suite = 0;
 	const char *srtp_crypto = NULL;
-	janus_config_item *s_suite = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_srtp_suite");
-	janus_config_item *s_crypto = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_srtp_crypto");
+	janus_config_item *s_suite = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_srtp_suite");
+	janus_config_item *s_crypto = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_srtp_crypto");
 	if(s_suite && s_suite->value) {
 		srtp_suite = atoi(s_suite->value);
 		if(srtp_suite != 32 && srtp_suite != 80) {
@@ -2209,25 +2516,28 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 			srtp_crypto = s_crypto->value;
 	}
 
-	janus_config_item *always_on_item = janus_config_get(config, cat, janus_config_type_item, "rtp_forward_always_on");
+	janus_config_item *always_on_item = janus_config_get(room_config, cat, janus_config_type_item, "rtp_forward_always_on");
 	gboolean always_on = FALSE;
 	if(always_on_item != NULL && always_on_item->value != NULL && strlen(always_on_item->value) > 0) {
 		always_on = janus_is_true(always_on_item->value);
 	}
 
 	/* Update room */
-	janus_mutex_lock(&rooms_mutex);
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
 	janus_mutex_lock(&audiobridge->mutex);
 
 	if(janus_audiobridge_create_udp_socket_if_needed(audiobridge)) {
 		janus_mutex_unlock(&audiobridge->mutex);
-		janus_mutex_unlock(&rooms_mutex);
+		if(!locked)
+			janus_mutex_unlock(&rooms_mutex);
 		return -1;
 	}
 
 	if(janus_audiobridge_create_opus_encoder_if_needed(audiobridge)) {
 		janus_mutex_unlock(&audiobridge->mutex);
-		janus_mutex_unlock(&rooms_mutex);
+		if(!locked)
+			janus_mutex_unlock(&rooms_mutex);
 		return -1;
 	}
 
@@ -2236,11 +2546,424 @@ static int janus_audiobridge_create_static_rtp_forwarder(janus_config_category *
 		always_on, forwarder_id);
 
 	janus_mutex_unlock(&audiobridge->mutex);
-	janus_mutex_unlock(&rooms_mutex);
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
 
 	return 0;
 }
 
+/* Helper to create a room out of a configuration category: rooms_mutex
+ * must be locked already if locked is TRUE, and is then not touched */
+static janus_audiobridge_room *janus_audiobridge_room_from_config(janus_config *room_config, janus_config_category *cat, gboolean locked) {
+	JANUS_LOG(LOG_VERB, "Adding AudioBridge room '%s'\n", cat->name);
+	janus_config_item *desc = janus_config_get(room_config, cat, janus_config_type_item, "description");
+	janus_config_item *priv = janus_config_get(room_config, cat, janus_config_type_item, "is_private");
+	janus_config_item *sampling = janus_config_get(room_config, cat, janus_config_type_item, "sampling_rate");
+	janus_config_item *spatial = janus_config_get(room_config, cat, janus_config_type_item, "spatial_audio");
+	janus_config_item *audiolevel_ext = janus_config_get(room_config, cat, janus_config_type_item, "audiolevel_ext");
+	janus_config_item *audiolevel_event = janus_config_get(room_config, cat, janus_config_type_item, "audiolevel_event");
+	janus_config_item *audio_active_packets = janus_config_get(room_config, cat, janus_config_type_item, "audio_active_packets");
+	janus_config_item *audio_level_average = janus_config_get(room_config, cat, janus_config_type_item, "audio_level_average");
+	janus_config_item *default_prebuffering = janus_config_get(room_config, cat, janus_config_type_item, "default_prebuffering");
+	janus_config_item *mix_speakers = janus_config_get(room_config, cat, janus_config_type_item, "mix_speakers");
+	janus_config_item *mix_threads = janus_config_get(room_config, cat, janus_config_type_item, "mix_threads");
+	janus_config_item *default_expectedloss = janus_config_get(room_config, cat, janus_config_type_item, "default_expectedloss");
+	janus_config_item *default_bitrate = janus_config_get(room_config, cat, janus_config_type_item, "default_bitrate");
+	janus_config_item *secret = janus_config_get(room_config, cat, janus_config_type_item, "secret");
+	janus_config_item *pin = janus_config_get(room_config, cat, janus_config_type_item, "pin");
+	janus_config_array *groups = janus_config_get(room_config, cat, janus_config_type_array, "groups");
+	janus_config_item *record = janus_config_get(room_config, cat, janus_config_type_item, "record");
+	janus_config_item *recfile = janus_config_get(room_config, cat, janus_config_type_item, "record_file");
+	janus_config_item *recdir = janus_config_get(room_config, cat, janus_config_type_item, "record_dir");
+	janus_config_item *recformat = janus_config_get(room_config, cat, janus_config_type_item, "record_format");
+	janus_config_item *mjrs = janus_config_get(room_config, cat, janus_config_type_item, "mjrs");
+	janus_config_item *mjrsdir = janus_config_get(room_config, cat, janus_config_type_item, "mjrs_dir");
+	janus_config_item *allowrtp = janus_config_get(room_config, cat, janus_config_type_item, "allow_rtp_participants");
+	if(sampling == NULL || sampling->value == NULL) {
+		JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, missing mandatory information...\n");
+		return NULL;
+	}
+	/* Create the AudioBridge room */
+	janus_audiobridge_room *audiobridge = g_malloc0(sizeof(janus_audiobridge_room));
+	janus_refcount_init(&audiobridge->ref, janus_audiobridge_room_free);
+	const char *room_num = cat->name;
+	if(strstr(room_num, "room-") == room_num)
+		room_num += 5;
+	if(!string_ids) {
+		audiobridge->room_id = g_ascii_strtoull(room_num, NULL, 0);
+		if(audiobridge->room_id == 0) {
+			JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, invalid ID 0...\n");
+			janus_audiobridge_room_destroy(audiobridge);
+			return NULL;
+		}
+		/* Make sure the ID is completely numeric */
+		char room_id_str[30];
+		g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, audiobridge->room_id);
+		if(strcmp(room_num, room_id_str)) {
+			JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, ID '%s' is not numeric...\n", room_num);
+			janus_audiobridge_room_destroy(audiobridge);
+			return NULL;
+		}
+	}
+	/* Let's make sure the room doesn't exist already */
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&audiobridge->room_id) != NULL) {
+		/* It does... */
+		if(!locked)
+			janus_mutex_unlock(&rooms_mutex);
+		JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, room %s already exists...\n", room_num);
+		janus_audiobridge_room_destroy(audiobridge);
+		return NULL;
+	}
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	audiobridge->room_id_str = g_strdup(room_num);
+	char *description = NULL;
+	if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
+		description = g_strdup(desc->value);
+	else
+		description = g_strdup(cat->name);
+	audiobridge->room_name = description;
+	audiobridge->is_private = priv && priv->value && janus_is_true(priv->value);
+	audiobridge->sampling_rate = atol(sampling->value);
+	switch(audiobridge->sampling_rate) {
+		case 8000:
+		case 12000:
+		case 16000:
+		case 24000:
+		case 48000:
+			JANUS_LOG(LOG_VERB, "Sampling rate for mixing: %"SCNu32"\n", audiobridge->sampling_rate);
+			break;
+		default:
+			JANUS_LOG(LOG_ERR, "Unsupported sampling rate %"SCNu32"...\n", audiobridge->sampling_rate);
+			janus_audiobridge_room_destroy(audiobridge);
+			return NULL;
+	}
+	audiobridge->spatial_audio = spatial && spatial->value && janus_is_true(spatial->value);
+	audiobridge->audiolevel_ext = TRUE;
+	if(audiolevel_ext != NULL && audiolevel_ext->value != NULL)
+		audiobridge->audiolevel_ext = janus_is_true(audiolevel_ext->value);
+	audiobridge->audiolevel_event = FALSE;
+	if(audiolevel_event != NULL && audiolevel_event->value != NULL)
+		audiobridge->audiolevel_event = janus_is_true(audiolevel_event->value);
+	if(audiobridge->audiolevel_event) {
+		audiobridge->audio_active_packets = 100;
+		if(audio_active_packets != NULL && audio_active_packets->value != NULL){
+			if(atoi(audio_active_packets->value) > 0) {
+				audiobridge->audio_active_packets = atoi(audio_active_packets->value);
+			} else {
+				JANUS_LOG(LOG_WARN, "Invalid audio_active_packets value provided, using default: %d\n", audiobridge->audio_active_packets);
+			}
+		}
+		audiobridge->audio_level_average = 25;
+		if(audio_level_average != NULL && audio_level_average->value != NULL) {
+			if(atoi(audio_level_average->value) > 0) {
+				audiobridge->audio_level_average = atoi(audio_level_average->value);
+			} else {
+				JANUS_LOG(LOG_WARN, "Invalid audio_level_average value provided, using default: %d\n", audiobridge->audio_level_average);
+			}
+		}
+	}
+	audiobridge->default_prebuffering = DEFAULT_PREBUFFERING;
+	if(default_prebuffering != NULL && default_prebuffering->value != NULL) {
+		int prebuffering = atoi(default_prebuffering->value);
+		if(prebuffering < 0 || prebuffering > MAX_PREBUFFERING) {
+			JANUS_LOG(LOG_WARN, "Invalid default_prebuffering value provided, using default: %d\n", audiobridge->default_prebuffering);
+		} else {
+			audiobridge->default_prebuffering = prebuffering;
+		}
+	}
+	audiobridge->mix_speakers = 0;
+	if(mix_speakers != NULL && mix_speakers->value != NULL) {
+		int speakers = atoi(mix_speakers->value);
+		if(speakers < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid mix_speakers value provided, mixing all participants\n");
+		} else {
+			audiobridge->mix_speakers = speakers;
+		}
+	}
+	audiobridge->mix_threads = 1;
+	if(mix_threads != NULL && mix_threads->value != NULL) {
+		int threads = atoi(mix_threads->value);
+		if(threads < 1 || threads > JANUS_AUDIOBRIDGE_MAX_MIX_THREADS) {
+			JANUS_LOG(LOG_WARN, "Invalid mix_threads value provided, using a single mixer thread\n");
+		} else {
+			audiobridge->mix_threads = threads;
+		}
+	}
+	audiobridge->default_expectedloss = 0;
+	if(default_expectedloss != NULL && default_expectedloss->value != NULL) {
+		int expectedloss = atoi(default_expectedloss->value);
+		if(expectedloss < 0 || expectedloss > 20) {
+			JANUS_LOG(LOG_WARN, "Invalid expectedloss value provided, using default: 0\n");
+		} else {
+			audiobridge->default_expectedloss = expectedloss;
+		}
+	}
+	audiobridge->default_bitrate = 0;
+	if(default_bitrate != NULL && default_bitrate->value != NULL) {
+		audiobridge->default_bitrate = atoi(default_bitrate->value);
+		if(audiobridge->default_bitrate < 500 || audiobridge->default_bitrate > 512000) {
+			JANUS_LOG(LOG_WARN, "Invalid bitrate %"SCNi32", falling back to auto\n", audiobridge->default_bitrate);
+			audiobridge->default_bitrate = 0;
+		}
+	}
+	audiobridge->room_ssrc = janus_random_uint32();
+	if(secret != NULL && secret->value != NULL) {
+		audiobridge->room_secret = g_strdup(secret->value);
+	}
+	if(pin != NULL && pin->value != NULL) {
+		audiobridge->room_pin = g_strdup(pin->value);
+	}
+	g_atomic_int_set(&audiobridge->record, 0);
+	if(record && record->value && janus_is_true(record->value))
+		g_atomic_int_set(&audiobridge->record, 1);
+	if(recfile && recfile->value)
+		audiobridge->record_file = g_strdup(recfile->value);
+	audiobridge->record_format = JANUS_AUDIOBRIDGE_REC_WAV;
+	if(recformat && recformat->value &&
+			!janus_audiobridge_rec_format_parse(recformat->value, &audiobridge->record_format)) {
+		JANUS_LOG(LOG_WARN, "Unsupported recording format %s, using WAV\n", recformat->value);
+	}
+	if(recdir && recdir->value) {
+		audiobridge->record_dir = g_strdup(recdir->value);
+		if(janus_mkdir(audiobridge->record_dir, 0755) < 0) {
+			/* FIXME Should this be fatal, when creating a room? */
+			JANUS_LOG(LOG_WARN, "AudioBridge mkdir (%s) error: %d (%s)\n", audiobridge->record_dir, errno, g_strerror(errno));
+		}
+	}
+	audiobridge->recording = NULL;
+	if(mjrs && mjrs->value && janus_is_true(mjrs->value))
+		audiobridge->mjrs = TRUE;
+	if(mjrsdir && mjrsdir->value)
+		audiobridge->mjrs_dir = g_strdup(mjrsdir->value);
+	audiobridge->allow_plainrtp = FALSE;
+	if(allowrtp && allowrtp->value)
+		audiobridge->allow_plainrtp = janus_is_true(allowrtp->value);
+	audiobridge->destroy = 0;
+	audiobridge->participants = g_hash_table_new_full(
+		string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
+	audiobridge->anncs = g_hash_table_new_full(g_str_hash, g_str_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
+	audiobridge->check_tokens = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
+	audiobridge->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+	if(groups != NULL) {
+		/* Populate the group hashtable, and create the related indexes */
+		GList *gl = groups->list;
+		if(g_list_length(gl) > JANUS_AUDIOBRIDGE_MAX_GROUPS) {
+			JANUS_LOG(LOG_ERR, "Too many groups specified in room %s (max %d allowed)\n", room_num, JANUS_AUDIOBRIDGE_MAX_GROUPS);
+			janus_refcount_decrease(&audiobridge->ref);
+			return NULL;
+		}
+		int count = 0;
+		audiobridge->groups = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+		audiobridge->groups_byid = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+		while(gl) {
+			janus_config_item *g = (janus_config_item *)gl->data;
+			if(g == NULL || g->type != janus_config_type_item || g->name != NULL || g->value == NULL) {
+				JANUS_LOG(LOG_WARN, "  -- Invalid group item (not a string?), skipping in '%s'...\n", cat->name);
+				gl = gl->next;
+				continue;
+			}
+			const char *name = g->value;
+			if(g_hash_table_lookup(audiobridge->groups, name)) {
+				JANUS_LOG(LOG_WARN, "Duplicated group name '%s', skipping\n", name);
+			} else {
+				count++;
+				g_hash_table_insert(audiobridge->groups, g_strdup(name), GUINT_TO_POINTER(count));
+				g_hash_table_insert(audiobridge->groups_byid, GUINT_TO_POINTER(count), g_strdup(name));
+			}
+			gl = gl->next;
+		}
+		if(count == 0) {
+			JANUS_LOG(LOG_WARN, "Empty or invalid groups array provided, groups will be disabled in '%s'...\n", cat->name);
+			g_hash_table_destroy(audiobridge->groups);
+			g_hash_table_destroy(audiobridge->groups_byid);
+			audiobridge->groups = NULL;
+			audiobridge->groups_byid = NULL;
+		}
+	}
+	g_atomic_int_set(&audiobridge->destroyed, 0);
+	janus_mutex_init(&audiobridge->mutex);
+	janus_mutex_init(&audiobridge->encoding_mutex);
+	audiobridge->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
+	audiobridge->rtp_encoder = NULL;
+	audiobridge->rtp_udp_sock = -1;
+	janus_mutex_init(&audiobridge->rtp_mutex);
+	JANUS_LOG(LOG_VERB, "Created AudioBridge room: %s (%s, %s, secret: %s, pin: %s)\n",
+		audiobridge->room_id_str, audiobridge->room_name,
+		audiobridge->is_private ? "private" : "public",
+		audiobridge->room_secret ? audiobridge->room_secret : "no secret",
+		audiobridge->room_pin ? audiobridge->room_pin : "no pin");
+
+	if(janus_audiobridge_create_static_rtp_forwarder(room_config, cat, audiobridge, locked)) {
+		JANUS_LOG(LOG_ERR, "Error creating static RTP forwarder (room %s)\n", audiobridge->room_id_str);
+	}
+
+	/* We need a thread for the mix */
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "mixer %s", audiobridge->room_id_str);
+	janus_refcount_increase(&audiobridge->ref);
+	audiobridge->thread = g_thread_try_new(tname, &janus_audiobridge_mixer_thread, audiobridge, &error);
+	if(error != NULL) {
+		/* FIXME We should clear some resources... */
+		janus_refcount_decrease(&audiobridge->ref);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the mixer thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		return NULL;
+	}
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	g_hash_table_insert(rooms,
+		string_ids ? (gpointer)g_strdup(audiobridge->room_id_str) : (gpointer)janus_uint64_dup(audiobridge->room_id),
+		audiobridge);
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	return audiobridge;
+}
+
+/* When a rooms folder is configured, the permanent rooms saved there are only
+ * loaded when first needed: this helper looks a room up, and loads it from
+ * the folder if it's not available yet (rooms_mutex must be locked) */
+static janus_audiobridge_room *janus_audiobridge_lookup_room(guint64 room_id, const char *room_id_str) {
+	janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
+	if(audiobridge != NULL || rooms_folder == NULL || room_id_str == NULL)
+		return audiobridge;
+	char cat[BUFSIZ];
+	g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+	if(!janus_config_folder_contains(rooms_folder, cat))
+		return NULL;
+	janus_config *room_config = janus_config_folder_load(rooms_folder, cat);
+	janus_config_category *c = janus_config_get(room_config, NULL, janus_config_type_category, cat);
+	if(c != NULL) {
+		JANUS_LOG(LOG_VERB, "Loading AudioBridge room %s from the rooms folder\n", room_id_str);
+		audiobridge = janus_audiobridge_room_from_config(room_config, c, TRUE);
+	}
+	/* Whatever happened, we won't load this room again until a restart */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_destroy(room_config);
+	return audiobridge;
+}
+
+/* Load all the rooms in the rooms folder we haven't loaded yet (rooms_mutex must be locked) */
+static void janus_audiobridge_load_rooms(void) {
+	if(rooms_folder == NULL)
+		return;
+	GList *names = janus_config_folder_get_names(rooms_folder), *l = names;
+	while(l) {
+		const char *cat = (const char *)l->data;
+		l = l->next;
+		if(strstr(cat, "room-") != cat)
+			continue;
+		/* The name will be freed when the room is loaded, so we copy the ID */
+		char *room_id_str = g_strdup(cat + 5);
+		janus_audiobridge_lookup_room(string_ids ? 0 : g_ascii_strtoull(room_id_str, NULL, 0), room_id_str);
+		g_free(room_id_str);
+	}
+	g_list_free(names);
+}
+
+/* Persist the changes to a room (config_mutex must be locked): when a rooms
+ * folder is configured, rooms that aren't in the main configuration file get
+ * a file of their own, so that we only write what changed; in_config is
+ * whether the room was in the main configuration before the change */
+static gboolean janus_audiobridge_save_room(const char *cat, gboolean in_config) {
+	if(rooms_folder == NULL || in_config)
+		return janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) >= 0;
+	janus_config_category *c = janus_config_get(config, NULL, janus_config_type_category, cat);
+	int res = c ? janus_config_folder_save(rooms_folder, config, c) : janus_config_folder_remove(rooms_folder, cat);
+	/* The room is in memory already, and doesn't belong in the main configuration */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_remove(config, NULL, cat);
+	return res == 0;
+}
+
+/* Build the list of rooms to return for a "list" request: rooms_mutex is
+ * only locked to get a reference to all the rooms, and not while we go
+ * through them to prepare the list */
+static json_t *janus_audiobridge_rooms_list(gboolean include_private) {
+	GList *rooms_list = NULL;
+	janus_mutex_lock(&rooms_mutex);
+	/* Make sure we also list the rooms we didn't need so far */
+	janus_audiobridge_load_rooms();
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, rooms);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_audiobridge_room *room = value;
+		if(!room || g_atomic_int_get(&room->destroyed))
+			continue;
+		if(room->is_private && !include_private) {
+			/* Skip private room if no valid admin_key was provided */
+			JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
+			continue;
+		}
+		janus_refcount_increase(&room->ref);
+		rooms_list = g_list_prepend(rooms_list, room);
+	}
+	janus_mutex_unlock(&rooms_mutex);
+	json_t *list = json_array();
+	GList *l = rooms_list;
+	while(l) {
+		janus_audiobridge_room *room = (janus_audiobridge_room *)l->data;
+		json_t *rl = json_object();
+		json_object_set_new(rl, "room", string_ids ? json_string(room->room_id_str) : json_integer(room->room_id));
+		json_object_set_new(rl, "description", json_string(room->room_name));
+		json_object_set_new(rl, "sampling_rate", json_integer(room->sampling_rate));
+		json_object_set_new(rl, "spatial_audio", room->spatial_audio ? json_true() : json_false());
+		json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
+		json_object_set_new(rl, "record", g_atomic_int_get(&room->record) ? json_true() : json_false());
+		json_object_set_new(rl, "muted", room->muted ? json_true() : json_false());
+		json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
+		json_object_set_new(rl, "mixing", janus_audiobridge_mixing_info(room));
+		if(encoders != NULL)
+			json_object_set_new(rl, "encoding", janus_audiobridge_encoding_info(room));
+		json_array_append_new(list, rl);
+		janus_refcount_decrease(&room->ref);
+		l = l->next;
+	}
+	g_list_free(rooms_list);
+	return list;
+}
+
+/* Get a copy of the (possibly cached) list of rooms */
+static json_t *janus_audiobridge_rooms_list_get(gboolean include_private) {
+	if(list_refresh == 0)
+		return janus_audiobridge_rooms_list(include_private);
+	json_t *list = NULL;
+	janus_mutex_lock(&rooms_list_mutex);
+	json_t **cached = include_private ? &rooms_list_all : &rooms_list_public;
+	gint64 now = janus_get_monotonic_time();
+	if(*cached == NULL || now - rooms_list_updated >= (gint64)list_refresh * 1000) {
+		if(now - rooms_list_updated >= (gint64)list_refresh * 1000) {
+			/* Both snapshots are stale */
+			json_decref(rooms_list_public);
+			rooms_list_public = NULL;
+			json_decref(rooms_list_all);
+			rooms_list_all = NULL;
+			rooms_list_updated = now;
+		}
+		*cached = janus_audiobridge_rooms_list(include_private);
+	}
+	list = json_deep_copy(*cached);
+	janus_mutex_unlock(&rooms_list_mutex);
+	return list;
+}
+
+/* Get rid of the cached lists of rooms, e.g., because rooms were added, edited or removed */
+static void janus_audiobridge_rooms_list_invalidate(void) {
+	janus_mutex_lock(&rooms_list_mutex);
+	json_decref(rooms_list_public);
+	rooms_list_public = NULL;
+	json_decref(rooms_list_all);
+	rooms_list_all = NULL;
+	janus_mutex_unlock(&rooms_list_mutex);
+}
+
 /* Plugin implementation */
 int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&stopping)) {
@@ -2267,8 +2990,11 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 	if(config != NULL)
 		janus_config_print(config);
 
+	/* Pick the best mixing kernels for this machine */
+	JANUS_LOG(LOG_INFO, "AudioBridge mixing kernels: %s\n", janus_audiobridge_mix_init());
+
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_audiobridge_session_destroy);
-	messages = g_async_queue_new_full((GDestroyNotify) janus_audiobridge_message_free);
+	request_stats = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
 
@@ -2297,9 +3023,69 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_item *ids = janus_config_get(config, config_general, janus_config_type_item, "string_ids");
 		if(ids != NULL && ids->value != NULL)
 			string_ids = janus_is_true(ids->value);
+		janus_config_item *se = janus_config_get(config, config_general, janus_config_type_item, "shared_encoding");
+		if(se != NULL && se->value != NULL)
+			shared_encoding = janus_is_true(se->value);
+		janus_config_item *et = janus_config_get(config, config_general, janus_config_type_item, "encoding_threads");
+		if(et != NULL && et->value != NULL) {
+			if(!strcasecmp(et->value, "auto")) {
+				encoding_threads = g_get_num_processors();
+			} else {
+				encoding_threads = atoi(et->value);
+				if(encoding_threads < 0) {
+					JANUS_LOG(LOG_WARN, "Invalid encoding_threads value %s, falling back to per-participant threads\n", et->value);
+					encoding_threads = 0;
+				}
+			}
+		}
 		if(string_ids) {
 			JANUS_LOG(LOG_INFO, "AudioBridge will use alphanumeric IDs, not numeric\n");
 		}
+		janus_config_item *lr = janus_config_get(config, config_general, janus_config_type_item, "list_refresh");
+		if(lr != NULL && lr->value != NULL) {
+			int value = atoi(lr->value);
+			if(value < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid list_refresh value '%s', using default (%d)\n", lr->value, JANUS_AUDIOBRIDGE_DEFAULT_LIST_REFRESH);
+				value = JANUS_AUDIOBRIDGE_DEFAULT_LIST_REFRESH;
+			}
+			list_refresh = value;
+		}
+		janus_config_item *hthreads = janus_config_get(config, config_general, janus_config_type_item, "handler_threads");
+		if(hthreads != NULL && hthreads->value != NULL) {
+			int value = atoi(hthreads->value);
+			if(value < 1 || value > JANUS_AUDIOBRIDGE_MAX_HANDLER_THREADS) {
+				JANUS_LOG(LOG_WARN, "Invalid handler_threads value '%s' (should be between 1 and %d), using default (%d)\n",
+					hthreads->value, JANUS_AUDIOBRIDGE_MAX_HANDLER_THREADS, JANUS_AUDIOBRIDGE_DEFAULT_HANDLER_THREADS);
+				value = JANUS_AUDIOBRIDGE_DEFAULT_HANDLER_THREADS;
+			}
+			handler_threads = value;
+		}
+		janus_config_item *rfolder = janus_config_get(config, config_general, janus_config_type_item, "rooms_folder");
+		if(rfolder != NULL && rfolder->value != NULL) {
+			rooms_folder = janus_config_folder_open(rfolder->value);
+			if(rooms_folder == NULL) {
+				JANUS_LOG(LOG_WARN, "Couldn't open the rooms folder, saving permanent rooms to the configuration file instead\n");
+			} else {
+				JANUS_LOG(LOG_INFO, "AudioBridge will save permanent rooms to %s, and load them on demand\n", rfolder->value);
+			}
+		}
+		janus_config_item *rt = janus_config_get(config, config_general, janus_config_type_item, "reactor_threads");
+		if(rt != NULL && rt->value != NULL) {
+			reactor_threads = atoi(rt->value);
+			if(reactor_threads < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid reactor_threads value %s, using a thread per plain RTP participant\n", rt->value);
+				reactor_threads = 0;
+			} else if(reactor_threads > JANUS_AUDIOBRIDGE_MAX_REACTOR_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many reactor threads (%d), capping to %d\n", reactor_threads, JANUS_AUDIOBRIDGE_MAX_REACTOR_THREADS);
+				reactor_threads = JANUS_AUDIOBRIDGE_MAX_REACTOR_THREADS;
+			}
+#ifndef HAVE_EPOLL
+			if(reactor_threads > 0) {
+				JANUS_LOG(LOG_WARN, "epoll not available, using a thread per plain RTP participant\n");
+				reactor_threads = 0;
+			}
+#endif
+		}
 		janus_config_item *lip = janus_config_get(config, config_general, janus_config_type_item, "local_ip");
 		if(lip && lip->value) {
 			/* Verify that the address is valid */
@@ -2371,251 +3157,8 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
 			janus_config_category *cat = (janus_config_category *)cl->data;
-			if(cat->name == NULL || !strcasecmp(cat->name, "general")) {
-				cl = cl->next;
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "Adding AudioBridge room '%s'\n", cat->name);
-			janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-			janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-			janus_config_item *sampling = janus_config_get(config, cat, janus_config_type_item, "sampling_rate");
-			janus_config_item *spatial = janus_config_get(config, cat, janus_config_type_item, "spatial_audio");
-			janus_config_item *audiolevel_ext = janus_config_get(config, cat, janus_config_type_item, "audiolevel_ext");
-			janus_config_item *audiolevel_event = janus_config_get(config, cat, janus_config_type_item, "audiolevel_event");
-			janus_config_item *audio_active_packets = janus_config_get(config, cat, janus_config_type_item, "audio_active_packets");
-			janus_config_item *audio_level_average = janus_config_get(config, cat, janus_config_type_item, "audio_level_average");
-			janus_config_item *default_prebuffering = janus_config_get(config, cat, janus_config_type_item, "default_prebuffering");
-			janus_config_item *default_expectedloss = janus_config_get(config, cat, janus_config_type_item, "default_expectedloss");
-			janus_config_item *default_bitrate = janus_config_get(config, cat, janus_config_type_item, "default_bitrate");
-			janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-			janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-			janus_config_array *groups = janus_config_get(config, cat, janus_config_type_array, "groups");
-			janus_config_item *record = janus_config_get(config, cat, janus_config_type_item, "record");
-			janus_config_item *recfile = janus_config_get(config, cat, janus_config_type_item, "record_file");
-			janus_config_item *recdir = janus_config_get(config, cat, janus_config_type_item, "record_dir");
-			janus_config_item *mjrs = janus_config_get(config, cat, janus_config_type_item, "mjrs");
-			janus_config_item *mjrsdir = janus_config_get(config, cat, janus_config_type_item, "mjrs_dir");
-			janus_config_item *allowrtp = janus_config_get(config, cat, janus_config_type_item, "allow_rtp_participants");
-			if(sampling == NULL || sampling->value == NULL) {
-				JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, missing mandatory information...\n");
-				cl = cl->next;
-				continue;
-			}
-			/* Create the AudioBridge room */
-			janus_audiobridge_room *audiobridge = g_malloc0(sizeof(janus_audiobridge_room));
-			janus_refcount_init(&audiobridge->ref, janus_audiobridge_room_free);
-			const char *room_num = cat->name;
-			if(strstr(room_num, "room-") == room_num)
-				room_num += 5;
-			if(!string_ids) {
-				audiobridge->room_id = g_ascii_strtoull(room_num, NULL, 0);
-				if(audiobridge->room_id == 0) {
-					JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, invalid ID 0...\n");
-					janus_audiobridge_room_destroy(audiobridge);
-					cl = cl->next;
-					continue;
-				}
-				/* Make sure the ID is completely numeric */
-				char room_id_str[30];
-				g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, audiobridge->room_id);
-				if(strcmp(room_num, room_id_str)) {
-					JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, ID '%s' is not numeric...\n", room_num);
-					janus_audiobridge_room_destroy(audiobridge);
-					cl = cl->next;
-					continue;
-				}
-			}
-			/* Let's make sure the room doesn't exist already */
-			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&audiobridge->room_id) != NULL) {
-				/* It does... */
-				janus_mutex_unlock(&rooms_mutex);
-				JANUS_LOG(LOG_ERR, "Can't add the AudioBridge room, room %s already exists...\n", room_num);
-				janus_audiobridge_room_destroy(audiobridge);
-				cl = cl->next;
-				continue;
-			}
-			janus_mutex_unlock(&rooms_mutex);
-			audiobridge->room_id_str = g_strdup(room_num);
-			char *description = NULL;
-			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
-				description = g_strdup(desc->value);
-			else
-				description = g_strdup(cat->name);
-			audiobridge->room_name = description;
-			audiobridge->is_private = priv && priv->value && janus_is_true(priv->value);
-			audiobridge->sampling_rate = atol(sampling->value);
-			switch(audiobridge->sampling_rate) {
-				case 8000:
-				case 12000:
-				case 16000:
-				case 24000:
-				case 48000:
-					JANUS_LOG(LOG_VERB, "Sampling rate for mixing: %"SCNu32"\n", audiobridge->sampling_rate);
-					break;
-				default:
-					JANUS_LOG(LOG_ERR, "Unsupported sampling rate %"SCNu32"...\n", audiobridge->sampling_rate);
-					janus_audiobridge_room_destroy(audiobridge);
-					cl = cl->next;
-					continue;
-			}
-			audiobridge->spatial_audio = spatial && spatial->value && janus_is_true(spatial->value);
-			audiobridge->audiolevel_ext = TRUE;
-			if(audiolevel_ext != NULL && audiolevel_ext->value != NULL)
-				audiobridge->audiolevel_ext = janus_is_true(audiolevel_ext->value);
-			audiobridge->audiolevel_event = FALSE;
-			if(audiolevel_event != NULL && audiolevel_event->value != NULL)
-				audiobridge->audiolevel_event = janus_is_true(audiolevel_event->value);
-			if(audiobridge->audiolevel_event) {
-				audiobridge->audio_active_packets = 100;
-				if(audio_active_packets != NULL && audio_active_packets->value != NULL){
-					if(atoi(audio_active_packets->value) > 0) {
-						audiobridge->audio_active_packets = atoi(audio_active_packets->value);
-					} else {
-						JANUS_LOG(LOG_WARN, "Invalid audio_active_packets value provided, using default: %d\n", audiobridge->audio_active_packets);
-					}
-				}
-				audiobridge->audio_level_average = 25;
-				if(audio_level_average != NULL && audio_level_average->value != NULL) {
-					if(atoi(audio_level_average->value) > 0) {
-						audiobridge->audio_level_average = atoi(audio_level_average->value);
-					} else {
-						JANUS_LOG(LOG_WARN, "Invalid audio_level_average value provided, using default: %d\n", audiobridge->audio_level_average);
-					}
-				}
-			}
-			audiobridge->default_prebuffering = DEFAULT_PREBUFFERING;
-			if(default_prebuffering != NULL && default_prebuffering->value != NULL) {
-				int prebuffering = atoi(default_prebuffering->value);
-				if(prebuffering < 0 || prebuffering > MAX_PREBUFFERING) {
-					JANUS_LOG(LOG_WARN, "Invalid default_prebuffering value provided, using default: %d\n", audiobridge->default_prebuffering);
-				} else {
-					audiobridge->default_prebuffering = prebuffering;
-				}
-			}
-			audiobridge->default_expectedloss = 0;
-			if(default_expectedloss != NULL && default_expectedloss->value != NULL) {
-				int expectedloss = atoi(default_expectedloss->value);
-				if(expectedloss < 0 || expectedloss > 20) {
-					JANUS_LOG(LOG_WARN, "Invalid expectedloss value provided, using default: 0\n");
-				} else {
-					audiobridge->default_expectedloss = expectedloss;
-				}
-			}
-			audiobridge->default_bitrate = 0;
-			if(default_bitrate != NULL && default_bitrate->value != NULL) {
-				audiobridge->default_bitrate = atoi(default_bitrate->value);
-				if(audiobridge->default_bitrate < 500 || audiobridge->default_bitrate > 512000) {
-					JANUS_LOG(LOG_WARN, "Invalid bitrate %"SCNi32", falling back to auto\n", audiobridge->default_bitrate);
-					audiobridge->default_bitrate = 0;
-				}
-			}
-			audiobridge->room_ssrc = janus_random_uint32();
-			if(secret != NULL && secret->value != NULL) {
-				audiobridge->room_secret = g_strdup(secret->value);
-			}
-			if(pin != NULL && pin->value != NULL) {
-				audiobridge->room_pin = g_strdup(pin->value);
-			}
-			g_atomic_int_set(&audiobridge->record, 0);
-			if(record && record->value && janus_is_true(record->value))
-				g_atomic_int_set(&audiobridge->record, 1);
-			if(recfile && recfile->value)
-				audiobridge->record_file = g_strdup(recfile->value);
-			if(recdir && recdir->value) {
-				audiobridge->record_dir = g_strdup(recdir->value);
-				if(janus_mkdir(audiobridge->record_dir, 0755) < 0) {
-					/* FIXME Should this be fatal, when creating a room? */
-					JANUS_LOG(LOG_WARN, "AudioBridge mkdir (%s) error: %d (%s)\n", audiobridge->record_dir, errno, g_strerror(errno));
-				}
-			}
-			audiobridge->recording = NULL;
-			if(mjrs && mjrs->value && janus_is_true(mjrs->value))
-				audiobridge->mjrs = TRUE;
-			if(mjrsdir && mjrsdir->value)
-				audiobridge->mjrs_dir = g_strdup(mjrsdir->value);
-			audiobridge->allow_plainrtp = FALSE;
-			if(allowrtp && allowrtp->value)
-				audiobridge->allow_plainrtp = janus_is_true(allowrtp->value);
-			audiobridge->destroy = 0;
-			audiobridge->participants = g_hash_table_new_full(
-				string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
-				(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
-			audiobridge->anncs = g_hash_table_new_full(g_str_hash, g_str_equal,
-				(GDestroyNotify)g_free, (GDestroyNotify)janus_audiobridge_participant_unref);
-			audiobridge->check_tokens = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
-			audiobridge->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
-			if(groups != NULL) {
-				/* Populate the group hashtable, and create the related indexes */
-				GList *gl = groups->list;
-				if(g_list_length(gl) > JANUS_AUDIOBRIDGE_MAX_GROUPS) {
-					JANUS_LOG(LOG_ERR, "Too many groups specified in room %s (max %d allowed)\n", room_num, JANUS_AUDIOBRIDGE_MAX_GROUPS);
-					janus_refcount_decrease(&audiobridge->ref);
-					cl = cl->next;
-				}
-				int count = 0;
-				audiobridge->groups = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
-				audiobridge->groups_byid = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
-				while(gl) {
-					janus_config_item *g = (janus_config_item *)gl->data;
-					if(g == NULL || g->type != janus_config_type_item || g->name != NULL || g->value == NULL) {
-						JANUS_LOG(LOG_WARN, "  -- Invalid group item (not a string?), skipping in '%s'...\n", cat->name);
-						gl = gl->next;
-						continue;
-					}
-					const char *name = g->value;
-					if(g_hash_table_lookup(audiobridge->groups, name)) {
-						JANUS_LOG(LOG_WARN, "Duplicated group name '%s', skipping\n", name);
-					} else {
-						count++;
-						g_hash_table_insert(audiobridge->groups, g_strdup(name), GUINT_TO_POINTER(count));
-						g_hash_table_insert(audiobridge->groups_byid, GUINT_TO_POINTER(count), g_strdup(name));
-					}
-					gl = gl->next;
-				}
-				if(count == 0) {
-					JANUS_LOG(LOG_WARN, "Empty or invalid groups array provided, groups will be disabled in '%s'...\n", cat->name);
-					g_hash_table_destroy(audiobridge->groups);
-					g_hash_table_destroy(audiobridge->groups_byid);
-					audiobridge->groups = NULL;
-					audiobridge->groups_byid = NULL;
-				}
-			}
-			g_atomic_int_set(&audiobridge->destroyed, 0);
-			janus_mutex_init(&audiobridge->mutex);
-			audiobridge->rtp_forwarders = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_rtp_forwarder_destroy);
-			audiobridge->rtp_encoder = NULL;
-			audiobridge->rtp_udp_sock = -1;
-			janus_mutex_init(&audiobridge->rtp_mutex);
-			JANUS_LOG(LOG_VERB, "Created AudioBridge room: %s (%s, %s, secret: %s, pin: %s)\n",
-				audiobridge->room_id_str, audiobridge->room_name,
-				audiobridge->is_private ? "private" : "public",
-				audiobridge->room_secret ? audiobridge->room_secret : "no secret",
-				audiobridge->room_pin ? audiobridge->room_pin : "no pin");
-
-			if(janus_audiobridge_create_static_rtp_forwarder(cat, audiobridge)) {
-				JANUS_LOG(LOG_ERR, "Error creating static RTP forwarder (room %s)\n", audiobridge->room_id_str);
-			}
-
-			/* We need a thread for the mix */
-			GError *error = NULL;
-			char tname[16];
-			g_snprintf(tname, sizeof(tname), "mixer %s", audiobridge->room_id_str);
-			janus_refcount_increase(&audiobridge->ref);
-			audiobridge->thread = g_thread_try_new(tname, &janus_audiobridge_mixer_thread, audiobridge, &error);
-			if(error != NULL) {
-				/* FIXME We should clear some resources... */
-				janus_refcount_decrease(&audiobridge->ref);
-				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the mixer thread...\n",
-					error->code, error->message ? error->message : "??");
-				g_error_free(error);
-			} else {
-				janus_mutex_lock(&rooms_mutex);
-				g_hash_table_insert(rooms,
-					string_ids ? (gpointer)g_strdup(audiobridge->room_id_str) : (gpointer)janus_uint64_dup(audiobridge->room_id),
-					audiobridge);
-				janus_mutex_unlock(&rooms_mutex);
-			}
+			if(cat->name != NULL && strcasecmp(cat->name, "general"))
+				janus_audiobridge_room_from_config(config, cat, FALSE);
 			cl = cl->next;
 		}
 		g_list_free(clist);
@@ -2651,17 +3194,63 @@ int janus_audiobridge_init(janus_callbacks *callback, const char *config_path) {
 
 	g_atomic_int_set(&initialized, 1);
 
-	/* Launch the thread that will handle incoming messages */
 	GError *error = NULL;
-	handler_thread = g_thread_try_new("audiobridge handler", janus_audiobridge_handler, NULL, &error);
+	if(encoding_threads > 0) {
+		/* Use a pool of threads to encode the mixed frames, rather than one thread per participant */
+		encoders = g_thread_pool_new(janus_audiobridge_encoder_task, NULL, encoding_threads, TRUE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the pool of encoding threads, falling back to per-participant threads\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			error = NULL;
+			encoders = NULL;
+		} else {
+			JANUS_LOG(LOG_INFO, "Using a pool of %d threads to encode the mixed frames\n", encoding_threads);
+		}
+	}
+
+	/* Launch the threads that will handle incoming messages */
+	char tname[16];
+	guint i = 0;
+	handlers = g_malloc0(handler_threads * sizeof(janus_audiobridge_handler_thread));
+	for(i=0; i<handler_threads; i++) {
+		janus_audiobridge_handler_thread *ht = &handlers[i];
+		ht->id = i+1;
+		ht->messages = g_async_queue_new_full((GDestroyNotify) janus_audiobridge_message_free);
+		g_snprintf(tname, sizeof(tname), "abridge hdl %u", ht->id);
+		ht->thread = g_thread_try_new(tname, janus_audiobridge_handler, ht, &error);
+		if(error != NULL)
+			break;
+	}
 	if(error != NULL) {
 		g_atomic_int_set(&initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the AudioBridge handler thread...\n",
 			error->code, error->message ? error->message : "??");
 		g_error_free(error);
+		/* Get rid of the handler threads we managed to spawn, if any */
+		guint j = 0;
+		for(j=0; j<=i; j++) {
+			if(handlers[j].thread != NULL) {
+				g_async_queue_push(handlers[j].messages, &exit_message);
+				g_thread_join(handlers[j].thread);
+			}
+			g_async_queue_unref(handlers[j].messages);
+		}
+		g_free(handlers);
+		handlers = NULL;
 		janus_config_destroy(config);
+		janus_config_folder_destroy(rooms_folder);
+		rooms_folder = NULL;
 		return -1;
 	}
+	if(handler_threads > 1) {
+		JANUS_LOG(LOG_INFO, "AudioBridge will process requests using %u handler threads\n", handler_threads);
+	}
+#ifdef HAVE_EPOLL
+	/* If we need reactor threads for plain RTP participants, start them too */
+	if(reactor_threads > 0)
+		janus_audiobridge_reactors_start(reactor_threads);
+#endif
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_AUDIOBRIDGE_NAME);
 	return 0;
 }
@@ -2671,11 +3260,18 @@ void janus_audiobridge_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(messages, &exit_message);
-	if(handler_thread != NULL) {
-		g_thread_join(handler_thread);
-		handler_thread = NULL;
+	guint i = 0;
+	for(i=0; i<handler_threads; i++)
+		g_async_queue_push(handlers[i].messages, &exit_message);
+	for(i=0; i<handler_threads; i++) {
+		if(handlers[i].thread != NULL) {
+			g_thread_join(handlers[i].thread);
+			handlers[i].thread = NULL;
+		}
 	}
+#ifdef HAVE_EPOLL
+	janus_audiobridge_reactors_stop();
+#endif
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -2685,10 +3281,25 @@ void janus_audiobridge_destroy(void) {
 	g_hash_table_destroy(rooms);
 	rooms = NULL;
 	janus_mutex_unlock(&rooms_mutex);
-	g_async_queue_unref(messages);
-	messages = NULL;
+	janus_audiobridge_rooms_list_invalidate();
+	if(encoders != NULL) {
+		/* Wait for the pending encoding tasks to be done */
+		GThreadPool *pool = encoders;
+		encoders = NULL;
+		g_thread_pool_free(pool, FALSE, TRUE);
+	}
+	for(i=0; i<handler_threads; i++)
+		g_async_queue_unref(handlers[i].messages);
+	g_free(handlers);
+	handlers = NULL;
+	janus_mutex_lock(&request_stats_mutex);
+	g_hash_table_destroy(request_stats);
+	request_stats = NULL;
+	janus_mutex_unlock(&request_stats_mutex);
 
 	janus_config_destroy(config);
+	janus_config_folder_destroy(rooms_folder);
+	rooms_folder = NULL;
 	g_free(admin_key);
 	g_free(rec_tempext);
 
@@ -2744,6 +3355,8 @@ void janus_audiobridge_create_session(janus_plugin_session *handle, int *error)
 	g_atomic_int_set(&session->started, 0);
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
+	/* Until a room is involved, spread sessions on the handler threads */
+	g_atomic_int_set(&session->handler_index, (guint)g_atomic_int_add(&handler_next, 1) % handler_threads);
 	handle->plugin_handle = session;
 	janus_refcount_init(&session->ref, janus_audiobridge_session_free);
 
@@ -2790,6 +3403,38 @@ static void janus_audiobridge_notify_participants(janus_audiobridge_participant
 	}
 }
 
+void janus_audiobridge_drain(gboolean draining) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return;
+	/* Janus is being drained (or not anymore): let all users know, so that
+	 * they can move to a different instance when it's more convenient */
+	GList *list = NULL, *temp = NULL;
+	janus_mutex_lock(&sessions_mutex);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, sessions);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_audiobridge_session *session = (janus_audiobridge_session *)value;
+		if(session == NULL || g_atomic_int_get(&session->destroyed))
+			continue;
+		janus_refcount_increase(&session->ref);
+		list = g_list_prepend(list, session);
+	}
+	janus_mutex_unlock(&sessions_mutex);
+	JANUS_LOG(LOG_INFO, "Notifying %u users that Janus is %s\n", g_list_length(list),
+		draining ? "draining" : "not draining anymore");
+	for(temp = list; temp != NULL; temp = temp->next) {
+		janus_audiobridge_session *session = (janus_audiobridge_session *)temp->data;
+		json_t *event = json_object();
+		json_object_set_new(event, "audiobridge", json_string("event"));
+		json_object_set_new(event, "draining", draining ? json_true() : json_false());
+		gateway->push_event(session->handle, &janus_audiobridge_plugin, NULL, event, NULL);
+		json_decref(event);
+		janus_refcount_decrease(&session->ref);
+	}
+	g_list_free(list);
+}
+
 json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
 		return NULL;
@@ -2825,17 +3470,20 @@ json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 			json_object_set_new(info, "admin", json_true());
 		json_object_set_new(info, "muted", participant->muted ? json_true() : json_false());
 		json_object_set_new(info, "active", g_atomic_int_get(&participant->active) ? json_true() : json_false());
-		json_object_set_new(info, "pre-buffering", participant->prebuffering ? json_true() : json_false());
+		json_object_set_new(info, "pre-buffering", janus_audiobridge_jb_is_buffering(participant->jb) ? json_true() : json_false());
 		json_object_set_new(info, "prebuffer-count", json_integer(participant->prebuffer_count));
-		if(participant->inbuf) {
-			janus_mutex_lock(&participant->qmutex);
-			json_object_set_new(info, "queue-in", json_integer(g_list_length(participant->inbuf)));
-			janus_mutex_unlock(&participant->qmutex);
+		if(participant->jb) {
+			janus_audiobridge_jb_stats jbs;
+			janus_audiobridge_jb_get_stats(participant->jb, &jbs);
+			json_object_set_new(info, "queue-in", json_integer(jbs.length));
+			json_object_set_new(info, "queue-in-target", json_integer(jbs.target));
+			json_object_set_new(info, "queue-in-late", json_integer(jbs.late));
+			json_object_set_new(info, "queue-in-early", json_integer(jbs.early));
+			json_object_set_new(info, "queue-in-discarded", json_integer(jbs.discarded));
+			json_object_set_new(info, "queue-in-lost", json_integer(jbs.lost));
 		}
 		if(participant->outbuf)
 			json_object_set_new(info, "queue-out", json_integer(g_async_queue_length(participant->outbuf)));
-		if(participant->last_drop > 0)
-			json_object_set_new(info, "last-drop", json_integer(participant->last_drop));
 		if(participant->stereo)
 			json_object_set_new(info, "spatial_position", json_integer(participant->spatial_position));
 		if(participant->arc && participant->arc->filename)
@@ -2843,6 +3491,8 @@ json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 		if(participant->extmap_id > 0) {
 			json_object_set_new(info, "audio-level-dBov", json_integer(participant->dBov_level));
 			json_object_set_new(info, "talking", participant->talking ? json_true() : json_false());
+			if(participant->room && participant->room->mix_speakers > 0)
+				json_object_set_new(info, "speaker", g_atomic_int_get(&participant->speaker) ? json_true() : json_false());
 		}
 		json_object_set_new(info, "fec", participant->fec ? json_true() : json_false());
 		if(participant->fec)
@@ -2863,6 +3513,11 @@ json_t *janus_audiobridge_query_session(janus_plugin_session *handle) {
 				json_object_set_new(rtp, "local-ssrc", json_integer(participant->plainrtp_media.audio_ssrc));
 			if(participant->plainrtp_media.audio_ssrc_peer)
 				json_object_set_new(rtp, "remote-ssrc", json_integer(participant->plainrtp_media.audio_ssrc_peer));
+#ifdef HAVE_EPOLL
+			janus_audiobridge_reactor *reactor = participant->plainrtp_media.reactor;
+			if(reactor != NULL)
+				json_object_set_new(rtp, "reactor", json_integer(reactor->id));
+#endif
 			json_object_set_new(info, "plain-rtp", rtp);
 		}
 	}
@@ -2888,8 +3543,7 @@ static int janus_audiobridge_access_room(json_t *root, gboolean check_modify, ja
 	} else {
 		room_id_str = (char *)json_string_value(room);
 	}
-	*audiobridge = g_hash_table_lookup(rooms,
-		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+	*audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 	if(*audiobridge == NULL) {
 		JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
 		error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -2973,12 +3627,15 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		json_t *audio_active_packets = json_object_get(root, "audio_active_packets");
 		json_t *audio_level_average = json_object_get(root, "audio_level_average");
 		json_t *default_prebuffering = json_object_get(root, "default_prebuffering");
+		json_t *mix_speakers = json_object_get(root, "mix_speakers");
+		json_t *mix_threads = json_object_get(root, "mix_threads");
 		json_t *default_expectedloss = json_object_get(root, "default_expectedloss");
 		json_t *default_bitrate = json_object_get(root, "default_bitrate");
 		json_t *groups = json_object_get(root, "groups");
 		json_t *record = json_object_get(root, "record");
 		json_t *recfile = json_object_get(root, "record_file");
 		json_t *recdir = json_object_get(root, "record_dir");
+		json_t *recformat = json_object_get(root, "record_format");
 		json_t *mjrs = json_object_get(root, "mjrs");
 		json_t *mjrsdir = json_object_get(root, "mjrs_dir");
 		json_t *allowrtp = json_object_get(root, "allow_rtp_participants");
@@ -3003,6 +3660,13 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				goto prepare_response;
 			}
 		}
+		janus_audiobridge_rec_format record_format = JANUS_AUDIOBRIDGE_REC_WAV;
+		if(recformat && !janus_audiobridge_rec_format_parse(json_string_value(recformat), &record_format)) {
+			JANUS_LOG(LOG_ERR, "Unsupported recording format %s\n", json_string_value(recformat));
+			error_code = JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT;
+			g_snprintf(error_cause, 512, "Unsupported recording format %s", json_string_value(recformat));
+			goto prepare_response;
+		}
 		if(groups) {
 			/* Make sure the "groups" array only contains strings */
 			gboolean ok = TRUE;
@@ -3052,7 +3716,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(janus_audiobridge_lookup_room(room_id, room_id_str) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_AUDIOBRIDGE_ERROR_ROOM_EXISTS;
@@ -3069,7 +3733,8 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		if(!string_ids && room_id == 0) {
 			while(room_id == 0) {
 				room_id = janus_random_uint64();
-				if(g_hash_table_lookup(rooms, &room_id) != NULL) {
+				g_snprintf(room_id_num, sizeof(room_id_num), "%"SCNu64, room_id);
+				if(janus_audiobridge_lookup_room(room_id, room_id_num) != NULL) {
 					/* Room ID already taken, try another one */
 					room_id = 0;
 				}
@@ -3079,7 +3744,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_audiobridge_lookup_room(0, room_id_str) != NULL) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -3132,6 +3797,16 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			JANUS_LOG(LOG_WARN, "Invalid default_prebuffering value provided (too high), using default: %d\n",
 				audiobridge->default_prebuffering);
 		}
+		audiobridge->mix_speakers = mix_speakers ? json_integer_value(mix_speakers) : 0;
+		audiobridge->mix_threads = 1;
+		if(mix_threads != NULL) {
+			int threads = json_integer_value(mix_threads);
+			if(threads < 1 || threads > JANUS_AUDIOBRIDGE_MAX_MIX_THREADS) {
+				JANUS_LOG(LOG_WARN, "Invalid mix_threads value provided, using a single mixer thread\n");
+			} else {
+				audiobridge->mix_threads = threads;
+			}
+		}
 		audiobridge->default_expectedloss = 0;
 		if(default_expectedloss != NULL) {
 			int expectedloss = json_integer_value(default_expectedloss);
@@ -3174,6 +3849,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			g_atomic_int_set(&audiobridge->record, 1);
 		if(recfile)
 			audiobridge->record_file = g_strdup(json_string_value(recfile));
+		audiobridge->record_format = record_format;
 		if(recdir) {
 			audiobridge->record_dir = g_strdup(json_string_value(recdir));
 			if(janus_mkdir(audiobridge->record_dir, 0755) < 0) {
@@ -3210,6 +3886,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		g_atomic_int_set(&audiobridge->destroyed, 0);
 		janus_mutex_init(&audiobridge->mutex);
+		janus_mutex_init(&audiobridge->encoding_mutex);
 		if(groups != NULL && json_array_size(groups) > 0) {
 			/* Populate the group hashtable, and create the related indexes */
 			audiobridge->groups = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
@@ -3274,6 +3951,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", audiobridge->room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_category *c = janus_config_get_create(config, NULL, janus_config_type_category, cat);
 			/* Now for the values */
 			janus_config_add(config, c, janus_config_item_create("description", audiobridge->room_name));
@@ -3302,6 +3980,14 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				g_snprintf(value, BUFSIZ, "%d", audiobridge->default_prebuffering);
 				janus_config_add(config, c, janus_config_item_create("default_prebuffering", value));
 			}
+			if(audiobridge->mix_speakers > 0) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->mix_speakers);
+				janus_config_add(config, c, janus_config_item_create("mix_speakers", value));
+			}
+			if(audiobridge->mix_threads > 1) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->mix_threads);
+				janus_config_add(config, c, janus_config_item_create("mix_threads", value));
+			}
 			if(audiobridge->allow_plainrtp)
 				janus_config_add(config, c, janus_config_item_create("allow_rtp_participants", "yes"));
 			if(audiobridge->groups) {
@@ -3321,6 +4007,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			}
 			if(audiobridge->record_dir)
 				janus_config_add(config, c, janus_config_item_create("record_dir", audiobridge->record_dir));
+			if(audiobridge->record_format != JANUS_AUDIOBRIDGE_REC_WAV) {
+				janus_config_add(config, c, janus_config_item_create("record_format",
+					janus_audiobridge_rec_format_extension(audiobridge->record_format)));
+			}
 			if(audiobridge->mjrs)
 				janus_config_add(config, c, janus_config_item_create("mjrs", "yes"));
 			if(audiobridge->mjrs_dir)
@@ -3328,7 +4018,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			if(audiobridge->spatial_audio)
 				janus_config_add(config, c, janus_config_item_create("spatial_audio", "yes"));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) < 0)
+			if(!janus_audiobridge_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -3349,6 +4039,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		if(room_id_allocated)
 			g_free(room_id_str);
 		janus_mutex_unlock(&rooms_mutex);
+		janus_audiobridge_rooms_list_invalidate();
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "edit")) {
 		JANUS_LOG(LOG_VERB, "Attempt to edit an existing AudioBridge room\n");
@@ -3394,8 +4085,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -3457,6 +4147,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			/* Remove the old category first */
 			janus_config_remove(config, NULL, cat);
 			/* Now write the room details again */
@@ -3487,6 +4178,14 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				g_snprintf(value, BUFSIZ, "%d", audiobridge->default_prebuffering);
 				janus_config_add(config, c, janus_config_item_create("default_prebuffering", value));
 			}
+			if(audiobridge->mix_speakers > 0) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->mix_speakers);
+				janus_config_add(config, c, janus_config_item_create("mix_speakers", value));
+			}
+			if(audiobridge->mix_threads > 1) {
+				g_snprintf(value, BUFSIZ, "%u", audiobridge->mix_threads);
+				janus_config_add(config, c, janus_config_item_create("mix_threads", value));
+			}
 			if(audiobridge->allow_plainrtp)
 				janus_config_add(config, c, janus_config_item_create("allow_rtp_participants", "yes"));
 			if(audiobridge->groups) {
@@ -3506,6 +4205,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			}
 			if(audiobridge->record_dir)
 				janus_config_add(config, c, janus_config_item_create("record_dir", audiobridge->record_dir));
+			if(audiobridge->record_format != JANUS_AUDIOBRIDGE_REC_WAV) {
+				janus_config_add(config, c, janus_config_item_create("record_format",
+					janus_audiobridge_rec_format_extension(audiobridge->record_format)));
+			}
 			if(audiobridge->mjrs)
 				janus_config_add(config, c, janus_config_item_create("mjrs", "yes"));
 			if(audiobridge->mjrs_dir)
@@ -3513,7 +4216,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			if(audiobridge->spatial_audio)
 				janus_config_add(config, c, janus_config_item_create("spatial_audio", "yes"));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) < 0)
+			if(!janus_audiobridge_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room changes are not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -3532,6 +4235,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		janus_mutex_unlock(&audiobridge->mutex);
 		janus_mutex_unlock(&rooms_mutex);
+		janus_audiobridge_rooms_list_invalidate();
 		/* Done */
 		JANUS_LOG(LOG_VERB, "Audiobridge room edited\n");
 		goto prepare_response;
@@ -3572,8 +4276,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -3601,9 +4304,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			char cat[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_remove(config, NULL, cat);
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_AUDIOBRIDGE_PACKAGE) < 0)
+			if(!janus_audiobridge_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room destruction is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -3628,18 +4332,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				/* Get rid of queued packets */
 				janus_mutex_lock(&p->qmutex);
 				g_atomic_int_set(&p->active, 0);
-				while(p->inbuf) {
-					GList *first = g_list_first(p->inbuf);
-					janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-					p->inbuf = g_list_delete_link(p->inbuf, first);
-					first = NULL;
-					if(pkt == NULL)
-						continue;
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-				}
+				janus_audiobridge_jb_flush(p->jb);
 				janus_mutex_unlock(&p->qmutex);
 				/* Request a WebRTC hangup */
 				gateway->close_pc(p->session->handle);
@@ -3655,6 +4348,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		janus_mutex_unlock(&audiobridge->mutex);
 		janus_mutex_unlock(&rooms_mutex);
+		janus_audiobridge_rooms_list_invalidate();
 		janus_refcount_decrease(&audiobridge->ref);
 		/* Done */
 		response = json_object();
@@ -3672,7 +4366,15 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		json_t *record = json_object_get(root, "record");
 		json_t *recfile = json_object_get(root, "record_file");
 		json_t *recdir = json_object_get(root, "record_dir");
+		json_t *recformat = json_object_get(root, "record_format");
 		gboolean recording_active = json_is_true(record);
+		janus_audiobridge_rec_format record_format = JANUS_AUDIOBRIDGE_REC_WAV;
+		if(recformat && !janus_audiobridge_rec_format_parse(json_string_value(recformat), &record_format)) {
+			JANUS_LOG(LOG_ERR, "Unsupported recording format %s\n", json_string_value(recformat));
+			error_code = JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT;
+			g_snprintf(error_cause, 512, "Unsupported recording format %s", json_string_value(recformat));
+			goto prepare_response;
+		}
 		/* Lookup room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_audiobridge_room *audiobridge = NULL;
@@ -3709,6 +4411,10 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				audiobridge->record_dir = g_strdup(json_string_value(recdir));
 				JANUS_LOG(LOG_VERB, "Recording folder: %s\n", audiobridge->record_dir);
 			}
+			if(recformat && recording_active) {
+				audiobridge->record_format = record_format;
+				JANUS_LOG(LOG_VERB, "Recording format: %s\n", janus_audiobridge_rec_format_extension(record_format));
+			}
 		}
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("success"));
@@ -3798,35 +4504,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				}
 			}
 		}
-		json_t *list = json_array();
-		janus_mutex_lock(&rooms_mutex);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, rooms);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_audiobridge_room *room = value;
-			if(!room || g_atomic_int_get(&room->destroyed))
-				continue;
-			janus_refcount_increase(&room->ref);
-			if(room->is_private && lock_room_list) {
-				/* Skip private room if no valid admin_key was provided */
-				JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
-				janus_refcount_decrease(&room->ref);
-				continue;
-			}
-			json_t *rl = json_object();
-			json_object_set_new(rl, "room", string_ids ? json_string(room->room_id_str) : json_integer(room->room_id));
-			json_object_set_new(rl, "description", json_string(room->room_name));
-			json_object_set_new(rl, "sampling_rate", json_integer(room->sampling_rate));
-			json_object_set_new(rl, "spatial_audio", room->spatial_audio ? json_true() : json_false());
-			json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
-			json_object_set_new(rl, "record", g_atomic_int_get(&room->record) ? json_true() : json_false());
-			json_object_set_new(rl, "muted", room->muted ? json_true() : json_false());
-			json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
-			json_array_append_new(list, rl);
-			janus_refcount_decrease(&room->ref);
-		}
-		janus_mutex_unlock(&rooms_mutex);
+		json_t *list = janus_audiobridge_rooms_list_get(!lock_room_list);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("success"));
 		json_object_set_new(response, "list", list);
@@ -3855,7 +4533,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = (janus_audiobridge_lookup_room(room_id, room_id_str) != NULL);
 		janus_mutex_unlock(&rooms_mutex);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("success"));
@@ -3901,8 +4579,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4025,8 +4702,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4086,20 +4762,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			participant->muted ? "true" : "false", participant->room->room_id_str, participant->user_id_str);
 		if(participant->muted) {
 			/* Clear the queued packets waiting to be handled */
-			janus_mutex_lock(&participant->qmutex);
-			while(participant->inbuf) {
-				GList *first = g_list_first(participant->inbuf);
-				janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-				participant->inbuf = g_list_delete_link(participant->inbuf, first);
-				first = NULL;
-				if(pkt == NULL)
-					continue;
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
-			janus_mutex_unlock(&participant->qmutex);
+			janus_audiobridge_jb_flush(participant->jb);
 		}
 
 		json_t *list = json_array();
@@ -4180,8 +4843,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4291,8 +4953,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4393,8 +5054,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4482,8 +5142,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4492,10 +5151,12 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			goto prepare_response;
 		}
 		janus_refcount_increase(&audiobridge->ref);
+		janus_mutex_unlock(&rooms_mutex);
 		/* Return a list of all participants */
 		json_t *list = json_array();
 		GHashTableIter iter;
 		gpointer value;
+		janus_mutex_lock(&audiobridge->mutex);
 		g_hash_table_iter_init(&iter, audiobridge->participants);
 		while(!g_atomic_int_get(&audiobridge->destroyed) && g_hash_table_iter_next(&iter, NULL, &value)) {
 			janus_audiobridge_participant *p = value;
@@ -4511,8 +5172,8 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 				json_object_set_new(pl, "spatial_position", json_integer(p->spatial_position));
 			json_array_append_new(list, pl);
 		}
+		janus_mutex_unlock(&audiobridge->mutex);
 		janus_refcount_decrease(&audiobridge->ref);
-		janus_mutex_unlock(&rooms_mutex);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("participants"));
 		json_object_set_new(response, "room", string_ids ? json_string(room_id_str) : json_integer(room_id));
@@ -4537,6 +5198,16 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
 		if(error_code != 0)
 			goto prepare_response;
+		json_t *mirrors = json_object_get(root, "mirrors");
+		size_t i = 0;
+		for(i=0; i<json_array_size(mirrors); i++) {
+			json_t *m = json_array_get(mirrors, i);
+			JANUS_VALIDATE_JSON_OBJECT(m, rtp_forward_mirror_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+		}
 		if(!string_ids) {
 			JANUS_VALIDATE_JSON_OBJECT(root, room_parameters,
 				error_code, error_cause, TRUE,
@@ -4670,8 +5341,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -4730,6 +5400,21 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 
 		guint32 stream_id = janus_audiobridge_rtp_forwarder_add_helper(audiobridge, group,
 			host, port, ssrc_value, ptype, codec, srtp_suite, srtp_crypto, always_on, 0);
+		if(stream_id > 0 && json_array_size(mirrors) > 0) {
+			/* Add the additional recipients of the same packets */
+			janus_mutex_lock(&audiobridge->rtp_mutex);
+			janus_rtp_forwarder *rf = g_hash_table_lookup(audiobridge->rtp_forwarders, GUINT_TO_POINTER(stream_id));
+			for(i=0; rf != NULL && i<json_array_size(mirrors); i++) {
+				json_t *m = json_array_get(mirrors, i);
+				const char *m_host = json_string_value(json_object_get(m, "host"));
+				int m_port = json_integer_value(json_object_get(m, "port"));
+				if(janus_rtp_forwarder_add_mirror(rf, m_host, m_port) < 0) {
+					JANUS_LOG(LOG_WARN, "Couldn't add mirror %s:%d to RTP forwarder %"SCNu32"\n",
+						m_host, m_port, stream_id);
+				}
+			}
+			janus_mutex_unlock(&audiobridge->rtp_mutex);
+		}
 		janus_mutex_unlock(&audiobridge->mutex);
 		janus_mutex_unlock(&rooms_mutex);
 
@@ -4749,6 +5434,16 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
 		if(error_code != 0)
 			goto prepare_response;
+		json_t *mirrors = json_object_get(root, "mirrors");
+		size_t i = 0;
+		for(i=0; i<json_array_size(mirrors); i++) {
+			json_t *m = json_array_get(mirrors, i);
+			JANUS_VALIDATE_JSON_OBJECT(m, rtp_forward_mirror_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_AUDIOBRIDGE_ERROR_MISSING_ELEMENT, JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+		}
 		if(!string_ids) {
 			JANUS_VALIDATE_JSON_OBJECT(root, room_parameters,
 				error_code, error_cause, TRUE,
@@ -4786,8 +5481,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		guint32 stream_id = json_integer_value(json_object_get(root, "stream_id"));
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -4812,7 +5506,30 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			goto prepare_response;
 		}
 		janus_mutex_lock(&audiobridge->rtp_mutex);
-		g_hash_table_remove(audiobridge->rtp_forwarders, GUINT_TO_POINTER(stream_id));
+		if(mirrors == NULL) {
+			g_hash_table_remove(audiobridge->rtp_forwarders, GUINT_TO_POINTER(stream_id));
+		} else {
+			/* Only remove the specified mirrors, and keep the forwarder */
+			janus_rtp_forwarder *rf = g_hash_table_lookup(audiobridge->rtp_forwarders, GUINT_TO_POINTER(stream_id));
+			if(rf == NULL) {
+				janus_mutex_unlock(&audiobridge->rtp_mutex);
+				janus_mutex_unlock(&audiobridge->mutex);
+				janus_mutex_unlock(&rooms_mutex);
+				JANUS_LOG(LOG_ERR, "No such RTP forwarder (%"SCNu32")\n", stream_id);
+				error_code = JANUS_AUDIOBRIDGE_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "No such RTP forwarder (%"SCNu32")", stream_id);
+				goto prepare_response;
+			}
+			for(i=0; i<json_array_size(mirrors); i++) {
+				json_t *m = json_array_get(mirrors, i);
+				const char *m_host = json_string_value(json_object_get(m, "host"));
+				int m_port = json_integer_value(json_object_get(m, "port"));
+				if(janus_rtp_forwarder_remove_mirror(rf, m_host, m_port) < 0) {
+					JANUS_LOG(LOG_WARN, "No mirror %s:%d in RTP forwarder %"SCNu32"\n",
+						m_host, m_port, stream_id);
+				}
+			}
+		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
 		janus_mutex_unlock(&audiobridge->mutex);
 		janus_mutex_unlock(&rooms_mutex);
@@ -4845,8 +5562,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -4868,6 +5584,8 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			janus_mutex_unlock(&rooms_mutex);
 			goto prepare_response;
 		}
+		janus_refcount_increase(&audiobridge->ref);
+		janus_mutex_unlock(&rooms_mutex);
 		/* Return a list of all forwarders */
 		json_t *list = json_array();
 		GHashTableIter iter;
@@ -4899,11 +5617,28 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 			json_object_set_new(fl, "ptype", json_integer(rf->payload_type));
 			if(rf->is_srtp)
 				json_object_set_new(fl, "srtp", json_true());
+			if(rf->queue != NULL)
+				json_object_set_new(fl, "dropped", json_integer(g_atomic_int_get(&rf->dropped)));
+			if(g_atomic_int_get(&rf->mirrors_num) > 0) {
+				json_t *ml = json_array();
+				janus_mutex_lock(&rf->mirrors_mutex);
+				GList *temp = rf->mirrors;
+				while(temp) {
+					janus_rtp_forwarder_mirror *mirror = (janus_rtp_forwarder_mirror *)temp->data;
+					json_t *m = json_object();
+					json_object_set_new(m, "host", json_string(mirror->host));
+					json_object_set_new(m, "port", json_integer(mirror->port));
+					json_array_append_new(ml, m);
+					temp = temp->next;
+				}
+				janus_mutex_unlock(&rf->mirrors_mutex);
+				json_object_set_new(fl, "mirrors", ml);
+			}
 			json_object_set_new(fl, "always_on", rfm->always_on ? json_true() : json_false());
 			json_array_append_new(list, fl);
 		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
-		janus_mutex_unlock(&rooms_mutex);
+		janus_refcount_decrease(&audiobridge->ref);
 		response = json_object();
 		json_object_set_new(response, "audiobridge", json_string("forwarders"));
 		json_object_set_new(response, "room", string_ids ? json_string(room_id_str) : json_integer(room_id));
@@ -4957,8 +5692,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5134,8 +5868,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5223,8 +5956,7 @@ static json_t *janus_audiobridge_process_synchronous_request(janus_audiobridge_s
 		}
 		/* Update room */
 		janus_mutex_lock(&rooms_mutex);
-		janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 		if(audiobridge == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -5310,6 +6042,74 @@ prepare_response:
 
 }
 
+/* Helper to pick the handler thread an asynchronous request should be queued to:
+ * a session sticks to the same thread as long as it has pending messages, so
+ * that its requests are never reordered, and otherwise follows the room the
+ * request is addressed to, if any, so that requests for a room are serialized */
+static guint janus_audiobridge_message_route(janus_audiobridge_session *session, json_t *message) {
+	if(handler_threads > 1 && g_atomic_int_get(&session->pending_messages) == 0) {
+		json_t *room = json_object_get(message, "room");
+		if(json_is_integer(room))
+			g_atomic_int_set(&session->handler_index, (guint)((guint64)json_integer_value(room) % handler_threads));
+		else if(json_is_string(room))
+			g_atomic_int_set(&session->handler_index, g_str_hash(json_string_value(room)) % handler_threads);
+	}
+	g_atomic_int_inc(&session->pending_messages);
+	return (guint)g_atomic_int_get(&session->handler_index);
+}
+
+/* Helper to keep track of how long asynchronous requests take */
+static void janus_audiobridge_request_stats_update(const char *request, gint64 elapsed) {
+	janus_mutex_lock(&request_stats_mutex);
+	if(request_stats == NULL) {
+		janus_mutex_unlock(&request_stats_mutex);
+		return;
+	}
+	janus_audiobridge_request_stats *stats = g_hash_table_lookup(request_stats, request);
+	if(stats == NULL) {
+		stats = g_malloc0(sizeof(janus_audiobridge_request_stats));
+		g_hash_table_insert(request_stats, g_strdup(request), stats);
+	}
+	stats->count++;
+	stats->total_time += elapsed;
+	if(elapsed > stats->max_time)
+		stats->max_time = elapsed;
+	janus_mutex_unlock(&request_stats_mutex);
+}
+
+/* Admin API request to inspect the handler threads and the request timing */
+static json_t *janus_audiobridge_query_handler(void) {
+	json_t *response = json_object();
+	json_object_set_new(response, "audiobridge", json_string("handler"));
+	json_object_set_new(response, "handler_threads", json_integer(handler_threads));
+	json_t *list = json_array();
+	guint i = 0;
+	for(i=0; i<handler_threads; i++) {
+		json_t *ht = json_object();
+		json_object_set_new(ht, "id", json_integer(handlers[i].id));
+		json_object_set_new(ht, "queued", json_integer(g_async_queue_length(handlers[i].messages)));
+		json_object_set_new(ht, "processed", json_integer(g_atomic_int_get(&handlers[i].processed)));
+		json_array_append_new(list, ht);
+	}
+	json_object_set_new(response, "handlers", list);
+	json_t *requests = json_object();
+	janus_mutex_lock(&request_stats_mutex);
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, request_stats);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		janus_audiobridge_request_stats *stats = (janus_audiobridge_request_stats *)value;
+		json_t *rs = json_object();
+		json_object_set_new(rs, "count", json_integer(stats->count));
+		json_object_set_new(rs, "avg_time", json_integer(stats->count ? stats->total_time/(gint64)stats->count : 0));
+		json_object_set_new(rs, "max_time", json_integer(stats->max_time));
+		json_object_set_new(requests, (const char *)key, rs);
+	}
+	janus_mutex_unlock(&request_stats_mutex);
+	json_object_set_new(response, "requests", requests);
+	return response;
+}
+
 struct janus_plugin_result *janus_audiobridge_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, g_atomic_int_get(&stopping) ? "Shutting down" : "Plugin not initialized", NULL);
@@ -5376,7 +6176,8 @@ struct janus_plugin_result *janus_audiobridge_handle_message(janus_plugin_sessio
 		msg->message = root;
 		msg->jsep = jsep;
 
-		g_async_queue_push(messages, msg);
+		guint index = janus_audiobridge_message_route(session, root);
+		g_async_queue_push(handlers[index].messages, msg);
 
 		return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 	} else {
@@ -5425,7 +6226,11 @@ json_t *janus_audiobridge_handle_admin_message(json_t *message) {
 		goto admin_response;
 	json_t *request = json_object_get(message, "request");
 	const char *request_text = json_string_value(request);
-	if((response = janus_audiobridge_process_synchronous_request(NULL, message)) != NULL) {
+	if(!strcasecmp(request_text, "query_handler")) {
+		/* This request is only available via Admin API */
+		response = janus_audiobridge_query_handler();
+		goto admin_response;
+	} else if((response = janus_audiobridge_process_synchronous_request(NULL, message)) != NULL) {
 		/* We got a response, send it back */
 		goto admin_response;
 	} else {
@@ -5516,6 +6321,22 @@ void janus_audiobridge_setup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&rooms_mutex);
 }
 
+/* Helper to decode a G.711 frame, and upsample it to the sampling rate of the room */
+static int janus_audiobridge_g711_decode(janus_audiobridge_participant *participant, int type,
+		const unsigned char *payload, opus_int16 *output) {
+	int16_t *dectable = (type == 0 ? janus_audiobridge_g711_ulaw_dectable : janus_audiobridge_g711_alaw_dectable);
+	uint32_t sampling_rate = participant->room ? participant->room->sampling_rate : 8000;
+	opus_int16 samples[G711_SAMPLES];
+	opus_int16 *decoded = (sampling_rate == 8000 ? output : samples);
+	int i = 0;
+	for(i=0; i<G711_SAMPLES; i++)
+		decoded[i] = dectable[payload[i]];
+	if(sampling_rate == 8000)
+		return G711_SAMPLES;
+	/* The resampler keeps the history of the stream, so that frames aren't filtered in isolation */
+	return janus_audiobridge_resampler_process(participant->upsampler, samples, G711_SAMPLES, 8000, output, sampling_rate);
+}
+
 void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *packet) {
 	if(handle == NULL || g_atomic_int_get(&handle->stopped) || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
@@ -5595,6 +6416,9 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 			if(level != -1) {
 				/* Is this silence? */
 				pkt->silence = (level == 127);
+				/* Keep track of how loud this participant is, in case only the loudest are mixed */
+				int speaker_level = g_atomic_int_get(&participant->speaker_level);
+				g_atomic_int_set(&participant->speaker_level, (speaker_level*3 + level + 3)/4);
 				if(participant->room && participant->room->audiolevel_event) {
 					/* We also need to detect who's talking: update our monitoring stuff */
 					int audio_active_packets = participant->room ? participant->room->audio_active_packets : 100;
@@ -5652,6 +6476,31 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 				}
 			}
 		}
+		if(participant->room->mix_speakers > 0 && participant->extmap_id > 0 &&
+				!g_atomic_int_get(&participant->speaker)) {
+			/* Only the loudest participants are mixed in this room, and this
+			 * is not one of them right now, so there's no point in decoding */
+			if(!participant->skipping) {
+				participant->skipping = TRUE;
+				janus_audiobridge_jb_restart(participant->jb);
+			}
+			if(participant->codec == JANUS_AUDIOCODEC_OPUS) {
+				/* Keep the packet, though, we'll need it to warm up the decoder */
+				int plen = 0;
+				char *payload = janus_rtp_payload(buf, len, &plen);
+				if(payload != NULL && plen > 0 && plen <= 1500) {
+					if(participant->warmup == NULL)
+						participant->warmup = g_malloc(1500);
+					memcpy(participant->warmup, payload, plen);
+					participant->warmup_len = plen;
+				}
+			}
+			participant->last_timestamp = pkt->timestamp;
+			participant->expected_seq = pkt->seq_number + 1;
+			g_free(pkt->data);
+			g_free(pkt);
+			return;
+		}
 		if(!g_atomic_int_compare_and_exchange(&participant->decoding, 0, 1)) {
 			/* This means we're cleaning up, so don't try to decode */
 			g_free(pkt->data);
@@ -5668,6 +6517,18 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 			g_free(pkt);
 			return;
 		}
+		if(participant->skipping) {
+			/* We just started decoding this participant again: feed the
+			 * latest packet we skipped to the decoder first, so that it
+			 * doesn't start from stale state (which would cause artifacts) */
+			participant->skipping = FALSE;
+			if(participant->codec == JANUS_AUDIOCODEC_OPUS && participant->warmup_len > 0) {
+				opus_decoder_ctl(participant->decoder, OPUS_RESET_STATE);
+				opus_decode(participant->decoder, participant->warmup, participant->warmup_len,
+					(opus_int16 *)pkt->data, BUFFER_SAMPLES, 0);
+				participant->warmup_len = 0;
+			}
+		}
 		/* Check sequence number received, verify if it's relevant to the expected one */
 		if(pkt->seq_number == participant->expected_seq) {
 			/* Regular decode */
@@ -5683,18 +6544,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 					g_free(pkt);
 					return;
 				}
-				int i = 0;
-				uint16_t *samples = (uint16_t *)pkt->data;
-				if(rtp->type == 0) {
-					/* mu-law */
-					for(i=0; i<plen; i++)
-						*(samples+i) = janus_audiobridge_g711_ulaw_dectable[*(payload+i)];
-				} else if(rtp->type == 8) {
-					/* a-law */
-					for(i=0; i<plen; i++)
-						*(samples+i) = janus_audiobridge_g711_alaw_dectable[*(payload+i)];
-				}
-				pkt->length = 320;
+				pkt->length = janus_audiobridge_g711_decode(participant, rtp->type, payload, (opus_int16 *)pkt->data);
 			}
 			/* Update last_timestamp */
 			participant->last_timestamp = pkt->timestamp;
@@ -5737,10 +6587,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 						return;
 					}
 					/* Enqueue the decoded frame */
-					janus_mutex_lock(&participant->qmutex);
-					/* Insert packets sorting by sequence number */
-					participant->inbuf = g_list_insert_sorted(participant->inbuf, lost_pkt, &janus_audiobridge_rtp_sort);
-					janus_mutex_unlock(&participant->qmutex);
+					janus_audiobridge_jb_insert(participant->jb, lost_pkt->seq_number, lost_pkt);
 				}
 			}
 			/* Then go with the regular decode (no FEC) */
@@ -5756,18 +6603,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 					g_free(pkt);
 					return;
 				}
-				int i = 0;
-				uint16_t *samples = (uint16_t *)pkt->data;
-				if(rtp->type == 0) {
-					/* mu-law */
-					for(i=0; i<plen; i++)
-						*(samples+i) = janus_audiobridge_g711_ulaw_dectable[*(payload+i)];
-				} else if(rtp->type == 8) {
-					/* a-law */
-					for(i=0; i<plen; i++)
-						*(samples+i) = janus_audiobridge_g711_alaw_dectable[*(payload+i)];
-				}
-				pkt->length = 320;
+				pkt->length = janus_audiobridge_g711_decode(participant, rtp->type, payload, (opus_int16 *)pkt->data);
 			}
 			/* Increment according to previous seq_number */
 			participant->expected_seq = pkt->seq_number + 1;
@@ -5779,6 +6615,7 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 				participant->expected_seq = pkt->seq_number + 1;
 			} else {
 				JANUS_LOG(LOG_WARN, "IN LATE SN seq =  %"SCNu16", expected_seq = %"SCNu16"\n", pkt->seq_number, participant->expected_seq);
+				janus_audiobridge_jb_count_late(participant->jb);
 			}
 			g_free(pkt->data);
 			g_free(pkt);
@@ -5795,45 +6632,9 @@ void janus_audiobridge_incoming_rtp(janus_plugin_session *handle, janus_plugin_r
 			g_free(pkt);
 			return;
 		}
-		/* Enqueue the decoded frame */
-		janus_mutex_lock(&participant->qmutex);
-		/* Insert packets sorting by sequence number */
-		participant->inbuf = g_list_insert_sorted(participant->inbuf, pkt, &janus_audiobridge_rtp_sort);
-		if(participant->prebuffering) {
-			/* Still pre-buffering: do we have enough packets now? */
-			if(g_list_length(participant->inbuf) > participant->prebuffer_count) {
-				participant->prebuffering = FALSE;
-				JANUS_LOG(LOG_VERB, "Prebuffering done! Finally adding the user to the mix\n");
-			} else {
-				JANUS_LOG(LOG_VERB, "Still prebuffering (got %d packets), not adding the user to the mix yet\n", g_list_length(participant->inbuf));
-			}
-		} else {
-			/* Make sure we're not queueing too many packets: if so, get rid of the older ones */
-			if(g_list_length(participant->inbuf) >= participant->prebuffer_count*2) {
-				gint64 now = janus_get_monotonic_time();
-				if(now - participant->last_drop > 5*G_USEC_PER_SEC) {
-					JANUS_LOG(LOG_VERB, "Too many packets in queue (%d > %d), removing older ones\n",
-						g_list_length(participant->inbuf), participant->prebuffer_count*2);
-					participant->last_drop = now;
-				}
-				while(g_list_length(participant->inbuf) > participant->prebuffer_count) {
-					/* Remove this packet: it's too old */
-					GList *first = g_list_first(participant->inbuf);
-					janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-					JANUS_LOG(LOG_VERB, "List length = %d, Remove sequence = %d\n",
-						g_list_length(participant->inbuf), pkt->seq_number);
-					participant->inbuf = g_list_delete_link(participant->inbuf, first);
-					first = NULL;
-					if(pkt == NULL)
-						continue;
-					g_free(pkt->data);
-					pkt->data = NULL;
-					g_free(pkt);
-					pkt = NULL;
-				}
-			}
-		}
-		janus_mutex_unlock(&participant->qmutex);
+		/* Enqueue the decoded frame: the jitter buffer will take care of
+		 * prebuffering, and of getting rid of packets if too many are queued */
+		janus_audiobridge_jb_insert(participant->jb, pkt->seq_number, pkt);
 	}
 }
 
@@ -5967,7 +6768,6 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 	participant->muted = TRUE;
 	g_free(participant->display);
 	participant->display = NULL;
-	participant->prebuffering = TRUE;
 	/* Make sure we're not using the encoder/decoder right now, we're going to destroy them */
 	while(!g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1))
 		g_usleep(5000);
@@ -5988,19 +6788,7 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 	g_free(participant->mjr_base);
 	participant->mjr_base = NULL;
 	/* Get rid of queued packets */
-	while(participant->inbuf) {
-		GList *first = g_list_first(participant->inbuf);
-		janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-		participant->inbuf = g_list_delete_link(participant->inbuf, first);
-		first = NULL;
-		if(pkt == NULL)
-			continue;
-		g_free(pkt->data);
-		pkt->data = NULL;
-		g_free(pkt);
-		pkt = NULL;
-	}
-	participant->last_drop = 0;
+	janus_audiobridge_jb_flush(participant->jb);
 	janus_mutex_unlock(&participant->qmutex);
 	if(audiobridge != NULL) {
 		janus_mutex_unlock(&audiobridge->mutex);
@@ -6015,15 +6803,35 @@ static void janus_audiobridge_hangup_media_internal(janus_plugin_session *handle
 
 /* Thread to handle incoming messages */
 static void *janus_audiobridge_handler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining AudioBridge handler thread\n");
+	janus_audiobridge_handler_thread *ht = (janus_audiobridge_handler_thread *)data;
+	JANUS_LOG(LOG_VERB, "Joining AudioBridge handler thread #%u\n", ht->id);
 	janus_audiobridge_message *msg = NULL;
 	int error_code = 0;
 	char error_cause[512];
 	json_t *root = NULL;
+	/* Requests may be completed in many different places below, so we take
+	 * care of the bookkeeping of the previous one before popping a new one */
+	janus_audiobridge_session *last_session = NULL;
+	char last_request[32];
+	gint64 last_start = 0;
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		msg = g_async_queue_pop(messages);
+		if(last_session != NULL) {
+			janus_audiobridge_request_stats_update(last_request, janus_get_monotonic_time() - last_start);
+			g_atomic_int_add(&last_session->pending_messages, -1);
+			janus_refcount_decrease(&last_session->ref);
+			last_session = NULL;
+		}
+		msg = g_async_queue_pop(ht->messages);
 		if(msg == &exit_message)
 			break;
+		g_atomic_int_inc(&ht->processed);
+		if(msg->handle != NULL && msg->handle->plugin_handle != NULL) {
+			last_session = (janus_audiobridge_session *)msg->handle->plugin_handle;
+			janus_refcount_increase(&last_session->ref);
+			const char *request_text = json_string_value(json_object_get(msg->message, "request"));
+			g_strlcpy(last_request, request_text ? request_text : "unknown", sizeof(last_request));
+			last_start = janus_get_monotonic_time();
+		}
 		if(msg->handle == NULL) {
 			janus_audiobridge_message_free(msg);
 			continue;
@@ -6137,8 +6945,7 @@ static void *janus_audiobridge_handler(void *data) {
 				room_id_str = (char *)json_string_value(room);
 			}
 			janus_mutex_lock(&rooms_mutex);
-			janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-				string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 			if(audiobridge == NULL) {
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -6330,11 +7137,15 @@ static void *janus_audiobridge_handler(void *data) {
 				janus_refcount_init(&participant->ref, janus_audiobridge_participant_free);
 				g_atomic_int_set(&participant->active, 0);
 				participant->codec = codec;
-				participant->prebuffering = TRUE;
 				participant->display = NULL;
-				participant->inbuf = NULL;
+				g_atomic_int_set(&participant->speaker_level, 127);
+				participant->jb = janus_audiobridge_jb_new(prebuffer_count,
+					(GDestroyNotify)janus_audiobridge_decoded_packet_free);
+				if(codec != JANUS_AUDIOCODEC_OPUS) {
+					participant->upsampler = janus_audiobridge_resampler_new();
+					participant->downsampler = janus_audiobridge_resampler_new();
+				}
 				participant->outbuf = NULL;
-				participant->last_drop = 0;
 				participant->encoder = NULL;
 				participant->decoder = NULL;
 				participant->reset = FALSE;
@@ -6358,6 +7169,7 @@ static void *janus_audiobridge_handler(void *data) {
 			participant->display = display_text ? g_strdup(display_text) : NULL;
 			participant->muted = muted ? json_is_true(muted) : FALSE;	/* By default, everyone's unmuted when joining */
 			participant->prebuffer_count = prebuffer_count;
+			janus_audiobridge_jb_set_depth(participant->jb, prebuffer_count);
 			participant->volume_gain = volume;
 			participant->opus_complexity = complexity;
 			participant->opus_bitrate = opus_bitrate;
@@ -6534,8 +7346,8 @@ static void *janus_audiobridge_handler(void *data) {
 				}
 			}
 			janus_mutex_unlock(&participant->rec_mutex);
-			/* Finally, start the encoding thread if it hasn't already */
-			if(participant->thread == NULL) {
+			/* Finally, start the encoding thread if it hasn't already (unless we use a pool) */
+			if(encoders == NULL && participant->thread == NULL) {
 				GError *error = NULL;
 				char roomtrunc[5], parttrunc[5];
 				g_snprintf(roomtrunc, sizeof(roomtrunc), "%s", audiobridge->room_id_str);
@@ -6554,24 +7366,32 @@ static void *janus_audiobridge_handler(void *data) {
 					g_error_free(error);
 				}
 			}
-			if(participant->plainrtp_media.audio_rtp_fd != -1 && participant->plainrtp_media.thread == NULL) {
-				/* Spawn a thread for incoming plain RTP traffic too */
-				GError *error = NULL;
-				char roomtrunc[5], parttrunc[5];
-				g_snprintf(roomtrunc, sizeof(roomtrunc), "%s", audiobridge->room_id_str);
-				g_snprintf(parttrunc, sizeof(parttrunc), "%s", participant->user_id_str);
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "rtp %s %s", roomtrunc, parttrunc);
+			if(participant->plainrtp_media.audio_rtp_fd != -1 && participant->plainrtp_media.thread == NULL &&
+					participant->plainrtp_media.reactor == NULL) {
 				janus_refcount_increase(&session->ref);
 				janus_refcount_increase(&participant->ref);
-				participant->plainrtp_media.thread = g_thread_try_new(tname, &janus_audiobridge_plainrtp_relay_thread, participant, &error);
-				if(error != NULL) {
-					janus_refcount_decrease(&participant->ref);
-					janus_refcount_decrease(&session->ref);
-					/* FIXME We should fail here... */
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the plain RTP participant thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
+				gboolean served = FALSE;
+#ifdef HAVE_EPOLL
+				/* If we have reactor threads, one of them will serve this participant */
+				served = (reactor_threads > 0 && janus_audiobridge_reactor_add(participant) == 0);
+#endif
+				if(!served) {
+					/* Spawn a thread for incoming plain RTP traffic too */
+					GError *error = NULL;
+					char roomtrunc[5], parttrunc[5];
+					g_snprintf(roomtrunc, sizeof(roomtrunc), "%s", audiobridge->room_id_str);
+					g_snprintf(parttrunc, sizeof(parttrunc), "%s", participant->user_id_str);
+					char tname[16];
+					g_snprintf(tname, sizeof(tname), "rtp %s %s", roomtrunc, parttrunc);
+					participant->plainrtp_media.thread = g_thread_try_new(tname, &janus_audiobridge_plainrtp_relay_thread, participant, &error);
+					if(error != NULL) {
+						janus_refcount_decrease(&participant->ref);
+						janus_refcount_decrease(&session->ref);
+						/* FIXME We should fail here... */
+						JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the plain RTP participant thread...\n",
+							error->code, error->message ? error->message : "??");
+						g_error_free(error);
+					}
 				}
 			}
 			/* If a PeerConnection exists, make sure to update the RTP headers */
@@ -6704,24 +7524,9 @@ static void *janus_audiobridge_handler(void *data) {
 					JANUS_LOG(LOG_WARN, "Invalid prebuffering value provided (too high), keeping previous value: %d\n",
 						participant->prebuffer_count);
 				} else if(prebuffer_count != participant->prebuffer_count) {
-					janus_mutex_lock(&participant->qmutex);
-					if(prebuffer_count < participant->prebuffer_count) {
-						/* We're switching to a shorter prebuffer, trim the incoming buffer */
-						while(g_list_length(participant->inbuf) > prebuffer_count) {
-							GList *first = g_list_first(participant->inbuf);
-							janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-							participant->inbuf = g_list_delete_link(participant->inbuf, first);
-							if(pkt == NULL)
-								continue;
-							g_free(pkt->data);
-							g_free(pkt);
-						}
-					} else {
-						/* Reset the prebuffering state */
-						participant->prebuffering = TRUE;
-					}
+					/* The jitter buffer will trim or fill up its queue accordingly */
+					janus_audiobridge_jb_set_depth(participant->jb, prebuffer_count);
 					participant->prebuffer_count = prebuffer_count;
-					janus_mutex_unlock(&participant->qmutex);
 				}
 			}
 			if(gain)
@@ -6778,21 +7583,7 @@ static void *janus_audiobridge_handler(void *data) {
 						participant->muted ? "true" : "false", participant->room->room_id_str, participant->user_id_str);
 					if(participant->muted) {
 						/* Clear the queued packets waiting to be handled */
-						janus_mutex_lock(&participant->qmutex);
-						while(participant->inbuf) {
-							GList *first = g_list_first(participant->inbuf);
-							janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-							participant->inbuf = g_list_delete_link(participant->inbuf, first);
-							first = NULL;
-							if(pkt == NULL)
-								continue;
-							if(pkt->data)
-								g_free(pkt->data);
-							pkt->data = NULL;
-							g_free(pkt);
-							pkt = NULL;
-						}
-						janus_mutex_unlock(&participant->qmutex);
+						janus_audiobridge_jb_flush(participant->jb);
 					}
 				}
 				if(display) {
@@ -6956,8 +7747,7 @@ static void *janus_audiobridge_handler(void *data) {
 				g_snprintf(error_cause, 512, "Already in this room");
 				goto error;
 			}
-			janus_audiobridge_room *audiobridge = g_hash_table_lookup(rooms,
-				string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+			janus_audiobridge_room *audiobridge = janus_audiobridge_lookup_room(room_id, room_id_str);
 			if(audiobridge == NULL) {
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_AUDIOBRIDGE_ERROR_NO_SUCH_ROOM;
@@ -7114,7 +7904,7 @@ static void *janus_audiobridge_handler(void *data) {
 				}
 				JANUS_LOG(LOG_VERB, "  -- Participant ID in new room %s: %s\n", room_id_str, user_id_str);
 			}
-			participant->prebuffering = TRUE;
+			janus_audiobridge_jb_flush(participant->jb);
 			participant->audio_active_packets = 0;
 			participant->audio_dBov_sum = 0;
 			participant->talking = FALSE;
@@ -7398,19 +8188,7 @@ static void *janus_audiobridge_handler(void *data) {
 			/* Get rid of queued packets */
 			janus_mutex_lock(&participant->qmutex);
 			g_atomic_int_set(&participant->active, 0);
-			participant->prebuffering = TRUE;
-			while(participant->inbuf) {
-				GList *first = g_list_first(participant->inbuf);
-				janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)first->data;
-				participant->inbuf = g_list_delete_link(participant->inbuf, first);
-				first = NULL;
-				if(pkt == NULL)
-					continue;
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
+			janus_audiobridge_jb_flush(participant->jb);
 			janus_mutex_unlock(&participant->qmutex);
 			/* Stop recording, if we were */
 			janus_mutex_lock(&participant->rec_mutex);
@@ -7680,124 +8458,349 @@ error:
 			janus_audiobridge_message_free(msg);
 		}
 	}
-	JANUS_LOG(LOG_VERB, "Leaving AudioBridge handler thread\n");
+	if(last_session != NULL) {
+		g_atomic_int_add(&last_session->pending_messages, -1);
+		janus_refcount_decrease(&last_session->ref);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving AudioBridge handler thread #%u\n", ht->id);
 	return NULL;
 }
-static void janus_audiobridge_rec_add_wav_header(janus_audiobridge_room *audiobridge) {
+/* Helpers to start and stop recording the mix of a room: the actual
+ * writing happens on a separate thread (see janus_audiobridge_rec.c) */
+static void janus_audiobridge_recording_done(const char *filename, gpointer user_data) {
+	janus_audiobridge_room *audiobridge = (janus_audiobridge_room *)user_data;
+	JANUS_LOG(LOG_VERB, "Recording of room %s (%s) done: %s\n", audiobridge->room_id_str, audiobridge->room_name, filename);
+	/* Notify event handlers */
+	if(notify_events && gateway->events_is_enabled()) {
+		json_t *info = json_object();
+		json_object_set_new(info, "event", json_string("recordingdone"));
+		json_object_set_new(info, "room",
+			string_ids ? json_string(audiobridge->room_id_str) : json_integer(audiobridge->room_id));
+		json_object_set_new(info, "record_file", json_string(filename));
+		gateway->notify_event(&janus_audiobridge_plugin, NULL, info);
+	}
+	janus_refcount_decrease(&audiobridge->ref);
+}
+static void janus_audiobridge_recording_start(janus_audiobridge_room *audiobridge) {
 	/* Do we need to record the mix? */
-	char filename[255];
+	char filename[255], tmpfilename[255];
 	gint64 now = janus_get_real_time();
 	audiobridge->rec_start_time = now;
 	if(audiobridge->record_file) {
-		g_snprintf(filename, 255, "%s%s%s%s%s",
+		g_snprintf(filename, 255, "%s%s%s",
 			audiobridge->record_dir ? audiobridge->record_dir : "",
 			audiobridge->record_dir ? "/" : "",
-			audiobridge->record_file,
-			rec_tempext ? "." : "", rec_tempext ? rec_tempext : "");
+			audiobridge->record_file);
 	} else {
-		g_snprintf(filename, 255, "%s%sjanus-audioroom-%s-%"SCNi64".wav%s%s",
+		g_snprintf(filename, 255, "%s%sjanus-audioroom-%s-%"SCNi64".%s",
 			audiobridge->record_dir ? audiobridge->record_dir : "",
 			audiobridge->record_dir ? "/" : "",
 			audiobridge->room_id_str, now,
-			rec_tempext ? "." : "", rec_tempext ? rec_tempext : "");
+			janus_audiobridge_rec_format_extension(audiobridge->record_format));
 	}
-	audiobridge->recording = fopen(filename, "wb");
+	if(rec_tempext)
+		g_snprintf(tmpfilename, 255, "%s.%s", filename, rec_tempext);
+	audiobridge->recording = janus_audiobridge_rec_open(rec_tempext ? tmpfilename : filename,
+		rec_tempext ? filename : NULL, audiobridge->record_format, audiobridge->sampling_rate,
+		audiobridge->spatial_audio ? 2 : 1, audiobridge->default_bitrate);
 	if(audiobridge->recording == NULL) {
-		JANUS_LOG(LOG_WARN, "Recording requested, but could NOT open file %s for writing, giving up...\n", filename);
+		JANUS_LOG(LOG_WARN, "Recording requested, but could NOT open file %s for writing, giving up...\n",
+			rec_tempext ? tmpfilename : filename);
 		g_atomic_int_set(&audiobridge->record, 0);
-		g_atomic_int_set(&audiobridge->wav_header_added, 0);
 		g_free(audiobridge->record_file);
 		audiobridge->record_file = NULL;
 	} else {
-		JANUS_LOG(LOG_VERB, "Recording requested, opened file %s for writing\n", filename);
-		/* Write WAV header */
-		wav_header header = {
-			{'R', 'I', 'F', 'F'},
-			0,
-			{'W', 'A', 'V', 'E'},
-			{'f', 'm', 't', ' '},
-			16,
-			1,
-			audiobridge->spatial_audio ? 2 : 1,
-			audiobridge->sampling_rate,
-			audiobridge->sampling_rate * 2 * (audiobridge->spatial_audio ? 2 : 1),
-			2,
-			16,
-			{'d', 'a', 't', 'a'},
-			0
-		};
-		if(fwrite(&header, 1, sizeof(header), audiobridge->recording) != sizeof(header)) {
-			JANUS_LOG(LOG_ERR, "Error writing WAV header...\n");
-		}
-		fflush(audiobridge->recording);
-		audiobridge->record_lastupdate = janus_get_monotonic_time();
-		g_atomic_int_set(&audiobridge->wav_header_added, 1);
-	}
-}
-static void janus_audiobridge_update_wav_header(janus_audiobridge_room *audiobridge) {
-	/* Update the length in the header */
+		JANUS_LOG(LOG_VERB, "Recording requested, opened file %s for writing\n", rec_tempext ? tmpfilename : filename);
+	}
+}
+static void janus_audiobridge_recording_stop(janus_audiobridge_room *audiobridge) {
 	if(audiobridge->recording == NULL)
 		return;
-	fseek(audiobridge->recording, 0, SEEK_END);
-	long int size = ftell(audiobridge->recording);
-	if(size >= 8) {
-		size -= 8;
-		fseek(audiobridge->recording, 4, SEEK_SET);
-		fwrite(&size, sizeof(uint32_t), 1, audiobridge->recording);
-		size += 8;
-		fseek(audiobridge->recording, 40, SEEK_SET);
-		fwrite(&size, sizeof(uint32_t), 1, audiobridge->recording);
-		fflush(audiobridge->recording);
-	}
-	fclose(audiobridge->recording);
+	/* The recorder will let us know when the file has been finalized */
+	janus_refcount_increase(&audiobridge->ref);
+	janus_audiobridge_rec_close(audiobridge->recording, janus_audiobridge_recording_done, audiobridge);
 	audiobridge->recording = NULL;
-	g_atomic_int_set(&audiobridge->wav_header_added, 0);
+}
 
-	char filename[255];
-	if(audiobridge->record_file) {
-		g_snprintf(filename, 255, "%s%s%s",
-			audiobridge->record_dir ? audiobridge->record_dir : "",
-			audiobridge->record_dir ? "/" : "",
-			audiobridge->record_file);
-	} else {
-		g_snprintf(filename, 255, "%s%sjanus-audioroom-%s-%"SCNi64".wav",
-			audiobridge->record_dir ? audiobridge->record_dir : "",
-			audiobridge->record_dir ? "/" : "",
-			audiobridge->room_id_str, audiobridge->rec_start_time);
-	}
-	if(rec_tempext) {
-		/* We need to rename the file, to remove the temporary extension */
-		char extfilename[255];
-		if(audiobridge->record_file) {
-			g_snprintf(extfilename, 255, "%s%s%s.%s",
-				audiobridge->record_dir ? audiobridge->record_dir : "",
-				audiobridge->record_dir ? "/" : "",
-				audiobridge->record_file, rec_tempext);
-		} else {
-			g_snprintf(extfilename, 255, "%s%sjanus-audioroom-%s-%"SCNi64".wav.%s",
-				audiobridge->record_dir ? audiobridge->record_dir : "",
-				audiobridge->record_dir ? "/" : "",
-				audiobridge->room_id_str,
-				audiobridge->rec_start_time, rec_tempext);
-		}
-		if(rename(extfilename, filename) != 0) {
-			JANUS_LOG(LOG_ERR, "Error renaming %s to %s...\n", extfilename, filename);
-		} else {
-			JANUS_LOG(LOG_INFO, "Recording renamed: %s\n", filename);
+/* Thread to mix the contributions from all participants */
+/* Helper to compute the gains to apply to the audio of a participant in the mix */
+static void janus_audiobridge_participant_gains(janus_audiobridge_participant *p, float *lgain, float *rgain) {
+	float volume = (p->volume_gain == 100 ? 1.0f : (float)p->volume_gain/100.0f);
+	*lgain = volume;
+	*rgain = volume;
+	if(p->stereo) {
+		/* Spatial audio: the position decides how much goes left and right */
+		int diff = 50 - p->spatial_position;
+		*lgain = volume * ((float)(50 + diff)/100.0f);
+		*rgain = volume * ((float)(50 - diff)/100.0f);
+	}
+}
+
+/* Helpers to pick the loudest participants, when only those are mixed */
+typedef struct janus_audiobridge_speaker {
+	janus_audiobridge_participant *participant;
+	int level;
+} janus_audiobridge_speaker;
+static gint janus_audiobridge_speaker_compare(gconstpointer a, gconstpointer b) {
+	const janus_audiobridge_speaker *sa = a, *sb = b;
+	/* Audio levels are in -dBov, so lower means louder */
+	return sa->level - sb->level;
+}
+static void janus_audiobridge_select_speakers(janus_audiobridge_room *audiobridge, GList *participants, GArray *speakers) {
+	g_array_set_size(speakers, 0);
+	GList *ps = participants;
+	while(ps) {
+		janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
+		ps = ps->next;
+		/* Participants not sending audio levels are always decoded, as we can't rank them */
+		if(g_atomic_int_get(&p->destroyed) || p->extmap_id <= 0)
+			continue;
+		janus_audiobridge_speaker speaker = { .participant = p, .level = g_atomic_int_get(&p->speaker_level) };
+		if(!g_atomic_int_get(&p->active) || p->muted) {
+			speaker.level = 128;
+		} else if(g_atomic_int_get(&p->speaker)) {
+			/* Favour the current speakers, to avoid switching back and forth */
+			speaker.level -= SPEAKERS_HYSTERESIS;
+		}
+		g_array_append_val(speakers, speaker);
+	}
+	g_array_sort(speakers, janus_audiobridge_speaker_compare);
+	guint i = 0;
+	for(i=0; i<speakers->len; i++) {
+		janus_audiobridge_speaker *speaker = &g_array_index(speakers, janus_audiobridge_speaker, i);
+		/* Participants that are silent don't need to be decoded either */
+		gboolean selected = (i < audiobridge->mix_speakers && speaker->level < 127 - SPEAKERS_HYSTERESIS);
+		if(selected != (g_atomic_int_get(&speaker->participant->speaker) != 0)) {
+			if(string_ids) {
+				JANUS_LOG(LOG_HUGE, "[%s] Participant %s %s the loudest speakers\n", audiobridge->room_id_str,
+					speaker->participant->user_id_str, selected ? "joined" : "left");
+			} else {
+				JANUS_LOG(LOG_HUGE, "[%s] Participant %"SCNu64" %s the loudest speakers\n", audiobridge->room_id_str,
+					speaker->participant->user_id, selected ? "joined" : "left");
+			}
+			g_atomic_int_set(&speaker->participant->speaker, selected ? 1 : 0);
 		}
 	}
-	/* Also notify event handlers */
-	if(notify_events && gateway->events_is_enabled()) {
-		json_t *info = json_object();
-		json_object_set_new(info, "event", json_string("recordingdone"));
-		json_object_set_new(info, "room",
-			string_ids ? json_string(audiobridge->room_id_str) : json_integer(audiobridge->room_id));
-		json_object_set_new(info, "record_file", json_string(filename));
-		gateway->notify_event(&janus_audiobridge_plugin, NULL, info);
+}
+
+/* Cascaded mixing: with a lot of participants, a single thread may not be
+ * able to mix a room within a tick. When a room has more than one mixer
+ * thread, participants are split in shards, and sub-mixer threads work on
+ * them in parallel, twice per tick: first to get their frames and sum them
+ * in a partial mix (one per group, if groups are used), and then, once the
+ * mixer thread has added the partial mixes together, to prepare the frame
+ * each participant will be sent. Since we sum integers, the result is the
+ * same we'd get with a single thread, whatever the number of shards. */
+/* We don't split participants in shards smaller than this */
+#define JANUS_AUDIOBRIDGE_MIN_MIX_SHARD		32
+struct janus_audiobridge_mixer;
+typedef struct janus_audiobridge_mix_shard {
+	struct janus_audiobridge_mixer *mixer;
+	GList *participants;	/* First participant in this shard */
+	guint offset, num;		/* Position of the first participant in the list, and how many are in this shard */
+	gboolean deliver;		/* Whether we're preparing the frames to send, rather than mixing */
+	opus_int32 *partial;	/* Partial mix (or group mixes) of the participants in this shard */
+	opus_int32 sumBuffer[OPUS_SAMPLES*2];
+	opus_int16 outBuffer[OPUS_SAMPLES*2];
+} janus_audiobridge_mix_shard;
+typedef struct janus_audiobridge_mixer {
+	janus_audiobridge_room *room;
+	int samples;			/* Samples in a frame (twice as many, if spatial audio is used) */
+	uint groups_num;		/* Number of forwarding groups, if any */
+	opus_int32 *mix;		/* The full mix */
+	GPtrArray *frames;		/* Frames popped from the participants' jitter buffers in the current tick */
+	guint32 mix_ticks;		/* Current tick */
+	guint16 seq;			/* RTP sequence number of the current tick */
+	guint32 ts;				/* RTP timestamp of the current tick */
+	janus_audiobridge_encode_tick *tick;	/* Encoding statistics for the current tick, if a pool of encoders is used */
+	GHashTable *shared_encoders;	/* Shared Opus encoders for participants not contributing to the mix, if enabled */
+	janus_mutex shared_mutex;		/* Shards may need the shared encoders at the same time */
+	GThreadPool *pool;		/* Sub-mixer threads, if any */
+	janus_mutex mutex;
+	janus_condition cond;
+	int pending;			/* How many shards the sub-mixers are still working on */
+	janus_audiobridge_mix_shard shards[JANUS_AUDIOBRIDGE_MAX_MIX_THREADS];
+} janus_audiobridge_mixer;
+
+/* Get the next frame of each participant in a shard from their jitter buffer, and mix it */
+static void janus_audiobridge_mix_shard_collect(janus_audiobridge_mix_shard *shard) {
+	janus_audiobridge_mixer *mixer = shard->mixer;
+	int samples = mixer->samples;
+	float lgain = 1.0f, rgain = 1.0f;
+	GList *ps = shard->participants;
+	guint index = 0;
+	for(index=0; index<shard->num && ps != NULL; index++, ps = ps->next) {
+		janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
+		janus_audiobridge_rtp_relay_packet *pkt = NULL;
+		if(!g_atomic_int_get(&p->destroyed) && p->session && g_atomic_int_get(&p->session->started)) {
+			/* We advance the jitter buffer even for muted participants,
+			 * so that they don't start with stale audio when unmuted */
+			pkt = janus_audiobridge_jb_pop(p->jb);
+			if(pkt != NULL && (!g_atomic_int_get(&p->active) || p->muted)) {
+				janus_audiobridge_decoded_packet_free(pkt);
+				pkt = NULL;
+			}
+		}
+		/* We keep the frames in the same order as the list, as we'll need
+		 * them again when removing each participant's own contribution */
+		g_ptr_array_index(mixer->frames, shard->offset + index) = pkt;
+		/* G.711 frames have been upsampled to the rate of the room when decoded already */
+		if(pkt != NULL && pkt->length > 0 && !pkt->silence) {
+			/* Add to the main mix, or to the group submix */
+			janus_audiobridge_participant_gains(p, &lgain, &rgain);
+			janus_audiobridge_mix->accumulate(mixer->groups_num == 0 ? shard->partial : (shard->partial + (p->group-1)*samples),
+				(opus_int16 *)pkt->data, samples, lgain, rgain);
+		}
 	}
 }
 
-/* Thread to mix the contributions from all participants */
+/* Prepare the frame to send to a participant (the mix minus their own contribution) */
+static void janus_audiobridge_mix_deliver(janus_audiobridge_mix_shard *shard,
+		janus_audiobridge_participant *p, janus_audiobridge_rtp_relay_packet *pkt) {
+	if(g_atomic_int_get(&p->destroyed) || !p->session || !g_atomic_int_get(&p->session->started))
+		return;
+	janus_audiobridge_mixer *mixer = shard->mixer;
+	janus_audiobridge_room *audiobridge = mixer->room;
+	int samples = mixer->samples;
+	float lgain = 1.0f, rgain = 1.0f;
+	/* Remove the participant's own contribution */
+	opus_int16 *curBuffer = (opus_int16 *)((pkt && pkt->length && !pkt->silence) ? pkt->data : NULL);
+	if(curBuffer == NULL && p->muted && mixer->shared_encoders != NULL && p->codec == JANUS_AUDIOCODEC_OPUS) {
+		/* This participant is muted and gets the full mix: check if it's been encoded already */
+		janus_audiobridge_rtp_relay_packet *mixedpkt = NULL;
+		guint64 key = janus_audiobridge_shared_encoder_key(p);
+		janus_mutex_lock_nodebug(&mixer->shared_mutex);
+		janus_audiobridge_shared_encoder *se = g_hash_table_lookup(mixer->shared_encoders, &key);
+		if(se == NULL) {
+			se = janus_audiobridge_shared_encoder_new(audiobridge, p);
+			if(se != NULL)
+				g_hash_table_insert(mixer->shared_encoders, janus_uint64_dup(key), se);
+		}
+		if(se != NULL) {
+			if(se->last_tick != mixer->mix_ticks) {
+				se->last_tick = mixer->mix_ticks;
+				if(se->frame != NULL)
+					janus_refcount_decrease(&se->frame->ref);
+				se->frame = NULL;
+				janus_audiobridge_mix->pack(shard->outBuffer, mixer->mix, samples);
+				int length = opus_encode(se->encoder, shard->outBuffer,
+					audiobridge->spatial_audio ? samples/2 : samples, se->payload, sizeof(se->payload));
+				if(length < 0) {
+					JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the shared Opus frame: %d (%s)\n", length, opus_strerror(length));
+				} else if(length > 0) {
+					se->frame = g_malloc(sizeof(janus_audiobridge_shared_frame) + length);
+					se->frame->length = length;
+					memcpy(se->frame->payload, se->payload, length);
+					janus_refcount_init(&se->frame->ref, janus_audiobridge_shared_frame_free);
+				}
+			}
+			if(se->frame != NULL) {
+				janus_refcount_increase(&se->frame->ref);
+				mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
+				mixedpkt->data = NULL;
+				mixedpkt->shared = se->frame;
+				mixedpkt->length = se->frame->length;
+			}
+		}
+		janus_mutex_unlock_nodebug(&mixer->shared_mutex);
+		if(mixedpkt != NULL) {
+			mixedpkt->timestamp = mixer->ts;
+			mixedpkt->seq_number = mixer->seq;
+			mixedpkt->ssrc = audiobridge->room_ssrc;
+			mixedpkt->silence = FALSE;
+			mixedpkt->encoded = TRUE;
+			mixedpkt->tick = mixer->tick;
+			if(mixer->tick != NULL)
+				g_atomic_int_inc(&mixer->tick->pending);
+			g_async_queue_push(p->outbuf, mixedpkt);
+			janus_audiobridge_encoder_schedule(p);
+			return;
+		}
+	}
+	janus_audiobridge_participant_gains(p, &lgain, &rgain);
+	janus_audiobridge_mix->subtract(shard->sumBuffer, mixer->mix, curBuffer, samples, lgain, rgain);
+	/* FIXME Smoothen/Normalize instead of saturating? */
+	janus_audiobridge_mix->pack(shard->outBuffer, shard->sumBuffer, samples);
+	/* Enqueue this mixed frame for encoding in the participant thread */
+	janus_audiobridge_rtp_relay_packet *mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
+	mixedpkt->data = g_malloc(samples*2);
+	if(p->codec != JANUS_AUDIOCODEC_OPUS && audiobridge->sampling_rate != 8000) {
+		/* Downsample this from whatever the mixer uses */
+		if(janus_audiobridge_resampler_process(p->downsampler, shard->outBuffer, samples,
+				audiobridge->sampling_rate, (opus_int16 *)mixedpkt->data, 8000) == 0) {
+			JANUS_LOG(LOG_WARN, "[G.711] Error downsampling from %d, skipping audio packet\n", audiobridge->sampling_rate);
+			g_free(mixedpkt->data);
+			g_free(mixedpkt);
+			return;
+		}
+	} else {
+		/* Just copy */
+		memcpy(mixedpkt->data, shard->outBuffer, samples*2);
+	}
+	mixedpkt->length = samples;	/* We set the number of samples here, not the data length */
+	mixedpkt->timestamp = mixer->ts;
+	mixedpkt->seq_number = mixer->seq;
+	mixedpkt->ssrc = audiobridge->room_ssrc;
+	mixedpkt->silence = FALSE;
+	mixedpkt->encoded = FALSE;
+	mixedpkt->shared = NULL;
+	mixedpkt->tick = mixer->tick;
+	if(mixer->tick != NULL)
+		g_atomic_int_inc(&mixer->tick->pending);
+	g_async_queue_push(p->outbuf, mixedpkt);
+	janus_audiobridge_encoder_schedule(p);
+}
+
+/* Send the proper frame to each participant in a shard, and release them */
+static void janus_audiobridge_mix_shard_deliver(janus_audiobridge_mix_shard *shard) {
+	janus_audiobridge_mixer *mixer = shard->mixer;
+	GList *ps = shard->participants;
+	guint index = 0;
+	for(index=0; index<shard->num && ps != NULL; index++, ps = ps->next) {
+		janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
+		janus_audiobridge_rtp_relay_packet *pkt = g_ptr_array_index(mixer->frames, shard->offset + index);
+		janus_audiobridge_mix_deliver(shard, p, pkt);
+		janus_audiobridge_decoded_packet_free(pkt);
+		janus_refcount_decrease(&p->ref);
+	}
+}
+
+/* Sub-mixer task */
+static void janus_audiobridge_mix_shard_task(gpointer data, gpointer user_data) {
+	janus_audiobridge_mix_shard *shard = (janus_audiobridge_mix_shard *)data;
+	janus_audiobridge_mixer *mixer = shard->mixer;
+	if(shard->deliver)
+		janus_audiobridge_mix_shard_deliver(shard);
+	else
+		janus_audiobridge_mix_shard_collect(shard);
+	janus_mutex_lock_nodebug(&mixer->mutex);
+	mixer->pending--;
+	if(mixer->pending == 0)
+		janus_condition_signal(&mixer->cond);
+	janus_mutex_unlock_nodebug(&mixer->mutex);
+}
+
+/* Have the sub-mixers work on all shards but the first, which the mixer thread takes care of */
+static void janus_audiobridge_mix_shards_run(janus_audiobridge_mixer *mixer, guint shards_num, gboolean deliver) {
+	guint index = 0;
+	mixer->pending = shards_num-1;
+	for(index=0; index<shards_num; index++) {
+		mixer->shards[index].deliver = deliver;
+		if(index > 0)
+			g_thread_pool_push(mixer->pool, &mixer->shards[index], NULL);
+	}
+	if(deliver)
+		janus_audiobridge_mix_shard_deliver(&mixer->shards[0]);
+	else
+		janus_audiobridge_mix_shard_collect(&mixer->shards[0]);
+	if(shards_num == 1)
+		return;
+	janus_mutex_lock_nodebug(&mixer->mutex);
+	while(mixer->pending > 0)
+		janus_condition_wait(&mixer->cond, &mixer->mutex);
+	janus_mutex_unlock_nodebug(&mixer->mutex);
+}
+
 static void *janus_audiobridge_mixer_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "Audio bridge thread starting...\n");
 	janus_audiobridge_room *audiobridge = (janus_audiobridge_room *)data;
@@ -7812,12 +8815,10 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	int samples = audiobridge->sampling_rate/50;
 	if(audiobridge->spatial_audio)
 		samples = samples*2;
-	opus_int32 buffer[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES],
-		sumBuffer[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES];
+	opus_int32 buffer[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES];
 	opus_int16 outBuffer[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES],
-		resampled[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES], *curBuffer = NULL;
+		resampled[audiobridge->spatial_audio ? OPUS_SAMPLES*2 : OPUS_SAMPLES];
 	memset(buffer, 0, OPUS_SAMPLES*(audiobridge->spatial_audio ? 8 : 4));
-	memset(sumBuffer, 0, OPUS_SAMPLES*(audiobridge->spatial_audio ? 8 : 4));
 	memset(outBuffer, 0, OPUS_SAMPLES*(audiobridge->spatial_audio ? 4 : 2));
 	memset(resampled, 0, OPUS_SAMPLES*(audiobridge->spatial_audio ? 4 : 2));
 
@@ -7860,15 +8861,59 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		}
 	}
 
+	/* Context shared with the sub-mixers */
+	janus_audiobridge_mixer *mixer = g_malloc0(sizeof(janus_audiobridge_mixer));
+	mixer->room = audiobridge;
+	mixer->samples = samples;
+	mixer->groups_num = groups_num;
+	mixer->mix = buffer;
+	mixer->frames = g_ptr_array_new();
+	/* Shared Opus encoders for participants not contributing to the mix, if enabled */
+	mixer->shared_encoders = shared_encoding ?
+		g_hash_table_new_full(g_int64_hash, g_int64_equal, (GDestroyNotify)g_free, janus_audiobridge_shared_encoder_free) : NULL;
+	janus_mutex_init(&mixer->shared_mutex);
+	janus_mutex_init(&mixer->mutex);
+	janus_condition_init(&mixer->cond);
+	guint shards_max = 1, shards_num = 1;
+	opus_int32 *partials[JANUS_AUDIOBRIDGE_MAX_MIX_THREADS];
+	if(audiobridge->mix_threads > 1) {
+		/* Cascaded mixing: start the sub-mixer threads, and allocate
+		 * the buffers for the partial mixes of all the shards */
+		GError *error = NULL;
+		mixer->pool = g_thread_pool_new(janus_audiobridge_mix_shard_task, NULL,
+			audiobridge->mix_threads-1, TRUE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating the sub-mixer threads for room %s, mixing on a single thread: %d (%s)\n",
+				audiobridge->room_id_str, error->code, error->message ? error->message : "??");
+			g_error_free(error);
+		} else {
+			shards_max = audiobridge->mix_threads;
+			JANUS_LOG(LOG_VERB, "Using up to %u threads to mix room %s\n", shards_max, audiobridge->room_id_str);
+		}
+	}
+	for(index=0; index<shards_max; index++) {
+		mixer->shards[index].mixer = mixer;
+		partials[index] = (shards_max > 1 ? g_malloc((groups_num > 0 ? groups_num : 1) * samples * sizeof(opus_int32)) : NULL);
+	}
+	guint32 mix_ticks = 0;
+	/* Candidates to be mixed, if only the loudest participants are */
+	GArray *speakers = g_array_new(FALSE, FALSE, sizeof(janus_audiobridge_speaker));
+
 	/* Base RTP packets, in case there are forwarders involved */
 	gboolean have_opus[JANUS_AUDIOBRIDGE_MAX_GROUPS+1],
 		have_alaw[JANUS_AUDIOBRIDGE_MAX_GROUPS+1],
-		have_ulaw[JANUS_AUDIOBRIDGE_MAX_GROUPS+1];
+		have_ulaw[JANUS_AUDIOBRIDGE_MAX_GROUPS+1],
+		have_8k[JANUS_AUDIOBRIDGE_MAX_GROUPS+1];
 	unsigned char *rtpbuffer = g_malloc0(1500 * (groups_num+1));
 	janus_rtp_header *rtph = NULL;
 	/* In case we need G.711 forwarders */
 	uint8_t *rtpalaw = g_malloc0((12+G711_SAMPLES) * (groups_num+1)),
 			*rtpulaw = g_malloc0((12+G711_SAMPLES) * (groups_num+1));
+	/* The 8kHz version of the mix (or group mixes), and the resamplers we use to get it */
+	opus_int16 *mix8k = g_malloc0(samples * sizeof(opus_int16) * (groups_num+1));
+	janus_audiobridge_resampler *resamplers8k[JANUS_AUDIOBRIDGE_MAX_GROUPS+1];
+	for(index=0; index <= groups_num; index++)
+		resamplers8k[index] = janus_audiobridge_resampler_new();
 
 	/* Timer */
 	struct timeval now, before;
@@ -7881,11 +8926,9 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 	guint16 seq = 0;
 	guint32 ts = 0;
 
-	g_atomic_int_set(&audiobridge->wav_header_added, 0);
 	/* Loop */
 	int i=0;
 	int count = 0, rf_count = 0, pf_count = 0, prev_count = 0;
-	int lgain = 0, rgain = 0, diff = 0;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&audiobridge->destroyed)) {
 		/* See if it's time to prepare a frame */
 		gettimeofday(&now, NULL);
@@ -7901,13 +8944,13 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			continue;
 		}
 		/* If we're recording to a wav file, update the info */
-		if(g_atomic_int_get(&audiobridge->record) && !g_atomic_int_get(&audiobridge->wav_header_added)) {
-			JANUS_LOG(LOG_VERB, "Adding WAV header for recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
-			janus_audiobridge_rec_add_wav_header(audiobridge);
+		if(g_atomic_int_get(&audiobridge->record) && audiobridge->recording == NULL) {
+			JANUS_LOG(LOG_VERB, "Starting recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
+			janus_audiobridge_recording_start(audiobridge);
 		}
-		if(!g_atomic_int_get(&audiobridge->record) && g_atomic_int_get(&audiobridge->wav_header_added)) {
-			JANUS_LOG(LOG_VERB, "Updating WAV header for recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
-			janus_audiobridge_update_wav_header(audiobridge);
+		if(!g_atomic_int_get(&audiobridge->record) && audiobridge->recording != NULL) {
+			JANUS_LOG(LOG_VERB, "Stopping recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
+			janus_audiobridge_recording_stop(audiobridge);
 		}
 		/* Update the reference time */
 		before.tv_usec += 20000;
@@ -7915,6 +8958,7 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			before.tv_sec++;
 			before.tv_usec -= 1000000;
 		}
+		gint64 tick_start = janus_get_monotonic_time();
 		/* Do we need to mix at all? */
 		janus_mutex_lock_nodebug(&audiobridge->mutex);
 		count = g_hash_table_size(audiobridge->participants);
@@ -7936,6 +8980,12 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		/* Update RTP header information */
 		seq++;
 		ts += OPUS_SAMPLES;
+		mix_ticks++;
+		mixer->seq = seq;
+		mixer->ts = ts;
+		mixer->mix_ticks = mix_ticks;
+		if(mixer->shared_encoders != NULL && (mix_ticks % 50) == 0)
+			g_hash_table_foreach_remove(mixer->shared_encoders, janus_audiobridge_shared_encoder_unused, GUINT_TO_POINTER(mix_ticks));
 		/* Mix all contributions */
 		GList *participants_list = g_hash_table_get_values(audiobridge->participants);
 		/* Add a reference to all these participants, in case some leave while we're mixing */
@@ -7954,131 +9004,44 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			ps = ps->next;
 		}
 		janus_mutex_unlock_nodebug(&audiobridge->mutex);
+		/* If only the loudest participants are mixed, check who they are */
+		if(audiobridge->mix_speakers > 0 && (mix_ticks % SPEAKERS_SELECTION_TICKS) == 1)
+			janus_audiobridge_select_speakers(audiobridge, participants_list, speakers);
 		for(i=0; i<samples; i++)
 			buffer[i] = 0;
 		if(groups_num > 0)
 			memset(groupBuffers, 0, groupBuffersSize);
+		/* Split the participants in shards, if there are enough of them, and
+		 * get the next frame of each participant from their jitter buffer */
+		guint participants_num = g_list_length(participants_list);
+		shards_num = MIN(shards_max, MAX(1, participants_num/JANUS_AUDIOBRIDGE_MIN_MIX_SHARD));
+		g_ptr_array_set_size(mixer->frames, 0);
+		g_ptr_array_set_size(mixer->frames, participants_num);
 		ps = participants_list;
-		while(ps) {
-			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
-			janus_mutex_lock(&p->qmutex);
-			if(g_atomic_int_get(&p->destroyed) || !p->session || !g_atomic_int_get(&p->session->started) || !g_atomic_int_get(&p->active) || p->muted || p->prebuffering || !p->inbuf) {
-				janus_mutex_unlock(&p->qmutex);
+		guint offset = 0;
+		for(index=0; index<shards_num; index++) {
+			janus_audiobridge_mix_shard *shard = &mixer->shards[index];
+			shard->participants = ps;
+			shard->offset = offset;
+			shard->num = (participants_num*(index+1))/shards_num - offset;
+			offset += shard->num;
+			for(i=0; i<(int)shard->num; i++)
 				ps = ps->next;
-				continue;
+			if(shards_num == 1) {
+				/* No need for partial mixes, mix directly */
+				shard->partial = (groups_num == 0 ? buffer : groupBuffers);
+			} else {
+				shard->partial = partials[index];
+				memset(shard->partial, 0, (groups_num > 0 ? groups_num : 1) * samples * sizeof(opus_int32));
 			}
-			GList *peek = g_list_first(p->inbuf);
-			janus_audiobridge_rtp_relay_packet *pkt = (janus_audiobridge_rtp_relay_packet *)(peek ? peek->data : NULL);
-			if(pkt != NULL && !pkt->silence) {
-				if(p->codec != JANUS_AUDIOCODEC_OPUS && audiobridge->sampling_rate != 8000) {
-					/* Upsample this to whatever the mixer needs */
-					pkt->length = janus_audiobridge_resample((opus_int16 *)pkt->data, 160, 8000, resampled, audiobridge->sampling_rate);
-					if(pkt->length == 0) {
-						JANUS_LOG(LOG_WARN, "[G.711] Error upsampling to %d, skipping audio packet\n", audiobridge->sampling_rate);
-						janus_mutex_unlock(&p->qmutex);
-						ps = ps->next;
-						continue;
-					}
-					memcpy(pkt->data, resampled, pkt->length*2);
-				}
-				curBuffer = (opus_int16 *)pkt->data;
-				if(groups_num == 0) {
-					/* Add to the main mix */
-					if(!p->stereo) {
-						for(i=0; i<samples; i++) {
-							if(p->volume_gain == 100) {
-								buffer[i] += curBuffer[i];
-							} else {
-								buffer[i] += (curBuffer[i]*p->volume_gain)/100;
-							}
-						}
-					} else {
-						diff = 50 - p->spatial_position;
-						lgain = 50 + diff;
-						rgain = 50 - diff;
-						for(i=0; i<samples; i++) {
-							if(i%2 == 0) {
-								if(lgain == 100) {
-									if(p->volume_gain == 100) {
-										buffer[i] += curBuffer[i];
-									} else {
-										buffer[i] += (curBuffer[i]*p->volume_gain)/100;
-									}
-								} else {
-									if(p->volume_gain == 100) {
-										buffer[i] += (curBuffer[i]*lgain)/100;
-									} else {
-										buffer[i] += (((curBuffer[i]*lgain)/100)*p->volume_gain)/100;
-									}
-								}
-							} else {
-								if(rgain == 100) {
-									if(p->volume_gain == 100) {
-										buffer[i] += curBuffer[i];
-									} else {
-										buffer[i] += (curBuffer[i]*p->volume_gain)/100;
-									}
-								} else {
-									if(p->volume_gain == 100) {
-										buffer[i] += (curBuffer[i]*rgain)/100;
-									} else {
-										buffer[i] += (((curBuffer[i]*rgain)/100)*p->volume_gain)/100;
-									}
-								}
-							}
-						}
-					}
-				} else {
-					/* Add to the group submix */
-					int index = p->group-1;
-					if(!p->stereo) {
-						for(i=0; i<samples; i++) {
-							if(p->volume_gain == 100) {
-								*(groupBuffers + index*samples + i) += curBuffer[i];
-							} else {
-								*(groupBuffers + index*samples + i) += (curBuffer[i]*p->volume_gain)/100;
-							}
-						}
-					} else {
-						diff = 50 - p->spatial_position;
-						lgain = 50 + diff;
-						rgain = 50 - diff;
-						for(i=0; i<samples; i++) {
-							if(i%2 == 0) {
-								if(lgain == 100) {
-									if(p->volume_gain == 100) {
-										*(groupBuffers + index*samples + i) += curBuffer[i];
-									} else {
-										*(groupBuffers + index*samples + i) += (curBuffer[i]*p->volume_gain)/100;
-									}
-								} else {
-									if(p->volume_gain == 100) {
-										*(groupBuffers + index*samples + i) += (curBuffer[i]*lgain)/100;
-									} else {
-										*(groupBuffers + index*samples + i) += (((curBuffer[i]*lgain)/100)*p->volume_gain)/100;
-									}
-								}
-							} else {
-								if(rgain == 100) {
-									if(p->volume_gain == 100) {
-										*(groupBuffers + index*samples + i) += curBuffer[i];
-									} else {
-										*(groupBuffers + index*samples + i) += (curBuffer[i]*p->volume_gain)/100;
-									}
-								} else {
-									if(p->volume_gain == 100) {
-										*(groupBuffers + index*samples + i) += (curBuffer[i]*rgain)/100;
-									} else {
-										*(groupBuffers + index*samples + i) += (((curBuffer[i]*rgain)/100)*p->volume_gain)/100;
-									}
-								}
-							}
-						}
-					}
-				}
+		}
+		janus_audiobridge_mix_shards_run(mixer, shards_num, FALSE);
+		if(shards_num > 1) {
+			/* Put the partial mixes of all shards together */
+			for(index=0; index<shards_num; index++) {
+				janus_audiobridge_mix->add(groups_num == 0 ? buffer : groupBuffers,
+					mixer->shards[index].partial, (groups_num > 0 ? groups_num : 1) * samples);
 			}
-			janus_mutex_unlock(&p->qmutex);
-			ps = ps->next;
 		}
 #ifdef HAVE_LIBOGG
 		/* If there are announcements playing, mix those too */
@@ -8143,26 +9106,10 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 						gateway->notify_event(&janus_audiobridge_plugin, NULL, info);
 					}
 				}
-				if(groups_num == 0) {
-					/* Add to the main mix */
-					for(i=0; i<samples; i++) {
-						if(p->volume_gain == 100) {
-							buffer[i] += resampled[i];
-						} else {
-							buffer[i] += (resampled[i]*p->volume_gain)/100;
-						}
-					}
-				} else {
-					/* Add to the group submix */
-					index = p->group-1;
-					for(i=0; i<samples; i++) {
-						if(p->volume_gain == 100) {
-							*(groupBuffers + index*samples + i) += resampled[i];
-						} else {
-							*(groupBuffers + index*samples + i) += (resampled[i]*p->volume_gain)/100;
-						}
-					}
-				}
+				/* Add to the main mix, or to the group submix */
+				float gain = (p->volume_gain == 100 ? 1.0f : (float)p->volume_gain/100.0f);
+				janus_audiobridge_mix->accumulate(groups_num == 0 ? buffer : (groupBuffers + (p->group-1)*samples),
+					resampled, samples, gain, gain);
 				ps = ps->next;
 			}
 			g_list_free_full(anncs_list, (GDestroyNotify)janus_audiobridge_participant_unref);
@@ -8171,120 +9118,32 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 		/* If groups are in use, put them together in the main mix */
 		if(groups_num > 0) {
 			/* Mix all submixes */
-			for(index=0; index<groups_num; index++) {
-				for(i=0; i<samples; i++)
-					buffer[i] += *(groupBuffers + index*samples + i);
-			}
+			for(index=0; index<groups_num; index++)
+				janus_audiobridge_mix->add(buffer, groupBuffers + index*samples, samples);
 		}
 		/* Are we recording the mix? (only do it if there's someone in, though...) */
-		if(audiobridge->recording != NULL && g_list_length(participants_list) > 0) {
-			for(i=0; i<samples; i++) {
-				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = buffer[i];
-			}
-			fwrite(outBuffer, sizeof(opus_int16), samples, audiobridge->recording);
-			/* Every 5 seconds we update the wav header */
-			gint64 now = janus_get_monotonic_time();
-			if(now - audiobridge->record_lastupdate >= 5*G_USEC_PER_SEC) {
-				audiobridge->record_lastupdate = now;
-				/* Update the length in the header */
-				fseek(audiobridge->recording, 0, SEEK_END);
-				long int size = ftell(audiobridge->recording);
-				if(size >= 8) {
-					size -= 8;
-					fseek(audiobridge->recording, 4, SEEK_SET);
-					fwrite(&size, sizeof(uint32_t), 1, audiobridge->recording);
-					size += 8;
-					fseek(audiobridge->recording, 40, SEEK_SET);
-					fwrite(&size, sizeof(uint32_t), 1, audiobridge->recording);
-					fflush(audiobridge->recording);
-					fseek(audiobridge->recording, 0, SEEK_END);
-				}
+		if(audiobridge->recording != NULL && participants_num > 0) {
+			/* FIXME Smoothen/Normalize instead of saturating? */
+			janus_audiobridge_mix->pack(outBuffer, buffer, samples);
+			/* This only queues the frame: a separate thread writes it to disk */
+			if(!janus_audiobridge_rec_write(audiobridge->recording, outBuffer, samples)) {
+				JANUS_LOG(LOG_HUGE, "[%s] Recorder is falling behind, dropped a frame of the mix\n", audiobridge->room_id_str);
 			}
 		}
 		/* Send proper packet to each participant (remove own contribution) */
-		ps = participants_list;
-		while(ps) {
-			janus_audiobridge_participant *p = (janus_audiobridge_participant *)ps->data;
-			if(g_atomic_int_get(&p->destroyed) || !p->session || !g_atomic_int_get(&p->session->started)) {
-				janus_refcount_decrease(&p->ref);
-				ps = ps->next;
-				continue;
-			}
-			janus_audiobridge_rtp_relay_packet *pkt = NULL;
-			janus_mutex_lock(&p->qmutex);
-			if(g_atomic_int_get(&p->active) && !p->muted && !p->prebuffering && p->inbuf) {
-				GList *first = g_list_first(p->inbuf);
-				pkt = (janus_audiobridge_rtp_relay_packet *)(first ? first->data : NULL);
-				p->inbuf = g_list_delete_link(p->inbuf, first);
-			}
-			janus_mutex_unlock(&p->qmutex);
-			/* Remove the participant's own contribution */
-			curBuffer = (opus_int16 *)((pkt && pkt->length && !pkt->silence) ? pkt->data : NULL);
-			if(!p->stereo) {
-				for(i=0; i<samples; i++) {
-					if(p->volume_gain == 100)
-						sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-					else
-						sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*p->volume_gain)/100 : 0);
-				}
-			} else {
-				diff = 50 - p->spatial_position;
-				lgain = 50 + diff;
-				rgain = 50 - diff;
-				for(i=0; i<samples; i++) {
-					if(i%2 == 0) {
-						if(lgain == 100) {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-						} else {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*lgain)/100 : 0);
-						}
-					} else {
-						if(rgain == 100) {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]) : 0);
-						} else {
-							sumBuffer[i] = buffer[i] - (curBuffer ? (curBuffer[i]*rgain)/100 : 0);
-						}
-					}
-				}
-			}
-			for(i=0; i<samples; i++)
-				/* FIXME Smoothen/Normalize instead of truncating? */
-				outBuffer[i] = sumBuffer[i];
-			/* Enqueue this mixed frame for encoding in the participant thread */
-			janus_audiobridge_rtp_relay_packet *mixedpkt = g_malloc(sizeof(janus_audiobridge_rtp_relay_packet));
-			mixedpkt->data = g_malloc(samples*2);
-			if(p->codec != JANUS_AUDIOCODEC_OPUS && audiobridge->sampling_rate != 8000) {
-				/* Downsample this from whatever the mixer uses */
-				i = janus_audiobridge_resample(outBuffer, samples, audiobridge->sampling_rate, (int16_t *)mixedpkt->data, 8000);
-				if(i == 0) {
-					JANUS_LOG(LOG_WARN, "[G.711] Error downsampling from %d, skipping audio packet\n", audiobridge->sampling_rate);
-					g_free(mixedpkt->data);
-					g_free(mixedpkt);
-					janus_refcount_decrease(&p->ref);
-					ps = ps->next;
-					continue;
-				}
-			} else {
-				/* Just copy */
-				memcpy(mixedpkt->data, outBuffer, samples*2);
-			}
-			mixedpkt->length = samples;	/* We set the number of samples here, not the data length */
-			mixedpkt->timestamp = ts;
-			mixedpkt->seq_number = seq;
-			mixedpkt->ssrc = audiobridge->room_ssrc;
-			mixedpkt->silence = FALSE;
-			g_async_queue_push(p->outbuf, mixedpkt);
-			if(pkt) {
-				g_free(pkt->data);
-				pkt->data = NULL;
-				g_free(pkt);
-				pkt = NULL;
-			}
-			janus_refcount_decrease(&p->ref);
-			ps = ps->next;
+		janus_audiobridge_encode_tick *tick = NULL;
+		if(encoders != NULL) {
+			/* Keep track of how long it takes the pool to encode this tick */
+			tick = g_malloc(sizeof(janus_audiobridge_encode_tick));
+			janus_refcount_increase(&audiobridge->ref);
+			tick->room = audiobridge;
+			tick->started = tick_start;
+			g_atomic_int_set(&tick->pending, 1);
 		}
+		mixer->tick = tick;
+		janus_audiobridge_mix_shards_run(mixer, shards_num, TRUE);
 		g_list_free(participants_list);
+		janus_audiobridge_encode_tick_done(tick);
 		/* Forward the mixed packet as RTP to any RTP forwarder that may be listening */
 		janus_mutex_lock(&audiobridge->rtp_mutex);
 		if(g_hash_table_size(audiobridge->rtp_forwarders) > 0 && audiobridge->rtp_encoder) {
@@ -8308,16 +9167,17 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			if(go_on) {
 				/* By default, let's send the mixed frame to everybody */
 				if(groups_num == 0) {
-					for(i=0; i<samples; i++)
-						outBuffer[i] = buffer[i];
+					janus_audiobridge_mix->pack(outBuffer, buffer, samples);
 					have_opus[0] = FALSE;
 					have_alaw[0] = FALSE;
 					have_ulaw[0] = FALSE;
+					have_8k[0] = FALSE;
 				} else {
 					for(index=0; index <= groups_num; index++) {
 						have_opus[index] = FALSE;
 						have_alaw[index] = FALSE;
 						have_ulaw[index] = FALSE;
+						have_8k[index] = FALSE;
 					}
 				}
 				GHashTableIter iter;
@@ -8333,13 +9193,11 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 					if(groups_num > 0) {
 						if(rfm->group == 0) {
 							/* We're forwarding the main mix */
-							for(i=0; i<samples; i++)
-								outBuffer[i] = buffer[i];
+							janus_audiobridge_mix->pack(outBuffer, buffer, samples);
 						} else {
 							/* We're forwarding a group mix */
 							index = rfm->group-1;
-							for(i=0; i<samples; i++)
-								outBuffer[i] = *(groupBuffers + index*samples + i);
+							janus_audiobridge_mix->pack(outBuffer, groupBuffers + index*samples, samples);
 						}
 					}
 					if(rfm->codec == JANUS_AUDIOCODEC_OPUS) {
@@ -8363,27 +9221,29 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 						if((rfm->codec == JANUS_AUDIOCODEC_PCMA && !have_alaw[rfm->group]) ||
 								(rfm->codec == JANUS_AUDIOCODEC_PCMU && !have_ulaw[rfm->group])) {
 							/* We don't, encode now */
-							if(audiobridge->sampling_rate != 8000) {
-								/* Downsample this from whatever the mixer uses */
-								i = janus_audiobridge_resample(outBuffer, samples, audiobridge->sampling_rate, resampled, 8000);
+							opus_int16 *rtp8k = mix8k + rfm->group*samples;
+							if(!have_8k[rfm->group]) {
+								/* Downsample this from whatever the mixer uses: we only do
+								 * this once per tick, as the resampler keeps the history of
+								 * the mix, and both A-law and mu-law forwarders use it */
+								i = janus_audiobridge_resampler_process(resamplers8k[rfm->group], outBuffer, samples,
+									audiobridge->sampling_rate, rtp8k, 8000);
 								if(i == 0) {
 									JANUS_LOG(LOG_WARN, "[G.711] Error downsampling from %d, skipping audio packet\n", audiobridge->sampling_rate);
 									continue;
 								}
-							} else {
-								/* Just copy */
-								memcpy(resampled, outBuffer, samples*2);
+								have_8k[rfm->group] = TRUE;
 							}
 							int i = 0;
 							if(rfm->codec == JANUS_AUDIOCODEC_PCMA) {
 								uint8_t *rtpalaw_buffer = rtpalaw + rfm->group*G711_SAMPLES + 12;
 								for(i=0; i<160; i++)
-									rtpalaw_buffer[i] = janus_audiobridge_g711_alaw_encode(resampled[i]);
+									rtpalaw_buffer[i] = janus_audiobridge_g711_alaw_encode(rtp8k[i]);
 								have_alaw[rfm->group] = TRUE;
 							} else {
 								uint8_t *rtpulaw_buffer = rtpulaw + rfm->group*G711_SAMPLES + 12;
 								for(i=0; i<160; i++)
-									rtpulaw_buffer[i] = janus_audiobridge_g711_ulaw_encode(resampled[i]);
+									rtpulaw_buffer[i] = janus_audiobridge_g711_ulaw_encode(rtp8k[i]);
 								have_ulaw[rfm->group] = TRUE;
 							}
 						}
@@ -8403,16 +9263,45 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 			}
 		}
 		janus_mutex_unlock(&audiobridge->rtp_mutex);
+		/* Take note of how long it took us to prepare this tick */
+		gint64 mixing_time = janus_get_monotonic_time() - tick_start;
+		janus_mutex_lock_nodebug(&audiobridge->encoding_mutex);
+		audiobridge->mixing_time[audiobridge->mixing_index] = mixing_time;
+		audiobridge->mixing_index = (audiobridge->mixing_index + 1) % JANUS_AUDIOBRIDGE_ENCODING_SAMPLES;
+		if(audiobridge->mixing_samples < JANUS_AUDIOBRIDGE_ENCODING_SAMPLES)
+			audiobridge->mixing_samples++;
+		audiobridge->mixing_ticks++;
+		if(mixing_time > 20000) {
+			audiobridge->mixing_overruns++;
+			JANUS_LOG(LOG_HUGE, "[%s] Mixer tick took %"SCNi64"us (%u participants, %u shards)\n",
+				audiobridge->room_id_str, mixing_time, participants_num, shards_num);
+		}
+		janus_mutex_unlock_nodebug(&audiobridge->encoding_mutex);
 	}
 	/* Close the recording file */
-	if(audiobridge->recording != NULL && g_atomic_int_get(&audiobridge->wav_header_added)) {
-		JANUS_LOG(LOG_VERB, "Update wave header for recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
-		janus_audiobridge_update_wav_header(audiobridge);
+	if(audiobridge->recording != NULL) {
+		JANUS_LOG(LOG_VERB, "Stopping recording %s (%s)...\n", audiobridge->room_id_str, audiobridge->room_name);
+		janus_audiobridge_recording_stop(audiobridge);
 	}
 	g_free(rtpbuffer);
 	g_free(rtpalaw);
 	g_free(rtpulaw);
+	g_free(mix8k);
+	for(index=0; index <= groups_num; index++)
+		janus_audiobridge_resampler_destroy(resamplers8k[index]);
 	g_free(groupBuffers);
+	g_array_free(speakers, TRUE);
+	if(mixer->pool != NULL)
+		g_thread_pool_free(mixer->pool, FALSE, TRUE);
+	for(index=0; index<shards_max; index++)
+		g_free(partials[index]);
+	g_ptr_array_free(mixer->frames, TRUE);
+	if(mixer->shared_encoders != NULL)
+		g_hash_table_destroy(mixer->shared_encoders);
+	janus_mutex_destroy(&mixer->shared_mutex);
+	janus_mutex_destroy(&mixer->mutex);
+	janus_condition_destroy(&mixer->cond);
+	g_free(mixer);
 	if(groupEncoders) {
 		for(index=0; index<groups_num; index++) {
 			if(groupEncoders[index])
@@ -8428,6 +9317,82 @@ static void *janus_audiobridge_mixer_thread(void *data) {
 }
 
 /* Thread to encode a mixed frame and send it to a specific participant */
+/* Helper to encode a mixed frame for a participant, and send it */
+static void janus_audiobridge_participant_encode(janus_audiobridge_participant *participant,
+		janus_audiobridge_rtp_relay_packet *mixedpkt, janus_audiobridge_rtp_relay_packet *outpkt) {
+	janus_audiobridge_session *session = participant->session;
+	if(mixedpkt == NULL || g_atomic_int_get(&session->destroyed) || !g_atomic_int_get(&session->started))
+		return;
+	uint8_t *payload = (uint8_t *)outpkt->data;
+	if(g_atomic_int_get(&participant->active) && (participant->codec == JANUS_AUDIOCODEC_PCMA ||
+			participant->codec == JANUS_AUDIOCODEC_PCMU) && g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
+		/* Encode using G.711 */
+		if(mixedpkt->length != 320) {
+			/* TODO Resample */
+		}
+		int i = 0;
+		opus_int16 *outBuffer = (opus_int16 *)mixedpkt->data;
+		if(participant->codec == JANUS_AUDIOCODEC_PCMA) {
+			/* A-law */
+			for(i=0; i<160; i++)
+				*(payload+12+i) = janus_audiobridge_g711_alaw_encode(outBuffer[i]);
+		} else {
+			/* Mu-Law */
+			for(i=0; i<160; i++)
+				*(payload+12+i) = janus_audiobridge_g711_ulaw_encode(outBuffer[i]);
+		}
+		g_atomic_int_set(&participant->encoding, 0);
+		outpkt->length = 172;	/* Take the RTP header into consideration */
+		/* Update RTP header */
+		outpkt->data->version = 2;
+		outpkt->data->markerbit = 0;	/* FIXME Should be 1 for the first packet */
+		outpkt->data->seq_number = htons(mixedpkt->seq_number);
+		outpkt->data->timestamp = htonl(mixedpkt->timestamp/6);
+		outpkt->data->ssrc = htonl(mixedpkt->ssrc);	/* The Janus core will fix this anyway */
+		/* Backup the actual timestamp and sequence number set by the audiobridge, in case a room is changed */
+		outpkt->ssrc = mixedpkt->ssrc;
+		outpkt->timestamp = mixedpkt->timestamp/6;
+		outpkt->seq_number = mixedpkt->seq_number;
+		janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
+	} else if(g_atomic_int_get(&participant->active) && participant->encoder &&
+			g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
+		if(mixedpkt->encoded) {
+			/* The mixer encoded this frame already, just copy it */
+			memcpy(payload+12, mixedpkt->shared->payload, mixedpkt->length);
+			outpkt->length = mixedpkt->length;
+			participant->shared_encoded = TRUE;
+		} else {
+			/* If we were getting frames from a shared encoder until now (e.g.,
+			 * because we were muted), our own encoder state is stale: reset it */
+			if(participant->shared_encoded) {
+				opus_encoder_ctl(participant->encoder, OPUS_RESET_STATE);
+				participant->shared_encoded = FALSE;
+			}
+			/* Encode raw frame to Opus */
+			opus_int16 *outBuffer = (opus_int16 *)mixedpkt->data;
+			outpkt->length = opus_encode(participant->encoder, outBuffer,
+				participant->stereo ? mixedpkt->length/2 : mixedpkt->length, payload+12, 1500-12);
+		}
+		g_atomic_int_set(&participant->encoding, 0);
+		if(outpkt->length < 0) {
+			JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the Opus frame: %d (%s)\n", outpkt->length, opus_strerror(outpkt->length));
+		} else {
+			outpkt->length += 12;	/* Take the RTP header into consideration */
+			/* Update RTP header */
+			outpkt->data->version = 2;
+			outpkt->data->markerbit = 0;	/* FIXME Should be 1 for the first packet */
+			outpkt->data->seq_number = htons(mixedpkt->seq_number);
+			outpkt->data->timestamp = htonl(mixedpkt->timestamp);
+			outpkt->data->ssrc = htonl(mixedpkt->ssrc);	/* The Janus core will fix this anyway */
+			/* Backup the actual timestamp and sequence number set by the audiobridge, in case a room is changed */
+			outpkt->ssrc = mixedpkt->ssrc;
+			outpkt->timestamp = mixedpkt->timestamp;
+			outpkt->seq_number = mixedpkt->seq_number;
+			janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
+		}
+	}
+}
+
 static void *janus_audiobridge_participant_thread(void *data) {
 	JANUS_LOG(LOG_VERB, "AudioBridge Participant thread starting...\n");
 	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
@@ -8448,73 +9413,15 @@ static void *janus_audiobridge_participant_thread(void *data) {
 	outpkt->seq_number = 0;
 	outpkt->length = 0;
 	outpkt->silence = FALSE;
-	uint8_t *payload = (uint8_t *)outpkt->data;
+	outpkt->batch = NULL;
 
 	janus_audiobridge_rtp_relay_packet *mixedpkt = NULL;
 
 	/* Start working: check the outgoing queue for packets, then encode and send them */
 	while(!g_atomic_int_get(&stopping) && g_atomic_int_get(&session->destroyed) == 0) {
 		mixedpkt = g_async_queue_timeout_pop(participant->outbuf, 100000);
-		if(mixedpkt != NULL && g_atomic_int_get(&session->destroyed) == 0 && g_atomic_int_get(&session->started)) {
-			if(g_atomic_int_get(&participant->active) && (participant->codec == JANUS_AUDIOCODEC_PCMA ||
-					participant->codec == JANUS_AUDIOCODEC_PCMU) && g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
-				/* Encode using G.711 */
-				if(mixedpkt->length != 320) {
-					/* TODO Resample */
-				}
-				int i = 0;
-				opus_int16 *outBuffer = (opus_int16 *)mixedpkt->data;
-				if(participant->codec == JANUS_AUDIOCODEC_PCMA) {
-					/* A-law */
-					for(i=0; i<160; i++)
-						*(payload+12+i) = janus_audiobridge_g711_alaw_encode(outBuffer[i]);
-				} else {
-					/* Mu-Law */
-					for(i=0; i<160; i++)
-						*(payload+12+i) = janus_audiobridge_g711_ulaw_encode(outBuffer[i]);
-				}
-				g_atomic_int_set(&participant->encoding, 0);
-				outpkt->length = 172;	/* Take the RTP header into consideration */
-				/* Update RTP header */
-				outpkt->data->version = 2;
-				outpkt->data->markerbit = 0;	/* FIXME Should be 1 for the first packet */
-				outpkt->data->seq_number = htons(mixedpkt->seq_number);
-				outpkt->data->timestamp = htonl(mixedpkt->timestamp/6);
-				outpkt->data->ssrc = htonl(mixedpkt->ssrc);	/* The Janus core will fix this anyway */
-				/* Backup the actual timestamp and sequence number set by the audiobridge, in case a room is changed */
-				outpkt->ssrc = mixedpkt->ssrc;
-				outpkt->timestamp = mixedpkt->timestamp/6;
-				outpkt->seq_number = mixedpkt->seq_number;
-				janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
-			} else if(g_atomic_int_get(&participant->active) && participant->encoder &&
-					g_atomic_int_compare_and_exchange(&participant->encoding, 0, 1)) {
-				/* Encode raw frame to Opus */
-				opus_int16 *outBuffer = (opus_int16 *)mixedpkt->data;
-				outpkt->length = opus_encode(participant->encoder, outBuffer,
-					participant->stereo ? mixedpkt->length/2 : mixedpkt->length, payload+12, 1500-12);
-				g_atomic_int_set(&participant->encoding, 0);
-				if(outpkt->length < 0) {
-					JANUS_LOG(LOG_ERR, "[Opus] Ops! got an error encoding the Opus frame: %d (%s)\n", outpkt->length, opus_strerror(outpkt->length));
-				} else {
-					outpkt->length += 12;	/* Take the RTP header into consideration */
-					/* Update RTP header */
-					outpkt->data->version = 2;
-					outpkt->data->markerbit = 0;	/* FIXME Should be 1 for the first packet */
-					outpkt->data->seq_number = htons(mixedpkt->seq_number);
-					outpkt->data->timestamp = htonl(mixedpkt->timestamp);
-					outpkt->data->ssrc = htonl(mixedpkt->ssrc);	/* The Janus core will fix this anyway */
-					/* Backup the actual timestamp and sequence number set by the audiobridge, in case a room is changed */
-					outpkt->ssrc = mixedpkt->ssrc;
-					outpkt->timestamp = mixedpkt->timestamp;
-					outpkt->seq_number = mixedpkt->seq_number;
-					janus_audiobridge_relay_rtp_packet(participant->session, outpkt);
-				}
-			}
-		}
-		if(mixedpkt) {
-			g_free(mixedpkt->data);
-			g_free(mixedpkt);
-		}
+		janus_audiobridge_participant_encode(participant, mixedpkt, outpkt);
+		janus_audiobridge_mixed_packet_free(mixedpkt);
 	}
 	/* We're done, get rid of the resources */
 	g_free(outpkt->data);
@@ -8527,6 +9434,47 @@ static void *janus_audiobridge_participant_thread(void *data) {
 	return NULL;
 }
 
+/* Encoding task, if a pool of encoders is used: each participant is only
+ * scheduled once at a time, which means frames are encoded in order */
+static void janus_audiobridge_encoder_task(gpointer data, gpointer user_data) {
+	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
+	janus_audiobridge_session *session = participant->session;
+	/* Output buffer */
+	char buffer[1500];
+	memset(buffer, 0, 12);
+	janus_audiobridge_rtp_relay_packet outpkt = { 0 };
+	outpkt.data = (janus_rtp_header *)buffer;
+	janus_audiobridge_rtp_relay_packet *mixedpkt = NULL;
+	while(TRUE) {
+		/* If the task fell behind, there may be several frames to send: in
+		 * that case we pass them to the core all at once, when we're done */
+		if(gateway != NULL && g_async_queue_length(participant->outbuf) > 1)
+			outpkt.batch = janus_plugin_rtp_batch_get(gateway);
+		while((mixedpkt = g_async_queue_try_pop(participant->outbuf)) != NULL) {
+			if(!g_atomic_int_get(&stopping))
+				janus_audiobridge_participant_encode(participant, mixedpkt, &outpkt);
+			janus_audiobridge_mixed_packet_free(mixedpkt);
+		}
+		janus_plugin_rtp_batch_flush(outpkt.batch);
+		outpkt.batch = NULL;
+		g_atomic_int_set(&participant->encoder_scheduled, 0);
+		/* Make sure we didn't miss a frame queued in the meanwhile */
+		if(g_async_queue_length(participant->outbuf) == 0 ||
+				!g_atomic_int_compare_and_exchange(&participant->encoder_scheduled, 0, 1))
+			break;
+	}
+	janus_refcount_decrease(&participant->ref);
+	janus_refcount_decrease(&session->ref);
+}
+
+static void janus_audiobridge_encoder_schedule(janus_audiobridge_participant *participant) {
+	if(encoders == NULL || !g_atomic_int_compare_and_exchange(&participant->encoder_scheduled, 0, 1))
+		return;
+	janus_refcount_increase(&participant->session->ref);
+	janus_refcount_increase(&participant->ref);
+	g_thread_pool_push(encoders, participant, NULL);
+}
+
 static void janus_audiobridge_relay_rtp_packet(gpointer data, gpointer user_data) {
 	janus_audiobridge_rtp_relay_packet *packet = (janus_audiobridge_rtp_relay_packet *)user_data;
 	if(!packet || !packet->data || packet->length < 1) {
@@ -8563,7 +9511,10 @@ static void janus_audiobridge_relay_rtp_packet(gpointer data, gpointer user_data
 		janus_plugin_rtp rtp = { .mindex = -1, .video = FALSE, .buffer = (char *)packet->data, .length = packet->length };
 		janus_plugin_rtp_extensions_reset(&rtp.extensions);
 		/* FIXME Should we add our own audio level extension? */
-		gateway->relay_rtp(session->handle, &rtp);
+		if(packet->batch != NULL)
+			janus_plugin_rtp_batch_add(packet->batch, session->handle, &rtp);
+		else
+			gateway->relay_rtp(session->handle, &rtp);
 	}
 	/* Restore the timestamp and sequence number to what the mixer set them to */
 	packet->data->timestamp = htonl(packet->timestamp);
@@ -8651,6 +9602,64 @@ static int janus_audiobridge_plainrtp_allocate_port(janus_audiobridge_plainrtp_m
 	}
 	return -1;
 }
+/* Helper to read as many RTP packets as are available (up to the batch size): returns how many we got, or -1 in case of errors */
+static int janus_audiobridge_recv_batch_read(janus_audiobridge_recv_batch *batch, int fd) {
+	int num = 0;
+#ifdef HAVE_RECVMMSG
+	int i = 0;
+	for(i=0; i<JANUS_AUDIOBRIDGE_RECV_BATCH; i++) {
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = sizeof(batch->data[i]);
+		memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+		batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* We were told there's something, so this won't block for the first
+	 * packet: the others are only read if they're already there */
+	num = recvmmsg(fd, batch->messages, JANUS_AUDIOBRIDGE_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(num < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	for(i=0; i<num; i++)
+		batch->length[i] = batch->messages[i].msg_len;
+#else
+	batch->length[0] = recvfrom(fd, batch->data[0], sizeof(batch->data[0]), MSG_DONTWAIT, NULL, NULL);
+	if(batch->length[0] < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	num = 1;
+#endif
+	return num;
+}
+
+/* Helper to handle an RTP packet coming from a plain RTP participant: returns TRUE if it was RTP */
+static gboolean janus_audiobridge_plainrtp_incoming(janus_audiobridge_participant *participant,
+		char *buffer, int bytes, gboolean *first) {
+	janus_audiobridge_session *session = participant->session;
+	/* Audio RTP */
+	if(!janus_is_rtp(buffer, bytes)) {
+		/* Not an RTP packet? */
+		return FALSE;
+	}
+	/* If this is the first packet we receive, simulate a setup_media event */
+	if(*first) {
+		*first = FALSE;
+		janus_audiobridge_setup_media(session->handle);
+	}
+	/* Handle the packet */
+	rtp_header *header = (rtp_header *)buffer;
+	if(participant->plainrtp_media.audio_ssrc_peer != ntohl(header->ssrc)) {
+		participant->plainrtp_media.audio_ssrc_peer = ntohl(header->ssrc);
+		JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Got peer audio SSRC: %"SCNu32"\n",
+			session, participant->plainrtp_media.audio_ssrc_peer);
+	}
+	/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+	janus_rtp_header_update(header, &participant->plainrtp_media.context, FALSE, 0);
+	/* Handle as a WebRTC RTP packet */
+	janus_plugin_rtp packet = { .video = FALSE, .buffer = buffer, .length = bytes };
+	janus_plugin_rtp_extensions_reset(&packet.extensions);
+	janus_audiobridge_incoming_rtp(session->handle, &packet);
+	return TRUE;
+}
+
 /* Thread to relay RTP/RTCP frames coming from the peer */
 static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
 	janus_audiobridge_participant *participant = (janus_audiobridge_participant *)data;
@@ -8663,21 +9672,14 @@ static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
 	JANUS_LOG(LOG_INFO, "[AudioBridge-%p] Starting Plain RTP participant thread\n", session);
 
 	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_storage remote = { 0 };
-	int resfd = 0, bytes = 0, pollerrs = 0;
+	int resfd = 0, pollerrs = 0;
 	struct pollfd fds[2];
 	int pipe_fd = participant->plainrtp_media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
+	janus_audiobridge_recv_batch *batch = g_malloc0(sizeof(janus_audiobridge_recv_batch));
 	/* Loop */
 	int num = 0;
 	gboolean first = TRUE, goon = TRUE;
 
-	/* Fake RTP packet */
-	janus_plugin_rtp packet = { .video = FALSE, .buffer = buffer, .length = 0 };
-	janus_plugin_rtp_extensions_reset(&packet.extensions);
-
 	while(goon && session != NULL && !g_atomic_int_get(&session->destroyed) && !g_atomic_int_get(&session->hangingup)) {
 		/* Prepare poll */
 		num = 0;
@@ -8709,7 +9711,7 @@ static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
 		}
 		if(session == NULL || g_atomic_int_get(&session->destroyed))
 			break;
-		int i = 0;
+		int i = 0, j = 0;
 		for(i=0; i<num; i++) {
 			if(fds[i].revents & (POLLERR | POLLHUP)) {
 				/* Check the socket error */
@@ -8739,40 +9741,17 @@ static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
 					(void)read(pipe_fd, &code, sizeof(int));
 					break;
 				}
-				/* Got an RTP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Audio RTP */
-				if(!janus_is_rtp(buffer, bytes)) {
-					/* Not an RTP packet? */
-					continue;
-				}
-				/* If this is the first packet we receive, simulate a setup_media event */
-				if(first) {
-					first = FALSE;
-					janus_audiobridge_setup_media(session->handle);
-				}
-				/* Handle the packet */
-				pollerrs = 0;
-				rtp_header *header = (rtp_header *)buffer;
-				if(participant->plainrtp_media.audio_ssrc_peer != ntohl(header->ssrc)) {
-					participant->plainrtp_media.audio_ssrc_peer = ntohl(header->ssrc);
-					JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Got peer audio SSRC: %"SCNu32"\n",
-						session, participant->plainrtp_media.audio_ssrc_peer);
+				/* Got one or more RTP packets */
+				int got = janus_audiobridge_recv_batch_read(batch, fds[i].fd);
+				for(j=0; j<got; j++) {
+					if(janus_audiobridge_plainrtp_incoming(participant, batch->data[j], batch->length[j], &first))
+						pollerrs = 0;
 				}
-				/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-				janus_rtp_header_update(header, &participant->plainrtp_media.context, FALSE, 0);
-				/* Handle as a WebRTC RTP packet */
-				packet.length = bytes;
-				janus_audiobridge_incoming_rtp(session->handle, &packet);
 				continue;
 			}
 		}
 	}
+	g_free(batch);
 	/* Cleanup the media session */
 	participant->plainrtp_media.thread = NULL;
 	janus_mutex_lock(&participant->pmutex);
@@ -8785,3 +9764,261 @@ static void *janus_audiobridge_plainrtp_relay_thread(void *data) {
 	g_thread_unref(g_thread_self());
 	return NULL;
 }
+
+#ifdef HAVE_EPOLL
+/* Reactor threads for plain RTP participants */
+static janus_audiobridge_reactor **reactors = NULL;
+/* Socket a reactor is monitoring */
+typedef struct janus_audiobridge_reactor_fd {
+	struct janus_audiobridge_reactor_participant *rp;
+	int fd;
+} janus_audiobridge_reactor_fd;
+/* Participant a reactor is serving */
+typedef struct janus_audiobridge_reactor_participant {
+	janus_audiobridge_participant *participant;
+	janus_audiobridge_reactor_fd fds[2];
+	int num_fds;
+	int pollerrs;
+	gboolean first, removed;
+} janus_audiobridge_reactor_participant;
+
+/* Helper to stop serving a participant: must only be called by the reactor thread */
+static void janus_audiobridge_reactor_remove(janus_audiobridge_reactor *reactor, janus_audiobridge_reactor_participant *rp) {
+	if(rp->removed)
+		return;
+	rp->removed = TRUE;
+	janus_audiobridge_participant *participant = rp->participant;
+	janus_audiobridge_session *session = participant->session;
+	int i = 0;
+	for(i=0; i<rp->num_fds; i++)
+		epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rp->fds[i].fd, NULL);
+	janus_mutex_lock(&reactor->mutex);
+	reactor->participants = g_list_remove(reactor->participants, rp);
+	reactor->count--;
+	participant->plainrtp_media.reactor = NULL;
+	janus_mutex_unlock(&reactor->mutex);
+	/* Cleanup the media session */
+	janus_mutex_lock(&participant->pmutex);
+	janus_audiobridge_plainrtp_media_cleanup(&participant->plainrtp_media);
+	janus_mutex_unlock(&participant->pmutex);
+	JANUS_LOG(LOG_INFO, "[AudioBridge-%p] Plain RTP participant removed from reactor thread #%u\n", session, reactor->id);
+	janus_refcount_decrease(&participant->ref);
+	janus_refcount_decrease(&session->ref);
+}
+
+/* Helper to check if a participant is gone */
+static gboolean janus_audiobridge_reactor_participant_gone(janus_audiobridge_reactor_participant *rp) {
+	janus_audiobridge_session *session = rp->participant->session;
+	return (session == NULL || g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup));
+}
+
+/* Reactor thread */
+#define JANUS_AUDIOBRIDGE_REACTOR_EVENTS	64
+static void *janus_audiobridge_reactor_thread(void *data) {
+	janus_audiobridge_reactor *reactor = (janus_audiobridge_reactor *)data;
+	JANUS_LOG(LOG_VERB, "Starting AudioBridge reactor thread #%u\n", reactor->id);
+	struct epoll_event events[JANUS_AUDIOBRIDGE_REACTOR_EVENTS];
+	janus_audiobridge_recv_batch *batch = g_malloc0(sizeof(janus_audiobridge_recv_batch));
+	GList *removed = NULL, *gone = NULL, *ps = NULL;
+	gint64 now = 0, check = janus_get_monotonic_time();
+	int num = 0, i = 0, j = 0;
+	while(!g_atomic_int_get(&reactor->stop)) {
+		num = epoll_wait(reactor->epfd, events, JANUS_AUDIOBRIDGE_REACTOR_EVENTS, 500);
+		if(num < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "[reactor #%u] Error polling... %d (%s)\n", reactor->id, errno, g_strerror(errno));
+			break;
+		}
+		for(i=0; i<num; i++) {
+			janus_audiobridge_reactor_fd *rfd = (janus_audiobridge_reactor_fd *)events[i].data.ptr;
+			janus_audiobridge_reactor_participant *rp = rfd->rp;
+			if(rp->removed)
+				continue;
+			janus_audiobridge_participant *participant = rp->participant;
+			janus_audiobridge_session *session = participant->session;
+			if(janus_audiobridge_reactor_participant_gone(rp)) {
+				janus_audiobridge_reactor_remove(reactor, rp);
+				removed = g_list_prepend(removed, rp);
+				continue;
+			}
+			if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+				/* Check the socket error */
+				int error = 0;
+				socklen_t errlen = sizeof(error);
+				getsockopt(rfd->fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+				if(error == 0) {
+					/* Maybe not a breaking error after all? */
+					continue;
+				}
+				rp->pollerrs++;
+				if(rp->pollerrs < 100)
+					continue;
+				JANUS_LOG(LOG_ERR, "[AudioBridge-%p] Too many errors polling %d: %s...\n", session,
+					rfd->fd, events[i].events & EPOLLERR ? "EPOLLERR" : "EPOLLHUP");
+				JANUS_LOG(LOG_ERR, "[AudioBridge-%p]   -- %d (%s)\n", session, error, g_strerror(error));
+				/* Close the channel, and stop serving this participant */
+				janus_audiobridge_hangup_media(session->handle);
+				janus_audiobridge_reactor_remove(reactor, rp);
+				removed = g_list_prepend(removed, rp);
+			} else if(events[i].events & EPOLLIN) {
+				if(rfd->fd == participant->plainrtp_media.pipefd[0]) {
+					/* We've been woken up for a reason, most likely a hangup */
+					int code = 0;
+					(void)read(rfd->fd, &code, sizeof(int));
+					continue;
+				}
+				/* Got one or more RTP packets */
+				int got = janus_audiobridge_recv_batch_read(batch, rfd->fd);
+				for(j=0; j<got; j++) {
+					if(janus_audiobridge_plainrtp_incoming(participant, batch->data[j], batch->length[j], &rp->first))
+						rp->pollerrs = 0;
+				}
+			}
+		}
+		/* Periodically check if any participant went away without us noticing */
+		now = janus_get_monotonic_time();
+		if(now - check >= 500000) {
+			check = now;
+			janus_mutex_lock(&reactor->mutex);
+			ps = reactor->participants;
+			while(ps) {
+				janus_audiobridge_reactor_participant *rp = (janus_audiobridge_reactor_participant *)ps->data;
+				if(janus_audiobridge_reactor_participant_gone(rp))
+					gone = g_list_prepend(gone, rp);
+				ps = ps->next;
+			}
+			janus_mutex_unlock(&reactor->mutex);
+			for(ps = gone; ps != NULL; ps = ps->next) {
+				janus_audiobridge_reactor_remove(reactor, (janus_audiobridge_reactor_participant *)ps->data);
+				removed = g_list_prepend(removed, ps->data);
+			}
+			g_list_free(gone);
+			gone = NULL;
+		}
+		/* We can only free the participants we removed once we're done with the events */
+		if(removed != NULL) {
+			g_list_free_full(removed, (GDestroyNotify)g_free);
+			removed = NULL;
+		}
+	}
+	/* Let go of the participants we're still serving, if any */
+	janus_mutex_lock(&reactor->mutex);
+	while(reactor->participants != NULL) {
+		janus_audiobridge_reactor_participant *rp = (janus_audiobridge_reactor_participant *)reactor->participants->data;
+		janus_mutex_unlock(&reactor->mutex);
+		janus_audiobridge_reactor_remove(reactor, rp);
+		g_free(rp);
+		janus_mutex_lock(&reactor->mutex);
+	}
+	janus_mutex_unlock(&reactor->mutex);
+	g_free(batch);
+	JANUS_LOG(LOG_VERB, "Leaving AudioBridge reactor thread #%u\n", reactor->id);
+	return NULL;
+}
+
+static void janus_audiobridge_reactors_start(int num) {
+	reactors = g_malloc0((num+1) * sizeof(janus_audiobridge_reactor *));
+	char tname[16];
+	int i = 0, started = 0;
+	for(i=0; i<num; i++) {
+		janus_audiobridge_reactor *reactor = g_malloc0(sizeof(janus_audiobridge_reactor));
+		reactor->id = i+1;
+		reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(reactor->epfd < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating epoll instance for reactor thread #%u... %d (%s)\n",
+				reactor->id, errno, g_strerror(errno));
+			g_free(reactor);
+			continue;
+		}
+		janus_mutex_init(&reactor->mutex);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "abridge rtp %u", reactor->id);
+		reactor->thread = g_thread_try_new(tname, &janus_audiobridge_reactor_thread, reactor, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the reactor thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			close(reactor->epfd);
+			janus_mutex_destroy(&reactor->mutex);
+			g_free(reactor);
+			continue;
+		}
+		reactors[started++] = reactor;
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any reactor thread, using a thread per plain RTP participant\n");
+		g_free(reactors);
+		reactors = NULL;
+		reactor_threads = 0;
+		return;
+	}
+	reactor_threads = started;
+	JANUS_LOG(LOG_INFO, "Using %d reactor threads for plain RTP participants\n", reactor_threads);
+}
+
+static void janus_audiobridge_reactors_stop(void) {
+	if(reactors == NULL)
+		return;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		janus_audiobridge_reactor *reactor = reactors[i];
+		g_atomic_int_set(&reactor->stop, 1);
+		g_thread_join(reactor->thread);
+		close(reactor->epfd);
+		janus_mutex_destroy(&reactor->mutex);
+		g_free(reactor);
+	}
+	g_free(reactors);
+	reactors = NULL;
+	reactor_threads = 0;
+}
+
+/* Helper to have a reactor thread serve a plain RTP participant, instead of
+ * a dedicated thread: the caller must have taken the references the reactor
+ * will release when done, and keeps them if this fails */
+static int janus_audiobridge_reactor_add(janus_audiobridge_participant *participant) {
+	if(reactors == NULL || participant->plainrtp_media.audio_rtp_fd == -1)
+		return -1;
+	/* Pick the reactor serving the fewest participants */
+	janus_audiobridge_reactor *reactor = NULL;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		if(reactor == NULL || reactors[i]->count < reactor->count)
+			reactor = reactors[i];
+	}
+	janus_audiobridge_reactor_participant *rp = g_malloc0(sizeof(janus_audiobridge_reactor_participant));
+	rp->participant = participant;
+	rp->first = TRUE;
+	int fds[2] = { participant->plainrtp_media.audio_rtp_fd, participant->plainrtp_media.pipefd[0] };
+	for(i=0; i<2; i++) {
+		if(fds[i] <= 0)
+			continue;
+		rp->fds[rp->num_fds].rp = rp;
+		rp->fds[rp->num_fds].fd = fds[i];
+		rp->num_fds++;
+	}
+	janus_mutex_lock(&reactor->mutex);
+	for(i=0; i<rp->num_fds; i++) {
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN;
+		event.data.ptr = &rp->fds[i];
+		if(epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, rp->fds[i].fd, &event) < 0) {
+			JANUS_LOG(LOG_ERR, "Error adding socket to reactor thread #%u... %d (%s)\n",
+				reactor->id, errno, g_strerror(errno));
+			while(--i >= 0)
+				epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rp->fds[i].fd, NULL);
+			janus_mutex_unlock(&reactor->mutex);
+			g_free(rp);
+			return -1;
+		}
+	}
+	participant->plainrtp_media.reactor = reactor;
+	reactor->participants = g_list_prepend(reactor->participants, rp);
+	reactor->count++;
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_VERB, "[AudioBridge-%p] Plain RTP participant served by reactor thread #%u\n",
+		participant->session, reactor->id);
+	return 0;
+}
+#endif
@@ -0,0 +1,329 @@
+/*! \file   janus_audiobridge_jb.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin jitter buffer
+ * \details  Implementation of the jitter buffer AudioBridge participants
+ * use for their incoming audio. Sequence numbers are extended to 32 bits
+ * by the receiving side, and each frame goes in the slot its sequence
+ * number points to. Each slot has a flag that only the receiving thread
+ * sets (after writing the frame) and only the mixer clears (after taking
+ * the frame), which is all the two sides need to hand frames over. The
+ * mixer owns the position of the next frame to play, while the receiving
+ * thread owns the position of the newest frame: when the latter needs
+ * the former to move (e.g., because sequence numbers jumped), it asks the
+ * mixer to resync instead of touching the slots itself.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#include <string.h>
+
+#include "janus_audiobridge_jb.h"
+
+#define JANUS_AUDIOBRIDGE_JB_MASK	(JANUS_AUDIOBRIDGE_JB_SLOTS-1)
+/* How many ticks (of 20ms) without late frames before the target depth shrinks */
+#define JANUS_AUDIOBRIDGE_JB_SHRINK_TICKS	500
+
+/* Slot in the buffer */
+typedef struct janus_audiobridge_jb_slot {
+	volatile gint full;		/* Set by the receiving thread, cleared by the mixer */
+	guint32 seq;			/* Extended sequence number of the frame */
+	gpointer frame;			/* The frame itself */
+} janus_audiobridge_jb_slot;
+
+struct janus_audiobridge_jb {
+	janus_audiobridge_jb_slot slots[JANUS_AUDIOBRIDGE_JB_SLOTS];
+	GDestroyNotify free_frame;
+	/* Receiving side */
+	gboolean started;			/* Whether we received any frame yet */
+	guint32 last_seq;			/* Newest extended sequence number we received */
+	volatile gint tail;			/* Extended sequence number following the newest frame */
+	/* Mixer side */
+	volatile gint head;			/* Extended sequence number of the next frame to play */
+	volatile gint buffering;	/* Whether we're waiting for the buffer to fill up */
+	volatile gint target;		/* Current target depth */
+	volatile gint min_depth;	/* Minimum target depth, i.e., the prebuffering value */
+	guint32 late_seen;			/* Late frames we already adapted the target depth to */
+	guint quiet_ticks;			/* Ticks since we last saw a late frame */
+	volatile gint popping;		/* Whether a thread is acting as the mixer right now */
+	/* Requests for the mixer side */
+	volatile gint flush;		/* Whether the buffer should be flushed */
+	volatile gint resync;		/* Whether the mixer should jump to resync_seq */
+	volatile gint resync_seq;	/* Extended sequence number to jump to */
+	/* Statistics */
+	volatile gint late, early, discarded, lost;
+};
+
+/* Helper to figure out how deep the buffer can get, for a minimum depth */
+static guint janus_audiobridge_jb_max_target(guint depth) {
+	guint max = MAX(depth*2, depth+4);
+	if(max > JANUS_AUDIOBRIDGE_JB_SLOTS/2)
+		max = MAX(depth, JANUS_AUDIOBRIDGE_JB_SLOTS/2);
+	return max;
+}
+
+janus_audiobridge_jb *janus_audiobridge_jb_new(guint depth, GDestroyNotify free_frame) {
+	janus_audiobridge_jb *jb = g_malloc0(sizeof(janus_audiobridge_jb));
+	jb->free_frame = free_frame;
+	if(depth > JANUS_AUDIOBRIDGE_JB_SLOTS/2)
+		depth = JANUS_AUDIOBRIDGE_JB_SLOTS/2;
+	g_atomic_int_set(&jb->min_depth, depth);
+	g_atomic_int_set(&jb->target, depth);
+	g_atomic_int_set(&jb->buffering, 1);
+	return jb;
+}
+
+/* Helper to free a frame we won't need */
+static void janus_audiobridge_jb_free_frame(janus_audiobridge_jb *jb, gpointer frame) {
+	if(frame != NULL && jb->free_frame != NULL)
+		jb->free_frame(frame);
+}
+
+/* Helper to empty a slot (mixer side only) */
+static void janus_audiobridge_jb_clear_slot(janus_audiobridge_jb *jb, janus_audiobridge_jb_slot *slot) {
+	gpointer frame = slot->frame;
+	slot->frame = NULL;
+	g_atomic_int_set(&slot->full, 0);
+	janus_audiobridge_jb_free_frame(jb, frame);
+}
+
+void janus_audiobridge_jb_destroy(janus_audiobridge_jb *jb) {
+	if(jb == NULL)
+		return;
+	guint i = 0;
+	for(i=0; i<JANUS_AUDIOBRIDGE_JB_SLOTS; i++) {
+		if(g_atomic_int_get(&jb->slots[i].full))
+			janus_audiobridge_jb_clear_slot(jb, &jb->slots[i]);
+	}
+	g_free(jb);
+}
+
+/* Helper to ask the mixer to jump to a different position (receiving side only) */
+static void janus_audiobridge_jb_request_resync(janus_audiobridge_jb *jb, guint32 seq) {
+	g_atomic_int_set(&jb->resync_seq, (gint)seq);
+	g_atomic_int_set(&jb->resync, 1);
+	g_atomic_int_set(&jb->tail, (gint)(seq+1));
+}
+
+void janus_audiobridge_jb_insert(janus_audiobridge_jb *jb, guint16 seq, gpointer frame) {
+	if(jb == NULL || frame == NULL) {
+		if(jb != NULL)
+			janus_audiobridge_jb_free_frame(jb, frame);
+		return;
+	}
+	guint32 ext = seq;
+	if(!jb->started) {
+		/* First frame, the mixer will start from here */
+		jb->started = TRUE;
+		jb->last_seq = ext;
+		janus_audiobridge_jb_request_resync(jb, ext);
+	} else {
+		/* Extend the sequence number, taking wraparounds into account */
+		ext = jb->last_seq + (gint16)(seq - (guint16)jb->last_seq);
+		if((gint32)(ext - jb->last_seq) > 0)
+			jb->last_seq = ext;
+	}
+	/* Make sure the frame fits in the window the mixer will look at */
+	guint32 base = g_atomic_int_get(&jb->resync) ?
+		(guint32)g_atomic_int_get(&jb->resync_seq) : (guint32)g_atomic_int_get(&jb->head);
+	gint32 offset = (gint32)(ext - base);
+	if(offset < 0 && -offset <= JANUS_AUDIOBRIDGE_JB_SLOTS) {
+		/* The mixer needed this frame already */
+		g_atomic_int_inc(&jb->late);
+		janus_audiobridge_jb_free_frame(jb, frame);
+		return;
+	} else if(offset < 0 || offset >= JANUS_AUDIOBRIDGE_JB_SLOTS) {
+		/* Too far from what the mixer is playing (sequence numbers
+		 * probably jumped), ask the mixer to start again from here */
+		g_atomic_int_inc(&jb->early);
+		janus_audiobridge_jb_request_resync(jb, ext);
+		jb->last_seq = ext;
+	}
+	janus_audiobridge_jb_slot *slot = &jb->slots[ext & JANUS_AUDIOBRIDGE_JB_MASK];
+	if(g_atomic_int_get(&slot->full)) {
+		/* Either a duplicate, or a frame the mixer didn't get rid of yet */
+		g_atomic_int_inc(&jb->discarded);
+		janus_audiobridge_jb_free_frame(jb, frame);
+		return;
+	}
+	slot->seq = ext;
+	slot->frame = frame;
+	g_atomic_int_set(&slot->full, 1);
+	if((gint32)(ext + 1 - (guint32)g_atomic_int_get(&jb->tail)) > 0)
+		g_atomic_int_set(&jb->tail, (gint)(ext+1));
+}
+
+void janus_audiobridge_jb_restart(janus_audiobridge_jb *jb) {
+	if(jb == NULL)
+		return;
+	/* Get rid of what we have, and resync on the next frame */
+	jb->started = FALSE;
+	janus_audiobridge_jb_flush(jb);
+}
+
+void janus_audiobridge_jb_count_late(janus_audiobridge_jb *jb) {
+	if(jb != NULL)
+		g_atomic_int_inc(&jb->late);
+}
+
+/* Helper to take the frame with a specific sequence number, if available (mixer side only) */
+static gpointer janus_audiobridge_jb_take(janus_audiobridge_jb *jb, guint32 seq) {
+	janus_audiobridge_jb_slot *slot = &jb->slots[seq & JANUS_AUDIOBRIDGE_JB_MASK];
+	if(!g_atomic_int_get(&slot->full))
+		return NULL;
+	if(slot->seq == seq) {
+		gpointer frame = slot->frame;
+		slot->frame = NULL;
+		g_atomic_int_set(&slot->full, 0);
+		return frame;
+	}
+	if((gint32)(slot->seq - seq) < 0) {
+		/* Leftover from before, get rid of it */
+		janus_audiobridge_jb_clear_slot(jb, slot);
+	}
+	return NULL;
+}
+
+/* Helper to get rid of all the frames (mixer side only) */
+static void janus_audiobridge_jb_flush_internal(janus_audiobridge_jb *jb) {
+	guint i = 0;
+	for(i=0; i<JANUS_AUDIOBRIDGE_JB_SLOTS; i++) {
+		if(g_atomic_int_get(&jb->slots[i].full))
+			janus_audiobridge_jb_clear_slot(jb, &jb->slots[i]);
+	}
+	g_atomic_int_set(&jb->head, g_atomic_int_get(&jb->tail));
+	g_atomic_int_set(&jb->buffering, 1);
+}
+
+gpointer janus_audiobridge_jb_pop(janus_audiobridge_jb *jb) {
+	if(jb == NULL || !g_atomic_int_compare_and_exchange(&jb->popping, 0, 1))
+		return NULL;
+	if(g_atomic_int_compare_and_exchange(&jb->flush, 1, 0))
+		janus_audiobridge_jb_flush_internal(jb);
+	guint32 head = (guint32)g_atomic_int_get(&jb->head);
+	if(g_atomic_int_get(&jb->resync)) {
+		/* Jump to where the receiving side asked us to, and get rid of
+		 * the frames that don't fit in the new window */
+		head = (guint32)g_atomic_int_get(&jb->resync_seq);
+		g_atomic_int_set(&jb->resync, 0);
+		guint i = 0;
+		for(i=0; i<JANUS_AUDIOBRIDGE_JB_SLOTS; i++) {
+			janus_audiobridge_jb_slot *slot = &jb->slots[i];
+			if(!g_atomic_int_get(&slot->full))
+				continue;
+			gint32 offset = (gint32)(slot->seq - head);
+			if(offset < 0 || offset >= JANUS_AUDIOBRIDGE_JB_SLOTS)
+				janus_audiobridge_jb_clear_slot(jb, slot);
+		}
+		g_atomic_int_set(&jb->buffering, 1);
+	}
+	gint32 depth = (gint32)((guint32)g_atomic_int_get(&jb->tail) - head);
+	if(depth < 0)
+		depth = 0;
+	else if(depth > JANUS_AUDIOBRIDGE_JB_SLOTS)
+		depth = JANUS_AUDIOBRIDGE_JB_SLOTS;
+	/* Adapt the target depth: grow it when frames arrive late or we run
+	 * out of frames, and shrink it back (dropping a frame) when that stops
+	 * happening for a while */
+	guint min = g_atomic_int_get(&jb->min_depth), max = janus_audiobridge_jb_max_target(min);
+	guint target = g_atomic_int_get(&jb->target);
+	guint32 late = g_atomic_int_get(&jb->late);
+	gboolean underrun = (depth == 0 && !g_atomic_int_get(&jb->buffering));
+	if(late != jb->late_seen || underrun) {
+		jb->late_seen = late;
+		jb->quiet_ticks = 0;
+		if(target < max) {
+			target++;
+			g_atomic_int_set(&jb->buffering, 1);
+		}
+	} else if(++jb->quiet_ticks >= JANUS_AUDIOBRIDGE_JB_SHRINK_TICKS) {
+		jb->quiet_ticks = 0;
+		if(target > min) {
+			target--;
+			if((guint)depth > target) {
+				janus_audiobridge_jb_free_frame(jb, janus_audiobridge_jb_take(jb, head));
+				g_atomic_int_inc(&jb->discarded);
+				head++;
+				depth--;
+			}
+		}
+	}
+	if(target < min) {
+		/* The prebuffering value grew */
+		target = min;
+		g_atomic_int_set(&jb->buffering, 1);
+	} else if(target > max) {
+		target = max;
+	}
+	g_atomic_int_set(&jb->target, target);
+	gpointer frame = NULL;
+	if(depth == 0 && !g_atomic_int_get(&jb->buffering)) {
+		/* We ran out of frames, buffer again before playing anything else */
+		g_atomic_int_set(&jb->buffering, 1);
+	} else if(g_atomic_int_get(&jb->buffering) && (guint)depth > target) {
+		/* We have enough frames to start playing */
+		g_atomic_int_set(&jb->buffering, 0);
+	}
+	if(!g_atomic_int_get(&jb->buffering)) {
+		/* Make sure we're not queueing too many frames: if so, get rid of the older ones */
+		guint keep = MAX(target, 1);
+		if((guint)depth >= keep*2) {
+			while((guint)depth > keep) {
+				janus_audiobridge_jb_free_frame(jb, janus_audiobridge_jb_take(jb, head));
+				g_atomic_int_inc(&jb->discarded);
+				head++;
+				depth--;
+			}
+		}
+		frame = janus_audiobridge_jb_take(jb, head);
+		if(frame == NULL)
+			g_atomic_int_inc(&jb->lost);
+		head++;
+	}
+	g_atomic_int_set(&jb->head, (gint)head);
+	g_atomic_int_set(&jb->popping, 0);
+	return frame;
+}
+
+void janus_audiobridge_jb_flush(janus_audiobridge_jb *jb) {
+	if(jb == NULL)
+		return;
+	if(g_atomic_int_compare_and_exchange(&jb->popping, 0, 1)) {
+		/* Nobody is popping frames right now, flush right away */
+		g_atomic_int_set(&jb->flush, 0);
+		janus_audiobridge_jb_flush_internal(jb);
+		g_atomic_int_set(&jb->popping, 0);
+	} else {
+		/* Let the mixer take care of it */
+		g_atomic_int_set(&jb->flush, 1);
+	}
+}
+
+void janus_audiobridge_jb_set_depth(janus_audiobridge_jb *jb, guint depth) {
+	if(jb == NULL)
+		return;
+	if(depth > JANUS_AUDIOBRIDGE_JB_SLOTS/2)
+		depth = JANUS_AUDIOBRIDGE_JB_SLOTS/2;
+	g_atomic_int_set(&jb->min_depth, depth);
+}
+
+gboolean janus_audiobridge_jb_is_buffering(janus_audiobridge_jb *jb) {
+	return jb ? (g_atomic_int_get(&jb->buffering) != 0) : TRUE;
+}
+
+void janus_audiobridge_jb_get_stats(janus_audiobridge_jb *jb, janus_audiobridge_jb_stats *stats) {
+	if(stats == NULL)
+		return;
+	memset(stats, 0, sizeof(*stats));
+	if(jb == NULL)
+		return;
+	gint32 depth = (gint32)((guint32)g_atomic_int_get(&jb->tail) - (guint32)g_atomic_int_get(&jb->head));
+	stats->length = depth < 0 ? 0 : MIN(depth, JANUS_AUDIOBRIDGE_JB_SLOTS);
+	stats->target = g_atomic_int_get(&jb->target);
+	stats->buffering = g_atomic_int_get(&jb->buffering) != 0;
+	stats->late = g_atomic_int_get(&jb->late);
+	stats->early = g_atomic_int_get(&jb->early);
+	stats->discarded = g_atomic_int_get(&jb->discarded);
+	stats->lost = g_atomic_int_get(&jb->lost);
+}
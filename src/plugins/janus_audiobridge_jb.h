@@ -0,0 +1,117 @@
+/*! \file   janus_audiobridge_jb.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin jitter buffer (headers)
+ * \details  Each AudioBridge participant has a jitter buffer that sits
+ * between the thread receiving (and decoding) its RTP packets, and the
+ * mixer thread of the room. Frames are stored in a fixed number of slots
+ * indexed by their RTP sequence number, which makes both inserting and
+ * popping frames O(1), and the two sides never need a mutex to hand
+ * frames over: the receiving thread is the only one filling slots, and
+ * the mixer is the only one emptying them.
+ *
+ * The buffer starts in a buffering state, and only returns frames after
+ * more than its target depth has been queued. The target depth starts
+ * from the configured prebuffering value, grows when frames arrive after
+ * the mixer needed them, and shrinks back slowly when that stops
+ * happening. When more than twice the target depth is queued, the oldest
+ * frames are discarded.
+ *
+ * janus_audiobridge_jb_insert() must only be called by the thread that
+ * receives packets, while janus_audiobridge_jb_pop() is meant for the
+ * mixer; all other functions can be called by any thread.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#ifndef JANUS_AUDIOBRIDGE_JB_H
+#define JANUS_AUDIOBRIDGE_JB_H
+
+#include <glib.h>
+
+/*! \brief Number of slots in a jitter buffer (a power of 2) */
+#define JANUS_AUDIOBRIDGE_JB_SLOTS	128
+
+/*! \brief Jitter buffer instance */
+typedef struct janus_audiobridge_jb janus_audiobridge_jb;
+
+/*! \brief Jitter buffer statistics */
+typedef struct janus_audiobridge_jb_stats {
+	/*! \brief Number of frames currently queued */
+	guint length;
+	/*! \brief Current target depth, in frames */
+	guint target;
+	/*! \brief Whether the buffer is still buffering */
+	gboolean buffering;
+	/*! \brief Frames that arrived after the mixer needed them */
+	guint32 late;
+	/*! \brief Frames that arrived too far ahead, and caused a resync */
+	guint32 early;
+	/*! \brief Frames dropped because too many were queued, or because they were duplicates */
+	guint32 discarded;
+	/*! \brief Frames that were missing when the mixer needed them */
+	guint32 lost;
+} janus_audiobridge_jb_stats;
+
+/*! \brief Create a new jitter buffer
+ * @param[in] depth Minimum target depth, in frames (the prebuffering value)
+ * @param[in] free_frame Function to free frames that are discarded
+ * @returns A new janus_audiobridge_jb instance */
+janus_audiobridge_jb *janus_audiobridge_jb_new(guint depth, GDestroyNotify free_frame);
+
+/*! \brief Destroy a jitter buffer, freeing all the frames still queued
+ * @note Neither side must be using the buffer when this is called
+ * @param[in] jb The janus_audiobridge_jb instance to destroy */
+void janus_audiobridge_jb_destroy(janus_audiobridge_jb *jb);
+
+/*! \brief Queue a decoded frame (receiving thread only)
+ * @note The buffer takes ownership of the frame in any case, and frees
+ * it right away if it's late, early or a duplicate
+ * @param[in] jb The janus_audiobridge_jb instance to queue the frame to
+ * @param[in] seq RTP sequence number of the frame
+ * @param[in] frame The frame to queue */
+void janus_audiobridge_jb_insert(janus_audiobridge_jb *jb, guint16 seq, gpointer frame);
+
+/*! \brief Stop playing, and start again from the next frame that is queued,
+ * whatever its sequence number (receiving thread only)
+ * @note This is meant for when the receiving thread stops queueing frames
+ * for a while on purpose, e.g., because it skips decoding
+ * @param[in] jb The janus_audiobridge_jb instance to restart */
+void janus_audiobridge_jb_restart(janus_audiobridge_jb *jb);
+
+/*! \brief Take note of a frame the receiving thread dropped because it was late
+ * @param[in] jb The janus_audiobridge_jb instance to update */
+void janus_audiobridge_jb_count_late(janus_audiobridge_jb *jb);
+
+/*! \brief Get the next frame to mix (mixer only)
+ * @note This has to be called once per mixer tick, as each call advances
+ * the buffer by a frame; if another thread is popping from the same
+ * buffer at the same time, NULL is returned
+ * @param[in] jb The janus_audiobridge_jb instance to pop the frame from
+ * @returns The frame, or NULL if there's nothing to play (still buffering,
+ * or the frame is missing) */
+gpointer janus_audiobridge_jb_pop(janus_audiobridge_jb *jb);
+
+/*! \brief Get rid of all the queued frames, and start buffering again
+ * @note If the mixer is popping a frame right now, the buffer is flushed
+ * the next time janus_audiobridge_jb_pop() is called instead
+ * @param[in] jb The janus_audiobridge_jb instance to flush */
+void janus_audiobridge_jb_flush(janus_audiobridge_jb *jb);
+
+/*! \brief Change the minimum target depth (e.g., because of a new prebuffering value)
+ * @param[in] jb The janus_audiobridge_jb instance to update
+ * @param[in] depth New minimum target depth, in frames */
+void janus_audiobridge_jb_set_depth(janus_audiobridge_jb *jb, guint depth);
+
+/*! \brief Check whether the buffer is buffering, and so not returning frames yet
+ * @param[in] jb The janus_audiobridge_jb instance to check
+ * @returns TRUE if buffering, FALSE otherwise */
+gboolean janus_audiobridge_jb_is_buffering(janus_audiobridge_jb *jb);
+
+/*! \brief Get the statistics of a jitter buffer
+ * @param[in] jb The janus_audiobridge_jb instance to check
+ * @param[out] stats Where to write the statistics */
+void janus_audiobridge_jb_get_stats(janus_audiobridge_jb *jb, janus_audiobridge_jb_stats *stats);
+
+#endif
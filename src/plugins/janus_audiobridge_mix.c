@@ -0,0 +1,322 @@
+/*! \file   janus_audiobridge_mix.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin mixing kernels
+ * \details  Implementation of the loops the AudioBridge mixer thread uses
+ * to create the mix and the per-participant outputs. A plain C version is
+ * always available, and vectorized versions are built where the compiler
+ * supports them: SSE2 and AVX2 on x86 (AVX2 is only used if the CPU
+ * supports it, which is checked at runtime), and NEON on ARM.
+ *
+ * Gains are applied by converting samples to floating point, multiplying
+ * them by the gain and truncating the result, which all the versions do
+ * in exactly the same way; when gains are 1.0, samples are just added.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#include <string.h>
+
+#include "janus_audiobridge_mix.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JANUS_AUDIOBRIDGE_MIX_X86
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define JANUS_AUDIOBRIDGE_MIX_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* Plain C version, also used by the other versions for the last samples */
+static void janus_audiobridge_accumulate_c(opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	int i = 0;
+	if(lgain == 1.0f && rgain == 1.0f) {
+		for(i=0; i<samples; i++)
+			mix[i] += src[i];
+		return;
+	}
+	for(i=0; i<samples; i++)
+		mix[i] += (opus_int32)((float)src[i] * (i%2 == 0 ? lgain : rgain));
+}
+
+static void janus_audiobridge_add_c(opus_int32 *mix, const opus_int32 *src, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++)
+		mix[i] += src[i];
+}
+
+static void janus_audiobridge_subtract_c(opus_int32 *dst, const opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	int i = 0;
+	if(src == NULL) {
+		memcpy(dst, mix, samples*sizeof(opus_int32));
+		return;
+	}
+	if(lgain == 1.0f && rgain == 1.0f) {
+		for(i=0; i<samples; i++)
+			dst[i] = mix[i] - src[i];
+		return;
+	}
+	for(i=0; i<samples; i++)
+		dst[i] = mix[i] - (opus_int32)((float)src[i] * (i%2 == 0 ? lgain : rgain));
+}
+
+static void janus_audiobridge_pack_c(opus_int16 *dst, const opus_int32 *mix, int samples) {
+	int i = 0;
+	for(i=0; i<samples; i++) {
+		opus_int32 s = mix[i];
+		dst[i] = (s > 32767 ? 32767 : (s < -32768 ? -32768 : s));
+	}
+}
+
+static const janus_audiobridge_mix_kernels janus_audiobridge_mix_c = {
+	.name = "c",
+	.accumulate = janus_audiobridge_accumulate_c,
+	.add = janus_audiobridge_add_c,
+	.subtract = janus_audiobridge_subtract_c,
+	.pack = janus_audiobridge_pack_c,
+};
+
+
+#ifdef JANUS_AUDIOBRIDGE_MIX_X86
+/* SSE2 version: notice that, since we always process a multiple of 4
+ * samples at a time, the left/right pattern of the gains never changes */
+__attribute__((target("sse2")))
+static inline void janus_audiobridge_widen_sse2(const opus_int16 *src, __m128i *lo, __m128i *hi) {
+	__m128i s = _mm_loadu_si128((const __m128i *)src);
+	/* Sign-extend the 16-bit samples to 32 bits */
+	*lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+	*hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_accumulate_sse2(opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	__m128 gain = _mm_setr_ps(lgain, rgain, lgain, rgain);
+	__m128i lo, hi;
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		janus_audiobridge_widen_sse2(src+i, &lo, &hi);
+		if(!unity) {
+			lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), gain));
+			hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), gain));
+		}
+		_mm_storeu_si128((__m128i *)(mix+i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mix+i)), lo));
+		_mm_storeu_si128((__m128i *)(mix+i+4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mix+i+4)), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_accumulate_c(mix+i, src+i, samples-i, lgain, rgain);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_add_sse2(opus_int32 *mix, const opus_int32 *src, int samples) {
+	int i = 0;
+	for(i=0; i+4<=samples; i+=4) {
+		_mm_storeu_si128((__m128i *)(mix+i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(mix+i)),
+			_mm_loadu_si128((const __m128i *)(src+i))));
+	}
+	if(i < samples)
+		janus_audiobridge_add_c(mix+i, src+i, samples-i);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_subtract_sse2(opus_int32 *dst, const opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	if(src == NULL) {
+		memcpy(dst, mix, samples*sizeof(opus_int32));
+		return;
+	}
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	__m128 gain = _mm_setr_ps(lgain, rgain, lgain, rgain);
+	__m128i lo, hi;
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		janus_audiobridge_widen_sse2(src+i, &lo, &hi);
+		if(!unity) {
+			lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), gain));
+			hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), gain));
+		}
+		_mm_storeu_si128((__m128i *)(dst+i), _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(mix+i)), lo));
+		_mm_storeu_si128((__m128i *)(dst+i+4), _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(mix+i+4)), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_subtract_c(dst+i, mix+i, src+i, samples-i, lgain, rgain);
+}
+
+__attribute__((target("sse2")))
+static void janus_audiobridge_pack_sse2(opus_int16 *dst, const opus_int32 *mix, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		__m128i packed = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)(mix+i)),
+			_mm_loadu_si128((const __m128i *)(mix+i+4)));
+		_mm_storeu_si128((__m128i *)(dst+i), packed);
+	}
+	if(i < samples)
+		janus_audiobridge_pack_c(dst+i, mix+i, samples-i);
+}
+
+static const janus_audiobridge_mix_kernels janus_audiobridge_mix_sse2 = {
+	.name = "sse2",
+	.accumulate = janus_audiobridge_accumulate_sse2,
+	.add = janus_audiobridge_add_sse2,
+	.subtract = janus_audiobridge_subtract_sse2,
+	.pack = janus_audiobridge_pack_sse2,
+};
+
+/* AVX2 version */
+__attribute__((target("avx2")))
+static void janus_audiobridge_accumulate_avx2(opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	__m256 gain = _mm256_setr_ps(lgain, rgain, lgain, rgain, lgain, rgain, lgain, rgain);
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src+i)));
+		if(!unity)
+			s = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(s), gain));
+		_mm256_storeu_si256((__m256i *)(mix+i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(mix+i)), s));
+	}
+	if(i < samples)
+		janus_audiobridge_accumulate_c(mix+i, src+i, samples-i, lgain, rgain);
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_add_avx2(opus_int32 *mix, const opus_int32 *src, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		_mm256_storeu_si256((__m256i *)(mix+i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(mix+i)),
+			_mm256_loadu_si256((const __m256i *)(src+i))));
+	}
+	if(i < samples)
+		janus_audiobridge_add_c(mix+i, src+i, samples-i);
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_subtract_avx2(opus_int32 *dst, const opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	if(src == NULL) {
+		memcpy(dst, mix, samples*sizeof(opus_int32));
+		return;
+	}
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	__m256 gain = _mm256_setr_ps(lgain, rgain, lgain, rgain, lgain, rgain, lgain, rgain);
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		__m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src+i)));
+		if(!unity)
+			s = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(s), gain));
+		_mm256_storeu_si256((__m256i *)(dst+i), _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(mix+i)), s));
+	}
+	if(i < samples)
+		janus_audiobridge_subtract_c(dst+i, mix+i, src+i, samples-i, lgain, rgain);
+}
+
+__attribute__((target("avx2")))
+static void janus_audiobridge_pack_avx2(opus_int16 *dst, const opus_int32 *mix, int samples) {
+	int i = 0;
+	for(i=0; i+16<=samples; i+=16) {
+		__m256i packed = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i *)(mix+i)),
+			_mm256_loadu_si256((const __m256i *)(mix+i+8)));
+		/* Packing works on 128-bit lanes, so we need to put the samples back in order */
+		packed = _mm256_permute4x64_epi64(packed, 0xD8);
+		_mm256_storeu_si256((__m256i *)(dst+i), packed);
+	}
+	if(i < samples)
+		janus_audiobridge_pack_c(dst+i, mix+i, samples-i);
+}
+
+static const janus_audiobridge_mix_kernels janus_audiobridge_mix_avx2 = {
+	.name = "avx2",
+	.accumulate = janus_audiobridge_accumulate_avx2,
+	.add = janus_audiobridge_add_avx2,
+	.subtract = janus_audiobridge_subtract_avx2,
+	.pack = janus_audiobridge_pack_avx2,
+};
+#endif
+
+
+#ifdef JANUS_AUDIOBRIDGE_MIX_NEON
+/* NEON version */
+static void janus_audiobridge_accumulate_neon(opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	const float gains[4] = { lgain, rgain, lgain, rgain };
+	float32x4_t gain = vld1q_f32(gains);
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		int16x8_t s = vld1q_s16(src+i);
+		int32x4_t lo = vmovl_s16(vget_low_s16(s));
+		int32x4_t hi = vmovl_s16(vget_high_s16(s));
+		if(!unity) {
+			lo = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(lo), gain));
+			hi = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(hi), gain));
+		}
+		vst1q_s32(mix+i, vaddq_s32(vld1q_s32(mix+i), lo));
+		vst1q_s32(mix+i+4, vaddq_s32(vld1q_s32(mix+i+4), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_accumulate_c(mix+i, src+i, samples-i, lgain, rgain);
+}
+
+static void janus_audiobridge_add_neon(opus_int32 *mix, const opus_int32 *src, int samples) {
+	int i = 0;
+	for(i=0; i+4<=samples; i+=4)
+		vst1q_s32(mix+i, vaddq_s32(vld1q_s32(mix+i), vld1q_s32(src+i)));
+	if(i < samples)
+		janus_audiobridge_add_c(mix+i, src+i, samples-i);
+}
+
+static void janus_audiobridge_subtract_neon(opus_int32 *dst, const opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain) {
+	if(src == NULL) {
+		memcpy(dst, mix, samples*sizeof(opus_int32));
+		return;
+	}
+	int unity = (lgain == 1.0f && rgain == 1.0f);
+	const float gains[4] = { lgain, rgain, lgain, rgain };
+	float32x4_t gain = vld1q_f32(gains);
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8) {
+		int16x8_t s = vld1q_s16(src+i);
+		int32x4_t lo = vmovl_s16(vget_low_s16(s));
+		int32x4_t hi = vmovl_s16(vget_high_s16(s));
+		if(!unity) {
+			lo = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(lo), gain));
+			hi = vcvtq_s32_f32(vmulq_f32(vcvtq_f32_s32(hi), gain));
+		}
+		vst1q_s32(dst+i, vsubq_s32(vld1q_s32(mix+i), lo));
+		vst1q_s32(dst+i+4, vsubq_s32(vld1q_s32(mix+i+4), hi));
+	}
+	if(i < samples)
+		janus_audiobridge_subtract_c(dst+i, mix+i, src+i, samples-i, lgain, rgain);
+}
+
+static void janus_audiobridge_pack_neon(opus_int16 *dst, const opus_int32 *mix, int samples) {
+	int i = 0;
+	for(i=0; i+8<=samples; i+=8)
+		vst1q_s16(dst+i, vcombine_s16(vqmovn_s32(vld1q_s32(mix+i)), vqmovn_s32(vld1q_s32(mix+i+4))));
+	if(i < samples)
+		janus_audiobridge_pack_c(dst+i, mix+i, samples-i);
+}
+
+static const janus_audiobridge_mix_kernels janus_audiobridge_mix_neon = {
+	.name = "neon",
+	.accumulate = janus_audiobridge_accumulate_neon,
+	.add = janus_audiobridge_add_neon,
+	.subtract = janus_audiobridge_subtract_neon,
+	.pack = janus_audiobridge_pack_neon,
+};
+#endif
+
+
+const janus_audiobridge_mix_kernels *janus_audiobridge_mix = &janus_audiobridge_mix_c;
+
+const char *janus_audiobridge_mix_init(void) {
+	janus_audiobridge_mix = &janus_audiobridge_mix_c;
+#ifdef JANUS_AUDIOBRIDGE_MIX_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		janus_audiobridge_mix = &janus_audiobridge_mix_avx2;
+	else if(__builtin_cpu_supports("sse2"))
+		janus_audiobridge_mix = &janus_audiobridge_mix_sse2;
+#elif defined(JANUS_AUDIOBRIDGE_MIX_NEON)
+	janus_audiobridge_mix = &janus_audiobridge_mix_neon;
+#endif
+	return janus_audiobridge_mix->name;
+}
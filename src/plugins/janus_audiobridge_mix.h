@@ -0,0 +1,50 @@
+/*! \file   janus_audiobridge_mix.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin mixing kernels (headers)
+ * \details  The AudioBridge mixer thread spends most of its time adding
+ * the audio of each participant to the mix, and then removing each
+ * participant's own contribution from it before encoding. These helpers
+ * implement those loops: depending on what the CPU supports, a vectorized
+ * version (SSE2, AVX2 or NEON) is picked at runtime by
+ * janus_audiobridge_mix_init(), with a plain C fallback otherwise. All
+ * implementations apply gains the same way, so the result is the same
+ * independently of which one is in use.
+ *
+ * Gains are expressed as floating point factors (1.0 meaning no change),
+ * and for stereo (interleaved) buffers the left and right gains are
+ * applied to even and odd samples respectively; for mono buffers, the
+ * two gains should be the same.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#ifndef JANUS_AUDIOBRIDGE_MIX_H
+#define JANUS_AUDIOBRIDGE_MIX_H
+
+#include <opus/opus.h>
+
+/*! \brief Set of mixing kernels */
+typedef struct janus_audiobridge_mix_kernels {
+	/*! \brief Name of the implementation (e.g., "avx2") */
+	const char *name;
+	/*! \brief Add samples to a mix, applying the provided gains: \c mix[i] \c += \c src[i]*gain */
+	void (* const accumulate)(opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain);
+	/*! \brief Add a submix to a mix: \c mix[i] \c += \c src[i] */
+	void (* const add)(opus_int32 *mix, const opus_int32 *src, int samples);
+	/*! \brief Remove a contribution from a mix: \c dst[i] \c = \c mix[i] \c - \c src[i]*gain
+	 * \note If \c src is NULL, the mix is just copied */
+	void (* const subtract)(opus_int32 *dst, const opus_int32 *mix, const opus_int16 *src, int samples, float lgain, float rgain);
+	/*! \brief Convert a mix to 16-bit samples, saturating values that don't fit */
+	void (* const pack)(opus_int16 *dst, const opus_int32 *mix, int samples);
+} janus_audiobridge_mix_kernels;
+
+/*! \brief Mixing kernels currently in use */
+extern const janus_audiobridge_mix_kernels *janus_audiobridge_mix;
+
+/*! \brief Pick the best mixing kernels for this CPU
+ * @returns The name of the implementation that was picked */
+const char *janus_audiobridge_mix_init(void);
+
+#endif
@@ -0,0 +1,407 @@
+/*! \file   janus_audiobridge_rec.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin room recorder
+ * \details  Implementation of the recorder the AudioBridge uses to save
+ * the mix of a room to disk. Each slot of the ring buffer has a flag that
+ * only the mixer sets (after copying the frame) and only the writer thread
+ * clears (after writing it), and each side keeps track of its own position
+ * in the ring. The writer thread wakes up every 20ms to write whatever was
+ * queued in the meanwhile. For WAV recordings, the header is updated every
+ * few seconds, so that the file is usable even if it's never finalized;
+ * for Opus recordings, frames are encoded and muxed in Ogg pages, as
+ * described in RFC 7845.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#ifdef HAVE_LIBOGG
+#include <ogg/ogg.h>
+#endif
+
+#include "janus_audiobridge_rec.h"
+#include "../debug.h"
+#include "../utils.h"
+
+#define JANUS_AUDIOBRIDGE_REC_MASK	(JANUS_AUDIOBRIDGE_REC_SLOTS-1)
+/* Largest frame we can be handed (20ms of 48kHz stereo) */
+#define JANUS_AUDIOBRIDGE_REC_MAX_SAMPLES	1920
+/* How often we update the header of WAV files */
+#define JANUS_AUDIOBRIDGE_REC_WAV_UPDATE	(5*G_USEC_PER_SEC)
+
+/* Slot in the ring buffer */
+typedef struct janus_audiobridge_rec_slot {
+	volatile gint full;		/* Set by the mixer, cleared by the writer thread */
+	int num;				/* Number of samples in the frame */
+	opus_int16 samples[JANUS_AUDIOBRIDGE_REC_MAX_SAMPLES];
+} janus_audiobridge_rec_slot;
+
+struct janus_audiobridge_rec {
+	janus_audiobridge_rec_slot slots[JANUS_AUDIOBRIDGE_REC_SLOTS];
+	guint tail;				/* Next slot the mixer will fill */
+	guint head;				/* Next slot the writer thread will empty */
+	volatile gint closing;	/* Whether we've been asked to stop */
+	volatile gint dropped;	/* Frames dropped because the ring buffer was full */
+	janus_audiobridge_rec_format format;
+	int sampling_rate, channels;
+	char *filename, *final_filename;
+	FILE *file;
+	GThread *thread;
+	janus_audiobridge_rec_done_cb done;
+	gpointer user_data;
+	/* WAV */
+	gint64 last_update;		/* When we last updated the header */
+#ifdef HAVE_LIBOGG
+	/* Opus */
+	OpusEncoder *encoder;
+	ogg_stream_state stream;
+	ogg_int64_t granulepos, packetno;
+	unsigned char pending[1500];	/* We always hold back the latest packet, to mark the last one as such */
+	int pending_len;
+	ogg_int64_t pending_duration;
+#endif
+};
+
+/* Helper struct to generate WAVE headers */
+typedef struct janus_audiobridge_rec_wav_header {
+	char riff[4];
+	uint32_t len;
+	char wave[4];
+	char fmt[4];
+	uint32_t formatsize;
+	uint16_t format;
+	uint16_t channels;
+	uint32_t samplerate;
+	uint32_t avgbyterate;
+	uint16_t samplebytes;
+	uint16_t channelbits;
+	char data[4];
+	uint32_t blocksize;
+} janus_audiobridge_rec_wav_header;
+
+const char *janus_audiobridge_rec_format_extension(janus_audiobridge_rec_format format) {
+	return format == JANUS_AUDIOBRIDGE_REC_OPUS ? "opus" : "wav";
+}
+
+gboolean janus_audiobridge_rec_format_parse(const char *name, janus_audiobridge_rec_format *format) {
+	if(name == NULL || format == NULL)
+		return FALSE;
+	if(!strcasecmp(name, "wav")) {
+		*format = JANUS_AUDIOBRIDGE_REC_WAV;
+		return TRUE;
+	}
+#ifdef HAVE_LIBOGG
+	if(!strcasecmp(name, "opus")) {
+		*format = JANUS_AUDIOBRIDGE_REC_OPUS;
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
+/* WAV helpers */
+static gboolean janus_audiobridge_rec_wav_start(janus_audiobridge_rec *rec) {
+	janus_audiobridge_rec_wav_header header = {
+		{'R', 'I', 'F', 'F'},
+		0,
+		{'W', 'A', 'V', 'E'},
+		{'f', 'm', 't', ' '},
+		16,
+		1,
+		rec->channels,
+		rec->sampling_rate,
+		rec->sampling_rate * 2 * rec->channels,
+		2 * rec->channels,
+		16,
+		{'d', 'a', 't', 'a'},
+		0
+	};
+	if(fwrite(&header, 1, sizeof(header), rec->file) != sizeof(header)) {
+		JANUS_LOG(LOG_ERR, "Error writing WAV header...\n");
+		return FALSE;
+	}
+	fflush(rec->file);
+	rec->last_update = janus_get_monotonic_time();
+	return TRUE;
+}
+
+static void janus_audiobridge_rec_wav_update(janus_audiobridge_rec *rec) {
+	/* Update the length in the header */
+	fseek(rec->file, 0, SEEK_END);
+	long int size = ftell(rec->file);
+	if(size >= 8) {
+		uint32_t len = size - 8;
+		fseek(rec->file, 4, SEEK_SET);
+		fwrite(&len, sizeof(uint32_t), 1, rec->file);
+		len = size - sizeof(janus_audiobridge_rec_wav_header);
+		fseek(rec->file, 40, SEEK_SET);
+		fwrite(&len, sizeof(uint32_t), 1, rec->file);
+		fflush(rec->file);
+		fseek(rec->file, 0, SEEK_END);
+	}
+	rec->last_update = janus_get_monotonic_time();
+}
+
+#ifdef HAVE_LIBOGG
+/* Ogg/Opus helpers */
+static void janus_audiobridge_rec_ogg_write(janus_audiobridge_rec *rec, gboolean flush) {
+	ogg_page page;
+	while(flush ? ogg_stream_flush(&rec->stream, &page) : ogg_stream_pageout(&rec->stream, &page)) {
+		if(fwrite(page.header, 1, page.header_len, rec->file) != (size_t)page.header_len ||
+				fwrite(page.body, 1, page.body_len, rec->file) != (size_t)page.body_len) {
+			JANUS_LOG(LOG_ERR, "Error writing Ogg page to %s...\n", rec->filename);
+		}
+	}
+}
+
+static void janus_audiobridge_rec_ogg_packet(janus_audiobridge_rec *rec, unsigned char *data, int len,
+		ogg_int64_t granulepos, gboolean bos, gboolean eos) {
+	ogg_packet op;
+	op.packet = data;
+	op.bytes = len;
+	op.b_o_s = bos ? 1 : 0;
+	op.e_o_s = eos ? 1 : 0;
+	op.granulepos = granulepos;
+	op.packetno = rec->packetno++;
+	ogg_stream_packetin(&rec->stream, &op);
+}
+
+static void janus_audiobridge_rec_le16(unsigned char *dst, uint16_t value) {
+	dst[0] = value & 0xFF;
+	dst[1] = (value >> 8) & 0xFF;
+}
+
+static void janus_audiobridge_rec_le32(unsigned char *dst, uint32_t value) {
+	janus_audiobridge_rec_le16(dst, value & 0xFFFF);
+	janus_audiobridge_rec_le16(dst+2, (value >> 16) & 0xFFFF);
+}
+
+static gboolean janus_audiobridge_rec_opus_start(janus_audiobridge_rec *rec, int bitrate) {
+	int error = 0;
+	rec->encoder = opus_encoder_create(rec->sampling_rate, rec->channels, OPUS_APPLICATION_AUDIO, &error);
+	if(error != OPUS_OK) {
+		JANUS_LOG(LOG_ERR, "Error creating Opus encoder for recording: %d (%s)\n", error, opus_strerror(error));
+		return FALSE;
+	}
+	if(bitrate > 0)
+		opus_encoder_ctl(rec->encoder, OPUS_SET_BITRATE(bitrate));
+	if(ogg_stream_init(&rec->stream, g_random_int()) < 0) {
+		JANUS_LOG(LOG_ERR, "Error initializing Ogg stream for recording\n");
+		opus_encoder_destroy(rec->encoder);
+		rec->encoder = NULL;
+		return FALSE;
+	}
+	/* The lookahead is expressed at the rate of the encoder, while the pre-skip is always at 48kHz */
+	opus_int32 lookahead = 0;
+	opus_encoder_ctl(rec->encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+	int preskip = lookahead * (48000 / rec->sampling_rate);
+	/* ID header */
+	unsigned char head[19];
+	memcpy(head, "OpusHead", 8);
+	head[8] = 1;
+	head[9] = rec->channels;
+	janus_audiobridge_rec_le16(head+10, preskip);
+	janus_audiobridge_rec_le32(head+12, rec->sampling_rate);
+	janus_audiobridge_rec_le16(head+16, 0);
+	head[18] = 0;
+	janus_audiobridge_rec_ogg_packet(rec, head, sizeof(head), 0, TRUE, FALSE);
+	janus_audiobridge_rec_ogg_write(rec, TRUE);
+	/* Comment header */
+	const char *vendor = opus_get_version_string();
+	int vendor_len = strlen(vendor);
+	unsigned char *tags = g_malloc(8 + 4 + vendor_len + 4);
+	memcpy(tags, "OpusTags", 8);
+	janus_audiobridge_rec_le32(tags+8, vendor_len);
+	memcpy(tags+12, vendor, vendor_len);
+	janus_audiobridge_rec_le32(tags+12+vendor_len, 0);
+	janus_audiobridge_rec_ogg_packet(rec, tags, 8 + 4 + vendor_len + 4, 0, FALSE, FALSE);
+	janus_audiobridge_rec_ogg_write(rec, TRUE);
+	g_free(tags);
+	fflush(rec->file);
+	return TRUE;
+}
+
+static void janus_audiobridge_rec_opus_frame(janus_audiobridge_rec *rec, opus_int16 *samples, int num) {
+	/* Encode into a local buffer first, as we still have to push the previous packet */
+	unsigned char payload[1500];
+	int frame_size = num / rec->channels;
+	int len = opus_encode(rec->encoder, samples, frame_size, payload, sizeof(payload));
+	if(len < 0) {
+		JANUS_LOG(LOG_ERR, "Error encoding Opus frame for recording: %d (%s)\n", len, opus_strerror(len));
+		return;
+	}
+	if(rec->pending_len > 0) {
+		rec->granulepos += rec->pending_duration;
+		janus_audiobridge_rec_ogg_packet(rec, rec->pending, rec->pending_len, rec->granulepos, FALSE, FALSE);
+		janus_audiobridge_rec_ogg_write(rec, FALSE);
+	}
+	memcpy(rec->pending, payload, len);
+	rec->pending_len = len;
+	rec->pending_duration = (ogg_int64_t)frame_size * (48000 / rec->sampling_rate);
+}
+
+static void janus_audiobridge_rec_opus_finish(janus_audiobridge_rec *rec) {
+	if(rec->pending_len > 0) {
+		rec->granulepos += rec->pending_duration;
+		janus_audiobridge_rec_ogg_packet(rec, rec->pending, rec->pending_len, rec->granulepos, FALSE, TRUE);
+		rec->pending_len = 0;
+	}
+	janus_audiobridge_rec_ogg_write(rec, TRUE);
+}
+#endif
+
+/* Writer thread */
+static void *janus_audiobridge_rec_thread(void *data) {
+	janus_audiobridge_rec *rec = (janus_audiobridge_rec *)data;
+	JANUS_LOG(LOG_VERB, "Starting recorder thread for %s\n", rec->filename);
+	gboolean closing = FALSE;
+	while(!closing) {
+		/* Check if we need to stop before writing what's queued, so that
+		 * we don't miss frames the mixer queued right before closing */
+		closing = g_atomic_int_get(&rec->closing);
+		janus_audiobridge_rec_slot *slot = &rec->slots[rec->head & JANUS_AUDIOBRIDGE_REC_MASK];
+		while(g_atomic_int_get(&slot->full)) {
+			if(rec->format == JANUS_AUDIOBRIDGE_REC_WAV) {
+				if(fwrite(slot->samples, sizeof(opus_int16), slot->num, rec->file) != (size_t)slot->num)
+					JANUS_LOG(LOG_ERR, "Error writing to %s...\n", rec->filename);
+#ifdef HAVE_LIBOGG
+			} else {
+				janus_audiobridge_rec_opus_frame(rec, slot->samples, slot->num);
+#endif
+			}
+			g_atomic_int_set(&slot->full, 0);
+			rec->head++;
+			slot = &rec->slots[rec->head & JANUS_AUDIOBRIDGE_REC_MASK];
+		}
+		if(rec->format == JANUS_AUDIOBRIDGE_REC_WAV &&
+				janus_get_monotonic_time() - rec->last_update >= JANUS_AUDIOBRIDGE_REC_WAV_UPDATE) {
+			/* Update the WAV header, in case we never get to finalize the file */
+			janus_audiobridge_rec_wav_update(rec);
+		}
+		if(!closing)
+			g_usleep(20000);
+	}
+	/* We're done, finalize the file */
+	if(rec->format == JANUS_AUDIOBRIDGE_REC_WAV) {
+		janus_audiobridge_rec_wav_update(rec);
+#ifdef HAVE_LIBOGG
+	} else {
+		janus_audiobridge_rec_opus_finish(rec);
+		ogg_stream_clear(&rec->stream);
+		opus_encoder_destroy(rec->encoder);
+#endif
+	}
+	fclose(rec->file);
+	guint32 dropped = g_atomic_int_get(&rec->dropped);
+	if(dropped > 0)
+		JANUS_LOG(LOG_WARN, "Recording %s is missing %"SCNu32" frames, as the disk couldn't keep up\n", rec->filename, dropped);
+	const char *filename = rec->filename;
+	if(rec->final_filename != NULL) {
+		/* We need to rename the file, e.g., to remove the temporary extension */
+		if(rename(rec->filename, rec->final_filename) != 0) {
+			JANUS_LOG(LOG_ERR, "Error renaming %s to %s...\n", rec->filename, rec->final_filename);
+		} else {
+			JANUS_LOG(LOG_INFO, "Recording renamed: %s\n", rec->final_filename);
+			filename = rec->final_filename;
+		}
+	}
+	if(rec->done != NULL)
+		rec->done(filename, rec->user_data);
+	JANUS_LOG(LOG_VERB, "Leaving recorder thread for %s\n", rec->filename);
+	g_free(rec->filename);
+	g_free(rec->final_filename);
+	g_free(rec);
+	g_thread_unref(g_thread_self());
+	return NULL;
+}
+
+janus_audiobridge_rec *janus_audiobridge_rec_open(const char *filename, const char *final_filename,
+		janus_audiobridge_rec_format format, int sampling_rate, int channels, int bitrate) {
+	if(filename == NULL || sampling_rate <= 0 || sampling_rate > 48000 || channels < 1 || channels > 2)
+		return NULL;
+#ifndef HAVE_LIBOGG
+	if(format == JANUS_AUDIOBRIDGE_REC_OPUS) {
+		JANUS_LOG(LOG_ERR, "Opus recordings not supported (libogg missing)\n");
+		return NULL;
+	}
+#endif
+	FILE *file = fopen(filename, "wb");
+	if(file == NULL) {
+		JANUS_LOG(LOG_ERR, "Couldn't open %s for writing: %d (%s)\n", filename, errno, g_strerror(errno));
+		return NULL;
+	}
+	janus_audiobridge_rec *rec = g_malloc0(sizeof(janus_audiobridge_rec));
+	rec->format = format;
+	rec->sampling_rate = sampling_rate;
+	rec->channels = channels;
+	rec->filename = g_strdup(filename);
+	rec->final_filename = final_filename ? g_strdup(final_filename) : NULL;
+	rec->file = file;
+	gboolean ok = FALSE;
+	if(format == JANUS_AUDIOBRIDGE_REC_WAV) {
+		ok = janus_audiobridge_rec_wav_start(rec);
+#ifdef HAVE_LIBOGG
+	} else {
+		ok = janus_audiobridge_rec_opus_start(rec, bitrate);
+#endif
+	}
+	if(ok) {
+		GError *error = NULL;
+		rec->thread = g_thread_try_new("abridge rec", &janus_audiobridge_rec_thread, rec, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the recorder thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+#ifdef HAVE_LIBOGG
+			if(rec->encoder != NULL) {
+				ogg_stream_clear(&rec->stream);
+				opus_encoder_destroy(rec->encoder);
+			}
+#endif
+			ok = FALSE;
+		}
+	}
+	if(!ok) {
+		fclose(rec->file);
+		g_free(rec->filename);
+		g_free(rec->final_filename);
+		g_free(rec);
+		return NULL;
+	}
+	return rec;
+}
+
+gboolean janus_audiobridge_rec_write(janus_audiobridge_rec *rec, const opus_int16 *samples, int num) {
+	if(rec == NULL || samples == NULL || num <= 0 || num > JANUS_AUDIOBRIDGE_REC_MAX_SAMPLES)
+		return FALSE;
+	janus_audiobridge_rec_slot *slot = &rec->slots[rec->tail & JANUS_AUDIOBRIDGE_REC_MASK];
+	if(g_atomic_int_get(&slot->full)) {
+		/* The writer thread is too far behind, drop this frame */
+		g_atomic_int_inc(&rec->dropped);
+		return FALSE;
+	}
+	memcpy(slot->samples, samples, num * sizeof(opus_int16));
+	slot->num = num;
+	g_atomic_int_set(&slot->full, 1);
+	rec->tail++;
+	return TRUE;
+}
+
+guint32 janus_audiobridge_rec_dropped(janus_audiobridge_rec *rec) {
+	return rec ? (guint32)g_atomic_int_get(&rec->dropped) : 0;
+}
+
+void janus_audiobridge_rec_close(janus_audiobridge_rec *rec, janus_audiobridge_rec_done_cb done, gpointer user_data) {
+	if(rec == NULL)
+		return;
+	rec->done = done;
+	rec->user_data = user_data;
+	g_atomic_int_set(&rec->closing, 1);
+}
@@ -0,0 +1,92 @@
+/*! \file   janus_audiobridge_rec.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin room recorder (headers)
+ * \details  When a room is recorded, the mixer hands each frame of the
+ * mix to a room recorder, which takes care of writing it to disk on a
+ * thread of its own: this way, a slow disk never delays the mix. Frames
+ * are copied to a fixed number of slots in a ring buffer, which the mixer
+ * fills and the writer thread empties, so the two never need a mutex to
+ * hand frames over; in case the writer falls so far behind that the ring
+ * buffer is full, new frames are dropped rather than having the mixer wait.
+ *
+ * Recordings can be saved as WAV files, or, if the plugin was built with
+ * libogg support, as Opus files: in that case, the writer thread encodes
+ * the mix itself, which means much less data is written to disk.
+ *
+ * janus_audiobridge_rec_write() must only be called by the mixer. Closing
+ * a recorder is asynchronous as well: the writer thread writes the frames
+ * that are still queued, finalizes the file, and then frees the recorder.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#ifndef JANUS_AUDIOBRIDGE_REC_H
+#define JANUS_AUDIOBRIDGE_REC_H
+
+#include <glib.h>
+#include <opus/opus.h>
+
+/*! \brief Number of frames a recorder can queue (a power of 2) */
+#define JANUS_AUDIOBRIDGE_REC_SLOTS	256
+
+/*! \brief Room recording formats */
+typedef enum janus_audiobridge_rec_format {
+	/*! \brief Uncompressed WAV */
+	JANUS_AUDIOBRIDGE_REC_WAV = 0,
+	/*! \brief Opus in an Ogg container */
+	JANUS_AUDIOBRIDGE_REC_OPUS
+} janus_audiobridge_rec_format;
+
+/*! \brief Helper method to return the extension to use for a format
+ * @param[in] format The recording format
+ * @returns The extension, without the dot (e.g., "wav") */
+const char *janus_audiobridge_rec_format_extension(janus_audiobridge_rec_format format);
+
+/*! \brief Helper method to parse a recording format
+ * @param[in] name Name of the format (e.g., "opus")
+ * @param[out] format Where to write the parsed format
+ * @returns TRUE if the format is supported, FALSE otherwise */
+gboolean janus_audiobridge_rec_format_parse(const char *name, janus_audiobridge_rec_format *format);
+
+/*! \brief Room recorder instance */
+typedef struct janus_audiobridge_rec janus_audiobridge_rec;
+
+/*! \brief Callback to invoke once a recording has been finalized
+ * @param[in] filename Path of the recording
+ * @param[in] user_data Opaque pointer passed to janus_audiobridge_rec_close() */
+typedef void (*janus_audiobridge_rec_done_cb)(const char *filename, gpointer user_data);
+
+/*! \brief Create a recorder, open the file and start the writer thread
+ * @param[in] filename Path of the file to write to
+ * @param[in] final_filename If the file must be renamed when done (e.g., to get rid
+ * of a temporary extension), path of the final file; NULL otherwise
+ * @param[in] format Format of the recording
+ * @param[in] sampling_rate Sampling rate of the mix
+ * @param[in] channels Number of channels of the mix (1 or 2)
+ * @param[in] bitrate For Opus recordings, the bitrate to encode at (0 to let libopus decide)
+ * @returns A new janus_audiobridge_rec instance, or NULL in case of errors */
+janus_audiobridge_rec *janus_audiobridge_rec_open(const char *filename, const char *final_filename,
+	janus_audiobridge_rec_format format, int sampling_rate, int channels, int bitrate);
+
+/*! \brief Queue a frame of the mix to be written (mixer only)
+ * @param[in] rec The janus_audiobridge_rec instance to queue the frame to
+ * @param[in] samples The samples to record (interleaved, if stereo)
+ * @param[in] num Number of samples (for all channels), at most 1920
+ * @returns TRUE if the frame was queued, FALSE if it had to be dropped */
+gboolean janus_audiobridge_rec_write(janus_audiobridge_rec *rec, const opus_int16 *samples, int num);
+
+/*! \brief Get how many frames were dropped so far, because the writer fell behind
+ * @param[in] rec The janus_audiobridge_rec instance to check
+ * @returns The number of dropped frames */
+guint32 janus_audiobridge_rec_dropped(janus_audiobridge_rec *rec);
+
+/*! \brief Stop recording: the writer thread finalizes the file and frees
+ * the recorder asynchronously, so the instance must not be used anymore
+ * @param[in] rec The janus_audiobridge_rec instance to close
+ * @param[in] done Callback to invoke, on the writer thread, when the file has been finalized (optional)
+ * @param[in] user_data Opaque pointer to pass to the callback */
+void janus_audiobridge_rec_close(janus_audiobridge_rec *rec, janus_audiobridge_rec_done_cb done, gpointer user_data);
+
+#endif
@@ -0,0 +1,165 @@
+/*! \file   janus_audiobridge_resampler.c
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin resampler
+ * \details  Implementation of the polyphase resampler the AudioBridge uses
+ * for G.711 participants and forwarders. Converting from a rate to another
+ * is seen as upsampling by a factor \c up, lowpass filtering, and then
+ * downsampling by a factor \c down: the filter is a Blackman windowed sinc,
+ * split in \c up phases so that only the coefficients that would multiply
+ * non-zero samples are ever used. The coefficients of each phase are stored
+ * in reverse order, which makes the inner loop a plain dot product the
+ * compiler can vectorize.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "janus_audiobridge_resampler.h"
+
+/* Maximum interpolation/decimation factor (e.g., 8kHz <-> 48kHz) */
+#define JANUS_AUDIOBRIDGE_RESAMPLER_MAX_FACTOR	6
+/* Taps of each phase, for each unit of decimation */
+#define JANUS_AUDIOBRIDGE_RESAMPLER_TAPS		16
+
+/* Filter for a specific ratio, shared by all resamplers that need it */
+typedef struct janus_audiobridge_resampler_filter {
+	int up, down;		/* Interpolation and decimation factors */
+	int taps;			/* Number of coefficients in each phase */
+	float *phases;		/* The up phases, taps coefficients each (reversed) */
+} janus_audiobridge_resampler_filter;
+static janus_audiobridge_resampler_filter
+	*filters[JANUS_AUDIOBRIDGE_RESAMPLER_MAX_FACTOR+1][JANUS_AUDIOBRIDGE_RESAMPLER_MAX_FACTOR+1];
+G_LOCK_DEFINE_STATIC(filters);
+
+struct janus_audiobridge_resampler {
+	int input_rate, output_rate;	/* Rates we're currently resampling between */
+	const janus_audiobridge_resampler_filter *filter;	/* Filter for those rates */
+	int offset;			/* Position of the next output sample, in 1/up input samples from the next input */
+	opus_int16 *work;	/* History of the stream (taps-1 samples), followed by the input */
+	int work_size;		/* Size of the work buffer, in samples */
+};
+
+static int janus_audiobridge_resampler_gcd(int a, int b) {
+	while(b != 0) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static janus_audiobridge_resampler_filter *janus_audiobridge_resampler_filter_design(int up, int down) {
+	janus_audiobridge_resampler_filter *filter = g_malloc0(sizeof(janus_audiobridge_resampler_filter));
+	filter->up = up;
+	filter->down = down;
+	filter->taps = JANUS_AUDIOBRIDGE_RESAMPLER_TAPS * down;
+	int len = filter->taps * up, n = 0;
+	/* Cut a bit below the lowest of the two Nyquist frequencies: the
+	 * frequency is relative to the rate of the upsampled signal */
+	double cutoff = 0.45 / MAX(up, down), center = (len - 1) / 2.0, sum = 0.0;
+	double *h = g_malloc(len * sizeof(double));
+	for(n=0; n<len; n++) {
+		double x = n - center;
+		double sinc = (x == 0.0) ? 2.0 * cutoff : sin(2.0 * G_PI * cutoff * x) / (G_PI * x);
+		double window = 0.42 - 0.5 * cos(2.0 * G_PI * n / (len - 1)) + 0.08 * cos(4.0 * G_PI * n / (len - 1));
+		h[n] = sinc * window;
+		sum += h[n];
+	}
+	/* Normalize, so that each phase has unity gain */
+	filter->phases = g_malloc(len * sizeof(float));
+	int phase = 0, k = 0;
+	for(phase=0; phase<up; phase++) {
+		for(k=0; k<filter->taps; k++)
+			filter->phases[phase*filter->taps + (filter->taps-1-k)] = (float)(h[phase + k*up] * up / sum);
+	}
+	g_free(h);
+	return filter;
+}
+
+static const janus_audiobridge_resampler_filter *janus_audiobridge_resampler_filter_get(int input_rate, int output_rate) {
+	if(input_rate <= 0 || output_rate <= 0)
+		return NULL;
+	int gcd = janus_audiobridge_resampler_gcd(input_rate, output_rate);
+	int up = output_rate/gcd, down = input_rate/gcd;
+	if(up > JANUS_AUDIOBRIDGE_RESAMPLER_MAX_FACTOR || down > JANUS_AUDIOBRIDGE_RESAMPLER_MAX_FACTOR)
+		return NULL;
+	G_LOCK(filters);
+	if(filters[up][down] == NULL)
+		filters[up][down] = janus_audiobridge_resampler_filter_design(up, down);
+	janus_audiobridge_resampler_filter *filter = filters[up][down];
+	G_UNLOCK(filters);
+	return filter;
+}
+
+janus_audiobridge_resampler *janus_audiobridge_resampler_new(void) {
+	return g_malloc0(sizeof(janus_audiobridge_resampler));
+}
+
+void janus_audiobridge_resampler_destroy(janus_audiobridge_resampler *resampler) {
+	if(resampler == NULL)
+		return;
+	g_free(resampler->work);
+	g_free(resampler);
+}
+
+void janus_audiobridge_resampler_reset(janus_audiobridge_resampler *resampler) {
+	if(resampler == NULL)
+		return;
+	resampler->offset = 0;
+	if(resampler->work != NULL)
+		memset(resampler->work, 0, resampler->work_size * sizeof(opus_int16));
+}
+
+int janus_audiobridge_resampler_process(janus_audiobridge_resampler *resampler,
+		const opus_int16 *input, int input_num, int input_rate, opus_int16 *output, int output_rate) {
+	if(resampler == NULL || input == NULL || output == NULL || input_num <= 0)
+		return 0;
+	if(input_rate == output_rate) {
+		/* Easy enough */
+		memcpy(output, input, input_num * sizeof(opus_int16));
+		return input_num;
+	}
+	if(resampler->filter == NULL || resampler->input_rate != input_rate || resampler->output_rate != output_rate) {
+		/* New rates, start over */
+		const janus_audiobridge_resampler_filter *filter = janus_audiobridge_resampler_filter_get(input_rate, output_rate);
+		if(filter == NULL)
+			return 0;
+		resampler->filter = filter;
+		resampler->input_rate = input_rate;
+		resampler->output_rate = output_rate;
+		janus_audiobridge_resampler_reset(resampler);
+	}
+	const janus_audiobridge_resampler_filter *filter = resampler->filter;
+	int history = filter->taps - 1;
+	if(resampler->work_size < history + input_num) {
+		int old_size = resampler->work_size;
+		resampler->work_size = history + input_num;
+		resampler->work = g_realloc(resampler->work, resampler->work_size * sizeof(opus_int16));
+		memset(resampler->work + old_size, 0, (resampler->work_size - old_size) * sizeof(opus_int16));
+	}
+	memcpy(resampler->work + history, input, input_num * sizeof(opus_int16));
+	/* Each output sample is the dot product of one of the phases and the
+	 * taps input samples ending with the one it's aligned to */
+	int written = 0, end = input_num * filter->up, k = 0;
+	while(resampler->offset < end) {
+		int base = resampler->offset / filter->up, phase = resampler->offset % filter->up;
+		const float *coeffs = filter->phases + phase*filter->taps;
+		const opus_int16 *samples = resampler->work + base;
+		float acc = 0.0f;
+		for(k=0; k<filter->taps; k++)
+			acc += coeffs[k] * samples[k];
+		acc = roundf(acc);
+		output[written++] = acc > 32767.0f ? 32767 : (acc < -32768.0f ? -32768 : (opus_int16)acc);
+		resampler->offset += filter->down;
+	}
+	resampler->offset -= end;
+	/* Keep the latest samples as the history for the next frame */
+	memmove(resampler->work, resampler->work + input_num, history * sizeof(opus_int16));
+	return written;
+}
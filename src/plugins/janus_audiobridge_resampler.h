@@ -0,0 +1,54 @@
+/*! \file   janus_audiobridge_resampler.h
+ * \author Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief  Janus AudioBridge plugin resampler (headers)
+ * \details  The AudioBridge mixes audio at the sampling rate of the room,
+ * which means G.711 participants and forwarders (always 8kHz) need their
+ * audio resampled. This is a polyphase FIR resampler for all the rational
+ * ratios between the sampling rates a room can use. The filters only
+ * depend on the input and output rates, and so are designed once (the
+ * first time they're needed) and shared by all resamplers that use them,
+ * while each resampler keeps the history of the stream it's resampling,
+ * so that consecutive frames are filtered as a continuous signal.
+ *
+ * A resampler is not thread safe, and is meant to be used for a single
+ * mono stream: if the rates change, the resampler starts over.
+ *
+ * \ingroup plugins
+ * \ref plugins
+ */
+
+#ifndef JANUS_AUDIOBRIDGE_RESAMPLER_H
+#define JANUS_AUDIOBRIDGE_RESAMPLER_H
+
+#include <opus/opus.h>
+
+/*! \brief Resampler instance */
+typedef struct janus_audiobridge_resampler janus_audiobridge_resampler;
+
+/*! \brief Create a new resampler
+ * @returns A new janus_audiobridge_resampler instance */
+janus_audiobridge_resampler *janus_audiobridge_resampler_new(void);
+
+/*! \brief Destroy a resampler
+ * @param[in] resampler The janus_audiobridge_resampler instance to destroy */
+void janus_audiobridge_resampler_destroy(janus_audiobridge_resampler *resampler);
+
+/*! \brief Forget the history of the stream, e.g., because there was a gap
+ * @param[in] resampler The janus_audiobridge_resampler instance to reset */
+void janus_audiobridge_resampler_reset(janus_audiobridge_resampler *resampler);
+
+/*! \brief Resample a frame
+ * @note The output buffer must be large enough for input_num*output_rate/input_rate
+ * samples, plus one, and can't be the same as the input buffer
+ * @param[in] resampler The janus_audiobridge_resampler instance to use
+ * @param[in] input The samples to resample
+ * @param[in] input_num The number of samples to resample
+ * @param[in] input_rate The sampling rate of the input
+ * @param[out] output Where to write the resampled samples
+ * @param[in] output_rate The sampling rate of the output
+ * @returns The number of samples written to the output, or 0 if the rates are not supported */
+int janus_audiobridge_resampler_process(janus_audiobridge_resampler *resampler,
+	const opus_int16 *input, int input_num, int input_rate, opus_int16 *output, int output_rate);
+
+#endif
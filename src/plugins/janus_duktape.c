@@ -59,7 +59,13 @@
  * with \c incomingTextData() or \c incomingBinaryData
  * though, the performance impact of directly processing and manipulating
  * RTP an RTCP packets is probably too high, and so their usage is currently
- * discouraged. The \c dataReady() callback can be used to figure out when
+ * discouraged: media routing is meant to be declarative instead, i.e.,
+ * the script uses \c addRecipient() \c configureMedium() and \c setSubstream()
+ * to fill a forwarding table in the C code, which then relays packets
+ * without ever entering the JavaScript engine. If a script does implement
+ * \c incomingRtp() or \c incomingRtcp() but only needs them for some
+ * sessions, it can call \c setMediaHooks() to have the packets of all
+ * the other sessions relayed natively as if they weren't implemented. The \c dataReady() callback can be used to figure out when
  * data can be sent. As an additional note, JavaScript scripts can also decide to
  * implement the functions that return information about the plugin itself,
  * namely \c getVersion() \c getVersionString() \c getDescription()
@@ -95,13 +101,19 @@
  * - \c removeRecipient(): specify which user should not receive a user's media anymore;
  * - \c setBitrate(): specify the bitrate to force on a user via REMB feedback;
  * - \c setPliFreq(): specify how often the plugin should send a PLI to this user;
+ * - \c setMediaHooks(): specify whether a user's RTP/RTCP should be passed to \c incomingRtp()/\c incomingRtcp() or relayed natively;
  * - \c setSubstream(): set the target simulcast substream;
  * - \c setTemporalLayer(): set the target simulcast temporal layer;
  * - \c sendPli(): send a PLI (keyframe request);
  * - \c startRecording(): start recording audio, video and or data for a user;
  * - \c stopRecording(): start recording audio, video and or data for a user;
  * - \c pokeScheduler(): notify the C code that there's a coroutine to resume;
- * - \c timeCallback(): trigger the execution of a JavaScript function after X milliseconds.
+ * - \c timeCallback(): trigger the execution of a JavaScript function after X milliseconds;
+ * - \c setSharedData(): share a string value with the scripts in all Duktape contexts;
+ * - \c getSharedData(): retrieve a value shared via \c setSharedData();
+ * - \c getContextId(): get the index of the Duktape context the script is running in;
+ * - \c getContextStats(): get usage stats on all Duktape contexts, as a JSON string;
+ * - \c getAsyncEventsStats(): get stats on the events sent asynchronously, as a JSON string.
  *
  * As anticipated in the previous section, almost all these methods also
  * expect the unique session identifier to address a specific user in the
@@ -117,7 +129,8 @@
  * JavaScript scripts, you can leverage a scheduler implemented in the C code.
  *
  * More specifically, when the plugin starts a dedicated thread is devoted
- * to the only purpose of acting as a scheduler for JavaScript coroutines. This
+ * to the only purpose of acting as a scheduler for JavaScript coroutines (one
+ * per Duktape context, if \ref jcontexts "more than one" was configured). This
  * means that, whenever this C scheduler is awaken, it will call the
  * \c resumeScheduler() function in the JavaScript script, thus allowing the
  * JavaScript script to execute one or more pending coroutines. The C scheduler
@@ -186,11 +199,62 @@ timeCallback("resumeScheduler", null, 0);
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section jcontexts Multiple Duktape contexts
+ *
+ * By default, the plugin creates a single Duktape context, which means
+ * that all requests, media callbacks and coroutines of all sessions are
+ * serialized on it, and so a busy script can only make use of a single
+ * core. If that's a problem, you can set the \c contexts property in the
+ * configuration file to the number of contexts to create instead (or
+ * \c auto to create one per core). Each context is a separate Duktape
+ * heap that loads its own copy of the script (which means \c init() and
+ * \c destroy() are invoked once per context), has its own
+ * \ref jcoroutines "scheduler thread", and timed callbacks are always
+ * invoked in the context that asked for them. New sessions are bound to
+ * the context serving the fewest sessions, and all the callbacks for a
+ * session are always invoked in that context, so that sessions in
+ * different contexts can be served in parallel.
+ *
+ * This has an important consequence: JavaScript variables are NOT shared
+ * by different contexts, and so a script only sees the sessions that were
+ * bound to its own context. Everything the C code handles (e.g., sending
+ * events, routing media via \c addRecipient(), etc.) works no matter
+ * which context the involved sessions are bound to, but any information
+ * the script itself needs to share with its instances in other contexts
+ * (e.g., which rooms exist, or who's in them) must go through the C code
+ * explicitly, via the \c setSharedData() and \c getSharedData() functions:
+ *
+ * \verbatim
+// Share a string (e.g., some JSON) with all the other contexts
+setSharedData("room-1234", JSON.stringify(room));
+// Retrieve it (null if there's no such key)
+var room = JSON.parse(getSharedData("room-1234"));
+// Remove it
+setSharedData("room-1234", null);
+\endverbatim
+ *
+ * Plugin-wide requests that are not bound to a session (e.g., Admin API
+ * messages, or the methods to get the plugin name and version) are always
+ * handled by the first context, i.e., the one where \c getContextId()
+ * returns 0. Scripts that were not written with multiple contexts in mind
+ * should keep using a single one.
+ *
+ * To check whether the load is evenly spread, \c getContextStats()
+ * returns a JSON array with an object per context, containing the number
+ * of sessions bound to it (\c sessions), how many times JavaScript code
+ * was invoked in it (\c calls), the time spent running JavaScript code
+ * (\c busy_time) and how much of that was actual CPU time (\c cpu_time),
+ * and the average and maximum latency of the invocations (\c avg_latency
+ * and \c max_latency), which includes the time spent waiting for the
+ * context to be available: all times are in microseconds. A context whose
+ * latency is much higher than its busy time per call is a bottleneck.
+ *
  * Refer to the \ref jspapi section for more information on how you
  * can register your own C functions.
  */
 
 #include <jansson.h>
+#include <time.h>
 
 /* Session definition and hashtable */
 #include "janus_duktape_data.h"
@@ -270,8 +334,11 @@ janus_callbacks *duktape_janus_core = NULL;
 static char *duktape_folder = NULL;
 
 /* Duktape stuff */
-duk_context *duktape_ctx = NULL;
-janus_mutex duktape_mutex = JANUS_MUTEX_INITIALIZER;
+janus_duktape_context **duktape_contexts = NULL;
+static int duktape_contexts_num = 1;
+#define JANUS_DUKTAPE_MAX_CONTEXTS	64
+/* Property we save the janus_duktape_context pointer with in the heap stash of each context */
+#define JANUS_DUKTAPE_CONTEXT_KEY	"janusContext"
 static const char *duktape_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -302,10 +369,8 @@ static gboolean has_data_ready = FALSE;
 static gboolean has_slow_link = FALSE;
 static gboolean has_substream_changed = FALSE;
 static gboolean has_temporal_changed = FALSE;
-/* JavaScript C scheduler (for coroutines) */
-static GThread *scheduler_thread = NULL;
+/* JavaScript C scheduler (for coroutines), one per context */
 static void *janus_duktape_scheduler(void *data);
-static GAsyncQueue *events = NULL;
 typedef enum janus_duktape_event {
 	janus_duktape_event_none = 0,
 	janus_duktape_event_resume,		/* Resume one or more pending coroutines */
@@ -323,8 +388,8 @@ typedef struct janus_duktape_callback {
 	GSource *source;
 	char *function;
 	char *argument;
+	janus_duktape_context *context;
 } janus_duktape_callback;
-static GHashTable *callbacks = NULL;
 static void janus_duktape_callback_free(janus_duktape_callback *cb) {
 	if(!cb)
 		return;
@@ -334,6 +399,71 @@ static void janus_duktape_callback_free(janus_duktape_callback *cb) {
 	g_free(cb->argument);
 	g_free(cb);
 }
+/* Data the script instances in different contexts can share */
+static GHashTable *shared_data = NULL;
+static janus_mutex shared_data_mutex = JANUS_MUTEX_INITIALIZER;
+
+janus_duktape_context *janus_duktape_context_from(duk_context *ctx) {
+	if(ctx == NULL)
+		return NULL;
+	duk_push_heap_stash(ctx);
+	duk_get_prop_string(ctx, -1, JANUS_DUKTAPE_CONTEXT_KEY);
+	janus_duktape_context *context = (janus_duktape_context *)duk_get_pointer(ctx, -1);
+	duk_pop_2(ctx);
+	return context;
+}
+
+/* Helpers to serialize access to a context, keeping track of how busy it is */
+static gint64 janus_duktape_cpu_time(void) {
+	/* CPU time spent by the current thread, in microseconds */
+	struct timespec ts;
+	if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+		return 0;
+	return (gint64)ts.tv_sec*G_USEC_PER_SEC + ts.tv_nsec/1000;
+}
+static void janus_duktape_context_lock(janus_duktape_context *context) {
+	gint64 requested = janus_get_monotonic_time();
+	janus_mutex_lock(&context->mutex);
+	context->requested = requested;
+	context->acquired = janus_get_monotonic_time();
+	context->cpu_acquired = janus_duktape_cpu_time();
+}
+static void janus_duktape_context_unlock(janus_duktape_context *context) {
+	gint64 now = janus_get_monotonic_time();
+	gint64 cpu = janus_duktape_cpu_time() - context->cpu_acquired;
+	gint64 latency = now - context->requested;
+	janus_mutex_lock(&context->stats_mutex);
+	context->calls++;
+	context->busy_time += now - context->acquired;
+	context->cpu_time += cpu;
+	context->total_latency += latency;
+	if(latency > context->max_latency)
+		context->max_latency = latency;
+	janus_mutex_unlock(&context->stats_mutex);
+	janus_mutex_unlock(&context->mutex);
+}
+/* Helper to return the stats on all contexts as a string (must be freed) */
+static char *janus_duktape_context_stats(void) {
+	json_t *list = json_array();
+	int i=0;
+	for(i=0; duktape_contexts != NULL && duktape_contexts[i] != NULL; i++) {
+		janus_duktape_context *context = duktape_contexts[i];
+		json_t *stats = json_object();
+		json_object_set_new(stats, "id", json_integer(context->id));
+		json_object_set_new(stats, "sessions", json_integer(g_atomic_int_get(&context->sessions)));
+		janus_mutex_lock(&context->stats_mutex);
+		json_object_set_new(stats, "calls", json_integer(context->calls));
+		json_object_set_new(stats, "busy_time", json_integer(context->busy_time));
+		json_object_set_new(stats, "cpu_time", json_integer(context->cpu_time));
+		json_object_set_new(stats, "avg_latency", json_integer(context->calls ? context->total_latency/context->calls : 0));
+		json_object_set_new(stats, "max_latency", json_integer(context->max_latency));
+		janus_mutex_unlock(&context->stats_mutex);
+		json_array_append_new(list, stats);
+	}
+	char *text = json_dumps(list, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
+	json_decref(list);
+	return text;
+}
 
 /* Helper function to sample the number of occupied slots into JavaScript stack */
 static void janus_duktape_stackdump(duk_context *ctx) {
@@ -397,6 +527,13 @@ typedef struct janus_duktape_async_event {
 	json_t *event;						/* Content of the notification, if any */
 	json_t *jsep;						/* Content of JSEP SDP, if any */
 } janus_duktape_async_event;
+/* Pool of threads to push events that need to be asynchronous (0 means a thread per event) */
+#define JANUS_DUKTAPE_DEFAULT_ASYNC_THREADS	4
+#define JANUS_DUKTAPE_MAX_ASYNC_THREADS		64
+static int async_threads = JANUS_DUKTAPE_DEFAULT_ASYNC_THREADS;
+static GThreadPool *async_events = NULL;
+/* How many events were sent asynchronously, and how many were queued at most */
+static volatile gint async_events_pushed = 0, async_events_max_queued = 0;
 /* Helper thread to push events that need to be asynchronous, e.g., for those
  * that would keep the Duktape context busy longer than usual and cause delays,
  * or those that might actually result in a deadlock if done synchronously */
@@ -415,6 +552,45 @@ static void *janus_duktape_async_event_helper(void *data) {
 	g_free(asev);
 	return NULL;
 }
+/* Same as above, but as a task of the async events pool */
+static void janus_duktape_async_event_task(gpointer data, gpointer user_data) {
+	janus_duktape_async_event_helper(data);
+}
+/* Helper to send an event asynchronously, via the pool if we have one */
+static gboolean janus_duktape_async_event_push(janus_duktape_async_event *asev) {
+	GError *error = NULL;
+	if(async_events != NULL) {
+		g_thread_pool_push(async_events, asev, &error);
+	} else {
+		g_thread_try_new("duktape pushevent", janus_duktape_async_event_helper, asev, &error);
+	}
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape pushevent thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		return FALSE;
+	}
+	g_atomic_int_inc(&async_events_pushed);
+	if(async_events != NULL) {
+		/* Keep track of the queue depth, so that it can be monitored */
+		gint queued = g_thread_pool_unprocessed(async_events);
+		gint max = g_atomic_int_get(&async_events_max_queued);
+		while(queued > max && !g_atomic_int_compare_and_exchange(&async_events_max_queued, max, queued))
+			max = g_atomic_int_get(&async_events_max_queued);
+	}
+	return TRUE;
+}
+/* Helper to return the stats on asynchronous events as a string (must be freed) */
+static char *janus_duktape_async_event_stats(void) {
+	json_t *stats = json_object();
+	json_object_set_new(stats, "threads", json_integer(async_events ? async_threads : 0));
+	json_object_set_new(stats, "queued", json_integer(async_events ? g_thread_pool_unprocessed(async_events) : 0));
+	json_object_set_new(stats, "max_queued", json_integer(g_atomic_int_get(&async_events_max_queued)));
+	json_object_set_new(stats, "pushed", json_integer(g_atomic_int_get(&async_events_pushed)));
+	char *text = json_dumps(stats, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
+	json_decref(stats);
+	return text;
+}
 
 
 /* Helper method to stringify Duktape types */
@@ -450,6 +626,73 @@ static duk_ret_t janus_duktape_method_getversion(duk_context *ctx) {
 	return 1;
 }
 
+static duk_ret_t janus_duktape_method_getasynceventsstats(duk_context *ctx) {
+	/* This method allows the JavaScript code to monitor the events that are sent asynchronously */
+	char *stats = janus_duktape_async_event_stats();
+	duk_push_string(ctx, stats);
+	free(stats);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_setshareddata(duk_context *ctx) {
+	/* This method allows the JavaScript script to share a value with the other contexts */
+	if(duk_get_type(ctx, 0) != DUK_TYPE_STRING) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_STRING &&
+			duk_get_type(ctx, 1) != DUK_TYPE_UNDEFINED && duk_get_type(ctx, 1) != DUK_TYPE_NULL) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	const char *key = duk_get_string(ctx, 0);
+	const char *value = duk_get_string(ctx, 1);
+	janus_mutex_lock(&shared_data_mutex);
+	if(value == NULL)
+		g_hash_table_remove(shared_data, key);
+	else
+		g_hash_table_insert(shared_data, g_strdup(key), g_strdup(value));
+	janus_mutex_unlock(&shared_data_mutex);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_getshareddata(duk_context *ctx) {
+	/* This method allows the JavaScript script to retrieve a value shared by any of the contexts */
+	if(duk_get_type(ctx, 0) != DUK_TYPE_STRING) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_STRING), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	const char *key = duk_get_string(ctx, 0);
+	/* We copy the value to the Duktape stack while holding the lock, as it may be replaced right after */
+	janus_mutex_lock(&shared_data_mutex);
+	const char *value = g_hash_table_lookup(shared_data, key);
+	if(value == NULL)
+		duk_push_null(ctx);
+	else
+		duk_push_string(ctx, value);
+	janus_mutex_unlock(&shared_data_mutex);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_getcontextid(duk_context *ctx) {
+	/* This method allows the JavaScript script to know which of the contexts it's running in */
+	janus_duktape_context *context = janus_duktape_context_from(ctx);
+	duk_push_int(ctx, context ? (int)context->id : -1);
+	return 1;
+}
+
+static duk_ret_t janus_duktape_method_getcontextstats(duk_context *ctx) {
+	/* This method allows the JavaScript code to monitor how busy each context is */
+	char *stats = janus_duktape_context_stats();
+	duk_push_string(ctx, stats);
+	free(stats);
+	return 1;
+}
+
 static duk_ret_t janus_duktape_method_readfile(duk_context *ctx) {
 	/* Helper method to read a text file and return its content as a string */
 	if(duk_get_type(ctx, 0) != DUK_TYPE_STRING) {
@@ -491,7 +734,8 @@ static duk_ret_t janus_duktape_method_readfile(duk_context *ctx) {
 
 static duk_ret_t janus_duktape_method_pokescheduler(duk_context *ctx) {
 	/* This method allows the JavaScript script to poke the scheduler and have it wake up ASAP */
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_duktape_event_resume));
+	janus_duktape_context *context = janus_duktape_context_from(ctx);
+	g_async_queue_push(context->events, GUINT_TO_POINTER(janus_duktape_event_resume));
 	duk_push_int(ctx, 0);
 	return 1;
 }
@@ -522,9 +766,10 @@ static duk_ret_t janus_duktape_method_timecallback(duk_context *ctx) {
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
 	cb->ms = ms;
+	cb->context = janus_duktape_context_from(ctx);
 	cb->source = g_timeout_source_new(ms);
 	g_source_set_callback(cb->source, janus_duktape_timer_cb, cb, NULL);
-	g_hash_table_insert(callbacks, cb, cb);
+	g_hash_table_insert(cb->context->callbacks, cb, cb);
 	cb->id = g_source_attach(cb->source, timer_context);
 	JANUS_LOG(LOG_VERB, "Created scheduled callback (%"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
 	/* Done */
@@ -622,12 +867,8 @@ static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 		}
 		janus_sdp_destroy(parsed_sdp);
 		/* Send asynchronously */
-		GError *error = NULL;
-		g_thread_try_new("duktape pushevent", janus_duktape_async_event_helper, asev, &error);
-		if(error != NULL) {
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape pushevent thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
+		gboolean sent = janus_duktape_async_event_push(asev);
+		if(!sent) {
 			json_decref(event);
 			json_decref(jsep);
 			g_free(asev->transaction);
@@ -635,7 +876,7 @@ static duk_ret_t janus_duktape_method_pushevent(duk_context *ctx) {
 			g_free(asev);
 		}
 		/* Return a success/error right away */
-		if(error) {
+		if(!sent) {
 			duk_push_error_object(ctx, DUK_ERR_ERROR, "Error spawning pushevent thread");
 			return duk_throw(ctx);
 		}
@@ -971,6 +1212,45 @@ static duk_ret_t janus_duktape_method_setplifreq(duk_context *ctx) {
 	return 1;
 }
 
+static duk_ret_t janus_duktape_method_setmediahooks(duk_context *ctx) {
+	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_NUMBER), janus_duktape_type_string(duk_get_type(ctx, 0)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 1) != DUK_TYPE_BOOLEAN) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_BOOLEAN), janus_duktape_type_string(duk_get_type(ctx, 1)));
+		return duk_throw(ctx);
+	}
+	if(duk_get_type(ctx, 2) != DUK_TYPE_BOOLEAN) {
+		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
+			janus_duktape_type_string(DUK_TYPE_BOOLEAN), janus_duktape_type_string(duk_get_type(ctx, 2)));
+		return duk_throw(ctx);
+	}
+	uint32_t id = (uint32_t)duk_get_number(ctx, 0);
+	int rtp = duk_get_boolean(ctx, 1);
+	int rtcp = duk_get_boolean(ctx, 2);
+	/* Find the session */
+	janus_mutex_lock(&duktape_sessions_mutex);
+	janus_duktape_session *session = g_hash_table_lookup(duktape_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&duktape_sessions_mutex);
+		duk_push_error_object(ctx, DUK_ERR_ERROR, "Session %"SCNu32" doesn't exist", id);
+		return duk_throw(ctx);
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&duktape_sessions_mutex);
+	/* When disabled, packets are handled as if the script didn't implement
+	 * incomingRtp/incomingRtcp, i.e., relayed natively to the recipients */
+	session->rtp_hook = rtp ? TRUE : FALSE;
+	session->rtcp_hook = rtcp ? TRUE : FALSE;
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	duk_push_int(ctx, 0);
+	return 1;
+}
+
 static duk_ret_t janus_duktape_method_setsubstream(duk_context *ctx) {
 	if(duk_get_type(ctx, 0) != DUK_TYPE_NUMBER) {
 		duk_push_error_object(ctx, DUK_RET_TYPE_ERROR, "Invalid argument (expected %s, got %s)\n",
@@ -1480,6 +1760,149 @@ static duk_ret_t janus_duktape_method_stoprecording(duk_context *ctx) {
 }
 
 
+/* Helpers to create and get rid of Duktape contexts */
+static void janus_duktape_context_destroy(janus_duktape_context *context);
+static janus_duktape_context *janus_duktape_context_create(guint id, const char *duktape_file, const char *script, size_t len) {
+	janus_duktape_context *context = g_malloc0(sizeof(janus_duktape_context));
+	context->id = id;
+	janus_mutex_init(&context->mutex);
+	janus_mutex_init(&context->stats_mutex);
+	context->events = g_async_queue_new();
+	context->callbacks = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_duktape_callback_free);
+	duk_context *ctx = duk_create_heap_default();
+	if(ctx == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
+		janus_duktape_context_destroy(context);
+		return NULL;
+	}
+	context->ctx = ctx;
+	duk_console_init(ctx, DUK_CONSOLE_PROXY_WRAPPER);
+	duk_module_duktape_init(ctx);
+	/* Keep track of the context in the heap stash, so that our functions know where they're invoked from */
+	duk_push_heap_stash(ctx);
+	duk_push_pointer(ctx, context);
+	duk_put_prop_string(ctx, -2, JANUS_DUKTAPE_CONTEXT_KEY);
+	duk_pop(ctx);
+
+	/* Register our functions */
+	duk_push_c_function(ctx, janus_duktape_method_getmodulesfolder, 0);
+	duk_put_global_string(ctx, "getModulesFolder");
+	duk_push_c_function(ctx, janus_duktape_method_readfile, 1);
+	duk_put_global_string(ctx, "readFile");
+	duk_push_c_function(ctx, janus_duktape_method_pokescheduler, 0);
+	duk_put_global_string(ctx, "pokeScheduler");
+	duk_push_c_function(ctx, janus_duktape_method_timecallback, 3);
+	duk_put_global_string(ctx, "timeCallback");
+	duk_push_c_function(ctx, janus_duktape_method_pushevent, 4);
+	duk_put_global_string(ctx, "pushEvent");
+	duk_push_c_function(ctx, janus_duktape_method_notifyevent, 2);
+	duk_put_global_string(ctx, "notifyEvent");
+	duk_push_c_function(ctx, janus_duktape_method_eventsisenabled, 0);
+	duk_put_global_string(ctx, "eventsIsEnabled");
+	duk_push_c_function(ctx, janus_duktape_method_closepc, 1);
+	duk_put_global_string(ctx, "closePc");
+	duk_push_c_function(ctx, janus_duktape_method_endsession, 1);
+	duk_put_global_string(ctx, "endSession");
+	duk_push_c_function(ctx, janus_duktape_method_configuremedium, 4);
+	duk_put_global_string(ctx, "configureMedium");
+	duk_push_c_function(ctx, janus_duktape_method_addrecipient, 2);
+	duk_put_global_string(ctx, "addRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_removerecipient, 2);
+	duk_put_global_string(ctx, "removeRecipient");
+	duk_push_c_function(ctx, janus_duktape_method_setbitrate, 2);
+	duk_put_global_string(ctx, "setBitrate");
+	duk_push_c_function(ctx, janus_duktape_method_setplifreq, 2);
+	duk_put_global_string(ctx, "setPliFreq");
+	duk_push_c_function(ctx, janus_duktape_method_setmediahooks, 3);
+	duk_put_global_string(ctx, "setMediaHooks");
+	duk_push_c_function(ctx, janus_duktape_method_setsubstream, 2);
+	duk_put_global_string(ctx, "setSubstream");
+	duk_push_c_function(ctx, janus_duktape_method_settemporallayer, 2);
+	duk_put_global_string(ctx, "setTemporalLayer");
+	duk_push_c_function(ctx, janus_duktape_method_sendpli, 1);
+	duk_put_global_string(ctx, "sendPli");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtp, 4);
+	duk_put_global_string(ctx, "relayRtp");
+	duk_push_c_function(ctx, janus_duktape_method_relayrtcp, 4);
+	duk_put_global_string(ctx, "relayRtcp");
+	duk_push_c_function(ctx, janus_duktape_method_relaydata, 5);	/* Legacy function, deprecated */
+	duk_put_global_string(ctx, "relayData");
+	duk_push_c_function(ctx, janus_duktape_method_relaytextdata, 5);
+	duk_put_global_string(ctx, "relayTextData");
+	duk_push_c_function(ctx, janus_duktape_method_relaybinarydata, 5);
+	duk_put_global_string(ctx, "relayBinaryData");
+	duk_push_c_function(ctx, janus_duktape_method_startrecording, 13);
+	duk_put_global_string(ctx, "startRecording");
+	duk_push_c_function(ctx, janus_duktape_method_stoprecording, 4);
+	duk_put_global_string(ctx, "stopRecording");
+	duk_push_c_function(ctx, janus_duktape_method_getversion, 0);
+	duk_put_global_string(ctx, "getDuktapeVersion");
+	duk_push_c_function(ctx, janus_duktape_method_getasynceventsstats, 0);
+	duk_put_global_string(ctx, "getAsyncEventsStats");
+	duk_push_c_function(ctx, janus_duktape_method_setshareddata, 2);
+	duk_put_global_string(ctx, "setSharedData");
+	duk_push_c_function(ctx, janus_duktape_method_getshareddata, 1);
+	duk_put_global_string(ctx, "getSharedData");
+	duk_push_c_function(ctx, janus_duktape_method_getcontextid, 0);
+	duk_put_global_string(ctx, "getContextId");
+	duk_push_c_function(ctx, janus_duktape_method_getcontextstats, 0);
+	duk_put_global_string(ctx, "getContextStats");
+	/* Register all extra functions, if any were added */
+	janus_duktape_register_extra_functions(ctx);
+
+	/* Now load the script */
+	duk_push_lstring(ctx, script, (duk_size_t)len);
+	if(duk_peval(ctx) != 0) {
+		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(ctx, -1));
+		janus_duktape_context_destroy(context);
+		return NULL;
+	}
+	duk_pop(ctx);
+	/* Make sure that all the functions we need are there */
+	uint i=0;
+	for(i=0; i<duktape_funcsize; i++) {
+		duk_get_global_string(ctx, duktape_functions[i]);
+		if(duk_is_function(ctx, duk_get_top(ctx)-1) == 0) {
+			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
+			janus_duktape_context_destroy(context);
+			return NULL;
+		}
+	}
+	duk_set_top(ctx, 0);
+	return context;
+}
+
+static void janus_duktape_context_destroy(janus_duktape_context *context) {
+	if(context == NULL)
+		return;
+	if(context->scheduler != NULL) {
+		g_async_queue_push(context->events, GUINT_TO_POINTER(janus_duktape_event_exit));
+		g_thread_join(context->scheduler);
+		context->scheduler = NULL;
+	}
+	janus_mutex_lock(&context->mutex);
+	g_hash_table_destroy(context->callbacks);
+	context->callbacks = NULL;
+	if(context->ctx != NULL)
+		duk_destroy_heap(context->ctx);
+	context->ctx = NULL;
+	janus_mutex_unlock(&context->mutex);
+	g_async_queue_unref(context->events);
+	janus_mutex_destroy(&context->mutex);
+	janus_mutex_destroy(&context->stats_mutex);
+	g_free(context);
+}
+
+static void janus_duktape_contexts_cleanup(void) {
+	if(duktape_contexts == NULL)
+		return;
+	int i=0;
+	for(i=0; duktape_contexts[i] != NULL; i++)
+		janus_duktape_context_destroy(duktape_contexts[i]);
+	g_free(duktape_contexts);
+	duktape_contexts = NULL;
+}
+
 /* Plugin implementation */
 int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(g_atomic_int_get(&duktape_stopping)) {
@@ -1524,79 +1947,43 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
 	if(conf && conf->value)
 		duktape_config = g_strdup(conf->value);
-	janus_config_destroy(config);
-
-	/* Initialize Duktape */
-	duktape_ctx = duk_create_heap_default();
-	if(duktape_ctx == NULL) {
-		JANUS_LOG(LOG_ERR, "Error creating Duktape heap...\n");
-		g_free(duktape_folder);
-		return -1;
+	janus_config_item *contexts = janus_config_get(config, config_general, janus_config_type_item, "contexts");
+	if(contexts && contexts->value) {
+		if(!strcasecmp(contexts->value, "auto"))
+			duktape_contexts_num = g_get_num_processors();
+		else
+			duktape_contexts_num = atoi(contexts->value);
+		if(duktape_contexts_num < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid contexts value %s, using a single Duktape context\n", contexts->value);
+			duktape_contexts_num = 1;
+		} else if(duktape_contexts_num > JANUS_DUKTAPE_MAX_CONTEXTS) {
+			JANUS_LOG(LOG_WARN, "Too many Duktape contexts (%d), capping to %d\n", duktape_contexts_num, JANUS_DUKTAPE_MAX_CONTEXTS);
+			duktape_contexts_num = JANUS_DUKTAPE_MAX_CONTEXTS;
+		}
 	}
-	duk_console_init(duktape_ctx, DUK_CONSOLE_PROXY_WRAPPER);
-	duk_module_duktape_init(duktape_ctx);
-
-	/* Register our functions */
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getmodulesfolder, 0);
-	duk_put_global_string(duktape_ctx, "getModulesFolder");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_readfile, 1);
-	duk_put_global_string(duktape_ctx, "readFile");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pokescheduler, 0);
-	duk_put_global_string(duktape_ctx, "pokeScheduler");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_timecallback, 3);
-	duk_put_global_string(duktape_ctx, "timeCallback");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_pushevent, 4);
-	duk_put_global_string(duktape_ctx, "pushEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_notifyevent, 2);
-	duk_put_global_string(duktape_ctx, "notifyEvent");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_eventsisenabled, 0);
-	duk_put_global_string(duktape_ctx, "eventsIsEnabled");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_closepc, 1);
-	duk_put_global_string(duktape_ctx, "closePc");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_endsession, 1);
-	duk_put_global_string(duktape_ctx, "endSession");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_configuremedium, 4);
-	duk_put_global_string(duktape_ctx, "configureMedium");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_addrecipient, 2);
-	duk_put_global_string(duktape_ctx, "addRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_removerecipient, 2);
-	duk_put_global_string(duktape_ctx, "removeRecipient");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setbitrate, 2);
-	duk_put_global_string(duktape_ctx, "setBitrate");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setplifreq, 2);
-	duk_put_global_string(duktape_ctx, "setPliFreq");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_setsubstream, 2);
-	duk_put_global_string(duktape_ctx, "setSubstream");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_settemporallayer, 2);
-	duk_put_global_string(duktape_ctx, "setTemporalLayer");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_sendpli, 1);
-	duk_put_global_string(duktape_ctx, "sendPli");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relayrtcp, 4);
-	duk_put_global_string(duktape_ctx, "relayRtcp");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaydata, 5);	/* Legacy function, deprecated */
-	duk_put_global_string(duktape_ctx, "relayData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaytextdata, 5);
-	duk_put_global_string(duktape_ctx, "relayTextData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_relaybinarydata, 5);
-	duk_put_global_string(duktape_ctx, "relayBinaryData");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_startrecording, 13);
-	duk_put_global_string(duktape_ctx, "startRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_stoprecording, 4);
-	duk_put_global_string(duktape_ctx, "stopRecording");
-	duk_push_c_function(duktape_ctx, janus_duktape_method_getversion, 0);
-	duk_put_global_string(duktape_ctx, "getDuktapeVersion");
-	/* Register all extra functions, if any were added */
-	janus_duktape_register_extra_functions(duktape_ctx);
+	janus_config_item *at = janus_config_get(config, config_general, janus_config_type_item, "async_threads");
+	if(at && at->value) {
+		if(!strcasecmp(at->value, "auto"))
+			async_threads = g_get_num_processors();
+		else
+			async_threads = atoi(at->value);
+		if(async_threads < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid async_threads value %s, using a thread per event\n", at->value);
+			async_threads = 0;
+		} else if(async_threads > JANUS_DUKTAPE_MAX_ASYNC_THREADS) {
+			JANUS_LOG(LOG_WARN, "Too many async threads (%d), capping to %d\n", async_threads, JANUS_DUKTAPE_MAX_ASYNC_THREADS);
+			async_threads = JANUS_DUKTAPE_MAX_ASYNC_THREADS;
+		}
+	}
+	janus_config_destroy(config);
 
-	/* Now load the script (FIXME badly) */
+	/* Read the script (FIXME badly): each context will load its own copy */
 	FILE *f = fopen(duktape_file, "rb");
 	if(f == NULL) {
 		JANUS_LOG(LOG_ERR, "Error loading JS script %s: no such file\n", duktape_file);
-		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
 	fseek(f, 0, SEEK_END);
@@ -1604,9 +1991,9 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(fs < 1) {
 		JANUS_LOG(LOG_ERR, "Error loading JS script %s: empty file\n", duktape_file);
 		fclose(f);
-		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
 	size_t len = fs;
@@ -1616,37 +2003,33 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_ERR, "Error reading JS script %s: %s\n", duktape_file, g_strerror(errno));
 		g_free(buf);
 		fclose(f);
-		duk_destroy_heap(duktape_ctx);
 		g_free(duktape_folder);
 		g_free(duktape_file);
+		g_free(duktape_config);
 		return -1;
 	}
 	fclose(f);
-	duk_push_lstring(duktape_ctx, (const char *)buf, (duk_size_t)len);
-	g_free(buf);
-	if(duk_peval(duktape_ctx) != 0) {
-		JANUS_LOG(LOG_ERR, "Error loading JS script %s: %s\n", duktape_file, duk_safe_to_string(duktape_ctx, -1));
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		return -1;
-	}
-	duk_pop(duktape_ctx);
-	/* Make sure that all the functions we need are there */
-	uint i=0;
-	for(i=0; i<duktape_funcsize; i++) {
-		duk_get_global_string(duktape_ctx, duktape_functions[i]);
-		if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) == 0) {
-			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", duktape_functions[i], duktape_file);
-			duk_destroy_heap(duktape_ctx);
+
+	/* Initialize Duktape */
+	duktape_contexts = g_malloc0((duktape_contexts_num+1)*sizeof(janus_duktape_context *));
+	int i=0;
+	for(i=0; i<duktape_contexts_num; i++) {
+		duktape_contexts[i] = janus_duktape_context_create(i, duktape_file, buf, len);
+		if(duktape_contexts[i] == NULL) {
+			janus_duktape_contexts_cleanup();
+			g_free(buf);
 			g_free(duktape_folder);
 			g_free(duktape_file);
+			g_free(duktape_config);
 			return -1;
 		}
 	}
+	g_free(buf);
 	/* Some JS functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with JavaScript only dictating
-	 * the logic, or those overriding the plugin namespace and versioning information */
+	 * the logic, or those overriding the plugin namespace and versioning information):
+	 * all contexts run the same script, so we only need to check the first one */
+	duk_context *duktape_ctx = duktape_contexts[0]->ctx;
 	duk_get_global_string(duktape_ctx, "getVersion");
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_get_version = TRUE;
@@ -1699,26 +2082,34 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 	if(duk_is_function(duktape_ctx, duk_get_top(duktape_ctx)-1) != 0)
 		has_temporal_changed = TRUE;
 
+	duk_set_top(duktape_ctx, 0);
+
 	duktape_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_duktape_session_destroy);
 	duktape_ids = g_hash_table_new(NULL, NULL);
-	events = g_async_queue_new();
-	callbacks = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_duktape_callback_free);
+	shared_data = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
 
 	g_atomic_int_set(&duktape_initialized, 1);
 
-	/* Launch the scheduler thread (which will be responsible for resuming asynchronous coroutines) */
+	/* Launch the scheduler threads (which will be responsible for resuming asynchronous coroutines) */
 	GError *error = NULL;
-	scheduler_thread = g_thread_try_new("duktape scheduler", janus_duktape_scheduler, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&duktape_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape scheduler thread...\n",
-			error->code, error->message ? error->message : "??");
-		g_error_free(error);
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		g_free(duktape_config);
-		return -1;
+	for(i=0; i<duktape_contexts_num; i++) {
+		char tname[16];
+		if(duktape_contexts_num == 1)
+			g_snprintf(tname, sizeof(tname), "duktape scheduler");
+		else
+			g_snprintf(tname, sizeof(tname), "duktape sched %d", i);
+		duktape_contexts[i]->scheduler = g_thread_try_new(tname, janus_duktape_scheduler, duktape_contexts[i], &error);
+		if(error != NULL) {
+			g_atomic_int_set(&duktape_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Duktape scheduler thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_duktape_contexts_cleanup();
+			g_free(duktape_folder);
+			g_free(duktape_file);
+			g_free(duktape_config);
+			return -1;
+		}
 	}
 	/* Launch the timer loop thread (which will be responsible for scheduling timed callbacks) */
 	timer_context = g_main_context_new();
@@ -1733,38 +2124,73 @@ int janus_duktape_init(janus_callbacks *callback, const char *config_path) {
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
+		janus_duktape_contexts_cleanup();
 		g_free(duktape_folder);
 		g_free(duktape_file);
 		g_free(duktape_config);
 		return -1;
 	}
 
+	if(async_threads > 0) {
+		/* Use a pool of threads to send asynchronous events, rather than one thread per event */
+		async_events = g_thread_pool_new(janus_duktape_async_event_task, NULL, async_threads, FALSE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the pool of async events threads, falling back to per-event threads\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			error = NULL;
+			async_events = NULL;
+		} else {
+			JANUS_LOG(LOG_INFO, "Using a pool of %d threads to send asynchronous events\n", async_threads);
+		}
+	}
+
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	duktape_janus_core = callback;
 
-	/* Init the JS script, in case it's needed */
-	duk_get_global_string(duktape_ctx, "init");
-	duk_push_string(duktape_ctx, duktape_config);
-	int res = duk_pcall(duktape_ctx, 1);
-	if(res != DUK_EXEC_SUCCESS) {
-		g_atomic_int_set(&duktape_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
+	/* Init the JS script in all contexts, in case it's needed */
+	for(i=0; i<duktape_contexts_num; i++) {
+		janus_mutex_lock(&duktape_contexts[i]->mutex);
+		duktape_ctx = duktape_contexts[i]->ctx;
+		duk_get_global_string(duktape_ctx, "init");
+		duk_push_string(duktape_ctx, duktape_config);
+		int res = duk_pcall(duktape_ctx, 1);
+		if(res != DUK_EXEC_SUCCESS) {
+			g_atomic_int_set(&duktape_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
+			duk_pop(duktape_ctx);
+			janus_mutex_unlock(&duktape_contexts[i]->mutex);
+			if(timer_loop != NULL)
+				g_main_loop_quit(timer_loop);
+			if(timer_thread != NULL) {
+				g_thread_join(timer_thread);
+				timer_thread = NULL;
+			}
+			if(async_events != NULL) {
+				g_thread_pool_free(async_events, FALSE, TRUE);
+				async_events = NULL;
+			}
+			if(timer_loop != NULL)
+				g_main_loop_unref(timer_loop);
+			if(timer_context != NULL)
+				g_main_context_unref(timer_context);
+			timer_loop = NULL;
+			timer_context = NULL;
+			janus_duktape_contexts_cleanup();
+			g_free(duktape_folder);
+			g_free(duktape_file);
+			g_free(duktape_config);
+			return -1;
+		}
 		duk_pop(duktape_ctx);
-		if(timer_loop != NULL)
-			g_main_loop_unref(timer_loop);
-		if(timer_context != NULL)
-			g_main_context_unref(timer_context);
-		duk_destroy_heap(duktape_ctx);
-		g_free(duktape_folder);
-		g_free(duktape_file);
-		g_free(duktape_config);
-		return -1;
+		janus_mutex_unlock(&duktape_contexts[i]->mutex);
 	}
 
 	g_free(duktape_file);
 	g_free(duktape_config);
 
+	if(duktape_contexts_num > 1)
+		JANUS_LOG(LOG_INFO, "Using %d Duktape contexts\n", duktape_contexts_num);
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_DUKTAPE_NAME);
 	return 0;
 }
@@ -1774,10 +2200,13 @@ void janus_duktape_destroy(void) {
 		return;
 	g_atomic_int_set(&duktape_stopping, 1);
 
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_duktape_event_exit));
-	if(scheduler_thread != NULL) {
-		g_thread_join(scheduler_thread);
-		scheduler_thread = NULL;
+	int i=0;
+	for(i=0; duktape_contexts[i] != NULL; i++) {
+		g_async_queue_push(duktape_contexts[i]->events, GUINT_TO_POINTER(janus_duktape_event_exit));
+		if(duktape_contexts[i]->scheduler != NULL) {
+			g_thread_join(duktape_contexts[i]->scheduler);
+			duktape_contexts[i]->scheduler = NULL;
+		}
 	}
 	if(timer_loop != NULL)
 		g_main_loop_quit(timer_loop);
@@ -1785,6 +2214,11 @@ void janus_duktape_destroy(void) {
 		g_thread_join(timer_thread);
 		timer_thread = NULL;
 	}
+	if(async_events != NULL) {
+		/* Send the events that are still queued, and wait for the pool threads */
+		g_thread_pool_free(async_events, FALSE, TRUE);
+		async_events = NULL;
+	}
 	if(timer_loop != NULL) {
 		g_main_loop_unref(timer_loop);
 		timer_loop = NULL;
@@ -1794,31 +2228,31 @@ void janus_duktape_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the JS script, in case it's needed */
-	janus_mutex_lock(&duktape_mutex);
-	duk_get_global_string(duktape_ctx, "destroy");
-	int res = duk_pcall(duktape_ctx, 0);
-	if(res != DUK_EXEC_SUCCESS) {
-		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
-		duk_pop(duktape_ctx);
+	/* Deinit the JS script in all contexts, in case it's needed */
+	for(i=0; duktape_contexts[i] != NULL; i++) {
+		janus_mutex_lock(&duktape_contexts[i]->mutex);
+		duk_context *duktape_ctx = duktape_contexts[i]->ctx;
+		duk_get_global_string(duktape_ctx, "destroy");
+		int res = duk_pcall(duktape_ctx, 0);
+		if(res != DUK_EXEC_SUCCESS) {
+			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
+			duk_pop(duktape_ctx);
+		}
+		janus_mutex_unlock(&duktape_contexts[i]->mutex);
 	}
-	g_hash_table_destroy(callbacks);
-	callbacks = NULL;
-	janus_mutex_unlock(&duktape_mutex);
 
 	janus_mutex_lock(&duktape_sessions_mutex);
 	g_hash_table_destroy(duktape_sessions);
 	duktape_sessions = NULL;
 	g_hash_table_destroy(duktape_ids);
 	duktape_ids = NULL;
-	g_async_queue_unref(events);
-	events = NULL;
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
-	janus_mutex_lock(&duktape_mutex);
-	duk_destroy_heap(duktape_ctx);
-	duktape_ctx = NULL;
-	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_contexts_cleanup();
+	janus_mutex_lock(&shared_data_mutex);
+	g_hash_table_destroy(shared_data);
+	shared_data = NULL;
+	janus_mutex_unlock(&shared_data_mutex);
 
 	g_free(duktape_script_version_string);
 	g_free(duktape_script_description);
@@ -1846,23 +2280,23 @@ int janus_duktape_get_version(void) {
 			/* Unless we asked already */
 			return duktape_script_version;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getVersion");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_VERSION;
 		}
 		duktape_script_version = (int)duk_get_number(t, -1);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_version;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1877,25 +2311,25 @@ const char *janus_duktape_get_version_string(void) {
 			/* Unless we asked already */
 			return duktape_script_version_string;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getVersionString");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_VERSION_STRING;
 		}
 		const char *version = duk_get_string(t, -1);
 		if(version != NULL)
 			duktape_script_version_string = g_strdup(version);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_version_string;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1910,25 +2344,25 @@ const char *janus_duktape_get_description(void) {
 			/* Unless we asked already */
 			return duktape_script_description;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getDescription");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_DESCRIPTION;
 		}
 		const char *description = duk_get_string(t, -1);
 		if(description != NULL)
 			duktape_script_description = g_strdup(description);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_description;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1943,25 +2377,25 @@ const char *janus_duktape_get_name(void) {
 			/* Unless we asked already */
 			return duktape_script_name;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getName");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_NAME;
 		}
 		const char *name = duk_get_string(t, -1);
 		if(name != NULL)
 			duktape_script_name = g_strdup(name);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_name;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -1976,25 +2410,25 @@ const char *janus_duktape_get_author(void) {
 			/* Unless we asked already */
 			return duktape_script_author;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getAuthor");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_AUTHOR;
 		}
 		const char *author = duk_get_string(t, -1);
 		if(author != NULL)
 			duktape_script_author = g_strdup(author);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_author;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -2009,25 +2443,25 @@ const char *janus_duktape_get_package(void) {
 			/* Unless we asked already */
 			return duktape_script_package;
 		}
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(duktape_contexts[0]);
+		duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+		duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 		duk_get_global_string(t, "getPackage");
 		int res = duk_pcall(t, 0);
 		if(res != DUK_EXEC_SUCCESS) {
 			/* Something went wrong... return the Janus Duktape plugin info */
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 			duk_pop(t);
-			duk_pop(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			duk_pop(duktape_contexts[0]->ctx);
+			janus_duktape_context_unlock(duktape_contexts[0]);
 			return JANUS_DUKTAPE_PACKAGE;
 		}
 		const char *package = duk_get_string(t, -1);
 		if(package != NULL)
 			duktape_script_package = g_strdup(package);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return duktape_script_package;
 	}
 	/* No override, return the Janus Duktape plugin info */
@@ -2060,6 +2494,14 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_duktape_session *session = (janus_duktape_session *)g_malloc0(sizeof(janus_duktape_session));
 	session->handle = handle;
 	session->id = id;
+	/* Bind the session to the context serving the fewest sessions */
+	int i=0;
+	session->context = duktape_contexts[0];
+	for(i=1; duktape_contexts[i] != NULL; i++) {
+		if(g_atomic_int_get(&duktape_contexts[i]->sessions) < g_atomic_int_get(&session->context->sessions))
+			session->context = duktape_contexts[i];
+	}
+	g_atomic_int_inc(&session->context->sessions);
 	janus_rtp_switching_context_reset(&session->artpctx);
 	janus_rtp_switching_context_reset(&session->vrtpctx);
 	janus_rtp_simulcasting_context_reset(&session->sim_context);
@@ -2069,6 +2511,8 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	session->rid_extmap_id = -1;
 	janus_mutex_init(&session->rid_mutex);
 	session->vcodec = JANUS_VIDEOCODEC_NONE;
+	session->rtp_hook = TRUE;
+	session->rtcp_hook = TRUE;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_duktape_session_free);
@@ -2078,9 +2522,9 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "createSession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2089,8 +2533,8 @@ void janus_duktape_create_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(session->context->ctx);
+	janus_duktape_context_unlock(session->context);
 
 	return;
 }
@@ -2114,9 +2558,9 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&duktape_sessions_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "destroySession");
 	duk_push_number(t, id);
 	int res = duk_pcall(t, 1);
@@ -2125,8 +2569,8 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(session->context->ctx);
+	janus_duktape_context_unlock(session->context);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -2142,6 +2586,7 @@ void janus_duktape_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Finally, remove from the hashtable */
+	g_atomic_int_add(&session->context->sessions, -1);
 	janus_mutex_lock(&duktape_sessions_mutex);
 	g_hash_table_remove(duktape_sessions, handle);
 	janus_mutex_unlock(&duktape_sessions_mutex);
@@ -2164,9 +2609,9 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&duktape_sessions_mutex);
 	/* Ask the JS script for information on this session */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "querySession");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2176,19 +2621,19 @@ json_t *janus_duktape_query_session(janus_plugin_session *handle) {
 		json_t *json = json_object();
 		json_object_set_new(json, "error", json_string(duk_safe_to_string(t, -1)));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
+		duk_pop(session->context->ctx);
 		janus_refcount_decrease(&session->ref);
-		janus_mutex_unlock(&duktape_mutex);
+		janus_duktape_context_unlock(session->context);
 		return json;
 	}
 	janus_refcount_decrease(&session->ref);
 	const char *info = duk_get_string(t, -1);
 	duk_pop(t);
-	duk_pop(duktape_ctx);
+	duk_pop(session->context->ctx);
 	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&duktape_mutex);
+	janus_duktape_context_unlock(session->context);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -2253,9 +2698,9 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		json_decref(jsep);
 	}
 	/* Invoke the script function */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "handleMessage");
 	duk_push_number(t, session->id);
 	duk_push_string(t, transaction);
@@ -2266,8 +2711,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Something went wrong... */
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 	}
 	janus_refcount_decrease(&session->ref);
@@ -2281,8 +2726,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		/* Either an error or an asynchronous response */
 		int res = (int)duk_get_number(t, 0);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		if(res < 0) {
 			/* We got an error */
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -2295,8 +2740,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
@@ -2305,8 +2750,8 @@ struct janus_plugin_result *janus_duktape_handle_message(janus_plugin_session *h
 	}
 	/* If we got here, we didn't get what we expect */
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(session->context->ctx);
+	janus_duktape_context_unlock(session->context);
 	return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Duktape error", NULL);
 }
 
@@ -2319,9 +2764,9 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 		return NULL;
 	}
 	/* Invoke the script function */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(duktape_contexts[0]);
+	duk_idx_t thr_idx = duk_push_thread(duktape_contexts[0]->ctx);
+	duk_context *t = duk_get_context(duktape_contexts[0]->ctx, thr_idx);
 	duk_get_global_string(t, "handleAdminMessage");
 	duk_push_string(t, message_text);
 	int res = duk_pcall(t, 1);
@@ -2329,8 +2774,8 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 		/* Something went wrong... */
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(duktape_contexts[0]->ctx);
+		janus_duktape_context_unlock(duktape_contexts[0]);
 		return NULL;
 	}
 	if(message_text != NULL)
@@ -2340,8 +2785,8 @@ json_t *janus_duktape_handle_admin_message(json_t *message) {
 	json_error_t error;
 	json_t *json = json_loads(response, 0, &error);
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(duktape_contexts[0]->ctx);
+	janus_duktape_context_unlock(duktape_contexts[0]);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 		return NULL;
@@ -2371,9 +2816,9 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "setupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2382,8 +2827,8 @@ void janus_duktape_setup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(session->context->ctx);
+	janus_duktape_context_unlock(session->context);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2401,11 +2846,11 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *
 	char *buf = rtp_packet->buffer;
 	uint16_t len = rtp_packet->length;
 	/* Check if the JS script wants to handle/manipulate RTP packets itself */
-	if(has_incoming_rtp) {
+	if(has_incoming_rtp && session->rtp_hook) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(session->context);
+		duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+		duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2417,8 +2862,8 @@ void janus_duktape_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2518,11 +2963,11 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp
 	char *buf = packet->buffer;
 	uint16_t len = packet->length;
 	/* Check if the JS script wants to handle/manipulate RTCP packets itself */
-	if(has_incoming_rtcp) {
+	if(has_incoming_rtcp && session->rtcp_hook) {
 		/* Yep, pass the data to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(session->context);
+		duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+		duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 		duk_get_global_string(t, "incomingRtcp");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, video);
@@ -2534,8 +2979,8 @@ void janus_duktape_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2578,9 +3023,9 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, janus_plugin_data
 		/* Yep, pass the data to the JS script and return */
 		if(packet->binary && !has_incoming_text_data)
 			JANUS_LOG(LOG_WARN, "Missing 'incomingTextData', invoking deprecated function 'incomingData' instead\n");
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(session->context);
+		duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+		duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 		duk_get_global_string(t, packet->binary ? "incomingBinaryData" : (has_incoming_text_data ? "incomingTextData" : "incomingData"));
 		duk_push_number(t, session->id);
 		/* We use a string for both text and binary data */
@@ -2594,8 +3039,8 @@ void janus_duktape_incoming_data(janus_plugin_session *handle, janus_plugin_data
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2632,9 +3077,9 @@ void janus_duktape_data_ready(janus_plugin_session *handle) {
 	/* Check if the JS script wants to receive this event */
 	if(has_data_ready) {
 		/* Yep, pass the event to the JS script and return */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(session->context);
+		duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+		duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 		duk_get_global_string(t, "dataReady");
 		duk_push_number(t, session->id);
 		int res = duk_pcall(t, 1);
@@ -2643,8 +3088,8 @@ void janus_duktape_data_ready(janus_plugin_session *handle) {
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 		return;
 	}
 }
@@ -2666,9 +3111,9 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int mindex, gboolean
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the JS script */
-		janus_mutex_lock(&duktape_mutex);
-		duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-		duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+		janus_duktape_context_lock(session->context);
+		duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+		duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 		duk_get_global_string(t, "slowLink");
 		duk_push_number(t, session->id);
 		duk_push_boolean(t, uplink);
@@ -2679,8 +3124,8 @@ void janus_duktape_slow_link(janus_plugin_session *handle, int mindex, gboolean
 			JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 		}
 		duk_pop(t);
-		duk_pop(duktape_ctx);
-		janus_mutex_unlock(&duktape_mutex);
+		duk_pop(session->context->ctx);
+		janus_duktape_context_unlock(session->context);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -2741,9 +3186,9 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the JS script */
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(session->context);
+	duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+	duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 	duk_get_global_string(t, "hangupMedia");
 	duk_push_number(t, session->id);
 	int res = duk_pcall(t, 1);
@@ -2752,8 +3197,8 @@ void janus_duktape_hangup_media(janus_plugin_session *handle) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
-	janus_mutex_unlock(&duktape_mutex);
+	duk_pop(session->context->ctx);
+	janus_duktape_context_unlock(session->context);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2797,9 +3242,9 @@ static void janus_duktape_relay_rtp_packet(gpointer data, gpointer user_data) {
 		if(session->sim_context.changed_substream) {
 			/* Notify the script about the substream change */
 			if(has_substream_changed) {
-				janus_mutex_lock(&duktape_mutex);
-				duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-				duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+				janus_duktape_context_lock(session->context);
+				duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+				duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 				duk_get_global_string(t, "substreamChanged");
 				duk_push_number(t, session->id);
 				duk_push_number(t, session->sim_context.substream);
@@ -2809,16 +3254,16 @@ static void janus_duktape_relay_rtp_packet(gpointer data, gpointer user_data) {
 					JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 				}
 				duk_pop(t);
-				duk_pop(duktape_ctx);
-				janus_mutex_unlock(&duktape_mutex);
+				duk_pop(session->context->ctx);
+				janus_duktape_context_unlock(session->context);
 			}
 		}
 		if(session->sim_context.changed_temporal) {
 			/* Notify the user about the temporal layer change */
 			if(has_substream_changed) {
-				janus_mutex_lock(&duktape_mutex);
-				duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-				duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+				janus_duktape_context_lock(session->context);
+				duk_idx_t thr_idx = duk_push_thread(session->context->ctx);
+				duk_context *t = duk_get_context(session->context->ctx, thr_idx);
 				duk_get_global_string(t, "temporalLayerChanged");
 				duk_push_number(t, session->id);
 				duk_push_number(t, session->sim_context.templayer);
@@ -2828,8 +3273,8 @@ static void janus_duktape_relay_rtp_packet(gpointer data, gpointer user_data) {
 					JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 				}
 				duk_pop(t);
-				duk_pop(duktape_ctx);
-				janus_mutex_unlock(&duktape_mutex);
+				duk_pop(session->context->ctx);
+				janus_duktape_context_unlock(session->context);
 			}
 		}
 		/* If we got here, update the RTP header and send the packet */
@@ -2902,24 +3347,25 @@ static void janus_duktape_relay_data_packet(gpointer data, gpointer user_data) {
  * JavaScript (e.g., for asynchronous requests), we do that ourselves here */
 static void *janus_duktape_scheduler(void *data) {
 	JANUS_LOG(LOG_VERB, "Joining Duktape scheduler thread\n");
+	janus_duktape_context *context = (janus_duktape_context *)data;
 	janus_duktape_event *event = NULL;
 	/* Wait until there are events to process */
 	while(g_atomic_int_get(&duktape_initialized) && !g_atomic_int_get(&duktape_stopping)) {
-		event = g_async_queue_pop(events);
+		event = g_async_queue_pop(context->events);
 		if(event == GUINT_TO_POINTER(janus_duktape_event_exit))
 			break;
 		if(event == GUINT_TO_POINTER(janus_duktape_event_resume)) {
 			/* There are coroutines to resume */
-			janus_mutex_lock(&duktape_mutex);
-			duk_get_global_string(duktape_ctx, "resumeScheduler");
-			int res = duk_pcall(duktape_ctx, 0);
+			janus_duktape_context_lock(context);
+			duk_get_global_string(context->ctx, "resumeScheduler");
+			int res = duk_pcall(context->ctx, 0);
 			if(res != DUK_EXEC_SUCCESS) {
-				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(duktape_ctx, -1));
+				JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(context->ctx, -1));
 			}
-			duk_pop(duktape_ctx);
+			duk_pop(context->ctx);
 			/* Print the count of elements into Duktape stack */
-			janus_duktape_stackdump(duktape_ctx);
-			janus_mutex_unlock(&duktape_mutex);
+			janus_duktape_stackdump(context->ctx);
+			janus_duktape_context_unlock(context);
 		}
 	}
 	JANUS_LOG(LOG_VERB, "Leaving Duktape scheduler thread\n");
@@ -2945,11 +3391,12 @@ static gboolean janus_duktape_timer_cb(void *data) {
 	janus_duktape_callback *cb = (janus_duktape_callback *)data;
 	if(cb == NULL)
 		return FALSE;
+	janus_duktape_context *context = cb->context;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&duktape_mutex);
-	duk_idx_t thr_idx = duk_push_thread(duktape_ctx);
-	duk_context *t = duk_get_context(duktape_ctx, thr_idx);
+	janus_duktape_context_lock(context);
+	duk_idx_t thr_idx = duk_push_thread(context->ctx);
+	duk_context *t = duk_get_context(context->ctx, thr_idx);
 	duk_get_global_string(t, cb->function);
 	if(cb->argument) {
 		duk_push_string(t, cb->argument);
@@ -2959,9 +3406,9 @@ static gboolean janus_duktape_timer_cb(void *data) {
 		JANUS_LOG(LOG_ERR, "Duktape error: %s\n", duk_safe_to_string(t, -1));
 	}
 	duk_pop(t);
-	duk_pop(duktape_ctx);
+	duk_pop(context->ctx);
 	/* Done */
-	g_hash_table_remove(callbacks, cb);
-	janus_mutex_unlock(&duktape_mutex);
+	g_hash_table_remove(context->callbacks, cb);
+	janus_duktape_context_unlock(context);
 	return FALSE;
 }
@@ -43,14 +43,40 @@
 extern volatile gint duktape_initialized, duktape_stopping;
 extern janus_callbacks *duktape_janus_core;
 
-/* Duktape context: we define context and mutex as extern */
-extern duk_context *duktape_ctx;
-extern janus_mutex duktape_mutex;
+/* Duktape contexts: by default there's a single one, but the plugin can be
+ * configured to use more, in which case sessions are spread across them.
+ * Each context is a separate Duktape heap running its own copy of the
+ * script, and has its own mutex and scheduler thread, so that sessions
+ * in different contexts never wait for each other: the contexts are in a
+ * NULL-terminated array, and the first one is also the one used for
+ * plugin-wide requests (e.g., Admin API) */
+typedef struct janus_duktape_context {
+	guint id;							/* Index of this context in the array */
+	duk_context *ctx;					/* The Duktape heap itself */
+	janus_mutex mutex;					/* Mutex to serialize access to the Duktape heap */
+	GThread *scheduler;					/* Thread resuming the coroutines of this context */
+	GAsyncQueue *events;				/* Events for the scheduler thread */
+	GHashTable *callbacks;				/* Timed callbacks scheduled by this context */
+	volatile gint sessions;				/* How many sessions are bound to this context */
+	/* Usage stats: these are protected by their own mutex, so that they can be
+	 * read at any time without waiting for the JavaScript code to be done */
+	janus_mutex stats_mutex;			/* Mutex to protect the stats */
+	guint64 calls;						/* How many times JavaScript code was invoked in this context */
+	gint64 busy_time;					/* Time spent running JavaScript code (us) */
+	gint64 cpu_time;					/* CPU time spent running JavaScript code (us) */
+	gint64 total_latency;				/* Sum of the latencies of all invocations, waiting included (us) */
+	gint64 max_latency;					/* Highest latency of an invocation, waiting included (us) */
+	gint64 requested, acquired, cpu_acquired;	/* When the current invocation asked for/got the context (protected by mutex) */
+} janus_duktape_context;
+extern janus_duktape_context **duktape_contexts;
+/* Helper to get the janus_duktape_context instance a Duktape C function was invoked from */
+janus_duktape_context *janus_duktape_context_from(duk_context *ctx);
 
 /* Duktape session: we keep only the barebone stuff here, the rest will be in the JavaScript script */
 typedef struct janus_duktape_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
 	uint32_t id;						/* Unique session ID (will be used to correlate with the JavaScript script) */
+	janus_duktape_context *context;		/* Duktape context this session is bound to */
 	/* The following are only needed for media manipulation, feedback and routing, and may not all be used */
 	gboolean accept_audio;				/* Whether incoming audio can be accepted or must be dropped */
 	gboolean accept_video;				/* Whether incoming video can be accepted or must be dropped */
@@ -58,6 +84,8 @@ typedef struct janus_duktape_session {
 	gboolean send_audio;				/* Whether outgoing audio can be sent or must be dropped */
 	gboolean send_video;				/* Whether outgoing video can be sent or must be dropped */
 	gboolean send_data;					/* Whether outgoing data can be sent or must be dropped */
+	gboolean rtp_hook;					/* Whether incoming RTP is passed to the JavaScript script (if it handles it), or relayed natively */
+	gboolean rtcp_hook;					/* Whether incoming RTCP is passed to the JavaScript script (if it handles it), or handled natively */
 	janus_rtp_switching_context artpctx, vrtpctx;
 	janus_rtp_switching_context rtpctx;	/* RTP switching context */
 	janus_videocodec vcodec;			/* Video codec this session is using */
@@ -158,6 +158,7 @@ void janus_echotest_slow_link(janus_plugin_session *handle, int mindex, gboolean
 void janus_echotest_hangup_media(janus_plugin_session *handle);
 void janus_echotest_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_echotest_query_session(janus_plugin_session *handle);
+json_t *janus_echotest_query_metrics(void);
 
 /* Plugin setup */
 static janus_plugin janus_echotest_plugin =
@@ -185,6 +186,7 @@ static janus_plugin janus_echotest_plugin =
 		.hangup_media = janus_echotest_hangup_media,
 		.destroy_session = janus_echotest_destroy_session,
 		.query_session = janus_echotest_query_session,
+		.query_metrics = janus_echotest_query_metrics,
 	);
 
 /* Plugin creator */
@@ -483,6 +485,17 @@ void janus_echotest_destroy_session(janus_plugin_session *handle, int *error) {
 	return;
 }
 
+json_t *janus_echotest_query_metrics(void) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return NULL;
+	janus_mutex_lock(&sessions_mutex);
+	guint count = g_hash_table_size(sessions);
+	janus_mutex_unlock(&sessions_mutex);
+	json_t *metrics = json_object();
+	json_object_set_new(metrics, "echotest_sessions", json_integer(count));
+	return metrics;
+}
+
 json_t *janus_echotest_query_session(janus_plugin_session *handle) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
 		return NULL;
@@ -59,7 +59,13 @@
  * with \c incomingTextData() or \c incomingBinaryData
  * though, the performance impact of directly processing and manipulating
  * RTP an RTCP packets is probably too high, and so their usage is currently
- * discouraged. The \c dataReady() callback can be used to figure out when
+ * discouraged: media routing is meant to be declarative instead, i.e.,
+ * the script uses \c addRecipient() \c configureMedium() and \c setSubstream()
+ * to fill a forwarding table in the C code, which then relays packets
+ * without ever entering the Lua engine. If a script does implement
+ * \c incomingRtp() or \c incomingRtcp() but only needs them for some
+ * sessions, it can call \c setMediaHooks() to have the packets of all
+ * the other sessions relayed natively as if they weren't implemented. The \c dataReady() callback can be used to figure out when
  * data can be sent. As an additional note, Lua scripts can also decide to
  * implement the functions that return information about the plugin itself,
  * namely \c getVersion() \c getVersionString() \c getDescription()
@@ -96,13 +102,18 @@
  * - \c removeRecipient(): specify which user should not receive a user's media anymore;
  * - \c setBitrate(): specify the bitrate to force on a user via REMB feedback;
  * - \c setPliFreq(): specify how often the plugin should send a PLI to this user;
+ * - \c setMediaHooks(): specify whether a user's RTP/RTCP should be passed to \c incomingRtp()/\c incomingRtcp() or relayed natively;
  * - \c setSubstream(): set the target simulcast substream;
  * - \c setTemporalLayer(): set the target simulcast temporal layer;
  * - \c sendPli(): send a PLI (keyframe request);
  * - \c startRecording(): start recording audio, video and or data for a user;
  * - \c stopRecording(): start recording audio, video and or data for a user;
  * - \c pokeScheduler(): notify the C code that there's a coroutine to resume;
- * - \c timeCallback(): trigger the execution of a Lua function after X milliseconds.
+ * - \c timeCallback(): trigger the execution of a Lua function after X milliseconds;
+ * - \c setSharedData(): share a string value with the scripts in all Lua states;
+ * - \c getSharedData(): retrieve a value shared via \c setSharedData();
+ * - \c getStateId(): get the index of the Lua state the script is running in;
+ * - \c getAsyncEventsStats(): get stats on the events sent asynchronously, as a JSON string.
  *
  * As anticipated in the previous section, almost all these methods also
  * expect the unique session identifier to address a specific user in the
@@ -118,7 +129,8 @@
  * Lua scripts, you can leverage a scheduler implemented in the C code.
  *
  * More specifically, when the plugin starts a dedicated thread is devoted
- * to the only purpose of acting as a scheduler for Lua coroutines. This
+ * to the only purpose of acting as a scheduler for Lua coroutines (one
+ * per Lua state, if \ref luastates "more than one" was configured). This
  * means that, whenever this C scheduler is awaken, it will call the
  * \c resumeScheduler() function in the Lua script, thus allowing the
  * Lua script to execute one or more pending coroutines. The C scheduler
@@ -187,6 +199,45 @@ timeCallback("resumeScheduler", nil, 0)
  * compact and less verbose, and as such is preferred in cases where
  * timing and opaque arguments are not needed.
  *
+ * \section luastates Multiple Lua states
+ *
+ * By default, the plugin creates a single Lua state, which means that
+ * all requests, media callbacks and coroutines of all sessions are
+ * serialized on it, and so a busy script can only make use of a single
+ * core. If that's a problem, you can set the \c states property in the
+ * configuration file to the number of Lua states to create instead (or
+ * \c auto to create one per core). Each state loads its own copy of the
+ * script (which means \c init() and \c destroy() are invoked once per
+ * state), has its own \ref coroutines "scheduler thread", and timed
+ * callbacks are always invoked in the state that asked for them. New
+ * sessions are bound to the state serving the fewest sessions, and all
+ * the callbacks for a session are always invoked in that state, so that
+ * sessions in different states can be served in parallel.
+ *
+ * This has an important consequence: Lua variables are NOT shared by
+ * different states, and so a script only sees the sessions that were
+ * bound to its own state. Everything the C code handles (e.g., sending
+ * events, routing media via \c addRecipient(), etc.) works no matter
+ * which state the involved sessions are bound to, but any information
+ * the script itself needs to share with its instances in other states
+ * (e.g., which rooms exist, or who's in them) must go through the C code
+ * explicitly, via the \c setSharedData() and \c getSharedData() functions:
+ *
+ * \verbatim
+-- Share a string (e.g., some JSON) with all the other states
+setSharedData("room-1234", json.encode(room))
+-- Retrieve it (nil if there's no such key)
+local room = json.decode(getSharedData("room-1234"))
+-- Remove it
+setSharedData("room-1234", nil)
+\endverbatim
+ *
+ * Plugin-wide requests that are not bound to a session (e.g., Admin API
+ * messages, or the methods to get the plugin name and version) are always
+ * handled by the first state, i.e., the one where \c getStateId() returns 0.
+ * Scripts that were not written with multiple states in mind should keep
+ * using a single state.
+ *
  * Refer to the \ref luapapi section for more information on how you
  * can register your own C functions.
  */
@@ -270,8 +321,11 @@ volatile gint lua_initialized = 0, lua_stopping = 0;
 janus_callbacks *lua_janus_core = NULL;
 
 /* Lua stuff */
-lua_State *lua_state = NULL;
-janus_mutex lua_mutex = JANUS_MUTEX_INITIALIZER;
+janus_lua_state **lua_states = NULL;
+static int lua_states_num = 1;
+#define JANUS_LUA_MAX_STATES	64
+/* Key we save the janus_lua_state pointer with in the registry of each state */
+#define JANUS_LUA_STATE_KEY		"janus.lua.state"
 static const char *lua_functions[] = {
 	"init", "destroy", "resumeScheduler",
 	"createSession", "destroySession", "querySession",
@@ -302,10 +356,8 @@ static gboolean has_data_ready = FALSE;
 static gboolean has_slow_link = FALSE;
 static gboolean has_substream_changed = FALSE;
 static gboolean has_temporal_changed = FALSE;
-/* Lua C scheduler (for coroutines) */
-static GThread *scheduler_thread = NULL;
+/* Lua C scheduler (for coroutines), one per state */
 static void *janus_lua_scheduler(void *data);
-static GAsyncQueue *events = NULL;
 typedef enum janus_lua_event {
 	janus_lua_event_none = 0,
 	janus_lua_event_resume,		/* Resume one or more pending coroutines */
@@ -321,10 +373,10 @@ typedef struct janus_lua_callback {
 	guint id;
 	uint32_t ms;
 	GSource *source;
+	janus_lua_state *state;
 	char *function;
 	char *argument;
 } janus_lua_callback;
-static GHashTable *callbacks = NULL;
 static void janus_lua_callback_free(janus_lua_callback *cb) {
 	if(!cb)
 		return;
@@ -334,6 +386,18 @@ static void janus_lua_callback_free(janus_lua_callback *cb) {
 	g_free(cb->argument);
 	g_free(cb);
 }
+/* Data the script instances in different states can share */
+static GHashTable *shared_data = NULL;
+static janus_mutex shared_data_mutex = JANUS_MUTEX_INITIALIZER;
+
+janus_lua_state *janus_lua_state_from(lua_State *s) {
+	if(s == NULL)
+		return NULL;
+	lua_getfield(s, LUA_REGISTRYINDEX, JANUS_LUA_STATE_KEY);
+	janus_lua_state *state = (janus_lua_state *)lua_touserdata(s, -1);
+	lua_pop(s, 1);
+	return state;
+}
 
 /* Helper function to sample the number of occupied slots into Lua stack */
 static void janus_lua_stackdump(lua_State* l) {
@@ -397,6 +461,13 @@ typedef struct janus_lua_async_event {
 	json_t *event;						/* Content of the notification, if any */
 	json_t *jsep;						/* Content of JSEP SDP, if any */
 } janus_lua_async_event;
+/* Pool of threads to push events that need to be asynchronous (0 means a thread per event) */
+#define JANUS_LUA_DEFAULT_ASYNC_THREADS	4
+#define JANUS_LUA_MAX_ASYNC_THREADS		64
+static int async_threads = JANUS_LUA_DEFAULT_ASYNC_THREADS;
+static GThreadPool *async_events = NULL;
+/* How many events were sent asynchronously, and how many were queued at most */
+static volatile gint async_events_pushed = 0, async_events_max_queued = 0;
 /* Helper thread to push events that need to be asynchronous, e.g., for those
  * that would keep the Lua state busy longer than usual and cause delays,
  * or those that might actually result in a deadlock if done synchronously */
@@ -415,6 +486,45 @@ static void *janus_lua_async_event_helper(void *data) {
 	g_free(asev);
 	return NULL;
 }
+/* Same as above, but as a task of the async events pool */
+static void janus_lua_async_event_task(gpointer data, gpointer user_data) {
+	janus_lua_async_event_helper(data);
+}
+/* Helper to send an event asynchronously, via the pool if we have one */
+static gboolean janus_lua_async_event_push(janus_lua_async_event *asev) {
+	GError *error = NULL;
+	if(async_events != NULL) {
+		g_thread_pool_push(async_events, asev, &error);
+	} else {
+		g_thread_try_new("lua pushevent", janus_lua_async_event_helper, asev, &error);
+	}
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua pushevent thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		return FALSE;
+	}
+	g_atomic_int_inc(&async_events_pushed);
+	if(async_events != NULL) {
+		/* Keep track of the queue depth, so that it can be monitored */
+		gint queued = g_thread_pool_unprocessed(async_events);
+		gint max = g_atomic_int_get(&async_events_max_queued);
+		while(queued > max && !g_atomic_int_compare_and_exchange(&async_events_max_queued, max, queued))
+			max = g_atomic_int_get(&async_events_max_queued);
+	}
+	return TRUE;
+}
+/* Helper to return the stats on asynchronous events as a string (must be freed) */
+static char *janus_lua_async_event_stats(void) {
+	json_t *stats = json_object();
+	json_object_set_new(stats, "threads", json_integer(async_events ? async_threads : 0));
+	json_object_set_new(stats, "queued", json_integer(async_events ? g_thread_pool_unprocessed(async_events) : 0));
+	json_object_set_new(stats, "max_queued", json_integer(g_atomic_int_get(&async_events_max_queued)));
+	json_object_set_new(stats, "pushed", json_integer(g_atomic_int_get(&async_events_pushed)));
+	char *text = json_dumps(stats, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
+	json_decref(stats);
+	return text;
+}
 
 
 /* Methods that we expose to the Lua script */
@@ -437,7 +547,12 @@ static int janus_lua_method_januslog(lua_State *s) {
 
 static int janus_lua_method_pokescheduler(lua_State *s) {
 	/* This method allows the Lua script to poke the scheduler and have it wake up ASAP */
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_lua_event_resume));
+	janus_lua_state *state = janus_lua_state_from(s);
+	if(state == NULL) {
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	g_async_queue_push(state->events, GUINT_TO_POINTER(janus_lua_event_resume));
 	lua_pushnumber(s, 0);
 	return 1;
 }
@@ -458,15 +573,21 @@ static int janus_lua_method_timecallback(lua_State *s) {
 	}
 	const char *argument = lua_tostring(s, 2);
 	guint32 ms = lua_tonumber(s, 3);
-	/* Create a callback instance */
+	janus_lua_state *state = janus_lua_state_from(s);
+	if(state == NULL) {
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	/* Create a callback instance: it will be invoked in the same state */
 	janus_lua_callback *cb = g_malloc0(sizeof(janus_lua_callback));
+	cb->state = state;
 	cb->function = g_strdup(function);
 	if(argument != NULL)
 		cb->argument = g_strdup(argument);
 	cb->ms = ms;
 	cb->source = g_timeout_source_new(ms);
 	g_source_set_callback(cb->source, janus_lua_timer_cb, cb, NULL);
-	g_hash_table_insert(callbacks, cb, cb);
+	g_hash_table_insert(state->callbacks, cb, cb);
 	cb->id = g_source_attach(cb->source, timer_context);
 	JANUS_LOG(LOG_VERB, "Created scheduled callback (%"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
 	/* Done */
@@ -550,12 +671,8 @@ static int janus_lua_method_pushevent(lua_State *s) {
 		}
 		janus_sdp_destroy(parsed_sdp);
 		/* Send asynchronously */
-		GError *error = NULL;
-		g_thread_try_new("lua pushevent", janus_lua_async_event_helper, asev, &error);
-		if(error != NULL) {
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua pushevent thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
+		gboolean sent = janus_lua_async_event_push(asev);
+		if(!sent) {
 			json_decref(event);
 			json_decref(jsep);
 			g_free(asev->transaction);
@@ -563,7 +680,7 @@ static int janus_lua_method_pushevent(lua_State *s) {
 			g_free(asev);
 		}
 		/* Return a success/error right away */
-		lua_pushnumber(s, error ? 1 : 0);
+		lua_pushnumber(s, sent ? 0 : 1);
 		return 1;
 	}
 	/* No SDP, send the event now */
@@ -876,6 +993,37 @@ static int janus_lua_method_setplifreq(lua_State *s) {
 	return 1;
 }
 
+static int janus_lua_method_setmediahooks(lua_State *s) {
+	/* Get the arguments from the provided state */
+	int n = lua_gettop(s);
+	if(n != 3) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 3)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	guint32 id = lua_tonumber(s, 1);
+	int rtp = lua_toboolean(s, 2);
+	int rtcp = lua_toboolean(s, 3);
+	/* Find the session */
+	janus_mutex_lock(&lua_sessions_mutex);
+	janus_lua_session *session = g_hash_table_lookup(lua_ids, GUINT_TO_POINTER(id));
+	if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+		janus_mutex_unlock(&lua_sessions_mutex);
+		lua_pushnumber(s, -1);
+		return 1;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&lua_sessions_mutex);
+	/* When disabled, packets are handled as if the script didn't implement
+	 * incomingRtp/incomingRtcp, i.e., relayed natively to the recipients */
+	session->rtp_hook = rtp ? TRUE : FALSE;
+	session->rtcp_hook = rtcp ? TRUE : FALSE;
+	/* Done */
+	janus_refcount_decrease(&session->ref);
+	lua_pushnumber(s, 0);
+	return 1;
+}
+
 static int janus_lua_method_setsubstream(lua_State *s) {
 	/* Get the arguments from the provided state */
 	int n = lua_gettop(s);
@@ -1318,57 +1466,85 @@ static int janus_lua_method_stoprecording(lua_State *s) {
 	return 1;
 }
 
+static int janus_lua_method_getasynceventsstats(lua_State *s) {
+	/* This method allows the Lua script to monitor the events that are sent asynchronously */
+	char *stats = janus_lua_async_event_stats();
+	lua_pushstring(s, stats);
+	free(stats);
+	return 1;
+}
 
-/* Plugin implementation */
-int janus_lua_init(janus_callbacks *callback, const char *config_path) {
-	if(g_atomic_int_get(&lua_stopping)) {
-		/* Still stopping from before */
-		return -1;
+static int janus_lua_method_setshareddata(lua_State *s) {
+	/* This method allows the Lua script to share a value with the other Lua states */
+	int n = lua_gettop(s);
+	if(n != 2) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
+		lua_pushnumber(s, -1);
+		return 1;
 	}
-	if(callback == NULL || config_path == NULL) {
-		/* Invalid arguments */
-		return -1;
+	const char *key = lua_tostring(s, 1);
+	if(key == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid argument (missing key)\n");
+		lua_pushnumber(s, -1);
+		return 1;
 	}
+	const char *value = lua_tostring(s, 2);
+	janus_mutex_lock(&shared_data_mutex);
+	if(value == NULL)
+		g_hash_table_remove(shared_data, key);
+	else
+		g_hash_table_insert(shared_data, g_strdup(key), g_strdup(value));
+	janus_mutex_unlock(&shared_data_mutex);
+	lua_pushnumber(s, 0);
+	return 1;
+}
 
-	/* Read configuration */
-	char filename[255];
-	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_LUA_PACKAGE);
-	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-	janus_config *config = janus_config_parse(filename);
-	if(config == NULL) {
-		JANUS_LOG(LOG_WARN, "Couldn't find .jcfg configuration file (%s), trying .cfg\n", JANUS_LUA_PACKAGE);
-		g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_LUA_PACKAGE);
-		JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-		config = janus_config_parse(filename);
-	}
-	if(config == NULL) {
-		/* No config means no Lua script */
-		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Lua plugin...\n");
-		return -1;
+static int janus_lua_method_getshareddata(lua_State *s) {
+	/* This method allows the Lua script to retrieve a value shared by any of the Lua states */
+	int n = lua_gettop(s);
+	if(n != 1) {
+		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
+		lua_pushnil(s);
+		return 1;
 	}
-	janus_config_print(config);
-	janus_config_category *config_general = janus_config_get_create(config, NULL, janus_config_type_category, "general");
-	char *lua_folder = NULL;
-	janus_config_item *folder = janus_config_get(config, config_general, janus_config_type_item, "path");
-	if(folder && folder->value)
-		lua_folder = g_strdup(folder->value);
-	janus_config_item *script = janus_config_get(config, config_general, janus_config_type_item, "script");
-	if(script == NULL || script->value == NULL) {
-		JANUS_LOG(LOG_ERR, "Missing script path in Lua plugin configuration...\n");
-		janus_config_destroy(config);
-		g_free(lua_folder);
-		return -1;
+	const char *key = lua_tostring(s, 1);
+	if(key == NULL) {
+		lua_pushnil(s);
+		return 1;
 	}
-	char *lua_file = g_strdup(script->value);
-	char *lua_config = NULL;
-	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
-	if(conf && conf->value)
-		lua_config = g_strdup(conf->value);
-	janus_config_destroy(config);
+	/* We copy the value to the Lua stack while holding the lock, as it may be replaced right after */
+	janus_mutex_lock(&shared_data_mutex);
+	const char *value = g_hash_table_lookup(shared_data, key);
+	if(value == NULL)
+		lua_pushnil(s);
+	else
+		lua_pushstring(s, value);
+	janus_mutex_unlock(&shared_data_mutex);
+	return 1;
+}
+
+static int janus_lua_method_getstateid(lua_State *s) {
+	/* This method allows the Lua script to know which of the Lua states it's running in */
+	janus_lua_state *state = janus_lua_state_from(s);
+	lua_pushnumber(s, state ? (int)state->id : -1);
+	return 1;
+}
 
-	/* Initialize Lua */
-	lua_state = luaL_newstate();
+
+/* Helpers to create and get rid of Lua states */
+static void janus_lua_state_destroy(janus_lua_state *state);
+static janus_lua_state *janus_lua_state_create(guint id, const char *lua_folder, const char *lua_file) {
+	janus_lua_state *state = g_malloc0(sizeof(janus_lua_state));
+	state->id = id;
+	janus_mutex_init(&state->mutex);
+	state->events = g_async_queue_new();
+	state->callbacks = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_lua_callback_free);
+	lua_State *lua_state = luaL_newstate();
+	state->state = lua_state;
 	luaL_openlibs(lua_state);
+	/* Keep track of the state in the registry, so that our functions know where they're invoked from */
+	lua_pushlightuserdata(lua_state, state);
+	lua_setfield(lua_state, LUA_REGISTRYINDEX, JANUS_LUA_STATE_KEY);
 
 	if(lua_folder != NULL) {
 		/* Add the script folder to the path, so that we can load other scripts from there */
@@ -1398,6 +1574,7 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_register(lua_state, "removeRecipient", janus_lua_method_removerecipient);
 	lua_register(lua_state, "setBitrate", janus_lua_method_setbitrate);
 	lua_register(lua_state, "setPliFreq", janus_lua_method_setplifreq);
+	lua_register(lua_state, "setMediaHooks", janus_lua_method_setmediahooks);
 	lua_register(lua_state, "setSubstream", janus_lua_method_setsubstream);
 	lua_register(lua_state, "setTemporalLayer", janus_lua_method_settemporallayer);
 	lua_register(lua_state, "sendPli", janus_lua_method_sendpli);
@@ -1408,6 +1585,10 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	lua_register(lua_state, "relayBinaryData", janus_lua_method_relaybinarydata);
 	lua_register(lua_state, "startRecording", janus_lua_method_startrecording);
 	lua_register(lua_state, "stopRecording", janus_lua_method_stoprecording);
+	lua_register(lua_state, "setSharedData", janus_lua_method_setshareddata);
+	lua_register(lua_state, "getSharedData", janus_lua_method_getshareddata);
+	lua_register(lua_state, "getStateId", janus_lua_method_getstateid);
+	lua_register(lua_state, "getAsyncEventsStats", janus_lua_method_getasynceventsstats);
 	/* Register all extra functions, if any were added */
 	janus_lua_register_extra_functions(lua_state);
 
@@ -1415,10 +1596,8 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	int err = luaL_dofile(lua_state, lua_file);
 	if(err) {
 		JANUS_LOG(LOG_ERR, "Error loading Lua script %s: %s\n", lua_file, lua_tostring(lua_state, -1));
-		lua_close(lua_state);
-		g_free(lua_folder);
-		g_free(lua_file);
-		return -1;
+		janus_lua_state_destroy(state);
+		return NULL;
 	}
 	/* Make sure that all the functions we need are there */
 	uint i=0;
@@ -1426,15 +1605,137 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 		lua_getglobal(lua_state, lua_functions[i]);
 		if(lua_isfunction(lua_state, lua_gettop(lua_state)) == 0) {
 			JANUS_LOG(LOG_ERR, "Function '%s' is missing in %s\n", lua_functions[i], lua_file);
-			lua_close(lua_state);
+			janus_lua_state_destroy(state);
+			return NULL;
+		}
+	}
+	lua_settop(lua_state, 0);
+	return state;
+}
+
+static void janus_lua_state_destroy(janus_lua_state *state) {
+	if(state == NULL)
+		return;
+	if(state->scheduler != NULL) {
+		g_async_queue_push(state->events, GUINT_TO_POINTER(janus_lua_event_exit));
+		g_thread_join(state->scheduler);
+		state->scheduler = NULL;
+	}
+	janus_mutex_lock(&state->mutex);
+	g_hash_table_destroy(state->callbacks);
+	state->callbacks = NULL;
+	if(state->state != NULL)
+		lua_close(state->state);
+	state->state = NULL;
+	janus_mutex_unlock(&state->mutex);
+	g_async_queue_unref(state->events);
+	janus_mutex_destroy(&state->mutex);
+	g_free(state);
+}
+
+static void janus_lua_states_cleanup(void) {
+	if(lua_states == NULL)
+		return;
+	int i=0;
+	for(i=0; lua_states[i] != NULL; i++)
+		janus_lua_state_destroy(lua_states[i]);
+	g_free(lua_states);
+	lua_states = NULL;
+}
+
+/* Plugin implementation */
+int janus_lua_init(janus_callbacks *callback, const char *config_path) {
+	if(g_atomic_int_get(&lua_stopping)) {
+		/* Still stopping from before */
+		return -1;
+	}
+	if(callback == NULL || config_path == NULL) {
+		/* Invalid arguments */
+		return -1;
+	}
+
+	/* Read configuration */
+	char filename[255];
+	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_LUA_PACKAGE);
+	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+	janus_config *config = janus_config_parse(filename);
+	if(config == NULL) {
+		JANUS_LOG(LOG_WARN, "Couldn't find .jcfg configuration file (%s), trying .cfg\n", JANUS_LUA_PACKAGE);
+		g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_LUA_PACKAGE);
+		JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+		config = janus_config_parse(filename);
+	}
+	if(config == NULL) {
+		/* No config means no Lua script */
+		JANUS_LOG(LOG_ERR, "Failed to load configuration file for Lua plugin...\n");
+		return -1;
+	}
+	janus_config_print(config);
+	janus_config_category *config_general = janus_config_get_create(config, NULL, janus_config_type_category, "general");
+	char *lua_folder = NULL;
+	janus_config_item *folder = janus_config_get(config, config_general, janus_config_type_item, "path");
+	if(folder && folder->value)
+		lua_folder = g_strdup(folder->value);
+	janus_config_item *script = janus_config_get(config, config_general, janus_config_type_item, "script");
+	if(script == NULL || script->value == NULL) {
+		JANUS_LOG(LOG_ERR, "Missing script path in Lua plugin configuration...\n");
+		janus_config_destroy(config);
+		g_free(lua_folder);
+		return -1;
+	}
+	char *lua_file = g_strdup(script->value);
+	char *lua_config = NULL;
+	janus_config_item *conf = janus_config_get(config, config_general, janus_config_type_item, "config");
+	if(conf && conf->value)
+		lua_config = g_strdup(conf->value);
+	janus_config_item *states = janus_config_get(config, config_general, janus_config_type_item, "states");
+	if(states && states->value) {
+		if(!strcasecmp(states->value, "auto"))
+			lua_states_num = g_get_num_processors();
+		else
+			lua_states_num = atoi(states->value);
+		if(lua_states_num < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid states value %s, using a single Lua state\n", states->value);
+			lua_states_num = 1;
+		} else if(lua_states_num > JANUS_LUA_MAX_STATES) {
+			JANUS_LOG(LOG_WARN, "Too many Lua states (%d), capping to %d\n", lua_states_num, JANUS_LUA_MAX_STATES);
+			lua_states_num = JANUS_LUA_MAX_STATES;
+		}
+	}
+	janus_config_item *at = janus_config_get(config, config_general, janus_config_type_item, "async_threads");
+	if(at && at->value) {
+		if(!strcasecmp(at->value, "auto"))
+			async_threads = g_get_num_processors();
+		else
+			async_threads = atoi(at->value);
+		if(async_threads < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid async_threads value %s, using a thread per event\n", at->value);
+			async_threads = 0;
+		} else if(async_threads > JANUS_LUA_MAX_ASYNC_THREADS) {
+			JANUS_LOG(LOG_WARN, "Too many async threads (%d), capping to %d\n", async_threads, JANUS_LUA_MAX_ASYNC_THREADS);
+			async_threads = JANUS_LUA_MAX_ASYNC_THREADS;
+		}
+	}
+	janus_config_destroy(config);
+
+	/* Initialize Lua: each state loads its own copy of the script */
+	lua_states = g_malloc0((lua_states_num+1)*sizeof(janus_lua_state *));
+	int i=0;
+	for(i=0; i<lua_states_num; i++) {
+		lua_states[i] = janus_lua_state_create(i, lua_folder, lua_file);
+		if(lua_states[i] == NULL) {
+			janus_lua_states_cleanup();
 			g_free(lua_folder);
 			g_free(lua_file);
+			g_free(lua_config);
 			return -1;
 		}
 	}
 	/* Some Lua functions are optional (e.g., those to directly handle RTP, RTCP and
 	 * data, as those will typically be kept at a C level, with Lua only dictating
-	 * the logic, or those overriding the plugin namespace and versioning information */
+	 * the logic, or those overriding the plugin namespace and versioning information):
+	 * all states run the same script, so we only need to check the first one */
+	lua_State *lua_state = lua_states[0]->state;
 	lua_getglobal(lua_state, "getVersion");
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_get_version = TRUE;
@@ -1487,26 +1788,34 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 	if(lua_isfunction(lua_state, lua_gettop(lua_state)) != 0)
 		has_temporal_changed = TRUE;
 
+	lua_settop(lua_state, 0);
+
 	lua_sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_lua_session_destroy);
 	lua_ids = g_hash_table_new(NULL, NULL);
-	events = g_async_queue_new();
-	callbacks = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_lua_callback_free);
+	shared_data = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
 
 	g_atomic_int_set(&lua_initialized, 1);
 
-	/* Launch the scheduler thread (which will be responsible for resuming asynchronous coroutines) */
+	/* Launch the scheduler threads (which will be responsible for resuming asynchronous coroutines) */
 	GError *error = NULL;
-	scheduler_thread = g_thread_try_new("lua scheduler", janus_lua_scheduler, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&lua_initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua scheduler thread...\n",
-			error->code, error->message ? error->message : "??");
-		g_error_free(error);
-		lua_close(lua_state);
-		g_free(lua_folder);
-		g_free(lua_file);
-		g_free(lua_config);
-		return -1;
+	for(i=0; i<lua_states_num; i++) {
+		char tname[16];
+		if(lua_states_num == 1)
+			g_snprintf(tname, sizeof(tname), "lua scheduler");
+		else
+			g_snprintf(tname, sizeof(tname), "lua sched %d", i);
+		lua_states[i]->scheduler = g_thread_try_new(tname, janus_lua_scheduler, lua_states[i], &error);
+		if(error != NULL) {
+			g_atomic_int_set(&lua_initialized, 0);
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Lua scheduler thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_lua_states_cleanup();
+			g_free(lua_folder);
+			g_free(lua_file);
+			g_free(lua_config);
+			return -1;
+		}
 	}
 	/* Launch the timer loop thread (which will be responsible for scheduling timed callbacks) */
 	timer_context = g_main_context_new();
@@ -1521,25 +1830,45 @@ int janus_lua_init(janus_callbacks *callback, const char *config_path) {
 			g_main_loop_unref(timer_loop);
 		if(timer_context != NULL)
 			g_main_context_unref(timer_context);
-		lua_close(lua_state);
+		janus_lua_states_cleanup();
 		g_free(lua_folder);
 		g_free(lua_file);
 		g_free(lua_config);
 		return -1;
 	}
 
+	if(async_threads > 0) {
+		/* Use a pool of threads to send asynchronous events, rather than one thread per event */
+		async_events = g_thread_pool_new(janus_lua_async_event_task, NULL, async_threads, FALSE, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the pool of async events threads, falling back to per-event threads\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			error = NULL;
+			async_events = NULL;
+		} else {
+			JANUS_LOG(LOG_INFO, "Using a pool of %d threads to send asynchronous events\n", async_threads);
+		}
+	}
+
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	lua_janus_core = callback;
 
-	/* Init the Lua script, in case it's needed */
-	lua_getglobal(lua_state, "init");
-	lua_pushstring(lua_state, lua_config);
-	lua_call(lua_state, 1, 0);
+	/* Init the Lua script in all states, in case it's needed */
+	for(i=0; i<lua_states_num; i++) {
+		janus_mutex_lock(&lua_states[i]->mutex);
+		lua_getglobal(lua_states[i]->state, "init");
+		lua_pushstring(lua_states[i]->state, lua_config);
+		lua_call(lua_states[i]->state, 1, 0);
+		janus_mutex_unlock(&lua_states[i]->mutex);
+	}
 
 	g_free(lua_folder);
 	g_free(lua_file);
 	g_free(lua_config);
 
+	if(lua_states_num > 1)
+		JANUS_LOG(LOG_INFO, "Using %d Lua states\n", lua_states_num);
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_LUA_NAME);
 	return 0;
 }
@@ -1549,10 +1878,13 @@ void janus_lua_destroy(void) {
 		return;
 	g_atomic_int_set(&lua_stopping, 1);
 
-	g_async_queue_push(events, GUINT_TO_POINTER(janus_lua_event_exit));
-	if(scheduler_thread != NULL) {
-		g_thread_join(scheduler_thread);
-		scheduler_thread = NULL;
+	int i=0;
+	for(i=0; lua_states[i] != NULL; i++) {
+		g_async_queue_push(lua_states[i]->events, GUINT_TO_POINTER(janus_lua_event_exit));
+		if(lua_states[i]->scheduler != NULL) {
+			g_thread_join(lua_states[i]->scheduler);
+			lua_states[i]->scheduler = NULL;
+		}
 	}
 	if(timer_loop != NULL)
 		g_main_loop_quit(timer_loop);
@@ -1560,6 +1892,11 @@ void janus_lua_destroy(void) {
 		g_thread_join(timer_thread);
 		timer_thread = NULL;
 	}
+	if(async_events != NULL) {
+		/* Send the events that are still queued, and wait for the pool threads */
+		g_thread_pool_free(async_events, FALSE, TRUE);
+		async_events = NULL;
+	}
 	if(timer_loop != NULL) {
 		g_main_loop_unref(timer_loop);
 		timer_loop = NULL;
@@ -1569,27 +1906,26 @@ void janus_lua_destroy(void) {
 		timer_context = NULL;
 	}
 
-	/* Deinit the Lua script, in case it's needed */
-	janus_mutex_lock(&lua_mutex);
-	lua_getglobal(lua_state, "destroy");
-	lua_call(lua_state, 0, 0);
-	g_hash_table_destroy(callbacks);
-	callbacks = NULL;
-	janus_mutex_unlock(&lua_mutex);
+	/* Deinit the Lua script in all states, in case it's needed */
+	for(i=0; lua_states[i] != NULL; i++) {
+		janus_mutex_lock(&lua_states[i]->mutex);
+		lua_getglobal(lua_states[i]->state, "destroy");
+		lua_call(lua_states[i]->state, 0, 0);
+		janus_mutex_unlock(&lua_states[i]->mutex);
+	}
 
 	janus_mutex_lock(&lua_sessions_mutex);
 	g_hash_table_destroy(lua_sessions);
 	lua_sessions = NULL;
 	g_hash_table_destroy(lua_ids);
 	lua_ids = NULL;
-	g_async_queue_unref(events);
-	events = NULL;
 	janus_mutex_unlock(&lua_sessions_mutex);
 
-	janus_mutex_lock(&lua_mutex);
-	lua_close(lua_state);
-	lua_state = NULL;
-	janus_mutex_unlock(&lua_mutex);
+	janus_lua_states_cleanup();
+	janus_mutex_lock(&shared_data_mutex);
+	g_hash_table_destroy(shared_data);
+	shared_data = NULL;
+	janus_mutex_unlock(&shared_data_mutex);
 
 	g_free(lua_script_version_string);
 	g_free(lua_script_description);
@@ -1615,13 +1951,13 @@ int janus_lua_get_version(void) {
 			/* Unless we asked already */
 			return lua_script_version;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getVersion");
 		lua_call(t, 0, 1);
 		lua_script_version = (int)lua_tonumber(t, -1);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_version;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1636,15 +1972,15 @@ const char *janus_lua_get_version_string(void) {
 			/* Unless we asked already */
 			return lua_script_version_string;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getVersionString");
 		lua_call(t, 0, 1);
 		const char *version = lua_tostring(t, -1);
 		if(version != NULL)
 			lua_script_version_string = g_strdup(version);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_version_string;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1659,15 +1995,15 @@ const char *janus_lua_get_description(void) {
 			/* Unless we asked already */
 			return lua_script_description;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getDescription");
 		lua_call(t, 0, 1);
 		const char *description = lua_tostring(t, -1);
 		if(description != NULL)
 			lua_script_description = g_strdup(description);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_description;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1682,15 +2018,15 @@ const char *janus_lua_get_name(void) {
 			/* Unless we asked already */
 			return lua_script_name;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getName");
 		lua_call(t, 0, 1);
 		const char *name = lua_tostring(t, -1);
 		if(name != NULL)
 			lua_script_name = g_strdup(name);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_name;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1705,15 +2041,15 @@ const char *janus_lua_get_author(void) {
 			/* Unless we asked already */
 			return lua_script_author;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getAuthor");
 		lua_call(t, 0, 1);
 		const char *author = lua_tostring(t, -1);
 		if(author != NULL)
 			lua_script_author = g_strdup(author);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_author;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1728,15 +2064,15 @@ const char *janus_lua_get_package(void) {
 			/* Unless we asked already */
 			return lua_script_package;
 		}
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&lua_states[0]->mutex);
+		lua_State *t = lua_newthread(lua_states[0]->state);
 		lua_getglobal(t, "getPackage");
 		lua_call(t, 0, 1);
 		const char *package = lua_tostring(t, -1);
 		if(package != NULL)
 			lua_script_package = g_strdup(package);
 		lua_pop(t, 1);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		return lua_script_package;
 	}
 	/* No override, return the Janus Lua plugin info */
@@ -1769,6 +2105,14 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_lua_session *session = (janus_lua_session *)g_malloc0(sizeof(janus_lua_session));
 	session->handle = handle;
 	session->id = id;
+	/* Bind the session to the Lua state serving the fewest sessions */
+	int i=0;
+	session->state = lua_states[0];
+	for(i=1; lua_states[i] != NULL; i++) {
+		if(g_atomic_int_get(&lua_states[i]->sessions) < g_atomic_int_get(&session->state->sessions))
+			session->state = lua_states[i];
+	}
+	g_atomic_int_inc(&session->state->sessions);
 	janus_rtp_switching_context_reset(&session->artpctx);
 	janus_rtp_switching_context_reset(&session->vrtpctx);
 	janus_rtp_simulcasting_context_reset(&session->sim_context);
@@ -1778,6 +2122,8 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	session->rid_extmap_id = -1;
 	janus_mutex_init(&session->rid_mutex);
 	session->vcodec = JANUS_VIDEOCODEC_NONE;
+	session->rtp_hook = TRUE;
+	session->rtcp_hook = TRUE;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_lua_session_free);
@@ -1787,13 +2133,13 @@ void janus_lua_create_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "createSession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(session->state->state, 1);
+	janus_mutex_unlock(&session->state->mutex);
 
 	return;
 }
@@ -1817,13 +2163,13 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&lua_sessions_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "destroySession");
 	lua_pushnumber(t, id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(session->state->state, 1);
+	janus_mutex_unlock(&session->state->mutex);
 
 	/* Get any rid references recipients of this sessions may have */
 	janus_mutex_lock(&session->recipients_mutex);
@@ -1839,6 +2185,7 @@ void janus_lua_destroy_session(janus_plugin_session *handle, int *error) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Finally, remove from the hashtable */
+	g_atomic_int_add(&session->state->sessions, -1);
 	janus_mutex_lock(&lua_sessions_mutex);
 	g_hash_table_remove(lua_sessions, handle);
 	janus_mutex_unlock(&lua_sessions_mutex);
@@ -1861,19 +2208,19 @@ json_t *janus_lua_query_session(janus_plugin_session *handle) {
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&lua_sessions_mutex);
 	/* Ask the Lua script for information on this session */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "querySession");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 1);
-	lua_pop(lua_state, 1);
+	lua_pop(session->state->state, 1);
 	janus_refcount_decrease(&session->ref);
 	const char *info = lua_tostring(t, -1);
 	lua_pop(t, 1);
 	/* We need a Jansson object */
 	json_error_t error;
 	json_t *json = json_loads(info, 0, &error);
-	janus_mutex_unlock(&lua_mutex);
+	janus_mutex_unlock(&session->state->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s", error.line, error.text);
 		return NULL;
@@ -1939,15 +2286,15 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 		json_decref(jsep);
 	}
 	/* Invoke the script function */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "handleMessage");
 	lua_pushnumber(t, session->id);
 	lua_pushstring(t, transaction);
 	lua_pushstring(t, message_text);
 	lua_pushstring(t, jsep_text);
 	lua_call(t, 4, 2);
-	lua_pop(lua_state, 1);
+	lua_pop(session->state->state, 1);
 	janus_refcount_decrease(&session->ref);
 	if(message_text != NULL)
 		free(message_text);
@@ -1956,7 +2303,7 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	g_free(transaction);
 	int n = lua_gettop(t);
 	if(n != 2) {
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&session->state->mutex);
 		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 2)\n", n);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 	}
@@ -1966,20 +2313,20 @@ struct janus_plugin_result *janus_lua_handle_message(janus_plugin_session *handl
 	lua_pop(t, 2);
 	if(res < 0) {
 		/* We got an error */
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&session->state->mutex);
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, response ? response : "Lua error", NULL);
 	} else if(res == 0) {
 		/* Synchronous response: we need a Jansson object */
 		json_error_t error;
 		json_t *json = json_loads(response, 0, &error);
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&session->state->mutex);
 		if(!json) {
 			JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 			return janus_plugin_result_new(JANUS_PLUGIN_ERROR, "Lua error", NULL);
 		}
 		return janus_plugin_result_new(JANUS_PLUGIN_OK, NULL, json);
 	}
-	janus_mutex_unlock(&lua_mutex);
+	janus_mutex_unlock(&session->state->mutex);
 	/* If we got here, it's an asynchronous response */
 	return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 }
@@ -1993,17 +2340,17 @@ json_t *janus_lua_handle_admin_message(json_t *message) {
 		return NULL;
 	}
 	/* Invoke the script function */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&lua_states[0]->mutex);
+	lua_State *t = lua_newthread(lua_states[0]->state);
 	lua_getglobal(t, "handleAdminMessage");
 	lua_pushstring(t, message_text);
 	lua_call(t, 1, 1);
-	lua_pop(lua_state, 1);
+	lua_pop(lua_states[0]->state, 1);
 	if(message_text != NULL)
 		free(message_text);
 	int n = lua_gettop(t);
 	if(n != 1) {
-		janus_mutex_unlock(&lua_mutex);
+		janus_mutex_unlock(&lua_states[0]->mutex);
 		JANUS_LOG(LOG_ERR, "Wrong number of arguments: %d (expected 1)\n", n);
 		return NULL;
 	}
@@ -2011,7 +2358,7 @@ json_t *janus_lua_handle_admin_message(json_t *message) {
 	const char *response = lua_tostring(t, 1);
 	json_error_t error;
 	json_t *json = json_loads(response, 0, &error);
-	janus_mutex_unlock(&lua_mutex);
+	janus_mutex_unlock(&lua_states[0]->mutex);
 	if(!json) {
 		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 		return NULL;
@@ -2041,13 +2388,13 @@ void janus_lua_setup_media(janus_plugin_session *handle) {
 	session->pli_latest = janus_get_monotonic_time();
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "setupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(session->state->state, 1);
+	janus_mutex_unlock(&session->state->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2065,18 +2412,18 @@ void janus_lua_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *rtp_
 	char *buf = rtp_packet->buffer;
 	uint16_t len = rtp_packet->length;
 	/* Check if the Lua script wants to handle/manipulate RTP packets itself */
-	if(has_incoming_rtp) {
+	if(has_incoming_rtp && session->rtp_hook) {
 		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&session->state->mutex);
+		lua_State *t = lua_newthread(session->state->state);
 		lua_getglobal(t, "incomingRtp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(session->state->state, 1);
+		janus_mutex_unlock(&session->state->mutex);
 		return;
 	}
 	/* Is this session allowed to send media? */
@@ -2178,18 +2525,18 @@ void janus_lua_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 	char *buf = packet->buffer;
 	uint16_t len = packet->length;
 	/* Check if the Lua script wants to handle/manipulate RTCP packets itself */
-	if(has_incoming_rtcp) {
+	if(has_incoming_rtcp && session->rtcp_hook) {
 		/* Yep, pass the data to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&session->state->mutex);
+		lua_State *t = lua_newthread(session->state->state);
 		lua_getglobal(t, "incomingRtcp");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, video);
 		lua_pushlstring(t, buf, len);
 		lua_pushnumber(t, len);
 		lua_call(t, 4, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(session->state->state, 1);
+		janus_mutex_unlock(&session->state->mutex);
 		return;
 	}
 	/* If a REMB arrived, make sure we cap it to our configuration, and send it as a video RTCP */
@@ -2232,8 +2579,8 @@ void janus_lua_incoming_data(janus_plugin_session *handle, janus_plugin_data *pa
 		/* Yep, pass the data to the Lua script and return */
 		if(!packet->binary && !has_incoming_text_data)
 			JANUS_LOG(LOG_WARN, "Missing 'incomingTextData', invoking deprecated function 'incomingData' instead\n");
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&session->state->mutex);
+		lua_State *t = lua_newthread(session->state->state);
 		lua_getglobal(t, packet->binary ? "incomingBinaryData" : (has_incoming_text_data ? "incomingTextData" : "incomingData"));
 		lua_pushnumber(t, session->id);
 		/* We use a string for both text and binary data */
@@ -2242,8 +2589,8 @@ void janus_lua_incoming_data(janus_plugin_session *handle, janus_plugin_data *pa
 		lua_pushlstring(t, label, label ? strlen(label) : 0);
 		lua_pushlstring(t, protocol, protocol ? strlen(protocol) : 0);
 		lua_call(t, 5, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(session->state->state, 1);
+		janus_mutex_unlock(&session->state->mutex);
 		return;
 	}
 	/* Is this session allowed to send data? */
@@ -2280,13 +2627,13 @@ void janus_lua_data_ready(janus_plugin_session *handle) {
 	/* Check if the Lua script wants to receive this event */
 	if(has_data_ready) {
 		/* Yep, pass the event to the Lua script and return */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&session->state->mutex);
+		lua_State *t = lua_newthread(session->state->state);
 		lua_getglobal(t, "dataReady");
 		lua_pushnumber(t, session->id);
 		lua_call(t, 1, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(session->state->state, 1);
+		janus_mutex_unlock(&session->state->mutex);
 		return;
 	}
 }
@@ -2308,15 +2655,15 @@ void janus_lua_slow_link(janus_plugin_session *handle, int mindex, gboolean vide
 	janus_refcount_increase(&session->ref);
 	if(has_slow_link) {
 		/* Notify the Lua script */
-		janus_mutex_lock(&lua_mutex);
-		lua_State *t = lua_newthread(lua_state);
+		janus_mutex_lock(&session->state->mutex);
+		lua_State *t = lua_newthread(session->state->state);
 		lua_getglobal(t, "slowLink");
 		lua_pushnumber(t, session->id);
 		lua_pushboolean(t, uplink);
 		lua_pushboolean(t, video);
 		lua_call(t, 3, 0);
-		lua_pop(lua_state, 1);
-		janus_mutex_unlock(&lua_mutex);
+		lua_pop(session->state->state, 1);
+		janus_mutex_unlock(&session->state->mutex);
 	}
 	janus_refcount_decrease(&session->ref);
 }
@@ -2377,13 +2724,13 @@ void janus_lua_hangup_media(janus_plugin_session *handle) {
 	janus_mutex_unlock(&session->recipients_mutex);
 
 	/* Notify the Lua script */
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_mutex_lock(&session->state->mutex);
+	lua_State *t = lua_newthread(session->state->state);
 	lua_getglobal(t, "hangupMedia");
 	lua_pushnumber(t, session->id);
 	lua_call(t, 1, 0);
-	lua_pop(lua_state, 1);
-	janus_mutex_unlock(&lua_mutex);
+	lua_pop(session->state->state, 1);
+	janus_mutex_unlock(&session->state->mutex);
 	janus_refcount_decrease(&session->ref);
 }
 
@@ -2427,27 +2774,27 @@ static void janus_lua_relay_rtp_packet(gpointer data, gpointer user_data) {
 		if(session->sim_context.changed_substream) {
 			/* Notify the script about the substream change */
 			if(has_substream_changed) {
-				janus_mutex_lock(&lua_mutex);
-				lua_State *t = lua_newthread(lua_state);
+				janus_mutex_lock(&session->state->mutex);
+				lua_State *t = lua_newthread(session->state->state);
 				lua_getglobal(t, "substreamChanged");
 				lua_pushnumber(t, session->id);
 				lua_pushnumber(t, session->sim_context.substream);
 				lua_call(t, 2, 0);
-				lua_pop(lua_state, 1);
-				janus_mutex_unlock(&lua_mutex);
+				lua_pop(session->state->state, 1);
+				janus_mutex_unlock(&session->state->mutex);
 			}
 		}
 		if(session->sim_context.changed_temporal) {
 			/* Notify the user about the temporal layer change */
 			if(has_substream_changed) {
-				janus_mutex_lock(&lua_mutex);
-				lua_State *t = lua_newthread(lua_state);
+				janus_mutex_lock(&session->state->mutex);
+				lua_State *t = lua_newthread(session->state->state);
 				lua_getglobal(t, "temporalLayerChanged");
 				lua_pushnumber(t, session->id);
 				lua_pushnumber(t, session->sim_context.templayer);
 				lua_call(t, 2, 0);
-				lua_pop(lua_state, 1);
-				janus_mutex_unlock(&lua_mutex);
+				lua_pop(session->state->state, 1);
+				janus_mutex_unlock(&session->state->mutex);
 			}
 		}
 		/* If we got here, update the RTP header and send the packet */
@@ -2517,26 +2864,28 @@ static void janus_lua_relay_data_packet(gpointer data, gpointer user_data) {
 }
 
 /* This is a scheduler thread: if we know there are coroutines to resume
- * in Lua (e.g., for asynchronous requests), we do that ourselves here */
+ * in Lua (e.g., for asynchronous requests), we do that ourselves here;
+ * each Lua state has its own, so that they can resume coroutines in parallel */
 static void *janus_lua_scheduler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining Lua scheduler thread\n");
+	janus_lua_state *state = (janus_lua_state *)data;
+	JANUS_LOG(LOG_VERB, "Joining Lua scheduler thread (state #%u)\n", state->id);
 	janus_lua_event *event = NULL;
 	/* Wait until there are events to process */
 	while(g_atomic_int_get(&lua_initialized) && !g_atomic_int_get(&lua_stopping)) {
-		event = g_async_queue_pop(events);
+		event = g_async_queue_pop(state->events);
 		if(event == GUINT_TO_POINTER(janus_lua_event_exit))
 			break;
 		if(event == GUINT_TO_POINTER(janus_lua_event_resume)) {
 			/* There are coroutines to resume */
-			janus_mutex_lock(&lua_mutex);
-			lua_getglobal(lua_state, "resumeScheduler");
-			lua_call(lua_state, 0, 0);
+			janus_mutex_lock(&state->mutex);
+			lua_getglobal(state->state, "resumeScheduler");
+			lua_call(state->state, 0, 0);
 			/* Print the count of elements into Lua stack */
-			janus_lua_stackdump(lua_state);
-			janus_mutex_unlock(&lua_mutex);
+			janus_lua_stackdump(state->state);
+			janus_mutex_unlock(&state->mutex);
 		}
 	}
-	JANUS_LOG(LOG_VERB, "Leaving Lua scheduler thread\n");
+	JANUS_LOG(LOG_VERB, "Leaving Lua scheduler thread (state #%u)\n", state->id);
 	return NULL;
 }
 
@@ -2561,8 +2910,9 @@ static gboolean janus_lua_timer_cb(void *data) {
 		return FALSE;
 	/* Invoke the callback with the provided argument, if available */
 	JANUS_LOG(LOG_VERB, "Invoking scheduled callback (waited %"SCNu32"ms) with ID %u\n", cb->ms, cb->id);
-	janus_mutex_lock(&lua_mutex);
-	lua_State *t = lua_newthread(lua_state);
+	janus_lua_state *state = cb->state;
+	janus_mutex_lock(&state->mutex);
+	lua_State *t = lua_newthread(state->state);
 	lua_getglobal(t, cb->function);
 	if(cb->argument == NULL) {
 		lua_call(t, 0, 0);
@@ -2570,9 +2920,9 @@ static gboolean janus_lua_timer_cb(void *data) {
 		lua_pushstring(t, cb->argument);
 		lua_call(t, 1, 0);
 	}
-	lua_pop(lua_state, 1);
+	lua_pop(state->state, 1);
 	/* Done */
-	g_hash_table_remove(callbacks, cb);
-	janus_mutex_unlock(&lua_mutex);
+	g_hash_table_remove(state->callbacks, cb);
+	janus_mutex_unlock(&state->mutex);
 	return FALSE;
 }
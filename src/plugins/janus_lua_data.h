@@ -43,14 +43,30 @@
 extern volatile gint lua_initialized, lua_stopping;
 extern janus_callbacks *lua_janus_core;
 
-/* Lua state: we define state and mutex as extern */
-extern lua_State *lua_state;
-extern janus_mutex lua_mutex;
+/* Lua states: by default there's a single one, but the plugin can be
+ * configured to use more, in which case sessions are spread across them.
+ * Each state runs its own copy of the script, and has its own mutex and
+ * scheduler thread, so that sessions in different states never wait for
+ * each other: the states are in a NULL-terminated array, and the first
+ * one is also the one used for plugin-wide requests (e.g., Admin API) */
+typedef struct janus_lua_state {
+	guint id;							/* Index of this state in the array */
+	lua_State *state;					/* The Lua state itself */
+	janus_mutex mutex;					/* Mutex to serialize access to the Lua state */
+	GThread *scheduler;					/* Thread resuming the coroutines of this state */
+	GAsyncQueue *events;				/* Events for the scheduler thread */
+	GHashTable *callbacks;				/* Timed callbacks scheduled by this state */
+	volatile gint sessions;				/* How many sessions are bound to this state */
+} janus_lua_state;
+extern janus_lua_state **lua_states;
+/* Helper to get the janus_lua_state instance a Lua C function was invoked from */
+janus_lua_state *janus_lua_state_from(lua_State *s);
 
 /* Lua session: we keep only the barebone stuff here, the rest will be in the Lua script */
 typedef struct janus_lua_session {
 	janus_plugin_session *handle;		/* Pointer to the core-plugin session */
 	uint32_t id;						/* Unique session ID (will be used to correlate with the Lua script) */
+	janus_lua_state *state;				/* Lua state this session is bound to */
 	/* The following are only needed for media manipulation, feedback and routing, and may not all be used */
 	gboolean accept_audio;				/* Whether incoming audio can be accepted or must be dropped */
 	gboolean accept_video;				/* Whether incoming video can be accepted or must be dropped */
@@ -58,6 +74,8 @@ typedef struct janus_lua_session {
 	gboolean send_audio;				/* Whether outgoing audio can be sent or must be dropped */
 	gboolean send_video;				/* Whether outgoing video can be sent or must be dropped */
 	gboolean send_data;					/* Whether outgoing data can be sent or must be dropped */
+	gboolean rtp_hook;					/* Whether incoming RTP is passed to the Lua script (if it handles it), or relayed natively */
+	gboolean rtcp_hook;					/* Whether incoming RTCP is passed to the Lua script (if it handles it), or handled natively */
 	janus_rtp_switching_context artpctx, vrtpctx;
 	janus_videocodec vcodec;			/* Video codec this session is using */
 	uint32_t ssrc[3];					/* Only needed in case VP8 (or H.264) simulcasting is involved */
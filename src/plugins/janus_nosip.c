@@ -149,6 +149,9 @@
  * A \c recordingupdated event is sent back in case the request is successful.
  */
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include "plugin.h"
 
 #include <arpa/inet.h>
@@ -156,6 +159,9 @@
 #include <sys/socket.h>
 #include <netdb.h>
 #include <poll.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include <jansson.h>
 
@@ -286,6 +292,14 @@ static GAsyncQueue *messages = NULL;
 static janus_nosip_message exit_message;
 
 
+/* Per-session counters: the ones for incoming packets are only updated by
+ * the thread relaying the media, the others by the core when sending */
+typedef struct janus_nosip_media_stats {
+	guint64 packets_in, bytes_in;		/* Packets received from the peer */
+	guint64 packets_out, bytes_out;		/* Packets sent to the peer */
+	guint32 srtp_errors;				/* Incoming packets we failed to decrypt */
+} janus_nosip_media_stats;
+
 typedef struct janus_nosip_media {
 	char *remote_audio_ip;
 	char *remote_video_ip;
@@ -322,6 +336,7 @@ typedef struct janus_nosip_media {
 	gboolean updated;
 	int video_orientation_extension_id;
 	int audio_level_extension_id;
+	janus_nosip_media_stats stats;
 } janus_nosip_media;
 
 typedef struct janus_nosip_session {
@@ -335,6 +350,7 @@ typedef struct janus_nosip_session {
 	janus_recorder *vrc_peer;	/* The Janus recorder instance for the peer's video, if enabled */
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders from race conditions */
 	GThread *relayer_thread;
+	struct janus_nosip_reactor *reactor;	/* Reactor thread relaying the media, if any */
 	volatile gint hangingup;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -347,6 +363,11 @@ static void janus_nosip_srtp_cleanup(janus_nosip_session *session);
 
 static void janus_nosip_media_reset(janus_nosip_session *session);
 
+/* Whether the media is being relayed, either by a dedicated thread or by a reactor thread */
+static gboolean janus_nosip_media_relaying(janus_nosip_session *session) {
+	return (session->relayer_thread != NULL || session->reactor != NULL);
+}
+
 static void janus_nosip_session_destroy(janus_nosip_session *session) {
 	if(session && g_atomic_int_compare_and_exchange(&session->destroyed, 0, 1))
 		janus_refcount_decrease(&session->ref);
@@ -642,9 +663,41 @@ void janus_nosip_sdp_process(janus_nosip_session *session, janus_sdp *sdp, gbool
 char *janus_nosip_sdp_manipulate(janus_nosip_session *session, janus_sdp *sdp, gboolean answer);
 /* Media */
 static int janus_nosip_allocate_local_ports(janus_nosip_session *session, gboolean update);
+static void janus_nosip_relay_start(janus_nosip_session *session);
 static void *janus_nosip_relay_thread(void *data);
 static void janus_nosip_media_cleanup(janus_nosip_session *session);
 
+/* Reactor threads, if enabled: rather than having a dedicated thread for
+ * the media of each session, a fixed number of threads serves all of them */
+#define JANUS_NOSIP_MAX_REACTOR_THREADS	64
+static int reactor_threads = 0;
+#ifdef HAVE_EPOLL
+typedef struct janus_nosip_reactor {
+	guint id;
+	int epfd;
+	GThread *thread;
+	volatile gint stop;
+	GList *sessions;		/* List of janus_nosip_reactor_session instances */
+	guint count;			/* How many sessions this reactor is serving */
+	janus_mutex mutex;
+} janus_nosip_reactor;
+static void janus_nosip_reactors_start(int num);
+static void janus_nosip_reactors_stop(void);
+static int janus_nosip_reactor_add(janus_nosip_session *session);
+#endif
+
+/* Packets from the peer are read in batches, where supported (recvmmsg) */
+#define JANUS_NOSIP_RECV_BATCH	16
+typedef struct janus_nosip_recv_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr messages[JANUS_NOSIP_RECV_BATCH];
+	struct iovec iovecs[JANUS_NOSIP_RECV_BATCH];
+#endif
+	int length[JANUS_NOSIP_RECV_BATCH];
+	char data[JANUS_NOSIP_RECV_BATCH][1500];
+} janus_nosip_recv_batch;
+static int janus_nosip_recv_batch_read(janus_nosip_recv_batch *batch, int fd);
+
 
 /* Error codes */
 #define JANUS_NOSIP_ERROR_UNKNOWN_ERROR			499
@@ -776,6 +829,28 @@ int janus_nosip_init(janus_callbacks *callback, const char *config_path) {
 			}
 		}
 
+		/* Should the media of sessions be relayed by reactor threads? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "reactor_threads");
+		if(item && item->value) {
+			if(!strcasecmp(item->value, "auto"))
+				reactor_threads = g_get_num_processors();
+			else
+				reactor_threads = atoi(item->value);
+			if(reactor_threads < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid reactor_threads value %s, using a thread per session\n", item->value);
+				reactor_threads = 0;
+			} else if(reactor_threads > JANUS_NOSIP_MAX_REACTOR_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many reactor threads (%d), capping to %d\n", reactor_threads, JANUS_NOSIP_MAX_REACTOR_THREADS);
+				reactor_threads = JANUS_NOSIP_MAX_REACTOR_THREADS;
+			}
+#ifndef HAVE_EPOLL
+			if(reactor_threads > 0) {
+				JANUS_LOG(LOG_WARN, "epoll not available, using a thread per session\n");
+				reactor_threads = 0;
+			}
+#endif
+		}
+
 		janus_config_destroy(config);
 	}
 	config = NULL;
@@ -809,6 +884,12 @@ int janus_nosip_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_WARN, "IPv6 disabled, will only use IPv4 for RTP/RTCP sockets (NoSIP)\n");
 	}
 
+#ifdef HAVE_EPOLL
+	/* If we need reactor threads to relay the media of sessions, start them too */
+	if(reactor_threads > 0)
+		janus_nosip_reactors_start(reactor_threads);
+#endif
+
 	g_atomic_int_set(&initialized, 1);
 
 	GError *error = NULL;
@@ -835,6 +916,9 @@ void janus_nosip_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+#ifdef HAVE_EPOLL
+	janus_nosip_reactors_stop();
+#endif
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -998,6 +1082,18 @@ json_t *janus_nosip_query_session(janus_plugin_session *handle) {
 		json_object_set_new(info, "srtp-required", json_string(session->media.require_srtp ? "yes" : "no"));
 		json_object_set_new(info, "sdes-local", json_string(session->media.has_srtp_local ? "yes" : "no"));
 		json_object_set_new(info, "sdes-remote", json_string(session->media.has_srtp_remote ? "yes" : "no"));
+		json_t *stats = json_object();
+		json_object_set_new(stats, "packets-in", json_integer(session->media.stats.packets_in));
+		json_object_set_new(stats, "bytes-in", json_integer(session->media.stats.bytes_in));
+		json_object_set_new(stats, "packets-out", json_integer(session->media.stats.packets_out));
+		json_object_set_new(stats, "bytes-out", json_integer(session->media.stats.bytes_out));
+		json_object_set_new(stats, "srtp-errors", json_integer(session->media.stats.srtp_errors));
+#ifdef HAVE_EPOLL
+		janus_nosip_reactor *reactor = session->reactor;
+		if(reactor != NULL)
+			json_object_set_new(stats, "reactor", json_integer(reactor->id));
+#endif
+		json_object_set_new(info, "media-stats", stats);
 	}
 	if(session->arc || session->vrc || session->arc_peer || session->vrc_peer) {
 		json_t *recording = json_object();
@@ -1126,6 +1222,9 @@ void janus_nosip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pa
 						guint16 seq = ntohs(header->seq_number);
 						JANUS_LOG(LOG_HUGE, "[NoSIP-%p] Error sending %s SRTP packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 							session, video ? "Video" : "Audio", g_strerror(errno), protected, timestamp, seq);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += protected;
 					}
 				}
 			} else {
@@ -1136,6 +1235,9 @@ void janus_nosip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pa
 					guint16 seq = ntohs(header->seq_number);
 					JANUS_LOG(LOG_HUGE, "[NoSIP-%p] Error sending %s RTP packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 						session, video ? "Video" : "Audio", g_strerror(errno), len, timestamp, seq);
+				} else {
+					session->media.stats.packets_out++;
+					session->media.stats.bytes_out += len;
 				}
 			}
 		}
@@ -1182,6 +1284,9 @@ void janus_nosip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *
 					if(send((video ? session->media.video_rtcp_fd : session->media.audio_rtcp_fd), sbuf, protected, 0) < 0) {
 						JANUS_LOG(LOG_HUGE, "[NoSIP-%p] Error sending SRTCP %s packet... %s (len=%d)...\n",
 							session, video ? "Video" : "Audio", g_strerror(errno), protected);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += protected;
 					}
 				}
 			} else {
@@ -1189,6 +1294,9 @@ void janus_nosip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *
 				if(send((video ? session->media.video_rtcp_fd : session->media.audio_rtcp_fd), buf, len, 0) < 0) {
 					JANUS_LOG(LOG_HUGE, "[NoSIP-%p] Error sending RTCP %s packet... %s (len=%d)...\n",
 						session, video ? "Video" : "Audio", g_strerror(errno), len);
+				} else {
+					session->media.stats.packets_out++;
+					session->media.stats.bytes_out += len;
 				}
 			}
 		}
@@ -1256,7 +1364,7 @@ static void janus_nosip_hangup_media_internal(janus_plugin_session *handle) {
 		} while(res == -1 && errno == EINTR);
 	}
 	/* Do cleanup if media thread has not been created */
-	if(!session->media.ready && !session->relayer_thread) {
+	if(!session->media.ready && !janus_nosip_media_relaying(session)) {
 		janus_mutex_lock(&session->mutex);
 		janus_nosip_media_cleanup(session);
 		janus_mutex_unlock(&session->mutex);
@@ -1566,19 +1674,7 @@ static void *janus_nosip_handler(void *data) {
 			if(!sdp_update && !offer) {
 				/* Start the media */
 				session->media.ready = 1;	/* FIXME Maybe we need a better way to signal this */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "nosiprtp %p", session);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_nosip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
-					session->media.ready = 0;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
-				}
+				janus_nosip_relay_start(session);
 			}
 		} else if(!strcasecmp(request_text, "hangup")) {
 			/* Get rid of an ongoing session */
@@ -2317,6 +2413,246 @@ static void janus_nosip_media_cleanup(janus_nosip_session *session) {
 	janus_nosip_media_reset(session);
 }
 
+/* Helper to read as many packets as are available (up to the batch size): returns how many we got, or -1 in case of errors */
+static int janus_nosip_recv_batch_read(janus_nosip_recv_batch *batch, int fd) {
+	int num = 0;
+#ifdef HAVE_RECVMMSG
+	int i = 0;
+	for(i=0; i<JANUS_NOSIP_RECV_BATCH; i++) {
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = sizeof(batch->data[i]);
+		memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+		batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* We were told there's something, so this won't block for the first
+	 * packet: the others are only read if they're already there */
+	num = recvmmsg(fd, batch->messages, JANUS_NOSIP_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(num < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	for(i=0; i<num; i++)
+		batch->length[i] = batch->messages[i].msg_len;
+#else
+	batch->length[0] = recvfrom(fd, batch->data[0], sizeof(batch->data[0]), MSG_DONTWAIT, NULL, NULL);
+	if(batch->length[0] < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	num = 1;
+#endif
+	return num;
+}
+
+/* Helper to start relaying the media of a session, on a reactor thread if
+ * we have them, or on a thread of its own otherwise */
+static void janus_nosip_relay_start(janus_nosip_session *session) {
+	memset(&session->media.stats, 0, sizeof(session->media.stats));
+	janus_refcount_increase(&session->ref);
+#ifdef HAVE_EPOLL
+	if(reactor_threads > 0 && janus_nosip_reactor_add(session) == 0)
+		return;
+#endif
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "nosiprtp %p", session);
+	session->relayer_thread = g_thread_try_new(tname, janus_nosip_relay_thread, session, &error);
+	if(error != NULL) {
+		session->relayer_thread = NULL;
+		session->media.ready = 0;
+		janus_refcount_decrease(&session->ref);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+	}
+}
+
+/* Helper to (re)connect the sockets, when starting or after a session update */
+static void janus_nosip_relay_update(janus_nosip_session *session) {
+	session->media.updated = FALSE;
+
+	/* Resolve the addresses, if needed */
+	gboolean have_audio_server_ip = FALSE;
+	gboolean have_video_server_ip = FALSE;
+	struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
+	if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve audio address '%s'\n",
+				session, session->media.remote_audio_ip);
+		} else {
+			/* Address resolved */
+			have_audio_server_ip = TRUE;
+		}
+	}
+	if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve video address '%s'\n",
+				session, session->media.remote_video_ip);
+		} else {
+			/* Address resolved */
+			have_video_server_ip = TRUE;
+		}
+	}
+
+	if(have_audio_server_ip || have_video_server_ip) {
+		janus_nosip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
+			have_video_server_ip ? &video_server_addr : NULL);
+	} else if (session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
+		JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n", session);
+	} else {
+		if(session->media.remote_audio_ip)
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
+				session, session->media.remote_audio_ip);
+		if(session->media.remote_video_ip)
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
+				session, session->media.remote_video_ip);
+	}
+}
+
+/* Helper to handle an error on one of the sockets of a session: returns FALSE
+ * if there were too many, and we closed the PeerConnection (so the media must
+ * not be relayed anymore) */
+static gboolean janus_nosip_relay_error(janus_nosip_session *session, int fd, int *pollerrs, const char *what) {
+	/* Check the socket error */
+	int error = 0;
+	socklen_t errlen = sizeof(error);
+	getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+	if(error == 0) {
+		/* Maybe not a breaking error after all? */
+		return TRUE;
+	} else if(error == 111) {
+		/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
+		if(fd == session->media.audio_rtcp_fd) {
+			JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the audio RTCP socket, closing it\n",
+				session, g_strerror(error));
+			janus_mutex_lock(&session->mutex);
+			close(session->media.audio_rtcp_fd);
+			session->media.audio_rtcp_fd = -1;
+			janus_mutex_unlock(&session->mutex);
+		} else if(fd == session->media.video_rtcp_fd) {
+			JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the video RTCP socket, closing it\n",
+				session, g_strerror(error));
+			janus_mutex_lock(&session->mutex);
+			close(session->media.video_rtcp_fd);
+			session->media.video_rtcp_fd = -1;
+			janus_mutex_unlock(&session->mutex);
+		}
+	}
+	/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+	(*pollerrs)++;
+	if(*pollerrs < 100)
+		return TRUE;
+	JANUS_LOG(LOG_ERR, "[NoSIP-%p] Too many errors polling %d: %s...\n", session, fd, what);
+	JANUS_LOG(LOG_ERR, "[NoSIP-%p]   -- %d (%s)\n", session, error, g_strerror(error));
+	/* FIXME Close the PeerConnection */
+	gateway->close_pc(session->handle);
+	return FALSE;
+}
+
+/* Helper to handle a packet coming from the peer on one of the sockets
+ * of a session: returns TRUE if it was a valid RTP packet */
+static gboolean janus_nosip_relay_incoming(janus_nosip_session *session, int fd, char *buffer, int bytes) {
+	if(bytes < 0) {
+		/* Failed to read? */
+		return FALSE;
+	}
+	/* Let's check what this is */
+	gboolean video = fd == session->media.video_rtp_fd || fd == session->media.video_rtcp_fd;
+	gboolean rtcp = fd == session->media.audio_rtcp_fd || fd == session->media.video_rtcp_fd;
+	if(!rtcp) {
+		/* Audio or Video RTP */
+		if(!janus_is_rtp(buffer, bytes)) {
+			/* Not an RTP packet? */
+			return FALSE;
+		}
+		session->media.stats.packets_in++;
+		session->media.stats.bytes_in += bytes;
+		rtp_header *header = (rtp_header *)buffer;
+		if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
+				(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
+			if(video && session->media.video_ssrc_peer == 0) {
+				session->media.video_ssrc_peer = ntohl(header->ssrc);
+			} else if(!video && session->media.audio_ssrc_peer == 0) {
+				session->media.audio_ssrc_peer = ntohl(header->ssrc);
+			}
+			JANUS_LOG(LOG_VERB, "[NoSIP-%p] Got SIP peer %s SSRC: %"SCNu32"\n",
+				session, video ? "video" : "audio",
+				video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
+		}
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(
+				(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+				buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				session->media.stats.srtp_errors++;
+				return TRUE;
+			}
+			bytes = buflen;
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, video ? &session->media.vcontext : &session->media.acontext, video, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
+		janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
+		/* Relay to browser */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = video, .buffer = buffer, .length = bytes };
+		/* Add audio-level extension, if present */
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		if(!video && session->media.audio_level_extension_id != -1) {
+			gboolean vad = FALSE;
+			int level = -1;
+			if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
+					session->media.audio_level_extension_id, &vad, &level) == 0) {
+				rtp.extensions.audio_level = level;
+				rtp.extensions.audio_level_vad = vad;
+			}
+		} else if(video && session->media.video_orientation_extension_id > 0) {
+			gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+			if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
+					session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
+				rtp.extensions.video_rotation = 0;
+				if(r1 && r0)
+					rtp.extensions.video_rotation = 270;
+				else if(r1)
+					rtp.extensions.video_rotation = 180;
+				else if(r0)
+					rtp.extensions.video_rotation = 90;
+				rtp.extensions.video_back_camera = c;
+				rtp.extensions.video_flipped = f;
+			}
+		}
+		gateway->relay_rtp(session->handle, &rtp);
+		return TRUE;
+	}
+	/* Audio or Video RTCP */
+	if(!janus_is_rtcp(buffer, bytes)) {
+		/* Not an RTCP packet? */
+		return FALSE;
+	}
+	session->media.stats.packets_in++;
+	session->media.stats.bytes_in += bytes;
+	if(session->media.has_srtp_remote) {
+		int buflen = bytes;
+		srtp_err_status_t res = srtp_unprotect_rtcp(
+			(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
+			buffer, &buflen);
+		if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+			JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
+				session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
+			session->media.stats.srtp_errors++;
+			return FALSE;
+		}
+		bytes = buflen;
+	}
+	/* Relay to browser */
+	janus_plugin_rtcp rtcp = { .mindex = -1, .video = video, .buffer = buffer, bytes };
+	gateway->relay_rtcp(session->handle, &rtcp);
+	return FALSE;
+}
+
 /* Thread to relay RTP/RTCP frames coming from the peer */
 static void *janus_nosip_relay_thread(void *data) {
 	janus_nosip_session *session = (janus_nosip_session *)data;
@@ -2327,13 +2663,9 @@ static void *janus_nosip_relay_thread(void *data) {
 	JANUS_LOG(LOG_INFO, "[NoSIP-%p] Starting relay thread\n", session);
 
 	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_in remote = { 0 };
-	int resfd = 0, bytes = 0, pollerrs = 0;
+	int resfd = 0, pollerrs = 0;
 	struct pollfd fds[5];
 	int pipe_fd = session->media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
 	if(pipe_fd == -1) {
 		/* If the pipe file descriptor doesn't exist, it means we're done already,
 		 * and/or we may never be notified about sessions being closed, so give up */
@@ -2342,57 +2674,19 @@ static void *janus_nosip_relay_thread(void *data) {
 		g_thread_unref(g_thread_self());
 		return NULL;
 	}
+	janus_nosip_recv_batch *batch = g_malloc0(sizeof(janus_nosip_recv_batch));
 	/* Loop */
 	int num = 0;
 	gboolean goon = TRUE;
 
 	session->media.updated = TRUE; /* Connect UDP sockets upon loop entry */
-	gboolean have_audio_server_ip = TRUE;
-	gboolean have_video_server_ip = TRUE;
 
 	while(goon && session != NULL &&
 			!g_atomic_int_get(&session->destroyed) && !g_atomic_int_get(&session->hangingup)) {
 
 		if(session->media.updated) {
 			/* Apparently there was a session update, or the loop has just been entered */
-			session->media.updated = FALSE;
-
-			/* Resolve the addresses, if needed */
-			have_audio_server_ip = FALSE;
-			have_video_server_ip = FALSE;
-			struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
-			if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve audio address '%s'\n",
-						session, session->media.remote_audio_ip);
-				} else {
-					/* Address resolved */
-					have_audio_server_ip = TRUE;
-				}
-			}
-			if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't resolve video address '%s'\n",
-						session, session->media.remote_video_ip);
-				} else {
-					/* Address resolved */
-					have_video_server_ip = TRUE;
-				}
-			}
-
-			if(have_audio_server_ip || have_video_server_ip) {
-				janus_nosip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
-					have_video_server_ip ? &video_server_addr : NULL);
-			} else if (session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n", session);
-			} else {
-				if(session->media.remote_audio_ip)
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
-						session, session->media.remote_audio_ip);
-				if(session->media.remote_video_ip)
-					JANUS_LOG(LOG_ERR, "[NoSIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
-						session, session->media.remote_video_ip);
-			}
+			janus_nosip_relay_update(session);
 		}
 
 		/* Prepare poll */
@@ -2447,48 +2741,16 @@ static void *janus_nosip_relay_thread(void *data) {
 		}
 		if(session == NULL || g_atomic_int_get(&session->destroyed))
 			break;
-		int i = 0;
+		int i = 0, j = 0;
 		for(i=0; i<num; i++) {
 			if(fds[i].revents & (POLLERR | POLLHUP)) {
 				/* If we just updated the session, let's wait until things have calmed down */
 				if(session->media.updated)
 					break;
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				} else if(error == 111) {
-					/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
-					if(fds[i].fd == session->media.audio_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the audio RTCP socket, closing it\n",
-							session, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.audio_rtcp_fd);
-						session->media.audio_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-					} else if(fds[i].fd == session->media.video_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[NoSIP-%p] Got a '%s' on the video RTCP socket, closing it\n",
-							session, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.video_rtcp_fd);
-						session->media.video_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-					}
-				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
+				if(janus_nosip_relay_error(session, fds[i].fd, &pollerrs, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP"))
 					continue;
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p] Too many errors polling %d (socket #%d): %s...\n", session,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[NoSIP-%p]   -- %d (%s)\n", session, error, g_strerror(error));
 				/* Can we assume it's pretty much over, after a POLLERR? */
 				goon = FALSE;
-				/* FIXME Close the PeerConnection */
-				gateway->close_pc(session->handle);
 				break;
 			} else if(fds[i].revents & POLLIN) {
 				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
@@ -2497,110 +2759,16 @@ static void *janus_nosip_relay_thread(void *data) {
 					(void)read(pipe_fd, &code, sizeof(int));
 					break;
 				}
-				/* Got an RTP/RTCP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Let's check what this is */
-				gboolean video = fds[i].fd == session->media.video_rtp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				gboolean rtcp = fds[i].fd == session->media.audio_rtcp_fd || fds[i].fd == session->media.video_rtcp_fd;
-				if(!rtcp) {
-					/* Audio or Video RTP */
-					if(!janus_is_rtp(buffer, bytes)) {
-						/* Not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					rtp_header *header = (rtp_header *)buffer;
-					if((video && session->media.video_ssrc_peer != ntohl(header->ssrc)) ||
-							(!video && session->media.audio_ssrc_peer != ntohl(header->ssrc))) {
-						if(video && session->media.video_ssrc_peer == 0) {
-							session->media.video_ssrc_peer = ntohl(header->ssrc);
-						} else if(!video && session->media.audio_ssrc_peer == 0) {
-							session->media.audio_ssrc_peer = ntohl(header->ssrc);
-						}
-						JANUS_LOG(LOG_VERB, "[NoSIP-%p] Got SIP peer %s SSRC: %"SCNu32"\n",
-							session, video ? "video" : "audio",
-							video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, video ? &session->media.vcontext : &session->media.acontext, video, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(video ? session->media.video_ssrc_peer : session->media.audio_ssrc_peer);
-					janus_recorder_save_frame(video ? session->vrc_peer : session->arc_peer, buffer, bytes);
-					/* Relay to browser */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = video, .buffer = buffer, .length = bytes };
-					/* Add audio-level extension, if present */
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					if(!video && session->media.audio_level_extension_id != -1) {
-						gboolean vad = FALSE;
-						int level = -1;
-						if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-								session->media.audio_level_extension_id, &vad, &level) == 0) {
-							rtp.extensions.audio_level = level;
-							rtp.extensions.audio_level_vad = vad;
-						}
-					} else if(video && session->media.video_orientation_extension_id > 0) {
-						gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-						if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-								session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
-							rtp.extensions.video_rotation = 0;
-							if(r1 && r0)
-								rtp.extensions.video_rotation = 270;
-							else if(r1)
-								rtp.extensions.video_rotation = 180;
-							else if(r0)
-								rtp.extensions.video_rotation = 90;
-							rtp.extensions.video_back_camera = c;
-							rtp.extensions.video_flipped = f;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else {
-					/* Audio or Video RTCP */
-					if(!janus_is_rtcp(buffer, bytes)) {
-						/* Not an RTCP packet? */
-						continue;
-					}
-					if(session->media.has_srtp_remote) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(
-							(video ? session->media.video_srtp_in : session->media.audio_srtp_in),
-							buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[NoSIP-%p] %s SRTCP unprotect error: %s (len=%d-->%d)\n",
-								session, video ? "Video" : "Audio", janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to browser */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = video, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
+				/* Got one or more RTP/RTCP packets */
+				int got = janus_nosip_recv_batch_read(batch, fds[i].fd);
+				for(j=0; j<got; j++) {
+					if(janus_nosip_relay_incoming(session, fds[i].fd, batch->data[j], batch->length[j]))
+						pollerrs = 0;
 				}
 			}
 		}
 	}
+	g_free(batch);
 	/* Cleanup the media session */
 	janus_mutex_lock(&session->mutex);
 	janus_nosip_media_cleanup(session);
@@ -2613,3 +2781,280 @@ static void *janus_nosip_relay_thread(void *data) {
 	return NULL;
 }
 
+#ifdef HAVE_EPOLL
+/* Reactor threads for the media of sessions */
+static janus_nosip_reactor **reactors = NULL;
+/* Socket a reactor is monitoring */
+typedef struct janus_nosip_reactor_fd {
+	struct janus_nosip_reactor_session *rs;
+	int fd;
+} janus_nosip_reactor_fd;
+/* Session a reactor is serving: a session update may add new sockets, and an
+ * RTCP socket may be closed, so we keep track of the ones we're monitoring */
+#define JANUS_NOSIP_REACTOR_PIPE	4
+typedef struct janus_nosip_reactor_session {
+	janus_nosip_session *session;
+	janus_nosip_reactor_fd fds[5];	/* Audio RTP/RTCP, video RTP/RTCP, and the pipe */
+	int pollerrs;
+	gboolean removed;
+} janus_nosip_reactor_session;
+
+/* Helper to monitor the sockets the session is currently using: must be called with the reactor mutex locked */
+static void janus_nosip_reactor_sync(janus_nosip_reactor *reactor, janus_nosip_reactor_session *rs) {
+	janus_nosip_session *session = rs->session;
+	janus_mutex_lock(&session->mutex);
+	int fds[5] = {
+		session->media.audio_rtp_fd, session->media.audio_rtcp_fd,
+		session->media.video_rtp_fd, session->media.video_rtcp_fd,
+		session->media.pipefd[0]
+	};
+	janus_mutex_unlock(&session->mutex);
+	int i = 0;
+	for(i=0; i<5; i++) {
+		if(fds[i] <= 0)
+			fds[i] = -1;
+		if(rs->fds[i].fd == fds[i])
+			continue;
+		/* If a socket we were monitoring changed, it was closed, which
+		 * means epoll stopped monitoring it already: since its number may
+		 * have been reused in the meanwhile, we don't try to remove it */
+		rs->fds[i].fd = fds[i];
+		if(fds[i] == -1)
+			continue;
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN;
+		event.data.ptr = &rs->fds[i];
+		if(epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fds[i], &event) < 0) {
+			JANUS_LOG(LOG_WARN, "[NoSIP-%p] Error adding socket %d to reactor thread #%u... %d (%s)\n",
+				session, fds[i], reactor->id, errno, g_strerror(errno));
+			rs->fds[i].fd = -1;
+		}
+	}
+}
+
+/* Helper to stop serving a session: must only be called by the reactor thread */
+static void janus_nosip_reactor_remove(janus_nosip_reactor *reactor, janus_nosip_reactor_session *rs) {
+	if(rs->removed)
+		return;
+	rs->removed = TRUE;
+	janus_nosip_session *session = rs->session;
+	int i = 0;
+	for(i=0; i<5; i++) {
+		if(rs->fds[i].fd != -1)
+			epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rs->fds[i].fd, NULL);
+	}
+	/* Cleanup the media session */
+	janus_mutex_lock(&session->mutex);
+	janus_nosip_media_cleanup(session);
+	janus_mutex_unlock(&session->mutex);
+	janus_mutex_lock(&reactor->mutex);
+	reactor->sessions = g_list_remove(reactor->sessions, rs);
+	reactor->count--;
+	session->reactor = NULL;
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_INFO, "[NoSIP-%p] Session removed from reactor thread #%u\n", session, reactor->id);
+	janus_refcount_decrease(&session->ref);
+}
+
+/* Helper to check if a session is gone */
+static gboolean janus_nosip_reactor_session_gone(janus_nosip_reactor_session *rs) {
+	janus_nosip_session *session = rs->session;
+	return (g_atomic_int_get(&session->destroyed) || g_atomic_int_get(&session->hangingup) ||
+		session->media.pipefd[0] == -1);
+}
+
+/* Reactor thread */
+#define JANUS_NOSIP_REACTOR_EVENTS	64
+static void *janus_nosip_reactor_thread(void *data) {
+	janus_nosip_reactor *reactor = (janus_nosip_reactor *)data;
+	JANUS_LOG(LOG_VERB, "Starting NoSIP reactor thread #%u\n", reactor->id);
+	struct epoll_event events[JANUS_NOSIP_REACTOR_EVENTS];
+	janus_nosip_recv_batch *batch = g_malloc0(sizeof(janus_nosip_recv_batch));
+	GList *removed = NULL, *sessions_list = NULL, *sl = NULL;
+	gint64 now = 0, check = janus_get_monotonic_time();
+	int num = 0, i = 0, j = 0;
+	while(!g_atomic_int_get(&reactor->stop)) {
+		num = epoll_wait(reactor->epfd, events, JANUS_NOSIP_REACTOR_EVENTS, 500);
+		if(num < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "[reactor #%u] Error polling... %d (%s)\n", reactor->id, errno, g_strerror(errno));
+			break;
+		}
+		for(i=0; i<num; i++) {
+			janus_nosip_reactor_fd *rfd = (janus_nosip_reactor_fd *)events[i].data.ptr;
+			janus_nosip_reactor_session *rs = rfd->rs;
+			if(rs->removed || rfd->fd == -1)
+				continue;
+			janus_nosip_session *session = rs->session;
+			if(janus_nosip_reactor_session_gone(rs)) {
+				janus_nosip_reactor_remove(reactor, rs);
+				removed = g_list_prepend(removed, rs);
+				continue;
+			}
+			if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+				/* If we just updated the session, let's wait until things have calmed down */
+				if(session->media.updated)
+					continue;
+				if(!janus_nosip_relay_error(session, rfd->fd, &rs->pollerrs, events[i].events & EPOLLERR ? "EPOLLERR" : "EPOLLHUP")) {
+					janus_nosip_reactor_remove(reactor, rs);
+					removed = g_list_prepend(removed, rs);
+					continue;
+				}
+				/* We may have closed an RTCP socket */
+				janus_mutex_lock(&reactor->mutex);
+				janus_nosip_reactor_sync(reactor, rs);
+				janus_mutex_unlock(&reactor->mutex);
+			} else if(events[i].events & EPOLLIN) {
+				if(rfd == &rs->fds[JANUS_NOSIP_REACTOR_PIPE]) {
+					/* We've been woken up for a reason, most likely a session update */
+					int code = 0;
+					(void)read(rfd->fd, &code, sizeof(int));
+					if(session->media.updated)
+						janus_nosip_relay_update(session);
+					janus_mutex_lock(&reactor->mutex);
+					janus_nosip_reactor_sync(reactor, rs);
+					janus_mutex_unlock(&reactor->mutex);
+					continue;
+				}
+				/* Got one or more RTP/RTCP packets */
+				int got = janus_nosip_recv_batch_read(batch, rfd->fd);
+				for(j=0; j<got; j++) {
+					if(janus_nosip_relay_incoming(session, rfd->fd, batch->data[j], batch->length[j]))
+						rs->pollerrs = 0;
+				}
+			}
+		}
+		/* Periodically check if any session went away, or was updated, without us being woken up */
+		now = janus_get_monotonic_time();
+		if(now - check >= 500000) {
+			check = now;
+			janus_mutex_lock(&reactor->mutex);
+			sessions_list = g_list_copy(reactor->sessions);
+			janus_mutex_unlock(&reactor->mutex);
+			for(sl = sessions_list; sl != NULL; sl = sl->next) {
+				janus_nosip_reactor_session *rs = (janus_nosip_reactor_session *)sl->data;
+				if(janus_nosip_reactor_session_gone(rs)) {
+					janus_nosip_reactor_remove(reactor, rs);
+					removed = g_list_prepend(removed, rs);
+					continue;
+				}
+				if(rs->session->media.updated)
+					janus_nosip_relay_update(rs->session);
+				janus_mutex_lock(&reactor->mutex);
+				janus_nosip_reactor_sync(reactor, rs);
+				janus_mutex_unlock(&reactor->mutex);
+			}
+			g_list_free(sessions_list);
+			sessions_list = NULL;
+		}
+		/* We can only free the sessions we removed once we're done with the events */
+		if(removed != NULL) {
+			g_list_free_full(removed, (GDestroyNotify)g_free);
+			removed = NULL;
+		}
+	}
+	/* Let go of the sessions we're still serving, if any */
+	janus_mutex_lock(&reactor->mutex);
+	while(reactor->sessions != NULL) {
+		janus_nosip_reactor_session *rs = (janus_nosip_reactor_session *)reactor->sessions->data;
+		janus_mutex_unlock(&reactor->mutex);
+		janus_nosip_reactor_remove(reactor, rs);
+		g_free(rs);
+		janus_mutex_lock(&reactor->mutex);
+	}
+	janus_mutex_unlock(&reactor->mutex);
+	g_free(batch);
+	JANUS_LOG(LOG_VERB, "Leaving NoSIP reactor thread #%u\n", reactor->id);
+	return NULL;
+}
+
+static void janus_nosip_reactors_start(int num) {
+	reactors = g_malloc0((num+1) * sizeof(janus_nosip_reactor *));
+	char tname[16];
+	int i = 0, started = 0;
+	for(i=0; i<num; i++) {
+		janus_nosip_reactor *reactor = g_malloc0(sizeof(janus_nosip_reactor));
+		reactor->id = i+1;
+		reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(reactor->epfd < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating epoll instance for reactor thread #%u... %d (%s)\n",
+				reactor->id, errno, g_strerror(errno));
+			g_free(reactor);
+			continue;
+		}
+		janus_mutex_init(&reactor->mutex);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "nosiprtp %u", reactor->id);
+		reactor->thread = g_thread_try_new(tname, &janus_nosip_reactor_thread, reactor, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the reactor thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			close(reactor->epfd);
+			janus_mutex_destroy(&reactor->mutex);
+			g_free(reactor);
+			continue;
+		}
+		reactors[started++] = reactor;
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any reactor thread, using a thread per session\n");
+		g_free(reactors);
+		reactors = NULL;
+		reactor_threads = 0;
+		return;
+	}
+	reactor_threads = started;
+	JANUS_LOG(LOG_INFO, "Using %d reactor threads for the media of sessions\n", reactor_threads);
+}
+
+static void janus_nosip_reactors_stop(void) {
+	if(reactors == NULL)
+		return;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		janus_nosip_reactor *reactor = reactors[i];
+		g_atomic_int_set(&reactor->stop, 1);
+		g_thread_join(reactor->thread);
+		close(reactor->epfd);
+		janus_mutex_destroy(&reactor->mutex);
+		g_free(reactor);
+	}
+	g_free(reactors);
+	reactors = NULL;
+	reactor_threads = 0;
+}
+
+/* Helper to have a reactor thread relay the media of a session, instead of a
+ * dedicated thread: the caller must have taken the reference the reactor
+ * will release when done, and keeps it if this fails */
+static int janus_nosip_reactor_add(janus_nosip_session *session) {
+	if(reactors == NULL || session->media.pipefd[0] == -1)
+		return -1;
+	/* Pick the reactor serving the fewest sessions */
+	janus_nosip_reactor *reactor = NULL;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		if(reactor == NULL || reactors[i]->count < reactor->count)
+			reactor = reactors[i];
+	}
+	janus_nosip_reactor_session *rs = g_malloc0(sizeof(janus_nosip_reactor_session));
+	rs->session = session;
+	for(i=0; i<5; i++) {
+		rs->fds[i].rs = rs;
+		rs->fds[i].fd = -1;
+	}
+	/* Connect the sockets right away, as the relay thread would do */
+	janus_nosip_relay_update(session);
+	janus_mutex_lock(&reactor->mutex);
+	session->reactor = reactor;
+	reactor->sessions = g_list_append(reactor->sessions, rs);
+	reactor->count++;
+	janus_nosip_reactor_sync(reactor, rs);
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_INFO, "[NoSIP-%p] Relaying media on reactor thread #%u\n", session, reactor->id);
+	return 0;
+}
+#endif
+
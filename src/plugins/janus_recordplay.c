@@ -26,6 +26,11 @@
  * The configuration process is quite easy: just choose where the
  * recordings should be saved. The same folder will also be used to list
  * the available recordings that can be replayed.
+ * By default, each viewer replaying a recording is served by a thread
+ * of its own: if you expect many viewers, you can set \c playout_threads
+ * to have a fixed number of threads pace the playout for all of them
+ * instead. Viewers of the same recording share the same frames, as the
+ * recording is mapped in memory once, and each keeps its own cursor.
  *
  * \note The application creates a special file in INI format with
  * <tt>.nfo</tt> extension for each recording that is saved. This is necessary
@@ -399,7 +404,18 @@ typedef struct janus_recordplay_frame_packet {
 	struct janus_recordplay_frame_packet *next;
 	struct janus_recordplay_frame_packet *prev;
 } janus_recordplay_frame_packet;
-janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, const char *filename);
+
+/* Frames of a recording file: the file is mapped in memory, and both the
+ * mapping and the ordered list of frames are shared by all the viewers
+ * playing the same recording at the same time */
+typedef struct janus_recordplay_frames {
+	GMappedFile *map;			/* The .mjr file, mapped in memory */
+	const char *data;			/* Contents of the file */
+	size_t size;				/* Size of the file */
+	janus_recordplay_frame_packet *list;	/* Frames, in the order they must be played */
+	guint users;				/* How many viewers are using these frames (protected by the recording mutex) */
+	struct janus_recordplay_frames **owner;	/* Where the recording keeps track of these frames */
+} janus_recordplay_frames;
 
 typedef struct janus_recordplay_recording {
 	guint64 id;					/* Recording unique ID */
@@ -421,6 +437,9 @@ typedef struct janus_recordplay_recording {
 	char *offer;				/* The SDP offer that will be sent to watchers */
 	gboolean e2ee;				/* Whether media in the recording is encrypted, e.g., using Insertable Streams */
 	GList *viewers;				/* List of users watching this recording */
+	janus_recordplay_frames *aframes;	/* Audio frames, if being played */
+	janus_recordplay_frames *vframes;	/* Video frames, if being played */
+	janus_recordplay_frames *dframes;	/* Data frames, if being played */
 	volatile gint paused;		/* Whether this recording is paused */
 	volatile gint completed;	/* Whether this recording was completed or still going on */
 	volatile gint destroyed;	/* Whether this recording has been marked as destroyed */
@@ -443,9 +462,9 @@ typedef struct janus_recordplay_session {
 	janus_recorder *vrc;	/* Video recorder */
 	janus_recorder *drc;	/* Data recorder */
 	janus_mutex rec_mutex;	/* Mutex to protect the recorders from race conditions */
-	janus_recordplay_frame_packet *aframes;	/* Audio frames (for playout) */
-	janus_recordplay_frame_packet *vframes;	/* Video frames (for playout) */
-	janus_recordplay_frame_packet *dframes;	/* Data packets (for playout) */
+	janus_recordplay_frames *aframes;	/* Audio frames (for playout) */
+	janus_recordplay_frames *vframes;	/* Video frames (for playout) */
+	janus_recordplay_frames *dframes;	/* Data packets (for playout) */
 	gboolean opusred;		/* Whether this user supports RED for audio (for playout) */
 	gboolean textdata;		/* Whether data format is text */
 	guint video_remb_startup;
@@ -510,6 +529,41 @@ static char *recordings_path = NULL;
 void janus_recordplay_update_recordings_list(void);
 static void *janus_recordplay_playout_thread(void *data);
 
+/* Playout of a recording for a viewer: just a cursor for each of the
+ * files, which are shared with all the other viewers of the recording */
+typedef struct janus_recordplay_playback {
+	janus_recordplay_session *session;
+	janus_recordplay_recording *rec;
+	janus_recordplay_frame_packet *audio, *video, *data;	/* Next frames to send */
+	gint64 abefore, vbefore, dbefore;	/* When the last frames were due (monotonic time) */
+	int akhz, vkhz;
+	gint64 due;				/* When the next frame is due (shared playout threads only) */
+	char buffer[1500];
+} janus_recordplay_playback;
+
+/* Shared playout threads, if enabled: rather than having a thread for each
+ * viewer, a fixed number of threads paces the playout for all of them */
+#define JANUS_RECORDPLAY_MAX_PLAYOUT_THREADS	64
+#define JANUS_RECORDPLAY_WHEEL_SLOTS	256
+#define JANUS_RECORDPLAY_WHEEL_TICK		5000	/* Duration of a slot of the timer wheel, in us */
+static int playout_threads = 0;
+typedef struct janus_recordplay_playout_worker {
+	guint id;
+	GThread *thread;
+	volatile gint stop;
+	volatile gint count;	/* How many playbacks this thread is serving */
+	GList *wheel[JANUS_RECORDPLAY_WHEEL_SLOTS];	/* Timer wheel (only accessed by the thread) */
+	GList *incoming;		/* New playbacks, to add to the wheel */
+	janus_mutex mutex;
+} janus_recordplay_playout_worker;
+static janus_recordplay_playout_worker **playout_workers = NULL;
+static void janus_recordplay_playout_workers_start(int num);
+static void janus_recordplay_playout_workers_stop(void);
+static void janus_recordplay_playout_add(janus_recordplay_session *session);
+static janus_recordplay_frames *janus_recordplay_frames_get(janus_recordplay_recording *rec,
+	const char *filename, janus_recordplay_frames **owner);
+static void janus_recordplay_frames_release(janus_recordplay_recording *rec, janus_recordplay_frames *frames);
+
 /* Helper to send RTCP feedback back to recorders, if needed */
 void janus_recordplay_send_rtcp_feedback(janus_plugin_session *handle, int video, char *buf, int len);
 
@@ -816,6 +870,21 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 		if(!notify_events && callback->events_is_enabled()) {
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_RECORDPLAY_NAME);
 		}
+		/* Should the playout for viewers be paced by a fixed number of threads? */
+		janus_config_item *threads = janus_config_get(config, config_general, janus_config_type_item, "playout_threads");
+		if(threads && threads->value) {
+			if(!strcasecmp(threads->value, "auto"))
+				playout_threads = g_get_num_processors();
+			else
+				playout_threads = atoi(threads->value);
+			if(playout_threads < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid playout_threads value %s, using a thread per viewer\n", threads->value);
+				playout_threads = 0;
+			} else if(playout_threads > JANUS_RECORDPLAY_MAX_PLAYOUT_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many playout threads (%d), capping to %d\n", playout_threads, JANUS_RECORDPLAY_MAX_PLAYOUT_THREADS);
+				playout_threads = JANUS_RECORDPLAY_MAX_PLAYOUT_THREADS;
+			}
+		}
 		/* Done */
 		janus_config_destroy(config);
 		config = NULL;
@@ -842,6 +911,10 @@ int janus_recordplay_init(janus_callbacks *callback, const char *config_path) {
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
 
+	/* If the playout must be paced by shared threads, start them now */
+	if(playout_threads > 0)
+		janus_recordplay_playout_workers_start(playout_threads);
+
 	g_atomic_int_set(&initialized, 1);
 
 	/* Launch the thread that will handle incoming messages */
@@ -868,6 +941,7 @@ void janus_recordplay_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+	janus_recordplay_playout_workers_stop();
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -1228,7 +1302,11 @@ void janus_recordplay_setup_media(janus_plugin_session *handle) {
 	g_atomic_int_set(&session->hangingup, 0);
 	/* Take note of the fact that the session is now active */
 	session->active = TRUE;
-	if(!session->recorder) {
+	if(!session->recorder && playout_workers != NULL) {
+		/* One of the shared playout threads will take care of this viewer */
+		janus_refcount_increase(&session->ref);
+		janus_recordplay_playout_add(session);
+	} else if(!session->recorder) {
 		GError *error = NULL;
 		janus_refcount_increase(&session->ref);
 		g_thread_try_new("recordplay playout thread", &janus_recordplay_playout_thread, session, &error);
@@ -1965,21 +2043,21 @@ recdone:
 			}
 			/* Access the frames */
 			if(rec->arc_file) {
-				session->aframes = janus_recordplay_get_frames(recordings_path, rec->arc_file);
+				session->aframes = janus_recordplay_frames_get(rec, rec->arc_file, &rec->aframes);
 				if(session->aframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening audio recording, trying to go on anyway\n");
 					warning = "Broken audio file, playing video only";
 				}
 			}
 			if(rec->vrc_file) {
-				session->vframes = janus_recordplay_get_frames(recordings_path, rec->vrc_file);
+				session->vframes = janus_recordplay_frames_get(rec, rec->vrc_file, &rec->vframes);
 				if(session->vframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening video recording, trying to go on anyway\n");
 					warning = "Broken video file, playing audio only";
 				}
 			}
 			if(rec->drc_file) {
-				session->dframes = janus_recordplay_get_frames(recordings_path, rec->drc_file);
+				session->dframes = janus_recordplay_frames_get(rec, rec->drc_file, &rec->dframes);
 				if(session->dframes == NULL) {
 					JANUS_LOG(LOG_WARN, "Error opening data recording, trying to go on anyway\n");
 					warning = "Broken data file, playing audio/video only";
@@ -2317,29 +2395,160 @@ void janus_recordplay_update_recordings_list(void) {
 	janus_mutex_unlock(&recordings_mutex);
 }
 
-janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, const char *filename) {
-	if(!dir || !filename)
+/* Helper to insert a frame in a list ordered by timestamps and sequence numbers */
+static void janus_recordplay_frame_insert(janus_recordplay_frame_packet **list,
+		janus_recordplay_frame_packet **last, janus_recordplay_frame_packet *p) {
+	if((*list) == NULL) {
+		/* First element becomes the list itself (and the last item), at least for now */
+		(*list) = p;
+		(*last) = p;
+	} else {
+		/* Check where we should insert this, starting from the end */
+		int added = 0;
+		janus_recordplay_frame_packet *tmp = (*last);
+		while(tmp) {
+			if(tmp->ts < p->ts) {
+				/* The new timestamp is greater than the last one we have, append */
+				added = 1;
+				if(tmp->next != NULL) {
+					/* We're inserting */
+					tmp->next->prev = p;
+					p->next = tmp->next;
+				} else {
+					/* Update the last packet */
+					(*last) = p;
+				}
+				tmp->next = p;
+				p->prev = tmp;
+				break;
+			} else if(tmp->ts == p->ts) {
+				/* Same timestamp, check the sequence number */
+				if(tmp->seq < p->seq && (abs(tmp->seq - p->seq) < 10000)) {
+					/* The new sequence number is greater than the last one we have, append */
+					added = 1;
+					if(tmp->next != NULL) {
+						/* We're inserting */
+						tmp->next->prev = p;
+						p->next = tmp->next;
+					} else {
+						/* Update the last packet */
+						(*last) = p;
+					}
+					tmp->next = p;
+					p->prev = tmp;
+					break;
+				} else if(tmp->seq > p->seq && (abs(tmp->seq - p->seq) > 10000)) {
+					/* The new sequence number (resetted) is greater than the last one we have, append */
+					added = 1;
+					if(tmp->next != NULL) {
+						/* We're inserting */
+						tmp->next->prev = p;
+						p->next = tmp->next;
+					} else {
+						/* Update the last packet */
+						(*last) = p;
+					}
+					tmp->next = p;
+					p->prev = tmp;
+					break;
+				}
+			}
+			/* If either the timestamp ot the sequence number we just got is smaller, keep going back */
+			tmp = tmp->prev;
+		}
+		if(!added) {
+			/* We reached the start */
+			p->next = (*list);
+			(*list)->prev = p;
+			(*list) = p;
+		}
+	}
+}
+
+/* Helper to build the ordered list of frames from the index saved alongside a recording, if any */
+static janus_recordplay_frame_packet *janus_recordplay_get_frames_from_index(const char *source, long fsize) {
+	char index[1100];
+	g_snprintf(index, sizeof(index), "%s.%s", source, JANUS_RECORDER_INDEX_EXT);
+	if(!g_file_test(index, G_FILE_TEST_EXISTS))
 		return NULL;
-	/* Open the file */
-	char source[1024];
-	if(strstr(filename, ".mjr"))
-		g_snprintf(source, 1024, "%s/%s", dir, filename);
-	else
-		g_snprintf(source, 1024, "%s/%s.mjr", dir, filename);
-	FILE *file = fopen(source, "rb");
-	if(file == NULL) {
-		JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
+	gchar *contents = NULL;
+	gsize size = 0;
+	size_t mlen = strlen(JANUS_RECORDER_INDEX_MAGIC);
+	if(!g_file_get_contents(index, &contents, &size, NULL) || size < mlen ||
+			memcmp(contents, JANUS_RECORDER_INDEX_MAGIC, mlen) ||
+			((size - mlen) % JANUS_RECORDER_INDEX_ENTRY_SIZE) != 0) {
+		JANUS_LOG(LOG_WARN, "Invalid index file %s, ignoring it\n", index);
+		g_free(contents);
 		return NULL;
 	}
-	fseek(file, 0L, SEEK_END);
-	long fsize = ftell(file);
-	fseek(file, 0L, SEEK_SET);
-	JANUS_LOG(LOG_VERB, "File is %zu bytes\n", fsize);
+	size_t num = (size - mlen) / JANUS_RECORDER_INDEX_ENTRY_SIZE, i = 0;
+	janus_recorder_index_entry entry;
+	if(num > 0) {
+		/* Make sure the index is consistent with the recording */
+		janus_recorder_index_entry_parse(contents + mlen + (num-1)*JANUS_RECORDER_INDEX_ENTRY_SIZE, &entry);
+		if((long)(entry.offset + entry.length) > fsize) {
+			JANUS_LOG(LOG_WARN, "Index file %s doesn't match the recording, ignoring it\n", index);
+			g_free(contents);
+			return NULL;
+		}
+	}
+	JANUS_LOG(LOG_VERB, "Using index file %s (%zu frames)\n", index, num);
+	/* Let's look for timestamp resets first */
+	uint32_t first_ts = 0, last_ts = 0, reset = 0;
+	for(i=0; i<num; i++) {
+		janus_recorder_index_entry_parse(contents + mlen + i*JANUS_RECORDER_INDEX_ENTRY_SIZE, &entry);
+		if(entry.length < 12)
+			continue;
+		if(last_ts == 0) {
+			first_ts = entry.timestamp;
+			if(first_ts > 1000*1000)	/* Just used to check whether a packet is pre- or post-reset */
+				first_ts -= 1000*1000;
+		} else {
+			if(entry.timestamp < last_ts) {
+				if(last_ts-entry.timestamp > 2*1000*1000*1000)
+					reset = entry.timestamp;
+			} else if(entry.timestamp < reset) {
+				reset = entry.timestamp;
+			}
+		}
+		last_ts = entry.timestamp;
+	}
+	/* Now let's order the frames */
+	janus_recordplay_frame_packet *list = NULL, *last = NULL;
+	for(i=0; i<num; i++) {
+		janus_recorder_index_entry_parse(contents + mlen + i*JANUS_RECORDER_INDEX_ENTRY_SIZE, &entry);
+		if(entry.length < 12)
+			continue;
+		janus_recordplay_frame_packet *p = g_malloc(sizeof(janus_recordplay_frame_packet));
+		p->seq = entry.seq;
+		if(reset == 0 || entry.timestamp > first_ts) {
+			p->ts = entry.timestamp;
+		} else {
+			/* Post-reset... */
+			uint64_t max32 = UINT32_MAX;
+			max32++;
+			p->ts = max32+entry.timestamp;
+		}
+		p->len = entry.length;
+		p->offset = entry.offset;
+		p->next = NULL;
+		p->prev = NULL;
+		janus_recordplay_frame_insert(&list, &last, p);
+	}
+	g_free(contents);
+	return list;
+}
+
+/* Helper to parse a recording mapped in memory, and build the ordered list of its frames */
+static janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *source, const char *contents, long fsize) {
+	/* If the recording has an index, we don't need to parse the whole file */
+	janus_recordplay_frame_packet *indexed = janus_recordplay_get_frames_from_index(source, fsize);
+	if(indexed != NULL)
+		return indexed;
 
 	/* Pre-parse */
 	JANUS_LOG(LOG_VERB, "Pre-parsing file %s to generate ordered index...\n", source);
 	gboolean parsed_header = FALSE;
-	int bytes = 0;
 	long offset = 0;
 	uint16_t len = 0, count = 0;
 	uint32_t first_ts = 0, last_ts = 0, reset = 0;	/* To handle whether there's a timestamp reset in the recording */
@@ -2350,36 +2559,35 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 	/* Let's look for timestamp resets first */
 	while(offset < fsize) {
 		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
+		if(fsize - offset < 10 || contents[offset] != 'M') {
 			JANUS_LOG(LOG_ERR, "Invalid header...\n");
-			fclose(file);
 			return NULL;
 		}
-		if(prebuffer[1] == 'E') {
+		const char *header = contents + offset;
+		memcpy(&len, header + 8, sizeof(uint16_t));
+		len = ntohs(len);
+		offset += 10;
+		if(len > fsize - offset) {
+			JANUS_LOG(LOG_WARN, "Truncated frame, stopping here...\n");
+			break;
+		}
+		if(header[1] == 'E') {
 			/* Either the old .mjr format header ('MEETECHO' header followed by 'audio' or 'video'), or a frame */
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
 			if(len == 5 && !parsed_header) {
 				/* This is the main header */
 				parsed_header = TRUE;
 				JANUS_LOG(LOG_VERB, "Old .mjr header format\n");
-				bytes = fread(prebuffer, sizeof(char), 5, file);
-				if(prebuffer[0] == 'v') {
+				if(contents[offset] == 'v') {
 					JANUS_LOG(LOG_INFO, "This is an old video recording, assuming VP8\n");
 					video = 1;
-				} else if(prebuffer[0] == 'a') {
+				} else if(contents[offset] == 'a') {
 					JANUS_LOG(LOG_INFO, "This is an old audio recording, assuming Opus\n");
 					audio = 1;
-				} else if(prebuffer[0] == 'd') {
+				} else if(contents[offset] == 'd') {
 					JANUS_LOG(LOG_INFO, "This is an old data recording, assuming Text\n");
 					data = 1;
 				} else {
 					JANUS_LOG(LOG_WARN, "Unsupported recording media type...\n");
-					fclose(file);
 					return NULL;
 				}
 				offset += len;
@@ -2390,21 +2598,16 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				offset += len;
 				continue;
 			}
-		} else if(prebuffer[1] == 'J') {
+		} else if(header[1] == 'J') {
 			/* New .mjr format, the header may contain useful info */
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
 			if(len > 0 && !parsed_header) {
 				/* This is the info header */
 				JANUS_LOG(LOG_VERB, "New .mjr header format\n");
-				bytes = fread(prebuffer, sizeof(char), len, file);
-				if(bytes < 0) {
-					JANUS_LOG(LOG_ERR, "Error reading from file... %s\n", g_strerror(errno));
-					fclose(file);
+				if(len >= sizeof(prebuffer)) {
+					JANUS_LOG(LOG_ERR, "Info header too large...\n");
 					return NULL;
 				}
+				memcpy(prebuffer, contents + offset, len);
 				parsed_header = TRUE;
 				prebuffer[len] = '\0';
 				json_error_t error;
@@ -2412,7 +2615,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				if(!info) {
 					JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
 					JANUS_LOG(LOG_WARN, "Error parsing info header...\n");
-					fclose(file);
 					return NULL;
 				}
 				/* Is it audio or video? */
@@ -2420,7 +2622,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				if(!type || !json_is_string(type)) {
 					JANUS_LOG(LOG_WARN, "Missing/invalid recording type in info header...\n");
 					json_decref(info);
-					fclose(file);
 					return NULL;
 				}
 				const char *t = json_string_value(type);
@@ -2433,7 +2634,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				} else {
 					JANUS_LOG(LOG_WARN, "Unsupported recording type '%s' in info header...\n", t);
 					json_decref(info);
-					fclose(file);
 					return NULL;
 				}
 				/* What codec was used? */
@@ -2441,7 +2641,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				if(!codec || !json_is_string(codec)) {
 					JANUS_LOG(LOG_WARN, "Missing recording codec in info header...\n");
 					json_decref(info);
-					fclose(file);
 					return NULL;
 				}
 				const char *c = json_string_value(codec);
@@ -2450,7 +2649,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				if(!created || !json_is_integer(created)) {
 					JANUS_LOG(LOG_WARN, "Missing recording created time in info header...\n");
 					json_decref(info);
-					fclose(file);
 					return NULL;
 				}
 				c_time = json_integer_value(created);
@@ -2459,7 +2657,6 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 				if(!written || !json_is_integer(written)) {
 					JANUS_LOG(LOG_WARN, "Missing recording written time in info header...\n");
 					json_decref(info);
-					fclose(file);
 					return NULL;
 				}
 				w_time = json_integer_value(created);
@@ -2472,13 +2669,11 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 			}
 		} else {
 			JANUS_LOG(LOG_ERR, "Invalid header...\n");
-			fclose(file);
 			return NULL;
 		}
 		/* Only read RTP header */
-		if(audio || video) {
-			bytes = fread(prebuffer, sizeof(char), 16, file);
-			janus_rtp_header *rtp = (janus_rtp_header *)prebuffer;
+		if((audio || video) && header[1] == 'E') {
+			janus_rtp_header *rtp = (janus_rtp_header *)(contents + offset);
 			if(last_ts == 0) {
 				first_ts = ntohl(rtp->timestamp);
 				if(first_ts > 1000*1000)	/* Just used to check whether a packet is pre- or post-reset */
@@ -2503,18 +2698,18 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 	/* Now let's parse the frames and order them */
 	offset = 0;
 	janus_recordplay_frame_packet *list = NULL, *last = NULL;
-	while(offset < fsize) {
+	while(fsize - offset >= 10) {
 		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		prebuffer[8] = '\0';
-		JANUS_LOG(LOG_HUGE, "Header: %s\n", prebuffer);
+		const char *header = contents + offset;
+		JANUS_LOG(LOG_HUGE, "Header: %.*s\n", 8, header);
 		offset += 8;
-		bytes = fread(&len, sizeof(uint16_t), 1, file);
+		memcpy(&len, contents + offset, sizeof(uint16_t));
 		len = ntohs(len);
 		JANUS_LOG(LOG_HUGE, "  -- Length: %"SCNu16"\n", len);
 		offset += 2;
-		if(prebuffer[1] == 'J' || (!data && len < 12)) {
+		if(len > fsize - offset)
+			break;
+		if(header[1] == 'J' || (!data && len < 12)) {
 			/* Not RTP, skip */
 			JANUS_LOG(LOG_HUGE, "  -- Not RTP, skipping\n");
 			offset += len;
@@ -2524,11 +2719,11 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 		if(data) {
 			/* Things are simpler for data, no reordering is needed: start by the data time */
 			gint64 when = 0;
-			bytes = fread(&when, 1, sizeof(gint64), file);
-			if(bytes < (int)sizeof(gint64)) {
+			if(len < sizeof(gint64)) {
 				JANUS_LOG(LOG_WARN, "Missing data timestamp header");
 				break;
 			}
+			memcpy(&when, contents + offset, sizeof(gint64));
 			when = ntohll(when);
 			offset += sizeof(gint64);
 			len -= sizeof(gint64);
@@ -2552,12 +2747,7 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 			continue;
 		}
 		/* Only read RTP header */
-		bytes = fread(prebuffer, sizeof(char), 16, file);
-		if(bytes < 0) {
-			JANUS_LOG(LOG_WARN, "Error reading RTP header, stopping here...\n");
-			break;
-		}
-		janus_rtp_header *rtp = (janus_rtp_header *)prebuffer;
+		janus_rtp_header *rtp = (janus_rtp_header *)(contents + offset);
 		JANUS_LOG(LOG_HUGE, "  -- RTP packet (ssrc=%"SCNu32", pt=%"SCNu16", ext=%"SCNu16", seq=%"SCNu16", ts=%"SCNu32")\n",
 				ntohl(rtp->ssrc), rtp->type, rtp->extension, ntohs(rtp->seq_number), ntohl(rtp->timestamp));
 		/* Generate frame packet and insert in the ordered list */
@@ -2582,71 +2772,7 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 		p->offset = offset;
 		p->next = NULL;
 		p->prev = NULL;
-		if(list == NULL) {
-			/* First element becomes the list itself (and the last item), at least for now */
-			list = p;
-			last = p;
-		} else {
-			/* Check where we should insert this, starting from the end */
-			int added = 0;
-			janus_recordplay_frame_packet *tmp = last;
-			while(tmp) {
-				if(tmp->ts < p->ts) {
-					/* The new timestamp is greater than the last one we have, append */
-					added = 1;
-					if(tmp->next != NULL) {
-						/* We're inserting */
-						tmp->next->prev = p;
-						p->next = tmp->next;
-					} else {
-						/* Update the last packet */
-						last = p;
-					}
-					tmp->next = p;
-					p->prev = tmp;
-					break;
-				} else if(tmp->ts == p->ts) {
-					/* Same timestamp, check the sequence number */
-					if(tmp->seq < p->seq && (abs(tmp->seq - p->seq) < 10000)) {
-						/* The new sequence number is greater than the last one we have, append */
-						added = 1;
-						if(tmp->next != NULL) {
-							/* We're inserting */
-							tmp->next->prev = p;
-							p->next = tmp->next;
-						} else {
-							/* Update the last packet */
-							last = p;
-						}
-						tmp->next = p;
-						p->prev = tmp;
-						break;
-					} else if(tmp->seq > p->seq && (abs(tmp->seq - p->seq) > 10000)) {
-						/* The new sequence number (resetted) is greater than the last one we have, append */
-						added = 1;
-						if(tmp->next != NULL) {
-							/* We're inserting */
-							tmp->next->prev = p;
-							p->next = tmp->next;
-						} else {
-							/* Update the last packet */
-							last = p;
-						}
-						tmp->next = p;
-						p->prev = tmp;
-						break;
-					}
-				}
-				/* If either the timestamp ot the sequence number we just got is smaller, keep going back */
-				tmp = tmp->prev;
-			}
-			if(!added) {
-				/* We reached the start */
-				p->next = list;
-				list->prev = p;
-				list = p;
-			}
-		}
+		janus_recordplay_frame_insert(&list, &last, p);
 		/* Skip data for now */
 		offset += len;
 		count++;
@@ -2663,21 +2789,102 @@ janus_recordplay_frame_packet *janus_recordplay_get_frames(const char *dir, cons
 	JANUS_LOG(LOG_VERB, "Counted %"SCNu16" frame packets\n", count);
 
 	/* Done! */
-	fclose(file);
 	return list;
 }
 
-static void *janus_recordplay_playout_thread(void *sessiondata) {
-	janus_recordplay_session *session = (janus_recordplay_session *)sessiondata;
-	if(!session) {
-		JANUS_LOG(LOG_ERR, "Invalid session, can't start playout thread...\n");
-		g_thread_unref(g_thread_self());
+/* Helper to get the frames of a recording file: if other viewers are
+ * playing the same file, we share the mapping and the list they use,
+ * otherwise we map the file and parse it (or its index) now */
+static janus_recordplay_frames *janus_recordplay_frames_get(janus_recordplay_recording *rec,
+		const char *filename, janus_recordplay_frames **owner) {
+	if(rec == NULL || filename == NULL || owner == NULL)
+		return NULL;
+	janus_mutex_lock(&rec->mutex);
+	janus_recordplay_frames *frames = *owner;
+	if(frames != NULL) {
+		frames->users++;
+		janus_mutex_unlock(&rec->mutex);
+		return frames;
+	}
+	/* Map the file */
+	char source[1024];
+	if(strstr(filename, ".mjr"))
+		g_snprintf(source, 1024, "%s/%s", recordings_path, filename);
+	else
+		g_snprintf(source, 1024, "%s/%s.mjr", recordings_path, filename);
+	GError *error = NULL;
+	GMappedFile *map = g_mapped_file_new(source, FALSE, &error);
+	if(map == NULL) {
+		janus_mutex_unlock(&rec->mutex);
+		JANUS_LOG(LOG_ERR, "Could not open file %s: %s\n", source, error ? error->message : "??");
+		g_clear_error(&error);
+		return NULL;
+	}
+	const char *contents = g_mapped_file_get_contents(map);
+	size_t size = g_mapped_file_get_length(map);
+	JANUS_LOG(LOG_VERB, "File is %zu bytes\n", size);
+	janus_recordplay_frame_packet *list = contents ? janus_recordplay_get_frames(source, contents, size) : NULL;
+	if(list == NULL) {
+		janus_mutex_unlock(&rec->mutex);
+		g_mapped_file_unref(map);
 		return NULL;
 	}
+	frames = g_malloc0(sizeof(janus_recordplay_frames));
+	frames->map = map;
+	frames->data = contents;
+	frames->size = size;
+	frames->list = list;
+	frames->users = 1;
+	frames->owner = owner;
+	*owner = frames;
+	janus_mutex_unlock(&rec->mutex);
+	return frames;
+}
+
+/* Helper to stop using the frames of a recording file: they're freed when
+ * the last viewer playing them is done */
+static void janus_recordplay_frames_release(janus_recordplay_recording *rec, janus_recordplay_frames *frames) {
+	if(rec == NULL || frames == NULL)
+		return;
+	janus_mutex_lock(&rec->mutex);
+	frames->users--;
+	if(frames->users > 0) {
+		janus_mutex_unlock(&rec->mutex);
+		return;
+	}
+	if(*frames->owner == frames)
+		*frames->owner = NULL;
+	janus_mutex_unlock(&rec->mutex);
+	janus_recordplay_frame_packet *tmp = NULL, *p = frames->list;
+	while(p) {
+		tmp = p->next;
+		g_free(p);
+		p = tmp;
+	}
+	g_mapped_file_unref(frames->map);
+	g_free(frames);
+}
+
+/* Helper to copy a frame out of a mapped recording file */
+static int janus_recordplay_frame_read(janus_recordplay_frames *frames, janus_recordplay_frame_packet *p, char *buffer, int size) {
+	if(p->offset < 0 || p->len <= 0 || (size_t)p->offset >= frames->size)
+		return 0;
+	size_t len = p->len;
+	if(len > frames->size - p->offset)
+		len = frames->size - p->offset;
+	if(len > (size_t)size)
+		len = size;
+	memcpy(buffer, frames->data + p->offset, len);
+	return len;
+}
+
+/* Helper to prepare the playout of a recording for a viewer: the session
+ * must have been referenced for the playout already, and on failure that
+ * reference is released */
+static janus_recordplay_playback *janus_recordplay_playback_new(janus_recordplay_session *session) {
 	if(!session->recording) {
 		janus_refcount_decrease(&session->ref);
-		JANUS_LOG(LOG_ERR, "No recording object, can't start playout thread...\n");
-		g_thread_unref(g_thread_self());
+		JANUS_LOG(LOG_ERR, "No recording object, can't start playout...\n");
 		return NULL;
 	}
 	janus_refcount_increase(&session->recording->ref);
@@ -2685,387 +2892,179 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 	if(session->recorder) {
 		janus_refcount_decrease(&rec->ref);
 		janus_refcount_decrease(&session->ref);
-		JANUS_LOG(LOG_ERR, "This is a recorder, can't start playout thread...\n");
-		g_thread_unref(g_thread_self());
+		JANUS_LOG(LOG_ERR, "This is a recorder, can't start playout...\n");
 		return NULL;
 	}
 	if(!session->aframes && !session->vframes) {
 		janus_refcount_decrease(&rec->ref);
 		janus_refcount_decrease(&session->ref);
-		JANUS_LOG(LOG_ERR, "No audio and no video frames, can't start playout thread...\n");
-		g_thread_unref(g_thread_self());
+		JANUS_LOG(LOG_ERR, "No audio and no video frames, can't start playout...\n");
 		return NULL;
 	}
-	JANUS_LOG(LOG_VERB, "Joining playout thread\n");
-	/* Open the files */
-	FILE *afile = NULL, *vfile = NULL, *dfile = NULL;
-	if(session->aframes) {
-		if(rec->arc_file == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "The recording session contains some audio packets but seems to lack a recording file name\n");
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-		char source[1024];
-		if(strstr(rec->arc_file, ".mjr"))
-			g_snprintf(source, 1024, "%s/%s", recordings_path, rec->arc_file);
-		else
-			g_snprintf(source, 1024, "%s/%s.mjr", recordings_path, rec->arc_file);
-		afile = fopen(source, "rb");
-		if(afile == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "Could not open audio file %s, can't start playout thread...\n", source);
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-	}
-	if(session->vframes) {
-		if(rec->vrc_file == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "The recording session contains some video packets but seems to lack a recording file name\n");
-			if(afile)
-				fclose(afile);
-			afile = NULL;
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-		char source[1024];
-		if(strstr(rec->vrc_file, ".mjr"))
-			g_snprintf(source, 1024, "%s/%s", recordings_path, rec->vrc_file);
-		else
-			g_snprintf(source, 1024, "%s/%s.mjr", recordings_path, rec->vrc_file);
-		vfile = fopen(source, "rb");
-		if(vfile == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "Could not open video file %s, can't start playout thread...\n", source);
-			if(afile)
-				fclose(afile);
-			afile = NULL;
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-	}
+	/* The files were mapped in memory already, when preparing the playout:
+	 * all we need is a cursor for each of them */
+	janus_recordplay_playback *pb = g_malloc0(sizeof(janus_recordplay_playback));
+	pb->session = session;
+	pb->rec = rec;
+	pb->audio = session->aframes ? session->aframes->list : NULL;
+	pb->video = session->vframes ? session->vframes->list : NULL;
+	pb->data = session->dframes ? session->dframes->list : NULL;
+	pb->akhz = 48;
+	if(rec->audio_pt == 0 || rec->audio_pt == 8 || rec->audio_pt == 9)
+		pb->akhz = 8;
+	pb->vkhz = 90;
+	gint64 now = janus_get_monotonic_time();
+	pb->abefore = now;
+	pb->vbefore = now;
+	pb->dbefore = now;
+	return pb;
+}
 
-	if(session->dframes) {
-		if(rec->drc_file == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "The recording session contains some data packets but seems to lack a recording file name\n");
-			if(afile)
-				fclose(afile);
-			afile = NULL;
-			if(vfile)
-				fclose(vfile);
-			vfile = NULL;
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-		char source[1024];
-		if(strstr(rec->drc_file, ".mjr"))
-			g_snprintf(source, 1024, "%s/%s", recordings_path, rec->drc_file);
-		else
-			g_snprintf(source, 1024, "%s/%s.mjr", recordings_path, rec->drc_file);
-		dfile = fopen(source, "rb");
-		if(dfile == NULL) {
-			janus_refcount_decrease(&rec->ref);
-			janus_refcount_decrease(&session->ref);
-			JANUS_LOG(LOG_ERR, "Could not open data file %s, can't start playout thread...\n", source);
-			if(afile)
-				fclose(afile);
-			afile = NULL;
-			if(vfile)
-				fclose(vfile);
-			vfile = NULL;
-			g_thread_unref(g_thread_self());
-			return NULL;
+/* Helpers to send a frame to a viewer */
+static void janus_recordplay_playback_send_audio(janus_recordplay_playback *pb, janus_recordplay_frame_packet *frame) {
+	janus_recordplay_session *session = pb->session;
+	janus_recordplay_recording *rec = pb->rec;
+	char *buffer = pb->buffer;
+	int bytes = janus_recordplay_frame_read(session->aframes, frame, buffer, sizeof(pb->buffer));
+	if(bytes != frame->len)
+		JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, frame->len);
+	/* Update payload type */
+	janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+	if(rec->opusred_pt == 0 || rtp->type != rec->opusred_pt)
+		rtp->type = rec->audio_pt;
+	/* If the recording contains RED but the user doesn't support it, only use the primary data */
+	if(rec->opusred_pt > 0 && rtp->type == rec->opusred_pt && !session->opusred) {
+		int plen = 0;
+		char *payload = janus_rtp_payload(buffer, bytes, &plen);
+		if(payload && plen > 0) {
+			janus_red_block blocks[JANUS_RED_MAX_BLOCKS];
+			int count = janus_red_parse_blocks_array(payload, plen, blocks, JANUS_RED_MAX_BLOCKS);
+			if(count > 0) {
+				/* Copy the last block (primary data) to the RTP payload */
+				janus_red_block *rb = &blocks[count-1];
+				if(rb->data && rb->length > 0) {
+					rtp->type = rec->audio_pt;
+					bytes -= (plen - rb->length);
+					memmove(payload, rb->data, rb->length);
+				}
+			}
 		}
 	}
-	/* Timer */
-	gboolean asent = FALSE, vsent = FALSE, dsent = FALSE;
-	struct timeval now, abefore, vbefore, dbefore;
-	time_t d_s, d_us;
-	gettimeofday(&now, NULL);
-	gettimeofday(&abefore, NULL);
-	gettimeofday(&vbefore, NULL);
-	gettimeofday(&dbefore, NULL);
-
-	janus_recordplay_frame_packet *audio = session->aframes, *video = session->vframes, *data = session->dframes;
-	char *buffer = g_malloc0(1500);
-	int bytes = 0;
-	int64_t ts_diff = 0, passed = 0;
+	janus_plugin_rtp prtp = { .mindex = -1, .video = FALSE, .buffer = (char *)buffer, .length = bytes };
+	janus_plugin_rtp_extensions_reset(&prtp.extensions);
+	gateway->relay_rtp(session->handle, &prtp);
+}
 
-	int audio_pt = session->recording->audio_pt;
-	int video_pt = session->recording->video_pt;
+static void janus_recordplay_playback_send_video(janus_recordplay_playback *pb, janus_recordplay_frame_packet *frame) {
+	char *buffer = pb->buffer;
+	int bytes = janus_recordplay_frame_read(pb->session->vframes, frame, buffer, sizeof(pb->buffer));
+	if(bytes != frame->len)
+		JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, frame->len);
+	/* Update payload type */
+	janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+	rtp->type = pb->rec->video_pt;
+	janus_plugin_rtp prtp = { .mindex = -1, .video = TRUE, .buffer = (char *)buffer, .length = bytes };
+	janus_plugin_rtp_extensions_reset(&prtp.extensions);
+	gateway->relay_rtp(pb->session->handle, &prtp);
+}
 
-	int akhz = 48;
-	if(audio_pt == 0 || audio_pt == 8 || audio_pt == 9)
-		akhz = 8;
-	int vkhz = 90;
+static void janus_recordplay_playback_send_data(janus_recordplay_playback *pb, janus_recordplay_frame_packet *frame) {
+	char *buffer = pb->buffer;
+	int bytes = janus_recordplay_frame_read(pb->session->dframes, frame, buffer, sizeof(pb->buffer));
+	if(bytes != frame->len)
+		JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, frame->len);
+	janus_plugin_data datapacket = {
+		.label = NULL,
+		.protocol = NULL,
+		.binary = pb->rec->textdata ? FALSE : TRUE,
+		.buffer = (char *)buffer,
+		.length = bytes
+	};
+	gateway->relay_data(pb->session->handle, &datapacket);
+}
 
-	while(!g_atomic_int_get(&session->destroyed) && session->active
-			&& !g_atomic_int_get(&rec->destroyed) && (audio || video)) {
-		if(!asent && !vsent && !dsent) {
-			/* We skipped the last round, so sleep a bit (5ms) */
-			g_usleep(5000);
-		}
-		asent = FALSE;
-		vsent = FALSE;
-		dsent = FALSE;
-		if(audio) {
-			if(audio == session->aframes) {
-				/* First packet, send now */
-				fseek(afile, audio->offset, SEEK_SET);
-				bytes = fread(buffer, sizeof(char), audio->len, afile);
-				if(bytes != audio->len)
-					JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, audio->len);
-				/* Update payload type */
-				janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-				if(rec->opusred_pt == 0 || rtp->type != rec->opusred_pt)
-					rtp->type = audio_pt;
-				/* If the recording contains RED but the user doesn't support it, only use the primary data */
-				if(rec->opusred_pt > 0 && rtp->type == rec->opusred_pt && !session->opusred) {
-					int plen = 0;
-					char *payload = janus_rtp_payload(buffer, bytes, &plen);
-					if(payload && plen > 0) {
-						GList *blocks = janus_red_parse_blocks(payload, plen);
-						if(blocks != NULL) {
-							/* Copy the last block (primary data) to the RTP payload */
-							GList *last = g_list_last(blocks);
-							janus_red_block *rb = (janus_red_block *)(last ? last->data : NULL);
-							if(rb && rb->data && rb->length > 0) {
-								rtp->type = audio_pt;
-								bytes -= (plen - rb->length);
-								memmove(payload, rb->data, rb->length);
-							}
-							g_list_free_full(blocks, (GDestroyNotify)g_free);
-						}
-					}
-				}
-				janus_plugin_rtp prtp = { .mindex = -1, .video = FALSE, .buffer = (char *)buffer, .length = bytes };
-				janus_plugin_rtp_extensions_reset(&prtp.extensions);
-				gateway->relay_rtp(session->handle, &prtp);
-				gettimeofday(&now, NULL);
-				abefore.tv_sec = now.tv_sec;
-				abefore.tv_usec = now.tv_usec;
-				asent = TRUE;
-				audio = audio->next;
-			} else {
-				/* What's the timestamp skip from the previous packet? */
-				ts_diff = audio->ts - audio->prev->ts;
-				ts_diff = (ts_diff*1000)/akhz;
-				/* Check if it's time to send */
-				gettimeofday(&now, NULL);
-				d_s = now.tv_sec - abefore.tv_sec;
-				d_us = now.tv_usec - abefore.tv_usec;
-				if(d_us < 0) {
-					d_us += 1000000;
-					--d_s;
-				}
-				passed = d_s*1000000 + d_us;
-				if(passed < (ts_diff-5000)) {
-					asent = FALSE;
-				} else {
-					/* Update the reference time */
-					abefore.tv_usec += ts_diff%1000000;
-					if(abefore.tv_usec > 1000000) {
-						abefore.tv_sec++;
-						abefore.tv_usec -= 1000000;
-					}
-					if(ts_diff/1000000 > 0) {
-						abefore.tv_sec += ts_diff/1000000;
-						abefore.tv_usec -= ts_diff/1000000;
-					}
-					/* Send now */
-					fseek(afile, audio->offset, SEEK_SET);
-					bytes = fread(buffer, sizeof(char), audio->len, afile);
-					if(bytes != audio->len)
-						JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, audio->len);
-					/* Update payload type */
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					if(rec->opusred_pt == 0 || rtp->type != rec->opusred_pt)
-						rtp->type = audio_pt;
-					/* If the recording contains RED but the user doesn't support it, only use the primary data */
-					if(rec->opusred_pt > 0 && rtp->type == rec->opusred_pt && !session->opusred) {
-						int plen = 0;
-						char *payload = janus_rtp_payload(buffer, bytes, &plen);
-						if(payload && plen > 0) {
-							GList *blocks = janus_red_parse_blocks(payload, plen);
-							if(blocks != NULL) {
-								/* Copy the last block (primary data) to the RTP payload */
-								GList *last = g_list_last(blocks);
-								janus_red_block *rb = (janus_red_block *)(last ? last->data : NULL);
-								if(rb && rb->data && rb->length > 0) {
-									rtp->type = audio_pt;
-									bytes -= (plen - rb->length);
-									memmove(payload, rb->data, rb->length);
-								}
-								g_list_free_full(blocks, (GDestroyNotify)g_free);
-							}
-						}
-					}
-					janus_plugin_rtp prtp = { .mindex = -1, .video = FALSE, .buffer = (char *)buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&prtp.extensions);
-					gateway->relay_rtp(session->handle, &prtp);
-					asent = TRUE;
-					audio = audio->next;
-				}
+/* Helper to send a viewer all the frames that are due: returns when (monotonic
+ * time) the next frame will be due, or -1 if the playout is over */
+static gint64 janus_recordplay_playback_step(janus_recordplay_playback *pb, gint64 now) {
+	janus_recordplay_session *session = pb->session;
+	if(g_atomic_int_get(&session->destroyed) || !session->active ||
+			g_atomic_int_get(&pb->rec->destroyed) || (!pb->audio && !pb->video))
+		return -1;
+	/* Frames are sent up to 5ms in advance */
+	gint64 next = -1, due = 0;
+	int64_t ts_diff = 0;
+	while(pb->audio) {
+		if(pb->audio != session->aframes->list) {
+			/* What's the timestamp skip from the previous packet? */
+			ts_diff = pb->audio->ts - pb->audio->prev->ts;
+			ts_diff = (ts_diff*1000)/pb->akhz;
+			due = pb->abefore + ts_diff;
+			if(now < due - 5000) {
+				next = due - 5000;
+				break;
 			}
+			pb->abefore = due;
+		} else {
+			/* First packet, send now */
+			pb->abefore = now;
 		}
-		if(video) {
-			if(video == session->vframes) {
-				/* First packets: there may be many of them with the same timestamp, send them all */
-				uint64_t ts = video->ts;
-				while(video && video->ts == ts) {
-					fseek(vfile, video->offset, SEEK_SET);
-					bytes = fread(buffer, sizeof(char), video->len, vfile);
-					if(bytes != video->len)
-						JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, video->len);
-					/* Update payload type */
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					rtp->type = video_pt;
-					janus_plugin_rtp prtp = { .mindex = -1, .video = TRUE, .buffer = (char *)buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&prtp.extensions);
-					gateway->relay_rtp(session->handle, &prtp);
-					video = video->next;
-				}
-				vsent = TRUE;
-				gettimeofday(&now, NULL);
-				vbefore.tv_sec = now.tv_sec;
-				vbefore.tv_usec = now.tv_usec;
-			} else {
-				/* What's the timestamp skip from the previous packet? */
-				ts_diff = video->ts - video->prev->ts;
-				ts_diff = (ts_diff*1000)/vkhz;
-				/* Check if it's time to send */
-				gettimeofday(&now, NULL);
-				d_s = now.tv_sec - vbefore.tv_sec;
-				d_us = now.tv_usec - vbefore.tv_usec;
-				if(d_us < 0) {
-					d_us += 1000000;
-					--d_s;
-				}
-				passed = d_s*1000000 + d_us;
-				if(passed < (ts_diff-5000)) {
-					vsent = FALSE;
-				} else {
-					/* Update the reference time */
-					vbefore.tv_usec += ts_diff%1000000;
-					if(vbefore.tv_usec > 1000000) {
-						vbefore.tv_sec++;
-						vbefore.tv_usec -= 1000000;
-					}
-					if(ts_diff/1000000 > 0) {
-						vbefore.tv_sec += ts_diff/1000000;
-						vbefore.tv_usec -= ts_diff/1000000;
-					}
-					/* There may be multiple packets with the same timestamp, send them all */
-					uint64_t ts = video->ts;
-					while(video && video->ts == ts) {
-						/* Send now */
-						fseek(vfile, video->offset, SEEK_SET);
-						bytes = fread(buffer, sizeof(char), video->len, vfile);
-						if(bytes != video->len)
-							JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, video->len);
-						/* Update payload type */
-						janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-						rtp->type = video_pt;
-						janus_plugin_rtp prtp = { .mindex = -1, .video = TRUE, .buffer = (char *)buffer, .length = bytes };
-						janus_plugin_rtp_extensions_reset(&prtp.extensions);
-						gateway->relay_rtp(session->handle, &prtp);
-						video = video->next;
-					}
-					vsent = TRUE;
-				}
+		janus_recordplay_playback_send_audio(pb, pb->audio);
+		pb->audio = pb->audio->next;
+	}
+	while(pb->video) {
+		if(pb->video != session->vframes->list) {
+			/* What's the timestamp skip from the previous packet? */
+			ts_diff = pb->video->ts - pb->video->prev->ts;
+			ts_diff = (ts_diff*1000)/pb->vkhz;
+			due = pb->vbefore + ts_diff;
+			if(now < due - 5000) {
+				if(next < 0 || due - 5000 < next)
+					next = due - 5000;
+				break;
 			}
+			pb->vbefore = due;
+		} else {
+			/* First packets, send now */
+			pb->vbefore = now;
 		}
-		if(data) {
-			u_int64_t prev_ts = 0; /* All timestamps for data are indexed to 0, since when parsing ts = when - c_time */
-			if(data->prev)
-				prev_ts = data->prev->ts;
-			ts_diff = data->ts - prev_ts;
-
-			/* Check if it's time to send */
-			gettimeofday(&now, NULL);
-			d_s = now.tv_sec - dbefore.tv_sec;
-			d_us = now.tv_usec - dbefore.tv_usec;
-			if(d_us < 0) {
-				d_us += 1000000;
-				--d_s;
-			}
-			passed = d_s*1000000 + d_us;
-			if(passed < (ts_diff-5000)) {
-				dsent = FALSE;
-			} else {
-				/* Update the reference time */
-				dbefore.tv_usec += ts_diff%1000000;
-				if(dbefore.tv_usec > 1000000) {
-					dbefore.tv_sec++;
-					dbefore.tv_usec -= 1000000;
-				}
-				if(ts_diff/1000000 > 0) {
-					dbefore.tv_sec += ts_diff/1000000;
-					dbefore.tv_usec -= ts_diff/1000000;
-				}
-				/* Read data packet */
-				fseek(dfile, data->offset, SEEK_SET);
-				bytes = fread(buffer, sizeof(char), data->len, dfile);
-				if(bytes != data->len)
-					JANUS_LOG(LOG_WARN, "Didn't manage to read all the bytes we needed (%d < %d)...\n", bytes, data->len);
-				/* Update payload type */
-				janus_plugin_data datapacket = {
-					.label = NULL,
-					.protocol = NULL,
-					.binary = rec->textdata ? FALSE : TRUE,
-					.buffer = (char *)buffer,
-					.length = bytes
-				};
-				gateway->relay_data(session->handle, &datapacket);
-				dsent = TRUE;
-				data = data->next;
-			}
+		/* There may be multiple packets with the same timestamp, send them all */
+		uint64_t ts = pb->video->ts;
+		while(pb->video && pb->video->ts == ts) {
+			janus_recordplay_playback_send_video(pb, pb->video);
+			pb->video = pb->video->next;
 		}
 	}
-
-	g_free(buffer);
-
-	/* Get rid of the indexes */
-	janus_recordplay_frame_packet *tmp = NULL;
-	audio = session->aframes;
-	while(audio) {
-		tmp = audio->next;
-		g_free(audio);
-		audio = tmp;
+	while(pb->data) {
+		/* All timestamps for data are indexed to 0, since when parsing ts = when - c_time */
+		uint64_t prev_ts = pb->data->prev ? pb->data->prev->ts : 0;
+		ts_diff = pb->data->ts - prev_ts;
+		due = pb->dbefore + ts_diff;
+		if(now < due - 5000) {
+			if(next < 0 || due - 5000 < next)
+				next = due - 5000;
+			break;
+		}
+		pb->dbefore = due;
+		janus_recordplay_playback_send_data(pb, pb->data);
+		pb->data = pb->data->next;
 	}
+	if(!pb->audio && !pb->video)
+		return -1;
+	return next;
+}
+
+/* Helper to wrap up the playout of a recording for a viewer */
+static void janus_recordplay_playback_done(janus_recordplay_playback *pb) {
+	janus_recordplay_session *session = pb->session;
+	janus_recordplay_recording *rec = pb->rec;
+	/* We're done with the frames: if no one else is using them, they're freed */
+	janus_recordplay_frames_release(rec, session->aframes);
 	session->aframes = NULL;
-	video = session->vframes;
-	while(video) {
-		tmp = video->next;
-		g_free(video);
-		video = tmp;
-	}
+	janus_recordplay_frames_release(rec, session->vframes);
 	session->vframes = NULL;
-	data = session->dframes;
-	while(data) {
-		tmp = data->next;
-		g_free(data);
-		data = tmp;
-	}
+	janus_recordplay_frames_release(rec, session->dframes);
 	session->dframes = NULL;
 
-	if(afile)
-		fclose(afile);
-	afile = NULL;
-	if(vfile)
-		fclose(vfile);
-	vfile = NULL;
-	if(dfile)
-		fclose(dfile);
-	dfile = NULL;
-
 	/* Remove from the list of viewers */
 	janus_mutex_lock(&rec->mutex);
 	rec->viewers = g_list_remove(rec->viewers, session);
@@ -3076,8 +3075,179 @@ static void *janus_recordplay_playout_thread(void *sessiondata) {
 
 	janus_refcount_decrease(&rec->ref);
 	janus_refcount_decrease(&session->ref);
+	g_free(pb);
+}
+
+/* Thread to play a recording for a single viewer, if the shared playout engine is not used */
+static void *janus_recordplay_playout_thread(void *sessiondata) {
+	janus_recordplay_session *session = (janus_recordplay_session *)sessiondata;
+	if(!session) {
+		JANUS_LOG(LOG_ERR, "Invalid session, can't start playout thread...\n");
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	janus_recordplay_playback *pb = janus_recordplay_playback_new(session);
+	if(pb == NULL) {
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	JANUS_LOG(LOG_VERB, "Joining playout thread\n");
+	gint64 now = 0, due = 0;
+	while((due = janus_recordplay_playback_step(pb, janus_get_monotonic_time())) >= 0) {
+		/* Sleep until the next frame is due, but at most 5ms at a time */
+		now = janus_get_monotonic_time();
+		if(due > now)
+			g_usleep(MIN(due - now, 5000));
+	}
+	janus_recordplay_playback_done(pb);
 
 	JANUS_LOG(LOG_VERB, "Leaving playout thread\n");
 	g_thread_unref(g_thread_self());
 	return NULL;
 }
+
+/* Helper to add a playback to the timer wheel of a playout thread (that thread only) */
+static void janus_recordplay_playout_schedule(janus_recordplay_playout_worker *worker,
+		janus_recordplay_playback *pb, gint64 due, gint64 tick) {
+	pb->due = due;
+	gint64 slot = due / JANUS_RECORDPLAY_WHEEL_TICK;
+	if(slot <= tick)
+		slot = tick + 1;
+	worker->wheel[slot % JANUS_RECORDPLAY_WHEEL_SLOTS] = g_list_prepend(worker->wheel[slot % JANUS_RECORDPLAY_WHEEL_SLOTS], pb);
+}
+
+/* Shared playout thread: playbacks are kept in a timer wheel, according to
+ * when their next frame is due, and each tick only the playbacks in the
+ * current slot are checked */
+static void *janus_recordplay_playout_worker_thread(void *data) {
+	janus_recordplay_playout_worker *worker = (janus_recordplay_playout_worker *)data;
+	JANUS_LOG(LOG_VERB, "Joining Record&Play playout thread #%u\n", worker->id);
+	gint64 now = janus_get_monotonic_time(), next = 0, current = 0, due = 0;
+	gint64 tick = now / JANUS_RECORDPLAY_WHEEL_TICK;
+	GList *list = NULL, *temp = NULL;
+	int i = 0;
+	while(!g_atomic_int_get(&worker->stop)) {
+		/* Wait for the next tick */
+		next = (tick + 1) * JANUS_RECORDPLAY_WHEEL_TICK;
+		now = janus_get_monotonic_time();
+		if(now < next) {
+			g_usleep(next - now);
+			now = janus_get_monotonic_time();
+		}
+		current = now / JANUS_RECORDPLAY_WHEEL_TICK;
+		if(current - tick > JANUS_RECORDPLAY_WHEEL_SLOTS) {
+			/* We fell behind by more than a whole turn of the wheel */
+			tick = current - JANUS_RECORDPLAY_WHEEL_SLOTS;
+		}
+		/* New playbacks start right away */
+		janus_mutex_lock(&worker->mutex);
+		list = worker->incoming;
+		worker->incoming = NULL;
+		janus_mutex_unlock(&worker->mutex);
+		for(temp = list; temp != NULL; temp = temp->next)
+			janus_recordplay_playout_schedule(worker, (janus_recordplay_playback *)temp->data, now, tick);
+		g_list_free(list);
+		/* Check the slots we went past */
+		while(tick < current) {
+			tick++;
+			guint slot = tick % JANUS_RECORDPLAY_WHEEL_SLOTS;
+			list = worker->wheel[slot];
+			worker->wheel[slot] = NULL;
+			for(temp = list; temp != NULL; temp = temp->next) {
+				janus_recordplay_playback *pb = (janus_recordplay_playback *)temp->data;
+				if(pb->due / JANUS_RECORDPLAY_WHEEL_TICK > tick) {
+					/* Due in a later turn of the wheel */
+					worker->wheel[slot] = g_list_prepend(worker->wheel[slot], pb);
+					continue;
+				}
+				due = janus_recordplay_playback_step(pb, now);
+				if(due < 0) {
+					janus_recordplay_playback_done(pb);
+					g_atomic_int_add(&worker->count, -1);
+					continue;
+				}
+				janus_recordplay_playout_schedule(worker, pb, due, current);
+			}
+			g_list_free(list);
+		}
+	}
+	/* We're done: wrap up all the playbacks we were still serving */
+	janus_mutex_lock(&worker->mutex);
+	list = worker->incoming;
+	worker->incoming = NULL;
+	janus_mutex_unlock(&worker->mutex);
+	for(i=0; i<JANUS_RECORDPLAY_WHEEL_SLOTS; i++) {
+		list = g_list_concat(list, worker->wheel[i]);
+		worker->wheel[i] = NULL;
+	}
+	g_list_free_full(list, (GDestroyNotify)janus_recordplay_playback_done);
+	JANUS_LOG(LOG_VERB, "Leaving Record&Play playout thread #%u\n", worker->id);
+	return NULL;
+}
+
+static void janus_recordplay_playout_workers_start(int num) {
+	playout_workers = g_malloc0((num+1) * sizeof(janus_recordplay_playout_worker *));
+	int i = 0, started = 0;
+	char tname[16];
+	for(i=0; i<num; i++) {
+		janus_recordplay_playout_worker *worker = g_malloc0(sizeof(janus_recordplay_playout_worker));
+		worker->id = i+1;
+		janus_mutex_init(&worker->mutex);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "recplay %u", worker->id);
+		worker->thread = g_thread_try_new(tname, &janus_recordplay_playout_worker_thread, worker, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Record&Play playout thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_mutex_destroy(&worker->mutex);
+			g_free(worker);
+			continue;
+		}
+		playout_workers[started++] = worker;
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any playout thread, using a thread per viewer\n");
+		g_free(playout_workers);
+		playout_workers = NULL;
+		playout_threads = 0;
+		return;
+	}
+	playout_threads = started;
+	JANUS_LOG(LOG_INFO, "Using %d threads for the playout of recordings\n", playout_threads);
+}
+
+static void janus_recordplay_playout_workers_stop(void) {
+	if(playout_workers == NULL)
+		return;
+	int i = 0;
+	for(i=0; playout_workers[i] != NULL; i++) {
+		janus_recordplay_playout_worker *worker = playout_workers[i];
+		g_atomic_int_set(&worker->stop, 1);
+		g_thread_join(worker->thread);
+		janus_mutex_destroy(&worker->mutex);
+		g_free(worker);
+	}
+	g_free(playout_workers);
+	playout_workers = NULL;
+	playout_threads = 0;
+}
+
+/* Helper to have the least loaded playout thread play a recording for a viewer:
+ * the caller must have taken the reference the playout will release */
+static void janus_recordplay_playout_add(janus_recordplay_session *session) {
+	janus_recordplay_playback *pb = janus_recordplay_playback_new(session);
+	if(pb == NULL)
+		return;
+	janus_recordplay_playout_worker *worker = NULL;
+	int i = 0;
+	for(i=0; playout_workers[i] != NULL; i++) {
+		if(worker == NULL || g_atomic_int_get(&playout_workers[i]->count) < g_atomic_int_get(&worker->count))
+			worker = playout_workers[i];
+	}
+	g_atomic_int_inc(&worker->count);
+	janus_mutex_lock(&worker->mutex);
+	worker->incoming = g_list_append(worker->incoming, pb);
+	janus_mutex_unlock(&worker->mutex);
+	JANUS_LOG(LOG_VERB, "Playing recording %"SCNu64" on playout thread #%u\n", pb->rec->id, worker->id);
+}
@@ -659,12 +659,35 @@
  * All this is the application responsibility, and as such it's up to
  * the developer to react to events accordingly.
  *
+ * \section sipstacks Shared Sofia stacks
+ *
+ * By default, each registered session gets a Sofia SIP stack of its own,
+ * each with a dedicated thread. When many accounts are registered on the
+ * same Janus instance, you can set \c sofia_stacks in the configuration
+ * to have a fixed number of stacks serve all of them instead: new sessions
+ * are assigned to the least loaded stack, and incoming requests are routed
+ * to the right session by looking at the username they're addressed to
+ * (which means a stack can only serve one session per username). Sessions
+ * that use TCP, SIPS or RFC2543-style CANCELs still get their own stack.
+ * When shared stacks are used, \c register_rate can also limit how many
+ * REGISTERs each stack sends per second, in order to avoid registration
+ * storms when many sessions register at the same time: REGISTERs are
+ * queued, and sent as soon as the rate allows without waiting for the
+ * responses to the previous ones. The \c sofia-stack object returned when
+ * querying a session provides info on the load of its stack.
+ *
  */
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include "plugin.h"
 
 #include <arpa/inet.h>
 #include <net/if.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include <jansson.h>
 
@@ -966,6 +989,8 @@ struct ssip_s {
 	GHashTable *subscriptions;
 	janus_mutex smutex;
 	struct janus_sip_session *session;
+	struct janus_sip_sofia_stack *shared;	/* Shared Sofia stack serving this session, if any */
+	char *user;			/* Username this session is known as by the shared stack */
 };
 
 typedef struct janus_sip_transfer {
@@ -1000,6 +1025,15 @@ typedef struct janus_sip_account {
 	janus_sip_registration_status registration_status;
 } janus_sip_account;
 
+/* Per-call counters: the ones for incoming packets are only updated by
+ * the thread relaying the media, the others by the core when sending */
+typedef struct janus_sip_media_stats {
+	guint64 packets_in, bytes_in;		/* Packets received from the SIP peer */
+	guint64 packets_out, bytes_out;		/* Packets sent to the SIP peer */
+	guint32 dropped;					/* Incoming packets we didn't relay (e.g., because on hold) */
+	guint32 srtp_errors;				/* Incoming packets we failed to decrypt */
+} janus_sip_media_stats;
+
 typedef struct janus_sip_media {
 	char *remote_audio_ip;			/* Peer audio media IP address */
 	char *remote_video_ip;			/* Peer video media IP address */
@@ -1045,6 +1079,7 @@ typedef struct janus_sip_media {
 	gboolean updated;
 	int video_orientation_extension_id;
 	int audio_level_extension_id;
+	janus_sip_media_stats stats;
 } janus_sip_media;
 
 typedef struct janus_sip_session {
@@ -1064,6 +1099,7 @@ typedef struct janus_sip_session {
 	janus_recorder *vrc_peer;	/* The Janus recorder instance for the peer's video, if enabled */
 	janus_mutex rec_mutex;		/* Mutex to protect the recorders from race conditions */
 	GThread *relayer_thread;
+	struct janus_sip_reactor *reactor;	/* Reactor thread relaying the media of the call, if any */
 	volatile gint establishing, established;
 	volatile gint hangingup;
 	volatile gint destroyed;
@@ -1105,6 +1141,11 @@ static gboolean janus_sip_call_is_established(janus_sip_session *session) {
 		session->status == janus_sip_call_status_incall_reinvited) ? TRUE : FALSE;
 }
 
+/* Whether the media of the call is being relayed, either by a dedicated thread or by a reactor thread */
+static gboolean janus_sip_media_relaying(janus_sip_session *session) {
+	return (session->relayer_thread != NULL || session->reactor != NULL);
+}
+
 static void janus_sip_media_reset(janus_sip_session *session);
 
 static void janus_sip_session_destroy(janus_sip_session *session) {
@@ -1135,6 +1176,7 @@ static void janus_sip_session_free(const janus_refcount *session_ref) {
 		su_home_deinit(session->stack->s_home);
 		su_home_unref(session->stack->s_home);
 		g_free(session->stack->contact_header);
+		g_free(session->stack->user);
 		g_free(session->stack);
 		session->stack = NULL;
 	}
@@ -1505,14 +1547,90 @@ gpointer janus_sip_sofia_thread(gpointer user_data);
 /* Sofia callbacks */
 void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase, nua_t *nua, nua_magic_t *magic, nua_handle_t *nh, nua_hmagic_t *hmagic, sip_t const *sip, tagi_t tags[]);
 void janus_sip_save_reason(sip_t const *sip, janus_sip_session *session);
+static void janus_sip_drop_active_calls(janus_sip_session *session);
+
+/* Shared Sofia stacks, if enabled: rather than having a Sofia thread (and
+ * NUA) for each registered session, a fixed number of stacks serves all of
+ * them, and REGISTERs are queued and sent at a configurable rate */
+#define JANUS_SIP_MAX_SOFIA_STACKS	64
+#define JANUS_SIP_SOFIA_STACK_TICK	50	/* How often queued REGISTERs are sent, in ms */
+static int sofia_stacks = 0;
+static int register_rate = 0;
+typedef struct janus_sip_sofia_stack {
+	guint id;
+	su_root_t *s_root;
+	nua_t *s_nua;
+	su_timer_t *timer;
+	GThread *thread;
+	volatile gint ready;	/* 1 when the NUA is up, -1 if it couldn't be created */
+	char *contact_header;	/* Only needed for Sofia SIP >= 1.13 */
+	GHashTable *users;		/* Sessions served by this stack, indexed by username */
+	GQueue *registers;		/* REGISTERs waiting to be sent */
+	GList *detached;		/* Sessions that have gone away and must be detached */
+	gint64 credit;			/* How many REGISTERs can be sent right now, in thousandths */
+	guint max_queued;		/* Longest the queue of REGISTERs has been */
+	volatile gint registers_sent, registers_answered;
+	janus_mutex mutex;
+} janus_sip_sofia_stack;
+static janus_sip_sofia_stack **stacks = NULL;
+static void janus_sip_stacks_start(int num);
+static void janus_sip_stacks_stop(void);
+static int janus_sip_stack_attach(janus_sip_session *session);
+static void janus_sip_stack_rekey(janus_sip_session *session);
+static void janus_sip_stack_detach(janus_sip_session *session);
+static nua_handle_t *janus_sip_nua_handle(janus_sip_session *session, nua_t *nua);
+/* A REGISTER to send: on shared stacks, it may be queued for a while */
+typedef struct janus_sip_register {
+	janus_sip_session *session;
+	nua_handle_t *nh;
+	char *authuser, *display_name, *identity;
+	char *headers, *params, *expires;
+	char *registrar, *proxy;
+} janus_sip_register;
+static void janus_sip_register_send(janus_sip_register *reg);
+static void janus_sip_stack_queue_register(janus_sip_sofia_stack *stack, janus_sip_register *reg);
+static void janus_sip_stack_callback(janus_sip_sofia_stack *stack, nua_event_t event, int status, char const *phrase,
+	nua_t *nua, nua_magic_t *magic, nua_handle_t *nh, sip_t const *sip, tagi_t tags[]);
 /* SDP parsing and manipulation */
 void janus_sip_sdp_process(janus_sip_session *session, janus_sdp *sdp, gboolean answer, gboolean update, gboolean *changed);
 char *janus_sip_sdp_manipulate(janus_sip_session *session, janus_sdp *sdp, gboolean answer);
 /* Media */
 static int janus_sip_allocate_local_ports(janus_sip_session *session, gboolean update);
+static void janus_sip_relay_start(janus_sip_session *session);
 static void *janus_sip_relay_thread(void *data);
 static void janus_sip_media_cleanup(janus_sip_session *session);
 
+/* Reactor threads, if enabled: rather than having a dedicated thread for
+ * the media of each call, a fixed number of threads serves all of them */
+#define JANUS_SIP_MAX_REACTOR_THREADS	64
+static int reactor_threads = 0;
+#ifdef HAVE_EPOLL
+typedef struct janus_sip_reactor {
+	guint id;
+	int epfd;
+	GThread *thread;
+	volatile gint stop;
+	GList *calls;			/* List of janus_sip_reactor_call instances */
+	guint count;			/* How many calls this reactor is serving */
+	janus_mutex mutex;
+} janus_sip_reactor;
+static void janus_sip_reactors_start(int num);
+static void janus_sip_reactors_stop(void);
+static int janus_sip_reactor_add(janus_sip_session *session);
+#endif
+
+/* Packets from the SIP peer are read in batches, where supported (recvmmsg) */
+#define JANUS_SIP_RECV_BATCH	16
+typedef struct janus_sip_recv_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr messages[JANUS_SIP_RECV_BATCH];
+	struct iovec iovecs[JANUS_SIP_RECV_BATCH];
+#endif
+	int length[JANUS_SIP_RECV_BATCH];
+	char data[JANUS_SIP_RECV_BATCH][1500];
+} janus_sip_recv_batch;
+static int janus_sip_recv_batch_read(janus_sip_recv_batch *batch, int fd);
+
 
 /* URI parsing utilies */
 
@@ -1990,6 +2108,52 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 			JANUS_LOG(LOG_VERB, "Sofia SIP certificates folder: %s\n", sips_certs_dir);
 		}
 
+		/* Should the media of calls be relayed by reactor threads? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "reactor_threads");
+		if(item && item->value) {
+			if(!strcasecmp(item->value, "auto"))
+				reactor_threads = g_get_num_processors();
+			else
+				reactor_threads = atoi(item->value);
+			if(reactor_threads < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid reactor_threads value %s, using a thread per call\n", item->value);
+				reactor_threads = 0;
+			} else if(reactor_threads > JANUS_SIP_MAX_REACTOR_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many reactor threads (%d), capping to %d\n", reactor_threads, JANUS_SIP_MAX_REACTOR_THREADS);
+				reactor_threads = JANUS_SIP_MAX_REACTOR_THREADS;
+			}
+#ifndef HAVE_EPOLL
+			if(reactor_threads > 0) {
+				JANUS_LOG(LOG_WARN, "epoll not available, using a thread per call\n");
+				reactor_threads = 0;
+			}
+#endif
+		}
+
+		/* Should registered sessions share a fixed number of Sofia stacks? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "sofia_stacks");
+		if(item && item->value) {
+			if(!strcasecmp(item->value, "auto"))
+				sofia_stacks = g_get_num_processors();
+			else
+				sofia_stacks = atoi(item->value);
+			if(sofia_stacks < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid sofia_stacks value %s, using a Sofia stack per session\n", item->value);
+				sofia_stacks = 0;
+			} else if(sofia_stacks > JANUS_SIP_MAX_SOFIA_STACKS) {
+				JANUS_LOG(LOG_WARN, "Too many Sofia stacks (%d), capping to %d\n", sofia_stacks, JANUS_SIP_MAX_SOFIA_STACKS);
+				sofia_stacks = JANUS_SIP_MAX_SOFIA_STACKS;
+			}
+		}
+		item = janus_config_get(config, config_general, janus_config_type_item, "register_rate");
+		if(item && item->value) {
+			register_rate = atoi(item->value);
+			if(register_rate < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid register_rate value %s, not limiting REGISTERs\n", item->value);
+				register_rate = 0;
+			}
+		}
+
 		janus_config_destroy(config);
 	}
 	config = NULL;
@@ -2037,6 +2201,15 @@ int janus_sip_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_WARN, "IPv6 disabled, will only use IPv4 for RTP/RTCP sockets (SIP)\n");
 	}
 
+#ifdef HAVE_EPOLL
+	/* If we need reactor threads to relay the media of calls, start them too */
+	if(reactor_threads > 0)
+		janus_sip_reactors_start(reactor_threads);
+#endif
+	/* If registered sessions must share Sofia stacks, start them too */
+	if(sofia_stacks > 0)
+		janus_sip_stacks_start(sofia_stacks);
+
 	g_atomic_int_set(&initialized, 1);
 
 	/* Launch the thread that will handle incoming messages */
@@ -2063,6 +2236,10 @@ void janus_sip_destroy(void) {
 		g_thread_join(handler_thread);
 		handler_thread = NULL;
 	}
+#ifdef HAVE_EPOLL
+	janus_sip_reactors_stop();
+#endif
+	janus_sip_stacks_stop();
 	/* FIXME We should destroy the sessions cleanly */
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
@@ -2292,8 +2469,10 @@ void janus_sip_destroy_session(janus_plugin_session *handle, int *error) {
 		g_hash_table_remove(transfers, GUINT_TO_POINTER(session->refer_id));
 		session->refer_id = 0;
 	}
-	/* Shutdown the NUA */
-	if(session->stack) {
+	/* Shutdown the NUA, or detach from the shared stack */
+	if(session->stack && session->stack->shared) {
+		janus_sip_stack_detach(session);
+	} else if(session->stack) {
 		janus_mutex_lock(&session->stack->smutex);
 		if(session->stack->s_nua)
 			nua_shutdown(session->stack->s_nua);
@@ -2350,8 +2529,34 @@ json_t *janus_sip_query_session(janus_plugin_session *handle) {
 		json_object_set_new(info, "sdes-local-video", json_string(session->media.has_srtp_local_video ? "yes" : "no"));
 		json_object_set_new(info, "sdes-remote-audio", json_string(session->media.has_srtp_remote_audio ? "yes" : "no"));
 		json_object_set_new(info, "sdes-remote-video", json_string(session->media.has_srtp_remote_video ? "yes" : "no"));
+		json_t *stats = json_object();
+		json_object_set_new(stats, "packets-in", json_integer(session->media.stats.packets_in));
+		json_object_set_new(stats, "bytes-in", json_integer(session->media.stats.bytes_in));
+		json_object_set_new(stats, "packets-out", json_integer(session->media.stats.packets_out));
+		json_object_set_new(stats, "bytes-out", json_integer(session->media.stats.bytes_out));
+		json_object_set_new(stats, "dropped", json_integer(session->media.stats.dropped));
+		json_object_set_new(stats, "srtp-errors", json_integer(session->media.stats.srtp_errors));
+#ifdef HAVE_EPOLL
+		janus_sip_reactor *reactor = session->reactor;
+		if(reactor != NULL)
+			json_object_set_new(stats, "reactor", json_integer(reactor->id));
+#endif
+		json_object_set_new(info, "media-stats", stats);
 	}
 	janus_mutex_unlock(&session->mutex);
+	janus_sip_sofia_stack *stack = session->stack ? session->stack->shared : NULL;
+	if(stack != NULL) {
+		json_t *sofia = json_object();
+		json_object_set_new(sofia, "id", json_integer(stack->id));
+		janus_mutex_lock(&stack->mutex);
+		json_object_set_new(sofia, "sessions", json_integer(g_hash_table_size(stack->users)));
+		json_object_set_new(sofia, "registers-queued", json_integer(g_queue_get_length(stack->registers)));
+		json_object_set_new(sofia, "registers-max-queued", json_integer(stack->max_queued));
+		janus_mutex_unlock(&stack->mutex);
+		json_object_set_new(sofia, "registers-sent", json_integer(g_atomic_int_get(&stack->registers_sent)));
+		json_object_set_new(sofia, "registers-answered", json_integer(g_atomic_int_get(&stack->registers_answered)));
+		json_object_set_new(info, "sofia-stack", sofia);
+	}
 	if(session->arc || session->vrc || session->arc_peer || session->vrc_peer) {
 		json_t *recording = json_object();
 		if(session->arc && session->arc->filename)
@@ -2481,6 +2686,9 @@ void janus_sip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pack
 							guint16 seq = ntohs(header->seq_number);
 							JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending SRTP video packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 								session->account.username, g_strerror(errno), protected, timestamp, seq);
+						} else {
+							session->media.stats.packets_out++;
+							session->media.stats.bytes_out += protected;
 						}
 					}
 				} else {
@@ -2491,6 +2699,9 @@ void janus_sip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pack
 						guint16 seq = ntohs(header->seq_number);
 						JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending RTP video packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 							session->account.username, g_strerror(errno), len, timestamp, seq);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += len;
 					}
 				}
 			}
@@ -2531,6 +2742,9 @@ void janus_sip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pack
 							guint16 seq = ntohs(header->seq_number);
 							JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending SRTP audio packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 								session->account.username, g_strerror(errno), protected, timestamp, seq);
+						} else {
+							session->media.stats.packets_out++;
+							session->media.stats.bytes_out += protected;
 						}
 					}
 				} else {
@@ -2541,6 +2755,9 @@ void janus_sip_incoming_rtp(janus_plugin_session *handle, janus_plugin_rtp *pack
 						guint16 seq = ntohs(header->seq_number);
 						JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending RTP audio packet... %s (len=%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 							session->account.username, g_strerror(errno), len, timestamp, seq);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += len;
 					}
 				}
 			}
@@ -2583,6 +2800,9 @@ void janus_sip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 						if(send(session->media.video_rtcp_fd, sbuf, protected, 0) < 0) {
 							JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending SRTCP video packet... %s (len=%d)...\n",
 								session->account.username, g_strerror(errno), protected);
+						} else {
+							session->media.stats.packets_out++;
+							session->media.stats.bytes_out += protected;
 						}
 					}
 				} else {
@@ -2590,6 +2810,9 @@ void janus_sip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 					if(send(session->media.video_rtcp_fd, buf, len, 0) < 0) {
 						JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending RTCP video packet... %s (len=%d)...\n",
 							session->account.username, g_strerror(errno), len);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += len;
 					}
 				}
 			}
@@ -2613,6 +2836,9 @@ void janus_sip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 						if(send(session->media.audio_rtcp_fd, sbuf, protected, 0) < 0) {
 							JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending SRTCP audio packet... %s (len=%d)...\n",
 								session->account.username, g_strerror(errno), protected);
+						} else {
+							session->media.stats.packets_out++;
+							session->media.stats.bytes_out += protected;
 						}
 					}
 				} else {
@@ -2620,6 +2846,9 @@ void janus_sip_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtcp *pa
 					if(send(session->media.audio_rtcp_fd, buf, len, 0) < 0) {
 						JANUS_LOG(LOG_HUGE, "[SIP-%s] Error sending RTCP audio packet... %s (len=%d)...\n",
 							session->account.username, g_strerror(errno), len);
+					} else {
+						session->media.stats.packets_out++;
+						session->media.stats.bytes_out += len;
 					}
 				}
 			}
@@ -2680,7 +2909,7 @@ static void janus_sip_hangup_media_internal(janus_plugin_session *handle) {
 		return;
 	session->media.simulcast_ssrc = 0;
 	/* Do cleanup if media thread has not been created */
-	if(!session->media.ready && !session->relayer_thread) {
+	if(!session->media.ready && !janus_sip_media_relaying(session)) {
 		janus_mutex_lock(&session->mutex);
 		janus_sip_media_cleanup(session);
 		janus_mutex_unlock(&session->mutex);
@@ -2859,6 +3088,7 @@ static void *janus_sip_handler(void *data) {
 				if(session->stack == NULL) {
 					session->stack = g_malloc0(sizeof(ssip_t));
 					su_home_init(session->stack->s_home);
+					session->stack->shared = session->master->stack->shared;
 					if(session->master->stack->contact_header != NULL)
 						session->stack->contact_header = g_strdup(session->master->stack->contact_header);
 				}
@@ -3159,6 +3389,15 @@ static void *janus_sip_handler(void *data) {
 			}
 
 			session->account.registration_status = janus_sip_registration_status_registering;
+			if(!refresh && session->stack == NULL && stacks != NULL &&
+					!session->account.force_tcp && !session->account.sips && !session->account.rfc2543_cancel) {
+				/* Have one of the shared Sofia stacks serve this session: if
+				 * it can't, we'll fallback to a dedicated thread below */
+				janus_sip_stack_attach(session);
+			} else if(refresh && session->stack != NULL && session->stack->shared != NULL) {
+				/* The username may have changed */
+				janus_sip_stack_rekey(session);
+			}
 			if(!refresh && session->stack == NULL) {
 				/* Start the thread first */
 				GError *error = NULL;
@@ -3218,7 +3457,7 @@ static void *janus_sip_handler(void *data) {
 					g_snprintf(error_cause, 512, "Invalid NUA");
 					goto error;
 				}
-				session->stack->s_nh_r = nua_handle(session->stack->s_nua, session, TAG_END());
+				session->stack->s_nh_r = janus_sip_nua_handle(session, session->stack->s_nua);
 				janus_mutex_unlock(&session->stack->smutex);
 				if(session->stack->s_nh_r == NULL) {
 					JANUS_LOG(LOG_ERR, "NUA Handle for REGISTER still null??\n");
@@ -3229,18 +3468,23 @@ static void *janus_sip_handler(void *data) {
 				/* TTL */
 				char ttl_text[20];
 				g_snprintf(ttl_text, sizeof(ttl_text), "%d", ttl);
-				/* Send the REGISTER */
-				nua_register(session->stack->s_nh_r,
-					NUTAG_M_USERNAME(session->account.authuser),
-					NUTAG_M_DISPLAY(session->account.display_name),
-					SIPTAG_FROM_STR(username_text),
-					SIPTAG_TO_STR(username_text),
-					TAG_IF(strlen(custom_headers) > 0, SIPTAG_HEADER_STR(custom_headers)),
-					TAG_IF(strlen(custom_params) > 0, NUTAG_M_PARAMS(custom_params)),
-					SIPTAG_EXPIRES_STR(ttl_text),
-					NUTAG_REGISTRAR(proxy_text),
-					NUTAG_PROXY(obproxy_text),
-					TAG_END());
+				/* Send the REGISTER: on shared stacks, it may have to wait in line */
+				janus_sip_register reg = {
+					.session = session,
+					.nh = session->stack->s_nh_r,
+					.authuser = session->account.authuser,
+					.display_name = session->account.display_name,
+					.identity = (char *)username_text,
+					.headers = custom_headers,
+					.params = custom_params,
+					.expires = ttl_text,
+					.registrar = (char *)proxy_text,
+					.proxy = (char *)obproxy_text
+				};
+				if(session->stack->shared != NULL && register_rate > 0)
+					janus_sip_stack_queue_register(session->stack->shared, &reg);
+				else
+					janus_sip_register_send(&reg);
 				result = json_object();
 				json_object_set_new(result, "event", json_string("registering"));
 			} else {
@@ -3356,7 +3600,7 @@ static void *janus_sip_handler(void *data) {
 						g_snprintf(error_cause, 512, "Invalid NUA");
 						goto error;
 					}
-					nh = nua_handle(session->stack->s_nua, session, TAG_END());
+					nh = janus_sip_nua_handle(session, session->stack->s_nua);
 				} else {
 					/* This is a helper, we need to use the master's SIP stack */
 					if(session->master == NULL || session->master->stack == NULL) {
@@ -3372,7 +3616,7 @@ static void *janus_sip_handler(void *data) {
 						g_snprintf(error_cause, 512, "Invalid NUA");
 						goto error;
 					}
-					nh = nua_handle(session->master->stack->s_nua, session, TAG_END());
+					nh = janus_sip_nua_handle(session, session->master->stack->s_nua);
 					janus_mutex_unlock(&session->master->stack->smutex);
 				}
 				if(session->stack->subscriptions == NULL) {
@@ -3628,7 +3872,7 @@ static void *janus_sip_handler(void *data) {
 					g_snprintf(error_cause, 512, "Invalid NUA");
 					goto error;
 				}
-				session->stack->s_nh_i = nua_handle(session->stack->s_nua, session, TAG_END());
+				session->stack->s_nh_i = janus_sip_nua_handle(session, session->stack->s_nua);
 				janus_mutex_unlock(&session->stack->smutex);
 				if(session->account.display_name) {
 					g_snprintf(from_hdr, sizeof(from_hdr), "\"%s\" <%s>", session->account.display_name, session->account.identity);
@@ -3655,7 +3899,7 @@ static void *janus_sip_handler(void *data) {
 					g_snprintf(error_cause, 512, "Invalid NUA");
 					goto error;
 				}
-				session->stack->s_nh_i = nua_handle(session->master->stack->s_nua, session, TAG_END());
+				session->stack->s_nh_i = janus_sip_nua_handle(session, session->master->stack->s_nua);
 				janus_mutex_unlock(&session->master->stack->smutex);
 				if(session->master->account.display_name) {
 					g_snprintf(from_hdr, sizeof(from_hdr), "\"%s\" <%s>", session->master->account.display_name, session->master->account.identity);
@@ -3982,19 +4226,7 @@ static void *janus_sip_handler(void *data) {
 			if(answer) {
 				/* Start the media */
 				session->media.ready = TRUE;	/* FIXME Maybe we need a better way to signal this */
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "siprtp %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_sip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
-					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
-				}
+				janus_sip_relay_start(session);
 			}
 		} else if(!strcasecmp(request_text, "update")) {
 			/* Update an existing call */
@@ -4803,7 +5035,7 @@ static void *janus_sip_handler(void *data) {
 						g_snprintf(error_cause, 512, "Invalid NUA");
 						goto error;
 					}
-					nh = nua_handle(session->stack->s_nua, session, TAG_END());
+					nh = janus_sip_nua_handle(session, session->stack->s_nua);
 					janus_mutex_unlock(&session->stack->smutex);
 				} else {
 					/* This is a helper, we need to use the master's SIP stack */
@@ -4820,7 +5052,7 @@ static void *janus_sip_handler(void *data) {
 						g_snprintf(error_cause, 512, "Invalid NUA");
 						goto error;
 					}
-					nh = nua_handle(session->master->stack->s_nua, session, TAG_END());
+					nh = janus_sip_nua_handle(session, session->master->stack->s_nua);
 					janus_mutex_unlock(&session->master->stack->smutex);
 				}
 				json_t *request_callid = json_object_get(root, "call_id");
@@ -4966,6 +5198,16 @@ error:
 /* Sofia callbacks */
 void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase, nua_t *nua, nua_magic_t *magic, nua_handle_t *nh, nua_hmagic_t *hmagic, sip_t const *sip, tagi_t tags[])
 {
+	if(hmagic == NULL && stacks != NULL) {
+		/* If this is a shared stack, find out which session this is for first */
+		int i = 0;
+		for(i=0; stacks[i] != NULL; i++) {
+			if((void *)magic == (void *)stacks[i]) {
+				janus_sip_stack_callback(stacks[i], event, status, phrase, nua, magic, nh, sip, tags);
+				return;
+			}
+		}
+	}
 	janus_sip_session *session = (janus_sip_session *)(hmagic ? hmagic : magic);
 	ssip_t *ssip = session->stack;
 
@@ -5146,7 +5388,7 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 			}
 			gboolean reinvite = FALSE, busy = FALSE;
 			if(session->stack->s_nh_i == NULL) {
-				if(g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || session->relayer_thread != NULL) {
+				if(g_atomic_int_get(&session->establishing) || g_atomic_int_get(&session->established) || janus_sip_media_relaying(session)) {
 					/* Still busy establishing another call (or maybe still cleaning up the previous call) */
 					busy = TRUE;
 				}
@@ -5170,7 +5412,7 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 				while(temp != NULL) {
 					helper = (janus_sip_session *)temp->data;
 					if(helper->stack->s_nh_i == NULL && !g_atomic_int_get(&helper->establishing) &&
-							!g_atomic_int_get(&helper->established) && helper->relayer_thread == NULL) {
+							!g_atomic_int_get(&helper->established) && !janus_sip_media_relaying(helper)) {
 						/* Found! */
 						break;
 					}
@@ -5599,16 +5841,7 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 				/* Check if this session (and/or its helpers) had dangling
 				 * references for ongoing calls: we won't receive other events
 				 * after this, so it's up to us to clean up after ourselfes */
-				janus_mutex_lock(&session->mutex);
-				while(session->active_calls) {
-					janus_sip_session *s = (janus_sip_session *)session->active_calls->data;
-					if(s != NULL) {
-						JANUS_LOG(LOG_VERB, "[%p] Removing reference\n", s);
-						janus_refcount_decrease(&s->ref);
-					}
-					session->active_calls = g_list_remove(session->active_calls, s);
-				}
-				janus_mutex_unlock(&session->mutex);
+				janus_sip_drop_active_calls(session);
 				/* End the event loop: su_root_run() will return */
 				su_root_break(ssip->s_root);
 			}
@@ -5929,21 +6162,8 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 				janus_sdp_destroy(sdp);
 				break;
 			}
-			if(!session->media.earlymedia && !session->media.update) {
-				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "siprtp %s", session->account.username);
-				janus_refcount_increase(&session->ref);
-				session->relayer_thread = g_thread_try_new(tname, janus_sip_relay_thread, session, &error);
-				if(error != NULL) {
-					session->relayer_thread = NULL;
-					session->media.ready = FALSE;
-					janus_refcount_decrease(&session->ref);
-					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
-						error->code, error->message ? error->message : "??");
-					g_error_free(error);
-				}
-			}
+			if(!session->media.earlymedia && !session->media.update)
+				janus_sip_relay_start(session);
 			/* Check if there's an isfocus feature parameter in the Contact header */
 			gboolean is_focus = FALSE;
 			if(sip->sip_contact && sip->sip_contact->m_params) {
@@ -6004,6 +6224,11 @@ void janus_sip_sofia_callback(nua_event_t event, int status, char const *phrase,
 		case nua_r_register:
 		case nua_r_unregister: {
 			JANUS_LOG(LOG_VERB, "[%s][%s]: %d %s\n", session->account.username, nua_event_name(event), status, phrase ? phrase : "??");
+			if(event == nua_r_register && ssip != NULL && ssip->shared != NULL && status >= 200 && status != 401 && status != 407 &&
+					session->account.registration_status == janus_sip_registration_status_registering) {
+				/* Keep track of how many of the REGISTERs we sent are done */
+				g_atomic_int_inc(&ssip->shared->registers_answered);
+			}
 			if(status == 200) {
 				if(event == nua_r_register) {
 					if(session->account.registration_status < janus_sip_registration_status_registered)
@@ -6915,6 +7140,326 @@ static void janus_sip_media_cleanup(janus_sip_session *session) {
 	janus_sip_media_reset(session);
 }
 
+/* Helper to read as many packets as are available (up to the batch size): returns how many we got, or -1 in case of errors */
+static int janus_sip_recv_batch_read(janus_sip_recv_batch *batch, int fd) {
+	int num = 0;
+#ifdef HAVE_RECVMMSG
+	int i = 0;
+	for(i=0; i<JANUS_SIP_RECV_BATCH; i++) {
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = sizeof(batch->data[i]);
+		memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+		batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* We were told there's something, so this won't block for the first
+	 * packet: the others are only read if they're already there */
+	num = recvmmsg(fd, batch->messages, JANUS_SIP_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(num < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	for(i=0; i<num; i++)
+		batch->length[i] = batch->messages[i].msg_len;
+#else
+	batch->length[0] = recvfrom(fd, batch->data[0], sizeof(batch->data[0]), MSG_DONTWAIT, NULL, NULL);
+	if(batch->length[0] < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	num = 1;
+#endif
+	return num;
+}
+
+/* Helper to start relaying the media of a call, on a reactor thread if
+ * we have them, or on a thread of its own otherwise */
+static void janus_sip_relay_start(janus_sip_session *session) {
+	memset(&session->media.stats, 0, sizeof(session->media.stats));
+	janus_refcount_increase(&session->ref);
+#ifdef HAVE_EPOLL
+	if(reactor_threads > 0 && janus_sip_reactor_add(session) == 0)
+		return;
+#endif
+	GError *error = NULL;
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "siprtp %s", session->account.username);
+	session->relayer_thread = g_thread_try_new(tname, janus_sip_relay_thread, session, &error);
+	if(error != NULL) {
+		session->relayer_thread = NULL;
+		session->media.ready = FALSE;
+		janus_refcount_decrease(&session->ref);
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTP/RTCP thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+	}
+}
+
+/* Helper to (re)connect the sockets, when starting or after a session update */
+static void janus_sip_relay_update(janus_sip_session *session) {
+	session->media.updated = FALSE;
+
+	/* Resolve the addresses, if needed */
+	gboolean have_audio_server_ip = FALSE;
+	gboolean have_video_server_ip = FALSE;
+	struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
+	if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve audio address '%s'\n",
+				session->account.username, session->media.remote_audio_ip);
+		} else {
+			/* Address resolved */
+			have_audio_server_ip = TRUE;
+		}
+	}
+	if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
+			JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve video address '%s'\n",
+				session->account.username, session->media.remote_video_ip);
+		} else {
+			/* Address resolved */
+			have_video_server_ip = TRUE;
+		}
+	}
+
+	if(have_audio_server_ip || have_video_server_ip) {
+		janus_sip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
+			have_video_server_ip ? &video_server_addr : NULL);
+	} else if(session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
+		JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
+			session->account.username);
+	} else {
+		if(session->media.remote_audio_ip)
+			JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
+				session->account.username, session->media.remote_audio_ip);
+		if(session->media.remote_video_ip)
+			JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
+				session->account.username, session->media.remote_video_ip);
+	}
+
+	/* In case we're on hold (remote address is 0.0.0.0) set the send properties to FALSE */
+	if(have_audio_server_ip && !strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
+		session->media.audio_send = FALSE;
+		session->media.audio_recv = FALSE;
+	}
+	if(have_video_server_ip && !strcmp(session->media.remote_video_ip, "0.0.0.0")) {
+		session->media.video_send = FALSE;
+		session->media.video_recv = FALSE;
+	}
+}
+
+/* Helper to handle an error on one of the sockets of a call: returns FALSE
+ * if there were too many, and we hung up (so the media must not be relayed anymore) */
+static gboolean janus_sip_relay_error(janus_sip_session *session, int fd, int *pollerrs, const char *what) {
+	/* Check the socket error */
+	int error = 0;
+	socklen_t errlen = sizeof(error);
+	getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
+	if(error == 0) {
+		/* Maybe not a breaking error after all? */
+		return TRUE;
+	} else if(error == 111) {
+		/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
+		if(fd == session->media.audio_rtcp_fd) {
+			JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the audio RTCP socket, closing it\n",
+				session->account.username, g_strerror(error));
+			janus_mutex_lock(&session->mutex);
+			close(session->media.audio_rtcp_fd);
+			session->media.audio_rtcp_fd = -1;
+			janus_mutex_unlock(&session->mutex);
+			return TRUE;
+		} else if(fd == session->media.video_rtcp_fd) {
+			JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the video RTCP socket, closing it\n",
+				session->account.username, g_strerror(error));
+			janus_mutex_lock(&session->mutex);
+			close(session->media.video_rtcp_fd);
+			session->media.video_rtcp_fd = -1;
+			janus_mutex_unlock(&session->mutex);
+			return TRUE;
+		}
+	}
+	/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
+	(*pollerrs)++;
+	if(*pollerrs < 100)
+		return TRUE;
+	JANUS_LOG(LOG_ERR, "[SIP-%s] Too many errors polling %d: %s...\n", session->account.username, fd, what);
+	JANUS_LOG(LOG_ERR, "[SIP-%s]   -- %d (%s)\n", session->account.username, error, g_strerror(error));
+	/* FIXME Simulate a "hangup" coming from the application */
+	janus_sip_hangup_media(session->handle);
+	return FALSE;
+}
+
+/* Helper to handle a packet coming from the SIP peer on one of the sockets
+ * of a call: returns TRUE if it was a valid RTP or RTCP packet */
+static gboolean janus_sip_relay_incoming(janus_sip_session *session, int fd, char *buffer, int bytes) {
+	if(session->media.audio_rtp_fd != -1 && fd == session->media.audio_rtp_fd) {
+		/* Got something audio (RTP) */
+		if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
+			/* Failed to read or not an RTP packet? */
+			return FALSE;
+		}
+		session->media.stats.packets_in++;
+		session->media.stats.bytes_in += bytes;
+		if(!session->media.audio_recv) {
+			/* Dropping audio packet, we weren't expecting anything */
+			session->media.stats.dropped++;
+			return TRUE;
+		}
+		if(session->media.on_hold && session->media.hold_audio_dir != JANUS_SDP_RECVONLY) {
+			/* Dropping video packet, the call is on hold and we're not receiving anything */
+			session->media.stats.dropped++;
+			return TRUE;
+		}
+		janus_rtp_header *header = (janus_rtp_header *)buffer;
+		if(session->media.audio_ssrc_peer == 0) {
+			session->media.audio_ssrc_peer = ntohl(header->ssrc);
+			JANUS_LOG(LOG_VERB, "Got SIP peer audio SSRC: %"SCNu32"\n", session->media.audio_ssrc_peer);
+		}
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote_audio) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(session->media.audio_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				session->media.stats.srtp_errors++;
+				return TRUE;
+			}
+			bytes = buflen;
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, &session->media.acontext, FALSE, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(session->media.audio_ssrc_peer);
+		janus_recorder_save_frame(session->arc_peer, buffer, bytes);
+		/* Relay to application */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = FALSE, .buffer = buffer, .length = bytes };
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		/* Add audio-level extension, if present */
+		if(session->media.audio_level_extension_id != -1) {
+			gboolean vad = FALSE;
+			int level = -1;
+			if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
+					session->media.audio_level_extension_id, &vad, &level) == 0) {
+				rtp.extensions.audio_level = level;
+				rtp.extensions.audio_level_vad = vad;
+			}
+		}
+		gateway->relay_rtp(session->handle, &rtp);
+		return TRUE;
+	} else if(session->media.audio_rtcp_fd != -1 && fd == session->media.audio_rtcp_fd) {
+		/* Got something audio (RTCP) */
+		if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
+			/* Failed to read or not an RTCP packet? */
+			return FALSE;
+		}
+		session->media.stats.packets_in++;
+		session->media.stats.bytes_in += bytes;
+		if(!session->media.video_recv) {
+			/* Dropping video packet, we weren't expecting anything */
+			session->media.stats.dropped++;
+			return TRUE;
+		}
+		if(session->media.on_hold && session->media.hold_video_dir != JANUS_SDP_RECVONLY) {
+			/* Dropping video packet, the call is on hold and we're not receiving anything */
+			session->media.stats.dropped++;
+			return TRUE;
+		}
+		/* Is this SRTCP? */
+		if(session->media.has_srtp_remote_audio) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(session->media.audio_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTCP unprotect error: %s (len=%d-->%d)\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen);
+				session->media.stats.srtp_errors++;
+				return TRUE;
+			}
+			bytes = buflen;
+		}
+		/* Relay to application */
+		janus_plugin_rtcp rtcp = { .mindex = -1, .video = FALSE, .buffer = buffer, bytes };
+		gateway->relay_rtcp(session->handle, &rtcp);
+		return TRUE;
+	} else if(session->media.video_rtp_fd != -1 && fd == session->media.video_rtp_fd) {
+		/* Got something video (RTP) */
+		if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
+			/* Failed to read or not an RTP packet? */
+			return FALSE;
+		}
+		session->media.stats.packets_in++;
+		session->media.stats.bytes_in += bytes;
+		janus_rtp_header *header = (janus_rtp_header *)buffer;
+		if(session->media.video_ssrc_peer == 0) {
+			session->media.video_ssrc_peer = ntohl(header->ssrc);
+			JANUS_LOG(LOG_VERB, "Got SIP peer video SSRC: %"SCNu32"\n", session->media.video_ssrc_peer);
+		}
+		/* Is this SRTP? */
+		if(session->media.has_srtp_remote_video) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect(session->media.video_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				guint32 timestamp = ntohl(header->timestamp);
+				guint16 seq = ntohs(header->seq_number);
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+				session->media.stats.srtp_errors++;
+				return TRUE;
+			}
+			bytes = buflen;
+		}
+		/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
+		janus_rtp_header_update(header, &session->media.vcontext, TRUE, 0);
+		/* Save the frame if we're recording */
+		header->ssrc = htonl(session->media.video_ssrc_peer);
+		janus_recorder_save_frame(session->vrc_peer, buffer, bytes);
+		/* Relay to application */
+		janus_plugin_rtp rtp = { .mindex = -1, .video = TRUE, .buffer = buffer, .length = bytes };
+		janus_plugin_rtp_extensions_reset(&rtp.extensions);
+		/* Add video-orientation extension, if present */
+		if(session->media.video_orientation_extension_id > 0) {
+			gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+			if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
+					session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
+				rtp.extensions.video_rotation = 0;
+				if(r1 && r0)
+					rtp.extensions.video_rotation = 270;
+				else if(r1)
+					rtp.extensions.video_rotation = 180;
+				else if(r0)
+					rtp.extensions.video_rotation = 90;
+				rtp.extensions.video_back_camera = c;
+				rtp.extensions.video_flipped = f;
+			}
+		}
+		gateway->relay_rtp(session->handle, &rtp);
+		return TRUE;
+	} else if(session->media.video_rtcp_fd != -1 && fd == session->media.video_rtcp_fd) {
+		/* Got something video (RTCP) */
+		if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
+			/* Failed to read or not an RTCP packet? */
+			return FALSE;
+		}
+		session->media.stats.packets_in++;
+		session->media.stats.bytes_in += bytes;
+		/* Is this SRTCP? */
+		if(session->media.has_srtp_remote_video) {
+			int buflen = bytes;
+			srtp_err_status_t res = srtp_unprotect_rtcp(session->media.video_srtp_in, buffer, &buflen);
+			if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+				JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d)\n",
+					session->account.username, janus_srtp_error_str(res), bytes, buflen);
+				session->media.stats.srtp_errors++;
+				return TRUE;
+			}
+			bytes = buflen;
+		}
+		/* Relay to application */
+		janus_plugin_rtcp rtcp = { .mindex = -1, .video = TRUE, .buffer = buffer, bytes };
+		gateway->relay_rtcp(session->handle, &rtcp);
+		return TRUE;
+	}
+	return FALSE;
+}
+
 /* Thread to relay RTP/RTCP frames coming from the SIP peer */
 static void *janus_sip_relay_thread(void *data) {
 	janus_sip_session *session = (janus_sip_session *)data;
@@ -6936,13 +7481,9 @@ static void *janus_sip_relay_thread(void *data) {
 		return NULL;
 	}
 	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_in remote;
-	int resfd = 0, bytes = 0, pollerrs = 0;
+	int resfd = 0, pollerrs = 0;
 	struct pollfd fds[5];
 	int pipe_fd = session->media.pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
 	if(pipe_fd == -1) {
 		/* If the pipe file descriptor doesn't exist, it means we're done already,
 		 * and/or we may never be notified about sessions being closed, so give up */
@@ -6951,13 +7492,12 @@ static void *janus_sip_relay_thread(void *data) {
 		g_thread_unref(g_thread_self());
 		return NULL;
 	}
+	janus_sip_recv_batch *batch = g_malloc0(sizeof(janus_sip_recv_batch));
 	/* Loop */
 	int num = 0;
 	gboolean goon = TRUE;
 
 	session->media.updated = TRUE; /* Connect UDP sockets upon loop entry */
-	gboolean have_audio_server_ip = TRUE;
-	gboolean have_video_server_ip = TRUE;
 
 	while(goon && session != NULL && !g_atomic_int_get(&session->destroyed) &&
 			session->status > janus_sip_call_status_idle &&
@@ -6965,55 +7505,7 @@ static void *janus_sip_relay_thread(void *data) {
 
 		if(session->media.updated) {
 			/* Apparently there was a session update, or the loop has just been entered */
-			session->media.updated = FALSE;
-
-			/* Resolve the addresses, if needed */
-			have_audio_server_ip = FALSE;
-			have_video_server_ip = FALSE;
-			struct sockaddr_storage audio_server_addr = { 0 }, video_server_addr = { 0 };
-			if(session->media.remote_audio_ip && strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_audio_ip, &audio_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve audio address '%s'\n",
-						session->account.username, session->media.remote_audio_ip);
-				} else {
-					/* Address resolved */
-					have_audio_server_ip = TRUE;
-				}
-			}
-			if(session->media.remote_video_ip && strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				if(janus_network_resolve_address(session->media.remote_video_ip, &video_server_addr) < 0) {
-					JANUS_LOG(LOG_ERR, "[SIP-%s] Couldn't resolve video address '%s'\n",
-						session->account.username, session->media.remote_video_ip);
-				} else {
-					/* Address resolved */
-					have_video_server_ip = TRUE;
-				}
-			}
-
-			if(have_audio_server_ip || have_video_server_ip) {
-				janus_sip_connect_sockets(session, have_audio_server_ip ? &audio_server_addr : NULL,
-					have_video_server_ip ? &video_server_addr : NULL);
-			} else if(session->media.remote_audio_ip == NULL && session->media.remote_video_ip == NULL) {
-				JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: both audio and video remote IP addresses are NULL\n",
-					session->account.username);
-			} else {
-				if(session->media.remote_audio_ip)
-					JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: audio remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_audio_ip);
-				if(session->media.remote_video_ip)
-					JANUS_LOG(LOG_ERR, "[SIP-%p] Couldn't update session details: video remote IP address (%s) is invalid\n",
-						session->account.username, session->media.remote_video_ip);
-			}
-
-			/* In case we're on hold (remote address is 0.0.0.0) set the send properties to FALSE */
-			if(have_audio_server_ip && !strcmp(session->media.remote_audio_ip, "0.0.0.0")) {
-				session->media.audio_send = FALSE;
-				session->media.audio_recv = FALSE;
-			}
-			if(have_video_server_ip && !strcmp(session->media.remote_video_ip, "0.0.0.0")) {
-				session->media.video_send = FALSE;
-				session->media.video_recv = FALSE;
-			}
+			janus_sip_relay_update(session);
 		}
 
 		/* Prepare poll */
@@ -7070,49 +7562,15 @@ static void *janus_sip_relay_thread(void *data) {
 				session->status <= janus_sip_call_status_idle ||
 				session->status >= janus_sip_call_status_closing)
 			break;
-		int i = 0;
+		int i = 0, j = 0;
 		for(i=0; i<num; i++) {
 			if(fds[i].revents & (POLLERR | POLLHUP)) {
 				/* If we just updated the session, let's wait until things have calmed down */
 				if(session->media.updated)
 					break;
-				/* Check the socket error */
-				int error = 0;
-				socklen_t errlen = sizeof(error);
-				getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen);
-				if(error == 0) {
-					/* Maybe not a breaking error after all? */
-					continue;
-				} else if(error == 111) {
-					/* ICMP error? If it's related to RTCP, let's just close the RTCP socket and move on */
-					if(fds[i].fd == session->media.audio_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the audio RTCP socket, closing it\n",
-							session->account.username, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.audio_rtcp_fd);
-						session->media.audio_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-						continue;
-					} else if(fds[i].fd == session->media.video_rtcp_fd) {
-						JANUS_LOG(LOG_WARN, "[SIP-%s] Got a '%s' on the video RTCP socket, closing it\n",
-							session->account.username, g_strerror(error));
-						janus_mutex_lock(&session->mutex);
-						close(session->media.video_rtcp_fd);
-						session->media.video_rtcp_fd = -1;
-						janus_mutex_unlock(&session->mutex);
-						continue;
-					}
-				}
-				/* FIXME Should we be more tolerant of ICMP errors on RTP sockets as well? */
-				pollerrs++;
-				if(pollerrs < 100)
+				if(janus_sip_relay_error(session, fds[i].fd, &pollerrs, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP"))
 					continue;
-				JANUS_LOG(LOG_ERR, "[SIP-%s] Too many errors polling %d (socket #%d): %s...\n", session->account.username,
-					fds[i].fd, i, fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP");
-				JANUS_LOG(LOG_ERR, "[SIP-%s]   -- %d (%s)\n", session->account.username, error, g_strerror(error));
 				goon = FALSE;	/* Can we assume it's pretty much over, after a POLLERR? */
-				/* FIXME Simulate a "hangup" coming from the application */
-				janus_sip_hangup_media(session->handle);
 				break;
 			} else if(fds[i].revents & POLLIN) {
 				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
@@ -7121,175 +7579,16 @@ static void *janus_sip_relay_thread(void *data) {
 					(void)read(pipe_fd, &code, sizeof(int));
 					break;
 				}
-				/* Got an RTP/RTCP packet */
-				if(session->media.audio_rtp_fd != -1 && fds[i].fd == session->media.audio_rtp_fd) {
-					/* Got something audio (RTP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.audio_rtp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					if(!session->media.audio_recv) {
-						/* Dropping audio packet, we weren't expecting anything */
-						continue;
-					}
-					if(session->media.on_hold && session->media.hold_audio_dir != JANUS_SDP_RECVONLY) {
-						/* Dropping video packet, the call is on hold and we're not receiving anything */
-						continue;
-					}
-					janus_rtp_header *header = (janus_rtp_header *)buffer;
-					if(session->media.audio_ssrc_peer == 0) {
-						session->media.audio_ssrc_peer = ntohl(header->ssrc);
-						JANUS_LOG(LOG_VERB, "Got SIP peer audio SSRC: %"SCNu32"\n", session->media.audio_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote_audio) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(session->media.audio_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, &session->media.acontext, FALSE, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(session->media.audio_ssrc_peer);
-					janus_recorder_save_frame(session->arc_peer, buffer, bytes);
-					/* Relay to application */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = FALSE, .buffer = buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					/* Add audio-level extension, if present */
-					if(session->media.audio_level_extension_id != -1) {
-						gboolean vad = FALSE;
-						int level = -1;
-						if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-								session->media.audio_level_extension_id, &vad, &level) == 0) {
-							rtp.extensions.audio_level = level;
-							rtp.extensions.audio_level_vad = vad;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else if(session->media.audio_rtcp_fd != -1 && fds[i].fd == session->media.audio_rtcp_fd) {
-					/* Got something audio (RTCP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.audio_rtcp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
-						/* Failed to read or not an RTCP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					if(!session->media.video_recv) {
-						/* Dropping video packet, we weren't expecting anything */
-						continue;
-					}
-					if(session->media.on_hold && session->media.hold_video_dir != JANUS_SDP_RECVONLY) {
-						/* Dropping video packet, the call is on hold and we're not receiving anything */
-						continue;
-					}
-					/* Is this SRTCP? */
-					if(session->media.has_srtp_remote_audio) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(session->media.audio_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Audio SRTCP unprotect error: %s (len=%d-->%d)\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to application */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = FALSE, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
-				} else if(session->media.video_rtp_fd != -1 && fds[i].fd == session->media.video_rtp_fd) {
-					/* Got something video (RTP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.video_rtp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					janus_rtp_header *header = (janus_rtp_header *)buffer;
-					if(session->media.video_ssrc_peer == 0) {
-						session->media.video_ssrc_peer = ntohl(header->ssrc);
-						JANUS_LOG(LOG_VERB, "Got SIP peer video SSRC: %"SCNu32"\n", session->media.video_ssrc_peer);
-					}
-					/* Is this SRTP? */
-					if(session->media.has_srtp_remote_video) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(session->media.video_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Check if the SSRC changed (e.g., after a re-INVITE or UPDATE) */
-					janus_rtp_header_update(header, &session->media.vcontext, TRUE, 0);
-					/* Save the frame if we're recording */
-					header->ssrc = htonl(session->media.video_ssrc_peer);
-					janus_recorder_save_frame(session->vrc_peer, buffer, bytes);
-					/* Relay to application */
-					janus_plugin_rtp rtp = { .mindex = -1, .video = TRUE, .buffer = buffer, .length = bytes };
-					janus_plugin_rtp_extensions_reset(&rtp.extensions);
-					/* Add video-orientation extension, if present */
-					if(session->media.video_orientation_extension_id > 0) {
-						gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-						if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-								session->media.video_orientation_extension_id, &c, &f, &r1, &r0) == 0) {
-							rtp.extensions.video_rotation = 0;
-							if(r1 && r0)
-								rtp.extensions.video_rotation = 270;
-							else if(r1)
-								rtp.extensions.video_rotation = 180;
-							else if(r0)
-								rtp.extensions.video_rotation = 90;
-							rtp.extensions.video_back_camera = c;
-							rtp.extensions.video_flipped = f;
-						}
-					}
-					gateway->relay_rtp(session->handle, &rtp);
-					continue;
-				} else if(session->media.video_rtcp_fd != -1 && fds[i].fd == session->media.video_rtcp_fd) {
-					/* Got something video (RTCP) */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(session->media.video_rtcp_fd, buffer, 1500, 0, (struct sockaddr*)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtcp(buffer, bytes)) {
-						/* Failed to read or not an RTCP packet? */
-						continue;
-					}
-					pollerrs = 0;
-					/* Is this SRTCP? */
-					if(session->media.has_srtp_remote_video) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect_rtcp(session->media.video_srtp_in, buffer, &buflen);
-						if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-							JANUS_LOG(LOG_ERR, "[SIP-%s] Video SRTP unprotect error: %s (len=%d-->%d)\n",
-								session->account.username, janus_srtp_error_str(res), bytes, buflen);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* Relay to application */
-					janus_plugin_rtcp rtcp = { .mindex = -1, .video = TRUE, .buffer = buffer, bytes };
-					gateway->relay_rtcp(session->handle, &rtcp);
-					continue;
+				/* Got one or more RTP/RTCP packets */
+				int got = janus_sip_recv_batch_read(batch, fds[i].fd);
+				for(j=0; j<got; j++) {
+					if(janus_sip_relay_incoming(session, fds[i].fd, batch->data[j], batch->length[j]))
+						pollerrs = 0;
 				}
 			}
 		}
 	}
+	g_free(batch);
 	/* Cleanup the media session */
 	janus_mutex_lock(&session->mutex);
 	janus_sip_media_cleanup(session);
@@ -7302,6 +7601,286 @@ static void *janus_sip_relay_thread(void *data) {
 	return NULL;
 }
 
+#ifdef HAVE_EPOLL
+/* Reactor threads for the media of calls */
+static janus_sip_reactor **reactors = NULL;
+/* Socket a reactor is monitoring */
+typedef struct janus_sip_reactor_fd {
+	struct janus_sip_reactor_call *rc;
+	int fd;
+} janus_sip_reactor_fd;
+/* Call a reactor is serving: a session update may add new sockets, and an
+ * RTCP socket may be closed, so we keep track of the ones we're monitoring */
+#define JANUS_SIP_REACTOR_PIPE	4
+typedef struct janus_sip_reactor_call {
+	janus_sip_session *session;
+	janus_sip_reactor_fd fds[5];	/* Audio RTP/RTCP, video RTP/RTCP, and the pipe */
+	int pollerrs;
+	gboolean removed;
+} janus_sip_reactor_call;
+
+/* Helper to monitor the sockets the call is currently using: must be called with the reactor mutex locked */
+static void janus_sip_reactor_sync(janus_sip_reactor *reactor, janus_sip_reactor_call *rc) {
+	janus_sip_session *session = rc->session;
+	janus_mutex_lock(&session->mutex);
+	int fds[5] = {
+		session->media.audio_rtp_fd, session->media.audio_rtcp_fd,
+		session->media.video_rtp_fd, session->media.video_rtcp_fd,
+		session->media.pipefd[0]
+	};
+	janus_mutex_unlock(&session->mutex);
+	int i = 0;
+	for(i=0; i<5; i++) {
+		if(fds[i] <= 0)
+			fds[i] = -1;
+		if(rc->fds[i].fd == fds[i])
+			continue;
+		/* If a socket we were monitoring changed, it was closed, which
+		 * means epoll stopped monitoring it already: since its number may
+		 * have been reused in the meanwhile, we don't try to remove it */
+		rc->fds[i].fd = fds[i];
+		if(fds[i] == -1)
+			continue;
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN;
+		event.data.ptr = &rc->fds[i];
+		if(epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fds[i], &event) < 0) {
+			JANUS_LOG(LOG_WARN, "[SIP-%s] Error adding socket %d to reactor thread #%u... %d (%s)\n",
+				session->account.username, fds[i], reactor->id, errno, g_strerror(errno));
+			rc->fds[i].fd = -1;
+		}
+	}
+}
+
+/* Helper to stop serving a call: must only be called by the reactor thread */
+static void janus_sip_reactor_remove(janus_sip_reactor *reactor, janus_sip_reactor_call *rc) {
+	if(rc->removed)
+		return;
+	rc->removed = TRUE;
+	janus_sip_session *session = rc->session;
+	int i = 0;
+	for(i=0; i<5; i++) {
+		if(rc->fds[i].fd != -1)
+			epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rc->fds[i].fd, NULL);
+	}
+	/* Cleanup the media session */
+	janus_mutex_lock(&session->mutex);
+	janus_sip_media_cleanup(session);
+	janus_mutex_unlock(&session->mutex);
+	janus_mutex_lock(&reactor->mutex);
+	reactor->calls = g_list_remove(reactor->calls, rc);
+	reactor->count--;
+	session->reactor = NULL;
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_VERB, "[SIP-%s] Call removed from reactor thread #%u\n", session->account.username, reactor->id);
+	janus_refcount_decrease(&session->ref);
+}
+
+/* Helper to check if a call is over */
+static gboolean janus_sip_reactor_call_gone(janus_sip_reactor_call *rc) {
+	janus_sip_session *session = rc->session;
+	return (g_atomic_int_get(&session->destroyed) ||
+		session->status <= janus_sip_call_status_idle ||
+		session->status >= janus_sip_call_status_closing ||
+		session->media.pipefd[0] == -1);
+}
+
+/* Reactor thread */
+#define JANUS_SIP_REACTOR_EVENTS	64
+static void *janus_sip_reactor_thread(void *data) {
+	janus_sip_reactor *reactor = (janus_sip_reactor *)data;
+	JANUS_LOG(LOG_VERB, "Starting SIP reactor thread #%u\n", reactor->id);
+	struct epoll_event events[JANUS_SIP_REACTOR_EVENTS];
+	janus_sip_recv_batch *batch = g_malloc0(sizeof(janus_sip_recv_batch));
+	GList *removed = NULL, *calls = NULL, *cl = NULL;
+	gint64 now = 0, check = janus_get_monotonic_time();
+	int num = 0, i = 0, j = 0;
+	while(!g_atomic_int_get(&reactor->stop)) {
+		num = epoll_wait(reactor->epfd, events, JANUS_SIP_REACTOR_EVENTS, 500);
+		if(num < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "[reactor #%u] Error polling... %d (%s)\n", reactor->id, errno, g_strerror(errno));
+			break;
+		}
+		for(i=0; i<num; i++) {
+			janus_sip_reactor_fd *rfd = (janus_sip_reactor_fd *)events[i].data.ptr;
+			janus_sip_reactor_call *rc = rfd->rc;
+			if(rc->removed || rfd->fd == -1)
+				continue;
+			janus_sip_session *session = rc->session;
+			if(janus_sip_reactor_call_gone(rc)) {
+				janus_sip_reactor_remove(reactor, rc);
+				removed = g_list_prepend(removed, rc);
+				continue;
+			}
+			if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+				/* If we just updated the session, let's wait until things have calmed down */
+				if(session->media.updated)
+					continue;
+				if(!janus_sip_relay_error(session, rfd->fd, &rc->pollerrs, events[i].events & EPOLLERR ? "EPOLLERR" : "EPOLLHUP")) {
+					janus_sip_reactor_remove(reactor, rc);
+					removed = g_list_prepend(removed, rc);
+					continue;
+				}
+				/* We may have closed an RTCP socket */
+				janus_mutex_lock(&reactor->mutex);
+				janus_sip_reactor_sync(reactor, rc);
+				janus_mutex_unlock(&reactor->mutex);
+			} else if(events[i].events & EPOLLIN) {
+				if(rfd == &rc->fds[JANUS_SIP_REACTOR_PIPE]) {
+					/* We've been woken up for a reason, most likely a session update */
+					int code = 0;
+					(void)read(rfd->fd, &code, sizeof(int));
+					if(session->media.updated)
+						janus_sip_relay_update(session);
+					janus_mutex_lock(&reactor->mutex);
+					janus_sip_reactor_sync(reactor, rc);
+					janus_mutex_unlock(&reactor->mutex);
+					continue;
+				}
+				/* Got one or more RTP/RTCP packets */
+				int got = janus_sip_recv_batch_read(batch, rfd->fd);
+				for(j=0; j<got; j++) {
+					if(janus_sip_relay_incoming(session, rfd->fd, batch->data[j], batch->length[j]))
+						rc->pollerrs = 0;
+				}
+			}
+		}
+		/* Periodically check if any call ended, or was updated, without us being woken up */
+		now = janus_get_monotonic_time();
+		if(now - check >= 500000) {
+			check = now;
+			janus_mutex_lock(&reactor->mutex);
+			calls = g_list_copy(reactor->calls);
+			janus_mutex_unlock(&reactor->mutex);
+			for(cl = calls; cl != NULL; cl = cl->next) {
+				janus_sip_reactor_call *rc = (janus_sip_reactor_call *)cl->data;
+				if(janus_sip_reactor_call_gone(rc)) {
+					janus_sip_reactor_remove(reactor, rc);
+					removed = g_list_prepend(removed, rc);
+					continue;
+				}
+				if(rc->session->media.updated)
+					janus_sip_relay_update(rc->session);
+				janus_mutex_lock(&reactor->mutex);
+				janus_sip_reactor_sync(reactor, rc);
+				janus_mutex_unlock(&reactor->mutex);
+			}
+			g_list_free(calls);
+			calls = NULL;
+		}
+		/* We can only free the calls we removed once we're done with the events */
+		if(removed != NULL) {
+			g_list_free_full(removed, (GDestroyNotify)g_free);
+			removed = NULL;
+		}
+	}
+	/* Let go of the calls we're still serving, if any */
+	janus_mutex_lock(&reactor->mutex);
+	while(reactor->calls != NULL) {
+		janus_sip_reactor_call *rc = (janus_sip_reactor_call *)reactor->calls->data;
+		janus_mutex_unlock(&reactor->mutex);
+		janus_sip_reactor_remove(reactor, rc);
+		g_free(rc);
+		janus_mutex_lock(&reactor->mutex);
+	}
+	janus_mutex_unlock(&reactor->mutex);
+	g_free(batch);
+	JANUS_LOG(LOG_VERB, "Leaving SIP reactor thread #%u\n", reactor->id);
+	return NULL;
+}
+
+static void janus_sip_reactors_start(int num) {
+	reactors = g_malloc0((num+1) * sizeof(janus_sip_reactor *));
+	char tname[16];
+	int i = 0, started = 0;
+	for(i=0; i<num; i++) {
+		janus_sip_reactor *reactor = g_malloc0(sizeof(janus_sip_reactor));
+		reactor->id = i+1;
+		reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(reactor->epfd < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating epoll instance for reactor thread #%u... %d (%s)\n",
+				reactor->id, errno, g_strerror(errno));
+			g_free(reactor);
+			continue;
+		}
+		janus_mutex_init(&reactor->mutex);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "siprtp %u", reactor->id);
+		reactor->thread = g_thread_try_new(tname, &janus_sip_reactor_thread, reactor, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the reactor thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			close(reactor->epfd);
+			janus_mutex_destroy(&reactor->mutex);
+			g_free(reactor);
+			continue;
+		}
+		reactors[started++] = reactor;
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any reactor thread, using a thread per call\n");
+		g_free(reactors);
+		reactors = NULL;
+		reactor_threads = 0;
+		return;
+	}
+	reactor_threads = started;
+	JANUS_LOG(LOG_INFO, "Using %d reactor threads for the media of calls\n", reactor_threads);
+}
+
+static void janus_sip_reactors_stop(void) {
+	if(reactors == NULL)
+		return;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		janus_sip_reactor *reactor = reactors[i];
+		g_atomic_int_set(&reactor->stop, 1);
+		g_thread_join(reactor->thread);
+		close(reactor->epfd);
+		janus_mutex_destroy(&reactor->mutex);
+		g_free(reactor);
+	}
+	g_free(reactors);
+	reactors = NULL;
+	reactor_threads = 0;
+}
+
+/* Helper to have a reactor thread relay the media of a call, instead of a
+ * dedicated thread: the caller must have taken the reference the reactor
+ * will release when done, and keeps it if this fails */
+static int janus_sip_reactor_add(janus_sip_session *session) {
+	if(reactors == NULL || !session->account.username || !session->callee || session->media.pipefd[0] == -1)
+		return -1;
+	/* Pick the reactor serving the fewest calls */
+	janus_sip_reactor *reactor = NULL;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		if(reactor == NULL || reactors[i]->count < reactor->count)
+			reactor = reactors[i];
+	}
+	janus_sip_reactor_call *rc = g_malloc0(sizeof(janus_sip_reactor_call));
+	rc->session = session;
+	for(i=0; i<5; i++) {
+		rc->fds[i].rc = rc;
+		rc->fds[i].fd = -1;
+	}
+	/* Connect the sockets right away, as the relay thread would do */
+	janus_sip_relay_update(session);
+	janus_mutex_lock(&reactor->mutex);
+	session->reactor = reactor;
+	reactor->calls = g_list_append(reactor->calls, rc);
+	reactor->count++;
+	janus_sip_reactor_sync(reactor, rc);
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_VERB, "[SIP-%s] Relaying media of the call (%s <--> %s) on reactor thread #%u\n",
+		session->account.username, session->account.username, session->callee, reactor->id);
+	return 0;
+}
+#endif
+
 
 /* Sofia Event thread */
 gpointer janus_sip_sofia_thread(gpointer user_data) {
@@ -7392,6 +7971,480 @@ gpointer janus_sip_sofia_thread(gpointer user_data) {
 	return NULL;
 }
 
+/* Helper to release the references a session still has for ongoing calls,
+ * when no more events for them will be received */
+static void janus_sip_drop_active_calls(janus_sip_session *session) {
+	janus_mutex_lock(&session->mutex);
+	while(session->active_calls) {
+		janus_sip_session *s = (janus_sip_session *)session->active_calls->data;
+		if(s != NULL) {
+			JANUS_LOG(LOG_VERB, "[%p] Removing reference\n", s);
+			janus_refcount_decrease(&s->ref);
+		}
+		session->active_calls = g_list_remove(session->active_calls, s);
+	}
+	janus_mutex_unlock(&session->mutex);
+}
+
+/* Helper to create a NUA handle for a session: on shared stacks, the
+ * username and User-Agent of the account are handle parameters instead */
+static nua_handle_t *janus_sip_nua_handle(janus_sip_session *session, nua_t *nua) {
+	gboolean shared = (session->stack != NULL && session->stack->shared != NULL);
+	janus_sip_account *account = (session->helper && session->master) ? &session->master->account : &session->account;
+	return nua_handle(nua, session,
+		TAG_IF(shared, NUTAG_M_USERNAME(account->username)),
+		TAG_IF(shared, SIPTAG_USER_AGENT_STR(account->user_agent ? account->user_agent : user_agent)),
+		TAG_END());
+}
+
+/* Helper to send a REGISTER */
+static void janus_sip_register_send(janus_sip_register *reg) {
+	nua_register(reg->nh,
+		NUTAG_M_USERNAME(reg->authuser),
+		NUTAG_M_DISPLAY(reg->display_name),
+		SIPTAG_FROM_STR(reg->identity),
+		SIPTAG_TO_STR(reg->identity),
+		TAG_IF(reg->headers != NULL && strlen(reg->headers) > 0, SIPTAG_HEADER_STR(reg->headers)),
+		TAG_IF(reg->params != NULL && strlen(reg->params) > 0, NUTAG_M_PARAMS(reg->params)),
+		SIPTAG_EXPIRES_STR(reg->expires),
+		NUTAG_REGISTRAR(reg->registrar),
+		NUTAG_PROXY(reg->proxy),
+		TAG_END());
+	if(reg->session->stack != NULL && reg->session->stack->shared != NULL)
+		g_atomic_int_inc(&reg->session->stack->shared->registers_sent);
+}
+
+static void janus_sip_register_free(janus_sip_register *reg) {
+	if(reg == NULL)
+		return;
+	nua_handle_unref(reg->nh);
+	janus_refcount_decrease(&reg->session->ref);
+	g_free(reg->authuser);
+	g_free(reg->display_name);
+	g_free(reg->identity);
+	g_free(reg->headers);
+	g_free(reg->params);
+	g_free(reg->expires);
+	g_free(reg->registrar);
+	g_free(reg->proxy);
+	g_free(reg);
+}
+
+/* Helper to queue a REGISTER on a shared stack: its timer will send it
+ * as soon as the configured rate allows, without waiting for the responses
+ * to the REGISTERs that were sent before */
+static void janus_sip_stack_queue_register(janus_sip_sofia_stack *stack, janus_sip_register *reg) {
+	janus_sip_register *queued = g_malloc0(sizeof(janus_sip_register));
+	janus_refcount_increase(&reg->session->ref);
+	queued->session = reg->session;
+	queued->nh = nua_handle_ref(reg->nh);
+	queued->authuser = g_strdup(reg->authuser);
+	queued->display_name = g_strdup(reg->display_name);
+	queued->identity = g_strdup(reg->identity);
+	queued->headers = g_strdup(reg->headers);
+	queued->params = g_strdup(reg->params);
+	queued->expires = g_strdup(reg->expires);
+	queued->registrar = g_strdup(reg->registrar);
+	queued->proxy = g_strdup(reg->proxy);
+	janus_mutex_lock(&stack->mutex);
+	g_queue_push_tail(stack->registers, queued);
+	if(g_queue_get_length(stack->registers) > stack->max_queued)
+		stack->max_queued = g_queue_get_length(stack->registers);
+	janus_mutex_unlock(&stack->mutex);
+}
+
+/* Helper to add the username to the Contact of a shared stack, which has none */
+static char *janus_sip_stack_contact(const char *contact, const char *username) {
+	if(contact == NULL || username == NULL)
+		return NULL;
+	const char *uri = strstr(contact, "sip:");
+	size_t scheme = 4;
+	const char *sips = strstr(contact, "sips:");
+	if(sips != NULL && (uri == NULL || sips < uri)) {
+		uri = sips;
+		scheme = 5;
+	}
+	if(uri == NULL || strchr(uri, '@') != NULL)
+		return g_strdup(contact);
+	return g_strdup_printf("%.*s%s@%s", (int)(uri - contact + scheme), contact, username, uri + scheme);
+}
+
+/* Helper to have the least loaded shared stack serve a session: as incoming
+ * requests are routed by username, a stack can only serve one session for
+ * each username, and if no stack can we return an error and the session
+ * will get a Sofia thread of its own instead */
+static int janus_sip_stack_attach(janus_sip_session *session) {
+	if(stacks == NULL || session->account.username == NULL)
+		return -1;
+	janus_sip_sofia_stack *stack = NULL;
+	guint load = 0;
+	int i = 0;
+	for(i=0; stacks[i] != NULL; i++) {
+		janus_mutex_lock(&stacks[i]->mutex);
+		if(stacks[i]->s_nua != NULL && !g_hash_table_contains(stacks[i]->users, session->account.username) &&
+				(stack == NULL || g_hash_table_size(stacks[i]->users) < load)) {
+			stack = stacks[i];
+			load = g_hash_table_size(stacks[i]->users);
+		}
+		janus_mutex_unlock(&stacks[i]->mutex);
+	}
+	if(stack == NULL) {
+		JANUS_LOG(LOG_WARN, "[SIP-%s] No shared Sofia stack can serve this session, using a dedicated one\n",
+			session->account.username);
+		return -1;
+	}
+	ssip_t *ssip = g_malloc0(sizeof(ssip_t));
+	su_home_init(ssip->s_home);
+	janus_mutex_init(&ssip->smutex);
+	ssip->session = session;
+	ssip->shared = stack;
+	ssip->user = g_strdup(session->account.username);
+	janus_mutex_lock(&stack->mutex);
+	if(stack->s_nua == NULL || g_hash_table_contains(stack->users, ssip->user)) {
+		/* Something changed in the meanwhile */
+		janus_mutex_unlock(&stack->mutex);
+		su_home_deinit(ssip->s_home);
+		g_free(ssip->user);
+		g_free(ssip);
+		return -1;
+	}
+	ssip->s_root = stack->s_root;
+	ssip->s_nua = stack->s_nua;
+	ssip->contact_header = janus_sip_stack_contact(stack->contact_header, ssip->user);
+	janus_refcount_increase(&session->ref);
+	g_hash_table_insert(stack->users, g_strdup(ssip->user), session);
+	janus_mutex_unlock(&stack->mutex);
+	session->stack = ssip;
+	JANUS_LOG(LOG_VERB, "[SIP-%s] Served by shared Sofia stack #%u\n", session->account.username, stack->id);
+	return 0;
+}
+
+/* Helper to update the username a shared stack knows a session as, after a new REGISTER */
+static void janus_sip_stack_rekey(janus_sip_session *session) {
+	ssip_t *ssip = session->stack;
+	janus_sip_sofia_stack *stack = ssip->shared;
+	if(session->account.username == NULL || (ssip->user && !strcmp(ssip->user, session->account.username)))
+		return;
+	janus_mutex_lock(&stack->mutex);
+	if(ssip->user != NULL && g_hash_table_lookup(stack->users, ssip->user) == session) {
+		janus_refcount_increase(&session->ref);
+		g_hash_table_remove(stack->users, ssip->user);
+		if(g_hash_table_contains(stack->users, session->account.username)) {
+			/* Another session is known by this username on this stack */
+			JANUS_LOG(LOG_WARN, "[SIP-%s] Username already served by shared Sofia stack #%u, incoming requests will go to the other session\n",
+				session->account.username, stack->id);
+			janus_refcount_decrease(&session->ref);
+		} else {
+			g_hash_table_insert(stack->users, g_strdup(session->account.username), session);
+		}
+	}
+	janus_mutex_lock(&ssip->smutex);
+	g_free(ssip->user);
+	ssip->user = g_strdup(session->account.username);
+	g_free(ssip->contact_header);
+	ssip->contact_header = janus_sip_stack_contact(stack->contact_header, ssip->user);
+	janus_mutex_unlock(&ssip->smutex);
+	janus_mutex_unlock(&stack->mutex);
+}
+
+/* Helper to detach a session that is going away from its shared stack:
+ * as handles must be destroyed by the thread of the stack, this is only
+ * queued here, and done by the stack timer */
+static void janus_sip_stack_detach(janus_sip_session *session) {
+	janus_sip_sofia_stack *stack = session->stack->shared;
+	janus_mutex_lock(&stack->mutex);
+	if(g_list_find(stack->detached, session) == NULL) {
+		janus_refcount_increase(&session->ref);
+		stack->detached = g_list_prepend(stack->detached, session);
+	}
+	janus_mutex_unlock(&stack->mutex);
+}
+
+/* Helper to destroy the handles of a session on a shared stack (stack thread only) */
+static void janus_sip_stack_release(janus_sip_session *session) {
+	ssip_t *ssip = session->stack;
+	janus_mutex_lock(&ssip->smutex);
+	ssip->s_nua = NULL;
+	ssip->s_root = NULL;
+	nua_handle_t *nh_r = ssip->s_nh_r, *nh_i = ssip->s_nh_i, *nh_m = ssip->s_nh_m;
+	ssip->s_nh_r = NULL;
+	ssip->s_nh_i = NULL;
+	ssip->s_nh_m = NULL;
+	GHashTable *subscriptions = ssip->subscriptions;
+	ssip->subscriptions = NULL;
+	janus_mutex_unlock(&ssip->smutex);
+	if(nh_r != NULL)
+		nua_handle_destroy(nh_r);
+	if(nh_i != NULL)
+		nua_handle_destroy(nh_i);
+	if(nh_m != NULL)
+		nua_handle_destroy(nh_m);
+	if(subscriptions != NULL)
+		g_hash_table_unref(subscriptions);
+	/* We won't get any more event for this session */
+	janus_sip_drop_active_calls(session);
+}
+
+/* Shared stack timer: detaches sessions that went away, and sends queued REGISTERs */
+static void janus_sip_stack_tick(su_root_magic_t *magic, su_timer_t *timer, su_timer_arg_t *arg) {
+	janus_sip_sofia_stack *stack = (janus_sip_sofia_stack *)arg;
+	GList *detached = NULL, *ready = NULL, *dropped = NULL, *temp = NULL;
+	janus_mutex_lock(&stack->mutex);
+	detached = stack->detached;
+	stack->detached = NULL;
+	for(temp = detached; temp != NULL; temp = temp->next) {
+		janus_sip_session *session = (janus_sip_session *)temp->data;
+		if(session->stack->user != NULL && g_hash_table_lookup(stack->users, session->stack->user) == session)
+			g_hash_table_remove(stack->users, session->stack->user);
+		/* Get rid of the REGISTERs for this session that are still queued */
+		GList *link = stack->registers->head;
+		while(link != NULL) {
+			GList *next = link->next;
+			janus_sip_register *reg = (janus_sip_register *)link->data;
+			if(reg->session == session) {
+				g_queue_delete_link(stack->registers, link);
+				dropped = g_list_prepend(dropped, reg);
+			}
+			link = next;
+		}
+	}
+	/* Check how many REGISTERs we can send now */
+	stack->credit += (gint64)register_rate * JANUS_SIP_SOFIA_STACK_TICK;
+	if(stack->credit > (gint64)register_rate * 1000)
+		stack->credit = (gint64)register_rate * 1000;
+	while(stack->credit >= 1000 && !g_queue_is_empty(stack->registers)) {
+		ready = g_list_prepend(ready, g_queue_pop_head(stack->registers));
+		stack->credit -= 1000;
+	}
+	janus_mutex_unlock(&stack->mutex);
+	g_list_free_full(dropped, (GDestroyNotify)janus_sip_register_free);
+	for(temp = detached; temp != NULL; temp = temp->next) {
+		janus_sip_session *session = (janus_sip_session *)temp->data;
+		janus_sip_stack_release(session);
+		janus_refcount_decrease(&session->ref);
+	}
+	g_list_free(detached);
+	ready = g_list_reverse(ready);
+	for(temp = ready; temp != NULL; temp = temp->next) {
+		janus_sip_register *reg = (janus_sip_register *)temp->data;
+		if(!g_atomic_int_get(&reg->session->destroyed))
+			janus_sip_register_send(reg);
+	}
+	g_list_free_full(ready, (GDestroyNotify)janus_sip_register_free);
+}
+
+/* Shared stack callback, for the events that are not tied to a session yet */
+static void janus_sip_stack_callback(janus_sip_sofia_stack *stack, nua_event_t event, int status, char const *phrase,
+		nua_t *nua, nua_magic_t *magic, nua_handle_t *nh, sip_t const *sip, tagi_t tags[]) {
+	switch(event) {
+		case nua_r_get_params: {
+			JANUS_LOG(LOG_VERB, "[SIP stack #%u][%s]: %d %s\n", stack->id, nua_event_name(event), status, phrase ? phrase : "??");
+			const tagi_t *from = NULL;
+			if((status != 200) || ((from = tl_find(tags, siptag_from_str)) == NULL)) {
+				JANUS_LOG(LOG_WARN, "Unable to find 'siptag_from_str' among all the tags\n");
+				break;
+			}
+			const char *from_value = (const char *)from->t_value;
+			if(from_value == NULL || strlen(from_value) < 2) {
+				JANUS_LOG(LOG_WARN, "Invalid 'siptag_from_str' value '%s'\n", from_value);
+				break;
+			}
+			JANUS_LOG(LOG_VERB, "'siptag_from_str': %s\n", from_value);
+			janus_mutex_lock(&stack->mutex);
+			g_free(stack->contact_header);
+			stack->contact_header = g_strdup(from_value);
+			/* Sessions that were attached before we got this need it too */
+			GHashTableIter iter;
+			gpointer value = NULL;
+			g_hash_table_iter_init(&iter, stack->users);
+			while(g_hash_table_iter_next(&iter, NULL, &value)) {
+				janus_sip_session *session = (janus_sip_session *)value;
+				janus_mutex_lock(&session->stack->smutex);
+				if(session->stack->contact_header == NULL)
+					session->stack->contact_header = janus_sip_stack_contact(stack->contact_header, session->stack->user);
+				janus_mutex_unlock(&session->stack->smutex);
+			}
+			janus_mutex_unlock(&stack->mutex);
+			break;
+		}
+		case nua_r_shutdown:
+			JANUS_LOG(LOG_VERB, "[SIP stack #%u][%s]: %d %s\n", stack->id, nua_event_name(event), status, phrase ? phrase : "??");
+			if(status >= 200)
+				su_root_break(stack->s_root);
+			break;
+		case nua_i_options:
+			/* The stack responds to these automatically */
+			JANUS_LOG(LOG_VERB, "[SIP stack #%u][%s]: %d %s\n", stack->id, nua_event_name(event), status, phrase ? phrase : "??");
+			break;
+		default: {
+			if(nh == NULL || sip == NULL || sip->sip_request == NULL) {
+				JANUS_LOG(LOG_VERB, "[SIP stack #%u][%s]: %d %s\n", stack->id, nua_event_name(event), status, phrase ? phrase : "??");
+				break;
+			}
+			/* A new incoming request: route it to the session it's addressed to */
+			const char *username = sip->sip_request->rq_url->url_user;
+			if(username == NULL && sip->sip_to != NULL)
+				username = sip->sip_to->a_url->url_user;
+			janus_sip_session *session = NULL;
+			janus_mutex_lock(&stack->mutex);
+			if(username != NULL)
+				session = g_hash_table_lookup(stack->users, username);
+			if(session != NULL)
+				janus_refcount_increase(&session->ref);
+			janus_mutex_unlock(&stack->mutex);
+			if(session == NULL || g_atomic_int_get(&session->destroyed)) {
+				JANUS_LOG(LOG_WARN, "[SIP stack #%u] Got %s for unknown user '%s', rejecting\n",
+					stack->id, nua_event_name(event), username ? username : "??");
+				nua_respond(nh, 404, sip_status_phrase(404), TAG_END());
+				nua_handle_destroy(nh);
+				if(session != NULL)
+					janus_refcount_decrease(&session->ref);
+				break;
+			}
+			nua_handle_bind(nh, session);
+			janus_sip_sofia_callback(event, status, phrase, nua, magic, nh, session, sip, tags);
+			janus_refcount_decrease(&session->ref);
+			break;
+		}
+	}
+}
+
+/* Shared Sofia stack thread */
+static void *janus_sip_stack_thread(void *data) {
+	janus_sip_sofia_stack *stack = (janus_sip_sofia_stack *)data;
+	JANUS_LOG(LOG_VERB, "Joining shared Sofia stack thread #%u\n", stack->id);
+	stack->s_root = su_root_create(NULL);
+	char sip_url[128];
+	char *ipv6 = strstr(local_ip, ":");
+	g_snprintf(sip_url, sizeof(sip_url), "sip:%s%s%s:*;transport=udp", ipv6 ? "[" : "", local_ip, ipv6 ? "]" : "");
+	char outbound_options[256] = "use-rport no-validate";
+	if(keepalive_interval > 0)
+		janus_strlcat(outbound_options, " options-keepalive", sizeof(outbound_options));
+	if(!behind_nat)
+		janus_strlcat(outbound_options, " no-natify", sizeof(outbound_options));
+	/* Account specific parameters, like the username, are set on the handles */
+	nua_t *s_nua = stack->s_root ? nua_create(stack->s_root,
+				janus_sip_sofia_callback,
+				(void *)stack,
+				SIPTAG_ALLOW_STR("INVITE, ACK, BYE, CANCEL, OPTIONS, UPDATE, REFER, MESSAGE, INFO, NOTIFY"),
+				NUTAG_URL(sip_url),
+				SIPTAG_USER_AGENT_STR(user_agent),
+				NUTAG_KEEPALIVE(keepalive_interval * 1000),	/* Sofia expects it in milliseconds */
+				NUTAG_OUTBOUND(outbound_options),
+				NUTAG_APPL_METHOD("REFER"),			/* We'll respond to incoming REFER messages ourselves */
+				SIPTAG_SUPPORTED_STR("replaces"),	/* Advertise that we support the Replaces header */
+				SIPTAG_SUPPORTED(NULL),
+				NTATAG_SIP_T1X64(sip_timer_t1x64),
+				TAG_NULL()) : NULL;
+	if(s_nua == NULL) {
+		JANUS_LOG(LOG_ERR, "Error creating the NUA of shared Sofia stack #%u\n", stack->id);
+		if(stack->s_root != NULL)
+			su_root_destroy(stack->s_root);
+		stack->s_root = NULL;
+		g_atomic_int_set(&stack->ready, -1);
+		return NULL;
+	}
+	if(query_contact_header)
+		nua_get_params(s_nua, SIPTAG_FROM_STR(""), TAG_END());
+	stack->timer = su_timer_create(su_root_task(stack->s_root), JANUS_SIP_SOFIA_STACK_TICK);
+	su_timer_set_for_ever(stack->timer, janus_sip_stack_tick, (su_timer_arg_t *)stack);
+	janus_mutex_lock(&stack->mutex);
+	stack->s_nua = s_nua;
+	janus_mutex_unlock(&stack->mutex);
+	g_atomic_int_set(&stack->ready, 1);
+	su_root_run(stack->s_root);
+	/* When we get here, we're done */
+	su_timer_destroy(stack->timer);
+	stack->timer = NULL;
+	janus_mutex_lock(&stack->mutex);
+	stack->s_nua = NULL;
+	GList *registers = NULL;
+	while(!g_queue_is_empty(stack->registers))
+		registers = g_list_prepend(registers, g_queue_pop_head(stack->registers));
+	GList *detached = stack->detached;
+	stack->detached = NULL;
+	janus_mutex_unlock(&stack->mutex);
+	g_list_free_full(registers, (GDestroyNotify)janus_sip_register_free);
+	g_list_free_full(detached, (GDestroyNotify)janus_sip_session_dereference);
+	nua_destroy(s_nua);
+	su_root_destroy(stack->s_root);
+	stack->s_root = NULL;
+	JANUS_LOG(LOG_VERB, "Leaving shared Sofia stack thread #%u\n", stack->id);
+	return NULL;
+}
+
+static void janus_sip_stacks_start(int num) {
+	stacks = g_malloc0((num+1) * sizeof(janus_sip_sofia_stack *));
+	int i = 0, started = 0;
+	char tname[16];
+	for(i=0; i<num; i++) {
+		janus_sip_sofia_stack *stack = g_malloc0(sizeof(janus_sip_sofia_stack));
+		stack->id = i+1;
+		stack->users = g_hash_table_new_full(g_str_hash, g_str_equal,
+			(GDestroyNotify)g_free, (GDestroyNotify)janus_sip_session_dereference);
+		stack->registers = g_queue_new();
+		janus_mutex_init(&stack->mutex);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "sip stack %u", stack->id);
+		stack->thread = g_thread_try_new(tname, &janus_sip_stack_thread, stack, &error);
+		if(error == NULL) {
+			/* Wait for the NUA to be created */
+			while(g_atomic_int_get(&stack->ready) == 0)
+				g_usleep(10000);
+			if(g_atomic_int_get(&stack->ready) > 0) {
+				stacks[started++] = stack;
+				continue;
+			}
+			g_thread_join(stack->thread);
+		} else {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the shared Sofia stack thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+		}
+		g_hash_table_destroy(stack->users);
+		g_queue_free(stack->registers);
+		janus_mutex_destroy(&stack->mutex);
+		g_free(stack);
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any shared Sofia stack, using a Sofia stack per session\n");
+		g_free(stacks);
+		stacks = NULL;
+		sofia_stacks = 0;
+		return;
+	}
+	sofia_stacks = started;
+	JANUS_LOG(LOG_INFO, "Using %d shared Sofia stacks for registered sessions (REGISTER rate: %s)\n",
+		sofia_stacks, register_rate > 0 ? "limited" : "unlimited");
+	if(register_rate > 0)
+		JANUS_LOG(LOG_INFO, "  -- Up to %d REGISTERs per second per stack\n", register_rate);
+}
+
+static void janus_sip_stacks_stop(void) {
+	if(stacks == NULL)
+		return;
+	int i = 0;
+	for(i=0; stacks[i] != NULL; i++) {
+		janus_sip_sofia_stack *stack = stacks[i];
+		janus_mutex_lock(&stack->mutex);
+		if(stack->s_nua != NULL)
+			nua_shutdown(stack->s_nua);
+		janus_mutex_unlock(&stack->mutex);
+		g_thread_join(stack->thread);
+	}
+	for(i=0; stacks[i] != NULL; i++) {
+		janus_sip_sofia_stack *stack = stacks[i];
+		g_hash_table_destroy(stack->users);
+		g_queue_free(stack->registers);
+		g_free(stack->contact_header);
+		janus_mutex_destroy(&stack->mutex);
+		g_free(stack);
+	}
+	g_free(stacks);
+	stacks = NULL;
+	sofia_stacks = 0;
+}
+
 /* Helper method to send an RTCP PLI to the SIP peer */
 static void janus_sip_rtcp_pli_send(janus_sip_session *session) {
 	if(!session || g_atomic_int_get(&session->destroyed)) {
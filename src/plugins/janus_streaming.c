@@ -73,6 +73,9 @@ metadata = An optional string that can contain any metadata (e.g., JSON)
 			associated with the stream you want users to receive
 is_private = true|false (private streams don't appear when you do a 'list' request)
 filename = path to the local file to stream (only for live/ondemand)
+sync_window = time window, in milliseconds, viewers of an ondemand mountpoint
+		that start watching within will share the same playout, rather than each having
+		their own (only for ondemand, default=0, independent playouts)
 secret = <optional password needed for manipulating (e.g., destroying
 		or enabling/disabling) the stream>
 pin = <optional password needed for watching the stream>
@@ -97,7 +100,9 @@ videopt = <video RTP payload type> (e.g., 100)
 videocodec = name of the video codec (vp8)
 videofmtp = Codec specific parameters, if any
 videobufferkf = true|false (whether the plugin should store the latest
-	keyframe and send it immediately for new viewers, EXPERIMENTAL)
+	keyframe and send it immediately for new viewers, EXPERIMENTAL; if
+	gop_cache_size is set in the general settings, the whole GOP since
+	the latest keyframe is stored and replayed instead)
 videosimulcast = true|false (do|don't enable video simulcasting)
 videoport2 = second local port for receiving video frames (only for rtp, and simulcasting)
 videoport3 = third local port for receiving video frames (only for rtp, and simulcasting)
@@ -144,6 +149,21 @@ subscriber can customize the playout delay of incoming video streams,
 assuming the browser supports the RTP extension in the first place.
 playoutdelay_ext = true
 
+RTP and RTSP mountpoints can also send what they receive to a multicast
+group, for receivers that don't need WebRTC (e.g., set-top boxes on a
+network that supports multicast): each packet is sent (and, if a shared
+SRTP key is configured, encrypted) only once, no matter how many receivers
+joined the group. Each stream is sent to a different port, starting from
+'mcast_out_port' and skipping one after each stream (e.g., 5002 and 5004
+for a mountpoint with two streams); simulcast streams only send the base
+substream, and data streams are not sent:
+mcast_out = IPv4 multicast group to send to
+mcast_out_port = base port to send to
+mcast_out_ttl = TTL of the multicast packets (default=1)
+mcast_out_iface = IPv4 address of the interface to send from, if any
+mcast_out_srtpsuite = 32|80, if the multicast output should be encrypted
+mcast_out_srtpcrypto = base64 encoded SRTP key to encrypt with, shared by all receivers
+
 The following options are only valid for the 'rtsp' type:
 url = RTSP stream URL
 rtsp_user = RTSP authorization username, if needed
@@ -160,6 +180,10 @@ rtsp_session_timeout = by default the streaming plugin will check the RTSP conne
 	formula: timeout = min(session_timeout, rtsp_session_timeout / 2). (default=0s)
 rtsp_timeout = communication timeout (CURLOPT_TIMEOUT) for cURL call gathering the RTSP information (default=10s)
 rtsp_conn_timeout = connection timeout for cURL (CURLOPT_CONNECTTIMEOUT) call gathering the RTSP information (default=5s)
+rtsp_lazy = whether the connection to the RTSP server should only be established when the first viewer
+	asks to watch the mountpoint, rather than when the mountpoint is created (default=false); the latest
+	keyframe is always buffered for lazy mountpoints, to send it to new viewers as soon as it's available
+rtsp_idle_timeout = for lazy mountpoints, after how many seconds with no viewers the RTSP session is torn down (0=never, default=30s)
 \endverbatim
  *
  * Notice that attributes like \c audioport or \c videopt only make sense
@@ -340,6 +364,31 @@ multistream-test: {
 		"viewers" : <count of current subscribers, if any>,
 		"enabled" : <true|false, depending on whether the mountpoint is currently enabled or not>,
 		"type" : "<type of mountpoint>",
+		"recv" : {	// Only for RTP mountpoints that received something already
+			"wakeups" : <how many times the relay thread read from the sockets>,
+			"packets" : <how many datagrams were read>,
+			"bytes" : <how many bytes were read>,
+			"packets_per_wakeup" : <average number of datagrams read at a time>
+		},
+		"rtsp_lazy" : <true, only for RTSP mountpoints that only connect when watched>,
+		"rtsp_idle" : <true|false, whether a lazy RTSP mountpoint is currently disconnected>,
+		"startup_latency_ms" : <how long it took a lazy RTSP mountpoint to get media after the first viewer came in, if known>,
+		"rtsp_control" : {	// Only for RTSP mountpoints
+			"setups" : <how many times we tried to connect to the RTSP server>,
+			"setup_failures" : <how many of those attempts failed>,
+			"setup_latency_ms" : <how long the latest successful DESCRIBE/SETUP took, queueing included>,
+			"keepalives" : <how many keep-alives (OPTIONS) were sent>,
+			"keepalive_failures" : <how many of those failed>,
+			"keepalive_latency_ms" : <how long the latest successful keep-alive took>,
+			"reconnect_failures" : <how many reconnection attempts failed in a row, if any>
+		},
+		"multicast_output" : {	// Only for RTP/RTSP mountpoints with a multicast output
+			"group" : "<multicast group media is sent to>",
+			"port" : <base port media is sent to>,
+			"ttl" : <TTL of the multicast packets>,
+			"iface" : "<address of the interface media is sent from, if configured>",
+			"srtp" : <true, if media is encrypted with a shared SRTP key>
+		},
 		"media" : [
 			{
 				"mid" : "<unique mid of this stream>",
@@ -352,6 +401,7 @@ multistream-test: {
 				"codec" : "<cocec name value, only present if RTP and configured>",
 				"rtpmap" : "<SDP rtpmap value, only present if RTP and configured>",
 				"fmtp" : "<audio SDP fmtp value, only present if RTP and configured>",
+				"gop_cache" : <true, if the GOP since the latest keyframe is replayed to new viewers>,
 				...
 			},
 			{
@@ -453,6 +503,10 @@ multistream-test: {
  * is all that a \c created request will contain. If you want to double
  * check everything in your \c create request went as expected, you may
  * want to issue a followup \c info request to compare the results.
+ * Notice that, if a \c mountpoints_folder is configured, permanent
+ * mountpoints are saved there (one file per mountpoint, named after its
+ * ID) rather than in the configuration file, and are only created when
+ * they're first needed.
  *
  * Once you created a mountpoint, you can modify some (not all) of its
  * properties via an \c edit request. Namely, you can only modify generic
@@ -888,6 +942,9 @@ multistream-test: {
  */
 
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include "plugin.h"
 
 #include <errno.h>
@@ -895,6 +952,9 @@ multistream-test: {
 #include <sys/poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include <jansson.h>
 
@@ -920,12 +980,14 @@ multistream-test: {
 #include "../utils.h"
 #include "../sdp-utils.h"
 #include "../ip-utils.h"
+#include "../rtpfwd.h"
 
 /* Default settings */
 #define JANUS_STREAMING_DEFAULT_SESSION_TIMEOUT 0 /* Overwrite the RTSP session timeout. If set to zero, the RTSP timeout is derived from a session. */
 #define JANUS_STREAMING_DEFAULT_RECONNECT_DELAY 5 /* Reconnecting delay in seconds. */
 #define JANUS_STREAMING_DEFAULT_CURL_TIMEOUT 10L /* Communication timeout for cURL. */
 #define JANUS_STREAMING_DEFAULT_CURL_CONNECT_TIMEOUT 5L /* Connection timeout for cURL. */
+#define JANUS_STREAMING_DEFAULT_IDLE_TIMEOUT 30 /* How long a lazy RTSP mountpoint can stay with no viewers before disconnecting, in seconds. */
 
 /* Plugin information */
 #define JANUS_STREAMING_VERSION			10
@@ -956,6 +1018,7 @@ void janus_streaming_data_ready(janus_plugin_session *handle);
 void janus_streaming_hangup_media(janus_plugin_session *handle);
 void janus_streaming_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_streaming_query_session(janus_plugin_session *handle);
+void janus_streaming_drain(gboolean draining);
 static int janus_streaming_get_fd_port(int fd);
 
 /* Plugin setup */
@@ -982,6 +1045,7 @@ static janus_plugin janus_streaming_plugin =
 		.hangup_media = janus_streaming_hangup_media,
 		.destroy_session = janus_streaming_destroy_session,
 		.query_session = janus_streaming_query_session,
+		.drain = janus_streaming_drain,
 	);
 
 /* Plugin creator */
@@ -1064,7 +1128,16 @@ static struct janus_json_parameter ondemand_parameters[] = {
 	{"audiocodec", JSON_STRING, 0},
 	{"audiortpmap", JSON_STRING, 0},	/* Deprecated */
 	{"audiofmtp", JSON_STRING, 0},
-	{"audiopt", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"audiopt", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"sync_window", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter mcast_out_parameters[] = {
+	{"mcast_out", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"mcast_out_port", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"mcast_out_ttl", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mcast_out_iface", JSON_STRING, 0},
+	{"mcast_out_srtpsuite", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mcast_out_srtpcrypto", JSON_STRING, 0}
 };
 #ifdef HAVE_LIBCURL
 static struct janus_json_parameter rtsp_parameters[] = {
@@ -1086,7 +1159,9 @@ static struct janus_json_parameter rtsp_parameters[] = {
 	{"videobufferkf", JANUS_JSON_BOOL, 0},
 	{"threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"rtspiface", JSON_STRING, 0},
-	{"rtsp_failcheck", JANUS_JSON_BOOL, 0}
+	{"rtsp_failcheck", JANUS_JSON_BOOL, 0},
+	{"rtsp_lazy", JANUS_JSON_BOOL, 0},
+	{"rtsp_idle_timeout", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 #endif
 static struct janus_json_parameter rtp_media_parameters[] = {
@@ -1211,12 +1286,20 @@ static struct janus_json_parameter disable_parameters[] = {
 static janus_config *config = NULL;
 static const char *config_folder = NULL;
 static janus_mutex config_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_config_folder *mountpoints_folder = NULL;
+static janus_mutex mountpoints_folder_mutex = JANUS_MUTEX_INITIALIZER;
 
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
 static gboolean string_ids = FALSE;
 static janus_callbacks *gateway = NULL;
+/* Maximum number of datagrams RTP relay threads read in a single syscall (0 means one at a time) */
+#define JANUS_STREAMING_MAX_RECV_BATCH	64
+#define JANUS_STREAMING_RECV_BUFSIZE	1500
+static int recv_batch_size = 0;
+/* Maximum size of the GOP video streams buffering keyframes can cache (0 means only the keyframe) */
+static size_t gop_cache_size = 0;
 static GThread *handler_thread;
 static void *janus_streaming_handler(void *data);
 
@@ -1230,11 +1313,41 @@ static janus_mutex fd_mutex = JANUS_MUTEX_INITIALIZER;
 
 static void *janus_streaming_ondemand_thread(void *data);
 static void *janus_streaming_filesource_thread(void *data);
+static void *janus_streaming_filesync_thread(void *data);
 static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_streaming_relay_rtcp_packet(gpointer data, gpointer user_data);
 static void *janus_streaming_relay_thread(void *data);
 static void janus_streaming_hangup_media_internal(janus_plugin_session *handle);
 
+/* Reactor threads, if enabled: rather than having a dedicated thread for
+ * each live RTP mountpoint, a fixed number of threads serves all of them */
+#define JANUS_STREAMING_MAX_REACTOR_THREADS	64
+#define JANUS_STREAMING_REACTOR_VNODES		64
+static int reactor_threads = 0;
+struct janus_streaming_mountpoint;
+#ifdef HAVE_EPOLL
+static void janus_streaming_reactors_start(int num);
+static void janus_streaming_reactors_stop(void);
+static int janus_streaming_reactor_add(struct janus_streaming_mountpoint *mountpoint);
+static void janus_streaming_reactor_wait(struct janus_streaming_mountpoint *mountpoint);
+#endif
+
+#ifdef HAVE_LIBCURL
+/* RTSP control: only a limited number of mountpoints can be talking to
+ * their RTSP servers to set up a session at the same time, so that when
+ * lots of cameras need reconnecting at once (e.g., after a network outage)
+ * we don't hammer the network (and the servers) all together, while the
+ * keep-alives of all RTSP mountpoints are sent by a single control thread
+ * driving a curl multi handle, so that relay threads never block on them */
+#define JANUS_STREAMING_RTSP_MAX_SETUPS	16
+static int rtsp_max_setups = JANUS_STREAMING_RTSP_MAX_SETUPS, rtsp_setups = 0;
+static janus_mutex rtsp_setups_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition rtsp_setups_cond;
+static GAsyncQueue *rtsp_keepalives = NULL;
+static GThread *rtsp_control_thread = NULL;
+static void *janus_streaming_rtsp_control(void *data);
+#endif
+
 typedef enum janus_streaming_type {
 	janus_streaming_type_none = 0,
 	janus_streaming_type_live,
@@ -1269,6 +1382,7 @@ typedef struct janus_streaming_rtp_relay_packet {
 	uint32_t ssrc[3];
 	janus_videocodec codec;
 	int substream;
+	janus_rtp_simulcasting_packet sim_packet;	/* Only relevant for simulcast, parsed once by the relay thread */
 	int ptype;
 	uint32_t timestamp;
 	uint16_t seq_number;
@@ -1277,8 +1391,11 @@ typedef struct janus_streaming_rtp_relay_packet {
 	janus_vp9_svc_info svc_info;
 	/* The following is only relevant for datachannels */
 	gboolean textdata;
+	/* Batch to collect the packets for all viewers in, if there are many */
+	janus_plugin_rtp_batch *batch;
 } janus_streaming_rtp_relay_packet;
 static janus_streaming_rtp_relay_packet exit_packet;
+static void janus_streaming_relay_rtp_viewers(GList *viewers, janus_streaming_rtp_relay_packet *packet);
 static void janus_streaming_rtp_relay_packet_free(janus_streaming_rtp_relay_packet *pkt) {
 	if(pkt == NULL || pkt == &exit_packet)
 		return;
@@ -1329,6 +1446,19 @@ typedef struct janus_streaming_rtp_source {
 	int rtsp_timeout;
 	int rtsp_conn_timeout;
 	janus_mutex rtsp_mutex;
+	/* Lazy mountpoints only connect to the RTSP server when somebody's watching */
+	gboolean rtsp_lazy;
+	gint64 rtsp_idle_timeout;
+	volatile gint rtsp_lazy_active;
+	gint64 rtsp_lazy_start, rtsp_startup_latency;
+	janus_mutex lazy_mutex;
+	janus_condition lazy_cond;
+	/* Keep-alives are sent by the RTSP control thread */
+	volatile gint rtsp_ka_pending;
+	/* RTSP control statistics */
+	guint32 reconnect_failures;
+	guint64 rtsp_setups, rtsp_setup_failures, rtsp_kas, rtsp_ka_failures;
+	gint64 rtsp_setup_latency, rtsp_ka_latency;
 #endif
 	/* Only needed for SRTP support */
 	gboolean is_srtp;
@@ -1340,8 +1470,99 @@ typedef struct janus_streaming_rtp_source {
 	gboolean e2ee;
 	/* Whether the playout-delay extension should be negotiated or not for new subscribers */
 	gboolean playoutdelay_ext;
+	/* Throughput counters, updated by the relay thread */
+	guint64 recv_wakeups, recv_packets, recv_bytes;
+	/* Multicast output, if any: what we receive is sent to a group too */
+	char *mcast_out;
+	int mcast_out_port, mcast_out_ttl;
+	char *mcast_out_iface;
+	int mcast_out_srtpsuite;
+	char *mcast_out_srtpcrypto;
+	int mcast_out_fd;
 } janus_streaming_rtp_source;
 
+/* Buffers the relay thread reads incoming datagrams into */
+typedef struct janus_streaming_recv_batch {
+	int size;
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr *messages;
+	struct iovec *iovecs;
+#endif
+	struct sockaddr_storage *remote;
+	socklen_t *addrlen;
+	int *length;
+	char *data;
+} janus_streaming_recv_batch;
+#define janus_streaming_recv_batch_buffer(batch, index) ((batch)->data + (index)*JANUS_STREAMING_RECV_BUFSIZE)
+static janus_streaming_recv_batch *janus_streaming_recv_batch_new(int size) {
+	janus_streaming_recv_batch *batch = g_malloc0(sizeof(janus_streaming_recv_batch));
+	batch->size = size > 0 ? size : 1;
+#ifdef HAVE_RECVMMSG
+	batch->messages = g_malloc0(batch->size * sizeof(struct mmsghdr));
+	batch->iovecs = g_malloc0(batch->size * sizeof(struct iovec));
+#endif
+	batch->remote = g_malloc0(batch->size * sizeof(struct sockaddr_storage));
+	batch->addrlen = g_malloc0(batch->size * sizeof(socklen_t));
+	batch->length = g_malloc0(batch->size * sizeof(int));
+	batch->data = g_malloc0(batch->size * JANUS_STREAMING_RECV_BUFSIZE);
+	return batch;
+}
+static void janus_streaming_recv_batch_free(janus_streaming_recv_batch *batch) {
+	if(batch == NULL)
+		return;
+#ifdef HAVE_RECVMMSG
+	g_free(batch->messages);
+	g_free(batch->iovecs);
+#endif
+	g_free(batch->remote);
+	g_free(batch->addrlen);
+	g_free(batch->length);
+	g_free(batch->data);
+	g_free(batch);
+}
+/* Read up to max datagrams from a socket: returns how many we got, or -1 in case of errors */
+static int janus_streaming_recv_batch_read(janus_streaming_rtp_source *source, int fd,
+		janus_streaming_recv_batch *batch, int max) {
+	if(max > batch->size)
+		max = batch->size;
+	int num = 0, i = 0;
+#ifdef HAVE_RECVMMSG
+	if(max > 1) {
+		for(i=0; i<max; i++) {
+			batch->iovecs[i].iov_base = janus_streaming_recv_batch_buffer(batch, i);
+			batch->iovecs[i].iov_len = JANUS_STREAMING_RECV_BUFSIZE;
+			memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+			batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+			batch->messages[i].msg_hdr.msg_iovlen = 1;
+			batch->messages[i].msg_hdr.msg_name = &batch->remote[i];
+			batch->messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+		}
+		/* Poll told us there's something, so this won't block for the first
+		 * datagram: the others are only read if they're already there */
+		num = recvmmsg(fd, batch->messages, max, MSG_DONTWAIT, NULL);
+		if(num < 0)
+			return -1;
+		for(i=0; i<num; i++) {
+			batch->length[i] = batch->messages[i].msg_len;
+			batch->addrlen[i] = batch->messages[i].msg_hdr.msg_namelen;
+		}
+	}
+#endif
+	if(num == 0) {
+		batch->addrlen[0] = sizeof(struct sockaddr_storage);
+		batch->length[0] = recvfrom(fd, batch->data, JANUS_STREAMING_RECV_BUFSIZE, 0,
+			(struct sockaddr *)&batch->remote[0], &batch->addrlen[0]);
+		if(batch->length[0] < 0)
+			return -1;
+		num = 1;
+	}
+	source->recv_wakeups++;
+	source->recv_packets += num;
+	for(i=0; i<num; i++)
+		source->recv_bytes += batch->length[i];
+	return num;
+}
+
 typedef enum janus_streaming_media {
 	JANUS_STREAMING_MEDIA_NONE = 0,
 	JANUS_STREAMING_MEDIA_AUDIO,
@@ -1400,10 +1621,16 @@ typedef struct janus_streaming_rtp_source_stream {
 	gint64 pli_latest;			/* Time of latest sent PLI (to avoid flooding) */
 	struct sockaddr_storage rtcp_addr;
 	janus_streaming_rtp_keyframe keyframe;
+	janus_rtp_gop_cache *gop;	/* If keyframes are buffered, we may keep the whole GOP as well */
 	gboolean textdata;
 	gboolean buffermsg;
 	void *last_msg;
 	janus_mutex buffermsg_mutex;
+	/* Simulcast: substreams some viewer is relaying, and the ones seen in the current window */
+	guint sim_layers, sim_layers_next;
+	gint64 sim_window;
+	janus_rtp_forwarder *mcast_fwd;	/* Forwarder to the multicast output of the mountpoint, if any */
+	gboolean mcast_fwd_failed;
 	janus_refcount ref;
 } janus_streaming_rtp_source_stream;
 static void janus_streaming_rtp_source_stream_unref(janus_streaming_rtp_source_stream *stream) {
@@ -1412,12 +1639,26 @@ static void janus_streaming_rtp_source_stream_unref(janus_streaming_rtp_source_s
 		janus_refcount_decrease(&stream->ref);
 }
 
+struct janus_streaming_file_group;
 typedef struct janus_streaming_file_source {
 	char *filename;
 	gboolean opus;
 	janus_streaming_codecs codecs;
+	/* The file is mapped in memory once, and shared by all the threads playing it */
+	GMappedFile *map;
+	/* On demand viewers joining within this window (in ms) share the same thread, if set */
+	gint64 sync_window;
+	struct janus_streaming_file_group *group;	/* Latest group viewers can join, if any */
+	janus_mutex mutex;
 } janus_streaming_file_source;
 
+/* Group of on demand viewers that are sent the same file at the same pace */
+typedef struct janus_streaming_file_group {
+	struct janus_streaming_mountpoint *mountpoint;
+	GList *sessions;	/* Viewers in this group (protected by the source mutex) */
+	gint64 created;		/* When this group was created (monotonic time) */
+} janus_streaming_file_group;
+
 /* used for audio/video fd and RTCP fd */
 typedef struct multiple_fds {
 	int fd;
@@ -1437,6 +1678,7 @@ typedef struct janus_streaming_mountpoint {
 	gboolean active;
 	gboolean audio, video, data;
 	GThread *thread;	/* A mountpoint may or may not have a thread */
+	struct janus_streaming_reactor *reactor;	/* Reactor thread serving this mountpoint, if any */
 	janus_streaming_type streaming_type;
 	janus_streaming_source streaming_source;
 	void *source;	/* Can differ according to the source type */
@@ -1449,6 +1691,31 @@ typedef struct janus_streaming_mountpoint {
 	janus_refcount ref;
 } janus_streaming_mountpoint;
 GHashTable *mountpoints = NULL, *mountpoints_temp = NULL;
+
+#ifdef HAVE_EPOLL
+/* Reactor thread, serving the sockets of multiple mountpoints via epoll */
+typedef struct janus_streaming_reactor {
+	guint id;
+	int epfd;
+	GThread *thread;
+	volatile gint stop;
+	GList *mountpoints;		/* List of janus_streaming_reactor_mountpoint instances */
+	janus_mutex mutex;
+	janus_condition cond;
+} janus_streaming_reactor;
+/* Socket a reactor is monitoring */
+typedef struct janus_streaming_reactor_fd {
+	struct janus_streaming_reactor_mountpoint *rmp;
+	int fd;
+} janus_streaming_reactor_fd;
+/* Mountpoint a reactor is serving */
+typedef struct janus_streaming_reactor_mountpoint {
+	janus_streaming_mountpoint *mountpoint;
+	janus_streaming_reactor_fd *fds;
+	int num_fds;
+	gboolean removed;
+} janus_streaming_reactor_mountpoint;
+#endif
 janus_mutex mountpoints_mutex = JANUS_MUTEX_INITIALIZER;
 static char *admin_key = NULL;
 
@@ -1501,7 +1768,20 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		gboolean dovideo, int videopt, char *vcodec, char *vfmtp, gboolean bufferkf,
 		const janus_network_address *iface, int threads,
 		gint64 reconnect_delay, gint64 session_timeout, int rtsp_timeout, int rtsp_conn_timeout,
-		gboolean error_on_failure);
+		gboolean lazy, gint64 idle_timeout, gboolean error_on_failure);
+#ifdef HAVE_LIBCURL
+/* Helper to connect a lazy RTSP mountpoint when the first viewer comes in */
+static int janus_streaming_rtsp_lazy_start(janus_streaming_mountpoint *mp);
+#endif
+/* Helpers to validate, configure and save the multicast output of RTP/RTSP mountpoints */
+static int janus_streaming_mcast_out_check(const char *group, int port, int ttl, const char *iface,
+	int srtpsuite, const char *srtpcrypto, char *error, size_t errlen);
+static void janus_streaming_mcast_out_set(janus_streaming_rtp_source *source, const char *group, int port, int ttl,
+	const char *iface, int srtpsuite, const char *srtpcrypto);
+static void janus_streaming_mcast_out_config(janus_config *mp_config, janus_streaming_mountpoint *mp, janus_config_category *cat);
+static void janus_streaming_mcast_out_save(janus_config *mp_config, janus_config_category *c, janus_streaming_rtp_source *source);
+/* Helper to map the file of a file source in memory, shared by all the players of the source */
+static GMappedFile *janus_streaming_file_source_map(janus_streaming_file_source *source, const char *name);
 
 typedef struct janus_streaming_message {
 	janus_plugin_session *handle;
@@ -1527,6 +1807,10 @@ typedef struct janus_streaming_session_stream {
 	int temporal_layer, target_temporal_layer;
 	/* Playout delays to enforce when relaying this stream, if the extension has been negotiated */
 	int16_t min_delay, max_delay;
+	/* GOP replay for new viewers, which the relay thread sends before the next live packet */
+	volatile gint gop_pending;
+	gboolean gop_replayed;
+	uint16_t gop_last_seq;
 } janus_streaming_session_stream;
 static void janus_streaming_session_stream_free(janus_streaming_session_stream *s) {
 	if(s && s->stream)
@@ -1558,6 +1842,10 @@ typedef struct janus_streaming_session {
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Helper to start sending an on demand file mountpoint to a viewer */
+static gboolean janus_streaming_ondemand_start(janus_streaming_mountpoint *mp,
+	janus_streaming_session *session, GError **error);
+
 static void janus_streaming_session_destroy(janus_streaming_session *session) {
 	if(session && g_atomic_int_compare_and_exchange(&session->destroyed, 0, 1))
 		janus_refcount_decrease(&session->ref);
@@ -1586,10 +1874,22 @@ static void janus_streaming_mountpoint_destroy(janus_streaming_mountpoint *mount
 				res = write(source->pipefd[1], &code, sizeof(int));
 			} while(res == -1 && errno == EINTR);
 		}
+#ifdef HAVE_LIBCURL
+		/* A lazy RTSP mountpoint may be waiting for viewers, wake it up */
+		if(source != NULL && source->rtsp_lazy) {
+			janus_mutex_lock(&source->lazy_mutex);
+			janus_condition_broadcast(&source->lazy_cond);
+			janus_mutex_unlock(&source->lazy_mutex);
+		}
+#endif
 	}
 	/* Wait for the thread to finish */
 	if(mountpoint->thread != NULL)
 		g_thread_join(mountpoint->thread);
+#ifdef HAVE_EPOLL
+	/* If a reactor thread is serving this mountpoint, wait for it to let it go */
+	janus_streaming_reactor_wait(mountpoint);
+#endif
 	/* Get rid of the helper threads, if any */
 	if(mountpoint->helper_threads > 0) {
 		GList *l = mountpoint->threads;
@@ -1663,7 +1963,8 @@ static void janus_streaming_message_free(janus_streaming_message *msg) {
 /* Helper struct to handle the playout of Opus files */
 typedef struct janus_streaming_opus_context {
 	char *name, *filename;
-	FILE *file;
+	const char *data;
+	size_t size, offset;
 	ogg_sync_state sync;
 	ogg_stream_state stream;
 	ogg_page page;
@@ -1673,9 +1974,9 @@ typedef struct janus_streaming_opus_context {
 } janus_streaming_opus_context;
 /* Helper method to open an Opus file, and make sure it's valid */
 static int janus_streaming_opus_context_init(janus_streaming_opus_context *ctx) {
-	if(ctx == NULL || ctx->file == NULL)
+	if(ctx == NULL || ctx->data == NULL)
 		return -1;
-	fseek(ctx->file, 0, SEEK_SET);
+	ctx->offset = 0;
 	ogg_stream_clear(&ctx->stream);
 	ogg_sync_clear(&ctx->sync);
 	if(ogg_sync_init(&ctx->sync) < 0) {
@@ -1702,7 +2003,7 @@ static gboolean janus_streaming_ogg_is_opus(ogg_page *page) {
 }
 /* Helper method to traverse the Opus file until we get a packet we can send */
 static int janus_streaming_opus_context_read(janus_streaming_opus_context *ctx, char *buffer, int length) {
-	if(ctx == NULL || ctx->file == NULL || buffer == NULL)
+	if(ctx == NULL || ctx->data == NULL || buffer == NULL)
 		return -1;
 	/* Check our current state in processing the Ogg file */
 	int read = 0;
@@ -1713,8 +2014,11 @@ static int janus_streaming_opus_context_read(janus_streaming_opus_context *ctx,
 			JANUS_LOG(LOG_ERR, "[%s] ogg_sync_buffer failed...\n", ctx->name);
 			return -2;
 		}
-		read = fread(ctx->oggbuf, 1, 8192, ctx->file);
-		if(read == 0 && feof(ctx->file)) {
+		size_t left = ctx->size - ctx->offset;
+		read = left > 8192 ? 8192 : (int)left;
+		memcpy(ctx->oggbuf, ctx->data + ctx->offset, read);
+		ctx->offset += read;
+		if(read == 0) {
 			/* FIXME We're doing this forever... should this be configurable? */
 			JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", ctx->name, ctx->filename);
 			if(janus_streaming_opus_context_init(ctx) < 0)
@@ -1804,6 +2108,77 @@ static void janus_streaming_opus_context_cleanup(janus_streaming_opus_context *c
 }
 #endif
 
+/* Helper struct to play a file source from memory, with its own cursor */
+typedef struct janus_streaming_file_player {
+	char *name;
+	janus_streaming_file_source *source;
+	GMappedFile *map;
+	const char *data;
+	size_t size, offset;
+#ifdef HAVE_LIBOGG
+	janus_streaming_opus_context opusctx;
+#endif
+} janus_streaming_file_player;
+/* Helper method to start playing a file source */
+static int janus_streaming_file_player_init(janus_streaming_file_player *player,
+		janus_streaming_file_source *source, char *name) {
+	memset(player, 0, sizeof(*player));
+	player->name = name;
+	player->source = source;
+	player->map = janus_streaming_file_source_map(source, name);
+	if(player->map == NULL)
+		return -1;
+	player->data = g_mapped_file_get_contents(player->map);
+	player->size = g_mapped_file_get_length(player->map);
+#ifdef HAVE_LIBOGG
+	/* Make sure that, if this is an .opus file, we can play it */
+	if(source->opus) {
+		player->opusctx.name = name;
+		player->opusctx.filename = source->filename;
+		player->opusctx.data = player->data;
+		player->opusctx.size = player->size;
+		if(janus_streaming_opus_context_init(&player->opusctx) < 0) {
+			g_mapped_file_unref(player->map);
+			player->map = NULL;
+			return -1;
+		}
+	}
+#endif
+	return 0;
+}
+/* Helper method to get the next frame from a file source: returns the size
+ * of the frame, 0 if we just rewound, and a negative value in case of errors */
+static int janus_streaming_file_player_read(janus_streaming_file_player *player, char *buffer, int length) {
+	if(player->source->opus) {
+#ifdef HAVE_LIBOGG
+		/* Get the next frame from the Opus file */
+		return janus_streaming_opus_context_read(&player->opusctx, buffer, length);
+#else
+		return -1;
+#endif
+	}
+	/* Get the next frame from the raw file */
+	if(player->size - player->offset < 160 || length < 160) {
+		/* FIXME We're doing this forever... should this be configurable? */
+		JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", player->name, player->source->filename);
+		player->offset = 0;
+		return 0;
+	}
+	memcpy(buffer, player->data + player->offset, 160);
+	player->offset += 160;
+	return 160;
+}
+/* Helper method to stop playing a file source */
+static void janus_streaming_file_player_cleanup(janus_streaming_file_player *player) {
+#ifdef HAVE_LIBOGG
+	if(player->source->opus)
+		janus_streaming_opus_context_cleanup(&player->opusctx);
+#endif
+	if(player->map != NULL)
+		g_mapped_file_unref(player->map);
+	player->map = NULL;
+}
+
 
 /* Helper method to send an RTCP PLI */
 static void janus_streaming_rtcp_pli_send(janus_streaming_rtp_source_stream *stream) {
@@ -1927,856 +2302,1044 @@ static char *janus_streaming_parse_sprop(char *sprop, int *len) {
 #define JANUS_STREAMING_ERROR_UNKNOWN_ERROR			470
 
 
-/* Plugin implementation */
-int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
-#ifdef HAVE_LIBCURL
-	curl_global_init(CURL_GLOBAL_ALL);
-#else
-	JANUS_LOG(LOG_WARN, "libcurl not available, Streaming plugin will not have RTSP support\n");
-#endif
-#ifndef HAVE_LIBOGG
-	JANUS_LOG(LOG_WARN, "libogg not available, Streaming plugin will not have file-based Opus streaming\n");
-#endif
-	if(g_atomic_int_get(&stopping)) {
-		/* Still stopping from before */
+/* Helper to create a mountpoint out of a configuration category: the name is
+ * the category name for mountpoints in the configuration file, while files in
+ * the mountpoints folder are named after the ID, and so keep it as an item */
+static int janus_streaming_mountpoint_from_config(janus_config *mp_config, janus_config_category *cat, const char *name, struct ifaddrs *ifas) {
+	JANUS_LOG(LOG_VERB, "Adding Streaming mountpoint '%s'\n", cat->name);
+	janus_config_item *type = janus_config_get(mp_config, cat, janus_config_type_item, "type");
+	if(type == NULL || type->value == NULL) {
+		JANUS_LOG(LOG_WARN, "  -- Invalid type, skipping mountpoint '%s'...\n", cat->name);
 		return -1;
 	}
-	if(callback == NULL || config_path == NULL) {
-		/* Invalid arguments */
-		return -1;
-	}
-
-	struct ifaddrs *ifas = NULL;
-	if(getifaddrs(&ifas) == -1) {
-		JANUS_LOG(LOG_ERR, "Unable to acquire list of network devices/interfaces; some configurations may not work as expected... %d (%s)\n",
-			errno, g_strerror(errno));
-	}
-
-	/* Read configuration */
-	char filename[255];
-	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_STREAMING_PACKAGE);
-	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-	config = janus_config_parse(filename);
-	if(config == NULL) {
-		JANUS_LOG(LOG_WARN, "Couldn't find .jcfg configuration file (%s), trying .cfg\n", JANUS_STREAMING_PACKAGE);
-		g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_STREAMING_PACKAGE);
-		JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
-		config = janus_config_parse(filename);
-	}
-	config_folder = config_path;
-	if(config != NULL)
-		janus_config_print(config);
-
-	/* Threads will expect this to be set */
-	g_atomic_int_set(&initialized, 1);
-
-	/* Parse configuration to populate the mountpoints */
-	if(config != NULL) {
-		janus_config_category *config_general = janus_config_get_create(config, NULL, janus_config_type_category, "general");
-		/* Any admin key to limit who can "create"? */
-		janus_config_item *key = janus_config_get(config, config_general, janus_config_type_item, "admin_key");
-		if(key != NULL && key->value != NULL)
-			admin_key = g_strdup(key->value);
-		janus_config_item *range = janus_config_get(config, config_general, janus_config_type_item, "rtp_port_range");
-		if(range && range->value) {
-			/* Split in min and max port */
-			char *maxport = strrchr(range->value, '-');
-			if(maxport != NULL) {
-				*maxport = '\0';
-				maxport++;
-				if(janus_string_to_uint16(range->value, &rtp_range_min) < 0)
-					JANUS_LOG(LOG_WARN, "Invalid RTP min port value: %s (assuming 0)\n", range->value);
-				if(janus_string_to_uint16(maxport, &rtp_range_max) < 0)
-					JANUS_LOG(LOG_WARN, "Invalid RTP max port value: %s (assuming 0)\n", maxport);
-				maxport--;
-				*maxport = '-';
-			}
-			if(rtp_range_min > rtp_range_max) {
-				uint16_t temp_port = rtp_range_min;
-				rtp_range_min = rtp_range_max;
-				rtp_range_max = temp_port;
+	janus_config_item *id = janus_config_get(mp_config, cat, janus_config_type_item, "id");
+	guint64 mpid = 0;
+	if(id == NULL || id->value == NULL) {
+		JANUS_LOG(LOG_VERB, "Missing id for mountpoint '%s', will generate a random one...\n", cat->name);
+	} else {
+		janus_mutex_lock(&mountpoints_mutex);
+		if(!string_ids) {
+			mpid = g_ascii_strtoull(id->value, 0, 10);
+			/* Make sure the ID is completely numeric */
+			char mpid_str[30];
+			g_snprintf(mpid_str, sizeof(mpid_str), "%"SCNu64, mpid);
+			if(strcmp(id->value, mpid_str)) {
+				janus_mutex_unlock(&mountpoints_mutex);
+				JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', ID '%s' is not numeric...\n",
+					cat->name, id->value);
+				return -1;
 			}
-			if(rtp_range_min % 2)
-				rtp_range_min++;	/* Pick an even port for RTP */
-			if(rtp_range_min > rtp_range_max) {
-				JANUS_LOG(LOG_WARN, "Incorrect port range (%u -- %u), switching min and max\n", rtp_range_min, rtp_range_max);
-				uint16_t range_temp = rtp_range_max;
-				rtp_range_max = rtp_range_min;
-				rtp_range_min = range_temp;
+			if(mpid == 0) {
+				janus_mutex_unlock(&mountpoints_mutex);
+				JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', invalid ID '%s'...\n",
+					cat->name, id->value);
+				return -1;
 			}
-			if(rtp_range_max == 0)
-				rtp_range_max = 65535;
-			rtp_range_slider = rtp_range_min;
-			JANUS_LOG(LOG_VERB, "Streaming RTP/RTCP port range: %u -- %u\n", rtp_range_min, rtp_range_max);
 		}
-		janus_config_item *events = janus_config_get(config, config_general, janus_config_type_item, "events");
-		if(events != NULL && events->value != NULL)
-			notify_events = janus_is_true(events->value);
-		if(!notify_events && callback->events_is_enabled()) {
-			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_STREAMING_NAME);
-		}
-		janus_config_item *ids = janus_config_get(config, config_general, janus_config_type_item, "string_ids");
-		if(ids != NULL && ids->value != NULL)
-			string_ids = janus_is_true(ids->value);
-		if(string_ids) {
-			JANUS_LOG(LOG_INFO, "Streaming will use alphanumeric IDs, not numeric\n");
+		/* Let's make sure the mountpoint doesn't exist already */
+		if(g_hash_table_lookup(mountpoints, string_ids ? (gpointer)id->value : (gpointer)&mpid) != NULL) {
+			/* It does... */
+			janus_mutex_unlock(&mountpoints_mutex);
+			JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', ID '%s' already exists...\n",
+				cat->name, id->value);
+			return -1;
 		}
+		janus_mutex_unlock(&mountpoints_mutex);
 	}
-	/* Iterate on all mountpoints */
-	mountpoints = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
-		(GDestroyNotify)g_free, (GDestroyNotify)janus_streaming_mountpoint_destroy);
-	mountpoints_temp = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
-		(GDestroyNotify)g_free, NULL);
-	if(config != NULL) {
-		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
-		while(cl != NULL) {
-			janus_config_category *cat = (janus_config_category *)cl->data;
-			if(cat->name == NULL || !strcasecmp(cat->name, "general")) {
-				cl = cl->next;
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "Adding Streaming mountpoint '%s'\n", cat->name);
-			janus_config_item *type = janus_config_get(config, cat, janus_config_type_item, "type");
-			if(type == NULL || type->value == NULL) {
-				JANUS_LOG(LOG_WARN, "  -- Invalid type, skipping mountpoint '%s'...\n", cat->name);
-				cl = cl->next;
-				continue;
-			}
-			janus_config_item *id = janus_config_get(config, cat, janus_config_type_item, "id");
-			guint64 mpid = 0;
-			if(id == NULL || id->value == NULL) {
-				JANUS_LOG(LOG_VERB, "Missing id for mountpoint '%s', will generate a random one...\n", cat->name);
-			} else {
-				janus_mutex_lock(&mountpoints_mutex);
-				if(!string_ids) {
-					mpid = g_ascii_strtoull(id->value, 0, 10);
-					/* Make sure the ID is completely numeric */
-					char mpid_str[30];
-					g_snprintf(mpid_str, sizeof(mpid_str), "%"SCNu64, mpid);
-					if(strcmp(id->value, mpid_str)) {
-						janus_mutex_unlock(&mountpoints_mutex);
-						JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', ID '%s' is not numeric...\n",
-							cat->name, id->value);
-						cl = cl->next;
-						continue;
-					}
-					if(mpid == 0) {
-						janus_mutex_unlock(&mountpoints_mutex);
-						JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', invalid ID '%s'...\n",
-							cat->name, id->value);
-						cl = cl->next;
-						continue;
-					}
-				}
-				/* Let's make sure the mountpoint doesn't exist already */
-				if(g_hash_table_lookup(mountpoints, string_ids ? (gpointer)id->value : (gpointer)&mpid) != NULL) {
-					/* It does... */
-					janus_mutex_unlock(&mountpoints_mutex);
-					JANUS_LOG(LOG_ERR, "Can't add the Streaming mountpoint '%s', ID '%s' already exists...\n",
-						cat->name, id->value);
-					cl = cl->next;
+	if(!strcasecmp(type->value, "rtp")) {
+		/* RTP live source (e.g., from gstreamer/ffmpeg/vlc/etc.) */
+		GList *streams = NULL;
+		janus_config_item *desc = janus_config_get(mp_config, cat, janus_config_type_item, "description");
+		janus_config_item *md = janus_config_get(mp_config, cat, janus_config_type_item, "metadata");
+		janus_config_item *priv = janus_config_get(mp_config, cat, janus_config_type_item, "is_private");
+		janus_config_item *secret = janus_config_get(mp_config, cat, janus_config_type_item, "secret");
+		janus_config_item *pin = janus_config_get(mp_config, cat, janus_config_type_item, "pin");
+		janus_config_item *media = janus_config_get(mp_config, cat, janus_config_type_array, "media");
+		janus_config_item *rtpcollision = janus_config_get(mp_config, cat, janus_config_type_item, "collision");
+		janus_config_item *threads = janus_config_get(mp_config, cat, janus_config_type_item, "threads");
+		janus_config_item *ssuite = janus_config_get(mp_config, cat, janus_config_type_item, "srtpsuite");
+		janus_config_item *scrypto = janus_config_get(mp_config, cat, janus_config_type_item, "srtpcrypto");
+		janus_config_item *e2ee = janus_config_get(mp_config, cat, janus_config_type_item, "e2ee");
+		janus_config_item *pd = janus_config_get(mp_config, cat, janus_config_type_item, "playoutdelay_ext");
+		gboolean is_private = priv && priv->value && janus_is_true(priv->value);
+		if(ssuite && ssuite->value && atoi(ssuite->value) != 32 && atoi(ssuite->value) != 80) {
+			JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid SRTP suite...\n", cat->name);
+			return -1;
+		}
+		if(rtpcollision && rtpcollision->value && atoi(rtpcollision->value) < 0) {
+			JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid collision configuration...\n", cat->name);
+			return -1;
+		}
+		if(threads && threads->value && atoi(threads->value) < 0) {
+			JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid threads configuration...\n", cat->name);
+			return -1;
+		}
+		/* How are we adding media? */
+		if(media != NULL) {
+			/* We're using the new media-based configuration, iterate on all media objects */
+			gboolean failed = FALSE;
+			GList *ml = media->list;
+			while(ml) {
+				janus_config_item *m = (janus_config_item *)ml->data;
+				if(m == NULL || m->type != janus_config_type_category) {
+					JANUS_LOG(LOG_WARN, "  -- Invalid media item (not a category?), skipping in '%s'...\n", cat->name);
+					ml = ml->next;
 					continue;
 				}
-				janus_mutex_unlock(&mountpoints_mutex);
-			}
-			if(!strcasecmp(type->value, "rtp")) {
-				/* RTP live source (e.g., from gstreamer/ffmpeg/vlc/etc.) */
-				GList *streams = NULL;
-				janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-				janus_config_item *md = janus_config_get(config, cat, janus_config_type_item, "metadata");
-				janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-				janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-				janus_config_item *media = janus_config_get(config, cat, janus_config_type_array, "media");
-				janus_config_item *rtpcollision = janus_config_get(config, cat, janus_config_type_item, "collision");
-				janus_config_item *threads = janus_config_get(config, cat, janus_config_type_item, "threads");
-				janus_config_item *ssuite = janus_config_get(config, cat, janus_config_type_item, "srtpsuite");
-				janus_config_item *scrypto = janus_config_get(config, cat, janus_config_type_item, "srtpcrypto");
-				janus_config_item *e2ee = janus_config_get(config, cat, janus_config_type_item, "e2ee");
-				janus_config_item *pd = janus_config_get(config, cat, janus_config_type_item, "playoutdelay_ext");
-				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
-				if(ssuite && ssuite->value && atoi(ssuite->value) != 32 && atoi(ssuite->value) != 80) {
-					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid SRTP suite...\n", cat->name);
-					cl = cl->next;
+				janus_config_item *type = janus_config_get(mp_config, m, janus_config_type_item, "type");
+				if(type == NULL || type->value == NULL) {
+					JANUS_LOG(LOG_WARN, "  -- Invalid media type, skipping in '%s'...\n", cat->name);
+					ml = ml->next;
 					continue;
 				}
-				if(rtpcollision && rtpcollision->value && atoi(rtpcollision->value) < 0) {
-					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid collision configuration...\n", cat->name);
-					cl = cl->next;
+				if(strcasecmp(type->value, "audio") && strcasecmp(type->value, "video") && strcasecmp(type->value, "data")) {
+					JANUS_LOG(LOG_WARN, "  -- Unsupported media type '%s', skipping in '%s'...\n", type->value, cat->name);
+					ml = ml->next;
 					continue;
 				}
-				if(threads && threads->value && atoi(threads->value) < 0) {
-					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid threads configuration...\n", cat->name);
-					cl = cl->next;
+				gboolean audio = !strcasecmp(type->value, "audio");
+				gboolean video = !strcasecmp(type->value, "video");
+				gboolean data = !strcasecmp(type->value, "data");
+				/* We need mid and label for addressing this stream on the client side */
+				janus_config_item *mid = janus_config_get(mp_config, m, janus_config_type_item, "mid");
+				if(mid == NULL || mid->value == NULL) {
+					JANUS_LOG(LOG_WARN, "  -- Missing media mid, skipping in '%s'...\n", cat->name);
+					ml = ml->next;
 					continue;
 				}
-				/* How are we adding media? */
-				if(media != NULL) {
-					/* We're using the new media-based configuration, iterate on all media objects */
-					gboolean failed = FALSE;
-					GList *ml = media->list;
-					while(ml) {
-						janus_config_item *m = (janus_config_item *)ml->data;
-						if(m == NULL || m->type != janus_config_type_category) {
-							JANUS_LOG(LOG_WARN, "  -- Invalid media item (not a category?), skipping in '%s'...\n", cat->name);
-							ml = ml->next;
-							continue;
-						}
-						janus_config_item *type = janus_config_get(config, m, janus_config_type_item, "type");
-						if(type == NULL || type->value == NULL) {
-							JANUS_LOG(LOG_WARN, "  -- Invalid media type, skipping in '%s'...\n", cat->name);
-							ml = ml->next;
-							continue;
-						}
-						if(strcasecmp(type->value, "audio") && strcasecmp(type->value, "video") && strcasecmp(type->value, "data")) {
-							JANUS_LOG(LOG_WARN, "  -- Unsupported media type '%s', skipping in '%s'...\n", type->value, cat->name);
-							ml = ml->next;
-							continue;
-						}
-						gboolean audio = !strcasecmp(type->value, "audio");
-						gboolean video = !strcasecmp(type->value, "video");
-						gboolean data = !strcasecmp(type->value, "data");
-						/* We need mid and label for addressing this stream on the client side */
-						janus_config_item *mid = janus_config_get(config, m, janus_config_type_item, "mid");
-						if(mid == NULL || mid->value == NULL) {
-							JANUS_LOG(LOG_WARN, "  -- Missing media mid, skipping in '%s'...\n", cat->name);
-							ml = ml->next;
-							continue;
-						}
-						janus_config_item *label = janus_config_get(config, m, janus_config_type_item, "label");
-						janus_config_item *msid = janus_config_get(config, m, janus_config_type_item, "msid");
-						/* These are the attributes we can configure per each media stream */
-						janus_network_address media_iface;
-						janus_config_item *iface = janus_config_get(config, m, janus_config_type_item, "iface");
-						janus_config_item *mcast = janus_config_get(config, m, janus_config_type_item, "mcast");
-						janus_config_item *port = janus_config_get(config, m, janus_config_type_item, "port");
-						janus_config_item *rtcpport = janus_config_get(config, m, janus_config_type_item, "rtcpport");
-						janus_config_item *pt = janus_config_get(config, m, janus_config_type_item, "pt");
-						janus_config_item *codec = janus_config_get(config, m, janus_config_type_item, "codec");
-						janus_config_item *rtpmap = janus_config_get(config, m, janus_config_type_item, "rtpmap");
-						janus_config_item *fmtp = janus_config_get(config, m, janus_config_type_item, "fmtp");
-						janus_config_item *vsps = janus_config_get(config, m, janus_config_type_item, "h264sps");
-						janus_config_item *vkf = janus_config_get(config, m, janus_config_type_item, "bufferkf");
-						janus_config_item *vsc = janus_config_get(config, m, janus_config_type_item, "simulcast");
-						janus_config_item *dbm = janus_config_get(config, cat, janus_config_type_item, "buffermsg");
-						janus_config_item *dt = janus_config_get(config, cat, janus_config_type_item, "datatype");
-						janus_config_item *vport2 = janus_config_get(config, m, janus_config_type_item, "port2");
-						janus_config_item *vport3 = janus_config_get(config, m, janus_config_type_item, "port3");
-						janus_config_item *vsvc = janus_config_get(config, m, janus_config_type_item, "svc");
-						janus_config_item *skew = janus_config_get(config, m, janus_config_type_item, "skew");
-						gboolean doskew = skew && skew->value && janus_is_true(skew->value);
-						gboolean dosvc = video && vsvc && vsvc->value && janus_is_true(vsvc->value);
-						gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
-						gboolean simulcast = video && vsc && vsc->value && janus_is_true(vsc->value);
-						if(simulcast && bufferkf) {
-							/* FIXME We'll need to take care of this */
-							JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
-							bufferkf = FALSE;
-						}
-						gboolean buffermsg = data && dbm && dbm->value && janus_is_true(dbm->value);
-						gboolean textdata = TRUE;
-						if(data && dt && dt->value) {
-							if(!strcasecmp(dt->value, "text"))
-								textdata = TRUE;
-							else if(!strcasecmp(dt->value, "binary"))
-								textdata = FALSE;
-							else {
-								JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid data type '%s'...\n", cat->name, dt->value);
-								cl = cl->next;
-								continue;
-							}
-						}
-						const char *streamcodec = (codec && codec->value ? codec->value : NULL);
-						if((audio || video) && streamcodec == NULL) {
-							/* No codec property, check the deprecated rtpmap */
-							if(rtpmap && rtpmap->value)
-								streamcodec = janus_sdp_get_rtpmap_codec(rtpmap->value);
-						}
-						if((audio || video) &&
-								(port == NULL || port->value == NULL || atoi(port->value) < 0 ||
-								pt == NULL || pt->value == NULL || streamcodec == NULL)) {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' stream '%s', missing mandatory information for audio/video stream...\n", cat->name);
-							failed = TRUE;
-							break;
-						} else if(data && (port == NULL || port->value == NULL || atoi(port->value) < 0)) {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' stream '%s', missing mandatory information for data stream...\n", cat->name);
-							failed = TRUE;
-							break;
-						}
-						if(iface) {
-							if(!ifas) {
-								JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', it relies on network configuration but network device information is unavailable...\n", type->value, cat->name);
-								failed = TRUE;
-								break;
-							}
-							if(janus_network_lookup_interface(ifas, iface->value, &media_iface) != 0) {
-								JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', invalid network interface configuration for media stream...\n", type->value, cat->name);
-								failed = TRUE;
-								break;
-							}
-						}
-						/* Create the source stream */
-						janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
-							cat->name, g_list_length(streams),
-							type->value, mid->value, (label && label->value ? label->value : type->value),
-							(msid && msid->value ? msid->value : NULL),
-							mcast ? (char *)mcast->value : NULL,
-							iface && iface->value ? (char *)iface->value : NULL,
-							iface && iface->value ? &media_iface : NULL,
-							(port && port->value) ? atoi(port->value) : 0,
-							(vport2 && vport2->value) ? atoi(vport2->value) : 0,
-							(vport3 && vport3->value) ? atoi(vport3->value) : 0,
-							(rtcpport && rtcpport->value),
-								(rtcpport && rtcpport->value) ? atoi(rtcpport->value) : 0,
-							(pt && pt->value) ? atoi(pt->value) : 0,
-							(char *)streamcodec,
-							fmtp ? (char *)fmtp->value : NULL,
-							vsps ? (char *)vsps->value : NULL,
-							doskew, bufferkf, simulcast, dosvc, textdata, buffermsg);
-						if(stream == NULL) {
-							JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', error creating source stream...\n", type->value, cat->name);
-							failed = TRUE;
-							break;
-						}
-						/* Add to the list of streams */
-						streams = g_list_append(streams, stream);
-						/* Go on */
-						ml = ml->next;
-					}
-					if(failed) {
-						cl = cl->next;
-						continue;
-					}
-				} else {
-					/* If we got here, we create a mountpoint the "old" way */
-					janus_network_address video_iface, audio_iface, data_iface;
-					janus_config_item *audio = janus_config_get(config, cat, janus_config_type_item, "audio");
-					janus_config_item *askew = janus_config_get(config, cat, janus_config_type_item, "audioskew");
-					janus_config_item *video = janus_config_get(config, cat, janus_config_type_item, "video");
-					janus_config_item *vskew = janus_config_get(config, cat, janus_config_type_item, "videoskew");
-					janus_config_item *vsvc = janus_config_get(config, cat, janus_config_type_item, "videosvc");
-					janus_config_item *data = janus_config_get(config, cat, janus_config_type_item, "data");
-					janus_config_item *amcast = janus_config_get(config, cat, janus_config_type_item, "audiomcast");
-					janus_config_item *aiface = janus_config_get(config, cat, janus_config_type_item, "audioiface");
-					janus_config_item *aport = janus_config_get(config, cat, janus_config_type_item, "audioport");
-					janus_config_item *artcpport = janus_config_get(config, cat, janus_config_type_item, "audiortcpport");
-					janus_config_item *apt = janus_config_get(config, cat, janus_config_type_item, "audiopt");
-					janus_config_item *acodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
-					janus_config_item *artpmap = janus_config_get(config, cat, janus_config_type_item, "audiortpmap");
-					janus_config_item *afmtp = janus_config_get(config, cat, janus_config_type_item, "audiofmtp");
-					janus_config_item *vmcast = janus_config_get(config, cat, janus_config_type_item, "videomcast");
-					janus_config_item *viface = janus_config_get(config, cat, janus_config_type_item, "videoiface");
-					janus_config_item *vport = janus_config_get(config, cat, janus_config_type_item, "videoport");
-					janus_config_item *vrtcpport = janus_config_get(config, cat, janus_config_type_item, "videortcpport");
-					janus_config_item *vpt = janus_config_get(config, cat, janus_config_type_item, "videopt");
-					janus_config_item *vcodec = janus_config_get(config, cat, janus_config_type_item, "videocodec");
-					janus_config_item *vrtpmap = janus_config_get(config, cat, janus_config_type_item, "videortpmap");
-					janus_config_item *vfmtp = janus_config_get(config, cat, janus_config_type_item, "videofmtp");
-					janus_config_item *vsps = janus_config_get(config, cat, janus_config_type_item, "h264sps");
-					janus_config_item *vkf = janus_config_get(config, cat, janus_config_type_item, "videobufferkf");
-					janus_config_item *vsc = janus_config_get(config, cat, janus_config_type_item, "videosimulcast");
-					janus_config_item *vport2 = janus_config_get(config, cat, janus_config_type_item, "videoport2");
-					janus_config_item *vport3 = janus_config_get(config, cat, janus_config_type_item, "videoport3");
-					janus_config_item *dmcast = janus_config_get(config, cat, janus_config_type_item, "datamcast");
-					janus_config_item *diface = janus_config_get(config, cat, janus_config_type_item, "dataiface");
-					janus_config_item *dport = janus_config_get(config, cat, janus_config_type_item, "dataport");
-					janus_config_item *dbm = janus_config_get(config, cat, janus_config_type_item, "databuffermsg");
-					janus_config_item *dt = janus_config_get(config, cat, janus_config_type_item, "datatype");
-					gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
-					gboolean doaskew = audio && askew && askew->value && janus_is_true(askew->value);
-					gboolean dovideo = video && video->value && janus_is_true(video->value);
-					gboolean dovskew = video && vskew && vskew->value && janus_is_true(vskew->value);
-					gboolean dosvc = video && vsvc && vsvc->value && janus_is_true(vsvc->value);
-					gboolean dodata = data && data->value && janus_is_true(data->value);
-					gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
-					gboolean simulcast = video && vsc && vsc->value && janus_is_true(vsc->value);
-					if(simulcast && bufferkf) {
-						/* FIXME We'll need to take care of this */
-						JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
-						bufferkf = FALSE;
-					}
-					gboolean buffermsg = data && dbm && dbm->value && janus_is_true(dbm->value);
-					gboolean textdata = TRUE;
-					if(data && dt && dt->value) {
-						if(!strcasecmp(dt->value, "text"))
-							textdata = TRUE;
-						else if(!strcasecmp(dt->value, "binary"))
-							textdata = FALSE;
-						else {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid data type '%s'...\n", cat->name, dt->value);
-							cl = cl->next;
-							continue;
-						}
-					}
-					if(!doaudio && !dovideo && !dodata) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', no audio, video or data have to be streamed...\n", cat->name);
-						cl = cl->next;
-						continue;
+				janus_config_item *label = janus_config_get(mp_config, m, janus_config_type_item, "label");
+				janus_config_item *msid = janus_config_get(mp_config, m, janus_config_type_item, "msid");
+				/* These are the attributes we can configure per each media stream */
+				janus_network_address media_iface;
+				janus_config_item *iface = janus_config_get(mp_config, m, janus_config_type_item, "iface");
+				janus_config_item *mcast = janus_config_get(mp_config, m, janus_config_type_item, "mcast");
+				janus_config_item *port = janus_config_get(mp_config, m, janus_config_type_item, "port");
+				janus_config_item *rtcpport = janus_config_get(mp_config, m, janus_config_type_item, "rtcpport");
+				janus_config_item *pt = janus_config_get(mp_config, m, janus_config_type_item, "pt");
+				janus_config_item *codec = janus_config_get(mp_config, m, janus_config_type_item, "codec");
+				janus_config_item *rtpmap = janus_config_get(mp_config, m, janus_config_type_item, "rtpmap");
+				janus_config_item *fmtp = janus_config_get(mp_config, m, janus_config_type_item, "fmtp");
+				janus_config_item *vsps = janus_config_get(mp_config, m, janus_config_type_item, "h264sps");
+				janus_config_item *vkf = janus_config_get(mp_config, m, janus_config_type_item, "bufferkf");
+				janus_config_item *vsc = janus_config_get(mp_config, m, janus_config_type_item, "simulcast");
+				janus_config_item *dbm = janus_config_get(mp_config, cat, janus_config_type_item, "buffermsg");
+				janus_config_item *dt = janus_config_get(mp_config, cat, janus_config_type_item, "datatype");
+				janus_config_item *vport2 = janus_config_get(mp_config, m, janus_config_type_item, "port2");
+				janus_config_item *vport3 = janus_config_get(mp_config, m, janus_config_type_item, "port3");
+				janus_config_item *vsvc = janus_config_get(mp_config, m, janus_config_type_item, "svc");
+				janus_config_item *skew = janus_config_get(mp_config, m, janus_config_type_item, "skew");
+				gboolean doskew = skew && skew->value && janus_is_true(skew->value);
+				gboolean dosvc = video && vsvc && vsvc->value && janus_is_true(vsvc->value);
+				gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
+				gboolean simulcast = video && vsc && vsc->value && janus_is_true(vsc->value);
+				if(simulcast && bufferkf) {
+					/* FIXME We'll need to take care of this */
+					JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
+					bufferkf = FALSE;
+				}
+				gboolean buffermsg = data && dbm && dbm->value && janus_is_true(dbm->value);
+				gboolean textdata = TRUE;
+				if(data && dt && dt->value) {
+					if(!strcasecmp(dt->value, "text"))
+						textdata = TRUE;
+					else if(!strcasecmp(dt->value, "binary"))
+						textdata = FALSE;
+					else {
+						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid data type '%s'...\n", cat->name, dt->value);
+						failed = TRUE;
+						break;
 					}
-					uint16_t audio_port = 0, audio_rtcp_port = 0;
-					const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
-					if(audiocodec == NULL) {
-						/* No audiocodec property, chech the deprecated audiortpmap */
-						if(artpmap && artpmap->value)
-							audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
+				}
+				const char *streamcodec = (codec && codec->value ? codec->value : NULL);
+				if((audio || video) && streamcodec == NULL) {
+					/* No codec property, check the deprecated rtpmap */
+					if(rtpmap && rtpmap->value)
+						streamcodec = janus_sdp_get_rtpmap_codec(rtpmap->value);
+				}
+				if((audio || video) &&
+						(port == NULL || port->value == NULL || atoi(port->value) < 0 ||
+						pt == NULL || pt->value == NULL || streamcodec == NULL)) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' stream '%s', missing mandatory information for audio/video stream...\n", cat->name);
+					failed = TRUE;
+					break;
+				} else if(data && (port == NULL || port->value == NULL || atoi(port->value) < 0)) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' stream '%s', missing mandatory information for data stream...\n", cat->name);
+					failed = TRUE;
+					break;
+				}
+				if(iface) {
+					if(!ifas) {
+						JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', it relies on network configuration but network device information is unavailable...\n", type->value, cat->name);
+						failed = TRUE;
+						break;
 					}
-					if(doaudio &&
-							(aport == NULL || aport->value == NULL ||
-							janus_string_to_uint16(aport->value, &audio_port) < 0 ||
-							apt == NULL || apt->value == NULL || audiocodec == NULL)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for audio...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					if(doaudio && artcpport != NULL && artcpport->value != NULL &&
-							(janus_string_to_uint16(artcpport->value, &audio_rtcp_port) < 0)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid audio RTCP port...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					gboolean doaudiortcp = (artcpport != NULL && artcpport->value != NULL);
-					if(doaudio && aiface) {
-						if(!ifas) {
-							JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						if(janus_network_lookup_interface(ifas, aiface->value, &audio_iface) != 0) {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for audio...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-					}
-					uint16_t video_port = 0, video_port2 = 0, video_port3 = 0, video_rtcp_port = 0;
-					const char *videocodec = (vcodec && vcodec->value ? vcodec->value : NULL);
-					if(videocodec == NULL) {
-						/* No videocodec property, chech the deprecated videortpmap */
-						if(vrtpmap && vrtpmap->value)
-							videocodec = janus_sdp_get_rtpmap_codec(vrtpmap->value);
-					}
-					if(dovideo &&
-							(vport == NULL || vport->value == NULL ||
-							janus_string_to_uint16(vport->value, &video_port) < 0 ||
-							vpt == NULL || vpt->value == NULL || videocodec == NULL)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for video...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					if(dovideo && vrtcpport != NULL && vrtcpport->value != NULL &&
-							(janus_string_to_uint16(vrtcpport->value, &video_rtcp_port) < 0)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid video RTCP port...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					gboolean dovideortcp = (vrtcpport != NULL && vrtcpport->value != NULL);
-					if(dovideo && vport2 != NULL && vport2->value != NULL &&
-							(janus_string_to_uint16(vport2->value, &video_port2) < 0)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid simulcast port...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					if(dovideo && vport3 != NULL && vport3->value != NULL &&
-							(janus_string_to_uint16(vport3->value, &video_port3) < 0)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid simulcast port...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					if(dovideo && viface) {
-						if(!ifas) {
-							JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						if(janus_network_lookup_interface(ifas, viface->value, &video_iface) != 0) {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for video...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-					}
-					uint16_t data_port = 0;
-					if(dodata && (dport == NULL || dport->value == NULL ||
-							janus_string_to_uint16(dport->value, &data_port) < 0)) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for data...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-	#ifndef HAVE_SCTP
-					if(dodata) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s': no datachannels support......\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-	#endif
-					if(dodata && diface) {
-						if(!ifas) {
-							JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						if(janus_network_lookup_interface(ifas, diface->value, &data_iface) != 0) {
-							JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for data...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-					}
-					/* Create the individual streams */
-					if(doaudio) {
-						/* Create the audio source stream */
-						janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
-							cat->name, g_list_length(streams),
-							"audio", "a", "audio", NULL,
-							amcast ? (char *)amcast->value : NULL,
-							aiface && aiface->value ? (char *)aiface->value : NULL,
-							aiface && aiface->value ? &audio_iface : NULL,
-							(aport && aport->value) ? atoi(aport->value) : 0, 0, 0,
-							doaudiortcp, (artcpport && artcpport->value) ? atoi(artcpport->value) : 0,
-							(apt && apt->value) ? atoi(apt->value) : 0,
-							(char *)audiocodec,
-							afmtp ? (char *)afmtp->value : NULL, NULL,
-							doaskew, FALSE, FALSE, FALSE, FALSE, FALSE);
-						if(stream == NULL) {
-							JANUS_LOG(LOG_ERR, "Skipping 'audio' stream '%s', error creating source stream...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						/* Add to the list of streams */
-						streams = g_list_append(streams, stream);
-					}
-					if(dovideo) {
-						/* Create the video source stream */
-						janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
-							cat->name, g_list_length(streams),
-							"video", "v", "video", NULL,
-							vmcast ? (char *)vmcast->value : NULL,
-							viface && viface->value ? (char *)viface->value : NULL,
-							viface && viface->value ? &video_iface : NULL,
-							(vport && vport->value) ? atoi(vport->value) : 0,
-							(vport2 && vport2->value) ? atoi(vport2->value) : 0,
-							(vport3 && vport3->value) ? atoi(vport3->value) : 0,
-							dovideortcp, (vrtcpport && vrtcpport->value) ? atoi(vrtcpport->value) : 0,
-							(vpt && vpt->value) ? atoi(vpt->value) : 0,
-							(char *)videocodec,
-							vfmtp ? (char *)vfmtp->value : NULL,
-							vsps ? (char *)vsps->value : NULL,
-							dovskew, bufferkf, simulcast, dosvc, FALSE, FALSE);
-						if(stream == NULL) {
-							JANUS_LOG(LOG_ERR, "Skipping 'video' stream '%s', error creating source stream...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						/* Add to the list of streams */
-						streams = g_list_append(streams, stream);
-					}
-					if(dodata) {
-						/* Create the data source stream */
-						janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
-							cat->name, g_list_length(streams),
-							"data", "d", "data", NULL,
-							dmcast ? (char *)dmcast->value : NULL,
-							diface && diface->value ? (char *)diface->value : NULL,
-							diface && diface->value ? &data_iface : NULL,
-							(dport && dport->value) ? atoi(dport->value) : 0,
-							0, 0, FALSE, 0,
-							0, NULL, NULL, NULL,
-							FALSE, FALSE, FALSE, FALSE, textdata, buffermsg);
-						if(stream == NULL) {
-							JANUS_LOG(LOG_ERR, "Skipping 'data' stream '%s', error creating source stream...\n", cat->name);
-							cl = cl->next;
-							continue;
-						}
-						/* Add to the list of streams */
-						streams = g_list_append(streams, stream);
+					if(janus_network_lookup_interface(ifas, iface->value, &media_iface) != 0) {
+						JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', invalid network interface configuration for media stream...\n", type->value, cat->name);
+						failed = TRUE;
+						break;
 					}
 				}
-				/* Streams created, create the actual mountpoint now */
-				janus_streaming_mountpoint *mp = NULL;
-				if((mp = janus_streaming_create_rtp_source(
-						mpid, (char *)(id ? id->value : NULL),
-						(char *)cat->name,
-						desc ? (char *)desc->value : NULL,
-						md ? (char *)md->value : NULL,
-						streams,
-						ssuite && ssuite->value ? atoi(ssuite->value) : 0,
-						scrypto && scrypto->value ? (char *)scrypto->value : NULL,
-						(threads && threads->value) ? atoi(threads->value) : 0,
-						(rtpcollision && rtpcollision->value) ?  atoi(rtpcollision->value) : 0,
-						(e2ee && e2ee->value) ? janus_is_true(e2ee->value) : FALSE,
-						(pd && pd->value) ? janus_is_true(pd->value) : FALSE)) == NULL) {
-					JANUS_LOG(LOG_ERR, "Error creating 'rtp' mountpoint '%s'...\n", cat->name);
-					cl = cl->next;
-					continue;
+				/* Create the source stream */
+				janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
+					name, g_list_length(streams),
+					type->value, mid->value, (label && label->value ? label->value : type->value),
+					(msid && msid->value ? msid->value : NULL),
+					mcast ? (char *)mcast->value : NULL,
+					iface && iface->value ? (char *)iface->value : NULL,
+					iface && iface->value ? &media_iface : NULL,
+					(port && port->value) ? atoi(port->value) : 0,
+					(vport2 && vport2->value) ? atoi(vport2->value) : 0,
+					(vport3 && vport3->value) ? atoi(vport3->value) : 0,
+					(rtcpport && rtcpport->value),
+						(rtcpport && rtcpport->value) ? atoi(rtcpport->value) : 0,
+					(pt && pt->value) ? atoi(pt->value) : 0,
+					(char *)streamcodec,
+					fmtp ? (char *)fmtp->value : NULL,
+					vsps ? (char *)vsps->value : NULL,
+					doskew, bufferkf, simulcast, dosvc, textdata, buffermsg);
+				if(stream == NULL) {
+					JANUS_LOG(LOG_ERR, "Can't add '%s' stream '%s', error creating source stream...\n", type->value, cat->name);
+					failed = TRUE;
+					break;
 				}
-				mp->is_private = is_private;
-				if(secret && secret->value)
-					mp->secret = g_strdup(secret->value);
-				if(pin && pin->value)
-					mp->pin = g_strdup(pin->value);
-			} else if(!strcasecmp(type->value, "live")) {
-				/* File-based live source */
-				janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-				janus_config_item *md = janus_config_get(config, cat, janus_config_type_item, "metadata");
-				janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-				janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-				janus_config_item *file = janus_config_get(config, cat, janus_config_type_item, "filename");
-				janus_config_item *audio = janus_config_get(config, cat, janus_config_type_item, "audio");
-				janus_config_item *apt = janus_config_get(config, cat, janus_config_type_item, "audiopt");
-				janus_config_item *acodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
-				janus_config_item *artpmap = janus_config_get(config, cat, janus_config_type_item, "audiortpmap");
-				janus_config_item *afmtp = janus_config_get(config, cat, janus_config_type_item, "audiofmtp");
-				janus_config_item *video = janus_config_get(config, cat, janus_config_type_item, "video");
-				if(file == NULL || file->value == NULL) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', missing mandatory information...\n", cat->name);
-					cl = cl->next;
-					continue;
+				/* Add to the list of streams */
+				streams = g_list_append(streams, stream);
+				/* Go on */
+				ml = ml->next;
+			}
+			if(failed) {
+				return -1;
+			}
+		} else {
+			/* If we got here, we create a mountpoint the "old" way */
+			janus_network_address video_iface, audio_iface, data_iface;
+			janus_config_item *audio = janus_config_get(mp_config, cat, janus_config_type_item, "audio");
+			janus_config_item *askew = janus_config_get(mp_config, cat, janus_config_type_item, "audioskew");
+			janus_config_item *video = janus_config_get(mp_config, cat, janus_config_type_item, "video");
+			janus_config_item *vskew = janus_config_get(mp_config, cat, janus_config_type_item, "videoskew");
+			janus_config_item *vsvc = janus_config_get(mp_config, cat, janus_config_type_item, "videosvc");
+			janus_config_item *data = janus_config_get(mp_config, cat, janus_config_type_item, "data");
+			janus_config_item *amcast = janus_config_get(mp_config, cat, janus_config_type_item, "audiomcast");
+			janus_config_item *aiface = janus_config_get(mp_config, cat, janus_config_type_item, "audioiface");
+			janus_config_item *aport = janus_config_get(mp_config, cat, janus_config_type_item, "audioport");
+			janus_config_item *artcpport = janus_config_get(mp_config, cat, janus_config_type_item, "audiortcpport");
+			janus_config_item *apt = janus_config_get(mp_config, cat, janus_config_type_item, "audiopt");
+			janus_config_item *acodec = janus_config_get(mp_config, cat, janus_config_type_item, "audiocodec");
+			janus_config_item *artpmap = janus_config_get(mp_config, cat, janus_config_type_item, "audiortpmap");
+			janus_config_item *afmtp = janus_config_get(mp_config, cat, janus_config_type_item, "audiofmtp");
+			janus_config_item *vmcast = janus_config_get(mp_config, cat, janus_config_type_item, "videomcast");
+			janus_config_item *viface = janus_config_get(mp_config, cat, janus_config_type_item, "videoiface");
+			janus_config_item *vport = janus_config_get(mp_config, cat, janus_config_type_item, "videoport");
+			janus_config_item *vrtcpport = janus_config_get(mp_config, cat, janus_config_type_item, "videortcpport");
+			janus_config_item *vpt = janus_config_get(mp_config, cat, janus_config_type_item, "videopt");
+			janus_config_item *vcodec = janus_config_get(mp_config, cat, janus_config_type_item, "videocodec");
+			janus_config_item *vrtpmap = janus_config_get(mp_config, cat, janus_config_type_item, "videortpmap");
+			janus_config_item *vfmtp = janus_config_get(mp_config, cat, janus_config_type_item, "videofmtp");
+			janus_config_item *vsps = janus_config_get(mp_config, cat, janus_config_type_item, "h264sps");
+			janus_config_item *vkf = janus_config_get(mp_config, cat, janus_config_type_item, "videobufferkf");
+			janus_config_item *vsc = janus_config_get(mp_config, cat, janus_config_type_item, "videosimulcast");
+			janus_config_item *vport2 = janus_config_get(mp_config, cat, janus_config_type_item, "videoport2");
+			janus_config_item *vport3 = janus_config_get(mp_config, cat, janus_config_type_item, "videoport3");
+			janus_config_item *dmcast = janus_config_get(mp_config, cat, janus_config_type_item, "datamcast");
+			janus_config_item *diface = janus_config_get(mp_config, cat, janus_config_type_item, "dataiface");
+			janus_config_item *dport = janus_config_get(mp_config, cat, janus_config_type_item, "dataport");
+			janus_config_item *dbm = janus_config_get(mp_config, cat, janus_config_type_item, "databuffermsg");
+			janus_config_item *dt = janus_config_get(mp_config, cat, janus_config_type_item, "datatype");
+			gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
+			gboolean doaskew = audio && askew && askew->value && janus_is_true(askew->value);
+			gboolean dovideo = video && video->value && janus_is_true(video->value);
+			gboolean dovskew = video && vskew && vskew->value && janus_is_true(vskew->value);
+			gboolean dosvc = video && vsvc && vsvc->value && janus_is_true(vsvc->value);
+			gboolean dodata = data && data->value && janus_is_true(data->value);
+			gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
+			gboolean simulcast = video && vsc && vsc->value && janus_is_true(vsc->value);
+			if(simulcast && bufferkf) {
+				/* FIXME We'll need to take care of this */
+				JANUS_LOG(LOG_WARN, "Simulcasting enabled, so disabling buffering of keyframes\n");
+				bufferkf = FALSE;
+			}
+			gboolean buffermsg = data && dbm && dbm->value && janus_is_true(dbm->value);
+			gboolean textdata = TRUE;
+			if(data && dt && dt->value) {
+				if(!strcasecmp(dt->value, "text"))
+					textdata = TRUE;
+				else if(!strcasecmp(dt->value, "binary"))
+					textdata = FALSE;
+				else {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid data type '%s'...\n", cat->name, dt->value);
+					return -1;
 				}
-				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
-				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
-				gboolean dovideo = video && video->value && janus_is_true(video->value);
-				/* We only support audio for file-based streaming at the moment: for streaming
-				 * files using other codecs/formats an external tools should feed us RTP instead */
-				if(!doaudio || dovideo) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', we only support audio file streaming right now...\n", cat->name);
-					cl = cl->next;
-					continue;
+			}
+			if(!doaudio && !dovideo && !dodata) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', no audio, video or data have to be streamed...\n", cat->name);
+				return -1;
+			}
+			uint16_t audio_port = 0, audio_rtcp_port = 0;
+			const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
+			if(audiocodec == NULL) {
+				/* No audiocodec property, chech the deprecated audiortpmap */
+				if(artpmap && artpmap->value)
+					audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
+			}
+			if(doaudio &&
+					(aport == NULL || aport->value == NULL ||
+					janus_string_to_uint16(aport->value, &audio_port) < 0 ||
+					apt == NULL || apt->value == NULL || audiocodec == NULL)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for audio...\n", cat->name);
+				return -1;
+			}
+			if(doaudio && artcpport != NULL && artcpport->value != NULL &&
+					(janus_string_to_uint16(artcpport->value, &audio_rtcp_port) < 0)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid audio RTCP port...\n", cat->name);
+				return -1;
+			}
+			gboolean doaudiortcp = (artcpport != NULL && artcpport->value != NULL);
+			if(doaudio && aiface) {
+				if(!ifas) {
+					JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
+					return -1;
 				}
-#ifdef HAVE_LIBOGG
-				if(!strstr(file->value, ".opus") && !strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support Opus and raw mu-Law/a-Law files right now)\n", cat->name);
-#else
-				if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
-#endif
-					cl = cl->next;
-					continue;
+				if(janus_network_lookup_interface(ifas, aiface->value, &audio_iface) != 0) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for audio...\n", cat->name);
+					return -1;
 				}
-				FILE *audiofile = fopen(file->value, "rb");
-				if(!audiofile) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint, no such file '%s'...\n", file->value);
-					cl = cl->next;
-					continue;
+			}
+			uint16_t video_port = 0, video_port2 = 0, video_port3 = 0, video_rtcp_port = 0;
+			const char *videocodec = (vcodec && vcodec->value ? vcodec->value : NULL);
+			if(videocodec == NULL) {
+				/* No videocodec property, chech the deprecated videortpmap */
+				if(vrtpmap && vrtpmap->value)
+					videocodec = janus_sdp_get_rtpmap_codec(vrtpmap->value);
+			}
+			if(dovideo &&
+					(vport == NULL || vport->value == NULL ||
+					janus_string_to_uint16(vport->value, &video_port) < 0 ||
+					vpt == NULL || vpt->value == NULL || videocodec == NULL)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for video...\n", cat->name);
+				return -1;
+			}
+			if(dovideo && vrtcpport != NULL && vrtcpport->value != NULL &&
+					(janus_string_to_uint16(vrtcpport->value, &video_rtcp_port) < 0)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid video RTCP port...\n", cat->name);
+				return -1;
+			}
+			gboolean dovideortcp = (vrtcpport != NULL && vrtcpport->value != NULL);
+			if(dovideo && vport2 != NULL && vport2->value != NULL &&
+					(janus_string_to_uint16(vport2->value, &video_port2) < 0)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid simulcast port...\n", cat->name);
+				return -1;
+			}
+			if(dovideo && vport3 != NULL && vport3->value != NULL &&
+					(janus_string_to_uint16(vport3->value, &video_port3) < 0)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid simulcast port...\n", cat->name);
+				return -1;
+			}
+			if(dovideo && viface) {
+				if(!ifas) {
+					JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
+					return -1;
 				}
-				fclose(audiofile);
-				const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
-				if(audiocodec == NULL) {
-					/* No audiocodec property, chech the deprecated audiortpmap */
-					if(artpmap && artpmap->value)
-						audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
-				}
-
-				janus_streaming_mountpoint *mp = NULL;
-				if((mp = janus_streaming_create_file_source(
-						mpid, (char *)(id ? id->value : NULL),
-						(char *)cat->name,
-						desc ? (char *)desc->value : NULL,
-						md ? (char *)md->value : NULL,
-						(char *)file->value, TRUE,
-						doaudio,
-						(apt && apt->value) ? atoi(apt->value) : 0,
-						(char *)audiocodec,
-						afmtp ? (char *)afmtp->value : NULL,
-						dovideo)) == NULL) {
-					JANUS_LOG(LOG_ERR, "Error creating 'live' mountpoint '%s'...\n", cat->name);
-					cl = cl->next;
-					continue;
+				if(janus_network_lookup_interface(ifas, viface->value, &video_iface) != 0) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for video...\n", cat->name);
+					return -1;
 				}
-				mp->is_private = is_private;
-				if(secret && secret->value)
-					mp->secret = g_strdup(secret->value);
-				if(pin && pin->value)
-					mp->pin = g_strdup(pin->value);
-			} else if(!strcasecmp(type->value, "ondemand")) {
-				/* File-based on demand source */
-				janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-				janus_config_item *md = janus_config_get(config, cat, janus_config_type_item, "metadata");
-				janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-				janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-				janus_config_item *file = janus_config_get(config, cat, janus_config_type_item, "filename");
-				janus_config_item *audio = janus_config_get(config, cat, janus_config_type_item, "audio");
-				janus_config_item *apt = janus_config_get(config, cat, janus_config_type_item, "audiopt");
-				janus_config_item *acodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
-				janus_config_item *artpmap = janus_config_get(config, cat, janus_config_type_item, "audiortpmap");
-				janus_config_item *afmtp = janus_config_get(config, cat, janus_config_type_item, "audiofmtp");
-				janus_config_item *video = janus_config_get(config, cat, janus_config_type_item, "video");
-				if(file == NULL || file->value == NULL) {
-					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', missing mandatory information...\n", cat->name);
-					cl = cl->next;
-					continue;
+			}
+			uint16_t data_port = 0;
+			if(dodata && (dport == NULL || dport->value == NULL ||
+					janus_string_to_uint16(dport->value, &data_port) < 0)) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', missing mandatory information for data...\n", cat->name);
+				return -1;
+			}
+	#ifndef HAVE_SCTP
+			if(dodata) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s': no datachannels support......\n", cat->name);
+				return -1;
+			}
+	#endif
+			if(dodata && diface) {
+				if(!ifas) {
+					JANUS_LOG(LOG_ERR, "Skipping 'rtp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
+					return -1;
 				}
-				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
-				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
-				gboolean dovideo = video && video->value && janus_is_true(video->value);
-				/* We only support audio for file-based streaming at the moment: for streaming
-				 * files using other codecs/formats an external tools should feed us RTP instead */
-				if(!doaudio || dovideo) {
-					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', we only support audio file streaming right now...\n", cat->name);
-					cl = cl->next;
-					continue;
+				if(janus_network_lookup_interface(ifas, diface->value, &data_iface) != 0) {
+					JANUS_LOG(LOG_ERR, "Can't add 'rtp' mountpoint '%s', invalid network interface configuration for data...\n", cat->name);
+					return -1;
 				}
-#ifdef HAVE_LIBOGG
-				if(!strstr(file->value, ".opus") && !strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support Opus and raw mu-Law/a-Law files right now)\n", cat->name);
-#else
-				if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
-					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
-#endif
-					cl = cl->next;
-					continue;
+			}
+			/* Create the individual streams */
+			if(doaudio) {
+				/* Create the audio source stream */
+				janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
+					name, g_list_length(streams),
+					"audio", "a", "audio", NULL,
+					amcast ? (char *)amcast->value : NULL,
+					aiface && aiface->value ? (char *)aiface->value : NULL,
+					aiface && aiface->value ? &audio_iface : NULL,
+					(aport && aport->value) ? atoi(aport->value) : 0, 0, 0,
+					doaudiortcp, (artcpport && artcpport->value) ? atoi(artcpport->value) : 0,
+					(apt && apt->value) ? atoi(apt->value) : 0,
+					(char *)audiocodec,
+					afmtp ? (char *)afmtp->value : NULL, NULL,
+					doaskew, FALSE, FALSE, FALSE, FALSE, FALSE);
+				if(stream == NULL) {
+					JANUS_LOG(LOG_ERR, "Skipping 'audio' stream '%s', error creating source stream...\n", cat->name);
+					return -1;
 				}
-				FILE *audiofile = fopen(file->value, "rb");
-				if(!audiofile) {
-					JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint, no such file '%s'...\n", file->value);
-					cl = cl->next;
-					continue;
+				/* Add to the list of streams */
+				streams = g_list_append(streams, stream);
+			}
+			if(dovideo) {
+				/* Create the video source stream */
+				janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
+					name, g_list_length(streams),
+					"video", "v", "video", NULL,
+					vmcast ? (char *)vmcast->value : NULL,
+					viface && viface->value ? (char *)viface->value : NULL,
+					viface && viface->value ? &video_iface : NULL,
+					(vport && vport->value) ? atoi(vport->value) : 0,
+					(vport2 && vport2->value) ? atoi(vport2->value) : 0,
+					(vport3 && vport3->value) ? atoi(vport3->value) : 0,
+					dovideortcp, (vrtcpport && vrtcpport->value) ? atoi(vrtcpport->value) : 0,
+					(vpt && vpt->value) ? atoi(vpt->value) : 0,
+					(char *)videocodec,
+					vfmtp ? (char *)vfmtp->value : NULL,
+					vsps ? (char *)vsps->value : NULL,
+					dovskew, bufferkf, simulcast, dosvc, FALSE, FALSE);
+				if(stream == NULL) {
+					JANUS_LOG(LOG_ERR, "Skipping 'video' stream '%s', error creating source stream...\n", cat->name);
+					return -1;
 				}
-				fclose(audiofile);
-				const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
-				if(audiocodec == NULL) {
-					/* No audiocodec property, chech the deprecated audiortpmap */
-					if(artpmap && artpmap->value)
-						audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
-				}
-
-				janus_streaming_mountpoint *mp = NULL;
-				if((mp = janus_streaming_create_file_source(
-						mpid, (char *)(id ? id->value : NULL),
-						(char *)cat->name,
-						desc ? (char *)desc->value : NULL,
-						md ? (char *)md->value : NULL,
-						(char *)file->value, FALSE,
-						doaudio,
-						(apt && apt->value) ? atoi(apt->value) : 0,
-						(char *)audiocodec,
-						afmtp ? (char *)afmtp->value : NULL,
-						dovideo)) == NULL) {
-					JANUS_LOG(LOG_ERR, "Error creating 'ondemand' mountpoint '%s'...\n", cat->name);
-					cl = cl->next;
-					continue;
+				/* Add to the list of streams */
+				streams = g_list_append(streams, stream);
+			}
+			if(dodata) {
+				/* Create the data source stream */
+				janus_streaming_rtp_source_stream *stream = janus_streaming_create_rtp_source_stream(
+					name, g_list_length(streams),
+					"data", "d", "data", NULL,
+					dmcast ? (char *)dmcast->value : NULL,
+					diface && diface->value ? (char *)diface->value : NULL,
+					diface && diface->value ? &data_iface : NULL,
+					(dport && dport->value) ? atoi(dport->value) : 0,
+					0, 0, FALSE, 0,
+					0, NULL, NULL, NULL,
+					FALSE, FALSE, FALSE, FALSE, textdata, buffermsg);
+				if(stream == NULL) {
+					JANUS_LOG(LOG_ERR, "Skipping 'data' stream '%s', error creating source stream...\n", cat->name);
+					return -1;
 				}
-				mp->is_private = is_private;
-				if(secret && secret->value)
-					mp->secret = g_strdup(secret->value);
-				if(pin && pin->value)
-					mp->pin = g_strdup(pin->value);
-			} else if(!strcasecmp(type->value, "rtsp")) {
+				/* Add to the list of streams */
+				streams = g_list_append(streams, stream);
+			}
+		}
+		/* Streams created, create the actual mountpoint now */
+		janus_streaming_mountpoint *mp = NULL;
+		if((mp = janus_streaming_create_rtp_source(
+				mpid, (char *)(id ? id->value : NULL),
+				(char *)name,
+				desc ? (char *)desc->value : NULL,
+				md ? (char *)md->value : NULL,
+				streams,
+				ssuite && ssuite->value ? atoi(ssuite->value) : 0,
+				scrypto && scrypto->value ? (char *)scrypto->value : NULL,
+				(threads && threads->value) ? atoi(threads->value) : 0,
+				(rtpcollision && rtpcollision->value) ?  atoi(rtpcollision->value) : 0,
+				(e2ee && e2ee->value) ? janus_is_true(e2ee->value) : FALSE,
+				(pd && pd->value) ? janus_is_true(pd->value) : FALSE)) == NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating 'rtp' mountpoint '%s'...\n", cat->name);
+			return -1;
+		}
+		mp->is_private = is_private;
+		janus_streaming_mcast_out_config(mp_config, mp, cat);
+		if(secret && secret->value)
+			mp->secret = g_strdup(secret->value);
+		if(pin && pin->value)
+			mp->pin = g_strdup(pin->value);
+	} else if(!strcasecmp(type->value, "live")) {
+		/* File-based live source */
+		janus_config_item *desc = janus_config_get(mp_config, cat, janus_config_type_item, "description");
+		janus_config_item *md = janus_config_get(mp_config, cat, janus_config_type_item, "metadata");
+		janus_config_item *priv = janus_config_get(mp_config, cat, janus_config_type_item, "is_private");
+		janus_config_item *secret = janus_config_get(mp_config, cat, janus_config_type_item, "secret");
+		janus_config_item *pin = janus_config_get(mp_config, cat, janus_config_type_item, "pin");
+		janus_config_item *file = janus_config_get(mp_config, cat, janus_config_type_item, "filename");
+		janus_config_item *audio = janus_config_get(mp_config, cat, janus_config_type_item, "audio");
+		janus_config_item *apt = janus_config_get(mp_config, cat, janus_config_type_item, "audiopt");
+		janus_config_item *acodec = janus_config_get(mp_config, cat, janus_config_type_item, "audiocodec");
+		janus_config_item *artpmap = janus_config_get(mp_config, cat, janus_config_type_item, "audiortpmap");
+		janus_config_item *afmtp = janus_config_get(mp_config, cat, janus_config_type_item, "audiofmtp");
+		janus_config_item *video = janus_config_get(mp_config, cat, janus_config_type_item, "video");
+		if(file == NULL || file->value == NULL) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', missing mandatory information...\n", cat->name);
+			return -1;
+		}
+		gboolean is_private = priv && priv->value && janus_is_true(priv->value);
+		gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
+		gboolean dovideo = video && video->value && janus_is_true(video->value);
+		/* We only support audio for file-based streaming at the moment: for streaming
+		 * files using other codecs/formats an external tools should feed us RTP instead */
+		if(!doaudio || dovideo) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', we only support audio file streaming right now...\n", cat->name);
+			return -1;
+		}
+#ifdef HAVE_LIBOGG
+		if(!strstr(file->value, ".opus") && !strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support Opus and raw mu-Law/a-Law files right now)\n", cat->name);
+#else
+		if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
+#endif
+			return -1;
+		}
+		FILE *audiofile = fopen(file->value, "rb");
+		if(!audiofile) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint, no such file '%s'...\n", file->value);
+			return -1;
+		}
+		fclose(audiofile);
+		const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
+		if(audiocodec == NULL) {
+			/* No audiocodec property, chech the deprecated audiortpmap */
+			if(artpmap && artpmap->value)
+				audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
+		}
+
+		janus_streaming_mountpoint *mp = NULL;
+		if((mp = janus_streaming_create_file_source(
+				mpid, (char *)(id ? id->value : NULL),
+				(char *)name,
+				desc ? (char *)desc->value : NULL,
+				md ? (char *)md->value : NULL,
+				(char *)file->value, TRUE,
+				doaudio,
+				(apt && apt->value) ? atoi(apt->value) : 0,
+				(char *)audiocodec,
+				afmtp ? (char *)afmtp->value : NULL,
+				dovideo)) == NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating 'live' mountpoint '%s'...\n", cat->name);
+			return -1;
+		}
+		mp->is_private = is_private;
+		if(secret && secret->value)
+			mp->secret = g_strdup(secret->value);
+		if(pin && pin->value)
+			mp->pin = g_strdup(pin->value);
+	} else if(!strcasecmp(type->value, "ondemand")) {
+		/* File-based on demand source */
+		janus_config_item *desc = janus_config_get(mp_config, cat, janus_config_type_item, "description");
+		janus_config_item *md = janus_config_get(mp_config, cat, janus_config_type_item, "metadata");
+		janus_config_item *priv = janus_config_get(mp_config, cat, janus_config_type_item, "is_private");
+		janus_config_item *secret = janus_config_get(mp_config, cat, janus_config_type_item, "secret");
+		janus_config_item *pin = janus_config_get(mp_config, cat, janus_config_type_item, "pin");
+		janus_config_item *file = janus_config_get(mp_config, cat, janus_config_type_item, "filename");
+		janus_config_item *audio = janus_config_get(mp_config, cat, janus_config_type_item, "audio");
+		janus_config_item *apt = janus_config_get(mp_config, cat, janus_config_type_item, "audiopt");
+		janus_config_item *acodec = janus_config_get(mp_config, cat, janus_config_type_item, "audiocodec");
+		janus_config_item *artpmap = janus_config_get(mp_config, cat, janus_config_type_item, "audiortpmap");
+		janus_config_item *afmtp = janus_config_get(mp_config, cat, janus_config_type_item, "audiofmtp");
+		janus_config_item *video = janus_config_get(mp_config, cat, janus_config_type_item, "video");
+		janus_config_item *syncw = janus_config_get(mp_config, cat, janus_config_type_item, "sync_window");
+		if(file == NULL || file->value == NULL) {
+			JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', missing mandatory information...\n", cat->name);
+			return -1;
+		}
+		gboolean is_private = priv && priv->value && janus_is_true(priv->value);
+		gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
+		gboolean dovideo = video && video->value && janus_is_true(video->value);
+		/* We only support audio for file-based streaming at the moment: for streaming
+		 * files using other codecs/formats an external tools should feed us RTP instead */
+		if(!doaudio || dovideo) {
+			JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', we only support audio file streaming right now...\n", cat->name);
+			return -1;
+		}
+#ifdef HAVE_LIBOGG
+		if(!strstr(file->value, ".opus") && !strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
+			JANUS_LOG(LOG_ERR, "Can't add 'live' mountpoint '%s', unsupported format (we only support Opus and raw mu-Law/a-Law files right now)\n", cat->name);
+#else
+		if(!strstr(file->value, ".alaw") && !strstr(file->value, ".mulaw")) {
+			JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint '%s', unsupported format (we only support raw mu-Law and a-Law files right now)\n", cat->name);
+#endif
+			return -1;
+		}
+		FILE *audiofile = fopen(file->value, "rb");
+		if(!audiofile) {
+			JANUS_LOG(LOG_ERR, "Can't add 'ondemand' mountpoint, no such file '%s'...\n", file->value);
+			return -1;
+		}
+		fclose(audiofile);
+		const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
+		if(audiocodec == NULL) {
+			/* No audiocodec property, chech the deprecated audiortpmap */
+			if(artpmap && artpmap->value)
+				audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
+		}
+
+		janus_streaming_mountpoint *mp = NULL;
+		if((mp = janus_streaming_create_file_source(
+				mpid, (char *)(id ? id->value : NULL),
+				(char *)name,
+				desc ? (char *)desc->value : NULL,
+				md ? (char *)md->value : NULL,
+				(char *)file->value, FALSE,
+				doaudio,
+				(apt && apt->value) ? atoi(apt->value) : 0,
+				(char *)audiocodec,
+				afmtp ? (char *)afmtp->value : NULL,
+				dovideo)) == NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating 'ondemand' mountpoint '%s'...\n", cat->name);
+			return -1;
+		}
+		if(syncw != NULL && syncw->value != NULL) {
+			int window = atoi(syncw->value);
+			if(window < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid sync window (%s), viewers won't be synchronized\n", syncw->value);
+			} else {
+				janus_streaming_file_source *source = mp->source;
+				source->sync_window = window;
+			}
+		}
+		mp->is_private = is_private;
+		if(secret && secret->value)
+			mp->secret = g_strdup(secret->value);
+		if(pin && pin->value)
+			mp->pin = g_strdup(pin->value);
+	} else if(!strcasecmp(type->value, "rtsp")) {
 #ifndef HAVE_LIBCURL
-				JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', libcurl support not compiled...\n", cat->name);
-				cl = cl->next;
-				continue;
+		JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', libcurl support not compiled...\n", cat->name);
+		return -1;
 #else
-				janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-				janus_config_item *md = janus_config_get(config, cat, janus_config_type_item, "metadata");
-				janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-				janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-				janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-				janus_config_item *file = janus_config_get(config, cat, janus_config_type_item, "url");
-				janus_config_item *username = janus_config_get(config, cat, janus_config_type_item, "rtsp_user");
-				janus_config_item *password = janus_config_get(config, cat, janus_config_type_item, "rtsp_pwd");
-				janus_config_item *quirk = janus_config_get(config, cat, janus_config_type_item, "rtsp_quirk");
-				janus_config_item *audio = janus_config_get(config, cat, janus_config_type_item, "audio");
-				janus_config_item *acodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
-				janus_config_item *artpmap = janus_config_get(config, cat, janus_config_type_item, "audiortpmap");
-				janus_config_item *apt = janus_config_get(config, cat, janus_config_type_item, "audiopt");
-				janus_config_item *afmtp = janus_config_get(config, cat, janus_config_type_item, "audiofmtp");
-				janus_config_item *video = janus_config_get(config, cat, janus_config_type_item, "video");
-				janus_config_item *vpt = janus_config_get(config, cat, janus_config_type_item, "videopt");
-				janus_config_item *vcodec = janus_config_get(config, cat, janus_config_type_item, "videocodec");
-				janus_config_item *vrtpmap = janus_config_get(config, cat, janus_config_type_item, "videortpmap");
-				janus_config_item *vfmtp = janus_config_get(config, cat, janus_config_type_item, "videofmtp");
-				janus_config_item *vkf = janus_config_get(config, cat, janus_config_type_item, "videobufferkf");
-				janus_config_item *iface = janus_config_get(config, cat, janus_config_type_item, "rtspiface");
-				janus_config_item *failerr = janus_config_get(config, cat, janus_config_type_item, "rtsp_failcheck");
-				janus_config_item *threads = janus_config_get(config, cat, janus_config_type_item, "threads");
-				janus_config_item *reconnect_delay = janus_config_get(config, cat, janus_config_type_item, "rtsp_reconnect_delay");
-				janus_config_item *session_timeout = janus_config_get(config, cat, janus_config_type_item, "rtsp_session_timeout");
-				janus_config_item *rtsp_timeout = janus_config_get(config, cat, janus_config_type_item, "rtsp_timeout");
-				janus_config_item *rtsp_conn_timeout = janus_config_get(config, cat, janus_config_type_item, "rtsp_conn_timeout");
-				janus_network_address iface_value;
-				if(file == NULL || file->value == NULL) {
-					JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', missing mandatory information...\n", cat->name);
-					cl = cl->next;
-					continue;
-				}
-				gboolean is_private = priv && priv->value && janus_is_true(priv->value);
-				gboolean rtsp_quirk = quirk && quirk->value && janus_is_true(quirk->value);
-				gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
-				gboolean dovideo = video && video->value && janus_is_true(video->value);
-				gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
-				gboolean error_on_failure = TRUE;
-				if(failerr && failerr->value)
-					error_on_failure = janus_is_true(failerr->value);
-				if(threads && threads->value && atoi(threads->value) < 0) {
-					JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', invalid threads configuration...\n", cat->name);
-					cl = cl->next;
-					continue;
-				}
+		janus_config_item *desc = janus_config_get(mp_config, cat, janus_config_type_item, "description");
+		janus_config_item *md = janus_config_get(mp_config, cat, janus_config_type_item, "metadata");
+		janus_config_item *priv = janus_config_get(mp_config, cat, janus_config_type_item, "is_private");
+		janus_config_item *secret = janus_config_get(mp_config, cat, janus_config_type_item, "secret");
+		janus_config_item *pin = janus_config_get(mp_config, cat, janus_config_type_item, "pin");
+		janus_config_item *file = janus_config_get(mp_config, cat, janus_config_type_item, "url");
+		janus_config_item *username = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_user");
+		janus_config_item *password = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_pwd");
+		janus_config_item *quirk = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_quirk");
+		janus_config_item *audio = janus_config_get(mp_config, cat, janus_config_type_item, "audio");
+		janus_config_item *acodec = janus_config_get(mp_config, cat, janus_config_type_item, "audiocodec");
+		janus_config_item *artpmap = janus_config_get(mp_config, cat, janus_config_type_item, "audiortpmap");
+		janus_config_item *apt = janus_config_get(mp_config, cat, janus_config_type_item, "audiopt");
+		janus_config_item *afmtp = janus_config_get(mp_config, cat, janus_config_type_item, "audiofmtp");
+		janus_config_item *video = janus_config_get(mp_config, cat, janus_config_type_item, "video");
+		janus_config_item *vpt = janus_config_get(mp_config, cat, janus_config_type_item, "videopt");
+		janus_config_item *vcodec = janus_config_get(mp_config, cat, janus_config_type_item, "videocodec");
+		janus_config_item *vrtpmap = janus_config_get(mp_config, cat, janus_config_type_item, "videortpmap");
+		janus_config_item *vfmtp = janus_config_get(mp_config, cat, janus_config_type_item, "videofmtp");
+		janus_config_item *vkf = janus_config_get(mp_config, cat, janus_config_type_item, "videobufferkf");
+		janus_config_item *iface = janus_config_get(mp_config, cat, janus_config_type_item, "rtspiface");
+		janus_config_item *failerr = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_failcheck");
+		janus_config_item *threads = janus_config_get(mp_config, cat, janus_config_type_item, "threads");
+		janus_config_item *reconnect_delay = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_reconnect_delay");
+		janus_config_item *session_timeout = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_session_timeout");
+		janus_config_item *rtsp_timeout = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_timeout");
+		janus_config_item *rtsp_conn_timeout = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_conn_timeout");
+		janus_config_item *lazy = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_lazy");
+		janus_config_item *idle_timeout = janus_config_get(mp_config, cat, janus_config_type_item, "rtsp_idle_timeout");
+		janus_network_address iface_value;
+		if(file == NULL || file->value == NULL) {
+			JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', missing mandatory information...\n", cat->name);
+			return -1;
+		}
+		gboolean is_private = priv && priv->value && janus_is_true(priv->value);
+		gboolean rtsp_quirk = quirk && quirk->value && janus_is_true(quirk->value);
+		gboolean doaudio = audio && audio->value && janus_is_true(audio->value);
+		gboolean dovideo = video && video->value && janus_is_true(video->value);
+		gboolean bufferkf = video && vkf && vkf->value && janus_is_true(vkf->value);
+		gboolean error_on_failure = TRUE;
+		if(failerr && failerr->value)
+			error_on_failure = janus_is_true(failerr->value);
+		gboolean rtsp_lazy = lazy && lazy->value && janus_is_true(lazy->value);
+		if(threads && threads->value && atoi(threads->value) < 0) {
+			JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', invalid threads configuration...\n", cat->name);
+			return -1;
+		}
 
-				if((doaudio || dovideo) && iface && iface->value) {
-					if(!ifas) {
-						JANUS_LOG(LOG_ERR, "Skipping 'rtsp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-					if(janus_network_lookup_interface(ifas, iface->value, &iface_value) != 0) {
-						JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', invalid network interface configuration for stream...\n", cat->name);
-						cl = cl->next;
-						continue;
-					}
-				}
+		if((doaudio || dovideo) && iface && iface->value) {
+			if(!ifas) {
+				JANUS_LOG(LOG_ERR, "Skipping 'rtsp' mountpoint '%s', it relies on network configuration but network device information is unavailable...\n", cat->name);
+				return -1;
+			}
+			if(janus_network_lookup_interface(ifas, iface->value, &iface_value) != 0) {
+				JANUS_LOG(LOG_ERR, "Can't add 'rtsp' mountpoint '%s', invalid network interface configuration for stream...\n", cat->name);
+				return -1;
+			}
+		}
 
-				const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
-				if(audiocodec == NULL) {
-					/* No audiocodec property, chech the deprecated audiortpmap */
-					if(artpmap && artpmap->value)
-						audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
-				}
-				const char *videocodec = (vcodec && vcodec->value ? vcodec->value : NULL);
-				if(videocodec == NULL) {
-					/* No videocodec property, chech the deprecated videortpmap */
-					if(vrtpmap && vrtpmap->value)
-						videocodec = janus_sdp_get_rtpmap_codec(vrtpmap->value);
-				}
-
-				janus_streaming_mountpoint *mp = NULL;
-				if((mp = janus_streaming_create_rtsp_source(
-						mpid, (char *)(id ? id->value : NULL),
-						(char *)cat->name,
-						desc ? (char *)desc->value : NULL,
-						md ? (char *)md->value : NULL,
-						(char *)file->value,
-						username ? (char *)username->value : NULL,
-						password ? (char *)password->value : NULL,
-						rtsp_quirk,
-						doaudio,
-						(apt && apt->value) ? atoi(apt->value) : -1,
-						(char *)audiocodec,
-						afmtp ? (char *)afmtp->value : NULL,
-						dovideo,
-						(vpt && vpt->value) ? atoi(vpt->value) : -1,
-						(char *)videocodec,
-						vfmtp ? (char *)vfmtp->value : NULL,
-						bufferkf,
-						iface && iface->value ? &iface_value : NULL,
-						(threads && threads->value) ? atoi(threads->value) : 0,
-						((reconnect_delay && reconnect_delay->value) ? atoi(reconnect_delay->value) : JANUS_STREAMING_DEFAULT_RECONNECT_DELAY) * G_USEC_PER_SEC,
-						((session_timeout && session_timeout->value) ? atoi(session_timeout->value) : JANUS_STREAMING_DEFAULT_SESSION_TIMEOUT) * G_USEC_PER_SEC,
-						((rtsp_timeout && rtsp_timeout->value) ? atoi(rtsp_timeout->value) : JANUS_STREAMING_DEFAULT_CURL_TIMEOUT),
-						((rtsp_conn_timeout && rtsp_conn_timeout->value) ? atoi(rtsp_conn_timeout->value) : JANUS_STREAMING_DEFAULT_CURL_CONNECT_TIMEOUT),
-						error_on_failure)) == NULL) {
-					JANUS_LOG(LOG_ERR, "Error creating 'rtsp' mountpoint '%s'...\n", cat->name);
-					cl = cl->next;
-					continue;
-				}
-				mp->is_private = is_private;
-				if(secret && secret->value)
-					mp->secret = g_strdup(secret->value);
-				if(pin && pin->value)
-					mp->pin = g_strdup(pin->value);
+		const char *audiocodec = (acodec && acodec->value ? acodec->value : NULL);
+		if(audiocodec == NULL) {
+			/* No audiocodec property, chech the deprecated audiortpmap */
+			if(artpmap && artpmap->value)
+				audiocodec = janus_sdp_get_rtpmap_codec(artpmap->value);
+		}
+		const char *videocodec = (vcodec && vcodec->value ? vcodec->value : NULL);
+		if(videocodec == NULL) {
+			/* No videocodec property, chech the deprecated videortpmap */
+			if(vrtpmap && vrtpmap->value)
+				videocodec = janus_sdp_get_rtpmap_codec(vrtpmap->value);
+		}
+
+		janus_streaming_mountpoint *mp = NULL;
+		if((mp = janus_streaming_create_rtsp_source(
+				mpid, (char *)(id ? id->value : NULL),
+				(char *)name,
+				desc ? (char *)desc->value : NULL,
+				md ? (char *)md->value : NULL,
+				(char *)file->value,
+				username ? (char *)username->value : NULL,
+				password ? (char *)password->value : NULL,
+				rtsp_quirk,
+				doaudio,
+				(apt && apt->value) ? atoi(apt->value) : -1,
+				(char *)audiocodec,
+				afmtp ? (char *)afmtp->value : NULL,
+				dovideo,
+				(vpt && vpt->value) ? atoi(vpt->value) : -1,
+				(char *)videocodec,
+				vfmtp ? (char *)vfmtp->value : NULL,
+				bufferkf,
+				iface && iface->value ? &iface_value : NULL,
+				(threads && threads->value) ? atoi(threads->value) : 0,
+				((reconnect_delay && reconnect_delay->value) ? atoi(reconnect_delay->value) : JANUS_STREAMING_DEFAULT_RECONNECT_DELAY) * G_USEC_PER_SEC,
+				((session_timeout && session_timeout->value) ? atoi(session_timeout->value) : JANUS_STREAMING_DEFAULT_SESSION_TIMEOUT) * G_USEC_PER_SEC,
+				((rtsp_timeout && rtsp_timeout->value) ? atoi(rtsp_timeout->value) : JANUS_STREAMING_DEFAULT_CURL_TIMEOUT),
+				((rtsp_conn_timeout && rtsp_conn_timeout->value) ? atoi(rtsp_conn_timeout->value) : JANUS_STREAMING_DEFAULT_CURL_CONNECT_TIMEOUT),
+				rtsp_lazy,
+				((idle_timeout && idle_timeout->value) ? atoi(idle_timeout->value) : JANUS_STREAMING_DEFAULT_IDLE_TIMEOUT) * G_USEC_PER_SEC,
+				error_on_failure)) == NULL) {
+			JANUS_LOG(LOG_ERR, "Error creating 'rtsp' mountpoint '%s'...\n", cat->name);
+			return -1;
+		}
+		mp->is_private = is_private;
+		janus_streaming_mcast_out_config(mp_config, mp, cat);
+		if(secret && secret->value)
+			mp->secret = g_strdup(secret->value);
+		if(pin && pin->value)
+			mp->pin = g_strdup(pin->value);
+#endif
+	} else {
+		JANUS_LOG(LOG_WARN, "Ignoring unknown mountpoint type '%s' (%s)...\n", type->value, cat->name);
+		return -1;
+	}
+	return 0;
+}
+
+/* When a mountpoints folder is configured, the permanent mountpoints saved
+ * there are only created when first needed: this helper makes sure the
+ * mountpoint with the provided ID exists, if the folder has a file for it.
+ * Files are named after the ID, as mountpoint names may not be valid file
+ * names, and they're kept indexed after loading, as edits only update some
+ * of the properties (mountpoints_mutex must NOT be locked, as creating a
+ * mountpoint locks it) */
+static void janus_streaming_load_mountpoint(const char *id_str) {
+	if(mountpoints_folder == NULL || id_str == NULL)
+		return;
+	char cat[BUFSIZ];
+	g_snprintf(cat, BUFSIZ, "mountpoint-%s", id_str);
+	janus_mutex_lock(&mountpoints_folder_mutex);
+	guint64 id = string_ids ? 0 : g_ascii_strtoull(id_str, NULL, 0);
+	janus_mutex_lock(&mountpoints_mutex);
+	gboolean exists = g_hash_table_contains(mountpoints, string_ids ? (gpointer)id_str : (gpointer)&id);
+	janus_mutex_unlock(&mountpoints_mutex);
+	janus_config *mp_config = NULL;
+	if(!exists) {
+		/* We never lock mountpoints_mutex after config_mutex, as edits do the opposite */
+		janus_mutex_lock(&config_mutex);
+		mp_config = janus_config_folder_load(mountpoints_folder, cat);
+		janus_mutex_unlock(&config_mutex);
+	}
+	janus_config_category *c = janus_config_get(mp_config, NULL, janus_config_type_category, cat);
+	if(c != NULL) {
+		JANUS_LOG(LOG_VERB, "Loading Streaming mountpoint %s from the mountpoints folder\n", id_str);
+		janus_config_item *name = janus_config_get(mp_config, c, janus_config_type_item, "name");
+		struct ifaddrs *ifas = NULL;
+		if(getifaddrs(&ifas) == -1) {
+			JANUS_LOG(LOG_ERR, "Unable to acquire list of network devices/interfaces; some configurations may not work as expected... %d (%s)\n",
+				errno, g_strerror(errno));
+		}
+		if(janus_streaming_mountpoint_from_config(mp_config, c, (name && name->value) ? name->value : cat, ifas) < 0) {
+			/* Don't try again until a restart */
+			janus_mutex_lock(&config_mutex);
+			janus_config_folder_forget(mountpoints_folder, cat);
+			janus_mutex_unlock(&config_mutex);
+		}
+		if(ifas)
+			freeifaddrs(ifas);
+	}
+	janus_config_destroy(mp_config);
+	janus_mutex_unlock(&mountpoints_folder_mutex);
+}
+
+/* Create all the mountpoints in the mountpoints folder we haven't created yet
+ * (mountpoints_mutex must NOT be locked) */
+static void janus_streaming_load_mountpoints(void) {
+	if(mountpoints_folder == NULL)
+		return;
+	janus_mutex_lock(&config_mutex);
+	GList *names = janus_config_folder_get_names(mountpoints_folder), *l = names;
+	GList *ids = NULL;
+	while(l) {
+		const char *cat = (const char *)l->data;
+		if(strstr(cat, "mountpoint-") == cat)
+			ids = g_list_prepend(ids, g_strdup(cat + strlen("mountpoint-")));
+		l = l->next;
+	}
+	g_list_free(names);
+	janus_mutex_unlock(&config_mutex);
+	/* The names may change while we create the mountpoints, so we use copies */
+	l = ids;
+	while(l) {
+		janus_streaming_load_mountpoint((const char *)l->data);
+		l = l->next;
+	}
+	g_list_free_full(ids, (GDestroyNotify)g_free);
+}
+
+/* Check whether an ID is used by a mountpoint in the mountpoints folder, even
+ * if it wasn't created yet (config_mutex must NOT be locked) */
+static gboolean janus_streaming_folder_contains(const char *id_str) {
+	if(mountpoints_folder == NULL || id_str == NULL)
+		return FALSE;
+	char cat[BUFSIZ];
+	g_snprintf(cat, BUFSIZ, "mountpoint-%s", id_str);
+	janus_mutex_lock(&config_mutex);
+	gboolean contains = janus_config_folder_contains(mountpoints_folder, cat);
+	janus_mutex_unlock(&config_mutex);
+	return contains;
+}
+
+/* Get the configuration a permanent mountpoint should be saved to, and the
+ * category to use there (config_mutex must be locked): when a mountpoints
+ * folder is configured, mountpoints that aren't in the main configuration
+ * file get a file of their own, so that we only write what changed */
+static janus_config *janus_streaming_mountpoint_config(janus_streaming_mountpoint *mp, char *cat, size_t catlen) {
+	if(mountpoints_folder == NULL || janus_config_get(config, NULL, janus_config_type_category, mp->name) != NULL) {
+		g_snprintf(cat, catlen, "%s", mp->name);
+		return config;
+	}
+	g_snprintf(cat, catlen, "mountpoint-%s", mp->id_str);
+	janus_config *mp_config = janus_config_folder_load(mountpoints_folder, cat);
+	if(mp_config == NULL) {
+		/* New file: we keep track of the name, as the file is named after the ID */
+		mp_config = janus_config_create(cat);
+		janus_config_category *c = janus_config_get_create(mp_config, NULL, janus_config_type_category, cat);
+		janus_config_add(mp_config, c, janus_config_item_create("name", mp->name));
+	}
+	return mp_config;
+}
+
+/* Persist the changes to a mountpoint (config_mutex must be locked), and get
+ * rid of the configuration janus_streaming_mountpoint_config returned */
+static gboolean janus_streaming_save_mountpoint(janus_config *mp_config, const char *cat) {
+	if(mp_config == config)
+		return janus_config_save(config, config_folder, JANUS_STREAMING_PACKAGE) >= 0;
+	janus_config_category *c = janus_config_get(mp_config, NULL, janus_config_type_category, cat);
+	int res = c ? janus_config_folder_save(mountpoints_folder, mp_config, c) : janus_config_folder_remove(mountpoints_folder, cat);
+	janus_config_destroy(mp_config);
+	return res == 0;
+}
+
+/* Plugin implementation */
+int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
+#ifdef HAVE_LIBCURL
+	curl_global_init(CURL_GLOBAL_ALL);
+#else
+	JANUS_LOG(LOG_WARN, "libcurl not available, Streaming plugin will not have RTSP support\n");
+#endif
+#ifndef HAVE_LIBOGG
+	JANUS_LOG(LOG_WARN, "libogg not available, Streaming plugin will not have file-based Opus streaming\n");
 #endif
+	if(g_atomic_int_get(&stopping)) {
+		/* Still stopping from before */
+		return -1;
+	}
+	if(callback == NULL || config_path == NULL) {
+		/* Invalid arguments */
+		return -1;
+	}
+
+	struct ifaddrs *ifas = NULL;
+	if(getifaddrs(&ifas) == -1) {
+		JANUS_LOG(LOG_ERR, "Unable to acquire list of network devices/interfaces; some configurations may not work as expected... %d (%s)\n",
+			errno, g_strerror(errno));
+	}
+
+	/* Read configuration */
+	char filename[255];
+	g_snprintf(filename, 255, "%s/%s.jcfg", config_path, JANUS_STREAMING_PACKAGE);
+	JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+	config = janus_config_parse(filename);
+	if(config == NULL) {
+		JANUS_LOG(LOG_WARN, "Couldn't find .jcfg configuration file (%s), trying .cfg\n", JANUS_STREAMING_PACKAGE);
+		g_snprintf(filename, 255, "%s/%s.cfg", config_path, JANUS_STREAMING_PACKAGE);
+		JANUS_LOG(LOG_VERB, "Configuration file: %s\n", filename);
+		config = janus_config_parse(filename);
+	}
+	config_folder = config_path;
+	if(config != NULL)
+		janus_config_print(config);
+
+	/* Threads will expect this to be set */
+	g_atomic_int_set(&initialized, 1);
+
+	/* Parse configuration to populate the mountpoints */
+	if(config != NULL) {
+		janus_config_category *config_general = janus_config_get_create(config, NULL, janus_config_type_category, "general");
+		/* Any admin key to limit who can "create"? */
+		janus_config_item *key = janus_config_get(config, config_general, janus_config_type_item, "admin_key");
+		if(key != NULL && key->value != NULL)
+			admin_key = g_strdup(key->value);
+		janus_config_item *range = janus_config_get(config, config_general, janus_config_type_item, "rtp_port_range");
+		if(range && range->value) {
+			/* Split in min and max port */
+			char *maxport = strrchr(range->value, '-');
+			if(maxport != NULL) {
+				*maxport = '\0';
+				maxport++;
+				if(janus_string_to_uint16(range->value, &rtp_range_min) < 0)
+					JANUS_LOG(LOG_WARN, "Invalid RTP min port value: %s (assuming 0)\n", range->value);
+				if(janus_string_to_uint16(maxport, &rtp_range_max) < 0)
+					JANUS_LOG(LOG_WARN, "Invalid RTP max port value: %s (assuming 0)\n", maxport);
+				maxport--;
+				*maxport = '-';
+			}
+			if(rtp_range_min > rtp_range_max) {
+				uint16_t temp_port = rtp_range_min;
+				rtp_range_min = rtp_range_max;
+				rtp_range_max = temp_port;
+			}
+			if(rtp_range_min % 2)
+				rtp_range_min++;	/* Pick an even port for RTP */
+			if(rtp_range_min > rtp_range_max) {
+				JANUS_LOG(LOG_WARN, "Incorrect port range (%u -- %u), switching min and max\n", rtp_range_min, rtp_range_max);
+				uint16_t range_temp = rtp_range_max;
+				rtp_range_max = rtp_range_min;
+				rtp_range_min = range_temp;
+			}
+			if(rtp_range_max == 0)
+				rtp_range_max = 65535;
+			rtp_range_slider = rtp_range_min;
+			JANUS_LOG(LOG_VERB, "Streaming RTP/RTCP port range: %u -- %u\n", rtp_range_min, rtp_range_max);
+		}
+		janus_config_item *events = janus_config_get(config, config_general, janus_config_type_item, "events");
+		if(events != NULL && events->value != NULL)
+			notify_events = janus_is_true(events->value);
+		if(!notify_events && callback->events_is_enabled()) {
+			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_STREAMING_NAME);
+		}
+		janus_config_item *ids = janus_config_get(config, config_general, janus_config_type_item, "string_ids");
+		if(ids != NULL && ids->value != NULL)
+			string_ids = janus_is_true(ids->value);
+		if(string_ids) {
+			JANUS_LOG(LOG_INFO, "Streaming will use alphanumeric IDs, not numeric\n");
+		}
+		janus_config_item *mfolder = janus_config_get(config, config_general, janus_config_type_item, "mountpoints_folder");
+		if(mfolder != NULL && mfolder->value != NULL) {
+			mountpoints_folder = janus_config_folder_open(mfolder->value);
+			if(mountpoints_folder == NULL) {
+				JANUS_LOG(LOG_WARN, "Couldn't open the mountpoints folder, saving permanent mountpoints to the configuration file instead\n");
 			} else {
-				JANUS_LOG(LOG_WARN, "Ignoring unknown mountpoint type '%s' (%s)...\n", type->value, cat->name);
+				JANUS_LOG(LOG_INFO, "Streaming will save permanent mountpoints to %s, and load them on demand\n", mfolder->value);
+			}
+		}
+		janus_config_item *rt = janus_config_get(config, config_general, janus_config_type_item, "reactor_threads");
+		if(rt != NULL && rt->value != NULL) {
+			reactor_threads = atoi(rt->value);
+			if(reactor_threads < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid reactor_threads value %s, using a thread per mountpoint\n", rt->value);
+				reactor_threads = 0;
+			} else if(reactor_threads > JANUS_STREAMING_MAX_REACTOR_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many reactor threads (%d), capping to %d\n", reactor_threads, JANUS_STREAMING_MAX_REACTOR_THREADS);
+				reactor_threads = JANUS_STREAMING_MAX_REACTOR_THREADS;
+			}
+#ifndef HAVE_EPOLL
+			if(reactor_threads > 0) {
+				JANUS_LOG(LOG_WARN, "Reactor threads not supported on this platform, using a thread per mountpoint\n");
+				reactor_threads = 0;
+			}
+#endif
+		}
+		janus_config_item *rb = janus_config_get(config, config_general, janus_config_type_item, "rtp_recv_batch");
+		if(rb != NULL && rb->value != NULL) {
+			recv_batch_size = atoi(rb->value);
+			if(recv_batch_size < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid rtp_recv_batch value %s, disabling batched receive\n", rb->value);
+				recv_batch_size = 0;
+			} else if(recv_batch_size > JANUS_STREAMING_MAX_RECV_BATCH) {
+				JANUS_LOG(LOG_WARN, "Batched receive size %d too large, capping to %d\n", recv_batch_size, JANUS_STREAMING_MAX_RECV_BATCH);
+				recv_batch_size = JANUS_STREAMING_MAX_RECV_BATCH;
+			}
+#ifndef HAVE_RECVMMSG
+			if(recv_batch_size > 1) {
+				JANUS_LOG(LOG_WARN, "Batched receive not supported on this platform, reading packets one at a time\n");
+				recv_batch_size = 0;
+			}
+#endif
+			if(recv_batch_size > 1)
+				JANUS_LOG(LOG_INFO, "RTP relay threads will read up to %d packets at a time\n", recv_batch_size);
+		}
+		janus_config_item *gcs = janus_config_get(config, config_general, janus_config_type_item, "gop_cache_size");
+		if(gcs != NULL && gcs->value != NULL) {
+			int size = atoi(gcs->value);
+			if(size < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid gop_cache_size value %s, disabling the GOP cache\n", gcs->value);
+				size = 0;
+			}
+			gop_cache_size = (size_t)size * 1024;
+			if(gop_cache_size > 0)
+				JANUS_LOG(LOG_INFO, "Video streams buffering keyframes will cache GOPs up to %d KB\n", size);
+		}
+#ifdef HAVE_LIBCURL
+		janus_config_item *ms = janus_config_get(config, config_general, janus_config_type_item, "rtsp_max_setups");
+		if(ms != NULL && ms->value != NULL) {
+			rtsp_max_setups = atoi(ms->value);
+			if(rtsp_max_setups < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid rtsp_max_setups value %s, using the default (%d)\n",
+					ms->value, JANUS_STREAMING_RTSP_MAX_SETUPS);
+				rtsp_max_setups = JANUS_STREAMING_RTSP_MAX_SETUPS;
 			}
+		}
+		if(rtsp_max_setups > 0)
+			JANUS_LOG(LOG_INFO, "Up to %d RTSP mountpoints will connect to their servers at the same time\n", rtsp_max_setups);
+#endif
+	}
+#ifdef HAVE_LIBCURL
+	/* Start the RTSP control thread before creating any mountpoint */
+	janus_condition_init(&rtsp_setups_cond);
+	rtsp_keepalives = g_async_queue_new();
+	CURLM *rtsp_multi = curl_multi_init();
+	if(rtsp_multi == NULL) {
+		/* Not fatal: relay threads will send keep-alives themselves */
+		JANUS_LOG(LOG_ERR, "Can't init CURL multi, relay threads will send RTSP keep-alives themselves\n");
+	} else {
+		GError *rtsp_error = NULL;
+		rtsp_control_thread = g_thread_try_new("streaming rtsp", janus_streaming_rtsp_control, rtsp_multi, &rtsp_error);
+		if(rtsp_error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the RTSP control thread, relay threads will send RTSP keep-alives themselves\n",
+				rtsp_error->code, rtsp_error->message ? rtsp_error->message : "??");
+			g_error_free(rtsp_error);
+			rtsp_control_thread = NULL;
+			curl_multi_cleanup(rtsp_multi);
+		}
+	}
+#endif
+#ifdef HAVE_EPOLL
+	/* If we need reactor threads, start them before creating any mountpoint */
+	if(reactor_threads > 0)
+		janus_streaming_reactors_start(reactor_threads);
+#endif
+	/* Iterate on all mountpoints */
+	mountpoints = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_streaming_mountpoint_destroy);
+	mountpoints_temp = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+		(GDestroyNotify)g_free, NULL);
+	if(config != NULL) {
+		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
+		while(cl != NULL) {
+			janus_config_category *cat = (janus_config_category *)cl->data;
+			if(cat->name != NULL && strcasecmp(cat->name, "general"))
+				janus_streaming_mountpoint_from_config(config, cat, cat->name, ifas);
 			cl = cl->next;
 		}
 		g_list_free(clist);
@@ -2815,6 +3378,8 @@ int janus_streaming_init(janus_callbacks *callback, const char *config_path) {
 			error->code, error->message ? error->message : "??");
 		g_error_free(error);
 		janus_config_destroy(config);
+		janus_config_folder_destroy(mountpoints_folder);
+		mountpoints_folder = NULL;
 		return -1;
 	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_STREAMING_NAME);
@@ -2825,6 +3390,12 @@ void janus_streaming_destroy(void) {
 	if(!g_atomic_int_get(&initialized))
 		return;
 	g_atomic_int_set(&stopping, 1);
+#ifdef HAVE_LIBCURL
+	/* Wake up mountpoints waiting for their turn to connect to an RTSP server */
+	janus_mutex_lock(&rtsp_setups_mutex);
+	janus_condition_broadcast(&rtsp_setups_cond);
+	janus_mutex_unlock(&rtsp_setups_mutex);
+#endif
 
 	g_async_queue_push(messages, &exit_message);
 	if(handler_thread != NULL) {
@@ -2839,6 +3410,17 @@ void janus_streaming_destroy(void) {
 	g_hash_table_destroy(mountpoints_temp);
 	mountpoints_temp = NULL;
 	janus_mutex_unlock(&mountpoints_mutex);
+#ifdef HAVE_EPOLL
+	janus_streaming_reactors_stop();
+#endif
+#ifdef HAVE_LIBCURL
+	if(rtsp_control_thread != NULL) {
+		g_thread_join(rtsp_control_thread);
+		rtsp_control_thread = NULL;
+	}
+	g_async_queue_unref(rtsp_keepalives);
+	rtsp_keepalives = NULL;
+#endif
 	janus_mutex_lock(&sessions_mutex);
 	g_hash_table_destroy(sessions);
 	sessions = NULL;
@@ -2847,6 +3429,8 @@ void janus_streaming_destroy(void) {
 	messages = NULL;
 
 	janus_config_destroy(config);
+	janus_config_folder_destroy(mountpoints_folder);
+	mountpoints_folder = NULL;
 	g_free(admin_key);
 
 	g_atomic_int_set(&initialized, 0);
@@ -2933,6 +3517,40 @@ void janus_streaming_destroy_session(janus_plugin_session *handle, int *error) {
 	return;
 }
 
+void janus_streaming_drain(gboolean draining) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return;
+	/* Janus is being drained (or not anymore): let all users know, so that
+	 * they can move to a different instance when it's more convenient */
+	GList *list = NULL, *temp = NULL;
+	janus_mutex_lock(&sessions_mutex);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, sessions);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_streaming_session *session = (janus_streaming_session *)value;
+		if(session == NULL || g_atomic_int_get(&session->destroyed))
+			continue;
+		janus_refcount_increase(&session->ref);
+		list = g_list_prepend(list, session);
+	}
+	janus_mutex_unlock(&sessions_mutex);
+	JANUS_LOG(LOG_INFO, "Notifying %u users that Janus is %s\n", g_list_length(list),
+		draining ? "draining" : "not draining anymore");
+	for(temp = list; temp != NULL; temp = temp->next) {
+		janus_streaming_session *session = (janus_streaming_session *)temp->data;
+		json_t *event = json_object();
+		json_object_set_new(event, "streaming", json_string("event"));
+		json_t *result = json_object();
+		json_object_set_new(result, "draining", draining ? json_true() : json_false());
+		json_object_set_new(event, "result", result);
+		gateway->push_event(session->handle, &janus_streaming_plugin, NULL, event, NULL);
+		json_decref(event);
+		janus_refcount_decrease(&session->ref);
+	}
+	g_list_free(list);
+}
+
 json_t *janus_streaming_query_session(janus_plugin_session *handle) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
 		return NULL;
@@ -3045,7 +3663,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			}
 		}
 		json_t *list = json_array();
-		/* Return a list of all available mountpoints */
+		/* Return a list of all available mountpoints, including the ones we didn't need so far */
+		janus_streaming_load_mountpoints();
 		janus_mutex_lock(&mountpoints_mutex);
 		GHashTableIter iter;
 		gpointer value;
@@ -3122,6 +3741,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		} else {
 			id_value_str = (char *)json_string_value(id);
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -3167,6 +3787,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			janus_streaming_file_source *source = mp->source;
 			if(admin && source->filename)
 				json_object_set_new(ml, "filename", json_string(source->filename));
+			if(source->sync_window > 0)
+				json_object_set_new(ml, "sync_window", json_integer(source->sync_window));
 			json_t *info = json_object();
 			json_object_set_new(info, "type", json_string("audio"));
 			if(source->codecs.pt != -1)
@@ -3198,15 +3820,57 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					if(source->rtsp_quirk)
 						json_object_set_new(ml, "rtsp_quirk", json_true());
 				}
+				if(source->rtsp_lazy) {
+					json_object_set_new(ml, "rtsp_lazy", json_true());
+					json_object_set_new(ml, "rtsp_idle", g_atomic_int_get(&source->rtsp_lazy_active) ? json_false() : json_true());
+					if(source->rtsp_startup_latency > 0)
+						json_object_set_new(ml, "startup_latency_ms", json_integer(source->rtsp_startup_latency / 1000));
+				}
+				json_t *rc = json_object();
+				json_object_set_new(rc, "setups", json_integer(source->rtsp_setups));
+				json_object_set_new(rc, "setup_failures", json_integer(source->rtsp_setup_failures));
+				if(source->rtsp_setup_latency > 0)
+					json_object_set_new(rc, "setup_latency_ms", json_integer(source->rtsp_setup_latency / 1000));
+				json_object_set_new(rc, "keepalives", json_integer(source->rtsp_kas));
+				json_object_set_new(rc, "keepalive_failures", json_integer(source->rtsp_ka_failures));
+				if(source->rtsp_ka_latency > 0)
+					json_object_set_new(rc, "keepalive_latency_ms", json_integer(source->rtsp_ka_latency / 1000));
+				if(source->reconnect_failures > 0)
+					json_object_set_new(rc, "reconnect_failures", json_integer(source->reconnect_failures));
+				json_object_set_new(ml, "rtsp_control", rc);
 			}
 #endif
 			if(source->is_srtp) {
 				json_object_set_new(ml, "srtp", json_true());
 			}
+			if(source->mcast_out != NULL) {
+				json_t *mo = json_object();
+				json_object_set_new(mo, "group", json_string(source->mcast_out));
+				json_object_set_new(mo, "port", json_integer(source->mcast_out_port));
+				json_object_set_new(mo, "ttl", json_integer(source->mcast_out_ttl));
+				if(source->mcast_out_iface)
+					json_object_set_new(mo, "iface", json_string(source->mcast_out_iface));
+				if(source->mcast_out_srtpsuite > 0)
+					json_object_set_new(mo, "srtp", json_true());
+				json_object_set_new(ml, "multicast_output", mo);
+			}
 			if(source->rtp_collision > 0)
 				json_object_set_new(ml, "collision", json_integer(source->rtp_collision));
 			if(mp->helper_threads > 0)
 				json_object_set_new(ml, "threads", json_integer(mp->helper_threads));
+#ifdef HAVE_EPOLL
+			if(admin && mp->reactor != NULL)
+				json_object_set_new(ml, "reactor", json_integer(mp->reactor->id));
+#endif
+			if(source->recv_wakeups > 0) {
+				/* How much traffic the relay thread has been reading, and how */
+				json_t *recv = json_object();
+				json_object_set_new(recv, "wakeups", json_integer(source->recv_wakeups));
+				json_object_set_new(recv, "packets", json_integer(source->recv_packets));
+				json_object_set_new(recv, "bytes", json_integer(source->recv_bytes));
+				json_object_set_new(recv, "packets_per_wakeup", json_real((double)source->recv_packets/(double)source->recv_wakeups));
+				json_object_set_new(ml, "recv", recv);
+			}
 			/* Iterate on media now */
 			GList *temp = source->media;
 			while(temp) {
@@ -3242,6 +3906,9 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				if(stream->keyframe.enabled) {
 					json_object_set_new(info, "videobufferkf", json_true());
 				}
+				if(stream->gop != NULL) {
+					json_object_set_new(info, "gop_cache", json_true());
+				}
 				if(stream->simulcast) {
 					json_object_set_new(info, "videosimulcast", json_true());
 				}
@@ -3328,11 +3995,45 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			g_snprintf(error_cause, 512, "No configuration file, can't create permanent mountpoint");
 			goto prepare_response;
 		}
+		/* Check if we need a multicast output too (only for RTP and RTSP mountpoints) */
+		json_t *mcast_out = json_object_get(root, "mcast_out");
+		json_t *mcast_out_port = NULL, *mcast_out_ttl = NULL, *mcast_out_iface = NULL,
+			*mcast_out_ssuite = NULL, *mcast_out_scrypto = NULL;
+		if(mcast_out != NULL) {
+			JANUS_VALIDATE_JSON_OBJECT(root, mcast_out_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_STREAMING_ERROR_MISSING_ELEMENT, JANUS_STREAMING_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+			if(strcasecmp(type_text, "rtp") && strcasecmp(type_text, "rtsp")) {
+				JANUS_LOG(LOG_ERR, "Multicast output only available for 'rtp' and 'rtsp' mountpoints\n");
+				error_code = JANUS_STREAMING_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "Multicast output only available for 'rtp' and 'rtsp' mountpoints");
+				goto prepare_response;
+			}
+			mcast_out_port = json_object_get(root, "mcast_out_port");
+			mcast_out_ttl = json_object_get(root, "mcast_out_ttl");
+			mcast_out_iface = json_object_get(root, "mcast_out_iface");
+			mcast_out_ssuite = json_object_get(root, "mcast_out_srtpsuite");
+			mcast_out_scrypto = json_object_get(root, "mcast_out_srtpcrypto");
+			if(janus_streaming_mcast_out_check(json_string_value(mcast_out), json_integer_value(mcast_out_port),
+					json_integer_value(mcast_out_ttl), json_string_value(mcast_out_iface),
+					json_integer_value(mcast_out_ssuite), json_string_value(mcast_out_scrypto),
+					error_cause, sizeof(error_cause)) < 0) {
+				JANUS_LOG(LOG_ERR, "%s\n", error_cause);
+				error_code = JANUS_STREAMING_ERROR_INVALID_ELEMENT;
+				goto prepare_response;
+			}
+		}
 		json_t *id = json_object_get(root, "id");
 		/* Check if an ID has been provided, or if we need to generate one ourselves */
-		janus_mutex_lock(&mountpoints_mutex);
 		guint64 mpid = string_ids ? 0 : json_integer_value(id);
 		char *mpid_str = (char *)(string_ids ? json_string_value(id) : NULL);
+		char mpid_num[30];
+		g_snprintf(mpid_num, sizeof(mpid_num), "%"SCNu64, mpid);
+		if((!string_ids && mpid > 0) || (string_ids && mpid_str != NULL))
+			janus_streaming_load_mountpoint(string_ids ? mpid_str : mpid_num);
+		janus_mutex_lock(&mountpoints_mutex);
 		if((!string_ids && mpid > 0) || (string_ids && mpid_str != NULL)) {
 			/* Make sure the provided ID isn't already in use */
 			if(g_hash_table_lookup(mountpoints, string_ids ? (gpointer)mpid_str : (gpointer)&mpid) != NULL ||
@@ -3348,8 +4049,10 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			JANUS_LOG(LOG_VERB, "Missing numeric id, will generate a random one...\n");
 			while(mpid == 0) {
 				mpid = janus_random_uint64();
+				g_snprintf(mpid_num, sizeof(mpid_num), "%"SCNu64, mpid);
 				if(g_hash_table_lookup(mountpoints, &mpid) != NULL ||
-						g_hash_table_lookup(mountpoints_temp, &mpid) != NULL) {
+						g_hash_table_lookup(mountpoints_temp, &mpid) != NULL ||
+						janus_streaming_folder_contains(mpid_num)) {
 					/* ID already in use, try another one */
 					mpid = 0;
 				}
@@ -3360,7 +4063,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			while(mpid_str == 0) {
 				mpid_str = janus_random_uuid();
 				if(g_hash_table_lookup(mountpoints, mpid_str) != NULL ||
-						g_hash_table_lookup(mountpoints_temp, mpid_str) != NULL) {
+						g_hash_table_lookup(mountpoints_temp, mpid_str) != NULL ||
+						janus_streaming_folder_contains(mpid_str)) {
 					/* ID already in use, try another one */
 					g_free(mpid_str);
 					mpid_str = NULL;
@@ -4009,6 +4713,11 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				g_snprintf(error_cause, 512, "Error creating 'ondemand' stream");
 				goto prepare_response;
 			}
+			json_t *syncw = json_object_get(root, "sync_window");
+			if(syncw) {
+				janus_streaming_file_source *source = mp->source;
+				source->sync_window = json_integer_value(syncw);
+			}
 			mp->is_private = is_private ? json_is_true(is_private) : FALSE;
 		} else if(!strcasecmp(type_text, "rtsp")) {
 #ifndef HAVE_LIBCURL
@@ -4054,6 +4763,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			json_t *session_timeout = json_object_get(root, "rtsp_session_timeout");
 			json_t *rtsp_timeout = json_object_get(root, "rtsp_timeout");
 			json_t *rtsp_conn_timeout = json_object_get(root, "rtsp_conn_timeout");
+			json_t *lazy = json_object_get(root, "rtsp_lazy");
+			json_t *idle_timeout = json_object_get(root, "rtsp_idle_timeout");
 			if(failerr == NULL)	/* For an old typo, we support the legacy syntax too */
 				failerr = json_object_get(root, "rtsp_check");
 			gboolean doaudio = audio ? json_is_true(audio) : FALSE;
@@ -4111,6 +4822,8 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 					((session_timeout ? json_integer_value(session_timeout) : JANUS_STREAMING_DEFAULT_SESSION_TIMEOUT) * G_USEC_PER_SEC),
 					(rtsp_timeout ? json_integer_value(rtsp_timeout) : JANUS_STREAMING_DEFAULT_CURL_TIMEOUT),
 					(rtsp_conn_timeout ? json_integer_value(rtsp_conn_timeout) : JANUS_STREAMING_DEFAULT_CURL_CONNECT_TIMEOUT),
+					lazy ? json_is_true(lazy) : FALSE,
+					((idle_timeout ? json_integer_value(idle_timeout) : JANUS_STREAMING_DEFAULT_IDLE_TIMEOUT) * G_USEC_PER_SEC),
 					error_on_failure);
 			janus_mutex_lock(&mountpoints_mutex);
 			g_hash_table_remove(mountpoints_temp, string_ids ? (gpointer)mpid_str : (gpointer)&mpid);
@@ -4135,157 +4848,182 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		/* Any PIN? */
 		if(pin)
 			mp->pin = g_strdup(json_string_value(pin));
+		/* Any multicast output? */
+		if(mcast_out) {
+			janus_streaming_mcast_out_set(mp->source, json_string_value(mcast_out), json_integer_value(mcast_out_port),
+				json_integer_value(mcast_out_ttl), json_string_value(mcast_out_iface),
+				json_integer_value(mcast_out_ssuite), json_string_value(mcast_out_scrypto));
+		}
 		if(save) {
 			/* This mountpoint is permanent: save to the configuration file too
 			 * FIXME: We should check if anything fails... */
 			JANUS_LOG(LOG_VERB, "Saving mountpoint %s permanently in config file\n", mp->id_str);
 			janus_mutex_lock(&config_mutex);
-			char value[BUFSIZ];
-			/* The category to add is the mountpoint name */
-			janus_config_category *c = janus_config_get_create(config, NULL, janus_config_type_category, mp->name);
+			char value[BUFSIZ], cat[BUFSIZ];
+			/* The category to add is the mountpoint name, unless it has a file of its own */
+			janus_config *mp_config = janus_streaming_mountpoint_config(mp, cat, sizeof(cat));
+			janus_config_category *c = janus_config_get_create(mp_config, NULL, janus_config_type_category, cat);
 			/* Now for the common values */
-			janus_config_add(config, c, janus_config_item_create("type", type_text));
-			janus_config_add(config, c, janus_config_item_create("id", mp->id_str));
-			janus_config_add(config, c, janus_config_item_create("description", mp->description));
+			janus_config_add(mp_config, c, janus_config_item_create("type", type_text));
+			janus_config_add(mp_config, c, janus_config_item_create("id", mp->id_str));
+			janus_config_add(mp_config, c, janus_config_item_create("description", mp->description));
 			if(mp->metadata)
-				janus_config_add(config, c, janus_config_item_create("metadata", mp->metadata));
+				janus_config_add(mp_config, c, janus_config_item_create("metadata", mp->metadata));
 			if(mp->is_private)
-				janus_config_add(config, c, janus_config_item_create("is_private", "true"));
+				janus_config_add(mp_config, c, janus_config_item_create("is_private", "true"));
 			if(mp->secret)
-				janus_config_add(config, c, janus_config_item_create("secret", mp->secret));
+				janus_config_add(mp_config, c, janus_config_item_create("secret", mp->secret));
 			if(mp->pin)
-				janus_config_add(config, c, janus_config_item_create("pin", mp->pin));
+				janus_config_add(mp_config, c, janus_config_item_create("pin", mp->pin));
+			if(mp->streaming_source == janus_streaming_source_rtp)
+				janus_streaming_mcast_out_save(mp_config, c, mp->source);
 			/* Per type values */
 			if(!strcasecmp(type_text, "rtp")) {
 				/* We save using the new format, not the old deprecated one */
 				janus_streaming_rtp_source *source = mp->source;
 				if(source->rtp_collision > 0) {
 					g_snprintf(value, BUFSIZ, "%d", source->rtp_collision);
-					janus_config_add(config, c, janus_config_item_create("collision", value));
+					janus_config_add(mp_config, c, janus_config_item_create("collision", value));
 				}
 				if(source->srtpsuite > 0 && source->srtpcrypto) {
 					g_snprintf(value, BUFSIZ, "%d", source->srtpsuite);
-					janus_config_add(config, c, janus_config_item_create("srtpsuite", value));
-					janus_config_add(config, c, janus_config_item_create("srtpcrypto", source->srtpcrypto));
+					janus_config_add(mp_config, c, janus_config_item_create("srtpsuite", value));
+					janus_config_add(mp_config, c, janus_config_item_create("srtpcrypto", source->srtpcrypto));
 				}
 				if(mp->helper_threads > 0) {
 					g_snprintf(value, BUFSIZ, "%d", mp->helper_threads);
-					janus_config_add(config, c, janus_config_item_create("threads", value));
+					janus_config_add(mp_config, c, janus_config_item_create("threads", value));
 				}
 				if(source->e2ee)
-					janus_config_add(config, c, janus_config_item_create("e2ee", "true"));
+					janus_config_add(mp_config, c, janus_config_item_create("e2ee", "true"));
 				if(source->playoutdelay_ext)
-					janus_config_add(config, c, janus_config_item_create("playoutdelay_ext", "true"));
+					janus_config_add(mp_config, c, janus_config_item_create("playoutdelay_ext", "true"));
 				/* Iterate on all media streams */
 				janus_config_array *media = janus_config_array_create("media");
-				janus_config_add(config, c, media);
+				janus_config_add(mp_config, c, media);
 				GList *temp = source->media;
 				while(temp) {
 					janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
 					janus_config_category *m = janus_config_category_create(NULL);
-					janus_config_add(config, media, m);
-					janus_config_add(config, m, janus_config_item_create("type", janus_streaming_media_str(stream->type)));
-					janus_config_add(config, m, janus_config_item_create("mid", stream->mid));
-					janus_config_add(config, m, janus_config_item_create("label", stream->label));
+					janus_config_add(mp_config, media, m);
+					janus_config_add(mp_config, m, janus_config_item_create("type", janus_streaming_media_str(stream->type)));
+					janus_config_add(mp_config, m, janus_config_item_create("mid", stream->mid));
+					janus_config_add(mp_config, m, janus_config_item_create("label", stream->label));
 					if(stream->msid && stream->mstid) {
 						char msid[150];
 						g_snprintf(msid, sizeof(msid), "%s %s", stream->msid, stream->mstid);
-						janus_config_add(config, m, janus_config_item_create("msid", msid));
+						janus_config_add(mp_config, m, janus_config_item_create("msid", msid));
 					}
 					if(stream->port[0] > 0) {
 						g_snprintf(value, BUFSIZ, "%d", stream->port[0]);
-						janus_config_add(config, m, janus_config_item_create("port", value));
+						janus_config_add(mp_config, m, janus_config_item_create("port", value));
 					}
 					if(stream->rtcp_port > 0) {
 						g_snprintf(value, BUFSIZ, "%d", stream->rtcp_port);
-						janus_config_add(config, m, janus_config_item_create("rtcpport", value));
+						janus_config_add(mp_config, m, janus_config_item_create("rtcpport", value));
 					}
 					if(stream->codecs.pt >= 0) {
 						g_snprintf(value, BUFSIZ, "%d", stream->codecs.pt);
-						janus_config_add(config, m, janus_config_item_create("pt", value));
+						janus_config_add(mp_config, m, janus_config_item_create("pt", value));
 					}
 					if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE || stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE) {
 						if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE)
-							janus_config_add(config, m, janus_config_item_create("codec", janus_audiocodec_name(stream->codecs.audio_codec)));
+							janus_config_add(mp_config, m, janus_config_item_create("codec", janus_audiocodec_name(stream->codecs.audio_codec)));
 						else if(stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE)
-							janus_config_add(config, m, janus_config_item_create("codec", janus_videocodec_name(stream->codecs.video_codec)));
+							janus_config_add(mp_config, m, janus_config_item_create("codec", janus_videocodec_name(stream->codecs.video_codec)));
 						if(stream->codecs.fmtp)
-							janus_config_add(config, m, janus_config_item_create("fmtp", stream->codecs.fmtp));
+							janus_config_add(mp_config, m, janus_config_item_create("fmtp", stream->codecs.fmtp));
 						if(stream->skew)
-							janus_config_add(config, m, janus_config_item_create("skew", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("skew", "true"));
 					}
 					if(stream->keyframe.enabled)
-						janus_config_add(config, m, janus_config_item_create("videobufferkf", "true"));
+						janus_config_add(mp_config, m, janus_config_item_create("videobufferkf", "true"));
 					if(stream->simulcast) {
-						janus_config_add(config, m, janus_config_item_create("videosimulcast", "true"));
+						janus_config_add(mp_config, m, janus_config_item_create("videosimulcast", "true"));
 						if(stream->port[1]) {
 							g_snprintf(value, BUFSIZ, "%d", stream->port[1]);
-							janus_config_add(config, m, janus_config_item_create("port2", value));
+							janus_config_add(mp_config, m, janus_config_item_create("port2", value));
 						}
 						if(stream->port[2]) {
 							g_snprintf(value, BUFSIZ, "%d", stream->port[2]);
-							janus_config_add(config, m, janus_config_item_create("port3", value));
+							janus_config_add(mp_config, m, janus_config_item_create("port3", value));
 						}
 					}
 					if(stream->svc)
-						janus_config_add(config, m, janus_config_item_create("videosvc", "true"));
+						janus_config_add(mp_config, m, janus_config_item_create("videosvc", "true"));
 					if(stream->skew)
-						janus_config_add(config, m, janus_config_item_create("skew", "true"));
+						janus_config_add(mp_config, m, janus_config_item_create("skew", "true"));
 					if(stream->mcast_str)
-						janus_config_add(config, m, janus_config_item_create("mcast", stream->mcast_str));
+						janus_config_add(mp_config, m, janus_config_item_create("mcast", stream->mcast_str));
 					if(stream->iface_str)
-						janus_config_add(config, m, janus_config_item_create("iface", stream->iface_str));
+						janus_config_add(mp_config, m, janus_config_item_create("iface", stream->iface_str));
 					if(stream->type == JANUS_STREAMING_MEDIA_DATA)
-						janus_config_add(config, m, janus_config_item_create("datatype", stream->textdata ? "text" : "binary"));
+						janus_config_add(mp_config, m, janus_config_item_create("datatype", stream->textdata ? "text" : "binary"));
 					if(stream->buffermsg)
-						janus_config_add(config, m, janus_config_item_create("databuffermsg", "true"));
+						janus_config_add(mp_config, m, janus_config_item_create("databuffermsg", "true"));
 					temp = temp->next;
 				}
 			} else if(!strcasecmp(type_text, "live") || !strcasecmp(type_text, "ondemand")) {
 				janus_streaming_file_source *source = mp->source;
-				janus_config_add(config, c, janus_config_item_create("filename", source->filename));
-				janus_config_add(config, c, janus_config_item_create("audio", "true"));
+				janus_config_add(mp_config, c, janus_config_item_create("filename", source->filename));
+				janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
+				if(source->sync_window > 0) {
+					g_snprintf(value, BUFSIZ, "%"SCNi64, source->sync_window);
+					janus_config_add(mp_config, c, janus_config_item_create("sync_window", value));
+				}
 			} else if(!strcasecmp(type_text, "rtsp")) {
 				janus_streaming_rtp_source *source = mp->source;
 #ifdef HAVE_LIBCURL
 				if(source->rtsp_url)
-					janus_config_add(config, c, janus_config_item_create("url", source->rtsp_url));
+					janus_config_add(mp_config, c, janus_config_item_create("url", source->rtsp_url));
 				if(source->rtsp_username)
-					janus_config_add(config, c, janus_config_item_create("rtsp_user", source->rtsp_username));
+					janus_config_add(mp_config, c, janus_config_item_create("rtsp_user", source->rtsp_username));
 				if(source->rtsp_password)
-					janus_config_add(config, c, janus_config_item_create("rtsp_pwd", source->rtsp_password));
+					janus_config_add(mp_config, c, janus_config_item_create("rtsp_pwd", source->rtsp_password));
 				if(source->rtsp_quirk)
-					janus_config_add(config, c, janus_config_item_create("rtsp_quirk", "true"));
+					janus_config_add(mp_config, c, janus_config_item_create("rtsp_quirk", "true"));
+				if(source->rtsp_lazy) {
+					janus_config_add(mp_config, c, janus_config_item_create("rtsp_lazy", "true"));
+					g_snprintf(value, BUFSIZ, "%"SCNi64, source->rtsp_idle_timeout / G_USEC_PER_SEC);
+					janus_config_add(mp_config, c, janus_config_item_create("rtsp_idle_timeout", value));
+					if(source->media == NULL) {
+						/* This lazy mountpoint never connected, so we don't know the streams yet */
+						if(mp->audio)
+							janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
+						if(mp->video)
+							janus_config_add(mp_config, c, janus_config_item_create("video", "true"));
+					}
+				}
 #endif
 				GList *temp = source->media;
 				while(temp) {
 					janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
 					/* FIXME Should we support RTSP streams with multiple media? */
 					if(stream->type == JANUS_STREAMING_MEDIA_AUDIO) {
-						janus_config_add(config, c, janus_config_item_create("audio", "true"));
+						janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
 						if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE)
-							janus_config_add(config, c, janus_config_item_create("audiocodec", janus_audiocodec_name(stream->codecs.audio_codec)));
+							janus_config_add(mp_config, c, janus_config_item_create("audiocodec", janus_audiocodec_name(stream->codecs.audio_codec)));
 						if(stream->codecs.fmtp)
-							janus_config_add(config, c, janus_config_item_create("audiofmtp", stream->codecs.fmtp));
+							janus_config_add(mp_config, c, janus_config_item_create("audiofmtp", stream->codecs.fmtp));
 					} else if(stream->type == JANUS_STREAMING_MEDIA_VIDEO) {
-						janus_config_add(config, c, janus_config_item_create("video", "true"));
+						janus_config_add(mp_config, c, janus_config_item_create("video", "true"));
 						if(stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE)
-							janus_config_add(config, c, janus_config_item_create("videocodec", janus_videocodec_name(stream->codecs.video_codec)));
+							janus_config_add(mp_config, c, janus_config_item_create("videocodec", janus_videocodec_name(stream->codecs.video_codec)));
 						if(stream->codecs.fmtp)
-							janus_config_add(config, c, janus_config_item_create("videofmtp", stream->codecs.fmtp));
+							janus_config_add(mp_config, c, janus_config_item_create("videofmtp", stream->codecs.fmtp));
 					}
 					temp = temp->next;
 				}
 				json_t *iface = json_object_get(root, "rtspiface");
 				if(iface)
-					janus_config_add(config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
+					janus_config_add(mp_config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
 				if(mp->helper_threads > 0) {
 					g_snprintf(value, BUFSIZ, "%d", mp->helper_threads);
-					janus_config_add(config, c, janus_config_item_create("threads", value));
+					janus_config_add(mp_config, c, janus_config_item_create("threads", value));
 				}
 			}
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_STREAMING_PACKAGE) < 0)
+			if(!janus_streaming_save_mountpoint(mp_config, cat))
 				save = FALSE;	/* This will notify the user the mountpoint is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -4425,6 +5163,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		} else {
 			id_value_str = (char *)json_string_value(id);
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -4493,23 +5232,25 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			 * FIXME: We should check if anything fails... */
 			JANUS_LOG(LOG_VERB, "Saving edited mountpoint %s permanently in config file\n", mp->id_str);
 			janus_mutex_lock(&config_mutex);
-			char value[BUFSIZ];
-			/* The category to add is the mountpoint name */
-			janus_config_category *c = janus_config_get_create(config, NULL, janus_config_type_category, mp->name);
+			char value[BUFSIZ], cat[BUFSIZ];
+			/* The category to add is the mountpoint name, unless it has a file of its own */
+			janus_config *mp_config = janus_streaming_mountpoint_config(mp, cat, sizeof(cat));
+			janus_config_category *c = janus_config_get_create(mp_config, NULL, janus_config_type_category, cat);
 			/* Now for the common values */
-			janus_config_add(config, c, janus_config_item_create("id", mp->id_str));
-			janus_config_add(config, c, janus_config_item_create("description", mp->description));
+			janus_config_add(mp_config, c, janus_config_item_create("id", mp->id_str));
+			janus_config_add(mp_config, c, janus_config_item_create("description", mp->description));
 			if(mp->metadata)
-				janus_config_add(config, c, janus_config_item_create("metadata", mp->metadata));
+				janus_config_add(mp_config, c, janus_config_item_create("metadata", mp->metadata));
 			if(mp->is_private)
-				janus_config_add(config, c, janus_config_item_create("is_private", "true"));
+				janus_config_add(mp_config, c, janus_config_item_create("is_private", "true"));
 			if(mp->secret)
-				janus_config_add(config, c, janus_config_item_create("secret", mp->secret));
+				janus_config_add(mp_config, c, janus_config_item_create("secret", mp->secret));
 			if(mp->pin)
-				janus_config_add(config, c, janus_config_item_create("pin", mp->pin));
+				janus_config_add(mp_config, c, janus_config_item_create("pin", mp->pin));
 			/* Per type values */
 			if(mp->streaming_source == janus_streaming_source_rtp) {
 				gboolean rtsp = FALSE;
+				janus_streaming_mcast_out_save(mp_config, c, mp->source);
 #ifdef HAVE_LIBCURL
 				janus_streaming_rtp_source *source = mp->source;
 				if(source->rtsp)
@@ -4518,137 +5259,153 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 				if(rtsp) {
 					janus_streaming_rtp_source *source = mp->source;
 #ifdef HAVE_LIBCURL
-					janus_config_add(config, c, janus_config_item_create("type", "rtsp"));
+					janus_config_add(mp_config, c, janus_config_item_create("type", "rtsp"));
 					if(source->rtsp_url)
-						janus_config_add(config, c, janus_config_item_create("url", source->rtsp_url));
+						janus_config_add(mp_config, c, janus_config_item_create("url", source->rtsp_url));
 					if(source->rtsp_username)
-						janus_config_add(config, c, janus_config_item_create("rtsp_user", source->rtsp_username));
+						janus_config_add(mp_config, c, janus_config_item_create("rtsp_user", source->rtsp_username));
 					if(source->rtsp_password)
-						janus_config_add(config, c, janus_config_item_create("rtsp_pwd", source->rtsp_password));
+						janus_config_add(mp_config, c, janus_config_item_create("rtsp_pwd", source->rtsp_password));
 					if(source->rtsp_quirk)
-						janus_config_add(config, c, janus_config_item_create("rtsp_quirk", "true"));
+						janus_config_add(mp_config, c, janus_config_item_create("rtsp_quirk", "true"));
+					if(source->rtsp_lazy) {
+						janus_config_add(mp_config, c, janus_config_item_create("rtsp_lazy", "true"));
+						g_snprintf(value, BUFSIZ, "%"SCNi64, source->rtsp_idle_timeout / G_USEC_PER_SEC);
+						janus_config_add(mp_config, c, janus_config_item_create("rtsp_idle_timeout", value));
+						if(source->media == NULL) {
+							/* This lazy mountpoint never connected, so we don't know the streams yet */
+							if(mp->audio)
+								janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
+							if(mp->video)
+								janus_config_add(mp_config, c, janus_config_item_create("video", "true"));
+						}
+					}
 #endif
 					GList *temp = source->media;
 					while(temp) {
 						janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
 						/* FIXME Should we support RTSP streams with multiple media? */
 						if(stream->type == JANUS_STREAMING_MEDIA_AUDIO) {
-							janus_config_add(config, c, janus_config_item_create("audio", "true"));
+							janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
 							if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE)
-								janus_config_add(config, c, janus_config_item_create("audiocodec", janus_audiocodec_name(stream->codecs.audio_codec)));
+								janus_config_add(mp_config, c, janus_config_item_create("audiocodec", janus_audiocodec_name(stream->codecs.audio_codec)));
 							if(stream->codecs.fmtp)
-								janus_config_add(config, c, janus_config_item_create("audiofmtp", stream->codecs.fmtp));
+								janus_config_add(mp_config, c, janus_config_item_create("audiofmtp", stream->codecs.fmtp));
 						} else if(stream->type == JANUS_STREAMING_MEDIA_VIDEO) {
-							janus_config_add(config, c, janus_config_item_create("video", "true"));
+							janus_config_add(mp_config, c, janus_config_item_create("video", "true"));
 							if(stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE)
-								janus_config_add(config, c, janus_config_item_create("videocodec", janus_videocodec_name(stream->codecs.video_codec)));
+								janus_config_add(mp_config, c, janus_config_item_create("videocodec", janus_videocodec_name(stream->codecs.video_codec)));
 							if(stream->codecs.fmtp)
-								janus_config_add(config, c, janus_config_item_create("videofmtp", stream->codecs.fmtp));
+								janus_config_add(mp_config, c, janus_config_item_create("videofmtp", stream->codecs.fmtp));
 						}
 						temp = temp->next;
 					}
 					json_t *iface = json_object_get(root, "rtspiface");
 					if(iface)
-						janus_config_add(config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
+						janus_config_add(mp_config, c, janus_config_item_create("rtspiface", json_string_value(iface)));
 					if(mp->helper_threads > 0) {
 						g_snprintf(value, BUFSIZ, "%d", mp->helper_threads);
-						janus_config_add(config, c, janus_config_item_create("threads", value));
+						janus_config_add(mp_config, c, janus_config_item_create("threads", value));
 					}
 				} else {
-					janus_config_add(config, c, janus_config_item_create("type", "rtp"));
+					janus_config_add(mp_config, c, janus_config_item_create("type", "rtp"));
 					/* We save using the new format, not the old deprecated one */
 					janus_streaming_rtp_source *source = mp->source;
 					if(source->rtp_collision > 0) {
 						g_snprintf(value, BUFSIZ, "%d", source->rtp_collision);
-						janus_config_add(config, c, janus_config_item_create("collision", value));
+						janus_config_add(mp_config, c, janus_config_item_create("collision", value));
 					}
 					if(source->srtpsuite > 0 && source->srtpcrypto) {
 						g_snprintf(value, BUFSIZ, "%d", source->srtpsuite);
-						janus_config_add(config, c, janus_config_item_create("srtpsuite", value));
-						janus_config_add(config, c, janus_config_item_create("srtpcrypto", source->srtpcrypto));
+						janus_config_add(mp_config, c, janus_config_item_create("srtpsuite", value));
+						janus_config_add(mp_config, c, janus_config_item_create("srtpcrypto", source->srtpcrypto));
 					}
 					if(mp->helper_threads > 0) {
 						g_snprintf(value, BUFSIZ, "%d", mp->helper_threads);
-						janus_config_add(config, c, janus_config_item_create("threads", value));
+						janus_config_add(mp_config, c, janus_config_item_create("threads", value));
 					}
 					if(source->e2ee)
-						janus_config_add(config, c, janus_config_item_create("e2ee", "true"));
+						janus_config_add(mp_config, c, janus_config_item_create("e2ee", "true"));
 					if(source->playoutdelay_ext)
-						janus_config_add(config, c, janus_config_item_create("playoutdelay_ext", "true"));
+						janus_config_add(mp_config, c, janus_config_item_create("playoutdelay_ext", "true"));
 					/* Iterate on all media streams */
 					janus_config_array *media = janus_config_array_create("media");
-					janus_config_add(config, c, media);
+					janus_config_add(mp_config, c, media);
 					GList *temp = source->media;
 					while(temp) {
 						janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
 						janus_config_category *m = janus_config_category_create(NULL);
-						janus_config_add(config, media, m);
-						janus_config_add(config, m, janus_config_item_create("type", janus_streaming_media_str(stream->type)));
-						janus_config_add(config, m, janus_config_item_create("mid", stream->mid));
-						janus_config_add(config, m, janus_config_item_create("label", stream->label));
+						janus_config_add(mp_config, media, m);
+						janus_config_add(mp_config, m, janus_config_item_create("type", janus_streaming_media_str(stream->type)));
+						janus_config_add(mp_config, m, janus_config_item_create("mid", stream->mid));
+						janus_config_add(mp_config, m, janus_config_item_create("label", stream->label));
 						if(stream->msid && stream->mstid) {
 							char msid[150];
 							g_snprintf(msid, sizeof(msid), "%s %s", stream->msid, stream->mstid);
-							janus_config_add(config, m, janus_config_item_create("msid", msid));
+							janus_config_add(mp_config, m, janus_config_item_create("msid", msid));
 						}
 						if(stream->port[0] > 0) {
 							g_snprintf(value, BUFSIZ, "%d", stream->port[0]);
-							janus_config_add(config, m, janus_config_item_create("port", value));
+							janus_config_add(mp_config, m, janus_config_item_create("port", value));
 						}
 						if(stream->rtcp_port > 0) {
 							g_snprintf(value, BUFSIZ, "%d", stream->rtcp_port);
-							janus_config_add(config, m, janus_config_item_create("rtcpport", value));
+							janus_config_add(mp_config, m, janus_config_item_create("rtcpport", value));
 						}
 						if(stream->codecs.pt >= 0) {
 							g_snprintf(value, BUFSIZ, "%d", stream->codecs.pt);
-							janus_config_add(config, m, janus_config_item_create("pt", value));
+							janus_config_add(mp_config, m, janus_config_item_create("pt", value));
 						}
 						if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE || stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE) {
 							if(stream->codecs.audio_codec != JANUS_AUDIOCODEC_NONE)
-								janus_config_add(config, m, janus_config_item_create("codec", janus_audiocodec_name(stream->codecs.audio_codec)));
+								janus_config_add(mp_config, m, janus_config_item_create("codec", janus_audiocodec_name(stream->codecs.audio_codec)));
 							else if(stream->codecs.video_codec != JANUS_VIDEOCODEC_NONE)
-								janus_config_add(config, m, janus_config_item_create("codec", janus_videocodec_name(stream->codecs.video_codec)));
+								janus_config_add(mp_config, m, janus_config_item_create("codec", janus_videocodec_name(stream->codecs.video_codec)));
 							if(stream->codecs.fmtp)
-								janus_config_add(config, m, janus_config_item_create("fmtp", stream->codecs.fmtp));
+								janus_config_add(mp_config, m, janus_config_item_create("fmtp", stream->codecs.fmtp));
 							if(stream->skew)
-								janus_config_add(config, m, janus_config_item_create("skew", "true"));
+								janus_config_add(mp_config, m, janus_config_item_create("skew", "true"));
 						}
 						if(stream->keyframe.enabled)
-							janus_config_add(config, m, janus_config_item_create("videobufferkf", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("videobufferkf", "true"));
 						if(stream->simulcast) {
-							janus_config_add(config, m, janus_config_item_create("videosimulcast", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("videosimulcast", "true"));
 							if(stream->port[1]) {
 								g_snprintf(value, BUFSIZ, "%d", stream->port[1]);
-								janus_config_add(config, m, janus_config_item_create("port2", value));
+								janus_config_add(mp_config, m, janus_config_item_create("port2", value));
 							}
 							if(stream->port[2]) {
 								g_snprintf(value, BUFSIZ, "%d", stream->port[2]);
-								janus_config_add(config, m, janus_config_item_create("port3", value));
+								janus_config_add(mp_config, m, janus_config_item_create("port3", value));
 							}
 						}
 						if(stream->svc)
-							janus_config_add(config, m, janus_config_item_create("videosvc", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("videosvc", "true"));
 						if(stream->skew)
-							janus_config_add(config, m, janus_config_item_create("skew", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("skew", "true"));
 						if(stream->mcast_str)
-							janus_config_add(config, m, janus_config_item_create("mcast", stream->mcast_str));
+							janus_config_add(mp_config, m, janus_config_item_create("mcast", stream->mcast_str));
 						if(stream->iface_str)
-							janus_config_add(config, m, janus_config_item_create("iface", stream->iface_str));
+							janus_config_add(mp_config, m, janus_config_item_create("iface", stream->iface_str));
 						if(stream->type == JANUS_STREAMING_MEDIA_DATA)
-							janus_config_add(config, m, janus_config_item_create("datatype", stream->textdata ? "text" : "binary"));
+							janus_config_add(mp_config, m, janus_config_item_create("datatype", stream->textdata ? "text" : "binary"));
 						if(stream->buffermsg)
-							janus_config_add(config, m, janus_config_item_create("databuffermsg", "true"));
+							janus_config_add(mp_config, m, janus_config_item_create("databuffermsg", "true"));
 						temp = temp->next;
 					}
 				}
 			} else {
-				janus_config_add(config, c, janus_config_item_create("type", (mp->streaming_type == janus_streaming_type_live) ? "live" : "ondemand"));
+				janus_config_add(mp_config, c, janus_config_item_create("type", (mp->streaming_type == janus_streaming_type_live) ? "live" : "ondemand"));
 				janus_streaming_file_source *source = mp->source;
-				janus_config_add(config, c, janus_config_item_create("filename", source->filename));
-				janus_config_add(config, c, janus_config_item_create("audio", "true"));
+				janus_config_add(mp_config, c, janus_config_item_create("filename", source->filename));
+				janus_config_add(mp_config, c, janus_config_item_create("audio", "true"));
+				if(source->sync_window > 0) {
+					g_snprintf(value, BUFSIZ, "%"SCNi64, source->sync_window);
+					janus_config_add(mp_config, c, janus_config_item_create("sync_window", value));
+				}
 			}
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_STREAMING_PACKAGE) < 0)
+			if(!janus_streaming_save_mountpoint(mp_config, cat))
 				save = FALSE;	/* This will notify the user the mountpoint is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -4718,6 +5475,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		} else {
 			id_value_str = (char *)json_string_value(id);
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -4843,6 +5601,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			g_snprintf(error_cause, 512, "No configuration file, can't destroy mountpoint permanently");
 			goto prepare_response;
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -4928,12 +5687,21 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 			 * FIXME: We should check if anything fails... */
 			JANUS_LOG(LOG_VERB, "Destroying mountpoint %s (%s) permanently in config file\n", mp->id_str, mp->name);
 			janus_mutex_lock(&config_mutex);
-			/* The category to remove is the mountpoint name */
-			janus_config_remove(config, NULL, mp->name);
+			/* The category to remove is the mountpoint name, unless it has a file of its own */
+			char cat[BUFSIZ];
+			janus_config *mp_config = janus_streaming_mountpoint_config(mp, cat, sizeof(cat));
+			janus_config_remove(mp_config, NULL, cat);
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_STREAMING_PACKAGE) < 0)
+			if(!janus_streaming_save_mountpoint(mp_config, cat))
 				save = FALSE;	/* This will notify the user the mountpoint is not permanent */
 			janus_mutex_unlock(&config_mutex);
+		} else if(mountpoints_folder != NULL) {
+			/* Make sure we don't create this mountpoint out of its file again until a restart */
+			char cat[BUFSIZ];
+			g_snprintf(cat, BUFSIZ, "mountpoint-%s", mp->id_str);
+			janus_mutex_lock(&config_mutex);
+			janus_config_folder_forget(mountpoints_folder, cat);
+			janus_mutex_unlock(&config_mutex);
 		}
 		janus_refcount_decrease(&mp->ref);
 		/* Also notify event handlers */
@@ -4985,6 +5753,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		} else {
 			id_value_str = (char *)json_string_value(id);
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -5268,6 +6037,7 @@ static json_t *janus_streaming_process_synchronous_request(janus_streaming_sessi
 		} else {
 			id_value_str = (char *)json_string_value(id);
 		}
+		janus_streaming_load_mountpoint(id_value_str);
 		janus_mutex_lock(&mountpoints_mutex);
 		janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 			string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -5499,6 +6269,31 @@ admin_response:
 
 }
 
+/* Helper to send a packet from a GOP cache to a new viewer: this is
+ * only called by the relay thread, before the next live packet */
+typedef struct janus_streaming_gop_replay {
+	janus_streaming_session *session;
+	janus_streaming_session_stream *s;
+} janus_streaming_gop_replay;
+static void janus_streaming_relay_gop_packet(char *buf, int len, gpointer user_data) {
+	janus_streaming_gop_replay *replay = (janus_streaming_gop_replay *)user_data;
+	janus_streaming_session_stream *s = replay->s;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	uint16_t seq_number = ntohs(rtp->seq_number);
+	janus_rtp_header_update(rtp, &s->context, TRUE, 0);
+	if(s->pt > 0)
+		rtp->type = s->pt;
+	janus_plugin_rtp pkt = { .mindex = s->mindex, .video = TRUE, .buffer = buf, .length = len };
+	janus_plugin_rtp_extensions_reset(&pkt.extensions);
+	if(s->min_delay > -1 && s->max_delay > -1) {
+		pkt.extensions.min_delay = s->min_delay;
+		pkt.extensions.max_delay = s->max_delay;
+	}
+	gateway->relay_rtp(replay->session->handle, &pkt);
+	s->gop_replayed = TRUE;
+	s->gop_last_seq = seq_number;
+}
+
 void janus_streaming_setup_media(janus_plugin_session *handle) {
 	JANUS_LOG(LOG_INFO, "[%s-%p] WebRTC media is now available\n", JANUS_STREAMING_PACKAGE, handle);
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
@@ -5529,6 +6324,27 @@ void janus_streaming_setup_media(janus_plugin_session *handle) {
 		GList *temp = source->media;
 		while(temp) {
 			janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+			if(stream->gop != NULL) {
+				/* We have a GOP cache: the relay thread will send it before the next
+				 * live packet (or ask for a keyframe, if it's empty), so that replayed
+				 * and live packets don't race each other on the viewer context */
+				gboolean pending = FALSE;
+				janus_mutex_lock(&mountpoint->mutex);
+				GList *ss = session->streams;
+				while(ss) {
+					janus_streaming_session_stream *s = (janus_streaming_session_stream *)ss->data;
+					if(s->stream == stream) {
+						g_atomic_int_set(&s->gop_pending, 1);
+						pending = TRUE;
+					}
+					ss = ss->next;
+				}
+				janus_mutex_unlock(&mountpoint->mutex);
+				if(pending) {
+					temp = temp->next;
+					continue;
+				}
+			}
 			if(stream->keyframe.enabled) {
 				JANUS_LOG(LOG_HUGE, "Any keyframe to send? (%s)\n", stream->mid);
 				janus_mutex_lock(&stream->keyframe.mutex);
@@ -5809,6 +6625,7 @@ static void *janus_streaming_handler(void *data) {
 			json_t *restart = json_object_get(root, "restart");
 			do_restart = restart ? json_is_true(restart) : FALSE;
 			/* Find the mountpoint and go on */
+			janus_streaming_load_mountpoint(id_value_str);
 			janus_mutex_lock(&mountpoints_mutex);
 			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -5828,7 +6645,46 @@ static void *janus_streaming_handler(void *data) {
 				janus_mutex_unlock(&mountpoints_mutex);
 				goto error;
 			}
+#ifdef HAVE_LIBCURL
+			gboolean lazy_rtsp = (!do_restart && session->mountpoint == NULL && mp->streaming_source == janus_streaming_source_rtp);
+			while(lazy_rtsp) {
+				/* If this is a lazy RTSP mountpoint, we may have to connect first: this
+				 * can take a while, so we do it before locking the mountpoint and the
+				 * session, or all other requests involving them would be stuck */
+				janus_mutex_unlock(&mountpoints_mutex);
+				if(janus_streaming_rtsp_lazy_start(mp) < 0) {
+					janus_refcount_decrease(&mp->ref);
+					JANUS_LOG(LOG_ERR, "Couldn't connect to the RTSP server of mountpoint %s\n", id_value_str);
+					error_code = JANUS_STREAMING_ERROR_UNKNOWN_ERROR;
+					g_snprintf(error_cause, 512, "Couldn't connect to the RTSP server of mountpoint %s", id_value_str);
+					goto error;
+				}
+				janus_mutex_lock(&mountpoints_mutex);
+				if(g_atomic_int_get(&mp->destroyed)) {
+					/* The mountpoint went away in the meanwhile */
+					janus_mutex_unlock(&mountpoints_mutex);
+					janus_refcount_decrease(&mp->ref);
+					JANUS_LOG(LOG_VERB, "No such mountpoint/stream %s\n", id_value_str);
+					error_code = JANUS_STREAMING_ERROR_NO_SUCH_MOUNTPOINT;
+					g_snprintf(error_cause, 512, "No such mountpoint/stream %s", id_value_str);
+					goto error;
+				}
+				janus_mutex_lock(&mp->mutex);
+				/* The relay thread only disconnects when there are no viewers, and checks
+				 * that while holding the mountpoint mutex: if we're still connected now,
+				 * we'll be a viewer by the time it can check again */
+				janus_streaming_rtp_source *lazy_source = (janus_streaming_rtp_source *)mp->source;
+				if(lazy_source == NULL || !lazy_source->rtsp || !lazy_source->rtsp_lazy ||
+						g_atomic_int_get(&lazy_source->rtsp_lazy_active))
+					break;
+				/* The connection went idle in the meanwhile, connect again */
+				janus_mutex_unlock(&mp->mutex);
+			}
+			if(!lazy_rtsp)
+				janus_mutex_lock(&mp->mutex);
+#else
 			janus_mutex_lock(&mp->mutex);
+#endif
 			janus_mutex_lock(&session->mutex);
 			janus_mutex_unlock(&mountpoints_mutex);
 			/* Check if this is a new viewer, or if an update is taking place (i.e., ICE restart) */
@@ -5947,19 +6803,12 @@ static void *janus_streaming_handler(void *data) {
 				g_hash_table_insert(session->streams_byid, GINT_TO_POINTER(s->mindex), s);
 			}
 			if(mp->streaming_type == janus_streaming_type_on_demand) {
-				/* Spawn a thread */
+				/* Spawn a thread, or join a group of synchronized viewers */
 				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "mp %s", mp->id_str);
-				janus_refcount_increase(&session->ref);
-				janus_refcount_increase(&mp->ref);
-				g_thread_try_new(tname, &janus_streaming_ondemand_thread, session, &error);
-				if(error != NULL) {
+				if(!janus_streaming_ondemand_start(mp, session, &error)) {
 					session->mountpoint = NULL;
 					janus_mutex_unlock(&session->mutex);
-					janus_refcount_decrease(&session->ref);	/* This is for the failed thread */
 					janus_mutex_unlock(&mp->mutex);
-					janus_refcount_decrease(&mp->ref);		/* This is for the failed thread */
 					janus_refcount_decrease(&mp->ref);
 					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the on-demand thread...\n",
 						error->code, error->message ? error->message : "??");
@@ -6212,7 +7061,7 @@ done:
 				goto error;
 			}
 			char error_str[512];
-			janus_sdp *parsed_sdp = janus_sdp_parse(jsep_sdp, error_str, sizeof(error_str));
+			janus_sdp *parsed_sdp = janus_sdp_parse_arena(jsep_sdp, error_str, sizeof(error_str));
 			if(parsed_sdp == NULL) {
 				JANUS_LOG(LOG_ERR, "Error parsing SDP: %s\n", error_str);
 				error_code = JANUS_STREAMING_ERROR_INVALID_SDP;
@@ -6253,6 +7102,7 @@ done:
 				id_value_str = (char *)json_string_value(id);
 			}
 			/* Find the mountpoint and go on */
+			janus_streaming_load_mountpoint(id_value_str);
 			janus_mutex_lock(&mountpoints_mutex);
 			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -6442,14 +7292,9 @@ done:
 				/* FIXME Ended up not subscribing to any stream? */
 				JANUS_LOG(LOG_WARN, "Not subscribed to any stream (all m-lines rejected)\n");
 			} else if(mp->streaming_type == janus_streaming_type_on_demand) {
-				/* Spawn a thread */
+				/* Spawn a thread, or join a group of synchronized viewers */
 				GError *error = NULL;
-				char tname[16];
-				g_snprintf(tname, sizeof(tname), "mp %s", mp->id_str);
-				janus_refcount_increase(&session->ref);
-				janus_refcount_increase(&mp->ref);
-				g_thread_try_new(tname, &janus_streaming_ondemand_thread, session, &error);
-				if(error != NULL) {
+				if(!janus_streaming_ondemand_start(mp, session, &error)) {
 					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the on-demand thread...\n",
 						error->code, error->message ? error->message : "??");
 					error_code = JANUS_STREAMING_ERROR_UNKNOWN_ERROR;
@@ -6849,6 +7694,7 @@ done:
 			} else {
 				id_value_str = (char *)json_string_value(id);
 			}
+			janus_streaming_load_mountpoint(id_value_str);
 			janus_mutex_lock(&mountpoints_mutex);
 			janus_streaming_mountpoint *mp = g_hash_table_lookup(mountpoints,
 				string_ids ? (gpointer)id_value_str : (gpointer)&id_value);
@@ -7249,12 +8095,15 @@ static void janus_streaming_rtp_source_stream_free(const janus_refcount *st_ref)
 		close(stream->fd[2]);
 	if(stream->rtcp_fd > -1)
 		close(stream->rtcp_fd);
+	janus_rtp_forwarder_destroy(stream->mcast_fwd);
 	g_free(stream->host);
 	janus_mutex_lock(&stream->keyframe.mutex);
 	if(stream->keyframe.latest_keyframe != NULL)
 		g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
 	stream->keyframe.latest_keyframe = NULL;
 	janus_mutex_unlock(&stream->keyframe.mutex);
+	janus_rtp_gop_cache_destroy(stream->gop);
+	stream->gop = NULL;
 	janus_mutex_lock(&stream->buffermsg_mutex);
 	if(stream->last_msg != NULL)
 		janus_streaming_rtp_relay_packet_free((janus_streaming_rtp_relay_packet *)stream->last_msg);
@@ -7309,19 +8158,200 @@ static void janus_streaming_rtp_source_free(janus_streaming_rtp_source *source)
 	g_free(source->rtsp_vhost);
 	g_free(source->rtsp_vcodecs.fmtp);
 	janus_mutex_unlock(&source->rtsp_mutex);
+	if(source->rtsp)
+		janus_condition_destroy(&source->lazy_cond);
 #endif
 	g_list_free_full(source->media, (GDestroyNotify)(janus_streaming_rtp_source_stream_unref));
 	g_hash_table_unref(source->media_byid);
 	g_hash_table_unref(source->media_byfd);
+	if(source->mcast_out != NULL && source->mcast_out_fd > -1)
+		close(source->mcast_out_fd);
+	g_free(source->mcast_out);
+	g_free(source->mcast_out_iface);
+	g_free(source->mcast_out_srtpcrypto);
 	g_free(source);
 }
 
+/* Multicast output: what live RTP/RTSP mountpoints receive can be sent to a
+ * multicast group as well, for receivers on networks that support it (e.g.,
+ * set-top boxes) that don't need WebRTC. Each packet is sent (and encrypted,
+ * if a shared SRTP key is configured) once, no matter how many receivers
+ * joined the group, which is something that's not possible for WebRTC
+ * viewers, as each of them has its own DTLS-SRTP keys. Each stream is sent
+ * to a different port, starting from the configured one, and skipping one
+ * for RTCP after each stream: for simulcast streams, only the base substream
+ * is sent, while data streams are not sent at all */
+static int janus_streaming_mcast_out_check(const char *group, int port, int ttl, const char *iface,
+		int srtpsuite, const char *srtpcrypto, char *error, size_t errlen) {
+	struct in_addr addr;
+	if(group == NULL || inet_pton(AF_INET, group, &addr) != 1 || !IN_MULTICAST(ntohl(addr.s_addr))) {
+		g_snprintf(error, errlen, "Invalid multicast output group (%s), must be an IPv4 multicast address", group ? group : "??");
+		return -1;
+	}
+	if(port < 1 || port > 65535) {
+		g_snprintf(error, errlen, "Invalid multicast output port (%d)", port);
+		return -1;
+	}
+	if(ttl < 0 || ttl > 255) {
+		g_snprintf(error, errlen, "Invalid multicast output TTL (%d)", ttl);
+		return -1;
+	}
+	if(iface != NULL && inet_pton(AF_INET, iface, &addr) != 1) {
+		g_snprintf(error, errlen, "Invalid multicast output interface (%s), must be an IPv4 address", iface);
+		return -1;
+	}
+	if((srtpsuite > 0 || srtpcrypto != NULL) && ((srtpsuite != 32 && srtpsuite != 80) || srtpcrypto == NULL)) {
+		g_snprintf(error, errlen, "Invalid multicast output SRTP settings (suite must be 32 or 80, with a crypto string)");
+		return -1;
+	}
+	return 0;
+}
+
+static void janus_streaming_mcast_out_set(janus_streaming_rtp_source *source, const char *group, int port, int ttl,
+		const char *iface, int srtpsuite, const char *srtpcrypto) {
+	if(source == NULL || group == NULL)
+		return;
+	source->mcast_out_port = port;
+	source->mcast_out_ttl = ttl > 0 ? ttl : 1;
+	source->mcast_out_iface = iface ? g_strdup(iface) : NULL;
+	source->mcast_out_srtpsuite = srtpcrypto ? srtpsuite : 0;
+	source->mcast_out_srtpcrypto = srtpcrypto ? g_strdup(srtpcrypto) : NULL;
+	/* The socket is only created when there's something to send */
+	source->mcast_out_fd = -1;
+	/* The relay thread may be running already: the group goes last */
+	g_atomic_pointer_set(&source->mcast_out, g_strdup(group));
+}
+
+static void janus_streaming_mcast_out_config(janus_config *mp_config, janus_streaming_mountpoint *mp, janus_config_category *cat) {
+	janus_config_item *group = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out");
+	if(group == NULL || group->value == NULL)
+		return;
+	janus_config_item *port = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out_port");
+	janus_config_item *ttl = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out_ttl");
+	janus_config_item *iface = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out_iface");
+	janus_config_item *ssuite = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out_srtpsuite");
+	janus_config_item *scrypto = janus_config_get(mp_config, cat, janus_config_type_item, "mcast_out_srtpcrypto");
+	int port_value = (port && port->value) ? atoi(port->value) : 0;
+	int ttl_value = (ttl && ttl->value) ? atoi(ttl->value) : 0;
+	int ssuite_value = (ssuite && ssuite->value) ? atoi(ssuite->value) : 0;
+	char error[256];
+	if(janus_streaming_mcast_out_check(group->value, port_value, ttl_value,
+			iface ? iface->value : NULL, ssuite_value, scrypto ? scrypto->value : NULL, error, sizeof(error)) < 0) {
+		JANUS_LOG(LOG_ERR, "[%s] %s, not sending to a multicast group\n", mp->name, error);
+		return;
+	}
+	janus_streaming_mcast_out_set(mp->source, group->value, port_value, ttl_value,
+		iface ? iface->value : NULL, ssuite_value, scrypto ? scrypto->value : NULL);
+}
+
+static void janus_streaming_mcast_out_save(janus_config *mp_config, janus_config_category *c, janus_streaming_rtp_source *source) {
+	if(source == NULL || source->mcast_out == NULL)
+		return;
+	char value[20];
+	janus_config_add(mp_config, c, janus_config_item_create("mcast_out", source->mcast_out));
+	g_snprintf(value, sizeof(value), "%d", source->mcast_out_port);
+	janus_config_add(mp_config, c, janus_config_item_create("mcast_out_port", value));
+	g_snprintf(value, sizeof(value), "%d", source->mcast_out_ttl);
+	janus_config_add(mp_config, c, janus_config_item_create("mcast_out_ttl", value));
+	if(source->mcast_out_iface)
+		janus_config_add(mp_config, c, janus_config_item_create("mcast_out_iface", source->mcast_out_iface));
+	if(source->mcast_out_srtpsuite > 0 && source->mcast_out_srtpcrypto) {
+		g_snprintf(value, sizeof(value), "%d", source->mcast_out_srtpsuite);
+		janus_config_add(mp_config, c, janus_config_item_create("mcast_out_srtpsuite", value));
+		janus_config_add(mp_config, c, janus_config_item_create("mcast_out_srtpcrypto", source->mcast_out_srtpcrypto));
+	}
+}
+
+/* Helper to create the socket the multicast output of a mountpoint is sent from */
+static int janus_streaming_mcast_out_socket(const char *name, janus_streaming_rtp_source *source) {
+	int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(fd < 0) {
+		JANUS_LOG(LOG_ERR, "[%s] Error creating multicast output socket... %d (%s)\n", name, errno, g_strerror(errno));
+		return -1;
+	}
+	unsigned char ttl = (unsigned char)source->mcast_out_ttl;
+	if(setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+		JANUS_LOG(LOG_WARN, "[%s] Error setting multicast output TTL... %d (%s)\n", name, errno, g_strerror(errno));
+	}
+	if(source->mcast_out_iface != NULL) {
+		struct in_addr addr;
+		if(inet_pton(AF_INET, source->mcast_out_iface, &addr) == 1 &&
+				setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) < 0) {
+			JANUS_LOG(LOG_WARN, "[%s] Error setting multicast output interface... %d (%s)\n", name, errno, g_strerror(errno));
+		}
+	}
+	return fd;
+}
+
+/* Helper to send a packet to the multicast output of a mountpoint, if any: this is
+ * only called by the relay thread, which creates the forwarders the first time */
+static void janus_streaming_relay_multicast(janus_streaming_mountpoint *mountpoint,
+		janus_streaming_rtp_source_stream *stream, janus_streaming_rtp_relay_packet *packet, int substream) {
+	janus_streaming_rtp_source *source = mountpoint->source;
+	const char *group = g_atomic_pointer_get(&source->mcast_out);
+	if(group == NULL || stream->mcast_fwd_failed || stream->type == JANUS_STREAMING_MEDIA_DATA)
+		return;
+	if(stream->mcast_fwd == NULL) {
+		int port = source->mcast_out_port + 2*stream->mindex;
+		if(source->mcast_out_fd < 0)
+			source->mcast_out_fd = janus_streaming_mcast_out_socket(mountpoint->name, source);
+		if(source->mcast_out_fd > -1 && port <= 65535) {
+			stream->mcast_fwd = janus_rtp_forwarder_create(JANUS_STREAMING_PACKAGE, 0,
+				source->mcast_out_fd, group, port, 0, 0,
+				source->mcast_out_srtpsuite, source->mcast_out_srtpcrypto,
+				FALSE, 0, stream->type == JANUS_STREAMING_MEDIA_VIDEO, FALSE);
+		}
+		if(stream->mcast_fwd == NULL) {
+			JANUS_LOG(LOG_ERR, "[%s] Couldn't send %s stream #%d to multicast group %s:%d\n",
+				mountpoint->name, janus_streaming_media_str(stream->type), stream->mindex, group, port);
+			stream->mcast_fwd_failed = TRUE;
+			return;
+		}
+		JANUS_LOG(LOG_INFO, "[%s] Sending %s stream #%d to multicast group %s:%d%s\n",
+			mountpoint->name, janus_streaming_media_str(stream->type), stream->mindex, group, port,
+			source->mcast_out_srtpsuite > 0 ? " (SRTP)" : "");
+	}
+	janus_rtp_forwarder_send_rtp(stream->mcast_fwd, (char *)packet->data, packet->length, substream);
+}
+
 static void janus_streaming_file_source_free(janus_streaming_file_source *source) {
 	g_free(source->codecs.fmtp);
 	g_free(source->filename);
+	if(source->map != NULL)
+		g_mapped_file_unref(source->map);
+	janus_mutex_destroy(&source->mutex);
 	g_free(source);
 }
 
+/* Helper to get a reference to the in-memory version of a file source: the
+ * file is only mapped the first time it's needed, and then shared by anyone
+ * playing it, which means it must not be modified in place after that */
+static GMappedFile *janus_streaming_file_source_map(janus_streaming_file_source *source, const char *name) {
+	janus_mutex_lock(&source->mutex);
+	if(source->map == NULL) {
+		GError *error = NULL;
+		source->map = g_mapped_file_new(source->filename, FALSE, &error);
+		if(source->map == NULL) {
+			JANUS_LOG(LOG_ERR, "[%s] Error mapping file %s: %s\n", name, source->filename,
+				error && error->message ? error->message : "??");
+			if(error != NULL)
+				g_error_free(error);
+			janus_mutex_unlock(&source->mutex);
+			return NULL;
+		}
+		if(g_mapped_file_get_length(source->map) == 0) {
+			JANUS_LOG(LOG_ERR, "[%s] File %s is empty\n", name, source->filename);
+			g_mapped_file_unref(source->map);
+			source->map = NULL;
+			janus_mutex_unlock(&source->mutex);
+			return NULL;
+		}
+	}
+	GMappedFile *map = g_mapped_file_ref(source->map);
+	janus_mutex_unlock(&source->mutex);
+	return map;
+}
+
 /* Helper to create an RTP live source (e.g., from gstreamer/ffmpeg/vlc/etc.) */
 /* Helpers to create an RTP live source (e.g., from gstreamer/ffmpeg/vlc/etc.) */
 janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
@@ -7475,6 +8505,8 @@ janus_streaming_rtp_source_stream *janus_streaming_create_rtp_source_stream(
 		stream->keyframe.temp_keyframe = NULL;
 		stream->keyframe.temp_ts = 0;
 		janus_mutex_init(&stream->keyframe.mutex);
+		if(bufferkf && gop_cache_size > 0)
+			stream->gop = janus_rtp_gop_cache_create(stream->codecs.video_codec, gop_cache_size);
 	} else if(mtype == JANUS_STREAMING_MEDIA_DATA) {
 		stream->textdata = textdata;
 		stream->buffermsg = buffermsg;
@@ -7660,6 +8692,11 @@ janus_streaming_mountpoint *janus_streaming_create_rtp_source(
 		}
 	}
 	janus_mutex_unlock(&mountpoints_mutex);
+#ifdef HAVE_EPOLL
+	/* If we have reactor threads, one of them will serve this mountpoint */
+	if(reactor_threads > 0 && janus_streaming_reactor_add(live_rtp) == 0)
+		return live_rtp;
+#endif
 	/* Finally, create the mountpoint thread itself */
 	g_snprintf(tname, sizeof(tname), "mp %s", live_rtp->id_str);
 	janus_refcount_increase(&live_rtp->ref);
@@ -7758,6 +8795,7 @@ janus_streaming_mountpoint *janus_streaming_create_file_source(
 	file_source->streaming_source = janus_streaming_source_file;
 	janus_streaming_file_source *file_source_source = g_malloc0(sizeof(janus_streaming_file_source));
 	file_source_source->filename = g_strdup(filename);
+	janus_mutex_init(&file_source_source->mutex);
 	file_source->source = file_source_source;
 	file_source->source_destroy = (GDestroyNotify) janus_streaming_file_source_free;
 	if(strstr(filename, ".opus")) {
@@ -7917,7 +8955,7 @@ static inline gint64 janus_streaming_min_if(gint64 a, gint64 b) {
 
 /* Static helper to connect to an RTSP server, considering we might do this either
  * when creating a new mountpoint, or when reconnecting after some failure */
-static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp) {
+static int janus_streaming_rtsp_connect_to_server_internal(janus_streaming_mountpoint *mp) {
 	if(mp == NULL)
 		return -1;
 	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
@@ -8538,6 +9576,12 @@ static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp
 				stream->keyframe.temp_keyframe = NULL;
 				stream->keyframe.temp_ts = 0;
 				janus_mutex_init(&stream->keyframe.mutex);
+				if(stream->gop != NULL) {
+					/* We're reconnecting, the codec may have changed too */
+					janus_rtp_gop_cache_reset(stream->gop);
+					stream->gop->vcodec = stream->codecs.video_codec;
+				} else if(gop_cache_size > 0)
+					stream->gop = janus_rtp_gop_cache_create(stream->codecs.video_codec, gop_cache_size);
 			}
 		}
 		temp = temp->next;
@@ -8548,6 +9592,143 @@ static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp
 	return 0;
 }
 
+/* Wrapper to the above, that waits for its turn if too many mountpoints are
+ * setting up an RTSP session already, and keeps track of how long it took */
+static int janus_streaming_rtsp_connect_to_server(janus_streaming_mountpoint *mp) {
+	if(mp == NULL || mp->source == NULL)
+		return -1;
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	gint64 start = janus_get_monotonic_time();
+	janus_mutex_lock(&rtsp_setups_mutex);
+	while(rtsp_max_setups > 0 && rtsp_setups >= rtsp_max_setups && !g_atomic_int_get(&stopping)) {
+		janus_condition_wait(&rtsp_setups_cond, &rtsp_setups_mutex);
+	}
+	rtsp_setups++;
+	janus_mutex_unlock(&rtsp_setups_mutex);
+	int res = janus_streaming_rtsp_connect_to_server_internal(mp);
+	janus_mutex_lock(&rtsp_setups_mutex);
+	rtsp_setups--;
+	janus_condition_signal(&rtsp_setups_cond);
+	janus_mutex_unlock(&rtsp_setups_mutex);
+	source->rtsp_setups++;
+	if(res < 0)
+		source->rtsp_setup_failures++;
+	else
+		source->rtsp_setup_latency = janus_get_monotonic_time() - start;
+	return res;
+}
+
+/* Helper to ask the RTSP control thread to send a keep-alive (OPTIONS) for a mountpoint:
+ * returns FALSE if there's no control thread, in which case it's up to the caller */
+static gboolean janus_streaming_rtsp_keepalive(janus_streaming_mountpoint *mp) {
+	if(rtsp_control_thread == NULL || rtsp_keepalives == NULL || g_atomic_int_get(&stopping))
+		return FALSE;
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	/* If the previous keep-alive is still in progress, there's nothing to do */
+	if(!g_atomic_int_compare_and_exchange(&source->rtsp_ka_pending, 0, 1))
+		return TRUE;
+	janus_refcount_increase(&mp->ref);
+	g_async_queue_push(rtsp_keepalives, mp);
+	return TRUE;
+}
+
+/* Thread sending the RTSP keep-alives of all mountpoints */
+static void *janus_streaming_rtsp_control(void *data) {
+	JANUS_LOG(LOG_VERB, "Starting RTSP control thread\n");
+	CURLM *multi = (CURLM *)data;
+	/* Keep-alives in progress, indexed by their (easy) curl handle */
+	GHashTable *active = g_hash_table_new(NULL, NULL);
+	int running = 0;
+	while(!g_atomic_int_get(&stopping) || g_hash_table_size(active) > 0) {
+		/* Any new keep-alive to send? Don't wait if we have transfers to follow */
+		janus_streaming_mountpoint *mp = NULL;
+		if(g_hash_table_size(active) > 0)
+			mp = g_async_queue_try_pop(rtsp_keepalives);
+		else
+			mp = g_async_queue_timeout_pop(rtsp_keepalives, 250000);
+		while(mp != NULL) {
+			janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+			/* If the relay thread is busy with the RTSP session (e.g., it's reconnecting),
+			 * that's a keep-alive of its own: we don't wait and skip this one */
+			if(g_atomic_int_get(&stopping) || g_atomic_int_get(&mp->destroyed) ||
+					!janus_mutex_trylock(&source->rtsp_mutex)) {
+				g_atomic_int_set(&source->rtsp_ka_pending, 0);
+				janus_refcount_decrease(&mp->ref);
+			} else if(source->curl == NULL || source->curldata == NULL) {
+				janus_mutex_unlock(&source->rtsp_mutex);
+				g_atomic_int_set(&source->rtsp_ka_pending, 0);
+				janus_refcount_decrease(&mp->ref);
+			} else {
+				/* Send an RTSP OPTIONS: we keep the RTSP mutex locked until it's done */
+				JANUS_LOG(LOG_VERB, "[%s] Sending OPTIONS\n", mp->name);
+				g_free(source->curldata->buffer);
+				source->curldata->buffer = g_malloc0(1);
+				source->curldata->size = 0;
+				curl_easy_setopt(source->curl, CURLOPT_RTSP_STREAM_URI, source->rtsp_url);
+				curl_easy_setopt(source->curl, CURLOPT_RTSP_REQUEST, (long)CURL_RTSPREQ_OPTIONS);
+				source->rtsp_ka_latency = janus_get_monotonic_time();
+				g_hash_table_insert(active, source->curl, mp);
+				curl_multi_add_handle(multi, source->curl);
+			}
+			mp = g_async_queue_try_pop(rtsp_keepalives);
+		}
+		if(g_hash_table_size(active) == 0)
+			continue;
+		/* Drive the transfers in progress */
+		curl_multi_perform(multi, &running);
+		CURLMsg *msg = NULL;
+		int left = 0;
+		while((msg = curl_multi_info_read(multi, &left)) != NULL) {
+			if(msg->msg != CURLMSG_DONE)
+				continue;
+			CURL *curl = msg->easy_handle;
+			CURLcode res = msg->data.result;
+			mp = g_hash_table_lookup(active, curl);
+			g_hash_table_remove(active, curl);
+			curl_multi_remove_handle(multi, curl);
+			if(mp == NULL)
+				continue;
+			janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+			source->rtsp_kas++;
+			if(res != CURLE_OK) {
+				JANUS_LOG(LOG_ERR, "[%s] Couldn't send OPTIONS request: %s (%s)\n",
+					mp->name, curl_easy_strerror(res), source->curl_errbuf);
+				source->rtsp_ka_failures++;
+				source->rtsp_ka_latency = 0;
+			} else {
+				source->rtsp_ka_latency = janus_get_monotonic_time() - source->rtsp_ka_latency;
+			}
+			janus_mutex_unlock(&source->rtsp_mutex);
+			g_atomic_int_set(&source->rtsp_ka_pending, 0);
+			janus_refcount_decrease(&mp->ref);
+		}
+		if(g_hash_table_size(active) > 0)
+			curl_multi_wait(multi, NULL, 0, 100, NULL);
+	}
+	/* Get rid of keep-alives we never got to send */
+	janus_streaming_mountpoint *mp = NULL;
+	while((mp = g_async_queue_try_pop(rtsp_keepalives)) != NULL) {
+		janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+		g_atomic_int_set(&source->rtsp_ka_pending, 0);
+		janus_refcount_decrease(&mp->ref);
+	}
+	g_hash_table_destroy(active);
+	curl_multi_cleanup(multi);
+	JANUS_LOG(LOG_VERB, "Leaving RTSP control thread\n");
+	return NULL;
+}
+
+/* Returns how long to wait before trying to reconnect an RTSP mountpoint again:
+ * we back off exponentially (up to 8 times the reconnect delay) as attempts keep
+ * failing, and add some jitter, so that mountpoints that got disconnected at the
+ * same time (e.g., because of a network outage) don't all retry at the same time */
+static gint64 janus_streaming_rtsp_reconnect_wait(janus_streaming_rtp_source *source) {
+	gint64 wait = source->reconnect_delay;
+	if(source->reconnect_failures > 1)
+		wait *= (gint64)1 << MIN(source->reconnect_failures - 1, 3);
+	return wait + (gint64)(g_random_double() * (wait / 2));
+}
+
 /* Helper method to send a latching packet on an RTSP media socket */
 static void janus_streaming_rtsp_latch(int fd, char *host, int port, struct sockaddr *remote) {
 	/* Resolve address to get an IP */
@@ -8642,6 +9823,95 @@ static int janus_streaming_rtsp_play(janus_streaming_rtp_source *source) {
 	return 0;
 }
 
+/* Helper to close the RTSP session and the sockets we were receiving media on,
+ * either because we're about to reconnect or because a lazy mountpoint went idle */
+static void janus_streaming_rtsp_disconnect(janus_streaming_rtp_source *source, gboolean teardown) {
+	GList *temp = source->media;
+	while(temp) {
+		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+		if(stream->fd[0] > -1) {
+			g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[0]));
+			close(stream->fd[0]);
+		}
+		stream->fd[0] = -1;
+		if(stream->fd[1] > -1) {
+			g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[1]));
+			close(stream->fd[1]);
+		}
+		stream->fd[1] = -1;
+		if(stream->fd[2] > -1) {
+			g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[2]));
+			close(stream->fd[2]);
+		}
+		stream->fd[2] = -1;
+		if(stream->rtcp_fd > -1) {
+			g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->rtcp_fd));
+			close(stream->rtcp_fd);
+		}
+		stream->rtcp_fd = -1;
+		temp = temp->next;
+	}
+	janus_mutex_lock(&source->rtsp_mutex);
+	if(teardown && source->curl) {
+		/* Send an RTSP TEARDOWN */
+		curl_easy_setopt(source->curl, CURLOPT_RTSP_REQUEST, (long)CURL_RTSPREQ_TEARDOWN);
+		int res = curl_easy_perform(source->curl);
+		if(res != CURLE_OK) {
+			JANUS_LOG(LOG_ERR, "Couldn't send TEARDOWN request: %s\n", curl_easy_strerror(res));
+		}
+	}
+	curl_easy_cleanup(source->curl);
+	source->curl = NULL;
+	g_free(source->curl_errbuf);
+	source->curl_errbuf = NULL;
+	if(source->curldata)
+		g_free(source->curldata->buffer);
+	g_free(source->curldata);
+	source->curldata = NULL;
+	janus_mutex_unlock(&source->rtsp_mutex);
+}
+
+/* Helper to connect a lazy RTSP mountpoint when the first viewer comes in,
+ * and wake up the relay thread: we do this synchronously, as we can't
+ * prepare an offer until we know which streams the RTSP server provides,
+ * so callers must not hold the mountpoint or session mutex while at it */
+static int janus_streaming_rtsp_lazy_start(janus_streaming_mountpoint *mp) {
+	janus_streaming_rtp_source *source = (janus_streaming_rtp_source *)mp->source;
+	if(source == NULL || !source->rtsp || !source->rtsp_lazy)
+		return 0;
+	janus_mutex_lock(&source->lazy_mutex);
+	if(g_atomic_int_get(&source->rtsp_lazy_active)) {
+		/* Already connected */
+		janus_mutex_unlock(&source->lazy_mutex);
+		return 0;
+	}
+	JANUS_LOG(LOG_INFO, "[%s] New viewer, connecting to the RTSP server\n", mp->name);
+	source->rtsp_lazy_start = janus_get_monotonic_time();
+	source->rtsp_startup_latency = 0;
+	if(janus_streaming_rtsp_connect_to_server(mp) < 0 || janus_streaming_rtsp_play(source) < 0) {
+		if(source->media == NULL) {
+			/* We never got to know which streams are available, so we can't offer anything */
+			JANUS_LOG(LOG_ERR, "[%s] Couldn't connect to the RTSP server\n", mp->name);
+			janus_mutex_unlock(&source->lazy_mutex);
+			return -1;
+		}
+		/* We know what to offer, the relay thread will keep on trying to reconnect */
+		JANUS_LOG(LOG_WARN, "[%s] Couldn't connect to the RTSP server, trying again in a few seconds...\n", mp->name);
+	}
+	/* Ask for a keyframe as soon as possible, so that viewers don't have to wait */
+	GList *temp = source->media;
+	while(temp) {
+		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+		if(stream->type == JANUS_STREAMING_MEDIA_VIDEO)
+			g_atomic_int_set(&stream->need_pli, 1);
+		temp = temp->next;
+	}
+	g_atomic_int_set(&source->rtsp_lazy_active, 1);
+	janus_condition_broadcast(&source->lazy_cond);
+	janus_mutex_unlock(&source->lazy_mutex);
+	return 0;
+}
+
 /* Helper to create an RTSP source */
 janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		uint64_t id, char *id_str, char *name, char *desc, char *metadata,
@@ -8650,7 +9920,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		gboolean dovideo, int vpt, char *vcodec, char *vfmtp, gboolean bufferkf,
 		const janus_network_address *iface, int threads,
 		gint64 reconnect_delay, gint64 session_timeout, int rtsp_timeout, int rtsp_conn_timeout,
-		gboolean error_on_failure) {
+		gboolean lazy, gint64 idle_timeout, gboolean error_on_failure) {
 	char id_num[30];
 	if(!string_ids) {
 		g_snprintf(id_num, sizeof(id_num), "%"SCNu64, id);
@@ -8676,6 +9946,10 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		JANUS_LOG(LOG_ERR, "rtsp_conn_timeout can't be smaller than zero.\n");
 		return NULL;
 	}
+	if(idle_timeout < 0) {
+		JANUS_LOG(LOG_ERR, "rtsp_idle_timeout can't be smaller than zero.\n");
+		return NULL;
+	}
 
 	JANUS_LOG(LOG_VERB, "Audio %s, Video %s\n", doaudio ? "enabled" : "NOT enabled", dovideo ? "enabled" : "NOT enabled");
 
@@ -8729,7 +10003,8 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	live_rtsp_source->pipefd[0] = -1;
 	live_rtsp_source->pipefd[1] = -1;
 	pipe(live_rtsp_source->pipefd);
-	live_rtsp_source->rtsp_bufferkf = bufferkf;
+	/* Lazy mountpoints always buffer keyframes, to serve new viewers quickly */
+	live_rtsp_source->rtsp_bufferkf = bufferkf || lazy;
 	live_rtsp_source->ka_timeout = session_timeout;
 	live_rtsp_source->reconnect_delay = reconnect_delay;
 	live_rtsp_source->session_timeout = session_timeout;
@@ -8737,6 +10012,11 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	live_rtsp_source->rtsp_conn_timeout = rtsp_conn_timeout;
 	live_rtsp_source->reconnect_timer = 0;
 	janus_mutex_init(&live_rtsp_source->rtsp_mutex);
+	live_rtsp_source->rtsp_lazy = lazy;
+	live_rtsp_source->rtsp_idle_timeout = idle_timeout;
+	g_atomic_int_set(&live_rtsp_source->rtsp_lazy_active, lazy ? 0 : 1);
+	janus_mutex_init(&live_rtsp_source->lazy_mutex);
+	janus_condition_init(&live_rtsp_source->lazy_cond);
 	live_rtsp->source = live_rtsp_source;
 	live_rtsp->source_destroy = (GDestroyNotify) janus_streaming_rtp_source_free;
 	live_rtsp->viewers = NULL;
@@ -8754,8 +10034,10 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 	if(dovideo && vcodec)
 		live_rtsp_source->rtsp_acodecs.video_codec = janus_videocodec_from_name(vcodec);
 	live_rtsp_source->rtsp_vcodecs.fmtp = dovideo ? (vfmtp ? g_strdup(vfmtp) : NULL) : NULL;
-	/* If we need to return an error on failure, try connecting right now */
-	if(error_on_failure) {
+	/* If we need to return an error on failure, try connecting right now,
+	 * unless this is a lazy mountpoint: in that case we'll connect when
+	 * the first viewer comes in, and the relay thread will wait until then */
+	if(error_on_failure && !lazy) {
 		/* Now connect to the RTSP server */
 		if(janus_streaming_rtsp_connect_to_server(live_rtsp) < 0) {
 			/* Error connecting, get rid of the mountpoint */
@@ -8844,7 +10126,7 @@ janus_streaming_mountpoint *janus_streaming_create_rtsp_source(
 		gboolean dovideo, int vpt, char *videocodec, char *videofmtp, gboolean bufferkf,
 		const janus_network_address *iface, int threads,
 		gint64 reconnect_delay, gint64 session_timeout, int rtsp_timeout, int rtsp_conn_timeout,
-		gboolean error_on_failure) {
+		gboolean lazy, gint64 idle_timeout, gboolean error_on_failure) {
 	JANUS_LOG(LOG_ERR, "RTSP need libcurl\n");
 	return NULL;
 }
@@ -8889,35 +10171,18 @@ static void *janus_streaming_ondemand_thread(void *data) {
 		return NULL;
 	}
 	JANUS_LOG(LOG_VERB, "[%s] Opening file source %s...\n", mountpoint->name, source->filename);
-	FILE *audio = fopen(source->filename, "rb");
-	if(!audio) {
-		JANUS_LOG(LOG_ERR, "[%s] Ooops, audio file missing!\n", mountpoint->name);
+	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
+	janus_streaming_file_player player;
+	if(janus_streaming_file_player_init(&player, source, name) < 0) {
+		JANUS_LOG(LOG_ERR, "[%s] Ooops, can't play audio file!\n", name);
+		g_free(name);
 		janus_refcount_decrease(&session->ref);
 		janus_refcount_decrease(&mountpoint->ref);
 		g_thread_unref(g_thread_self());
 		return NULL;
 	}
-	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
 	JANUS_LOG(LOG_VERB, "[%s] Streaming audio file: %s\n", name, source->filename);
 
-#ifdef HAVE_LIBOGG
-	/* Make sure that, if this is an .opus file, we can open it */
-	janus_streaming_opus_context opusctx = { 0 };
-	if(source->opus) {
-		opusctx.name = name;
-		opusctx.filename = source->filename;
-		opusctx.file = audio;
-		if(janus_streaming_opus_context_init(&opusctx) < 0) {
-			g_free(name);
-			fclose(audio);
-			janus_refcount_decrease(&session->ref);
-			janus_refcount_decrease(&mountpoint->ref);
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-	}
-#endif
-
 	/* Buffer */
 	char buf[1500];
 	memset(buf, 0, sizeof(buf));
@@ -8939,10 +10204,8 @@ static void *janus_streaming_ondemand_thread(void *data) {
 	time_t passed, d_s, d_us;
 	/* Loop */
 	gint read = 0;
-#ifdef HAVE_LIBOGG
 	const gint plen = (sizeof(buf)-RTP_HEADER_SIZE);
-#endif
-	janus_streaming_rtp_relay_packet packet;
+	janus_streaming_rtp_relay_packet packet = { 0 };
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed) &&
 			!g_atomic_int_get(&session->stopping) && !g_atomic_int_get(&session->destroyed)) {
 		/* See if it's time to prepare a frame */
@@ -8967,23 +10230,12 @@ static void *janus_streaming_ondemand_thread(void *data) {
 		/* If not started or paused, wait some more */
 		if(!g_atomic_int_get(&session->started) || g_atomic_int_get(&session->paused) || !mountpoint->enabled)
 			continue;
-		if(source->opus) {
-#ifdef HAVE_LIBOGG
-			/* Get the next frame from the Opus file */
-			read = janus_streaming_opus_context_read(&opusctx, buf + RTP_HEADER_SIZE, plen);
-#endif
-		} else {
-			/* Read frame from file... */
-			read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
-			if(feof(audio)) {
-				/* FIXME We're doing this forever... should this be configurable? */
-				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
-				fseek(audio, 0, SEEK_SET);
-				continue;
-			}
-		}
+		/* Get the next frame from the file */
+		read = janus_streaming_file_player_read(&player, buf + RTP_HEADER_SIZE, plen);
 		if(read < 0)
 			break;
+		if(read == 0)
+			continue;
 		if(mountpoint->active == FALSE)
 			mountpoint->active = TRUE;
 		/* Relay to the listener */
@@ -9007,12 +10259,8 @@ static void *janus_streaming_ondemand_thread(void *data) {
 		header->markerbit = 0;
 	}
 	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (ondemand) thread\n", name);
-#ifdef HAVE_LIBOGG
-	if(source->opus)
-		janus_streaming_opus_context_cleanup(&opusctx);
-#endif
+	janus_streaming_file_player_cleanup(&player);
 	g_free(name);
-	fclose(audio);
 	janus_refcount_decrease(&session->ref);
 	janus_refcount_decrease(&mountpoint->ref);
 	g_thread_unref(g_thread_self());
@@ -9044,32 +10292,16 @@ static void *janus_streaming_filesource_thread(void *data) {
 		return NULL;
 	}
 	JANUS_LOG(LOG_VERB, "[%s] Opening file source %s...\n", mountpoint->name, source->filename);
-	FILE *audio = fopen(source->filename, "rb");
-	if(!audio) {
-		JANUS_LOG(LOG_ERR, "[%s] Ooops, audio file missing!\n", mountpoint->name);
+	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
+	janus_streaming_file_player player;
+	if(janus_streaming_file_player_init(&player, source, name) < 0) {
+		JANUS_LOG(LOG_ERR, "[%s] Ooops, can't play audio file!\n", name);
+		g_free(name);
 		janus_refcount_decrease(&mountpoint->ref);
 		return NULL;
 	}
-	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
 	JANUS_LOG(LOG_VERB, "[%s] Streaming audio file: %s\n", mountpoint->name, source->filename);
 
-#ifdef HAVE_LIBOGG
-	/* Make sure that, if this is an .opus file, we can open it */
-	janus_streaming_opus_context opusctx = { 0 };
-	if(source->opus) {
-		opusctx.name = name;
-		opusctx.filename = source->filename;
-		opusctx.file = audio;
-		if(janus_streaming_opus_context_init(&opusctx) < 0) {
-			g_free(name);
-			fclose(audio);
-			janus_refcount_decrease(&mountpoint->ref);
-			g_thread_unref(g_thread_self());
-			return NULL;
-		}
-	}
-#endif
-
 	/* Buffer */
 	char buf[1500];
 	memset(buf, 0, sizeof(buf));
@@ -9091,10 +10323,8 @@ static void *janus_streaming_filesource_thread(void *data) {
 	time_t passed, d_s, d_us;
 	/* Loop */
 	gint read = 0;
-#ifdef HAVE_LIBOGG
 	const gint plen = (sizeof(buf)-RTP_HEADER_SIZE);
-#endif
-	janus_streaming_rtp_relay_packet packet;
+	janus_streaming_rtp_relay_packet packet = { 0 };
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
 		/* See if it's time to prepare a frame */
 		gettimeofday(&now, NULL);
@@ -9118,26 +10348,135 @@ static void *janus_streaming_filesource_thread(void *data) {
 		/* If paused, wait some more */
 		if(!mountpoint->enabled)
 			continue;
-		if(source->opus) {
-#ifdef HAVE_LIBOGG
-			/* Get the next frame from the Opus file */
-			read = janus_streaming_opus_context_read(&opusctx, buf + RTP_HEADER_SIZE, plen);
-#endif
-		} else {
-			/* Read frame from file... */
-			read = fread(buf + RTP_HEADER_SIZE, sizeof(char), 160, audio);
-			if(feof(audio)) {
-				/* FIXME We're doing this forever... should this be configurable? */
-				JANUS_LOG(LOG_VERB, "[%s] Rewind! (%s)\n", name, source->filename);
-				fseek(audio, 0, SEEK_SET);
-				continue;
+		/* Get the next frame from the file */
+		read = janus_streaming_file_player_read(&player, buf + RTP_HEADER_SIZE, plen);
+		if(read < 0)
+			break;
+		if(read == 0)
+			continue;
+		if(mountpoint->active == FALSE)
+			mountpoint->active = TRUE;
+		/* Relay on all sessions */
+		packet.mindex = -1;
+		packet.data = header;
+		packet.length = RTP_HEADER_SIZE + read;
+		packet.is_rtp = TRUE;
+		packet.is_video = FALSE;
+		packet.is_keyframe = FALSE;
+		/* Backup the actual payload type, timestamp and sequence number */
+		packet.ptype = packet.data->type;
+		packet.timestamp = ntohl(packet.data->timestamp);
+		packet.seq_number = ntohs(packet.data->seq_number);
+		/* Go! */
+		janus_mutex_lock_nodebug(&mountpoint->mutex);
+		janus_streaming_relay_rtp_viewers(mountpoint->viewers, &packet);
+		janus_mutex_unlock_nodebug(&mountpoint->mutex);
+		/* Update header */
+		seq++;
+		header->seq_number = htons(seq);
+		ts += (source->opus ? 960 : 160);
+		header->timestamp = htonl(ts);
+		header->markerbit = 0;
+	}
+	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (live) thread\n", name);
+	janus_streaming_file_player_cleanup(&player);
+	g_free(name);
+	janus_refcount_decrease(&mountpoint->ref);
+	return NULL;
+}
+
+/* Thread to send RTP packets from a file (on demand) to a group of synchronized viewers */
+static void *janus_streaming_filesync_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Filesource (synchronized) thread starting...\n");
+	janus_streaming_file_group *group = (janus_streaming_file_group *)data;
+	janus_streaming_mountpoint *mountpoint = group->mountpoint;
+	janus_streaming_file_source *source = mountpoint->source;
+	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
+	janus_streaming_file_player player;
+	gboolean playing = (janus_streaming_file_player_init(&player, source, name) == 0);
+	if(!playing)
+		JANUS_LOG(LOG_ERR, "[%s] Ooops, can't play audio file!\n", name);
+	/* Buffer */
+	char buf[1500];
+	memset(buf, 0, sizeof(buf));
+	/* Set up RTP */
+	guint16 seq = 1;
+	guint32 ts = 0;
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	header->version = 2;
+	header->markerbit = 1;
+	header->type = source->codecs.pt;
+	header->seq_number = htons(seq);
+	header->timestamp = htonl(ts);
+	header->ssrc = htonl(1);	/* The Janus core will fix this anyway */
+	/* Timer */
+	struct timeval now, before;
+	gettimeofday(&before, NULL);
+	now.tv_sec = before.tv_sec;
+	now.tv_usec = before.tv_usec;
+	time_t passed, d_s, d_us;
+	/* Loop */
+	gint read = 0;
+	const gint plen = (sizeof(buf)-RTP_HEADER_SIZE);
+	janus_streaming_rtp_relay_packet packet = { 0 };
+	while(playing && !g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
+		/* See if it's time to prepare a frame */
+		gettimeofday(&now, NULL);
+		d_s = now.tv_sec - before.tv_sec;
+		d_us = now.tv_usec - before.tv_usec;
+		if(d_us < 0) {
+			d_us += 1000000;
+			--d_s;
+		}
+		passed = d_s*1000000 + d_us;
+		if(passed < 18000) {	/* Let's wait about 18ms */
+			g_usleep(5000);
+			continue;
+		}
+		/* Update the reference time */
+		before.tv_usec += 20000;
+		if(before.tv_usec > 1000000) {
+			before.tv_sec++;
+			before.tv_usec -= 1000000;
+		}
+		/* Get rid of the viewers that left, and check if any is ready */
+		gboolean started = FALSE;
+		janus_mutex_lock(&source->mutex);
+		GList *temp = group->sessions;
+		while(temp) {
+			janus_streaming_session *session = (janus_streaming_session *)temp->data;
+			GList *next = temp->next;
+			if(g_atomic_int_get(&session->stopping) || g_atomic_int_get(&session->destroyed)) {
+				group->sessions = g_list_delete_link(group->sessions, temp);
+				janus_refcount_decrease(&session->ref);
+			} else if(g_atomic_int_get(&session->started)) {
+				started = TRUE;
 			}
+			temp = next;
 		}
-		if(read < 0)
+		if(group->sessions == NULL) {
+			/* Nobody left, make sure no new viewer can join us */
+			if(source->group == group)
+				source->group = NULL;
+			janus_mutex_unlock(&source->mutex);
 			break;
+		}
+		/* If no viewer started yet, or paused, wait some more */
+		if(!started || !mountpoint->enabled) {
+			janus_mutex_unlock(&source->mutex);
+			continue;
+		}
+		/* Get the next frame from the file */
+		read = janus_streaming_file_player_read(&player, buf + RTP_HEADER_SIZE, plen);
+		if(read <= 0) {
+			janus_mutex_unlock(&source->mutex);
+			if(read < 0)
+				break;
+			continue;
+		}
 		if(mountpoint->active == FALSE)
 			mountpoint->active = TRUE;
-		/* Relay on all sessions */
+		/* Relay to all the viewers in the group */
 		packet.mindex = -1;
 		packet.data = header;
 		packet.length = RTP_HEADER_SIZE + read;
@@ -9149,9 +10488,8 @@ static void *janus_streaming_filesource_thread(void *data) {
 		packet.timestamp = ntohl(packet.data->timestamp);
 		packet.seq_number = ntohs(packet.data->seq_number);
 		/* Go! */
-		janus_mutex_lock_nodebug(&mountpoint->mutex);
-		g_list_foreach(mountpoint->viewers, janus_streaming_relay_rtp_packet, &packet);
-		janus_mutex_unlock_nodebug(&mountpoint->mutex);
+		janus_streaming_relay_rtp_viewers(group->sessions, &packet);
+		janus_mutex_unlock(&source->mutex);
 		/* Update header */
 		seq++;
 		header->seq_number = htons(seq);
@@ -9159,40 +10497,681 @@ static void *janus_streaming_filesource_thread(void *data) {
 		header->timestamp = htonl(ts);
 		header->markerbit = 0;
 	}
-	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (live) thread\n", name);
-#ifdef HAVE_LIBOGG
-	if(source->opus)
-		janus_streaming_opus_context_cleanup(&opusctx);
-#endif
+	JANUS_LOG(LOG_VERB, "[%s] Leaving filesource (synchronized) thread\n", name);
+	if(playing)
+		janus_streaming_file_player_cleanup(&player);
+	/* Release the viewers that are still in the group, if any */
+	janus_mutex_lock(&source->mutex);
+	if(source->group == group)
+		source->group = NULL;
+	while(group->sessions != NULL) {
+		janus_streaming_session *session = (janus_streaming_session *)group->sessions->data;
+		group->sessions = g_list_delete_link(group->sessions, group->sessions);
+		janus_refcount_decrease(&session->ref);
+	}
+	janus_mutex_unlock(&source->mutex);
+	g_free(group);
 	g_free(name);
-	fclose(audio);
 	janus_refcount_decrease(&mountpoint->ref);
+	g_thread_unref(g_thread_self());
 	return NULL;
 }
 
-/* Thread to relay RTP frames coming from gstreamer/ffmpeg/others */
-static void *janus_streaming_relay_thread(void *data) {
-	JANUS_LOG(LOG_VERB, "Starting streaming relay thread\n");
-	janus_streaming_mountpoint *mountpoint = (janus_streaming_mountpoint *)data;
-	if(!mountpoint) {
-		JANUS_LOG(LOG_ERR, "Invalid mountpoint!\n");
-		return NULL;
+/* Helper to start sending an on demand file mountpoint to a viewer: depending
+ * on the mountpoint configuration, the viewer either gets a dedicated thread,
+ * or joins the latest group of viewers, if it was created recently enough */
+static gboolean janus_streaming_ondemand_start(janus_streaming_mountpoint *mp,
+		janus_streaming_session *session, GError **error) {
+	char tname[16];
+	g_snprintf(tname, sizeof(tname), "mp %s", mp->id_str);
+	janus_streaming_file_source *source = mp->source;
+	if(source->sync_window <= 0) {
+		/* Spawn a thread for this viewer */
+		janus_refcount_increase(&session->ref);
+		janus_refcount_increase(&mp->ref);
+		g_thread_try_new(tname, &janus_streaming_ondemand_thread, session, error);
+		if(*error != NULL) {
+			janus_refcount_decrease(&session->ref);	/* This is for the failed thread */
+			janus_refcount_decrease(&mp->ref);		/* This is for the failed thread */
+			return FALSE;
+		}
+		return TRUE;
 	}
-	if(mountpoint->streaming_source != janus_streaming_source_rtp) {
-		JANUS_LOG(LOG_ERR, "[%s] Not an RTP source mountpoint!\n", mountpoint->name);
-		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
+	janus_mutex_lock(&source->mutex);
+	gint64 now = janus_get_monotonic_time();
+	janus_streaming_file_group *group = source->group;
+	if(group == NULL || (now - group->created) > source->sync_window*1000) {
+		/* Start a new group, and spawn a thread for it */
+		group = g_malloc0(sizeof(janus_streaming_file_group));
+		group->mountpoint = mp;
+		group->created = now;
+		janus_refcount_increase(&mp->ref);
+		g_thread_try_new(tname, &janus_streaming_filesync_thread, group, error);
+		if(*error != NULL) {
+			janus_mutex_unlock(&source->mutex);
+			janus_refcount_decrease(&mp->ref);		/* This is for the failed thread */
+			g_free(group);
+			return FALSE;
+		}
+		source->group = group;
+	}
+	/* Add the viewer to the group */
+	janus_refcount_increase(&session->ref);
+	group->sessions = g_list_append(group->sessions, session);
+	janus_mutex_unlock(&source->mutex);
+	return TRUE;
+}
+
+/* Helper to send a PLI and/or REMB back to the source of a stream, if needed */
+static void janus_streaming_relay_feedback(janus_streaming_rtp_source *source, janus_streaming_rtp_source_stream *stream) {
+	if(stream->type != JANUS_STREAMING_MEDIA_VIDEO)
+		return;
+	if(g_atomic_int_get(&stream->need_pli))
+		janus_streaming_rtcp_pli_send(stream);
+	if(stream->rtcp_fd > -1 && source->lowest_bitrate > 0) {
+		gint64 now = janus_get_monotonic_time();
+		if(source->remb_latest == 0)
+			source->remb_latest = now;
+		else if(now - source->remb_latest >= G_USEC_PER_SEC)
+			janus_streaming_rtcp_remb_send(source, stream);
 	}
+}
+
+/* Simulcast dispatching: viewers only ever relay one substream at a time, so
+ * packets from the other ones would be dropped by each of them anyway. Viewers
+ * let the stream know which substreams they're relaying (all of them, while
+ * they're waiting for or switching to a substream), and packets from substreams
+ * nobody's relaying are not dispatched at all, except for keyframes (viewers may
+ * switch on them) and the first packet of each window, which goes to everybody
+ * so that viewers whose substream stopped flowing can fall back to another one */
+#define JANUS_STREAMING_SIMULCAST_ALL		0x7
+#define JANUS_STREAMING_SIMULCAST_WINDOW	250000
+static gboolean janus_streaming_simulcast_dispatch(janus_streaming_rtp_source_stream *stream,
+		const janus_rtp_simulcasting_packet *sim_packet, gint64 now) {
+	if(sim_packet->substream < 0 || sim_packet->substream > 2)
+		return TRUE;
+	if(now - stream->sim_window >= JANUS_STREAMING_SIMULCAST_WINDOW) {
+		/* New window: from now on, only dispatch what viewers relayed in the previous one */
+		stream->sim_window = now;
+		__atomic_store_n(&stream->sim_layers,
+			__atomic_exchange_n(&stream->sim_layers_next, 0, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+		return TRUE;
+	}
+	guint layer = 1 << sim_packet->substream;
+	if(sim_packet->keyframe) {
+		/* Viewers may switch to this substream, keep it open until the next window */
+		__atomic_fetch_or(&stream->sim_layers, layer, __ATOMIC_RELAXED);
+		return TRUE;
+	}
+	return (__atomic_load_n(&stream->sim_layers, __ATOMIC_RELAXED) & layer) != 0;
+}
+/* Called by viewers after processing a simulcast packet, to tell the stream what they need */
+static void janus_streaming_simulcast_track(janus_streaming_rtp_source_stream *stream,
+		janus_rtp_simulcasting_context *sc) {
+	guint layers = JANUS_STREAMING_SIMULCAST_ALL;
+	if(sc->substream >= 0 && sc->substream <= 2 && sc->substream == sc->substream_target &&
+			sc->substream_target_temp == -1)
+		layers = 1 << sc->substream;
+	/* Most of the times there's nothing new, so avoid writing to the shared fields */
+	if((__atomic_load_n(&stream->sim_layers_next, __ATOMIC_RELAXED) & layers) != layers)
+		__atomic_fetch_or(&stream->sim_layers_next, layers, __ATOMIC_RELAXED);
+	if((__atomic_load_n(&stream->sim_layers, __ATOMIC_RELAXED) & layers) != layers)
+		__atomic_fetch_or(&stream->sim_layers, layers, __ATOMIC_RELAXED);
+}
+
+/* Helper to process traffic on one of the sockets of a live RTP mountpoint:
+ * returns -1 if there's nothing more to do for now, 0 otherwise */
+static int janus_streaming_relay_handle(janus_streaming_mountpoint *mountpoint,
+		janus_streaming_recv_batch *batch, int fd, short revents) {
 	janus_streaming_rtp_source *source = mountpoint->source;
-	if(source == NULL) {
-		JANUS_LOG(LOG_ERR, "[%s] Invalid RTP source mountpoint!\n", mountpoint->name);
+	janus_streaming_rtp_source_stream *stream = NULL;
+	const char *name = mountpoint->name ? mountpoint->name : "??";
+	janus_streaming_rtp_relay_packet packet = { 0 };
+	uint32_t ssrc = 0;
+	char *buffer = NULL;
+	int bytes = 0, received = 0, r = 0;
+	if(revents & (POLLERR | POLLHUP)) {
+		/* Socket error? */
+		JANUS_LOG(LOG_ERR, "[%s] Error polling: %s... %d (%s)\n", name,
+			revents & POLLERR ? "POLLERR" : "POLLHUP", errno, g_strerror(errno));
+		mountpoint->enabled = FALSE;
+		janus_mutex_lock(&source->rec_mutex);
+		GList *temp = source->media;
+		while(temp) {
+			janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+			janus_recorder_close(stream->rc);
+			JANUS_LOG(LOG_INFO, "[%s] Closed %s recording %s (%s)\n", mountpoint->name,
+				janus_streaming_media_str(stream->type), stream->rc->filename, stream->mid);
+			janus_recorder *tmp = stream->rc;
+			stream->rc = NULL;
+			janus_recorder_destroy(tmp);
+			break;
+		}
+		janus_mutex_unlock(&source->rec_mutex);
+		return -1;
+	} else if(revents & POLLIN) {
+		/* Got an RTP or data packet */
+		if(fd == source->pipefd[0]) {
+			/* We're done here */
+			int code = 0;
+			bytes = read(fd, &code, sizeof(int));
+			JANUS_LOG(LOG_VERB, "[%s] Interrupting mountpoint\n", mountpoint->name);
+			return -1;
+		} else {
+			/* Check which stream this file descriptor belongs to */
+			stream = g_hash_table_lookup(source->media_byfd, GINT_TO_POINTER(fd));
+		}
+		if(stream == NULL) {
+			/* No stream..? Shouldn't happen, read the bytes and dump them */
+			(void)janus_streaming_recv_batch_read(source, fd, batch, batch->size);
+			return 0;
+		}
+		if(stream->type == JANUS_STREAMING_MEDIA_AUDIO && fd == stream->fd[0]) {
+			/* Got something audio (RTP) */
+			if(mountpoint->active == FALSE)
+				mountpoint->active = TRUE;
+			gint64 now = janus_get_monotonic_time();
+#ifdef HAVE_LIBCURL
+			source->reconnect_timer = now;
+#endif
+			received = janus_streaming_recv_batch_read(source, fd, batch, batch->size);
+			for(r=0; r<received; r++) {
+				buffer = janus_streaming_recv_batch_buffer(batch, r);
+				bytes = batch->length[r];
+				if(!janus_is_rtp(buffer, bytes)) {
+					/* Not an RTP packet? */
+					continue;
+				}
+				janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+				ssrc = ntohl(rtp->ssrc);
+				if(source->rtp_collision > 0 && stream->last_ssrc[0] && ssrc != stream->last_ssrc[0] &&
+						(now-stream->last_received) < (gint64)1000*source->rtp_collision) {
+					JANUS_LOG(LOG_WARN, "[%s] RTP collision on audio mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
+						name, stream->mindex, ssrc);
+					continue;
+				}
+				stream->last_received = now;
+				//~ JANUS_LOG(LOG_VERB, "************************\nGot %d bytes on the audio channel...\n", bytes);
+				/* Do we have a new stream? */
+				if(ssrc != stream->last_ssrc[0]) {
+					stream->ssrc = stream->last_ssrc[0] = ssrc;
+					JANUS_LOG(LOG_INFO, "[%s] New audio stream! (#%d, ssrc=%"SCNu32")\n", name, stream->mindex, ssrc);
+				}
+				/* If paused, ignore this packet */
+				if(!mountpoint->enabled && !stream->rc)
+					continue;
+				/* Is this SRTP? */
+				if(source->is_srtp) {
+					int buflen = bytes;
+					srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
+					//~ if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+					if(res != srtp_err_status_ok) {
+						guint32 timestamp = ntohl(rtp->timestamp);
+						guint16 seq = ntohs(rtp->seq_number);
+						JANUS_LOG(LOG_ERR, "[%s] Audio (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+							name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+						continue;
+					}
+					bytes = buflen;
+				}
+				//~ JANUS_LOG(LOG_VERB, " ... parsed RTP packet (ssrc=%u, pt=%u, seq=%u, ts=%u)...\n",
+					//~ ntohl(rtp->ssrc), rtp->type, ntohs(rtp->seq_number), ntohl(rtp->timestamp));
+				/* Relay on all sessions */
+				packet.mindex = stream->mindex;
+				packet.data = rtp;
+				packet.length = bytes;
+				packet.is_rtp = TRUE;
+				packet.is_video = FALSE;
+				packet.is_keyframe = FALSE;
+				packet.data->type = stream->codecs.pt;
+				/* Is there a recorder? */
+				janus_rtp_header_update(packet.data, &stream->context[0], FALSE, 0);
+				if(stream->skew) {
+					int ret = janus_rtp_skew_compensate_audio(packet.data, &stream->context[0], now);
+					if(ret < 0) {
+						JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, audio source clock is too fast (#%d, ssrc=%"SCNu32")\n",
+							name, -ret, stream->mindex, ssrc);
+						continue;
+					} else if(ret > 0) {
+						JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, audio source clock is too slow (#%d, ssrc=%"SCNu32")\n",
+							name, ret, stream->mindex, ssrc);
+					}
+				}
+				if(stream->rc) {
+					packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+					janus_recorder_save_frame(stream->rc, buffer, bytes);
+				}
+				if(mountpoint->enabled) {
+					packet.data->ssrc = htonl(ssrc);
+					/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
+					packet.ptype = packet.data->type;
+					packet.timestamp = ntohl(packet.data->timestamp);
+					packet.seq_number = ntohs(packet.data->seq_number);
+					/* Send to the multicast output, if any, and then to all viewers */
+					janus_streaming_relay_multicast(mountpoint, stream, &packet, 0);
+					/* Go! */
+					janus_mutex_lock(&mountpoint->mutex);
+					if(mountpoint->helper_threads == 0)
+						janus_streaming_relay_rtp_viewers(mountpoint->viewers, &packet);
+					else
+						g_list_foreach(mountpoint->threads, janus_streaming_helper_rtprtcp_packet, &packet);
+					janus_mutex_unlock(&mountpoint->mutex);
+				}
+			}
+			return 0;
+		} else if(stream->type == JANUS_STREAMING_MEDIA_VIDEO && ((fd == stream->fd[0]) ||
+				(fd == stream->fd[1]) || (fd == stream->fd[2]))) {
+			/* Got something video (RTP) */
+			int index = -1;
+			if(fd == stream->fd[0])
+				index = 0;
+			else if(fd == stream->fd[1])
+				index = 1;
+			else if(fd == stream->fd[2])
+				index = 2;
+			if(mountpoint->active == FALSE)
+				mountpoint->active = TRUE;
+			gint64 now = janus_get_monotonic_time();
+#ifdef HAVE_LIBCURL
+			source->reconnect_timer = now;
+#endif
+			received = janus_streaming_recv_batch_read(source, fd, batch, batch->size);
+			for(r=0; r<received; r++) {
+				buffer = janus_streaming_recv_batch_buffer(batch, r);
+				bytes = batch->length[r];
+				if(!janus_is_rtp(buffer, bytes)) {
+					/* Not an RTP packet? */
+					continue;
+				}
+				janus_rtp_header *rtp = (janus_rtp_header *)buffer;
+				ssrc = ntohl(rtp->ssrc);
+				if(source->rtp_collision > 0 && stream->last_ssrc[index] && ssrc != stream->last_ssrc[index] &&
+						(now-stream->last_received) < (gint64)1000*source->rtp_collision) {
+					JANUS_LOG(LOG_WARN, "[%s] RTP collision on video mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
+						name, stream->mindex, ssrc);
+					continue;
+				}
+				stream->last_received = now;
+				//~ JANUS_LOG(LOG_VERB, "************************\nGot %d bytes on the video channel...\n", bytes);
+				/* Do we have a new stream? */
+				if(ssrc != stream->last_ssrc[index]) {
+					stream->last_ssrc[index] = ssrc;
+					if(index == 0) {
+						stream->ssrc = ssrc;
+						/* Whatever GOP we cached is from the previous source */
+						janus_rtp_gop_cache_reset(stream->gop);
+					}
+					JANUS_LOG(LOG_INFO, "[%s] New video stream! (#%d, ssrc=%"SCNu32", index %d)\n",
+						name, stream->mindex, ssrc, index);
+				}
+				/* Is this SRTP? */
+				if(source->is_srtp) {
+					int buflen = bytes;
+					srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
+					//~ if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
+					if(res != srtp_err_status_ok) {
+						guint32 timestamp = ntohl(rtp->timestamp);
+						guint16 seq = ntohs(rtp->seq_number);
+						JANUS_LOG(LOG_ERR, "[%s] Video (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
+							name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
+						continue;
+					}
+					bytes = buflen;
+				}
+				/* If we need to know what's in the packet, classify it once */
+				janus_rtp_video_facts facts = { 0 };
+				if((index == 0 && stream->keyframe.enabled) || stream->h264_spspps)
+					janus_rtp_video_facts_get(stream->codecs.video_codec, buffer, bytes, &facts);
+				/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
+				if(index == 0 && stream->keyframe.enabled) {
+					if(stream->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != stream->keyframe.temp_ts) {
+						/* We received the last part of the keyframe, get rid of the old one and use this from now on */
+						JANUS_LOG(LOG_HUGE, "[%s] ... ... last part of keyframe received! ts=%"SCNu32", %d packets\n",
+							name, stream->keyframe.temp_ts, g_list_length(stream->keyframe.temp_keyframe));
+						stream->keyframe.temp_ts = 0;
+						janus_mutex_lock(&stream->keyframe.mutex);
+						if(stream->keyframe.latest_keyframe != NULL)
+							g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+						stream->keyframe.latest_keyframe = stream->keyframe.temp_keyframe;
+						stream->keyframe.temp_keyframe = NULL;
+						janus_mutex_unlock(&stream->keyframe.mutex);
+					} else if(ntohl(rtp->timestamp) == stream->keyframe.temp_ts) {
+						/* Part of the keyframe we're currently saving, store */
+						janus_mutex_lock(&stream->keyframe.mutex);
+						JANUS_LOG(LOG_HUGE, "[%s] ... other part of keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
+						janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
+						pkt->mindex = stream->mindex;
+						pkt->data = g_malloc(bytes);
+						memcpy(pkt->data, buffer, bytes);
+						pkt->data->ssrc = htons(1);
+						pkt->data->type = stream->codecs.pt;
+						pkt->is_rtp = TRUE;
+						pkt->is_video = TRUE;
+						pkt->is_keyframe = TRUE;
+						pkt->length = bytes;
+						pkt->ptype = rtp->type;
+						pkt->timestamp = stream->keyframe.temp_ts;
+						pkt->seq_number = ntohs(rtp->seq_number);
+						stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
+						janus_mutex_unlock(&stream->keyframe.mutex);
+					} else {
+						gboolean kf = FALSE;
+						/* Parse RTP header first */
+						janus_rtp_header *header = (janus_rtp_header *)buffer;
+						guint32 timestamp = ntohl(header->timestamp);
+						guint16 seq = ntohs(header->seq_number);
+						JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
+							bytes, seq, timestamp);
+						if(facts.payload) {
+							kf = facts.keyframe;
+							if(kf) {
+								/* New keyframe, start saving it */
+								stream->keyframe.temp_ts = ntohl(rtp->timestamp);
+								JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
+								janus_mutex_lock(&stream->keyframe.mutex);
+								janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
+								pkt->mindex = stream->mindex;
+								pkt->data = g_malloc(bytes);
+								memcpy(pkt->data, buffer, bytes);
+								pkt->data->ssrc = htons(1);
+								pkt->data->type = stream->codecs.pt;
+								pkt->is_rtp = TRUE;
+								pkt->is_video = TRUE;
+								pkt->is_keyframe = TRUE;
+								pkt->length = bytes;
+								pkt->ptype = rtp->type;
+								pkt->timestamp = stream->keyframe.temp_ts;
+								pkt->seq_number = ntohs(rtp->seq_number);
+								stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
+								janus_mutex_unlock(&stream->keyframe.mutex);
+							}
+						}
+					}
+				}
+				/* If paused, ignore this packet */
+				if(!mountpoint->enabled && !stream->rc)
+					continue;
+				//~ JANUS_LOG(LOG_VERB, " ... parsed RTP packet (ssrc=%u, pt=%u, seq=%u, ts=%u)...\n",
+					//~ ntohl(rtp->ssrc), rtp->type, ntohs(rtp->seq_number), ntohl(rtp->timestamp));
+				/* Relay on all sessions */
+				packet.mindex = stream->mindex;
+				packet.data = rtp;
+				packet.length = bytes;
+				packet.is_rtp = TRUE;
+				packet.is_video = TRUE;
+				packet.is_keyframe = FALSE;
+				packet.simulcast = stream->simulcast;
+				packet.substream = index;
+				packet.codec = stream->codecs.video_codec;
+				packet.svc = FALSE;
+				if(stream->svc) {
+					/* We're doing SVC: let's parse this packet to see which layers are there */
+					int plen = 0;
+					char *payload = janus_rtp_payload(buffer, bytes, &plen);
+					if(payload) {
+						gboolean found = FALSE;
+						memset(&packet.svc_info, 0, sizeof(packet.svc_info));
+						if(janus_vp9_parse_svc(payload, plen, &found, &packet.svc_info) == 0) {
+							packet.svc = found;
+						}
+					}
+				}
+				packet.data->type = stream->codecs.pt;
+				/* Is there a recorder? (FIXME notice we only record the first substream, if simulcasting) */
+				janus_rtp_header_update(packet.data, &stream->context[index], TRUE, 0);
+				if(stream->skew) {
+					int ret = janus_rtp_skew_compensate_video(packet.data, &stream->context[index], now);
+					if(ret < 0) {
+						JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, video source clock is too fast (#%d, ssrc=%"SCNu32", index %d)\n",
+							name, -ret, stream->mindex, ssrc, index);
+						continue;
+					} else if(ret > 0) {
+						JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, video source clock is too slow (#%d, ssrc=%"SCNu32", index %d)\n",
+							name, ret, stream->mindex, ssrc, index);
+					}
+				}
+				if(stream->h264_spspps) {
+					/* We have our own SPS/PPS to send, check if we just received a keyframe */
+					if(facts.i_frame) {
+						/* This is an I-frame: prepend an SPS/PPS packet */
+						janus_rtp_header *sps_rtp = (janus_rtp_header *)stream->h264_spspps;
+						sps_rtp->type = rtp->type;
+						sps_rtp->seq_number = rtp->seq_number;
+						rtp->seq_number = htons(ntohs(rtp->seq_number) + 1);
+						stream->context[index].base_seq--;
+						sps_rtp->timestamp = rtp->timestamp;
+						/* Save the packet, if needed */
+						sps_rtp->ssrc = htonl((uint32_t)mountpoint->id);
+						janus_recorder_save_frame(stream->rc, stream->h264_spspps, stream->h264_spspps_len);
+						sps_rtp->ssrc = rtp->ssrc;
+						/* Relay on all sessions */
+						janus_streaming_rtp_relay_packet spspkt = { 0 };
+						spspkt.mindex = stream->mindex;
+						spspkt.data = sps_rtp;
+						spspkt.length = stream->h264_spspps_len;
+						spspkt.is_rtp = TRUE;
+						spspkt.is_video = TRUE;
+						spspkt.is_keyframe = FALSE;
+						spspkt.simulcast = FALSE;
+						spspkt.codec = stream->codecs.video_codec;
+						spspkt.svc = FALSE;
+						spspkt.ptype = spspkt.data->type;
+						spspkt.timestamp = ntohl(spspkt.data->timestamp);
+						spspkt.seq_number = ntohs(spspkt.data->seq_number);
+						/* New viewers will need this before the keyframe too */
+						janus_rtp_gop_cache_add(stream->gop, (char *)spspkt.data, spspkt.length);
+						janus_streaming_relay_multicast(mountpoint, stream, &spspkt, index);
+						janus_mutex_lock(&mountpoint->mutex);
+						JANUS_LOG(LOG_HUGE, "[%s] Sending SPS/PPS (seq=%"SCNu16", ts=%"SCNu32")\n", name,
+							ntohs(spspkt.data->seq_number), ntohl(spspkt.data->timestamp));
+						if(mountpoint->helper_threads == 0)
+							janus_streaming_relay_rtp_viewers(mountpoint->viewers, &spspkt);
+						else
+							g_list_foreach(mountpoint->threads, janus_streaming_helper_rtprtcp_packet, &spspkt);
+						janus_mutex_unlock(&mountpoint->mutex);
+					}
+				}
+				if(index == 0 && stream->rc) {
+					packet.data->ssrc = htonl((uint32_t)mountpoint->id);
+					janus_recorder_save_frame(stream->rc, buffer, bytes);
+				}
+				if(mountpoint->enabled) {
+					packet.data->ssrc = htonl(ssrc);
+					/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
+					packet.ptype = packet.data->type;
+					packet.timestamp = ntohl(packet.data->timestamp);
+					packet.seq_number = ntohs(packet.data->seq_number);
+					/* Take note of the simulcast SSRCs, and find out what's in the packet once for all viewers */
+					gboolean dispatch = TRUE;
+					if(stream->simulcast) {
+						packet.ssrc[0] = stream->last_ssrc[0];
+						packet.ssrc[1] = stream->last_ssrc[1];
+						packet.ssrc[2] = stream->last_ssrc[2];
+						janus_rtp_simulcasting_packet_parse(&packet.sim_packet, (char *)packet.data, bytes,
+							0, packet.ssrc, NULL, packet.codec, NULL);
+						dispatch = janus_streaming_simulcast_dispatch(stream, &packet.sim_packet, now);
+					}
+					/* Update the GOP cache before relaying, so that new viewers can't miss this packet */
+					if(index == 0)
+						janus_rtp_gop_cache_add(stream->gop, (char *)packet.data, bytes);
+					/* Send to the multicast output, if any, and then to all viewers */
+					janus_streaming_relay_multicast(mountpoint, stream, &packet, index);
+					/* Go! */
+					if(dispatch) {
+						janus_mutex_lock(&mountpoint->mutex);
+						if(mountpoint->helper_threads == 0)
+							janus_streaming_relay_rtp_viewers(mountpoint->viewers, &packet);
+						else
+							g_list_foreach(mountpoint->threads, janus_streaming_helper_rtprtcp_packet, &packet);
+						janus_mutex_unlock(&mountpoint->mutex);
+					}
+				}
+			}
+			return 0;
+		} else if(stream->type == JANUS_STREAMING_MEDIA_DATA && fd == stream->fd[0]) {
+			/* Got something data (text) */
+			if(mountpoint->active == FALSE)
+				mountpoint->active = TRUE;
+			stream->last_received = janus_get_monotonic_time();
+#ifdef HAVE_LIBCURL
+			source->reconnect_timer = janus_get_monotonic_time();
+#endif
+			if(janus_streaming_recv_batch_read(source, fd, batch, 1) < 1)
+				return 0;
+			buffer = batch->data;
+			bytes = batch->length[0];
+			if(bytes < 1) {
+				/* Failed to read? */
+				return 0;
+			}
+			if(!mountpoint->enabled && !stream->rc)
+				return 0;
+			/* Copy the data */
+			char *data = g_malloc(bytes);
+			memcpy(data, buffer, bytes);
+			/* Relay on all sessions */
+			packet.mindex = stream->mindex;
+			packet.data = (janus_rtp_header *)data;
+			packet.length = bytes;
+			packet.is_rtp = FALSE;
+			packet.is_data = TRUE;
+			packet.textdata = stream->textdata;
+			/* Is there a recorder? */
+			janus_recorder_save_frame(stream->rc, data, bytes);
+			if(mountpoint->enabled) {
+				/* Are we keeping track of the last message being relayed? */
+				if(stream->buffermsg) {
+					janus_mutex_lock(&stream->buffermsg_mutex);
+					janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
+					pkt->data = g_malloc(bytes);
+					memcpy(pkt->data, data, bytes);
+					packet.mindex = stream->mindex;
+					packet.is_rtp = FALSE;
+					packet.is_data = TRUE;
+					packet.textdata = stream->textdata;
+					pkt->length = bytes;
+					janus_mutex_unlock(&stream->buffermsg_mutex);
+				}
+				/* Go! */
+				janus_mutex_lock(&mountpoint->mutex);
+				g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
+					mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
+					&packet);
+				janus_mutex_unlock(&mountpoint->mutex);
+			}
+			g_free(packet.data);
+			packet.data = NULL;
+			return 0;
+		} else if(fd == stream->rtcp_fd) {
+			if(janus_streaming_recv_batch_read(source, fd, batch, 1) < 1)
+				return 0;
+			buffer = batch->data;
+			bytes = batch->length[0];
+			if(bytes < 0 || (!janus_is_rtp(buffer, bytes) && !janus_is_rtcp(buffer, bytes))) {
+				/* For latching we need an RTP or RTCP packet */
+				return 0;
+			}
+			if(!mountpoint->enabled)
+				return 0;
+			memcpy(&stream->rtcp_addr, &batch->remote[0], batch->addrlen[0]);
+			if(!janus_is_rtcp(buffer, bytes)) {
+				/* Failed to read or not an RTCP packet? */
+				return 0;
+			}
+			JANUS_LOG(LOG_HUGE, "[%s] Got audio/video RTCP feedback: #%d, SSRC %"SCNu32"\n",
+				name, stream->mindex, janus_rtcp_get_sender_ssrc(buffer, bytes));
+			/* Relay on all sessions */
+			packet.mindex = stream->mindex;
+			packet.is_rtp = FALSE;
+			packet.is_video = (stream->type == JANUS_STREAMING_MEDIA_VIDEO);
+			packet.data = (janus_rtp_header *)buffer;
+			packet.length = bytes;
+			/* Go! */
+			janus_mutex_lock(&mountpoint->mutex);
+			g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
+				mountpoint->helper_threads == 0 ? janus_streaming_relay_rtcp_packet : janus_streaming_helper_rtprtcp_packet,
+				&packet);
+			janus_mutex_unlock(&mountpoint->mutex);
+		}
+	}
+	return 0;
+}
+
+/* Helper to close the sockets of a live RTP mountpoint, and notify viewers it's done */
+static void janus_streaming_relay_cleanup(janus_streaming_mountpoint *mountpoint) {
+	janus_streaming_rtp_source *source = mountpoint->source;
+	/* Close the ports we bound to */
+	GList *temp = source->media;
+	while(temp) {
+		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+		if(stream->fd[0] > -1)
+			close(stream->fd[0]);
+		stream->fd[0] = -1;
+		if(stream->fd[1] > -1)
+			close(stream->fd[1]);
+		stream->fd[1] = -1;
+		if(stream->fd[2] > -1)
+			close(stream->fd[2]);
+		stream->fd[2] = -1;
+		if(stream->rtcp_fd > -1)
+			close(stream->rtcp_fd);
+		stream->rtcp_fd = -1;
+		temp = temp->next;
+	}
+
+	/* Notify users this mountpoint is done */
+	janus_mutex_lock(&mountpoint->mutex);
+	GList *viewer = g_list_first(mountpoint->viewers);
+	/* Prepare JSON event */
+	json_t *event = json_object();
+	json_object_set_new(event, "streaming", json_string("event"));
+	json_t *result = json_object();
+	json_object_set_new(result, "status", json_string("stopped"));
+	json_object_set_new(event, "result", result);
+	while(viewer) {
+		janus_streaming_session *session = (janus_streaming_session *)viewer->data;
+		if(session == NULL) {
+			mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
+			viewer = g_list_first(mountpoint->viewers);
+			continue;
+		}
+		janus_mutex_lock(&session->mutex);
+		if(session->mountpoint != mountpoint) {
+			mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
+			viewer = g_list_first(mountpoint->viewers);
+			janus_mutex_unlock(&session->mutex);
+			continue;
+		}
+		g_atomic_int_set(&session->stopping, 1);
+		g_atomic_int_set(&session->started, 0);
+		g_atomic_int_set(&session->paused, 0);
+		session->mountpoint = NULL;
+		/* Tell the core to tear down the PeerConnection, hangup_media will do the rest */
+		gateway->push_event(session->handle, &janus_streaming_plugin, NULL, event, NULL);
+		gateway->close_pc(session->handle);
+		janus_refcount_decrease(&session->ref);
 		janus_refcount_decrease(&mountpoint->ref);
-		return NULL;
+		mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
+		viewer = g_list_first(mountpoint->viewers);
+		janus_mutex_unlock(&session->mutex);
 	}
+	json_decref(event);
+	janus_mutex_unlock(&mountpoint->mutex);
 
-	/* Check how many file descriptors we'll need to monitor */
+	/* Unref the helper threads */
+	if(mountpoint->helper_threads > 0) {
+		GList *l = mountpoint->threads;
+		while(l) {
+			janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+			janus_refcount_decrease(&ht->ref);
+			l = l->next;
+		}
+	}
+}
+
+/* Helper to count the file descriptors the relay thread needs to monitor */
+static int janus_streaming_relay_count_fds(janus_streaming_rtp_source *source) {
 	int num = 0;
-	janus_streaming_rtp_source_stream *stream = NULL;
 	GList *temp = source->media;
 	while(temp) {
 		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
@@ -9207,6 +11186,32 @@ static void *janus_streaming_relay_thread(void *data) {
 		temp = temp->next;
 	}
 	num++;	/* There's the pipe too */
+	return num;
+}
+
+/* Thread to relay RTP frames coming from gstreamer/ffmpeg/others */
+static void *janus_streaming_relay_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Starting streaming relay thread\n");
+	janus_streaming_mountpoint *mountpoint = (janus_streaming_mountpoint *)data;
+	if(!mountpoint) {
+		JANUS_LOG(LOG_ERR, "Invalid mountpoint!\n");
+		return NULL;
+	}
+	if(mountpoint->streaming_source != janus_streaming_source_rtp) {
+		JANUS_LOG(LOG_ERR, "[%s] Not an RTP source mountpoint!\n", mountpoint->name);
+		janus_refcount_decrease(&mountpoint->ref);
+		return NULL;
+	}
+	janus_streaming_rtp_source *source = mountpoint->source;
+	if(source == NULL) {
+		JANUS_LOG(LOG_ERR, "[%s] Invalid RTP source mountpoint!\n", mountpoint->name);
+		janus_refcount_decrease(&mountpoint->ref);
+		return NULL;
+	}
+
+	/* Check how many file descriptors we'll need to monitor */
+	int num = janus_streaming_relay_count_fds(source);
+	GList *temp = NULL;
 
 	/* Add a reference to the helper threads, if needed */
 	if(mountpoint->helper_threads > 0) {
@@ -9219,15 +11224,11 @@ static void *janus_streaming_relay_thread(void *data) {
 	}
 
 	char *name = g_strdup(mountpoint->name ? mountpoint->name : "??");
-	/* Needed to fix seq and ts */
-	uint32_t ssrc = 0;
 	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_storage remote;
-	int resfd = 0, bytes = 0;
+	int resfd = 0;
 	struct pollfd *fds = g_malloc(num * sizeof(struct pollfd));
-	char buffer[1500];
-	memset(buffer, 0, 1500);
+	/* Incoming RTP packets may be read in batches, if configured */
+	janus_streaming_recv_batch *batch = janus_streaming_recv_batch_new(recv_batch_size);
 	/* We'll have a dynamic number of streams */
 #ifdef HAVE_LIBCURL
 	/* In case this is an RTSP restreamer, we may have to send keep-alives from time to time */
@@ -9237,11 +11238,76 @@ static void *janus_streaming_relay_thread(void *data) {
 		ka_timeout = source->ka_timeout;
 	}
 	gboolean connected = TRUE;
+	/* Lazy RTSP mountpoints disconnect when nobody's been watching for a while */
+	gint64 idle_check = now, idle_since = 0;
+	guint64 lazy_packets = 0;
 #endif
 	/* Loop */
-	janus_streaming_rtp_relay_packet packet;
 	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
 #ifdef HAVE_LIBCURL
+		if(source->rtsp && source->rtsp_lazy && !g_atomic_int_get(&source->rtsp_lazy_active)) {
+			/* Nobody's watching, wait for a viewer to connect us again */
+			janus_mutex_lock(&source->lazy_mutex);
+			while(!g_atomic_int_get(&source->rtsp_lazy_active) &&
+					!g_atomic_int_get(&stopping) && !g_atomic_int_get(&mountpoint->destroyed)) {
+				janus_condition_wait(&source->lazy_cond, &source->lazy_mutex);
+			}
+			janus_mutex_unlock(&source->lazy_mutex);
+			if(!g_atomic_int_get(&source->rtsp_lazy_active))
+				continue;
+			/* We may have a different set of sockets to monitor now */
+			num = janus_streaming_relay_count_fds(source);
+			fds = g_realloc(fds, num * sizeof(struct pollfd));
+			now = janus_get_monotonic_time();
+			before = now;
+			idle_check = now;
+			idle_since = 0;
+			lazy_packets = source->recv_packets;
+			source->reconnect_timer = now;
+			ka_timeout = source->ka_timeout;
+			connected = TRUE;
+		}
+		if(source->rtsp && source->rtsp_lazy && source->rtsp_idle_timeout > 0) {
+			/* Check once in a while if we still have viewers */
+			now = janus_get_monotonic_time();
+			if(now - idle_check >= G_USEC_PER_SEC) {
+				idle_check = now;
+				janus_mutex_lock(&mountpoint->mutex);
+				if(mountpoint->viewers != NULL) {
+					idle_since = 0;
+				} else if(idle_since == 0) {
+					idle_since = now;
+				} else if(now - idle_since >= source->rtsp_idle_timeout) {
+					/* Nobody's been watching for a while, disconnect: we do this while
+					 * holding the lazy mutex, so that new viewers wait for us first */
+					JANUS_LOG(LOG_INFO, "[%s] %"SCNi64"s passed with no viewers, disconnecting from the RTSP server\n",
+						name, (now - idle_since)/G_USEC_PER_SEC);
+					janus_mutex_lock(&source->lazy_mutex);
+					g_atomic_int_set(&source->rtsp_lazy_active, 0);
+					janus_mutex_unlock(&mountpoint->mutex);
+					janus_streaming_rtsp_disconnect(source, TRUE);
+					/* Get rid of the keyframes we buffered, they'd be stale by the time we're back */
+					temp = source->media;
+					while(temp) {
+						janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+						janus_mutex_lock(&stream->keyframe.mutex);
+						if(stream->keyframe.temp_keyframe != NULL)
+							g_list_free_full(stream->keyframe.temp_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+						stream->keyframe.temp_keyframe = NULL;
+						if(stream->keyframe.latest_keyframe != NULL)
+							g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
+						stream->keyframe.latest_keyframe = NULL;
+						stream->keyframe.temp_ts = 0;
+						janus_mutex_unlock(&stream->keyframe.mutex);
+						janus_rtp_gop_cache_reset(stream->gop);
+						temp = temp->next;
+					}
+					janus_mutex_unlock(&source->lazy_mutex);
+					continue;
+				}
+				janus_mutex_unlock(&mountpoint->mutex);
+			}
+		}
 		/* Let's check regularly if the RTSP server seems to be gone */
 		if(source->rtsp) {
 			if(source->reconnecting) {
@@ -9254,46 +11320,15 @@ static void *janus_streaming_relay_thread(void *data) {
 				/*  Assume the RTSP server has gone and schedule a reconnect */
 				JANUS_LOG(LOG_WARN, "[%s] %"SCNi64"s passed with no media, trying to reconnect the RTSP stream\n",
 					name, (now - source->reconnect_timer)/G_USEC_PER_SEC);
-				temp = source->media;
-				while(temp) {
-					janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
-					if(stream->fd[0] > -1) {
-						g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[0]));
-						close(stream->fd[0]);
-					}
-					stream->fd[0] = -1;
-					if(stream->fd[1] > -1) {
-						g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[1]));
-						close(stream->fd[1]);
-					}
-					stream->fd[1] = -1;
-					if(stream->fd[2] > -1) {
-						g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->fd[2]));
-						close(stream->fd[2]);
-					}
-					stream->fd[2] = -1;
-					if(stream->rtcp_fd > -1) {
-						g_hash_table_remove(source->media_byfd, GINT_TO_POINTER(stream->rtcp_fd));
-						close(stream->rtcp_fd);
-					}
-					stream->rtcp_fd = -1;
-					temp = temp->next;
-				}
 				source->reconnect_timer = now;
 				connected = FALSE;
 				source->reconnecting = TRUE;
 				/* Let's clean up the source first */
-				curl_easy_cleanup(source->curl);
-				source->curl = NULL;
-				g_free(source->curl_errbuf);
-				source->curl_errbuf = NULL;
-				if(source->curldata)
-					g_free(source->curldata->buffer);
-				g_free(source->curldata);
-				source->curldata = NULL;
+				janus_streaming_rtsp_disconnect(source, FALSE);
 				if(g_atomic_int_get(&mountpoint->destroyed))
 					break;
 				/* Now let's try to reconnect */
+				source->reconnect_failures++;
 				if(janus_streaming_rtsp_connect_to_server(mountpoint) < 0) {
 					/* Reconnection failed? Let's try again later */
 					JANUS_LOG(LOG_WARN, "[%s] Reconnection of the RTSP stream failed, trying again in a few seconds...\n", name);
@@ -9303,20 +11338,28 @@ static void *janus_streaming_relay_thread(void *data) {
 						/* Error trying to play? Let's try again later */
 						JANUS_LOG(LOG_WARN, "[%s] RTSP PLAY failed, trying again in a few seconds...\n", name);
 					} else {
+						source->reconnect_failures = 0;
 						/* Everything should be back to normal */
 						JANUS_LOG(LOG_INFO, "[%s] Reconnected to the RTSP server, streaming again\n", name);
 						ka_timeout = source->ka_timeout;
 						connected = TRUE;
+						/* Make sure we have room for all the sockets we have now */
+						num = janus_streaming_relay_count_fds(source);
+						fds = g_realloc(fds, num * sizeof(struct pollfd));
 					}
 				}
 				source->reconnect_timer = janus_get_monotonic_time();
+				if(source->reconnect_failures > 0) {
+					/* Schedule the next attempt, backing off and with some jitter */
+					source->reconnect_timer += janus_streaming_rtsp_reconnect_wait(source) - source->reconnect_delay;
+				}
 				source->reconnecting = FALSE;
 				continue;
 			}
 		}
 		if(source->reconnecting || !connected) {
 			/* No socket, we may be in the process of reconnecting, or waiting to reconnect */
-			g_usleep(source->reconnect_delay);
+			g_usleep(MIN(source->reconnect_delay, 250000));
 			continue;
 		}
 		/* We may also need to occasionally send a OPTIONS request as a keep-alive */
@@ -9326,19 +11369,25 @@ static void *janus_streaming_relay_thread(void *data) {
 			if(now-before > ka_timeout && source->curldata) {
 				JANUS_LOG(LOG_VERB, "[%s] %"SCNi64"s passed, sending OPTIONS\n", name, (now-before)/G_USEC_PER_SEC);
 				before = now;
-				/* Send an RTSP OPTIONS */
-				janus_mutex_lock(&source->rtsp_mutex);
-				g_free(source->curldata->buffer);
-				source->curldata->buffer = g_malloc0(1);
-				source->curldata->size = 0;
-				curl_easy_setopt(source->curl, CURLOPT_RTSP_STREAM_URI, source->rtsp_url);
-				curl_easy_setopt(source->curl, CURLOPT_RTSP_REQUEST, (long)CURL_RTSPREQ_OPTIONS);
-				resfd = curl_easy_perform(source->curl);
-				if(resfd != CURLE_OK) {
-					JANUS_LOG(LOG_ERR, "[%s] Couldn't send OPTIONS request: %s (%s)\n",
-						name, curl_easy_strerror(resfd), source->curl_errbuf);
+				if(!janus_streaming_rtsp_keepalive(mountpoint)) {
+					/* No RTSP control thread, send an RTSP OPTIONS ourselves */
+					janus_mutex_lock(&source->rtsp_mutex);
+					g_free(source->curldata->buffer);
+					source->curldata->buffer = g_malloc0(1);
+					source->curldata->size = 0;
+					curl_easy_setopt(source->curl, CURLOPT_RTSP_STREAM_URI, source->rtsp_url);
+					curl_easy_setopt(source->curl, CURLOPT_RTSP_REQUEST, (long)CURL_RTSPREQ_OPTIONS);
+					resfd = curl_easy_perform(source->curl);
+					source->rtsp_kas++;
+					if(resfd != CURLE_OK) {
+						JANUS_LOG(LOG_ERR, "[%s] Couldn't send OPTIONS request: %s (%s)\n",
+							name, curl_easy_strerror(resfd), source->curl_errbuf);
+						source->rtsp_ka_failures++;
+					} else {
+						source->rtsp_ka_latency = janus_get_monotonic_time() - now;
+					}
+					janus_mutex_unlock(&source->rtsp_mutex);
 				}
-				janus_mutex_unlock(&source->rtsp_mutex);
 			}
 		}
 #endif
@@ -9372,17 +11421,7 @@ static void *janus_streaming_relay_thread(void *data) {
 				num++;
 			}
 			/* Any PLI and/or REMB we should send back to the source? */
-			if(stream->type == JANUS_STREAMING_MEDIA_VIDEO) {
-				if(g_atomic_int_get(&stream->need_pli))
-					janus_streaming_rtcp_pli_send(stream);
-				if(stream->rtcp_fd > -1 && source->lowest_bitrate > 0) {
-					gint64 now = janus_get_monotonic_time();
-					if(source->remb_latest == 0)
-						source->remb_latest = now;
-					else if(now - source->remb_latest >= G_USEC_PER_SEC)
-						janus_streaming_rtcp_remb_send(source, stream);
-				}
-			}
+			janus_streaming_relay_feedback(source, stream);
 			temp = temp->next;
 		}
 		if(source->pipefd[0] != -1) {
@@ -9420,533 +11459,371 @@ static void *janus_streaming_relay_thread(void *data) {
 		}
 		int i = 0;
 		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* Socket error? */
-				JANUS_LOG(LOG_ERR, "[%s] Error polling: %s... %d (%s)\n", name,
-					fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP", errno, g_strerror(errno));
-				mountpoint->enabled = FALSE;
-				janus_mutex_lock(&source->rec_mutex);
-				GList *temp = source->media;
-				while(temp) {
-					janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
-					janus_recorder_close(stream->rc);
-					JANUS_LOG(LOG_INFO, "[%s] Closed %s recording %s (%s)\n", mountpoint->name,
-						janus_streaming_media_str(stream->type), stream->rc->filename, stream->mid);
-					janus_recorder *tmp = stream->rc;
-					stream->rc = NULL;
-					janus_recorder_destroy(tmp);
-					break;
-				}
-				janus_mutex_unlock(&source->rec_mutex);
+			if(janus_streaming_relay_handle(mountpoint, batch, fds[i].fd, fds[i].revents) < 0)
 				break;
-			} else if(fds[i].revents & POLLIN) {
-				/* Got an RTP or data packet */
-				if(fds[i].fd == source->pipefd[0]) {
-					/* We're done here */
-					int code = 0;
-					bytes = read(fds[i].fd, &code, sizeof(int));
-					JANUS_LOG(LOG_VERB, "[%s] Interrupting mountpoint\n", mountpoint->name);
-					break;
-				} else {
-					/* Check which stream this file descriptor belongs to */
-					stream = g_hash_table_lookup(source->media_byfd, GINT_TO_POINTER(fds[i].fd));
-				}
-				if(stream == NULL) {
-					/* No stream..? Shouldn't happen, read the bytes and dump them */
-					addrlen = sizeof(remote);
-					(void)recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					continue;
-				}
-				if(stream->type == JANUS_STREAMING_MEDIA_AUDIO && fds[i].fd == stream->fd[0]) {
-					/* Got something audio (RTP) */
-					if(mountpoint->active == FALSE)
-						mountpoint->active = TRUE;
-					gint64 now = janus_get_monotonic_time();
-#ifdef HAVE_LIBCURL
-					source->reconnect_timer = now;
-#endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					ssrc = ntohl(rtp->ssrc);
-					if(source->rtp_collision > 0 && stream->last_ssrc[0] && ssrc != stream->last_ssrc[0] &&
-							(now-stream->last_received) < (gint64)1000*source->rtp_collision) {
-						JANUS_LOG(LOG_WARN, "[%s] RTP collision on audio mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
-							name, stream->mindex, ssrc);
-						continue;
-					}
-					stream->last_received = now;
-					//~ JANUS_LOG(LOG_VERB, "************************\nGot %d bytes on the audio channel...\n", bytes);
-					/* Do we have a new stream? */
-					if(ssrc != stream->last_ssrc[0]) {
-						stream->ssrc = stream->last_ssrc[0] = ssrc;
-						JANUS_LOG(LOG_INFO, "[%s] New audio stream! (#%d, ssrc=%"SCNu32")\n", name, stream->mindex, ssrc);
-					}
-					/* If paused, ignore this packet */
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					/* Is this SRTP? */
-					if(source->is_srtp) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
-						//~ if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-						if(res != srtp_err_status_ok) {
-							guint32 timestamp = ntohl(rtp->timestamp);
-							guint16 seq = ntohs(rtp->seq_number);
-							JANUS_LOG(LOG_ERR, "[%s] Audio (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					//~ JANUS_LOG(LOG_VERB, " ... parsed RTP packet (ssrc=%u, pt=%u, seq=%u, ts=%u)...\n",
-						//~ ntohl(rtp->ssrc), rtp->type, ntohs(rtp->seq_number), ntohl(rtp->timestamp));
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = rtp;
-					packet.length = bytes;
-					packet.is_rtp = TRUE;
-					packet.is_video = FALSE;
-					packet.is_keyframe = FALSE;
-					packet.data->type = stream->codecs.pt;
-					/* Is there a recorder? */
-					janus_rtp_header_update(packet.data, &stream->context[0], FALSE, 0);
-					if(stream->skew) {
-						int ret = janus_rtp_skew_compensate_audio(packet.data, &stream->context[0], now);
-						if(ret < 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, audio source clock is too fast (#%d, ssrc=%"SCNu32")\n",
-								name, -ret, stream->mindex, ssrc);
-							continue;
-						} else if(ret > 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, audio source clock is too slow (#%d, ssrc=%"SCNu32")\n",
-								name, ret, stream->mindex, ssrc);
-						}
-					}
-					if(stream->rc) {
-						packet.data->ssrc = htonl((uint32_t)mountpoint->id);
-						janus_recorder_save_frame(stream->rc, buffer, bytes);
-					}
-					if(mountpoint->enabled) {
-						packet.data->ssrc = htonl(ssrc);
-						/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
-						packet.ptype = packet.data->type;
-						packet.timestamp = ntohl(packet.data->timestamp);
-						packet.seq_number = ntohs(packet.data->seq_number);
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
-					}
-					continue;
-				} else if(stream->type == JANUS_STREAMING_MEDIA_VIDEO && ((fds[i].fd == stream->fd[0]) ||
-						(fds[i].fd == stream->fd[1]) || (fds[i].fd == stream->fd[2]))) {
-					/* Got something video (RTP) */
-					int index = -1;
-					if(fds[i].fd == stream->fd[0])
-						index = 0;
-					else if(fds[i].fd == stream->fd[1])
-						index = 1;
-					else if(fds[i].fd == stream->fd[2])
-						index = 2;
-					if(mountpoint->active == FALSE)
-						mountpoint->active = TRUE;
-					gint64 now = janus_get_monotonic_time();
-#ifdef HAVE_LIBCURL
-					source->reconnect_timer = now;
-#endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || !janus_is_rtp(buffer, bytes)) {
-						/* Failed to read or not an RTP packet? */
-						continue;
-					}
-					janus_rtp_header *rtp = (janus_rtp_header *)buffer;
-					ssrc = ntohl(rtp->ssrc);
-					if(source->rtp_collision > 0 && stream->last_ssrc[index] && ssrc != stream->last_ssrc[index] &&
-							(now-stream->last_received) < (gint64)1000*source->rtp_collision) {
-						JANUS_LOG(LOG_WARN, "[%s] RTP collision on video mountpoint, dropping packet (#%d, ssrc=%"SCNu32")\n",
-							name, stream->mindex, ssrc);
-						continue;
-					}
-					stream->last_received = now;
-					//~ JANUS_LOG(LOG_VERB, "************************\nGot %d bytes on the video channel...\n", bytes);
-					/* Do we have a new stream? */
-					if(ssrc != stream->last_ssrc[index]) {
-						stream->last_ssrc[index] = ssrc;
-						if(index == 0)
-							stream->ssrc = ssrc;
-						JANUS_LOG(LOG_INFO, "[%s] New video stream! (#%d, ssrc=%"SCNu32", index %d)\n",
-							name, stream->mindex, ssrc, index);
-					}
-					/* Is this SRTP? */
-					if(source->is_srtp) {
-						int buflen = bytes;
-						srtp_err_status_t res = srtp_unprotect(source->srtp_ctx, buffer, &buflen);
-						//~ if(res != srtp_err_status_ok && res != srtp_err_status_replay_fail && res != srtp_err_status_replay_old) {
-						if(res != srtp_err_status_ok) {
-							guint32 timestamp = ntohl(rtp->timestamp);
-							guint16 seq = ntohs(rtp->seq_number);
-							JANUS_LOG(LOG_ERR, "[%s] Video (#%d) SRTP unprotect error: %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")\n",
-								name, stream->mindex, janus_srtp_error_str(res), bytes, buflen, timestamp, seq);
-							continue;
-						}
-						bytes = buflen;
-					}
-					/* First of all, let's check if this is (part of) a keyframe that we may need to save it for future reference */
-					if(index == 0 && stream->keyframe.enabled) {
-						if(stream->keyframe.temp_ts > 0 && ntohl(rtp->timestamp) != stream->keyframe.temp_ts) {
-							/* We received the last part of the keyframe, get rid of the old one and use this from now on */
-							JANUS_LOG(LOG_HUGE, "[%s] ... ... last part of keyframe received! ts=%"SCNu32", %d packets\n",
-								name, stream->keyframe.temp_ts, g_list_length(stream->keyframe.temp_keyframe));
-							stream->keyframe.temp_ts = 0;
-							janus_mutex_lock(&stream->keyframe.mutex);
-							if(stream->keyframe.latest_keyframe != NULL)
-								g_list_free_full(stream->keyframe.latest_keyframe, (GDestroyNotify)janus_streaming_rtp_relay_packet_free);
-							stream->keyframe.latest_keyframe = stream->keyframe.temp_keyframe;
-							stream->keyframe.temp_keyframe = NULL;
-							janus_mutex_unlock(&stream->keyframe.mutex);
-						} else if(ntohl(rtp->timestamp) == stream->keyframe.temp_ts) {
-							/* Part of the keyframe we're currently saving, store */
-							janus_mutex_lock(&stream->keyframe.mutex);
-							JANUS_LOG(LOG_HUGE, "[%s] ... other part of keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
-							janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-							pkt->mindex = stream->mindex;
-							pkt->data = g_malloc(bytes);
-							memcpy(pkt->data, buffer, bytes);
-							pkt->data->ssrc = htons(1);
-							pkt->data->type = stream->codecs.pt;
-							pkt->is_rtp = TRUE;
-							pkt->is_video = TRUE;
-							pkt->is_keyframe = TRUE;
-							pkt->length = bytes;
-							pkt->ptype = rtp->type;
-							pkt->timestamp = stream->keyframe.temp_ts;
-							pkt->seq_number = ntohs(rtp->seq_number);
-							stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
-							janus_mutex_unlock(&stream->keyframe.mutex);
-						} else {
-							gboolean kf = FALSE;
-							/* Parse RTP header first */
-							janus_rtp_header *header = (janus_rtp_header *)buffer;
-							guint32 timestamp = ntohl(header->timestamp);
-							guint16 seq = ntohs(header->seq_number);
-							JANUS_LOG(LOG_HUGE, "Checking if packet (size=%d, seq=%"SCNu16", ts=%"SCNu32") is a key frame...\n",
-								bytes, seq, timestamp);
-							int plen = 0;
-							char *payload = janus_rtp_payload(buffer, bytes, &plen);
-							if(payload) {
-								switch(stream->codecs.video_codec) {
-									case JANUS_VIDEOCODEC_VP8:
-										kf = janus_vp8_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_VP9:
-										kf = janus_vp9_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H264:
-										kf = janus_h264_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_AV1:
-										kf = janus_av1_is_keyframe(payload, plen);
-										break;
-									case JANUS_VIDEOCODEC_H265:
-										kf = janus_h265_is_keyframe(payload, plen);
-										break;
-									default:
-										break;
-								}
-								if(kf) {
-									/* New keyframe, start saving it */
-									stream->keyframe.temp_ts = ntohl(rtp->timestamp);
-									JANUS_LOG(LOG_HUGE, "[%s] New keyframe received! ts=%"SCNu32"\n", name, stream->keyframe.temp_ts);
-									janus_mutex_lock(&stream->keyframe.mutex);
-									janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-									pkt->mindex = stream->mindex;
-									pkt->data = g_malloc(bytes);
-									memcpy(pkt->data, buffer, bytes);
-									pkt->data->ssrc = htons(1);
-									pkt->data->type = stream->codecs.pt;
-									pkt->is_rtp = TRUE;
-									pkt->is_video = TRUE;
-									pkt->is_keyframe = TRUE;
-									pkt->length = bytes;
-									pkt->ptype = rtp->type;
-									pkt->timestamp = stream->keyframe.temp_ts;
-									pkt->seq_number = ntohs(rtp->seq_number);
-									stream->keyframe.temp_keyframe = g_list_append(stream->keyframe.temp_keyframe, pkt);
-									janus_mutex_unlock(&stream->keyframe.mutex);
-								}
-							}
-						}
-					}
-					/* If paused, ignore this packet */
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					//~ JANUS_LOG(LOG_VERB, " ... parsed RTP packet (ssrc=%u, pt=%u, seq=%u, ts=%u)...\n",
-						//~ ntohl(rtp->ssrc), rtp->type, ntohs(rtp->seq_number), ntohl(rtp->timestamp));
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = rtp;
-					packet.length = bytes;
-					packet.is_rtp = TRUE;
-					packet.is_video = TRUE;
-					packet.is_keyframe = FALSE;
-					packet.simulcast = stream->simulcast;
-					packet.substream = index;
-					packet.codec = stream->codecs.video_codec;
-					packet.svc = FALSE;
-					if(stream->svc) {
-						/* We're doing SVC: let's parse this packet to see which layers are there */
-						int plen = 0;
-						char *payload = janus_rtp_payload(buffer, bytes, &plen);
-						if(payload) {
-							gboolean found = FALSE;
-							memset(&packet.svc_info, 0, sizeof(packet.svc_info));
-							if(janus_vp9_parse_svc(payload, plen, &found, &packet.svc_info) == 0) {
-								packet.svc = found;
-							}
-						}
-					}
-					packet.data->type = stream->codecs.pt;
-					/* Is there a recorder? (FIXME notice we only record the first substream, if simulcasting) */
-					janus_rtp_header_update(packet.data, &stream->context[index], TRUE, 0);
-					if(stream->skew) {
-						int ret = janus_rtp_skew_compensate_video(packet.data, &stream->context[index], now);
-						if(ret < 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Dropping %d packets, video source clock is too fast (#%d, ssrc=%"SCNu32", index %d)\n",
-								name, -ret, stream->mindex, ssrc, index);
-							continue;
-						} else if(ret > 0) {
-							JANUS_LOG(LOG_WARN, "[%s] Jumping %d RTP sequence numbers, video source clock is too slow (#%d, ssrc=%"SCNu32", index %d)\n",
-								name, ret, stream->mindex, ssrc, index);
-						}
-					}
-					if(stream->h264_spspps) {
-						int plen = 0;
-						char *payload = janus_rtp_payload((char *)packet.data, bytes, &plen);
-						/* We have our own SPS/PPS to send, check if we just received a keyframe */
-						if(payload && janus_h264_is_i_frame(payload, plen)) {
-							/* This is an I-frame: prepend an SPS/PPS packet */
-							janus_rtp_header *sps_rtp = (janus_rtp_header *)stream->h264_spspps;
-							sps_rtp->type = rtp->type;
-							sps_rtp->seq_number = rtp->seq_number;
-							rtp->seq_number = htons(ntohs(rtp->seq_number) + 1);
-							stream->context[index].base_seq--;
-							sps_rtp->timestamp = rtp->timestamp;
-							/* Save the packet, if needed */
-							sps_rtp->ssrc = htonl((uint32_t)mountpoint->id);
-							janus_recorder_save_frame(stream->rc, stream->h264_spspps, stream->h264_spspps_len);
-							sps_rtp->ssrc = rtp->ssrc;
-							/* Relay on all sessions */
-							janus_streaming_rtp_relay_packet spspkt = { 0 };
-							spspkt.mindex = stream->mindex;
-							spspkt.data = sps_rtp;
-							spspkt.length = stream->h264_spspps_len;
-							spspkt.is_rtp = TRUE;
-							spspkt.is_video = TRUE;
-							spspkt.is_keyframe = FALSE;
-							spspkt.simulcast = FALSE;
-							spspkt.codec = stream->codecs.video_codec;
-							spspkt.svc = FALSE;
-							spspkt.ptype = spspkt.data->type;
-							spspkt.timestamp = ntohl(spspkt.data->timestamp);
-							spspkt.seq_number = ntohs(spspkt.data->seq_number);
-							janus_mutex_lock(&mountpoint->mutex);
-							JANUS_LOG(LOG_HUGE, "[%s] Sending SPS/PPS (seq=%"SCNu16", ts=%"SCNu32")\n", name,
-								ntohs(spspkt.data->seq_number), ntohl(spspkt.data->timestamp));
-							g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-								mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-								&spspkt);
-							janus_mutex_unlock(&mountpoint->mutex);
-						}
-					}
-					if(index == 0 && stream->rc) {
-						packet.data->ssrc = htonl((uint32_t)mountpoint->id);
-						janus_recorder_save_frame(stream->rc, buffer, bytes);
-					}
-					if(mountpoint->enabled) {
-						packet.data->ssrc = htonl(ssrc);
-						/* Backup the actual payload type, timestamp and sequence number set by the restreamer, in case switching is involved */
-						packet.ptype = packet.data->type;
-						packet.timestamp = ntohl(packet.data->timestamp);
-						packet.seq_number = ntohs(packet.data->seq_number);
-						/* Take note of the simulcast SSRCs */
-						if(stream->simulcast) {
-							packet.ssrc[0] = stream->last_ssrc[0];
-							packet.ssrc[1] = stream->last_ssrc[1];
-							packet.ssrc[2] = stream->last_ssrc[2];
-						}
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
-					}
-					continue;
-				} else if(stream->type == JANUS_STREAMING_MEDIA_DATA && fds[i].fd == stream->fd[0]) {
-					/* Got something data (text) */
-					if(mountpoint->active == FALSE)
-						mountpoint->active = TRUE;
-					stream->last_received = janus_get_monotonic_time();
+		}
 #ifdef HAVE_LIBCURL
-					source->reconnect_timer = janus_get_monotonic_time();
+		if(source->rtsp_lazy && source->rtsp_startup_latency == 0 && source->recv_packets > lazy_packets) {
+			/* First media since a viewer woke us up, keep track of how long it took */
+			source->rtsp_startup_latency = janus_get_monotonic_time() - source->rtsp_lazy_start;
+			JANUS_LOG(LOG_INFO, "[%s] Got media from the RTSP server %"SCNi64"ms after the first viewer came in\n",
+				name, source->rtsp_startup_latency/1000);
+		}
 #endif
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 1) {
-						/* Failed to read? */
-						continue;
-					}
-					if(!mountpoint->enabled && !stream->rc)
-						continue;
-					/* Copy the data */
-					char *data = g_malloc(bytes);
-					memcpy(data, buffer, bytes);
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.data = (janus_rtp_header *)data;
-					packet.length = bytes;
-					packet.is_rtp = FALSE;
-					packet.is_data = TRUE;
-					packet.textdata = stream->textdata;
-					/* Is there a recorder? */
-					janus_recorder_save_frame(stream->rc, data, bytes);
-					if(mountpoint->enabled) {
-						/* Are we keeping track of the last message being relayed? */
-						if(stream->buffermsg) {
-							janus_mutex_lock(&stream->buffermsg_mutex);
-							janus_streaming_rtp_relay_packet *pkt = g_malloc0(sizeof(janus_streaming_rtp_relay_packet));
-							pkt->data = g_malloc(bytes);
-							memcpy(pkt->data, data, bytes);
-							packet.mindex = stream->mindex;
-							packet.is_rtp = FALSE;
-							packet.is_data = TRUE;
-							packet.textdata = stream->textdata;
-							pkt->length = bytes;
-							janus_mutex_unlock(&stream->buffermsg_mutex);
-						}
-						/* Go! */
-						janus_mutex_lock(&mountpoint->mutex);
-						g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-							mountpoint->helper_threads == 0 ? janus_streaming_relay_rtp_packet : janus_streaming_helper_rtprtcp_packet,
-							&packet);
-						janus_mutex_unlock(&mountpoint->mutex);
-					}
-					g_free(packet.data);
-					packet.data = NULL;
-					continue;
-				} else if(fds[i].fd == stream->rtcp_fd) {
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || (!janus_is_rtp(buffer, bytes) && !janus_is_rtcp(buffer, bytes))) {
-						/* For latching we need an RTP or RTCP packet */
-						continue;
-					}
-					if(!mountpoint->enabled)
-						continue;
-					memcpy(&stream->rtcp_addr, &remote, addrlen);
-					if(!janus_is_rtcp(buffer, bytes)) {
-						/* Failed to read or not an RTCP packet? */
-						continue;
-					}
-					JANUS_LOG(LOG_HUGE, "[%s] Got audio/video RTCP feedback: #%d, SSRC %"SCNu32"\n",
-						name, stream->mindex, janus_rtcp_get_sender_ssrc(buffer, bytes));
-					/* Relay on all sessions */
-					packet.mindex = stream->mindex;
-					packet.is_rtp = FALSE;
-					packet.is_video = (stream->type == JANUS_STREAMING_MEDIA_VIDEO);
-					packet.data = (janus_rtp_header *)buffer;
-					packet.length = bytes;
-					/* Go! */
-					janus_mutex_lock(&mountpoint->mutex);
-					g_list_foreach(mountpoint->helper_threads == 0 ? mountpoint->viewers : mountpoint->threads,
-						mountpoint->helper_threads == 0 ? janus_streaming_relay_rtcp_packet : janus_streaming_helper_rtprtcp_packet,
-						&packet);
-					janus_mutex_unlock(&mountpoint->mutex);
+	}
+
+	g_free(fds);
+	janus_streaming_recv_batch_free(batch);
+	/* Close the ports we bound to, and notify users this mountpoint is done */
+	janus_streaming_relay_cleanup(mountpoint);
+
+	JANUS_LOG(LOG_VERB, "[%s] Leaving streaming relay thread\n", name);
+	g_free(name);
+	janus_refcount_decrease(&mountpoint->ref);
+	return NULL;
+}
+
+#ifdef HAVE_EPOLL
+/* Reactor threads, and the ring we use to assign mountpoints to them via consistent hashing */
+static janus_streaming_reactor **reactors = NULL;
+typedef struct janus_streaming_reactor_vnode {
+	guint32 hash;
+	janus_streaming_reactor *reactor;
+} janus_streaming_reactor_vnode;
+static janus_streaming_reactor_vnode *reactor_ring = NULL;
+static guint reactor_ring_size = 0;
+
+/* FNV-1a, so that the assignment doesn't depend on the GLib version */
+static guint32 janus_streaming_reactor_hash(const char *key) {
+	guint32 hash = 2166136261u;
+	while(key && *key) {
+		hash ^= (guint8)*key;
+		hash *= 16777619u;
+		key++;
+	}
+	return hash;
+}
+
+static int janus_streaming_reactor_vnode_compare(const void *a, const void *b) {
+	const janus_streaming_reactor_vnode *va = (const janus_streaming_reactor_vnode *)a;
+	const janus_streaming_reactor_vnode *vb = (const janus_streaming_reactor_vnode *)b;
+	return (va->hash > vb->hash) - (va->hash < vb->hash);
+}
+
+static janus_streaming_reactor *janus_streaming_reactor_pick(janus_streaming_mountpoint *mountpoint) {
+	if(reactor_ring == NULL || reactor_ring_size == 0)
+		return NULL;
+	/* Find the first virtual node after the hash of the mountpoint ID */
+	guint32 hash = janus_streaming_reactor_hash(mountpoint->id_str);
+	guint low = 0, high = reactor_ring_size;
+	while(low < high) {
+		guint mid = low + (high-low)/2;
+		if(reactor_ring[mid].hash < hash)
+			low = mid+1;
+		else
+			high = mid;
+	}
+	return reactor_ring[low == reactor_ring_size ? 0 : low].reactor;
+}
+
+/* Helper to stop serving a mountpoint: must only be called by the reactor thread */
+static void janus_streaming_reactor_remove(janus_streaming_reactor *reactor, janus_streaming_reactor_mountpoint *rmp) {
+	if(rmp->removed)
+		return;
+	rmp->removed = TRUE;
+	janus_streaming_mountpoint *mountpoint = rmp->mountpoint;
+	int i = 0;
+	for(i=0; i<rmp->num_fds; i++)
+		epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rmp->fds[i].fd, NULL);
+	/* Close the ports we bound to, and notify users this mountpoint is done */
+	janus_streaming_relay_cleanup(mountpoint);
+	JANUS_LOG(LOG_VERB, "[%s] Mountpoint removed from reactor thread #%u\n", mountpoint->name, reactor->id);
+	janus_mutex_lock(&reactor->mutex);
+	reactor->mountpoints = g_list_remove(reactor->mountpoints, rmp);
+	mountpoint->reactor = NULL;
+	janus_condition_broadcast(&reactor->cond);
+	janus_mutex_unlock(&reactor->mutex);
+	janus_refcount_decrease(&mountpoint->ref);
+}
+
+static void janus_streaming_reactor_mountpoint_free(janus_streaming_reactor_mountpoint *rmp) {
+	if(rmp == NULL)
+		return;
+	g_free(rmp->fds);
+	g_free(rmp);
+}
+
+/* Reactor thread */
+#define JANUS_STREAMING_REACTOR_EVENTS	64
+static void *janus_streaming_reactor_thread(void *data) {
+	janus_streaming_reactor *reactor = (janus_streaming_reactor *)data;
+	JANUS_LOG(LOG_VERB, "Starting streaming reactor thread #%u\n", reactor->id);
+	struct epoll_event events[JANUS_STREAMING_REACTOR_EVENTS];
+	janus_streaming_recv_batch *batch = janus_streaming_recv_batch_new(recv_batch_size);
+	GList *removed = NULL, *temp = NULL, *ms = NULL;
+	gint64 now = 0, feedback = janus_get_monotonic_time();
+	int num = 0, i = 0;
+	while(!g_atomic_int_get(&reactor->stop)) {
+		num = epoll_wait(reactor->epfd, events, JANUS_STREAMING_REACTOR_EVENTS, 100);
+		if(num < 0) {
+			if(errno == EINTR)
+				continue;
+			JANUS_LOG(LOG_ERR, "[reactor #%u] Error polling... %d (%s)\n", reactor->id, errno, g_strerror(errno));
+			break;
+		}
+		for(i=0; i<num; i++) {
+			janus_streaming_reactor_fd *rfd = (janus_streaming_reactor_fd *)events[i].data.ptr;
+			janus_streaming_reactor_mountpoint *rmp = rfd->rmp;
+			if(rmp->removed)
+				continue;
+			janus_streaming_mountpoint *mountpoint = rmp->mountpoint;
+			janus_streaming_rtp_source *source = mountpoint->source;
+			short revents = 0;
+			if(events[i].events & EPOLLERR)
+				revents |= POLLERR;
+			if(events[i].events & EPOLLHUP)
+				revents |= POLLHUP;
+			if(events[i].events & EPOLLIN)
+				revents |= POLLIN;
+			if(janus_streaming_relay_handle(mountpoint, batch, rfd->fd, revents) < 0) {
+				if(g_atomic_int_get(&mountpoint->destroyed)) {
+					/* The mountpoint is going away, we're done with it */
+					janus_streaming_reactor_remove(reactor, rmp);
+					removed = g_list_prepend(removed, rmp);
+				} else if(rfd->fd != source->pipefd[0]) {
+					/* Socket error: stop monitoring this socket, or we'd keep on waking up */
+					epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rfd->fd, NULL);
+				}
+			}
+		}
+		/* We can only free the mountpoints we removed once we're done with the events */
+		if(removed != NULL) {
+			g_list_free_full(removed, (GDestroyNotify)janus_streaming_reactor_mountpoint_free);
+			removed = NULL;
+		}
+		/* Any PLI and/or REMB we should send back to the sources? */
+		now = janus_get_monotonic_time();
+		if(now - feedback >= 100000) {
+			feedback = now;
+			janus_mutex_lock(&reactor->mutex);
+			ms = reactor->mountpoints;
+			while(ms) {
+				janus_streaming_reactor_mountpoint *rmp = (janus_streaming_reactor_mountpoint *)ms->data;
+				janus_streaming_rtp_source *source = rmp->mountpoint->source;
+				temp = source->media;
+				while(temp) {
+					janus_streaming_relay_feedback(source, (janus_streaming_rtp_source_stream *)temp->data);
+					temp = temp->next;
 				}
+				ms = ms->next;
 			}
+			janus_mutex_unlock(&reactor->mutex);
 		}
 	}
-
-	/* Close the ports we bound to */
-	temp = source->media;
-	while(temp) {
-		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
-		if(stream->fd[0] > -1)
-			close(stream->fd[0]);
-		stream->fd[0] = -1;
-		if(stream->fd[1] > -1)
-			close(stream->fd[1]);
-		stream->fd[1] = -1;
-		if(stream->fd[2] > -1)
-			close(stream->fd[2]);
-		stream->fd[2] = -1;
-		if(stream->rtcp_fd > -1)
-			close(stream->rtcp_fd);
-		stream->rtcp_fd = -1;
-		temp = temp->next;
+	/* Let go of the mountpoints we're still serving, if any */
+	janus_mutex_lock(&reactor->mutex);
+	while(reactor->mountpoints != NULL) {
+		janus_streaming_reactor_mountpoint *rmp = (janus_streaming_reactor_mountpoint *)reactor->mountpoints->data;
+		janus_mutex_unlock(&reactor->mutex);
+		janus_streaming_reactor_remove(reactor, rmp);
+		janus_streaming_reactor_mountpoint_free(rmp);
+		janus_mutex_lock(&reactor->mutex);
 	}
-	g_free(fds);
+	janus_mutex_unlock(&reactor->mutex);
+	janus_streaming_recv_batch_free(batch);
+	JANUS_LOG(LOG_VERB, "Leaving streaming reactor thread #%u\n", reactor->id);
+	return NULL;
+}
 
-	/* Notify users this mountpoint is done */
-	janus_mutex_lock(&mountpoint->mutex);
-	GList *viewer = g_list_first(mountpoint->viewers);
-	/* Prepare JSON event */
-	json_t *event = json_object();
-	json_object_set_new(event, "streaming", json_string("event"));
-	json_t *result = json_object();
-	json_object_set_new(result, "status", json_string("stopped"));
-	json_object_set_new(event, "result", result);
-	while(viewer) {
-		janus_streaming_session *session = (janus_streaming_session *)viewer->data;
-		if(session == NULL) {
-			mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
-			viewer = g_list_first(mountpoint->viewers);
+static void janus_streaming_reactors_start(int num) {
+	reactors = g_malloc0((num+1) * sizeof(janus_streaming_reactor *));
+	reactor_ring = g_malloc0(num * JANUS_STREAMING_REACTOR_VNODES * sizeof(janus_streaming_reactor_vnode));
+	reactor_ring_size = 0;
+	char tname[16], vname[32];
+	int i = 0, j = 0, started = 0;
+	for(i=0; i<num; i++) {
+		janus_streaming_reactor *reactor = g_malloc0(sizeof(janus_streaming_reactor));
+		reactor->id = i+1;
+		reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(reactor->epfd < 0) {
+			JANUS_LOG(LOG_ERR, "Error creating epoll instance for reactor thread #%u... %d (%s)\n",
+				reactor->id, errno, g_strerror(errno));
+			g_free(reactor);
 			continue;
 		}
-		janus_mutex_lock(&session->mutex);
-		if(session->mountpoint != mountpoint) {
-			mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
-			viewer = g_list_first(mountpoint->viewers);
-			janus_mutex_unlock(&session->mutex);
+		janus_mutex_init(&reactor->mutex);
+		janus_condition_init(&reactor->cond);
+		GError *error = NULL;
+		g_snprintf(tname, sizeof(tname), "mp reactor %u", reactor->id);
+		reactor->thread = g_thread_try_new(tname, &janus_streaming_reactor_thread, reactor, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the reactor thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			close(reactor->epfd);
+			janus_condition_destroy(&reactor->cond);
+			janus_mutex_destroy(&reactor->mutex);
+			g_free(reactor);
 			continue;
 		}
-		g_atomic_int_set(&session->stopping, 1);
-		g_atomic_int_set(&session->started, 0);
-		g_atomic_int_set(&session->paused, 0);
-		session->mountpoint = NULL;
-		/* Tell the core to tear down the PeerConnection, hangup_media will do the rest */
-		gateway->push_event(session->handle, &janus_streaming_plugin, NULL, event, NULL);
-		gateway->close_pc(session->handle);
-		janus_refcount_decrease(&session->ref);
-		janus_refcount_decrease(&mountpoint->ref);
-		mountpoint->viewers = g_list_remove_all(mountpoint->viewers, session);
-		viewer = g_list_first(mountpoint->viewers);
-		janus_mutex_unlock(&session->mutex);
+		reactors[started++] = reactor;
+		/* Add the virtual nodes for this reactor to the ring */
+		for(j=0; j<JANUS_STREAMING_REACTOR_VNODES; j++) {
+			g_snprintf(vname, sizeof(vname), "reactor-%u-%d", reactor->id, j);
+			reactor_ring[reactor_ring_size].hash = janus_streaming_reactor_hash(vname);
+			reactor_ring[reactor_ring_size].reactor = reactor;
+			reactor_ring_size++;
+		}
+	}
+	if(started == 0) {
+		JANUS_LOG(LOG_WARN, "Couldn't start any reactor thread, using a thread per mountpoint\n");
+		g_free(reactors);
+		reactors = NULL;
+		g_free(reactor_ring);
+		reactor_ring = NULL;
+		reactor_ring_size = 0;
+		reactor_threads = 0;
+		return;
 	}
-	json_decref(event);
-	janus_mutex_unlock(&mountpoint->mutex);
+	qsort(reactor_ring, reactor_ring_size, sizeof(janus_streaming_reactor_vnode), janus_streaming_reactor_vnode_compare);
+	reactor_threads = started;
+	JANUS_LOG(LOG_INFO, "Using %d reactor threads for live RTP mountpoints\n", reactor_threads);
+}
 
-	/* Unref the helper threads */
+static void janus_streaming_reactors_stop(void) {
+	if(reactors == NULL)
+		return;
+	int i = 0;
+	for(i=0; reactors[i] != NULL; i++) {
+		janus_streaming_reactor *reactor = reactors[i];
+		g_atomic_int_set(&reactor->stop, 1);
+		g_thread_join(reactor->thread);
+		close(reactor->epfd);
+		janus_condition_destroy(&reactor->cond);
+		janus_mutex_destroy(&reactor->mutex);
+		g_free(reactor);
+	}
+	g_free(reactors);
+	reactors = NULL;
+	g_free(reactor_ring);
+	reactor_ring = NULL;
+	reactor_ring_size = 0;
+	reactor_threads = 0;
+}
+
+/* Helper to have a reactor thread serve a live RTP mountpoint, instead of a dedicated thread */
+static int janus_streaming_reactor_add(janus_streaming_mountpoint *mountpoint) {
+	janus_streaming_reactor *reactor = janus_streaming_reactor_pick(mountpoint);
+	janus_streaming_rtp_source *source = mountpoint->source;
+	if(reactor == NULL || source == NULL)
+		return -1;
+#ifdef HAVE_LIBCURL
+	/* RTSP mountpoints may need to reconnect, so they keep their own thread */
+	if(source->rtsp)
+		return -1;
+#endif
+	janus_streaming_reactor_mountpoint *rmp = g_malloc0(sizeof(janus_streaming_reactor_mountpoint));
+	rmp->mountpoint = mountpoint;
+	/* We'll monitor up to four sockets per stream, plus the pipe */
+	rmp->fds = g_malloc0((4*g_list_length(source->media) + 1) * sizeof(janus_streaming_reactor_fd));
+	GList *temp = source->media;
+	while(temp) {
+		janus_streaming_rtp_source_stream *stream = (janus_streaming_rtp_source_stream *)temp->data;
+		int fds[4] = { stream->fd[0], stream->fd[1], stream->fd[2], stream->rtcp_fd }, i = 0;
+		for(i=0; i<4; i++) {
+			if(fds[i] != -1) {
+				rmp->fds[rmp->num_fds].rmp = rmp;
+				rmp->fds[rmp->num_fds].fd = fds[i];
+				rmp->num_fds++;
+			}
+		}
+		temp = temp->next;
+	}
+	if(source->pipefd[0] != -1) {
+		rmp->fds[rmp->num_fds].rmp = rmp;
+		rmp->fds[rmp->num_fds].fd = source->pipefd[0];
+		rmp->num_fds++;
+	}
+	/* Add a reference to the mountpoint and to the helper threads, if needed */
+	janus_refcount_increase(&mountpoint->ref);
 	if(mountpoint->helper_threads > 0) {
 		GList *l = mountpoint->threads;
 		while(l) {
 			janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
-			janus_refcount_decrease(&ht->ref);
+			janus_refcount_increase(&ht->ref);
 			l = l->next;
 		}
 	}
+	janus_mutex_lock(&reactor->mutex);
+	mountpoint->reactor = reactor;
+	reactor->mountpoints = g_list_append(reactor->mountpoints, rmp);
+	int i = 0;
+	for(i=0; i<rmp->num_fds; i++) {
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN;
+		event.data.ptr = &rmp->fds[i];
+		if(epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, rmp->fds[i].fd, &event) < 0) {
+			JANUS_LOG(LOG_ERR, "[%s] Error adding socket to reactor thread #%u... %d (%s)\n",
+				mountpoint->name, reactor->id, errno, g_strerror(errno));
+			break;
+		}
+	}
+	if(i < rmp->num_fds) {
+		/* Something went wrong, undo what we did and let the caller spawn a thread instead */
+		while(i > 0) {
+			i--;
+			epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, rmp->fds[i].fd, NULL);
+		}
+		reactor->mountpoints = g_list_remove(reactor->mountpoints, rmp);
+		mountpoint->reactor = NULL;
+		janus_mutex_unlock(&reactor->mutex);
+		if(mountpoint->helper_threads > 0) {
+			GList *l = mountpoint->threads;
+			while(l) {
+				janus_streaming_helper *ht = (janus_streaming_helper *)l->data;
+				janus_refcount_decrease(&ht->ref);
+				l = l->next;
+			}
+		}
+		janus_refcount_decrease(&mountpoint->ref);
+		janus_streaming_reactor_mountpoint_free(rmp);
+		return -1;
+	}
+	janus_mutex_unlock(&reactor->mutex);
+	JANUS_LOG(LOG_VERB, "[%s] Mountpoint served by reactor thread #%u\n", mountpoint->name, reactor->id);
+	return 0;
+}
 
-	JANUS_LOG(LOG_VERB, "[%s] Leaving streaming relay thread\n", name);
-	g_free(name);
-	janus_refcount_decrease(&mountpoint->ref);
-	return NULL;
+/* Helper to wait for a reactor thread to let go of a mountpoint that is being destroyed */
+static void janus_streaming_reactor_wait(janus_streaming_mountpoint *mountpoint) {
+	janus_streaming_reactor *reactor = mountpoint->reactor;
+	if(reactor == NULL)
+		return;
+	janus_mutex_lock(&reactor->mutex);
+	while(mountpoint->reactor != NULL)
+		janus_condition_wait(&reactor->cond, &reactor->mutex);
+	janus_mutex_unlock(&reactor->mutex);
+}
+#endif
+
+/* Helper to relay an RTP packet to a list of viewers: if there are many, we
+ * collect the packets for all of them, and pass them to the core at once */
+static void janus_streaming_relay_rtp_viewers(GList *viewers, janus_streaming_rtp_relay_packet *packet) {
+	packet->batch = (gateway != NULL && packet->is_rtp && viewers != NULL && viewers->next != NULL) ?
+		janus_plugin_rtp_batch_get(gateway) : NULL;
+	g_list_foreach(viewers, janus_streaming_relay_rtp_packet, packet);
+	janus_plugin_rtp_batch_flush(packet->batch);
+	packet->batch = NULL;
+}
+
+static void janus_streaming_relay_rtp_send(janus_streaming_rtp_relay_packet *packet,
+		janus_plugin_session *handle, janus_plugin_rtp *rtp) {
+	if(gateway == NULL)
+		return;
+	if(packet->batch != NULL)
+		janus_plugin_rtp_batch_add(packet->batch, handle, rtp);
+	else
+		gateway->relay_rtp(handle, rtp);
 }
 
 static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data) {
@@ -9960,10 +11837,6 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 		//~ JANUS_LOG(LOG_ERR, "Invalid session...\n");
 		return;
 	}
-	if(!packet->is_keyframe && (!g_atomic_int_get(&session->started) || g_atomic_int_get(&session->paused))) {
-		//~ JANUS_LOG(LOG_ERR, "Streaming not started yet for this session...\n");
-		return;
-	}
 	janus_streaming_session_stream *s = g_hash_table_lookup(session->streams_byid, GINT_TO_POINTER(packet->mindex));
 	if(s == NULL) {
 		/* No session stream for this mindex: maybe the viewer did not subscribe to it */
@@ -9974,6 +11847,14 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 		return;
 	}
 	janus_streaming_rtp_source_stream *stream = s->stream;
+	if(!packet->is_keyframe && (!g_atomic_int_get(&session->started) || g_atomic_int_get(&session->paused))) {
+		//~ JANUS_LOG(LOG_ERR, "Streaming not started yet for this session...\n");
+		if(packet->simulcast && stream != NULL) {
+			/* Make sure what we were relaying is still dispatched when we resume */
+			janus_streaming_simulcast_track(stream, &s->sim_context);
+		}
+		return;
+	}
 
 	if(packet->is_rtp) {
 		/* Make sure there hasn't been a video source switch by checking the SSRC */
@@ -10128,8 +12009,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					rtp.extensions.min_delay = s->min_delay;
 					rtp.extensions.max_delay = s->max_delay;
 				}
-				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, &rtp);
+				janus_streaming_relay_rtp_send(packet, session->handle, &rtp);
 				if(override_mark_bit && !has_marker_bit) {
 					packet->data->markerbit = 0;
 				}
@@ -10144,9 +12024,11 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 				if(payload == NULL)
 					return;
 				/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
-				gboolean relay = janus_rtp_simulcasting_context_process_rtp(&s->sim_context,
-					(char *)packet->data, packet->length, NULL, 0,
-					packet->ssrc, NULL, packet->codec, &s->context, NULL);
+				gboolean relay = janus_rtp_simulcasting_context_process_packet(&s->sim_context,
+					&packet->sim_packet, (char *)packet->data, packet->length, NULL, 0,
+					packet->ssrc, packet->codec, &s->context);
+				if(stream != NULL)
+					janus_streaming_simulcast_track(stream, &s->sim_context);
 				if(!relay) {
 					/* Did a lot of time pass before we could relay a packet? */
 					gint64 now = janus_get_monotonic_time();
@@ -10203,8 +12085,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					rtp.extensions.min_delay = s->min_delay;
 					rtp.extensions.max_delay = s->max_delay;
 				}
-				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, &rtp);
+				janus_streaming_relay_rtp_send(packet, session->handle, &rtp);
 				/* Restore the timestamp and sequence number to what the publisher set them to */
 				packet->data->type = packet->ptype;
 				packet->data->timestamp = htonl(packet->timestamp);
@@ -10214,6 +12095,24 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					memcpy(payload, vp8pd, sizeof(vp8pd));
 				}
 			} else {
+				if(g_atomic_int_compare_and_exchange(&s->gop_pending, 1, 0) && stream != NULL) {
+					/* New viewer: send the cached GOP first, so that it can start decoding right away */
+					janus_streaming_gop_replay replay = { .session = session, .s = s };
+					s->gop_replayed = FALSE;
+					int packets = janus_rtp_gop_cache_replay(stream->gop, janus_streaming_relay_gop_packet, &replay);
+					if(packets > 0) {
+						JANUS_LOG(LOG_HUGE, "Replayed %d packets from the GOP cache (%s)\n", packets, stream->mid);
+					} else {
+						/* Nothing to replay, ask the source for a keyframe */
+						g_atomic_int_set(&stream->need_pli, 1);
+					}
+				}
+				if(s->gop_replayed) {
+					/* Skip the live packets the replayed GOP contained already */
+					if((int16_t)(packet->seq_number - s->gop_last_seq) <= 0)
+						return;
+					s->gop_replayed = FALSE;
+				}
 				/* Fix sequence number and timestamp (switching may be involved) */
 				janus_rtp_header_update(packet->data, &s->context, TRUE, 0);
 				if(s->pt > 0)
@@ -10224,8 +12123,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 					rtp.extensions.min_delay = s->min_delay;
 					rtp.extensions.max_delay = s->max_delay;
 				}
-				if(gateway != NULL)
-					gateway->relay_rtp(session->handle, &rtp);
+				janus_streaming_relay_rtp_send(packet, session->handle, &rtp);
 				/* Restore the timestamp and sequence number to what the video source set them to */
 				packet->data->type = packet->ptype;
 				packet->data->timestamp = htonl(packet->timestamp);
@@ -10238,8 +12136,7 @@ static void janus_streaming_relay_rtp_packet(gpointer data, gpointer user_data)
 				packet->data->type = s->pt;
 			janus_plugin_rtp rtp = { .mindex = s->mindex, .video = packet->is_video, .buffer = (char *)packet->data, .length = packet->length };
 			janus_plugin_rtp_extensions_reset(&rtp.extensions);
-			if(gateway != NULL)
-				gateway->relay_rtp(session->handle, &rtp);
+			janus_streaming_relay_rtp_send(packet, session->handle, &rtp);
 			/* Restore the timestamp and sequence number to what the video source set them to */
 			packet->data->type = packet->ptype;
 			packet->data->timestamp = htonl(packet->timestamp);
@@ -10318,6 +12215,7 @@ static void janus_streaming_helper_rtprtcp_packet(gpointer data, gpointer user_d
 	copy->ssrc[2] = packet->ssrc[2];
 	copy->codec = packet->codec;
 	copy->substream = packet->substream;
+	copy->sim_packet = packet->sim_packet;
 	copy->svc = packet->svc;
 	if(copy->svc)
 		copy->svc_info = packet->svc_info;
@@ -10337,9 +12235,10 @@ static void *janus_streaming_helper_thread(void *data) {
 		if(pkt == &exit_packet)
 			break;
 		janus_mutex_lock(&helper->mutex);
-		g_list_foreach(helper->viewers,
-			pkt->is_rtp || pkt->is_data ? janus_streaming_relay_rtp_packet : janus_streaming_relay_rtcp_packet,
-			pkt);
+		if(pkt->is_rtp || pkt->is_data)
+			janus_streaming_relay_rtp_viewers(helper->viewers, pkt);
+		else
+			g_list_foreach(helper->viewers, janus_streaming_relay_rtcp_packet, pkt);
 		janus_mutex_unlock(&helper->mutex);
 		janus_streaming_rtp_relay_packet_free(pkt);
 	}
@@ -163,6 +163,9 @@ post = <optional backend to contact via HTTP post for all incoming messages>
  *
  * If you requested a permanent room but a \c false value is returned
  * instead, good chances are that there are permission problems.
+ * Notice that, if a \c rooms_folder is configured, permanent rooms are
+ * saved there (one file per room) rather than in the configuration file,
+ * and are only loaded when they're first needed.
  *
  * An error instead (and the same applies to all other requests, so this
  * won't be repeated) would provide both an error code and a more verbose
@@ -457,6 +460,27 @@ post = <optional backend to contact via HTTP post for all incoming messages>
  * In case the \c whisper attribute is \c true it means the user actually
  * received a  private message from another participant in the room.
  *
+ * For applications sending lots of small messages (e.g., chats or
+ * telemetry), the plugin can also be configured (\c binary_messages in
+ * the plugin settings) to accept a compact alternative to \c message,
+ * that is a binary DataChannel message with a simple fixed header
+ * followed by an opaque body, which the plugin relays as it is, without
+ * parsing it. The header is made of a version byte (currently \c 1),
+ * one byte with the length of the room ID, the room ID itself as a
+ * string (the decimal representation of the ID, when using numeric IDs),
+ * one byte with the length of the username of the recipient (0 to send
+ * the message to the whole room), and the username itself, if any:
+ *
+\verbatim
++---------+----------+---------+--------+-------------+--------------
+| version | room len | room ID | to len | to username | body...
++---------+----------+---------+--------+-------------+--------------
+\endverbatim
+ *
+ * Recipients get a binary message formatted the same way, where the
+ * recipient username is replaced by the username of the sender. No ack,
+ * history, HTTP forwarding or event is generated for these messages.
+ *
  * Another way of injecting text into rooms is by means of announcements.
  * Announcements are basically messages sent by the room itself, rather
  * than individual users: as such, only users or applications managing
@@ -656,11 +680,20 @@ static struct janus_json_parameter announcement_parameters[] = {
 static janus_config *config = NULL;
 static const char *config_folder = NULL;
 static janus_mutex config_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_config_folder *rooms_folder = NULL;
 
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
 static gboolean string_ids = FALSE;
+/* Maximum number of messages that can be waiting to be relayed to a participant (0=no limit) */
+#define JANUS_TEXTROOM_DEFAULT_MAX_QUEUED	1000
+static guint max_queued = JANUS_TEXTROOM_DEFAULT_MAX_QUEUED;
+/* Whether binary DataChannel messages are accepted, as a compact envelope for "message" */
+static gboolean binary_messages = FALSE;
+#define JANUS_TEXTROOM_ENVELOPE_VERSION	1
+/* Maximum number of messages we relay to a participant in a single batch */
+#define JANUS_TEXTROOM_BATCH_SIZE	32
 static janus_callbacks *gateway = NULL;
 static GThread *handler_thread;
 static void *janus_textroom_handler(void *data);
@@ -706,11 +739,53 @@ typedef struct janus_textroom_session {
 static GHashTable *sessions;
 static janus_mutex sessions_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Serialized message, shared by all the participants it's relayed to */
+typedef struct janus_textroom_payload {
+	char *text;					/* Message, as returned by json_dumps, or binary envelope */
+	size_t length;				/* Length of the message */
+	gboolean binary;			/* Whether this is a binary envelope */
+	janus_refcount ref;
+} janus_textroom_payload;
+static void janus_textroom_payload_free(const janus_refcount *payload_ref) {
+	janus_textroom_payload *payload = janus_refcount_containerof(payload_ref, janus_textroom_payload, ref);
+	/* Strings returned by json_dumps must be released with free() */
+	if(payload->binary)
+		g_free(payload->text);
+	else
+		free(payload->text);
+	g_free(payload);
+}
+/* The payload takes ownership of the text */
+static janus_textroom_payload *janus_textroom_payload_new(char *text) {
+	janus_textroom_payload *payload = g_malloc(sizeof(janus_textroom_payload));
+	payload->text = text;
+	payload->length = strlen(text);
+	payload->binary = FALSE;
+	janus_refcount_init(&payload->ref, janus_textroom_payload_free);
+	return payload;
+}
+/* The payload takes ownership of the buffer, which must have been allocated with g_malloc */
+static janus_textroom_payload *janus_textroom_payload_new_binary(char *buffer, size_t length) {
+	janus_textroom_payload *payload = g_malloc(sizeof(janus_textroom_payload));
+	payload->text = buffer;
+	payload->length = length;
+	payload->binary = TRUE;
+	janus_refcount_init(&payload->ref, janus_textroom_payload_free);
+	return payload;
+}
+static void janus_textroom_payload_unref(janus_textroom_payload *payload) {
+	if(payload)
+		janus_refcount_decrease(&payload->ref);
+}
+
 typedef struct janus_textroom_participant {
 	janus_textroom_session *session;
 	janus_textroom_room *room;	/* Room this participant is in */
 	gchar *username;			/* Unique username in the room */
 	gchar *display;				/* Display name in the room, if any */
+	GQueue outbound;			/* Messages waiting to be relayed to this participant */
+	gboolean flushing;			/* Whether some thread is relaying the outbound messages right now */
+	guint64 sent, dropped;		/* Number of messages relayed to this participant, and dropped because of the cap */
 	janus_mutex mutex;			/* Mutex to lock this session */
 	volatile gint destroyed;	/* Whether this participant has been destroyed */
 	janus_refcount ref;
@@ -762,9 +837,108 @@ static void janus_textroom_participant_free(const janus_refcount *participant_re
 	/* This participant can be destroyed, free all the resources */
 	g_free(participant->username);
 	g_free(participant->display);
+	janus_textroom_payload *payload = NULL;
+	while((payload = g_queue_pop_head(&participant->outbound)) != NULL)
+		janus_textroom_payload_unref(payload);
 	g_free(participant);
 }
 
+/* Participant a message must be sent to, taken from the room while it's locked */
+typedef struct janus_textroom_recipient {
+	janus_textroom_participant *participant;
+	janus_textroom_session *session;
+} janus_textroom_recipient;
+static void janus_textroom_recipient_free(janus_textroom_recipient *recipient) {
+	janus_refcount_decrease(&recipient->session->ref);
+	janus_refcount_decrease(&recipient->participant->ref);
+	g_free(recipient);
+}
+
+/* Add a participant to a list of recipients: must be called with the room mutex locked */
+static void janus_textroom_recipients_add(GPtrArray *recipients, janus_textroom_participant *participant) {
+	if(participant == NULL || participant->session == NULL || g_atomic_int_get(&participant->destroyed))
+		return;
+	janus_textroom_recipient *recipient = g_malloc(sizeof(janus_textroom_recipient));
+	janus_refcount_increase(&participant->ref);
+	recipient->participant = participant;
+	janus_refcount_increase(&participant->session->ref);
+	recipient->session = participant->session;
+	g_ptr_array_add(recipients, recipient);
+}
+
+/* Get all the participants in a room, except the one to skip (if any): must
+ * be called with the room mutex locked, the list can then be used without it */
+static GPtrArray *janus_textroom_room_recipients(janus_textroom_room *textroom, janus_textroom_participant *skip) {
+	GPtrArray *recipients = g_ptr_array_new_full(textroom->participants ? g_hash_table_size(textroom->participants) : 0,
+		(GDestroyNotify)janus_textroom_recipient_free);
+	if(textroom->participants) {
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, textroom->participants);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_textroom_participant *top = value;
+			if(top != skip)
+				janus_textroom_recipients_add(recipients, top);
+		}
+	}
+	return recipients;
+}
+
+/* Queue a message for a participant, and relay whatever is queued in batches,
+ * unless another thread is doing that already: the queue is capped, so that
+ * bursts of messages in busy rooms can't make it grow forever */
+static void janus_textroom_participant_send(janus_textroom_participant *participant,
+		janus_textroom_session *session, janus_textroom_payload *payload) {
+	janus_mutex_lock(&participant->mutex);
+	if(max_queued > 0 && g_queue_get_length(&participant->outbound) >= max_queued) {
+		/* Drop the oldest message we have */
+		janus_textroom_payload_unref(g_queue_pop_head(&participant->outbound));
+		participant->dropped++;
+		JANUS_LOG(LOG_HUGE, "Too many messages queued for %s, dropping the oldest one (%"SCNu64" dropped so far)\n",
+			participant->username, participant->dropped);
+	}
+	janus_refcount_increase(&payload->ref);
+	g_queue_push_tail(&participant->outbound, payload);
+	if(participant->flushing) {
+		/* Whoever is relaying messages to this participant will send this one too */
+		janus_mutex_unlock(&participant->mutex);
+		return;
+	}
+	participant->flushing = TRUE;
+	janus_textroom_payload *batch[JANUS_TEXTROOM_BATCH_SIZE];
+	janus_plugin_data packets[JANUS_TEXTROOM_BATCH_SIZE];
+	while(!g_queue_is_empty(&participant->outbound)) {
+		int count = 0, i = 0;
+		while(count < JANUS_TEXTROOM_BATCH_SIZE && !g_queue_is_empty(&participant->outbound)) {
+			batch[count] = g_queue_pop_head(&participant->outbound);
+			packets[count].label = NULL;
+			packets[count].protocol = NULL;
+			packets[count].binary = batch[count]->binary;
+			packets[count].buffer = batch[count]->text;
+			packets[count].length = batch[count]->length;
+			count++;
+		}
+		participant->sent += count;
+		janus_mutex_unlock(&participant->mutex);
+		gateway->relay_data_batch(session->handle, packets, count);
+		for(i=0; i<count; i++)
+			janus_textroom_payload_unref(batch[i]);
+		janus_mutex_lock(&participant->mutex);
+	}
+	participant->flushing = FALSE;
+	janus_mutex_unlock(&participant->mutex);
+}
+
+/* Send a message to a list of recipients: the room mutex must NOT be locked */
+static void janus_textroom_broadcast(GPtrArray *recipients, janus_textroom_payload *payload) {
+	guint i = 0;
+	for(i=0; i<recipients->len; i++) {
+		janus_textroom_recipient *recipient = g_ptr_array_index(recipients, i);
+		JANUS_LOG(LOG_VERB, "  >> To %s\n", recipient->participant->username);
+		janus_textroom_participant_send(recipient->participant, recipient->session, payload);
+	}
+}
+
 
 typedef struct janus_textroom_message {
 	janus_plugin_session *handle;
@@ -842,6 +1016,157 @@ static size_t janus_textroom_write_data(void *buffer, size_t size, size_t nmemb,
 janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session *handle,
 	char *text, json_t *json, gboolean internal);
 
+/* Helper to create a room out of a configuration category: rooms_mutex
+ * must be locked already if locked is TRUE, and is then not touched */
+static janus_textroom_room *janus_textroom_room_from_config(janus_config *room_config, janus_config_category *cat, gboolean locked) {
+	JANUS_LOG(LOG_VERB, "Adding TextRoom room '%s'\n", cat->name);
+	janus_config_item *desc = janus_config_get(room_config, cat, janus_config_type_item, "description");
+	janus_config_item *priv = janus_config_get(room_config, cat, janus_config_type_item, "is_private");
+	janus_config_item *secret = janus_config_get(room_config, cat, janus_config_type_item, "secret");
+	janus_config_item *pin = janus_config_get(room_config, cat, janus_config_type_item, "pin");
+	janus_config_item *history = janus_config_get(room_config, cat, janus_config_type_item, "history");
+	janus_config_item *post = janus_config_get(room_config, cat, janus_config_type_item, "post");
+	/* Create the text room */
+	janus_textroom_room *textroom = g_malloc0(sizeof(janus_textroom_room));
+	const char *room_num = cat->name;
+	if(strstr(room_num, "room-") == room_num)
+		room_num += 5;
+	if(!string_ids) {
+		textroom->room_id = g_ascii_strtoull(room_num, NULL, 0);
+		if(textroom->room_id == 0) {
+			JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, invalid ID 0...\n");
+			g_free(textroom);
+			return NULL;
+		}
+		/* Make sure the ID is completely numeric */
+		char room_id_str[30];
+		g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, textroom->room_id);
+		if(strcmp(room_num, room_id_str)) {
+			JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, ID '%s' is not numeric...\n", room_num);
+			g_free(textroom);
+			return NULL;
+		}
+	}
+	/* Let's make sure the room doesn't exist already */
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&textroom->room_id) != NULL) {
+		/* It does... */
+		if(!locked)
+			janus_mutex_unlock(&rooms_mutex);
+		JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, room %s already exists...\n", room_num);
+		g_free(textroom);
+		return NULL;
+	}
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	textroom->room_id_str = g_strdup(room_num);
+	char *description = NULL;
+	if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
+		description = g_strdup(desc->value);
+	else
+		description = g_strdup(cat->name);
+	textroom->room_name = description;
+	textroom->is_private = priv && priv->value && janus_is_true(priv->value);
+	if(secret != NULL && secret->value != NULL) {
+		textroom->room_secret = g_strdup(secret->value);
+	}
+	if(pin != NULL && pin->value != NULL) {
+		textroom->room_pin = g_strdup(pin->value);
+	}
+	if(history != NULL && history->value != NULL) {
+		if(janus_string_to_uint16(history->value, &textroom->history_size) < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid history size value (%s), disabling history...\n", history->value);
+		} else {
+			if(textroom->history_size > 0)
+				textroom->history = g_queue_new();
+		}
+	}
+	if(post != NULL && post->value != NULL) {
+#ifdef HAVE_LIBCURL
+		/* FIXME Should we check if this is a valid HTTP address? */
+		textroom->http_backend = g_strdup(post->value);
+#else
+		JANUS_LOG(LOG_WARN, "HTTP backend specified, but libcurl support was not built in...\n");
+#endif
+	}
+	textroom->participants = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)janus_textroom_participant_dereference);
+	textroom->check_tokens = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
+	textroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+	textroom->destroyed = 0;
+	janus_mutex_init(&textroom->mutex);
+	janus_refcount_init(&textroom->ref, janus_textroom_room_free);
+	JANUS_LOG(LOG_VERB, "Created TextRoom: %s (%s, %s, secret: %s, pin: %s, history: %"SCNu16" messages)\n",
+		textroom->room_id_str, textroom->room_name,
+		textroom->is_private ? "private" : "public",
+		textroom->room_secret ? textroom->room_secret : "no secret",
+		textroom->room_pin ? textroom->room_pin : "no pin", textroom->history_size);
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	g_hash_table_insert(rooms,
+		string_ids ? (gpointer)g_strdup(textroom->room_id_str) : (gpointer)janus_uint64_dup(textroom->room_id),
+		textroom);
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	return textroom;
+}
+
+/* When a rooms folder is configured, the permanent rooms saved there are only
+ * loaded when first needed: this helper looks a room up, and loads it from
+ * the folder if it's not available yet (rooms_mutex must be locked) */
+static janus_textroom_room *janus_textroom_lookup_room(guint64 room_id, const char *room_id_str) {
+	janus_textroom_room *textroom = g_hash_table_lookup(rooms,
+		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+	if(textroom != NULL || rooms_folder == NULL || room_id_str == NULL)
+		return textroom;
+	char cat[BUFSIZ];
+	g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+	if(!janus_config_folder_contains(rooms_folder, cat))
+		return NULL;
+	janus_config *room_config = janus_config_folder_load(rooms_folder, cat);
+	janus_config_category *c = janus_config_get(room_config, NULL, janus_config_type_category, cat);
+	if(c != NULL) {
+		JANUS_LOG(LOG_VERB, "Loading TextRoom room %s from the rooms folder\n", room_id_str);
+		textroom = janus_textroom_room_from_config(room_config, c, TRUE);
+	}
+	/* Whatever happened, we won't load this room again until a restart */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_destroy(room_config);
+	return textroom;
+}
+
+/* Load all the rooms in the rooms folder we haven't loaded yet (rooms_mutex must be locked) */
+static void janus_textroom_load_rooms(void) {
+	if(rooms_folder == NULL)
+		return;
+	GList *names = janus_config_folder_get_names(rooms_folder), *l = names;
+	while(l) {
+		const char *cat = (const char *)l->data;
+		l = l->next;
+		if(strstr(cat, "room-") != cat)
+			continue;
+		/* The name will be freed when the room is loaded, so we copy the ID */
+		char *room_id_str = g_strdup(cat + 5);
+		janus_textroom_lookup_room(string_ids ? 0 : g_ascii_strtoull(room_id_str, NULL, 10), room_id_str);
+		g_free(room_id_str);
+	}
+	g_list_free(names);
+}
+
+/* Persist the changes to a room (config_mutex must be locked): when a rooms
+ * folder is configured, rooms that aren't in the main configuration file get
+ * a file of their own, so that we only write what changed; in_config is
+ * whether the room was in the main configuration before the change */
+static gboolean janus_textroom_save_room(const char *cat, gboolean in_config) {
+	if(rooms_folder == NULL || in_config)
+		return janus_config_save(config, config_folder, JANUS_TEXTROOM_PACKAGE) >= 0;
+	janus_config_category *c = janus_config_get(config, NULL, janus_config_type_category, cat);
+	int res = c ? janus_config_folder_save(rooms_folder, config, c) : janus_config_folder_remove(rooms_folder, cat);
+	/* The room is in memory already, and doesn't belong in the main configuration */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_remove(config, NULL, cat);
+	return res == 0;
+}
 
 /* Plugin implementation */
 int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
@@ -915,6 +1240,27 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		if(string_ids) {
 			JANUS_LOG(LOG_INFO, "TextRoom will use alphanumeric IDs, not numeric\n");
 		}
+		janus_config_item *rfolder = janus_config_get(config, config_general, janus_config_type_item, "rooms_folder");
+		if(rfolder != NULL && rfolder->value != NULL) {
+			rooms_folder = janus_config_folder_open(rfolder->value);
+			if(rooms_folder == NULL) {
+				JANUS_LOG(LOG_WARN, "Couldn't open the rooms folder, saving permanent rooms to the configuration file instead\n");
+			} else {
+				JANUS_LOG(LOG_INFO, "TextRoom will save permanent rooms to %s, and load them on demand\n", rfolder->value);
+			}
+		}
+		janus_config_item *bm = janus_config_get(config, config_general, janus_config_type_item, "binary_messages");
+		if(bm != NULL && bm->value != NULL)
+			binary_messages = janus_is_true(bm->value);
+		janus_config_item *mq = janus_config_get(config, config_general, janus_config_type_item, "max_queued");
+		if(mq != NULL && mq->value != NULL) {
+			int value = atoi(mq->value);
+			if(value < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid max_queued value '%s', using default (%d)\n", mq->value, JANUS_TEXTROOM_DEFAULT_MAX_QUEUED);
+				value = JANUS_TEXTROOM_DEFAULT_MAX_QUEUED;
+			}
+			max_queued = value;
+		}
 	}
 	/* Iterate on all rooms */
 	rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
@@ -923,95 +1269,8 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
 			janus_config_category *cat = (janus_config_category *)cl->data;
-			if(cat->name == NULL || !strcasecmp(cat->name, "general")) {
-				cl = cl->next;
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "Adding TextRoom room '%s'\n", cat->name);
-			janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-			janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-			janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-			janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-			janus_config_item *history = janus_config_get(config, cat, janus_config_type_item, "history");
-			janus_config_item *post = janus_config_get(config, cat, janus_config_type_item, "post");
-			/* Create the text room */
-			janus_textroom_room *textroom = g_malloc0(sizeof(janus_textroom_room));
-			const char *room_num = cat->name;
-			if(strstr(room_num, "room-") == room_num)
-				room_num += 5;
-			if(!string_ids) {
-				textroom->room_id = g_ascii_strtoull(room_num, NULL, 0);
-				if(textroom->room_id == 0) {
-					JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, invalid ID 0...\n");
-					g_free(textroom);
-					cl = cl->next;
-					continue;
-				}
-				/* Make sure the ID is completely numeric */
-				char room_id_str[30];
-				g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, textroom->room_id);
-				if(strcmp(room_num, room_id_str)) {
-					JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, ID '%s' is not numeric...\n", room_num);
-					g_free(textroom);
-					cl = cl->next;
-					continue;
-				}
-			}
-			/* Let's make sure the room doesn't exist already */
-			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&textroom->room_id) != NULL) {
-				/* It does... */
-				janus_mutex_unlock(&rooms_mutex);
-				JANUS_LOG(LOG_ERR, "Can't add the TextRoom room, room %s already exists...\n", room_num);
-				g_free(textroom);
-				cl = cl->next;
-				continue;
-			}
-			janus_mutex_unlock(&rooms_mutex);
-			textroom->room_id_str = g_strdup(room_num);
-			char *description = NULL;
-			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
-				description = g_strdup(desc->value);
-			else
-				description = g_strdup(cat->name);
-			textroom->room_name = description;
-			textroom->is_private = priv && priv->value && janus_is_true(priv->value);
-			if(secret != NULL && secret->value != NULL) {
-				textroom->room_secret = g_strdup(secret->value);
-			}
-			if(pin != NULL && pin->value != NULL) {
-				textroom->room_pin = g_strdup(pin->value);
-			}
-			if(history != NULL && history->value != NULL) {
-				if(janus_string_to_uint16(history->value, &textroom->history_size) < 0) {
-					JANUS_LOG(LOG_WARN, "Invalid history size value (%s), disabling history...\n", history->value);
-				} else {
-					if(textroom->history_size > 0)
-						textroom->history = g_queue_new();
-				}
-			}
-			if(post != NULL && post->value != NULL) {
-#ifdef HAVE_LIBCURL
-				/* FIXME Should we check if this is a valid HTTP address? */
-				textroom->http_backend = g_strdup(post->value);
-#else
-				JANUS_LOG(LOG_WARN, "HTTP backend specified, but libcurl support was not built in...\n");
-#endif
-			}
-			textroom->participants = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify)janus_textroom_participant_dereference);
-			textroom->check_tokens = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
-			textroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
-			textroom->destroyed = 0;
-			janus_mutex_init(&textroom->mutex);
-			janus_refcount_init(&textroom->ref, janus_textroom_room_free);
-			JANUS_LOG(LOG_VERB, "Created TextRoom: %s (%s, %s, secret: %s, pin: %s, history: %"SCNu16" messages)\n",
-				textroom->room_id_str, textroom->room_name,
-				textroom->is_private ? "private" : "public",
-				textroom->room_secret ? textroom->room_secret : "no secret",
-				textroom->room_pin ? textroom->room_pin : "no pin", textroom->history_size);
-			g_hash_table_insert(rooms,
-				string_ids ? (gpointer)g_strdup(textroom->room_id_str) : (gpointer)janus_uint64_dup(textroom->room_id),
-				textroom);
+			if(cat->name != NULL && strcasecmp(cat->name, "general"))
+				janus_textroom_room_from_config(config, cat, FALSE);
 			cl = cl->next;
 		}
 		g_list_free(clist);
@@ -1043,6 +1302,8 @@ int janus_textroom_init(janus_callbacks *callback, const char *config_path) {
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the TextRoom handler thread...\n",
 			error->code, error->message ? error->message : "??");
 		g_error_free(error);
+		janus_config_folder_destroy(rooms_folder);
+		rooms_folder = NULL;
 		return -1;
 	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_TEXTROOM_NAME);
@@ -1077,6 +1338,8 @@ void janus_textroom_destroy(void) {
 #endif
 
 	janus_config_destroy(config);
+	janus_config_folder_destroy(rooms_folder);
+	rooms_folder = NULL;
 	g_free(admin_key);
 
 	g_atomic_int_set(&initialized, 0);
@@ -1178,8 +1441,29 @@ json_t *janus_textroom_query_session(janus_plugin_session *handle) {
 	}
 	janus_refcount_increase(&session->ref);
 	janus_mutex_unlock(&sessions_mutex);
-	/* TODO Return meaningful info: participant details, rooms they're in, etc. */
 	json_t *info = json_object();
+	/* Rooms this user is in, and how many messages were relayed or dropped */
+	json_t *list = json_array();
+	janus_mutex_lock(&session->mutex);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, session->rooms);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_textroom_participant *p = value;
+		json_t *pl = json_object();
+		janus_mutex_lock(&p->mutex);
+		janus_textroom_room *textroom = p->room;
+		if(textroom)
+			json_object_set_new(pl, "room", string_ids ? json_string(textroom->room_id_str) : json_integer(textroom->room_id));
+		json_object_set_new(pl, "username", json_string(p->username));
+		json_object_set_new(pl, "sent", json_integer(p->sent));
+		json_object_set_new(pl, "queued", json_integer(g_queue_get_length(&p->outbound)));
+		json_object_set_new(pl, "dropped", json_integer(p->dropped));
+		janus_mutex_unlock(&p->mutex);
+		json_array_append_new(list, pl);
+	}
+	janus_mutex_unlock(&session->mutex);
+	json_object_set_new(info, "rooms", list);
 	json_object_set_new(info, "destroyed", json_integer(session->destroyed));
 	janus_refcount_decrease(&session->ref);
 	return info;
@@ -1386,11 +1670,99 @@ void janus_textroom_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rtc
 	/* We don't do audio/video */
 }
 
+/* Helper method to relay messages sent using the compact binary envelope */
+static void janus_textroom_handle_envelope(janus_textroom_session *session, char *buf, uint16_t len) {
+	/* Parse the header: version, room ID and recipient (if any) */
+	const guint8 *data = (const guint8 *)buf;
+	if(len < 3 || data[0] != JANUS_TEXTROOM_ENVELOPE_VERSION) {
+		JANUS_LOG(LOG_ERR, "Invalid or unsupported binary envelope, dropping...\n");
+		return;
+	}
+	uint16_t offset = 1;
+	guint8 room_len = data[offset++];
+	if(room_len == 0 || offset + room_len + 1 > len) {
+		JANUS_LOG(LOG_ERR, "Invalid room ID in binary envelope, dropping...\n");
+		return;
+	}
+	char room_id_str[256], to[256];
+	memcpy(room_id_str, buf + offset, room_len);
+	room_id_str[room_len] = '\0';
+	offset += room_len;
+	guint8 to_len = data[offset++];
+	if(offset + to_len > len) {
+		JANUS_LOG(LOG_ERR, "Invalid recipient in binary envelope, dropping...\n");
+		return;
+	}
+	memcpy(to, buf + offset, to_len);
+	to[to_len] = '\0';
+	offset += to_len;
+	guint64 room_id = 0;
+	if(!string_ids) {
+		char *end = NULL;
+		room_id = g_ascii_strtoull(room_id_str, &end, 10);
+		if(room_id == 0 || end == NULL || *end != '\0') {
+			JANUS_LOG(LOG_ERR, "Invalid room ID in binary envelope (%s), dropping...\n", room_id_str);
+			return;
+		}
+	}
+	janus_mutex_lock(&rooms_mutex);
+	janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
+	if(textroom == NULL) {
+		janus_mutex_unlock(&rooms_mutex);
+		JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
+		return;
+	}
+	janus_refcount_increase(&textroom->ref);
+	janus_mutex_unlock(&rooms_mutex);
+	janus_mutex_lock(&textroom->mutex);
+	janus_textroom_participant *participant = g_hash_table_lookup(session->rooms,
+		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+	size_t from_len = participant ? strlen(participant->username) : 0;
+	if(participant == NULL || from_len > 255) {
+		janus_mutex_unlock(&textroom->mutex);
+		janus_refcount_decrease(&textroom->ref);
+		if(participant == NULL)
+			JANUS_LOG(LOG_ERR, "Not in room %s\n", room_id_str);
+		else
+			JANUS_LOG(LOG_ERR, "Username too long for binary envelopes, dropping...\n");
+		return;
+	}
+	/* Forward the same header, with the sender in place of the recipient */
+	size_t body_len = len - offset, out_len = 3 + room_len + from_len + body_len;
+	char *out = g_malloc(out_len);
+	size_t out_offset = 0;
+	out[out_offset++] = JANUS_TEXTROOM_ENVELOPE_VERSION;
+	out[out_offset++] = room_len;
+	memcpy(out + out_offset, room_id_str, room_len);
+	out_offset += room_len;
+	out[out_offset++] = from_len;
+	memcpy(out + out_offset, participant->username, from_len);
+	out_offset += from_len;
+	memcpy(out + out_offset, buf + offset, body_len);
+	janus_textroom_payload *payload = janus_textroom_payload_new_binary(out, out_len);
+	GPtrArray *recipients = NULL;
+	if(to_len == 0) {
+		recipients = janus_textroom_room_recipients(textroom, NULL);
+	} else {
+		recipients = g_ptr_array_new_with_free_func((GDestroyNotify)janus_textroom_recipient_free);
+		janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
+		if(top)
+			janus_textroom_recipients_add(recipients, top);
+		else
+			JANUS_LOG(LOG_WARN, "User %s is not in room %s, failed to send message\n", to, room_id_str);
+	}
+	janus_mutex_unlock(&textroom->mutex);
+	janus_textroom_broadcast(recipients, payload);
+	g_ptr_array_free(recipients, TRUE);
+	janus_textroom_payload_unref(payload);
+	janus_refcount_decrease(&textroom->ref);
+}
+
 void janus_textroom_incoming_data(janus_plugin_session *handle, janus_plugin_data *packet) {
 	if(handle == NULL || handle->stopped || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return;
-	if(packet->binary) {
-		/* We don't support binary data in the TextRoom plugin, it has to be text */
+	if(packet->binary && !binary_messages) {
+		/* Binary envelopes are disabled, so everything has to be text */
 		JANUS_LOG(LOG_ERR, "Binary data received, dropping...\n");
 		return;
 	}
@@ -1411,6 +1783,12 @@ void janus_textroom_incoming_data(janus_plugin_session *handle, janus_plugin_dat
 		janus_refcount_decrease(&session->ref);
 		return;
 	}
+	if(packet->binary) {
+		/* Compact message envelope, relay it without parsing the body */
+		janus_textroom_handle_envelope(session, buf, len);
+		janus_refcount_decrease(&session->ref);
+		return;
+	}
 	char *text = g_malloc(len+1);
 	memcpy(text, buf, len);
 	*(text+len) = '\0';
@@ -1487,8 +1865,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1552,6 +1929,9 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			history_text = json_dumps(msg, json_format);
 		}
 		json_decref(msg);
+		/* The message is serialized once, and shared by all recipients */
+		janus_textroom_payload *payload = janus_textroom_payload_new(msg_text);
+		GPtrArray *recipients = NULL;
 		/* Start preparing the response too */
 		reply = json_object();
 		json_object_set_new(reply, "textroom", json_string("success"));
@@ -1562,11 +1942,9 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			const char *to = json_string_value(username);
 			JANUS_LOG(LOG_VERB, "To %s in %s: %s\n", to, room_id_str, message);
 			janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
+			recipients = g_ptr_array_new_with_free_func((GDestroyNotify)janus_textroom_recipient_free);
 			if(top) {
-				janus_refcount_increase(&top->ref);
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-				gateway->relay_data(top->session->handle, &data);
-				janus_refcount_decrease(&top->ref);
+				janus_textroom_recipients_add(recipients, top);
 				json_object_set_new(sent, to, json_true());
 			} else {
 				JANUS_LOG(LOG_WARN, "User %s is not in room %s, failed to send message\n", to, room_id_str);
@@ -1577,16 +1955,14 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			/* A limited number of users */
 			json_t *sent = json_object();
 			size_t i = 0;
+			recipients = g_ptr_array_new_full(json_array_size(usernames), (GDestroyNotify)janus_textroom_recipient_free);
 			for(i=0; i<json_array_size(usernames); i++) {
 				json_t *u = json_array_get(usernames, i);
 				const char *to = json_string_value(u);
 				JANUS_LOG(LOG_VERB, "To %s in %s: %s\n", to, room_id_str, message);
 				janus_textroom_participant *top = g_hash_table_lookup(textroom->participants, to);
 				if(top) {
-					janus_refcount_increase(&top->ref);
-					janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-					gateway->relay_data(top->session->handle, &data);
-					janus_refcount_decrease(&top->ref);
+					janus_textroom_recipients_add(recipients, top);
 					json_object_set_new(sent, to, json_true());
 				} else {
 					JANUS_LOG(LOG_WARN, "User %s is not in room %s, failed to send message\n", to, room_id_str);
@@ -1597,19 +1973,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		} else {
 			/* Everybody in the room */
 			JANUS_LOG(LOG_VERB, "To everybody in %s: %s\n", room_id_str, message);
-			if(textroom->participants) {
-				GHashTableIter iter;
-				gpointer value;
-				g_hash_table_iter_init(&iter, textroom->participants);
-				while(g_hash_table_iter_next(&iter, NULL, &value)) {
-					janus_textroom_participant *top = value;
-					JANUS_LOG(LOG_VERB, "  >> To %s in %s: %s\n", top->username, room_id_str, message);
-					janus_refcount_increase(&top->ref);
-					janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-					gateway->relay_data(top->session->handle, &data);
-					janus_refcount_decrease(&top->ref);
-				}
-			}
+			recipients = janus_textroom_room_recipients(textroom, NULL);
 			if(textroom->history && history_text) {
 				/* Store in the history */
 				g_queue_push_tail(textroom->history, history_text);
@@ -1649,8 +2013,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 #endif
 		}
 		janus_refcount_decrease(&participant->ref);
-		free(msg_text);
 		janus_mutex_unlock(&textroom->mutex);
+		/* Now that the room is unlocked, relay the message */
+		janus_textroom_broadcast(recipients, payload);
+		g_ptr_array_free(recipients, TRUE);
+		janus_textroom_payload_unref(payload);
 		janus_refcount_decrease(&textroom->ref);
 		/* By default we send a confirmation back to the user that sent this message:
 		 * if the user passed an ack=false, though, we don't do that */
@@ -1690,8 +2057,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1754,6 +2120,10 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		participant->room = textroom;
 		participant->username = g_strdup(username_text);
 		participant->display = display_text ? g_strdup(display_text) : NULL;
+		g_queue_init(&participant->outbound);
+		participant->flushing = FALSE;
+		participant->sent = 0;
+		participant->dropped = 0;
 		participant->destroyed = 0;
 		janus_mutex_init(&participant->mutex);
 		janus_refcount_init(&participant->ref, janus_textroom_participant_free);
@@ -1768,21 +2138,25 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		gboolean send_history = history ? json_is_true(history) : TRUE;
 		if(send_history) {
 			if(textroom->history != NULL && textroom->history->head != NULL) {
+				/* Send the whole history in one go */
+				guint count = g_queue_get_length(textroom->history), i = 0;
+				janus_plugin_data *packets = g_malloc0(count * sizeof(janus_plugin_data));
 				GList *temp = textroom->history->head;
-				char *text = NULL;
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = NULL, .length = 0 };
-				while(temp) {
-					text = (char *)temp->data;
-					data.buffer = text;
-					data.length = strlen(text);
-					gateway->relay_data(handle, &data);
+				while(temp && i < count) {
+					packets[i].buffer = (char *)temp->data;
+					packets[i].length = strlen(packets[i].buffer);
+					i++;
 					temp = temp->next;
 				}
+				gateway->relay_data_batch(handle, packets, i);
+				g_free(packets);
 			}
 		}
 		/* Notify all participants */
 		JANUS_LOG(LOG_VERB, "Notifying all participants about the new join\n");
 		json_t *list = json_array();
+		janus_textroom_payload *payload = NULL;
+		GPtrArray *recipients = NULL;
 		if(textroom->participants) {
 			/* Prepare event */
 			json_t *event = json_object();
@@ -1802,9 +2176,12 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				g_snprintf(error_cause, 512, "Failed to stringify message");
 				goto msg_response;
 			}
-			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
+			payload = janus_textroom_payload_new(event_text);
+			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = payload->text, .length = payload->length };
 			gateway->relay_data(handle, &data);
-			/* Broadcast */
+			/* Take note of who we should broadcast this to */
+			recipients = g_ptr_array_new_full(g_hash_table_size(textroom->participants),
+				(GDestroyNotify)janus_textroom_recipient_free);
 			GHashTableIter iter;
 			gpointer value;
 			g_hash_table_iter_init(&iter, textroom->participants);
@@ -1812,21 +2189,23 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				janus_textroom_participant *top = value;
 				if(top == participant)
 					continue;	/* Skip us */
-				janus_refcount_increase(&top->ref);
-				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				gateway->relay_data(top->session->handle, &data);
+				janus_textroom_recipients_add(recipients, top);
 				/* Take note of this user */
 				json_t *p = json_object();
 				json_object_set_new(p, "username", json_string(top->username));
 				if(top->display != NULL)
 					json_object_set_new(p, "display", json_string(top->display));
 				json_array_append_new(list, p);
-				janus_refcount_decrease(&top->ref);
 			}
-			free(event_text);
 		}
 		janus_mutex_unlock(&session->mutex);
 		janus_mutex_unlock(&textroom->mutex);
+		if(recipients) {
+			/* Broadcast, now that the room is unlocked */
+			janus_textroom_broadcast(recipients, payload);
+			g_ptr_array_free(recipients, TRUE);
+		}
+		janus_textroom_payload_unref(payload);
 		janus_refcount_decrease(&textroom->ref);
 		if(!internal) {
 			/* Send response back */
@@ -1867,8 +2246,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -1898,6 +2276,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		participant->room = NULL;
 		/* Notify all participants */
 		JANUS_LOG(LOG_VERB, "Notifying all participants about the new leave\n");
+		janus_textroom_payload *payload = NULL;
+		GPtrArray *recipients = NULL;
 		if(textroom->participants) {
 			/* Prepare event */
 			json_t *event = json_object();
@@ -1917,22 +2297,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 				g_snprintf(error_cause, 512, "Failed to stringify message");
 				goto msg_response;
 			}
-			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = event_text, .length = strlen(event_text) };
+			payload = janus_textroom_payload_new(event_text);
+			janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = payload->text, .length = payload->length };
 			gateway->relay_data(handle, &data);
-			/* Broadcast */
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, textroom->participants);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_textroom_participant *top = value;
-				if(top == participant)
-					continue;	/* Skip us */
-				janus_refcount_increase(&top->ref);
-				JANUS_LOG(LOG_VERB, "  >> To %s in %s\n", top->username, room_id_str);
-				gateway->relay_data(top->session->handle, &data);
-				janus_refcount_decrease(&top->ref);
-			}
-			free(event_text);
+			/* Take note of who we should broadcast this to */
+			recipients = janus_textroom_room_recipients(textroom, participant);
 		}
 		/* Also notify event handlers */
 		if(notify_events && gateway->events_is_enabled()) {
@@ -1944,6 +2313,12 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		}
 		janus_mutex_unlock(&session->mutex);
 		janus_mutex_unlock(&textroom->mutex);
+		if(recipients) {
+			/* Broadcast, now that the room is unlocked */
+			janus_textroom_broadcast(recipients, payload);
+			g_ptr_array_free(recipients, TRUE);
+		}
+		janus_textroom_payload_unref(payload);
 		janus_refcount_decrease(&textroom->ref);
 		janus_refcount_decrease(&participant->ref);
 		janus_textroom_participant_destroy(participant);
@@ -1971,6 +2346,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		}
 		json_t *list = json_array();
 		janus_mutex_lock(&rooms_mutex);
+		/* Make sure we also list the rooms we didn't need so far */
+		janus_textroom_load_rooms();
 		GHashTableIter iter;
 		gpointer value;
 		g_hash_table_iter_init(&iter, rooms);
@@ -2028,8 +2405,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL || g_atomic_int_get(&textroom->destroyed)) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2098,8 +2474,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2209,8 +2584,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2320,8 +2694,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2364,19 +2737,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			goto msg_response;
 		}
 		/* Send the announcement to everybody in the room */
-		if(textroom->participants) {
-			GHashTableIter iter;
-			gpointer value;
-			g_hash_table_iter_init(&iter, textroom->participants);
-			while(g_hash_table_iter_next(&iter, NULL, &value)) {
-				janus_textroom_participant *top = value;
-				JANUS_LOG(LOG_VERB, "  >> To %s in %s: %s\n", top->username, room_id_str, message);
-				janus_refcount_increase(&top->ref);
-				janus_plugin_data data = { .label = NULL, .protocol = NULL, .binary = FALSE, .buffer = msg_text, .length = strlen(msg_text) };
-				gateway->relay_data(top->session->handle, &data);
-				janus_refcount_decrease(&top->ref);
-			}
-		}
+		janus_textroom_payload *payload = janus_textroom_payload_new(msg_text);
+		GPtrArray *recipients = janus_textroom_room_recipients(textroom, NULL);
 		if(textroom->history) {
 			/* Store in the history */
 			g_queue_push_tail(textroom->history, g_strdup(msg_text));
@@ -2414,8 +2776,11 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			}
 		}
 #endif
-		free(msg_text);
 		janus_mutex_unlock(&textroom->mutex);
+		JANUS_LOG(LOG_VERB, "Announcement to everybody in %s: %s\n", room_id_str, message);
+		janus_textroom_broadcast(recipients, payload);
+		g_ptr_array_free(recipients, TRUE);
+		janus_textroom_payload_unref(payload);
 		janus_refcount_decrease(&textroom->ref);
 		if(!internal) {
 			/* Send response back */
@@ -2502,7 +2867,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(janus_textroom_lookup_room(room_id, room_id_str) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_TEXTROOM_ERROR_ROOM_EXISTS;
@@ -2518,7 +2883,8 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		if(!string_ids && room_id == 0) {
 			while(room_id == 0) {
 				room_id = janus_random_uint64();
-				if(g_hash_table_lookup(rooms, &room_id) != NULL) {
+				g_snprintf(room_id_num, sizeof(room_id_num), "%"SCNu64, room_id);
+				if(janus_textroom_lookup_room(room_id, room_id_num) != NULL) {
 					/* Room ID already taken, try another one */
 					room_id = 0;
 				}
@@ -2528,7 +2894,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_textroom_lookup_room(0, room_id_str) != NULL) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -2597,6 +2963,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", textroom->room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_category *c = janus_config_get_create(config, NULL, janus_config_type_category, cat);
 			/* Now for the values */
 			janus_config_add(config, c, janus_config_item_create("description", textroom->room_name));
@@ -2613,7 +2980,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			if(textroom->http_backend)
 				janus_config_add(config, c, janus_config_item_create("post", textroom->http_backend));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_TEXTROOM_PACKAGE) < 0)
+			if(!janus_textroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -2666,7 +3033,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = (janus_textroom_lookup_room(room_id, room_id_str) != NULL);
 		janus_mutex_unlock(&rooms_mutex);
 		if(!internal) {
 			/* Send response back */
@@ -2717,8 +3084,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2770,6 +3136,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			/* Remove the old category first */
 			janus_config_remove(config, NULL, cat);
 			/* Now write the room details again */
@@ -2788,7 +3155,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			if(textroom->http_backend)
 				janus_config_add(config, c, janus_config_item_create("post", textroom->http_backend));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_TEXTROOM_PACKAGE) < 0)
+			if(!janus_textroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room changes are not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -2845,8 +3212,7 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		janus_textroom_room *textroom = g_hash_table_lookup(rooms,
-			string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		janus_textroom_room *textroom = janus_textroom_lookup_room(room_id, room_id_str);
 		if(textroom == NULL) {
 			janus_mutex_unlock(&rooms_mutex);
 			JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
@@ -2875,9 +3241,10 @@ janus_plugin_result *janus_textroom_handle_incoming_request(janus_plugin_session
 			char cat[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_remove(config, NULL, cat);
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_TEXTROOM_PACKAGE) < 0)
+			if(!janus_textroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room destruction is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -1327,6 +1327,10 @@ static void *janus_videocall_handler(void *data) {
 				if(session->e2ee)
 					json_object_set_new(jsep, "e2ee", json_true());
 				g_atomic_int_set(&session->hangingup, 0);
+				/* The callee hasn't negotiated anything yet: ask the core to move it to the
+				 * same loop as the caller, so that we can forward without thread hops */
+				if(gateway->colocate(peer->handle, session->handle) < 0)
+					JANUS_LOG(LOG_VERB, "Couldn't co-locate %s with %s, forwarding through the queues\n", peer->username, session->username);
 				int ret = gateway->push_event(peer->handle, &janus_videocall_plugin, NULL, call, jsep);
 				JANUS_LOG(LOG_VERB, "  >> Pushing event to peer: %d (%s)\n", ret, janus_get_api_error(ret));
 				json_decref(call);
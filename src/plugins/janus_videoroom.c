@@ -81,6 +81,8 @@ room-<unique room ID>: {
 	bitrate = <max video bitrate for senders> (e.g., 128000)
 	bitrate_cap = <true|false, whether the above cap should act as a limit to dynamic bitrate changes by publishers, default=false>,
 	fir_freq = <send a FIR to publishers every fir_freq seconds> (0=disable)
+	data_batch = <how many milliseconds DataChannel messages for subscribers can be held, so that
+				they're sent together, e.g., for rooms with lots of small live messages (0=disable, default)>
 	audiocodec = opus|g722|pcmu|pcma|isac32|isac16 (audio codec to force on publishers, default=opus
 				can be a comma separated list in order of preference, e.g., opus,pcmu)
 	videocodec = vp8|vp9|h264|av1|h265 (video codec to force on publishers, default=vp8
@@ -119,6 +121,15 @@ room-<unique room ID>: {
 				optionally with a fmtp attribute to match (codec/fmtp properties).
 				If not provided, all codecs enabled in the room are offered, with no fmtp.
 				Notice that the fmtp is parsed, and only a few codecs are supported.
+	threads = number of helper threads subscribers should be spread across, to
+				relay media to them in parallel rather than from the thread receiving
+				media from the publisher (optional, default=0, no helper threads)
+	threads_threshold = minimum number of subscribers a stream should have before
+				the helper threads are used to relay it (optional, default=0, always)
+	gop_cache_size = maximum size, in kilobytes, of the last group of pictures
+				to cache for each (non-simulcast, non-SVC) video stream, so that new
+				subscribers can be sent it right away instead of waiting for a new
+				keyframe (optional, default=0, no cache)
 }
 \endverbatim
  *
@@ -197,6 +208,9 @@ room-<unique room ID>: {
  *
  * If you requested a permanent room but a \c false value is returned
  * instead, good chances are that there are permission problems.
+ * Notice that, if a \c rooms_folder is configured, permanent rooms are
+ * saved there (one file per room) rather than in the configuration file,
+ * and are only loaded when they're first needed.
  *
  * An error instead (and the same applies to all other requests, so this
  * won't be repeated) would provide both an error code and a more verbose
@@ -409,10 +423,14 @@ room-<unique room ID>: {
 			"bitrate" : <bitrate cap that should be forced (via REMB) on all publishers by default>,
 			"bitrate_cap" : <true|false, whether the above cap should act as a limit to dynamic bitrate changes by publishers (optional)>,
 			"fir_freq" : <how often a keyframe request is sent via PLI/FIR to active publishers>,
+			"data_batch" : <how long (in ms) DataChannel messages for subscribers are held to be sent together, if enabled>,
 			"require_pvtid": <true|false, whether subscriptions in this room require a private_id>,
 			"require_e2ee": <true|false, whether end-to-end encrypted publishers are required>,
 			"dummy_publisher": <true|false, whether a dummy publisher exists for placeholder subscriptions>,
 			"notify_joining": <true|false, whether an event is sent to notify all participants if a new participant joins the room>,
+			"threads": <number of helper threads used to relay media to subscribers, if any>,
+			"threads_threshold": <minimum number of subscribers to a stream before helper threads are used, if any>,
+			"gop_cache_size": <maximum size in KB of the GOP cached for each video stream, if any>,
 			"audiocodec" : "<comma separated list of allowed audio codecs>",
 			"videocodec" : "<comma separated list of allowed video codecs>",
 			"opus_fec": <true|false, whether inband FEC must be negotiated (note: only available for Opus) (optional)>,
@@ -433,6 +451,12 @@ room-<unique room ID>: {
 	]
 }
 \endverbatim
+ *
+ * Notice that the list comes from a snapshot, which the plugin refreshes
+ * when rooms are created, edited or destroyed, and otherwise keeps for up
+ * to \c list_refresh milliseconds (see the plugin settings): this means
+ * that some details (e.g., the number of participants) may be slightly
+ * out of date.
  *
  * To get a list of the participants in a specific room, instead, you
  * can make use of the \c listparticipants request, which has to be
@@ -462,6 +486,45 @@ room-<unique room ID>: {
 		// Other participants
 	]
 }
+\endverbatim
+ *
+ * Asynchronous requests are processed by a configurable number of handler
+ * threads (see \c handler_threads in the plugin settings): requests are
+ * routed by room, so that requests addressed to the same room are still
+ * processed in order, while different rooms can proceed in parallel. To
+ * check how those threads are doing, the Admin API supports an additional
+ * \c query_handler request, which has to be formatted as follows:
+ *
+\verbatim
+{
+	"request" : "query_handler"
+}
+\endverbatim
+ *
+ * The response lists the handler threads, and how long each type of
+ * asynchronous request took so far (times are in microseconds):
+ *
+\verbatim
+{
+	"videoroom" : "handler",
+	"handler_threads" : <number of handler threads>,
+	"handlers" : [
+		{
+			"id" : <ID of the handler thread>,
+			"queued" : <number of messages waiting to be processed>,
+			"processed" : <number of messages processed so far>
+		},
+		// Other handler threads
+	],
+	"requests" : {
+		"<request name, e.g., configure>" : {
+			"count" : <number of requests processed>,
+			"avg_time" : <average processing time>,
+			"max_time" : <longest processing time>
+		},
+		// Other requests
+	}
+}
 \endverbatim
  *
  * This covers almost all the synchronous requests. All the asynchronous requests,
@@ -825,6 +888,13 @@ room-<unique room ID>: {
 			"port_3" : <if video and simulcasting, port to forward the packets from the third substream/layer to>,
 			"ssrc_3" : <if video and simulcasting, SSRC to use to use the third substream/layer; optional>,
 			"pt_3" : <if video and simulcasting, payload type to use the third substream/layer; optional>,
+			"mirrors" : [	// Optional, only for RTP streams, not data
+				{
+					"host" : "<IP address of an additional recipient of the same packets>",
+					"port" : <port of the additional recipient>
+				},
+				.. other mirrors, if needed..
+			]
 		},
 		{
 			.. other streams, if needed..
@@ -844,6 +914,17 @@ room-<unique room ID>: {
  * be sent to the same IP address, while the port must be specific to the
  * stream itself.
  *
+ * In case the same stream must be sent to several recipients at the
+ * same time, rather than creating a separate forwarder for each of them
+ * you can list the additional recipients in the \c mirrors array of the
+ * stream: packets are then processed (and, if SRTP is used, encrypted)
+ * only once, and the very same packets sent to all of them, which also
+ * means they'll all share the same SSRC, payload type and SRTP context.
+ * Mirrors must be numeric IP addresses (multicast addresses are fine
+ * too), and when forwarding simulcast substreams separately they only
+ * apply to the main \c port . Notice that RTCP feedback, if enabled, is
+ * only received from the main recipient.
+ *
  * Notice that, as explained above, in case you configured an \c admin_key
  * property and extended it to RTP forwarding as well, you'll need to provide
  * it in the request as well or it will be rejected as unauthorized. By
@@ -900,9 +981,20 @@ room-<unique room ID>: {
 	"request" : "stop_rtp_forward",
 	"room" : <unique numeric ID of the room the publisher is in>,
 	"publisher_id" : <unique numeric ID of the publisher to update>,
-	"stream_id" : <unique numeric ID of the RTP forwarder>
+	"stream_id" : <unique numeric ID of the RTP forwarder>,
+	"mirrors" : [	// Optional
+		{
+			"host" : "<IP address of the mirror to remove>",
+			"port" : <port of the mirror to remove>
+		},
+		.. other mirrors, if needed..
+	]
 }
 \endverbatim
+ *
+ * In case a \c mirrors array is provided, the forwarder is not stopped:
+ * only the listed mirrors are removed from it, while the forwarder keeps
+ * on sending packets to its main recipient and to the other mirrors.
  *
  * A successful request will result in a \c stop_rtp_forward response:
  *
@@ -948,7 +1040,14 @@ room-<unique room ID>: {
 					"ssrc" : <SSRC this forwarder is using, if any>,
 					"pt" : <payload type this forwarder is using, if any>,
 					"substream" : <video substream this video forwarder is relaying, if any>,
-					"srtp" : <true|false, whether the RTP stream is encrypted>
+					"srtp" : <true|false, whether the RTP stream is encrypted>,
+					"mirrors" : [	// Only if the forwarder has mirrors
+						{
+							"host" : "<IP address of the mirror, as provided in rtp_forward>",
+							"port" : <port of the mirror>
+						},
+						// Other mirrors
+					]
 				},
 				// Other forwarders for this publisher
 			],
@@ -957,6 +1056,40 @@ room-<unique room ID>: {
 	]
 }
 \endverbatim *
+ *
+ * When cascading VideoRoom instances via \c publish_remotely and
+ * \c add_remote_publisher, each remote publisher normally gets sockets
+ * and a thread of its own on the receiving side. If many publishers are
+ * relayed between the same two instances, you can create a trunk instead,
+ * that is a single RTP/RTCP socket pair (and thread) that all of them
+ * share, using the \c add_remote_trunk request (which, if an \c admin_key
+ * is configured, needs it to be provided):
+ *
+\verbatim
+{
+	"request" : "add_remote_trunk",
+	"trunk_id" : "<unique ID of the trunk; optional, random if missing>",
+	"mcast" : "<multicast group to bind to; optional>",
+	"iface" : "<network interface or IP address to bind to; optional>",
+	"port" : <port to bind to for RTP; optional, random if missing>,
+	"rtcp_port" : <port to bind to for RTCP; optional, random if missing>
+}
+\endverbatim
+ *
+ * A successful response will contain the \c trunk_id, \c ip, \c port
+ * and \c rtcp_port of the new trunk. Passing that \c trunk_id as
+ * \c trunk in an \c add_remote_publisher request will then have the
+ * remote publisher received on the trunk, with no new socket or thread:
+ * since the traffic of different publishers is told apart by SSRC, each
+ * publisher in a trunk gets its own SSRC base (a multiple of 1000, which
+ * you can either pick via \c ssrc_base or let the plugin choose), that
+ * is returned in the response and must then be passed as \c ssrc_base
+ * in the \c publish_remotely request on the sending side. Trunks can be
+ * listed with \c list_remote_trunks, and destroyed, along with all the
+ * remote publishers they're receiving, with a \c remove_remote_trunk
+ * request that only needs the \c trunk_id. Packets on trunks, as well as
+ * on regular remote publishers, are read in batches where \c recvmmsg
+ * is available.
  *
  * To enable or disable recording on all participants while the conference
  * is in progress, you can make use of the \c enable_recording request,
@@ -1047,6 +1180,7 @@ room-<unique room ID>: {
 	"room" : <unique ID of the room to subscribe in>,
 	"use_msid" : <whether subscriptions should include an msid that references the publisher; false by default>,
 	"autoupdate" : <whether a new SDP offer is sent automatically when a subscribed publisher leaves; true by default>,
+	"low_latency" : <whether this is an interactive subscriber, that needs media with as little delay as possible; false by default>,
 	"private_id" : <unique ID of the publisher that originated this request; optional, unless mandated by the room configuration>,
 	"streams" : [
 		{
@@ -1076,6 +1210,14 @@ room-<unique room ID>: {
  * Notice that if a publisher stream is marked as \c disabled and you try
  * to subscribe to it, it will be skipped silently.
  *
+ * Setting \c low_latency to \c true is meant for the few interactive users
+ * of a room (e.g., bidders in an auction), rather than for bulk viewers:
+ * the subscriber will be sent a playout-delay of 0 (if the extension was
+ * negotiated), won't be sent the cached GOP when joining (it will wait for
+ * a fresh keyframe instead), and its packets will be neither paced nor
+ * queued behind those of other subscribers served by the same event loop.
+ * The mode can be toggled later on via \c configure as well.
+ *
  * Depending on whether the subscription will refer to a
  * single publisher (legacy approach) or to streams coming from different
  * publishers (multistream), the list of streams may differ. The ability
@@ -1374,6 +1516,7 @@ room-<unique room ID>: {
 		},
 		// Other streams, if any
 	],
+	"low_latency" : <true|false, whether to enable or disable the low-latency mode (see above); optional>,
 	"restart" : <trigger an ICE restart; optional>
 }
 \endverbatim
@@ -1500,6 +1643,9 @@ room-<unique room ID>: {
 \endverbatim
  */
 
+#ifdef HAVE_RECVMMSG
+#define _GNU_SOURCE
+#endif
 #include "plugin.h"
 
 #include <jansson.h>
@@ -1550,9 +1696,12 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rt
 void janus_videoroom_incoming_data(janus_plugin_session *handle, janus_plugin_data *packet);
 void janus_videoroom_data_ready(janus_plugin_session *handle);
 void janus_videoroom_slow_link(janus_plugin_session *handle, int mindex, gboolean video, gboolean uplink);
+void janus_videoroom_estimated_bandwidth(janus_plugin_session *handle, uint32_t estimate);
 void janus_videoroom_hangup_media(janus_plugin_session *handle);
 void janus_videoroom_destroy_session(janus_plugin_session *handle, int *error);
 json_t *janus_videoroom_query_session(janus_plugin_session *handle);
+void janus_videoroom_drain(gboolean draining);
+json_t *janus_videoroom_query_metrics(void);
 
 /* Plugin setup */
 static janus_plugin janus_videoroom_plugin =
@@ -1577,9 +1726,12 @@ static janus_plugin janus_videoroom_plugin =
 		.incoming_data = janus_videoroom_incoming_data,
 		.data_ready = janus_videoroom_data_ready,
 		.slow_link = janus_videoroom_slow_link,
+		.estimated_bandwidth = janus_videoroom_estimated_bandwidth,
 		.hangup_media = janus_videoroom_hangup_media,
 		.destroy_session = janus_videoroom_destroy_session,
 		.query_session = janus_videoroom_query_session,
+		.drain = janus_videoroom_drain,
+		.query_metrics = janus_videoroom_query_metrics,
 	);
 
 /* Plugin creator */
@@ -1606,6 +1758,7 @@ static struct janus_json_parameter create_parameters[] = {
 	{"bitrate", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"bitrate_cap", JANUS_JSON_BOOL, 0},
 	{"fir_freq", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"data_batch", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"publishers", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"audiocodec", JSON_STRING, 0},
 	{"videocodec", JSON_STRING, 0},
@@ -1627,7 +1780,10 @@ static struct janus_json_parameter create_parameters[] = {
 	{"notify_joining", JANUS_JSON_BOOL, 0},
 	{"require_e2ee", JANUS_JSON_BOOL, 0},
 	{"dummy_publisher", JANUS_JSON_BOOL, 0},
-	{"dummy_streams", JANUS_JSON_ARRAY, 0}
+	{"dummy_streams", JANUS_JSON_ARRAY, 0},
+	{"threads", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"threads_threshold", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"gop_cache_size", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter edit_parameters[] = {
 	{"secret", JSON_STRING, 0},
@@ -1787,11 +1943,17 @@ static struct janus_json_parameter rtp_forward_stream_parameters[] = {
 	{"pt_2", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"port_3", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"ssrc_3", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
-	{"pt_3", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"pt_3", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"mirrors", JANUS_JSON_ARRAY, 0}
+};
+static struct janus_json_parameter rtp_forward_mirror_parameters[] = {
+	{"host", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
+	{"port", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter stop_rtp_forward_parameters[] = {
 	{"secret", JSON_STRING, 0},
-	{"stream_id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE}
+	{"stream_id", JSON_INTEGER, JANUS_JSON_PARAM_REQUIRED | JANUS_JSON_PARAM_POSITIVE},
+	{"mirrors", JANUS_JSON_ARRAY, 0}
 };
 static struct janus_json_parameter publisher_parameters[] = {
 	{"display", JSON_STRING, 0}
@@ -1815,6 +1977,7 @@ static struct janus_json_parameter configure_stream_parameters[] = {
 };
 static struct janus_json_parameter configure_parameters[] = {
 	{"streams", JANUS_JSON_ARRAY, 0},
+	{"low_latency", JANUS_JSON_BOOL, 0},
 	/* The following is to handle a renegotiation */
 	{"update", JANUS_JSON_BOOL, 0},
 	/* The following is to force a restart */
@@ -1828,6 +1991,7 @@ static struct janus_json_parameter subscriber_parameters[] = {
 	{"streams", JANUS_JSON_ARRAY, 0},
 	{"private_id", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"autoupdate", JANUS_JSON_BOOL, 0},
+	{"low_latency", JANUS_JSON_BOOL, 0},
 	/* All the following parameters are deprecated: use streams instead */
 	{"audio", JANUS_JSON_BOOL, 0},
 	{"video", JANUS_JSON_BOOL, 0},
@@ -1889,7 +2053,8 @@ static struct janus_json_parameter publish_remotely_parameters[] = {
 	{"host", JSON_STRING, JANUS_JSON_PARAM_REQUIRED},
 	{"host_family", JSON_STRING, 0},
 	{"port", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE | JANUS_JSON_PARAM_REQUIRED},
-	{"rtcp_port", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+	{"rtcp_port", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"ssrc_base", JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
 };
 static struct janus_json_parameter unpublish_remotely_parameters[] = {
 	{"secret", JSON_STRING, 0},
@@ -1901,8 +2066,20 @@ static struct janus_json_parameter remote_publisher_parameters[] = {
 	{"mcast", JANUS_JSON_STRING, 0},
 	{"iface", JANUS_JSON_STRING, 0},
 	{"port", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"trunk", JANUS_JSON_STRING, 0},
+	{"ssrc_base", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
 	{"streams", JANUS_JSON_ARRAY, JANUS_JSON_PARAM_REQUIRED},
 };
+static struct janus_json_parameter remote_trunk_parameters[] = {
+	{"trunk_id", JANUS_JSON_STRING, 0},
+	{"mcast", JANUS_JSON_STRING, 0},
+	{"iface", JANUS_JSON_STRING, 0},
+	{"port", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE},
+	{"rtcp_port", JANUS_JSON_INTEGER, JANUS_JSON_PARAM_POSITIVE}
+};
+static struct janus_json_parameter remote_trunk_id_parameters[] = {
+	{"trunk_id", JANUS_JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
+};
 static struct janus_json_parameter remote_publisher_update_parameters[] = {
 	{"secret", JSON_STRING, 0},
 	{"display", JANUS_JSON_STRING, 0},
@@ -1930,15 +2107,23 @@ static struct janus_json_parameter remote_publisher_stream_parameters[] = {
 /* Static configuration instance */
 static janus_config *config = NULL;
 static const char *config_folder = NULL;
+static janus_config_folder *rooms_folder = NULL;
 static janus_mutex config_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Snapshots of the rooms list (public rooms only, and all rooms), so that
+ * frequent "list" requests don't need to iterate on all rooms every time */
+#define JANUS_VIDEOROOM_DEFAULT_LIST_REFRESH	1000
+static guint list_refresh = JANUS_VIDEOROOM_DEFAULT_LIST_REFRESH;
+static json_t *rooms_list_public = NULL, *rooms_list_all = NULL;
+static gint64 rooms_list_updated = 0;
+static janus_mutex rooms_list_mutex = JANUS_MUTEX_INITIALIZER;
+
 /* Useful stuff */
 static volatile gint initialized = 0, stopping = 0;
 static gboolean notify_events = TRUE;
 static gboolean string_ids = FALSE;
 static gboolean ipv6_disabled = FALSE;
 static janus_callbacks *gateway = NULL;
-static GThread *handler_thread;
 static void *janus_videoroom_handler(void *data);
 static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data);
 static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data);
@@ -1996,9 +2181,33 @@ typedef struct janus_videoroom_message {
 	json_t *message;
 	json_t *jsep;
 } janus_videoroom_message;
-static GAsyncQueue *messages = NULL;
 static janus_videoroom_message exit_message;
 
+/* Asynchronous requests are processed by one or more handler threads, each
+ * with its own queue: messages are routed by room (or by session, when no
+ * room is specified), so that requests addressed to the same room are still
+ * processed in order, while different rooms can proceed in parallel */
+#define JANUS_VIDEOROOM_DEFAULT_HANDLER_THREADS	1
+#define JANUS_VIDEOROOM_MAX_HANDLER_THREADS		32
+typedef struct janus_videoroom_handler_thread {
+	guint id;					/* Handler thread ID */
+	GThread *thread;			/* Handler thread */
+	GAsyncQueue *messages;		/* Queue of messages to process */
+	volatile gint processed;	/* How many messages this thread processed so far */
+} janus_videoroom_handler_thread;
+static janus_videoroom_handler_thread *handlers = NULL;
+static guint handler_threads = JANUS_VIDEOROOM_DEFAULT_HANDLER_THREADS;
+static volatile gint handler_next = 0;
+
+/* Timing of asynchronous requests, per request type (see "query_handler") */
+typedef struct janus_videoroom_request_stats {
+	guint64 count;			/* How many requests of this type were processed */
+	gint64 total_time;		/* Time spent processing them, in microseconds */
+	gint64 max_time;		/* Longest time spent on a single request, in microseconds */
+} janus_videoroom_request_stats;
+static GHashTable *request_stats = NULL;
+static janus_mutex request_stats_mutex = JANUS_MUTEX_INITIALIZER;
+
 
 typedef struct janus_videoroom {
 	guint64 room_id;			/* Unique room ID (when using integers) */
@@ -2015,6 +2224,7 @@ typedef struct janus_videoroom {
 	uint32_t bitrate;			/* Global bitrate limit */
 	gboolean bitrate_cap;		/* Whether the above limit is insormountable */
 	uint16_t fir_freq;			/* Regular FIR frequency (0=disabled) */
+	uint16_t data_batch;		/* How long (ms) DataChannel messages for subscribers are held to be sent together (0=disabled) */
 	janus_audiocodec acodec[5];	/* Audio codec(s) to force on publishers */
 	janus_videocodec vcodec[5];	/* Video codec(s) to force on publishers */
 	char *vp9_profile;			/* VP9 codec profile to prefer, if more are negotiated */
@@ -2037,11 +2247,39 @@ typedef struct janus_videoroom {
 	gboolean check_allowed;		/* Whether to check tokens when participants join (see below) */
 	GHashTable *allowed;		/* Map of participants (as tokens) allowed to join */
 	gboolean notify_joining;	/* Whether an event is sent to notify all participants if a new participant joins the room */
+	int helper_threads;			/* Number of helper threads to relay media to subscribers, if any */
+	guint helper_threshold;		/* Minimum number of subscribers to a stream before helper threads are used */
+	GList *threads;				/* Helper threads, if any */
+	size_t gop_cache_size;		/* Maximum size of the GOP cached for each video stream, in bytes (0=disabled) */
+	GHashTable *offer_templates;	/* Subscriber offers we generated, indexed by what they were generated from */
+	janus_mutex offer_templates_mutex;	/* Mutex to lock the offer templates */
 	janus_mutex mutex;			/* Mutex to lock this room instance */
 	janus_refcount ref;			/* Reference counter for this room */
 } janus_videoroom;
 static GHashTable *rooms;
 static janus_mutex rooms_mutex = JANUS_MUTEX_INITIALIZER;
+
+/* Subscribers of the same publishers get the same offer, except for the
+ * o= session ID and version: we cache the rest of the SDP as a template */
+typedef struct janus_videoroom_offer_template {
+	char *head;		/* SDP up to the o= session ID */
+	char *tail;		/* SDP after the o= session version */
+} janus_videoroom_offer_template;
+#define JANUS_VIDEOROOM_MAX_OFFER_TEMPLATES	64
+static void janus_videoroom_offer_template_free(janus_videoroom_offer_template *template) {
+	if(template == NULL)
+		return;
+	g_free(template->head);
+	g_free(template->tail);
+	g_free(template);
+}
+static void janus_videoroom_offer_templates_clear(janus_videoroom *room) {
+	if(room == NULL || room->offer_templates == NULL)
+		return;
+	janus_mutex_lock(&room->offer_templates_mutex);
+	g_hash_table_remove_all(room->offer_templates);
+	janus_mutex_unlock(&room->offer_templates_mutex);
+}
 static char *admin_key = NULL;
 static gboolean lock_rtpfwd = FALSE;
 
@@ -2055,6 +2293,8 @@ typedef struct janus_videoroom_session {
 	volatile gint dataready;
 	volatile gint hangingup;
 	volatile gint destroyed;
+	guint handler_index;		/* Handler thread this session's messages are routed to */
+	volatile gint pending_messages;	/* How many messages are still queued or being processed */
 	janus_mutex mutex;
 	janus_refcount ref;
 } janus_videoroom_session;
@@ -2096,6 +2336,8 @@ typedef struct janus_videoroom_publisher {
 	/* In case this is a remote publisher */
 	gboolean remote;			/* Whether this is a remote publisher */
 	int remote_fd, remote_rtcp_fd, pipefd[2];	/* Remote publisher sockets */
+	uint32_t remote_ssrc_base;	/* SSRC the remote streams are numbered from */
+	struct janus_videoroom_remote_trunk *trunk;	/* Trunk this remote publisher is received on, if any */
 	struct sockaddr_storage rtcp_addr;	/* RTCP address of the remote publisher */
 	GThread *remote_thread;		/* Remote publisher incoming packets thread */
 	volatile gint remote_leaving;
@@ -2109,6 +2351,7 @@ typedef struct janus_videoroom_publisher {
 	janus_refcount ref;
 } janus_videoroom_publisher;
 /* Each VideoRoom publisher can share multiple streams, so each stream is its own structure */
+typedef struct janus_videoroom_subscribers_snapshot janus_videoroom_subscribers_snapshot;
 typedef struct janus_videoroom_publisher_stream {
 	janus_videoroom_publisher *publisher;	/* Publisher instance this stream belongs to */
 	janus_videoroom_media type;				/* Type of this stream (audio, video or data) */
@@ -2130,6 +2373,7 @@ typedef struct janus_videoroom_publisher_stream {
 	gboolean opusdtx;						/* Whether this publisher is using Opus DTX (Discontinuous Transmission) */
 	gboolean opusstereo;					/* Whether this publisher is doing stereo Opus */
 	gboolean simulcast, svc;				/* Whether this stream uses simulcast or SVC */
+	janus_av1_svc_context dd_context;		/* AV1 SVC templates, so that subscribers don't parse the Dependency Descriptor */
 	uint32_t vssrc[3];						/* Only needed in case simulcasting is involved */
 	char *rid[3];							/* Only needed if simulcasting is rid-based */
 	int rid_extmap_id;						/* rid extmap ID */
@@ -2160,6 +2404,12 @@ typedef struct janus_videoroom_publisher_stream {
 	/* Subscriptions to this publisher stream (who's receiving it)  */
 	GSList *subscribers;
 	janus_mutex subscribers_mutex;
+	/* Immutable copy of the list above, that media is relayed from without locking the mutex */
+	janus_videoroom_subscribers_snapshot *volatile snapshot;
+	gboolean helpers_active;	/* Whether helper threads are currently relaying this stream to subscribers */
+	volatile gint helpers_pending;	/* Packets of this stream the helper threads still have to relay */
+	/* Latest GOP, to send to new subscribers right away (video only, if enabled in the room) */
+	janus_rtp_gop_cache *gop;
 	volatile gint destroyed;
 	janus_refcount ref;
 } janus_videoroom_publisher_stream;
@@ -2171,6 +2421,7 @@ static janus_rtp_forwarder *janus_videoroom_rtp_forwarder_add_helper(janus_video
 	int substream, gboolean is_video, gboolean is_data);
 static void janus_videoroom_rtp_forwarder_rtcp_receive(janus_rtp_forwarder *rf, char *buffer, int len);
 static json_t *janus_videoroom_rtp_forwarder_summary(janus_rtp_forwarder *f);
+static void janus_videoroom_rtp_forwarder_add_mirrors(janus_rtp_forwarder *f, json_t *mirrors);
 static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, GHashTable *streams);
 
 /* We support remote publishers as well, for which we use plain RTP,
@@ -2183,6 +2434,9 @@ static uint16_t rtp_range_slider = DEFAULT_RTP_RANGE_MIN;
 static janus_mutex fd_mutex = JANUS_MUTEX_INITIALIZER;
 #define REMOTE_PUBLISHER_BASE_SSRC	1000
 #define REMOTE_PUBLISHER_SSRC_STEP	10
+/* Remote publishers sharing a trunk are told apart by their SSRC base,
+ * which must be a multiple of this value (so up to 100 streams each) */
+#define REMOTE_PUBLISHER_SSRC_BLOCK	1000
 /* Helpers to create a listener filedescriptor */
 static int janus_videoroom_create_fd(int port, in_addr_t mcast, const janus_network_address *iface, char *host, size_t hostlen);
 /* Helper to return fd port */
@@ -2190,6 +2444,94 @@ static int janus_videoroom_get_fd_port(int fd);
 /* Thread responsible for a specific remote publisher */
 static void *janus_videoroom_remote_publisher_thread(void *data);
 
+/* Remote publishers relayed by the same Janus instance can share a single
+ * trunk (one RTP/RTCP socket pair and one thread), rather than getting
+ * sockets and a thread each: the traffic is demultiplexed by SSRC */
+typedef struct janus_videoroom_remote_trunk {
+	char *trunk_id;				/* Unique ID of the trunk */
+	int fd, rtcp_fd, pipefd[2];	/* Trunk sockets */
+	uint16_t port, rtcp_port;	/* Ports the trunk is bound to */
+	char host[46];				/* Address the trunk is bound to, if any */
+	GHashTable *publishers;		/* Remote publishers in the trunk, indexed by SSRC base (only changed by the trunk thread) */
+	GList *joining;				/* Remote publishers that were just added, and the trunk thread hasn't picked up yet */
+	GThread *thread;			/* Trunk incoming packets thread */
+	volatile gint destroyed;
+	janus_mutex mutex;
+	janus_refcount ref;
+} janus_videoroom_remote_trunk;
+static GHashTable *remote_trunks = NULL;
+static janus_mutex remote_trunks_mutex = JANUS_MUTEX_INITIALIZER;
+static void *janus_videoroom_remote_trunk_thread(void *data);
+static void janus_videoroom_remote_trunk_free(const janus_refcount *t_ref) {
+	janus_videoroom_remote_trunk *t = janus_refcount_containerof(t_ref, janus_videoroom_remote_trunk, ref);
+	g_free(t->trunk_id);
+	if(t->fd > 0)
+		close(t->fd);
+	if(t->rtcp_fd > 0)
+		close(t->rtcp_fd);
+	if(t->pipefd[0] > 0)
+		close(t->pipefd[0]);
+	if(t->pipefd[1] > 0)
+		close(t->pipefd[1]);
+	g_hash_table_destroy(t->publishers);
+	g_list_free(t->joining);
+	janus_mutex_destroy(&t->mutex);
+	g_free(t);
+}
+/* Helper to wake the trunk thread up */
+static void janus_videoroom_remote_trunk_notify(janus_videoroom_remote_trunk *t) {
+	if(t->pipefd[1] > 0) {
+		int code = 1;
+		ssize_t res = 0;
+		do {
+			res = write(t->pipefd[1], &code, sizeof(int));
+		} while(res == -1 && errno == EINTR);
+	}
+}
+static void janus_videoroom_remote_trunk_destroy(janus_videoroom_remote_trunk *t) {
+	if(t && g_atomic_int_compare_and_exchange(&t->destroyed, 0, 1)) {
+		/* The trunk thread will get rid of the remote publishers */
+		janus_videoroom_remote_trunk_notify(t);
+		janus_refcount_decrease(&t->ref);
+	}
+}
+/* Helper to pick the SSRC base of a new remote publisher in a trunk (0 if the one
+ * that was requested is already taken): must be called with the trunk mutex locked */
+static uint32_t janus_videoroom_remote_trunk_ssrc_base(janus_videoroom_remote_trunk *t, uint32_t ssrc_base) {
+	uint32_t base = ssrc_base ? ssrc_base : REMOTE_PUBLISHER_SSRC_BLOCK;
+	while(base > 0 && base <= G_MAXUINT32 - REMOTE_PUBLISHER_SSRC_BLOCK) {
+		gboolean taken = (g_hash_table_lookup(t->publishers, GUINT_TO_POINTER(base)) != NULL);
+		GList *temp = t->joining;
+		while(temp && !taken) {
+			janus_videoroom_publisher *p = (janus_videoroom_publisher *)temp->data;
+			taken = (p->remote_ssrc_base == base);
+			temp = temp->next;
+		}
+		if(!taken)
+			return base;
+		if(ssrc_base > 0)
+			break;
+		base += REMOTE_PUBLISHER_SSRC_BLOCK;
+	}
+	return 0;
+}
+/* Helper to create the sockets a remote publisher (or trunk) receives media on */
+static int janus_videoroom_remote_fds_create(json_t *root, int *fd, int *rtcp_fd,
+	uint16_t *port, uint16_t *rtcp_port, char *host, size_t hostlen, char *error_cause, size_t error_len);
+
+/* Remote publishers and trunks read packets in batches, where supported (recvmmsg) */
+#define JANUS_VIDEOROOM_RECV_BATCH	16
+typedef struct janus_videoroom_recv_batch {
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr messages[JANUS_VIDEOROOM_RECV_BATCH];
+	struct iovec iovecs[JANUS_VIDEOROOM_RECV_BATCH];
+#endif
+	int length[JANUS_VIDEOROOM_RECV_BATCH];
+	char data[JANUS_VIDEOROOM_RECV_BATCH][1500];
+} janus_videoroom_recv_batch;
+static int janus_videoroom_recv_batch_read(janus_videoroom_recv_batch *batch, int fd);
+
+typedef struct janus_videoroom_helper janus_videoroom_helper;
 typedef struct janus_videoroom_subscriber {
 	janus_videoroom_session *session;
 	janus_videoroom *room;	/* Room */
@@ -2199,12 +2541,19 @@ typedef struct janus_videoroom_subscriber {
 	GHashTable *streams_byid;	/* As above, indexed by mindex */
 	GHashTable *streams_bymid;	/* As above, indexed by mid */
 	janus_mutex streams_mutex;
+	GHashTable *offer_mlines;	/* m-lines of the offers we sent, indexed by mid, to only regenerate what changed */
 	gboolean use_msid;		/* Whether we should add custom msid attributes to offers, to match publishers and streams */
 	gboolean autoupdate;	/* Whether we should trigger a renegotiation automatically when a subscribed publisher goes away */
+	gboolean low_latency;	/* Whether this is an interactive subscriber, that needs media with as little delay as possible */
 	guint32 pvt_id;			/* Private ID of the participant that is subscribing (if available/provided) */
 	gboolean paused;
 	gboolean kicked;	/* Whether this subscription belongs to a participant that has been kicked */
 	gboolean e2ee;		/* If media for this subscriber is end-to-end encrypted */
+	janus_videoroom_helper *helper;	/* Helper thread relaying media to this subscriber, if the room uses them */
+	GPtrArray *data_batch;			/* DataChannel messages waiting to be sent, if the room batches them */
+	gint64 data_batch_deadline;		/* When the messages above must be sent */
+	janus_mutex data_batch_mutex;
+	volatile gint estimated_bandwidth;	/* Latest bandwidth the core estimated towards this subscriber, if any */
 	volatile gint answered, pending_offer, pending_restart, skipped_autoupdate;
 	volatile gint destroyed;
 	janus_refcount ref;
@@ -2235,10 +2584,48 @@ typedef struct janus_videoroom_subscriber_stream {
 	janus_rtp_svc_context svc_context;
 	/* Playout delays to enforce when relaying this stream, if the extension has been negotiated */
 	int16_t min_delay, max_delay;
+	/* GOP cache replay, in case the publisher stream has a cache */
+	volatile gint gop_pending;	/* Whether the cached GOP must be sent before the next packet */
+	gboolean gop_replayed;		/* Whether live packets the replayed GOP covered must be skipped */
+	uint16_t gop_last_seq;		/* Sequence number of the last packet in the replayed GOP */
 	volatile gint ready, destroyed;
 	janus_refcount ref;
 } janus_videoroom_subscriber_stream;
 
+/* VP8 simulcast subscribers rewrite the payload descriptor, so they can't share the
+ * publisher packet: those that end up with the same descriptor (e.g., same layer and
+ * same switching history) form a group instead, sharing a copy of the rewritten packet */
+#define JANUS_VIDEOROOM_LAYER_GROUPS	4
+typedef struct janus_videoroom_layer_group {
+	char vp8pd[6];
+	janus_plugin_rtp_shared *shared;
+} janus_videoroom_layer_group;
+/* In rooms that batch DataChannel messages, each message is copied once, and
+ * then shared by all the subscribers that have it waiting to be sent */
+typedef struct janus_videoroom_data_message {
+	char *label;
+	gboolean binary;
+	char *buffer;
+	int length;
+	gint64 window;		/* How long subscribers can hold it, before sending it */
+	janus_refcount ref;
+} janus_videoroom_data_message;
+static void janus_videoroom_data_message_free(const janus_refcount *m_ref) {
+	janus_videoroom_data_message *message = janus_refcount_containerof(m_ref, janus_videoroom_data_message, ref);
+	g_free(message->label);
+	g_free(message->buffer);
+	g_free(message);
+}
+static void janus_videoroom_data_message_unref(janus_videoroom_data_message *message) {
+	if(message)
+		janus_refcount_decrease(&message->ref);
+}
+/* Subscribers with batched DataChannel messages are served by a dedicated thread */
+static GList *data_batches = NULL;
+static janus_mutex data_batches_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition data_batches_cond;
+static GThread *data_batches_thread = NULL;
+static void *janus_videoroom_data_batches_thread(void *data);
 typedef struct janus_videoroom_rtp_relay_packet {
 	janus_videoroom_publisher_stream *source;
 	janus_rtp_header *data;
@@ -2250,14 +2637,154 @@ typedef struct janus_videoroom_rtp_relay_packet {
 	uint16_t seq_number;
 	/* Extensions to add, if any */
 	janus_plugin_rtp_extensions extensions;
-	/* Whether simulcast is involved */
+	/* Whether simulcast is involved, and if so what subscribers need to know about the packet */
 	gboolean simulcast;
+	janus_rtp_simulcasting_packet sim_packet;
 	/* The following are only relevant if we're doing SVC*/
 	gboolean svc;
 	janus_vp9_svc_info svc_info;
+	janus_av1_svc_info av1_info;
 	/* The following is only relevant for datachannels */
 	gboolean textdata;
+	janus_videoroom_data_message *message;	/* Shared copy, if the room batches messages */
+	janus_plugin_data *outgoing;	/* Message to send, and subscribers to send it to, if not batching */
+	GArray *targets;
+	/* Shared copy of the packet, if many subscribers will get it */
+	janus_plugin_rtp_shared *shared;
+	/* Shared copies of the rewritten packet, for groups of VP8 simulcast subscribers */
+	janus_videoroom_layer_group groups[JANUS_VIDEOROOM_LAYER_GROUPS];
+	guint groups_count;
+	/* Batch to collect the packets for all subscribers in, if many will get it */
+	janus_plugin_rtp_batch *batch;
 } janus_videoroom_rtp_relay_packet;
+/* Find the group a VP8 subscriber belongs to, given how it rewrote the payload descriptor */
+static janus_plugin_rtp_shared *janus_videoroom_layer_group_get(janus_videoroom_rtp_relay_packet *packet, char *payload) {
+	guint i = 0;
+	for(i=0; i<packet->groups_count; i++) {
+		if(!memcmp(packet->groups[i].vp8pd, payload, sizeof(packet->groups[i].vp8pd)))
+			return packet->groups[i].shared;
+	}
+	/* New group: only worth it if there are other subscribers, which is when there's a shared copy */
+	if(packet->shared == NULL || packet->groups_count == JANUS_VIDEOROOM_LAYER_GROUPS)
+		return NULL;
+	janus_videoroom_layer_group *group = &packet->groups[packet->groups_count];
+	packet->groups_count++;
+	memcpy(group->vp8pd, payload, sizeof(group->vp8pd));
+	group->shared = janus_plugin_rtp_shared_new((char *)packet->data, packet->length);
+	return group->shared;
+}
+static void janus_videoroom_layer_groups_clear(janus_videoroom_rtp_relay_packet *packet) {
+	guint i = 0;
+	for(i=0; i<packet->groups_count; i++)
+		janus_refcount_decrease(&packet->groups[i].shared->ref);
+	packet->groups_count = 0;
+}
+
+/* Rooms can optionally spawn helper threads, to relay media to subscribers
+ * of popular streams in parallel: each subscriber is assigned to one of the
+ * helpers when it's created, and always served by that helper only, which
+ * means packets for a specific subscriber stream are never reordered */
+#define JANUS_VIDEOROOM_MAX_HELPER_THREADS	32
+struct janus_videoroom_helper {
+	janus_videoroom *room;
+	guint id;
+	GThread *thread;
+	volatile gint num_subscribers;
+	GAsyncQueue *queued_packets;
+	volatile gint destroyed;
+	janus_refcount ref;
+};
+/* Packet queued to a helper: a private copy of the packet (the RTP header
+ * is updated for each subscriber), and the streams the helper must serve */
+typedef struct janus_videoroom_helper_packet {
+	janus_videoroom_rtp_relay_packet packet;
+	GPtrArray *streams;
+} janus_videoroom_helper_packet;
+static janus_videoroom_helper_packet helper_exit_packet;
+static void janus_videoroom_helper_packet_free(janus_videoroom_helper_packet *pkt);
+static void janus_videoroom_helper_destroy(janus_videoroom_helper *helper) {
+	if(helper && g_atomic_int_compare_and_exchange(&helper->destroyed, 0, 1))
+		janus_refcount_decrease(&helper->ref);
+}
+static void janus_videoroom_helper_free(const janus_refcount *helper_ref) {
+	janus_videoroom_helper *helper = janus_refcount_containerof(helper_ref, janus_videoroom_helper, ref);
+	/* This helper can be destroyed, free all the resources */
+	g_async_queue_unref(helper->queued_packets);
+	g_free(helper);
+}
+static void *janus_videoroom_helper_thread(void *data);
+static gboolean janus_videoroom_helpers_start(janus_videoroom *room);
+static void janus_videoroom_helpers_relay_rtp_packet(janus_videoroom *room,
+	janus_videoroom_subscribers_snapshot *snapshot, janus_videoroom_rtp_relay_packet *packet);
+
+/* Relaying media doesn't lock the subscribers mutex of publisher streams:
+ * every time the list of subscribers changes, an immutable snapshot of the
+ * list is created and swapped with the current one, which is released right
+ * away. To relay a packet, the media thread takes the snapshot out of the
+ * stream, and puts it back when done: if a newer snapshot was swapped in in
+ * the meanwhile, it's the media thread that releases the one it was using.
+ * This way superseded snapshots never outlive the next update, even when a
+ * stream is quiet. Snapshots hold a reference to the streams and subscribers
+ * in them, so they can't go away while in use */
+struct janus_videoroom_subscribers_snapshot {
+	guint len;
+	janus_videoroom_subscriber_stream **streams;
+	janus_refcount ref;
+};
+static void janus_videoroom_subscribers_snapshot_free(const janus_refcount *snapshot_ref) {
+	janus_videoroom_subscribers_snapshot *snapshot = janus_refcount_containerof(snapshot_ref, janus_videoroom_subscribers_snapshot, ref);
+	/* This snapshot can be destroyed, release the streams */
+	guint i = 0;
+	for(i=0; i<snapshot->len; i++) {
+		janus_videoroom_subscriber_stream *ss = snapshot->streams[i];
+		janus_refcount_decrease(&ss->subscriber->ref);
+		janus_refcount_decrease(&ss->ref);
+	}
+	g_free(snapshot->streams);
+	g_free(snapshot);
+}
+/* Must be called with the subscribers mutex of the publisher stream locked */
+static void janus_videoroom_publisher_stream_update_snapshot(janus_videoroom_publisher_stream *ps) {
+	janus_videoroom_subscribers_snapshot *snapshot = g_malloc(sizeof(janus_videoroom_subscribers_snapshot));
+	snapshot->len = 0;
+	snapshot->streams = g_malloc(g_slist_length(ps->subscribers) * sizeof(janus_videoroom_subscriber_stream *));
+	GSList *temp = ps->subscribers;
+	while(temp) {
+		janus_videoroom_subscriber_stream *ss = (janus_videoroom_subscriber_stream *)temp->data;
+		temp = temp->next;
+		if(ss == NULL || ss->subscriber == NULL)
+			continue;
+		janus_refcount_increase(&ss->ref);
+		janus_refcount_increase(&ss->subscriber->ref);
+		snapshot->streams[snapshot->len++] = ss;
+	}
+	janus_refcount_init(&snapshot->ref, janus_videoroom_subscribers_snapshot_free);
+	/* Replace the current snapshot: if the media thread is using it right now
+	 * we'll find none, and it will be up to the media thread to release it */
+	janus_videoroom_subscribers_snapshot *old = NULL;
+	do {
+		old = g_atomic_pointer_get(&ps->snapshot);
+	} while(!g_atomic_pointer_compare_and_exchange(&ps->snapshot, old, snapshot));
+	if(old != NULL)
+		janus_refcount_decrease(&old->ref);
+}
+/* Must only be called by the thread relaying media for the publisher stream,
+ * which must then give the snapshot back with janus_videoroom_publisher_stream_put_snapshot */
+static janus_videoroom_subscribers_snapshot *janus_videoroom_publisher_stream_get_snapshot(janus_videoroom_publisher_stream *ps) {
+	janus_videoroom_subscribers_snapshot *snapshot = NULL;
+	do {
+		snapshot = g_atomic_pointer_get(&ps->snapshot);
+	} while(snapshot != NULL && !g_atomic_pointer_compare_and_exchange(&ps->snapshot, snapshot, NULL));
+	return snapshot;
+}
+static void janus_videoroom_publisher_stream_put_snapshot(janus_videoroom_publisher_stream *ps,
+		janus_videoroom_subscribers_snapshot *snapshot) {
+	if(snapshot == NULL)
+		return;
+	/* If the list changed while we were using the snapshot, this one is stale */
+	if(!g_atomic_pointer_compare_and_exchange(&ps->snapshot, NULL, snapshot))
+		janus_refcount_decrease(&snapshot->ref);
+}
 
 /* VideoRoom publishers can be forwarder remotely: we use the following
  * struct to track specific recipients of a local publisher */
@@ -2267,6 +2794,7 @@ typedef struct janus_videoroom_remote_recipient {
 	uint16_t port;			/* Port this publisher is being relayed to */
 	uint16_t rtcp_port;		/* RTCP port this publisher is going to latch to */
 	gboolean rtcp_added;	/* Whether we created an RTCP socket for this remotization */
+	uint32_t ssrc_base;		/* SSRC the relayed streams are numbered from */
 } janus_videoroom_remote_recipient;
 static void janus_videoroom_remote_recipient_free(janus_videoroom_remote_recipient *r) {
 	if(r) {
@@ -2318,6 +2846,14 @@ static void janus_videoroom_subscriber_free(const janus_refcount *s_ref) {
 	g_list_free_full(s->streams, (GDestroyNotify)(janus_videoroom_subscriber_stream_destroy));
 	g_hash_table_unref(s->streams_byid);
 	g_hash_table_unref(s->streams_bymid);
+	if(s->offer_mlines != NULL)
+		g_hash_table_destroy(s->offer_mlines);
+	if(s->helper != NULL) {
+		g_atomic_int_dec_and_test(&s->helper->num_subscribers);
+		janus_refcount_decrease(&s->helper->ref);
+	}
+	if(s->data_batch != NULL)
+		g_ptr_array_unref(s->data_batch);
 
 	g_free(s);
 }
@@ -2355,9 +2891,13 @@ static void janus_videoroom_publisher_stream_free(const janus_refcount *ps_ref)
 	ps->rtp_forwarders = NULL;
 	janus_mutex_destroy(&ps->rtp_forwarders_mutex);
 	g_slist_free(ps->subscribers);
+	if(ps->snapshot != NULL)
+		janus_refcount_decrease(&ps->snapshot->ref);
 	janus_mutex_destroy(&ps->subscribers_mutex);
 	janus_mutex_destroy(&ps->rid_mutex);
 	janus_rtp_simulcasting_cleanup(NULL, NULL, ps->rid, NULL);
+	janus_rtp_gop_cache_destroy(ps->gop);
+	janus_av1_svc_context_reset(&ps->dd_context);
 	g_free(ps);
 }
 
@@ -2436,6 +2976,8 @@ static void janus_videoroom_publisher_free(const janus_refcount *p_ref) {
 		close(p->pipefd[0]);
 	if(p->pipefd[1] > 0)
 		close(p->pipefd[1]);
+	if(p->trunk != NULL)
+		janus_refcount_decrease(&p->trunk->ref);
 
 	janus_mutex_destroy(&p->subscribers_mutex);
 	janus_mutex_destroy(&p->rtp_forwarders_mutex);
@@ -2466,8 +3008,17 @@ static void janus_videoroom_room_dereference(janus_videoroom *room) {
 }
 
 static void janus_videoroom_room_destroy(janus_videoroom *room) {
-	if(room && g_atomic_int_compare_and_exchange(&room->destroyed, 0, 1))
+	if(room && g_atomic_int_compare_and_exchange(&room->destroyed, 0, 1)) {
+		/* Get rid of the helper threads, if any */
+		GList *l = room->threads;
+		while(l) {
+			janus_videoroom_helper *ht = (janus_videoroom_helper *)l->data;
+			g_async_queue_push(ht->queued_packets, &helper_exit_packet);
+			janus_videoroom_helper_destroy(ht);
+			l = l->next;
+		}
 		janus_refcount_decrease(&room->ref);
+	}
 }
 
 static void janus_videoroom_room_free(const janus_refcount *room_ref) {
@@ -2483,6 +3034,17 @@ static void janus_videoroom_room_free(const janus_refcount *room_ref) {
 	g_hash_table_destroy(room->participants);
 	g_hash_table_destroy(room->private_ids);
 	g_hash_table_destroy(room->allowed);
+	g_hash_table_destroy(room->offer_templates);
+	if(room->threads != NULL) {
+		/* Remove the last reference to the helper threads, if any */
+		GList *l = room->threads;
+		while(l) {
+			janus_videoroom_helper *ht = (janus_videoroom_helper *)l->data;
+			janus_refcount_decrease(&ht->ref);
+			l = l->next;
+		}
+		g_list_free(room->threads);
+	}
 	g_free(room);
 }
 
@@ -2556,7 +3118,8 @@ static void janus_videoroom_rtcp_pli_send(janus_videoroom_publisher_stream *ps)
 	if(ps == NULL || ps->publisher == NULL)
 		return;
 	janus_videoroom_publisher *publisher = ps->publisher;
-	if(publisher->remote_rtcp_fd < 0 || publisher->rtcp_addr.ss_family == 0)
+	int rtcp_fd = publisher->trunk ? publisher->trunk->rtcp_fd : publisher->remote_rtcp_fd;
+	if(rtcp_fd < 0 || publisher->rtcp_addr.ss_family == 0)
 		return;
 	if(!g_atomic_int_compare_and_exchange(&ps->sending_pli, 0, 1))
 		return;
@@ -2575,12 +3138,12 @@ static void janus_videoroom_rtcp_pli_send(janus_videoroom_publisher_stream *ps)
 	char rtcp_buf[12];
 	int rtcp_len = 12;
 	janus_rtcp_pli((char *)&rtcp_buf, rtcp_len);
-	uint32_t ssrc = REMOTE_PUBLISHER_BASE_SSRC + (ps->mindex*REMOTE_PUBLISHER_SSRC_STEP);
+	uint32_t ssrc = publisher->remote_ssrc_base + (ps->mindex*REMOTE_PUBLISHER_SSRC_STEP);
 	janus_rtcp_fix_ssrc(NULL, rtcp_buf, rtcp_len, 1, 1, ssrc);
 	/* Send the packet */
 	socklen_t addrlen = publisher->rtcp_addr.ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
 	int sent = 0;
-	if((sent = sendto(publisher->remote_rtcp_fd, rtcp_buf, rtcp_len, 0,
+	if((sent = sendto(rtcp_fd, rtcp_buf, rtcp_len, 0,
 			(struct sockaddr *)&publisher->rtcp_addr, addrlen)) < 0) {
 		JANUS_LOG(LOG_ERR, "Error in sendto... %d (%s)\n", errno, g_strerror(errno));
 	} else {
@@ -2707,9 +3270,42 @@ static json_t *janus_videoroom_rtp_forwarder_summary(janus_rtp_forwarder *f) {
 	}
 	if(f->is_srtp)
 		json_object_set_new(json, "srtp", json_true());
+	if(f->queue != NULL)
+		json_object_set_new(json, "dropped", json_integer(g_atomic_int_get(&f->dropped)));
+	if(g_atomic_int_get(&f->mirrors_num) > 0) {
+		json_t *mirrors = json_array();
+		janus_mutex_lock(&f->mirrors_mutex);
+		GList *temp = f->mirrors;
+		while(temp) {
+			janus_rtp_forwarder_mirror *mirror = (janus_rtp_forwarder_mirror *)temp->data;
+			json_t *m = json_object();
+			json_object_set_new(m, "host", json_string(mirror->host));
+			json_object_set_new(m, "port", json_integer(mirror->port));
+			json_array_append_new(mirrors, m);
+			temp = temp->next;
+		}
+		janus_mutex_unlock(&f->mirrors_mutex);
+		json_object_set_new(json, "mirrors", mirrors);
+	}
 	return json;
 }
 
+/* Helper to add the requested mirrors (already validated) to a forwarder */
+static void janus_videoroom_rtp_forwarder_add_mirrors(janus_rtp_forwarder *f, json_t *mirrors) {
+	if(f == NULL || mirrors == NULL)
+		return;
+	size_t i = 0;
+	for(i=0; i<json_array_size(mirrors); i++) {
+		json_t *m = json_array_get(mirrors, i);
+		const char *m_host = json_string_value(json_object_get(m, "host"));
+		int m_port = json_integer_value(json_object_get(m, "port"));
+		if(janus_rtp_forwarder_add_mirror(f, m_host, m_port) < 0) {
+			JANUS_LOG(LOG_WARN, "Couldn't add mirror %s:%d to RTP forwarder %"SCNu32"\n",
+				m_host, m_port, f->stream_id);
+		}
+	}
+}
+
 /* Helper to create a dummy publisher, with placeholder streams for each supported codec */
 static void janus_videoroom_create_dummy_publisher(janus_videoroom *room, GHashTable *streams) {
 	if(room == NULL || !room->dummy_publisher)
@@ -2918,6 +3514,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add(
 	/* The two streams reference each other */
 	janus_refcount_increase(&stream->ref);
 	janus_refcount_increase(&ps->ref);
+	janus_videoroom_publisher_stream_update_snapshot(ps);
 	janus_mutex_unlock(&ps->subscribers_mutex);
 	return stream;
 }
@@ -2942,6 +3539,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add_
 				/* The two streams reference each other */
 				janus_refcount_increase(&stream->ref);
 				janus_refcount_increase(&ps->ref);
+				janus_videoroom_publisher_stream_update_snapshot(ps);
 			}
 			janus_mutex_unlock(&ps->subscribers_mutex);
 			return NULL;
@@ -2980,6 +3578,7 @@ static janus_videoroom_subscriber_stream *janus_videoroom_subscriber_stream_add_
 					/* The two streams reference each other */
 					janus_refcount_increase(&stream->ref);
 					janus_refcount_increase(&ps->ref);
+					janus_videoroom_publisher_stream_update_snapshot(ps);
 				}
 				janus_mutex_unlock(&ps->subscribers_mutex);
 				break;
@@ -3015,6 +3614,9 @@ static void janus_videoroom_subscriber_stream_remove(janus_videoroom_subscriber_
 			if(g_slist_find(ps->subscribers, s) != NULL) {
 				ps->subscribers = g_slist_remove(ps->subscribers, s);
 				unref_ss = TRUE;
+				/* When the caller owns the lock, it's up to them to update the snapshot */
+				if(lock_ps)
+					janus_videoroom_publisher_stream_update_snapshot(ps);
 			}
 			if(lock_ps)
 				janus_mutex_unlock(&ps->subscribers_mutex);
@@ -3122,80 +3724,744 @@ static json_t *janus_videoroom_subscriber_streams_summary(janus_videoroom_subscr
 	return media;
 }
 
+/* Everything a subscriber m-line in an offer depends on */
+typedef struct janus_videoroom_offer_mline {
+	janus_videoroom_media type;
+	const char *mid, *msid, *mstid, *codec, *h264_profile, *vp9_profile;
+	int pt;
+	char audio_fmtp[256];
+	janus_sdp_mdirection direction;
+	int audio_level_id, video_orient_id, playout_delay_id, transport_wide_cc_id, abs_send_time_id;
+} janus_videoroom_offer_mline;
+
+/* Text of an m-line we offered to a subscriber, and what it was generated from */
+typedef struct janus_videoroom_offer_mline_text {
+	char *key;
+	char *text;
+} janus_videoroom_offer_mline_text;
+static void janus_videoroom_offer_mline_text_free(janus_videoroom_offer_mline_text *mt) {
+	if(mt == NULL)
+		return;
+	g_free(mt->key);
+	g_free(mt->text);
+	g_free(mt);
+}
+static gboolean janus_videoroom_offer_mline_text_is_stale(gpointer key, gpointer value, gpointer user_data) {
+	janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)user_data;
+	return g_hash_table_lookup(subscriber->streams_bymid, key) == NULL;
+}
+
+static void janus_videoroom_offer_mline_prepare(janus_videoroom_subscriber *subscriber,
+		janus_videoroom_subscriber_stream *stream, janus_videoroom_offer_mline *ml) {
+	janus_videoroom_publisher_stream *ps = stream->publisher_streams ? stream->publisher_streams->data : NULL;
+	memset(ml, 0, sizeof(*ml));
+	ml->type = stream->type;
+	ml->mid = stream->mid;
+	ml->pt = -1;
+	if(ps && stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO) {
+		if(ps->opusfec)
+			g_snprintf(ml->audio_fmtp, sizeof(ml->audio_fmtp), "useinbandfec=1");
+		if(ps->opusdtx) {
+			if(strlen(ml->audio_fmtp) == 0) {
+				g_snprintf(ml->audio_fmtp, sizeof(ml->audio_fmtp), "usedtx=1");
+			} else {
+				janus_strlcat(ml->audio_fmtp, ";usedtx=1", sizeof(ml->audio_fmtp));
+			}
+		}
+		if(ps->opusstereo) {
+			if(strlen(ml->audio_fmtp) == 0) {
+				g_snprintf(ml->audio_fmtp, sizeof(ml->audio_fmtp), "stereo=1");
+			} else {
+				janus_strlcat(ml->audio_fmtp, ";stereo=1", sizeof(ml->audio_fmtp));
+			}
+		}
+	}
+	if(stream->type != JANUS_VIDEOROOM_MEDIA_DATA) {
+		ml->pt = stream->pt;
+		ml->codec = (stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO ?
+			janus_audiocodec_name(stream->acodec) : janus_videocodec_name(stream->vcodec));
+	}
+	if(subscriber->use_msid && ps && !ps->disabled) {
+		ml->msid = stream->msid;
+		ml->mstid = stream->mstid;
+	}
+	if(stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO) {
+		ml->h264_profile = stream->h264_profile;
+		ml->vp9_profile = stream->vp9_profile;
+	}
+	ml->direction = ((ps && !ps->disabled) || stream->type == JANUS_VIDEOROOM_MEDIA_DATA) ? JANUS_SDP_SENDONLY : JANUS_SDP_INACTIVE;
+	ml->audio_level_id = (stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO && (ps && ps->audio_level_extmap_id > 0)) ?
+		janus_rtp_extension_id(JANUS_RTP_EXTMAP_AUDIO_LEVEL) : 0;
+	ml->video_orient_id = (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && (ps && ps->video_orient_extmap_id > 0)) ?
+		janus_rtp_extension_id(JANUS_RTP_EXTMAP_VIDEO_ORIENTATION) : 0;
+	ml->playout_delay_id = (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && (ps && ps->playout_delay_extmap_id > 0)) ?
+		janus_rtp_extension_id(JANUS_RTP_EXTMAP_PLAYOUT_DELAY) : 0;
+	ml->transport_wide_cc_id = (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && subscriber->room->transport_wide_cc_ext) ?
+		janus_rtp_extension_id(JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC) : 0;
+	ml->abs_send_time_id = (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO) ?
+		janus_rtp_extension_id(JANUS_RTP_EXTMAP_ABS_SEND_TIME) : 0;
+}
+
 /* Helper to generate a new offer with the subscriber streams */
 static json_t *janus_videoroom_subscriber_offer(janus_videoroom_subscriber *subscriber) {
 	g_atomic_int_set(&subscriber->answered, 0);
-	char s_name[100], audio_fmtp[256];
-	g_snprintf(s_name, sizeof(s_name), "VideoRoom %s", subscriber->room->room_id_str);
-	janus_sdp *offer = janus_sdp_generate_offer(s_name, "0.0.0.0",
-		JANUS_SDP_OA_DONE);
+	janus_videoroom *room = subscriber->room;
+	/* Collect what the m-lines depend on, which is also what identifies the offer template */
+	guint count = g_list_length(subscriber->streams), i = 0;
+	janus_videoroom_offer_mline *mlines = count ? g_malloc(count * sizeof(janus_videoroom_offer_mline)) : NULL;
+	char **mkeys = count ? g_malloc0(count * sizeof(char *)) : NULL;
+	GString *key = g_string_new(NULL);
 	GList *temp = subscriber->streams;
 	while(temp) {
-		janus_videoroom_subscriber_stream *stream = (janus_videoroom_subscriber_stream *)temp->data;
-		janus_videoroom_publisher_stream *ps = stream->publisher_streams ? stream->publisher_streams->data : NULL;
-		int pt = -1;
-		const char *codec = NULL;
-		audio_fmtp[0] = '\0';
-		if(ps && stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO) {
-			if(ps->opusfec)
-				g_snprintf(audio_fmtp, sizeof(audio_fmtp), "useinbandfec=1");
-			if(ps->opusdtx) {
-				if(strlen(audio_fmtp) == 0) {
-					g_snprintf(audio_fmtp, sizeof(audio_fmtp), "usedtx=1");
-				} else {
-					janus_strlcat(audio_fmtp, ";usedtx=1", sizeof(audio_fmtp));
-				}
-			}
-			if(ps->opusstereo) {
-				if(strlen(audio_fmtp) == 0) {
-					g_snprintf(audio_fmtp, sizeof(audio_fmtp), "stereo=1");
-				} else {
-					janus_strlcat(audio_fmtp, ";stereo=1", sizeof(audio_fmtp));
-				}
-			}
-		}
-		if(stream->type != JANUS_VIDEOROOM_MEDIA_DATA) {
-			pt = stream->pt;
-			codec = (stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO ?
-				janus_audiocodec_name(stream->acodec) : janus_videocodec_name(stream->vcodec));
-		}
-		gboolean add_msid = (subscriber->use_msid && ps && !ps->disabled);
-		janus_sdp_generate_offer_mline(offer,
-			JANUS_SDP_OA_MLINE, janus_videoroom_media_sdptype(stream->type),
-			JANUS_SDP_OA_MID, stream->mid,
-			JANUS_SDP_OA_MSID, add_msid ? stream->msid : NULL, add_msid ? stream->mstid : NULL,
-			JANUS_SDP_OA_PT, pt,
-			JANUS_SDP_OA_CODEC, codec,
-			JANUS_SDP_OA_FMTP, (stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO && strlen(audio_fmtp) ? audio_fmtp : NULL),
-			JANUS_SDP_OA_H264_PROFILE, (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO ? stream->h264_profile : NULL),
-			JANUS_SDP_OA_VP9_PROFILE, (stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO ? stream->vp9_profile : NULL),
-			JANUS_SDP_OA_DIRECTION, ((ps && !ps->disabled) || stream->type == JANUS_VIDEOROOM_MEDIA_DATA) ? JANUS_SDP_SENDONLY : JANUS_SDP_INACTIVE,
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_AUDIO_LEVEL,
-				(stream->type == JANUS_VIDEOROOM_MEDIA_AUDIO && (ps && ps->audio_level_extmap_id > 0)) ? janus_rtp_extension_id(JANUS_RTP_EXTMAP_AUDIO_LEVEL) : 0,
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_MID, janus_rtp_extension_id(JANUS_RTP_EXTMAP_MID),
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_VIDEO_ORIENTATION,
-				(stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && (ps && ps->video_orient_extmap_id > 0)) ? janus_rtp_extension_id(JANUS_RTP_EXTMAP_VIDEO_ORIENTATION) : 0,
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_PLAYOUT_DELAY,
-				(stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && (ps && ps->playout_delay_extmap_id > 0)) ? janus_rtp_extension_id(JANUS_RTP_EXTMAP_PLAYOUT_DELAY) : 0,
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC,
-				(stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO && subscriber->room->transport_wide_cc_ext) ? janus_rtp_extension_id(JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC) : 0,
-			JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_ABS_SEND_TIME,
-				(stream->type == JANUS_VIDEOROOM_MEDIA_VIDEO) ? janus_rtp_extension_id(JANUS_RTP_EXTMAP_ABS_SEND_TIME) : 0,
-			/* TODO Add other properties from original SDP */
-			JANUS_SDP_OA_DONE);
+		janus_videoroom_offer_mline *ml = &mlines[i];
+		janus_videoroom_offer_mline_prepare(subscriber, (janus_videoroom_subscriber_stream *)temp->data, ml);
+		mkeys[i] = g_strdup_printf("%d|%s|%s|%s|%d|%s|%s|%s|%s|%d|%d|%d|%d|%d|%d\n",
+			ml->type, ml->mid, ml->msid, ml->mstid, ml->pt, ml->codec, ml->audio_fmtp,
+			ml->h264_profile, ml->vp9_profile, ml->direction, ml->audio_level_id, ml->video_orient_id,
+			ml->playout_delay_id, ml->transport_wide_cc_id, ml->abs_send_time_id);
+		g_string_append(key, mkeys[i]);
+		i++;
 		temp = temp->next;
 	}
 	/* Update (or set) the SDP version */
 	subscriber->session->sdp_version++;
-	offer->o_version = subscriber->session->sdp_version;
-	char *sdp = janus_sdp_write(offer);
-	janus_sdp_destroy(offer);
+	guint64 sessid = janus_get_real_time(), version = subscriber->session->sdp_version;
+	char *sdp = NULL;
+	janus_mutex_lock(&room->offer_templates_mutex);
+	janus_videoroom_offer_template *template = g_hash_table_lookup(room->offer_templates, key->str);
+	if(template != NULL)
+		sdp = g_strdup_printf("%s%"SCNu64" %"SCNu64"%s", template->head, sessid, version, template->tail);
+	janus_mutex_unlock(&room->offer_templates_mutex);
+	if(sdp == NULL) {
+		/* No template for these streams yet: we only generate the m-lines
+		 * that changed since the last offer we sent, and reuse the others */
+		if(subscriber->offer_mlines == NULL) {
+			subscriber->offer_mlines = g_hash_table_new_full(g_str_hash, g_str_equal,
+				(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_offer_mline_text_free);
+		}
+		char s_name[100];
+		g_snprintf(s_name, sizeof(s_name), "VideoRoom %s", room->room_id_str);
+		janus_sdp *offer = janus_sdp_generate_offer(s_name, "0.0.0.0",
+			JANUS_SDP_OA_DONE);
+		janus_videoroom_offer_mline_text **texts = count ? g_malloc0(count * sizeof(janus_videoroom_offer_mline_text *)) : NULL;
+		gboolean *generated = count ? g_malloc0(count * sizeof(gboolean)) : NULL;
+		for(i=0; i<count; i++) {
+			janus_videoroom_offer_mline *ml = &mlines[i];
+			janus_videoroom_offer_mline_text *mt = ml->mid ? g_hash_table_lookup(subscriber->offer_mlines, ml->mid) : NULL;
+			if(mt != NULL && !strcmp(mt->key, mkeys[i])) {
+				/* Nothing changed in this m-line */
+				texts[i] = mt;
+				continue;
+			}
+			generated[i] = (janus_sdp_generate_offer_mline(offer,
+				JANUS_SDP_OA_MLINE, janus_videoroom_media_sdptype(ml->type),
+				JANUS_SDP_OA_MID, ml->mid,
+				JANUS_SDP_OA_MSID, ml->msid, ml->mstid,
+				JANUS_SDP_OA_PT, ml->pt,
+				JANUS_SDP_OA_CODEC, ml->codec,
+				JANUS_SDP_OA_FMTP, (ml->type == JANUS_VIDEOROOM_MEDIA_AUDIO && strlen(ml->audio_fmtp) ? ml->audio_fmtp : NULL),
+				JANUS_SDP_OA_H264_PROFILE, ml->h264_profile,
+				JANUS_SDP_OA_VP9_PROFILE, ml->vp9_profile,
+				JANUS_SDP_OA_DIRECTION, ml->direction,
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_AUDIO_LEVEL, ml->audio_level_id,
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_MID, janus_rtp_extension_id(JANUS_RTP_EXTMAP_MID),
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_VIDEO_ORIENTATION, ml->video_orient_id,
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_PLAYOUT_DELAY, ml->playout_delay_id,
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_TRANSPORT_WIDE_CC, ml->transport_wide_cc_id,
+				JANUS_SDP_OA_EXTENSION, JANUS_RTP_EXTMAP_ABS_SEND_TIME, ml->abs_send_time_id,
+				/* TODO Add other properties from original SDP */
+				JANUS_SDP_OA_DONE) == 0);
+		}
+		offer->o_sessid = sessid;
+		offer->o_version = version;
+		char *partial = janus_sdp_write(offer);
+		/* The session level comes first, followed by the m-lines we just generated,
+		 * in order: m-lines are written independently of each other, so we can put
+		 * them together with the ones we had already, and get the same SDP */
+		GString *full = g_string_sized_new(partial ? strlen(partial) : 0);
+		char *next = partial ? strstr(partial, "\r\nm=") : NULL;
+		if(partial != NULL)
+			g_string_append_len(full, partial, next ? (next - partial) + 2 : (gssize)strlen(partial));
+		for(i=0; i<count; i++) {
+			if(texts[i] != NULL) {
+				g_string_append(full, texts[i]->text);
+			} else if(generated[i] && next != NULL) {
+				char *mline = next + 2;
+				next = strstr(mline, "\r\nm=");
+				char *text = next ? g_strndup(mline, (next - mline) + 2) : g_strdup(mline);
+				g_string_append(full, text);
+				if(mlines[i].mid != NULL) {
+					janus_videoroom_offer_mline_text *mt = g_malloc(sizeof(janus_videoroom_offer_mline_text));
+					mt->key = mkeys[i];
+					mkeys[i] = NULL;
+					mt->text = text;
+					g_hash_table_insert(subscriber->offer_mlines, g_strdup(mlines[i].mid), mt);
+				} else {
+					g_free(text);
+				}
+			}
+		}
+		g_free(partial);
+		g_free(texts);
+		g_free(generated);
+		sdp = g_string_free(full, FALSE);
+		/* Get rid of the m-lines of streams we don't have anymore */
+		if(g_hash_table_size(subscriber->offer_mlines) > count) {
+			g_hash_table_foreach_remove(subscriber->offer_mlines,
+				janus_videoroom_offer_mline_text_is_stale, subscriber);
+		}
+		/* Split the SDP around the o= session ID and version, to use it as a template */
+		char marker[256];
+		g_snprintf(marker, sizeof(marker), "o=%s %"SCNu64" %"SCNu64" ", offer->o_name, sessid, version);
+		char *found = strstr(sdp, marker);
+		if(found != NULL) {
+			template = g_malloc(sizeof(janus_videoroom_offer_template));
+			template->head = g_strndup(sdp, (found - sdp) + strlen(offer->o_name) + 3);
+			template->tail = g_strdup(found + strlen(marker) - 1);
+			janus_mutex_lock(&room->offer_templates_mutex);
+			if(g_hash_table_size(room->offer_templates) >= JANUS_VIDEOROOM_MAX_OFFER_TEMPLATES)
+				g_hash_table_remove_all(room->offer_templates);
+			g_hash_table_insert(room->offer_templates, g_strdup(key->str), template);
+			janus_mutex_unlock(&room->offer_templates_mutex);
+		}
+		janus_sdp_destroy(offer);
+	}
+	for(i=0; i<count; i++)
+		g_free(mkeys[i]);
+	g_free(mkeys);
+	g_string_free(key, TRUE);
+	g_free(mlines);
 	json_t *jsep = json_pack("{ssss}", "type", "offer", "sdp", sdp);
 	g_free(sdp);
 	/* Done */
 	return jsep;
 }
 
+/* Helper to create a room out of a configuration category: rooms_mutex
+ * must be locked already if locked is TRUE, and is then not touched */
+static janus_videoroom *janus_videoroom_room_from_config(janus_config *room_config, janus_config_category *cat, gboolean locked) {
+	JANUS_LOG(LOG_VERB, "Adding VideoRoom room '%s'\n", cat->name);
+	janus_config_item *desc = janus_config_get(room_config, cat, janus_config_type_item, "description");
+	janus_config_item *priv = janus_config_get(room_config, cat, janus_config_type_item, "is_private");
+	janus_config_item *secret = janus_config_get(room_config, cat, janus_config_type_item, "secret");
+	janus_config_item *pin = janus_config_get(room_config, cat, janus_config_type_item, "pin");
+	janus_config_item *req_pvtid = janus_config_get(room_config, cat, janus_config_type_item, "require_pvtid");
+	janus_config_item *signed_tokens = janus_config_get(room_config, cat, janus_config_type_item, "signed_tokens");
+	janus_config_item *bitrate = janus_config_get(room_config, cat, janus_config_type_item, "bitrate");
+	janus_config_item *bitrate_cap = janus_config_get(room_config, cat, janus_config_type_item, "bitrate_cap");
+	janus_config_item *maxp = janus_config_get(room_config, cat, janus_config_type_item, "publishers");
+	janus_config_item *firfreq = janus_config_get(room_config, cat, janus_config_type_item, "fir_freq");
+	janus_config_item *databatch = janus_config_get(room_config, cat, janus_config_type_item, "data_batch");
+	janus_config_item *audiocodec = janus_config_get(room_config, cat, janus_config_type_item, "audiocodec");
+	janus_config_item *videocodec = janus_config_get(room_config, cat, janus_config_type_item, "videocodec");
+	janus_config_item *vp9profile = janus_config_get(room_config, cat, janus_config_type_item, "vp9_profile");
+	janus_config_item *h264profile = janus_config_get(room_config, cat, janus_config_type_item, "h264_profile");
+	janus_config_item *fec = janus_config_get(room_config, cat, janus_config_type_item, "opus_fec");
+	janus_config_item *dtx = janus_config_get(room_config, cat, janus_config_type_item, "opus_dtx");
+	janus_config_item *audiolevel_ext = janus_config_get(room_config, cat, janus_config_type_item, "audiolevel_ext");
+	janus_config_item *audiolevel_event = janus_config_get(room_config, cat, janus_config_type_item, "audiolevel_event");
+	janus_config_item *audio_active_packets = janus_config_get(room_config, cat, janus_config_type_item, "audio_active_packets");
+	janus_config_item *audio_level_average = janus_config_get(room_config, cat, janus_config_type_item, "audio_level_average");
+	janus_config_item *videoorient_ext = janus_config_get(room_config, cat, janus_config_type_item, "videoorient_ext");
+	janus_config_item *playoutdelay_ext = janus_config_get(room_config, cat, janus_config_type_item, "playoutdelay_ext");
+	janus_config_item *transport_wide_cc_ext = janus_config_get(room_config, cat, janus_config_type_item, "transport_wide_cc_ext");
+	janus_config_item *notify_joining = janus_config_get(room_config, cat, janus_config_type_item, "notify_joining");
+	janus_config_item *threads = janus_config_get(room_config, cat, janus_config_type_item, "threads");
+	janus_config_item *threads_threshold = janus_config_get(room_config, cat, janus_config_type_item, "threads_threshold");
+	janus_config_item *gop_cache = janus_config_get(room_config, cat, janus_config_type_item, "gop_cache_size");
+	janus_config_item *req_e2ee = janus_config_get(room_config, cat, janus_config_type_item, "require_e2ee");
+	janus_config_item *dummy_pub = janus_config_get(room_config, cat, janus_config_type_item, "dummy_publisher");
+	janus_config_item *dummy_str = janus_config_get(room_config, cat, janus_config_type_array, "dummy_streams");
+	janus_config_item *record = janus_config_get(room_config, cat, janus_config_type_item, "record");
+	janus_config_item *rec_dir = janus_config_get(room_config, cat, janus_config_type_item, "rec_dir");
+	janus_config_item *lock_record = janus_config_get(room_config, cat, janus_config_type_item, "lock_record");
+	/* Create the video room */
+	janus_videoroom *videoroom = g_malloc0(sizeof(janus_videoroom));
+	const char *room_num = cat->name;
+	if(strstr(room_num, "room-") == room_num)
+		room_num += 5;
+	if(!string_ids) {
+		videoroom->room_id = g_ascii_strtoull(room_num, NULL, 0);
+		if(videoroom->room_id == 0) {
+			JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, invalid ID 0...\n");
+			g_free(videoroom);
+			return NULL;
+		}
+		/* Make sure the ID is completely numeric */
+		char room_id_str[30];
+		g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, videoroom->room_id);
+		if(strcmp(room_num, room_id_str)) {
+			JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, ID '%s' is not numeric...\n", room_num);
+			g_free(videoroom);
+			return NULL;
+		}
+	}
+	/* Let's make sure the room doesn't exist already */
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&videoroom->room_id) != NULL) {
+		/* It does... */
+		if(!locked)
+			janus_mutex_unlock(&rooms_mutex);
+		JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, room %s already exists...\n", room_num);
+		g_free(videoroom);
+		return NULL;
+	}
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	videoroom->room_id_str = g_strdup(room_num);
+	char *description = NULL;
+	if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
+		description = g_strdup(desc->value);
+	else
+		description = g_strdup(cat->name);
+	videoroom->room_name = description;
+	if(secret != NULL && secret->value != NULL) {
+		videoroom->room_secret = g_strdup(secret->value);
+	}
+	if(pin != NULL && pin->value != NULL) {
+		videoroom->room_pin = g_strdup(pin->value);
+	}
+	videoroom->is_private = priv && priv->value && janus_is_true(priv->value);
+	videoroom->require_pvtid = req_pvtid && req_pvtid->value && janus_is_true(req_pvtid->value);
+	if(signed_tokens && signed_tokens->value && janus_is_true(signed_tokens->value)) {
+		if(!gateway->auth_is_signed()) {
+			JANUS_LOG(LOG_WARN, "Can't enforce signed tokens for this room, signed-mode not in use in the core\n");
+		} else {
+			videoroom->signed_tokens = TRUE;
+		}
+	}
+	videoroom->require_e2ee = req_e2ee && req_e2ee->value && janus_is_true(req_e2ee->value);
+	videoroom->max_publishers = 3;	/* FIXME How should we choose a default? */
+	if(maxp != NULL && maxp->value != NULL)
+		videoroom->max_publishers = atol(maxp->value);
+	if(videoroom->max_publishers < 0)
+		videoroom->max_publishers = 3;	/* FIXME How should we choose a default? */
+	videoroom->bitrate = 0;
+	if(bitrate != NULL && bitrate->value != NULL)
+		videoroom->bitrate = atol(bitrate->value);
+	if(videoroom->bitrate > 0 && videoroom->bitrate < 64000)
+		videoroom->bitrate = 64000;	/* Don't go below 64k */
+	videoroom->bitrate_cap = bitrate_cap && bitrate_cap->value && janus_is_true(bitrate_cap->value);
+	videoroom->fir_freq = 0;
+	if(firfreq != NULL && firfreq->value != NULL)
+		videoroom->fir_freq = atol(firfreq->value);
+	videoroom->data_batch = 0;
+	if(databatch != NULL && databatch->value != NULL)
+		videoroom->data_batch = atol(databatch->value);
+	/* By default, we force Opus as the only audio codec */
+	videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
+	videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
+	videoroom->acodec[2] = JANUS_AUDIOCODEC_NONE;
+	videoroom->acodec[3] = JANUS_AUDIOCODEC_NONE;
+	videoroom->acodec[4] = JANUS_AUDIOCODEC_NONE;
+	/* Check if we're forcing a different single codec, or allowing more than one */
+	if(audiocodec && audiocodec->value) {
+		gchar **list = g_strsplit(audiocodec->value, ",", 6);
+		gchar *codec = list[0];
+		if(codec != NULL) {
+			int i=0;
+			while(codec != NULL) {
+				if(i == 5) {
+					JANUS_LOG(LOG_WARN, "Ignoring extra audio codecs: %s\n", codec);
+					break;
+				}
+				if(strlen(codec) > 0)
+					videoroom->acodec[i] = janus_audiocodec_from_name(codec);
+				i++;
+				codec = list[i];
+			}
+		}
+		g_clear_pointer(&list, g_strfreev);
+	}
+	/* By default, we force VP8 as the only video codec */
+	videoroom->vcodec[0] = JANUS_VIDEOCODEC_VP8;
+	videoroom->vcodec[1] = JANUS_VIDEOCODEC_NONE;
+	videoroom->vcodec[2] = JANUS_VIDEOCODEC_NONE;
+	videoroom->vcodec[3] = JANUS_VIDEOCODEC_NONE;
+	videoroom->vcodec[4] = JANUS_VIDEOCODEC_NONE;
+	/* Check if we're forcing a different single codec, or allowing more than one */
+	if(videocodec && videocodec->value) {
+		gchar **list = g_strsplit(videocodec->value, ",", 6);
+		gchar *codec = list[0];
+		if(codec != NULL) {
+			int i=0;
+			while(codec != NULL) {
+				if(i == 5) {
+					JANUS_LOG(LOG_WARN, "Ignoring extra video codecs: %s\n", codec);
+					break;
+				}
+				if(strlen(codec) > 0)
+					videoroom->vcodec[i] = janus_videocodec_from_name(codec);
+				i++;
+				codec = list[i];
+			}
+		}
+		g_clear_pointer(&list, g_strfreev);
+	}
+	if(vp9profile && vp9profile->value && (videoroom->vcodec[0] == JANUS_VIDEOCODEC_VP9 ||
+			videoroom->vcodec[1] == JANUS_VIDEOCODEC_VP9 ||
+			videoroom->vcodec[2] == JANUS_VIDEOCODEC_VP9 ||
+			videoroom->vcodec[3] == JANUS_VIDEOCODEC_VP9 ||
+			videoroom->vcodec[4] == JANUS_VIDEOCODEC_VP9)) {
+		videoroom->vp9_profile = g_strdup(vp9profile->value);
+	}
+	if(h264profile && h264profile->value && (videoroom->vcodec[0] == JANUS_VIDEOCODEC_H264 ||
+			videoroom->vcodec[1] == JANUS_VIDEOCODEC_H264 ||
+			videoroom->vcodec[2] == JANUS_VIDEOCODEC_H264 ||
+			videoroom->vcodec[3] == JANUS_VIDEOCODEC_H264 ||
+			videoroom->vcodec[4] == JANUS_VIDEOCODEC_H264)) {
+		videoroom->h264_profile = g_strdup(h264profile->value);
+	}
+	videoroom->do_opusfec = TRUE;
+	if(fec && fec->value) {
+		videoroom->do_opusfec = janus_is_true(fec->value);
+		if(videoroom->acodec[0] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[1] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[2] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[3] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[4] != JANUS_AUDIOCODEC_OPUS) {
+			videoroom->do_opusfec = FALSE;
+			JANUS_LOG(LOG_WARN, "Inband FEC is only supported for rooms that allow Opus: disabling it...\n");
+		}
+	}
+	if(dtx && dtx->value) {
+		videoroom->do_opusdtx = janus_is_true(dtx->value);
+		if(videoroom->acodec[0] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[1] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[2] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[3] != JANUS_AUDIOCODEC_OPUS &&
+				videoroom->acodec[4] != JANUS_AUDIOCODEC_OPUS) {
+			videoroom->do_opusdtx = FALSE;
+			JANUS_LOG(LOG_WARN, "DTX is only supported for rooms that allow Opus: disabling it...\n");
+		}
+	}
+	videoroom->audiolevel_ext = TRUE;
+	if(audiolevel_ext != NULL && audiolevel_ext->value != NULL)
+		videoroom->audiolevel_ext = janus_is_true(audiolevel_ext->value);
+	videoroom->audiolevel_event = FALSE;
+	if(audiolevel_event != NULL && audiolevel_event->value != NULL)
+		videoroom->audiolevel_event = janus_is_true(audiolevel_event->value);
+	if(videoroom->audiolevel_event) {
+		videoroom->audio_active_packets = 100;
+		if(audio_active_packets != NULL && audio_active_packets->value != NULL){
+			if(atoi(audio_active_packets->value) > 0) {
+				videoroom->audio_active_packets = atoi(audio_active_packets->value);
+			} else {
+				JANUS_LOG(LOG_WARN, "Invalid audio_active_packets value, using default: %d\n", videoroom->audio_active_packets);
+			}
+		}
+		videoroom->audio_level_average = 25;
+		if(audio_level_average != NULL && audio_level_average->value != NULL) {
+			if(atoi(audio_level_average->value) > 0) {
+				videoroom->audio_level_average = atoi(audio_level_average->value);
+			} else {
+				JANUS_LOG(LOG_WARN, "Invalid audio_level_average value provided, using default: %d\n", videoroom->audio_level_average);
+			}
+		}
+	}
+	videoroom->videoorient_ext = TRUE;
+	if(videoorient_ext != NULL && videoorient_ext->value != NULL)
+		videoroom->videoorient_ext = janus_is_true(videoorient_ext->value);
+	videoroom->playoutdelay_ext = TRUE;
+	if(playoutdelay_ext != NULL && playoutdelay_ext->value != NULL)
+		videoroom->playoutdelay_ext = janus_is_true(playoutdelay_ext->value);
+	videoroom->transport_wide_cc_ext = TRUE;
+	if(transport_wide_cc_ext != NULL && transport_wide_cc_ext->value != NULL)
+		videoroom->transport_wide_cc_ext = janus_is_true(transport_wide_cc_ext->value);
+	if(record && record->value) {
+		videoroom->record = janus_is_true(record->value);
+	}
+	if(rec_dir && rec_dir->value) {
+		videoroom->rec_dir = g_strdup(rec_dir->value);
+	}
+	if(lock_record && lock_record->value) {
+		videoroom->lock_record = janus_is_true(lock_record->value);
+	}
+	/* By default, the VideoRoom plugin does not notify about participants simply joining the room.
+		It only notifies when the participant actually starts publishing media. */
+	videoroom->notify_joining = FALSE;
+	if(notify_joining != NULL && notify_joining->value != NULL)
+		videoroom->notify_joining = janus_is_true(notify_joining->value);
+	/* By default, media is relayed to subscribers by the thread receiving it from publishers */
+	if(threads != NULL && threads->value != NULL) {
+		videoroom->helper_threads = atoi(threads->value);
+		if(videoroom->helper_threads < 0 || videoroom->helper_threads > JANUS_VIDEOROOM_MAX_HELPER_THREADS) {
+			JANUS_LOG(LOG_WARN, "Invalid number of helper threads (%s), disabling them\n", threads->value);
+			videoroom->helper_threads = 0;
+		}
+	}
+	if(threads_threshold != NULL && threads_threshold->value != NULL) {
+		int threshold = atoi(threads_threshold->value);
+		if(threshold < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid helper threads threshold (%s), ignoring\n", threads_threshold->value);
+		} else {
+			videoroom->helper_threshold = threshold;
+		}
+	}
+	if(gop_cache != NULL && gop_cache->value != NULL) {
+		int gop_size = atoi(gop_cache->value);
+		if(gop_size < 0) {
+			JANUS_LOG(LOG_WARN, "Invalid GOP cache size (%s), disabling it\n", gop_cache->value);
+		} else {
+			videoroom->gop_cache_size = (size_t)gop_size * 1024;
+		}
+	}
+	g_atomic_int_set(&videoroom->destroyed, 0);
+	janus_mutex_init(&videoroom->mutex);
+	janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
+	videoroom->offer_templates = g_hash_table_new_full(g_str_hash, g_str_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_offer_template_free);
+	janus_mutex_init(&videoroom->offer_templates_mutex);
+	if(videoroom->helper_threads > 0 && !janus_videoroom_helpers_start(videoroom)) {
+		JANUS_LOG(LOG_WARN, "Couldn't spawn the helper threads for room %s, relaying media inline\n",
+			videoroom->room_id_str);
+	}
+	videoroom->participants = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_publisher_dereference);
+	videoroom->private_ids = g_hash_table_new(NULL, NULL);
+	videoroom->check_allowed = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
+	videoroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
+	/* Should we create a dummy participant for placeholder m-lines? */
+	if(dummy_pub && dummy_pub->value && janus_is_true(dummy_pub->value)) {
+		videoroom->dummy_publisher = TRUE;
+		/* Check if we only need a subset of codecs, and&/or a specific fmtp */
+		GHashTable *dummy_streams = NULL;
+		if(dummy_str != NULL) {
+			GList *l = dummy_str->list;
+			while(l) {
+				janus_config_item *m = (janus_config_item *)l->data;
+				if(m == NULL || m->type != janus_config_type_category) {
+					JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream item (not a category?), skipping in '%s'...\n", cat->name);
+					l = l->next;
+					continue;
+				}
+				janus_config_item *codec = janus_config_get(room_config, m, janus_config_type_item, "codec");
+				if(codec == NULL || codec->value == NULL) {
+					JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream codec, skipping in '%s'...\n", cat->name);
+					l = l->next;
+					continue;
+				}
+				janus_config_item *fmtp = janus_config_get(room_config, m, janus_config_type_item, "fmtp");
+				if(fmtp != NULL && fmtp->value == NULL) {
+					JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream fmtp, skipping in '%s'...\n", cat->name);
+					l = l->next;
+					continue;
+				}
+				if(dummy_streams == NULL)
+					dummy_streams = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
+				g_hash_table_insert(dummy_streams, g_strdup(codec->value), g_strdup(fmtp ? fmtp->value : "none"));
+				l = l->next;
+			}
+		}
+		/* Create the dummy publisher */
+		janus_videoroom_create_dummy_publisher(videoroom, dummy_streams);
+		if(dummy_streams != NULL)
+			g_hash_table_destroy(dummy_streams);
+	}
+	if(!locked)
+		janus_mutex_lock(&rooms_mutex);
+	g_hash_table_insert(rooms,
+		string_ids ? (gpointer)g_strdup(videoroom->room_id_str) : (gpointer)janus_uint64_dup(videoroom->room_id),
+		videoroom);
+	if(!locked)
+		janus_mutex_unlock(&rooms_mutex);
+	/* Compute a list of the supported codecs for the summary */
+	char audio_codecs[100], video_codecs[100];
+	janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), "|");
+	JANUS_LOG(LOG_VERB, "Created VideoRoom: %s (%s, %s, %s/%s codecs, secret: %s, pin: %s, pvtid: %s)\n",
+		videoroom->room_id_str, videoroom->room_name,
+		videoroom->is_private ? "private" : "public",
+		audio_codecs, video_codecs,
+		videoroom->room_secret ? videoroom->room_secret : "no secret",
+		videoroom->room_pin ? videoroom->room_pin : "no pin",
+		videoroom->require_pvtid ? "required" : "optional");
+	if(videoroom->record) {
+		JANUS_LOG(LOG_VERB, "  -- Room is going to be recorded in %s\n",
+			videoroom->rec_dir ? videoroom->rec_dir : "the current folder");
+	}
+	if(videoroom->require_e2ee) {
+		JANUS_LOG(LOG_VERB, "  -- All publishers MUST use end-to-end encryption\n");
+	}
+	if(videoroom->dummy_publisher) {
+		JANUS_LOG(LOG_VERB, "  -- The room is going to have a dummy publisher for placeholder subscriptions\n");
+	}
+	return videoroom;
+}
+
+/* When a rooms folder is configured, the permanent rooms saved there are only
+ * loaded when first needed: this helper looks a room up, and loads it from
+ * the folder if it's not available yet (rooms_mutex must be locked) */
+static janus_videoroom *janus_videoroom_lookup_room(guint64 room_id, const char *room_id_str) {
+	janus_videoroom *videoroom = g_hash_table_lookup(rooms,
+		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+	if(videoroom != NULL || rooms_folder == NULL || room_id_str == NULL)
+		return videoroom;
+	char cat[BUFSIZ];
+	g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+	if(!janus_config_folder_contains(rooms_folder, cat))
+		return NULL;
+	janus_config *room_config = janus_config_folder_load(rooms_folder, cat);
+	janus_config_category *c = janus_config_get(room_config, NULL, janus_config_type_category, cat);
+	if(c != NULL) {
+		JANUS_LOG(LOG_VERB, "Loading VideoRoom room %s from the rooms folder\n", room_id_str);
+		videoroom = janus_videoroom_room_from_config(room_config, c, TRUE);
+	}
+	/* Whatever happened, we won't load this room again until a restart */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_destroy(room_config);
+	return videoroom;
+}
+
+/* Load all the rooms in the rooms folder we haven't loaded yet (rooms_mutex must be locked) */
+static void janus_videoroom_load_rooms(void) {
+	if(rooms_folder == NULL)
+		return;
+	GList *names = janus_config_folder_get_names(rooms_folder), *l = names;
+	while(l) {
+		const char *cat = (const char *)l->data;
+		l = l->next;
+		if(strstr(cat, "room-") != cat)
+			continue;
+		/* The name will be freed when the room is loaded, so we copy the ID */
+		char *room_id_str = g_strdup(cat + 5);
+		janus_videoroom_lookup_room(string_ids ? 0 : g_ascii_strtoull(room_id_str, NULL, 0), room_id_str);
+		g_free(room_id_str);
+	}
+	g_list_free(names);
+}
+
+/* Persist the changes to a room (config_mutex must be locked): when a rooms
+ * folder is configured, rooms that aren't in the main configuration file get
+ * a file of their own, so that we only write what changed; in_config is
+ * whether the room was in the main configuration before the change */
+static gboolean janus_videoroom_save_room(const char *cat, gboolean in_config) {
+	if(rooms_folder == NULL || in_config)
+		return janus_config_save(config, config_folder, JANUS_VIDEOROOM_PACKAGE) >= 0;
+	janus_config_category *c = janus_config_get(config, NULL, janus_config_type_category, cat);
+	int res = c ? janus_config_folder_save(rooms_folder, config, c) : janus_config_folder_remove(rooms_folder, cat);
+	/* The room is in memory already, and doesn't belong in the main configuration */
+	janus_config_folder_forget(rooms_folder, cat);
+	janus_config_remove(config, NULL, cat);
+	return res == 0;
+}
+
+
+/* Build the list of rooms to return for a "list" request: rooms_mutex is
+ * only locked to get a reference to all the rooms, and not while we go
+ * through them to prepare the list */
+static json_t *janus_videoroom_rooms_list(gboolean include_private) {
+	GList *rooms_list = NULL;
+	janus_mutex_lock(&rooms_mutex);
+	/* Make sure we also list the rooms we didn't need so far */
+	janus_videoroom_load_rooms();
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, rooms);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_videoroom *room = value;
+		if(!room)
+			continue;
+		if(room->is_private && !include_private) {
+			/* Skip private room if no valid admin_key was provided */
+			JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
+			continue;
+		}
+		janus_refcount_increase(&room->ref);
+		rooms_list = g_list_prepend(rooms_list, room);
+	}
+	janus_mutex_unlock(&rooms_mutex);
+	json_t *list = json_array();
+	GList *l = rooms_list;
+	while(l) {
+		janus_videoroom *room = (janus_videoroom *)l->data;
+		if(!g_atomic_int_get(&room->destroyed)) {
+			json_t *rl = json_object();
+			json_object_set_new(rl, "room", string_ids ? json_string(room->room_id_str) : json_integer(room->room_id));
+			json_object_set_new(rl, "description", json_string(room->room_name));
+			json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
+			json_object_set_new(rl, "is_private", room->is_private ? json_true() : json_false());
+			json_object_set_new(rl, "max_publishers", json_integer(room->max_publishers));
+			json_object_set_new(rl, "bitrate", json_integer(room->bitrate));
+			if(room->bitrate_cap)
+				json_object_set_new(rl, "bitrate_cap", json_true());
+			json_object_set_new(rl, "fir_freq", json_integer(room->fir_freq));
+			if(room->data_batch > 0)
+				json_object_set_new(rl, "data_batch", json_integer(room->data_batch));
+			json_object_set_new(rl, "require_pvtid", room->require_pvtid ? json_true() : json_false());
+			json_object_set_new(rl, "require_e2ee", room->require_e2ee ? json_true() : json_false());
+			json_object_set_new(rl, "dummy_publisher", room->dummy_publisher ? json_true() : json_false());
+			json_object_set_new(rl, "notify_joining", room->notify_joining ? json_true() : json_false());
+			if(room->helper_threads > 0) {
+				json_object_set_new(rl, "threads", json_integer(room->helper_threads));
+				json_object_set_new(rl, "threads_threshold", json_integer(room->helper_threshold));
+			}
+			if(room->gop_cache_size > 0)
+				json_object_set_new(rl, "gop_cache_size", json_integer(room->gop_cache_size/1024));
+			char audio_codecs[100];
+			char video_codecs[100];
+			janus_videoroom_codecstr(room, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
+			json_object_set_new(rl, "audiocodec", json_string(audio_codecs));
+			json_object_set_new(rl, "videocodec", json_string(video_codecs));
+			if(room->do_opusfec)
+				json_object_set_new(rl, "opus_fec", json_true());
+			if(room->do_opusdtx)
+				json_object_set_new(rl, "opus_dtx", json_true());
+			json_object_set_new(rl, "record", room->record ? json_true() : json_false());
+			json_object_set_new(rl, "rec_dir", json_string(room->rec_dir));
+			json_object_set_new(rl, "lock_record", room->lock_record ? json_true() : json_false());
+			json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
+			json_object_set_new(rl, "audiolevel_ext", room->audiolevel_ext ? json_true() : json_false());
+			json_object_set_new(rl, "audiolevel_event", room->audiolevel_event ? json_true() : json_false());
+			if(room->audiolevel_event) {
+				json_object_set_new(rl, "audio_active_packets", json_integer(room->audio_active_packets));
+				json_object_set_new(rl, "audio_level_average", json_integer(room->audio_level_average));
+			}
+			json_object_set_new(rl, "videoorient_ext", room->videoorient_ext ? json_true() : json_false());
+			json_object_set_new(rl, "playoutdelay_ext", room->playoutdelay_ext ? json_true() : json_false());
+			json_object_set_new(rl, "transport_wide_cc_ext", room->transport_wide_cc_ext ? json_true() : json_false());
+			json_array_append_new(list, rl);
+		}
+		janus_refcount_decrease(&room->ref);
+		l = l->next;
+	}
+	g_list_free(rooms_list);
+	return list;
+}
+
+/* Get a copy of the (possibly cached) list of rooms */
+static json_t *janus_videoroom_rooms_list_get(gboolean include_private) {
+	if(list_refresh == 0)
+		return janus_videoroom_rooms_list(include_private);
+	json_t *list = NULL;
+	janus_mutex_lock(&rooms_list_mutex);
+	json_t **cached = include_private ? &rooms_list_all : &rooms_list_public;
+	gint64 now = janus_get_monotonic_time();
+	if(*cached == NULL || now - rooms_list_updated >= (gint64)list_refresh * 1000) {
+		if(now - rooms_list_updated >= (gint64)list_refresh * 1000) {
+			/* Both snapshots are stale */
+			json_decref(rooms_list_public);
+			rooms_list_public = NULL;
+			json_decref(rooms_list_all);
+			rooms_list_all = NULL;
+			rooms_list_updated = now;
+		}
+		*cached = janus_videoroom_rooms_list(include_private);
+	}
+	list = json_deep_copy(*cached);
+	janus_mutex_unlock(&rooms_list_mutex);
+	return list;
+}
+
+/* Get rid of the cached lists of rooms, e.g., because rooms were added, edited or removed */
+static void janus_videoroom_rooms_list_invalidate(void) {
+	janus_mutex_lock(&rooms_list_mutex);
+	json_decref(rooms_list_public);
+	rooms_list_public = NULL;
+	json_decref(rooms_list_all);
+	rooms_list_all = NULL;
+	janus_mutex_unlock(&rooms_list_mutex);
+}
 
 /* Plugin implementation */
 int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
@@ -3224,7 +4490,7 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 		janus_config_print(config);
 
 	sessions = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_videoroom_session_destroy);
-	messages = g_async_queue_new_full((GDestroyNotify) janus_videoroom_message_free);
+	request_stats = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
 
 	/* This is the callback we'll need to invoke to contact the Janus core */
 	gateway = callback;
@@ -3251,326 +4517,49 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 		if(string_ids) {
 			JANUS_LOG(LOG_INFO, "VideoRoom will use alphanumeric IDs, not numeric\n");
 		}
+		janus_config_item *lr = janus_config_get(config, config_general, janus_config_type_item, "list_refresh");
+		if(lr != NULL && lr->value != NULL) {
+			int value = atoi(lr->value);
+			if(value < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid list_refresh value '%s', using default (%d)\n", lr->value, JANUS_VIDEOROOM_DEFAULT_LIST_REFRESH);
+				value = JANUS_VIDEOROOM_DEFAULT_LIST_REFRESH;
+			}
+			list_refresh = value;
+		}
+		janus_config_item *hthreads = janus_config_get(config, config_general, janus_config_type_item, "handler_threads");
+		if(hthreads != NULL && hthreads->value != NULL) {
+			int value = atoi(hthreads->value);
+			if(value < 1 || value > JANUS_VIDEOROOM_MAX_HANDLER_THREADS) {
+				JANUS_LOG(LOG_WARN, "Invalid handler_threads value '%s' (should be between 1 and %d), using default (%d)\n",
+					hthreads->value, JANUS_VIDEOROOM_MAX_HANDLER_THREADS, JANUS_VIDEOROOM_DEFAULT_HANDLER_THREADS);
+				value = JANUS_VIDEOROOM_DEFAULT_HANDLER_THREADS;
+			}
+			handler_threads = value;
+		}
+		janus_config_item *rfolder = janus_config_get(config, config_general, janus_config_type_item, "rooms_folder");
+		if(rfolder != NULL && rfolder->value != NULL) {
+			rooms_folder = janus_config_folder_open(rfolder->value);
+			if(rooms_folder == NULL) {
+				JANUS_LOG(LOG_WARN, "Couldn't open the rooms folder, saving permanent rooms to the configuration file instead\n");
+			} else {
+				JANUS_LOG(LOG_INFO, "VideoRoom will save permanent rooms to %s, and load them on demand\n", rfolder->value);
+			}
+		}
 	}
 	rooms = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
 		(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_room_destroy);
+	remote_trunks = g_hash_table_new_full(g_str_hash, g_str_equal,
+		(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_remote_trunk_destroy);
 	/* Iterate on all rooms */
 	if(config != NULL) {
 		GList *clist = janus_config_get_categories(config, NULL), *cl = clist;
 		while(cl != NULL) {
 			janus_config_category *cat = (janus_config_category *)cl->data;
-			if(cat->name == NULL || !strcasecmp(cat->name, "general")) {
-				cl = cl->next;
-				continue;
-			}
-			JANUS_LOG(LOG_VERB, "Adding VideoRoom room '%s'\n", cat->name);
-			janus_config_item *desc = janus_config_get(config, cat, janus_config_type_item, "description");
-			janus_config_item *priv = janus_config_get(config, cat, janus_config_type_item, "is_private");
-			janus_config_item *secret = janus_config_get(config, cat, janus_config_type_item, "secret");
-			janus_config_item *pin = janus_config_get(config, cat, janus_config_type_item, "pin");
-			janus_config_item *req_pvtid = janus_config_get(config, cat, janus_config_type_item, "require_pvtid");
-			janus_config_item *signed_tokens = janus_config_get(config, cat, janus_config_type_item, "signed_tokens");
-			janus_config_item *bitrate = janus_config_get(config, cat, janus_config_type_item, "bitrate");
-			janus_config_item *bitrate_cap = janus_config_get(config, cat, janus_config_type_item, "bitrate_cap");
-			janus_config_item *maxp = janus_config_get(config, cat, janus_config_type_item, "publishers");
-			janus_config_item *firfreq = janus_config_get(config, cat, janus_config_type_item, "fir_freq");
-			janus_config_item *audiocodec = janus_config_get(config, cat, janus_config_type_item, "audiocodec");
-			janus_config_item *videocodec = janus_config_get(config, cat, janus_config_type_item, "videocodec");
-			janus_config_item *vp9profile = janus_config_get(config, cat, janus_config_type_item, "vp9_profile");
-			janus_config_item *h264profile = janus_config_get(config, cat, janus_config_type_item, "h264_profile");
-			janus_config_item *fec = janus_config_get(config, cat, janus_config_type_item, "opus_fec");
-			janus_config_item *dtx = janus_config_get(config, cat, janus_config_type_item, "opus_dtx");
-			janus_config_item *audiolevel_ext = janus_config_get(config, cat, janus_config_type_item, "audiolevel_ext");
-			janus_config_item *audiolevel_event = janus_config_get(config, cat, janus_config_type_item, "audiolevel_event");
-			janus_config_item *audio_active_packets = janus_config_get(config, cat, janus_config_type_item, "audio_active_packets");
-			janus_config_item *audio_level_average = janus_config_get(config, cat, janus_config_type_item, "audio_level_average");
-			janus_config_item *videoorient_ext = janus_config_get(config, cat, janus_config_type_item, "videoorient_ext");
-			janus_config_item *playoutdelay_ext = janus_config_get(config, cat, janus_config_type_item, "playoutdelay_ext");
-			janus_config_item *transport_wide_cc_ext = janus_config_get(config, cat, janus_config_type_item, "transport_wide_cc_ext");
-			janus_config_item *notify_joining = janus_config_get(config, cat, janus_config_type_item, "notify_joining");
-			janus_config_item *req_e2ee = janus_config_get(config, cat, janus_config_type_item, "require_e2ee");
-			janus_config_item *dummy_pub = janus_config_get(config, cat, janus_config_type_item, "dummy_publisher");
-			janus_config_item *dummy_str = janus_config_get(config, cat, janus_config_type_array, "dummy_streams");
-			janus_config_item *record = janus_config_get(config, cat, janus_config_type_item, "record");
-			janus_config_item *rec_dir = janus_config_get(config, cat, janus_config_type_item, "rec_dir");
-			janus_config_item *lock_record = janus_config_get(config, cat, janus_config_type_item, "lock_record");
-			/* Create the video room */
-			janus_videoroom *videoroom = g_malloc0(sizeof(janus_videoroom));
-			const char *room_num = cat->name;
-			if(strstr(room_num, "room-") == room_num)
-				room_num += 5;
-			if(!string_ids) {
-				videoroom->room_id = g_ascii_strtoull(room_num, NULL, 0);
-				if(videoroom->room_id == 0) {
-					JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, invalid ID 0...\n");
-					g_free(videoroom);
-					cl = cl->next;
-					continue;
-				}
-				/* Make sure the ID is completely numeric */
-				char room_id_str[30];
-				g_snprintf(room_id_str, sizeof(room_id_str), "%"SCNu64, videoroom->room_id);
-				if(strcmp(room_num, room_id_str)) {
-					JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, ID '%s' is not numeric...\n", room_num);
-					g_free(videoroom);
-					cl = cl->next;
-					continue;
-				}
-			}
-			/* Let's make sure the room doesn't exist already */
-			janus_mutex_lock(&rooms_mutex);
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_num : (gpointer)&videoroom->room_id) != NULL) {
-				/* It does... */
-				janus_mutex_unlock(&rooms_mutex);
-				JANUS_LOG(LOG_ERR, "Can't add the VideoRoom room, room %s already exists...\n", room_num);
-				g_free(videoroom);
-				cl = cl->next;
-				continue;
-			}
-			janus_mutex_unlock(&rooms_mutex);
-			videoroom->room_id_str = g_strdup(room_num);
-			char *description = NULL;
-			if(desc != NULL && desc->value != NULL && strlen(desc->value) > 0)
-				description = g_strdup(desc->value);
-			else
-				description = g_strdup(cat->name);
-			videoroom->room_name = description;
-			if(secret != NULL && secret->value != NULL) {
-				videoroom->room_secret = g_strdup(secret->value);
-			}
-			if(pin != NULL && pin->value != NULL) {
-				videoroom->room_pin = g_strdup(pin->value);
-			}
-			videoroom->is_private = priv && priv->value && janus_is_true(priv->value);
-			videoroom->require_pvtid = req_pvtid && req_pvtid->value && janus_is_true(req_pvtid->value);
-			if(signed_tokens && signed_tokens->value && janus_is_true(signed_tokens->value)) {
-				if(!gateway->auth_is_signed()) {
-					JANUS_LOG(LOG_WARN, "Can't enforce signed tokens for this room, signed-mode not in use in the core\n");
-				} else {
-					videoroom->signed_tokens = TRUE;
-				}
-			}
-			videoroom->require_e2ee = req_e2ee && req_e2ee->value && janus_is_true(req_e2ee->value);
-			videoroom->max_publishers = 3;	/* FIXME How should we choose a default? */
-			if(maxp != NULL && maxp->value != NULL)
-				videoroom->max_publishers = atol(maxp->value);
-			if(videoroom->max_publishers < 0)
-				videoroom->max_publishers = 3;	/* FIXME How should we choose a default? */
-			videoroom->bitrate = 0;
-			if(bitrate != NULL && bitrate->value != NULL)
-				videoroom->bitrate = atol(bitrate->value);
-			if(videoroom->bitrate > 0 && videoroom->bitrate < 64000)
-				videoroom->bitrate = 64000;	/* Don't go below 64k */
-			videoroom->bitrate_cap = bitrate_cap && bitrate_cap->value && janus_is_true(bitrate_cap->value);
-			videoroom->fir_freq = 0;
-			if(firfreq != NULL && firfreq->value != NULL)
-				videoroom->fir_freq = atol(firfreq->value);
-			/* By default, we force Opus as the only audio codec */
-			videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
-			videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
-			videoroom->acodec[2] = JANUS_AUDIOCODEC_NONE;
-			videoroom->acodec[3] = JANUS_AUDIOCODEC_NONE;
-			videoroom->acodec[4] = JANUS_AUDIOCODEC_NONE;
-			/* Check if we're forcing a different single codec, or allowing more than one */
-			if(audiocodec && audiocodec->value) {
-				gchar **list = g_strsplit(audiocodec->value, ",", 6);
-				gchar *codec = list[0];
-				if(codec != NULL) {
-					int i=0;
-					while(codec != NULL) {
-						if(i == 5) {
-							JANUS_LOG(LOG_WARN, "Ignoring extra audio codecs: %s\n", codec);
-							break;
-						}
-						if(strlen(codec) > 0)
-							videoroom->acodec[i] = janus_audiocodec_from_name(codec);
-						i++;
-						codec = list[i];
-					}
-				}
-				g_clear_pointer(&list, g_strfreev);
-			}
-			/* By default, we force VP8 as the only video codec */
-			videoroom->vcodec[0] = JANUS_VIDEOCODEC_VP8;
-			videoroom->vcodec[1] = JANUS_VIDEOCODEC_NONE;
-			videoroom->vcodec[2] = JANUS_VIDEOCODEC_NONE;
-			videoroom->vcodec[3] = JANUS_VIDEOCODEC_NONE;
-			videoroom->vcodec[4] = JANUS_VIDEOCODEC_NONE;
-			/* Check if we're forcing a different single codec, or allowing more than one */
-			if(videocodec && videocodec->value) {
-				gchar **list = g_strsplit(videocodec->value, ",", 6);
-				gchar *codec = list[0];
-				if(codec != NULL) {
-					int i=0;
-					while(codec != NULL) {
-						if(i == 5) {
-							JANUS_LOG(LOG_WARN, "Ignoring extra video codecs: %s\n", codec);
-							break;
-						}
-						if(strlen(codec) > 0)
-							videoroom->vcodec[i] = janus_videocodec_from_name(codec);
-						i++;
-						codec = list[i];
-					}
-				}
-				g_clear_pointer(&list, g_strfreev);
-			}
-			if(vp9profile && vp9profile->value && (videoroom->vcodec[0] == JANUS_VIDEOCODEC_VP9 ||
-					videoroom->vcodec[1] == JANUS_VIDEOCODEC_VP9 ||
-					videoroom->vcodec[2] == JANUS_VIDEOCODEC_VP9 ||
-					videoroom->vcodec[3] == JANUS_VIDEOCODEC_VP9 ||
-					videoroom->vcodec[4] == JANUS_VIDEOCODEC_VP9)) {
-				videoroom->vp9_profile = g_strdup(vp9profile->value);
-			}
-			if(h264profile && h264profile->value && (videoroom->vcodec[0] == JANUS_VIDEOCODEC_H264 ||
-					videoroom->vcodec[1] == JANUS_VIDEOCODEC_H264 ||
-					videoroom->vcodec[2] == JANUS_VIDEOCODEC_H264 ||
-					videoroom->vcodec[3] == JANUS_VIDEOCODEC_H264 ||
-					videoroom->vcodec[4] == JANUS_VIDEOCODEC_H264)) {
-				videoroom->h264_profile = g_strdup(h264profile->value);
-			}
-			videoroom->do_opusfec = TRUE;
-			if(fec && fec->value) {
-				videoroom->do_opusfec = janus_is_true(fec->value);
-				if(videoroom->acodec[0] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[1] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[2] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[3] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[4] != JANUS_AUDIOCODEC_OPUS) {
-					videoroom->do_opusfec = FALSE;
-					JANUS_LOG(LOG_WARN, "Inband FEC is only supported for rooms that allow Opus: disabling it...\n");
-				}
-			}
-			if(dtx && dtx->value) {
-				videoroom->do_opusdtx = janus_is_true(dtx->value);
-				if(videoroom->acodec[0] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[1] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[2] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[3] != JANUS_AUDIOCODEC_OPUS &&
-						videoroom->acodec[4] != JANUS_AUDIOCODEC_OPUS) {
-					videoroom->do_opusdtx = FALSE;
-					JANUS_LOG(LOG_WARN, "DTX is only supported for rooms that allow Opus: disabling it...\n");
-				}
-			}
-			videoroom->audiolevel_ext = TRUE;
-			if(audiolevel_ext != NULL && audiolevel_ext->value != NULL)
-				videoroom->audiolevel_ext = janus_is_true(audiolevel_ext->value);
-			videoroom->audiolevel_event = FALSE;
-			if(audiolevel_event != NULL && audiolevel_event->value != NULL)
-				videoroom->audiolevel_event = janus_is_true(audiolevel_event->value);
-			if(videoroom->audiolevel_event) {
-				videoroom->audio_active_packets = 100;
-				if(audio_active_packets != NULL && audio_active_packets->value != NULL){
-					if(atoi(audio_active_packets->value) > 0) {
-						videoroom->audio_active_packets = atoi(audio_active_packets->value);
-					} else {
-						JANUS_LOG(LOG_WARN, "Invalid audio_active_packets value, using default: %d\n", videoroom->audio_active_packets);
-					}
-				}
-				videoroom->audio_level_average = 25;
-				if(audio_level_average != NULL && audio_level_average->value != NULL) {
-					if(atoi(audio_level_average->value) > 0) {
-						videoroom->audio_level_average = atoi(audio_level_average->value);
-					} else {
-						JANUS_LOG(LOG_WARN, "Invalid audio_level_average value provided, using default: %d\n", videoroom->audio_level_average);
-					}
-				}
-			}
-			videoroom->videoorient_ext = TRUE;
-			if(videoorient_ext != NULL && videoorient_ext->value != NULL)
-				videoroom->videoorient_ext = janus_is_true(videoorient_ext->value);
-			videoroom->playoutdelay_ext = TRUE;
-			if(playoutdelay_ext != NULL && playoutdelay_ext->value != NULL)
-				videoroom->playoutdelay_ext = janus_is_true(playoutdelay_ext->value);
-			videoroom->transport_wide_cc_ext = TRUE;
-			if(transport_wide_cc_ext != NULL && transport_wide_cc_ext->value != NULL)
-				videoroom->transport_wide_cc_ext = janus_is_true(transport_wide_cc_ext->value);
-			if(record && record->value) {
-				videoroom->record = janus_is_true(record->value);
-			}
-			if(rec_dir && rec_dir->value) {
-				videoroom->rec_dir = g_strdup(rec_dir->value);
-			}
-			if(lock_record && lock_record->value) {
-				videoroom->lock_record = janus_is_true(lock_record->value);
-			}
-			/* By default, the VideoRoom plugin does not notify about participants simply joining the room.
-				It only notifies when the participant actually starts publishing media. */
-			videoroom->notify_joining = FALSE;
-			if(notify_joining != NULL && notify_joining->value != NULL)
-				videoroom->notify_joining = janus_is_true(notify_joining->value);
-			g_atomic_int_set(&videoroom->destroyed, 0);
-			janus_mutex_init(&videoroom->mutex);
-			janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
-			videoroom->participants = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
-				(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_publisher_dereference);
-			videoroom->private_ids = g_hash_table_new(NULL, NULL);
-			videoroom->check_allowed = FALSE;	/* Static rooms can't have an "allowed" list yet, no hooks to the configuration file */
-			videoroom->allowed = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, NULL);
-			/* Should we create a dummy participant for placeholder m-lines? */
-			if(dummy_pub && dummy_pub->value && janus_is_true(dummy_pub->value)) {
-				videoroom->dummy_publisher = TRUE;
-				/* Check if we only need a subset of codecs, and&/or a specific fmtp */
-				GHashTable *dummy_streams = NULL;
-				if(dummy_str != NULL) {
-					GList *l = dummy_str->list;
-					while(l) {
-						janus_config_item *m = (janus_config_item *)l->data;
-						if(m == NULL || m->type != janus_config_type_category) {
-							JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream item (not a category?), skipping in '%s'...\n", cat->name);
-							l = l->next;
-							continue;
-						}
-						janus_config_item *codec = janus_config_get(config, m, janus_config_type_item, "codec");
-						if(codec == NULL || codec->value == NULL) {
-							JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream codec, skipping in '%s'...\n", cat->name);
-							l = l->next;
-							continue;
-						}
-						janus_config_item *fmtp = janus_config_get(config, m, janus_config_type_item, "fmtp");
-						if(fmtp != NULL && fmtp->value == NULL) {
-							JANUS_LOG(LOG_WARN, "  -- Invalid dummy stream fmtp, skipping in '%s'...\n", cat->name);
-							l = l->next;
-							continue;
-						}
-						if(dummy_streams == NULL)
-							dummy_streams = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, (GDestroyNotify)g_free);
-						g_hash_table_insert(dummy_streams, g_strdup(codec->value), g_strdup(fmtp ? fmtp->value : "none"));
-						l = l->next;
-					}
-				}
-				/* Create the dummy publisher */
-				janus_videoroom_create_dummy_publisher(videoroom, dummy_streams);
-				if(dummy_streams != NULL)
-					g_hash_table_destroy(dummy_streams);
-			}
-			janus_mutex_lock(&rooms_mutex);
-			g_hash_table_insert(rooms,
-				string_ids ? (gpointer)g_strdup(videoroom->room_id_str) : (gpointer)janus_uint64_dup(videoroom->room_id),
-				videoroom);
-			janus_mutex_unlock(&rooms_mutex);
-			/* Compute a list of the supported codecs for the summary */
-			char audio_codecs[100], video_codecs[100];
-			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), "|");
-			JANUS_LOG(LOG_VERB, "Created VideoRoom: %s (%s, %s, %s/%s codecs, secret: %s, pin: %s, pvtid: %s)\n",
-				videoroom->room_id_str, videoroom->room_name,
-				videoroom->is_private ? "private" : "public",
-				audio_codecs, video_codecs,
-				videoroom->room_secret ? videoroom->room_secret : "no secret",
-				videoroom->room_pin ? videoroom->room_pin : "no pin",
-				videoroom->require_pvtid ? "required" : "optional");
-			if(videoroom->record) {
-				JANUS_LOG(LOG_VERB, "  -- Room is going to be recorded in %s\n",
-					videoroom->rec_dir ? videoroom->rec_dir : "the current folder");
-			}
-			if(videoroom->require_e2ee) {
-				JANUS_LOG(LOG_VERB, "  -- All publishers MUST use end-to-end encryption\n");
-			}
-			if(videoroom->dummy_publisher) {
-				JANUS_LOG(LOG_VERB, "  -- The room is going to have a dummy publisher for placeholder subscriptions\n");
-			}
+			if(cat->name != NULL && strcasecmp(cat->name, "general"))
+				janus_videoroom_room_from_config(config, cat, FALSE);
 			cl = cl->next;
 		}
+		g_list_free(clist);
 		/* Done: we keep the configuration file open in case we get a "create" or "destroy" with permanent=true */
 	}
 
@@ -3607,17 +4596,54 @@ int janus_videoroom_init(janus_callbacks *callback, const char *config_path) {
 
 	g_atomic_int_set(&initialized, 1);
 
-	/* Launch the thread that will handle incoming messages */
+	/* Launch the threads that will handle incoming messages */
 	GError *error = NULL;
-	handler_thread = g_thread_try_new("videoroom handler", janus_videoroom_handler, NULL, &error);
+	char tname[16];
+	guint i = 0;
+	handlers = g_malloc0(handler_threads * sizeof(janus_videoroom_handler_thread));
+	for(i=0; i<handler_threads; i++) {
+		janus_videoroom_handler_thread *ht = &handlers[i];
+		ht->id = i+1;
+		ht->messages = g_async_queue_new_full((GDestroyNotify) janus_videoroom_message_free);
+		g_snprintf(tname, sizeof(tname), "vroom handler %u", ht->id);
+		ht->thread = g_thread_try_new(tname, janus_videoroom_handler, ht, &error);
+		if(error != NULL)
+			break;
+	}
 	if(error != NULL) {
 		g_atomic_int_set(&initialized, 0);
 		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the VideoRoom handler thread...\n",
 			error->code, error->message ? error->message : "??");
 		g_error_free(error);
+		/* Get rid of the handler threads we managed to spawn, if any */
+		guint j = 0;
+		for(j=0; j<=i; j++) {
+			if(handlers[j].thread != NULL) {
+				g_async_queue_push(handlers[j].messages, &exit_message);
+				g_thread_join(handlers[j].thread);
+			}
+			g_async_queue_unref(handlers[j].messages);
+		}
+		g_free(handlers);
+		handlers = NULL;
 		janus_config_destroy(config);
+		janus_config_folder_destroy(rooms_folder);
+		rooms_folder = NULL;
 		return -1;
 	}
+	if(handler_threads > 1) {
+		JANUS_LOG(LOG_INFO, "VideoRoom will process requests using %u handler threads\n", handler_threads);
+	}
+	/* Launch the thread that sends batched DataChannel messages, for rooms that ask for it */
+	janus_condition_init(&data_batches_cond);
+	data_batches_thread = g_thread_try_new("vroom data", janus_videoroom_data_batches_thread, NULL, &error);
+	if(error != NULL) {
+		/* Not fatal: DataChannel messages will just be sent right away */
+		JANUS_LOG(LOG_WARN, "Got error %d (%s) trying to launch the VideoRoom DataChannel batches thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		data_batches_thread = NULL;
+	}
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_VIDEOROOM_NAME);
 	return 0;
 }
@@ -3627,10 +4653,21 @@ void janus_videoroom_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	g_async_queue_push(messages, &exit_message);
-	if(handler_thread != NULL) {
-		g_thread_join(handler_thread);
-		handler_thread = NULL;
+	guint i = 0;
+	for(i=0; i<handler_threads; i++)
+		g_async_queue_push(handlers[i].messages, &exit_message);
+	for(i=0; i<handler_threads; i++) {
+		if(handlers[i].thread != NULL) {
+			g_thread_join(handlers[i].thread);
+			handlers[i].thread = NULL;
+		}
+	}
+	if(data_batches_thread != NULL) {
+		janus_mutex_lock(&data_batches_mutex);
+		janus_condition_broadcast(&data_batches_cond);
+		janus_mutex_unlock(&data_batches_mutex);
+		g_thread_join(data_batches_thread);
+		data_batches_thread = NULL;
 	}
 
 	/* FIXME We should destroy the sessions cleanly */
@@ -3639,15 +4676,29 @@ void janus_videoroom_destroy(void) {
 	sessions = NULL;
 	janus_mutex_unlock(&sessions_mutex);
 
+	janus_mutex_lock(&remote_trunks_mutex);
+	g_hash_table_destroy(remote_trunks);
+	remote_trunks = NULL;
+	janus_mutex_unlock(&remote_trunks_mutex);
+
 	janus_mutex_lock(&rooms_mutex);
 	g_hash_table_destroy(rooms);
 	rooms = NULL;
 	janus_mutex_unlock(&rooms_mutex);
+	janus_videoroom_rooms_list_invalidate();
 
-	g_async_queue_unref(messages);
-	messages = NULL;
+	for(i=0; i<handler_threads; i++)
+		g_async_queue_unref(handlers[i].messages);
+	g_free(handlers);
+	handlers = NULL;
+	janus_mutex_lock(&request_stats_mutex);
+	g_hash_table_destroy(request_stats);
+	request_stats = NULL;
+	janus_mutex_unlock(&request_stats_mutex);
 
 	janus_config_destroy(config);
+	janus_config_folder_destroy(rooms_folder);
+	rooms_folder = NULL;
 	g_free(admin_key);
 
 	g_atomic_int_set(&initialized, 0);
@@ -3703,6 +4754,8 @@ void janus_videoroom_create_session(janus_plugin_session *handle, int *error) {
 	session->participant = NULL;
 	g_atomic_int_set(&session->hangingup, 0);
 	g_atomic_int_set(&session->destroyed, 0);
+	/* Until a room is involved, spread sessions on the handler threads */
+	session->handler_index = (guint)g_atomic_int_add(&handler_next, 1) % handler_threads;
 	handle->plugin_handle = session;
 	janus_mutex_init(&session->mutex);
 	janus_refcount_init(&session->ref, janus_videoroom_session_free);
@@ -3933,6 +4986,8 @@ static void janus_videoroom_leave_or_unpublish(janus_videoroom_publisher *partic
 	json_object_set_new(event, is_leaving ? (kicked ? "kicked" : "leaving") : "unpublished",
 		string_ids ? json_string(participant->user_id_str) : json_integer(participant->user_id));
 	janus_videoroom_notify_participants(participant, event, FALSE);
+	/* The offer templates involving this publisher's streams are stale now */
+	janus_videoroom_offer_templates_clear(room);
 	/* Also notify event handlers */
 	if(notify_events && gateway->events_is_enabled()) {
 		json_t *info = json_object();
@@ -4019,6 +5074,54 @@ void janus_videoroom_destroy_session(janus_plugin_session *handle, int *error) {
 	return;
 }
 
+json_t *janus_videoroom_query_metrics(void) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return NULL;
+	/* We only return what we can get without iterating on rooms or participants */
+	janus_mutex_lock(&rooms_mutex);
+	guint rooms_count = g_hash_table_size(rooms);
+	janus_mutex_unlock(&rooms_mutex);
+	janus_mutex_lock(&sessions_mutex);
+	guint sessions_count = g_hash_table_size(sessions);
+	janus_mutex_unlock(&sessions_mutex);
+	json_t *metrics = json_object();
+	json_object_set_new(metrics, "videoroom_rooms", json_integer(rooms_count));
+	json_object_set_new(metrics, "videoroom_sessions", json_integer(sessions_count));
+	return metrics;
+}
+
+void janus_videoroom_drain(gboolean draining) {
+	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return;
+	/* Janus is being drained (or not anymore): let all users know, so that
+	 * they can move to a different instance when it's more convenient */
+	GList *list = NULL, *temp = NULL;
+	janus_mutex_lock(&sessions_mutex);
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, sessions);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_videoroom_session *session = (janus_videoroom_session *)value;
+		if(session == NULL || g_atomic_int_get(&session->destroyed))
+			continue;
+		janus_refcount_increase(&session->ref);
+		list = g_list_prepend(list, session);
+	}
+	janus_mutex_unlock(&sessions_mutex);
+	JANUS_LOG(LOG_INFO, "Notifying %u users that Janus is %s\n", g_list_length(list),
+		draining ? "draining" : "not draining anymore");
+	for(temp = list; temp != NULL; temp = temp->next) {
+		janus_videoroom_session *session = (janus_videoroom_session *)temp->data;
+		json_t *event = json_object();
+		json_object_set_new(event, "videoroom", json_string("event"));
+		json_object_set_new(event, "draining", draining ? json_true() : json_false());
+		gateway->push_event(session->handle, &janus_videoroom_plugin, NULL, event, NULL);
+		json_decref(event);
+		janus_refcount_decrease(&session->ref);
+	}
+	g_list_free(list);
+}
+
 json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized)) {
 		return NULL;
@@ -4115,6 +5218,11 @@ json_t *janus_videoroom_query_session(janus_plugin_session *handle) {
 				json_object_set_new(info, "paused", participant->paused ? json_true() : json_false());
 				if(participant->e2ee)
 					json_object_set_new(info, "e2ee", json_true());
+				if(participant->low_latency)
+					json_object_set_new(info, "low_latency", json_true());
+				guint32 estimate = (guint32)g_atomic_int_get(&participant->estimated_bandwidth);
+				if(estimate > 0)
+					json_object_set_new(info, "estimated-bandwidth", json_integer(estimate));
 				janus_mutex_lock(&participant->streams_mutex);
 				json_t *media = janus_videoroom_subscriber_streams_summary(participant, FALSE, NULL);
 				janus_mutex_unlock(&participant->streams_mutex);
@@ -4143,8 +5251,7 @@ static int janus_videoroom_access_room(json_t *root, gboolean check_modify, gboo
 	} else {
 		room_id_str = (char *)json_string_value(room);
 	}
-	*videoroom = g_hash_table_lookup(rooms,
-		string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+	*videoroom = janus_videoroom_lookup_room(room_id, room_id_str);
 	if(*videoroom == NULL) {
 		JANUS_LOG(LOG_ERR, "No such room (%s)\n", room_id_str);
 		error_code = JANUS_VIDEOROOM_ERROR_NO_SUCH_ROOM;
@@ -4246,6 +5353,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *bitrate = json_object_get(root, "bitrate");
 		json_t *bitrate_cap = json_object_get(root, "bitrate_cap");
 		json_t *fir_freq = json_object_get(root, "fir_freq");
+		json_t *data_batch = json_object_get(root, "data_batch");
 		json_t *publishers = json_object_get(root, "publishers");
 		json_t *allowed = json_object_get(root, "allowed");
 		json_t *audiocodec = json_object_get(root, "audiocodec");
@@ -4306,6 +5414,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_t *playoutdelay_ext = json_object_get(root, "playoutdelay_ext");
 		json_t *transport_wide_cc_ext = json_object_get(root, "transport_wide_cc_ext");
 		json_t *notify_joining = json_object_get(root, "notify_joining");
+		json_t *threads = json_object_get(root, "threads");
+		json_t *threads_threshold = json_object_get(root, "threads_threshold");
+		json_t *gop_cache = json_object_get(root, "gop_cache_size");
 		json_t *record = json_object_get(root, "record");
 		json_t *rec_dir = json_object_get(root, "rec_dir");
 		json_t *lock_record = json_object_get(root, "lock_record");
@@ -4353,7 +5464,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		janus_mutex_lock(&rooms_mutex);
 		if(room_id > 0 || room_id_str != NULL) {
 			/* Let's make sure the room doesn't exist already */
-			if(g_hash_table_lookup(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id) != NULL) {
+			if(janus_videoroom_lookup_room(room_id, room_id_str) != NULL) {
 				/* It does... */
 				janus_mutex_unlock(&rooms_mutex);
 				error_code = JANUS_VIDEOROOM_ERROR_ROOM_EXISTS;
@@ -4369,7 +5480,8 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		if(!string_ids && room_id == 0) {
 			while(room_id == 0) {
 				room_id = janus_random_uint64();
-				if(g_hash_table_lookup(rooms, &room_id) != NULL) {
+				g_snprintf(room_id_num, sizeof(room_id_num), "%"SCNu64, room_id);
+				if(janus_videoroom_lookup_room(room_id, room_id_num) != NULL) {
 					/* Room ID already taken, try another one */
 					room_id = 0;
 				}
@@ -4379,7 +5491,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		} else if(string_ids && room_id_str == NULL) {
 			while(room_id_str == NULL) {
 				room_id_str = janus_random_uuid();
-				if(g_hash_table_lookup(rooms, room_id_str) != NULL) {
+				if(janus_videoroom_lookup_room(0, room_id_str) != NULL) {
 					/* Room ID already taken, try another one */
 					g_clear_pointer(&room_id_str, g_free);
 				}
@@ -4427,6 +5539,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		videoroom->fir_freq = 0;
 		if(fir_freq)
 			videoroom->fir_freq = json_integer_value(fir_freq);
+		videoroom->data_batch = 0;
+		if(data_batch)
+			videoroom->data_batch = json_integer_value(data_batch);
 		/* By default, we force Opus as the only audio codec */
 		videoroom->acodec[0] = JANUS_AUDIOCODEC_OPUS;
 		videoroom->acodec[1] = JANUS_AUDIOCODEC_NONE;
@@ -4540,6 +5655,18 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		/* By default, the VideoRoom plugin does not notify about participants simply joining the room.
 		   It only notifies when the participant actually starts publishing media. */
 		videoroom->notify_joining = notify_joining ? json_is_true(notify_joining) : FALSE;
+		if(threads) {
+			videoroom->helper_threads = json_integer_value(threads);
+			if(videoroom->helper_threads > JANUS_VIDEOROOM_MAX_HELPER_THREADS) {
+				JANUS_LOG(LOG_WARN, "Too many helper threads (%d), using %d\n",
+					videoroom->helper_threads, JANUS_VIDEOROOM_MAX_HELPER_THREADS);
+				videoroom->helper_threads = JANUS_VIDEOROOM_MAX_HELPER_THREADS;
+			}
+		}
+		if(threads_threshold)
+			videoroom->helper_threshold = json_integer_value(threads_threshold);
+		if(gop_cache)
+			videoroom->gop_cache_size = (size_t)json_integer_value(gop_cache) * 1024;
 		if(record) {
 			videoroom->record = json_is_true(record);
 		}
@@ -4552,6 +5679,13 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		g_atomic_int_set(&videoroom->destroyed, 0);
 		janus_mutex_init(&videoroom->mutex);
 		janus_refcount_init(&videoroom->ref, janus_videoroom_room_free);
+		videoroom->offer_templates = g_hash_table_new_full(g_str_hash, g_str_equal,
+			(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_offer_template_free);
+		janus_mutex_init(&videoroom->offer_templates_mutex);
+		if(videoroom->helper_threads > 0 && !janus_videoroom_helpers_start(videoroom)) {
+			JANUS_LOG(LOG_WARN, "Couldn't spawn the helper threads for room %s, relaying media inline\n",
+				videoroom->room_id_str);
+		}
 		videoroom->participants = g_hash_table_new_full(string_ids ? g_str_hash : g_int64_hash, string_ids ? g_str_equal : g_int64_equal,
 			(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_publisher_dereference);
 		videoroom->private_ids = g_hash_table_new(NULL, NULL);
@@ -4628,6 +5762,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", videoroom->room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_category *c = janus_config_get_create(config, NULL, janus_config_type_category, cat);
 			/* Now for the values */
 			janus_config_add(config, c, janus_config_item_create("description", videoroom->room_name));
@@ -4651,6 +5786,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->data_batch) {
+				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->data_batch);
+				janus_config_add(config, c, janus_config_item_create("data_batch", value));
+			}
 			char video_codecs[100];
 			char audio_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -4688,6 +5827,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_config_add(config, c, janus_config_item_create("transport_wide_cc_ext", videoroom->transport_wide_cc_ext ? "yes" : "no"));
 			if(videoroom->notify_joining)
 				janus_config_add(config, c, janus_config_item_create("notify_joining", "yes"));
+			if(videoroom->helper_threads > 0) {
+				g_snprintf(value, BUFSIZ, "%d", videoroom->helper_threads);
+				janus_config_add(config, c, janus_config_item_create("threads", value));
+				g_snprintf(value, BUFSIZ, "%u", videoroom->helper_threshold);
+				janus_config_add(config, c, janus_config_item_create("threads_threshold", value));
+			}
+			if(videoroom->gop_cache_size > 0) {
+				g_snprintf(value, BUFSIZ, "%zu", videoroom->gop_cache_size/1024);
+				janus_config_add(config, c, janus_config_item_create("gop_cache_size", value));
+			}
 			if(videoroom->record)
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 			if(videoroom->rec_dir)
@@ -4695,7 +5844,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			if(videoroom->lock_record)
 				janus_config_add(config, c, janus_config_item_create("lock_record", "yes"));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_VIDEOROOM_PACKAGE) < 0)
+			if(!janus_videoroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -4703,16 +5852,19 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		g_hash_table_insert(rooms,
 			string_ids ? (gpointer)g_strdup(videoroom->room_id_str) : (gpointer)janus_uint64_dup(videoroom->room_id),
 			videoroom);
-		/* Show updated rooms list */
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, rooms);
-		while (g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_videoroom *vr = value;
-			JANUS_LOG(LOG_VERB, "  ::: [%s][%s] %"SCNu32", max %d publishers, FIR frequency of %d seconds\n",
-				vr->room_id_str, vr->room_name, vr->bitrate, vr->max_publishers, vr->fir_freq);
+		if(janus_log_level >= LOG_VERB) {
+			/* Show updated rooms list (only if we'd print it, as there may be many) */
+			GHashTableIter iter;
+			gpointer value;
+			g_hash_table_iter_init(&iter, rooms);
+			while (g_hash_table_iter_next(&iter, NULL, &value)) {
+				janus_videoroom *vr = value;
+				JANUS_LOG(LOG_VERB, "  ::: [%s][%s] %"SCNu32", max %d publishers, FIR frequency of %d seconds\n",
+					vr->room_id_str, vr->room_name, vr->bitrate, vr->max_publishers, vr->fir_freq);
+			}
 		}
 		janus_mutex_unlock(&rooms_mutex);
+		janus_videoroom_rooms_list_invalidate();
 		/* Send info back */
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("created"));
@@ -4819,6 +5971,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			char cat[BUFSIZ], value[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", videoroom->room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			/* Remove the old category first */
 			janus_config_remove(config, NULL, cat);
 			/* Now write the room details again */
@@ -4844,6 +5997,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->fir_freq);
 				janus_config_add(config, c, janus_config_item_create("fir_freq", value));
 			}
+			if(videoroom->data_batch) {
+				g_snprintf(value, BUFSIZ, "%"SCNu16, videoroom->data_batch);
+				janus_config_add(config, c, janus_config_item_create("data_batch", value));
+			}
 			char audio_codecs[100];
 			char video_codecs[100];
 			janus_videoroom_codecstr(videoroom, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
@@ -4881,6 +6038,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			janus_config_add(config, c, janus_config_item_create("transport_wide_cc_ext", videoroom->transport_wide_cc_ext ? "yes" : "no"));
 			if(videoroom->notify_joining)
 				janus_config_add(config, c, janus_config_item_create("notify_joining", "yes"));
+			if(videoroom->helper_threads > 0) {
+				g_snprintf(value, BUFSIZ, "%d", videoroom->helper_threads);
+				janus_config_add(config, c, janus_config_item_create("threads", value));
+				g_snprintf(value, BUFSIZ, "%u", videoroom->helper_threshold);
+				janus_config_add(config, c, janus_config_item_create("threads_threshold", value));
+			}
+			if(videoroom->gop_cache_size > 0) {
+				g_snprintf(value, BUFSIZ, "%zu", videoroom->gop_cache_size/1024);
+				janus_config_add(config, c, janus_config_item_create("gop_cache_size", value));
+			}
 			if(videoroom->record)
 				janus_config_add(config, c, janus_config_item_create("record", "yes"));
 			if(videoroom->rec_dir)
@@ -4888,11 +6055,12 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			if(videoroom->lock_record)
 				janus_config_add(config, c, janus_config_item_create("lock_record", "yes"));
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_VIDEOROOM_PACKAGE) < 0)
+			if(!janus_videoroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room changes are not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
 		janus_mutex_unlock(&rooms_mutex);
+		janus_videoroom_rooms_list_invalidate();
 		/* Send info back */
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("edited"));
@@ -4982,6 +6150,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			gateway->notify_event(&janus_videoroom_plugin, session ? session->handle : NULL, info);
 		}
 		janus_mutex_unlock(&rooms_mutex);
+		janus_videoroom_rooms_list_invalidate();
 		if(save) {
 			/* This change is permanent: save to the configuration file too
 			 * FIXME: We should check if anything fails... */
@@ -4990,9 +6159,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			char cat[BUFSIZ];
 			/* The room ID is the category (prefixed by "room-") */
 			g_snprintf(cat, BUFSIZ, "room-%s", room_id_str);
+			gboolean in_config = (janus_config_get(config, NULL, janus_config_type_category, cat) != NULL);
 			janus_config_remove(config, NULL, cat);
 			/* Save modified configuration */
-			if(janus_config_save(config, config_folder, JANUS_VIDEOROOM_PACKAGE) < 0)
+			if(!janus_videoroom_save_room(cat, in_config))
 				save = FALSE;	/* This will notify the user the room destruction is not permanent */
 			janus_mutex_unlock(&config_mutex);
 		}
@@ -5020,64 +6190,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				}
 			}
 		}
-		json_t *list = json_array();
-		janus_mutex_lock(&rooms_mutex);
-		GHashTableIter iter;
-		gpointer value;
-		g_hash_table_iter_init(&iter, rooms);
-		while(g_hash_table_iter_next(&iter, NULL, &value)) {
-			janus_videoroom *room = value;
-			if(!room)
-				continue;
-			janus_refcount_increase(&room->ref);
-			if(room->is_private && lock_room_list) {
-				/* Skip private room if no valid admin_key was provided */
-				JANUS_LOG(LOG_VERB, "Skipping private room '%s'\n", room->room_name);
-				janus_refcount_decrease(&room->ref);
-				continue;
-			}
-			if(!g_atomic_int_get(&room->destroyed)) {
-				json_t *rl = json_object();
-				json_object_set_new(rl, "room", string_ids ? json_string(room->room_id_str) : json_integer(room->room_id));
-				json_object_set_new(rl, "description", json_string(room->room_name));
-				json_object_set_new(rl, "pin_required", room->room_pin ? json_true() : json_false());
-				json_object_set_new(rl, "is_private", room->is_private ? json_true() : json_false());
-				json_object_set_new(rl, "max_publishers", json_integer(room->max_publishers));
-				json_object_set_new(rl, "bitrate", json_integer(room->bitrate));
-				if(room->bitrate_cap)
-					json_object_set_new(rl, "bitrate_cap", json_true());
-				json_object_set_new(rl, "fir_freq", json_integer(room->fir_freq));
-				json_object_set_new(rl, "require_pvtid", room->require_pvtid ? json_true() : json_false());
-				json_object_set_new(rl, "require_e2ee", room->require_e2ee ? json_true() : json_false());
-				json_object_set_new(rl, "dummy_publisher", room->dummy_publisher ? json_true() : json_false());
-				json_object_set_new(rl, "notify_joining", room->notify_joining ? json_true() : json_false());
-				char audio_codecs[100];
-				char video_codecs[100];
-				janus_videoroom_codecstr(room, audio_codecs, video_codecs, sizeof(audio_codecs), ",");
-				json_object_set_new(rl, "audiocodec", json_string(audio_codecs));
-				json_object_set_new(rl, "videocodec", json_string(video_codecs));
-				if(room->do_opusfec)
-					json_object_set_new(rl, "opus_fec", json_true());
-				if(room->do_opusdtx)
-					json_object_set_new(rl, "opus_dtx", json_true());
-				json_object_set_new(rl, "record", room->record ? json_true() : json_false());
-				json_object_set_new(rl, "rec_dir", json_string(room->rec_dir));
-				json_object_set_new(rl, "lock_record", room->lock_record ? json_true() : json_false());
-				json_object_set_new(rl, "num_participants", json_integer(g_hash_table_size(room->participants)));
-				json_object_set_new(rl, "audiolevel_ext", room->audiolevel_ext ? json_true() : json_false());
-				json_object_set_new(rl, "audiolevel_event", room->audiolevel_event ? json_true() : json_false());
-				if(room->audiolevel_event) {
-					json_object_set_new(rl, "audio_active_packets", json_integer(room->audio_active_packets));
-					json_object_set_new(rl, "audio_level_average", json_integer(room->audio_level_average));
-				}
-				json_object_set_new(rl, "videoorient_ext", room->videoorient_ext ? json_true() : json_false());
-				json_object_set_new(rl, "playoutdelay_ext", room->playoutdelay_ext ? json_true() : json_false());
-				json_object_set_new(rl, "transport_wide_cc_ext", room->transport_wide_cc_ext ? json_true() : json_false());
-				json_array_append_new(list, rl);
-			}
-			janus_refcount_decrease(&room->ref);
-		}
-		janus_mutex_unlock(&rooms_mutex);
+		json_t *list = janus_videoroom_rooms_list_get(!lock_room_list);
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("success"));
 		json_object_set_new(response, "list", list);
@@ -5209,6 +6322,17 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 					JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
 				if(error_code != 0)
 					goto prepare_response;
+				/* Validate the mirrors, if any */
+				json_t *stream_mirrors = json_object_get(s, "mirrors");
+				size_t j = 0;
+				for(j=0; j<json_array_size(stream_mirrors); j++) {
+					json_t *m = json_array_get(stream_mirrors, j);
+					JANUS_VALIDATE_JSON_OBJECT(m, rtp_forward_mirror_parameters,
+						error_code, error_cause, TRUE,
+						JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+					if(error_code != 0)
+						goto prepare_response;
+				}
 				/* Make sure we have a host attribute, either global or stream-specific */
 				json_t *stream_host = json_object_get(s, "host");
 				const char *s_host = json_string_value(stream_host);
@@ -5378,6 +6502,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 						json_integer_value(stream_pt), json_integer_value(stream_ssrc),
 						FALSE, srtp_suite, srtp_crypto, 0, FALSE, FALSE);
 					if(f) {
+						janus_videoroom_rtp_forwarder_add_mirrors(f, json_object_get(s, "mirrors"));
 						json_t *rtpf = janus_videoroom_rtp_forwarder_summary(f);
 						json_array_append_new(new_forwarders, rtpf);
 						/* Also notify event handlers */
@@ -5403,6 +6528,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 						json_integer_value(stream_pt), json_integer_value(stream_ssrc),
 						json_is_true(stream_simulcast), srtp_suite, srtp_crypto, 0, TRUE, FALSE);
 					if(f) {
+						janus_videoroom_rtp_forwarder_add_mirrors(f, json_object_get(s, "mirrors"));
 						json_t *rtpf = janus_videoroom_rtp_forwarder_summary(f);
 						json_array_append_new(new_forwarders, rtpf);
 						/* Also notify event handlers */
@@ -5773,6 +6899,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
 		if(error_code != 0)
 			goto prepare_response;
+		json_t *mirrors = json_object_get(root, "mirrors");
+		size_t i = 0;
+		for(i=0; i<json_array_size(mirrors); i++) {
+			json_t *m = json_array_get(mirrors, i);
+			JANUS_VALIDATE_JSON_OBJECT(m, rtp_forward_mirror_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+		}
 		if(lock_rtpfwd && admin_key != NULL) {
 			/* An admin key was specified: make sure it was provided, and that it's valid */
 			JANUS_VALIDATE_JSON_OBJECT(root, adminkey_parameters,
@@ -5844,6 +6980,21 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 					found = FALSE;
 					break;
 				}
+				if(mirrors != NULL) {
+					/* Only remove the specified mirrors, and keep the forwarder */
+					for(i=0; i<json_array_size(mirrors); i++) {
+						json_t *m = json_array_get(mirrors, i);
+						const char *m_host = json_string_value(json_object_get(m, "host"));
+						int m_port = json_integer_value(json_object_get(m, "port"));
+						if(janus_rtp_forwarder_remove_mirror(f, m_host, m_port) < 0) {
+							JANUS_LOG(LOG_WARN, "No mirror %s:%d in RTP forwarder %"SCNu32"\n",
+								m_host, m_port, stream_id);
+						}
+					}
+					janus_mutex_unlock(&ps->rtp_forwarders_mutex);
+					found = TRUE;
+					break;
+				}
 				g_hash_table_remove(ps->rtp_forwarders, GUINT_TO_POINTER(stream_id));
 				janus_mutex_unlock(&ps->rtp_forwarders_mutex);
 				/* Found, remove from global index too */
@@ -5869,8 +7020,8 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		json_object_set_new(response, "room", string_ids ? json_string(room_id_str) : json_integer(room_id));
 		json_object_set_new(response, "publisher_id", string_ids ? json_string(publisher_id_str) : json_integer(publisher_id));
 		json_object_set_new(response, "stream_id", json_integer(stream_id));
-		/* Also notify event handlers */
-		if(notify_events && gateway->events_is_enabled()) {
+		/* Also notify event handlers, unless we only removed some mirrors */
+		if(mirrors == NULL && notify_events && gateway->events_is_enabled()) {
 			json_t *info = json_object();
 			json_object_set_new(info, "event", json_string("stop_rtp_forward"));
 			json_object_set_new(info, "room", string_ids ? json_string(room_id_str) : json_integer(room_id));
@@ -5903,7 +7054,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			room_id_str = (char *)json_string_value(room);
 		}
 		janus_mutex_lock(&rooms_mutex);
-		gboolean room_exists = g_hash_table_contains(rooms, string_ids ? (gpointer)room_id_str : (gpointer)&room_id);
+		gboolean room_exists = (janus_videoroom_lookup_room(room_id, room_id_str) != NULL);
 		janus_mutex_unlock(&rooms_mutex);
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("success"));
@@ -6551,6 +7702,16 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			g_snprintf(error_cause, 512, "Invalid element (port must be a non-zero positive integer)");
 			goto prepare_response;
 		}
+		/* If the remote side is a trunk, it will have told us which SSRC base to use */
+		uint32_t ssrc_base = json_integer_value(json_object_get(root, "ssrc_base"));
+		if(ssrc_base == 0) {
+			ssrc_base = REMOTE_PUBLISHER_BASE_SSRC;
+		} else if(ssrc_base % REMOTE_PUBLISHER_SSRC_BLOCK != 0) {
+			JANUS_LOG(LOG_ERR, "Invalid element (ssrc_base must be a multiple of %d)\n", REMOTE_PUBLISHER_SSRC_BLOCK);
+			error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+			g_snprintf(error_cause, 512, "Invalid element (ssrc_base must be a multiple of %d)", REMOTE_PUBLISHER_SSRC_BLOCK);
+			goto prepare_response;
+		}
 		int family = 0;
 		if(host_family) {
 			if(!strcasecmp(host_family, "ipv4")) {
@@ -6682,7 +7843,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				/* Audio stream */
 				f = janus_videoroom_rtp_forwarder_add_helper(publisher, ps,
 					host, port, -1, 0,
-					(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+					(ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
 					FALSE, 0, NULL, 0, FALSE, FALSE);
 				if(f != NULL)
 					f->metadata = g_strdup(remote_id);
@@ -6691,7 +7852,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				add_rtcp = (!rtcp_added && rtcp_port > 0);
 				f = janus_videoroom_rtp_forwarder_add_helper(publisher, ps,
 					host, port, add_rtcp ? rtcp_port : -1, 0,
-					(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+					(ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
 					FALSE, 0, NULL, 0, TRUE, FALSE);
 				if(f != NULL)
 					f->metadata = g_strdup(remote_id);
@@ -6701,7 +7862,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				if(ps->vssrc[1] || ps->rid[1]) {
 					f = janus_videoroom_rtp_forwarder_add_helper(publisher, ps,
 						host, port, -1, 0,
-						(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 1),
+						(ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 1),
 						FALSE, 0, NULL, 1, TRUE, FALSE);
 					if(f != NULL)
 						f->metadata = g_strdup(remote_id);
@@ -6709,7 +7870,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				if(ps->vssrc[2] || ps->rid[2]) {
 					f = janus_videoroom_rtp_forwarder_add_helper(publisher, ps,
 						host, port, -1, 0,
-						(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 2),
+						(ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 2),
 						FALSE, 0, NULL, 2, TRUE, FALSE);
 					if(f != NULL)
 						f->metadata = g_strdup(remote_id);
@@ -6718,7 +7879,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 				/* Data stream */
 				f = janus_videoroom_rtp_forwarder_add_helper(publisher, ps,
 					host, port, -1, 0,
-					(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+					(ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
 					FALSE, 0, NULL, 0, FALSE, TRUE);
 				if(f != NULL)
 					f->metadata = g_strdup(remote_id);
@@ -6733,6 +7894,7 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		recipient->port = port;
 		recipient->rtcp_port = rtcp_port;
 		recipient->rtcp_added = rtcp_added;
+		recipient->ssrc_base = ssrc_base;
 		g_hash_table_insert(publisher->remote_recipients, g_strdup(remote_id), recipient);
 		/* Done */
 		janus_mutex_unlock(&publisher->rtp_forwarders_mutex);
@@ -7004,6 +8166,21 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		if(error_code != 0)
 			goto prepare_response;
+		/* Check if a specific SSRC base was requested */
+		uint32_t ssrc_base = json_integer_value(json_object_get(root, "ssrc_base"));
+		if(ssrc_base % REMOTE_PUBLISHER_SSRC_BLOCK != 0) {
+			error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+			JANUS_LOG(LOG_ERR, "Invalid element value (ssrc_base must be a multiple of %d)\n", REMOTE_PUBLISHER_SSRC_BLOCK);
+			g_snprintf(error_cause, 512, "Invalid element value (ssrc_base must be a multiple of %d)", REMOTE_PUBLISHER_SSRC_BLOCK);
+			goto prepare_response;
+		}
+		if(json_object_get(root, "trunk") != NULL &&
+				json_array_size(streams) > REMOTE_PUBLISHER_SSRC_BLOCK/REMOTE_PUBLISHER_SSRC_STEP) {
+			error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+			JANUS_LOG(LOG_ERR, "Invalid element value (too many streams for a trunk)\n");
+			g_snprintf(error_cause, 512, "Invalid element value (too many streams for a trunk)");
+			goto prepare_response;
+		}
 		/* Now access the room */
 		janus_mutex_lock(&rooms_mutex);
 		janus_videoroom *videoroom = NULL;
@@ -7069,64 +8246,62 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			}
 			JANUS_LOG(LOG_VERB, "  -- Participant ID: %s\n", user_id_str);
 		}
-		/* Create the socket we'll need for this remote publisher */
-		const char *mcast = json_string_value(json_object_get(root, "mcast"));
-		const char *iface = json_string_value(json_object_get(root, "iface"));
-		janus_network_address miface;
-		if(iface) {
-			struct ifaddrs *ifas = NULL;
-			if(getifaddrs(&ifas) == -1) {
-				JANUS_LOG(LOG_ERR, "Unable to acquire list of network devices/interfaces; remote publishers may not work as expected... %d (%s)\n",
-					errno, g_strerror(errno));
-			}
-			if(janus_network_lookup_interface(ifas, iface, &miface) != 0) {
+		/* Check if this remote publisher will be received on a trunk, or needs sockets of its own */
+		janus_videoroom_remote_trunk *trunk = NULL;
+		uint16_t port = 0, rtcp_port = 0;
+		char host[46];
+		host[0] = '\0';
+		int fd = -1, rtcp_fd = -1;
+		const char *trunk_id = json_string_value(json_object_get(root, "trunk"));
+		if(trunk_id != NULL) {
+			janus_mutex_lock(&remote_trunks_mutex);
+			trunk = g_hash_table_lookup(remote_trunks, trunk_id);
+			if(trunk == NULL || g_atomic_int_get(&trunk->destroyed)) {
+				janus_mutex_unlock(&remote_trunks_mutex);
 				if(user_id_allocated)
 					g_free(user_id_str);
-				if(ifas)
-					freeifaddrs(ifas);
 				janus_mutex_unlock(&videoroom->mutex);
 				janus_refcount_decrease(&videoroom->ref);
-				JANUS_LOG(LOG_ERR, "Invalid network interface configuration for remote publisher...\n");
-				error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-				g_snprintf(error_cause, 512, ifas ? "Invalid network interface configuration for remote publisher" : "Unable to query network device information");
+				JANUS_LOG(LOG_ERR, "No such trunk (%s)\n", trunk_id);
+				error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+				g_snprintf(error_cause, 512, "No such trunk (%s)", trunk_id);
 				goto prepare_response;
 			}
-			if(ifas)
-				freeifaddrs(ifas);
+			janus_refcount_increase(&trunk->ref);
+			janus_mutex_unlock(&remote_trunks_mutex);
+			/* We keep the trunk locked until the publisher is added, so that the SSRC base stays ours */
+			janus_mutex_lock(&trunk->mutex);
+			uint32_t base = janus_videoroom_remote_trunk_ssrc_base(trunk, ssrc_base);
+			if(base == 0) {
+				janus_mutex_unlock(&trunk->mutex);
+				janus_refcount_decrease(&trunk->ref);
+				if(user_id_allocated)
+					g_free(user_id_str);
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				JANUS_LOG(LOG_ERR, "SSRC base %"SCNu32" already in use in trunk %s\n", ssrc_base, trunk_id);
+				error_code = JANUS_VIDEOROOM_ERROR_ID_EXISTS;
+				g_snprintf(error_cause, 512, "SSRC base %"SCNu32" already in use in trunk %s", ssrc_base, trunk_id);
+				goto prepare_response;
+			}
+			ssrc_base = base;
+			port = trunk->port;
+			rtcp_port = trunk->rtcp_port;
+			g_strlcpy(host, trunk->host, sizeof(host));
 		} else {
-			janus_network_address_nullify(&miface);
-		}
-		uint16_t port = json_integer_value(json_object_get(root, "port"));
-		uint16_t rtcp_port = json_integer_value(json_object_get(root, "rtcp_port"));
-		char host[46];
-		host[0] = '\0';
-		int fd = janus_videoroom_create_fd(port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
-		if(fd < 0) {
-			if(user_id_allocated)
-				g_free(user_id_str);
-			janus_mutex_unlock(&videoroom->mutex);
-			janus_refcount_decrease(&videoroom->ref);
-			JANUS_LOG(LOG_ERR, "Could not open UDP socket for RTP stream for remote publisher, %d (%s)\n",
-				errno, g_strerror(errno));
-			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-			g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
-			goto prepare_response;
-		}
-		port = janus_videoroom_get_fd_port(fd);
-		int rtcp_fd = janus_videoroom_create_fd(rtcp_port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, sizeof(host));
-		if(rtcp_fd < 0) {
-			close(fd);
-			if(user_id_allocated)
-				g_free(user_id_str);
-			janus_mutex_unlock(&videoroom->mutex);
-			janus_refcount_decrease(&videoroom->ref);
-			JANUS_LOG(LOG_ERR, "Could not open UDP socket for remote publisher RTCP, %d (%s)\n",
-				errno, g_strerror(errno));
-			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
-			g_snprintf(error_cause, 512, "Could not open UDP socket for RTP stream");
-			goto prepare_response;
+			/* Create the sockets we'll need for this remote publisher */
+			error_code = janus_videoroom_remote_fds_create(root, &fd, &rtcp_fd,
+				&port, &rtcp_port, host, sizeof(host), error_cause, sizeof(error_cause));
+			if(error_code != 0) {
+				if(user_id_allocated)
+					g_free(user_id_str);
+				janus_mutex_unlock(&videoroom->mutex);
+				janus_refcount_decrease(&videoroom->ref);
+				goto prepare_response;
+			}
+			if(ssrc_base == 0)
+				ssrc_base = REMOTE_PUBLISHER_BASE_SSRC;
 		}
-		rtcp_port = janus_videoroom_get_fd_port(rtcp_fd);
 		/* We create a dummy session first, that's not actually bound to anything */
 		janus_videoroom_session *session = g_malloc0(sizeof(janus_videoroom_session));
 		session->handle = NULL;
@@ -7151,7 +8326,13 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		publisher->remote = TRUE;
 		publisher->remote_fd = fd;
 		publisher->remote_rtcp_fd = rtcp_fd;
-		pipe(publisher->pipefd);
+		publisher->remote_ssrc_base = ssrc_base;
+		if(trunk == NULL) {
+			pipe(publisher->pipefd);
+		} else {
+			publisher->pipefd[0] = -1;
+			publisher->pipefd[1] = -1;
+		}
 		janus_mutex_init(&publisher->subscribers_mutex);
 		janus_mutex_init(&publisher->own_subscriptions_mutex);
 		publisher->streams_byid = g_hash_table_new_full(NULL, NULL,
@@ -7245,9 +8426,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 					ps->simulcast = json_is_true(json_object_get(s, "simulcast"));
 					ps->svc = json_is_true(json_object_get(s, "svc"));
 					if(ps->simulcast) {
-						ps->vssrc[0] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP);
-						ps->vssrc[1] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 1;
-						ps->vssrc[2] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 2;
+						ps->vssrc[0] = ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP);
+						ps->vssrc[1] = ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 1;
+						ps->vssrc[2] = ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 2;
 					}
 				}
 				int video_orient_extmap_id = json_integer_value(json_object_get(s, "videoorient_ext_id"));
@@ -7275,13 +8456,22 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			g_hash_table_insert(publisher->streams_bymid, g_strdup(ps->mid), ps);
 			mindex++;
 		}
-		/* Done, spawn a thread for this remote publisher */
+		/* Done, spawn a thread for this remote publisher, or hand it to the trunk */
 		janus_refcount_increase(&publisher->ref);
 		janus_refcount_increase(&publisher->session->ref);
 		GError *error = NULL;
-		char tname[16];
-		g_snprintf(tname, sizeof(tname), "vremote %s", publisher->user_id_str);
-		publisher->remote_thread = g_thread_try_new(tname, janus_videoroom_remote_publisher_thread, publisher, &error);
+		if(trunk != NULL) {
+			/* The publisher takes the trunk reference we got, and the
+			 * trunk thread will be responsible for adding it to the room */
+			publisher->trunk = trunk;
+			trunk->joining = g_list_append(trunk->joining, publisher);
+			janus_mutex_unlock(&trunk->mutex);
+			janus_videoroom_remote_trunk_notify(trunk);
+		} else {
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "vremote %s", publisher->user_id_str);
+			publisher->remote_thread = g_thread_try_new(tname, janus_videoroom_remote_publisher_thread, publisher, &error);
+		}
 		if(error != NULL) {
 			/* Something went wrong */
 			janus_mutex_unlock(&videoroom->mutex);
@@ -7307,6 +8497,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 			json_object_set_new(response, "ip", json_string(host));
 		json_object_set_new(response, "port", json_integer(port));
 		json_object_set_new(response, "rtcp_port", json_integer(rtcp_port));
+		if(trunk != NULL)
+			json_object_set_new(response, "trunk", json_string(trunk_id));
+		json_object_set_new(response, "ssrc_base", json_integer(ssrc_base));
 		goto prepare_response;
 	} else if(!strcasecmp(request_text, "update_remote_publisher")) {
 		/* Update an existing remote publisher */
@@ -7521,9 +8714,9 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 					ps->simulcast = json_is_true(json_object_get(s, "simulcast"));
 					ps->svc = json_is_true(json_object_get(s, "svc"));
 					if(ps->simulcast) {
-						ps->vssrc[0] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP);
-						ps->vssrc[1] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 1;
-						ps->vssrc[2] = REMOTE_PUBLISHER_BASE_SSRC + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 2;
+						ps->vssrc[0] = publisher->remote_ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP);
+						ps->vssrc[1] = publisher->remote_ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 1;
+						ps->vssrc[2] = publisher->remote_ssrc_base + (mindex*REMOTE_PUBLISHER_SSRC_STEP) + 2;
 					}
 				}
 				int video_orient_extmap_id = json_integer_value(json_object_get(s, "videoorient_ext_id"));
@@ -7618,8 +8811,10 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		}
 		/* Mark the remote publisher as leaving, the thread will do the cleanup */
 		g_atomic_int_set(&publisher->remote_leaving, 1);
-		/* Notify the thread that it's time to go */
-		if(publisher->pipefd[1] > 0) {
+		/* Notify the thread (or the trunk) that it's time to go */
+		if(publisher->trunk != NULL) {
+			janus_videoroom_remote_trunk_notify(publisher->trunk);
+		} else if(publisher->pipefd[1] > 0) {
 			int code = 1;
 			ssize_t res = 0;
 			do {
@@ -7632,6 +8827,160 @@ static json_t *janus_videoroom_process_synchronous_request(janus_videoroom_sessi
 		response = json_object();
 		json_object_set_new(response, "videoroom", json_string("success"));
 		goto prepare_response;
+	} else if(!strcasecmp(request_text, "add_remote_trunk")) {
+		/* Create a trunk multiple remote publishers can be received on */
+		JANUS_VALIDATE_JSON_OBJECT(root, remote_trunk_parameters,
+			error_code, error_cause, TRUE,
+			JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+		if(error_code != 0)
+			goto prepare_response;
+		if(admin_key != NULL) {
+			/* An admin key was specified: make sure it was provided, and that it's valid */
+			JANUS_VALIDATE_JSON_OBJECT(root, adminkey_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+			JANUS_CHECK_SECRET(admin_key, root, "admin_key", error_code, error_cause,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT, JANUS_VIDEOROOM_ERROR_UNAUTHORIZED);
+			if(error_code != 0)
+				goto prepare_response;
+		}
+		const char *trunk_id = json_string_value(json_object_get(root, "trunk_id"));
+		janus_mutex_lock(&remote_trunks_mutex);
+		if(trunk_id != NULL && g_hash_table_lookup(remote_trunks, trunk_id) != NULL) {
+			janus_mutex_unlock(&remote_trunks_mutex);
+			JANUS_LOG(LOG_ERR, "Trunk %s already exists\n", trunk_id);
+			error_code = JANUS_VIDEOROOM_ERROR_ID_EXISTS;
+			g_snprintf(error_cause, 512, "Trunk %s already exists", trunk_id);
+			goto prepare_response;
+		}
+		janus_videoroom_remote_trunk *trunk = g_malloc0(sizeof(janus_videoroom_remote_trunk));
+		error_code = janus_videoroom_remote_fds_create(root, &trunk->fd, &trunk->rtcp_fd,
+			&trunk->port, &trunk->rtcp_port, trunk->host, sizeof(trunk->host), error_cause, sizeof(error_cause));
+		if(error_code != 0) {
+			janus_mutex_unlock(&remote_trunks_mutex);
+			g_free(trunk);
+			goto prepare_response;
+		}
+		if(trunk_id != NULL) {
+			trunk->trunk_id = g_strdup(trunk_id);
+		} else {
+			/* Generate a random ID */
+			while(trunk->trunk_id == NULL) {
+				trunk->trunk_id = janus_random_uuid();
+				if(g_hash_table_lookup(remote_trunks, trunk->trunk_id) != NULL) {
+					/* Trunk ID already taken, try another one */
+					g_clear_pointer(&trunk->trunk_id, g_free);
+				}
+			}
+		}
+		pipe(trunk->pipefd);
+		trunk->publishers = g_hash_table_new(NULL, NULL);
+		janus_mutex_init(&trunk->mutex);
+		g_atomic_int_set(&trunk->destroyed, 0);
+		janus_refcount_init(&trunk->ref, janus_videoroom_remote_trunk_free);
+		/* Spawn the thread that will receive the media for this trunk */
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "vtrunk %s", trunk->trunk_id);
+		janus_refcount_increase(&trunk->ref);
+		trunk->thread = g_thread_try_new(tname, janus_videoroom_remote_trunk_thread, trunk, &error);
+		if(error != NULL) {
+			janus_mutex_unlock(&remote_trunks_mutex);
+			JANUS_LOG(LOG_ERR, "Could not spawn thread for trunk, %d (%s)\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_refcount_decrease(&trunk->ref);
+			janus_refcount_decrease(&trunk->ref);
+			error_code = JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+			g_snprintf(error_cause, 512, "Could not spawn thread for trunk");
+			goto prepare_response;
+		}
+		g_hash_table_insert(remote_trunks, g_strdup(trunk->trunk_id), trunk);
+		janus_mutex_unlock(&remote_trunks_mutex);
+		JANUS_LOG(LOG_VERB, "Created trunk %s (port %"SCNu16", RTCP port %"SCNu16")\n",
+			trunk->trunk_id, trunk->port, trunk->rtcp_port);
+		/* Done, return connectivity information */
+		response = json_object();
+		json_object_set_new(response, "videoroom", json_string("success"));
+		json_object_set_new(response, "trunk_id", json_string(trunk->trunk_id));
+		if(strlen(trunk->host) > 0)
+			json_object_set_new(response, "ip", json_string(trunk->host));
+		json_object_set_new(response, "port", json_integer(trunk->port));
+		json_object_set_new(response, "rtcp_port", json_integer(trunk->rtcp_port));
+		goto prepare_response;
+	} else if(!strcasecmp(request_text, "remove_remote_trunk")) {
+		/* Get rid of a trunk, and all the remote publishers received on it */
+		JANUS_VALIDATE_JSON_OBJECT(root, remote_trunk_id_parameters,
+			error_code, error_cause, TRUE,
+			JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+		if(error_code != 0)
+			goto prepare_response;
+		if(admin_key != NULL) {
+			/* An admin key was specified: make sure it was provided, and that it's valid */
+			JANUS_VALIDATE_JSON_OBJECT(root, adminkey_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+			JANUS_CHECK_SECRET(admin_key, root, "admin_key", error_code, error_cause,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT, JANUS_VIDEOROOM_ERROR_UNAUTHORIZED);
+			if(error_code != 0)
+				goto prepare_response;
+		}
+		const char *trunk_id = json_string_value(json_object_get(root, "trunk_id"));
+		janus_mutex_lock(&remote_trunks_mutex);
+		if(!g_hash_table_remove(remote_trunks, trunk_id)) {
+			janus_mutex_unlock(&remote_trunks_mutex);
+			JANUS_LOG(LOG_ERR, "No such trunk (%s)\n", trunk_id);
+			error_code = JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT;
+			g_snprintf(error_cause, 512, "No such trunk (%s)", trunk_id);
+			goto prepare_response;
+		}
+		janus_mutex_unlock(&remote_trunks_mutex);
+		/* Done */
+		response = json_object();
+		json_object_set_new(response, "videoroom", json_string("success"));
+		goto prepare_response;
+	} else if(!strcasecmp(request_text, "list_remote_trunks")) {
+		/* List the existing trunks */
+		if(admin_key != NULL) {
+			/* An admin key was specified: make sure it was provided, and that it's valid */
+			JANUS_VALIDATE_JSON_OBJECT(root, adminkey_parameters,
+				error_code, error_cause, TRUE,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT);
+			if(error_code != 0)
+				goto prepare_response;
+			JANUS_CHECK_SECRET(admin_key, root, "admin_key", error_code, error_cause,
+				JANUS_VIDEOROOM_ERROR_MISSING_ELEMENT, JANUS_VIDEOROOM_ERROR_INVALID_ELEMENT, JANUS_VIDEOROOM_ERROR_UNAUTHORIZED);
+			if(error_code != 0)
+				goto prepare_response;
+		}
+		json_t *list = json_array();
+		janus_mutex_lock(&remote_trunks_mutex);
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, remote_trunks);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_videoroom_remote_trunk *trunk = (janus_videoroom_remote_trunk *)value;
+			json_t *t = json_object();
+			json_object_set_new(t, "trunk_id", json_string(trunk->trunk_id));
+			if(strlen(trunk->host) > 0)
+				json_object_set_new(t, "ip", json_string(trunk->host));
+			json_object_set_new(t, "port", json_integer(trunk->port));
+			json_object_set_new(t, "rtcp_port", json_integer(trunk->rtcp_port));
+			janus_mutex_lock(&trunk->mutex);
+			json_object_set_new(t, "publishers",
+				json_integer(g_hash_table_size(trunk->publishers) + g_list_length(trunk->joining)));
+			janus_mutex_unlock(&trunk->mutex);
+			json_array_append_new(list, t);
+		}
+		janus_mutex_unlock(&remote_trunks_mutex);
+		response = json_object();
+		json_object_set_new(response, "videoroom", json_string("success"));
+		json_object_set_new(response, "trunks", list);
+		goto prepare_response;
 	} else {
 		/* Not a request we recognize, don't do anything */
 		return NULL;
@@ -7655,6 +9004,77 @@ prepare_response:
 
 }
 
+/* Helper to pick the handler thread an asynchronous request should be queued to:
+ * a session sticks to the same thread as long as it has pending messages, so
+ * that its requests are never reordered, and otherwise follows the room the
+ * request is addressed to, if any, so that requests for a room are serialized */
+static guint janus_videoroom_message_route(janus_videoroom_session *session, json_t *message) {
+	janus_mutex_lock(&session->mutex);
+	if(handler_threads > 1 && g_atomic_int_get(&session->pending_messages) == 0) {
+		json_t *room = json_object_get(message, "room");
+		if(json_is_integer(room))
+			session->handler_index = (guint)((guint64)json_integer_value(room) % handler_threads);
+		else if(json_is_string(room))
+			session->handler_index = g_str_hash(json_string_value(room)) % handler_threads;
+	}
+	guint index = session->handler_index;
+	g_atomic_int_inc(&session->pending_messages);
+	janus_mutex_unlock(&session->mutex);
+	return index;
+}
+
+/* Helper to keep track of how long asynchronous requests take */
+static void janus_videoroom_request_stats_update(const char *request, gint64 elapsed) {
+	janus_mutex_lock(&request_stats_mutex);
+	if(request_stats == NULL) {
+		janus_mutex_unlock(&request_stats_mutex);
+		return;
+	}
+	janus_videoroom_request_stats *stats = g_hash_table_lookup(request_stats, request);
+	if(stats == NULL) {
+		stats = g_malloc0(sizeof(janus_videoroom_request_stats));
+		g_hash_table_insert(request_stats, g_strdup(request), stats);
+	}
+	stats->count++;
+	stats->total_time += elapsed;
+	if(elapsed > stats->max_time)
+		stats->max_time = elapsed;
+	janus_mutex_unlock(&request_stats_mutex);
+}
+
+/* Admin API request to inspect the handler threads and the request timing */
+static json_t *janus_videoroom_query_handler(void) {
+	json_t *response = json_object();
+	json_object_set_new(response, "videoroom", json_string("handler"));
+	json_object_set_new(response, "handler_threads", json_integer(handler_threads));
+	json_t *list = json_array();
+	guint i = 0;
+	for(i=0; i<handler_threads; i++) {
+		json_t *ht = json_object();
+		json_object_set_new(ht, "id", json_integer(handlers[i].id));
+		json_object_set_new(ht, "queued", json_integer(g_async_queue_length(handlers[i].messages)));
+		json_object_set_new(ht, "processed", json_integer(g_atomic_int_get(&handlers[i].processed)));
+		json_array_append_new(list, ht);
+	}
+	json_object_set_new(response, "handlers", list);
+	json_t *requests = json_object();
+	janus_mutex_lock(&request_stats_mutex);
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, request_stats);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		janus_videoroom_request_stats *stats = (janus_videoroom_request_stats *)value;
+		json_t *rs = json_object();
+		json_object_set_new(rs, "count", json_integer(stats->count));
+		json_object_set_new(rs, "avg_time", json_integer(stats->count ? stats->total_time/(gint64)stats->count : 0));
+		json_object_set_new(rs, "max_time", json_integer(stats->max_time));
+		json_object_set_new(requests, (const char *)key, rs);
+	}
+	janus_mutex_unlock(&request_stats_mutex);
+	json_object_set_new(response, "requests", requests);
+	return response;
+}
+
 struct janus_plugin_result *janus_videoroom_handle_message(janus_plugin_session *handle, char *transaction, json_t *message, json_t *jsep) {
 	if(g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
 		return janus_plugin_result_new(JANUS_PLUGIN_ERROR, g_atomic_int_get(&stopping) ? "Shutting down" : "Plugin not initialized", NULL);
@@ -7722,7 +9142,8 @@ struct janus_plugin_result *janus_videoroom_handle_message(janus_plugin_session
 		msg->transaction = transaction;
 		msg->message = root;
 		msg->jsep = jsep;
-		g_async_queue_push(messages, msg);
+		guint index = janus_videoroom_message_route(session, root);
+		g_async_queue_push(handlers[index].messages, msg);
 
 		return janus_plugin_result_new(JANUS_PLUGIN_OK_WAIT, NULL, NULL);
 	} else {
@@ -7771,7 +9192,11 @@ json_t *janus_videoroom_handle_admin_message(json_t *message) {
 		goto admin_response;
 	json_t *request = json_object_get(message, "request");
 	const char *request_text = json_string_value(request);
-	if((response = janus_videoroom_process_synchronous_request(NULL, message)) != NULL) {
+	if(!strcasecmp(request_text, "query_handler")) {
+		/* This request is only available via Admin API */
+		response = janus_videoroom_query_handler();
+		goto admin_response;
+	} else if((response = janus_videoroom_process_synchronous_request(NULL, message)) != NULL) {
 		/* We got a response, send it back */
 		goto admin_response;
 	} else {
@@ -7844,7 +9269,12 @@ void janus_videoroom_setup_media(janus_plugin_session *handle) {
 					janus_videoroom_subscriber_stream *ss = (janus_videoroom_subscriber_stream *)temp->data;
 					janus_videoroom_publisher_stream *ps = ss->publisher_streams ? ss->publisher_streams->data : NULL;
 					if(ps && ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO && ps->publisher && ps->publisher->session) {
-						janus_videoroom_reqpli(ps, "New subscriber available");
+						if(g_atomic_pointer_get(&ps->gop) != NULL) {
+							/* The cached GOP will be sent before the next packet instead (or a PLI, if empty) */
+							g_atomic_int_set(&ss->gop_pending, 1);
+						} else {
+							janus_videoroom_reqpli(ps, "New subscriber available");
+						}
 					}
 					temp = temp->next;
 				}
@@ -7968,7 +9398,11 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 				/* We may not know the SSRC yet, try the rid RTP extension */
 				char sdes_item[16];
 				janus_mutex_lock(&ps->rid_mutex);
-				if(janus_rtp_header_extension_parse_rid(buf, len, ps->rid_extmap_id, sdes_item, sizeof(sdes_item)) == 0) {
+				/* The core may have parsed the extension for us already */
+				if(pkt->extensions.rid[0] != '\0')
+					g_strlcpy(sdes_item, pkt->extensions.rid, sizeof(sdes_item));
+				if(pkt->extensions.rid[0] != '\0' ||
+						janus_rtp_header_extension_parse_rid(buf, len, ps->rid_extmap_id, sdes_item, sizeof(sdes_item)) == 0) {
 					if(ps->rid[0] != NULL && !strcmp(ps->rid[0], sdes_item)) {
 						ps->vssrc[0] = ssrc;
 						sc = 0;
@@ -8045,13 +9479,21 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 				}
 			} else if(ps->vcodec == JANUS_VIDEOCODEC_AV1) {
 				packet.svc = (pkt->extensions.dd_len > 0);
+				/* Parse the Dependency Descriptor once, rather than for each subscriber */
+				if(packet.svc) {
+					janus_av1_svc_context_parse(&ps->dd_context, buf, len,
+						pkt->extensions.dd_content, pkt->extensions.dd_len, &packet.av1_info);
+				}
 			}
 		}
-		if(video && ps->simulcast)
-			packet.simulcast = TRUE;
 		packet.ssrc[0] = (sc != -1 ? ps->vssrc[0] : 0);
 		packet.ssrc[1] = (sc != -1 ? ps->vssrc[1] : 0);
 		packet.ssrc[2] = (sc != -1 ? ps->vssrc[2] : 0);
+		if(video && ps->simulcast) {
+			/* Find out the substream and whether it's a keyframe once, rather than for each subscriber */
+			packet.simulcast = TRUE;
+			janus_rtp_simulcasting_packet_parse(&packet.sim_packet, buf, len, 0, packet.ssrc, NULL, ps->vcodec, NULL);
+		}
 		/* Backup the actual timestamp and sequence number set by the publisher, in case switching is involved */
 		packet.timestamp = ntohl(packet.data->timestamp);
 		packet.seq_number = ntohs(packet.data->seq_number);
@@ -8059,10 +9501,56 @@ static void janus_videoroom_incoming_rtp_internal(janus_videoroom_session *sessi
 			packet.extensions.min_delay = ps->min_delay;
 			packet.extensions.max_delay = ps->max_delay;
 		}
+		if(video && !ps->simulcast && !ps->svc && videoroom->gop_cache_size > 0) {
+			/* Keep track of the latest GOP, so that new subscribers can get it right away */
+			if(ps->gop == NULL) {
+				g_atomic_pointer_set(&ps->gop, janus_rtp_gop_cache_create(ps->vcodec, videoroom->gop_cache_size));
+			} else if(ps->gop->vcodec != ps->vcodec) {
+				/* The publisher renegotiated the codec */
+				janus_rtp_gop_cache_reset(ps->gop);
+				ps->gop->vcodec = ps->vcodec;
+			}
+			janus_rtp_gop_cache_add(ps->gop, buf, len);
+		}
 		/* Go: some viewers may decide to drop the packet, but that's up to them */
-		janus_mutex_lock_nodebug(&ps->subscribers_mutex);
-		g_slist_foreach(ps->subscribers, janus_videoroom_relay_rtp_packet, &packet);
-		janus_mutex_unlock_nodebug(&ps->subscribers_mutex);
+		janus_videoroom_subscribers_snapshot *snapshot = janus_videoroom_publisher_stream_get_snapshot(ps);
+		guint subscribers = snapshot ? snapshot->len : 0;
+		if(subscribers > 1) {
+			/* More than one subscriber, create a shared copy of the payload
+			 * that the core can use, so that it doesn't need a copy for each */
+			packet.shared = janus_plugin_rtp_shared_new((char *)rtp, len);
+		}
+		if(videoroom->threads != NULL) {
+			/* Check if there are enough subscribers to involve the helper threads: we
+			 * only switch back to relaying inline when the count drops to half the
+			 * threshold, to avoid flapping (which could reorder packets) */
+			guint threshold = videoroom->helper_threshold;
+			if(ps->helpers_active)
+				threshold /= 2;
+			gboolean helpers = (subscribers >= threshold);
+			if(!helpers && ps->helpers_active && g_atomic_int_get(&ps->helpers_pending) > 0) {
+				/* The helpers still have packets of this stream to relay: we stay on
+				 * them until they're done, or inline packets would overtake those,
+				 * and the subscriber contexts would be updated by two threads */
+				helpers = TRUE;
+			}
+			ps->helpers_active = helpers;
+		}
+		if(ps->helpers_active && subscribers > 0) {
+			janus_videoroom_helpers_relay_rtp_packet(videoroom, snapshot, &packet);
+		} else {
+			/* Relay to all subscribers with a single call to the core, if there are many */
+			if(packet.shared != NULL)
+				packet.batch = janus_plugin_rtp_batch_get(gateway);
+			guint i = 0;
+			for(i=0; i<subscribers; i++)
+				janus_videoroom_relay_rtp_packet(snapshot->streams[i], &packet);
+			janus_plugin_rtp_batch_flush(packet.batch);
+		}
+		janus_videoroom_publisher_stream_put_snapshot(ps, snapshot);
+		janus_videoroom_layer_groups_clear(&packet);
+		if(packet.shared != NULL)
+			janus_refcount_decrease(&packet.shared->ref);
 
 		/* Check if we need to send any REMB, FIR or PLI back to this publisher */
 		if(video && ps->active && !ps->muted) {
@@ -8167,13 +9655,16 @@ void janus_videoroom_incoming_rtcp(janus_plugin_session *handle, janus_plugin_rt
 		}
 		janus_refcount_increase_nodebug(&ps->ref);
 		janus_mutex_unlock(&s->streams_mutex);
-		if(janus_rtcp_has_fir(buf, len) || janus_rtcp_has_pli(buf, len)) {
+		/* The core may have parsed the packet for us already */
+		gboolean pli = packet->summarized ? (packet->has_fir || packet->has_pli) :
+			(janus_rtcp_has_fir(buf, len) || janus_rtcp_has_pli(buf, len));
+		if(pli) {
 			/* We got a FIR or PLI, forward a PLI to the publisher */
 			janus_videoroom_publisher *p = ps->publisher;
 			if(p && p->session)
 				janus_videoroom_reqpli(ps, "PLI from subscriber");
 		}
-		uint32_t bitrate = janus_rtcp_get_remb(buf, len);
+		uint32_t bitrate = packet->summarized ? packet->remb : janus_rtcp_get_remb(buf, len);
 		if(bitrate > 0) {
 			/* FIXME We got a REMB from this subscriber, should we do something about it? */
 		}
@@ -8269,9 +9760,41 @@ static void janus_videoroom_incoming_data_internal(janus_videoroom_session *sess
 	pkt.length = len;
 	pkt.is_rtp = FALSE;
 	pkt.textdata = !packet->binary;
+	if(participant->room->data_batch > 0 && data_batches_thread != NULL) {
+		/* Subscribers will send this later, together with other messages */
+		janus_videoroom_data_message *message = g_malloc(sizeof(janus_videoroom_data_message));
+		message->label = g_strdup(participant->user_id_str);
+		message->binary = packet->binary;
+		message->buffer = g_malloc(len);
+		memcpy(message->buffer, buf, len);
+		message->length = len;
+		message->window = (gint64)participant->room->data_batch * 1000;
+		janus_refcount_init(&message->ref, janus_videoroom_data_message_free);
+		pkt.message = message;
+	}
+	janus_plugin_data outgoing = {
+		.label = participant->user_id_str,
+		.protocol = NULL,
+		.binary = packet->binary,
+		.buffer = buf,
+		.length = len
+	};
 	janus_mutex_lock_nodebug(&ps->subscribers_mutex);
+	if(gateway != NULL && pkt.message == NULL && ps->subscribers != NULL) {
+		/* Collect all the subscribers, so that we can relay with a single call */
+		pkt.outgoing = &outgoing;
+		pkt.targets = g_array_sized_new(FALSE, FALSE, sizeof(janus_plugin_data_target), g_slist_length(ps->subscribers));
+	}
 	g_slist_foreach(ps->subscribers, janus_videoroom_relay_data_packet, &pkt);
+	if(pkt.targets != NULL && pkt.targets->len > 0) {
+		JANUS_LOG(LOG_VERB, "Forwarding %s DataChannel message (%d bytes) to %u viewers\n",
+			pkt.textdata ? "text" : "binary", len, pkt.targets->len);
+		gateway->relay_data_batch_targets((janus_plugin_data_target *)pkt.targets->data, pkt.targets->len);
+	}
 	janus_mutex_unlock_nodebug(&ps->subscribers_mutex);
+	if(pkt.targets != NULL)
+		g_array_free(pkt.targets, TRUE);
+	janus_videoroom_data_message_unref(pkt.message);
 	janus_videoroom_publisher_dereference_nodebug(participant);
 }
 
@@ -8351,6 +9874,27 @@ void janus_videoroom_slow_link(janus_plugin_session *handle, int mindex, gboolea
 	janus_refcount_decrease(&session->ref);
 }
 
+void janus_videoroom_estimated_bandwidth(janus_plugin_session *handle, uint32_t estimate) {
+	/* The core is telling us how much bandwidth it thinks a subscriber has */
+	if(handle == NULL || g_atomic_int_get(&handle->stopped) || g_atomic_int_get(&stopping) || !g_atomic_int_get(&initialized))
+		return;
+	janus_mutex_lock(&sessions_mutex);
+	janus_videoroom_session *session = janus_videoroom_lookup_session(handle);
+	if(!session || g_atomic_int_get(&session->destroyed) || session->participant_type != janus_videoroom_p_type_subscriber) {
+		janus_mutex_unlock(&sessions_mutex);
+		return;
+	}
+	janus_refcount_increase(&session->ref);
+	janus_mutex_unlock(&sessions_mutex);
+	janus_videoroom_subscriber *subscriber = janus_videoroom_session_get_subscriber(session);
+	if(subscriber != NULL) {
+		/* We only keep track of it for now: it's up to the application to act on it */
+		g_atomic_int_set(&subscriber->estimated_bandwidth, (gint)estimate);
+		janus_refcount_decrease(&subscriber->ref);
+	}
+	janus_refcount_decrease(&session->ref);
+}
+
 static void janus_videoroom_recorder_create(janus_videoroom_publisher_stream *ps) {
 	char filename[255];
 	janus_recorder *rc = NULL;
@@ -8492,6 +10036,7 @@ static void janus_videoroom_hangup_media_internal(gpointer session_data) {
 			}
 			g_slist_free(ps->subscribers);
 			ps->subscribers = NULL;
+			janus_videoroom_publisher_stream_update_snapshot(ps);
 			janus_rtp_simulcasting_cleanup(&ps->rid_extmap_id, ps->vssrc, ps->rid, &ps->rid_mutex);
 			g_free(ps->fmtp);
 			ps->fmtp = NULL;
@@ -8613,15 +10158,35 @@ static void janus_videoroom_hangup_media_internal(gpointer session_data) {
 
 /* Thread to handle incoming messages */
 static void *janus_videoroom_handler(void *data) {
-	JANUS_LOG(LOG_VERB, "Joining VideoRoom handler thread\n");
+	janus_videoroom_handler_thread *ht = (janus_videoroom_handler_thread *)data;
+	JANUS_LOG(LOG_VERB, "Joining VideoRoom handler thread #%u\n", ht->id);
 	janus_videoroom_message *msg = NULL;
 	int error_code = 0;
 	char error_cause[512];
 	json_t *root = NULL;
+	/* Requests may be completed in many different places below, so we take
+	 * care of the bookkeeping of the previous one before popping a new one */
+	janus_videoroom_session *last_session = NULL;
+	char last_request[32];
+	gint64 last_start = 0;
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		msg = g_async_queue_pop(messages);
+		if(last_session != NULL) {
+			janus_videoroom_request_stats_update(last_request, janus_get_monotonic_time() - last_start);
+			g_atomic_int_add(&last_session->pending_messages, -1);
+			janus_refcount_decrease(&last_session->ref);
+			last_session = NULL;
+		}
+		msg = g_async_queue_pop(ht->messages);
 		if(msg == &exit_message)
 			break;
+		g_atomic_int_inc(&ht->processed);
+		if(msg->handle != NULL && msg->handle->plugin_handle != NULL) {
+			last_session = (janus_videoroom_session *)msg->handle->plugin_handle;
+			janus_refcount_increase(&last_session->ref);
+			const char *request_text = json_string_value(json_object_get(msg->message, "request"));
+			g_strlcpy(last_request, request_text ? request_text : "unknown", sizeof(last_request));
+			last_start = janus_get_monotonic_time();
+		}
 		if(msg->handle == NULL) {
 			janus_videoroom_message_free(msg);
 			continue;
@@ -9379,16 +10944,36 @@ static void *janus_videoroom_handler(void *data) {
 				subscriber->room_id = videoroom->room_id;
 				subscriber->room_id_str = videoroom->room_id_str ? g_strdup(videoroom->room_id_str) : NULL;
 				subscriber->room = videoroom;
+				if(videoroom->threads != NULL) {
+					/* Assign this subscriber to the least loaded helper thread */
+					janus_videoroom_helper *helper = NULL;
+					GList *l = videoroom->threads;
+					while(l) {
+						janus_videoroom_helper *ht = (janus_videoroom_helper *)l->data;
+						if(helper == NULL || g_atomic_int_get(&ht->num_subscribers) < g_atomic_int_get(&helper->num_subscribers))
+							helper = ht;
+						l = l->next;
+					}
+					g_atomic_int_inc(&helper->num_subscribers);
+					janus_refcount_increase(&helper->ref);
+					subscriber->helper = helper;
+					JANUS_LOG(LOG_VERB, "Assigned subscriber to helper thread #%d (%d subscribers)\n",
+						helper->id, g_atomic_int_get(&helper->num_subscribers));
+				}
 				videoroom = NULL;
 				subscriber->pvt_id = pvt_id;
 				subscriber->use_msid = use_msid;
 				subscriber->autoupdate = autoupdate;
+				subscriber->low_latency = json_is_true(json_object_get(root, "low_latency"));
+				if(subscriber->low_latency)
+					gateway->set_low_latency(session->handle, TRUE);
 				subscriber->paused = TRUE;	/* We need an explicit start from the stream */
 				subscriber->streams_byid = g_hash_table_new_full(NULL, NULL,
 					NULL, (GDestroyNotify)janus_videoroom_subscriber_stream_destroy);
 				subscriber->streams_bymid = g_hash_table_new_full(g_str_hash, g_str_equal,
 					(GDestroyNotify)g_free, (GDestroyNotify)janus_videoroom_subscriber_stream_unref);
 				janus_mutex_init(&subscriber->streams_mutex);
+				janus_mutex_init(&subscriber->data_batch_mutex);
 				g_atomic_int_set(&subscriber->destroyed, 0);
 				janus_refcount_init(&subscriber->ref, janus_videoroom_subscriber_free);
 				janus_refcount_increase(&subscriber->ref);
@@ -9446,6 +11031,7 @@ static void *janus_videoroom_handler(void *data) {
 								/* The two streams reference each other */
 								janus_refcount_increase(&data_stream->ref);
 								janus_refcount_increase(&ps->ref);
+								janus_videoroom_publisher_stream_update_snapshot(ps);
 							}
 							janus_mutex_unlock(&ps->subscribers_mutex);
 							janus_mutex_unlock(&publisher->streams_mutex);
@@ -9511,6 +11097,7 @@ static void *janus_videoroom_handler(void *data) {
 									/* The two streams reference each other */
 									janus_refcount_increase(&data_stream->ref);
 									janus_refcount_increase(&ps->ref);
+									janus_videoroom_publisher_stream_update_snapshot(ps);
 								}
 								janus_mutex_unlock(&ps->subscribers_mutex);
 								temp = temp->next;
@@ -10708,6 +12295,11 @@ static void *janus_videoroom_handler(void *data) {
 				}
 				json_t *restart = json_object_get(root, "restart");
 				json_t *update = json_object_get(root, "update");
+				json_t *low_latency = json_object_get(root, "low_latency");
+				if(low_latency != NULL && json_is_true(low_latency) != subscriber->low_latency) {
+					subscriber->low_latency = json_is_true(low_latency);
+					gateway->set_low_latency(session->handle, subscriber->low_latency);
+				}
 				/* Audio, video and data are deprecated properties */
 				json_t *audio = json_object_get(root, "audio");
 				json_t *video = json_object_get(root, "video");
@@ -11303,6 +12895,7 @@ static void *janus_videoroom_handler(void *data) {
 						janus_mutex_lock(&stream_ps->subscribers_mutex);
 						stream_ps->subscribers = g_slist_remove(stream_ps->subscribers, stream);
 						stream->publisher_streams = g_slist_remove(stream->publisher_streams, stream_ps);
+						janus_videoroom_publisher_stream_update_snapshot(stream_ps);
 						janus_mutex_unlock(&stream_ps->subscribers_mutex);
 						janus_refcount_decrease(&stream_ps->ref);
 					}
@@ -11312,6 +12905,7 @@ static void *janus_videoroom_handler(void *data) {
 					ps->subscribers = g_slist_append(ps->subscribers, stream);
 					janus_refcount_increase(&ps->ref);
 					janus_refcount_increase(&stream->ref);
+					janus_videoroom_publisher_stream_update_snapshot(ps);
 					/* Reset simulcast and SVC properties too */
 					janus_rtp_simulcasting_context_reset(&stream->sim_context);
 					janus_mutex_lock(&ps->rid_mutex);
@@ -11501,7 +13095,7 @@ static void *janus_videoroom_handler(void *data) {
 				janus_mutex_lock(&subscriber->streams_mutex);
 				/* Mark all streams that were answered to as ready */
 				char error_str[512];
-				janus_sdp *answer = janus_sdp_parse(msg_sdp, error_str, sizeof(error_str));
+				janus_sdp *answer = janus_sdp_parse_arena(msg_sdp, error_str, sizeof(error_str));
 				GList *temp = answer->m_lines;
 				while(temp) {
 					janus_sdp_mline *m = (janus_sdp_mline *)temp->data;
@@ -11613,7 +13207,7 @@ static void *janus_videoroom_handler(void *data) {
 				}
 				/* Start by parsing the offer */
 				char error_str[512];
-				janus_sdp *offer = janus_sdp_parse(msg_sdp, error_str, sizeof(error_str));
+				janus_sdp *offer = janus_sdp_parse_arena(msg_sdp, error_str, sizeof(error_str));
 				if(offer == NULL) {
 					janus_refcount_decrease(&videoroom->ref);
 					json_decref(event);
@@ -11622,6 +13216,8 @@ static void *janus_videoroom_handler(void *data) {
 					g_snprintf(error_cause, 512, "Error parsing offer: %s", error_str);
 					goto error;
 				}
+				/* Subscribers will get different offers after this, drop the old templates */
+				janus_videoroom_offer_templates_clear(videoroom);
 				/* Prepare an answer, by iterating on all m-lines */
 				janus_sdp *answer = janus_sdp_generate_answer(offer);
 				json_t *media = json_array();
@@ -11968,7 +13564,7 @@ static void *janus_videoroom_handler(void *data) {
 									/* Audio stream */
 									f = janus_videoroom_rtp_forwarder_add_helper(participant, ps,
 										r->host, r->port, -1, 0,
-										(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+										(r->ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
 										FALSE, 0, NULL, 0, FALSE, FALSE);
 									if(f != NULL)
 										f->metadata = g_strdup(r->remote_id);
@@ -11977,7 +13573,7 @@ static void *janus_videoroom_handler(void *data) {
 									gboolean add_rtcp = (!r->rtcp_added && r->rtcp_port > 0);
 									f = janus_videoroom_rtp_forwarder_add_helper(participant, ps,
 										r->host, r->port, add_rtcp ? r->rtcp_port : -1, 0,
-										(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+										(r->ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
 										FALSE, 0, NULL, 0, TRUE, FALSE);
 									if(f != NULL)
 										f->metadata = g_strdup(r->remote_id);
@@ -11987,7 +13583,7 @@ static void *janus_videoroom_handler(void *data) {
 									if(ps->vssrc[1] || ps->rid[1]) {
 										f = janus_videoroom_rtp_forwarder_add_helper(participant, ps,
 											r->host, r->port, -1, 0,
-											(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 1),
+											(r->ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 1),
 											FALSE, 0, NULL, 1, TRUE, FALSE);
 										if(f != NULL)
 											f->metadata = g_strdup(r->remote_id);
@@ -11995,7 +13591,7 @@ static void *janus_videoroom_handler(void *data) {
 									if(ps->vssrc[2] || ps->rid[2]) {
 										f = janus_videoroom_rtp_forwarder_add_helper(participant, ps,
 											r->host, r->port, -1, 0,
-											(REMOTE_PUBLISHER_BASE_SSRC + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 2),
+											(r->ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP + 2),
 											FALSE, 0, NULL, 2, TRUE, FALSE);
 										if(f != NULL)
 											f->metadata = g_strdup(r->remote_id);
@@ -12003,7 +13599,11 @@ static void *janus_videoroom_handler(void *data) {
 								} else {
 									/* Data stream */
 									f = janus_videoroom_rtp_forwarder_add_helper(participant, ps,
-										r->host, r->port, 0, 0, 0, FALSE, 0, NULL, 0, FALSE, TRUE);
+										r->host, r->port, -1, 0,
+										(r->ssrc_base + ps->mindex*REMOTE_PUBLISHER_SSRC_STEP),
+										FALSE, 0, NULL, 0, FALSE, TRUE);
+									if(f != NULL)
+										f->metadata = g_strdup(r->remote_id);
 								}
 							}
 						}
@@ -12125,11 +13725,54 @@ error:
 			janus_videoroom_message_free(msg);
 		}
 	}
-	JANUS_LOG(LOG_VERB, "Leaving VideoRoom handler thread\n");
+	if(last_session != NULL) {
+		g_atomic_int_add(&last_session->pending_messages, -1);
+		janus_refcount_decrease(&last_session->ref);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving VideoRoom handler thread #%u\n", ht->id);
 	return NULL;
 }
 
+/* Helper to set the playout-delay to enforce on a subscriber stream, if any:
+ * low-latency subscribers always get 0, so that they render frames right away */
+static void janus_videoroom_subscriber_stream_playout_delay(janus_videoroom_subscriber_stream *stream,
+		janus_plugin_rtp_extensions *extensions) {
+	if(stream->subscriber->low_latency) {
+		extensions->min_delay = 0;
+		extensions->max_delay = 0;
+	} else if(stream->min_delay > -1 && stream->max_delay > -1) {
+		extensions->min_delay = stream->min_delay;
+		extensions->max_delay = stream->max_delay;
+	}
+}
 /* Helper to quickly relay RTP packets from publishers to subscribers */
+static void janus_videoroom_relay_rtp_send(janus_videoroom_rtp_relay_packet *packet,
+		janus_videoroom_session *session, janus_plugin_rtp *rtp) {
+	if(packet->batch != NULL)
+		janus_plugin_rtp_batch_add(packet->batch, session->handle, rtp);
+	else
+		gateway->relay_rtp(session->handle, rtp);
+}
+/* Helper to send a packet from a publisher stream GOP cache to a new subscriber */
+static void janus_videoroom_relay_gop_packet(char *buf, int len, gpointer user_data) {
+	janus_videoroom_subscriber_stream *stream = (janus_videoroom_subscriber_stream *)user_data;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	uint32_t timestamp = ntohl(rtp->timestamp);
+	uint16_t seq_number = ntohs(rtp->seq_number);
+	janus_rtp_header_update(rtp, &stream->context, TRUE, 0);
+	if(gateway != NULL) {
+		janus_plugin_rtp pkt = { .mindex = stream->mindex, .video = TRUE, .buffer = buf, .length = len };
+		janus_plugin_rtp_extensions_reset(&pkt.extensions);
+		janus_videoroom_subscriber_stream_playout_delay(stream, &pkt.extensions);
+		gateway->relay_rtp(stream->subscriber->session->handle, &pkt);
+	}
+	/* Restore the timestamp and sequence number to what the publisher set them to */
+	rtp->timestamp = htonl(timestamp);
+	rtp->seq_number = htons(seq_number);
+	stream->gop_replayed = TRUE;
+	stream->gop_last_seq = seq_number;
+}
+
 static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data) {
 	janus_videoroom_rtp_relay_packet *packet = (janus_videoroom_rtp_relay_packet *)user_data;
 	if(!packet || !packet->data || packet->length < 1) {
@@ -12161,9 +13804,12 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 				return;
 			/* Process this packet: don't relay if it's not the layer we wanted to handle */
 			janus_rtp_header rtp = *(packet->data);
-			gboolean relay = janus_rtp_svc_context_process_rtp(&stream->svc_context,
-				(char *)packet->data, packet->length, packet->extensions.dd_content, packet->extensions.dd_len,
-				ps->vcodec, &packet->svc_info, &stream->context);
+			gboolean relay = (ps->vcodec == JANUS_VIDEOCODEC_AV1) ?
+				janus_rtp_svc_context_process_av1(&stream->svc_context,
+					(char *)packet->data, packet->length, &packet->av1_info, &stream->context) :
+				janus_rtp_svc_context_process_rtp(&stream->svc_context,
+					(char *)packet->data, packet->length, packet->extensions.dd_content, packet->extensions.dd_len,
+					ps->vcodec, &packet->svc_info, &stream->context);
 			if(stream->svc_context.need_pli) {
 				/* Send a PLI */
 				JANUS_LOG(LOG_VERB, "We need a PLI for the SVC context\n");
@@ -12198,12 +13844,9 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			/* Send the packet */
 			if(gateway != NULL) {
 				janus_plugin_rtp rtp = { .mindex = stream->mindex, .video = packet->is_video, .buffer = (char *)packet->data, .length = packet->length,
-					.extensions = packet->extensions };
-				if(stream->min_delay > -1 && stream->max_delay > -1) {
-					rtp.extensions.min_delay = stream->min_delay;
-					rtp.extensions.max_delay = stream->max_delay;
-				}
-				gateway->relay_rtp(session->handle, &rtp);
+					.extensions = packet->extensions, .shared = packet->shared };
+				janus_videoroom_subscriber_stream_playout_delay(stream, &rtp.extensions);
+				janus_videoroom_relay_rtp_send(packet, session, &rtp);
 			}
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			*(packet->data) = rtp;
@@ -12214,9 +13857,9 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			if(payload == NULL)
 				return;
 			/* Process this packet: don't relay if it's not the SSRC/layer we wanted to handle */
-			gboolean relay = janus_rtp_simulcasting_context_process_rtp(&stream->sim_context,
+			gboolean relay = janus_rtp_simulcasting_context_process_packet(&stream->sim_context, &packet->sim_packet,
 				(char *)packet->data, packet->length, packet->extensions.dd_content, packet->extensions.dd_len,
-				packet->ssrc, NULL, ps->vcodec, &stream->context, &ps->rid_mutex);
+				packet->ssrc, ps->vcodec, &stream->context);
 			if(!relay) {
 				/* Did a lot of time pass before we could relay a packet? */
 				gint64 now = janus_get_monotonic_time();
@@ -12265,12 +13908,11 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 			/* Send the packet */
 			if(gateway != NULL) {
 				janus_plugin_rtp rtp = { .mindex = stream->mindex, .video = packet->is_video, .buffer = (char *)packet->data, .length = packet->length,
-					.extensions = packet->extensions };
-				if(stream->min_delay > -1 && stream->max_delay > -1) {
-					rtp.extensions.min_delay = stream->min_delay;
-					rtp.extensions.max_delay = stream->max_delay;
-				}
-				gateway->relay_rtp(session->handle, &rtp);
+					.extensions = packet->extensions,
+					/* For VP8 we may have changed the payload descriptor, so we use the copy of our group */
+					.shared = (ps->vcodec == JANUS_VIDEOCODEC_VP8 ? janus_videoroom_layer_group_get(packet, payload) : packet->shared) };
+				janus_videoroom_subscriber_stream_playout_delay(stream, &rtp.extensions);
+				janus_videoroom_relay_rtp_send(packet, session, &rtp);
 			}
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
@@ -12280,17 +13922,31 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 				memcpy(payload, vp8pd, sizeof(vp8pd));
 			}
 		} else {
+			if(g_atomic_int_compare_and_exchange(&stream->gop_pending, 1, 0)) {
+				/* New subscriber: send the cached GOP first, so that it can start decoding right away,
+				 * unless it's a low-latency one, which would rather wait for a fresh keyframe */
+				int packets = subscriber->low_latency ? 0 : janus_rtp_gop_cache_replay(g_atomic_pointer_get(&ps->gop),
+					janus_videoroom_relay_gop_packet, stream);
+				if(packets > 0) {
+					JANUS_LOG(LOG_HUGE, "Replayed %d packets from the GOP cache (%s)\n", packets, stream->mid);
+				} else {
+					janus_videoroom_reqpli(ps, "New subscriber available");
+				}
+			}
+			if(stream->gop_replayed) {
+				/* Skip the live packets the replayed GOP contained already */
+				if((int16_t)(packet->seq_number - stream->gop_last_seq) <= 0)
+					return;
+				stream->gop_replayed = FALSE;
+			}
 			/* Fix sequence number and timestamp (publisher switching may be involved) */
 			janus_rtp_header_update(packet->data, &stream->context, TRUE, 0);
 			/* Send the packet */
 			if(gateway != NULL) {
 				janus_plugin_rtp rtp = { .mindex = stream->mindex, .video = packet->is_video, .buffer = (char *)packet->data, .length = packet->length,
-					.extensions = packet->extensions };
-				if(stream->min_delay > -1 && stream->max_delay > -1) {
-					rtp.extensions.min_delay = stream->min_delay;
-					rtp.extensions.max_delay = stream->max_delay;
-				}
-				gateway->relay_rtp(session->handle, &rtp);
+					.extensions = packet->extensions, .shared = packet->shared };
+				janus_videoroom_subscriber_stream_playout_delay(stream, &rtp.extensions);
+				janus_videoroom_relay_rtp_send(packet, session, &rtp);
 			}
 			/* Restore the timestamp and sequence number to what the publisher set them to */
 			packet->data->timestamp = htonl(packet->timestamp);
@@ -12302,8 +13958,8 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 		/* Send the packet */
 		if(gateway != NULL) {
 			janus_plugin_rtp rtp = { .mindex = stream->mindex, .video = packet->is_video, .buffer = (char *)packet->data, .length = packet->length,
-				.extensions = packet->extensions };
-			gateway->relay_rtp(session->handle, &rtp);
+				.extensions = packet->extensions, .shared = packet->shared };
+			janus_videoroom_relay_rtp_send(packet, session, &rtp);
 		}
 		/* Restore the timestamp and sequence number to what the publisher set them to */
 		packet->data->timestamp = htonl(packet->timestamp);
@@ -12313,6 +13969,146 @@ static void janus_videoroom_relay_rtp_packet(gpointer data, gpointer user_data)
 	return;
 }
 
+/* Helper threads */
+static gboolean janus_videoroom_helpers_start(janus_videoroom *room) {
+	GError *error = NULL;
+	char tname[16];
+	int i=0;
+	for(i=0; i<room->helper_threads; i++) {
+		janus_videoroom_helper *helper = g_malloc0(sizeof(janus_videoroom_helper));
+		helper->id = i+1;
+		helper->room = room;
+		helper->queued_packets = g_async_queue_new_full((GDestroyNotify)janus_videoroom_helper_packet_free);
+		janus_refcount_init(&helper->ref, janus_videoroom_helper_free);
+		/* Spawn a thread and add references */
+		g_snprintf(tname, sizeof(tname), "vhelp %u-%s", helper->id, room->room_id_str);
+		janus_refcount_increase(&room->ref);
+		janus_refcount_increase(&helper->ref);
+		helper->thread = g_thread_try_new(tname, &janus_videoroom_helper_thread, helper, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the helper thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			janus_refcount_decrease(&room->ref);	/* This is for the helper thread */
+			janus_refcount_decrease(&helper->ref);
+			/* This extra unref is for the init */
+			janus_refcount_decrease(&helper->ref);
+			break;
+		}
+		janus_refcount_increase(&helper->ref);
+		room->threads = g_list_append(room->threads, helper);
+	}
+	if(i < room->helper_threads) {
+		/* Get rid of the helper threads we managed to spawn, if any */
+		GList *l = room->threads;
+		while(l) {
+			janus_videoroom_helper *ht = (janus_videoroom_helper *)l->data;
+			g_async_queue_push(ht->queued_packets, &helper_exit_packet);
+			janus_videoroom_helper_destroy(ht);
+			janus_refcount_decrease(&ht->ref);
+			l = l->next;
+		}
+		g_list_free(room->threads);
+		room->threads = NULL;
+		room->helper_threads = 0;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static void janus_videoroom_helper_packet_free(janus_videoroom_helper_packet *pkt) {
+	if(pkt == NULL || pkt == &helper_exit_packet)
+		return;
+	if(pkt->streams != NULL) {
+		guint i = 0;
+		for(i=0; i<pkt->streams->len; i++) {
+			janus_videoroom_subscriber_stream *ss = g_ptr_array_index(pkt->streams, i);
+			janus_refcount_decrease(&ss->subscriber->ref);
+			janus_refcount_decrease(&ss->ref);
+		}
+		g_ptr_array_free(pkt->streams, TRUE);
+	}
+	janus_videoroom_layer_groups_clear(&pkt->packet);
+	if(pkt->packet.shared != NULL)
+		janus_refcount_decrease(&pkt->packet.shared->ref);
+	if(pkt->packet.source != NULL) {
+		g_atomic_int_dec_and_test(&pkt->packet.source->helpers_pending);
+		janus_refcount_decrease(&pkt->packet.source->ref);
+	}
+	g_free(pkt->packet.data);
+	g_free(pkt);
+}
+
+static void janus_videoroom_helpers_relay_rtp_packet(janus_videoroom *room,
+		janus_videoroom_subscribers_snapshot *snapshot, janus_videoroom_rtp_relay_packet *packet) {
+	/* Split the subscribers among the helper threads they belong to, and relay inline to the others */
+	GPtrArray *streams[JANUS_VIDEOROOM_MAX_HELPER_THREADS] = { 0 };
+	guint i = 0;
+	for(i=0; i<snapshot->len; i++) {
+		janus_videoroom_subscriber_stream *ss = snapshot->streams[i];
+		if(ss == NULL || !g_atomic_int_get(&ss->ready) || g_atomic_int_get(&ss->destroyed) || ss->subscriber == NULL)
+			continue;
+		janus_videoroom_helper *helper = ss->subscriber->helper;
+		if(helper == NULL || helper->id < 1 || helper->id > JANUS_VIDEOROOM_MAX_HELPER_THREADS) {
+			if(packet->batch == NULL && packet->shared != NULL)
+				packet->batch = janus_plugin_rtp_batch_get(gateway);
+			janus_videoroom_relay_rtp_packet(ss, packet);
+			continue;
+		}
+		if(streams[helper->id-1] == NULL)
+			streams[helper->id-1] = g_ptr_array_new();
+		janus_refcount_increase(&ss->ref);
+		janus_refcount_increase(&ss->subscriber->ref);
+		g_ptr_array_add(streams[helper->id-1], ss);
+	}
+	/* Queue a copy of the packet to all the helpers that need it */
+	GList *l = room->threads;
+	while(l) {
+		janus_videoroom_helper *helper = (janus_videoroom_helper *)l->data;
+		l = l->next;
+		if(streams[helper->id-1] == NULL)
+			continue;
+		janus_videoroom_helper_packet *pkt = g_malloc(sizeof(janus_videoroom_helper_packet));
+		pkt->packet = *packet;
+		/* Each helper forms its own groups of subscribers */
+		pkt->packet.groups_count = 0;
+		pkt->packet.data = g_malloc(packet->length);
+		memcpy(pkt->packet.data, packet->data, packet->length);
+		janus_refcount_increase(&pkt->packet.source->ref);
+		if(pkt->packet.shared != NULL)
+			janus_refcount_increase(&pkt->packet.shared->ref);
+		pkt->packet.batch = NULL;
+		pkt->streams = streams[helper->id-1];
+		g_atomic_int_inc(&pkt->packet.source->helpers_pending);
+		g_async_queue_push(helper->queued_packets, pkt);
+	}
+	janus_plugin_rtp_batch_flush(packet->batch);
+}
+
+static void *janus_videoroom_helper_thread(void *data) {
+	janus_videoroom_helper *helper = (janus_videoroom_helper *)data;
+	janus_videoroom *room = helper->room;
+	JANUS_LOG(LOG_INFO, "[%s/#%d] Joining VideoRoom helper thread\n", room->room_id_str, helper->id);
+	janus_videoroom_helper_packet *pkt = NULL;
+	while(!g_atomic_int_get(&stopping) && !g_atomic_int_get(&room->destroyed) && !g_atomic_int_get(&helper->destroyed)) {
+		pkt = g_async_queue_pop(helper->queued_packets);
+		if(pkt == &helper_exit_packet)
+			break;
+		if(pkt->packet.shared != NULL)
+			pkt->packet.batch = janus_plugin_rtp_batch_get(gateway);
+		guint i = 0;
+		for(i=0; i<pkt->streams->len; i++)
+			janus_videoroom_relay_rtp_packet(g_ptr_array_index(pkt->streams, i), &pkt->packet);
+		janus_plugin_rtp_batch_flush(pkt->packet.batch);
+		janus_videoroom_helper_packet_free(pkt);
+	}
+	JANUS_LOG(LOG_INFO, "[%s/#%d] Leaving VideoRoom helper thread\n", room->room_id_str, helper->id);
+	janus_refcount_decrease(&helper->ref);
+	janus_refcount_decrease(&room->ref);
+	g_thread_unref(g_thread_self());
+	return NULL;
+}
+
 static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data) {
 	janus_videoroom_rtp_relay_packet *packet = (janus_videoroom_rtp_relay_packet *)user_data;
 	if(!packet || packet->is_rtp || !packet->data || packet->length < 1) {
@@ -12333,6 +14129,34 @@ static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data)
 	janus_videoroom_subscriber *subscriber = stream->subscriber;
 	janus_videoroom_session *session = subscriber->session;
 
+	if(packet->message != NULL) {
+		/* The room batches messages: queue this one, the batches thread will send it */
+		janus_videoroom_data_message *message = packet->message;
+		gboolean schedule = FALSE;
+		janus_mutex_lock(&subscriber->data_batch_mutex);
+		if(subscriber->data_batch == NULL) {
+			subscriber->data_batch = g_ptr_array_new_with_free_func((GDestroyNotify)janus_videoroom_data_message_unref);
+			subscriber->data_batch_deadline = janus_get_monotonic_time() + message->window;
+			schedule = TRUE;
+		}
+		janus_refcount_increase(&message->ref);
+		g_ptr_array_add(subscriber->data_batch, message);
+		janus_mutex_unlock(&subscriber->data_batch_mutex);
+		if(schedule) {
+			janus_refcount_increase(&subscriber->ref);
+			janus_mutex_lock(&data_batches_mutex);
+			data_batches = g_list_prepend(data_batches, subscriber);
+			janus_condition_signal(&data_batches_cond);
+			janus_mutex_unlock(&data_batches_mutex);
+		}
+		return;
+	}
+	if(packet->targets != NULL) {
+		/* We'll relay to all subscribers at once */
+		janus_plugin_data_target target = { .handle = session->handle, .packet = packet->outgoing };
+		g_array_append_val(packet->targets, target);
+		return;
+	}
 	if(gateway != NULL && packet->data != NULL) {
 		JANUS_LOG(LOG_VERB, "Forwarding %s DataChannel message (%d bytes) to viewer\n",
 			packet->textdata ? "text" : "binary", packet->length);
@@ -12348,6 +14172,86 @@ static void janus_videoroom_relay_data_packet(gpointer data, gpointer user_data)
 	return;
 }
 
+/* Helper to send all the DataChannel messages a subscriber has waiting at once */
+static void janus_videoroom_data_batch_flush(janus_videoroom_subscriber *subscriber) {
+	janus_mutex_lock(&subscriber->data_batch_mutex);
+	GPtrArray *batch = subscriber->data_batch;
+	subscriber->data_batch = NULL;
+	janus_mutex_unlock(&subscriber->data_batch_mutex);
+	if(batch == NULL)
+		return;
+	janus_videoroom_session *session = subscriber->session;
+	if(gateway != NULL && !g_atomic_int_get(&subscriber->destroyed) && !subscriber->kicked &&
+			session != NULL && session->handle != NULL && !g_atomic_int_get(&session->destroyed) &&
+			g_atomic_int_get(&session->dataready)) {
+		JANUS_LOG(LOG_VERB, "Forwarding %u DataChannel messages to viewer\n", batch->len);
+		janus_plugin_data *packets = g_malloc(batch->len * sizeof(janus_plugin_data));
+		guint i = 0;
+		for(i=0; i<batch->len; i++) {
+			janus_videoroom_data_message *message = g_ptr_array_index(batch, i);
+			packets[i].label = message->label;
+			packets[i].protocol = NULL;
+			packets[i].binary = message->binary;
+			packets[i].buffer = message->buffer;
+			packets[i].length = message->length;
+		}
+		gateway->relay_data_batch(session->handle, packets, batch->len);
+		g_free(packets);
+	}
+	g_ptr_array_unref(batch);
+}
+
+/* Thread sending the DataChannel messages subscribers have waiting, when it's time */
+static void *janus_videoroom_data_batches_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining VideoRoom DataChannel batches thread\n");
+	janus_mutex_lock(&data_batches_mutex);
+	while(!g_atomic_int_get(&stopping)) {
+		if(data_batches == NULL) {
+			janus_condition_wait(&data_batches_cond, &data_batches_mutex);
+			continue;
+		}
+		/* Check which subscribers are due, and when the next one will be */
+		gint64 now = janus_get_monotonic_time(), next = 0;
+		GList *due = NULL, *temp = data_batches;
+		while(temp) {
+			GList *item = temp;
+			temp = temp->next;
+			janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)item->data;
+			janus_mutex_lock(&subscriber->data_batch_mutex);
+			gint64 deadline = subscriber->data_batch_deadline;
+			janus_mutex_unlock(&subscriber->data_batch_mutex);
+			if(deadline <= now) {
+				data_batches = g_list_remove_link(data_batches, item);
+				due = g_list_concat(item, due);
+			} else if(next == 0 || deadline < next) {
+				next = deadline;
+			}
+		}
+		if(due == NULL) {
+			janus_condition_wait_until(&data_batches_cond, &data_batches_mutex, next);
+			continue;
+		}
+		/* Send the messages without holding the lock */
+		janus_mutex_unlock(&data_batches_mutex);
+		for(temp = due; temp != NULL; temp = temp->next) {
+			janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)temp->data;
+			janus_videoroom_data_batch_flush(subscriber);
+			janus_refcount_decrease(&subscriber->ref);
+		}
+		g_list_free(due);
+		janus_mutex_lock(&data_batches_mutex);
+	}
+	/* We're shutting down: drop whatever is still waiting */
+	while(data_batches) {
+		janus_videoroom_subscriber *subscriber = (janus_videoroom_subscriber *)data_batches->data;
+		data_batches = g_list_delete_link(data_batches, data_batches);
+		janus_refcount_decrease(&subscriber->ref);
+	}
+	janus_mutex_unlock(&data_batches_mutex);
+	JANUS_LOG(LOG_VERB, "Leaving VideoRoom DataChannel batches thread\n");
+	return NULL;
+}
+
 /* The following methods are only relevant if RTCP is used for RTP forwarders */
 static void janus_videoroom_rtp_forwarder_rtcp_receive(janus_rtp_forwarder *rf, char *buffer, int len) {
 	if(len > 0 && janus_is_rtcp(buffer, len)) {
@@ -12601,46 +14505,85 @@ static int janus_videoroom_get_fd_port(int fd) {
 	}
 	return ntohs(server.sin6_port);
 }
-/* Thread responsible for a specific remote publisher */
-static void *janus_videoroom_remote_publisher_thread(void *user_data) {
-	janus_videoroom_publisher *publisher = (janus_videoroom_publisher *)user_data;
-	if(publisher == NULL) {
-		JANUS_LOG(LOG_ERR, "Invalid publisher instance\n");
-		g_thread_unref(g_thread_self());
-		return NULL;
+/* Helper to create the sockets a remote publisher (or trunk) receives media on */
+static int janus_videoroom_remote_fds_create(json_t *root, int *fd, int *rtcp_fd,
+		uint16_t *port, uint16_t *rtcp_port, char *host, size_t hostlen, char *error_cause, size_t error_len) {
+	*fd = -1;
+	*rtcp_fd = -1;
+	const char *mcast = json_string_value(json_object_get(root, "mcast"));
+	const char *iface = json_string_value(json_object_get(root, "iface"));
+	janus_network_address miface;
+	if(iface) {
+		struct ifaddrs *ifas = NULL;
+		if(getifaddrs(&ifas) == -1) {
+			JANUS_LOG(LOG_ERR, "Unable to acquire list of network devices/interfaces; remote publishers may not work as expected... %d (%s)\n",
+				errno, g_strerror(errno));
+		}
+		if(janus_network_lookup_interface(ifas, iface, &miface) != 0) {
+			JANUS_LOG(LOG_ERR, "Invalid network interface configuration for remote publisher...\n");
+			g_snprintf(error_cause, error_len, ifas ? "Invalid network interface configuration for remote publisher" : "Unable to query network device information");
+			if(ifas)
+				freeifaddrs(ifas);
+			return JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+		}
+		if(ifas)
+			freeifaddrs(ifas);
+	} else {
+		janus_network_address_nullify(&miface);
 	}
-	JANUS_LOG(LOG_VERB, "[%s/%s] Joining remote publisher thread...\n",
-		publisher->room->room_id_str, publisher->user_id_str);
-
-	/* File descriptors */
-	socklen_t addrlen;
-	struct sockaddr_storage remote = { 0 };
-	int resfd = 0, bytes = 0;
-	struct pollfd fds[3];
-	int pipe_fd = publisher->pipefd[0];
-	char buffer[1500];
-	memset(buffer, 0, 1500);
-	if(pipe_fd == -1) {
-		/* If the pipe file descriptor doesn't exist, it means we're done already,
-		 * and/or we may never be notified about sessions being closed, so give up */
-		JANUS_LOG(LOG_WARN, "[%s/%s] Leaving remote publisher thread, no pipe file descriptor...\n",
-			publisher->room->room_id_str, publisher->user_id_str);
-		janus_videoroom_publisher_destroy(publisher);
-		janus_refcount_decrease(&publisher->session->ref);
-		janus_refcount_decrease(&publisher->ref);
-		g_thread_unref(g_thread_self());
-		return NULL;
+	*port = json_integer_value(json_object_get(root, "port"));
+	*rtcp_port = json_integer_value(json_object_get(root, "rtcp_port"));
+	host[0] = '\0';
+	*fd = janus_videoroom_create_fd(*port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, hostlen);
+	if(*fd < 0) {
+		JANUS_LOG(LOG_ERR, "Could not open UDP socket for RTP stream for remote publisher, %d (%s)\n",
+			errno, g_strerror(errno));
+		g_snprintf(error_cause, error_len, "Could not open UDP socket for RTP stream");
+		return JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
 	}
-	/* RTP stuff */
-	janus_rtp_header *rtp = NULL;
-	uint32_t ssrc = 0, diff = 0;
-	int mindex = 0, vindex = 0;
-	janus_videoroom_publisher_stream *ps = NULL;
-	janus_plugin_rtp pkt = { 0 };
-	janus_plugin_data data = { 0 };
-	GList *temp = NULL;
+	*port = janus_videoroom_get_fd_port(*fd);
+	*rtcp_fd = janus_videoroom_create_fd(*rtcp_port, mcast ? inet_addr(mcast) : INADDR_ANY, &miface, host, hostlen);
+	if(*rtcp_fd < 0) {
+		JANUS_LOG(LOG_ERR, "Could not open UDP socket for remote publisher RTCP, %d (%s)\n",
+			errno, g_strerror(errno));
+		close(*fd);
+		*fd = -1;
+		g_snprintf(error_cause, error_len, "Could not open UDP socket for RTP stream");
+		return JANUS_VIDEOROOM_ERROR_UNKNOWN_ERROR;
+	}
+	*rtcp_port = janus_videoroom_get_fd_port(*rtcp_fd);
+	return 0;
+}
+/* Helper to read as many packets as are available (up to the batch size): returns how many we got, or -1 in case of errors */
+static int janus_videoroom_recv_batch_read(janus_videoroom_recv_batch *batch, int fd) {
+	int num = 0;
+#ifdef HAVE_RECVMMSG
+	int i = 0;
+	for(i=0; i<JANUS_VIDEOROOM_RECV_BATCH; i++) {
+		batch->iovecs[i].iov_base = batch->data[i];
+		batch->iovecs[i].iov_len = sizeof(batch->data[i]);
+		memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+		batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+		batch->messages[i].msg_hdr.msg_iovlen = 1;
+	}
+	/* We were told there's something, so this won't block for the first
+	 * packet: the others are only read if they're already there */
+	num = recvmmsg(fd, batch->messages, JANUS_VIDEOROOM_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(num < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	for(i=0; i<num; i++)
+		batch->length[i] = batch->messages[i].msg_len;
+#else
+	batch->length[0] = recvfrom(fd, batch->data[0], sizeof(batch->data[0]), MSG_DONTWAIT, NULL, NULL);
+	if(batch->length[0] < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	num = 1;
+#endif
+	return num;
+}
 
-	/* As the first thing, we add the remote publisher to the list */
+/* Helper to add a remote publisher to its room, and let other participants know */
+static void janus_videoroom_remote_publisher_join(janus_videoroom_publisher *publisher) {
 	janus_refcount_increase(&publisher->ref);
 	janus_refcount_increase(&publisher->session->ref);
 	janus_videoroom *videoroom = publisher->room;
@@ -12650,187 +14593,128 @@ static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 		publisher);
 	/* Let's also notify all other participants that the publisher is here */
 	janus_videoroom_notify_about_publisher(publisher, FALSE);
+}
 
-	/* Loop */
-	int num = 0, i = 0;
-	while(!g_atomic_int_get(&publisher->remote_leaving) && !g_atomic_int_get(&publisher->destroyed)) {
-		/* Prepare poll */
-		num = 0;
-		if(publisher->remote_fd != -1) {
-			fds[num].fd = publisher->remote_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		if(publisher->remote_rtcp_fd != -1) {
-			fds[num].fd = publisher->remote_rtcp_fd;
-			fds[num].events = POLLIN;
-			fds[num].revents = 0;
-			num++;
-		}
-		pipe_fd = publisher->pipefd[0];
-		if(pipe_fd == -1) {
-			/* Pipe was closed? Means the call is over */
-			break;
+/* Helper to send any PLI that the streams of a remote publisher may be waiting for */
+static void janus_videoroom_remote_publisher_plis(janus_videoroom_publisher *publisher) {
+	janus_mutex_lock(&publisher->streams_mutex);
+	GList *temp = publisher->streams;
+	while(temp) {
+		janus_videoroom_publisher_stream *ps = (janus_videoroom_publisher_stream *)temp->data;
+		/* Any PLI and/or REMB we should send back to the source? */
+		if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO && g_atomic_int_get(&ps->need_pli))
+			janus_videoroom_rtcp_pli_send(ps);
+		temp = temp->next;
+	}
+	janus_mutex_unlock(&publisher->streams_mutex);
+}
+
+/* Helper to handle an RTP packet (or data envelope) coming from a remote publisher */
+static void janus_videoroom_remote_publisher_incoming(janus_videoroom_publisher *publisher, char *buffer, int bytes) {
+	janus_videoroom *videoroom = publisher->room;
+	janus_rtp_header *rtp = NULL;
+	uint32_t ssrc = 0, diff = 0;
+	int mindex = 0, vindex = 0;
+	janus_videoroom_publisher_stream *ps = NULL;
+	janus_plugin_rtp pkt = { 0 };
+	janus_plugin_data data = { 0 };
+	/* Handle packet: check SSRC and do relay_rtp accordingly */
+	if(!janus_is_rtp(buffer, bytes)) {
+		/* Not RTP, drop the packet */
+		return;
+	}
+	rtp = (janus_rtp_header *)buffer;
+	ssrc = ntohl(rtp->ssrc);
+	if(ssrc < publisher->remote_ssrc_base) {
+		/* Can't be one of the SSRCs we're waiting for, innore */
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid SSRC (%"SCNu32")\n",
+			videoroom->room_id_str, publisher->user_id_str, ssrc);
+		return;
+	}
+	diff = ssrc - publisher->remote_ssrc_base;
+	mindex = diff/REMOTE_PUBLISHER_SSRC_STEP;
+	vindex = diff - (mindex*REMOTE_PUBLISHER_SSRC_STEP);
+	janus_mutex_lock(&publisher->streams_mutex);
+	ps = g_hash_table_lookup(publisher->streams_byid, GINT_TO_POINTER(mindex));
+	if(ps == NULL) {
+		janus_mutex_unlock(&publisher->streams_mutex);
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid mindex %d\n",
+			videoroom->room_id_str, publisher->user_id_str, mindex);
+		return;
+	}
+	if((!ps->simulcast && vindex > 0) || vindex > 2) {
+		janus_mutex_unlock(&publisher->streams_mutex);
+		JANUS_LOG(LOG_WARN, "[%s/%s] Invalid substream %d\n",
+			videoroom->room_id_str, publisher->user_id_str, vindex);
+		return;
+	}
+	/* Check if this is an actual RTP packet, or an
+	 * envelope created to relay data channels */
+	if(ps->type == JANUS_VIDEOROOM_MEDIA_DATA) {
+		/* Handle as data channel, stripping the RTP header */
+		janus_refcount_increase_nodebug(&publisher->ref);
+		janus_mutex_unlock(&publisher->streams_mutex);
+		data.label = NULL;
+		data.protocol = NULL;
+		data.binary = rtp->type ? TRUE : FALSE;
+		data.buffer = buffer + 12;
+		data.length = bytes - 12;
+		/* Now handle the packet as if coming from a regular publisher */
+		janus_videoroom_incoming_data_internal(publisher->session, publisher, &data);
+		return;
+	}
+	/* Prepare the RTP packet */
+	pkt.mindex = mindex;
+	pkt.video = (ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO);
+	pkt.buffer = buffer;
+	pkt.length = bytes;
+	janus_plugin_rtp_extensions_reset(&pkt.extensions);
+	janus_refcount_increase_nodebug(&publisher->ref);
+	janus_mutex_unlock(&publisher->streams_mutex);
+	/* Parse RTP extensions before relaying the packet */
+	if(!pkt.video && ps->audio_level_extmap_id > 0) {
+		gboolean vad = FALSE;
+		int level = -1;
+		if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
+				ps->audio_level_extmap_id, &vad, &level) == 0) {
+			pkt.extensions.audio_level = level;
+			pkt.extensions.audio_level_vad = vad;
 		}
-		fds[num].fd = pipe_fd;
-		fds[num].events = POLLIN;
-		fds[num].revents = 0;
-		num++;
-		/* Check if we need to send any PLI */
-		janus_mutex_lock(&publisher->streams_mutex);
-		temp = publisher->streams;
-		while(temp) {
-			ps = (janus_videoroom_publisher_stream *)temp->data;
-			/* Any PLI and/or REMB we should send back to the source? */
-			if(ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO && g_atomic_int_get(&ps->need_pli))
-				janus_videoroom_rtcp_pli_send(ps);
-			temp = temp->next;
+	}
+	if(pkt.video && ps->video_orient_extmap_id > 0) {
+		gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
+		if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
+				ps->video_orient_extmap_id, &c, &f, &r1, &r0) == 0) {
+			pkt.extensions.video_rotation = 0;
+			if(r1 && r0)
+				pkt.extensions.video_rotation = 270;
+			else if(r1)
+				pkt.extensions.video_rotation = 180;
+			else if(r0)
+				pkt.extensions.video_rotation = 90;
+			pkt.extensions.video_back_camera = c;
+			pkt.extensions.video_flipped = f;
 		}
-		janus_mutex_unlock(&publisher->streams_mutex);
-		/* Wait for some data */
-		resfd = poll(fds, num, 1000);
-		if(resfd < 0) {
-			if(errno == EINTR) {
-				JANUS_LOG(LOG_HUGE, "[%s/%s] Got an EINTR (%s), ignoring...\n",
-					videoroom->room_id_str, publisher->user_id_str, g_strerror(errno));
-				continue;
-			}
-			JANUS_LOG(LOG_ERR, "[%s/%s] Error polling...\n", videoroom->room_id_str, publisher->user_id_str);
-			JANUS_LOG(LOG_ERR, "[%s/%s]   -- %d (%s)\n",
-				videoroom->room_id_str, publisher->user_id_str, errno, g_strerror(errno));
-			break;
-		} else if(resfd == 0) {
-			/* No data, keep going */
-			continue;
+	}
+	if(pkt.video && ps->playout_delay_extmap_id > 0) {
+		uint16_t min = 0, max = 0;
+		if(janus_rtp_header_extension_parse_playout_delay(buffer, bytes,
+				ps->playout_delay_extmap_id, &min, &max) == 0) {
+			pkt.extensions.min_delay = min;
+			pkt.extensions.max_delay = max;
 		}
-		if(g_atomic_int_get(&publisher->remote_leaving) || g_atomic_int_get(&publisher->destroyed))
-			break;
-		for(i=0; i<num; i++) {
-			if(fds[i].revents & (POLLERR | POLLHUP)) {
-				/* Socket error? */
-				JANUS_LOG(LOG_ERR, "[%s/%s] Error polling: %s... %d (%s)\n",
-					videoroom->room_id_str, publisher->user_id_str,
-					fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP", errno, g_strerror(errno));
-				break;
-			} else if(fds[i].revents & POLLIN) {
-				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
-					/* Poll interrupted for a reason, go on */
-					int code = 0;
-					(void)read(pipe_fd, &code, sizeof(int));
-					break;
-				} else if(fds[i].fd == publisher->remote_rtcp_fd) {
-					/* Got Something on the RTCP socket, we only use this for latching */
-					addrlen = sizeof(remote);
-					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-					if(bytes < 0 || (!janus_is_rtp(buffer, bytes) && !janus_is_rtcp(buffer, bytes))) {
-						/* For latching we need an RTP or RTCP packet */
-						continue;
-					}
-					memcpy(&publisher->rtcp_addr, &remote, addrlen);
-					continue;
-				}
-				/* Got an RTP/RTCP packet */
-				addrlen = sizeof(remote);
-				bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
-				if(bytes < 0) {
-					/* Failed to read? */
-					continue;
-				}
-				/* Handle packet: check SSRC and do relay_rtp accordingly */
-				if(!janus_is_rtp(buffer, bytes)) {
-					/* Not RTP, drop the packet */
-					continue;
-				}
-				rtp = (janus_rtp_header *)buffer;
-				ssrc = ntohl(rtp->ssrc);
-				if(ssrc < REMOTE_PUBLISHER_BASE_SSRC) {
-					/* Can't be one of the SSRCs we're waiting for, innore */
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid SSRC (%"SCNu32")\n",
-						videoroom->room_id_str, publisher->user_id_str, ssrc);
-					continue;
-				}
-				diff = ssrc - REMOTE_PUBLISHER_BASE_SSRC;
-				mindex = diff/REMOTE_PUBLISHER_SSRC_STEP;
-				vindex = diff - (mindex*REMOTE_PUBLISHER_SSRC_STEP);
-				janus_mutex_lock(&publisher->streams_mutex);
-				ps = g_hash_table_lookup(publisher->streams_byid, GINT_TO_POINTER(mindex));
-				if(ps == NULL) {
-					janus_mutex_unlock(&publisher->streams_mutex);
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid mindex %d\n",
-						videoroom->room_id_str, publisher->user_id_str, mindex);
-					continue;
-				}
-				if((!ps->simulcast && vindex > 0) || vindex > 2) {
-					janus_mutex_unlock(&publisher->streams_mutex);
-					JANUS_LOG(LOG_WARN, "[%s/%s] Invalid substream %d\n",
-						videoroom->room_id_str, publisher->user_id_str, vindex);
-					continue;
-				}
-				/* Check if this is an actual RTP packet, or an
-				 * envelope created to relay data channels */
-				if(ps->type == JANUS_VIDEOROOM_MEDIA_DATA) {
-					/* Handle as data channel, stripping the RTP header */
-					janus_refcount_increase_nodebug(&publisher->ref);
-					janus_mutex_unlock(&publisher->streams_mutex);
-					data.label = NULL;
-					data.protocol = NULL;
-					data.binary = rtp->type ? TRUE : FALSE;
-					data.buffer = buffer + 12;
-					data.length = bytes - 12;
-					/* Now handle the packet as if coming from a regular publisher */
-					janus_videoroom_incoming_data_internal(publisher->session, publisher, &data);
-					continue;
-				}
-				/* Prepare the RTP packet */
-				pkt.mindex = mindex;
-				pkt.video = (ps->type == JANUS_VIDEOROOM_MEDIA_VIDEO);
-				pkt.buffer = buffer;
-				pkt.length = bytes;
-				janus_plugin_rtp_extensions_reset(&pkt.extensions);
-				janus_refcount_increase_nodebug(&publisher->ref);
-				janus_mutex_unlock(&publisher->streams_mutex);
-				/* Parse RTP extensions before relaying the packet */
-				if(!pkt.video && ps->audio_level_extmap_id > 0) {
-					gboolean vad = FALSE;
-					int level = -1;
-					if(janus_rtp_header_extension_parse_audio_level(buffer, bytes,
-							ps->audio_level_extmap_id, &vad, &level) == 0) {
-						pkt.extensions.audio_level = level;
-						pkt.extensions.audio_level_vad = vad;
-					}
-				}
-				if(pkt.video && ps->video_orient_extmap_id > 0) {
-					gboolean c = FALSE, f = FALSE, r1 = FALSE, r0 = FALSE;
-					if(janus_rtp_header_extension_parse_video_orientation(buffer, bytes,
-							ps->video_orient_extmap_id, &c, &f, &r1, &r0) == 0) {
-						pkt.extensions.video_rotation = 0;
-						if(r1 && r0)
-							pkt.extensions.video_rotation = 270;
-						else if(r1)
-							pkt.extensions.video_rotation = 180;
-						else if(r0)
-							pkt.extensions.video_rotation = 90;
-						pkt.extensions.video_back_camera = c;
-						pkt.extensions.video_flipped = f;
-					}
-				}
-				if(pkt.video && ps->playout_delay_extmap_id > 0) {
-					uint16_t min = 0, max = 0;
-					if(janus_rtp_header_extension_parse_playout_delay(buffer, bytes,
-							ps->playout_delay_extmap_id, &min, &max) == 0) {
-						pkt.extensions.min_delay = min;
-						pkt.extensions.max_delay = max;
-					}
-				}
-				/* Now handle the packet as if coming from a regular publisher */
-				janus_refcount_increase_nodebug(&publisher->ref);
-				janus_videoroom_incoming_rtp_internal(publisher->session, publisher, &pkt);
-			}
-		}
-	}
-	/* If we got here, the remote publisher has been removed from the
-	 * room: let's notify all other publishers in the room */
+	}
+	/* Now handle the packet as if coming from a regular publisher */
+	janus_refcount_increase_nodebug(&publisher->ref);
+	janus_videoroom_incoming_rtp_internal(publisher->session, publisher, &pkt);
+}
+
+/* Helper to remove a remote publisher from its room, when it's gone */
+static void janus_videoroom_remote_publisher_leave(janus_videoroom_publisher *publisher) {
+	janus_videoroom *videoroom = publisher->room;
+	GList *temp = NULL;
+	/* The remote publisher has been removed from the room:
+	 * let's notify all other publishers in the room */
 	janus_mutex_lock(&publisher->rec_mutex);
 	g_free(publisher->recording_base);
 	publisher->recording_base = NULL;
@@ -12865,6 +14749,7 @@ static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 		}
 		g_slist_free(ps->subscribers);
 		ps->subscribers = NULL;
+		janus_videoroom_publisher_stream_update_snapshot(ps);
 		int i=0;
 		for(i=0; i<3; i++) {
 			ps->vssrc[i] = 0;
@@ -12933,11 +14818,304 @@ static void *janus_videoroom_remote_publisher_thread(void *user_data) {
 	janus_videoroom_leave_or_unpublish(publisher, TRUE, FALSE);
 	janus_videoroom_publisher_destroy(publisher);
 	/* Done */
-	JANUS_LOG(LOG_VERB, "[%s/%s] Leaving remote publisher thread...\n",
-		videoroom->room_id_str, publisher->user_id_str);
 	janus_refcount_decrease(&videoroom->ref);
 	janus_refcount_decrease(&publisher->session->ref);
 	janus_refcount_decrease(&publisher->ref);
+}
+
+/* Thread responsible for a specific remote publisher */
+static void *janus_videoroom_remote_publisher_thread(void *user_data) {
+	janus_videoroom_publisher *publisher = (janus_videoroom_publisher *)user_data;
+	if(publisher == NULL) {
+		JANUS_LOG(LOG_ERR, "Invalid publisher instance\n");
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	JANUS_LOG(LOG_VERB, "[%s/%s] Joining remote publisher thread...\n",
+		publisher->room->room_id_str, publisher->user_id_str);
+
+	/* File descriptors */
+	socklen_t addrlen;
+	struct sockaddr_storage remote = { 0 };
+	int resfd = 0, bytes = 0;
+	struct pollfd fds[3];
+	int pipe_fd = publisher->pipefd[0];
+	char buffer[1500];
+	memset(buffer, 0, 1500);
+	if(pipe_fd == -1) {
+		/* If the pipe file descriptor doesn't exist, it means we're done already,
+		 * and/or we may never be notified about sessions being closed, so give up */
+		JANUS_LOG(LOG_WARN, "[%s/%s] Leaving remote publisher thread, no pipe file descriptor...\n",
+			publisher->room->room_id_str, publisher->user_id_str);
+		janus_videoroom_publisher_destroy(publisher);
+		janus_refcount_decrease(&publisher->session->ref);
+		janus_refcount_decrease(&publisher->ref);
+		g_thread_unref(g_thread_self());
+		return NULL;
+	}
+	janus_videoroom_recv_batch *batch = g_malloc0(sizeof(janus_videoroom_recv_batch));
+
+	/* As the first thing, we add the remote publisher to the list */
+	janus_videoroom_remote_publisher_join(publisher);
+	janus_videoroom *videoroom = publisher->room;
+
+	/* Loop */
+	int num = 0, i = 0, got = 0, j = 0;
+	while(!g_atomic_int_get(&publisher->remote_leaving) && !g_atomic_int_get(&publisher->destroyed)) {
+		/* Prepare poll */
+		num = 0;
+		if(publisher->remote_fd != -1) {
+			fds[num].fd = publisher->remote_fd;
+			fds[num].events = POLLIN;
+			fds[num].revents = 0;
+			num++;
+		}
+		if(publisher->remote_rtcp_fd != -1) {
+			fds[num].fd = publisher->remote_rtcp_fd;
+			fds[num].events = POLLIN;
+			fds[num].revents = 0;
+			num++;
+		}
+		pipe_fd = publisher->pipefd[0];
+		if(pipe_fd == -1) {
+			/* Pipe was closed? Means the call is over */
+			break;
+		}
+		fds[num].fd = pipe_fd;
+		fds[num].events = POLLIN;
+		fds[num].revents = 0;
+		num++;
+		/* Check if we need to send any PLI */
+		janus_videoroom_remote_publisher_plis(publisher);
+		/* Wait for some data */
+		resfd = poll(fds, num, 1000);
+		if(resfd < 0) {
+			if(errno == EINTR) {
+				JANUS_LOG(LOG_HUGE, "[%s/%s] Got an EINTR (%s), ignoring...\n",
+					videoroom->room_id_str, publisher->user_id_str, g_strerror(errno));
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "[%s/%s] Error polling...\n", videoroom->room_id_str, publisher->user_id_str);
+			JANUS_LOG(LOG_ERR, "[%s/%s]   -- %d (%s)\n",
+				videoroom->room_id_str, publisher->user_id_str, errno, g_strerror(errno));
+			break;
+		} else if(resfd == 0) {
+			/* No data, keep going */
+			continue;
+		}
+		if(g_atomic_int_get(&publisher->remote_leaving) || g_atomic_int_get(&publisher->destroyed))
+			break;
+		for(i=0; i<num; i++) {
+			if(fds[i].revents & (POLLERR | POLLHUP)) {
+				/* Socket error? */
+				JANUS_LOG(LOG_ERR, "[%s/%s] Error polling: %s... %d (%s)\n",
+					videoroom->room_id_str, publisher->user_id_str,
+					fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP", errno, g_strerror(errno));
+				break;
+			} else if(fds[i].revents & POLLIN) {
+				if(pipe_fd != -1 && fds[i].fd == pipe_fd) {
+					/* Poll interrupted for a reason, go on */
+					int code = 0;
+					(void)read(pipe_fd, &code, sizeof(int));
+					break;
+				} else if(fds[i].fd == publisher->remote_rtcp_fd) {
+					/* Got Something on the RTCP socket, we only use this for latching */
+					addrlen = sizeof(remote);
+					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
+					if(bytes < 0 || (!janus_is_rtp(buffer, bytes) && !janus_is_rtcp(buffer, bytes))) {
+						/* For latching we need an RTP or RTCP packet */
+						continue;
+					}
+					memcpy(&publisher->rtcp_addr, &remote, addrlen);
+					continue;
+				}
+				/* Got RTP/RTCP packets, read as many as we can in one go */
+				got = janus_videoroom_recv_batch_read(batch, fds[i].fd);
+				for(j=0; j<got; j++) {
+					if(batch->length[j] > 0)
+						janus_videoroom_remote_publisher_incoming(publisher, batch->data[j], batch->length[j]);
+				}
+			}
+		}
+	}
+	g_free(batch);
+	JANUS_LOG(LOG_VERB, "[%s/%s] Leaving remote publisher thread...\n",
+		videoroom->room_id_str, publisher->user_id_str);
+	/* If we got here, the remote publisher has been removed from the room */
+	janus_videoroom_remote_publisher_leave(publisher);
+	g_thread_unref(g_thread_self());
+	return NULL;
+}
+
+/* Thread responsible for a trunk of remote publishers */
+static void *janus_videoroom_remote_trunk_thread(void *user_data) {
+	janus_videoroom_remote_trunk *trunk = (janus_videoroom_remote_trunk *)user_data;
+	JANUS_LOG(LOG_VERB, "[trunk-%s] Joining remote trunk thread...\n", trunk->trunk_id);
+
+	/* File descriptors */
+	socklen_t addrlen;
+	struct sockaddr_storage remote = { 0 };
+	int resfd = 0, bytes = 0, num = 0, i = 0, got = 0, j = 0;
+	struct pollfd fds[3];
+	char buffer[1500];
+	memset(buffer, 0, 1500);
+	janus_videoroom_recv_batch *batch = g_malloc0(sizeof(janus_videoroom_recv_batch));
+	janus_videoroom_publisher *publisher = NULL;
+	janus_rtp_header *rtp = NULL;
+	uint32_t ssrc = 0;
+	GList *joining = NULL, *leaving = NULL, *temp = NULL;
+	GHashTableIter iter;
+	gpointer value;
+
+	/* Loop */
+	while(!g_atomic_int_get(&trunk->destroyed) && !g_atomic_int_get(&stopping)) {
+		/* Check if any remote publisher was added or removed: we're the only
+		 * ones changing the publishers table, so we can read it without locking */
+		janus_mutex_lock(&trunk->mutex);
+		g_hash_table_iter_init(&iter, trunk->publishers);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			publisher = (janus_videoroom_publisher *)value;
+			if(g_atomic_int_get(&publisher->remote_leaving) || g_atomic_int_get(&publisher->destroyed)) {
+				leaving = g_list_append(leaving, publisher);
+				g_hash_table_iter_remove(&iter);
+			}
+		}
+		joining = trunk->joining;
+		trunk->joining = NULL;
+		for(temp = joining; temp; temp = temp->next) {
+			publisher = (janus_videoroom_publisher *)temp->data;
+			g_hash_table_insert(trunk->publishers, GUINT_TO_POINTER(publisher->remote_ssrc_base), publisher);
+		}
+		janus_mutex_unlock(&trunk->mutex);
+		for(temp = joining; temp; temp = temp->next) {
+			publisher = (janus_videoroom_publisher *)temp->data;
+			JANUS_LOG(LOG_VERB, "[trunk-%s] Adding remote publisher %s/%s (SSRC base %"SCNu32")\n", trunk->trunk_id,
+				publisher->room->room_id_str, publisher->user_id_str, publisher->remote_ssrc_base);
+			janus_videoroom_remote_publisher_join(publisher);
+		}
+		g_list_free(joining);
+		joining = NULL;
+		for(temp = leaving; temp; temp = temp->next) {
+			publisher = (janus_videoroom_publisher *)temp->data;
+			JANUS_LOG(LOG_VERB, "[trunk-%s] Removing remote publisher %s/%s\n", trunk->trunk_id,
+				publisher->room->room_id_str, publisher->user_id_str);
+			janus_videoroom_remote_publisher_leave(publisher);
+		}
+		g_list_free(leaving);
+		leaving = NULL;
+		/* Check if we need to send any PLI */
+		g_hash_table_iter_init(&iter, trunk->publishers);
+		while(g_hash_table_iter_next(&iter, NULL, &value))
+			janus_videoroom_remote_publisher_plis((janus_videoroom_publisher *)value);
+		/* Prepare poll */
+		num = 0;
+		fds[num].fd = trunk->fd;
+		fds[num].events = POLLIN;
+		fds[num].revents = 0;
+		num++;
+		fds[num].fd = trunk->rtcp_fd;
+		fds[num].events = POLLIN;
+		fds[num].revents = 0;
+		num++;
+		fds[num].fd = trunk->pipefd[0];
+		fds[num].events = POLLIN;
+		fds[num].revents = 0;
+		num++;
+		/* Wait for some data */
+		resfd = poll(fds, num, 1000);
+		if(resfd < 0) {
+			if(errno == EINTR) {
+				JANUS_LOG(LOG_HUGE, "[trunk-%s] Got an EINTR (%s), ignoring...\n",
+					trunk->trunk_id, g_strerror(errno));
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "[trunk-%s] Error polling... %d (%s)\n",
+				trunk->trunk_id, errno, g_strerror(errno));
+			break;
+		} else if(resfd == 0) {
+			/* No data, keep going */
+			continue;
+		}
+		for(i=0; i<num; i++) {
+			if(fds[i].revents & (POLLERR | POLLHUP)) {
+				/* Socket error? */
+				JANUS_LOG(LOG_ERR, "[trunk-%s] Error polling: %s... %d (%s)\n", trunk->trunk_id,
+					fds[i].revents & POLLERR ? "POLLERR" : "POLLHUP", errno, g_strerror(errno));
+				break;
+			} else if(fds[i].revents & POLLIN) {
+				if(fds[i].fd == trunk->pipefd[0]) {
+					/* Poll interrupted for a reason, go on */
+					int code = 0;
+					(void)read(trunk->pipefd[0], &code, sizeof(int));
+					break;
+				} else if(fds[i].fd == trunk->rtcp_fd) {
+					/* Got something on the RTCP socket, we only use this for latching:
+					 * the SSRC tells us which remote publisher is latching */
+					addrlen = sizeof(remote);
+					bytes = recvfrom(fds[i].fd, buffer, 1500, 0, (struct sockaddr *)&remote, &addrlen);
+					if(bytes < 12 || (!janus_is_rtp(buffer, bytes) && !janus_is_rtcp(buffer, bytes)))
+						continue;
+					if(janus_is_rtp(buffer, bytes)) {
+						rtp = (janus_rtp_header *)buffer;
+						ssrc = ntohl(rtp->ssrc);
+					} else {
+						ssrc = janus_rtcp_get_sender_ssrc(buffer, bytes);
+					}
+					publisher = g_hash_table_lookup(trunk->publishers,
+						GUINT_TO_POINTER(ssrc - (ssrc % REMOTE_PUBLISHER_SSRC_BLOCK)));
+					if(publisher == NULL) {
+						JANUS_LOG(LOG_WARN, "[trunk-%s] Can't latch RTCP, unknown SSRC %"SCNu32"\n",
+							trunk->trunk_id, ssrc);
+						continue;
+					}
+					memcpy(&publisher->rtcp_addr, &remote, addrlen);
+					continue;
+				}
+				/* Got RTP packets, read as many as we can in one go and
+				 * demultiplex them to the right remote publisher by SSRC */
+				got = janus_videoroom_recv_batch_read(batch, fds[i].fd);
+				for(j=0; j<got; j++) {
+					if(batch->length[j] < 12 || !janus_is_rtp(batch->data[j], batch->length[j]))
+						continue;
+					rtp = (janus_rtp_header *)batch->data[j];
+					ssrc = ntohl(rtp->ssrc);
+					publisher = g_hash_table_lookup(trunk->publishers,
+						GUINT_TO_POINTER(ssrc - (ssrc % REMOTE_PUBLISHER_SSRC_BLOCK)));
+					if(publisher == NULL || g_atomic_int_get(&publisher->remote_leaving))
+						continue;
+					janus_videoroom_remote_publisher_incoming(publisher, batch->data[j], batch->length[j]);
+				}
+			}
+		}
+	}
+	g_free(batch);
+	/* If we got here, the trunk is gone, and so are all its remote publishers */
+	JANUS_LOG(LOG_VERB, "[trunk-%s] Leaving remote trunk thread...\n", trunk->trunk_id);
+	janus_mutex_lock(&trunk->mutex);
+	joining = trunk->joining;
+	trunk->joining = NULL;
+	g_hash_table_iter_init(&iter, trunk->publishers);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		leaving = g_list_append(leaving, value);
+		g_hash_table_iter_remove(&iter);
+	}
+	janus_mutex_unlock(&trunk->mutex);
+	for(temp = joining; temp; temp = temp->next) {
+		/* These were never added to the room */
+		publisher = (janus_videoroom_publisher *)temp->data;
+		g_atomic_int_set(&publisher->remote_leaving, 1);
+		janus_videoroom_publisher_destroy(publisher);
+		janus_refcount_decrease(&publisher->session->ref);
+		janus_refcount_decrease(&publisher->ref);
+	}
+	g_list_free(joining);
+	for(temp = leaving; temp; temp = temp->next) {
+		publisher = (janus_videoroom_publisher *)temp->data;
+		g_atomic_int_set(&publisher->remote_leaving, 1);
+		janus_videoroom_remote_publisher_leave(publisher);
+	}
+	g_list_free(leaving);
+	janus_refcount_decrease(&trunk->ref);
 	g_thread_unref(g_thread_self());
 	return NULL;
 }
@@ -15,6 +15,7 @@
 
 #include "../apierror.h"
 #include "../debug.h"
+#include "../rtp.h"
 
 /* Plugin results */
 janus_plugin_result *janus_plugin_result_new(janus_plugin_result_type type, const char *text, json_t *content) {
@@ -48,6 +49,11 @@ void janus_plugin_rtp_extensions_reset(janus_plugin_rtp_extensions *extensions)
 		extensions->max_delay = -1;
 		extensions->dd_len = 0;
 		memset(extensions->dd_content, 0, sizeof(extensions->dd_content));
+		extensions->transport_seq_num = -1;
+		extensions->abs_send_time = -1;
+		extensions->mid[0] = '\0';
+		extensions->rid[0] = '\0';
+		extensions->repaired_rid[0] = '\0';
 	}
 }
 void janus_plugin_rtp_reset(janus_plugin_rtp *packet) {
@@ -57,6 +63,81 @@ void janus_plugin_rtp_reset(janus_plugin_rtp *packet) {
 		janus_plugin_rtp_extensions_reset(&packet->extensions);
 	}
 }
+static void janus_plugin_rtp_shared_free(const janus_refcount *shared_ref) {
+	janus_plugin_rtp_shared *shared = janus_refcount_containerof(shared_ref, janus_plugin_rtp_shared, ref);
+	g_free(shared->buffer);
+	g_free(shared);
+}
+janus_plugin_rtp_shared *janus_plugin_rtp_shared_new(const char *buffer, uint16_t length) {
+	if(buffer == NULL || length == 0)
+		return NULL;
+	janus_plugin_rtp_shared *shared = g_malloc(sizeof(janus_plugin_rtp_shared));
+	shared->buffer = g_malloc(length);
+	memcpy(shared->buffer, buffer, length);
+	shared->length = length;
+	janus_refcount_init(&shared->ref, janus_plugin_rtp_shared_free);
+	return shared;
+}
+/* RTP batches, to relay packets to many peers with a single call */
+#define JANUS_PLUGIN_RTP_BATCH_TARGETS	64
+#define JANUS_PLUGIN_RTP_BATCH_BUFFER	16384
+struct janus_plugin_rtp_batch {
+	janus_callbacks *gateway;
+	janus_plugin_rtp_target targets[JANUS_PLUGIN_RTP_BATCH_TARGETS];
+	janus_plugin_rtp packets[JANUS_PLUGIN_RTP_BATCH_TARGETS];
+	int count;
+	/* Packets (or only their headers, if there's a shared copy) are copied here */
+	char buffer[JANUS_PLUGIN_RTP_BATCH_BUFFER];
+	size_t used;
+};
+static GPrivate rtp_batch = G_PRIVATE_INIT(g_free);
+janus_plugin_rtp_batch *janus_plugin_rtp_batch_get(janus_callbacks *gateway) {
+	janus_plugin_rtp_batch *batch = g_private_get(&rtp_batch);
+	if(batch == NULL) {
+		batch = g_malloc(sizeof(janus_plugin_rtp_batch));
+		batch->count = 0;
+		batch->used = 0;
+		g_private_set(&rtp_batch, batch);
+	}
+	batch->gateway = gateway;
+	return batch;
+}
+void janus_plugin_rtp_batch_add(janus_plugin_rtp_batch *batch, janus_plugin_session *handle, janus_plugin_rtp *packet) {
+	if(batch == NULL || batch->gateway == NULL || handle == NULL || packet == NULL || packet->buffer == NULL || packet->length < 1)
+		return;
+	size_t size = packet->length;
+	if(packet->shared != NULL && packet->shared->length == packet->length) {
+		/* The core will only read the header, that's all we need to copy */
+		int plen = 0;
+		char *payload = janus_rtp_payload(packet->buffer, packet->length, &plen);
+		if(payload != NULL)
+			size = payload - packet->buffer;
+	}
+	if(size > sizeof(batch->buffer)) {
+		/* Too large to copy, relay it right away */
+		janus_plugin_rtp_batch_flush(batch);
+		batch->gateway->relay_rtp(handle, packet);
+		return;
+	}
+	if(batch->count == JANUS_PLUGIN_RTP_BATCH_TARGETS || batch->used + size > sizeof(batch->buffer))
+		janus_plugin_rtp_batch_flush(batch);
+	janus_plugin_rtp *copy = &batch->packets[batch->count];
+	*copy = *packet;
+	copy->buffer = batch->buffer + batch->used;
+	memcpy(copy->buffer, packet->buffer, size);
+	batch->used += size;
+	batch->targets[batch->count].handle = handle;
+	batch->targets[batch->count].packet = copy;
+	batch->count++;
+}
+void janus_plugin_rtp_batch_flush(janus_plugin_rtp_batch *batch) {
+	if(batch == NULL || batch->count == 0)
+		return;
+	batch->gateway->relay_rtp_batch(batch->targets, batch->count);
+	batch->count = 0;
+	batch->used = 0;
+}
+
 void janus_plugin_rtcp_reset(janus_plugin_rtcp *packet) {
 	if(packet) {
 		memset(packet, 0, sizeof(janus_plugin_rtcp));
@@ -21,6 +21,15 @@
  * - \c relay_rtp(): to send/relay the peer an RTP packet;
  * - \c relay_rtcp(): to send/relay the peer an RTCP message.
  * - \c relay_data(): to send/relay the peer a SCTP DataChannel message.
+ * - \c relay_data_batch(): to send/relay the peer several SCTP DataChannel
+ * messages at once.
+ * - \c relay_rtp_batch(): to send/relay RTP packets to several peers at once.
+ * - \c relay_data_batch_targets(): to send/relay SCTP DataChannel messages
+ * to several peers at once.
+ * - \c colocate(): to ask the core to serve two peers bridged by the plugin
+ * on the same event loop.
+ * - \c set_low_latency(): to ask the core to serve a peer with as little
+ * latency as possible, e.g., for interactive users.
  *
  * On the other hand, a plugin that wants to register at the Janus core
  * needs to implement the \c janus_plugin interface. Besides, as a
@@ -67,12 +76,16 @@ janus_plugin *create(void) {
  * - \c incoming_data(): a callback to notify you a peer has sent you a message on a SCTP DataChannel;
  * - \c data_ready(): a callback to notify you data can be sent on the SCTP DataChannel;
  * - \c slow_link(): a callback to notify you Janus or the peer have lost packets recently, and the media path may be slow;
+ * - \c estimated_bandwidth(): a callback to notify you of how much bandwidth Janus estimates is available towards the peer;
  * - \c hangup_media(): a callback to notify you the peer PeerConnection has been closed (e.g., after a DTLS alert);
  * - \c query_session(): this method is called by the core to get plugin-specific info on a session between you and a peer;
+ * - \c query_metrics(): this method is called by the core to get plugin-specific gauges, when metrics are scraped;
+ * - \c drain(): this method is called by the core when an administrator starts or stops draining Janus;
  * - \c destroy_session(): this method is called by the core to destroy a session between you and a peer.
  *
  * All the above methods and callbacks, except for \c incoming_rtp ,
- * \c incoming_rtcp , \c incoming_data and \c slow_link , are mandatory:
+ * \c incoming_rtcp , \c incoming_data , \c slow_link , \c estimated_bandwidth
+ * \c query_metrics and \c drain , are mandatory:
  * the Janus core will reject a plugin that doesn't implement any of the
  * mandatory callbacks. The previously mentioned ones, instead, are
  * optional, so you're free to implement only those you care about. If
@@ -80,9 +93,9 @@ janus_plugin *create(void) {
  * sense to not implement the \c incoming_data callback at all. At the
  * same time, if your plugin is ONLY going to use data channels and
  * can't care less about RTP or RTCP, \c incoming_rtp and \c incoming_rtcp
- * can be left out. Finally, \c slow_link is just there as a helper, some
- * additional information you may be interested about, but you're not
- * forced to receive it if you don't care.
+ * can be left out. Finally, \c slow_link and \c estimated_bandwidth are
+ * just there as helpers, some additional information you may be interested
+ * about, but you're not forced to receive it if you don't care.
  *
  * The Janus core \c janus_callbacks interface is provided to a plugin, together
  * with the path to the configurations files folder, in the \c init() method.
@@ -171,7 +184,7 @@ janus_plugin *create(void) {
  * Janus instance or it will crash.
  *
  */
-#define JANUS_PLUGIN_API_VERSION	102
+#define JANUS_PLUGIN_API_VERSION	113
 
 /*! \brief Initialization of all plugin properties to NULL
  *
@@ -208,9 +221,12 @@ static janus_plugin janus_echotest_plugin =
 		.incoming_data = NULL,			\
 		.data_ready = NULL,				\
 		.slow_link = NULL,				\
+		.estimated_bandwidth = NULL,	\
 		.hangup_media = NULL,			\
 		.destroy_session = NULL,		\
 		.query_session = NULL, 			\
+		.query_metrics = NULL, 			\
+		.drain = NULL,					\
 		## __VA_ARGS__ }
 
 
@@ -227,10 +243,18 @@ typedef struct janus_plugin_result janus_plugin_result;
 typedef struct janus_plugin_rtp janus_plugin_rtp;
 /*! \brief RTP extensions parsed in an RTP packet */
 typedef struct janus_plugin_rtp_extensions janus_plugin_rtp_extensions;
+/*! \brief Shared RTP packet that can be relayed to multiple peers */
+typedef struct janus_plugin_rtp_shared janus_plugin_rtp_shared;
 /*! \brief RTCP message exchanged with the core */
 typedef struct janus_plugin_rtcp janus_plugin_rtcp;
 /*! \brief Data message exchanged with the core */
 typedef struct janus_plugin_data janus_plugin_data;
+/*! \brief RTP packet to relay to a specific peer, as part of a batch */
+typedef struct janus_plugin_rtp_target janus_plugin_rtp_target;
+/*! \brief Data message to relay to a specific peer, as part of a batch */
+typedef struct janus_plugin_data_target janus_plugin_data_target;
+/*! \brief Helper to collect RTP packets for different peers, and relay them as a batch */
+typedef struct janus_plugin_rtp_batch janus_plugin_rtp_batch;
 
 /* Use forward declaration to avoid including jansson.h */
 typedef struct json_t json_t;
@@ -244,8 +268,9 @@ struct janus_plugin_session {
 	/*! \brief Whether this mapping has been stopped definitely or not: if so,
 	 * the plugin shouldn't make use of it anymore */
 	volatile gint stopped;
-	/*! \brief Reference counter for this instance */
-	janus_refcount ref;
+	/*! \brief Reference counter for this instance (in a cache line of its own,
+	 * as it's shared by the core and the plugin threads) */
+	JANUS_REFCOUNT_HOT(ref);
 };
 
 /*! \brief The plugin session and callbacks interface */
@@ -335,6 +360,17 @@ struct janus_plugin {
 	 * @param[in] uplink Whether this is related to the uplink (Janus to peer)
 	 * or downlink (peer to Janus) */
 	void (* const slow_link)(janus_plugin_session *handle, int mindex, gboolean video, gboolean uplink);
+	/*! \brief Callback to be notified about the bandwidth Janus estimates is available towards a peer
+	 * \note The estimate is computed out of the transport wide cc feedback
+	 * the peer sends for the packets we send, which means it's only available
+	 * when the extension was negotiated: besides, the core only computes it
+	 * if the plugin implements this callback. The callback is only invoked
+	 * when the estimate changes significantly, and at most every 200ms.
+	 * Plugins can use it, e.g., to automatically switch simulcast or SVC
+	 * layers for the peer, depending on how much it can receive.
+	 * @param[in] handle The plugin/gateway session used for this peer
+	 * @param[in] estimate The estimated bandwidth, in bits per second */
+	void (* const estimated_bandwidth)(janus_plugin_session *handle, uint32_t estimate);
 	/*! \brief Callback to be notified about DTLS alerts from a peer (i.e., the PeerConnection is not valid any more)
 	 * @param[in] handle The plugin/gateway session used for this peer */
 	void (* const hangup_media)(janus_plugin_session *handle);
@@ -348,6 +384,21 @@ struct janus_plugin {
 	 * @param[in] handle The plugin/gateway session used for this peer
 	 * @returns A json_t object with the requested info */
 	json_t *(* const query_session)(janus_plugin_session *handle);
+	/*! \brief Method to get plugin-specific metrics, when the core metrics are scraped
+	 * \note This is optional, and is called on whatever thread is serving the scrape:
+	 * as such, it should be cheap, e.g., return counters the plugin keeps anyway
+	 * rather than iterate on all sessions. Each property of the returned object is
+	 * exposed as a gauge, prefixed by \c janus_plugin_ and labelled with the plugin
+	 * package; properties whose value is not a number are ignored
+	 * @returns A json_t object with the metrics names and values, or NULL */
+	json_t *(* const query_metrics)(void);
+	/*! \brief Method to notify the plugin that Janus started (or stopped) draining
+	 * \note This is optional, and only called if the administrator asked for plugins
+	 * to be involved: while draining, no new sessions or handles are accepted, and
+	 * plugins may want to let their users know, e.g., so that they can move to
+	 * another instance when it's convenient for them, rather than be kicked out
+	 * @param[in] draining Whether Janus is now draining or not */
+	void (* const drain)(gboolean draining);
 
 };
 
@@ -357,6 +408,13 @@ struct janus_callbacks {
 	 * @note The Janus core increases the references to both the message and jsep
 	 * json_t objects. This means that you'll have to decrease your own
 	 * reference yourself with a \c json_decref after calling push_event.
+	 * @note The same message object can be passed to push_event for several
+	 * peers (e.g., to notify all participants in a room about something), in
+	 * which case the core serializes it only once for all of them: this means
+	 * that a message must NOT be modified after it's been passed to push_event,
+	 * not even to send a different version of it to other peers, as they'd
+	 * get the serialization of the original message instead. Create a new
+	 * json_t object (or a copy) for each different message instead.
 	 * @param[in] handle The plugin/gateway session used for this peer
 	 * @param[in] plugin The plugin instance that is sending the message/event
 	 * @param[in] transaction The transaction identifier this message refers to
@@ -379,6 +437,34 @@ struct janus_callbacks {
 	 * @param[in] handle The plugin/gateway session that will be used for this peer
 	 * @param[in] packet The message data and related info */
 	void (* const relay_data)(janus_plugin_session *handle, janus_plugin_data *packet);
+	/*! \brief Callback to relay multiple SCTP/DataChannel messages to a peer at once
+	 * @note This is functionally the same as calling relay_data for each message,
+	 * but all messages are queued in one go and the core is only woken up once
+	 * to send them, which is cheaper when there are many (e.g., a backlog to replay).
+	 * Messages are sent in the order they're provided, and as for relay_data, the
+	 * buffers are copied, so they can be freed as soon as the callback returns
+	 * @param[in] handle The plugin/gateway session that will be used for this peer
+	 * @param[in] packets Array of messages to send
+	 * @param[in] count Number of messages in the array */
+	void (* const relay_data_batch)(janus_plugin_session *handle, janus_plugin_data *packets, int count);
+	/*! \brief Callback to relay RTP packets to several peers at once
+	 * @note This is functionally the same as calling relay_rtp for each target,
+	 * but the core only wakes up the loops of the peers once, after all packets
+	 * have been queued, which is much cheaper when fanning out the same media
+	 * to many peers (e.g., subscribers of the same publisher). Packets are queued
+	 * in the order they're provided, and as for relay_rtp, the buffers are copied,
+	 * so they can be reused as soon as the callback returns. The janus_plugin_rtp_batch
+	 * helpers can be used to collect the targets while processing each peer.
+	 * @param[in] targets Array of peers and the RTP packets to send them
+	 * @param[in] count Number of targets in the array */
+	void (* const relay_rtp_batch)(janus_plugin_rtp_target *targets, int count);
+	/*! \brief Callback to relay SCTP/DataChannel messages to several peers at once
+	 * @note This is functionally the same as calling relay_data for each target,
+	 * but the core only wakes up the loops of the peers once, after all messages
+	 * have been queued. Different targets can point to the same message
+	 * @param[in] targets Array of peers and the messages to send them
+	 * @param[in] count Number of targets in the array */
+	void (* const relay_data_batch_targets)(janus_plugin_data_target *targets, int count);
 
 	/*! \brief Helper to ask for a keyframe via a RTCP PLI to all video streams
 	 * @note This is a shortcut, as it is also possible to do the same by crafting
@@ -409,6 +495,26 @@ struct janus_callbacks {
 	 * callback on this plugin when done
 	 * @param[in] handle The plugin/gateway session to get rid of */
 	void (* const end_session)(janus_plugin_session *handle);
+	/*! \brief Placement hint, to ask the core to serve a peer on the same event loop as another one
+	 * \note This is meant for plugins bridging two peers (e.g., a 1:1 call): when both
+	 * peers are on the same static event loop, the core can send the packets relayed
+	 * from one to the other right away, from the same thread, rather than queueing
+	 * them and waking another loop up. If the peer has a PeerConnection already, it
+	 * will only be moved before the next one is set up, so the best time to ask for
+	 * this is before pushing a JSEP offer to it. Does nothing if static event loops
+	 * are not in use.
+	 * @param[in] handle The plugin/gateway session of the peer to move
+	 * @param[in] peer The plugin/gateway session of the peer to share the loop with
+	 * @returns 0 if the peers share the loop, 1 if they will, a negative integer otherwise */
+	int (* const colocate)(janus_plugin_session *handle, janus_plugin_session *peer);
+	/*! \brief Latency hint, to ask the core to favour latency over smoothness for a peer
+	 * \note When enabled, the packets relayed to the peer are never paced, and are sent
+	 * before those of other peers served by the same event loop: this is meant for
+	 * the few interactive users of a session, not for bulk viewers. What the plugin
+	 * relays (e.g., playout-delay values, cached keyframes) is up to the plugin itself.
+	 * @param[in] handle The plugin/gateway session of the peer
+	 * @param[in] enabled Whether the low-latency mode should be enabled or not */
+	void (* const set_low_latency)(janus_plugin_session *handle, gboolean enabled);
 
 	/*! \brief Callback to check whether the event handlers mechanism is enabled
 	 * @returns TRUE if it is, FALSE if it isn't (which means notify_event should NOT be called) */
@@ -575,6 +681,15 @@ struct janus_plugin_rtp_extensions {
 	uint8_t dd_len;
 	/*! \brief Dependency Descriptor content */
 	uint8_t dd_content[256];
+	/*! \brief Transport-wide sequence number, if available; -1 means no extension
+	 * @note Only set on incoming packets, the core takes care of this on outgoing ones */
+	int32_t transport_seq_num;
+	/*! \brief Absolute send time (24 bits, 6.18 fixed point seconds), if available; -1 means no extension
+	 * @note Only set on incoming packets, the core takes care of this on outgoing ones */
+	int32_t abs_send_time;
+	/*! \brief mid, rid and repaired rid, if available; empty strings mean no extension
+	 * @note Only set on incoming packets, the core takes care of these on outgoing ones */
+	char mid[16], rid[16], repaired_rid[16];
 };
 /*! \brief Helper method to initialise/reset the RTP extensions field
  * @note This is important because each of the supported extensions may
@@ -601,6 +716,14 @@ struct janus_plugin_rtp {
 	uint16_t length;
 	/*! \brief RTP extensions */
 	janus_plugin_rtp_extensions extensions;
+	/*! \brief Optional shared copy of the packet, when relaying the same packet to many peers
+	 * @note If set, the core only copies the RTP header from \c buffer, and
+	 * takes the payload from here when actually sending the packet, holding a
+	 * reference in the meanwhile: this means the payload in \c buffer must be
+	 * the same as in the shared copy, and only the RTP header may differ. As
+	 * only the header is read, \c buffer doesn't even need to contain the
+	 * payload at all, as long as \c length is the same as the shared copy */
+	janus_plugin_rtp_shared *shared;
 };
 /*! \brief Helper method to initialise/reset the RTP packet
  * @note The main motivation for this method comes from the presence of the
@@ -609,6 +732,55 @@ struct janus_plugin_rtp {
 */
 void janus_plugin_rtp_reset(janus_plugin_rtp *packet);
 
+/*! \brief Immutable, reference counted copy of an RTP packet, that plugins can
+ * attach to janus_plugin_rtp instances when relaying the same packet to many
+ * peers, so that the core doesn't need a copy of the payload for each of them */
+struct janus_plugin_rtp_shared {
+	/*! \brief The packet data */
+	char *buffer;
+	/*! \brief The packet length */
+	uint16_t length;
+	/*! \brief Reference counter for this instance */
+	janus_refcount ref;
+};
+/*! \brief Helper method to create a new shared RTP packet
+ * @param[in] buffer The RTP packet to copy
+ * @param[in] length The RTP packet length
+ * @returns A new janus_plugin_rtp_shared instance, with a reference that
+ * must be released with janus_refcount_decrease() when done */
+janus_plugin_rtp_shared *janus_plugin_rtp_shared_new(const char *buffer, uint16_t length);
+
+/*! \brief Janus plugin RTP packet to relay to a specific peer */
+struct janus_plugin_rtp_target {
+	/*! \brief The plugin/gateway session of the peer */
+	janus_plugin_session *handle;
+	/*! \brief The RTP packet to send */
+	janus_plugin_rtp *packet;
+};
+
+/* Helpers to fan out RTP packets via relay_rtp_batch: plugins usually
+ * rewrite the RTP header in place for each peer, and restore it right after,
+ * so the batch takes a copy of each packet it's given. When the packet has a
+ * shared copy, only the RTP header is copied, which makes this cheap. The
+ * packets are relayed when the batch gets full, or when it's flushed */
+/*! \brief Helper method to get the RTP batch of the current thread
+ * @note Each thread has its own batch, which is created the first time it's
+ * needed, and freed when the thread exits: as it's meant to be flushed at the
+ * end of each fan-out, it's always empty when it's returned
+ * @param[in] gateway The callbacks to relay the packets with
+ * @returns The janus_plugin_rtp_batch instance of the thread */
+janus_plugin_rtp_batch *janus_plugin_rtp_batch_get(janus_callbacks *gateway);
+/*! \brief Helper method to add an RTP packet for a peer to a batch
+ * @note The packet is copied, so it can be modified as soon as this method
+ * returns; if the batch is full, the packets collected so far are relayed first
+ * @param[in] batch The janus_plugin_rtp_batch instance to add the packet to
+ * @param[in] handle The plugin/gateway session of the peer
+ * @param[in] packet The RTP packet to send */
+void janus_plugin_rtp_batch_add(janus_plugin_rtp_batch *batch, janus_plugin_session *handle, janus_plugin_rtp *packet);
+/*! \brief Helper method to relay all the packets collected in a batch, and reset it
+ * @param[in] batch The janus_plugin_rtp_batch instance to flush */
+void janus_plugin_rtp_batch_flush(janus_plugin_rtp_batch *batch);
+
 /*! \brief Janus plugin RTCP packet */
 struct janus_plugin_rtcp {
 	/*! \brief Index of the stream (relative to the SDP)
@@ -624,6 +796,13 @@ struct janus_plugin_rtcp {
 	char *buffer;
 	/*! \brief The packet length */
 	uint16_t length;
+	/*! \brief Whether the core already parsed the packet and filled in the properties below
+	 * @note Only set on incoming packets: outgoing packets don't need to set any of these */
+	gboolean summarized;
+	/*! \brief Whether the packet contains a PLI or a FIR (same as janus_rtcp_has_pli and janus_rtcp_has_fir) */
+	gboolean has_pli, has_fir;
+	/*! \brief REMB bitrate in the packet, if any (0 otherwise) */
+	uint32_t remb;
 };
 /*! \brief Helper method to initialise/reset the RTCP packet
  * @param[in] packet Pointer to the janus_plugin_rtcp packet to reset
@@ -650,6 +829,14 @@ struct janus_plugin_data {
  * @param[in] packet Pointer to the janus_plugin_data message to reset
 */
 void janus_plugin_data_reset(janus_plugin_data *packet);
+
+/*! \brief Janus plugin data message to relay to a specific peer */
+struct janus_plugin_data_target {
+	/*! \brief The plugin/gateway session of the peer */
+	janus_plugin_session *handle;
+	/*! \brief The message to send */
+	janus_plugin_data *packet;
+};
 ///@}
 
 
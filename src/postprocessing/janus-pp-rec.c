@@ -93,13 +93,62 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
                                 Minimum latency of moving average to reach
                                   before starting to correct timestamps.
                                   (default=500)
+  -b, --batch=file              Process all the recordings listed in this
+                                  file, one 'source.mjr [destination]' per
+                                  line ('-' to read the list from stdin)
+  -J, --jobs=count              How many recordings to process in parallel
+                                  in batch mode (default=number of cores)
+  -A, --audio=file              Merge this Opus .mjr recording in the target
+                                  file of the video one (VP8, VP9 or H.264),
+                                  synchronizing them via the recording times
+  -k, --key=file                Decrypt recordings Janus encrypted at rest
+                                  with the key in this file
+\endverbatim
+ *
+ * When there are many recordings to process (e.g., all those of a day),
+ * you can pass them all to a single janus-pp-rec invocation in batch
+ * mode, rather than invoking it once per file: in that case, the tool
+ * reads the list of recordings to process from the file passed via
+ * \c --batch (or from the standard input, if \c - is passed), and
+ * processes up to \c --jobs of them in parallel, using a separate
+ * janus-pp-rec process for each of them with the same options. Each line
+ * in the list must contain the path to the source .mjr file and,
+ * optionally, the path to the destination, separated by whitespace: if
+ * the destination is missing, the one of the source is used, with the
+ * extension replaced by the one passed via \c --format. The tool returns
+ * a non-zero value if the processing of any of the recordings failed.
+ *
+\verbatim
+ls /path/to/recordings/*-audio.mjr | ./janus-pp-rec --format=opus --jobs=8 --batch=-
+\endverbatim
+ *
+ * Audio and video recordings belonging to the same media session (e.g.,
+ * those of a VideoRoom publisher) can also be muxed in a single file in
+ * the same pass, rather than processing them separately and muxing the
+ * results with a third-party application. To do that, pass the video
+ * recording as the source, and the Opus recording via \c --audio: the
+ * audio frames will be written to the same .webm/.mkv (VP8/VP9) or
+ * .mp4/.mkv (H.264) target file, interleaved with the video ones and
+ * synchronized using the times the two recordings started at, e.g.:
+ *
+\verbatim
+./janus-pp-rec --audio=/path/to/audio.mjr /path/to/video.mjr /path/to/destination.webm
+\endverbatim
+ *
+ * Recordings Janus encrypted at rest (see the \c recordings_encryption_key
+ * property in \c janus.jcfg ) can only be processed if the same key is
+ * passed via \c --key (or the \c JANUS_PPREC_KEY environment variable):
+ * their segments are authenticated and decrypted in memory, in order,
+ * and processing stops at the first segment that isn't authentic.
+ *
+\verbatim
+./janus-pp-rec --key=/path/to/recordings.key /path/to/source.mjr /path/to/destination.opus
 \endverbatim
  *
  * \note This utility does not do any form of transcoding. It just
  * depacketizes the RTP frames in order to get the payload, and saves
  * the frames in a valid container. Any further post-processing (e.g.,
- * muxing audio and video belonging to the same media session in a single
- * .webm file) is up to third-party applications.
+ * mixing or transcoding the media) is up to third-party applications.
  *
  * \ingroup postprocessing
  * \ref postprocessing
@@ -115,6 +164,9 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 
 #include <jansson.h>
 
@@ -122,6 +174,7 @@ Usage: janus-pp-rec [OPTIONS] source.mjr
 #include "../utils.h"
 #include "pp-options.h"
 #include "pp-rtp.h"
+#include "pp-mjr.h"
 #include "pp-webm.h"
 #include "pp-h264.h"
 #include "pp-av1.h"
@@ -154,6 +207,22 @@ static int working = 0;
 #define DEFAULT_RESTAMP_MIN_TH 500
 #define DEFAULT_RESTAMP_PACKETS 10
 
+/* Size of the buffer we read recordings with, when we can't map them in
+ * memory: packets are mostly read in increasing offsets, so a larger
+ * buffer saves a lot of system calls */
+#define JANUS_PP_READ_BUFFER_SIZE	(1024*1024)
+
+/* Merging of an Opus recording in the target file of a video one */
+static janus_pp_frame_packet *janus_pp_audio_parse(janus_pp_mjr *mjr, gboolean *multiopus, int *opusred_pt, gint64 *w_time);
+
+/* Batch mode, to process many recordings with a single invocation */
+static int janus_pp_batch_process(char **args, const char *batch, int jobs, const char *extension);
+
+/* Index files Janus can save alongside recordings (see JANUS_RECORDER_INDEX_MAGIC in record.h) */
+#define JANUS_PP_INDEX_MAGIC "MJRIDX01"
+#define JANUS_PP_INDEX_ENTRY_SIZE 24
+static gboolean janus_pp_index_check(const char *source, long fsize);
+
 /* Signal handler */
 static void janus_pp_handle_signal(int signum) {
 	working = 0;
@@ -224,9 +293,12 @@ int main(int argc, char *argv[]) {
 	options.restamp_multiplier = g_getenv("JANUS_PPREC_RESTAMP") ? atoi(g_getenv("JANUS_PPREC_RESTAMP")) : DEFAULT_RESTAMP_MULTIPLIER;
 	options.restamp_min_th = g_getenv("JANUS_PPREC_RESTAMP_MIN_TH") ? atoi(g_getenv("JANUS_PPREC_RESTAMP_MIN_TH")) : DEFAULT_RESTAMP_MIN_TH;
 	options.restamp_packets = g_getenv("JANUS_PPREC_RESTAMP_PACKETS") ? atoi(g_getenv("JANUS_PPREC_RESTAMP_PACKETS")) : DEFAULT_RESTAMP_PACKETS;
-	/* Let's call our cmdline parser */
-	if(!janus_pprec_options_parse(&options, argc, argv))
+	/* Let's call our cmdline parser (keeping a copy of the arguments, in case we need them for batch mode) */
+	char **args = g_strdupv(argv);
+	if(!janus_pprec_options_parse(&options, argc, argv)) {
+		g_strfreev(args);
 		exit(1);
+	}
 
 	/* Check if we only need to print the supported extensions for all codecs */
 	if(options.fileexts_only) {
@@ -295,6 +367,34 @@ int main(int argc, char *argv[]) {
 		options.restamp_packets = DEFAULT_RESTAMP_PACKETS;
 	if(options.restamp_min_th < 0)
 		options.restamp_packets = DEFAULT_RESTAMP_MIN_TH;
+	const char *key = options.key ? options.key : g_getenv("JANUS_PPREC_KEY");
+	if(key != NULL && !janus_pp_mjr_set_key(key)) {
+		g_strfreev(args);
+		g_free(metadata);
+		g_free(extension);
+		janus_pprec_options_destroy();
+		exit(1);
+	}
+
+	/* Check if we've been asked to process a list of recordings */
+	if(options.batch != NULL) {
+		if(options.paths != NULL || options.audio != NULL || jsonheader_only || header_only || parse_only) {
+			JANUS_LOG(LOG_ERR, "Batch mode only supports processing recordings listed in the batch file\n");
+			g_strfreev(args);
+			g_free(metadata);
+			g_free(extension);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		int res = janus_pp_batch_process(args, options.batch,
+			options.jobs > 0 ? options.jobs : (int)g_get_num_processors(), extension);
+		g_strfreev(args);
+		g_free(metadata);
+		g_free(extension);
+		janus_pprec_options_destroy();
+		exit(res);
+	}
+	g_strfreev(args);
 
 	/* Evaluate arguments to find source and target */
 	char *source = options.paths ? options.paths[0] : NULL;
@@ -347,17 +447,40 @@ int main(int argc, char *argv[]) {
 		extension = g_strdup(extension);
 	}
 
+	if(options.audio != NULL && (jsonheader_only || header_only || parse_only || extjson_only)) {
+		JANUS_LOG(LOG_ERR, "Merging an audio recording is only supported when processing\n");
+		janus_pprec_options_destroy();
+		exit(1);
+	}
+
 	if(options.faststart && strcasecmp(extension, "mp4")) {
 		JANUS_LOG(LOG_ERR, "Faststart only supported for MP4");
 		janus_pprec_options_destroy();
 		exit(1);
 	}
 
-	FILE *file = fopen(source, "rb");
+	/* Map the recording in memory, if we can, so that all the reads
+	 * the parsing and processing do don't need any system call */
+	FILE *file = NULL;
+	janus_pp_mjr *mjr = janus_pp_mjr_open(source);
+	if(mjr != NULL) {
+		file = janus_pp_mjr_file(mjr);
+		if(file == NULL) {
+			janus_pp_mjr_close(mjr);
+			mjr = NULL;
+		}
+	}
 	if(file == NULL) {
-		JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
-		janus_pprec_options_destroy();
-		exit(1);
+		file = fopen(source, "rb");
+		if(file == NULL) {
+			JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		setvbuf(file, NULL, _IOFBF, JANUS_PP_READ_BUFFER_SIZE);
+#ifdef POSIX_FADV_SEQUENTIAL
+		posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
 	}
 	fseek(file, 0L, SEEK_END);
 	long fsize = ftell(file);
@@ -369,6 +492,11 @@ int main(int argc, char *argv[]) {
 	working = 1;
 	signal(SIGINT, janus_pp_handle_signal);
 
+	/* If there's an index, the pre-parse only needs to look at the info header */
+	gboolean indexed = janus_pp_index_check(source, fsize);
+	if(indexed && !jsonheader_only)
+		JANUS_LOG(LOG_INFO, "Recording has an index, skipping the full pre-parse\n");
+
 	/* Pre-parse */
 	if(!jsonheader_only)
 		JANUS_LOG(LOG_INFO, "Pre-parsing file to generate ordered index...\n");
@@ -397,6 +525,10 @@ int main(int argc, char *argv[]) {
 			janus_pprec_options_destroy();
 			exit(0);
 		}
+		if(indexed && parsed_header) {
+			/* We know the rest of the file only contains frames */
+			break;
+		}
 		/* Read frame header */
 		skip = 0;
 		fseek(file, offset, SEEK_SET);
@@ -1342,6 +1474,49 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	/* Check if there's an audio recording to merge in the same file */
+	janus_pp_mjr *audio_mjr = NULL;
+	FILE *audio_file = NULL;
+	janus_pp_frame_packet *audio_list = NULL;
+	if(options.audio != NULL) {
+		if(!vp8 && !vp9 && !h264) {
+			JANUS_LOG(LOG_ERR, "Audio recordings can only be merged in VP8, VP9 or H.264 ones\n");
+			g_free(metadata);
+			g_free(extension);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		if(w_time == 0) {
+			JANUS_LOG(LOG_ERR, "Old .mjr header format, can't synchronize the audio recording\n");
+			g_free(metadata);
+			g_free(extension);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		JANUS_LOG(LOG_INFO, "Merging audio file: %s\n", options.audio);
+		gboolean audio_multiopus = FALSE;
+		int audio_red_pt = 0;
+		gint64 audio_w_time = 0;
+		audio_mjr = janus_pp_mjr_open(options.audio);
+		if(audio_mjr != NULL) {
+			audio_file = janus_pp_mjr_file(audio_mjr);
+			if(audio_file != NULL)
+				audio_list = janus_pp_audio_parse(audio_mjr, &audio_multiopus, &audio_red_pt, &audio_w_time);
+		}
+		if(audio_list == NULL) {
+			JANUS_LOG(LOG_ERR, "Error parsing audio file %s\n", options.audio);
+			janus_pp_mjr_close(audio_mjr);
+			g_free(metadata);
+			g_free(extension);
+			janus_pprec_options_destroy();
+			exit(1);
+		}
+		/* The audio stream is added when the video writer creates the file */
+		JANUS_LOG(LOG_INFO, "  -- Audio started %.3fs %s the video\n",
+			(double)llabs(audio_w_time - w_time)/G_USEC_PER_SEC, audio_w_time >= w_time ? "after" : "before");
+		janus_pp_opus_mux(audio_multiopus, audio_red_pt, audio_w_time - w_time);
+	}
+
 	if(!video && !data) {
 		if(opus) {
 			if(janus_pp_opus_create(destination, metadata, multiopus, extension, opusred_pt) < 0) {
@@ -1460,6 +1635,10 @@ int main(int argc, char *argv[]) {
 			}
 		}
 	} else {
+		/* If we're merging audio, its frames are queued and written along the video ones */
+		if(audio_list != NULL && janus_pp_opus_process(audio_file, audio_list, &working) < 0) {
+			JANUS_LOG(LOG_ERR, "Error processing Opus RTP frames...\n");
+		}
 		if(vp8 || vp9) {
 			if(janus_pp_webm_process(file, list, vp8, &working) < 0) {
 				JANUS_LOG(LOG_ERR, "Error processing %s RTP frames...\n", vp8 ? "VP8" : "VP9");
@@ -1490,6 +1669,10 @@ int main(int argc, char *argv[]) {
 		} else if(h265) {
 			janus_pp_h265_close();
 		}
+		if(audio_mjr != NULL) {
+			janus_pp_opus_close();
+			janus_pp_mjr_close(audio_mjr);
+		}
 	} else if(data) {
 		if(textdata) {
 			janus_pp_srt_close();
@@ -1507,7 +1690,10 @@ int main(int argc, char *argv[]) {
 			janus_pp_l16_close();
 		}
 	}
-	fclose(file);
+	if(mjr != NULL)
+		janus_pp_mjr_close(mjr);
+	else
+		fclose(file);
 
 	file = fopen(destination, "rb");
 	if(file == NULL) {
@@ -1525,6 +1711,12 @@ int main(int argc, char *argv[]) {
 		g_free(temp);
 		temp = next;
 	}
+	temp = audio_list;
+	while(temp) {
+		next = temp->next;
+		g_free(temp);
+		temp = next;
+	}
 
 	g_free(metadata);
 	g_free(extension);
@@ -1534,7 +1726,315 @@ int main(int argc, char *argv[]) {
 	return 0;
 }
 
+/* Parse an Opus recording to merge in the target file of the video one: we
+ * only need the ordered list of packets, and the time the recording started */
+static janus_pp_frame_packet *janus_pp_audio_parse(janus_pp_mjr *mjr, gboolean *multiopus, int *opusred_pt, gint64 *w_time) {
+	long offset = 0;
+	janus_pp_mjr_frame frame;
+	/* We need the info header, so only the new .mjr format is supported */
+	if(!janus_pp_mjr_next(mjr, &offset, &frame) || !frame.info || frame.len == 0) {
+		JANUS_LOG(LOG_ERR, "Invalid header, not a recent .mjr file?\n");
+		return NULL;
+	}
+	gboolean has_timestamps = !memcmp(frame.prefix, "MJR00002", 8);
+	json_error_t error;
+	json_t *info = json_loadb((const char *)frame.data, frame.len, 0, &error);
+	if(!info) {
+		JANUS_LOG(LOG_ERR, "JSON error: on line %d: %s\n", error.line, error.text);
+		return NULL;
+	}
+	const char *t = json_string_value(json_object_get(info, "t"));
+	const char *c = json_string_value(json_object_get(info, "c"));
+	json_t *written = json_object_get(info, "u");
+	if(t == NULL || strcasecmp(t, "a") || c == NULL || (strcasecmp(c, "opus") && strcasecmp(c, "multiopus"))) {
+		JANUS_LOG(LOG_ERR, "Not an Opus recording (%s)\n", c ? c : "??");
+		json_decref(info);
+		return NULL;
+	}
+	if(json_is_true(json_object_get(info, "e"))) {
+		JANUS_LOG(LOG_ERR, "End-to-end encrypted media recording, can't process...\n");
+		json_decref(info);
+		return NULL;
+	}
+	if(!written || !json_is_integer(written)) {
+		JANUS_LOG(LOG_ERR, "Missing recording written time in info header...\n");
+		json_decref(info);
+		return NULL;
+	}
+	*multiopus = !strcasecmp(c, "multiopus");
+	*opusred_pt = json_integer_value(json_object_get(info, "or"));
+	*w_time = json_integer_value(written);
+	json_decref(info);
+	/* Now let's parse the frames and order them */
+	janus_pp_frame_packet *alist = NULL, *alast = NULL;
+	uint32_t highest_rtp_ts = 0, ssrc = 0;
+	/* Start from 1 to take into account late packets */
+	int times_resetted = 1;
+	uint64_t max32 = UINT32_MAX;
+	gboolean started = FALSE;
+	int skip = 0, count = 0;
+	while(working && janus_pp_mjr_next(mjr, &offset, &frame)) {
+		if(frame.info || frame.len < 12 || frame.len > 1500) {
+			/* Not RTP, skip */
+			continue;
+		}
+		const uint8_t *buffer = frame.data;
+		int len = frame.len;
+		janus_pp_rtp_header *rtp = (janus_pp_rtp_header *)buffer;
+		if(ssrc == 0)
+			ssrc = ntohl(rtp->ssrc);
+		if(ssrc != ntohl(rtp->ssrc))
+			continue;
+		skip = rtp->csrccount*4;
+		if(rtp->extension && 12+skip+4 <= len) {
+			janus_pp_rtp_header_extension *ext = (janus_pp_rtp_header_extension *)(buffer+12+skip);
+			skip += 4 + ntohs(ext->length)*4;
+		}
+		if(rtp->padding)
+			len -= buffer[len-1];
+		if(len - skip - 12 <= 0) {
+			/* Nothing to play here */
+			continue;
+		}
+		/* Due to resets, we need to mess a bit with the original timestamps */
+		uint32_t rtp_ts = ntohl(rtp->timestamp);
+		gboolean pre_reset_pkt = FALSE;
+		if(!started) {
+			started = TRUE;
+			highest_rtp_ts = rtp_ts;
+		} else if((int32_t)(rtp_ts-highest_rtp_ts) > 0) {
+			if(rtp_ts < highest_rtp_ts) {
+				JANUS_LOG(LOG_WARN, "Timestamp reset: %"SCNu32"\n", rtp_ts);
+				times_resetted++;
+			}
+			highest_rtp_ts = rtp_ts;
+		} else if((int32_t)(rtp_ts-highest_rtp_ts) < 0 && rtp_ts > highest_rtp_ts) {
+			JANUS_LOG(LOG_WARN, "Late pre-reset packet: %"SCNu32"\n", rtp_ts);
+			pre_reset_pkt = TRUE;
+		}
+		janus_pp_frame_packet *p = g_malloc0(sizeof(janus_pp_frame_packet));
+		p->version = has_timestamps ? 2 : 1;
+		p->p_ts = has_timestamps ? frame.time : 0;
+		p->seq = ntohs(rtp->seq_number);
+		p->pt = rtp->type;
+		p->ts = ((pre_reset_pkt ? times_resetted-1 : times_resetted)*max32)+rtp_ts;
+		p->len = len;
+		p->offset = frame.offset;
+		p->skip = skip;
+		p->audiolevel = -1;
+		p->rotation = -1;
+		/* Check where we should insert this, starting from the end */
+		janus_pp_frame_packet *tmp = alast;
+		while(tmp != NULL && (tmp->ts > p->ts || (tmp->ts == p->ts && (int16_t)(tmp->seq - p->seq) > 0)))
+			tmp = tmp->prev;
+		if(tmp != NULL && tmp->ts == p->ts && tmp->seq == p->seq) {
+			/* Maybe a retransmission? Skip */
+			g_free(p);
+		} else if(tmp == NULL) {
+			/* We reached the start */
+			p->next = alist;
+			if(alist != NULL)
+				alist->prev = p;
+			else
+				alast = p;
+			alist = p;
+			count++;
+		} else {
+			p->prev = tmp;
+			p->next = tmp->next;
+			if(tmp->next != NULL)
+				tmp->next->prev = p;
+			else
+				alast = p;
+			tmp->next = p;
+			count++;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Counted %d audio frame packets\n", count);
+	return alist;
+}
+
+/* Batch mode: spawn a janus-pp-rec process for each of the recordings in
+ * the list, passing the same options we got, with at most 'jobs' at a time */
+static gboolean janus_pp_batch_option(char **args, int *index) {
+	/* Check if this is one of the batch mode arguments, which we must not pass along */
+	const char *arg = args[*index];
+	if(!strcmp(arg, "-b") || !strcmp(arg, "--batch") || !strcmp(arg, "-J") || !strcmp(arg, "--jobs")) {
+		/* The value is the next argument */
+		if(args[*index+1] != NULL)
+			(*index)++;
+		return TRUE;
+	}
+	return g_str_has_prefix(arg, "--batch=") || g_str_has_prefix(arg, "--jobs=") ||
+		g_str_has_prefix(arg, "-b") || g_str_has_prefix(arg, "-J");
+}
+
+static int janus_pp_batch_wait(GHashTable *pids) {
+	/* Wait for one of the recordings to be processed: returns 1 if it failed */
+	int status = 0;
+	pid_t pid = waitpid(-1, &status, 0);
+	while(pid < 0 && errno == EINTR)
+		pid = waitpid(-1, &status, 0);
+	if(pid < 0)
+		return -1;
+	const char *source = g_hash_table_lookup(pids, GINT_TO_POINTER(pid));
+	gboolean failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+	if(failed) {
+		JANUS_LOG(LOG_ERR, "Error processing %s (%s %d)\n", source ? source : "??",
+			WIFEXITED(status) ? "exit code" : "signal", WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status));
+	} else {
+		JANUS_LOG(LOG_INFO, "Processed %s\n", source ? source : "??");
+	}
+	g_hash_table_remove(pids, GINT_TO_POINTER(pid));
+	return failed ? 1 : 0;
+}
+
+static int janus_pp_batch_process(char **args, const char *batch, int jobs, const char *extension) {
+	/* Read the list of recordings to process */
+	char *text = NULL;
+	if(!strcmp(batch, "-")) {
+		GString *list = g_string_new(NULL);
+		char buffer[4096];
+		size_t bytes = 0;
+		while((bytes = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+			g_string_append_len(list, buffer, bytes);
+		text = g_string_free(list, FALSE);
+	} else {
+		GError *error = NULL;
+		if(!g_file_get_contents(batch, &text, NULL, &error)) {
+			JANUS_LOG(LOG_ERR, "Error reading batch file %s: %s\n", batch, error->message);
+			g_error_free(error);
+			return 1;
+		}
+	}
+	JANUS_LOG(LOG_INFO, "Batch mode, processing up to %d recordings at a time\n", jobs);
+	/* Handle SIGINT: we stop processing the list, and wait for the ongoing processes */
+	working = 1;
+	signal(SIGINT, janus_pp_handle_signal);
+	GHashTable *pids = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
+	int running = 0, processed = 0, failed = 0, res = 0;
+	gchar **lines = g_strsplit(text, "\n", -1);
+	g_free(text);
+	int i = 0, j = 0;
+	for(i=0; lines[i] != NULL && working; i++) {
+		/* Each line is a source and an optional destination */
+		char *source = NULL, *destination = NULL;
+		gchar **paths = g_strsplit_set(g_strstrip(lines[i]), " \t", -1);
+		for(j=0; paths[j] != NULL; j++) {
+			if(*paths[j] == '\0')
+				continue;
+			if(source == NULL) {
+				source = paths[j];
+			} else if(destination == NULL) {
+				destination = g_strdup(paths[j]);
+			}
+		}
+		if(source == NULL || *source == '#') {
+			/* Empty line or comment */
+			g_strfreev(paths);
+			continue;
+		}
+		processed++;
+		if(destination == NULL) {
+			/* Replace the extension of the source with the target one */
+			if(extension == NULL) {
+				JANUS_LOG(LOG_ERR, "No destination for %s, and no format to derive it from\n", source);
+				g_strfreev(paths);
+				failed++;
+				continue;
+			}
+			const char *dot = strrchr(source, '.'), *slash = strrchr(source, '/');
+			int len = (dot != NULL && (slash == NULL || dot > slash)) ? (int)(dot - source) : (int)strlen(source);
+			destination = g_strdup_printf("%.*s.%s", len, source, extension);
+		}
+		/* Wait until there's room for another process */
+		while(running >= jobs) {
+			res = janus_pp_batch_wait(pids);
+			if(res < 0)
+				break;
+			running--;
+			failed += res;
+		}
+		/* Same arguments we were launched with, except those for batch mode */
+		GPtrArray *cargs = g_ptr_array_new();
+		for(j=0; args[j] != NULL; j++) {
+			if(j > 0 && janus_pp_batch_option(args, &j))
+				continue;
+			g_ptr_array_add(cargs, args[j]);
+		}
+		g_ptr_array_add(cargs, source);
+		g_ptr_array_add(cargs, destination);
+		g_ptr_array_add(cargs, NULL);
+		GPid pid = 0;
+		GError *error = NULL;
+		if(!g_spawn_async(NULL, (gchar **)cargs->pdata, NULL, G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+				NULL, NULL, &pid, &error)) {
+			JANUS_LOG(LOG_ERR, "Error processing %s: %s\n", source, error->message);
+			g_error_free(error);
+			failed++;
+		} else {
+			g_hash_table_insert(pids, GINT_TO_POINTER(pid), g_strdup(source));
+			running++;
+		}
+		g_ptr_array_free(cargs, TRUE);
+		g_free(destination);
+		g_strfreev(paths);
+	}
+	g_strfreev(lines);
+	/* Wait for the recordings still being processed */
+	while(running > 0) {
+		res = janus_pp_batch_wait(pids);
+		if(res < 0)
+			break;
+		running--;
+		failed += res;
+	}
+	g_hash_table_destroy(pids);
+	JANUS_LOG(LOG_INFO, "Processed %d recordings (%d failed)%s\n", processed, failed,
+		working ? "" : ", interrupted");
+	return (failed > 0 || !working) ? 1 : 0;
+}
+
 /* Static helper to quickly find the extension data */
+/* Check if a recording has a valid index file saved alongside it */
+static gboolean janus_pp_index_check(const char *source, long fsize) {
+	char index[1100];
+	g_snprintf(index, sizeof(index), "%s.idx", source);
+	FILE *file = fopen(index, "rb");
+	if(file == NULL)
+		return FALSE;
+	char magic[8];
+	gboolean valid = (fread(magic, sizeof(char), sizeof(magic), file) == sizeof(magic) &&
+		!memcmp(magic, JANUS_PP_INDEX_MAGIC, sizeof(magic)));
+	if(valid) {
+		/* Make sure the last entry is consistent with the recording */
+		fseek(file, 0L, SEEK_END);
+		long isize = ftell(file);
+		if(((isize - sizeof(magic)) % JANUS_PP_INDEX_ENTRY_SIZE) != 0) {
+			valid = FALSE;
+		} else if(isize > (long)sizeof(magic)) {
+			char entry[JANUS_PP_INDEX_ENTRY_SIZE];
+			fseek(file, isize - JANUS_PP_INDEX_ENTRY_SIZE, SEEK_SET);
+			if(fread(entry, sizeof(char), sizeof(entry), file) != sizeof(entry)) {
+				valid = FALSE;
+			} else {
+				uint32_t hi = 0, lo = 0;
+				uint16_t len = 0;
+				memcpy(&hi, entry, sizeof(uint32_t));
+				memcpy(&lo, entry + 4, sizeof(uint32_t));
+				memcpy(&len, entry + 18, sizeof(uint16_t));
+				uint64_t offset = ((uint64_t)ntohl(hi) << 32) | ntohl(lo);
+				if(offset + ntohs(len) > (uint64_t)fsize)
+					valid = FALSE;
+			}
+		}
+	}
+	fclose(file);
+	if(!valid)
+		JANUS_LOG(LOG_WARN, "Ignoring invalid index file %s\n", index);
+	return valid;
+}
+
 static int janus_pp_rtp_header_extension_find(char *buf, int len, int id,
 		uint8_t *byte, uint32_t *word, char **ref) {
 	if(!buf || len < 12)
@@ -42,6 +42,7 @@
 #include "../debug.h"
 #include "../version.h"
 #include "pp-rtp.h"
+#include "pp-mjr.h"
 
 
 #define htonll(x) ((1==htonl(1)) ? (x) : ((gint64)htonl((x) & 0xFFFFFFFF) << 32) | htonl((x) >> 32))
@@ -167,15 +168,13 @@ int main(int argc, char *argv[]) {
 	destination = argv[2];
 	JANUS_LOG(LOG_INFO, "%s --> %s\n", source, destination);
 
-	/* Open the source file */
-	FILE *file = fopen(source, "rb");
-	if(file == NULL) {
+	/* Map the source file */
+	janus_pp_mjr *mjr = janus_pp_mjr_open(source);
+	if(mjr == NULL) {
 		JANUS_LOG(LOG_ERR, "Could not open file %s\n", source);
 		exit(1);
 	}
-	fseek(file, 0L, SEEK_END);
-	long fsize = ftell(file);
-	fseek(file, 0L, SEEK_SET);
+	long fsize = mjr->size;
 	JANUS_LOG(LOG_INFO, "File is %zu bytes\n", fsize);
 
 	/* Handle SIGINT */
@@ -187,62 +186,42 @@ int main(int argc, char *argv[]) {
 	gboolean has_timestamps = FALSE;
 	gboolean parsed_header = FALSE;
 	json_t *mjr_header = NULL;
-	int bytes = 0;
 	long offset = 0;
-	uint16_t len = 0;
 	gint64 started = 0;
-	char prebuffer[1500];
-	memset(prebuffer, 0, 1500);
+	janus_pp_mjr_frame frame;
 	/* Let's look for timestamp resets first */
 	while(working && offset < fsize) {
-		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
-			JANUS_LOG(LOG_WARN, "Invalid header at offset %ld (%s), the processing will stop here...\n",
-				offset, bytes != 8 ? "not enough bytes" : "wrong prefix");
+		/* Get the next frame */
+		if(!janus_pp_mjr_next(mjr, &offset, &frame)) {
+			JANUS_LOG(LOG_WARN, "Invalid header at offset %ld, the processing will stop here...\n", offset);
 			break;
 		}
-		if(prebuffer[1] == 'E') {
+		if(frame.prefix[1] == 'E') {
 			/* Either the old .mjr format header ('MEETECHO' header followed by 'audio' or 'video'), or a frame */
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
-			if(len == 5 && !parsed_header) {
+			if(frame.len == 5 && !parsed_header) {
 				/* Old .mjr format, check if this is an RTP recording */
-				bytes = fread(prebuffer, sizeof(char), 5, file);
-				if(prebuffer[0] != 'a' && prebuffer[0] != 'v') {
-					fclose(file);
+				if(frame.data[0] != 'a' && frame.data[0] != 'v') {
+					janus_pp_mjr_close(mjr);
 					JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
 					exit(1);
 				}
-			} else if(len < 12) {
+			} else if(frame.len < 12) {
 				/* Not RTP, skip */
 				JANUS_LOG(LOG_VERB, "Skipping packet (not RTP?)\n");
-				offset += len;
-				continue;
 			}
-		} else if(prebuffer[1] == 'J') {
+		} else if(frame.info) {
 			/* New .mjr format, check if this is an RTP recording */
-			if(prebuffer[2] == 'R' && prebuffer[3] == '0' && prebuffer[4] == '0' &&
-					prebuffer[5] == '0' && prebuffer[6] == '0' && prebuffer[7] == '2') {
+			if(!memcmp(frame.prefix, "MJR00002", 8)) {
 				/* Main header is MJR00002: this means we have timestamps too */
 				has_timestamps = TRUE;
 				JANUS_LOG(LOG_VERB, "New .mjr format, will parse timestamps too\n");
 			}
-			offset += 8;
-			bytes = fread(&len, sizeof(uint16_t), 1, file);
-			len = ntohs(len);
-			offset += 2;
-			if(len > 0 && !parsed_header) {
+			if(frame.len > 0 && !parsed_header) {
 				/* This is the info header */
-				bytes = fread(prebuffer, sizeof(char), len, file);
-				prebuffer[len] = '\0';
 				json_error_t error;
-				mjr_header = json_loads(prebuffer, 0, &error);
+				mjr_header = json_loadb((const char *)frame.data, frame.len, 0, &error);
 				if(!mjr_header) {
-					fclose(file);
+					janus_pp_mjr_close(mjr);
 					JANUS_LOG(LOG_ERR, "Error parsing header, JSON error: on line %d: %s\n", error.line, error.text);
 					exit(1);
 				}
@@ -250,7 +229,7 @@ int main(int argc, char *argv[]) {
 				json_t *type = json_object_get(mjr_header, "t");
 				if(!type || !json_is_string(type)) {
 					json_decref(mjr_header);
-					fclose(file);
+					janus_pp_mjr_close(mjr);
 					JANUS_LOG(LOG_ERR, "Missing/invalid recording type in info header...\n");
 					exit(1);
 				}
@@ -258,14 +237,14 @@ int main(int argc, char *argv[]) {
 				if(!strcasecmp(t, "d")) {
 					/* Data recordings are not supported yet */
 					json_decref(mjr_header);
-					fclose(file);
+					janus_pp_mjr_close(mjr);
 					JANUS_LOG(LOG_ERR, "Not an RTP recording (data currently unsupported)...\n");
 					exit(1);
 				}
 				json_t *updated = json_object_get(mjr_header, "u");
 				if(!updated || !json_is_integer(updated)) {
 					json_decref(mjr_header);
-					fclose(file);
+					janus_pp_mjr_close(mjr);
 					JANUS_LOG(LOG_ERR, "Missing/invalid updated time in info header...\n");
 					exit(1);
 				}
@@ -274,17 +253,16 @@ int main(int argc, char *argv[]) {
 		} else {
 			JANUS_LOG(LOG_ERR, "Invalid header...\n");
 			json_decref(mjr_header);
-			fclose(file);
+			janus_pp_mjr_close(mjr);
 			exit(1);
 		}
-		/* Skip data for now */
-		offset += len;
 	}
 
 	/* Create the target file */
 	FILE *outfile = fopen(destination, "wb");
 	if(outfile == NULL) {
 		json_decref(mjr_header);
+		janus_pp_mjr_close(mjr);
 		JANUS_LOG(LOG_ERR, "Couldn't open output file\n");
 		exit(1);
 	}
@@ -296,42 +274,23 @@ int main(int argc, char *argv[]) {
 	/* Now iterate on all packets, and save them to the .pcap file */
 	offset = 0;
 	JANUS_LOG(LOG_INFO, "Traversing RTP packets...\n");
-	uint32_t pkt_ts = 0;
+	uint16_t len = 0;
 	while(working && offset < fsize) {
-		/* Read frame header */
-		fseek(file, offset, SEEK_SET);
-		bytes = fread(prebuffer, sizeof(char), 8, file);
-		if(bytes != 8 || prebuffer[0] != 'M') {
+		/* Get the next frame */
+		if(!janus_pp_mjr_next(mjr, &offset, &frame)) {
 			/* Broken packet? Stop here */
 			break;
 		}
-		if(has_timestamps) {
-			/* Read the packet timestamp */
-			memcpy(&pkt_ts, prebuffer+4, sizeof(uint32_t));
-			pkt_ts = ntohl(pkt_ts);
-		}
-		offset += 8;
-		bytes = fread(&len, sizeof(uint16_t), 1, file);
-		len = ntohs(len);
+		len = frame.len;
 		JANUS_LOG(LOG_VERB, "  -- Length: %"SCNu16"\n", len);
-		offset += 2;
-		if(prebuffer[1] == 'J' || len < 12) {
+		if(frame.info || len < 12) {
 			/* Not RTP, skip */
 			JANUS_LOG(LOG_VERB, "  -- Not RTP, skipping\n");
-			offset += len;
 			continue;
 		}
 		if(len > 1500) {
 			/* Way too large, very likely not RTP, skip */
 			JANUS_LOG(LOG_VERB, "  -- Too large packet (%d bytes), skipping\n", len);
-			offset += len;
-			continue;
-		}
-		/* Get the whole packet */
-		bytes = fread(prebuffer, sizeof(char), len, file);
-		if(bytes != len) {
-			JANUS_LOG(LOG_WARN, "  -- Failed to read packet (%d != %d bytes), skipping\n", bytes, len);
-			offset += len;
 			continue;
 		}
 		/* Save the packet to PCAP */
@@ -348,7 +307,7 @@ int main(int argc, char *argv[]) {
 		struct timeval tv;
 		if(has_timestamps) {
 			/* Prepare a valid timestamp */
-			gint64 timestamp = started + (pkt_ts*1000);
+			gint64 timestamp = started + (frame.time*1000);
 			tv.tv_sec = timestamp / G_USEC_PER_SEC;
 			tv.tv_usec = timestamp -  (tv.tv_sec*G_USEC_PER_SEC);
 		} else {
@@ -362,21 +321,20 @@ int main(int argc, char *argv[]) {
 		fwrite(&eth, sizeof(char), sizeof(eth), outfile);
 		fwrite(&ip, sizeof(char), sizeof(ip), outfile);
 		fwrite(&udp, sizeof(char), sizeof(udp), outfile);
-		/* The write the packet itself (or part of it) */
+		/* The write the packet itself (or part of it), straight from the mapped file */
 		int temp = 0, tot = len;
 		while(tot > 0) {
-			temp = fwrite(prebuffer+len-tot, sizeof(char), len, outfile);
+			temp = fwrite(frame.data+len-tot, sizeof(char), tot, outfile);
 			if(temp <= 0) {
 				JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
 				break;
 			}
 			tot -= temp;
 		}
-		offset += len;
 	}
 	/* We're done */
 	json_decref(mjr_header);
-	fclose(file);
+	janus_pp_mjr_close(mjr);
 	fclose(outfile);
 	outfile = fopen(destination, "rb");
 	if(outfile == NULL) {
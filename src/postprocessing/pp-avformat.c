@@ -5,6 +5,8 @@
  * \ref postprocessing
  */
 
+#include <string.h>
+
 #include "pp-avformat.h"
 
 void janus_pp_setup_avformat(void) {
@@ -91,3 +93,111 @@ AVStream *janus_pp_new_video_avstream(AVFormatContext *fctx, int codec_id, int w
 	return st;
 }
 
+
+/* Muxing of an audio recording in the video output file */
+typedef struct janus_pp_mux_frame {
+	int stream_index;
+	int64_t pts, duration;
+	int flags;
+	int size;
+	uint8_t data[];
+} janus_pp_mux_frame;
+static janus_pp_mux_stream_cb mux_add_stream = NULL;
+static gint64 mux_audio_offset = 0, mux_video_offset = 0;
+static GQueue *mux_queue = NULL;
+
+void janus_pp_mux_audio(janus_pp_mux_stream_cb add_stream, gint64 offset) {
+	/* The offset is how much later than the video (in microseconds) the
+	 * audio started: whichever started later is the one we shift */
+	mux_add_stream = add_stream;
+	mux_audio_offset = offset > 0 ? offset : 0;
+	mux_video_offset = offset < 0 ? -offset : 0;
+	if(mux_queue == NULL)
+		mux_queue = g_queue_new();
+}
+
+int janus_pp_write_header(AVFormatContext *fctx, AVDictionary **options) {
+	/* If there's an audio recording to merge, add its stream too */
+	if(mux_add_stream != NULL && mux_add_stream(fctx) < 0) {
+		JANUS_LOG(LOG_ERR, "Error adding audio stream\n");
+		return -1;
+	}
+	return avformat_write_header(fctx, options);
+}
+
+static int janus_pp_mux_write(AVFormatContext *fctx, janus_pp_mux_frame *frame) {
+	/* Write a queued audio frame */
+#ifdef FF_API_INIT_PACKET
+	AVPacket *packet = av_packet_alloc();
+#else
+	AVPacket pkt = { 0 }, *packet = &pkt;
+	av_init_packet(packet);
+#endif
+	packet->stream_index = frame->stream_index;
+	packet->data = frame->data;
+	packet->size = frame->size;
+	packet->pts = packet->dts = frame->pts;
+	packet->duration = frame->duration;
+	packet->flags = frame->flags;
+	int res = av_write_frame(fctx, packet);
+	if(res < 0) {
+		JANUS_LOG(LOG_ERR, "Error writing audio frame to file... (error %d, %s)\n",
+			res, av_err2str(res));
+	}
+#ifdef FF_API_INIT_PACKET
+	av_packet_free(&packet);
+#endif
+	return res;
+}
+
+int janus_pp_write_frame(AVFormatContext *fctx, AVPacket *packet, gboolean audio) {
+	if(fctx == NULL || packet == NULL)
+		return -1;
+	if(mux_queue == NULL) {
+		/* Not muxing, write the frame as it is */
+		return av_write_frame(fctx, packet);
+	}
+	AVRational tb = fctx->streams[packet->stream_index]->time_base;
+	gint64 offset = av_rescale_q(audio ? mux_audio_offset : mux_video_offset, AV_TIME_BASE_Q, tb);
+	packet->pts += offset;
+	packet->dts += offset;
+	if(audio) {
+		/* Audio frames are all processed first: queue a copy of the frame,
+		 * we'll write it when the video gets to the same point in time */
+		janus_pp_mux_frame *frame = g_malloc(sizeof(janus_pp_mux_frame) + packet->size);
+		frame->stream_index = packet->stream_index;
+		frame->pts = packet->pts;
+		frame->duration = packet->duration;
+		frame->flags = packet->flags;
+		frame->size = packet->size;
+		memcpy(frame->data, packet->data, packet->size);
+		g_queue_push_tail(mux_queue, frame);
+		return 0;
+	}
+	/* Before writing this video frame, write all the audio frames that precede it */
+	gint64 when = av_rescale_q(packet->pts, tb, AV_TIME_BASE_Q);
+	janus_pp_mux_frame *frame = NULL;
+	while((frame = g_queue_peek_head(mux_queue)) != NULL) {
+		if(av_rescale_q(frame->pts, fctx->streams[frame->stream_index]->time_base, AV_TIME_BASE_Q) > when)
+			break;
+		g_queue_pop_head(mux_queue);
+		janus_pp_mux_write(fctx, frame);
+		g_free(frame);
+	}
+	return av_write_frame(fctx, packet);
+}
+
+void janus_pp_write_trailer(AVFormatContext *fctx) {
+	if(mux_queue != NULL) {
+		/* Write the audio frames that come after the end of the video */
+		janus_pp_mux_frame *frame = NULL;
+		while((frame = g_queue_pop_head(mux_queue)) != NULL) {
+			janus_pp_mux_write(fctx, frame);
+			g_free(frame);
+		}
+		g_queue_free(mux_queue);
+		mux_queue = NULL;
+		mux_add_stream = NULL;
+	}
+	av_write_trailer(fctx);
+}
@@ -47,5 +47,14 @@ AVFormatContext *janus_pp_create_avformatcontext(const char *format, const char
 AVStream *janus_pp_new_video_avstream(AVFormatContext *fctx, int codec_id, int width, int height);
 AVStream *janus_pp_new_audio_avstream(AVFormatContext *fctx, int codec_id, int samplerate, int channels, const uint8_t *extradata, int size);
 
+/* Muxing of an audio recording in the file we write the video one to: the
+ * audio writer registers a callback to add its stream before the header is
+ * written, and its frames are then queued and interleaved with the video ones */
+typedef int (*janus_pp_mux_stream_cb)(AVFormatContext *fctx);
+void janus_pp_mux_audio(janus_pp_mux_stream_cb add_stream, gint64 offset);
+int janus_pp_write_header(AVFormatContext *fctx, AVDictionary **options);
+int janus_pp_write_frame(AVFormatContext *fctx, AVPacket *packet, gboolean audio);
+void janus_pp_write_trailer(AVFormatContext *fctx);
+
 
 #endif
@@ -129,7 +129,7 @@ int janus_pp_h264_create(char *destination, char *metadata, gboolean faststart,
 #if LIBAVFORMAT_VER_AT_LEAST(58, 7)
 	fctx->url = g_strdup(filename);
 #endif
-	if(avformat_write_header(fctx, &options) < 0) {
+	if(janus_pp_write_header(fctx, &options) < 0) {
 		JANUS_LOG(LOG_ERR, "Error writing header\n");
 		return -1;
 	}
@@ -524,7 +524,7 @@ int janus_pp_h264_process(FILE *file, janus_pp_frame_packet *list, int *working)
 			JANUS_LOG(LOG_HUGE, "%"SCNu64" - %"SCNu64" --> %"SCNu64"\n",
 				tmp->ts, list->ts, packet->pts);
 			if(fctx) {
-				int res = av_write_frame(fctx, packet);
+				int res = janus_pp_write_frame(fctx, packet, FALSE);
 				if(res < 0) {
 					JANUS_LOG(LOG_ERR, "Error writing video frame to file... (error %d, %s)\n",
 						res, av_err2str(res));
@@ -544,7 +544,7 @@ int janus_pp_h264_process(FILE *file, janus_pp_frame_packet *list, int *working)
 /* Close MP4 file */
 void janus_pp_h264_close(void) {
 	if(fctx != NULL)
-		av_write_trailer(fctx);
+		janus_pp_write_trailer(fctx);
 #ifdef USE_CODECPAR
 	if(vEncoder != NULL)
 		avcodec_close(vEncoder);
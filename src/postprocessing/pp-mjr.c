@@ -0,0 +1,256 @@
+/*! \file    pp-mjr.c
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Memory-mapped reader for .mjr recordings
+ * \details  Helper code to map a .mjr recording in memory, and iterate
+ * on its frames without copying them or doing any system call: the
+ * same mapping can also be accessed as a FILE stream, for the code that
+ * still needs to read the frames with fread and fseek. Recordings
+ * Janus encrypted at rest are decrypted one segment at a time, while
+ * mapping them, after checking each segment is authentic.
+ *
+ * \ingroup postprocessing
+ * \ref postprocessing
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "pp-mjr.h"
+#include "../debug.h"
+
+/* Recordings encrypted at rest (see JANUS_RECORDER_CRYPTO_MAGIC in record.h) */
+#define JANUS_PP_CRYPTO_MAGIC		"ENCMJR01"
+#define JANUS_PP_CRYPTO_SALT_SIZE	16
+#define JANUS_PP_CRYPTO_KEY_SIZE	32
+#define JANUS_PP_CRYPTO_HEADER_SIZE	4
+#define JANUS_PP_CRYPTO_TAG_SIZE	16
+
+static gboolean janus_pp_mjr_key_set = FALSE;
+static unsigned char janus_pp_mjr_key[JANUS_PP_CRYPTO_KEY_SIZE];
+
+gboolean janus_pp_mjr_set_key(const char *key_file) {
+	if(key_file == NULL)
+		return FALSE;
+	gchar *contents = NULL;
+	if(!g_file_get_contents(key_file, &contents, NULL, NULL)) {
+		JANUS_LOG(LOG_ERR, "Could not read key file %s\n", key_file);
+		return FALSE;
+	}
+	/* The key is hex encoded, as in the Janus configuration */
+	char *hex = g_strstrip(contents);
+	gboolean valid = (strlen(hex) == 2*JANUS_PP_CRYPTO_KEY_SIZE);
+	int i = 0;
+	for(i=0; valid && i<JANUS_PP_CRYPTO_KEY_SIZE; i++) {
+		int hi = g_ascii_xdigit_value(hex[2*i]), lo = g_ascii_xdigit_value(hex[2*i+1]);
+		if(hi < 0 || lo < 0)
+			valid = FALSE;
+		else
+			janus_pp_mjr_key[i] = (hi << 4) | lo;
+	}
+	OPENSSL_cleanse(contents, strlen(contents));
+	g_free(contents);
+	if(!valid) {
+		JANUS_LOG(LOG_ERR, "Invalid key in %s (should be %d hex encoded bytes)\n", key_file, JANUS_PP_CRYPTO_KEY_SIZE);
+		OPENSSL_cleanse(janus_pp_mjr_key, sizeof(janus_pp_mjr_key));
+		return FALSE;
+	}
+	janus_pp_mjr_key_set = TRUE;
+	return TRUE;
+}
+
+/* Decrypt a recording encrypted at rest in a new anonymous mapping: segments are
+ * decrypted in order, and we stop at the first one that isn't authentic */
+static uint8_t *janus_pp_mjr_decrypt(const char *path, const uint8_t *data, size_t size, size_t *plain_size, size_t *mapped_size) {
+	if(!janus_pp_mjr_key_set) {
+		JANUS_LOG(LOG_ERR, "Recording %s is encrypted, a key is needed to process it\n", path);
+		return NULL;
+	}
+	size_t offset = strlen(JANUS_PP_CRYPTO_MAGIC) + JANUS_PP_CRYPTO_SALT_SIZE;
+	if(size < offset) {
+		JANUS_LOG(LOG_ERR, "Recording %s is encrypted, but its header is truncated\n", path);
+		return NULL;
+	}
+	/* Find out how large the decrypted recording is first */
+	size_t start = offset, total = 0;
+	gboolean complete = FALSE;
+	uint32_t len = 0;
+	while(offset + JANUS_PP_CRYPTO_HEADER_SIZE <= size) {
+		memcpy(&len, data + offset, sizeof(uint32_t));
+		len = ntohl(len);
+		if(len == 0) {
+			/* Janus closed the recording properly */
+			complete = TRUE;
+			break;
+		}
+		if(offset + JANUS_PP_CRYPTO_HEADER_SIZE + len + JANUS_PP_CRYPTO_TAG_SIZE > size)
+			break;
+		total += len;
+		offset += JANUS_PP_CRYPTO_HEADER_SIZE + len + JANUS_PP_CRYPTO_TAG_SIZE;
+	}
+	if(!complete)
+		JANUS_LOG(LOG_WARN, "Recording %s wasn't closed properly, it may be truncated\n", path);
+	if(total == 0) {
+		JANUS_LOG(LOG_ERR, "Recording %s is encrypted, but contains no data\n", path);
+		return NULL;
+	}
+	uint8_t *plain = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(plain == MAP_FAILED) {
+		JANUS_LOG(LOG_ERR, "Could not allocate memory to decrypt %s (%d, %s)\n", path, errno, g_strerror(errno));
+		return NULL;
+	}
+	/* Derive the key of this recording from the salt, and decrypt the segments */
+	unsigned char key[EVP_MAX_MD_SIZE];
+	unsigned int key_len = 0;
+	const unsigned char *salt = data + strlen(JANUS_PP_CRYPTO_MAGIC);
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if(ctx == NULL || HMAC(EVP_sha256(), janus_pp_mjr_key, sizeof(janus_pp_mjr_key),
+			salt, JANUS_PP_CRYPTO_SALT_SIZE, key, &key_len) == NULL ||
+			EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, NULL) != 1) {
+		JANUS_LOG(LOG_ERR, "Could not initialize the decryption of %s\n", path);
+		OPENSSL_cleanse(key, sizeof(key));
+		if(ctx != NULL)
+			EVP_CIPHER_CTX_free(ctx);
+		munmap(plain, total);
+		return NULL;
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	size_t written = 0;
+	uint64_t segment = 0;
+	offset = start;
+	while(written < total) {
+		memcpy(&len, data + offset, sizeof(uint32_t));
+		len = ntohl(len);
+		unsigned char iv[12];
+		memset(iv, 0, sizeof(iv));
+		uint32_t hi = htonl(segment >> 32), lo = htonl(segment & 0xFFFFFFFF);
+		memcpy(iv + 4, &hi, sizeof(uint32_t));
+		memcpy(iv + 8, &lo, sizeof(uint32_t));
+		const uint8_t *ciphertext = data + offset + JANUS_PP_CRYPTO_HEADER_SIZE;
+		int out = 0;
+		if(EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) != 1 ||
+				EVP_DecryptUpdate(ctx, NULL, &out, data + offset, JANUS_PP_CRYPTO_HEADER_SIZE) != 1 ||
+				EVP_DecryptUpdate(ctx, plain + written, &out, ciphertext, len) != 1 ||
+				EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, JANUS_PP_CRYPTO_TAG_SIZE, (void *)(ciphertext + len)) != 1 ||
+				EVP_DecryptFinal_ex(ctx, plain + written + len, &out) != 1) {
+			JANUS_LOG(LOG_WARN, "Segment %"SCNu64" of %s (offset %zu) is not authentic, the processing will stop here...\n",
+				segment, path, offset);
+			break;
+		}
+		written += len;
+		offset += JANUS_PP_CRYPTO_HEADER_SIZE + len + JANUS_PP_CRYPTO_TAG_SIZE;
+		segment++;
+	}
+	EVP_CIPHER_CTX_free(ctx);
+	if(written == 0) {
+		JANUS_LOG(LOG_ERR, "Could not decrypt %s (wrong key?)\n", path);
+		munmap(plain, total);
+		return NULL;
+	}
+	if(written < total) {
+		/* Clear what we couldn't authenticate */
+		memset(plain + written, 0, total - written);
+	}
+	mprotect(plain, total, PROT_READ);
+	*plain_size = written;
+	*mapped_size = total;
+	return plain;
+}
+
+janus_pp_mjr *janus_pp_mjr_open(const char *path) {
+	if(path == NULL)
+		return NULL;
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		JANUS_LOG(LOG_ERR, "Could not open file %s (%d, %s)\n", path, errno, g_strerror(errno));
+		return NULL;
+	}
+	struct stat st;
+	if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		/* We can only map regular, non-empty, files */
+		close(fd);
+		return NULL;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping stays valid after we close the descriptor */
+	close(fd);
+	if(data == MAP_FAILED) {
+		JANUS_LOG(LOG_WARN, "Could not map file %s (%d, %s)\n", path, errno, g_strerror(errno));
+		return NULL;
+	}
+	size_t size = st.st_size, mapped = st.st_size;
+	if(size >= strlen(JANUS_PP_CRYPTO_MAGIC) &&
+			!memcmp(data, JANUS_PP_CRYPTO_MAGIC, strlen(JANUS_PP_CRYPTO_MAGIC))) {
+		/* Encrypted at rest: we read the segments in order, so let the kernel know */
+		madvise(data, size, MADV_SEQUENTIAL);
+		uint8_t *plain = janus_pp_mjr_decrypt(path, data, st.st_size, &size, &mapped);
+		munmap(data, st.st_size);
+		if(plain == NULL)
+			return NULL;
+		data = plain;
+	}
+	janus_pp_mjr *mjr = g_malloc0(sizeof(janus_pp_mjr));
+	mjr->data = data;
+	mjr->size = size;
+	mjr->mapped = mapped;
+	return mjr;
+}
+
+FILE *janus_pp_mjr_file(janus_pp_mjr *mjr) {
+	if(mjr == NULL)
+		return NULL;
+	if(mjr->file == NULL) {
+		/* Reads and seeks on this stream are just copies from the mapping */
+		mjr->file = fmemopen((void *)mjr->data, mjr->size, "rb");
+		if(mjr->file == NULL)
+			JANUS_LOG(LOG_ERR, "Could not create stream (%d, %s)\n", errno, g_strerror(errno));
+	}
+	return mjr->file;
+}
+
+gboolean janus_pp_mjr_next(janus_pp_mjr *mjr, long *offset, janus_pp_mjr_frame *frame) {
+	if(mjr == NULL || offset == NULL || frame == NULL || *offset < 0)
+		return FALSE;
+	/* Each frame is an 8 bytes prefix, a 2 bytes length, and the content */
+	size_t start = *offset;
+	if(start + 10 > mjr->size || mjr->data[start] != 'M')
+		return FALSE;
+	frame->prefix = (const char *)(mjr->data + start);
+	frame->info = (frame->prefix[1] == 'J');
+	frame->time = 0;
+	if(!frame->info && memcmp(frame->prefix, "MEETECHO", 8)) {
+		/* Packet saved with its time (MJR00002) */
+		uint32_t time = 0;
+		memcpy(&time, frame->prefix + 4, sizeof(uint32_t));
+		frame->time = ntohl(time);
+	}
+	uint16_t len = 0;
+	memcpy(&len, mjr->data + start + 8, sizeof(uint16_t));
+	frame->len = ntohs(len);
+	frame->offset = start + 10;
+	if((size_t)frame->offset + frame->len > mjr->size) {
+		/* Truncated frame */
+		return FALSE;
+	}
+	frame->data = mjr->data + frame->offset;
+	*offset = frame->offset + frame->len;
+	return TRUE;
+}
+
+void janus_pp_mjr_close(janus_pp_mjr *mjr) {
+	if(mjr == NULL)
+		return;
+	if(mjr->file != NULL)
+		fclose(mjr->file);
+	munmap((void *)mjr->data, mjr->mapped);
+	g_free(mjr);
+}
@@ -0,0 +1,63 @@
+/*! \file    pp-mjr.h
+ * \author   Lorenzo Miniero <lorenzo@meetecho.com>
+ * \copyright GNU General Public License v3
+ * \brief    Memory-mapped reader for .mjr recordings (headers)
+ * \details  Helper code to map a .mjr recording in memory, and iterate
+ * on its frames without copying them or doing any system call: the
+ * same mapping can also be accessed as a FILE stream, for the code that
+ * still needs to read the frames with fread and fseek. Recordings
+ * Janus encrypted at rest are decrypted while mapping them.
+ *
+ * \ingroup postprocessing
+ * \ref postprocessing
+ */
+
+#ifndef JANUS_PP_MJR
+#define JANUS_PP_MJR
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <glib.h>
+
+/* A memory-mapped .mjr recording */
+typedef struct janus_pp_mjr {
+	/* Mapped content of the file */
+	const uint8_t *data;
+	/* Size of the file (decrypted, if it was encrypted at rest) */
+	size_t size;
+	/* Size of the mapping */
+	size_t mapped;
+	/* FILE stream on top of the mapping, if one was requested */
+	FILE *file;
+} janus_pp_mjr;
+
+/* A frame in a .mjr recording, pointing to the mapped data */
+typedef struct janus_pp_mjr_frame {
+	/* The 8 bytes prefix of the frame ("MJR0000x" for the info header,
+	 * "MEET" + packet time or "MEETECHO" for packets) */
+	const char *prefix;
+	/* Whether this is the info header, rather than a packet */
+	gboolean info;
+	/* Time the packet was saved at, in ms (MJR00002 recordings only) */
+	uint32_t time;
+	/* The content of the frame and its length */
+	const uint8_t *data;
+	uint16_t len;
+	/* Offset of the content in the file */
+	long offset;
+} janus_pp_mjr_frame;
+
+/* Load the key (hex encoded in a file) to decrypt recordings encrypted at rest with */
+gboolean janus_pp_mjr_set_key(const char *key_file);
+/* Map a .mjr recording in memory, decrypting it if it's encrypted at rest */
+janus_pp_mjr *janus_pp_mjr_open(const char *path);
+/* Get a FILE stream to read the mapped recording with */
+FILE *janus_pp_mjr_file(janus_pp_mjr *mjr);
+/* Get the frame at the provided offset, and move the offset to the next
+ * one: returns FALSE when there are no more (valid) frames */
+gboolean janus_pp_mjr_next(janus_pp_mjr *mjr, long *offset, janus_pp_mjr_frame *frame);
+/* Unmap a recording, closing the FILE stream too if any */
+void janus_pp_mjr_close(janus_pp_mjr *mjr);
+
+#endif
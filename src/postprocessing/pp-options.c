@@ -37,6 +37,10 @@ gboolean janus_pprec_options_parse(janus_pprec_options *options, int argc, char
 		{ "restamp", 'r', 0, G_OPTION_ARG_INT, &options->restamp_multiplier, "If the latency of a packet is bigger than the `moving_average_latency * (<restamp>/1000)` the timestamps will be corrected, disabled if 0 (default=0)", NULL },
 		{ "restamp-packets", 'c', 0, G_OPTION_ARG_INT, &options->restamp_packets, "Number of packets used for calculating moving average latency for timestamp correction (default=10)", NULL },
 		{ "restamp-min-th", 'n', 0, G_OPTION_ARG_INT, &options->restamp_min_th, "Minimum latency of moving average to reach before starting to correct timestamps. (default=500)", NULL },
+		{ "batch", 'b', 0, G_OPTION_ARG_STRING, &options->batch, "Process all the recordings listed in this file, one 'source.mjr [destination]' per line ('-' to read the list from stdin)", NULL },
+		{ "jobs", 'J', 0, G_OPTION_ARG_INT, &options->jobs, "How many recordings to process in parallel in batch mode (default=number of cores)", NULL },
+		{ "audio", 'A', 0, G_OPTION_ARG_STRING, &options->audio, "Merge this Opus .mjr recording in the target file of the video one (VP8, VP9 or H.264), synchronizing them via the recording times", NULL },
+		{ "key", 'k', 0, G_OPTION_ARG_STRING, &options->key, "Decrypt recordings Janus encrypted at rest with the key in this file", NULL },
 		{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &options->paths, NULL, NULL },
 		{ NULL },
 	};
@@ -37,6 +37,10 @@ typedef struct janus_pprec_options {
 	int restamp_multiplier;
 	int restamp_min_th;
 	int restamp_packets;
+	const char *batch;
+	int jobs;
+	const char *audio;
+	const char *key;
 	char **paths;
 } janus_pprec_options;
 
@@ -26,6 +26,7 @@
 #include "../version.h"
 
 static gboolean multichannel_opus = FALSE;
+static gboolean muxed = FALSE;
 static AVFormatContext *fctx;
 static AVStream *vStream;
 
@@ -98,6 +99,34 @@ int janus_pp_opus_create(char *destination, char *metadata, gboolean multiopus,
 	return 0;
 }
 
+/* Muxing in the video output file */
+static int janus_pp_opus_mux_stream(AVFormatContext *octx) {
+	/* The video writer is about to write the header, add our stream */
+	fctx = octx;
+	/* Older versions of FFmpeg consider Opus in MP4 experimental */
+	fctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+	if(!multichannel_opus) {
+		vStream = janus_pp_new_audio_avstream(fctx, AV_CODEC_ID_OPUS, 48000, 2, opus_extradata, sizeof(opus_extradata));
+	} else {
+		vStream = janus_pp_new_audio_avstream(fctx, AV_CODEC_ID_OPUS, 48000, 6, multiopus_extradata, sizeof(multiopus_extradata));
+	}
+	return vStream ? 0 : -1;
+}
+
+int janus_pp_opus_mux(gboolean multiopus, int opusred_pt, gint64 offset) {
+	/* Rather than creating a file of our own, we'll add an audio stream
+	 * to the one the video writer creates, delayed by offset microseconds
+	 * (negative if it's the video that should be delayed instead) */
+	muxed = TRUE;
+	multichannel_opus = multiopus;
+	janus_pp_mux_audio(janus_pp_opus_mux_stream, offset);
+	if(opusred_pt > 0) {
+		red_pt = opusred_pt;
+		JANUS_LOG(LOG_INFO, "  -- Enabling RED decapsulation (pt=%d)\n", red_pt);
+	}
+	return 0;
+}
+
 // It assumes ALL the packets are of the 20ms kind
 #define OPUS_PACKET_DURATION 48 * 20;
 
@@ -271,13 +300,13 @@ int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, int *working)
 #ifdef FF_API_INIT_PACKET
 				av_packet_unref(pkt);
 #endif
-				pkt->stream_index = 0;
+				pkt->stream_index = vStream->index;
 				pkt->data = opus_silence;
 				pkt->size = sizeof(opus_silence);
-				pkt->pts = pkt->dts = av_rescale_q(pos, timebase, fctx->streams[0]->time_base);
+				pkt->pts = pkt->dts = av_rescale_q(pos, timebase, vStream->time_base);
 				pkt->duration = OPUS_PACKET_DURATION;
 
-				int res = av_write_frame(fctx, pkt);
+				int res = janus_pp_write_frame(fctx, pkt, TRUE);
 				if(res < 0) {
 					JANUS_LOG(LOG_ERR, "Error writing video frame to file... (error %d, %s)\n",
 						res, av_err2str(res));
@@ -328,13 +357,13 @@ int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, int *working)
 #else
 		av_init_packet(pkt);
 #endif
-		pkt->stream_index = 0;
+		pkt->stream_index = vStream->index;
 		pkt->data = buffer;
 		pkt->size = bytes;
-		pkt->pts = pkt->dts = av_rescale_q(tmp->ts - list->ts, timebase, fctx->streams[0]->time_base);
+		pkt->pts = pkt->dts = av_rescale_q(tmp->ts - list->ts, timebase, vStream->time_base);
 		pkt->duration = OPUS_PACKET_DURATION;
 
-		if(av_write_frame(fctx, pkt) < 0) {
+		if(janus_pp_write_frame(fctx, pkt, TRUE) < 0) {
 			JANUS_LOG(LOG_ERR, "Error writing audio frame to file...\n");
 		}
 
@@ -348,6 +377,12 @@ int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, int *working)
 }
 
 void janus_pp_opus_close(void) {
+	if(muxed) {
+		/* The file belongs to the video writer, which closes it */
+		fctx = NULL;
+		muxed = FALSE;
+		return;
+	}
 	if(fctx != NULL) {
                 av_write_trailer(fctx);
                 avio_close(fctx->pb);
@@ -20,6 +20,7 @@
 const char **janus_pp_opus_get_extensions(void);
 int janus_pp_opus_create(char *destination, char *metadata, gboolean multiopus, const char *extension, int opusred_pt);
 int janus_pp_opus_process(FILE *file, janus_pp_frame_packet *list, int *working);
+int janus_pp_opus_mux(gboolean multiopus, int opusred_pt, gint64 offset);
 void janus_pp_opus_close(void);
 
 #endif
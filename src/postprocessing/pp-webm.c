@@ -84,7 +84,7 @@ int janus_pp_webm_create(char *destination, char *metadata, gboolean vp8, const
 		return -1;
 	}
 
-	if(avformat_write_header(fctx, NULL) < 0) {
+	if(janus_pp_write_header(fctx, NULL) < 0) {
 		JANUS_LOG(LOG_ERR, "Error writing header\n");
 		return -1;
 	}
@@ -593,7 +593,7 @@ int janus_pp_webm_process(FILE *file, janus_pp_frame_packet *list, gboolean vp8,
 			/* First we save to the file... */
 			packet->pts = packet->dts = av_rescale_q(tmp->ts-list->ts, timebase, fctx->streams[0]->time_base);
 			if(fctx) {
-				int res = av_write_frame(fctx, packet);
+				int res = janus_pp_write_frame(fctx, packet, FALSE);
 				if(res < 0) {
 					JANUS_LOG(LOG_ERR, "Error writing video frame to file... (error %d, %s)\n",
 						res, av_err2str(res));
@@ -613,7 +613,7 @@ int janus_pp_webm_process(FILE *file, janus_pp_frame_packet *list, gboolean vp8,
 /* Close WebM file */
 void janus_pp_webm_close(void) {
 	if(fctx != NULL) {
-		av_write_trailer(fctx);
+		janus_pp_write_trailer(fctx);
 		avio_close(fctx->pb);
 		avformat_free_context(fctx);
 	}
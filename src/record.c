@@ -21,9 +21,16 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <libgen.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #include <glib.h>
 #include <jansson.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
 
 #include "record.h"
 #include "debug.h"
@@ -43,6 +50,516 @@ static gboolean rec_tempname = FALSE;
 /* Extension to add in case tempnames is true (default="tmp" --> ".tmp") */
 static char *rec_tempext = NULL;
 
+/* Asynchronous writing: frames are serialized and queued by janus_recorder_save_frame,
+ * and a pool of writer threads periodically writes them to file in larger chunks */
+#define JANUS_RECORDER_QUEUE_SIZE	1024
+#define JANUS_RECORDER_WRITE_SIZE	65536
+#define JANUS_RECORDER_MAX_WRITERS	16
+typedef struct janus_recorder_frame {
+	size_t length;
+	char data[];
+} janus_recorder_frame;
+typedef struct janus_recorder_writer janus_recorder_writer;
+/* Backends writer threads can use to write the chunks to file */
+typedef struct janus_recorder_backend {
+	const char *name;
+	/* Size of the buffer to coalesce frames in */
+	size_t buffer_size;
+	/* Prepare and get rid of the writer specific resources, if any */
+	int (* const init)(janus_recorder_writer *writer);
+	void (* const deinit)(janus_recorder_writer *writer);
+	/* Write a chunk: this may be asynchronous, in which case the data
+	 * will remain valid until the next call to commit */
+	void (* const write)(janus_recorder_writer *writer, janus_recorder *recorder, const char *data, size_t length);
+	/* Wait for all the pending writes, if any, to be completed */
+	void (* const commit)(janus_recorder_writer *writer);
+} janus_recorder_backend;
+struct janus_recorder_writer {
+	GThread *thread;
+	/* Recorders whose queue is filling up, and need to be written early */
+	GAsyncQueue *queue;
+	/* Recorders this thread is taking care of */
+	GList *recorders;
+	janus_mutex mutex;
+	/* Backend used to write to file, and its own resources */
+	const janus_recorder_backend *backend;
+	gpointer backend_data;
+	/* Buffer used to coalesce frames before writing them */
+	char *buffer;
+	size_t used;
+};
+static int rec_writers_num = 0, rec_flush_interval = 100;
+static janus_recorder_writer *rec_writers = NULL;
+static volatile gint rec_writers_next = 0;
+static janus_recorder rec_writer_exit;
+
+/* Whether audio/video recordings should have an index file too (default=false) */
+static gboolean rec_index = FALSE;
+
+/* Encryption at rest: each recording is encrypted with its own key, derived from
+ * the configured one and a random salt, in segments that contain a whole chunk
+ * of frames each (length[4], ciphertext, tag[16]), whose IV is their index */
+static gboolean rec_encrypt = FALSE;
+static unsigned char rec_key[JANUS_RECORDER_CRYPTO_KEY_SIZE];
+typedef struct janus_recorder_crypto {
+	EVP_CIPHER_CTX *ctx;
+	guint64 segment;
+} janus_recorder_crypto;
+
+/* Create the encryption context of a new recording, and fill in the file header (magic and salt) */
+static janus_recorder_crypto *janus_recorder_crypto_new(char *file_header) {
+	unsigned char salt[JANUS_RECORDER_CRYPTO_SALT_SIZE], key[EVP_MAX_MD_SIZE];
+	unsigned int key_len = 0;
+	if(RAND_bytes(salt, sizeof(salt)) != 1 ||
+			HMAC(EVP_sha256(), rec_key, sizeof(rec_key), salt, sizeof(salt), key, &key_len) == NULL)
+		return NULL;
+	EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+	if(ctx == NULL || EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, key, NULL) != 1) {
+		OPENSSL_cleanse(key, sizeof(key));
+		if(ctx != NULL)
+			EVP_CIPHER_CTX_free(ctx);
+		return NULL;
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	memcpy(file_header, JANUS_RECORDER_CRYPTO_MAGIC, strlen(JANUS_RECORDER_CRYPTO_MAGIC));
+	memcpy(file_header + strlen(JANUS_RECORDER_CRYPTO_MAGIC), salt, sizeof(salt));
+	janus_recorder_crypto *crypto = g_malloc0(sizeof(janus_recorder_crypto));
+	crypto->ctx = ctx;
+	return crypto;
+}
+
+/* Encrypt a segment in place: the plaintext must be preceded by room for the
+ * header, and followed by room for the tag. Returns the size of the segment */
+static size_t janus_recorder_crypto_seal(janus_recorder_crypto *crypto, char *segment, size_t length) {
+	guint32 header = htonl(length);
+	memcpy(segment, &header, sizeof(guint32));
+	unsigned char iv[12];
+	memset(iv, 0, sizeof(iv));
+	guint32 hi = htonl(crypto->segment >> 32), lo = htonl(crypto->segment & 0xFFFFFFFF);
+	memcpy(iv + 4, &hi, sizeof(guint32));
+	memcpy(iv + 8, &lo, sizeof(guint32));
+	unsigned char *data = (unsigned char *)segment + JANUS_RECORDER_CRYPTO_HEADER_SIZE;
+	int len = 0;
+	/* The header is authenticated too, as additional data */
+	if(EVP_EncryptInit_ex(crypto->ctx, NULL, NULL, NULL, iv) != 1 ||
+			EVP_EncryptUpdate(crypto->ctx, NULL, &len, (unsigned char *)segment, JANUS_RECORDER_CRYPTO_HEADER_SIZE) != 1 ||
+			(length > 0 && EVP_EncryptUpdate(crypto->ctx, data, &len, data, length) != 1) ||
+			EVP_EncryptFinal_ex(crypto->ctx, data + length, &len) != 1 ||
+			EVP_CIPHER_CTX_ctrl(crypto->ctx, EVP_CTRL_GCM_GET_TAG, JANUS_RECORDER_CRYPTO_TAG_SIZE, data + length) != 1)
+		return 0;
+	crypto->segment++;
+	return JANUS_RECORDER_CRYPTO_HEADER_SIZE + length + JANUS_RECORDER_CRYPTO_TAG_SIZE;
+}
+
+static void janus_recorder_crypto_free(janus_recorder_crypto *crypto) {
+	if(crypto == NULL)
+		return;
+	EVP_CIPHER_CTX_free(crypto->ctx);
+	g_free(crypto);
+}
+
+/* Plain stdio backend, which writes chunks synchronously */
+static void janus_recorder_stdio_write(janus_recorder_writer *writer, janus_recorder *recorder, const char *data, size_t length) {
+	size_t res = fwrite(data, sizeof(char), length, recorder->file);
+	if(res != length) {
+		JANUS_LOG(LOG_ERR, "Error saving frames in .mjr file (%zu != %zu, %s)\n",
+			res, length, g_strerror(errno));
+	}
+	recorder->offset += res;
+}
+static const janus_recorder_backend janus_recorder_backend_stdio = {
+	.name = "stdio",
+	.buffer_size = JANUS_RECORDER_WRITE_SIZE,
+	.init = NULL,
+	.deinit = NULL,
+	.write = janus_recorder_stdio_write,
+	.commit = NULL,
+};
+
+#ifdef HAVE_LIBURING
+/* io_uring backend, which submits the writes for all recorders in a batch */
+#define JANUS_RECORDER_URING_DEPTH			256
+#define JANUS_RECORDER_URING_BUFFER_SIZE	(1024*1024)
+typedef struct janus_recorder_uring_request {
+	int fd;
+	const char *data;
+	size_t length;
+	gint64 offset;
+	gboolean done;
+} janus_recorder_uring_request;
+typedef struct janus_recorder_uring {
+	struct io_uring ring;
+	janus_recorder_uring_request requests[JANUS_RECORDER_URING_DEPTH];
+	int pending;
+	gboolean failed;	/* Whether the ring couldn't be recreated, and we fell back to synchronous writes */
+} janus_recorder_uring;
+static int janus_recorder_uring_init(janus_recorder_writer *writer) {
+	janus_recorder_uring *ur = g_malloc0(sizeof(janus_recorder_uring));
+	int res = io_uring_queue_init(JANUS_RECORDER_URING_DEPTH, &ur->ring, 0);
+	if(res < 0) {
+		JANUS_LOG(LOG_ERR, "Error initializing io_uring: %d (%s)\n", -res, g_strerror(-res));
+		g_free(ur);
+		return -1;
+	}
+	writer->backend_data = ur;
+	return 0;
+}
+static void janus_recorder_uring_deinit(janus_recorder_writer *writer) {
+	janus_recorder_uring *ur = (janus_recorder_uring *)writer->backend_data;
+	if(ur == NULL)
+		return;
+	if(!ur->failed)
+		io_uring_queue_exit(&ur->ring);
+	g_free(ur);
+	writer->backend_data = NULL;
+}
+/* Write (what's left of) a request synchronously, e.g., when io_uring failed us */
+static void janus_recorder_uring_pwrite(janus_recorder_uring_request *req, size_t done) {
+	while(done < req->length) {
+		ssize_t w = pwrite(req->fd, req->data + done, req->length - done, req->offset + done);
+		if(w < 0 && errno == EINTR)
+			continue;
+		if(w <= 0) {
+			JANUS_LOG(LOG_ERR, "Error saving frames in .mjr file (%s)\n", g_strerror(errno));
+			break;
+		}
+		done += w;
+	}
+	req->done = TRUE;
+}
+static void janus_recorder_uring_commit(janus_recorder_writer *writer) {
+	janus_recorder_uring *ur = (janus_recorder_uring *)writer->backend_data;
+	if(ur->pending == 0)
+		return;
+	/* Submit the writes: the kernel may take them in more than one go */
+	int submitted = 0, res = 0, attempts = 0;
+	while(submitted < ur->pending) {
+		res = io_uring_submit(&ur->ring);
+		if((res == -EINTR || res == -EAGAIN) && ++attempts < 10)
+			continue;
+		if(res <= 0)
+			break;
+		submitted += res;
+	}
+	if(res < 0)
+		JANUS_LOG(LOG_ERR, "Error submitting recording writes: %d (%s)\n", -res, g_strerror(-res));
+	/* Wait for all the writes we submitted: the requests (and the buffers
+	 * they point to) can only be reused once the kernel is done with them */
+	gboolean broken = (submitted < ur->pending);
+	int i = 0;
+	for(i=0; i<submitted; i++) {
+		struct io_uring_cqe *cqe = NULL;
+		res = io_uring_wait_cqe(&ur->ring, &cqe);
+		if(res == -EINTR) {
+			i--;
+			continue;
+		}
+		if(res < 0 || cqe == NULL) {
+			JANUS_LOG(LOG_ERR, "Error waiting for recording writes: %d (%s)\n", -res, g_strerror(-res));
+			broken = TRUE;
+			break;
+		}
+		janus_recorder_uring_request *req = (janus_recorder_uring_request *)io_uring_cqe_get_data(cqe);
+		int written = cqe->res;
+		io_uring_cqe_seen(&ur->ring, cqe);
+		if(req == NULL)
+			continue;
+		if(written < 0) {
+			/* Don't leave a hole in the file, try again synchronously */
+			JANUS_LOG(LOG_WARN, "Error saving frames in .mjr file (%s), retrying\n", g_strerror(-written));
+			written = 0;
+		}
+		/* In case of short writes, write the rest synchronously */
+		janus_recorder_uring_pwrite(req, written);
+	}
+	/* Whatever wasn't submitted, or we didn't get a completion for, is written
+	 * synchronously: the offsets were reserved already, so this fills the gaps */
+	for(i=0; i<ur->pending; i++) {
+		if(!ur->requests[i].done)
+			janus_recorder_uring_pwrite(&ur->requests[i], 0);
+	}
+	ur->pending = 0;
+	if(broken) {
+		/* Requests we didn't get a completion for (or that are still in the
+		 * submission queue) may still refer to our buffers: start from scratch */
+		JANUS_LOG(LOG_WARN, "Resetting the recordings io_uring\n");
+		io_uring_queue_exit(&ur->ring);
+		res = io_uring_queue_init(JANUS_RECORDER_URING_DEPTH, &ur->ring, 0);
+		if(res < 0) {
+			JANUS_LOG(LOG_FATAL, "Error initializing io_uring: %d (%s)\n", -res, g_strerror(-res));
+			ur->failed = TRUE;
+		}
+	}
+}
+static void janus_recorder_uring_write(janus_recorder_writer *writer, janus_recorder *recorder, const char *data, size_t length) {
+	janus_recorder_uring *ur = (janus_recorder_uring *)writer->backend_data;
+	if(ur->pending == JANUS_RECORDER_URING_DEPTH) {
+		/* Too many writes in flight already, wait for them first */
+		janus_recorder_uring_commit(writer);
+	}
+	struct io_uring_sqe *sqe = ur->failed ? NULL : io_uring_get_sqe(&ur->ring);
+	if(sqe == NULL && !ur->failed) {
+		janus_recorder_uring_commit(writer);
+		sqe = ur->failed ? NULL : io_uring_get_sqe(&ur->ring);
+	}
+	if(sqe == NULL) {
+		/* No io_uring to use, write synchronously */
+		janus_recorder_uring_request req = { .fd = fileno(recorder->file), .data = data,
+			.length = length, .offset = recorder->offset, .done = FALSE };
+		janus_recorder_uring_pwrite(&req, 0);
+		recorder->offset += length;
+		return;
+	}
+	janus_recorder_uring_request *req = &ur->requests[ur->pending];
+	req->done = FALSE;
+	req->fd = fileno(recorder->file);
+	req->data = data;
+	req->length = length;
+	req->offset = recorder->offset;
+	io_uring_prep_write(sqe, req->fd, data, length, req->offset);
+	io_uring_sqe_set_data(sqe, req);
+	ur->pending++;
+	/* We track the offset ourselves, so that writes can be submitted in parallel */
+	recorder->offset += length;
+}
+static const janus_recorder_backend janus_recorder_backend_uring = {
+	.name = "io_uring",
+	.buffer_size = JANUS_RECORDER_URING_BUFFER_SIZE,
+	.init = janus_recorder_uring_init,
+	.deinit = janus_recorder_uring_deinit,
+	.write = janus_recorder_uring_write,
+	.commit = janus_recorder_uring_commit,
+};
+#endif
+static const janus_recorder_backend *rec_backend = &janus_recorder_backend_stdio;
+
+static gboolean janus_recorder_queue_frame(janus_recorder *recorder, janus_recorder_frame *frame) {
+	if(!janus_ring_push(recorder->queue, frame)) {
+		/* The writer can't keep up, drop the frame */
+		g_free(frame);
+		if(g_atomic_int_add(&recorder->dropped, 1) == 0)
+			JANUS_LOG(LOG_WARN, "Recording queue full, dropping frames: %s\n", recorder->filename);
+		return FALSE;
+	}
+	if(janus_ring_length(recorder->queue) >= JANUS_RECORDER_QUEUE_SIZE/2 &&
+			g_atomic_int_compare_and_exchange(&recorder->flush_needed, 0, 1)) {
+		/* Ask the writer thread to take care of this recorder right away */
+		janus_recorder_writer *writer = (janus_recorder_writer *)recorder->writer;
+		if(writer != NULL) {
+			janus_refcount_increase(&recorder->ref);
+			g_async_queue_push(writer->queue, recorder);
+		}
+	}
+	return TRUE;
+}
+
+/* Make sure all the chunks passed to the backend have been written */
+static void janus_recorder_commit(janus_recorder_writer *writer) {
+	if(writer->backend->commit != NULL)
+		writer->backend->commit(writer);
+	writer->used = 0;
+}
+
+/* Pass a chunk of frames to the backend, encrypting it first if needed: in that
+ * case, the chunk must have room for the segment header before the frames, and
+ * for the tag after them. Returns how much of the chunk was passed to the backend */
+static size_t janus_recorder_write_chunk(janus_recorder_writer *writer, janus_recorder *recorder, char *chunk, size_t length) {
+	if(recorder->crypto != NULL) {
+		length = janus_recorder_crypto_seal((janus_recorder_crypto *)recorder->crypto, chunk, length);
+		if(length == 0) {
+			JANUS_LOG(LOG_ERR, "Error encrypting frames, dropping them: %s\n", recorder->filename);
+			return 0;
+		}
+	}
+	writer->backend->write(writer, recorder, chunk, length);
+	return length;
+}
+
+/* Write all the frames queued by a recorder: must be called with the writer mutex locked */
+static void janus_recorder_flush(janus_recorder *recorder, janus_recorder_writer *writer) {
+	if(recorder->queue == NULL || recorder->file == NULL)
+		return;
+	const janus_recorder_backend *backend = writer->backend;
+	/* Encrypted chunks need room for the segment header and tag as well */
+	size_t head = 0, tail = 0;
+	if(recorder->crypto != NULL) {
+		head = JANUS_RECORDER_CRYPTO_HEADER_SIZE;
+		tail = JANUS_RECORDER_CRYPTO_TAG_SIZE;
+	}
+	size_t start = writer->used;
+	writer->used += head;
+	janus_recorder_frame *frame = NULL;
+	while((frame = janus_ring_pop(recorder->queue)) != NULL) {
+		if(writer->used + frame->length + tail > backend->buffer_size) {
+			/* No room for this frame, write what we have first */
+			if(writer->used > start + head)
+				janus_recorder_write_chunk(writer, recorder, writer->buffer + start, writer->used - start - head);
+			janus_recorder_commit(writer);
+			start = 0;
+			writer->used = head;
+		}
+		if(head + frame->length + tail > backend->buffer_size) {
+			/* Too large to be coalesced, write it on its own */
+			char *chunk = frame->data;
+			if(recorder->crypto != NULL) {
+				chunk = g_malloc(head + frame->length + tail);
+				memcpy(chunk + head, frame->data, frame->length);
+			}
+			janus_recorder_write_chunk(writer, recorder, chunk, frame->length);
+			janus_recorder_commit(writer);
+			writer->used = head;
+			if(chunk != frame->data)
+				g_free(chunk);
+		} else {
+			memcpy(writer->buffer + writer->used, frame->data, frame->length);
+			writer->used += frame->length;
+		}
+		g_free(frame);
+	}
+	if(writer->used > start + head)
+		writer->used = start + janus_recorder_write_chunk(writer, recorder, writer->buffer + start, writer->used - start - head);
+	else
+		writer->used = start;
+	if(backend->commit == NULL)
+		writer->used = 0;
+}
+
+/* Write the frames queued by all the recorders of a writer: must be called with the writer mutex locked */
+static void janus_recorder_flush_all(janus_recorder_writer *writer) {
+	GList *temp = NULL;
+	for(temp = writer->recorders; temp != NULL; temp = temp->next)
+		janus_recorder_flush((janus_recorder *)temp->data, writer);
+	janus_recorder_commit(writer);
+}
+
+static void *janus_recorder_writer_thread(void *data) {
+	janus_recorder_writer *writer = (janus_recorder_writer *)data;
+	JANUS_LOG(LOG_VERB, "Joining recordings writer thread...\n");
+	gint64 interval = (gint64)rec_flush_interval*1000, last_flush = janus_get_monotonic_time();
+	janus_recorder *recorder = NULL;
+	while(TRUE) {
+		recorder = g_async_queue_timeout_pop(writer->queue, interval);
+		if(recorder == &rec_writer_exit)
+			break;
+		janus_mutex_lock(&writer->mutex);
+		if(recorder != NULL) {
+			/* A queue is filling up, write its frames now, if we still own the recorder */
+			g_atomic_int_set(&recorder->flush_needed, 0);
+			if(recorder->writer == writer) {
+				janus_recorder_flush(recorder, writer);
+				janus_recorder_commit(writer);
+			}
+		}
+		gint64 now = janus_get_monotonic_time();
+		if(now - last_flush >= interval) {
+			/* Time to write what all the recorders queued */
+			last_flush = now;
+			janus_recorder_flush_all(writer);
+		}
+		janus_mutex_unlock(&writer->mutex);
+		if(recorder != NULL)
+			janus_refcount_decrease(&recorder->ref);
+	}
+	/* Write anything that's left before leaving */
+	janus_mutex_lock(&writer->mutex);
+	janus_recorder_flush_all(writer);
+	janus_mutex_unlock(&writer->mutex);
+	JANUS_LOG(LOG_VERB, "Leaving recordings writer thread...\n");
+	return NULL;
+}
+
+/* Stop having a writer thread take care of a recorder, writing what's left first */
+static void janus_recorder_writer_remove(janus_recorder *recorder) {
+	janus_recorder_writer *writer = (janus_recorder_writer *)recorder->writer;
+	if(writer == NULL)
+		return;
+	janus_mutex_lock(&writer->mutex);
+	writer->recorders = g_list_remove(writer->recorders, recorder);
+	janus_recorder_flush(recorder, writer);
+	char end[JANUS_RECORDER_CRYPTO_HEADER_SIZE + JANUS_RECORDER_CRYPTO_TAG_SIZE];
+	if(recorder->crypto != NULL && recorder->file != NULL) {
+		/* Mark the end of the recording with an empty segment, so that truncations can be detected */
+		janus_recorder_write_chunk(writer, recorder, end, 0);
+	}
+	janus_recorder_commit(writer);
+	recorder->writer = NULL;
+	janus_mutex_unlock(&writer->mutex);
+	if(g_atomic_int_get(&recorder->dropped) > 0) {
+		JANUS_LOG(LOG_WARN, "Dropped %d frames while recording: %s\n",
+			g_atomic_int_get(&recorder->dropped), recorder->filename);
+	}
+	janus_refcount_decrease(&recorder->ref);
+}
+
+void janus_recorder_set_async(int threads, int flush_interval) {
+	if(threads > JANUS_RECORDER_MAX_WRITERS) {
+		JANUS_LOG(LOG_WARN, "Too many recordings writer threads (%d), limiting to %d\n",
+			threads, JANUS_RECORDER_MAX_WRITERS);
+		threads = JANUS_RECORDER_MAX_WRITERS;
+	}
+	rec_writers_num = threads > 0 ? threads : 0;
+	if(flush_interval > 0)
+		rec_flush_interval = flush_interval;
+}
+
+void janus_recorder_set_index(gboolean enabled) {
+	rec_index = enabled;
+}
+
+int janus_recorder_set_encryption(const char *key_file) {
+	rec_encrypt = FALSE;
+	OPENSSL_cleanse(rec_key, sizeof(rec_key));
+	if(key_file == NULL)
+		return 0;
+	gchar *contents = NULL;
+	GError *error = NULL;
+	if(!g_file_get_contents(key_file, &contents, NULL, &error)) {
+		JANUS_LOG(LOG_ERR, "Couldn't read recordings key file %s (%s)\n",
+			key_file, error && error->message ? error->message : "??");
+		g_clear_error(&error);
+		return -1;
+	}
+	/* The key must be hex encoded */
+	char *hex = g_strstrip(contents);
+	int i = 0;
+	if(strlen(hex) != 2*JANUS_RECORDER_CRYPTO_KEY_SIZE) {
+		JANUS_LOG(LOG_ERR, "Invalid recordings key in %s (should be %d hex encoded bytes)\n",
+			key_file, JANUS_RECORDER_CRYPTO_KEY_SIZE);
+		OPENSSL_cleanse(contents, strlen(contents));
+		g_free(contents);
+		return -1;
+	}
+	for(i=0; i<JANUS_RECORDER_CRYPTO_KEY_SIZE; i++) {
+		int hi = g_ascii_xdigit_value(hex[2*i]), lo = g_ascii_xdigit_value(hex[2*i+1]);
+		if(hi < 0 || lo < 0) {
+			JANUS_LOG(LOG_ERR, "Invalid recordings key in %s (not hex encoded)\n", key_file);
+			OPENSSL_cleanse(rec_key, sizeof(rec_key));
+			OPENSSL_cleanse(contents, strlen(contents));
+			g_free(contents);
+			return -1;
+		}
+		rec_key[i] = (hi << 4) | lo;
+	}
+	OPENSSL_cleanse(contents, strlen(contents));
+	g_free(contents);
+	rec_encrypt = TRUE;
+	return 0;
+}
+
+int janus_recorder_set_backend(const char *name) {
+	if(name == NULL || !strcasecmp(name, janus_recorder_backend_stdio.name)) {
+		rec_backend = &janus_recorder_backend_stdio;
+		return 0;
+	}
+#ifdef HAVE_LIBURING
+	if(!strcasecmp(name, janus_recorder_backend_uring.name)) {
+		rec_backend = &janus_recorder_backend_uring;
+		return 0;
+	}
+#endif
+	return -1;
+}
+
 void janus_recorder_init(gboolean tempnames, const char *extension) {
 	JANUS_LOG(LOG_INFO, "Initializing recorder code\n");
 	if(tempnames) {
@@ -55,11 +572,95 @@ void janus_recorder_init(gboolean tempnames, const char *extension) {
 			JANUS_LOG(LOG_INFO, "  -- Using temporary extension .%s\n", rec_tempext);
 		}
 	}
+	if(rec_encrypt && rec_writers_num == 0) {
+		/* Recordings are encrypted by writer threads, so we need at least one */
+		JANUS_LOG(LOG_WARN, "Recordings encryption needs a writer thread, spawning one\n");
+		rec_writers_num = 1;
+	}
+	if(rec_writers_num > 0) {
+		/* Spawn the writer threads */
+		rec_writers = g_malloc0(rec_writers_num * sizeof(janus_recorder_writer));
+		int i = 0;
+		for(i=0; i<rec_writers_num; i++) {
+			janus_recorder_writer *writer = &rec_writers[i];
+			writer->queue = g_async_queue_new();
+			writer->backend = rec_backend;
+			if(writer->backend->init != NULL && writer->backend->init(writer) < 0) {
+				JANUS_LOG(LOG_WARN, "Couldn't initialize the %s backend, falling back to %s\n",
+					writer->backend->name, janus_recorder_backend_stdio.name);
+				writer->backend = &janus_recorder_backend_stdio;
+			}
+			writer->buffer = g_malloc(writer->backend->buffer_size);
+			janus_mutex_init(&writer->mutex);
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "recwriter %d", i+1);
+			GError *error = NULL;
+			writer->thread = g_thread_try_new(tname, janus_recorder_writer_thread, writer, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the recordings writer thread...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				break;
+			}
+		}
+		if(i < rec_writers_num) {
+			/* Only keep the threads we managed to spawn */
+			int j = 0;
+			for(j=i; j<rec_writers_num && rec_writers[j].queue != NULL; j++) {
+				if(rec_writers[j].backend->deinit != NULL)
+					rec_writers[j].backend->deinit(&rec_writers[j]);
+				g_async_queue_unref(rec_writers[j].queue);
+				g_free(rec_writers[j].buffer);
+				janus_mutex_destroy(&rec_writers[j].mutex);
+			}
+			rec_writers_num = i;
+		}
+		if(rec_writers_num > 0) {
+			JANUS_LOG(LOG_INFO, "  -- Writing recordings asynchronously (%d threads, every %dms, %s backend)\n",
+				rec_writers_num, rec_flush_interval, rec_backend->name);
+			if(rec_encrypt)
+				JANUS_LOG(LOG_INFO, "  -- Encrypting recordings at rest (AES-256-GCM)\n");
+		} else {
+			g_free(rec_writers);
+			rec_writers = NULL;
+		}
+	}
 }
 
 void janus_recorder_deinit(void) {
 	rec_tempname = FALSE;
+	rec_encrypt = FALSE;
+	OPENSSL_cleanse(rec_key, sizeof(rec_key));
 	g_free(rec_tempext);
+	if(rec_writers != NULL) {
+		int i = 0;
+		for(i=0; i<rec_writers_num; i++)
+			g_async_queue_push(rec_writers[i].queue, &rec_writer_exit);
+		for(i=0; i<rec_writers_num; i++) {
+			janus_recorder_writer *writer = &rec_writers[i];
+			g_thread_join(writer->thread);
+			/* Get rid of the recorders that were never closed */
+			janus_recorder *recorder = NULL;
+			while((recorder = g_async_queue_try_pop(writer->queue)) != NULL)
+				janus_refcount_decrease(&recorder->ref);
+			g_async_queue_unref(writer->queue);
+			GList *temp = writer->recorders;
+			while(temp) {
+				recorder = (janus_recorder *)temp->data;
+				recorder->writer = NULL;
+				janus_refcount_decrease(&recorder->ref);
+				temp = temp->next;
+			}
+			g_list_free(writer->recorders);
+			if(writer->backend->deinit != NULL)
+				writer->backend->deinit(writer);
+			g_free(writer->buffer);
+			janus_mutex_destroy(&writer->mutex);
+		}
+		g_free(rec_writers);
+		rec_writers = NULL;
+		rec_writers_num = 0;
+	}
 }
 
 static void janus_recorder_free(const janus_refcount *recorder_ref) {
@@ -73,12 +674,23 @@ static void janus_recorder_free(const janus_refcount *recorder_ref) {
 	if(recorder->file != NULL)
 		fclose(recorder->file);
 	recorder->file = NULL;
+	if(recorder->index != NULL)
+		fclose(recorder->index);
+	recorder->index = NULL;
 	g_free(recorder->codec);
 	recorder->codec = NULL;
 	g_free(recorder->fmtp);
 	recorder->fmtp = NULL;
+	janus_recorder_crypto_free((janus_recorder_crypto *)recorder->crypto);
+	recorder->crypto = NULL;
 	if(recorder->extensions != NULL)
 		g_hash_table_destroy(recorder->extensions);
+	if(recorder->queue != NULL) {
+		janus_recorder_frame *frame = NULL;
+		while((frame = janus_ring_pop(recorder->queue)) != NULL)
+			g_free(frame);
+		janus_ring_destroy(recorder->queue);
+	}
 	janus_mutex_destroy(&recorder->mutex);
 	g_free(recorder);
 }
@@ -238,16 +850,85 @@ janus_recorder *janus_recorder_create_full(const char *dir, const char *codec, c
 		rc->dir = g_strdup(rec_dir);
 	rc->filename = g_strdup(newname);
 	rc->type = type;
+	rc->vcodec = (type == JANUS_RECORDER_VIDEO ? janus_videocodec_from_name(codec) : JANUS_VIDEOCODEC_NONE);
+	if(rec_index && type != JANUS_RECORDER_DATA) {
+		/* Create the index file too */
+		char path[1024];
+		if(rec_dir == NULL)
+			g_snprintf(path, sizeof(path), "%s.%s", newname, JANUS_RECORDER_INDEX_EXT);
+		else
+			g_snprintf(path, sizeof(path), "%s/%s.%s", rec_dir, newname, JANUS_RECORDER_INDEX_EXT);
+		rc->index = fopen(path, "wb");
+		if(rc->index == NULL || fwrite(JANUS_RECORDER_INDEX_MAGIC, sizeof(char),
+				strlen(JANUS_RECORDER_INDEX_MAGIC), rc->index) != strlen(JANUS_RECORDER_INDEX_MAGIC)) {
+			JANUS_LOG(LOG_WARN, "Couldn't create index file %s (%s), recording without index\n",
+				path, g_strerror(errno));
+			if(rc->index != NULL)
+				fclose(rc->index);
+			rc->index = NULL;
+			remove(path);
+		}
+	}
+	if(rec_writers != NULL) {
+		/* A writer thread will take care of this file, and write in larger chunks itself */
+		setvbuf(rc->file, NULL, _IONBF, 0);
+	}
+	/* If the recording is encrypted, the file starts with a plaintext header
+	 * (magic and salt), and everything else is written in encrypted segments */
+	const char *file_header = header;
+	size_t file_header_len = strlen(header);
+	char crypto_header[sizeof(JANUS_RECORDER_CRYPTO_MAGIC)-1 + JANUS_RECORDER_CRYPTO_SALT_SIZE];
+	if(rec_encrypt) {
+		if(rec_writers == NULL) {
+			/* Encrypting on this thread would defeat the purpose, and we can't write in clear */
+			JANUS_LOG(LOG_ERR, "Can't encrypt recordings without writer threads\n");
+			janus_recorder_destroy(rc);
+			g_free(copy_for_parent);
+			g_free(copy_for_base);
+			return NULL;
+		}
+		rc->crypto = janus_recorder_crypto_new(crypto_header);
+		if(rc->crypto == NULL) {
+			JANUS_LOG(LOG_ERR, "Couldn't initialize the recording encryption\n");
+			janus_recorder_destroy(rc);
+			g_free(copy_for_parent);
+			g_free(copy_for_base);
+			return NULL;
+		}
+		file_header = crypto_header;
+		file_header_len = sizeof(crypto_header);
+	}
 	/* Write the first part of the header */
-	size_t res = fwrite(header, sizeof(char), strlen(header), rc->file);
-	if(res != strlen(header)) {
+	size_t res = fwrite(file_header, sizeof(char), file_header_len, rc->file);
+	if(res != file_header_len) {
 		JANUS_LOG(LOG_ERR, "Couldn't write .mjr header (%zu != %zu, %s)\n",
-			res, strlen(header), g_strerror(errno));
+			res, file_header_len, g_strerror(errno));
 		janus_recorder_destroy(rc);
 		g_free(copy_for_parent);
 		g_free(copy_for_base);
 		return NULL;
 	}
+	/* Frames go after the header: this must be set before the writer
+	 * thread knows about us, as it may flush our frames at any time */
+	rc->offset = file_header_len;
+	rc->size = strlen(header);
+	if(rec_writers != NULL) {
+		/* Pick the writer thread that will write the frames for us */
+		janus_recorder_writer *writer = &rec_writers[(guint)g_atomic_int_add(&rec_writers_next, 1) % rec_writers_num];
+		rc->queue = janus_ring_new(JANUS_RECORDER_QUEUE_SIZE);
+		janus_refcount_increase(&rc->ref);
+		janus_mutex_lock(&writer->mutex);
+		rc->writer = writer;
+		writer->recorders = g_list_append(writer->recorders, rc);
+		janus_mutex_unlock(&writer->mutex);
+	}
+	if(rc->crypto != NULL) {
+		/* The MJR header is the first thing we encrypt */
+		janus_recorder_frame *frame = g_malloc(sizeof(janus_recorder_frame) + strlen(header));
+		frame->length = strlen(header);
+		memcpy(frame->data, header, strlen(header));
+		janus_recorder_queue_frame(rc, frame);
+	}
 	g_atomic_int_set(&rc->writable, 1);
 	/* We still need to also write the info header first */
 	g_atomic_int_set(&rc->header, 0);
@@ -329,6 +1010,79 @@ int janus_recorder_encrypted(janus_recorder *recorder) {
 	return -1;
 }
 
+/* Helper to serialize a frame as it would be written to the .mjr file */
+static janus_recorder_frame *janus_recorder_serialize_frame(janus_recorder *recorder, char *buffer, uint length, uint32_t time) {
+	size_t hlen = strlen(frame_header);
+	size_t extra = (recorder->type == JANUS_RECORDER_DATA ? sizeof(gint64) : 0);
+	size_t total = hlen + sizeof(uint32_t) + sizeof(uint16_t) + extra + length;
+	janus_recorder_frame *frame = g_malloc(sizeof(janus_recorder_frame) + total);
+	frame->length = total;
+	char *p = frame->data;
+	/* Frame header (fixed part[4], timestamp[4], length[2]) */
+	memcpy(p, frame_header, hlen);
+	p += hlen;
+	uint32_t timestamp = htonl(time);
+	memcpy(p, &timestamp, sizeof(uint32_t));
+	p += sizeof(uint32_t);
+	uint16_t header_bytes = htons(length + extra);
+	memcpy(p, &header_bytes, sizeof(uint16_t));
+	p += sizeof(uint16_t);
+	if(recorder->type == JANUS_RECORDER_DATA) {
+		/* If it's data, then we need to prepend timing related info, as it's not there by itself */
+		gint64 when = htonll(janus_get_real_time());
+		memcpy(p, &when, sizeof(gint64));
+		p += sizeof(gint64);
+	}
+	memcpy(p, buffer, length);
+	if(recorder->type != JANUS_RECORDER_DATA) {
+		/* Rewrite the RTP header in our copy, leaving the original untouched */
+		janus_rtp_header_update((janus_rtp_header *)p, &recorder->context, recorder->type == JANUS_RECORDER_VIDEO, 0);
+	}
+	return frame;
+}
+
+/* Helper to prepare the index entry for a frame, whose RTP header has already been rewritten */
+static void janus_recorder_index_prepare(janus_recorder *recorder, char *rtp, uint length, uint32_t time, char *entry) {
+	memset(entry, 0, JANUS_RECORDER_INDEX_ENTRY_SIZE);
+	/* The packet will come right after the frame header (fixed part[4], timestamp[4], length[2]) */
+	guint64 offset = recorder->size + strlen(frame_header) + sizeof(uint32_t) + sizeof(uint16_t);
+	guint32 hi = htonl(offset >> 32), lo = htonl(offset & 0xFFFFFFFF);
+	memcpy(entry, &hi, sizeof(guint32));
+	memcpy(entry + 4, &lo, sizeof(guint32));
+	guint32 t = htonl(time);
+	memcpy(entry + 8, &t, sizeof(guint32));
+	janus_rtp_header *header = (janus_rtp_header *)rtp;
+	memcpy(entry + 12, &header->timestamp, sizeof(guint32));
+	memcpy(entry + 16, &header->seq_number, sizeof(guint16));
+	guint16 l = htons(length);
+	memcpy(entry + 18, &l, sizeof(guint16));
+	if(recorder->type == JANUS_RECORDER_VIDEO && !recorder->encrypted) {
+		/* Check if this is a keyframe, to make seeking easier */
+		int plen = 0;
+		char *payload = janus_rtp_payload(rtp, length, &plen);
+		janus_videocodec vcodec = recorder->vcodec;
+		if(payload != NULL && plen > 0 &&
+				((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
+				(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
+				(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
+				(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
+				(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen)))) {
+			entry[20] |= JANUS_RECORDER_INDEX_KEYFRAME;
+		}
+	}
+}
+
+/* Helper to save an index entry (if needed), once the related frame of the specified size has been saved */
+static void janus_recorder_index_save(janus_recorder *recorder, const char *entry, size_t size) {
+	if(recorder->index != NULL && entry != NULL &&
+			fwrite(entry, sizeof(char), JANUS_RECORDER_INDEX_ENTRY_SIZE, recorder->index) != JANUS_RECORDER_INDEX_ENTRY_SIZE) {
+		JANUS_LOG(LOG_WARN, "Couldn't write to index file (%s), closing it\n", g_strerror(errno));
+		fclose(recorder->index);
+		recorder->index = NULL;
+	}
+	recorder->size += size;
+}
+
 int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint length) {
 	if(!recorder)
 		return -1;
@@ -403,29 +1157,54 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 			return -5;
 		}
 		uint16_t info_bytes = htons(strlen(info_text));
-		size_t res = fwrite(&info_bytes, sizeof(uint16_t), 1, recorder->file);
-		if(res != 1) {
-			JANUS_LOG(LOG_WARN, "Couldn't write size of JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-				res, sizeof(uint16_t), g_strerror(errno));
-		}
-		res = fwrite(info_text, sizeof(char), strlen(info_text), recorder->file);
-		if(res != strlen(info_text)) {
-			JANUS_LOG(LOG_WARN, "Couldn't write JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
-				res, strlen(info_text), g_strerror(errno));
+		if(recorder->queue != NULL) {
+			/* Queue the info header, a writer thread will write it for us */
+			size_t info_len = strlen(info_text);
+			janus_recorder_frame *frame = g_malloc(sizeof(janus_recorder_frame) + sizeof(uint16_t) + info_len);
+			frame->length = sizeof(uint16_t) + info_len;
+			memcpy(frame->data, &info_bytes, sizeof(uint16_t));
+			memcpy(frame->data + sizeof(uint16_t), info_text, info_len);
+			free(info_text);
+			if(janus_recorder_queue_frame(recorder, frame))
+				recorder->size += sizeof(uint16_t) + info_len;
+		} else {
+			size_t res = fwrite(&info_bytes, sizeof(uint16_t), 1, recorder->file);
+			if(res != 1) {
+				JANUS_LOG(LOG_WARN, "Couldn't write size of JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
+					res, sizeof(uint16_t), g_strerror(errno));
+			}
+			res = fwrite(info_text, sizeof(char), strlen(info_text), recorder->file);
+			if(res != strlen(info_text)) {
+				JANUS_LOG(LOG_WARN, "Couldn't write JSON header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
+					res, strlen(info_text), g_strerror(errno));
+			}
+			recorder->size += sizeof(uint16_t) + strlen(info_text);
+			free(info_text);
 		}
-		free(info_text);
 		/* Done */
 		recorder->started = now;
 		g_atomic_int_set(&recorder->header, 1);
 	}
+	uint32_t time = (uint32_t)(now > recorder->started ? ((now - recorder->started)/1000) : 0);
+	char entry[JANUS_RECORDER_INDEX_ENTRY_SIZE];
+	if(recorder->queue != NULL) {
+		/* Serialize the whole frame and queue it, a writer thread will write it for us */
+		janus_recorder_frame *frame = janus_recorder_serialize_frame(recorder, buffer, length, time);
+		size_t size = frame->length;
+		if(recorder->index != NULL)
+			janus_recorder_index_prepare(recorder, frame->data + size - length, length, time, entry);
+		if(janus_recorder_queue_frame(recorder, frame))
+			janus_recorder_index_save(recorder, recorder->index ? entry : NULL, size);
+		janus_mutex_unlock_nodebug(&recorder->mutex);
+		return 0;
+	}
 	/* Write frame header (fixed part[4], timestamp[4], length[2]) */
 	size_t res = fwrite(frame_header, sizeof(char), strlen(frame_header), recorder->file);
 	if(res != strlen(frame_header)) {
 		JANUS_LOG(LOG_WARN, "Couldn't write frame header in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
 			res, strlen(frame_header), g_strerror(errno));
 	}
-	uint32_t timestamp = (uint32_t)(now > recorder->started ? ((now - recorder->started)/1000) : 0);
-	timestamp = htonl(timestamp);
+	uint32_t timestamp = htonl(time);
 	res = fwrite(&timestamp, sizeof(uint32_t), 1, recorder->file);
 	if(res != 1) {
 		JANUS_LOG(LOG_WARN, "Couldn't write frame timestamp in .mjr file (%zu != %zu, %s), expect issues post-processing\n",
@@ -473,6 +1252,12 @@ int janus_recorder_save_frame(janus_recorder *recorder, char *buffer, uint lengt
 		}
 		tot -= temp;
 	}
+	/* Keep track of where the packet is, in case we have an index */
+	if(recorder->index != NULL)
+		janus_recorder_index_prepare(recorder, buffer, length, time, entry);
+	janus_recorder_index_save(recorder, recorder->index ? entry : NULL,
+		strlen(frame_header) + sizeof(uint32_t) + sizeof(uint16_t) +
+		(recorder->type == JANUS_RECORDER_DATA ? sizeof(gint64) : 0) + length);
 	if(recorder->type != JANUS_RECORDER_DATA) {
 		/* Restore packet header data */
 		header->ssrc = htonl(ssrc);
@@ -488,6 +1273,12 @@ int janus_recorder_close(janus_recorder *recorder) {
 	if(!recorder || !g_atomic_int_compare_and_exchange(&recorder->writable, 1, 0))
 		return -1;
 	janus_mutex_lock_nodebug(&recorder->mutex);
+	/* If a writer thread was taking care of this recorder, make sure everything was written */
+	janus_recorder_writer_remove(recorder);
+	if(recorder->index != NULL) {
+		fclose(recorder->index);
+		recorder->index = NULL;
+	}
 	if(recorder->file) {
 		fseek(recorder->file, 0L, SEEK_END);
 		size_t fsize = ftell(recorder->file);
@@ -514,6 +1305,14 @@ int janus_recorder_close(janus_recorder *recorder) {
 			JANUS_LOG(LOG_ERR, "Error renaming %s to %s...\n", recorder->filename, newname);
 		} else {
 			JANUS_LOG(LOG_INFO, "Recording renamed: %s\n", newname);
+			if(rec_index && recorder->type != JANUS_RECORDER_DATA) {
+				/* Rename the index file as well, if there's one */
+				char oldindex[1100], newindex[1100];
+				g_snprintf(oldindex, sizeof(oldindex), "%s.%s", oldpath, JANUS_RECORDER_INDEX_EXT);
+				g_snprintf(newindex, sizeof(newindex), "%s.%s", newpath, JANUS_RECORDER_INDEX_EXT);
+				if(g_file_test(oldindex, G_FILE_TEST_EXISTS) && rename(oldindex, newindex) != 0)
+					JANUS_LOG(LOG_ERR, "Error renaming index %s to %s...\n", oldindex, newindex);
+			}
 			g_free(recorder->filename);
 			recorder->filename = g_strdup(newname);
 		}
@@ -525,5 +1324,8 @@ int janus_recorder_close(janus_recorder *recorder) {
 void janus_recorder_destroy(janus_recorder *recorder) {
 	if(!recorder || !g_atomic_int_compare_and_exchange(&recorder->destroyed, 0, 1))
 		return;
+	/* A writer thread may still have a reference, if the recorder was never closed */
+	if(recorder->writer != NULL)
+		janus_recorder_close(recorder);
 	janus_refcount_decrease(&recorder->ref);
 }
@@ -12,6 +12,23 @@
  * \note If you want to record both audio and video, you'll have to use
  * two different recorders. Any muxing in the same container will have
  * to be done in the post-processing phase.
+ * \note By default frames are written to file on the same thread that
+ * saves them, which means a slow disk may end up delaying media. In case
+ * a pool of writer threads is configured via janus_recorder_set_async(),
+ * frames are queued instead, and periodically written to file in larger
+ * chunks by one of those threads: if a recorder can't keep up and its
+ * queue gets full, new frames are dropped (and counted). How writer
+ * threads write to file depends on the backend selected via
+ * janus_recorder_set_backend().
+ * \note When enabled via janus_recorder_set_index(), audio and video
+ * recorders also save an index file alongside the recording, which maps
+ * each frame to its position in the file: see the \ref mjrindex section
+ * of the \ref recordings documentation for details on its format.
+ * \note When a key is configured via janus_recorder_set_encryption(),
+ * recordings are also encrypted at rest (AES-256-GCM), in segments that
+ * the writer threads seal right before writing each chunk: this way, no
+ * encryption ever happens on the thread that saves the frames. See the
+ * \ref mjrcrypto section of the \ref recordings documentation for details.
  *
  * \ingroup core
  * \ref core
@@ -28,8 +45,64 @@
 #include "mutex.h"
 #include "refcount.h"
 #include "rtp.h"
+#include "ring.h"
 
 
+/*! \brief Magic string at the beginning of a recording index file */
+#define JANUS_RECORDER_INDEX_MAGIC		"MJRIDX01"
+/*! \brief Extension of the recording index files */
+#define JANUS_RECORDER_INDEX_EXT		"idx"
+/*! \brief Size of each entry in a recording index file */
+#define JANUS_RECORDER_INDEX_ENTRY_SIZE	24
+/*! \brief Flag marking index entries that contain (part of) a keyframe */
+#define JANUS_RECORDER_INDEX_KEYFRAME	0x01
+
+/*! \brief Entry in a recording index file */
+typedef struct janus_recorder_index_entry {
+	/*! \brief Offset of the RTP packet in the recording */
+	guint64 offset;
+	/*! \brief Frame timestamp (ms since the first frame was written) */
+	guint32 time;
+	/*! \brief RTP timestamp of the packet, as saved in the recording */
+	guint32 timestamp;
+	/*! \brief RTP sequence number of the packet, as saved in the recording */
+	guint16 seq;
+	/*! \brief Length of the RTP packet */
+	guint16 length;
+	/*! \brief Flags (e.g., JANUS_RECORDER_INDEX_KEYFRAME) */
+	guint8 flags;
+} janus_recorder_index_entry;
+
+/*! \brief Helper to parse an entry of a recording index file
+ * @param[in] buffer Buffer containing the serialized entry (JANUS_RECORDER_INDEX_ENTRY_SIZE bytes)
+ * @param[out] entry The entry to fill in */
+static inline void janus_recorder_index_entry_parse(const char *buffer, janus_recorder_index_entry *entry) {
+	guint32 hi = 0, lo = 0;
+	memcpy(&hi, buffer, sizeof(guint32));
+	memcpy(&lo, buffer + 4, sizeof(guint32));
+	entry->offset = ((guint64)g_ntohl(hi) << 32) | g_ntohl(lo);
+	memcpy(&entry->time, buffer + 8, sizeof(guint32));
+	entry->time = g_ntohl(entry->time);
+	memcpy(&entry->timestamp, buffer + 12, sizeof(guint32));
+	entry->timestamp = g_ntohl(entry->timestamp);
+	memcpy(&entry->seq, buffer + 16, sizeof(guint16));
+	entry->seq = g_ntohs(entry->seq);
+	memcpy(&entry->length, buffer + 18, sizeof(guint16));
+	entry->length = g_ntohs(entry->length);
+	entry->flags = (guint8)buffer[20];
+}
+
+/*! \brief Magic string at the beginning of a recording encrypted at rest */
+#define JANUS_RECORDER_CRYPTO_MAGIC		"ENCMJR01"
+/*! \brief Size of the random salt the key of each encrypted recording is derived with */
+#define JANUS_RECORDER_CRYPTO_SALT_SIZE	16
+/*! \brief Size of the key (AES-256) recordings are encrypted with */
+#define JANUS_RECORDER_CRYPTO_KEY_SIZE	32
+/*! \brief Size of the header (length of the plaintext) of each encrypted segment */
+#define JANUS_RECORDER_CRYPTO_HEADER_SIZE	4
+/*! \brief Size of the authentication tag at the end of each encrypted segment */
+#define JANUS_RECORDER_CRYPTO_TAG_SIZE	16
+
 /*! \brief Media types we can record */
 typedef enum janus_recorder_medium {
 	JANUS_RECORDER_AUDIO,
@@ -71,6 +144,24 @@ typedef struct janus_recorder {
 	janus_rtp_switching_context context;
 	/*! \brief Mutex to lock/unlock this recorder instance */
 	janus_mutex mutex;
+	/*! \brief Queue of serialized frames to write, if a writer thread is taking care of this recorder */
+	janus_ring *queue;
+	/*! \brief Opaque pointer to the writer thread taking care of this recorder, if any */
+	gpointer writer;
+	/*! \brief Whether the writer thread has already been asked to write the queued frames early */
+	volatile gint flush_needed;
+	/*! \brief Number of frames dropped because the queue was full */
+	volatile gint dropped;
+	/*! \brief Opaque pointer to the context used to encrypt the recording at rest, if any */
+	gpointer crypto;
+	/*! \brief Offset in the file the writer thread will write the next chunk at */
+	gint64 offset;
+	/*! \brief Index file, if any */
+	FILE *index;
+	/*! \brief Size of the recording, once all saved frames are written (used for the index) */
+	gint64 size;
+	/*! \brief Video codec of the recording, if video, to detect keyframes for the index */
+	janus_videocodec vcodec;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -81,6 +172,33 @@ typedef struct janus_recorder {
  * @param[in] tempnames Whether the filenames should have a temporary extension, while saving, or not
  * @param[in] extension Extension to add in case tempnames is true */
 void janus_recorder_init(gboolean tempnames, const char *extension);
+/*! \brief Configure a pool of threads to write recordings asynchronously
+ * \note This must be called before janus_recorder_init(), and only affects
+ * recorders created after that: by default (no threads) frames are written
+ * synchronously, in the context of janus_recorder_save_frame()
+ * @param[in] threads Number of writer threads to spawn (0 to disable)
+ * @param[in] flush_interval How often (in ms) each thread should write the frames queued by its recorders */
+void janus_recorder_set_async(int threads, int flush_interval);
+/*! \brief Choose the backend writer threads should use to write recordings
+ * \note This must be called before janus_recorder_init(), and is only
+ * relevant when writer threads are used. The default is \c stdio , which
+ * writes each chunk synchronously; when compiled with liburing, \c io_uring
+ * can be used instead, to have each thread submit the writes for all its
+ * recorders at the same time, and wait for them as a batch.
+ * @param[in] name Name of the backend ("stdio" or "io_uring")
+ * @returns 0 in case of success, a negative integer if the backend is not available */
+int janus_recorder_set_backend(const char *name);
+/*! \brief Configure whether recorders should save an index file alongside audio/video recordings
+ * \note This only affects recorders created after the call
+ * @param[in] enabled Whether index files should be saved or not */
+void janus_recorder_set_index(gboolean enabled);
+/*! \brief Configure the key recordings should be encrypted at rest with
+ * \note This must be called before janus_recorder_init(), and only affects
+ * recorders created after that. Since encryption is performed by writer
+ * threads, one is spawned anyway if none was configured via janus_recorder_set_async().
+ * @param[in] key_file Path to a file containing the key (32 bytes, hex encoded), or NULL to disable encryption
+ * @returns 0 in case of success, a negative integer if the key couldn't be loaded */
+int janus_recorder_set_encryption(const char *key_file);
 /*! \brief De-initialize the recorder code */
 void janus_recorder_deinit(void);
 
@@ -49,6 +49,14 @@ void my_free_function(janus_refcount *counter) {
 	free(my_object);
 }
 \endverbatim
+ *
+ * Objects whose counter is updated all the time by different threads
+ * (e.g., for every packet) can use JANUS_REFCOUNT_HOT instead of a plain
+ * janus_refcount member, so that the counter sits in a cache line of
+ * its own and doesn't invalidate the other members on every update.
+ * Besides, when building with \c REFCOUNT_NODEBUG defined (which
+ * \c --disable-refcount-debug does), the runtime check on \c refcount_debug
+ * is stripped from all the macros, and only the non-debug versions are used.
  *
  * \ingroup core
  * \ref core
@@ -82,6 +90,18 @@ struct janus_refcount {
 	void (*free)(const janus_refcount *);
 };
 
+/*! \brief Size of a cache line, used to keep hot counters apart */
+#define JANUS_CACHELINE_SIZE	64
+/*! \brief Macro to declare a reference counter that different threads
+ * update all the time, padded so that no other member of the object
+ * shares a cache line with it, whatever the alignment of the object
+ * \note The counter can be accessed as any other janus_refcount member,
+ * e.g., <code>janus_refcount_increase(&object->member)</code> */
+#define JANUS_REFCOUNT_HOT(member) \
+	char member##_pad_before[JANUS_CACHELINE_SIZE]; \
+	janus_refcount member; \
+	char member##_pad_after[JANUS_CACHELINE_SIZE - sizeof(janus_refcount)]
+
 
 #ifdef REFCOUNT_DEBUG
 /* Reference counters debugging */
@@ -108,6 +128,9 @@ extern janus_mutex counters_mutex;
  * @param refp Pointer to the Janus reference counter instance
  * @param free_fn Pointer to the function to invoke when the object the counter
  * refers to needs to be destroyed */
+#ifdef REFCOUNT_NODEBUG
+#define janus_refcount_init(refp, free_fn) janus_refcount_init_nodebug(refp, free_fn)
+#else
 #define janus_refcount_init(refp, free_fn) { \
 	if(!refcount_debug) { \
 		janus_refcount_init_nodebug(refp, free_fn); \
@@ -115,6 +138,7 @@ extern janus_mutex counters_mutex;
 		janus_refcount_init_debug(refp, free_fn); \
 	} \
 }
+#endif
 /*! \brief Janus reference counter initialization (no debug)
  * \note Also sets the counter to 1 automatically, so no need to increase
  * it again manually via janus_refcount_increase() after the initialization
@@ -156,6 +180,9 @@ extern janus_mutex counters_mutex;
 
 /*! \brief Increase the Janus reference counter (debug according to settings)
  * @param refp Pointer to the Janus reference counter instance */
+#ifdef REFCOUNT_NODEBUG
+#define janus_refcount_increase(refp) janus_refcount_increase_nodebug(refp)
+#else
 #define janus_refcount_increase(refp) { \
 	if(!refcount_debug) { \
 		janus_refcount_increase_nodebug(refp); \
@@ -163,6 +190,7 @@ extern janus_mutex counters_mutex;
 		janus_refcount_increase_debug(refp); \
 	} \
 }
+#endif
 /*! \brief Increase the Janus reference counter (no debug)
  * @param refp Pointer to the Janus reference counter instance */
 #define janus_refcount_increase_nodebug(refp)  { \
@@ -178,6 +206,9 @@ extern janus_mutex counters_mutex;
 /*! \brief Decrease the Janus reference counter (debug according to settings)
  * \note Will invoke the \c free function if the counter reaches 0
  * @param refp Pointer to the Janus reference counter instance */
+#ifdef REFCOUNT_NODEBUG
+#define janus_refcount_decrease(refp) janus_refcount_decrease_nodebug(refp)
+#else
 #define janus_refcount_decrease(refp) { \
 	if(!refcount_debug) { \
 		janus_refcount_decrease_nodebug(refp); \
@@ -185,6 +216,7 @@ extern janus_mutex counters_mutex;
 		janus_refcount_decrease_debug(refp); \
 	} \
 }
+#endif
 /*! \brief Decrease the Janus reference counter (debug)
  * \note Will invoke the \c free function if the counter reaches 0
  * @param refp Pointer to the Janus reference counter instance */
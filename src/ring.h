@@ -0,0 +1,167 @@
+/*! \file    ring.h
+ * \copyright GNU General Public License v3
+ * \brief    Bounded lock-free queue
+ * \details  Implementation of a bounded multi-producer/single-consumer
+ * queue, that can be used instead of a GAsyncQueue when several threads
+ * need to push items that a single thread (e.g., an event loop) will
+ * consume. Pushing and popping items doesn't involve any mutex: each
+ * slot in the ring has a sequence number, that producers and the
+ * consumer use to figure out whether the slot is free or ready to be
+ * read (this is based on the well known bounded queue design by Dmitry
+ * Vyukov). Since the queue is bounded, pushing an item into a full queue
+ * fails, and it's up to the caller to decide what to do with the item.
+ *
+ * The size of the queue must be a power of 2: use janus_ring_new() to
+ * create one, janus_ring_push() and janus_ring_pop() to add and remove
+ * items (or janus_ring_pop_mc() in case there are multiple consumers),
+ * and janus_ring_destroy() to free it when done. Notice that the queue
+ * doesn't own the items, so they must be removed before destroying it.
+ *
+ * \ingroup core
+ * \ref core
+ */
+
+#ifndef JANUS_RING_H
+#define JANUS_RING_H
+
+#include <glib.h>
+
+/*! \brief Slot in the ring */
+typedef struct janus_ring_slot {
+	/*! \brief Sequence number for this slot */
+	volatile gsize seq;
+	/*! \brief Item currently stored in the slot, if any */
+	gpointer data;
+} janus_ring_slot;
+
+/*! \brief Bounded lock-free queue instance */
+typedef struct janus_ring {
+	/*! \brief Number of slots in the ring (a power of 2) */
+	gsize size;
+	/*! \brief Mask to apply to positions to get the slot index */
+	gsize mask;
+	/*! \brief The slots */
+	janus_ring_slot *slots;
+	/*! \brief Position producers will write to next */
+	volatile gsize head;
+	/*! \brief Position the consumer will read from next */
+	volatile gsize tail;
+} janus_ring;
+
+/*! \brief Helper to create a new ring
+ * @param[in] size Number of slots in the ring, rounded up to the closest power of 2
+ * @returns A new janus_ring instance */
+static inline janus_ring *janus_ring_new(gsize size) {
+	gsize real = 2;
+	while(real < size)
+		real <<= 1;
+	janus_ring *ring = g_malloc0(sizeof(janus_ring));
+	ring->size = real;
+	ring->mask = real - 1;
+	ring->slots = g_malloc(real * sizeof(janus_ring_slot));
+	gsize i = 0;
+	for(i=0; i<real; i++) {
+		ring->slots[i].seq = i;
+		ring->slots[i].data = NULL;
+	}
+	return ring;
+}
+
+/*! \brief Helper to destroy a ring
+ * @note Items still in the ring are not freed
+ * @param[in] ring The janus_ring instance to destroy */
+static inline void janus_ring_destroy(janus_ring *ring) {
+	if(ring == NULL)
+		return;
+	g_free(ring->slots);
+	g_free(ring);
+}
+
+/*! \brief Helper to add an item to the ring (safe to call from multiple threads)
+ * @param[in] ring The janus_ring instance to push the item to
+ * @param[in] data The item to push
+ * @returns TRUE if the item was added, FALSE if the ring was full */
+static inline gboolean janus_ring_push(janus_ring *ring, gpointer data) {
+	gsize pos = (gsize)g_atomic_pointer_get(&ring->head);
+	janus_ring_slot *slot = NULL;
+	while(TRUE) {
+		slot = &ring->slots[pos & ring->mask];
+		gsize seq = (gsize)g_atomic_pointer_get(&slot->seq);
+		gssize diff = (gssize)seq - (gssize)pos;
+		if(diff == 0) {
+			/* The slot is free, try to claim it */
+			if(g_atomic_pointer_compare_and_exchange(&ring->head, pos, pos+1))
+				break;
+			pos = (gsize)g_atomic_pointer_get(&ring->head);
+		} else if(diff < 0) {
+			/* The ring is full */
+			return FALSE;
+		} else {
+			/* Another producer got here first, try again */
+			pos = (gsize)g_atomic_pointer_get(&ring->head);
+		}
+	}
+	slot->data = data;
+	g_atomic_pointer_set(&slot->seq, pos+1);
+	return TRUE;
+}
+
+/*! \brief Helper to get the next item from the ring (must only be called by the consumer)
+ * @param[in] ring The janus_ring instance to pop the item from
+ * @returns The item, if any, or NULL if the ring is empty */
+static inline gpointer janus_ring_pop(janus_ring *ring) {
+	gsize pos = ring->tail;
+	janus_ring_slot *slot = &ring->slots[pos & ring->mask];
+	gsize seq = (gsize)g_atomic_pointer_get(&slot->seq);
+	if((gssize)seq - (gssize)(pos+1) < 0) {
+		/* Empty, or a producer is still writing */
+		return NULL;
+	}
+	gpointer data = slot->data;
+	slot->data = NULL;
+	g_atomic_pointer_set(&ring->tail, pos+1);
+	g_atomic_pointer_set(&slot->seq, pos + ring->size);
+	return data;
+}
+
+/*! \brief Helper to get the next item from the ring, when there may be multiple consumers
+ * @note This is slightly more expensive than janus_ring_pop(), so only
+ * use it when the ring may be drained by different threads at the same time
+ * @param[in] ring The janus_ring instance to pop the item from
+ * @returns The item, if any, or NULL if the ring is empty */
+static inline gpointer janus_ring_pop_mc(janus_ring *ring) {
+	gsize pos = (gsize)g_atomic_pointer_get(&ring->tail);
+	janus_ring_slot *slot = NULL;
+	while(TRUE) {
+		slot = &ring->slots[pos & ring->mask];
+		gsize seq = (gsize)g_atomic_pointer_get(&slot->seq);
+		gssize diff = (gssize)seq - (gssize)(pos+1);
+		if(diff == 0) {
+			/* There's an item here, try to claim it */
+			if(g_atomic_pointer_compare_and_exchange(&ring->tail, pos, pos+1))
+				break;
+			pos = (gsize)g_atomic_pointer_get(&ring->tail);
+		} else if(diff < 0) {
+			/* Empty, or a producer is still writing */
+			return NULL;
+		} else {
+			/* Another consumer got here first, try again */
+			pos = (gsize)g_atomic_pointer_get(&ring->tail);
+		}
+	}
+	gpointer data = slot->data;
+	slot->data = NULL;
+	g_atomic_pointer_set(&slot->seq, pos + ring->size);
+	return data;
+}
+
+/*! \brief Helper to get an estimate of the items currently in the ring
+ * @param[in] ring The janus_ring instance to check
+ * @returns The number of items in the ring */
+static inline gsize janus_ring_length(janus_ring *ring) {
+	gsize tail = (gsize)g_atomic_pointer_get(&ring->tail);
+	gsize head = (gsize)g_atomic_pointer_get(&ring->head);
+	return head > tail ? head - tail : 0;
+}
+
+#endif
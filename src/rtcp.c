@@ -161,6 +161,121 @@ guint32 janus_rtcp_get_receiver_ssrc(char *packet, int len) {
 	return 0;
 }
 
+int janus_rtcp_summarize(char *packet, int len, janus_rtcp_summary *summary) {
+	if(summary == NULL)
+		return -1;
+	memset(summary, 0, sizeof(*summary));
+	if(packet == NULL || len == 0)
+		return -1;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	gboolean sender_found = FALSE, receiver_found = FALSE;
+	int total = len;
+	while(rtcp) {
+		if (!janus_rtcp_check_len(rtcp, total))
+			break;
+		if(rtcp->version != 2)
+			break;
+		summary->messages++;
+		switch(rtcp->type) {
+			case RTCP_SR: {
+				janus_rtcp_sr *sr = (janus_rtcp_sr *)rtcp;
+				summary->sr++;
+				if(!sender_found) {
+					summary->sender_ssrc = ntohl(sr->ssrc);
+					sender_found = TRUE;
+				}
+				if(janus_rtcp_check_sr(rtcp, total)) {
+					summary->report_blocks += sr->header.rc;
+					if(!receiver_found && sr->header.rc > 0) {
+						summary->receiver_ssrc = ntohl(sr->rb[0].ssrc);
+						receiver_found = TRUE;
+					}
+				}
+				break;
+			}
+			case RTCP_RR: {
+				janus_rtcp_rr *rr = (janus_rtcp_rr *)rtcp;
+				summary->rr++;
+				if(!sender_found) {
+					summary->sender_ssrc = ntohl(rr->ssrc);
+					sender_found = TRUE;
+				}
+				if(janus_rtcp_check_rr(rtcp, total)) {
+					summary->report_blocks += rr->header.rc;
+					if(!receiver_found && rr->header.rc > 0) {
+						summary->receiver_ssrc = ntohl(rr->rb[0].ssrc);
+						receiver_found = TRUE;
+					}
+				}
+				break;
+			}
+			case RTCP_RTPFB: {
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(!sender_found) {
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+					sender_found = TRUE;
+				}
+				if(!receiver_found && janus_rtcp_check_fci(rtcp, total, 4)) {
+					summary->receiver_ssrc = ntohl(rtcpfb->media);
+					receiver_found = TRUE;
+				}
+				if(rtcp->rc == 1)
+					summary->has_nacks = TRUE;
+				else if(rtcp->rc == 15)
+					summary->twcc++;
+				break;
+			}
+			case RTCP_PSFB: {
+				janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+				if(!sender_found) {
+					summary->sender_ssrc = ntohl(rtcpfb->ssrc);
+					sender_found = TRUE;
+				}
+				if(rtcp->rc == 1) {
+					summary->has_pli = TRUE;
+				} else if(rtcp->rc == 15 && summary->remb == 0) {
+					janus_rtcp_fb_remb *remb = (janus_rtcp_fb_remb *)rtcpfb->fci;
+					if(janus_rtcp_check_remb(rtcp, total) && remb->id[0] == 'R' && remb->id[1] == 'E' && remb->id[2] == 'M' && remb->id[3] == 'B') {
+						unsigned char *_ptrRTCPData = (unsigned char *)remb;
+						_ptrRTCPData += 4;	/* Skip unique identifier and num ssrc */
+						uint8_t brExp = (_ptrRTCPData[1] >> 2) & 0x3F;
+						uint32_t brMantissa = (_ptrRTCPData[1] & 0x03) << 16;
+						brMantissa += (_ptrRTCPData[2] << 8);
+						brMantissa += (_ptrRTCPData[3]);
+						summary->remb = (uint64_t)brMantissa << brExp;
+					}
+				}
+				break;
+			}
+			case RTCP_XR: {
+				janus_rtcp_xr *xr = (janus_rtcp_xr *)rtcp;
+				if(!sender_found) {
+					summary->sender_ssrc = ntohl(xr->ssrc);
+					sender_found = TRUE;
+				}
+				break;
+			}
+			case RTCP_FIR:
+				summary->has_fir = TRUE;
+				break;
+			case RTCP_BYE:
+				summary->has_bye = TRUE;
+				break;
+			default:
+				break;
+		}
+		/* Is this a compound packet? */
+		int length = ntohs(rtcp->length);
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return 0;
+}
+
 void janus_rtcp_swap_report_blocks(char *packet, int len, uint32_t rtx_ssrc) {
 	if(packet == NULL || len == 0)
 		return;
@@ -226,9 +341,11 @@ static void janus_rtcp_incoming_sr(janus_rtcp_context *ctx, janus_rtcp_sr *sr) {
 	ctx->lsr = (ntp >> 16);
 }
 
-/* Helper to handle an incoming transport-cc feedback: triggered by a call to janus_rtcp_fix_ssrc a valid context pointer */
-static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp_fb *twcc, int total) {
-	if(ctx == NULL || twcc == NULL || total < 20)
+/* Helper to handle an incoming transport-cc feedback: triggered by a call to janus_rtcp_fix_ssrc a valid context pointer,
+ * or by janus_rtcp_get_transport_cc, in which case the callback is invoked for each packet in the feedback */
+static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp_fb *twcc, int total,
+		janus_rtcp_transport_cc_cb callback, gpointer user_data) {
+	if((ctx == NULL && callback == NULL) || twcc == NULL || total < 20)
 		return;
 	if(!janus_rtcp_check_fci((janus_rtcp_header *)twcc, total, 4))
 		return;
@@ -302,16 +419,21 @@ static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp
 	num = 0;
 	uint16_t delta = 0;
 	uint32_t delta_us = 0;
+	/* The reference time is a signed 24-bit value, in multiples of 64ms */
+	gint64 arrival = (gint64)((reference & 0x800000) ? (gint32)reference - 0x1000000 : (gint32)reference) * 64000;
 	GList *iter = list;
-	while(iter != NULL && total > 0) {
+	while(iter != NULL) {
 		num++;
 		delta = 0;
 		s = GPOINTER_TO_UINT(iter->data);
 		if(s == janus_rtp_packet_status_smalldelta) {
 			/* Small delta = 1 byte */
+			if(total < 1)
+				break;
 			delta = *data;
 			total--;
 			data++;
+			arrival += delta*250;
 		} else if(s == janus_rtp_packet_status_largeornegativedelta) {
 			/* Large or negative delta = 2 bytes */
 			if(total < 2)
@@ -320,11 +442,16 @@ static void janus_rtcp_incoming_transport_cc(janus_rtcp_context *ctx, janus_rtcp
 			delta = ntohs(delta);
 			total -= 2;
 			data += 2;
+			arrival += (int16_t)delta*250;
 		}
 		delta_us = delta*250;
 		/* Print summary */
 		JANUS_LOG(LOG_HUGE, "  [%02"SCNu16"][%"SCNu16"] %s (%"SCNu32"us)\n", num, (uint16_t)(base_seq+num-1),
 			janus_rtp_packet_status_description(s), delta_us);
+		if(callback != NULL) {
+			gboolean received = (s == janus_rtp_packet_status_smalldelta || s == janus_rtp_packet_status_largeornegativedelta);
+			callback((uint16_t)(base_seq+num-1), received ? arrival : -1, user_data);
+		}
 		iter = iter->next;
 	}
 	/* TODO Update the context with the feedback we got */
@@ -648,7 +775,7 @@ int janus_rtcp_fix_ssrc(janus_rtcp_context *ctx, char *packet, int len, int fixs
 					}
 				} else if(fmt == 15) {	/* transport-cc */
 					/* If an RTCP context was provided, parse this transport-cc feedback */
-					janus_rtcp_incoming_transport_cc(ctx, rtcpfb, total);
+					janus_rtcp_incoming_transport_cc(ctx, rtcpfb, total, NULL, NULL);
 				} else {
 					JANUS_LOG(LOG_HUGE, "     #%d ??? -- RTPFB (205, fmt=%d)\n", pno, fmt);
 				}
@@ -1265,6 +1392,53 @@ GSList *janus_rtcp_get_nacks(char *packet, int len) {
 	return list;
 }
 
+int janus_rtcp_get_nacks_array(char *packet, int len, guint16 *seqs, guint max) {
+	if(packet == NULL || len == 0 || seqs == NULL || max == 0)
+		return 0;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	guint count = 0;
+	int total = len;
+	while(rtcp) {
+		if(!janus_rtcp_check_len(rtcp, total))
+			return -1;
+		if(rtcp->version != 2)
+			return -1;
+		if(rtcp->type == RTCP_RTPFB && rtcp->rc == 1) {
+			/* NACK FCI size is 4 bytes */
+			if(!janus_rtcp_check_fci(rtcp, total, 4))
+				return -1;
+			janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+			int nacks = ntohs(rtcp->length)-2;	/* Skip SSRCs */
+			int i = 0, j = 0;
+			for(i=0; i<nacks; i++) {
+				janus_rtcp_nack *nack = (janus_rtcp_nack *)rtcpfb->fci + i;
+				uint16_t pid = ntohs(nack->pid);
+				uint16_t blp = ntohs(nack->blp);
+				if(count == max)
+					return count;
+				seqs[count++] = pid;
+				for(j=0; j<16; j++) {
+					if(!(blp & (1 << j)))
+						continue;
+					if(count == max)
+						return count;
+					seqs[count++] = pid+j+1;
+				}
+			}
+			break;
+		}
+		/* Is this a compound packet? */
+		int length = ntohs(rtcp->length);
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return count;
+}
+
 int janus_rtcp_remove_nacks(char *packet, int len) {
 	if(packet == NULL || len == 0)
 		return len;
@@ -1363,6 +1537,33 @@ uint32_t janus_rtcp_get_remb(char *packet, int len) {
 	return 0;
 }
 
+int janus_rtcp_get_transport_cc(char *packet, int len, janus_rtcp_transport_cc_cb callback, gpointer user_data) {
+	if(packet == NULL || len == 0 || callback == NULL)
+		return 0;
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	/* Look for transport-wide CC feedback */
+	int total = len, found = 0;
+	while(rtcp) {
+		if (!janus_rtcp_check_len(rtcp, total))
+			break;
+		if(rtcp->version != 2)
+			break;
+		if(rtcp->type == RTCP_RTPFB && rtcp->rc == 15) {
+			janus_rtcp_incoming_transport_cc(NULL, (janus_rtcp_fb *)rtcp, total, callback, user_data);
+			found++;
+		}
+		/* Is this a compound packet? */
+		int length = ntohs(rtcp->length);
+		if(length == 0)
+			break;
+		total -= length*4+4;
+		if(total <= 0)
+			break;
+		rtcp = (janus_rtcp_header *)((uint32_t*)rtcp + length + 1);
+	}
+	return found;
+}
+
 /* Change an existing REMB message */
 int janus_rtcp_cap_remb(char *packet, int len, uint32_t bitrate) {
 	if(packet == NULL || len == 0)
@@ -1586,8 +1787,50 @@ int janus_rtcp_nacks(char *packet, int len, GSList *nacks) {
 	return words*4+4;
 }
 
-int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats) {
-	if(packet == NULL || size < sizeof(janus_rtcp_header) || transport_wide_cc_stats == NULL || g_queue_is_empty(transport_wide_cc_stats))
+int janus_rtcp_nacks_array(char *packet, int len, const guint16 *seqs, guint count) {
+	if(packet == NULL || len < 16 || seqs == NULL || count == 0)
+		return -1;
+	memset(packet, 0, len);
+	janus_rtcp_header *rtcp = (janus_rtcp_header *)packet;
+	/* Set header */
+	rtcp->version = 2;
+	rtcp->type = RTCP_RTPFB;
+	rtcp->rc = 1;	/* FMT=1 */
+	/* Now set NACK stuff: we assume the sequence numbers are ordered */
+	janus_rtcp_fb *rtcpfb = (janus_rtcp_fb *)rtcp;
+	janus_rtcp_nack *nack = (janus_rtcp_nack *)rtcpfb->fci;
+	guint16 pid = seqs[0], blp = 0;
+	int words = 3;
+	guint i = 0;
+	for(i=1; i<count; i++) {
+		int16_t diff = (int16_t)(seqs[i] - pid);
+		if(diff < 1) {
+			JANUS_LOG(LOG_HUGE, "Skipping PID to NACK (%"SCNu16" already added)...\n", seqs[i]);
+		} else if(diff > 16) {
+			/* We need a new block: this sequence number will be its root PID */
+			nack->pid = htons(pid);
+			nack->blp = htons(blp);
+			words++;
+			if(len < (words*4+4)) {
+				JANUS_LOG(LOG_ERR, "Buffer too small: %d < %d (at least %d NACK blocks needed)\n", len, words*4+4, words);
+				return -1;
+			}
+			nack = (janus_rtcp_nack *)(packet + words*4);
+			pid = seqs[i];
+			blp = 0;
+		} else {
+			blp |= 1 << (diff-1);
+		}
+	}
+	nack->pid = htons(pid);
+	nack->blp = htons(blp);
+	rtcp->length = htons(words);
+	return words*4+4;
+}
+
+int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssrc, guint32 media, guint8 feedback_packet_count,
+		guint16 base_seq_num, const guint64 *timestamps, guint count) {
+	if(packet == NULL || size < sizeof(janus_rtcp_header) || timestamps == NULL || count == 0 || count > JANUS_RTCP_TWCC_MAX_PACKETS)
 		return -1;
 
 	memset(packet, 0, size);
@@ -1601,13 +1844,10 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	rtcpfb->ssrc = htonl(ssrc);
 	rtcpfb->media = htonl(media);
 
-	/* Get first packet */
-	janus_rtcp_transport_wide_cc_stats *stat = (janus_rtcp_transport_wide_cc_stats *) g_queue_pop_head (transport_wide_cc_stats);
 	/* Calculate temporal info */
-	guint16 base_seq_num = stat->transport_seq_num;
 	gboolean first_received	= FALSE;
 	guint64 reference_time = 0;
-	guint packet_status_count = g_queue_get_length(transport_wide_cc_stats) + 1;
+	guint packet_status_count = count;
 
 	/*
 		0                   1                   2                   3
@@ -1638,25 +1878,29 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	guint64 timestamp = 0;
 
 	/* Store delta array */
-	GQueue *deltas = g_queue_new();
+	gint deltas[JANUS_RTCP_TWCC_MAX_PACKETS];
+	guint deltas_count = 0;
 	GQueue *statuses = g_queue_new();
 	janus_rtp_packet_status last_status = janus_rtp_packet_status_reserved;
 	janus_rtp_packet_status max_status = janus_rtp_packet_status_notreceived;
 	gboolean all_same = TRUE;
 
 	/* For each packet  */
-	while (stat != NULL) {
+	guint n = 0;
+	for (n=0; n<count; n++) {
 		janus_rtp_packet_status status = janus_rtp_packet_status_notreceived;
+		/* A zero timestamp means the packet was not received */
+		guint64 received = timestamps[n];
 
 		/* If got packet */
-		if (stat->timestamp) {
+		if (received) {
 			int delta = 0;
 			/* If first received */
 			if (!first_received) {
 				/* Got it  */
 				first_received = TRUE;
 				/* Set it */
-				reference_time = stat->timestamp / 64000;
+				reference_time = received / 64000;
 				/* Get initial time */
 				timestamp = reference_time * 64000;
 				/* also in buffer */
@@ -1665,10 +1909,10 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 			}
 
 			/* Get delta */
-			if (stat->timestamp>timestamp)
-				delta = (stat->timestamp-timestamp)/250;
+			if (received>timestamp)
+				delta = (received-timestamp)/250;
 			else
-				delta = -(int)((timestamp-stat->timestamp)/250);
+				delta = -(int)((timestamp-received)/250);
 			/* If it is negative or too big */
 			if (delta<0 || delta> 255) {
 				/* Big one */
@@ -1679,9 +1923,9 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 			}
 			/* Store delta */
 			/* Overflows are possible here */
-			g_queue_push_tail(deltas, GINT_TO_POINTER(delta));
+			deltas[deltas_count++] = delta;
 			/* Set last time */
-			timestamp = stat->timestamp;
+			timestamp = received;
 		}
 
 		/* Check if all previoues ones were equal and this one the first different */
@@ -1806,11 +2050,6 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 				all_same = TRUE;
 			}
 		}
-		/* Free mem */
-		g_free(stat);
-
-		/* Get next packet stat */
-		stat = (janus_rtcp_transport_wide_cc_stats *) g_queue_pop_head (transport_wide_cc_stats);
 	}
 
 	/* Get status len */
@@ -1868,9 +2107,9 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 	}
 
 	/* Write now the deltas */
-	while (!g_queue_is_empty(deltas)) {
+	for (n=0; n<deltas_count; n++) {
 		/* Get next delta */
-		gint delta = GPOINTER_TO_INT(g_queue_pop_head (deltas));
+		gint delta = deltas[n];
 		/* Check size */
 		if (delta<0 || delta>255) {
 			short reported_delta = (short)delta;
@@ -1893,7 +2132,6 @@ int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t size, guint32 ssr
 
 	/* Clean mem */
 	g_queue_free(statuses);
-	g_queue_free(deltas);
 
 	/* Add zero padding */
 	while (len%4) {
@@ -332,6 +332,33 @@ uint32_t janus_rtcp_context_get_out_media_link_quality(janus_rtcp_context *ctx);
  * @param[in] rtx_ssrc The rtx SSRC
  * @returns The receiver SSRC, or 0 in case of error */
 void janus_rtcp_swap_report_blocks(char *packet, int len, uint32_t rtx_ssrc);
+/*! \brief Summary of the content of an RTCP compound packet, obtained with a single traversal */
+typedef struct janus_rtcp_summary {
+	/*! \brief Sender SSRC (same as janus_rtcp_get_sender_ssrc) */
+	guint32 sender_ssrc;
+	/*! \brief Receiver SSRC (same as janus_rtcp_get_receiver_ssrc) */
+	guint32 receiver_ssrc;
+	/*! \brief Number of messages in the compound packet */
+	guint messages;
+	/*! \brief Number of SR and RR messages */
+	guint sr, rr;
+	/*! \brief Total number of report blocks in SR and RR messages */
+	guint report_blocks;
+	/*! \brief Whether there's a BYE, a PLI, a FIR (same as janus_rtcp_has_fir) or any NACK */
+	gboolean has_bye, has_pli, has_fir, has_nacks;
+	/*! \brief Number of transport-wide CC feedback messages */
+	guint twcc;
+	/*! \brief REMB bitrate, if any (0 otherwise) */
+	uint32_t remb;
+} janus_rtcp_summary;
+/*! \brief Method to get a summary of an RTCP compound packet, as a faster alternative to
+ * calling several helpers (e.g., janus_rtcp_has_pli and janus_rtcp_get_remb) that each
+ * traverse the packet on their own: the packet is not modified
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] summary The janus_rtcp_summary instance to fill
+ * @returns 0 in case of success, -1 in case of invalid arguments */
+int janus_rtcp_summarize(char *packet, int len, janus_rtcp_summary *summary);
 /*! \brief Method to quickly retrieve the sender SSRC (needed for demuxing RTCP in BUNDLE)
  * @param[in] packet The message data
  * @param[in] len The message data length in bytes
@@ -456,6 +483,14 @@ gboolean janus_rtcp_has_pli(char *packet, int len);
  * @returns A list of janus_nack elements containing the sequence numbers to send again */
 GSList *janus_rtcp_get_nacks(char *packet, int len);
 
+/*! \brief Method to parse an RTCP NACK message, without allocating anything
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[out] seqs Array to fill with the sequence numbers to send again
+ * @param[in] max Size of the array
+ * @returns The number of sequence numbers added to the array, or -1 on errors */
+int janus_rtcp_get_nacks_array(char *packet, int len, guint16 *seqs, guint max);
+
 /*! \brief Method to remove an RTCP NACK message
  * @param[in] packet The message data
  * @param[in] len The message data length in bytes
@@ -466,6 +501,21 @@ GSList *janus_rtcp_get_nacks(char *packet, int len);
  * have been handled. */
 int janus_rtcp_remove_nacks(char *packet, int len);
 
+/*! \brief Callback invoked for each packet reported in a transport-wide CC feedback message
+ * @param[in] seq The transport-wide sequence number of the packet
+ * @param[in] arrival The arrival time of the packet (in us, relative to the peer's
+ * reference time), or a negative value if the packet was reported as not received
+ * @param[in] user_data The opaque pointer passed to janus_rtcp_get_transport_cc */
+typedef void (*janus_rtcp_transport_cc_cb)(guint16 seq, gint64 arrival, gpointer user_data);
+
+/*! \brief Inspect an existing RTCP compound to parse the transport-wide CC feedback it contains, if any
+ * @param[in] packet The message data
+ * @param[in] len The message data length in bytes
+ * @param[in] callback The function to invoke for each packet reported in the feedback
+ * @param[in] user_data An opaque pointer to pass to the callback
+ * @returns The number of transport-wide CC feedback messages that were found */
+int janus_rtcp_get_transport_cc(char *packet, int len, janus_rtcp_transport_cc_cb callback, gpointer user_data);
+
 /*! \brief Inspect an existing RTCP REMB message to retrieve the reported bitrate
  * @param[in] packet The message data
  * @param[in] len The message data length in bytes
@@ -530,14 +580,29 @@ int janus_rtcp_pli(char *packet, int len);
  * @returns The message data length in bytes, if successful, -1 on errors */
 int janus_rtcp_nacks(char *packet, int len, GSList *nacks);
 
+/*! \brief Method to generate a new RTCP NACK message from an array of lost packets
+ * @param[in] packet The buffer data (MUST be at least 16 chars)
+ * @param[in] len The buffer data length in bytes
+ * @param[in] seqs Ordered array of the sequence numbers to NACK
+ * @param[in] count Number of sequence numbers in the array
+ * @returns The message data length in bytes, if successful, -1 on errors */
+int janus_rtcp_nacks_array(char *packet, int len, const guint16 *seqs, guint count);
+
+/*! \brief Maximum number of packets a single transport wide feedback message can report */
+#define JANUS_RTCP_TWCC_MAX_PACKETS	400
+
 /*! \brief Method to generate a new RTCP transport wide message to report reception stats
  * @param[in] packet The buffer data (MUST be at least 16 chars)
  * @param[in] len The message data length in bytes
  * @param[in] ssrc SSRC of the origin stream
  * @param[in] media SSRC of the destination stream
  * @param[in] feedback_packet_count Feedback paccket count
- * @param[in] transport_wide_cc_stats List of rtp packet reception stats
+ * @param[in] base_seq_num Transport wide sequence number of the first packet to report
+ * @param[in] timestamps Reception times (in microseconds) of the consecutive packets
+ * to report, starting from base_seq_num, where 0 means the packet was not received
+ * @param[in] count Number of packets to report (at most JANUS_RTCP_TWCC_MAX_PACKETS)
  * @returns The message data length in bytes, if successful, -1 on errors */
-int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count, GQueue *transport_wide_cc_stats);
+int janus_rtcp_transport_wide_cc_feedback(char *packet, size_t len, guint32 ssrc, guint32 media, guint8 feedback_packet_count,
+	guint16 base_seq_num, const guint64 *timestamps, guint count);
 
 #endif
@@ -210,6 +210,122 @@ static int janus_rtp_header_extension_find(char *buf, int len, int id,
 	return -1;
 }
 
+/* Static helper to copy a mid/rid extension to a string */
+static void janus_rtp_header_extension_copy_sdes(char *dst, size_t size, const char *ext, uint8_t idlen) {
+	if(idlen > size-1)
+		idlen = size-1;
+	memcpy(dst, ext, idlen);
+	dst[idlen] = '\0';
+}
+
+/* Static helper to decode a single extension we found in the block */
+static gboolean janus_rtp_header_extension_decode(const janus_rtp_extension_ids *ids, int id,
+		const char *ext, uint8_t idlen, janus_plugin_rtp_extensions *extensions) {
+	if(id == ids->audio_level && idlen >= 1) {
+		/* a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level */
+		uint8_t byte = (uint8_t)ext[0];
+		extensions->audio_level = byte & 0x7F;
+		extensions->audio_level_vad = (byte & 0x80) >> 7;
+	} else if(id == ids->video_orientation && idlen >= 1) {
+		/* a=extmap:4 urn:3gpp:video-orientation */
+		uint8_t byte = (uint8_t)ext[0];
+		gboolean r1 = (byte & 0x02) >> 1, r0 = byte & 0x01;
+		extensions->video_rotation = (r1 && r0) ? 270 : (r1 ? 180 : (r0 ? 90 : 0));
+		extensions->video_back_camera = (byte & 0x08) >> 3;
+		extensions->video_flipped = (byte & 0x04) >> 2;
+	} else if(id == ids->playout_delay && idlen >= 3) {
+		/* a=extmap:6 http://www.webrtc.org/experiments/rtp-hdrext/playout-delay */
+		const uint8_t *bytes = (const uint8_t *)ext;
+		extensions->min_delay = (bytes[0] << 4) | (bytes[1] >> 4);
+		extensions->max_delay = ((bytes[1] & 0x0F) << 8) | bytes[2];
+	} else if(id == ids->mid && idlen >= 1) {
+		/* a=extmap:3 urn:ietf:params:rtp-hdrext:sdes:mid */
+		janus_rtp_header_extension_copy_sdes(extensions->mid, sizeof(extensions->mid), ext, idlen);
+	} else if(id == ids->rid && idlen >= 1) {
+		/* a=extmap:4 urn:ietf:params:rtp-hdrext:sdes:rtp-stream-id */
+		janus_rtp_header_extension_copy_sdes(extensions->rid, sizeof(extensions->rid), ext, idlen);
+	} else if(id == ids->repaired_rid && idlen >= 1) {
+		/* a=extmap:5 urn:ietf:params:rtp-hdrext:sdes:repaired-rtp-stream-id */
+		janus_rtp_header_extension_copy_sdes(extensions->repaired_rid, sizeof(extensions->repaired_rid), ext, idlen);
+	} else if(id == ids->transport_wide_cc && idlen >= 2) {
+		/* a=extmap:5 http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01 */
+		uint16_t seq = 0;
+		memcpy(&seq, ext, sizeof(uint16_t));
+		extensions->transport_seq_num = ntohs(seq);
+	} else if(id == ids->abs_send_time && idlen >= 3) {
+		/* a=extmap:4 http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time */
+		const uint8_t *bytes = (const uint8_t *)ext;
+		extensions->abs_send_time = (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+	} else if(id == ids->dependency_desc && idlen >= 1) {
+		/* a=extmap:10 https://aomediacodec.github.io/av1-rtp-spec/#dependency-descriptor-rtp-header-extension */
+		/* The length can't exceed 255 bytes, so the content always fits */
+		memcpy(extensions->dd_content, ext, idlen);
+		extensions->dd_len = idlen;
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+int janus_rtp_header_extensions_parse(char *buf, int len, const janus_rtp_extension_ids *ids,
+		janus_plugin_rtp_extensions *extensions) {
+	if(!buf || len < 12 || ids == NULL || extensions == NULL)
+		return -1;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	if(rtp->version != 2)
+		return -2;
+	int hlen = 12;
+	if(rtp->csrccount)	/* Skip CSRC if needed */
+		hlen += rtp->csrccount*4;
+	if(!rtp->extension || len <= hlen + (int)sizeof(janus_rtp_header_extension))
+		return 0;
+	janus_rtp_header_extension *ext = (janus_rtp_header_extension *)(buf+hlen);
+	int extlen = ntohs(ext->length)*4;
+	hlen += 4;
+	if(len <= (hlen + extlen))
+		return 0;
+	uint16_t type = ntohs(ext->type);
+	if(type != 0xBEDE && type != 0x1000)
+		return 0;
+	gboolean one_byte = (type == 0xBEDE);
+	const char *block = buf+hlen;
+	int i = 0, found = 0, extid = 0;
+	uint8_t idlen = 0;
+	while(i < extlen) {
+		if(one_byte) {
+			/* 1-Byte extension */
+			extid = (uint8_t)block[i] >> 4;
+			if(extid == 0xF)
+				break;
+			if(extid == 0) {
+				/* Padding */
+				i++;
+				continue;
+			}
+			idlen = ((uint8_t)block[i] & 0xF)+1;
+			i++;
+		} else {
+			/* 2-Byte extension */
+			extid = (uint8_t)block[i];
+			if(extid == 0) {
+				/* Padding */
+				i++;
+				continue;
+			}
+			if((extlen-i) < 2)
+				break;
+			idlen = (uint8_t)block[i+1];
+			i += 2;
+		}
+		if(i+idlen > extlen)
+			break;
+		if(janus_rtp_header_extension_decode(ids, extid, block+i, idlen, extensions))
+			found++;
+		i += idlen;
+	}
+	return found;
+}
+
 int janus_rtp_header_extension_parse_audio_level(char *buf, int len, int id, gboolean *vad, int *level) {
 	uint8_t byte = 0, idlen = 0;
 	if(janus_rtp_header_extension_find(buf, len, id, &byte, NULL, NULL, &idlen) < 0)
@@ -494,10 +610,15 @@ void janus_rtp_switching_context_reset(janus_rtp_switching_context *context) {
 	memset(context, 0, sizeof(*context));
 }
 
-int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
+/* Audio and video skew compensation only differ in the clock rate (in kHz)
+ * and the threshold: the time of arrival is provided by the caller, which
+ * usually reads the clock once for a whole batch of packets, and the
+ * estimate only needs integer arithmetic */
+static int janus_rtp_skew_compensate(janus_rtp_header *header, janus_rtp_switching_context *context,
+		gint64 now, guint32 khz, gint32 threshold_ms, const char *kind) {
 	/* Reset values if a new ssrc has been detected */
-	if(context->new_ssrc) {
-		JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" resetting status\n", context->last_ssrc);
+	if(G_UNLIKELY(context->new_ssrc)) {
+		JANUS_LOG(LOG_VERB, "%s skew SSRC=%"SCNu32" resetting status\n", kind, context->last_ssrc);
 		context->reference_time = now;
 		context->start_time = 0;
 		context->evaluating_start_time = 0;
@@ -510,16 +631,16 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
 		context->new_ssrc = FALSE;
 	}
 
-	/* N 	: a N sequence number jump has been performed */
+	/* N 	: a N sequence numbers jump has been performed */
 	/* 0  	: any new skew compensation has been applied */
-	/* -N  	: a N packet drop must be performed */
+	/* -N  	: a N packets drop must be performed */
 	int exit_status = 0;
 
 	/* Do not execute skew analysis in the first seconds */
 	if(now-context->reference_time < SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
 		return 0;
-	} else if(!context->start_time) {
-		JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase start\n", context->last_ssrc);
+	} else if(G_UNLIKELY(!context->start_time)) {
+		JANUS_LOG(LOG_VERB, "%s skew SSRC=%"SCNu32" evaluation phase start\n", kind, context->last_ssrc);
 		context->start_time = now;
 		context->evaluating_start_time = now;
 		context->start_ts = context->last_ts;
@@ -534,12 +655,8 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
 		context->target_ts = 0;
 		/* Do not execute analysis for out of order packets or multi-packets frame */
 		if(context->last_seq == context->prev_seq + 1 && context->last_ts != context->prev_ts) {
-			/* Set the sample rate according to the header */
-			guint32 akhz = 48; /* 48khz for Opus */
-			if(header->type == 0 || header->type == 8 || header->type == 9)
-				akhz = 8;
 			/* Evaluate the local RTP timestamp according to the local clock */
-			guint32 expected_ts = ((now - context->start_time)*akhz)/1000 + context->start_ts;
+			guint32 expected_ts = ((now - context->start_time)*khz)/1000 + context->start_ts;
 			/* Evaluate current delay */
 			gint32 delay_now = context->last_ts - expected_ts;
 			/* Exponentially weighted moving average estimation */
@@ -548,22 +665,22 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
 			context->prev_delay = delay_estimate;
 			/* Evaluate the distance between active delay and current delay estimate */
 			gint32 offset = context->active_delay - delay_estimate;
-			JANUS_LOG(LOG_HUGE, "audio skew status SSRC=%"SCNu32" RECVD_TS=%"SCNu32" EXPTD_TS=%"SCNu32" OFFSET=%"SCNi32" TS_OFFSET=%"SCNi32" SEQ_OFFSET=%"SCNi16"\n", context->last_ssrc, context->last_ts, expected_ts, offset, context->ts_offset, context->seq_offset);
-			gint32 skew_th = RTP_AUDIO_SKEW_TH_MS*akhz;
+			JANUS_LOG(LOG_HUGE, "%s skew status SSRC=%"SCNu32" RECVD_TS=%"SCNu32" EXPTD_TS=%"SCNu32" OFFSET=%"SCNi32" TS_OFFSET=%"SCNi32" SEQ_OFFSET=%"SCNi16"\n", kind, context->last_ssrc, context->last_ts, expected_ts, offset, context->ts_offset, context->seq_offset);
+			gint32 skew_th = threshold_ms*khz;
 			/* Evaluation phase */
 			if(context->evaluating_start_time > 0) {
 				/* Check if the offset has surpassed half the threshold during the evaluating phase */
 				if(now-context->evaluating_start_time <= SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
 					if(abs(offset) <= skew_th/2) {
-						JANUS_LOG(LOG_HUGE, "audio skew SSRC=%"SCNu32" evaluation phase continue\n", context->last_ssrc);
+						JANUS_LOG(LOG_HUGE, "%s skew SSRC=%"SCNu32" evaluation phase continue\n", kind, context->last_ssrc);
 					} else {
-						JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase reset\n", context->last_ssrc);
+						JANUS_LOG(LOG_VERB, "%s skew SSRC=%"SCNu32" evaluation phase reset\n", kind, context->last_ssrc);
 						context->start_time = now;
 						context->evaluating_start_time = now;
 						context->start_ts = context->last_ts;
 					}
 				} else {
-					JANUS_LOG(LOG_VERB, "audio skew SSRC=%"SCNu32" evaluation phase stop\n", context->last_ssrc);
+					JANUS_LOG(LOG_VERB, "%s skew SSRC=%"SCNu32" evaluation phase stop\n", kind, context->last_ssrc);
 					context->evaluating_start_time = 0;
 				}
 				return 0;
@@ -590,7 +707,7 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
 				context->ts_offset -= skew_th;
 				/* Set target ts */
 				context->target_ts = context->last_ts + skew_th;
-				if (context->target_ts == 0)
+				if(context->target_ts == 0)
 					context->target_ts = 1;
 				/* Adjust seq num offset */
 				context->seq_offset--;
@@ -610,118 +727,15 @@ int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switchin
 	return exit_status;
 }
 
-int janus_rtp_skew_compensate_video(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
-	/* Reset values if a new ssrc has been detected */
-	if(context->new_ssrc) {
-		JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" resetting status\n", context->last_ssrc);
-		context->reference_time = now;
-		context->start_time = 0;
-		context->evaluating_start_time = 0;
-		context->start_ts = 0;
-		context->active_delay = 0;
-		context->prev_delay = 0;
-		context->seq_offset = 0;
-		context->ts_offset = 0;
-		context->target_ts = 0;
-		context->new_ssrc = FALSE;
-	}
-
-	/* N 	: a N sequence numbers jump has been performed */
-	/* 0  	: any new skew compensation has been applied */
-	/* -N  	: a N packets drop must be performed */
-	int exit_status = 0;
-
-	/* Do not execute skew analysis in the first seconds */
-	if(now-context->reference_time < SKEW_DETECTION_WAIT_TIME_SECS/2 *G_USEC_PER_SEC) {
-		return 0;
-	} else if(!context->start_time) {
-		JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase start\n", context->last_ssrc);
-		context->start_time = now;
-		context->evaluating_start_time = now;
-		context->start_ts = context->last_ts;
-	}
-
-	/* Skew analysis */
-	/* Are we waiting for a target timestamp? (a negative skew has been evaluated in a previous iteration) */
-	if(context->target_ts > 0 && (gint32)(context->target_ts - context->last_ts) > 0) {
-		context->seq_offset--;
-		exit_status = -1;
-	} else {
-		context->target_ts = 0;
-		/* Do not execute analysis for out of order packets or multi-packets frame */
-		if(context->last_seq == context->prev_seq + 1 && context->last_ts != context->prev_ts) {
-			/* Set the sample rate */
-			guint32 vkhz = 90; /* 90khz */
-			/* Evaluate the local RTP timestamp according to the local clock */
-			guint32 expected_ts = ((now - context->start_time)*vkhz)/1000 + context->start_ts;
-			/* Evaluate current delay */
-			gint32 delay_now = context->last_ts - expected_ts;
-			/* Exponentially weighted moving average estimation */
-			gint32 delay_estimate = (63*context->prev_delay + delay_now)/64;
-			/* Save previous delay for the next iteration*/
-			context->prev_delay = delay_estimate;
-			/* Evaluate the distance between active delay and current delay estimate */
-			gint32 offset = context->active_delay - delay_estimate;
-			JANUS_LOG(LOG_HUGE, "video skew status SSRC=%"SCNu32" RECVD_TS=%"SCNu32" EXPTD_TS=%"SCNu32" OFFSET=%"SCNi32" TS_OFFSET=%"SCNi32" SEQ_OFFSET=%"SCNi16"\n", context->last_ssrc, context->last_ts, expected_ts, offset, context->ts_offset, context->seq_offset);
-			gint32 skew_th = RTP_VIDEO_SKEW_TH_MS*vkhz;
-			/* Evaluation phase */
-			if(context->evaluating_start_time > 0) {
-				/* Check if the offset has surpassed half the threshold during the evaluating phase */
-				if(now-context->evaluating_start_time <= SKEW_DETECTION_WAIT_TIME_SECS/2 * G_USEC_PER_SEC) {
-					if(abs(offset) <= skew_th/2) {
-						JANUS_LOG(LOG_HUGE, "video skew SSRC=%"SCNu32" evaluation phase continue\n", context->last_ssrc);
-					} else {
-						JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase reset\n", context->last_ssrc);
-						context->start_time = now;
-						context->evaluating_start_time = now;
-						context->start_ts = context->last_ts;
-					}
-				} else {
-					JANUS_LOG(LOG_VERB, "video skew SSRC=%"SCNu32" evaluation phase stop\n", context->last_ssrc);
-					context->evaluating_start_time = 0;
-				}
-				return 0;
-			}
-			/* Check if the offset has surpassed the threshold */
-			if(offset >= skew_th) {
-				/* The source is slowing down */
-				/* Update active delay */
-				context->active_delay = delay_estimate;
-				/* Adjust ts offset */
-				context->ts_offset += skew_th;
-				/* Calculate last ts increase */
-				guint32 ts_incr = context->last_ts-context->prev_ts;
-				/* Evaluate sequence number jump */
-				guint16 jump = (skew_th+ts_incr-1)/ts_incr;
-				/* Adjust seq num offset */
-				context->seq_offset += jump;
-				exit_status = jump;
-			} else if(offset <= -skew_th) {
-				/* The source is speeding up*/
-				/* Update active delay */
-				context->active_delay = delay_estimate;
-				/* Adjust ts offset */
-				context->ts_offset -= skew_th;
-				/* Set target ts */
-				context->target_ts = context->last_ts + skew_th;
-				if(context->target_ts == 0)
-					context->target_ts = 1;
-				/* Adjust seq num offset */
-				context->seq_offset--;
-				exit_status = -1;
-			}
-		}
-	}
-
-	/* Skew compensation */
-	/* Fix header timestamp considering the active offset */
-	guint32 fixed_rtp_ts = context->last_ts + context->ts_offset;
-	header->timestamp = htonl(fixed_rtp_ts);
-	/* Fix header sequence number considering the total offset */
-	guint16 fixed_rtp_seq = context->last_seq + context->seq_offset;
-	header->seq_number = htons(fixed_rtp_seq);
+int janus_rtp_skew_compensate_audio(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
+	/* 48khz for Opus, 8khz for G.711 and G.722 */
+	guint32 akhz = (header->type == 0 || header->type == 8 || header->type == 9) ? 8 : 48;
+	return janus_rtp_skew_compensate(header, context, now, akhz, RTP_AUDIO_SKEW_TH_MS, "audio");
+}
 
-	return exit_status;
+int janus_rtp_skew_compensate_video(janus_rtp_header *header, janus_rtp_switching_context *context, gint64 now) {
+	/* 90khz */
+	return janus_rtp_skew_compensate(header, context, now, 90, RTP_VIDEO_SKEW_TH_MS, "video");
 }
 
 void janus_rtp_header_update(janus_rtp_header *header, janus_rtp_switching_context *context, gboolean video, int step) {
@@ -1083,10 +1097,15 @@ void janus_rtp_simulcasting_cleanup(int *rid_ext_id, uint32_t *ssrcs, char **rid
 		janus_mutex_unlock(rid_mutex);
 }
 
-gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
-		char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
-		janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex) {
-	if(!context || !buf || len < 1)
+gboolean janus_rtp_simulcasting_packet_parse(janus_rtp_simulcasting_packet *packet,
+		char *buf, int len, int rid_ext_id, uint32_t *ssrcs, char **rids,
+		janus_videocodec vcodec, janus_mutex *rid_mutex) {
+	if(!packet)
+		return FALSE;
+	memset(packet, 0, sizeof(*packet));
+	packet->substream = -1;
+	packet->temporal = -1;
+	if(!buf || len < 1)
 		return FALSE;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
 	uint32_t ssrc = ntohl(header->ssrc);
@@ -1099,10 +1118,10 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 		substream = 2;
 	} else {
 		/* We don't recognize this SSRC, check if rid can help us */
-		if(context->rid_ext_id < 1 || rids == NULL)
+		if(rid_ext_id < 1 || rids == NULL)
 			return FALSE;
 		char sdes_item[16];
-		if(janus_rtp_header_extension_parse_rid(buf, len, context->rid_ext_id, sdes_item, sizeof(sdes_item)) != 0)
+		if(janus_rtp_header_extension_parse_rid(buf, len, rid_ext_id, sdes_item, sizeof(sdes_item)) != 0)
 			return FALSE;
 		if(rid_mutex != NULL)
 			janus_mutex_lock(rid_mutex);
@@ -1126,16 +1145,73 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 			return FALSE;
 		}
 	}
+	packet->substream = substream;
+	/* Access the packet payload */
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return TRUE;
+	packet->payload = TRUE;
+	packet->keyframe = (vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
+		(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
+		(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
+		(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
+		(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen));
+	/* Temporal layers are only easily available for some codecs */
+	if(vcodec == JANUS_VIDEOCODEC_VP8) {
+		gboolean m = FALSE;
+		uint16_t picid = 0;
+		uint8_t tlzi = 0, tid = 0, ybit = 0, keyidx = 0;
+		if(janus_vp8_parse_descriptor(payload, plen, &m, &picid, &tlzi, &tid, &ybit, &keyidx) == 0)
+			packet->temporal = tid;
+	} else if(vcodec == JANUS_VIDEOCODEC_VP9) {
+		gboolean found = FALSE;
+		janus_vp9_svc_info svc_info = { 0 };
+		if(janus_vp9_parse_svc(payload, plen, &found, &svc_info) == 0 && found) {
+			packet->temporal = svc_info.temporal_layer;
+			packet->ubit = svc_info.ubit;
+			packet->bbit = svc_info.bbit;
+			packet->ebit = svc_info.ebit;
+		}
+	}
+	return TRUE;
+}
+
+gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
+		char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
+		janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex) {
+	if(!context || !buf || len < 1)
+		return FALSE;
+	janus_rtp_simulcasting_packet packet;
+	if(!janus_rtp_simulcasting_packet_parse(&packet, buf, len, context->rid_ext_id, ssrcs, rids, vcodec, rid_mutex))
+		return FALSE;
+	return janus_rtp_simulcasting_context_process_packet(context, &packet,
+		buf, len, dd_content, dd_len, ssrcs, vcodec, sc);
+}
+
+gboolean janus_rtp_simulcasting_context_process_packet(janus_rtp_simulcasting_context *context,
+		const janus_rtp_simulcasting_packet *packet, char *buf, int len, uint8_t *dd_content, int dd_len,
+		uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc) {
+	if(!context || !packet || !buf || len < 1 || packet->substream == -1)
+		return FALSE;
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	uint32_t ssrc = ntohl(header->ssrc);
+	int substream = packet->substream;
 	/* Reset the flags */
 	context->changed_substream = FALSE;
 	context->changed_temporal = FALSE;
 	context->need_pli = FALSE;
+	if(!packet->payload)
+		return FALSE;
 	gint64 now = janus_get_monotonic_time();
-	/* Access the packet payload */
-	int plen = 0;
-	char *payload = janus_rtp_payload(buf, len, &plen);
-	if(payload == NULL)
+	guint32 drop_trigger = context->drop_trigger ? context->drop_trigger : 250000;
+	if(substream != context->substream && !packet->keyframe && context->substream >= 0 &&
+			context->substream_target_temp == -1 && context->last_relayed != 0 &&
+			(context->substream == 0 || (now - context->last_relayed) <= drop_trigger)) {
+		/* Fast path: this packet is from a substream we're not relaying, it's not
+		 * a keyframe we could switch on, and no timer expired, so just drop it */
 		return FALSE;
+	}
 	/* Check what's our target */
 	if(context->substream_target_temp != -1 && (substream > context->substream_target_temp ||
 			context->substream_target <= context->substream_target_temp)) {
@@ -1147,11 +1223,7 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	int target = (context->substream_target_temp == -1) ? context->substream_target : context->substream_target_temp;
 	/* Check what we need to do with the packet */
 	if(context->substream == -1) {
-		if((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
-				(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen))) {
+		if(packet->keyframe) {
 			context->substream = substream;
 			/* Notify the caller that the substream changed */
 			context->changed_substream = TRUE;
@@ -1163,12 +1235,7 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	} else if(context->substream != target) {
 		/* We're not on the substream we'd like: let's wait for a keyframe on the target */
 		if(((context->substream < target && substream > context->substream) ||
-				(context->substream > target && substream < context->substream)) &&
-					((vcodec == JANUS_VIDEOCODEC_VP8 && janus_vp8_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_VP9 && janus_vp9_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H264 && janus_h264_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_AV1 && janus_av1_is_keyframe(payload, plen)) ||
-					(vcodec == JANUS_VIDEOCODEC_H265 && janus_h265_is_keyframe(payload, plen)))) {
+				(context->substream > target && substream < context->substream)) && packet->keyframe) {
 			JANUS_LOG(LOG_VERB, "Received keyframe on #%d (SSRC %"SCNu32"), switching (was #%d/%"SCNu32")\n",
 				substream, ssrc, context->substream, *(ssrcs + context->substream));
 			context->substream = substream;
@@ -1183,7 +1250,7 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 		context->last_relayed = now;
 	} else if(context->substream > 0) {
 		/* Check if too much time went by with no packet relayed */
-		if((now - context->last_relayed) > (context->drop_trigger ? context->drop_trigger : 250000)) {
+		if((now - context->last_relayed) > drop_trigger) {
 			context->last_relayed = now;
 			if(context->substream != substream && context->substream_target_temp != 0) {
 				if(context->substream_target > substream) {
@@ -1216,14 +1283,8 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 	/* Temporal layers are only easily available for some codecs */
 	if(vcodec == JANUS_VIDEOCODEC_VP8) {
 		/* Check if there's any temporal scalability to take into account */
-		gboolean m = FALSE;
-		uint16_t picid = 0;
-		uint8_t tlzi = 0;
-		uint8_t tid = 0;
-		uint8_t ybit = 0;
-		uint8_t keyidx = 0;
-		if(janus_vp8_parse_descriptor(payload, plen, &m, &picid, &tlzi, &tid, &ybit, &keyidx) == 0) {
-			//~ JANUS_LOG(LOG_WARN, "%"SCNu16", %u, %u, %u, %u\n", picid, tlzi, tid, ybit, keyidx);
+		if(packet->temporal != -1) {
+			int tid = packet->temporal;
 			if(context->templayer != context->templayer_target && tid == context->templayer_target) {
 				/* FIXME We should be smarter in deciding when to switch */
 				context->templayer = context->templayer_target;
@@ -1240,30 +1301,28 @@ gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_conte
 			}
 		}
 	} else if(vcodec == JANUS_VIDEOCODEC_VP9) {
-		/* We use the VP9 SVC parser to extract info on temporal layers */
-		gboolean found = FALSE;
-		janus_vp9_svc_info svc_info = { 0 };
-		if(janus_vp9_parse_svc(payload, plen, &found, &svc_info) == 0 && found) {
+		/* We use what the VP9 SVC parser extracted on temporal layers */
+		if(packet->temporal != -1) {
 			int temporal_layer = context->templayer;
 			if(context->templayer_target > context->templayer) {
 				/* We need to upscale */
-				if(svc_info.ubit && svc_info.bbit &&
-						svc_info.temporal_layer > context->templayer &&
-						svc_info.temporal_layer <= context->templayer_target) {
-					context->templayer = svc_info.temporal_layer;
+				if(packet->ubit && packet->bbit &&
+						packet->temporal > context->templayer &&
+						packet->temporal <= context->templayer_target) {
+					context->templayer = packet->temporal;
 					temporal_layer = context->templayer;
 					context->changed_temporal = TRUE;
 				}
 			} else if(context->templayer_target < context->templayer) {
 				/* We need to downscale */
-				if(svc_info.ebit && svc_info.temporal_layer == context->templayer_target) {
+				if(packet->ebit && packet->temporal == context->templayer_target) {
 					context->templayer = context->templayer_target;
 					context->changed_temporal = TRUE;
 				}
 			}
-			if(temporal_layer < svc_info.temporal_layer) {
+			if(temporal_layer < packet->temporal) {
 				JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
-					svc_info.temporal_layer, context->templayer);
+					packet->temporal, context->templayer);
 				/* We increase the base sequence number, or there will be gaps when delivering later */
 				if(sc)
 					sc->base_seq++;
@@ -1322,122 +1381,127 @@ void janus_rtp_svc_context_reset(janus_rtp_svc_context *context) {
 	context->temporal = -1;
 }
 
-gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
-		char *buf, int len, uint8_t *dd_content, int dd_len,
-		janus_videocodec vcodec, janus_vp9_svc_info *info, janus_rtp_switching_context *sc) {
-	if(!context || !buf || len < 1 || (vcodec != JANUS_VIDEOCODEC_VP9 && vcodec != JANUS_VIDEOCODEC_AV1))
+gboolean janus_rtp_svc_context_process_av1(janus_rtp_svc_context *context,
+		char *buf, int len, const janus_av1_svc_info *info, janus_rtp_switching_context *sc) {
+	if(!context || !buf || len < 1 || !info)
 		return FALSE;
 	janus_rtp_header *header = (janus_rtp_header *)buf;
 	/* Reset the flags */
 	context->changed_spatial = FALSE;
 	context->changed_temporal = FALSE;
 	context->need_pli = FALSE;
-	gint64 now = janus_get_monotonic_time();
-	/* Access the packet payload */
-	int plen = 0;
-	char *payload = janus_rtp_payload(buf, len, &plen);
-	if(payload == NULL)
+	if(!info->payload)
 		return FALSE;
-	/* Check if we should use the Dependency Descriptor */
-	if(vcodec == JANUS_VIDEOCODEC_AV1) {
-		/* We do, make sure the data is there */
-		if(dd_content == NULL || dd_len < 1) {
-			/* No Dependency Descriptor, relay as it is */
-			return TRUE;
-		}
-		uint8_t template = 0, ebit = 0;
-		if(!janus_av1_svc_context_process_dd(&context->dd_context, dd_content, dd_len, &template, &ebit)) {
-			/* We couldn't parse the Dependency Descriptor, relay as it is */
-			return TRUE;
-		}
-		janus_av1_svc_template *t = g_hash_table_lookup(context->dd_context.templates, GUINT_TO_POINTER(template));
-		if(t == NULL) {
-			/* We couldn't find the template, relay as it is */
-			return TRUE;
-		}
-		/* Now let's check if we should let the packet through or not */
-		gboolean keyframe = janus_av1_is_keyframe((const char *)payload, plen);
-		gboolean override_mark_bit = FALSE, has_marker_bit = header->markerbit;
-		int spatial_layer = context->spatial;
-		if(t->spatial >= 0 && t->spatial <= 2)
-			context->last_spatial_layer[t->spatial] = now;
-		if(context->spatial_target > context->spatial) {
-			JANUS_LOG(LOG_HUGE, "We need to upscale spatially: (%d < %d)\n",
-				context->spatial, context->spatial_target);
-			/* We need to upscale: wait for a keyframe */
-			if(keyframe) {
-				int new_spatial_layer = context->spatial_target;
-				while(new_spatial_layer > context->spatial && new_spatial_layer > 0) {
-					if(now - context->last_spatial_layer[new_spatial_layer] >= (context->drop_trigger ? context->drop_trigger : 250000)) {
-						/* We haven't received packets from this layer for a while, try a lower layer */
-						JANUS_LOG(LOG_HUGE, "Haven't received packets from layer %d for a while, trying %d instead...\n",
-							new_spatial_layer, new_spatial_layer-1);
-						new_spatial_layer--;
-					} else {
-						break;
-					}
-				}
-				if(new_spatial_layer > context->spatial) {
-					JANUS_LOG(LOG_HUGE, "  -- Upscaling spatial layer: %d --> %d (need %d)\n",
-						context->spatial, new_spatial_layer, context->spatial_target);
-					context->spatial = new_spatial_layer;
-					spatial_layer = context->spatial;
-					context->changed_spatial = TRUE;
+	if(!info->found) {
+		/* No (valid) Dependency Descriptor, relay as it is */
+		return TRUE;
+	}
+	gint64 now = janus_get_monotonic_time();
+	/* Now let's check if we should let the packet through or not */
+	gboolean override_mark_bit = FALSE, has_marker_bit = header->markerbit;
+	int spatial_layer = context->spatial;
+	if(info->spatial >= 0 && info->spatial <= 2)
+		context->last_spatial_layer[info->spatial] = now;
+	if(context->spatial_target > context->spatial) {
+		JANUS_LOG(LOG_HUGE, "We need to upscale spatially: (%d < %d)\n",
+			context->spatial, context->spatial_target);
+		/* We need to upscale: wait for a keyframe */
+		if(info->keyframe) {
+			int new_spatial_layer = context->spatial_target;
+			while(new_spatial_layer > context->spatial && new_spatial_layer > 0) {
+				if(now - context->last_spatial_layer[new_spatial_layer] >= (context->drop_trigger ? context->drop_trigger : 250000)) {
+					/* We haven't received packets from this layer for a while, try a lower layer */
+					JANUS_LOG(LOG_HUGE, "Haven't received packets from layer %d for a while, trying %d instead...\n",
+						new_spatial_layer, new_spatial_layer-1);
+					new_spatial_layer--;
+				} else {
+					break;
 				}
 			}
-		} else if(context->spatial_target < context->spatial) {
-			/* We need to scale: wait for a keyframe */
-			JANUS_LOG(LOG_HUGE, "We need to downscale spatially: (%d > %d)\n",
-				context->spatial, context->spatial_target);
-			/* Check the E bit to see if this is an end-of-frame */
-			if(ebit) {
-				JANUS_LOG(LOG_HUGE, "  -- Downscaling spatial layer: %d --> %d\n",
-					context->spatial, context->spatial_target);
-				context->spatial = context->spatial_target;
+			if(new_spatial_layer > context->spatial) {
+				JANUS_LOG(LOG_HUGE, "  -- Upscaling spatial layer: %d --> %d (need %d)\n",
+					context->spatial, new_spatial_layer, context->spatial_target);
+				context->spatial = new_spatial_layer;
+				spatial_layer = context->spatial;
 				context->changed_spatial = TRUE;
 			}
 		}
-		if(spatial_layer < t->spatial) {
-			/* Drop the packet: update the context to make sure sequence number is increased normally later */
-			JANUS_LOG(LOG_HUGE, "Dropping packet (spatial layer %d < %d)\n", spatial_layer, t->spatial);
-			if(sc)
-				sc->base_seq++;
-			return FALSE;
-		} else if(ebit && spatial_layer == t->spatial) {
-			/* If we stop at layer 0, we need a marker bit now, as the one from layer 1 will not be received */
-			override_mark_bit = TRUE;
+	} else if(context->spatial_target < context->spatial) {
+		/* We need to scale: wait for a keyframe */
+		JANUS_LOG(LOG_HUGE, "We need to downscale spatially: (%d > %d)\n",
+			context->spatial, context->spatial_target);
+		/* Check the E bit to see if this is an end-of-frame */
+		if(info->ebit) {
+			JANUS_LOG(LOG_HUGE, "  -- Downscaling spatial layer: %d --> %d\n",
+				context->spatial, context->spatial_target);
+			context->spatial = context->spatial_target;
+			context->changed_spatial = TRUE;
 		}
-		int temporal = context->temporal;
-		if(context->temporal_target > context->temporal) {
-			/* We need to upscale */
-			if(t->temporal > context->temporal && t->temporal <= context->temporal_target) {
-				context->temporal = t->temporal;
-				temporal = context->temporal;
-				context->changed_temporal = TRUE;
-			}
-		} else if(context->temporal_target < context->temporal) {
-			/* We need to downscale */
-			if(t->temporal == context->temporal_target) {
-				context->temporal = context->temporal_target;
-				context->changed_temporal = TRUE;
-			}
+	}
+	if(spatial_layer < info->spatial) {
+		/* Drop the packet: update the context to make sure sequence number is increased normally later */
+		JANUS_LOG(LOG_HUGE, "Dropping packet (spatial layer %d < %d)\n", spatial_layer, info->spatial);
+		if(sc)
+			sc->base_seq++;
+		return FALSE;
+	} else if(info->ebit && spatial_layer == info->spatial) {
+		/* If we stop at layer 0, we need a marker bit now, as the one from layer 1 will not be received */
+		override_mark_bit = TRUE;
+	}
+	int temporal = context->temporal;
+	if(context->temporal_target > context->temporal) {
+		/* We need to upscale */
+		if(info->temporal > context->temporal && info->temporal <= context->temporal_target) {
+			context->temporal = info->temporal;
+			temporal = context->temporal;
+			context->changed_temporal = TRUE;
 		}
-		if(temporal < t->temporal) {
-			JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
-				t->temporal, context->temporal);
-			/* We increase the base sequence number, or there will be gaps when delivering later */
-			if(sc)
-				sc->base_seq++;
-			return FALSE;
+	} else if(context->temporal_target < context->temporal) {
+		/* We need to downscale */
+		if(info->temporal == context->temporal_target) {
+			context->temporal = context->temporal_target;
+			context->changed_temporal = TRUE;
 		}
-		/* If we got here, we can send the frame: this doesn't necessarily mean it's
-		 * one of the layers the user wants, as there may be dependencies involved */
-		JANUS_LOG(LOG_HUGE, "Sending packet (spatial=%d, temporal=%d)\n",
-			t->spatial, t->temporal);
-		if(override_mark_bit && !has_marker_bit)
-			header->markerbit = 1;
-		return TRUE;
 	}
+	if(temporal < info->temporal) {
+		JANUS_LOG(LOG_HUGE, "Dropping packet (it's temporal layer %d, but we're capping at %d)\n",
+			info->temporal, context->temporal);
+		/* We increase the base sequence number, or there will be gaps when delivering later */
+		if(sc)
+			sc->base_seq++;
+		return FALSE;
+	}
+	/* If we got here, we can send the frame: this doesn't necessarily mean it's
+	 * one of the layers the user wants, as there may be dependencies involved */
+	JANUS_LOG(LOG_HUGE, "Sending packet (spatial=%d, temporal=%d)\n",
+		info->spatial, info->temporal);
+	if(override_mark_bit && !has_marker_bit)
+		header->markerbit = 1;
+	return TRUE;
+}
+
+gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
+		char *buf, int len, uint8_t *dd_content, int dd_len,
+		janus_videocodec vcodec, janus_vp9_svc_info *info, janus_rtp_switching_context *sc) {
+	if(!context || !buf || len < 1 || (vcodec != JANUS_VIDEOCODEC_VP9 && vcodec != JANUS_VIDEOCODEC_AV1))
+		return FALSE;
+	if(vcodec == JANUS_VIDEOCODEC_AV1) {
+		/* Parse the Dependency Descriptor with our own context, and then process the result */
+		janus_av1_svc_info av1_info;
+		janus_av1_svc_context_parse(&context->dd_context, buf, len, dd_content, dd_len, &av1_info);
+		return janus_rtp_svc_context_process_av1(context, buf, len, &av1_info, sc);
+	}
+	janus_rtp_header *header = (janus_rtp_header *)buf;
+	/* Reset the flags */
+	context->changed_spatial = FALSE;
+	context->changed_temporal = FALSE;
+	context->need_pli = FALSE;
+	gint64 now = janus_get_monotonic_time();
+	/* Access the packet payload */
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return FALSE;
 	/* If we got here, it's VP9, for which we parse the payload manually:
 	 * if we don't have any info parsed from the VP9 payload header, get it now */
 	janus_vp9_svc_info svc_info = { 0 };
@@ -1572,35 +1636,35 @@ gboolean janus_av1_svc_context_process_dd(janus_av1_svc_context *context,
 		return FALSE;
 
 	/* First of all, let's parse the Dependency Descriptor */
-	size_t blen = dd_len*8;
-	uint32_t offset = 0;
+	janus_bitstream_reader reader;
+	janus_bitstream_reader_init(&reader, dd, dd_len);
 	/* mandatory_descriptor_fields() */
-	uint8_t start = janus_bitstream_getbit(dd, offset++);
-	uint8_t end = janus_bitstream_getbit(dd, offset++);
+	uint8_t start = janus_bitstream_reader_get(&reader, 1);
+	uint8_t end = janus_bitstream_reader_get(&reader, 1);
 	if(ebit)
 		*ebit = end;
-	uint8_t template = janus_bitstream_getbits(dd, 6, &offset);
-	uint16_t frame = janus_bitstream_getbits(dd, 16, &offset);
+	uint8_t template = janus_bitstream_reader_get(&reader, 6);
+	uint16_t frame = janus_bitstream_reader_get(&reader, 16);
 	JANUS_LOG(LOG_HUGE, "  -- s=%u, e=%u, t=%u, f=%u\n",
 		start, end, template, frame);
-	if(blen > 24) {
+	if(dd_len > 3) {
 		/* extended_descriptor_fields() */
-		uint8_t tdeps = janus_bitstream_getbit(dd, offset++);
-		(void)janus_bitstream_getbit(dd, offset++);
-		(void)janus_bitstream_getbit(dd, offset++);
-		(void)janus_bitstream_getbit(dd, offset++);
-		(void)janus_bitstream_getbit(dd, offset++);
+		uint8_t tdeps = janus_bitstream_reader_get(&reader, 1);
+		(void)janus_bitstream_reader_get(&reader, 1);
+		(void)janus_bitstream_reader_get(&reader, 1);
+		(void)janus_bitstream_reader_get(&reader, 1);
+		(void)janus_bitstream_reader_get(&reader, 1);
 		/* template_dependency_structure() */
 		if(tdeps) {
-			uint8_t tioff = janus_bitstream_getbits(dd, 6, &offset);
-			(void)janus_bitstream_getbits(dd, 5, &offset);
+			uint8_t tioff = janus_bitstream_reader_get(&reader, 6);
+			(void)janus_bitstream_reader_get(&reader, 5);
 			/* template_layers() */
 			uint32_t nlidc = 0;
 			uint8_t tcnt = 0;
 			int spatial_layers = 0;
 			int temporal_layers = 0;
 			do {
-				nlidc = janus_bitstream_getbits(dd, 2, &offset);
+				nlidc = janus_bitstream_reader_get(&reader, 2);
 				if(context->templates == NULL)
 					context->templates = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_free);
 				janus_av1_svc_template *t = g_hash_table_lookup(context->templates,
@@ -1622,7 +1686,12 @@ gboolean janus_av1_svc_context_process_dd(janus_av1_svc_context *context,
 					spatial_layers++;
 				}
 				tcnt++;
-			} while(nlidc != 3);
+			} while(nlidc != 3 && !reader.overflow && tcnt < 64);
+			if(reader.overflow || nlidc != 3) {
+				/* The template structure is broken or truncated */
+				JANUS_LOG(LOG_WARN, "Invalid Dependency Descriptor template structure, ignoring packet...\n");
+				return FALSE;
+			}
 			/* Check if anything changed since the latest update */
 			if(context->tcnt != tcnt || context->tioff != tioff ||
 					context->spatial_layers != spatial_layers ||
@@ -1653,3 +1722,187 @@ gboolean janus_av1_svc_context_process_dd(janus_av1_svc_context *context,
 		*template_id = tindex;
 	return TRUE;
 }
+
+gboolean janus_av1_svc_context_parse(janus_av1_svc_context *context,
+		char *buf, int len, uint8_t *dd, int dd_len, janus_av1_svc_info *info) {
+	if(!info)
+		return FALSE;
+	memset(info, 0, sizeof(*info));
+	if(!context || !buf || len < 1)
+		return FALSE;
+	int plen = 0;
+	char *payload = janus_rtp_payload(buf, len, &plen);
+	if(payload == NULL)
+		return FALSE;
+	info->payload = TRUE;
+	if(dd == NULL || dd_len < 1)
+		return FALSE;
+	uint8_t template = 0, ebit = 0;
+	if(!janus_av1_svc_context_process_dd(context, dd, dd_len, &template, &ebit))
+		return FALSE;
+	janus_av1_svc_template *t = g_hash_table_lookup(context->templates, GUINT_TO_POINTER(template));
+	if(t == NULL)
+		return FALSE;
+	info->found = TRUE;
+	info->spatial = t->spatial;
+	info->temporal = t->temporal;
+	info->ebit = ebit;
+	info->keyframe = janus_av1_is_keyframe((const char *)payload, plen);
+	return TRUE;
+}
+
+/* Video packet classification */
+void janus_rtp_video_facts_get(janus_videocodec vcodec, char *buf, int len, janus_rtp_video_facts *facts) {
+	if(facts == NULL)
+		return;
+	memset(facts, 0, sizeof(*facts));
+	int plen = 0;
+	char *payload = buf ? janus_rtp_payload(buf, len, &plen) : NULL;
+	if(payload == NULL)
+		return;
+	facts->payload = TRUE;
+	switch(vcodec) {
+		case JANUS_VIDEOCODEC_VP8:
+			facts->keyframe = janus_vp8_is_keyframe(payload, plen);
+			break;
+		case JANUS_VIDEOCODEC_VP9:
+			facts->keyframe = janus_vp9_is_keyframe(payload, plen);
+			break;
+		case JANUS_VIDEOCODEC_H264:
+			/* A single pass tells us about all the NALs we may care about */
+			facts->h264_nals = janus_h264_nal_types(payload, plen);
+			facts->keyframe = (facts->h264_nals & (1 << 7)) != 0;
+			facts->i_frame = (facts->h264_nals & (1 << 5)) != 0;
+			break;
+		case JANUS_VIDEOCODEC_AV1:
+			facts->keyframe = janus_av1_is_keyframe(payload, plen);
+			break;
+		case JANUS_VIDEOCODEC_H265:
+			facts->keyframe = janus_h265_is_keyframe(payload, plen);
+			break;
+		default:
+			break;
+	}
+}
+
+/* GOP cache */
+typedef struct janus_rtp_gop_packet {
+	char *buffer;
+	int length;
+} janus_rtp_gop_packet;
+static void janus_rtp_gop_packet_free(janus_rtp_gop_packet *pkt) {
+	if(pkt == NULL)
+		return;
+	g_free(pkt->buffer);
+	g_free(pkt);
+}
+
+static gboolean janus_rtp_gop_cache_is_keyframe(janus_videocodec vcodec, char *buf, int len) {
+	janus_rtp_video_facts facts;
+	janus_rtp_video_facts_get(vcodec, buf, len, &facts);
+	return facts.keyframe;
+}
+
+janus_rtp_gop_cache *janus_rtp_gop_cache_create(janus_videocodec vcodec, size_t max_size) {
+	janus_rtp_gop_cache *cache = g_malloc0(sizeof(janus_rtp_gop_cache));
+	cache->vcodec = vcodec;
+	cache->packets = g_queue_new();
+	cache->max_size = max_size;
+	janus_mutex_init(&cache->mutex);
+	return cache;
+}
+
+/* Helper to empty the cache: must be called with the mutex locked */
+static void janus_rtp_gop_cache_flush(janus_rtp_gop_cache *cache) {
+	janus_rtp_gop_packet *pkt = NULL;
+	while((pkt = g_queue_pop_head(cache->packets)) != NULL)
+		janus_rtp_gop_packet_free(pkt);
+	cache->size = 0;
+	cache->valid = FALSE;
+}
+
+void janus_rtp_gop_cache_reset(janus_rtp_gop_cache *cache) {
+	if(cache == NULL)
+		return;
+	janus_mutex_lock(&cache->mutex);
+	janus_rtp_gop_cache_flush(cache);
+	janus_mutex_unlock(&cache->mutex);
+}
+
+void janus_rtp_gop_cache_destroy(janus_rtp_gop_cache *cache) {
+	if(cache == NULL)
+		return;
+	janus_mutex_lock(&cache->mutex);
+	janus_rtp_gop_cache_flush(cache);
+	g_queue_free(cache->packets);
+	cache->packets = NULL;
+	janus_mutex_unlock(&cache->mutex);
+	janus_mutex_destroy(&cache->mutex);
+	g_free(cache);
+}
+
+void janus_rtp_gop_cache_add(janus_rtp_gop_cache *cache, char *buf, int len) {
+	if(cache == NULL || buf == NULL || len < 12)
+		return;
+	janus_rtp_header *rtp = (janus_rtp_header *)buf;
+	uint32_t timestamp = ntohl(rtp->timestamp);
+	gboolean keyframe = janus_rtp_gop_cache_is_keyframe(cache->vcodec, buf, len);
+	janus_mutex_lock(&cache->mutex);
+	if(keyframe && (!cache->valid || timestamp != cache->keyframe_ts)) {
+		/* New keyframe (keyframes may span multiple packets), start a new GOP */
+		janus_rtp_gop_cache_flush(cache);
+		cache->valid = TRUE;
+		cache->keyframe_ts = timestamp;
+	}
+	if(!cache->valid) {
+		/* We're waiting for a keyframe */
+		janus_mutex_unlock(&cache->mutex);
+		return;
+	}
+	if(cache->size + len > cache->max_size) {
+		/* This GOP is too large, we'll wait for the next keyframe instead */
+		JANUS_LOG(LOG_HUGE, "GOP larger than %zu bytes, emptying the cache\n", cache->max_size);
+		janus_rtp_gop_cache_flush(cache);
+		janus_mutex_unlock(&cache->mutex);
+		return;
+	}
+	janus_rtp_gop_packet *pkt = g_malloc(sizeof(janus_rtp_gop_packet));
+	pkt->buffer = g_malloc(len);
+	memcpy(pkt->buffer, buf, len);
+	pkt->length = len;
+	g_queue_push_tail(cache->packets, pkt);
+	cache->size += len;
+	janus_mutex_unlock(&cache->mutex);
+}
+
+int janus_rtp_gop_cache_replay(janus_rtp_gop_cache *cache, janus_rtp_gop_cache_callback callback, gpointer user_data) {
+	if(cache == NULL || callback == NULL)
+		return 0;
+	/* Copy the packets out first, so that the cache isn't locked while we
+	 * send them, which would hold up the thread adding new packets to it */
+	GList *packets = NULL;
+	janus_mutex_lock(&cache->mutex);
+	if(cache->valid) {
+		GList *temp = cache->packets->tail;
+		while(temp) {
+			janus_rtp_gop_packet *pkt = (janus_rtp_gop_packet *)temp->data;
+			janus_rtp_gop_packet *copy = g_malloc(sizeof(janus_rtp_gop_packet));
+			copy->buffer = g_malloc(pkt->length);
+			memcpy(copy->buffer, pkt->buffer, pkt->length);
+			copy->length = pkt->length;
+			packets = g_list_prepend(packets, copy);
+			temp = temp->prev;
+		}
+	}
+	janus_mutex_unlock(&cache->mutex);
+	int count = 0;
+	GList *temp = packets;
+	while(temp) {
+		janus_rtp_gop_packet *pkt = (janus_rtp_gop_packet *)temp->data;
+		callback(pkt->buffer, pkt->length, user_data);
+		count++;
+		temp = temp->next;
+	}
+	g_list_free_full(packets, (GDestroyNotify)janus_rtp_gop_packet_free);
+	return count;
+}
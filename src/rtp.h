@@ -152,6 +152,32 @@ int janus_rtp_header_extension_get_id(const char *sdp, const char *extension);
  * @returns The extension namespace, if found, NULL otherwise */
 const char *janus_rtp_header_extension_get_from_id(const char *sdp, int id);
 
+/*! \brief IDs of the RTP extensions to decode when parsing all of them at once
+ * \note Extensions whose ID is 0 or negative are considered as not negotiated */
+typedef struct janus_rtp_extension_ids {
+	int audio_level;
+	int video_orientation;
+	int playout_delay;
+	int mid;
+	int rid;
+	int repaired_rid;
+	int transport_wide_cc;
+	int abs_send_time;
+	int dependency_desc;
+} janus_rtp_extension_ids;
+
+/*! \brief Helper to parse all the RTP extensions we're interested in with a single
+ * walk of the extensions block, rather than looking for each of them separately
+ * \note Extensions that are not present are left untouched, which means that
+ * the janus_plugin_rtp_extensions instance should be reset before calling this
+ * @param[in] buf The packet data
+ * @param[in] len The packet data length in bytes
+ * @param[in] ids The IDs of the extensions to look for
+ * @param[out] extensions The janus_plugin_rtp_extensions instance to fill
+ * @returns The number of extensions that were decoded, or a negative integer in case of errors */
+int janus_rtp_header_extensions_parse(char *buf, int len, const janus_rtp_extension_ids *ids,
+	janus_plugin_rtp_extensions *extensions);
+
 /*! \brief Helper to parse a ssrc-audio-level RTP extension (https://tools.ietf.org/html/rfc6464)
  * @note Browsers apparently always set the VAD to 1, so it's unreliable and should be ignored:
  * only use this method if you're interested in the audio-level value itself.
@@ -341,6 +367,33 @@ void janus_av1_svc_context_reset(janus_av1_svc_context *context);
  * @returns TRUE if the packet is valid, FALSE if it should be dropped instead */
 gboolean janus_av1_svc_context_process_dd(janus_av1_svc_context *context,
 	uint8_t *dd, int dd_len, uint8_t *template_id, uint8_t *ebit);
+
+/*! \brief Layer info decoded from the Dependency Descriptor of a packet, that can be
+ * computed once (e.g., by the publisher) and then shared with all recipients of the packet */
+typedef struct janus_av1_svc_info {
+	/*! \brief Whether the packet has a payload */
+	gboolean payload;
+	/*! \brief Whether a valid Dependency Descriptor, and a template for it, were found */
+	gboolean found;
+	/*! \brief Spatial and temporal layer of the packet */
+	int spatial, temporal;
+	/*! \brief Whether the packet is an end of frame */
+	gboolean ebit;
+	/*! \brief Whether the packet contains a keyframe */
+	gboolean keyframe;
+} janus_av1_svc_info;
+
+/*! \brief Process the Dependency Descriptor of a packet once, updating the templates
+ * cached in the context, and get the layer info it refers to
+ * @param[in] context The av1svc context to use (e.g., one per publisher stream)
+ * @param[in] buf The RTP packet
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] dd Pointer to the Dependency Descriptor data, if available
+ * @param[in] dd_len The length of the Dependendy Descriptor data, if available
+ * @param[out] info The janus_av1_svc_info instance to fill in
+ * @returns TRUE if layer info was found, FALSE otherwise */
+gboolean janus_av1_svc_context_parse(janus_av1_svc_context *context,
+	char *buf, int len, uint8_t *dd, int dd_len, janus_av1_svc_info *info);
 ///@}
 
 /** @name Janus simulcast processing methods
@@ -376,6 +429,21 @@ typedef struct janus_rtp_simulcasting_context {
  * @param[in] context The context to (re)set */
 void janus_rtp_simulcasting_context_reset(janus_rtp_simulcasting_context *context);
 
+/*! \brief Facts about a simulcast packet that don't depend on who's receiving it: when the
+ * same packet goes to many recipients, they can be computed only once and then shared */
+typedef struct janus_rtp_simulcasting_packet {
+	/*! \brief Substream the packet belongs to (-1 if unknown) */
+	int substream;
+	/*! \brief Whether the packet has a payload */
+	gboolean payload;
+	/*! \brief Whether the packet contains a keyframe */
+	gboolean keyframe;
+	/*! \brief Temporal layer of the packet (-1 if unknown, only available for VP8 and VP9) */
+	int temporal;
+	/*! \brief VP9 only: whether the packet is a switching point, and whether it begins and/or ends a frame */
+	gboolean ubit, bbit, ebit;
+} janus_rtp_simulcasting_packet;
+
 /*! \brief Helper method to prepare the simulcasting info (rids and/or SSRCs) from
  * the simulcast object the core passes to plugins for new PeerConnections
  * @param[in] simulcast JSON object containing SSRCs and rids
@@ -409,6 +477,38 @@ void janus_rtp_simulcasting_cleanup(int *rid_ext_id, uint32_t *ssrcs, char **rid
 gboolean janus_rtp_simulcasting_context_process_rtp(janus_rtp_simulcasting_context *context,
 	char *buf, int len, uint8_t *dd_content, int dd_len, uint32_t *ssrcs, char **rids,
 	janus_videocodec vcodec, janus_rtp_switching_context *sc, janus_mutex *rid_mutex);
+
+/*! \brief Parse an RTP packet to get the simulcast facts that don't depend on a specific context,
+ * e.g., to then process the same packet for many contexts via janus_rtp_simulcasting_context_process_packet
+ * @param[out] packet The janus_rtp_simulcasting_packet instance to fill in
+ * @param[in] buf The RTP packet to parse
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] rid_ext_id The rid RTP extension ID, if any
+ * @param[in] ssrcs The simulcast SSRCs to refer to (may be updated if rids are involved)
+ * @param[in] rids The simulcast rids to refer to, if any
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] rid_mutex A mutex that must be acquired before reading the rids array, if any
+ * @returns TRUE if the packet belongs to a known substream, FALSE otherwise */
+gboolean janus_rtp_simulcasting_packet_parse(janus_rtp_simulcasting_packet *packet,
+	char *buf, int len, int rid_ext_id, uint32_t *ssrcs, char **rids,
+	janus_videocodec vcodec, janus_mutex *rid_mutex);
+
+/*! \brief Same as janus_rtp_simulcasting_context_process_rtp, but using the facts on the
+ * packet obtained via janus_rtp_simulcasting_packet_parse, so that per-context work is
+ * limited to comparisons: packets from substreams we're not interested in are dropped early
+ * @param[in] context The simulcasting context to use
+ * @param[in] packet The simulcast facts on the packet
+ * @param[in] buf The RTP packet to process
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] dd_content The Dependency Descriptor RTP extension data, if available
+ * @param[in] dd_len Length of the Dependency Descriptor data, if available
+ * @param[in] ssrcs The simulcast SSRCs to refer to
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] sc RTP switching context to refer to, if any (only needed for VP8 and dropping temporal layers)
+ * @returns TRUE if the packet should be relayed, FALSE if it should be dropped instead */
+gboolean janus_rtp_simulcasting_context_process_packet(janus_rtp_simulcasting_context *context,
+	const janus_rtp_simulcasting_packet *packet, char *buf, int len, uint8_t *dd_content, int dd_len,
+	uint32_t *ssrcs, janus_videocodec vcodec, janus_rtp_switching_context *sc);
 ///@}
 
 /** @name Janus SVC processing methods
@@ -457,6 +557,102 @@ void janus_rtp_svc_context_reset(janus_rtp_svc_context *context);
 gboolean janus_rtp_svc_context_process_rtp(janus_rtp_svc_context *context,
 	char *buf, int len, uint8_t *dd_content, int dd_len,
 	janus_videocodec vcodec, janus_vp9_svc_info *info, janus_rtp_switching_context *sc);
+
+/*! \brief Same as janus_rtp_svc_context_process_rtp for AV1, but using layer info obtained via
+ * janus_av1_svc_context_parse, so that the Dependency Descriptor isn't parsed again for each context
+ * \note The Dependency Descriptor context in \c context is not used (nor updated) in this case
+ * @param[in] context The SVC context to use
+ * @param[in] buf The RTP packet to process
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[in] info The layer info decoded from the Dependency Descriptor
+ * @param[in] sc RTP switching context to refer to, if any
+ * @returns TRUE if the packet should be relayed, FALSE if it should be dropped instead */
+gboolean janus_rtp_svc_context_process_av1(janus_rtp_svc_context *context,
+	char *buf, int len, const janus_av1_svc_info *info, janus_rtp_switching_context *sc);
+///@}
+
+/** @name Janus video packet classification methods
+ */
+///@{
+/*! \brief What the payload of a video RTP packet tells us, so that a packet can be
+ * classified once, e.g., before it's handed to recordings, caches and recipients */
+typedef struct janus_rtp_video_facts {
+	/*! \brief Whether the packet has a payload */
+	gboolean payload;
+	/*! \brief Whether the packet contains a keyframe (for H.264, an SPS, see janus_h264_is_keyframe) */
+	gboolean keyframe;
+	/*! \brief H.264 only: whether the packet contains an I-Frame */
+	gboolean i_frame;
+	/*! \brief H.264 only: bitmask of the NAL types in the packet, see janus_h264_nal_types */
+	guint32 h264_nals;
+} janus_rtp_video_facts;
+
+/*! \brief Classify a video RTP packet, scanning its payload only once
+ * @param[in] vcodec Video codec of the RTP payload
+ * @param[in] buf The RTP packet to classify
+ * @param[in] len The length of the RTP packet (header, extension and payload)
+ * @param[out] facts The janus_rtp_video_facts instance to fill in */
+void janus_rtp_video_facts_get(janus_videocodec vcodec, char *buf, int len, janus_rtp_video_facts *facts);
+///@}
+
+/** @name Janus GOP cache methods
+ */
+///@{
+/*! \brief Helper struct to keep the packets of the latest group of pictures
+ * (GOP) of a video stream, that is all the packets received since the latest
+ * keyframe, so that they can be replayed to new recipients: this way they
+ * can start decoding right away, rather than waiting for the next keyframe
+ * \note The cache is bounded: if the current GOP grows larger than the
+ * maximum size, the cache is emptied and stays so until the next keyframe */
+typedef struct janus_rtp_gop_cache {
+	/*! \brief Video codec of the stream, used to detect keyframes */
+	janus_videocodec vcodec;
+	/*! \brief Packets in the cache, starting from the latest keyframe */
+	GQueue *packets;
+	/*! \brief Size of the packets currently in the cache */
+	size_t size;
+	/*! \brief Maximum size of the packets in the cache */
+	size_t max_size;
+	/*! \brief RTP timestamp of the keyframe the cache starts from */
+	uint32_t keyframe_ts;
+	/*! \brief Whether the cache contains a GOP we can replay, i.e., it starts with a keyframe */
+	gboolean valid;
+	/*! \brief Mutex to lock this instance */
+	janus_mutex mutex;
+} janus_rtp_gop_cache;
+
+/*! \brief Callback to invoke for each packet when replaying a GOP cache
+ * \note The callback is invoked on a copy of the packets, without the cache
+ * locked: it can modify the RTP header of the packet, but not the payload */
+typedef void (*janus_rtp_gop_cache_callback)(char *buf, int len, gpointer user_data);
+
+/*! \brief Create a new GOP cache
+ * @param[in] vcodec Video codec of the stream
+ * @param[in] max_size Maximum size of a GOP we can keep, in bytes
+ * @returns A new janus_rtp_gop_cache instance */
+janus_rtp_gop_cache *janus_rtp_gop_cache_create(janus_videocodec vcodec, size_t max_size);
+
+/*! \brief Get rid of the packets in a GOP cache, e.g., because of a source switch
+ * @param[in] cache The cache to reset */
+void janus_rtp_gop_cache_reset(janus_rtp_gop_cache *cache);
+
+/*! \brief Destroy a GOP cache
+ * @param[in] cache The cache to destroy */
+void janus_rtp_gop_cache_destroy(janus_rtp_gop_cache *cache);
+
+/*! \brief Add an RTP packet to a GOP cache: a keyframe starts a new GOP, while
+ * packets that don't belong to a GOP we can replay are simply ignored
+ * @param[in] cache The cache to update
+ * @param[in] buf The RTP packet to add (a copy is made)
+ * @param[in] len The length of the RTP packet (header, extension and payload) */
+void janus_rtp_gop_cache_add(janus_rtp_gop_cache *cache, char *buf, int len);
+
+/*! \brief Replay the GOP currently in a cache, in the order packets were added
+ * @param[in] cache The cache to replay
+ * @param[in] callback The callback to invoke for each packet
+ * @param[in] user_data Opaque pointer to pass to the callback
+ * @returns The number of packets that were replayed, or 0 if there's no GOP to replay */
+int janus_rtp_gop_cache_replay(janus_rtp_gop_cache *cache, janus_rtp_gop_cache_callback callback, gpointer user_data);
 ///@}
 
 #endif
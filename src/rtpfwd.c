@@ -13,6 +13,11 @@
  * \ref protocols
  */
 
+#ifdef HAVE_SENDMMSG
+#define _GNU_SOURCE
+#endif
+#include <sys/socket.h>
+
 #include "rtpfwd.h"
 #include "rtcp.h"
 #include "utils.h"
@@ -38,6 +43,157 @@ static void *janus_rtp_forwarder_rtcp_thread(void *data) {
 static void janus_rtp_forwarder_unref(janus_rtp_forwarder *rf);
 /* Static helper to free an RTP forwarder instance when the reference goes to 0 */
 static void janus_rtp_forwarder_free(const janus_refcount *f_ref);
+/* Static helper to get a reference to the current mirrors of a forwarder, if any */
+static GPtrArray *janus_rtp_forwarder_mirrors_get(janus_rtp_forwarder *rf);
+
+/* Asynchronous sending, if enabled: forwarders queue packets in their own
+ * ring, and a shared pool of threads serves the forwarders with packets to
+ * send, one thread at a time for each forwarder so that order is preserved */
+#define JANUS_RTP_FORWARDER_QUEUE_SIZE	256
+#define JANUS_RTP_FORWARDER_BATCH_SIZE	32
+#define JANUS_RTP_FORWARDER_MAX_BATCHES	4
+#define JANUS_RTP_FORWARDER_MAX_SENDERS	32
+static int rtpfwd_senders = 0;
+static GAsyncQueue *rtpfwd_queue = NULL;
+static GThread *rtpfwd_threads[JANUS_RTP_FORWARDER_MAX_SENDERS];
+static janus_rtp_forwarder rtpfwd_exit;
+typedef struct janus_rtp_forwarder_packet {
+	int length;
+	char buffer[];
+} janus_rtp_forwarder_packet;
+static void janus_rtp_forwarder_send_batch_to(janus_rtp_forwarder *rf, janus_rtp_forwarder_packet **pkts, int count,
+		struct sockaddr *address, socklen_t addrlen) {
+	int i = 0;
+#ifdef HAVE_SENDMMSG
+	/* Send all the packets with a single system call, if possible */
+	struct mmsghdr msgs[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	struct iovec iovs[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	int num = 0;
+	for(i=0; i<count; i++) {
+		if(pkts[i]->length == 0)
+			continue;
+		iovs[num].iov_base = pkts[i]->buffer;
+		iovs[num].iov_len = pkts[i]->length;
+		memset(&msgs[num], 0, sizeof(msgs[num]));
+		msgs[num].msg_hdr.msg_name = address;
+		msgs[num].msg_hdr.msg_namelen = addrlen;
+		msgs[num].msg_hdr.msg_iov = &iovs[num];
+		msgs[num].msg_hdr.msg_iovlen = 1;
+		num++;
+	}
+	int sent = 0;
+	while(sent < num) {
+		int res = sendmmsg(rf->udp_fd, &msgs[sent], num - sent, 0);
+		if(res <= 0) {
+			/* Skip the packet that failed, and try again with the others */
+			JANUS_LOG(LOG_HUGE, "Error forwarding %s %s packet... %s (len=%zu)...\n",
+				(rf->is_srtp ? "SRTP" : "RTP"), (rf->is_video ? "video" : "audio"),
+				g_strerror(errno), iovs[sent].iov_len);
+			res = 1;
+		}
+		sent += res;
+	}
+#else
+	for(i=0; i<count; i++) {
+		if(pkts[i]->length == 0)
+			continue;
+		if(sendto(rf->udp_fd, pkts[i]->buffer, pkts[i]->length, 0, address, addrlen) < 0) {
+			JANUS_LOG(LOG_HUGE, "Error forwarding %s %s packet... %s (len=%d)...\n",
+				(rf->is_srtp ? "SRTP" : "RTP"), (rf->is_video ? "video" : "audio"),
+				g_strerror(errno), pkts[i]->length);
+		}
+	}
+#endif
+}
+static void janus_rtp_forwarder_send_batch(janus_rtp_forwarder *rf, janus_rtp_forwarder_packet **pkts, int count) {
+	int i = 0;
+	if(rf->is_srtp) {
+		/* Encrypt the packets first (the buffers have room for the tag) */
+		for(i=0; i<count; i++) {
+			int protected = pkts[i]->length;
+			int res = srtp_protect(rf->srtp_ctx, pkts[i]->buffer, &protected);
+			if(res != srtp_err_status_ok) {
+				janus_rtp_header *header = (janus_rtp_header *)pkts[i]->buffer;
+				JANUS_LOG(LOG_ERR, "Error encrypting %s packet... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
+					(rf->is_video ? "Video" : "Audio"), janus_srtp_error_str(res), pkts[i]->length, protected,
+					ntohl(header->timestamp), ntohs(header->seq_number));
+				pkts[i]->length = 0;
+			} else {
+				pkts[i]->length = protected;
+			}
+		}
+	}
+	/* Send the same packets to the recipient and to all the mirrors, if any */
+	struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
+		(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
+	socklen_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
+	janus_rtp_forwarder_send_batch_to(rf, pkts, count, address, addrlen);
+	GPtrArray *mirrors = janus_rtp_forwarder_mirrors_get(rf);
+	if(mirrors != NULL) {
+		guint m = 0;
+		for(m=0; m<mirrors->len; m++) {
+			janus_rtp_forwarder_mirror *mirror = g_ptr_array_index(mirrors, m);
+			janus_rtp_forwarder_send_batch_to(rf, pkts, count, (struct sockaddr *)&mirror->addr, mirror->addrlen);
+		}
+		g_ptr_array_unref(mirrors);
+	}
+}
+static void *janus_rtp_forwarder_sender_thread(void *data) {
+	JANUS_LOG(LOG_VERB, "Joining RTP forwarders sender thread...\n");
+	janus_rtp_forwarder_packet *pkts[JANUS_RTP_FORWARDER_BATCH_SIZE];
+	janus_rtp_forwarder *rf = NULL;
+	while((rf = g_async_queue_pop(rtpfwd_queue)) != &rtpfwd_exit) {
+		/* Send what this forwarder queued, in batches */
+		int batches = 0;
+		while(TRUE) {
+			int count = 0;
+			janus_rtp_forwarder_packet *pkt = NULL;
+			while(count < JANUS_RTP_FORWARDER_BATCH_SIZE && (pkt = janus_ring_pop(rf->queue)) != NULL)
+				pkts[count++] = pkt;
+			if(count == 0) {
+				/* Done for now, unless something was queued in the meanwhile */
+				g_atomic_int_set(&rf->scheduled, 0);
+				if(janus_ring_length(rf->queue) == 0 || !g_atomic_int_compare_and_exchange(&rf->scheduled, 0, 1)) {
+					janus_rtp_forwarder_unref(rf);
+					break;
+				}
+				continue;
+			}
+			if(!g_atomic_int_get(&rf->destroyed))
+				janus_rtp_forwarder_send_batch(rf, pkts, count);
+			int i = 0;
+			for(i=0; i<count; i++)
+				g_free(pkts[i]);
+			batches++;
+			if(batches == JANUS_RTP_FORWARDER_MAX_BATCHES) {
+				/* Give other forwarders a chance too, we'll get back to this one later */
+				g_async_queue_push(rtpfwd_queue, rf);
+				break;
+			}
+		}
+	}
+	JANUS_LOG(LOG_VERB, "Leaving RTP forwarders sender thread...\n");
+	return NULL;
+}
+
+/* Configure the asynchronous sending of packets */
+void janus_rtp_forwarders_set_async(int threads) {
+	if(rtpfwd_queue != NULL) {
+		JANUS_LOG(LOG_WARN, "RTP forwarders already initialized, can't change the number of sender threads\n");
+		return;
+	}
+	if(threads < 0)
+		threads = 0;
+	if(threads > JANUS_RTP_FORWARDER_MAX_SENDERS) {
+		JANUS_LOG(LOG_WARN, "Too many RTP forwarders sender threads (%d), using %d\n",
+			threads, JANUS_RTP_FORWARDER_MAX_SENDERS);
+		threads = JANUS_RTP_FORWARDER_MAX_SENDERS;
+	}
+	rtpfwd_senders = threads;
+}
+int janus_rtp_forwarders_get_async(void) {
+	return rtpfwd_queue != NULL ? rtpfwd_senders : 0;
+}
 
 /* \brief RTP forwarders code initialization
  * @returns 0 in case of success, a negative integer on errors */
@@ -72,6 +228,31 @@ int janus_rtp_forwarders_init(void) {
 		g_error_free(error);
 		return -1;
 	}
+	/* Spawn the sender threads, if asynchronous sending is enabled */
+	if(rtpfwd_senders > 0) {
+		rtpfwd_queue = g_async_queue_new();
+		int i = 0;
+		for(i=0; i<rtpfwd_senders; i++) {
+			char tname[16];
+			g_snprintf(tname, sizeof(tname), "rtpfwd %d", i+1);
+			rtpfwd_threads[i] = g_thread_try_new(tname, janus_rtp_forwarder_sender_thread, NULL, &error);
+			if(error != NULL) {
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch a sender thread for RTP forwarders...\n",
+					error->code, error->message ? error->message : "??");
+				g_error_free(error);
+				error = NULL;
+				break;
+			}
+		}
+		rtpfwd_senders = i;
+		if(rtpfwd_senders == 0) {
+			JANUS_LOG(LOG_WARN, "No sender thread for RTP forwarders, packets will be sent synchronously\n");
+			g_async_queue_unref(rtpfwd_queue);
+			rtpfwd_queue = NULL;
+		} else {
+			JANUS_LOG(LOG_INFO, "RTP forwarders will send packets using %d sender threads\n", rtpfwd_senders);
+		}
+	}
 	/* Donw */
 	return 0;
 }
@@ -87,6 +268,22 @@ void janus_rtp_forwarders_deinit(void) {
 		g_thread_join(rtcpfwd_thread);
 		rtcpfwd_thread = NULL;
 	}
+	/* Stop the sender threads, if any */
+	if(rtpfwd_queue != NULL) {
+		int i = 0;
+		for(i=0; i<rtpfwd_senders; i++)
+			g_async_queue_push(rtpfwd_queue, &rtpfwd_exit);
+		for(i=0; i<rtpfwd_senders; i++) {
+			g_thread_join(rtpfwd_threads[i]);
+			rtpfwd_threads[i] = NULL;
+		}
+		/* Forwarders that were still scheduled are only referenced here now */
+		janus_rtp_forwarder *rf = NULL;
+		while((rf = g_async_queue_try_pop(rtpfwd_queue)) != NULL)
+			janus_rtp_forwarder_unref(rf);
+		g_async_queue_unref(rtpfwd_queue);
+		rtpfwd_queue = NULL;
+	}
 	/* Get rid of the table */
 	janus_mutex_lock(&rtpfwds_mutex);
 	g_hash_table_destroy(rtpfwds);
@@ -233,6 +430,9 @@ janus_rtp_forwarder *janus_rtp_forwarder_create(const char *ctx,
 		rf->sim_context.substream_target = 2;
 		rf->sim_context.templayer_target = 2;
 	}
+	if(!is_data && rtpfwd_queue != NULL)
+		rf->queue = janus_ring_new(JANUS_RTP_FORWARDER_QUEUE_SIZE);
+	janus_mutex_init(&rf->mirrors_mutex);
 	janus_refcount_init(&rf->ref, janus_rtp_forwarder_free);
 	rf->context = g_strdup(ctx);
 	rf->stream_id = stream_id;
@@ -323,12 +523,139 @@ int janus_rtp_forwarder_add_rtcp(janus_rtp_forwarder *rf, int rtcp_port,
 	}
 	janus_rtp_header rtp = { 0 };
 	rtp.version = 2;
+	/* Use the SSRC we forward with, so that the receiver can tell latching packets apart */
+	rtp.ssrc = htonl(rf->ssrc);
 	(void)sendto(fd, &rtp, 12, 0, address, addrlen);
 	(void)sendto(fd, &rtp, 12, 0, address, addrlen);
 	/* Done */
 	return 0;
 }
 
+/* Static helper to free a mirror of an RTP forwarder */
+static void janus_rtp_forwarder_mirror_free(janus_rtp_forwarder_mirror *mirror) {
+	g_free(mirror->host);
+	g_free(mirror);
+}
+
+/* Static helper to replace the copy of the mirrors that senders use (mirrors_mutex
+ * must be locked): the old copy is freed once whoever is using it is done */
+static void janus_rtp_forwarder_mirrors_update(janus_rtp_forwarder *rf) {
+	GPtrArray *snapshot = NULL;
+	if(rf->mirrors != NULL) {
+		snapshot = g_ptr_array_new_with_free_func((GDestroyNotify)janus_rtp_forwarder_mirror_free);
+		GList *temp = rf->mirrors;
+		while(temp) {
+			janus_rtp_forwarder_mirror *mirror = g_malloc(sizeof(janus_rtp_forwarder_mirror));
+			memcpy(mirror, temp->data, sizeof(janus_rtp_forwarder_mirror));
+			mirror->host = g_strdup(mirror->host);
+			g_ptr_array_add(snapshot, mirror);
+			temp = temp->next;
+		}
+	}
+	if(rf->mirrors_snapshot != NULL)
+		g_ptr_array_unref(rf->mirrors_snapshot);
+	rf->mirrors_snapshot = snapshot;
+}
+
+/* Add a mirror to an existing RTP forwarder */
+int janus_rtp_forwarder_add_mirror(janus_rtp_forwarder *rf, const char *host, int port) {
+	if(rf == NULL || g_atomic_int_get(&rf->destroyed) || rf->is_data || host == NULL || port < 1 || port > 65535)
+		return -1;
+	janus_rtp_forwarder_mirror *mirror = g_malloc0(sizeof(janus_rtp_forwarder_mirror));
+	/* Check if the host address is IPv4 or IPv6 */
+	if(strstr(host, ":") != NULL) {
+		struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&mirror->addr;
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port = htons(port);
+		if(inet_pton(AF_INET6, host, &addr6->sin6_addr) != 1) {
+			JANUS_LOG(LOG_ERR, "Invalid mirror address (%s)\n", host);
+			g_free(mirror);
+			return -2;
+		}
+		mirror->addrlen = sizeof(struct sockaddr_in6);
+	} else {
+		struct sockaddr_in *addr4 = (struct sockaddr_in *)&mirror->addr;
+		addr4->sin_family = AF_INET;
+		addr4->sin_port = htons(port);
+		if(inet_pton(AF_INET, host, &addr4->sin_addr) != 1) {
+			JANUS_LOG(LOG_ERR, "Invalid mirror address (%s)\n", host);
+			g_free(mirror);
+			return -2;
+		}
+		mirror->addrlen = sizeof(struct sockaddr_in);
+	}
+	mirror->host = g_strdup(host);
+	mirror->port = port;
+	janus_mutex_lock(&rf->mirrors_mutex);
+	rf->mirrors = g_list_append(rf->mirrors, mirror);
+	janus_rtp_forwarder_mirrors_update(rf);
+	g_atomic_int_inc(&rf->mirrors_num);
+	janus_mutex_unlock(&rf->mirrors_mutex);
+	JANUS_LOG(LOG_VERB, "Added mirror %s:%d to RTP forwarder %"SCNu32"\n", host, port, rf->stream_id);
+	return 0;
+}
+
+/* Remove a mirror from an existing RTP forwarder */
+int janus_rtp_forwarder_remove_mirror(janus_rtp_forwarder *rf, const char *host, int port) {
+	if(rf == NULL || host == NULL)
+		return -1;
+	janus_mutex_lock(&rf->mirrors_mutex);
+	GList *temp = rf->mirrors;
+	while(temp) {
+		janus_rtp_forwarder_mirror *mirror = (janus_rtp_forwarder_mirror *)temp->data;
+		if(mirror->port == port && !strcmp(mirror->host, host))
+			break;
+		temp = temp->next;
+	}
+	if(temp == NULL) {
+		janus_mutex_unlock(&rf->mirrors_mutex);
+		return -1;
+	}
+	janus_rtp_forwarder_mirror_free((janus_rtp_forwarder_mirror *)temp->data);
+	rf->mirrors = g_list_delete_link(rf->mirrors, temp);
+	janus_rtp_forwarder_mirrors_update(rf);
+	g_atomic_int_dec_and_test(&rf->mirrors_num);
+	janus_mutex_unlock(&rf->mirrors_mutex);
+	JANUS_LOG(LOG_VERB, "Removed mirror %s:%d from RTP forwarder %"SCNu32"\n", host, port, rf->stream_id);
+	return 0;
+}
+
+/* Get a reference to the current copy of the mirrors of a forwarder, if any:
+ * packets are then sent without holding the mutex, and changes to the list
+ * made in the meanwhile only affect the packets that come after */
+static GPtrArray *janus_rtp_forwarder_mirrors_get(janus_rtp_forwarder *rf) {
+	if(g_atomic_int_get(&rf->mirrors_num) == 0)
+		return NULL;
+	janus_mutex_lock(&rf->mirrors_mutex);
+	GPtrArray *mirrors = rf->mirrors_snapshot ? g_ptr_array_ref(rf->mirrors_snapshot) : NULL;
+	janus_mutex_unlock(&rf->mirrors_mutex);
+	return mirrors;
+}
+
+/* Helper to send a packet to the recipient of a forwarder, and its mirrors */
+static void janus_rtp_forwarder_send_packet(janus_rtp_forwarder *rf, char *buffer, int len) {
+	struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
+		(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
+	size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
+	if(sendto(rf->udp_fd, buffer, len, 0, address, addrlen) < 0) {
+		JANUS_LOG(LOG_HUGE, "Error forwarding %s %s packet... %s (len=%d)...\n",
+			(rf->is_srtp ? "SRTP" : "RTP"), (rf->is_video ? "video" : "audio"), g_strerror(errno), len);
+	}
+	GPtrArray *mirrors = janus_rtp_forwarder_mirrors_get(rf);
+	if(mirrors == NULL)
+		return;
+	guint m = 0;
+	for(m=0; m<mirrors->len; m++) {
+		janus_rtp_forwarder_mirror *mirror = g_ptr_array_index(mirrors, m);
+		if(sendto(rf->udp_fd, buffer, len, 0, (struct sockaddr *)&mirror->addr, mirror->addrlen) < 0) {
+			JANUS_LOG(LOG_HUGE, "Error forwarding %s %s packet to mirror %s:%d... %s (len=%d)...\n",
+				(rf->is_srtp ? "SRTP" : "RTP"), (rf->is_video ? "video" : "audio"),
+				mirror->host, mirror->port, g_strerror(errno), len);
+		}
+	}
+	g_ptr_array_unref(mirrors);
+}
+
 /* Simplified frontend to the forwarder function */
 void janus_rtp_forwarder_send_rtp(janus_rtp_forwarder *rf, char *buffer, int len, int substream) {
 	janus_rtp_forwarder_send_rtp_full(rf, buffer, len, substream, NULL, NULL, JANUS_VIDEOCODEC_NONE, NULL);
@@ -367,16 +694,24 @@ void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, in
 		rtp->type = rf->payload_type;
 	if(rf->ssrc > 0)
 		rtp->ssrc = htonl(rf->ssrc);
-	/* Check if this is an RTP or SRTP forwarder */
-	if(!rf->is_srtp) {
-		/* Plain RTP */
-		struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
-			(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
-		size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
-		if(sendto(rf->udp_fd, buffer, len, 0, address, addrlen) < 0) {
-			JANUS_LOG(LOG_HUGE, "Error forwarding RTP %s packet... %s (len=%d)...\n",
-				(rf->is_video ? "video" : "audio"), g_strerror(errno), len);
+	/* Check if we should queue the packet, or send it right away */
+	if(rf->queue != NULL) {
+		/* Queue a copy of the packet for the sender threads (with room for the SRTP tag) */
+		janus_rtp_forwarder_packet *pkt = g_malloc(sizeof(janus_rtp_forwarder_packet) + len + SRTP_MAX_TAG_LEN);
+		pkt->length = len;
+		memcpy(pkt->buffer, buffer, len);
+		if(!janus_ring_push(rf->queue, pkt)) {
+			/* The queue is full, drop the packet */
+			g_free(pkt);
+			g_atomic_int_inc(&rf->dropped);
+		} else if(g_atomic_int_compare_and_exchange(&rf->scheduled, 0, 1)) {
+			/* Wake a sender thread, which will keep a reference until it's done */
+			janus_refcount_increase(&rf->ref);
+			g_async_queue_push(rtpfwd_queue, rf);
 		}
+	} else if(!rf->is_srtp) {
+		/* Plain RTP */
+		janus_rtp_forwarder_send_packet(rf, buffer, len);
 	} else {
 		/* SRTP: encrypt the packet before sending it */
 		char sbuf[1500];
@@ -390,13 +725,8 @@ void janus_rtp_forwarder_send_rtp_full(janus_rtp_forwarder *rf, char *buffer, in
 			JANUS_LOG(LOG_ERR, "Error encrypting %s packet... %s (len=%d-->%d, ts=%"SCNu32", seq=%"SCNu16")...\n",
 				(rf->is_video ? "Video" : "Audio"), janus_srtp_error_str(res), len, protected, timestamp, seq);
 		} else {
-			struct sockaddr *address = (rf->serv_addr.sin_family == AF_INET ?
-				(struct sockaddr *)&rf->serv_addr : (struct sockaddr *)&rf->serv_addr6);
-			size_t addrlen = (rf->serv_addr.sin_family == AF_INET ? sizeof(rf->serv_addr) : sizeof(rf->serv_addr6));
-			if(sendto(rf->udp_fd, sbuf, protected, 0, address, addrlen) < 0) {
-				JANUS_LOG(LOG_HUGE, "Error forwarding SRTP %s packet... %s (len=%d)...\n",
-					(rf->is_video ? "video" : "audio"), g_strerror(errno), protected);
-			}
+			/* Encrypted once, even if there are mirrors to send it to */
+			janus_rtp_forwarder_send_packet(rf, sbuf, protected);
 		}
 	}
 	/* Restore original values of the RTP payload before returning */
@@ -429,6 +759,7 @@ static void janus_rtp_forwarder_unref(janus_rtp_forwarder *rf) {
 		janus_refcount_decrease(&rf->ref);
 }
 
+
 /* Static helper to free an RTP forwarder instance when the reference goes to 0 */
 static void janus_rtp_forwarder_free(const janus_refcount *f_ref) {
 	janus_rtp_forwarder *rf = janus_refcount_containerof(f_ref, janus_rtp_forwarder, ref);
@@ -438,6 +769,16 @@ static void janus_rtp_forwarder_free(const janus_refcount *f_ref) {
 		srtp_dealloc(rf->srtp_ctx);
 		g_free(rf->srtp_policy.key);
 	}
+	if(rf->queue != NULL) {
+		gpointer pkt = NULL;
+		while((pkt = janus_ring_pop(rf->queue)) != NULL)
+			g_free(pkt);
+		janus_ring_destroy(rf->queue);
+	}
+	g_list_free_full(rf->mirrors, (GDestroyNotify)janus_rtp_forwarder_mirror_free);
+	if(rf->mirrors_snapshot != NULL)
+		g_ptr_array_unref(rf->mirrors_snapshot);
+	janus_mutex_destroy(&rf->mirrors_mutex);
 	g_free(rf->context);
 	g_free(rf->metadata);
 	g_free(rf);
@@ -18,14 +18,37 @@
 
 #include "rtp.h"
 #include "rtpsrtp.h"
+#include "ring.h"
 
 
+/* \brief Configure RTP forwarders to send packets asynchronously
+ * \note By default packets are sent by whichever thread forwards them: when
+ * a sender pool is configured, forwarders queue packets instead, and the pool
+ * takes care of encrypting (if needed) and sending them. This must be called
+ * before janus_rtp_forwarders_init() to have any effect.
+ * @param[in] threads Number of sender threads to spawn (0 disables the pool) */
+void janus_rtp_forwarders_set_async(int threads);
+/* \brief Get the number of sender threads used by RTP forwarders, if any
+ * @returns The number of sender threads, or 0 if packets are sent synchronously */
+int janus_rtp_forwarders_get_async(void);
 /* \brief RTP forwarders code initialization
  * @returns 0 in case of success, a negative integer on errors */
 int janus_rtp_forwarders_init(void);
 /* \brief RTP forwarders code de-initialization */
 void janus_rtp_forwarders_deinit(void);
 
+/*! \brief Additional recipient of the packets sent by an RTP forwarder */
+typedef struct janus_rtp_forwarder_mirror {
+	/*! \brief Address of the recipient, as provided */
+	char *host;
+	/*! \brief Port of the recipient */
+	int port;
+	/*! \brief Recipient address */
+	struct sockaddr_storage addr;
+	/*! \brief Length of the recipient address */
+	socklen_t addrlen;
+} janus_rtp_forwarder_mirror;
+
 /*! \brief Helper struct for implementing RTP forwarders */
 typedef struct janus_rtp_forwarder {
 	/* \brief Opaque pointer to the owner of this forwarder */
@@ -70,6 +93,21 @@ typedef struct janus_rtp_forwarder {
 	srtp_t srtp_ctx;
 	/* \brief The SRTP policy, in case SRTP is enabled */
 	srtp_policy_t srtp_policy;
+	/* \brief Queue of packets to send, in case asynchronous sending is enabled */
+	janus_ring *queue;
+	/* \brief Whether this forwarder is waiting for (or being served by) a sender thread */
+	volatile gint scheduled;
+	/* \brief Number of packets dropped because the queue was full (asynchronous sending only) */
+	volatile gint dropped;
+	/* \brief Additional recipients of the same packets (janus_rtp_forwarder_mirror), if any */
+	GList *mirrors;
+	/* \brief Number of additional recipients */
+	volatile gint mirrors_num;
+	/* \brief Copy of the additional recipients, replaced (never modified) when
+	 * the list changes, so that senders can use it without holding the mutex */
+	GPtrArray *mirrors_snapshot;
+	/* \brief Mutex to protect the list of additional recipients */
+	janus_mutex mirrors_mutex;
 	/* \brief Opaque metadata property, in case it's useful to the owner
 	 * \note This can be anything (e.g., a string, an allocated struct, etc.),
 	 * as long as it can be freed with a single call to g_free(), as
@@ -110,6 +148,23 @@ janus_rtp_forwarder *janus_rtp_forwarder_create(const char *ctx,
  * @returns 0 if successful, a negative integer otherwise */
 int janus_rtp_forwarder_add_rtcp(janus_rtp_forwarder *rf, int rtcp_port,
 	void (*rtcp_callback)(janus_rtp_forwarder *rf, char *buffer, int len));
+/*! \brief Helper method to add a mirror to an existing forwarder, that is an
+ * additional recipient for the very same packets: this allows the same stream
+ * to be forwarded to multiple destinations, with packets processed (and, in
+ * case SRTP is used, encrypted) only once and then sent to all of them
+ * @note The address of the mirror must be an IPv4 or IPv6 address, not a domain
+ * @param[in] rf The janus_rtp_forwarder instance to add the mirror to
+ * @param[in] host The address of the mirror
+ * @param[in] port The port of the mirror
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_rtp_forwarder_add_mirror(janus_rtp_forwarder *rf, const char *host, int port);
+/*! \brief Helper method to remove a mirror from an existing forwarder
+ * @note The mirror is matched by the same address and port it was added with
+ * @param[in] rf The janus_rtp_forwarder instance to remove the mirror from
+ * @param[in] host The address of the mirror
+ * @param[in] port The port of the mirror
+ * @returns 0 if successful, a negative integer otherwise (e.g., no such mirror) */
+int janus_rtp_forwarder_remove_mirror(janus_rtp_forwarder *rf, const char *host, int port);
 /*! \brief Helper method to forward an RTP packet within the context of a forwarder
  * @note This is equivalent to calling janus_rtp_forwarder_send_rtp_full
  * with all the extra arguments that are usually not required set to NULL
@@ -127,11 +127,76 @@ static janus_mutex sctp_mutex;
 static GHashTable *sctp_ids = NULL;
 static void janus_sctp_association_unref(janus_sctp_association *sctp);
 
+/* Whether associations should only be created when actually needed */
+static gboolean sctp_lazy = FALSE;
+/* Number of associations that were created lazily */
+static volatile gint sctp_lazy_created = 0;
+
+#ifdef HAVE_USRSCTP_NOTHREADS
+/* When supported, we drive the SCTP timers ourselves, rather than rely on
+ * the usrsctp thread for that: this allows us to track how expensive that
+ * is, and to avoid ticking the stack at all when there are no associations */
+#define JANUS_SCTP_TIMER_TICK	10
+static GThread *sctp_timer_thread = NULL;
+static volatile gint sctp_timer_stop = 0;
+static janus_mutex sctp_timer_mutex = JANUS_MUTEX_INITIALIZER;
+static guint64 sctp_timer_ticks = 0, sctp_timer_idle = 0, sctp_timer_total = 0, sctp_timer_max = 0;
+
+static gpointer janus_sctp_timer_thread(gpointer data) {
+	JANUS_LOG(LOG_VERB, "Joining SCTP timer thread\n");
+	gint64 last = janus_get_monotonic_time(), now = 0, cost = 0;
+	guint associations = 0;
+	uint32_t elapsed = 0;
+	while(!g_atomic_int_get(&sctp_timer_stop)) {
+		g_usleep(JANUS_SCTP_TIMER_TICK * G_TIME_SPAN_MILLISECOND);
+		now = janus_get_monotonic_time();
+		elapsed = (now - last) / G_TIME_SPAN_MILLISECOND;
+		if(elapsed == 0)
+			continue;
+		/* Keep the remainder, so that we don't drift over time */
+		last += (gint64)elapsed * G_TIME_SPAN_MILLISECOND;
+		janus_mutex_lock(&sctp_mutex);
+		associations = sctp_ids ? g_hash_table_size(sctp_ids) : 0;
+		janus_mutex_unlock(&sctp_mutex);
+		if(associations == 0) {
+			/* Nothing to do */
+			janus_mutex_lock(&sctp_timer_mutex);
+			sctp_timer_idle++;
+			janus_mutex_unlock(&sctp_timer_mutex);
+			continue;
+		}
+		usrsctp_handle_timers(elapsed);
+		cost = janus_get_monotonic_time() - now;
+		janus_mutex_lock(&sctp_timer_mutex);
+		sctp_timer_ticks++;
+		sctp_timer_total += cost;
+		if((guint64)cost > sctp_timer_max)
+			sctp_timer_max = cost;
+		janus_mutex_unlock(&sctp_timer_mutex);
+	}
+	JANUS_LOG(LOG_VERB, "Leaving SCTP timer thread\n");
+	return NULL;
+}
+#endif
+
 /* SCTP management code */
 static gboolean sctp_running;
 int janus_sctp_init(void) {
 	/* Initialize the SCTP stack */
+#ifdef HAVE_USRSCTP_NOTHREADS
+	usrsctp_init_nothreads(0, janus_sctp_data_to_dtls, NULL);
+	GError *error = NULL;
+	sctp_timer_thread = g_thread_try_new("sctp timers", janus_sctp_timer_thread, NULL, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the SCTP timer thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		usrsctp_finish();
+		return -1;
+	}
+#else
 	usrsctp_init(0, janus_sctp_data_to_dtls, NULL);
+#endif
 	sctp_running = TRUE;
 
 #ifdef DEBUG_SCTP
@@ -149,6 +214,13 @@ int janus_sctp_init(void) {
 }
 
 void janus_sctp_deinit(void) {
+#ifdef HAVE_USRSCTP_NOTHREADS
+	if(sctp_timer_thread != NULL) {
+		g_atomic_int_set(&sctp_timer_stop, 1);
+		g_thread_join(sctp_timer_thread);
+		sctp_timer_thread = NULL;
+	}
+#endif
 	usrsctp_finish();
 	sctp_running = FALSE;
 	janus_mutex_lock(&sctp_mutex);
@@ -156,6 +228,43 @@ void janus_sctp_deinit(void) {
 	janus_mutex_unlock(&sctp_mutex);
 }
 
+void janus_sctp_set_lazy(gboolean enabled) {
+	sctp_lazy = enabled;
+	JANUS_LOG(LOG_INFO, "SCTP associations will be created %s\n",
+		sctp_lazy ? "when the first message is exchanged" : "as soon as DTLS is up");
+}
+
+gboolean janus_sctp_is_lazy(void) {
+	return sctp_lazy;
+}
+
+void janus_sctp_lazy_created(void) {
+	g_atomic_int_inc(&sctp_lazy_created);
+}
+
+json_t *janus_sctp_info(void) {
+	json_t *info = json_object();
+	janus_mutex_lock(&sctp_mutex);
+	json_object_set_new(info, "associations", json_integer(sctp_ids ? g_hash_table_size(sctp_ids) : 0));
+	janus_mutex_unlock(&sctp_mutex);
+	json_object_set_new(info, "lazy", sctp_lazy ? json_true() : json_false());
+	if(sctp_lazy)
+		json_object_set_new(info, "lazy_created", json_integer(g_atomic_int_get(&sctp_lazy_created)));
+#ifdef HAVE_USRSCTP_NOTHREADS
+	json_t *timers = json_object();
+	janus_mutex_lock(&sctp_timer_mutex);
+	json_object_set_new(timers, "tick", json_integer(JANUS_SCTP_TIMER_TICK));
+	json_object_set_new(timers, "ticks", json_integer(sctp_timer_ticks));
+	json_object_set_new(timers, "idle_ticks", json_integer(sctp_timer_idle));
+	json_object_set_new(timers, "total_us", json_integer(sctp_timer_total));
+	json_object_set_new(timers, "avg_us", json_integer(sctp_timer_ticks ? sctp_timer_total/sctp_timer_ticks : 0));
+	json_object_set_new(timers, "max_us", json_integer(sctp_timer_max));
+	janus_mutex_unlock(&sctp_timer_mutex);
+	json_object_set_new(info, "timers", timers);
+#endif
+	return info;
+}
+
 static void janus_sctp_association_unref(janus_sctp_association *sctp) {
 	if(sctp)
 		janus_refcount_decrease(&sctp->ref);
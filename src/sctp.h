@@ -42,6 +42,7 @@
 #include <errno.h>
 #include <usrsctp.h>
 #include <glib.h>
+#include <jansson.h>
 
 #include "mutex.h"
 #include "refcount.h"
@@ -54,6 +55,24 @@ int janus_sctp_init(void);
 /*! \brief SCTP stuff de-initialization */
 void janus_sctp_deinit(void);
 
+/*! \brief Method to configure whether SCTP associations should be created lazily
+ * \details By default, an SCTP association is created as soon as the DTLS
+ * handshake is over, when DataChannels were negotiated. In lazy mode, it's
+ * only created when the peer starts talking SCTP, or when a plugin sends
+ * the first message: this saves resources (and SCTP timer ticks) for
+ * PeerConnections that negotiate DataChannels but never use them.
+ * @param[in] enabled Whether lazy mode should be enabled */
+void janus_sctp_set_lazy(gboolean enabled);
+/*! \brief Method to check whether SCTP associations are created lazily
+ * @returns TRUE if lazy mode is enabled, FALSE otherwise */
+gboolean janus_sctp_is_lazy(void);
+/*! \brief Helper to keep track of associations that were created lazily */
+void janus_sctp_lazy_created(void);
+/*! \brief Helper to get info on the SCTP stack (associations, lazy mode and
+ * the cost of the SCTP timers, when Janus drives them itself)
+ * @returns A JSON object with the info */
+json_t *janus_sctp_info(void);
+
 
 #define BUFFER_SIZE (1<<16)
 #define NUMBER_OF_CHANNELS (150)
@@ -152,6 +152,10 @@ janus_sdp_mline *janus_sdp_mline_find_by_index(janus_sdp *sdp, int index) {
 int janus_sdp_mline_remove(janus_sdp *sdp, janus_sdp_mtype type) {
 	if(sdp == NULL)
 		return -1;
+	if(sdp->arena) {
+		JANUS_LOG(LOG_ERR, "Can't remove m-line from a read-only SDP\n");
+		return -1;
+	}
 	GList *ml = sdp->m_lines;
 	while(ml) {
 		janus_sdp_mline *m = (janus_sdp_mline *)ml->data;
@@ -295,7 +299,127 @@ const char *janus_sdp_oa_type_str(janus_sdp_oa_type type) {
 	return NULL;
 }
 
-janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
+/* Parser state: when an arena is used, everything (including the janus_sdp
+ * instance itself, at the very beginning) is allocated from a single buffer */
+typedef struct janus_sdp_parser {
+	char *arena;
+	size_t size, offset;
+} janus_sdp_parser;
+#define JANUS_SDP_ARENA_ALIGN(size)	(((size) + 15) & ~((size_t)15))
+
+/* Objects in an arena don't need to be freed one by one */
+static void janus_sdp_arena_nofree(const janus_refcount *ref) {
+}
+
+static void janus_sdp_arena_free(const janus_refcount *sdp_ref) {
+	janus_sdp *sdp = janus_refcount_containerof(sdp_ref, janus_sdp, ref);
+	/* The SDP instance is the start of the arena */
+	g_free(sdp);
+}
+
+static void *janus_sdp_parser_alloc(janus_sdp_parser *parser, size_t size) {
+	if(parser->arena == NULL)
+		return g_malloc0(size);
+	size_t offset = JANUS_SDP_ARENA_ALIGN(parser->offset);
+	if(offset + size > parser->size)
+		return NULL;
+	parser->offset = offset + size;
+	memset(parser->arena + offset, 0, size);
+	return parser->arena + offset;
+}
+
+static char *janus_sdp_parser_strdup(janus_sdp_parser *parser, const char *str) {
+	if(parser->arena == NULL)
+		return g_strdup(str);
+	size_t len = strlen(str) + 1;
+	if(parser->offset + len > parser->size)
+		return NULL;
+	char *dup = parser->arena + parser->offset;
+	memcpy(dup, str, len);
+	parser->offset += len;
+	return dup;
+}
+
+/* Strings that stay NUL-terminated in our copy of the SDP text can be
+ * referenced directly when using an arena, rather than copied */
+static char *janus_sdp_parser_span(janus_sdp_parser *parser, char *str) {
+	return parser->arena ? str : g_strdup(str);
+}
+
+static GList *janus_sdp_parser_prepend(janus_sdp_parser *parser, GList *list, gpointer data) {
+	if(parser->arena == NULL)
+		return g_list_prepend(list, data);
+	GList *node = janus_sdp_parser_alloc(parser, sizeof(GList));
+	if(node == NULL)
+		return list;
+	node->data = data;
+	node->next = list;
+	if(list)
+		list->prev = node;
+	return node;
+}
+
+static void janus_sdp_parser_refcount_init(janus_sdp_parser *parser, janus_refcount *ref, void (*free_fn)(const janus_refcount *)) {
+	janus_refcount_init(ref, parser->arena ? janus_sdp_arena_nofree : free_fn);
+}
+
+/* How large an arena must be to parse the provided SDP: we look at how many
+ * lines and spaces there are, to know how many objects and list nodes we may need */
+static size_t janus_sdp_arena_size(const char *sdp, size_t len) {
+	size_t lines = 1, spaces = 0, i = 0;
+	for(i=0; i<len; i++) {
+		if(sdp[i] == '\n')
+			lines++;
+		else if(sdp[i] == ' ')
+			spaces++;
+	}
+	size_t object = MAX(sizeof(janus_sdp_mline), sizeof(janus_sdp_attribute));
+	return JANUS_SDP_ARENA_ALIGN(sizeof(janus_sdp)) +
+		/* Our copy of the text */
+		(len + 1) +
+		/* An m-line or attribute per line, and a list node for each of them */
+		lines * (JANUS_SDP_ARENA_ALIGN(object) + JANUS_SDP_ARENA_ALIGN(sizeof(GList))) +
+		/* Formats and payload types for each token in m-lines */
+		(spaces + lines) * 2 * JANUS_SDP_ARENA_ALIGN(sizeof(GList)) +
+		/* Strings we copy (at most two per line, and never longer than the line),
+		 * plus the padding the allocations that follow them may need */
+		(len + 2 * lines) + lines * 32 + 16;
+}
+
+/* Parse an a= attribute (the line must not include the "a=" prefix) */
+static janus_sdp_attribute *janus_sdp_parse_attribute(janus_sdp_parser *parser, char *line, char *error, size_t errlen) {
+	char *semicolon = strchr(line, ':');
+	if(semicolon != NULL && *(semicolon+1) == '\0') {
+		if(error)
+			g_snprintf(error, errlen, "Invalid a= line: %s", line);
+		return NULL;
+	}
+	janus_sdp_attribute *a = janus_sdp_parser_alloc(parser, sizeof(janus_sdp_attribute));
+	if(a == NULL) {
+		if(error)
+			g_snprintf(error, errlen, "SDP arena exhausted");
+		return NULL;
+	}
+	janus_sdp_parser_refcount_init(parser, &a->ref, janus_sdp_attribute_free);
+	if(semicolon == NULL) {
+		a->name = janus_sdp_parser_span(parser, line);
+		a->value = NULL;
+	} else {
+		a->direction = JANUS_SDP_DEFAULT;
+		if(strstr(line, "/sendonly"))
+			a->direction = JANUS_SDP_SENDONLY;
+		else if(strstr(line, "/recvonly"))
+			a->direction = JANUS_SDP_RECVONLY;
+		if(strstr(line, "/inactive"))
+			a->direction = JANUS_SDP_INACTIVE;
+		*semicolon = '\0';
+		a->name = janus_sdp_parser_span(parser, line);
+		a->value = janus_sdp_parser_span(parser, semicolon+1);
+	}
+	return a;
+}
+
+static janus_sdp *janus_sdp_parse_internal(const char *sdp, char *error, size_t errlen, gboolean arena) {
 	if(!sdp)
 		return NULL;
 	if(strstr(sdp, "v=") != sdp) {
@@ -303,9 +427,26 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 			g_snprintf(error, errlen, "Invalid SDP (doesn't start with v=)");
 		return NULL;
 	}
-	janus_sdp *imported = g_malloc0(sizeof(janus_sdp));
+	/* We work on a copy of the text, which we split in place */
+	janus_sdp_parser parser = { 0 };
+	janus_sdp *imported = NULL;
+	size_t len = strlen(sdp);
+	char *text = NULL;
+	if(arena) {
+		parser.size = janus_sdp_arena_size(sdp, len);
+		parser.arena = g_malloc(parser.size);
+		imported = janus_sdp_parser_alloc(&parser, sizeof(janus_sdp));
+		text = parser.arena + parser.offset;
+		memcpy(text, sdp, len + 1);
+		parser.offset += len + 1;
+		imported->arena = TRUE;
+		janus_refcount_init(&imported->ref, janus_sdp_arena_free);
+	} else {
+		imported = g_malloc0(sizeof(janus_sdp));
+		text = g_strdup(sdp);
+		janus_refcount_init(&imported->ref, janus_sdp_free);
+	}
 	g_atomic_int_set(&imported->destroyed, 0);
-	janus_refcount_init(&imported->ref, janus_sdp_free);
 	imported->o_ipv4 = TRUE;
 	imported->c_ipv4 = TRUE;
 
@@ -313,348 +454,296 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 	janus_sdp_mline *mline = NULL;
 	int mlines = 0;
 
-	gchar **parts = g_strsplit(sdp, "\n", -1);
-	if(parts) {
-		int index = 0;
-		char *line = NULL, *cr = NULL;
-		while(success && (line = parts[index]) != NULL) {
-			cr = strchr(line, '\r');
-			if(cr != NULL)
-				*cr = '\0';
-			if(*line == '\0') {
-				if(cr != NULL)
-					*cr = '\r';
-				index++;
-				continue;
-			}
-			if(strnlen(line, 3) < 3) {
-				if(error)
-					g_snprintf(error, errlen, "Invalid line (%zu bytes): %s", strlen(line), line);
-				success = FALSE;
-				break;
-			}
-			if(*(line+1) != '=') {
-				if(error)
-					g_snprintf(error, errlen, "Invalid line (2nd char is not '='): %s", line);
-				success = FALSE;
-				break;
-			}
-			char c = *line;
-			if(mline == NULL) {
-				/* Global stuff */
-				switch(c) {
-					case 'v': {
-						if(sscanf(line, "v=%d", &imported->version) != 1) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid v= line: %s", line);
-							success = FALSE;
-							break;
-						}
+	char *next = text, *line = NULL, *cr = NULL, *nl = NULL;
+	while(success && next != NULL) {
+		line = next;
+		nl = strchr(line, '\n');
+		if(nl != NULL) {
+			*nl = '\0';
+			next = nl+1;
+		} else {
+			next = NULL;
+		}
+		cr = strchr(line, '\r');
+		if(cr != NULL)
+			*cr = '\0';
+		if(*line == '\0')
+			continue;
+		if(strnlen(line, 3) < 3) {
+			if(error)
+				g_snprintf(error, errlen, "Invalid line (%zu bytes): %s", strlen(line), line);
+			success = FALSE;
+			break;
+		}
+		if(*(line+1) != '=') {
+			if(error)
+				g_snprintf(error, errlen, "Invalid line (2nd char is not '='): %s", line);
+			success = FALSE;
+			break;
+		}
+		char c = *line;
+		if(mline != NULL && c == 'm') {
+			/* Current m-line ended, back to global parsing */
+			if(mline->attributes)
+				mline->attributes = g_list_reverse(mline->attributes);
+			mline = NULL;
+		}
+		if(mline == NULL) {
+			/* Global stuff */
+			switch(c) {
+				case 'v': {
+					if(sscanf(line, "v=%d", &imported->version) != 1) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid v= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'o': {
-						if(imported->o_name || imported->o_addr) {
-							if(error)
-								g_snprintf(error, errlen, "Multiple o= lines: %s", line);
-							success = FALSE;
-							break;
-						}
-						char name[256], addrtype[6], addr[256];
-						if(sscanf(line, "o=%255s %"SCNu64" %"SCNu64" IN %5s %255s",
-								name, &imported->o_sessid, &imported->o_version, addrtype, addr) != 5) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid o= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							imported->o_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							imported->o_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid o= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						imported->o_name = g_strdup(name);
-						imported->o_addr = g_strdup(addr);
+					break;
+				}
+				case 'o': {
+					if(imported->o_name || imported->o_addr) {
+						if(error)
+							g_snprintf(error, errlen, "Multiple o= lines: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 's': {
-						if(imported->s_name) {
-							if(error)
-								g_snprintf(error, errlen, "Multiple s= lines: %s", line);
-							success = FALSE;
-							break;
-						}
-						imported->s_name = g_strdup(line+2);
+					char name[256], addrtype[6], addr[256];
+					if(sscanf(line, "o=%255s %"SCNu64" %"SCNu64" IN %5s %255s",
+							name, &imported->o_sessid, &imported->o_version, addrtype, addr) != 5) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid o= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 't': {
-						if(sscanf(line, "t=%"SCNu64" %"SCNu64, &imported->t_start, &imported->t_stop) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid t= line: %s", line);
-							success = FALSE;
-							break;
-						}
+					if(!strcasecmp(addrtype, "IP4"))
+						imported->o_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						imported->o_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid o= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
 						break;
 					}
-					case 'c': {
-						if(imported->c_addr) {
-							if(error)
-								g_snprintf(error, errlen, "Multiple global c= lines: %s", line);
-							success = FALSE;
-							break;
-						}
-						char addrtype[6], addr[256];
-						if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							imported->c_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							imported->c_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						imported->c_addr = g_strdup(addr);
+					imported->o_name = janus_sdp_parser_strdup(&parser, name);
+					imported->o_addr = janus_sdp_parser_strdup(&parser, addr);
+					break;
+				}
+				case 's': {
+					if(imported->s_name) {
+						if(error)
+							g_snprintf(error, errlen, "Multiple s= lines: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'a': {
-						janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
-						janus_refcount_init(&a->ref, janus_sdp_attribute_free);
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL) {
-							a->name = g_strdup(line);
-							a->value = NULL;
-						} else {
-							if(*(semicolon+1) == '\0') {
-								janus_sdp_attribute_destroy(a);
-								if(error)
-									g_snprintf(error, errlen, "Invalid a= line: %s", line);
-								success = FALSE;
-								break;
-							}
-							*semicolon = '\0';
-							a->name = g_strdup(line);
-							a->value = g_strdup(semicolon+1);
-							a->direction = JANUS_SDP_DEFAULT;
-							*semicolon = ':';
-							if(strstr(line, "/sendonly"))
-								a->direction = JANUS_SDP_SENDONLY;
-							else if(strstr(line, "/recvonly"))
-								a->direction = JANUS_SDP_RECVONLY;
-							if(strstr(line, "/inactive"))
-								a->direction = JANUS_SDP_INACTIVE;
-						}
-						imported->attributes = g_list_prepend(imported->attributes, a);
+					imported->s_name = janus_sdp_parser_span(&parser, line+2);
+					break;
+				}
+				case 't': {
+					if(sscanf(line, "t=%"SCNu64" %"SCNu64, &imported->t_start, &imported->t_stop) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid t= line: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'm': {
-						janus_sdp_mline *m = g_malloc0(sizeof(janus_sdp_mline));
-						g_atomic_int_set(&m->destroyed, 0);
-						janus_refcount_init(&m->ref, janus_sdp_mline_free);
-						/* Start with media type, port and protocol */
-						char type[32];
-						char proto[64];
-						if(strnlen(line, 200 + 1) > 200) {
-							janus_sdp_mline_destroy(m);
-							if(error)
-								g_snprintf(error, errlen, "Invalid m= line (too long): %zu", strlen(line));
-							success = FALSE;
-							break;
-						}
-						if(sscanf(line, "m=%31s %"SCNu16" %63s %*s", type, &m->port, proto) != 3) {
-							janus_sdp_mline_destroy(m);
-							if(error)
-								g_snprintf(error, errlen, "Invalid m= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						m->index = mlines;
-						mlines++;
-						m->type = janus_sdp_parse_mtype(type);
-						if(m->type == JANUS_SDP_OTHER) {
-							janus_sdp_mline_destroy(m);
-							if(error)
-								g_snprintf(error, errlen, "Invalid m= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						m->type_str = g_strdup(type);
-						m->proto = g_strdup(proto);
-						m->direction = JANUS_SDP_SENDRECV;
-						m->c_ipv4 = TRUE;
-						/* Now let's check the payload types/formats */
-						gchar **mline_parts = g_strsplit(line+2, " ", -1);
-						if(!mline_parts && (m->port > 0 || m->type == JANUS_SDP_APPLICATION)) {
-							janus_sdp_mline_destroy(m);
-							if(error)
-								g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
-							success = FALSE;
-							break;
-						} else {
-							int mindex = 0;
-							while(mline_parts[mindex]) {
-								if(mindex < 3) {
-									/* We've parsed these before */
-									mindex++;
-									continue;
-								}
-								/* Add string fmt */
-								m->fmts = g_list_prepend(m->fmts, g_strdup(mline_parts[mindex]));
-								/* Add numeric payload type */
-								int ptype = atoi(mline_parts[mindex]);
-								if(ptype < 0) {
-									JANUS_LOG(LOG_ERR, "Invalid payload type (%s)\n", mline_parts[mindex]);
-								} else {
-									m->ptypes = g_list_prepend(m->ptypes, GINT_TO_POINTER(ptype));
-								}
-								mindex++;
-							}
-							g_strfreev(mline_parts);
-							if(m->fmts == NULL || m->ptypes == NULL) {
-								janus_sdp_mline_destroy(m);
-								if(error)
-									g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
-								success = FALSE;
-								break;
-							}
-							m->fmts = g_list_reverse(m->fmts);
-							m->ptypes = g_list_reverse(m->ptypes);
-						}
-						/* Append to the list of m-lines */
-						imported->m_lines = g_list_prepend(imported->m_lines, m);
-						/* From now on, we parse this m-line */
-						mline = m;
+					break;
+				}
+				case 'c': {
+					if(imported->c_addr) {
+						if(error)
+							g_snprintf(error, errlen, "Multiple global c= lines: %s", line);
+						success = FALSE;
 						break;
 					}
-					default:
-						JANUS_LOG(LOG_WARN, "Ignoring '%c' property\n", c);
+					char addrtype[6], addr[256];
+					if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line: %s", line);
+						success = FALSE;
 						break;
+					}
+					if(!strcasecmp(addrtype, "IP4"))
+						imported->c_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						imported->c_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
+						break;
+					}
+					imported->c_addr = janus_sdp_parser_strdup(&parser, addr);
+					break;
 				}
-			} else {
-				/* m-line stuff */
-				switch(c) {
-					case 'c': {
-						if(mline->c_addr) {
-							if(error)
-								g_snprintf(error, errlen, "Multiple m-line c= lines: %s", line);
-							success = FALSE;
-							break;
-						}
-						char addrtype[6], addr[256];
-						if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						if(!strcasecmp(addrtype, "IP4"))
-							mline->c_ipv4 = TRUE;
-						else if(!strcasecmp(addrtype, "IP6"))
-							mline->c_ipv4 = FALSE;
-						else {
-							if(error)
-								g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
-							success = FALSE;
-							break;
-						}
-						mline->c_addr = g_strdup(addr);
+				case 'a': {
+					janus_sdp_attribute *a = janus_sdp_parse_attribute(&parser, line+2, error, errlen);
+					if(a == NULL) {
+						success = FALSE;
 						break;
 					}
-					case 'b': {
-						if(mline->b_name) {
-							JANUS_LOG(LOG_WARN, "Ignoring extra m-line b= line: %s\n", line);
-							if(cr != NULL)
-								*cr = '\r';
-							index++;
-							continue;
-						}
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL || (*(semicolon+1) == '\0')) {
-							if(error)
-								g_snprintf(error, errlen, "Invalid b= line: %s", line);
-							success = FALSE;
-							break;
-						}
-						*semicolon = '\0';
-						if(strcmp(line, "AS") && strcmp(line, "TIAS")) {
-							/* We only support b=AS and b=TIAS, skip */
-							break;
-						}
-						mline->b_name = g_strdup(line);
-						mline->b_value = atol(semicolon+1);
-						*semicolon = ':';
+					imported->attributes = janus_sdp_parser_prepend(&parser, imported->attributes, a);
+					break;
+				}
+				case 'm': {
+					janus_sdp_mline *m = janus_sdp_parser_alloc(&parser, sizeof(janus_sdp_mline));
+					if(m == NULL) {
+						if(error)
+							g_snprintf(error, errlen, "SDP arena exhausted");
+						success = FALSE;
 						break;
 					}
-					case 'a': {
-						janus_sdp_attribute *a = g_malloc0(sizeof(janus_sdp_attribute));
-						janus_refcount_init(&a->ref, janus_sdp_attribute_free);
-						line += 2;
-						char *semicolon = strchr(line, ':');
-						if(semicolon == NULL) {
-							/* Is this a media direction attribute? */
-							janus_sdp_mdirection direction = janus_sdp_parse_mdirection(line);
-							if(direction != JANUS_SDP_INVALID) {
-								janus_sdp_attribute_destroy(a);
-								mline->direction = direction;
-								break;
-							}
-							a->name = g_strdup(line);
-							a->value = NULL;
-						} else {
-							if(*(semicolon+1) == '\0') {
-								janus_sdp_attribute_destroy(a);
-								if(error)
-									g_snprintf(error, errlen, "Invalid a= line: %s", line);
-								success = FALSE;
-								break;
+					g_atomic_int_set(&m->destroyed, 0);
+					janus_sdp_parser_refcount_init(&parser, &m->ref, janus_sdp_mline_free);
+					/* Start with media type, port and protocol */
+					char type[32];
+					char proto[64];
+					if(strnlen(line, 200 + 1) > 200) {
+						janus_sdp_mline_destroy(m);
+						if(error)
+							g_snprintf(error, errlen, "Invalid m= line (too long): %zu", strlen(line));
+						success = FALSE;
+						break;
+					}
+					if(sscanf(line, "m=%31s %"SCNu16" %63s %*s", type, &m->port, proto) != 3) {
+						janus_sdp_mline_destroy(m);
+						if(error)
+							g_snprintf(error, errlen, "Invalid m= line: %s", line);
+						success = FALSE;
+						break;
+					}
+					m->index = mlines;
+					mlines++;
+					m->type = janus_sdp_parse_mtype(type);
+					if(m->type == JANUS_SDP_OTHER) {
+						janus_sdp_mline_destroy(m);
+						if(error)
+							g_snprintf(error, errlen, "Invalid m= line: %s", line);
+						success = FALSE;
+						break;
+					}
+					m->type_str = janus_sdp_parser_strdup(&parser, type);
+					m->proto = janus_sdp_parser_strdup(&parser, proto);
+					m->direction = JANUS_SDP_SENDRECV;
+					m->c_ipv4 = TRUE;
+					/* Now let's check the payload types/formats, splitting the line in place */
+					int mindex = 0;
+					char *token = line+2, *space = NULL;
+					while(token != NULL) {
+						space = strchr(token, ' ');
+						if(space != NULL)
+							*space = '\0';
+						if(mindex >= 3) {
+							/* Add string fmt */
+							m->fmts = janus_sdp_parser_prepend(&parser, m->fmts, janus_sdp_parser_span(&parser, token));
+							/* Add numeric payload type */
+							int ptype = atoi(token);
+							if(ptype < 0) {
+								JANUS_LOG(LOG_ERR, "Invalid payload type (%s)\n", token);
+							} else {
+								m->ptypes = janus_sdp_parser_prepend(&parser, m->ptypes, GINT_TO_POINTER(ptype));
 							}
-							*semicolon = '\0';
-							a->name = g_strdup(line);
-							a->value = g_strdup(semicolon+1);
-							a->direction = JANUS_SDP_DEFAULT;
-							*semicolon = ':';
-							if(strstr(line, "/sendonly"))
-								a->direction = JANUS_SDP_SENDONLY;
-							else if(strstr(line, "/recvonly"))
-								a->direction = JANUS_SDP_RECVONLY;
-							if(strstr(line, "/inactive"))
-								a->direction = JANUS_SDP_INACTIVE;
 						}
-						mline->attributes = g_list_prepend(mline->attributes, a);
+						/* The first three we parsed before */
+						mindex++;
+						token = space ? space+1 : NULL;
+					}
+					if(m->fmts == NULL || m->ptypes == NULL) {
+						janus_sdp_mline_destroy(m);
+						if(error)
+							g_snprintf(error, errlen, "Invalid m= line (no payload types/formats): %s", line);
+						success = FALSE;
+						break;
+					}
+					m->fmts = g_list_reverse(m->fmts);
+					m->ptypes = g_list_reverse(m->ptypes);
+					/* Append to the list of m-lines */
+					imported->m_lines = janus_sdp_parser_prepend(&parser, imported->m_lines, m);
+					/* From now on, we parse this m-line */
+					mline = m;
+					break;
+				}
+				default:
+					JANUS_LOG(LOG_WARN, "Ignoring '%c' property\n", c);
+					break;
+			}
+		} else {
+			/* m-line stuff */
+			switch(c) {
+				case 'c': {
+					if(mline->c_addr) {
+						if(error)
+							g_snprintf(error, errlen, "Multiple m-line c= lines: %s", line);
+						success = FALSE;
 						break;
 					}
-					case 'm': {
-						/* Current m-line ended, back to global parsing */
-						if(mline && mline->attributes)
-							mline->attributes = g_list_reverse(mline->attributes);
-						mline = NULL;
+					char addrtype[6], addr[256];
+					if(sscanf(line, "c=IN %5s %255s", addrtype, addr) != 2) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line: %s", line);
+						success = FALSE;
+						break;
+					}
+					if(!strcasecmp(addrtype, "IP4"))
+						mline->c_ipv4 = TRUE;
+					else if(!strcasecmp(addrtype, "IP6"))
+						mline->c_ipv4 = FALSE;
+					else {
+						if(error)
+							g_snprintf(error, errlen, "Invalid c= line (unsupported protocol %s): %s", addrtype, line);
+						success = FALSE;
+						break;
+					}
+					mline->c_addr = janus_sdp_parser_strdup(&parser, addr);
+					break;
+				}
+				case 'b': {
+					if(mline->b_name) {
+						JANUS_LOG(LOG_WARN, "Ignoring extra m-line b= line: %s\n", line);
 						continue;
 					}
-					default:
-						JANUS_LOG(LOG_WARN, "Ignoring '%c' property (m-line)\n", c);
+					line += 2;
+					char *semicolon = strchr(line, ':');
+					if(semicolon == NULL || (*(semicolon+1) == '\0')) {
+						if(error)
+							g_snprintf(error, errlen, "Invalid b= line: %s", line);
+						success = FALSE;
+						break;
+					}
+					*semicolon = '\0';
+					if(strcmp(line, "AS") && strcmp(line, "TIAS")) {
+						/* We only support b=AS and b=TIAS, skip */
 						break;
+					}
+					mline->b_name = janus_sdp_parser_span(&parser, line);
+					mline->b_value = atol(semicolon+1);
+					break;
+				}
+				case 'a': {
+					line += 2;
+					if(strchr(line, ':') == NULL) {
+						/* Is this a media direction attribute? */
+						janus_sdp_mdirection direction = janus_sdp_parse_mdirection(line);
+						if(direction != JANUS_SDP_INVALID) {
+							mline->direction = direction;
+							break;
+						}
+					}
+					janus_sdp_attribute *a = janus_sdp_parse_attribute(&parser, line, error, errlen);
+					if(a == NULL) {
+						success = FALSE;
+						break;
+					}
+					mline->attributes = janus_sdp_parser_prepend(&parser, mline->attributes, a);
+					break;
 				}
+				default:
+					JANUS_LOG(LOG_WARN, "Ignoring '%c' property (m-line)\n", c);
+					break;
 			}
-			if(cr != NULL)
-				*cr = '\r';
-			index++;
 		}
-		if(cr != NULL)
-			*cr = '\r';
-		g_strfreev(parts);
 	}
+	if(!arena)
+		g_free(text);
 	/* FIXME Do a last check: is all the stuff that's supposed to be there available? */
 	if(success && (imported->o_name == NULL || imported->o_addr == NULL || imported->s_name == NULL || imported->m_lines == NULL)) {
 		success = FALSE;
@@ -679,9 +768,21 @@ janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
 	return imported;
 }
 
+janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen) {
+	return janus_sdp_parse_internal(sdp, error, errlen, FALSE);
+}
+
+janus_sdp *janus_sdp_parse_arena(const char *sdp, char *error, size_t errlen) {
+	return janus_sdp_parse_internal(sdp, error, errlen, TRUE);
+}
+
 int janus_sdp_remove_payload_type(janus_sdp *sdp, int index, int pt) {
 	if(!sdp || pt < 0)
 		return -1;
+	if(sdp->arena) {
+		JANUS_LOG(LOG_ERR, "Can't remove payload type from a read-only SDP\n");
+		return -1;
+	}
 	GList *ml = sdp->m_lines;
 	while(ml) {
 		janus_sdp_mline *m = (janus_sdp_mline *)ml->data;
@@ -1115,102 +1216,120 @@ int janus_sdp_get_opusred_pt(janus_sdp *sdp, int index) {
 	return -1;
 }
 
+/* Helpers to serialize attributes, and to guess how large a serialized SDP will be */
+static void janus_sdp_write_attribute(GString *sdp, janus_sdp_attribute *a) {
+	g_string_append_len(sdp, "a=", 2);
+	g_string_append(sdp, a->name);
+	if(a->value != NULL) {
+		g_string_append_c(sdp, ':');
+		g_string_append(sdp, a->value);
+	}
+	g_string_append_len(sdp, "\r\n", 2);
+}
+static size_t janus_sdp_attributes_size(GList *attributes) {
+	size_t size = 0;
+	while(attributes) {
+		janus_sdp_attribute *a = (janus_sdp_attribute *)attributes->data;
+		size += 5 + strlen(a->name) + (a->value ? strlen(a->value) : 0);
+		attributes = attributes->next;
+	}
+	return size;
+}
+static size_t janus_sdp_write_size(janus_sdp *imported) {
+	/* The fixed parts of each line need less than 128 bytes */
+	size_t size = 512 + janus_sdp_attributes_size(imported->attributes);
+	GList *temp = imported->m_lines;
+	while(temp) {
+		janus_sdp_mline *m = (janus_sdp_mline *)temp->data;
+		size += 256 + 4*g_list_length(m->ptypes) + janus_sdp_attributes_size(m->attributes);
+		GList *fmts = m->fmts;
+		while(fmts) {
+			size += 1 + strlen((char *)fmts->data);
+			fmts = fmts->next;
+		}
+		temp = temp->next;
+	}
+	return size;
+}
+
 char *janus_sdp_write(janus_sdp *imported) {
 	if(!imported)
 		return NULL;
 	janus_refcount_increase(&imported->ref);
-	char *sdp = g_malloc(1024), mline[8192], buffer[512];
-	*sdp = '\0';
-	size_t sdplen = 1024, mlen = sizeof(mline), offset = 0, moffset = 0;
+	/* Size the buffer in advance, so that we (almost) never need to grow it */
+	GString *sdp = g_string_sized_new(janus_sdp_write_size(imported));
 	/* v= */
-	g_snprintf(buffer, sizeof(buffer), "v=%d\r\n", imported->version);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	g_string_append_printf(sdp, "v=%d\r\n", imported->version);
 	/* o= */
-	g_snprintf(buffer, sizeof(buffer), "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
+	g_string_append_printf(sdp, "o=%s %"SCNu64" %"SCNu64" IN %s %s\r\n",
 		imported->o_name, imported->o_sessid, imported->o_version,
 		imported->o_ipv4 ? "IP4" : "IP6", imported->o_addr);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
 	/* s= */
-	g_snprintf(buffer, sizeof(buffer), "s=%s\r\n", imported->s_name);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	g_string_append_printf(sdp, "s=%s\r\n", imported->s_name);
 	/* t= */
-	g_snprintf(buffer, sizeof(buffer), "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
-	janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+	g_string_append_printf(sdp, "t=%"SCNu64" %"SCNu64"\r\n", imported->t_start, imported->t_stop);
 	/* c= */
 	if(imported->c_addr != NULL) {
 		if(imported->c_ipv4 && imported->c_addr && strstr(imported->c_addr, ":"))
 			imported->c_ipv4 = FALSE;
-		g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+		g_string_append_printf(sdp, "c=IN %s %s\r\n",
 			imported->c_ipv4 ? "IP4" : "IP6", imported->c_addr);
-		janus_strlcat_fast(sdp, buffer, sdplen, &offset);
 	}
 	/* a= */
 	GList *temp = imported->attributes;
 	while(temp) {
-		janus_sdp_attribute *a = (janus_sdp_attribute *)temp->data;
-		if(a->value != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
-		} else {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
-		}
-		janus_strlcat_fast(sdp, buffer, sdplen, &offset);
+		janus_sdp_write_attribute(sdp, (janus_sdp_attribute *)temp->data);
 		temp = temp->next;
 	}
 	/* m= */
 	temp = imported->m_lines;
 	while(temp) {
-		mline[0] = '\0';
-		moffset = 0;
 		janus_sdp_mline *m = (janus_sdp_mline *)temp->data;
-		g_snprintf(buffer, sizeof(buffer), "m=%s %d %s", m->type_str, m->port, m->proto);
-		janus_strlcat_fast(mline, buffer, mlen, &moffset);
+		g_string_append_printf(sdp, "m=%s %d %s", m->type_str, m->port, m->proto);
 		if(m->port == 0 && m->type != JANUS_SDP_APPLICATION) {
-			/* Remove all payload types/formats if we're rejecting the media */
-			g_list_free_full(m->fmts, (GDestroyNotify)g_free);
-			m->fmts = NULL;
-			g_list_free(m->ptypes);
-			m->ptypes = NULL;
-			m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(0));
-			janus_strlcat_fast(mline, " 0", mlen, &moffset);
+			/* Remove all payload types/formats if we're rejecting the media
+			 * (unless the SDP lives in an arena, which we can't modify) */
+			if(!imported->arena) {
+				g_list_free_full(m->fmts, (GDestroyNotify)g_free);
+				m->fmts = NULL;
+				g_list_free(m->ptypes);
+				m->ptypes = NULL;
+				m->ptypes = g_list_append(m->ptypes, GINT_TO_POINTER(0));
+			}
+			g_string_append_len(sdp, " 0", 2);
 		} else {
 			if(m->proto != NULL && strstr(m->proto, "RTP") != NULL) {
 				/* RTP profile, use payload types */
 				GList *ptypes = m->ptypes;
 				while(ptypes) {
-					g_snprintf(buffer, sizeof(buffer), " %d", GPOINTER_TO_INT(ptypes->data));
-					janus_strlcat_fast(mline, buffer, mlen, &moffset);
+					g_string_append_printf(sdp, " %d", GPOINTER_TO_INT(ptypes->data));
 					ptypes = ptypes->next;
 				}
 			} else {
 				/* Something else, use formats */
 				GList *fmts = m->fmts;
 				while(fmts) {
-					g_snprintf(buffer, sizeof(buffer), " %s", (char *)(fmts->data));
-					janus_strlcat_fast(mline, buffer, mlen, &moffset);
+					g_string_append_c(sdp, ' ');
+					g_string_append(sdp, (char *)(fmts->data));
 					fmts = fmts->next;
 				}
 			}
 		}
-		janus_strlcat_fast(mline, "\r\n", mlen, &moffset);
+		g_string_append_len(sdp, "\r\n", 2);
 		/* c= */
 		if(m->c_addr != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "c=IN %s %s\r\n",
+			g_string_append_printf(sdp, "c=IN %s %s\r\n",
 				m->c_ipv4 ? "IP4" : "IP6", m->c_addr);
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
 		}
 		if(m->port > 0) {
 			/* b= */
-			if(m->b_name != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
-				janus_strlcat_fast(mline, buffer, mlen, &moffset);
-			}
+			if(m->b_name != NULL)
+				g_string_append_printf(sdp, "b=%s:%"SCNu32"\r\n", m->b_name, m->b_value);
 		}
 		/* a= (note that we don't format the direction if it's JANUS_SDP_DEFAULT) */
 		const char *direction = m->direction != JANUS_SDP_DEFAULT ? janus_sdp_mdirection_str(m->direction) : NULL;
-		if(direction != NULL) {
-			g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", direction);
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
-		}
+		if(direction != NULL)
+			g_string_append_printf(sdp, "a=%s\r\n", direction);
 		GList *temp2 = m->attributes;
 		while(temp2) {
 			janus_sdp_attribute *a = (janus_sdp_attribute *)temp2->data;
@@ -1219,31 +1338,14 @@ char *janus_sdp_write(janus_sdp *imported) {
 				temp2 = temp2->next;
 				continue;
 			}
-			if(a->value != NULL) {
-				g_snprintf(buffer, sizeof(buffer), "a=%s:%s\r\n", a->name, a->value);
-			} else {
-				g_snprintf(buffer, sizeof(buffer), "a=%s\r\n", a->name);
-			}
-			janus_strlcat_fast(mline, buffer, mlen, &moffset);
+			janus_sdp_write_attribute(sdp, a);
 			temp2 = temp2->next;
 		}
-		/* Append the generated m-line to the SDP */
-		size_t cur_sdplen = strlen(sdp);
-		size_t mlinelen = strlen(mline);
-		if(cur_sdplen + mlinelen + 1 > sdplen) {
-			/* Increase the SDP buffer first */
-			if(sdplen < (mlinelen+1))
-				sdplen = cur_sdplen + mlinelen + 1;
-			else
-				sdplen = sdplen*2;
-			sdp = g_realloc(sdp, sdplen);
-		}
-		janus_strlcat_fast(sdp, mline, sdplen, &offset);
 		/* Move on */
 		temp = temp->next;
 	}
 	janus_refcount_decrease(&imported->ref);
-	return sdp;
+	return g_string_free(sdp, FALSE);
 }
 
 void janus_sdp_find_preferred_codec(janus_sdp *sdp, janus_sdp_mtype type, int index, const char **codec) {
@@ -1347,6 +1449,7 @@ janus_sdp *janus_sdp_new(const char *name, const char *address) {
 	sdp->c_addr = g_strdup(address ? address : "127.0.0.1");
 	sdp->attributes = NULL;
 	sdp->m_lines = NULL;
+	sdp->arena = FALSE;
 	/* Done */
 	return sdp;
 }
@@ -1872,6 +1975,7 @@ janus_sdp *janus_sdp_generate_answer(janus_sdp *offer) {
 	answer->c_addr = g_strdup(offer->c_addr ? offer->c_addr : "127.0.0.1");
 	answer->attributes = NULL;
 	answer->m_lines = NULL;
+	answer->arena = FALSE;
 
 	/* Iterate on all m-lines to add, if any */
 	GList *temp = offer->m_lines;
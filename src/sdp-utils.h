@@ -50,6 +50,8 @@ typedef struct janus_sdp {
 	GList *attributes;
 	/*! \brief List of m= m-lines */
 	GList *m_lines;
+	/*! \brief Whether this instance (and everything it contains) lives in an arena, see janus_sdp_parse_arena */
+	gboolean arena;
 	/*! \brief Atomic flag to check if this instance has been destroyed */
 	volatile gint destroyed;
 	/*! \brief Reference counter for this instance */
@@ -230,6 +232,22 @@ int janus_sdp_attribute_add_to_mline(janus_sdp_mline *mline, janus_sdp_attribute
  * of errors, if provided the error string is filled with a reason  */
 janus_sdp *janus_sdp_parse(const char *sdp, char *error, size_t errlen);
 
+/*! \brief Method to parse an SDP string to a read-only janus_sdp object
+ * \details The object, its m-lines, attributes, lists and strings all come
+ * out of a single allocation, which is released at once when the object is
+ * destroyed: this makes it cheaper to parse SDPs that only need to be
+ * inspected (e.g., to generate an answer to them, or to check what was
+ * negotiated). As such, the object must NOT be modified: methods like
+ * janus_sdp_remove_payload_type or janus_sdp_mline_remove will refuse to
+ * work on it, and m-lines or attributes must not be added, removed or
+ * freed. Destroy it with janus_sdp_destroy as usual.
+ * @param[in] sdp The SDP string to parse
+ * @param[in,out] error Buffer to receive a reason for an error, if any
+ * @param[in] errlen The length of the error buffer
+ * @returns A pointer to a janus_sdp object, if successful, NULL otherwise; in case
+ * of errors, if provided the error string is filled with a reason  */
+janus_sdp *janus_sdp_parse_arena(const char *sdp, char *error, size_t errlen);
+
 /*! \brief Helper method to quickly remove all traces (m-line, rtpmap, fmtp, etc.) of a payload type
  * @param[in] sdp The janus_sdp object to remove the payload type from
  * @param[in] index The m-line to remove the payload type from (use -1 for the first m-line that matches)
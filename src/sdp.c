@@ -27,6 +27,7 @@
 #include "ip-utils.h"
 #include "debug.h"
 #include "events.h"
+#include "metrics.h"
 
 
 /* Pre-parse SDP: is this SDP valid? how many audio/video lines? any features to take into account? */
@@ -142,6 +143,42 @@ janus_sdp *janus_sdp_preparse(void *ice_handle, const char *jsep_sdp, char *erro
 	return parsed_sdp;
 }
 
+/* Hash of everything in a remote m-line we care about (FNV-1a), used in
+ * renegotiations to spot the m-lines that didn't change since last time */
+static guint64 janus_sdp_mline_hash_string(guint64 hash, const char *s) {
+	if(s != NULL) {
+		while(*s) {
+			hash ^= (guchar)*s++;
+			hash *= 1099511628211ULL;
+		}
+	}
+	/* Separate this string from the next one */
+	hash ^= 0xff;
+	hash *= 1099511628211ULL;
+	return hash;
+}
+static guint64 janus_sdp_mline_hash(janus_sdp_mline *m, gboolean rids_hml) {
+	char buffer[64];
+	g_snprintf(buffer, sizeof(buffer), "%d %d %d %d", m->type, m->port, m->direction, rids_hml);
+	guint64 hash = janus_sdp_mline_hash_string(14695981039346656037ULL, buffer);
+	hash = janus_sdp_mline_hash_string(hash, m->proto);
+	GList *temp = m->ptypes;
+	while(temp) {
+		g_snprintf(buffer, sizeof(buffer), "%d", GPOINTER_TO_INT(temp->data));
+		hash = janus_sdp_mline_hash_string(hash, buffer);
+		temp = temp->next;
+	}
+	temp = m->attributes;
+	while(temp) {
+		janus_sdp_attribute *a = (janus_sdp_attribute *)temp->data;
+		hash = janus_sdp_mline_hash_string(hash, a->name);
+		hash = janus_sdp_mline_hash_string(hash, a->value);
+		temp = temp->next;
+	}
+	/* Zero means "never processed", so make sure we never return it */
+	return hash ? hash : 1;
+}
+
 /* Parse remote SDP */
 int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean rids_hml, gboolean update) {
 	if(!ice_handle || !remote_sdp)
@@ -298,6 +335,19 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 			temp = temp->next;
 			continue;
 		}
+		/* In renegotiations, skip the attributes of m-lines that didn't change since
+		 * the last time we processed them: the first m-line is always processed
+		 * anyway, as that's where we check the ICE credentials and fingerprint */
+		guint64 mline_hash = janus_sdp_mline_hash(m, rids_hml);
+		if(update && m->index > 0 && medium->remote_mline_hash == mline_hash) {
+			JANUS_LOG(LOG_HUGE, "[%"SCNu64"] m-line #%d unchanged, skipping\n", handle->handle_id, m->index);
+			if(medium->remote_mline_rtx)
+				rtx = TRUE;
+			temp = temp->next;
+			continue;
+		}
+		medium->remote_mline_hash = 0;
+		medium->remote_mline_rtx = FALSE;
 		/* Look for mid, msid, ICE credentials and fingerprint first: check media attributes */
 		GList *tempA = m->attributes;
 		while(tempA) {
@@ -584,6 +634,7 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 							JANUS_LOG(LOG_ERR, "[%"SCNu64"] Failed to parse fmtp/apt attribute...\n", handle->handle_id);
 						} else {
 							rtx = TRUE;
+							medium->remote_mline_rtx = TRUE;
 							janus_flags_set(&handle->webrtc_flags, JANUS_ICE_HANDLE_WEBRTC_RFC4588_RTX);
 							if(pc->rtx_payload_types == NULL)
 								pc->rtx_payload_types = g_hash_table_new(NULL, NULL);
@@ -659,8 +710,8 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 							medium->rtcp_ctx[vindex]->out_link_quality = 100;
 							medium->rtcp_ctx[vindex]->out_media_link_quality = 100;
 						}
-						if(medium->last_seqs[vindex])
-							janus_seq_list_free(&medium->last_seqs[vindex]);
+						if(medium->loss_trackers[vindex] != NULL)
+							janus_ice_loss_tracker_reset(medium->loss_trackers[vindex]);
 						janus_mutex_unlock(&medium->mutex);
 					}
 					medium->ssrc_peer[vindex] = medium->ssrc_peer_new[vindex];
@@ -722,6 +773,8 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 						janus_sdp_remove_payload_type(remote_sdp, medium->mindex, ptype);
 						g_hash_table_remove(pc->clock_rates, GINT_TO_POINTER(ptype));
 						g_hash_table_remove(medium->clock_rates, GINT_TO_POINTER(ptype));
+						/* We'll need to do this again if we get the same m-line */
+						mline_hash = 0;
 					}
 					tempP = tempP->next;
 				}
@@ -729,6 +782,7 @@ int janus_sdp_process_remote(void *ice_handle, janus_sdp *remote_sdp, gboolean r
 				g_list_free(rtx_ptypes);
 			}
 		}
+		medium->remote_mline_hash = mline_hash;
 		temp = temp->next;
 	}
 	/* Disable RFC4588 if the peer didn't negotiate it */
@@ -915,36 +969,39 @@ int janus_sdp_process_local(void *ice_handle, janus_sdp *remote_sdp, gboolean up
 	return 0;	/* FIXME Handle errors better */
 }
 
+/* mDNS resolutions are cached for a short time and shared by all handles,
+ * as the same browser will use the same .local address in all its offers
+ * and trickled candidates: failures are cached as well (for a shorter
+ * time), so that they don't cost us a new lookup each time, and concurrent
+ * lookups for the same address are coalesced in a single one. Notice that
+ * connectivity checks don't need to wait for any of this: if the peer
+ * reaches us before the address is resolved, libnice will simply pair the
+ * check with a peer-reflexive candidate, which the resolved candidate will
+ * then be matched to when it's added */
+#define JANUS_SDP_MDNS_CACHE_TTL	(60*G_USEC_PER_SEC)
+#define JANUS_SDP_MDNS_NEGATIVE_TTL	(10*G_USEC_PER_SEC)
+#define JANUS_SDP_MDNS_CACHE_MAX	1024
 typedef struct janus_sdp_mdns_candidate {
 	janus_ice_handle *handle;
 	char *candidate, *local;
 	GCancellable *cancellable;
 } janus_sdp_mdns_candidate;
-static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, gpointer user_data) {
-	/* This callback is invoked when the address is resolved */
-	janus_sdp_mdns_candidate *mc = (janus_sdp_mdns_candidate *)user_data;
-	GResolver *resolver = g_resolver_get_default();
-	GError *error = NULL;
-	GList *list = g_resolver_lookup_by_name_finish(resolver, res, &error);
-	if(mc == NULL) {
-		g_resolver_free_addresses(list);
-		g_object_unref(resolver);
-		return;
-	}
-	char *resolved = NULL;
-	if(error != NULL || list == NULL || list->data == NULL) {
-		JANUS_LOG(LOG_WARN, "[%"SCNu64"] Error resolving mDNS address (%s): %s\n",
-			mc->handle->handle_id, mc->local, error ? error->message : "no results");
-	} else {
-		resolved = g_inet_address_to_string((GInetAddress *)list->data);
-		JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) resolved: %s\n",
-			mc->handle->handle_id, mc->local, resolved);
-	}
-	g_resolver_free_addresses(list);
-	g_object_unref(resolver);
+typedef struct janus_sdp_mdns_entry {
+	char *address;		/* NULL if the resolution failed */
+	gint64 expires;		/* 0 while the resolution is in progress */
+	GList *waiting;		/* Candidates waiting for the resolution */
+} janus_sdp_mdns_entry;
+static GHashTable *mdns_cache = NULL;
+static guint64 mdns_lookups = 0, mdns_hits = 0, mdns_negative_hits = 0,
+	mdns_coalesced = 0, mdns_failures = 0;
+static janus_mutex mdns_mutex = JANUS_MUTEX_INITIALIZER;
+
+static void janus_sdp_mdns_candidate_done(janus_sdp_mdns_candidate *mc, const char *resolved) {
 	if(resolved != NULL && mc->handle->pc && mc->handle->app_handle &&
 			!g_atomic_int_get(&mc->handle->app_handle->stopped) &&
 			!g_atomic_int_get(&mc->handle->destroyed)) {
+		JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) resolved: %s\n",
+			mc->handle->handle_id, mc->local, resolved);
 		/* Replace the .local address with the resolved one in the candidate string */
 		mc->candidate = janus_string_replace(mc->candidate, mc->local, resolved);
 		/* Parse the candidate again */
@@ -952,7 +1009,6 @@ static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, g
 		(void)janus_sdp_parse_candidate(mc->handle->pc, mc->candidate, 1);
 		janus_mutex_unlock(&mc->handle->mutex);
 	}
-	g_free(resolved);
 	/* Get rid of the helper struct */
 	janus_refcount_decrease(&mc->handle->ref);
 	g_free(mc->candidate);
@@ -960,6 +1016,94 @@ static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, g
 	g_free(mc);
 }
 
+static void janus_sdp_mdns_entry_free(janus_sdp_mdns_entry *entry) {
+	if(entry == NULL)
+		return;
+	/* If anyone is still waiting for this resolution, give up on them */
+	GList *temp = entry->waiting;
+	while(temp) {
+		janus_sdp_mdns_candidate_done((janus_sdp_mdns_candidate *)temp->data, NULL);
+		temp = temp->next;
+	}
+	g_list_free(entry->waiting);
+	g_free(entry->address);
+	g_free(entry);
+}
+
+static void janus_sdp_mdns_resolved(GObject *source_object, GAsyncResult *res, gpointer user_data) {
+	/* This callback is invoked when the address is resolved */
+	char *local = (char *)user_data;
+	GResolver *resolver = g_resolver_get_default();
+	GError *error = NULL;
+	GList *list = g_resolver_lookup_by_name_finish(resolver, res, &error);
+	char *resolved = NULL;
+	if(error != NULL || list == NULL || list->data == NULL) {
+		JANUS_LOG(LOG_WARN, "Error resolving mDNS address (%s): %s\n",
+			local, error ? error->message : "no results");
+	} else {
+		resolved = g_inet_address_to_string((GInetAddress *)list->data);
+	}
+	g_clear_error(&error);
+	g_resolver_free_addresses(list);
+	g_object_unref(resolver);
+	/* Update the cache, and take note of who was waiting for this */
+	GList *waiting = NULL;
+	janus_mutex_lock(&mdns_mutex);
+	if(resolved == NULL)
+		mdns_failures++;
+	janus_sdp_mdns_entry *entry = mdns_cache ? g_hash_table_lookup(mdns_cache, local) : NULL;
+	if(entry != NULL && entry->expires == 0) {
+		entry->address = g_strdup(resolved);
+		entry->expires = janus_get_monotonic_time() +
+			(resolved ? JANUS_SDP_MDNS_CACHE_TTL : JANUS_SDP_MDNS_NEGATIVE_TTL);
+		waiting = g_list_reverse(entry->waiting);
+		entry->waiting = NULL;
+	}
+	janus_mutex_unlock(&mdns_mutex);
+	GList *temp = waiting;
+	while(temp) {
+		janus_sdp_mdns_candidate_done((janus_sdp_mdns_candidate *)temp->data, resolved);
+		temp = temp->next;
+	}
+	g_list_free(waiting);
+	g_free(resolved);
+	g_free(local);
+}
+
+void janus_sdp_mdns_cache_deinit(void) {
+	janus_mutex_lock(&mdns_mutex);
+	if(mdns_cache != NULL)
+		g_hash_table_destroy(mdns_cache);
+	mdns_cache = NULL;
+	janus_mutex_unlock(&mdns_mutex);
+}
+
+void janus_sdp_mdns_cache_metrics(GString *out) {
+	if(out == NULL || !janus_ice_is_mdns_enabled())
+		return;
+	janus_mutex_lock(&mdns_mutex);
+	guint64 lookups = mdns_lookups, hits = mdns_hits, negative_hits = mdns_negative_hits,
+		coalesced = mdns_coalesced, failures = mdns_failures;
+	guint entries = mdns_cache ? g_hash_table_size(mdns_cache) : 0;
+	janus_mutex_unlock(&mdns_mutex);
+	janus_metrics_print_family(out, "janus_mdns_lookups", "counter", "mDNS addresses actually resolved (cache misses)");
+	janus_metrics_print_sample(out, "janus_mdns_lookups_total", NULL, (double)lookups);
+	janus_metrics_print_family(out, "janus_mdns_cache_hits", "counter", "mDNS candidates served by the cache, with a resolved or failed address");
+	janus_metrics_print_sample(out, "janus_mdns_cache_hits_total", "result=\"resolved\"", (double)hits);
+	janus_metrics_print_sample(out, "janus_mdns_cache_hits_total", "result=\"failed\"", (double)negative_hits);
+	janus_metrics_print_family(out, "janus_mdns_coalesced", "counter", "mDNS candidates that waited for a resolution already in progress");
+	janus_metrics_print_sample(out, "janus_mdns_coalesced_total", NULL, (double)coalesced);
+	janus_metrics_print_family(out, "janus_mdns_failures", "counter", "mDNS resolutions that failed");
+	janus_metrics_print_sample(out, "janus_mdns_failures_total", NULL, (double)failures);
+	janus_metrics_print_family(out, "janus_mdns_cache_entries", "gauge", "mDNS addresses in the cache");
+	janus_metrics_print_sample(out, "janus_mdns_cache_entries", NULL, entries);
+}
+
+static gboolean janus_sdp_mdns_entry_is_expired(gpointer key, gpointer value, gpointer user_data) {
+	janus_sdp_mdns_entry *entry = (janus_sdp_mdns_entry *)value;
+	return entry->expires > 0 && entry->expires <= *(gint64 *)user_data;
+}
+
 int janus_sdp_parse_candidate(void *ice_pc, const char *candidate, int trickle) {
 	if(ice_pc == NULL || candidate == NULL)
 		return -1;
@@ -997,18 +1141,65 @@ int janus_sdp_parse_candidate(void *ice_pc, const char *candidate, int trickle)
 				JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS candidate ignored\n", handle->handle_id);
 				return 0;
 			}
+			/* Check if we resolved (or failed to resolve) this address recently */
+			gint64 now = janus_get_monotonic_time();
+			janus_mutex_lock(&mdns_mutex);
+			if(mdns_cache == NULL) {
+				mdns_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					(GDestroyNotify)g_free, (GDestroyNotify)janus_sdp_mdns_entry_free);
+			}
+			janus_sdp_mdns_entry *entry = g_hash_table_lookup(mdns_cache, rip);
+			if(entry != NULL && entry->expires > 0 && entry->expires <= now) {
+				g_hash_table_remove(mdns_cache, rip);
+				entry = NULL;
+			}
+			if(entry != NULL && entry->expires > 0) {
+				if(entry->address == NULL) {
+					mdns_negative_hits++;
+					janus_mutex_unlock(&mdns_mutex);
+					JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) recently failed to resolve, ignoring candidate\n",
+						handle->handle_id, rip);
+					return 0;
+				}
+				mdns_hits++;
+				char *resolved = g_strdup(entry->address);
+				janus_mutex_unlock(&mdns_mutex);
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] mDNS address (%s) resolved (cached): %s\n",
+					handle->handle_id, rip, resolved);
+				char *cached = janus_string_replace(g_strdup(candidate), rip, resolved);
+				res = janus_sdp_parse_candidate(pc, cached, trickle);
+				g_free(cached);
+				g_free(resolved);
+				return res;
+			}
 			/* We'll resolve this address asynchronously, in order not to keep this thread busy */
-			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Resolving mDNS address (%s) asynchronously\n",
-				handle->handle_id, rip);
 			janus_sdp_mdns_candidate *mc = g_malloc(sizeof(janus_sdp_mdns_candidate));
 			janus_refcount_increase(&handle->ref);
 			mc->handle = handle;
 			mc->candidate = g_strdup(candidate);
 			mc->local = g_strdup(rip);
 			mc->cancellable = NULL;
+			if(entry != NULL) {
+				/* A resolution is already in progress, wait for that one */
+				mdns_coalesced++;
+				entry->waiting = g_list_prepend(entry->waiting, mc);
+				janus_mutex_unlock(&mdns_mutex);
+				JANUS_LOG(LOG_VERB, "[%"SCNu64"] Waiting for mDNS address (%s) to be resolved\n",
+					handle->handle_id, rip);
+				return 0;
+			}
+			if(g_hash_table_size(mdns_cache) >= JANUS_SDP_MDNS_CACHE_MAX)
+				g_hash_table_foreach_remove(mdns_cache, janus_sdp_mdns_entry_is_expired, &now);
+			mdns_lookups++;
+			entry = g_malloc0(sizeof(janus_sdp_mdns_entry));
+			entry->waiting = g_list_prepend(NULL, mc);
+			g_hash_table_insert(mdns_cache, g_strdup(rip), entry);
+			janus_mutex_unlock(&mdns_mutex);
+			JANUS_LOG(LOG_VERB, "[%"SCNu64"] Resolving mDNS address (%s) asynchronously\n",
+				handle->handle_id, rip);
 			GResolver *resolver = g_resolver_get_default();
 			g_resolver_lookup_by_name_async(resolver, rip, NULL,
-				(GAsyncReadyCallback)janus_sdp_mdns_resolved, mc);
+				(GAsyncReadyCallback)janus_sdp_mdns_resolved, g_strdup(rip));
 			g_object_unref(resolver);
 			return 0;
 		}
@@ -1485,10 +1676,7 @@ char *janus_sdp_merge(void *ice_handle, janus_sdp *anon, gboolean offer) {
 	g_free(anon->c_addr);
 	anon->c_addr = NULL;
 	/* bundle: add new global attribute */
-	char buffer[8192], buffer_part[512];
-	buffer[0] = '\0';
-	buffer_part[0] = '\0';
-	g_snprintf(buffer, sizeof(buffer), "BUNDLE");
+	GString *bundle = g_string_new("BUNDLE");
 	/* Iterate on available media */
 #ifdef HAVE_SCTP
 	int data = 0;
@@ -1499,14 +1687,15 @@ char *janus_sdp_merge(void *ice_handle, janus_sdp *anon, gboolean offer) {
 		/* Find the internal medium instance */
 		medium = g_hash_table_lookup(pc->media, GINT_TO_POINTER(m->index));
 		if(medium && m->port > 0) {
-			g_snprintf(buffer_part, sizeof(buffer_part), " %s", medium->mid);
-			janus_strlcat(buffer, buffer_part, sizeof(buffer));
+			g_string_append_c(bundle, ' ');
+			g_string_append(bundle, medium->mid);
 		}
 		temp = temp->next;
 	}
 	/* Global attributes: start with group */
 	GList *first = anon->attributes;
-	janus_sdp_attribute *a = janus_sdp_attribute_create("group", "%s", buffer);
+	janus_sdp_attribute *a = janus_sdp_attribute_create("group", "%s", bundle->str);
+	g_string_free(bundle, TRUE);
 	anon->attributes = g_list_insert_before(anon->attributes, first, a);
 	/* Advertise trickle support */
 	a = janus_sdp_attribute_create("ice-options", "trickle");
@@ -73,6 +73,13 @@ int janus_sdp_process_local(void *handle, janus_sdp *sdp, gboolean update);
  * @returns 0 in case of success, a non-zero integer in case of an error */
 int janus_sdp_parse_candidate(void *pc, const char *candidate, int trickle);
 
+/*! \brief Method to get rid of the cache of resolved mDNS addresses */
+void janus_sdp_mdns_cache_deinit(void);
+
+/*! \brief Method to add the metrics of the mDNS resolution cache
+ * @param[in] out The buffer to append to */
+void janus_sdp_mdns_cache_metrics(GString *out);
+
 /*! \brief Method to parse a SSRC group attribute
  * \details This method will parse a SSRC group attribute, and set the parsed values for the peer
  * @param[in] medium Opaque pointer to the medium this candidate refers to
@@ -4,8 +4,9 @@
  * \brief    Dumping of RTP/RTCP packets to text2pcap or pcap format
  * \details  Implementation of a simple helper utility that can be used
  * to dump incoming and outgoing RTP/RTCP packets to pcap or text2pcap format.
- * Saving to pcap natively can be more efficient but will lack some features,
- * as the target will be a legacy (v2.4) \c .pcap file and not a \c .pcapng one.
+ * Saving to pcap natively can be more efficient, and the target can either
+ * be a legacy (v2.4) \c .pcap file or a \c .pcapng one: the latter also
+ * marks each packet as inbound or outbound, which Wireshark can filter on.
  * When saving to a text file, instead, the resulting file can be passed to
  * the \c text2pcap application in order to get a \c .pcap or \c .pcapng file
  * that can be analyzed via Wireshark or similar applications, e.g.:
@@ -22,6 +23,15 @@
  * of that section for more details. Notice that starting a new dump on
  * an existing filename will result in the new packets to be appended.
  *
+ * To keep the overhead on the media path as low as possible, dumping a
+ * packet only copies it (or the part of it that will be saved) to a
+ * lock-free ring: a background thread takes care of formatting the
+ * packets and writing them to the file. If that thread can't keep up,
+ * or if the capture is limited to a maximum number of packets per
+ * second, the packets in excess are dropped and counted. Captures can
+ * also be limited to the RTP headers (and extensions), to capture the
+ * traffic of many handles without saving their media.
+ *
  * \note Motivation and inspiration for this work came from a
  * <a href="https://blog.mozilla.org/webrtc/debugging-encrypted-rtp-is-more-fun-than-it-used-to-be/">similar effort</a>
  * recently done in Firefox, and from a discussion related to a
@@ -152,19 +162,83 @@ static void janus_text2pcap_udp_header_init(janus_text2pcap_udp_header *udp, gbo
 }
 
 
+/* pcapng blocks (https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html):
+ * we only need a section header, an interface description and enhanced packets */
+typedef struct janus_text2pcap_pcapng_shb {
+	guint32 block_type;		/* 0x0A0D0D0A */
+	guint32 block_length;
+	guint32 byte_order;		/* 0x1A2B3C4D */
+	guint16 version_major;
+	guint16 version_minor;
+	guint32 section_length[2];	/* -1, not specified */
+	guint32 block_length_end;
+} janus_text2pcap_pcapng_shb;
+typedef struct janus_text2pcap_pcapng_idb {
+	guint32 block_type;		/* 0x00000001 */
+	guint32 block_length;
+	guint16 linktype;
+	guint16 reserved;
+	guint32 snaplen;
+	guint32 block_length_end;
+} janus_text2pcap_pcapng_idb;
+typedef struct janus_text2pcap_pcapng_epb {
+	guint32 block_type;		/* 0x00000006 */
+	guint32 block_length;
+	guint32 interface_id;
+	guint32 ts_high;
+	guint32 ts_low;
+	guint32 incl_len;
+	guint32 orig_len;
+} janus_text2pcap_pcapng_epb;
+/* The epb_flags option (inbound/outbound), followed by opt_endofopt */
+typedef struct janus_text2pcap_pcapng_epb_flags {
+	guint16 code;			/* 2 */
+	guint16 length;			/* 4 */
+	guint32 flags;			/* 1 inbound, 2 outbound */
+	guint32 end;
+} janus_text2pcap_pcapng_epb_flags;
+
+
+/* Ring of packets to dump: the media threads queue packets (lock-free, as
+ * in Dmitry Vyukov's bounded queue), and a single writer thread dequeues them */
+#define JANUS_TEXT2PCAP_RING_SIZE	1024
+#define JANUS_TEXT2PCAP_SLOT_SIZE	1500
+struct janus_text2pcap_slot {
+	/* Sequence number, telling producers and consumer whether the slot is free */
+	volatile gint sequence;
+	/* When the packet was dumped (real time) */
+	gint64 when;
+	janus_text2pcap_packet type;
+	gboolean incoming;
+	/* Original size of the packet, and how much of it we saved */
+	int len, caplen;
+	/* Custom string to append to the line (text mode only) */
+	char note[128];
+	char data[JANUS_TEXT2PCAP_SLOT_SIZE];
+};
+static void *janus_text2pcap_writer(void *data);
+
+
 janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, int truncate, gboolean text) {
+	return janus_text2pcap_create_full(dir, filename, truncate, text, FALSE, FALSE, 0);
+}
+
+janus_text2pcap *janus_text2pcap_create_full(const char *dir, const char *filename, int truncate,
+		gboolean text, gboolean pcapng, gboolean headers_only, int max_rate) {
 	janus_text2pcap *tp;
 	char newname[1024];
 	char *fname;
 	FILE *f;
 
-	if(truncate < 0)
+	if(truncate < 0 || max_rate < 0)
 		return NULL;
+	if(text)
+		pcapng = FALSE;
 
 	/* Copy given filename or generate a random one */
 	if(filename == NULL) {
 		g_snprintf(newname, sizeof(newname),
-		    "janus-text2pcap-%"SCNu32".%s", janus_random_uint32(), text ? "txt" : "pcap");
+		    "janus-text2pcap-%"SCNu32".%s", janus_random_uint32(), text ? "txt" : (pcapng ? "pcapng" : "pcap"));
 	} else {
 		g_strlcpy(newname, filename, sizeof(newname));
 	}
@@ -192,123 +266,298 @@ janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, i
 	}
 
 	/* Create the text2pcap instance */
-	tp = g_malloc(sizeof(janus_text2pcap));
+	tp = g_malloc0(sizeof(janus_text2pcap));
 	tp->filename = fname;
 	tp->file = f;
 	tp->truncate = truncate;
 	tp->text = text;
+	tp->pcapng = pcapng;
+	tp->headers_only = headers_only;
+	tp->max_rate = max_rate;
+	tp->filter.incoming = tp->filter.outgoing = TRUE;
+	tp->filter.audio = tp->filter.video = TRUE;
+	tp->filter.rtp = tp->filter.rtcp = TRUE;
+	tp->ring = g_malloc0(JANUS_TEXT2PCAP_RING_SIZE * sizeof(janus_text2pcap_slot));
+	int i = 0;
+	for(i=0; i<JANUS_TEXT2PCAP_RING_SIZE; i++)
+		tp->ring[i].sequence = i;
 	g_atomic_int_set(&tp->writable, 1);
 	janus_mutex_init(&tp->mutex);
 
 	/* If we're saving to .pcap directly, generate a global header */
-	if(!text) {
+	if(pcapng) {
+		janus_text2pcap_pcapng_shb shb = {
+			0x0A0D0D0A, sizeof(shb), 0x1A2B3C4D, 1, 0, { 0xFFFFFFFF, 0xFFFFFFFF }, sizeof(shb)
+		};
+		janus_text2pcap_pcapng_idb idb = {
+			0x00000001, sizeof(idb), 1, 0, 65535, sizeof(idb)
+		};
+		fwrite(&shb, sizeof(char), sizeof(shb), f);
+		fwrite(&idb, sizeof(char), sizeof(idb), f);
+	} else if(!text) {
 		janus_text2pcap_global_header header = {
 			0xa1b2c3d4, 2, 4, 0, 0, 65535, 1
 		};
 		fwrite(&header, sizeof(char), sizeof(header), f);
 	}
 
+	/* Start the thread that will write the packets */
+	GError *error = NULL;
+	tp->writer = g_thread_try_new("text2pcap", &janus_text2pcap_writer, tp, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the text2pcap writer thread...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		fclose(f);
+		g_free(tp->ring);
+		g_free(tp->filename);
+		g_free(tp);
+		return NULL;
+	}
+
 	return tp;
 }
 
+void janus_text2pcap_set_filter(janus_text2pcap *instance, const janus_text2pcap_filter *filter) {
+	if(instance == NULL || filter == NULL)
+		return;
+	instance->filter = *filter;
+}
+
+gboolean janus_text2pcap_media_enabled(janus_text2pcap *instance, gboolean video) {
+	if(instance == NULL)
+		return FALSE;
+	return video ? instance->filter.video : instance->filter.audio;
+}
+
+/* Check if a packet matches the SSRC we're filtering on */
+static gboolean janus_text2pcap_ssrc_match(janus_text2pcap_packet type, const char *buf, int len, guint32 ssrc) {
+	guint32 packet_ssrc = 0;
+	if(type == JANUS_TEXT2PCAP_RTP) {
+		if(len < 12)
+			return FALSE;
+		memcpy(&packet_ssrc, buf+8, sizeof(packet_ssrc));
+		return ntohl(packet_ssrc) == ssrc;
+	} else if(type == JANUS_TEXT2PCAP_RTCP) {
+		/* Check both the sender and the media SSRC of the first packet in the compound */
+		if(len < 8)
+			return FALSE;
+		memcpy(&packet_ssrc, buf+4, sizeof(packet_ssrc));
+		if(ntohl(packet_ssrc) == ssrc)
+			return TRUE;
+		if(len < 12)
+			return FALSE;
+		memcpy(&packet_ssrc, buf+8, sizeof(packet_ssrc));
+		return ntohl(packet_ssrc) == ssrc;
+	}
+	return FALSE;
+}
+
+/* How much of an RTP packet we save, when we only want the headers */
+static int janus_text2pcap_rtp_headers_size(const char *buf, int len) {
+	if(len < 12)
+		return len;
+	const uint8_t *rtp = (const uint8_t *)buf;
+	int size = 12 + (rtp[0] & 0x0F)*4;
+	if((rtp[0] & 0x10) && size + 4 <= len) {
+		/* There are RTP extensions: we save those too */
+		uint16_t extlen = 0;
+		memcpy(&extlen, rtp + size + 2, sizeof(extlen));
+		size += 4 + ntohs(extlen)*4;
+	}
+	return size < len ? size : len;
+}
+
 int janus_text2pcap_dump(janus_text2pcap *instance,
 		janus_text2pcap_packet type, gboolean incoming, char *buf, int len, const char *format, ...) {
 	if(instance == NULL || buf == NULL || len < 1)
 		return -1;
-	janus_mutex_lock_nodebug(&instance->mutex);
-	if(instance->file == NULL || !g_atomic_int_get(&instance->writable)) {
-		janus_mutex_unlock_nodebug(&instance->mutex);
+	if(instance->file == NULL || !g_atomic_int_get(&instance->writable))
 		return -1;
+	/* Check if we're interested in this packet at all */
+	janus_text2pcap_filter *filter = &instance->filter;
+	if((incoming && !filter->incoming) || (!incoming && !filter->outgoing))
+		return 0;
+	if((type == JANUS_TEXT2PCAP_RTP && !filter->rtp) || (type == JANUS_TEXT2PCAP_RTCP && !filter->rtcp))
+		return 0;
+	if(filter->ssrc && !janus_text2pcap_ssrc_match(type, buf, len, filter->ssrc))
+		return 0;
+	if(filter->sampling > 1 && (g_atomic_int_add(&instance->filtered, 1) % filter->sampling) != 0)
+		return 0;
+	/* Check if we're rate limiting the capture */
+	if(instance->max_rate > 0) {
+		gint now = (gint)(janus_get_monotonic_time() / G_USEC_PER_SEC);
+		gint window = g_atomic_int_get(&instance->rate_window);
+		if(window != now && g_atomic_int_compare_and_exchange(&instance->rate_window, window, now))
+			g_atomic_int_set(&instance->rate_count, 0);
+		if(g_atomic_int_add(&instance->rate_count, 1) >= instance->max_rate) {
+			g_atomic_int_inc(&instance->dropped_rate);
+			return -3;
+		}
+	}
+	/* Find out how much of the packet we need to save */
+	int size = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
+	if(instance->headers_only && type == JANUS_TEXT2PCAP_RTP) {
+		int hsize = janus_text2pcap_rtp_headers_size(buf, len);
+		if(hsize < size)
+			size = hsize;
 	}
-	/* If we're saving to .pcap directly, generate a packet header and save the payload */
+	if(size > JANUS_TEXT2PCAP_SLOT_SIZE)
+		size = JANUS_TEXT2PCAP_SLOT_SIZE;
+	/* Reserve a slot in the ring */
+	janus_text2pcap_slot *slot = NULL;
+	gint pos = g_atomic_int_get(&instance->ring_head);
+	while(TRUE) {
+		slot = &instance->ring[(guint)pos % JANUS_TEXT2PCAP_RING_SIZE];
+		gint diff = (gint)((guint)g_atomic_int_get(&slot->sequence) - (guint)pos);
+		if(diff == 0) {
+			if(g_atomic_int_compare_and_exchange(&instance->ring_head, pos, (gint)((guint)pos+1)))
+				break;
+		} else if(diff < 0) {
+			/* The ring is full, the writer can't keep up */
+			g_atomic_int_inc(&instance->dropped_full);
+			return -2;
+		}
+		pos = g_atomic_int_get(&instance->ring_head);
+	}
+	/* Copy the packet and publish it */
+	slot->when = janus_get_real_time();
+	slot->type = type;
+	slot->incoming = incoming;
+	slot->len = len;
+	slot->caplen = size;
+	memcpy(slot->data, buf, size);
+	slot->note[0] = '\0';
+	if(instance->text && format) {
+		/* This callback has variable arguments (error string) */
+		va_list ap;
+		va_start(ap, format);
+		g_vsnprintf(slot->note, sizeof(slot->note), format, ap);
+		va_end(ap);
+	}
+	g_atomic_int_set(&slot->sequence, (gint)((guint)pos+1));
+	return 0;
+}
+
+/* Write a queued packet to the file */
+static int janus_text2pcap_write(janus_text2pcap *instance, janus_text2pcap_slot *slot) {
+	FILE *file = instance->file;
 	if(!instance->text) {
-		/* Are we truncating? */
-		int size = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
+		/* We need a fake Ethernet/IP/UDP encapsulation for this packet */
 		int hsize = sizeof(janus_text2pcap_ethernet_header) + sizeof(janus_text2pcap_ip_header) +
 			sizeof(janus_text2pcap_udp_header);
-		int hsize_cut = hsize + size;
-		int hsize_tot = hsize + len;
-		/* We need a fake Ethernet/IP/UDP encapsulation for this packet */
 		janus_text2pcap_ethernet_header eth;
 		janus_text2pcap_ethernet_header_init(&eth);
 		janus_text2pcap_ip_header ip;
-		janus_text2pcap_ip_header_init(&ip, incoming, len);
+		janus_text2pcap_ip_header_init(&ip, slot->incoming, slot->len);
 		janus_text2pcap_udp_header udp;
-		janus_text2pcap_udp_header_init(&udp, incoming, len);
+		janus_text2pcap_udp_header_init(&udp, slot->incoming, slot->len);
 		/* Now prepare the packet header */
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		janus_text2pcap_packet_header header = {
-			tv.tv_sec, tv.tv_usec, hsize_cut, hsize_tot
-		};
-		fwrite(&header, sizeof(char), sizeof(header), instance->file);
-		fwrite(&eth, sizeof(char), sizeof(eth), instance->file);
-		fwrite(&ip, sizeof(char), sizeof(ip), instance->file);
-		fwrite(&udp, sizeof(char), sizeof(udp), instance->file);
+		int padding = 0;
+		if(instance->pcapng) {
+			padding = (4 - ((hsize + slot->caplen) % 4)) % 4;
+			janus_text2pcap_pcapng_epb epb = {
+				0x00000006, 0, 0,
+				(guint32)(slot->when >> 32), (guint32)(slot->when & 0xFFFFFFFF),
+				hsize + slot->caplen, hsize + slot->len
+			};
+			epb.block_length = sizeof(epb) + hsize + slot->caplen + padding +
+				sizeof(janus_text2pcap_pcapng_epb_flags) + sizeof(guint32);
+			fwrite(&epb, sizeof(char), sizeof(epb), file);
+		} else {
+			janus_text2pcap_packet_header header = {
+				slot->when / G_USEC_PER_SEC, slot->when % G_USEC_PER_SEC, hsize + slot->caplen, hsize + slot->len
+			};
+			fwrite(&header, sizeof(char), sizeof(header), file);
+		}
+		fwrite(&eth, sizeof(char), sizeof(eth), file);
+		fwrite(&ip, sizeof(char), sizeof(ip), file);
+		fwrite(&udp, sizeof(char), sizeof(udp), file);
 		/* The write the packet itself (or part of it) */
-		int temp = 0, tot = size;
-		while(tot > 0) {
-			temp = fwrite(buf+size-tot, sizeof(char), tot, instance->file);
-			if(temp <= 0) {
-				JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
-				janus_mutex_unlock_nodebug(&instance->mutex);
-				return -2;
-			}
-			tot -= temp;
+		if(fwrite(slot->data, sizeof(char), slot->caplen, file) != (size_t)slot->caplen) {
+			JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
+			return -2;
+		}
+		if(instance->pcapng) {
+			/* Pad the packet data, and add the direction */
+			guint32 zero = 0;
+			if(padding > 0)
+				fwrite(&zero, sizeof(char), padding, file);
+			janus_text2pcap_pcapng_epb_flags flags = {
+				2, 4, slot->incoming ? 1 : 2, 0
+			};
+			fwrite(&flags, sizeof(char), sizeof(flags), file);
+			guint32 block_length = sizeof(janus_text2pcap_pcapng_epb) + hsize + slot->caplen + padding +
+				sizeof(janus_text2pcap_pcapng_epb_flags) + sizeof(guint32);
+			fwrite(&block_length, sizeof(char), sizeof(block_length), file);
 		}
-		/* Done */
-		janus_mutex_unlock_nodebug(&instance->mutex);
 		return 0;
 	}
 	/* If we got here, we need to prepare a text representation of the packet */
-	char buffer[5000], timestamp[20], usec[10], byte[10];
+	static const char hex[] = "0123456789abcdef";
+	char buffer[5000], timestamp[20], usec[10];
 	memset(timestamp, 0, sizeof(timestamp));
 	memset(usec, 0, sizeof(usec));
-	time_t t = time(NULL);
-	struct tm *tm = localtime(&t);
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	strftime(timestamp, sizeof(timestamp), "%H:%M:%S", tm);
-	g_snprintf(usec, sizeof(usec), ".%06ld", tv.tv_usec);
+	time_t t = slot->when / G_USEC_PER_SEC;
+	struct tm tm;
+	localtime_r(&t, &tm);
+	strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &tm);
+	g_snprintf(usec, sizeof(usec), ".%06"SCNi64, slot->when % G_USEC_PER_SEC);
 	janus_strlcat(timestamp, usec, sizeof(timestamp));
-	memset(buffer, 0, sizeof(buffer));
-	g_snprintf(buffer, sizeof(buffer), "%s %s 000000 ", incoming ? "I" : "O", timestamp);
+	int offset = g_snprintf(buffer, sizeof(buffer), "%s %s 000000 ", slot->incoming ? "I" : "O", timestamp);
 	int i=0;
-	int stop = instance->truncate ? (len > instance->truncate ? instance->truncate : len) : len;
-	for(i=0; i<stop; i++) {
-		memset(byte, 0, sizeof(byte));
-		g_snprintf(byte, sizeof(byte), " %02x", (unsigned char)buf[i]);
-		janus_strlcat(buffer, byte, sizeof(buffer));
+	for(i=0; i<slot->caplen && offset+4 < (int)sizeof(buffer); i++) {
+		unsigned char byte = (unsigned char)slot->data[i];
+		buffer[offset++] = ' ';
+		buffer[offset++] = hex[byte >> 4];
+		buffer[offset++] = hex[byte & 0x0F];
 	}
+	buffer[offset] = '\0';
 	janus_strlcat(buffer, " ", sizeof(buffer));
-	janus_strlcat(buffer, janus_text2pcap_packet_string(type), sizeof(buffer));
-	if(format) {
-		/* This callback has variable arguments (error string) */
-		char custom[512];
-		va_list ap;
-		va_start(ap, format);
-		g_vsnprintf(custom, sizeof(custom), format, ap);
-		va_end(ap);
+	janus_strlcat(buffer, janus_text2pcap_packet_string(slot->type), sizeof(buffer));
+	if(slot->note[0] != '\0') {
 		janus_strlcat(buffer, " ", sizeof(buffer));
-		janus_strlcat(buffer, custom, sizeof(buffer));
+		janus_strlcat(buffer, slot->note, sizeof(buffer));
 	}
 	janus_strlcat(buffer, "\r\n", sizeof(buffer));
 	/* Save textified packet on file */
 	int temp = 0, buflen = strlen(buffer), tot = buflen;
 	while(tot > 0) {
-		temp = fwrite(buffer+buflen-tot, sizeof(char), tot, instance->file);
+		temp = fwrite(buffer+buflen-tot, sizeof(char), tot, file);
 		if(temp <= 0) {
 			JANUS_LOG(LOG_ERR, "Error dumping packet...\n");
-			janus_mutex_unlock_nodebug(&instance->mutex);
 			return -2;
 		}
 		tot -= temp;
 	}
-	/* Done */
-	janus_mutex_unlock_nodebug(&instance->mutex);
 	return 0;
 }
 
+/* Thread draining the ring, and writing the packets to the file */
+static void *janus_text2pcap_writer(void *data) {
+	janus_text2pcap *instance = (janus_text2pcap *)data;
+	JANUS_LOG(LOG_VERB, "Joining text2pcap writer thread (%s)\n", instance->filename);
+	janus_text2pcap_slot *slot = NULL;
+	while(TRUE) {
+		slot = &instance->ring[(guint)instance->ring_tail % JANUS_TEXT2PCAP_RING_SIZE];
+		if((gint)((guint)g_atomic_int_get(&slot->sequence) - ((guint)instance->ring_tail+1)) < 0) {
+			/* Nothing to write: stop if we've been closed, or wait a bit */
+			if(!g_atomic_int_get(&instance->writable))
+				break;
+			g_usleep(5000);
+			continue;
+		}
+		janus_text2pcap_write(instance, slot);
+		g_atomic_int_inc(&instance->captured);
+		/* Give the slot back to the producers */
+		g_atomic_int_set(&slot->sequence, (gint)((guint)instance->ring_tail + JANUS_TEXT2PCAP_RING_SIZE));
+		instance->ring_tail = (gint)((guint)instance->ring_tail+1);
+	}
+	fflush(instance->file);
+	JANUS_LOG(LOG_VERB, "Leaving text2pcap writer thread (%s)\n", instance->filename);
+	return NULL;
+}
+
 int janus_text2pcap_close(janus_text2pcap *instance) {
 	if(instance == NULL)
 		return -1;
@@ -317,9 +566,18 @@ int janus_text2pcap_close(janus_text2pcap *instance) {
 		janus_mutex_unlock_nodebug(&instance->mutex);
 		return 0;
 	}
+	/* Wait for the writer to save what's still in the ring */
+	if(instance->writer != NULL) {
+		g_thread_join(instance->writer);
+		instance->writer = NULL;
+	}
 	fclose(instance->file);
 	instance->file = NULL;
 	janus_mutex_unlock_nodebug(&instance->mutex);
+	if(g_atomic_int_get(&instance->dropped_full) > 0 || g_atomic_int_get(&instance->dropped_rate) > 0) {
+		JANUS_LOG(LOG_WARN, "Capture %s: %d packets dropped (ring full), %d dropped (rate limit)\n",
+			instance->filename, g_atomic_int_get(&instance->dropped_full), g_atomic_int_get(&instance->dropped_rate));
+	}
 	return 0;
 }
 
@@ -327,6 +585,7 @@ void janus_text2pcap_free(janus_text2pcap *instance) {
 	if(instance == NULL)
 		return;
 	janus_text2pcap_close(instance);
+	g_free(instance->ring);
 	g_free(instance->filename);
 	g_free(instance);
 }
@@ -4,8 +4,9 @@
  * \brief    Dumping of RTP/RTCP packets to text2pcap or pcap format (headers)
  * \details  Implementation of a simple helper utility that can be used
  * to dump incoming and outgoing RTP/RTCP packets to pcap or text2pcap format.
- * Saving to pcap natively can be more efficient but will lack some features,
- * as the target will be a legacy (v2.4) \c .pcap file and not a \c .pcapng one.
+ * Saving to pcap natively can be more efficient, and the target can either
+ * be a legacy (v2.4) \c .pcap file or a \c .pcapng one: the latter also
+ * marks each packet as inbound or outbound, which Wireshark can filter on.
  * When saving to a text file, instead, the resulting file can be passed to
  * the \c text2pcap application in order to get a \c .pcap or \c .pcapng file
  * that can be analyzed via Wireshark or similar applications, e.g.:
@@ -22,6 +23,15 @@
  * of that section for more details. Notice that starting a new dump on
  * an existing filename will result in the new packets to be appended.
  *
+ * To keep the overhead on the media path as low as possible, dumping a
+ * packet only copies it (or the part of it that will be saved) to a
+ * lock-free ring: a background thread takes care of formatting the
+ * packets and writing them to the file. If that thread can't keep up,
+ * or if the capture is limited to a maximum number of packets per
+ * second, the packets in excess are dropped and counted. Captures can
+ * also be limited to the RTP headers (and extensions), to capture the
+ * traffic of many handles without saving their media.
+ *
  * \note Motivation and inspiration for this work came from a
  * <a href="https://blog.mozilla.org/webrtc/debugging-encrypted-rtp-is-more-fun-than-it-used-to-be/">similar effort</a>
  * recently done in Firefox, and from a discussion related to a
@@ -45,6 +55,23 @@
 
 #include "mutex.h"
 
+/*! \brief Filter on the packets a text2pcap recorder will capture */
+typedef struct janus_text2pcap_filter {
+	/*! \brief Whether incoming and/or outgoing packets should be captured */
+	gboolean incoming, outgoing;
+	/*! \brief Whether audio and/or video packets should be captured */
+	gboolean audio, video;
+	/*! \brief Whether RTP and/or RTCP packets should be captured */
+	gboolean rtp, rtcp;
+	/*! \brief Only capture packets with this SSRC (0 means any SSRC) */
+	guint32 ssrc;
+	/*! \brief Only capture one out of this many packets (0 or 1 means all of them) */
+	int sampling;
+} janus_text2pcap_filter;
+
+/*! \brief Packet queued in the ring of a text2pcap recorder */
+typedef struct janus_text2pcap_slot janus_text2pcap_slot;
+
 /*! \brief Instance of a text2pcap recorder */
 typedef struct janus_text2pcap {
 	/*! \brief Absolute path to where the text2pcap file is stored */
@@ -55,6 +82,32 @@ typedef struct janus_text2pcap {
 	int truncate;
 	/*! \brief Whether we'll save as text, or directly to pcap */
 	gboolean text;
+	/*! \brief Whether we'll save to pcapng, rather than legacy pcap */
+	gboolean pcapng;
+	/*! \brief Whether we'll only save the RTP headers (and extensions) of RTP packets */
+	gboolean headers_only;
+	/*! \brief Maximum number of packets per second to capture (0 means no limit) */
+	int max_rate;
+	/*! \brief Filter on the packets to capture */
+	janus_text2pcap_filter filter;
+	/*! \brief Number of packets that passed the filter, for sampling purposes */
+	volatile gint filtered;
+	/*! \brief Ring the packets to dump are queued in */
+	janus_text2pcap_slot *ring;
+	/*! \brief Position in the ring the next packet will be queued at */
+	volatile gint ring_head;
+	/*! \brief Position in the ring the writer will read the next packet from */
+	gint ring_tail;
+	/*! \brief Thread writing the queued packets to the file */
+	GThread *writer;
+	/*! \brief Current rate limiting window (in seconds), and packets captured in it */
+	volatile gint rate_window, rate_count;
+	/*! \brief Number of packets captured so far */
+	volatile gint captured;
+	/*! \brief Number of packets dropped because the ring was full */
+	volatile gint dropped_full;
+	/*! \brief Number of packets dropped because of the rate limit */
+	volatile gint dropped_rate;
 	/*! \brief Whether we can write to this file or not */
 	volatile int writable;
 	/*! \brief Mutex to lock/unlock this recorder instance */
@@ -79,7 +132,36 @@ const char *janus_text2pcap_packet_string(janus_text2pcap_packet type);
  * @returns A valid janus_text2pcap instance in case of success, NULL otherwise */
 janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, int truncate, gboolean text);
 
+/*! \brief Create a text2pcap recorder, with more control on what is captured and how
+ * \note If no target directory is provided, the current directory will be used. If no filename
+ * is passed, a random filename will be used.
+ * @param[in] dir Path of the directory to save the recording into (will try to create it if it doesn't exist)
+ * @param[in] filename Filename to use for the recording
+ * @param[in] truncate Number of bytes to truncate each packet at (0 to not truncate at all)
+ * @param[in] text Whether we'll save as text, or directly to pcap
+ * @param[in] pcapng Whether we'll save to pcapng rather than legacy pcap (ignored if saving as text)
+ * @param[in] headers_only Whether we'll only save the RTP headers (and extensions) of RTP packets
+ * @param[in] max_rate Maximum number of packets per second to capture (0 means no limit)
+ * @returns A valid janus_text2pcap instance in case of success, NULL otherwise */
+janus_text2pcap *janus_text2pcap_create_full(const char *dir, const char *filename, int truncate,
+	gboolean text, gboolean pcapng, gboolean headers_only, int max_rate);
+
+/*! \brief Restrict the packets a text2pcap recorder will capture
+ * \note This should be done before any packet is dumped: by default, all packets are captured
+ * @param[in] instance Instance of the janus_text2pcap recorder to configure
+ * @param[in] filter The filter to apply to the packets (copied) */
+void janus_text2pcap_set_filter(janus_text2pcap *instance, const janus_text2pcap_filter *filter);
+
+/*! \brief Check whether a text2pcap recorder captures audio or video packets
+ * \note The recorder can't tell by itself which media a packet belongs to,
+ * so this is meant to be checked before dumping a packet
+ * @param[in] instance Instance of the janus_text2pcap recorder to check
+ * @param[in] video Whether the packet to dump is video, rather than audio
+ * @returns TRUE if packets of that media are captured, FALSE otherwise */
+gboolean janus_text2pcap_media_enabled(janus_text2pcap *instance, gboolean video);
+
 /*! \brief Dump an RTP or RTCP packet
+ * \note The packet is only queued: it's a background thread that writes it to the file
  * @param[in] instance Instance of the janus_text2pcap recorder to dump the packet to
  * @param[in] type Type of the packet we're going to dump
  * @param[in] incoming Whether this is an incoming or outgoing packet
@@ -90,7 +172,7 @@ janus_text2pcap *janus_text2pcap_create(const char *dir, const char *filename, i
 int janus_text2pcap_dump(janus_text2pcap *instance,
 	janus_text2pcap_packet type, gboolean incoming, char *buf, int len, const char *format, ...) G_GNUC_PRINTF(6, 7);
 
-/*! \brief Close a text2pcap recorder
+/*! \brief Close a text2pcap recorder, waiting for the queued packets to be written first
  * @param[in] instance Instance of the janus_text2pcap recorder to close
  * @returns 0 in case of success, a negative integer otherwise */
 int janus_text2pcap_close(janus_text2pcap *instance);
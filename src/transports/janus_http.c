@@ -14,7 +14,10 @@
  * associated to a Janus session (and as such to all its plugin handles
  * and the events plugins push in the session itself), using a long poll
  * approach. A JavaScript library (janus.js) implements all of this on
- * the client side automatically.
+ * the client side automatically. When a \c metrics_path is configured,
+ * GET requests on that path on the admin/monitor web server return the
+ * core and plugins metrics in the Prometheus/OpenMetrics text format,
+ * which is much cheaper to scrape than polling the Admin API.
  * \note There's a well known bug in libmicrohttpd that may cause it to
  * spike to 100% of the CPU when using HTTPS on some distributions. In
  * case you're interested in HTTPS support, it's better to just rely on
@@ -156,19 +159,29 @@ typedef struct janus_http_msg {
 	gint64 session_id;					/* Janus-Client session identifier this message belongs to */
 	char *response;						/* The response from the core as a string */
 	size_t resplen;						/* Length of the response in octets */
+	size_t respoffset;					/* In case this is a stream, how much of the response has been sent already */
 	GSource *timeout;					/* Timeout monitor, if any */
 	volatile gint timeout_flag;			/* Whether a timeout hasn't fired yet */
+	struct janus_http_session *stream;	/* In case this is a stream of server-sent events, the session it's for */
+	char *secret, *token;				/* In case this is a stream, the credentials to use for keepalives to the core */
+	GSource *stream_keepalive;			/* In case this is a stream, periodic keepalive monitor */
+	volatile gint stream_ping;			/* Whether a keepalive should be sent on the stream */
 	volatile gint destroyed;			/* Whether this session has been destroyed */
 	janus_refcount ref;					/* Reference counter for this message */
 } janus_http_msg;
 static GHashTable *messages = NULL;
 static janus_mutex messages_mutex = JANUS_MUTEX_INITIALIZER;
 
+static void janus_http_session_unref(struct janus_http_session *session);
 static void janus_http_msg_free(const janus_refcount *msg_ref) {
 	janus_http_msg *request = janus_refcount_containerof(msg_ref, janus_http_msg, ref);
 	/* This message can be destroyed, free all the resources */
 	if(!request)
 		return;
+	if(request->stream)
+		janus_http_session_unref(request->stream);
+	g_free(request->secret);
+	g_free(request->token);
 	g_free(request->payload);
 	g_free(request->contenttype);
 	g_free(request->acro);
@@ -191,6 +204,7 @@ typedef struct janus_http_session {
 	guint64 session_id;			/* Core session identifier */
 	GAsyncQueue *events;		/* Events to notify for this session */
 	GList *longpolls;			/* Long poll connection */
+	GList *streams;				/* Server-sent events streams (janus_http_msg instances) */
 	janus_mutex mutex;			/* Mutex to lock this instance */
 	volatile gint destroyed;	/* Whether this session has been destroyed */
 	janus_refcount ref;			/* Reference counter for this session */
@@ -214,9 +228,25 @@ static void janus_http_session_free(const janus_refcount *session_ref) {
 			json_decref(event);
 		g_async_queue_unref(session->events);
 	}
+	g_list_free(session->streams);
 	g_free(session);
 }
 
+static void janus_http_session_unref(janus_http_session *session) {
+	janus_refcount_decrease(&session->ref);
+}
+
+/* Helper to wake up the server-sent events streams of a session (session mutex must be locked) */
+static void janus_http_session_wake_streams(janus_http_session *session) {
+	GList *l = session->streams;
+	while(l) {
+		janus_http_msg *msg = (janus_http_msg *)l->data;
+		if(g_atomic_int_compare_and_exchange(&msg->suspended, 1, 0))
+			MHD_resume_connection(msg->connection);
+		l = l->next;
+	}
+}
+
 
 /* Custom GSource for tracking request timeouts (including long polls) */
 typedef struct janus_http_request_timeout {
@@ -281,10 +311,18 @@ static void janus_http_request_completed(void *cls, struct MHD_Connection *conne
 	void **con_cls, enum MHD_RequestTerminationCode toe);
 /* Callback to send data back after resuming a connection */
 static ssize_t janus_http_response_callback(void *cls, uint64_t pos, char *buf, size_t max);
+/* Callback (libmicrohttpd) invoked when more data should be sent on a server-sent events stream */
+static ssize_t janus_http_stream_callback(void *cls, uint64_t pos, char *buf, size_t max);
+/* How often (in seconds) we send keepalives on server-sent events streams */
+#define JANUS_HTTP_STREAM_KEEPALIVE		25
+static gboolean janus_http_stream_keepalive(gpointer user_data);
+static void janus_http_transport_session_unref(gpointer user_data);
 /* Worker to handle requests that are actually long polls */
 static int janus_http_notifier(janus_http_msg *msg);
 /* Helper to quickly send a success response */
 static MHD_Result janus_http_return_success(janus_transport_session *ts, char *payload);
+/* Helper to send the metrics the core collected */
+static MHD_Result janus_http_return_metrics(janus_transport_session *ts);
 /* Helper to quickly send an error response */
 static MHD_Result janus_http_return_error(janus_transport_session *ts, uint64_t session_id,
 	const char *transaction, gint error, const char *format, ...) G_GNUC_PRINTF(5, 6);
@@ -298,6 +336,8 @@ static char *cert_pem_bytes = NULL, *cert_key_bytes = NULL;
 /* Admin/Monitor MHD Web Server */
 static struct MHD_Daemon *admin_ws = NULL, *admin_sws = NULL;
 static char *admin_ws_path = NULL;
+/* Path of the Prometheus/OpenMetrics scrape endpoint on the admin web server, if enabled */
+static char *metrics_path = NULL;
 
 /* Custom Access-Control-Allow-Origin value, if specified */
 static char *allow_origin = NULL;
@@ -710,6 +750,16 @@ int janus_http_init(janus_transport_callbacks *callback, const char *config_path
 		} else {
 			admin_ws_path = g_strdup("/admin");
 		}
+		/* Should we serve metrics scrapes on the admin/monitor interface too? */
+		item = janus_config_get(config, config_admin, janus_config_type_item, "metrics_path");
+		if(item && item->value) {
+			if(item->value[0] != '/') {
+				JANUS_LOG(LOG_FATAL, "Invalid metrics path %s (it should start with a /, e.g., /metrics\n", item->value);
+				return -1;
+			}
+			metrics_path = g_strdup(item->value);
+			JANUS_LOG(LOG_INFO, "Metrics will be served on %s (admin/monitor webserver)\n", metrics_path);
+		}
 		/* Check the open connections limit for mhd */
 		item = janus_config_get(config, config_general, janus_config_type_item, "mhd_connection_limit");
 		if(item && item->value && janus_string_to_uint32(item->value, &connection_limit) < 0) {
@@ -1075,6 +1125,8 @@ int janus_http_send_message(janus_transport_session *transport, void *request_id
 			}
 			session->longpolls = g_list_remove(session->longpolls, transport);
 		}
+		/* Any stream waiting for events? */
+		janus_http_session_wake_streams(session);
 		janus_mutex_unlock(&session->mutex);
 		janus_refcount_decrease(&session->ref);
 	} else {
@@ -1112,7 +1164,7 @@ int janus_http_send_message(janus_transport_session *transport, void *request_id
 			g_source_unref(msg->timeout);
 		}
 		msg->timeout = NULL;
-		char *response_text = json_dumps(message, json_format);
+		char *response_text = janus_json_dumps(message, json_format);
 		json_decref(message);
 		if(response_text == NULL) {
 			JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
@@ -1142,6 +1194,7 @@ void janus_http_session_created(janus_transport_session *transport, guint64 sess
 	session->session_id = session_id;
 	session->events = g_async_queue_new();
 	session->longpolls = NULL;
+	session->streams = NULL;
 	janus_mutex_init(&session->mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_http_session_free);
@@ -1155,8 +1208,18 @@ void janus_http_session_over(janus_transport_session *transport, guint64 session
 		claimed ? "but has been claimed" : "and has not been claimed", session_id);
 	/* Get rid of the session's queue of events */
 	janus_mutex_lock(&sessions_mutex);
+	janus_http_session *session = g_hash_table_lookup(sessions, &session_id);
+	if(session != NULL)
+		janus_refcount_increase(&session->ref);
 	g_hash_table_remove(sessions, &session_id);
 	janus_mutex_unlock(&sessions_mutex);
+	if(session == NULL)
+		return;
+	/* Wake up the streams, if any, so that they're closed */
+	janus_mutex_lock(&session->mutex);
+	janus_http_session_wake_streams(session);
+	janus_mutex_unlock(&session->mutex);
+	janus_refcount_decrease(&session->ref);
 }
 
 void janus_http_session_claimed(janus_transport_session *transport, guint64 session_id) {
@@ -1171,6 +1234,7 @@ void janus_http_session_claimed(janus_transport_session *transport, guint64 sess
 	session->session_id = session_id;
 	session->events = g_async_queue_new();
 	session->longpolls = NULL;
+	session->streams = NULL;
 	janus_mutex_init(&session->mutex);
 	g_atomic_int_set(&session->destroyed, 0);
 	janus_refcount_init(&session->ref, janus_http_session_free);
@@ -1200,6 +1264,8 @@ void janus_http_session_claimed(janus_transport_session *transport, guint64 sess
 		}
 		session->longpolls = g_list_remove(old_session->longpolls, transport);
 	}
+	/* Streams for the old session will be closed too */
+	janus_http_session_wake_streams(old_session);
 	janus_mutex_unlock(&old_session->mutex);
 	janus_refcount_decrease(&old_session->ref);
 }
@@ -1631,6 +1697,39 @@ static MHD_Result janus_http_handler(void *cls, struct MHD_Connection *connectio
 				max_events = 1;
 			}
 		}
+		/* Does the application want a stream of server-sent events, rather than a long poll? */
+		const char *accept = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Accept");
+		if(accept && strstr(accept, "text/event-stream")) {
+			JANUS_LOG(LOG_VERB, "Session %"SCNu64" found... streaming events\n", session_id);
+			response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN,
+				1024, &janus_http_stream_callback, msg, NULL);
+			if(response == NULL) {
+				ret = MHD_NO;
+			} else {
+				/* Mark this connection as a stream for this session */
+				janus_mutex_lock(&session->mutex);
+				janus_refcount_increase(&session->ref);
+				msg->stream = session;
+				msg->secret = g_strdup(secret);
+				msg->token = g_strdup(token);
+				janus_refcount_increase(&msg->ref);
+				session->streams = g_list_append(session->streams, msg);
+				janus_mutex_unlock(&session->mutex);
+				MHD_add_response_header(response, "Content-Type", "text/event-stream");
+				MHD_add_response_header(response, "Cache-Control", "no-cache");
+				janus_http_add_cors_headers(msg, response);
+				ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+				MHD_destroy_response(response);
+				/* The stream replaces long polls, so we'll need to keep the session alive ourselves */
+				janus_refcount_increase(&ts->ref);
+				msg->stream_keepalive = g_timeout_source_new_seconds(JANUS_HTTP_STREAM_KEEPALIVE);
+				g_source_set_callback(msg->stream_keepalive, janus_http_stream_keepalive, ts,
+					janus_http_transport_session_unref);
+				g_source_attach(msg->stream_keepalive, httpctx);
+			}
+			janus_refcount_decrease(&session->ref);
+			goto done;
+		}
 		JANUS_LOG(LOG_VERB, "Session %"SCNu64" found... returning up to %d messages\n", session_id, max_events);
 		/* Handle GET, taking the first message from the list */
 		janus_mutex_lock(&session->mutex);
@@ -1638,7 +1737,7 @@ static MHD_Result janus_http_handler(void *cls, struct MHD_Connection *connectio
 		if(event != NULL) {
 			if(max_events == 1) {
 				/* Return just this message and leave */
-				char *event_text = json_dumps(event, json_format);
+				char *event_text = janus_json_dumps(event, json_format);
 				json_decref(event);
 				ret = janus_http_return_success(ts, event_text);
 			} else {
@@ -1844,6 +1943,13 @@ static MHD_Result janus_http_admin_handler(void *cls, struct MHD_Connection *con
 		ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
 		MHD_destroy_response(response);
 	}
+	/* Is this a metrics scrape? */
+	if(metrics_path != NULL && !strcasecmp(method, "GET") && !strcmp(url, metrics_path)) {
+		if(firstround)
+			return ret;
+		ret = janus_http_return_metrics(ts);
+		goto done;
+	}
 	/* Get path components */
 	if(strcasecmp(url, admin_ws_path)) {
 		if(strnlen(admin_ws_path, 1 + 1) > 1) {
@@ -2066,6 +2172,21 @@ static void janus_http_request_completed(void *cls, struct MHD_Connection *conne
 			janus_mutex_unlock(&session->mutex);
 			janus_refcount_decrease(&session->ref);
 		}
+		if(request->stream) {
+			/* This was a stream of server-sent events, stop keeping it alive */
+			if(request->stream_keepalive) {
+				g_source_destroy(request->stream_keepalive);
+				g_source_unref(request->stream_keepalive);
+				request->stream_keepalive = NULL;
+			}
+			janus_mutex_lock(&request->stream->mutex);
+			GList *l = g_list_find(request->stream->streams, request);
+			if(l != NULL) {
+				request->stream->streams = g_list_delete_link(request->stream->streams, l);
+				janus_refcount_decrease(&request->ref);
+			}
+			janus_mutex_unlock(&request->stream->mutex);
+		}
 		janus_refcount_decrease(&request->ref);
 	}
 	janus_mutex_lock(&messages_mutex);
@@ -2089,6 +2210,93 @@ static ssize_t janus_http_response_callback(void *cls, uint64_t pos, char *buf,
 	return bytes;
 }
 
+static ssize_t janus_http_stream_callback(void *cls, uint64_t pos, char *buf, size_t max) {
+	janus_http_msg *request = (janus_http_msg *)cls;
+	if(request == NULL || request->stream == NULL || g_atomic_int_get(&stopping))
+		return MHD_CONTENT_READER_END_WITH_ERROR;
+	janus_http_session *session = request->stream;
+	janus_mutex_lock(&session->mutex);
+	if(request->response == NULL) {
+		/* Nothing left to send from before, is there any new event? */
+		json_t *event = g_async_queue_try_pop(session->events);
+		if(event != NULL) {
+			/* Events are sent on a single line, no matter which format was configured */
+			char *event_text = janus_json_dumps(event, JSON_INDENT(0) | JSON_PRESERVE_ORDER);
+			json_decref(event);
+			if(event_text != NULL) {
+				request->response = g_strdup_printf("data: %s\n\n", event_text);
+				free(event_text);
+			}
+		} else if(g_atomic_int_compare_and_exchange(&request->stream_ping, 1, 0)) {
+			/* Send a comment, to keep the connection alive */
+			request->response = g_strdup(": keepalive\n\n");
+		}
+		if(request->response == NULL) {
+			if(g_atomic_int_get(&session->destroyed)) {
+				/* The session is gone, close the stream */
+				janus_mutex_unlock(&session->mutex);
+				return MHD_CONTENT_READER_END_OF_STREAM;
+			}
+			/* Wait for the next event */
+			g_atomic_int_set(&request->suspended, 1);
+			MHD_suspend_connection(request->connection);
+			janus_mutex_unlock(&session->mutex);
+			return 0;
+		}
+		request->resplen = strlen(request->response);
+		request->respoffset = 0;
+	}
+	size_t bytes = request->resplen - request->respoffset;
+	if(bytes > max)
+		bytes = max;
+	memcpy(buf, request->response + request->respoffset, bytes);
+	request->respoffset += bytes;
+	if(request->respoffset >= request->resplen) {
+		g_free(request->response);
+		request->response = NULL;
+		request->resplen = 0;
+		request->respoffset = 0;
+	}
+	janus_mutex_unlock(&session->mutex);
+	return bytes;
+}
+
+static void janus_http_transport_session_unref(gpointer user_data) {
+	janus_transport_session *ts = (janus_transport_session *)user_data;
+	janus_refcount_decrease(&ts->ref);
+}
+
+static gboolean janus_http_stream_keepalive(gpointer user_data) {
+	janus_transport_session *ts = (janus_transport_session *)user_data;
+	janus_http_msg *msg = (janus_http_msg *)ts->transport_p;
+	if(msg == NULL || msg->stream == NULL || g_atomic_int_get(&ts->destroyed) || g_atomic_int_get(&stopping))
+		return G_SOURCE_REMOVE;
+	janus_http_session *session = msg->stream;
+	if(g_atomic_int_get(&session->destroyed))
+		return G_SOURCE_REMOVE;
+	/* Pass a fake keepalive to the core, as a long poll would do */
+	char tr[12];
+	janus_http_random_string(12, (char *)&tr);
+	json_t *root = json_object();
+	json_object_set_new(root, "janus", json_string("keepalive"));
+	json_object_set_new(root, "session_id", json_integer(session->session_id));
+	json_object_set_new(root, "transaction", json_string(tr));
+	if(msg->secret)
+		json_object_set_new(root, "apisecret", json_string(msg->secret));
+	if(msg->token)
+		json_object_set_new(root, "token", json_string(msg->token));
+	gateway->incoming_request(&janus_http_transport, ts, (void *)keepalive_id, FALSE, root, NULL);
+	/* Send a keepalive to the client as well, if the stream is still there */
+	janus_mutex_lock(&session->mutex);
+	if(g_list_find(session->streams, msg) != NULL) {
+		g_atomic_int_set(&msg->stream_ping, 1);
+		if(g_atomic_int_compare_and_exchange(&msg->suspended, 1, 0))
+			MHD_resume_connection(msg->connection);
+	}
+	janus_mutex_unlock(&session->mutex);
+	return G_SOURCE_CONTINUE;
+}
+
 /* Worker to handle notifications */
 static int janus_http_notifier(janus_http_msg *msg) {
 	if(!msg || !msg->connection)
@@ -2147,7 +2355,7 @@ static int janus_http_notifier(janus_http_msg *msg) {
 		}
 		/* FIXME Improve the Janus protocol keep-alive mechanism in JavaScript */
 	}
-	char *payload_text = json_dumps(max_events == 1 ? event : list, json_format);
+	char *payload_text = janus_json_dumps(max_events == 1 ? event : list, json_format);
 	json_decref(max_events == 1 ? event : list);
 	if(payload_text == NULL) {
 		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
@@ -2193,6 +2401,30 @@ static MHD_Result janus_http_return_success(janus_transport_session *ts, char *p
 	return ret;
 }
 
+/* Helper to send the metrics the core collected, in the OpenMetrics text format */
+static MHD_Result janus_http_return_metrics(janus_transport_session *ts) {
+	if(!ts)
+		return MHD_NO;
+	janus_http_msg *msg = (janus_http_msg *)ts->transport_p;
+	if(!msg || !msg->connection)
+		return MHD_NO;
+	char *metrics = gateway->get_metrics();
+	if(metrics == NULL)
+		return MHD_NO;
+	janus_refcount_increase(&msg->ref);
+	struct MHD_Response *response = MHD_create_response_from_buffer(
+		strlen(metrics),
+		(void*)metrics,
+		MHD_RESPMEM_MUST_COPY);
+	g_free(metrics);
+	MHD_add_response_header(response, "Content-Type", "application/openmetrics-text; version=1.0.0; charset=utf-8");
+	janus_http_add_cors_headers(msg, response);
+	int ret = MHD_queue_response(msg->connection, MHD_HTTP_OK, response);
+	MHD_destroy_response(response);
+	janus_refcount_decrease(&msg->ref);
+	return ret;
+}
+
 /* Helper to quickly send an error response */
 static MHD_Result janus_http_return_error(janus_transport_session *ts, uint64_t session_id,
 		const char *transaction, gint error, const char *format, ...) {
@@ -2256,7 +2488,7 @@ void janus_http_timeout(janus_transport_session *ts, janus_http_session *session
 			json_array_append_new(list, event);
 			event = list;
 		}
-		char *payload_text = json_dumps(event, json_format);
+		char *payload_text = janus_json_dumps(event, json_format);
 		json_decref(event);
 		if(payload_text == NULL) {
 			JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
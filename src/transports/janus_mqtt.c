@@ -22,6 +22,18 @@
  * events related to it is done automatically through the outgoing queue,
  * so no need for an explicit request as the GET in the plain HTTP API.
  *
+ * To scale the Janus API traffic, the plugin can open a pool of client
+ * connections to the broker (\c clients property). In that case, all the
+ * connections subscribe to the incoming topic as a shared subscription
+ * (\c $share/\<group>/\<topic>), so that the broker spreads requests on
+ * all of them, while outgoing messages are sharded by session: all the
+ * messages related to the same session go through the same connection,
+ * which preserves their order. Messages for the same topic can also be
+ * published in batches (\c publish_batch property): in that case, what
+ * is published is a JSON array of Janus API messages, which the
+ * application must be ready to handle. Admin API and status messages
+ * always go through the first connection, and are never batched.
+ *
  * \ingroup transports
  * \ref transports
  */
@@ -153,12 +165,17 @@ typedef struct janus_mqtt_context {
 	} status;
 	struct {
 		char *topic;
+		/* What we actually subscribe to (a shared subscription, when we have a pool of clients) */
+		char *filter;
 		int qos;
 	} subscribe;
 	struct {
 		char *topic;
 		int qos;
 		gboolean retain;
+		/* Batched publication: maximum messages per batch, and how long they can wait (ms) */
+		int batch_size;
+		int batch_time;
 #ifdef MQTTVERSION_5
 		GArray *proxy_transaction_user_properties;
 		GArray *add_transaction_user_properties;
@@ -183,6 +200,13 @@ typedef struct janus_mqtt_context {
 #ifdef MQTTVERSION_5
 	gint64 vacuum_interval;
 #endif
+	/* Index of this client in the pool (the first one is the main one, and owns the configuration) */
+	guint index;
+	/* Janus API messages waiting to be published as a batch */
+	struct {
+		json_t *messages;
+		janus_mutex mutex;
+	} batch;
 } janus_mqtt_context;
 
 #ifdef MQTTVERSION_5
@@ -267,6 +291,20 @@ void janus_mqtt_client_publish_status_failure_impl(int rc);
 /* We only handle a single client */
 static janus_mqtt_context *context_ = NULL;
 static janus_transport_session *mqtt_session = NULL;
+/* Pool of client connections, sessions are sharded on them (the first one is context_) */
+static janus_mqtt_context **pool_ = NULL;
+static guint pool_size = 1;
+#define JANUS_MQTT_DEFAULT_SHARED_GROUP	"janus"
+/* Thread flushing pending batches of messages */
+static GMainContext *batch_context = NULL;
+static GMainLoop *batch_loop = NULL;
+static GThread *batch_thread = NULL;
+static gpointer janus_mqtt_batch_thread(gpointer context);
+static gboolean janus_mqtt_batch_timeout(gpointer context);
+static void janus_mqtt_batch_add(janus_mqtt_context *ctx, json_t *message);
+static void janus_mqtt_batch_flush(janus_mqtt_context *ctx);
+static int janus_mqtt_client_create(janus_mqtt_context *ctx, const char *url, const char *client_id);
+static gboolean janus_mqtt_has_transaction_state(janus_mqtt_context *ctx, json_t *message);
 
 #ifdef MQTTVERSION_5
 /* MQTT 5 specific statics and functions */
@@ -294,6 +332,7 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 	/* Initializing context */
 	janus_mqtt_context *ctx = g_malloc0(sizeof(struct janus_mqtt_context));
 	ctx->gateway = callback;
+	janus_mutex_init(&ctx->batch.mutex);
 	context_ = ctx;
 
 	/* Set default values */
@@ -506,6 +545,23 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 				ctx->publish.qos = 1;
 			}
 
+			janus_config_item *batch_item = janus_config_get(config, config_general, janus_config_type_item, "publish_batch");
+			ctx->publish.batch_size = (batch_item && batch_item->value) ? atoi(batch_item->value) : 0;
+			if(ctx->publish.batch_size < 0) {
+				JANUS_LOG(LOG_ERR, "Invalid publish-batch value: %s (disabling)\n", batch_item->value);
+				ctx->publish.batch_size = 0;
+			}
+			janus_config_item *batch_time_item = janus_config_get(config, config_general, janus_config_type_item, "publish_batch_time");
+			ctx->publish.batch_time = (batch_time_item && batch_time_item->value) ? atoi(batch_time_item->value) : 10;
+			if(ctx->publish.batch_time <= 0) {
+				JANUS_LOG(LOG_ERR, "Invalid publish-batch-time value: %s (falling back to default)\n", batch_time_item->value);
+				ctx->publish.batch_time = 10;
+			}
+			if(ctx->publish.batch_size > 1) {
+				JANUS_LOG(LOG_INFO, "Janus API messages will be published in batches of up to %d (%d ms)\n",
+					ctx->publish.batch_size, ctx->publish.batch_time);
+			}
+
 #ifdef MQTTVERSION_5
 			if (ctx->connect.mqtt_version == MQTTVERSION_5) {
 				/* MQTT 5 specific configuration */
@@ -547,6 +603,27 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 			}
 #endif
 		}
+
+		/* Pool of clients configuration */
+		{
+			janus_config_item *clients_item = janus_config_get(config, config_general, janus_config_type_item, "clients");
+			int clients = (clients_item && clients_item->value) ? atoi(clients_item->value) : 1;
+			if(clients < 1) {
+				JANUS_LOG(LOG_ERR, "Invalid clients value: %s (falling back to default)\n", clients_item->value);
+				clients = 1;
+			}
+			pool_size = clients;
+			if(pool_size > 1) {
+				/* All the clients share the subscription, so that the broker spreads requests on them */
+				janus_config_item *group_item = janus_config_get(config, config_general, janus_config_type_item, "shared_group");
+				ctx->subscribe.filter = g_strdup_printf("$share/%s/%s",
+					(group_item && group_item->value) ? group_item->value : JANUS_MQTT_DEFAULT_SHARED_GROUP,
+					ctx->subscribe.topic);
+				JANUS_LOG(LOG_INFO, "Using a pool of %u MQTT clients (%s)\n", pool_size, ctx->subscribe.filter);
+			} else {
+				ctx->subscribe.filter = g_strdup(ctx->subscribe.topic);
+			}
+		}
 	} else {
 		janus_mqtt_api_enabled_ = FALSE;
 		ctx->subscribe.topic = NULL;
@@ -683,7 +760,79 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 	}
 #endif
 
-	/* Creating a client */
+	/* Creating the clients: the first one is the main one */
+	if(janus_mqtt_client_create(ctx, url, client_id) < 0)
+		goto error;
+	pool_ = g_malloc0(pool_size * sizeof(janus_mqtt_context *));
+	pool_[0] = ctx;
+	guint i = 0;
+	for(i=1; i<pool_size; i++) {
+		/* The other clients share the configuration of the main one,
+		 * but are only used for the Janus API, so no status/admin topics */
+		janus_mqtt_context *client = g_malloc(sizeof(janus_mqtt_context));
+		*client = *ctx;
+		client->index = i;
+		client->client = NULL;
+		client->status.enabled = FALSE;
+		client->batch.messages = NULL;
+		janus_mutex_init(&client->batch.mutex);
+		janus_mutex_init(&client->disconnect.mutex);
+		janus_condition_init(&client->disconnect.cond);
+		pool_[i] = client;
+		char *pool_client_id = g_strdup_printf("%s-%u", client_id, i);
+		int res = janus_mqtt_client_create(client, url, pool_client_id);
+		g_free(pool_client_id);
+		if(res < 0)
+			goto error;
+	}
+
+	if(janus_mqtt_api_enabled_ && ctx->publish.batch_size > 1) {
+		/* Start the thread publishing batches that are due */
+		batch_context = g_main_context_new();
+		batch_loop = g_main_loop_new(batch_context, FALSE);
+		GError *terror = NULL;
+		batch_thread = g_thread_try_new("mqtt batch", &janus_mqtt_batch_thread, ctx, &terror);
+		if(terror != NULL) {
+			JANUS_LOG(LOG_ERR, "Failed to spawn MQTT transport batch thread (%d): %s\n", terror->code, terror->message ? terror->message : "??");
+			g_error_free(terror);
+			goto error;
+		}
+	}
+
+	g_free((char *)url);
+	g_free((char *)client_id);
+	janus_config_destroy(config);
+	return 0;
+
+error:
+	/* If we got here, something went wrong */
+#ifdef MQTTVERSION_5
+	if(vacuum_loop != NULL)
+		g_main_loop_unref(vacuum_loop);
+	if(vacuum_context != NULL)
+		g_main_context_unref(vacuum_context);
+#endif
+	if(batch_loop != NULL)
+		g_main_loop_unref(batch_loop);
+	if(batch_context != NULL)
+		g_main_context_unref(batch_context);
+	if(pool_ != NULL) {
+		guint j = 0;
+		for(j=1; j<pool_size; j++)
+			janus_mqtt_client_destroy_context(&pool_[j]);
+		g_free(pool_);
+		pool_ = NULL;
+	}
+	janus_transport_session_destroy(mqtt_session);
+	janus_mqtt_client_destroy_context(&ctx);
+	g_free((char *)url);
+	g_free((char *)client_id);
+	janus_config_destroy(config);
+
+	return -1;
+}
+
+static int janus_mqtt_client_create(janus_mqtt_context *ctx, const char *url, const char *client_id) {
 	MQTTAsync_createOptions create_options = MQTTAsync_createOptions_initializer;
 
 #ifdef MQTTVERSION_5
@@ -702,33 +851,33 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 			NULL,
 			&create_options) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error creating client...\n");
-		goto error;
+		return -1;
 	}
 
 	if(MQTTAsync_setConnected(ctx->client, ctx, janus_mqtt_client_connected) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error setting up connected callback...\n");
-		goto error;
+		return -1;
 	}
 
 #ifdef MQTTVERSION_5
 	if(MQTTAsync_setDisconnected(ctx->client, ctx, janus_mqtt_client_disconnected5) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error setting up disconnected callback...\n");
-		goto error;
+		return -1;
 	}
 
 	if(MQTTAsync_setConnectionLostCallback(ctx->client, ctx, janus_mqtt_client_connection_lost) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error setting up connection lost callback...\n");
-		goto error;
+		return -1;
 	}
 
 	if(MQTTAsync_setMessageArrivedCallback(ctx->client, ctx, janus_mqtt_client_message_arrived) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error setting up message arrived callback...\n");
-		goto error;
+		return -1;
 	}
 #else
 	if(MQTTAsync_setCallbacks(ctx->client, ctx, janus_mqtt_client_connection_lost, janus_mqtt_client_message_arrived, NULL) != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker: error callbacks...\n");
-		goto error;
+		return -1;
 	}
 #endif
 
@@ -736,35 +885,36 @@ int janus_mqtt_init(janus_transport_callbacks *callback, const char *config_path
 	int rc = janus_mqtt_client_connect(ctx);
 	if(rc != MQTTASYNC_SUCCESS) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to MQTT broker, return code: %d\n", rc);
-		goto error;
+		return -1;
 	}
 
-	g_free((char *)url);
-	g_free((char *)client_id);
-	janus_config_destroy(config);
 	return 0;
-
-error:
-	/* If we got here, something went wrong */
-#ifdef MQTTVERSION_5
-	if(vacuum_loop != NULL)
-		g_main_loop_unref(vacuum_loop);
-	if(vacuum_context != NULL)
-		g_main_context_unref(vacuum_context);
-#endif
-	janus_transport_session_destroy(mqtt_session);
-	janus_mqtt_client_destroy_context(&ctx);
-	g_free((char *)url);
-	g_free((char *)client_id);
-	janus_config_destroy(config);
-
-	return -1;
 }
 
 void janus_mqtt_destroy(void) {
 	JANUS_LOG(LOG_INFO, "Disconnecting MQTT client...\n");
 
 	janus_transport_session_destroy(mqtt_session);
+
+	/* Stop the batch thread, and publish what's still pending */
+	if(batch_thread != NULL) {
+		if(g_main_loop_is_running(batch_loop)) {
+			g_main_loop_quit(batch_loop);
+			g_main_context_wakeup(batch_context);
+		}
+		g_thread_join(batch_thread);
+		batch_thread = NULL;
+	}
+	guint i = 0;
+	if(pool_ != NULL) {
+		for(i=0; i<pool_size; i++)
+			janus_mqtt_batch_flush(pool_[i]);
+		/* Disconnect the other clients of the pool first, and the main one last */
+		for(i=1; i<pool_size; i++)
+			janus_mqtt_client_disconnect(pool_[i]);
+		g_free(pool_);
+		pool_ = NULL;
+	}
 	janus_mqtt_client_disconnect(context_);
 
 #ifdef MQTTVERSION_5
@@ -851,14 +1001,28 @@ gboolean janus_mqtt_is_admin_api_enabled(void) {
 int janus_mqtt_send_message(janus_transport_session *transport, void *request_id, gboolean admin, json_t *message) {
 	if(message == NULL || transport == NULL) return -1;
 
-	/* Not really needed as we always only have a single context, but that's fine */
+	/* This is always the main client, we may pick another one from the pool below */
 	janus_mqtt_context *ctx = (janus_mqtt_context *)transport->transport_p;
 	if(ctx == NULL) {
 		json_decref(message);
 		return -1;
 	}
+	if(!admin && pool_ != NULL && pool_size > 1) {
+		/* Messages related to the same session always go through the same client, to keep them in order */
+		guint64 session_id = json_integer_value(json_object_get(message, "session_id"));
+		ctx = pool_[session_id % pool_size];
+	}
+	if(!admin && ctx->publish.batch_size > 1) {
+		if(!janus_mqtt_has_transaction_state(ctx, message)) {
+			/* Queue the message, it will be published with others */
+			janus_mqtt_batch_add(ctx, message);
+			return 0;
+		}
+		/* This message needs its own properties: publish what's pending first, so that it doesn't overtake it */
+		janus_mqtt_batch_flush(ctx);
+	}
 
-	char *payload = json_dumps(message, json_format);
+	char *payload = janus_json_dumps(message, json_format);
 	if(payload == NULL) {
 		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
 		return -1;
@@ -1069,12 +1233,12 @@ void janus_mqtt_client_connected(void *context, char *cause) {
 
 	/* Subscribe to one (janus or admin) topic at the time */
 	if(janus_mqtt_api_enabled_) {
-		JANUS_LOG(LOG_INFO, "Subscribing to MQTT topic %s\n", ctx->subscribe.topic);
+		JANUS_LOG(LOG_INFO, "Subscribing to MQTT topic %s\n", ctx->subscribe.filter);
 		int rc = janus_mqtt_client_subscribe(context, FALSE);
 		if(rc != MQTTASYNC_SUCCESS) {
-			JANUS_LOG(LOG_ERR, "Can't subscribe to MQTT topic: %s, return code: %d\n", ctx->subscribe.topic, rc);
+			JANUS_LOG(LOG_ERR, "Can't subscribe to MQTT topic: %s, return code: %d\n", ctx->subscribe.filter, rc);
 		}
-	} else if(janus_mqtt_admin_api_enabled_) {
+	} else if(janus_mqtt_admin_api_enabled_ && ctx->index == 0) {
 		JANUS_LOG(LOG_INFO, "Subscribing to MQTT admin topic %s\n", ctx->admin.subscribe.topic);
 		int rc = janus_mqtt_client_subscribe(context, TRUE);
 		if(rc != MQTTASYNC_SUCCESS) {
@@ -1407,7 +1571,7 @@ int janus_mqtt_client_subscribe(janus_mqtt_context *ctx, gboolean admin) {
 		options.onSuccess = janus_mqtt_client_subscribe_success;
 		options.onFailure = janus_mqtt_client_subscribe_failure;
 #endif
-		return MQTTAsync_subscribe(ctx->client, ctx->subscribe.topic, ctx->subscribe.qos, &options);
+		return MQTTAsync_subscribe(ctx->client, ctx->subscribe.filter, ctx->subscribe.qos, &options);
 	}
 }
 
@@ -1423,10 +1587,11 @@ void janus_mqtt_client_subscribe_success5(void *context, MQTTAsync_successData5
 
 void janus_mqtt_client_subscribe_success_impl(void *context) {
 	janus_mqtt_context *ctx = (janus_mqtt_context *)context;
-	JANUS_LOG(LOG_INFO, "MQTT client has been successfully subscribed to MQTT topic: %s\n", ctx->subscribe.topic);
+	JANUS_LOG(LOG_INFO, "MQTT client has been successfully subscribed to MQTT topic: %s\n", ctx->subscribe.filter);
 
-	/* Subscribe to admin topic if we haven't done it yet */
-	if(janus_mqtt_admin_api_enabled_ && (!janus_mqtt_api_enabled_ || strcasecmp(ctx->subscribe.topic, ctx->admin.subscribe.topic))) {
+	/* Subscribe to admin topic if we haven't done it yet (only the main client does) */
+	if(janus_mqtt_admin_api_enabled_ && ctx->index == 0 &&
+			(!janus_mqtt_api_enabled_ || strcasecmp(ctx->subscribe.topic, ctx->admin.subscribe.topic))) {
 		int rc = janus_mqtt_client_subscribe(context, TRUE);
 		if(rc != MQTTASYNC_SUCCESS) {
 			JANUS_LOG(LOG_ERR, "Can't subscribe to MQTT topic: %s, return code: %d\n", ctx->subscribe.topic, rc);
@@ -1448,7 +1613,7 @@ void janus_mqtt_client_subscribe_failure5(void *context, MQTTAsync_failureData5
 
 void janus_mqtt_client_subscribe_failure_impl(void *context, int rc) {
 	janus_mqtt_context *ctx = (janus_mqtt_context *)context;
-	JANUS_LOG(LOG_ERR, "MQTT client has failed subscribing to MQTT topic: %s, return code: %d. Reconnecting...\n", ctx->subscribe.topic, rc);
+	JANUS_LOG(LOG_ERR, "MQTT client has failed subscribing to MQTT topic: %s, return code: %d. Reconnecting...\n", ctx->subscribe.filter, rc);
 
 	/* Reconnect */
 	{
@@ -1673,9 +1838,27 @@ void janus_mqtt_client_publish_status_failure_impl(int rc) {
 
 void janus_mqtt_client_destroy_context(janus_mqtt_context **ptr) {
 	janus_mqtt_context *ctx = (janus_mqtt_context *)*ptr;
+	if(ctx && ctx->index > 0) {
+		/* Client of the pool: the configuration belongs to the main one */
+		if(ctx->client != NULL)
+			MQTTAsync_destroy(&ctx->client);
+		janus_mutex_destroy(&ctx->disconnect.mutex);
+		janus_condition_destroy(&ctx->disconnect.cond);
+		if(ctx->batch.messages != NULL)
+			json_decref(ctx->batch.messages);
+		janus_mutex_destroy(&ctx->batch.mutex);
+		g_free(ctx);
+		*ptr = NULL;
+		return;
+	}
 	if(ctx) {
-		MQTTAsync_destroy(&ctx->client);
+		if(ctx->client != NULL)
+			MQTTAsync_destroy(&ctx->client);
+		if(ctx->batch.messages != NULL)
+			json_decref(ctx->batch.messages);
+		janus_mutex_destroy(&ctx->batch.mutex);
 		g_free(ctx->subscribe.topic);
+		g_free(ctx->subscribe.filter);
 		g_free(ctx->publish.topic);
 		g_free(ctx->connect.username);
 		g_free(ctx->connect.password);
@@ -1746,3 +1929,93 @@ void janus_mqtt_transaction_state_free(gpointer state_ptr) {
 	g_free(state);
 }
 #endif
+
+/* Check if a message is a response that needs the MQTT 5 properties of the request */
+static gboolean janus_mqtt_has_transaction_state(janus_mqtt_context *ctx, json_t *message) {
+#ifdef MQTTVERSION_5
+	if(ctx->connect.mqtt_version != MQTTVERSION_5)
+		return FALSE;
+	const char *transaction = json_string_value(json_object_get(message, "transaction"));
+	if(transaction == NULL)
+		return FALSE;
+	g_rw_lock_reader_lock(&janus_mqtt_transaction_states_lock);
+	gboolean found = (g_hash_table_lookup(janus_mqtt_transaction_states, transaction) != NULL);
+	g_rw_lock_reader_unlock(&janus_mqtt_transaction_states_lock);
+	return found;
+#else
+	return FALSE;
+#endif
+}
+
+/* Publish all the messages pending for a client as a single JSON array: must be called with the batch mutex locked */
+static void janus_mqtt_batch_flush_locked(janus_mqtt_context *ctx) {
+	json_t *messages = ctx->batch.messages;
+	ctx->batch.messages = NULL;
+	if(messages == NULL)
+		return;
+	char *payload = janus_json_dumps(messages, json_format);
+	size_t count = json_array_size(messages);
+	json_decref(messages);
+	if(payload == NULL) {
+		JANUS_LOG(LOG_ERR, "Failed to stringify batch of %zu messages...\n", count);
+		return;
+	}
+	JANUS_LOG(LOG_HUGE, "Sending batch of %zu Janus API messages via MQTT: %s\n", count, payload);
+	int rc;
+#ifdef MQTTVERSION_5
+	if(ctx->connect.mqtt_version == MQTTVERSION_5) {
+		MQTTProperties properties = MQTTProperties_initializer;
+		rc = janus_mqtt_client_publish_message5(ctx, payload, FALSE, &properties, NULL);
+		MQTTProperties_free(&properties);
+	} else {
+		rc = janus_mqtt_client_publish_message(ctx, payload, FALSE);
+	}
+#else
+	rc = janus_mqtt_client_publish_message(ctx, payload, FALSE);
+#endif
+	if(rc != MQTTASYNC_SUCCESS) {
+		JANUS_LOG(LOG_ERR, "Can't publish batch to MQTT topic: %s, return code: %d\n", ctx->publish.topic, rc);
+	}
+	free(payload);
+}
+
+static void janus_mqtt_batch_flush(janus_mqtt_context *ctx) {
+	if(ctx == NULL)
+		return;
+	janus_mutex_lock(&ctx->batch.mutex);
+	janus_mqtt_batch_flush_locked(ctx);
+	janus_mutex_unlock(&ctx->batch.mutex);
+}
+
+static void janus_mqtt_batch_add(janus_mqtt_context *ctx, json_t *message) {
+	janus_mutex_lock(&ctx->batch.mutex);
+	if(ctx->batch.messages == NULL)
+		ctx->batch.messages = json_array();
+	json_array_append_new(ctx->batch.messages, message);
+	if(json_array_size(ctx->batch.messages) >= (size_t)ctx->publish.batch_size)
+		janus_mqtt_batch_flush_locked(ctx);
+	janus_mutex_unlock(&ctx->batch.mutex);
+}
+
+static gpointer janus_mqtt_batch_thread(gpointer context) {
+	janus_mqtt_context *ctx = (janus_mqtt_context*)context;
+
+	GSource *timeout_source;
+	timeout_source = g_timeout_source_new(ctx->publish.batch_time);
+	g_source_set_callback(timeout_source, janus_mqtt_batch_timeout, context, NULL);
+	g_source_attach(timeout_source, batch_context);
+	g_source_unref(timeout_source);
+
+	JANUS_LOG(LOG_VERB, "Starting MQTT transport batch thread\n");
+	g_main_loop_run(batch_loop);
+	JANUS_LOG(LOG_VERB, "MQTT transport batch thread finished\n");
+	return NULL;
+}
+
+static gboolean janus_mqtt_batch_timeout(gpointer context) {
+	/* Publish whatever is pending on all the clients */
+	guint i = 0;
+	for(i=0; i<pool_size; i++)
+		janus_mqtt_batch_flush(pool_[i]);
+	return G_SOURCE_CONTINUE;
+}
@@ -9,6 +9,10 @@
  * in this plugin: specifically, you'll only be able to use the \c NN_PAIR
  * transport mechanism. Future versions may implement more, but for the
  * time being these should be enough to cover most development requirements.
+ * Since \c NN_PAIR only allows for a single peer, more than one address
+ * can be provided for each API: each resulting socket is served by a
+ * thread of its own, and messages are exchanged using Nanomsg's own
+ * (\c NN_MSG) buffers, so that the library doesn't need to copy them.
  *
  * \ingroup transports
  * \ref transports
@@ -98,6 +102,8 @@ static gboolean notify_events = TRUE;
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
 
 #define BUFFER_SIZE		8192
+/* Maximum number of sockets we'll create for each API */
+#define JANUS_NANOMSG_MAX_SOCKETS	16
 
 /* Parameter validation (for tweaking and queries via Admin API) */
 static struct janus_json_parameter request_parameters[] = {
@@ -114,23 +120,25 @@ static struct janus_json_parameter configure_parameters[] = {
 #define JANUS_NANOMSG_ERROR_UNKNOWN_ERROR		499
 
 
-/* Nanomsg server thread */
-static GThread *nanomsg_thread = NULL;
-void *janus_nanomsg_thread(void *data);
-
-/* Nanomsg servers */
-static int nfd = -1, nfd_addr = -1, admin_nfd = -1, admin_nfd_addr = -1;
-/* Pipeline to notify about the need for outgoing data */
-static int write_nfd[2];
-
-/* Nanomsg client session */
+/* Nanomsg client session: we handle a single client per socket, since we use NN_PAIR */
 typedef struct janus_nanomsg_client {
 	gboolean admin;					/* Whether this client is for the Admin or Janus API */
-	GAsyncQueue *messages;			/* Queue of outgoing messages to push */
+	guint index;					/* Index of this socket, to tell them apart */
+	int fd, fd_addr;				/* Nanomsg socket, and endpoint it's bound/connected to */
+	int write_nfd[2];				/* Pipeline to notify about the need for outgoing data */
+	volatile gint notified;			/* Whether the thread has already been notified about outgoing data */
+	GAsyncQueue *messages;			/* Queue of outgoing messages (NN_MSG buffers) to push */
+	void *pending;					/* Message we couldn't send yet, if any */
 	janus_transport_session *ts;	/* Janus core-transport session */
+	GThread *thread;				/* Thread serving this socket */
 } janus_nanomsg_client;
-/* We only handle a single client per API, since we use NN_PAIR and we bind locally */
-static janus_nanomsg_client client, admin_client;
+static GPtrArray *clients = NULL;
+static gboolean janus_api_enabled = FALSE, admin_api_enabled = FALSE;
+static janus_nanomsg_client *janus_nanomsg_client_create(gboolean admin, guint index, const char *address, const char *mode);
+static void janus_nanomsg_client_free(janus_nanomsg_client *nc);
+
+/* Nanomsg server threads, one per socket */
+void *janus_nanomsg_thread(void *data);
 
 
 /* Transport implementation */
@@ -190,17 +198,7 @@ int janus_nanomsg_init(janus_transport_callbacks *callback, const char *config_p
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_NANOMSG_NAME);
 		}
 
-		/* First of all, initialize the pipeline for writeable notifications */
-		write_nfd[0] = nn_socket(AF_SP, NN_PULL);
-		write_nfd[1] = nn_socket(AF_SP, NN_PUSH);
-		if(nn_bind(write_nfd[0], "inproc://janus") < 0) {
-			JANUS_LOG(LOG_WARN, "Error configuring internal Nanomsg pipeline... %d (%s)\n", errno, nn_strerror(errno));
-			return -1;	/* No point in keeping the plugin loaded */
-		}
-		if(nn_connect(write_nfd[1], "inproc://janus") < 0) {
-			JANUS_LOG(LOG_WARN, "Error configuring internal Nanomsg pipeline...%d (%s)\n", errno, nn_strerror(errno));
-			return -1;	/* No point in keeping the plugin loaded */
-		}
+		clients = g_ptr_array_new();
 
 		/* Setup the Janus API Nanomsg server(s) */
 		item = janus_config_get(config, config_general, janus_config_type_item, "enabled");
@@ -213,34 +211,24 @@ int janus_nanomsg_init(janus_transport_callbacks *callback, const char *config_p
 			const char *mode = item && item->value ? item->value : NULL;
 			if(mode == NULL)
 				mode = "bind";
-			nfd = nn_socket(AF_SP, NN_PAIR);
-			if(nfd < 0) {
-				JANUS_LOG(LOG_ERR, "Error creating Janus API Nanomsg socket: %d (%s)\n", errno, nn_strerror(errno));
+			/* We may have been provided with a comma separated list of addresses */
+			if(address == NULL) {
+				JANUS_LOG(LOG_ERR, "Missing address for the Janus API Nanomsg socket\n");
 			} else {
-				if(!strcasecmp(mode, "bind")) {
-					/* Bind to this address */
-					nfd_addr = nn_bind(nfd, address);
-					if(nfd_addr < 0) {
-						JANUS_LOG(LOG_ERR, "Error binding Janus API Nanomsg socket to address '%s': %d (%s)\n",
-							address, errno, nn_strerror(errno));
-						nn_close(nfd);
-						nfd = -1;
-					}
-				} else if(!strcasecmp(mode, "connect")) {
-					/* Connect to this address */
-					nfd_addr = nn_connect(nfd, address);
-					if(nfd_addr < 0) {
-						JANUS_LOG(LOG_ERR, "Error connecting Janus API Nanomsg socket to address '%s': %d (%s)\n",
-							address, errno, nn_strerror(errno));
-						nn_close(nfd);
-						nfd = -1;
-					}
-				} else {
-					/* Unsupported mode */
-					JANUS_LOG(LOG_ERR, "Unsupported mode '%s'\n", mode);
-					nn_close(nfd);
-					nfd = -1;
+				char **list = g_strsplit(address, ",", -1);
+				guint i = 0, count = 0;
+				for(i=0; list[i] != NULL && count < JANUS_NANOMSG_MAX_SOCKETS; i++) {
+					char *addr = g_strstrip(list[i]);
+					if(strlen(addr) == 0)
+						continue;
+					janus_nanomsg_client *nc = janus_nanomsg_client_create(FALSE, count, addr, mode);
+					if(nc == NULL)
+						continue;
+					g_ptr_array_add(clients, nc);
+					janus_api_enabled = TRUE;
+					count++;
 				}
+				g_strfreev(list);
 			}
 		}
 		/* Do the same for the Admin API, if enabled */
@@ -254,87 +242,69 @@ int janus_nanomsg_init(janus_transport_callbacks *callback, const char *config_p
 			const char *mode = item && item->value ? item->value : NULL;
 			if(mode == NULL)
 				mode = "bind";
-			admin_nfd = nn_socket(AF_SP, NN_PAIR);
-			if(admin_nfd < 0) {
-				JANUS_LOG(LOG_ERR, "Error creating Admin API Nanomsg socket: %d (%s)\n", errno, nn_strerror(errno));
+			if(address == NULL) {
+				JANUS_LOG(LOG_ERR, "Missing address for the Admin API Nanomsg socket\n");
 			} else {
-				if(!strcasecmp(mode, "bind")) {
-					/* Bind to this address */
-					admin_nfd_addr = nn_bind(admin_nfd, address);
-					if(admin_nfd_addr < 0) {
-						JANUS_LOG(LOG_ERR, "Error binding Admin API Nanomsg socket to address '%s': %d (%s)\n",
-							address, errno, nn_strerror(errno));
-						nn_close(admin_nfd);
-						admin_nfd = -1;
-					}
-				} else if(!strcasecmp(mode, "connect")) {
-					/* Connect to this address */
-					admin_nfd_addr = nn_connect(admin_nfd, address);
-					if(admin_nfd_addr < 0) {
-						JANUS_LOG(LOG_ERR, "Error connecting Admin API Nanomsg socket to address '%s': %d (%s)\n",
-							address, errno, nn_strerror(errno));
-						nn_close(admin_nfd);
-						admin_nfd = -1;
-					}
-				} else {
-					/* Unsupported mode */
-					JANUS_LOG(LOG_ERR, "Unsupported mode '%s'\n", mode);
-					nn_close(admin_nfd);
-					admin_nfd = -1;
+				char **list = g_strsplit(address, ",", -1);
+				guint i = 0, count = 0;
+				for(i=0; list[i] != NULL && count < JANUS_NANOMSG_MAX_SOCKETS; i++) {
+					char *addr = g_strstrip(list[i]);
+					if(strlen(addr) == 0)
+						continue;
+					janus_nanomsg_client *nc = janus_nanomsg_client_create(TRUE, count, addr, mode);
+					if(nc == NULL)
+						continue;
+					g_ptr_array_add(clients, nc);
+					admin_api_enabled = TRUE;
+					count++;
 				}
+				g_strfreev(list);
 			}
 		}
 	}
 	janus_config_destroy(config);
 	config = NULL;
-	if(nfd < 0 && admin_nfd < 0) {
+	if(!janus_api_enabled && !admin_api_enabled) {
 		JANUS_LOG(LOG_WARN, "No Nanomsg server started, giving up...\n");
+		if(clients != NULL)
+			g_ptr_array_free(clients, TRUE);
+		clients = NULL;
 		return -1;	/* No point in keeping the plugin loaded */
 	}
 
-	/* Create the clients */
-	memset(&client, 0, sizeof(janus_nanomsg_client));
-	if(nfd > -1) {
-		client.admin = FALSE;
-		client.messages = g_async_queue_new();
-		/* Create a transport instance as well */
-		client.ts = janus_transport_session_create(&client, NULL);
-		/* Notify handlers about this new transport */
-		if(notify_events && gateway->events_is_enabled()) {
-			json_t *info = json_object();
-			json_object_set_new(info, "event", json_string("created"));
-			json_object_set_new(info, "admin_api", json_false());
-			json_object_set_new(info, "socket", json_integer(nfd));
-			gateway->notify_event(&janus_nanomsg_transport, client.ts, info);
-		}
-	}
-	memset(&admin_client, 0, sizeof(janus_nanomsg_client));
-	if(admin_nfd > -1) {
-		admin_client.admin = TRUE;
-		admin_client.messages = g_async_queue_new();
-		/* Create a transport instance as well */
-		admin_client.ts = janus_transport_session_create(&admin_client, NULL);
-		/* Notify handlers about this new transport */
-		if(notify_events && gateway->events_is_enabled()) {
-			json_t *info = json_object();
-			json_object_set_new(info, "event", json_string("created"));
-			json_object_set_new(info, "admin_api", json_true());
-			json_object_set_new(info, "socket", json_integer(admin_nfd));
-			gateway->notify_event(&janus_nanomsg_transport, admin_client.ts, info);
+	/* Start the Nanomsg service threads */
+	guint i = 0;
+	for(i=0; i<clients->len; i++) {
+		janus_nanomsg_client *nc = g_ptr_array_index(clients, i);
+		GError *error = NULL;
+		char tname[16];
+		g_snprintf(tname, sizeof(tname), "nanomsg %s%u", nc->admin ? "a" : "", nc->index);
+		nc->thread = g_thread_try_new(tname, &janus_nanomsg_thread, nc, &error);
+		if(error != NULL) {
+			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Nanomsg thread...\n",
+				error->code, error->message ? error->message : "??");
+			g_error_free(error);
+			nc->thread = NULL;
+			/* Stop the threads we started so far, and get rid of everything */
+			g_atomic_int_set(&stopping, 1);
+			guint j = 0;
+			for(j=0; j<clients->len; j++) {
+				janus_nanomsg_client *c = g_ptr_array_index(clients, j);
+				if(c->thread != NULL) {
+					(void)nn_send(c->write_nfd[1], "x", 1, 0);
+					g_thread_join(c->thread);
+				}
+				janus_nanomsg_client_free(c);
+			}
+			g_ptr_array_free(clients, TRUE);
+			clients = NULL;
+			janus_api_enabled = FALSE;
+			admin_api_enabled = FALSE;
+			g_atomic_int_set(&stopping, 0);
+			return -1;
 		}
 	}
 
-	/* Start the Nanomsg service thread */
-	GError *error = NULL;
-	nanomsg_thread = g_thread_try_new("nanomsg thread", &janus_nanomsg_thread, NULL, &error);
-	if(error != NULL) {
-		g_atomic_int_set(&initialized, 0);
-		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the Nanomsg thread...\n",
-			error->code, error->message ? error->message : "??");
-		g_error_free(error);
-		return -1;
-	}
-
 	/* Done */
 	g_atomic_int_set(&initialized, 1);
 	JANUS_LOG(LOG_INFO, "%s initialized!\n", JANUS_NANOMSG_NAME);
@@ -346,13 +316,25 @@ void janus_nanomsg_destroy(void) {
 		return;
 	g_atomic_int_set(&stopping, 1);
 
-	/* Stop the service thread */
-	(void)nn_send(write_nfd[1], "x", 1, 0);
-
-	if(nanomsg_thread != NULL) {
-		g_thread_join(nanomsg_thread);
-		nanomsg_thread = NULL;
+	/* Stop the service threads */
+	guint i = 0;
+	for(i=0; clients != NULL && i<clients->len; i++) {
+		janus_nanomsg_client *nc = g_ptr_array_index(clients, i);
+		(void)nn_send(nc->write_nfd[1], "x", 1, 0);
+	}
+	for(i=0; clients != NULL && i<clients->len; i++) {
+		janus_nanomsg_client *nc = g_ptr_array_index(clients, i);
+		if(nc->thread != NULL) {
+			g_thread_join(nc->thread);
+			nc->thread = NULL;
+		}
+		janus_nanomsg_client_free(nc);
 	}
+	if(clients != NULL)
+		g_ptr_array_free(clients, TRUE);
+	clients = NULL;
+	janus_api_enabled = FALSE;
+	admin_api_enabled = FALSE;
 
 	g_atomic_int_set(&initialized, 0);
 	g_atomic_int_set(&stopping, 0);
@@ -389,27 +371,45 @@ const char *janus_nanomsg_get_package(void) {
 }
 
 gboolean janus_nanomsg_is_janus_api_enabled(void) {
-	return nfd > -1;
+	return janus_api_enabled;
 }
 
 gboolean janus_nanomsg_is_admin_api_enabled(void) {
-	return admin_nfd > -1;
+	return admin_api_enabled;
 }
 
 int janus_nanomsg_send_message(janus_transport_session *transport, void *request_id, gboolean admin, json_t *message) {
 	if(message == NULL)
 		return -1;
+	janus_nanomsg_client *nc = transport ? (janus_nanomsg_client *)transport->transport_p : NULL;
+	if(nc == NULL) {
+		json_decref(message);
+		return -1;
+	}
 	/* Convert to string */
-	char *payload = json_dumps(message, json_format);
+	char *payload = janus_json_dumps(message, json_format);
 	json_decref(message);
 	if(payload == NULL) {
 		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
 		return -1;
 	}
+	/* Move the string to a Nanomsg buffer here, rather than having the
+	 * library copy it when sending: the socket thread just hands it over */
+	size_t len = strlen(payload);
+	void *msg = nn_allocmsg(len, 0);
+	if(msg == NULL) {
+		JANUS_LOG(LOG_ERR, "Failed to allocate Nanomsg message: %d (%s)\n", errno, nn_strerror(errno));
+		free(payload);
+		return -1;
+	}
+	memcpy(msg, payload, len);
+	free(payload);
 	/* Enqueue the packet and have poll tell us when it's time to send it */
-	g_async_queue_push(admin ? admin_client.messages : client.messages, payload);
-	/* Notify the thread there's data to send */
-	(void)nn_send(write_nfd[1], "x", 1, 0);
+	g_async_queue_push(nc->messages, msg);
+	/* Notify the thread there's data to send, unless we did already and
+	 * it didn't wake up yet: it will send everything it finds in one go */
+	if(g_atomic_int_compare_and_exchange(&nc->notified, 0, 1))
+		(void)nn_send(nc->write_nfd[1], "x", 1, 0);
 	return 0;
 }
 
@@ -504,39 +504,116 @@ plugin_response:
 }
 
 
+
+
+/* Sockets management */
+static janus_nanomsg_client *janus_nanomsg_client_create(gboolean admin, guint index, const char *address, const char *mode) {
+	const char *api = admin ? "Admin" : "Janus";
+	int fd = nn_socket(AF_SP, NN_PAIR);
+	if(fd < 0) {
+		JANUS_LOG(LOG_ERR, "Error creating %s API Nanomsg socket: %d (%s)\n", api, errno, nn_strerror(errno));
+		return NULL;
+	}
+	int fd_addr = -1;
+	if(!strcasecmp(mode, "bind")) {
+		/* Bind to this address */
+		fd_addr = nn_bind(fd, address);
+		if(fd_addr < 0) {
+			JANUS_LOG(LOG_ERR, "Error binding %s API Nanomsg socket to address '%s': %d (%s)\n",
+				api, address, errno, nn_strerror(errno));
+			nn_close(fd);
+			return NULL;
+		}
+	} else if(!strcasecmp(mode, "connect")) {
+		/* Connect to this address */
+		fd_addr = nn_connect(fd, address);
+		if(fd_addr < 0) {
+			JANUS_LOG(LOG_ERR, "Error connecting %s API Nanomsg socket to address '%s': %d (%s)\n",
+				api, address, errno, nn_strerror(errno));
+			nn_close(fd);
+			return NULL;
+		}
+	} else {
+		/* Unsupported mode */
+		JANUS_LOG(LOG_ERR, "Unsupported mode '%s'\n", mode);
+		nn_close(fd);
+		return NULL;
+	}
+	janus_nanomsg_client *nc = g_malloc0(sizeof(janus_nanomsg_client));
+	nc->admin = admin;
+	nc->index = index;
+	nc->fd = fd;
+	nc->fd_addr = fd_addr;
+	/* Each socket has its own pipeline for writeable notifications */
+	char inproc[64];
+	g_snprintf(inproc, sizeof(inproc), "inproc://janus-%s-%u", admin ? "admin" : "janus", index);
+	nc->write_nfd[0] = nn_socket(AF_SP, NN_PULL);
+	nc->write_nfd[1] = nn_socket(AF_SP, NN_PUSH);
+	if(nn_bind(nc->write_nfd[0], inproc) < 0 || nn_connect(nc->write_nfd[1], inproc) < 0) {
+		JANUS_LOG(LOG_WARN, "Error configuring internal Nanomsg pipeline... %d (%s)\n", errno, nn_strerror(errno));
+		nn_close(nc->write_nfd[0]);
+		nn_close(nc->write_nfd[1]);
+		nn_shutdown(fd, fd_addr);
+		nn_close(fd);
+		g_free(nc);
+		return NULL;
+	}
+	nc->messages = g_async_queue_new();
+	/* Create a transport instance as well */
+	nc->ts = janus_transport_session_create(nc, NULL);
+	JANUS_LOG(LOG_INFO, "%s API Nanomsg socket #%u ready (%s %s)\n", api, index, mode, address);
+	/* Notify handlers about this new transport */
+	if(notify_events && gateway->events_is_enabled()) {
+		json_t *info = json_object();
+		json_object_set_new(info, "event", json_string("created"));
+		json_object_set_new(info, "admin_api", admin ? json_true() : json_false());
+		json_object_set_new(info, "socket", json_integer(fd));
+		json_object_set_new(info, "address", json_string(address));
+		gateway->notify_event(&janus_nanomsg_transport, nc->ts, info);
+	}
+	return nc;
+}
+
+static void janus_nanomsg_client_free(janus_nanomsg_client *nc) {
+	if(nc == NULL)
+		return;
+	/* Get rid of the messages we never sent */
+	if(nc->pending != NULL)
+		nn_freemsg(nc->pending);
+	nc->pending = NULL;
+	void *msg = NULL;
+	while((msg = g_async_queue_try_pop(nc->messages)) != NULL)
+		nn_freemsg(msg);
+	g_async_queue_unref(nc->messages);
+	nn_close(nc->write_nfd[0]);
+	nn_close(nc->write_nfd[1]);
+	nn_shutdown(nc->fd, nc->fd_addr);
+	nn_close(nc->fd);
+	janus_transport_session_destroy(nc->ts);
+	nc->ts = NULL;
+	g_free(nc);
+}
+
+
 /* Thread */
 void *janus_nanomsg_thread(void *data) {
-	JANUS_LOG(LOG_INFO, "Nanomsg thread started\n");
+	janus_nanomsg_client *nc = (janus_nanomsg_client *)data;
+	const char *api = nc->admin ? "Admin" : "Janus";
+	JANUS_LOG(LOG_INFO, "Nanomsg thread started (%s API, socket #%u)\n", api, nc->index);
 
-	int fds = 0;
-	struct nn_pollfd poll_nfds[3];	/* FIXME Should we allow for more clients? */
+	struct nn_pollfd poll_nfds[2];
 	char buffer[BUFFER_SIZE];
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		/* Prepare poll list of file descriptors */
-		fds = 0;
-		/* Writeable monitor */
-		poll_nfds[fds].fd = write_nfd[0];
-		poll_nfds[fds].events = NN_POLLIN;
-		fds++;
-		if(nfd > -1) {
-			/* Janus API */
-			poll_nfds[fds].fd = nfd;
-			poll_nfds[fds].events = NN_POLLIN;
-			if(client.messages != NULL && g_async_queue_length(client.messages) > 0)
-				poll_nfds[fds].events |= NN_POLLOUT;
-			fds++;
-		}
-		if(admin_nfd > -1) {
-			/* Admin API */
-			poll_nfds[fds].fd = admin_nfd;
-			poll_nfds[fds].events = NN_POLLIN;
-			if(admin_client.messages != NULL && g_async_queue_length(admin_client.messages) > 0)
-				poll_nfds[fds].events |= NN_POLLOUT;
-			fds++;
-		}
+		/* Prepare poll list of file descriptors: writeable monitor and socket */
+		poll_nfds[0].fd = nc->write_nfd[0];
+		poll_nfds[0].events = NN_POLLIN;
+		poll_nfds[1].fd = nc->fd;
+		poll_nfds[1].events = NN_POLLIN;
+		if(nc->pending != NULL || g_async_queue_length(nc->messages) > 0)
+			poll_nfds[1].events |= NN_POLLOUT;
 		/* Start polling */
-		int res = nn_poll(poll_nfds, fds, -1);
+		int res = nn_poll(poll_nfds, 2, -1);
 		if(res == 0)
 			continue;
 		if(res < 0) {
@@ -547,68 +624,56 @@ void *janus_nanomsg_thread(void *data) {
 			JANUS_LOG(LOG_ERR, "poll() failed: %d (%s)\n", errno, nn_strerror(errno));
 			break;
 		}
-		int i = 0;
-		for(i=0; i<fds; i++) {
-			/* FIXME Is there a Nanomsg equivalent of POLLERR? */
-			if(poll_nfds[i].revents & NN_POLLOUT) {
-				/* Find the client from its file descriptor */
-				if(poll_nfds[i].fd == nfd || poll_nfds[i].fd == admin_nfd) {
-					char *payload = NULL;
-					while((payload = g_async_queue_try_pop(poll_nfds[i].fd == nfd ? client.messages : admin_client.messages)) != NULL) {
-						int res = nn_send(poll_nfds[i].fd, payload, strlen(payload), 0);
-						/* FIXME Should we check if sent everything? */
-						JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, strlen(payload), poll_nfds[i].fd);
-						free(payload);
+		if(poll_nfds[0].revents & NN_POLLIN) {
+			/* Read and ignore: we use this to unlock the poll if there's data to write */
+			(void)nn_recv(nc->write_nfd[0], buffer, BUFFER_SIZE, NN_DONTWAIT);
+			g_atomic_int_set(&nc->notified, 0);
+		}
+		/* FIXME Is there a Nanomsg equivalent of POLLERR? */
+		if(poll_nfds[1].revents & NN_POLLOUT) {
+			/* Send everything that's queued: ownership of the buffers goes to Nanomsg */
+			void *msg = nc->pending ? nc->pending : g_async_queue_try_pop(nc->messages);
+			nc->pending = NULL;
+			int sent = 0;
+			while(msg != NULL) {
+				int res = nn_send(nc->fd, &msg, NN_MSG, NN_DONTWAIT);
+				if(res < 0) {
+					if(errno == EAGAIN) {
+						/* Try again when the socket is writeable again */
+						nc->pending = msg;
+						break;
 					}
+					JANUS_LOG(LOG_WARN, "Error sending %s API message... %d (%s)\n", api, errno, nn_strerror(errno));
+					nn_freemsg(msg);
+				} else {
+					sent++;
+					JANUS_LOG(LOG_HUGE, "Written %d bytes on %d\n", res, nc->fd);
 				}
+				msg = g_async_queue_try_pop(nc->messages);
 			}
-			if(poll_nfds[i].revents & NN_POLLIN) {
-				if(poll_nfds[i].fd == write_nfd[0]) {
-					/* Read and ignore: we use this to unlock the poll if there's data to write */
-					(void)nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, 0);
-				} else if(poll_nfds[i].fd == nfd || poll_nfds[i].fd == admin_nfd) {
-					/* Janus/Admin API: get the message from the client */
-					int res = nn_recv(poll_nfds[i].fd, buffer, BUFFER_SIZE, 0);
-					if(res < 0) {
-						JANUS_LOG(LOG_WARN, "Error receiving %s API message... %d (%s)\n",
-							poll_nfds[i].fd == nfd ? "Janus" : "Admin", errno, nn_strerror(errno));
-						continue;
-					}
-					/* If we got here, there's data to handle */
-					buffer[res] = '\0';
-					JANUS_LOG(LOG_VERB, "Got %s API message (%d bytes)\n",
-						poll_nfds[i].fd == nfd ? "Janus" : "Admin", res);
-					JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-					/* Parse the JSON payload */
-					json_error_t error;
-					json_t *root = json_loads(buffer, 0, &error);
-					/* Notify the core, passing both the object and, since it may be needed, the error */
-					gateway->incoming_request(&janus_nanomsg_transport,
-						poll_nfds[i].fd == nfd ? client.ts : admin_client.ts,
-						NULL,
-						poll_nfds[i].fd == nfd ? FALSE : TRUE,
-						root, &error);
-				}
+			JANUS_LOG(LOG_HUGE, "Sent %d %s API messages on socket #%u\n", sent, api, nc->index);
+		}
+		if(poll_nfds[1].revents & NN_POLLIN) {
+			/* Janus/Admin API: get the message from the client, in a buffer Nanomsg allocated for us */
+			void *msg = NULL;
+			int res = nn_recv(nc->fd, &msg, NN_MSG, 0);
+			if(res < 0) {
+				JANUS_LOG(LOG_WARN, "Error receiving %s API message... %d (%s)\n", api, errno, nn_strerror(errno));
+				continue;
 			}
+			/* If we got here, there's data to handle */
+			JANUS_LOG(LOG_VERB, "Got %s API message (%d bytes)\n", api, res);
+			JANUS_LOG(LOG_HUGE, "%.*s\n", res, (char *)msg);
+			/* Parse the JSON payload */
+			json_error_t error;
+			json_t *root = json_loadb(msg, res, 0, &error);
+			nn_freemsg(msg);
+			/* Notify the core, passing both the object and, since it may be needed, the error */
+			gateway->incoming_request(&janus_nanomsg_transport, nc->ts, NULL, nc->admin, root, &error);
 		}
 	}
 
-	nn_close(write_nfd[0]);
-	nn_close(write_nfd[1]);
-	if(nfd > -1) {
-		nn_shutdown(nfd, nfd_addr);
-		nn_close(nfd);
-		janus_transport_session_destroy(client.ts);
-		client.ts = NULL;
-	}
-	if(admin_nfd > -1) {
-		nn_shutdown(admin_nfd, admin_nfd_addr);
-		nn_close(admin_nfd);
-		janus_transport_session_destroy(admin_client.ts);
-		admin_client.ts = NULL;
-	}
-
 	/* Done */
-	JANUS_LOG(LOG_INFO, "Nanomsg thread ended\n");
+	JANUS_LOG(LOG_INFO, "Nanomsg thread ended (%s API, socket #%u)\n", api, nc->index);
 	return NULL;
 }
@@ -32,6 +32,10 @@
 #include <sys/socket.h>
 #include <poll.h>
 #include <sys/un.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 
 #ifdef  HAVE_LIBSYSTEMD
 #include "systemd/sd-daemon.h"
@@ -144,19 +148,30 @@ static gboolean dgram = FALSE, admin_dgram = FALSE;
 #ifdef HAVE_LIBSYSTEMD
 static gboolean sd_socket = FALSE, admin_sd_socket = FALSE;
 #endif /* HAVE_LIBSYSTEMD */
-/* Socket pair to notify about the need for outgoing data */
+/* Socket pair (or eventfd, if epoll is available) to notify about the need for outgoing data */
 static int write_fd[2];
+#ifdef HAVE_EPOLL
+/* epoll instance the thread waits on */
+static int epfd = -1;
+#define JANUS_PFUNIX_EPOLL_EVENTS	64
+#endif
+/* Max number of messages to send to a client with a single syscall */
+#define JANUS_PFUNIX_WRITE_BATCH	32
 
 /* Unix Sockets client session */
 typedef struct janus_pfunix_client {
 	int fd;							/* Client socket (in case SOCK_SEQPACKET is used) */
 	struct sockaddr_un addr;		/* Client address (in case SOCK_DGRAM is used) */
 	gboolean admin;					/* Whether this client is for the Admin or Janus API */
-	GAsyncQueue *messages;			/* Queue of outgoing messages to push */
+	GQueue *messages;				/* Queue of outgoing messages to push (protected by the clients mutex) */
 	gboolean session_timeout;		/* Whether a Janus session timeout occurred in the core */
 	janus_transport_session *ts;	/* Janus core-transport session */
 } janus_pfunix_client;
 static GHashTable *clients = NULL, *clients_by_fd = NULL, *clients_by_path = NULL;
+#ifdef HAVE_EPOLL
+/* Clients that have messages to write: only these are checked when the thread is woken up */
+static GHashTable *writable_clients = NULL;
+#endif
 static janus_mutex clients_mutex = JANUS_MUTEX_INITIALIZER;
 
 static void janus_pfunix_client_free(void *client_ref) {
@@ -164,16 +179,24 @@ static void janus_pfunix_client_free(void *client_ref) {
 		return;
 	JANUS_LOG(LOG_INFO, "Freeing unix sockets client\n");
 	janus_pfunix_client *client = (janus_pfunix_client *) client_ref;
-	if(client->messages != NULL) {
-		char *response = NULL;
-		while((response = g_async_queue_try_pop(client->messages)) != NULL) {
-			g_free(response);
-		}
-		g_async_queue_unref(client->messages);
-	}
+	if(client->messages != NULL)
+		g_queue_free_full(client->messages, free);
 	g_free(client);
 }
 
+/* Helper to wake up the thread */
+static void janus_pfunix_wakeup(void) {
+	int res = 0;
+	do {
+#ifdef HAVE_EPOLL
+		uint64_t value = 1;
+		res = write(write_fd[1], &value, sizeof(value));
+#else
+		res = write(write_fd[1], "x", 1);
+#endif
+	} while(res == -1 && errno == EINTR);
+}
+
 
 /* Helper to create a named Unix Socket out of the path to link to */
 static int janus_pfunix_create_socket(char *pfname, gboolean use_dgram) {
@@ -273,11 +296,27 @@ int janus_pfunix_init(janus_transport_callbacks *callback, const char *config_pa
 			JANUS_LOG(LOG_WARN, "Notification of events to handlers disabled for %s\n", JANUS_PFUNIX_NAME);
 		}
 
-		/* First of all, initialize the socketpair for writeable notifications */
+		/* First of all, initialize the socketpair (or eventfd) for writeable notifications */
+#ifdef HAVE_EPOLL
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		if(epfd < 0) {
+			JANUS_LOG(LOG_FATAL, "Error creating epoll instance: %d, %s\n", errno, g_strerror(errno));
+			return -1;
+		}
+		write_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if(write_fd[0] < 0) {
+			JANUS_LOG(LOG_FATAL, "Error creating eventfd for writeable events: %d, %s\n", errno, g_strerror(errno));
+			close(epfd);
+			epfd = -1;
+			return -1;
+		}
+		write_fd[1] = write_fd[0];
+#else
 		if(socketpair(PF_LOCAL, SOCK_STREAM, 0, write_fd) < 0) {
 			JANUS_LOG(LOG_FATAL, "Error creating socket pair for writeable events: %d, %s\n", errno, g_strerror(errno));
 			return -1;
 		}
+#endif
 
 		/* Setup the Janus API Unix Sockets server(s) */
 		item = janus_config_get(config, config_general, janus_config_type_item, "enabled");
@@ -352,6 +391,9 @@ int janus_pfunix_init(janus_transport_callbacks *callback, const char *config_pa
 	clients = g_hash_table_new(NULL, NULL);
 	clients_by_fd = g_hash_table_new(NULL, NULL);
 	clients_by_path = g_hash_table_new(g_str_hash, g_str_equal);
+#ifdef HAVE_EPOLL
+	writable_clients = g_hash_table_new(NULL, NULL);
+#endif
 
 	/* Start the Unix Sockets service thread */
 	GError *error = NULL;
@@ -376,10 +418,7 @@ void janus_pfunix_destroy(void) {
 	g_atomic_int_set(&stopping, 1);
 
 	/* Stop the service thread */
-	int res = 0;
-	do {
-		res = write(write_fd[1], "x", 1);
-	} while(res == -1 && errno == EINTR);
+	janus_pfunix_wakeup();
 
 	if(pfunix_thread != NULL) {
 		g_thread_join(pfunix_thread);
@@ -435,33 +474,37 @@ int janus_pfunix_send_message(janus_transport_session *transport, void *request_
 		json_decref(message);
 		return -1;
 	}
-	/* Make sure this is related to a still valid Unix Sockets session */
+	/* Convert to string */
 	janus_pfunix_client *client = (janus_pfunix_client *)transport->transport_p;
+	char *payload = janus_json_dumps(message, json_format);
+	json_decref(message);
+	if(payload == NULL) {
+		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+		return -1;
+	}
+	/* Make sure this is related to a still valid Unix Sockets session */
 	janus_mutex_lock(&clients_mutex);
 	if(g_hash_table_lookup(clients, client) == NULL) {
 		janus_mutex_unlock(&clients_mutex);
 		JANUS_LOG(LOG_WARN, "Outgoing message for invalid client %p\n", client);
-		json_decref(message);
-		message = NULL;
-		return -1;
-	}
-	janus_mutex_unlock(&clients_mutex);
-	/* Convert to string */
-	char *payload = json_dumps(message, json_format);
-	json_decref(message);
-	if(payload == NULL) {
-		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+		free(payload);
 		return -1;
 	}
 	if(client->fd != -1) {
-		/* SOCK_SEQPACKET, enqueue the packet and have poll tell us when it's time to send it */
-		g_async_queue_push(client->messages, payload);
+		/* SOCK_SEQPACKET, enqueue the packet and have the thread send it */
+		g_queue_push_tail(client->messages, payload);
+		gboolean wakeup = TRUE;
+#ifdef HAVE_EPOLL
+		/* If other clients are waiting to be written to, the thread has been notified already */
+		wakeup = (g_hash_table_size(writable_clients) == 0);
+		g_hash_table_insert(writable_clients, client, client);
+#endif
+		janus_mutex_unlock(&clients_mutex);
 		/* Notify the thread there's data to send */
-		int res = 0;
-		do {
-			res = write(write_fd[1], "x", 1);
-		} while(res == -1 && errno == EINTR);
+		if(wakeup)
+			janus_pfunix_wakeup();
 	} else {
+		janus_mutex_unlock(&clients_mutex);
 		/* SOCK_DGRAM, send it right away */
 		int res = 0;
 		do {
@@ -485,11 +528,11 @@ void janus_pfunix_session_over(janus_transport_session *transport, guint64 sessi
 	janus_mutex_lock(&clients_mutex);
 	if(g_hash_table_lookup(clients, client) != NULL) {
 		client->session_timeout = TRUE;
+#ifdef HAVE_EPOLL
+		g_hash_table_insert(writable_clients, client, client);
+#endif
 		/* Notify the thread about this */
-		int res = 0;
-		do {
-			res = write(write_fd[1], "x", 1);
-		} while(res == -1 && errno == EINTR);
+		janus_pfunix_wakeup();
 	}
 	janus_mutex_unlock(&clients_mutex);
 }
@@ -584,21 +627,380 @@ plugin_response:
 }
 
 
+/* Helper to get rid of a client (clients mutex must be locked) */
+static void janus_pfunix_client_close(janus_pfunix_client *client, gboolean notify) {
+	if(notify) {
+		/* Notify core */
+		gateway->transport_gone(&janus_pfunix_transport, client->ts);
+		/* Notify handlers about this transport being gone */
+		if(notify_events && gateway->events_is_enabled()) {
+			json_t *info = json_object();
+			json_object_set_new(info, "event", json_string("disconnected"));
+			gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+		}
+	}
+	int fd = client->fd;
+	if(fd > -1) {
+#ifdef HAVE_EPOLL
+		epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+		/* Close socket */
+		shutdown(fd, SHUT_RDWR);
+		close(fd);
+		client->fd = -1;
+		g_hash_table_remove(clients_by_fd, GINT_TO_POINTER(fd));
+	}
+#ifdef HAVE_EPOLL
+	g_hash_table_remove(writable_clients, client);
+#endif
+	/* Destroy the client */
+	g_hash_table_remove(clients, client);
+	/* Unref the transport instance */
+	janus_transport_session_destroy(client->ts);
+}
+
+/* Helper to send the messages queued for a client (clients mutex must be locked):
+ * returns 0 if everything was sent, 1 if the socket is full, and -1 on errors */
+static int janus_pfunix_client_flush(janus_pfunix_client *client) {
+	int res = 0;
+	while(client->fd > -1 && !g_queue_is_empty(client->messages)) {
+#ifdef HAVE_SENDMMSG
+		/* Send as many messages as we can with a single syscall */
+		struct mmsghdr msgs[JANUS_PFUNIX_WRITE_BATCH];
+		struct iovec iovs[JANUS_PFUNIX_WRITE_BATCH];
+		memset(msgs, 0, sizeof(msgs));
+		int count = 0;
+		GList *l = client->messages->head;
+		while(l != NULL && count < JANUS_PFUNIX_WRITE_BATCH) {
+			iovs[count].iov_base = l->data;
+			iovs[count].iov_len = strlen((char *)l->data);
+			msgs[count].msg_hdr.msg_iov = &iovs[count];
+			msgs[count].msg_hdr.msg_iovlen = 1;
+			count++;
+			l = l->next;
+		}
+		do {
+			res = sendmmsg(client->fd, msgs, count, MSG_NOSIGNAL);
+		} while(res == -1 && errno == EINTR);
+		if(res < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+		JANUS_LOG(LOG_HUGE, "Written %d/%d messages on %d\n", res, count, client->fd);
+		int i = 0;
+		for(i=0; i<res; i++)
+			free(g_queue_pop_head(client->messages));
+		if(res < count)
+			return 1;
+#else
+		char *payload = g_queue_peek_head(client->messages);
+		size_t len = strlen(payload);
+		do {
+			res = write(client->fd, payload, len);
+		} while(res == -1 && errno == EINTR);
+		if(res < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+		JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, len, client->fd);
+		free(g_queue_pop_head(client->messages));
+#endif
+	}
+	return 0;
+}
+
+/* Helper to handle a writable client (clients mutex must be locked) */
+static void janus_pfunix_client_write(janus_pfunix_client *client) {
+	int res = janus_pfunix_client_flush(client);
+	if(res < 0) {
+		JANUS_LOG(LOG_ERR, "Error writing to client %d: %d (%s)\n", client->fd, errno, g_strerror(errno));
+		janus_pfunix_client_close(client, TRUE);
+	} else if(res == 0 && client->session_timeout) {
+		/* We should actually get rid of this connection, now */
+		janus_pfunix_client_close(client, FALSE);
+	}
+}
+
+/* Helper to accept new clients (SOCK_SEQPACKET) */
+static void janus_pfunix_accept(int lfd) {
+	gboolean admin = (lfd == admin_pfd);
+	while(1) {
+		struct sockaddr_un address;
+		socklen_t addrlen = sizeof(address);
+#ifdef HAVE_EPOLL
+		/* Client sockets are edge-triggered, so we need them non-blocking */
+		int cfd = accept4(lfd, (struct sockaddr *) &address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		int cfd = accept(lfd, (struct sockaddr *) &address, &addrlen);
+#endif
+		if(cfd < 0) {
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				JANUS_LOG(LOG_ERR, "Error accepting Unix Sockets %s API client: %d (%s)\n",
+					admin ? "Admin" : "Janus", errno, g_strerror(errno));
+			return;
+		}
+		JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %d\n", admin ? "Admin" : "Janus", cfd);
+		/* Allocate new client */
+		janus_pfunix_client *client = g_malloc(sizeof(janus_pfunix_client));
+		client->fd = cfd;
+		memset(&client->addr, 0, sizeof(client->addr));
+		client->admin = admin;	/* API client type */
+		client->messages = g_queue_new();
+		client->session_timeout = FALSE;
+		/* Create a transport instance as well */
+		client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
+		/* Take note of this new client */
+		janus_mutex_lock(&clients_mutex);
+		g_hash_table_insert(clients_by_fd, GINT_TO_POINTER(cfd), client);
+		g_hash_table_insert(clients, client, client);
+#ifdef HAVE_EPOLL
+		struct epoll_event event = { 0 };
+		event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+		event.data.fd = cfd;
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &event) < 0) {
+			JANUS_LOG(LOG_ERR, "Error adding client %d to epoll: %d (%s)\n", cfd, errno, g_strerror(errno));
+			janus_pfunix_client_close(client, FALSE);
+			janus_mutex_unlock(&clients_mutex);
+			continue;
+		}
+#endif
+		janus_mutex_unlock(&clients_mutex);
+		/* Notify handlers about this new transport */
+		if(notify_events && gateway->events_is_enabled()) {
+			json_t *info = json_object();
+			json_object_set_new(info, "event", json_string("connected"));
+			json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
+			json_object_set_new(info, "fd", json_integer(client->fd));
+			gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+		}
+	}
+}
+
+/* Helper to receive messages on a server socket (SOCK_DGRAM) */
+static void janus_pfunix_read_dgram(int lfd, char *buffer) {
+	gboolean admin = (lfd == admin_pfd);
+	while(1) {
+		struct sockaddr_storage address;
+		socklen_t addrlen = sizeof(address);
+		int res = recvfrom(lfd, buffer, BUFFER_SIZE-1, 0, (struct sockaddr *)&address, &addrlen);
+		if(res < 0) {
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				JANUS_LOG(LOG_ERR, "Error reading from client (%s API)...\n", admin ? "Admin" : "Janus");
+			}
+			return;
+		}
+		buffer[res] = '\0';
+		/* Is this a new client, or one we knew about already? */
+		struct sockaddr_un *uaddr = (struct sockaddr_un *)&address;
+		if(strlen(uaddr->sun_path) == 0) {
+			/* No path provided, drop the packet */
+			JANUS_LOG(LOG_WARN, "Dropping packet from unknown source (no path provided)\n");
+			continue;
+		}
+		janus_mutex_lock(&clients_mutex);
+		janus_pfunix_client *client = g_hash_table_lookup(clients_by_path, uaddr->sun_path);
+		if(client == NULL) {
+			JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %s\n", admin ? "Admin" : "Janus", uaddr->sun_path);
+			/* Allocate new client */
+			client = g_malloc(sizeof(janus_pfunix_client));
+			client->fd = -1;
+			memcpy(&client->addr, uaddr, sizeof(struct sockaddr_un));
+			client->admin = admin;	/* API client type */
+			client->messages = g_queue_new();
+			client->session_timeout = FALSE;
+			/* Create a transport instance as well */
+			client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
+			/* Take note of this new client */
+			g_hash_table_insert(clients_by_path, client->addr.sun_path, client);
+			g_hash_table_insert(clients, client, client);
+			/* Notify handlers about this new transport */
+			if(notify_events && gateway->events_is_enabled()) {
+				json_t *info = json_object();
+				json_object_set_new(info, "event", json_string("connected"));
+				json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
+				json_object_set_new(info, "fd", json_integer(client->fd));
+				json_object_set_new(info, "type", json_string("SOCK_DGRAM"));
+				gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+			}
+		}
+		janus_mutex_unlock(&clients_mutex);
+		JANUS_LOG(LOG_VERB, "Message from client %s (%d bytes)\n", uaddr->sun_path, res);
+		JANUS_LOG(LOG_HUGE, "%s\n", buffer);
+		/* Parse the JSON payload */
+		json_error_t error;
+		json_t *root = json_loads(buffer, 0, &error);
+		/* Notify the core, passing both the object and, since it may be needed, the error */
+		gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
+	}
+}
+
+/* Helper to receive messages from a client (SOCK_SEQPACKET) */
+static void janus_pfunix_read_client(int fd, char *buffer) {
+	struct iovec iov[1];
+	struct msghdr msg;
+	while(1) {
+		memset(&msg, 0, sizeof(msg));
+		iov[0].iov_base = buffer;
+		iov[0].iov_len = BUFFER_SIZE-1;
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 1;
+		int res = recvmsg(fd, &msg, MSG_WAITALL);
+		if(res < 0) {
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				JANUS_LOG(LOG_ERR, "Error reading from client %d...\n", fd);
+			}
+			return;
+		}
+		if(msg.msg_flags & MSG_TRUNC) {
+			/* Apparently our buffer is not large enough? */
+			JANUS_LOG(LOG_WARN, "Incoming message from client %d truncated (%d bytes), dropping it...\n", fd, res);
+			continue;
+		}
+		/* Find the client from its file descriptor */
+		janus_mutex_lock(&clients_mutex);
+		janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(fd));
+		if(client == NULL) {
+			janus_mutex_unlock(&clients_mutex);
+			JANUS_LOG(LOG_WARN, "Got data from unknown Unix Sockets client %d, closing connection...\n", fd);
+			/* Close socket */
+			shutdown(fd, SHUT_RDWR);
+			close(fd);
+			return;
+		}
+		if(res == 0) {
+			JANUS_LOG(LOG_INFO, "Unix Sockets client disconnected (%d)\n", fd);
+			janus_pfunix_client_close(client, TRUE);
+			janus_mutex_unlock(&clients_mutex);
+			return;
+		}
+		janus_refcount_increase(&client->ts->ref);
+		janus_mutex_unlock(&clients_mutex);
+		/* If we got here, there's data to handle */
+		buffer[res] = '\0';
+		JANUS_LOG(LOG_VERB, "Message from client %d (%d bytes)\n", fd, res);
+		JANUS_LOG(LOG_HUGE, "%s\n", buffer);
+		/* Parse the JSON payload */
+		json_error_t error;
+		json_t *root = json_loads(buffer, 0, &error);
+		/* Notify the core, passing both the object and, since it may be needed, the error */
+		gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
+		janus_refcount_decrease(&client->ts->ref);
+#ifndef HAVE_EPOLL
+		/* With poll we're level-triggered, no need to read until there's nothing left */
+		return;
+#endif
+	}
+}
+
 /* Thread */
 void *janus_pfunix_thread(void *data) {
 	JANUS_LOG(LOG_INFO, "Unix Sockets thread started\n");
 
+	char buffer[BUFFER_SIZE];
+#ifdef HAVE_EPOLL
+	/* Listening sockets and the eventfd are level-triggered, clients are edge-triggered */
+	struct epoll_event event = { 0 };
+	event.events = EPOLLIN;
+	event.data.fd = write_fd[0];
+	epoll_ctl(epfd, EPOLL_CTL_ADD, write_fd[0], &event);
+	if(pfd > -1) {
+		event.data.fd = pfd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, pfd, &event);
+	}
+	if(admin_pfd > -1) {
+		event.data.fd = admin_pfd;
+		epoll_ctl(epfd, EPOLL_CTL_ADD, admin_pfd, &event);
+	}
+	struct epoll_event events[JANUS_PFUNIX_EPOLL_EVENTS];
+
+	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
+		int num = epoll_wait(epfd, events, JANUS_PFUNIX_EPOLL_EVENTS, -1);
+		if(num < 0) {
+			if(errno == EINTR) {
+				JANUS_LOG(LOG_HUGE, "Got an EINTR (%s) polling the Unix Sockets descriptors, ignoring...\n", g_strerror(errno));
+				continue;
+			}
+			JANUS_LOG(LOG_ERR, "epoll_wait() failed: %d (%s)\n", errno, g_strerror(errno));
+			break;
+		}
+		int i = 0;
+		for(i=0; i<num; i++) {
+			int fd = events[i].data.fd;
+			if(fd == write_fd[0]) {
+				/* Some clients have data to write: we only check those */
+				uint64_t value = 0;
+				(void)read(fd, &value, sizeof(value));
+				janus_mutex_lock(&clients_mutex);
+				GList *writable = g_hash_table_get_values(writable_clients);
+				g_hash_table_remove_all(writable_clients);
+				GList *temp = writable;
+				while(temp) {
+					janus_pfunix_client *client = (janus_pfunix_client *)temp->data;
+					if(g_hash_table_lookup(clients, client) != NULL) {
+						if(client->fd > -1)
+							janus_pfunix_client_write(client);
+					}
+					temp = temp->next;
+				}
+				g_list_free(writable);
+				janus_mutex_unlock(&clients_mutex);
+			} else if(fd == pfd || fd == admin_pfd) {
+				if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+					/* Error in the Janus or Admin API socket */
+					JANUS_LOG(LOG_WARN, "Error polling Unix Sockets %s API interface (%s), disabling it\n",
+						fd == pfd ? "Janus" : "Admin", events[i].events & EPOLLERR ? "EPOLLERR" : "EPOLLHUP");
+					epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+					close(fd);
+					if(fd == pfd)
+						pfd = -1;
+					else
+						admin_pfd = -1;
+					continue;
+				}
+				/* Janus/Admin API: accept the new client (SOCK_SEQPACKET) or receive data (SOCK_DGRAM) */
+				if((fd == pfd && !dgram) || (fd == admin_pfd && !admin_dgram))
+					janus_pfunix_accept(fd);
+				else
+					janus_pfunix_read_dgram(fd, buffer);
+			} else {
+				if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+					/* Error in a client socket, find and remove it */
+					janus_mutex_lock(&clients_mutex);
+					janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(fd));
+					if(client != NULL) {
+						JANUS_LOG(LOG_INFO, "Unix Sockets client disconnected (%d)\n", fd);
+						janus_pfunix_client_close(client, TRUE);
+					}
+					janus_mutex_unlock(&clients_mutex);
+					continue;
+				}
+				if(events[i].events & EPOLLOUT) {
+					/* The socket can be written to again, send what we couldn't before */
+					janus_mutex_lock(&clients_mutex);
+					janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(fd));
+					if(client != NULL)
+						janus_pfunix_client_write(client);
+					janus_mutex_unlock(&clients_mutex);
+				}
+				if(events[i].events & EPOLLIN) {
+					/* Client data: receive messages */
+					janus_pfunix_read_client(fd, buffer);
+				}
+			}
+		}
+	}
+	close(epfd);
+	epfd = -1;
+	close(write_fd[0]);
+	write_fd[0] = -1;
+	write_fd[1] = -1;
+	g_hash_table_destroy(writable_clients);
+	writable_clients = NULL;
+#else
 	int fds = 0;
 	struct pollfd poll_fds[1024];	/* FIXME Should we allow for more clients? */
-	char buffer[BUFFER_SIZE];
-	struct iovec iov[1];
-	struct msghdr msg;
-	memset(&msg, 0, sizeof(msg));
-	memset(iov, 0, sizeof(iov));
-	iov[0].iov_base = buffer;
-	iov[0].iov_len = sizeof(buffer);
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
 		/* Prepare poll list of file descriptors */
@@ -628,7 +1030,8 @@ void *janus_pfunix_thread(void *data) {
 			janus_pfunix_client *client = value;
 			if(client->fd > -1) {
 				poll_fds[fds].fd = client->fd;
-				poll_fds[fds].events = g_async_queue_length(client->messages) > 0 ? POLLIN | POLLOUT : POLLIN;
+				poll_fds[fds].events = (!g_queue_is_empty(client->messages) || client->session_timeout) ?
+					POLLIN | POLLOUT : POLLIN;
 				fds++;
 			}
 		}
@@ -680,29 +1083,10 @@ void *janus_pfunix_thread(void *data) {
 					/* Error in a client socket, find and remove it */
 					janus_mutex_lock(&clients_mutex);
 					janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-					if(client == NULL) {
-						/* We're not handling this, ignore */
-						janus_mutex_unlock(&clients_mutex);
-						continue;
-					}
-					JANUS_LOG(LOG_INFO, "Unix Sockets client disconnected (%d)\n", poll_fds[i].fd);
-					/* Notify core */
-					gateway->transport_gone(&janus_pfunix_transport, client->ts);
-					/* Notify handlers about this transport being gone */
-					if(notify_events && gateway->events_is_enabled()) {
-						json_t *info = json_object();
-						json_object_set_new(info, "event", json_string("disconnected"));
-						gateway->notify_event(&janus_pfunix_transport, client->ts, info);
+					if(client != NULL) {
+						JANUS_LOG(LOG_INFO, "Unix Sockets client disconnected (%d)\n", poll_fds[i].fd);
+						janus_pfunix_client_close(client, TRUE);
 					}
-					/* Close socket */
-					shutdown(SHUT_RDWR, poll_fds[i].fd);
-					close(poll_fds[i].fd);
-					client->fd = -1;
-					/* Destroy the client */
-					g_hash_table_remove(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-					g_hash_table_remove(clients, client);
-					/* Unref the transport instance */
-					janus_transport_session_destroy(client->ts);
 					janus_mutex_unlock(&clients_mutex);
 					continue;
 				}
@@ -712,37 +1096,8 @@ void *janus_pfunix_thread(void *data) {
 				/* Find the client from its file descriptor */
 				janus_mutex_lock(&clients_mutex);
 				janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-				if(client != NULL) {
-					char *payload = NULL;
-					while((payload = g_async_queue_try_pop(client->messages)) != NULL) {
-						int res = 0;
-						do {
-							if(client->fd < 0)
-								break;
-							res = write(client->fd, payload, strlen(payload));
-						} while(res == -1 && errno == EINTR);
-						/* FIXME Should we check if sent everything? */
-						JANUS_LOG(LOG_HUGE, "Written %d/%zu bytes on %d\n", res, strlen(payload), client->fd);
-						g_free(payload);
-					}
-					if(client->session_timeout) {
-						/* We should actually get rid of this connection, now */
-						shutdown(SHUT_RDWR, poll_fds[i].fd);
-						close(poll_fds[i].fd);
-						client->fd = -1;
-						/* Destroy the client */
-						g_hash_table_remove(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-						g_hash_table_remove(clients, client);
-						if(client->messages != NULL) {
-							char *response = NULL;
-							while((response = g_async_queue_try_pop(client->messages)) != NULL) {
-								g_free(response);
-							}
-							g_async_queue_unref(client->messages);
-						}
-						g_free(client);
-					}
-				}
+				if(client != NULL)
+					janus_pfunix_client_write(client);
 				janus_mutex_unlock(&clients_mutex);
 			}
 			if(poll_fds[i].revents & POLLIN) {
@@ -751,154 +1106,18 @@ void *janus_pfunix_thread(void *data) {
 					(void)read(poll_fds[i].fd, buffer, BUFFER_SIZE);
 				} else if(poll_fds[i].fd == pfd || poll_fds[i].fd == admin_pfd) {
 					/* Janus/Admin API: accept the new client (SOCK_SEQPACKET) or receive data (SOCK_DGRAM) */
-					struct sockaddr_un address;
-					socklen_t addrlen = sizeof(address);
-					if((poll_fds[i].fd == pfd && !dgram) || (poll_fds[i].fd == admin_pfd && !admin_dgram)) {
-						/* SOCK_SEQPACKET */
-						int cfd = accept(poll_fds[i].fd, (struct sockaddr *) &address, &addrlen);
-						if(cfd > -1) {
-							JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %d\n",
-								poll_fds[i].fd == pfd ? "Janus" : "Admin", cfd);
-							/* Allocate new client */
-							janus_pfunix_client *client = g_malloc(sizeof(janus_pfunix_client));
-							client->fd = cfd;
-							memset(&client->addr, 0, sizeof(client->addr));
-							client->admin = (poll_fds[i].fd == admin_pfd);	/* API client type */
-							client->messages = g_async_queue_new();
-							client->session_timeout = FALSE;
-							/* Create a transport instance as well */
-							client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
-							/* Take note of this new client */
-							janus_mutex_lock(&clients_mutex);
-							g_hash_table_insert(clients_by_fd, GINT_TO_POINTER(cfd), client);
-							g_hash_table_insert(clients, client, client);
-							janus_mutex_unlock(&clients_mutex);
-							/* Notify handlers about this new transport */
-							if(notify_events && gateway->events_is_enabled()) {
-								json_t *info = json_object();
-								json_object_set_new(info, "event", json_string("connected"));
-								json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
-								json_object_set_new(info, "fd", json_integer(client->fd));
-								gateway->notify_event(&janus_pfunix_transport, client->ts, info);
-							}
-						}
-					} else {
-						/* SOCK_DGRAM */
-						struct sockaddr_storage address;
-						res = recvfrom(poll_fds[i].fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&address, &addrlen);
-						if(res < 0) {
-							if(errno != EAGAIN && errno != EWOULDBLOCK) {
-								JANUS_LOG(LOG_ERR, "Error reading from client (%s API)...\n",
-									poll_fds[i].fd == pfd ? "Janus" : "Admin");
-							}
-							continue;
-						}
-						buffer[res] = '\0';
-						/* Is this a new client, or one we knew about already? */
-						struct sockaddr_un *uaddr = (struct sockaddr_un *)&address;
-						if(strlen(uaddr->sun_path) == 0) {
-							/* No path provided, drop the packet */
-							JANUS_LOG(LOG_WARN, "Dropping packet from unknown source (no path provided)\n");
-							continue;
-						}
-						janus_mutex_lock(&clients_mutex);
-						janus_pfunix_client *client = g_hash_table_lookup(clients_by_path, uaddr->sun_path);
-						if(client == NULL) {
-							JANUS_LOG(LOG_INFO, "Got new Unix Sockets %s API client: %s\n",
-								poll_fds[i].fd == pfd ? "Janus" : "Admin", uaddr->sun_path);
-							/* Allocate new client */
-							client = g_malloc(sizeof(janus_pfunix_client));
-							client->fd = -1;
-							memcpy(&client->addr, uaddr, sizeof(struct sockaddr_un));
-							client->admin = (poll_fds[i].fd == admin_pfd);	/* API client type */
-							client->messages = g_async_queue_new();
-							client->session_timeout = FALSE;
-							/* Create a transport instance as well */
-							client->ts = janus_transport_session_create(client, janus_pfunix_client_free);
-							/* Take note of this new client */
-							g_hash_table_insert(clients_by_path, uaddr->sun_path, client);
-							g_hash_table_insert(clients, client, client);
-							/* Notify handlers about this new transport */
-							if(notify_events && gateway->events_is_enabled()) {
-								json_t *info = json_object();
-								json_object_set_new(info, "event", json_string("connected"));
-								json_object_set_new(info, "admin_api", client->admin ? json_true() : json_false());
-								json_object_set_new(info, "fd", json_integer(client->fd));
-								json_object_set_new(info, "type", json_string("SOCK_DGRAM"));
-								gateway->notify_event(&janus_pfunix_transport, client->ts, info);
-							}
-						}
-						janus_mutex_unlock(&clients_mutex);
-						JANUS_LOG(LOG_VERB, "Message from client %s (%d bytes)\n", uaddr->sun_path, res);
-						JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-						/* Parse the JSON payload */
-						json_error_t error;
-						json_t *root = json_loads(buffer, 0, &error);
-						/* Notify the core, passing both the object and, since it may be needed, the error */
-						gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
-					}
+					if((poll_fds[i].fd == pfd && !dgram) || (poll_fds[i].fd == admin_pfd && !admin_dgram))
+						janus_pfunix_accept(poll_fds[i].fd);
+					else
+						janus_pfunix_read_dgram(poll_fds[i].fd, buffer);
 				} else {
 					/* Client data: receive message */
-					iov[0].iov_len = sizeof(buffer);
-					res = recvmsg(poll_fds[i].fd, &msg, MSG_WAITALL);
-					if(res < 0) {
-						if(errno != EAGAIN && errno != EWOULDBLOCK) {
-							JANUS_LOG(LOG_ERR, "Error reading from client %d...\n", poll_fds[i].fd);
-						}
-						continue;
-					}
-					if(msg.msg_flags & MSG_TRUNC) {
-						/* Apparently our buffer is not large enough? */
-						JANUS_LOG(LOG_WARN, "Incoming message from client %d truncated (%d bytes), dropping it...\n", poll_fds[i].fd, res);
-						continue;
-					}
-					/* Find the client from its file descriptor */
-					janus_mutex_lock(&clients_mutex);
-					janus_pfunix_client *client = g_hash_table_lookup(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-					if(client == NULL) {
-						janus_mutex_unlock(&clients_mutex);
-						JANUS_LOG(LOG_WARN, "Got data from unknown Unix Sockets client %d, closing connection...\n", poll_fds[i].fd);
-						/* Close socket */
-						shutdown(SHUT_RDWR, poll_fds[i].fd);
-						close(poll_fds[i].fd);
-						continue;
-					}
-					if(res == 0) {
-						JANUS_LOG(LOG_INFO, "Unix Sockets client disconnected (%d)\n", poll_fds[i].fd);
-						/* Notify core */
-						gateway->transport_gone(&janus_pfunix_transport, client->ts);
-						/* Notify handlers about this transport being gone */
-						if(notify_events && gateway->events_is_enabled()) {
-							json_t *info = json_object();
-							json_object_set_new(info, "event", json_string("disconnected"));
-							gateway->notify_event(&janus_pfunix_transport, client->ts, info);
-						}
-						/* Close socket */
-						shutdown(SHUT_RDWR, poll_fds[i].fd);
-						close(poll_fds[i].fd);
-						client->fd = -1;
-						/* Destroy the client */
-						g_hash_table_remove(clients_by_fd, GINT_TO_POINTER(poll_fds[i].fd));
-						g_hash_table_remove(clients, client);
-						/* Unref the transport instance */
-						janus_transport_session_destroy(client->ts);
-						janus_mutex_unlock(&clients_mutex);
-						continue;
-					}
-					janus_mutex_unlock(&clients_mutex);
-					/* If we got here, there's data to handle */
-					buffer[res] = '\0';
-					JANUS_LOG(LOG_VERB, "Message from client %d (%d bytes)\n", poll_fds[i].fd, res);
-					JANUS_LOG(LOG_HUGE, "%s\n", buffer);
-					/* Parse the JSON payload */
-					json_error_t error;
-					json_t *root = json_loads(buffer, 0, &error);
-					/* Notify the core, passing both the object and, since it may be needed, the error */
-					gateway->incoming_request(&janus_pfunix_transport, client->ts, NULL, client->admin, root, &error);
+					janus_pfunix_read_client(poll_fds[i].fd, buffer);
 				}
 			}
 		}
 	}
+#endif
 
 	void *addr = g_malloc(sizeof(struct sockaddr_un)+1);
 	if(pfd > -1) {
@@ -26,6 +26,12 @@
  * \note When you create a session using RabbitMQ, a subscription to the
  * events related to it is done automatically through the outgoing queue,
  * so no need for an explicit request as the GET in the plain HTTP API.
+ * \note Incoming Janus API requests can be consumed by more than one
+ * thread, each with a connection of its own (rabbitmq-c connections
+ * can't be shared across threads), optionally with a prefetch window
+ * and explicit acks. Outgoing messages are published on a dedicated
+ * connection too, in batches, and can optionally make use of
+ * asynchronous publisher confirms.
  *
  * \ingroup transports
  * \ref transports
@@ -155,6 +161,9 @@ typedef struct janus_rabbitmq_client {
 	gboolean admin_api_enabled;				/* Whether the Janus API via RabbitMQ is enabled */
 	amqp_bytes_t to_janus_admin_queue;		/* AMQP outgoing messages queue (Admin API) */
 	GThread *in_thread, *out_thread;		/* Threads to handle incoming and outgoing queues */
+	amqp_connection_state_t pub_conn;		/* AMQP connection for outgoing messages (only used by the out thread) */
+	uint64_t pub_seqno, pub_acked;			/* Publisher confirms: last published and last confirmed delivery tags */
+	guint64 pub_nacked;						/* Publisher confirms: how many messages the broker rejected */
 	GAsyncQueue *messages;					/* Queue of outgoing messages to push */
 	janus_mutex mutex;						/* Mutex to lock/unlock this session */
 	gint session_timeout:1;					/* Whether a Janus session timeout occurred in the core */
@@ -170,9 +179,19 @@ typedef struct janus_rabbitmq_response {
 } janus_rabbitmq_response;
 static janus_rabbitmq_response exit_message;
 
+/* Additional consumer of the Janus API queue, with its own connection */
+typedef struct janus_rabbitmq_consumer {
+	guint index;							/* Index of this consumer (the in thread is 0) */
+	amqp_connection_state_t conn;			/* AMQP connection state */
+	GThread *thread;						/* Thread receiving the deliveries */
+} janus_rabbitmq_consumer;
+static janus_rabbitmq_consumer *rmq_consumers = NULL;
+static guint rmq_consumers_num = 0;
+
 /* Threads */
 void *janus_rmq_in_thread(void *data);
 void *janus_rmq_out_thread(void *data);
+void *janus_rmq_consumer_thread(void *data);
 
 
 /* We only handle a single client per time, as the queues are fixed */
@@ -190,6 +209,10 @@ static gboolean declare_outgoing_queue = FALSE, declare_outgoing_queue_admin = F
 amqp_boolean_t queue_durable = 0, queue_exclusive = 0, queue_autodelete = 0,
 	queue_durable_admin = 0, queue_exclusive_admin = 0, queue_autodelete_admin = 0;
 static uint16_t heartbeat = 0;
+/* Consumers, prefetch and publishing */
+static uint16_t rmq_prefetch = 0;
+static guint rmq_publish_batch = 1, rmq_confirm_window = 256;
+static gboolean rmq_publisher_confirms = FALSE;
 
 /* Transport implementation */
 int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_path) {
@@ -312,6 +335,43 @@ int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_
 		heartbeat = 0;
 	}
 
+	/* Consumers, prefetch and publishing config */
+	item = janus_config_get(config, config_general, janus_config_type_item, "consumers");
+	if(item && item->value) {
+		int consumers = atoi(item->value);
+		if(consumers < 1 || consumers > 64) {
+			JANUS_LOG(LOG_WARN, "Invalid number of consumers (%s), falling back to default (1)\n", item->value);
+		} else {
+			rmq_consumers_num = consumers - 1;
+		}
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "prefetch");
+	if(item && item->value && janus_string_to_uint16(item->value, &rmq_prefetch) < 0) {
+		JANUS_LOG(LOG_ERR, "Invalid prefetch count (%s), falling back to default (0, automatic acks)\n", item->value);
+		rmq_prefetch = 0;
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "publish_batch");
+	if(item && item->value) {
+		int batch = atoi(item->value);
+		if(batch < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid publish batch size (%s), falling back to default (1)\n", item->value);
+		} else {
+			rmq_publish_batch = batch;
+		}
+	}
+	item = janus_config_get(config, config_general, janus_config_type_item, "publisher_confirms");
+	if(item && item->value && janus_is_true(item->value))
+		rmq_publisher_confirms = TRUE;
+	item = janus_config_get(config, config_general, janus_config_type_item, "confirm_window");
+	if(item && item->value) {
+		int window = atoi(item->value);
+		if(window < 1) {
+			JANUS_LOG(LOG_WARN, "Invalid publisher confirms window (%s), falling back to default (256)\n", item->value);
+		} else {
+			rmq_confirm_window = window;
+		}
+	}
+
 	/* Now check if the Janus API must be supported */
 	item = janus_config_get(config, config_general, janus_config_type_item, "enabled");
 	if(item == NULL) {
@@ -388,6 +448,13 @@ int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_
 			JANUS_LOG(LOG_INFO, "RabbitMQ support for Janus API enabled, %s:%d (%s/%s) exch: (%s) exchange_type:%s \n", rmqhost, rmqport, to_janus, from_janus, janus_exchange, janus_exchange_type);
 		}
 		rmq_janus_api_enabled = TRUE;
+		if(rmq_consumers_num > 0 && queue_exclusive) {
+			/* Other connections can't consume from an exclusive queue */
+			JANUS_LOG(LOG_WARN, "The Janus API queue is exclusive, disabling additional consumers\n");
+			rmq_consumers_num = 0;
+		}
+	} else {
+		rmq_consumers_num = 0;
 	}
 	/* Do the same for the admin API */
 	item = janus_config_get(config, config_admin, janus_config_type_item, "admin_enabled");
@@ -488,6 +555,27 @@ int janus_rabbitmq_init(janus_transport_callbacks *callback, const char *config_
 			janus_config_destroy(config);
 			return -1;
 		}
+		/* Additional consumers of the Janus API queue, if configured */
+		if(rmq_consumers_num > 0) {
+			rmq_consumers = g_malloc0(rmq_consumers_num * sizeof(janus_rabbitmq_consumer));
+			guint i = 0;
+			for(i=0; i<rmq_consumers_num; i++) {
+				janus_rabbitmq_consumer *consumer = &rmq_consumers[i];
+				consumer->index = i+1;
+				char tname[16];
+				g_snprintf(tname, sizeof(tname), "rmq_consumer %u", consumer->index);
+				consumer->thread = g_thread_try_new(tname, &janus_rmq_consumer_thread, consumer, &error);
+				if(error != NULL) {
+					/* Not fatal, we'll just have fewer consumers */
+					JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch RabbitMQ consumer thread #%u...\n",
+						error->code, error->message ? error->message : "??", consumer->index);
+					g_error_free(error);
+					error = NULL;
+					consumer->thread = NULL;
+				}
+			}
+			JANUS_LOG(LOG_INFO, "Using %u additional RabbitMQ consumers (prefetch: %"SCNu16")\n", rmq_consumers_num, rmq_prefetch);
+		}
 
 		janus_mutex_init(&rmq_client->mutex);
 		/* Done */
@@ -530,16 +618,13 @@ error:
 	return -1;
 }
 
-int janus_rabbitmq_connect(void) {
-	rmq_client->connected = 0;
-	/* Connect */
-	rmq_client->rmq_conn = amqp_new_connection();
+/* Open the socket, log in, and open a channel on a new connection */
+static int janus_rabbitmq_login(amqp_connection_state_t conn, amqp_channel_t channel) {
 	amqp_socket_t *socket = NULL;
-	amqp_queue_declare_ok_t *declare = NULL;
 	int status;
 	JANUS_LOG(LOG_VERB, "Creating RabbitMQ socket...\n");
 	if(ssl_enabled) {
-		socket = amqp_ssl_socket_new(rmq_client->rmq_conn);
+		socket = amqp_ssl_socket_new(conn);
 		if(socket == NULL) {
 			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error creating socket...\n");
 			return -1;
@@ -562,7 +647,7 @@ int janus_rabbitmq_connect(void) {
 			}
 		}
 	} else {
-		socket = amqp_tcp_socket_new(rmq_client->rmq_conn);
+		socket = amqp_tcp_socket_new(conn);
 		if(socket == NULL) {
 			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error creating socket...\n");
 			return -1;
@@ -575,19 +660,50 @@ int janus_rabbitmq_connect(void) {
 		return -1;
 	}
 	JANUS_LOG(LOG_VERB, "Logging in...\n");
-	amqp_rpc_reply_t result = amqp_login(rmq_client->rmq_conn, vhost, 0, 131072, heartbeat, AMQP_SASL_METHOD_PLAIN, username, password);
+	amqp_rpc_reply_t result = amqp_login(conn, vhost, 0, 131072, heartbeat, AMQP_SASL_METHOD_PLAIN, username, password);
 	if(result.reply_type != AMQP_RESPONSE_NORMAL) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error logging in... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
 		return -1;
 	}
-	rmq_client->rmq_channel = 1;
 	JANUS_LOG(LOG_VERB, "Opening channel...\n");
-	amqp_channel_open(rmq_client->rmq_conn, rmq_client->rmq_channel);
-	result = amqp_get_rpc_reply(rmq_client->rmq_conn);
+	amqp_channel_open(conn, channel);
+	result = amqp_get_rpc_reply(conn);
 	if(result.reply_type != AMQP_RESPONSE_NORMAL) {
 		JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error opening channel... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
 		return -1;
 	}
+	return 0;
+}
+
+/* Start consuming from a queue: with a prefetch window, deliveries must be acknowledged */
+static int janus_rabbitmq_consume(amqp_connection_state_t conn, amqp_channel_t channel, amqp_bytes_t queue) {
+	amqp_rpc_reply_t result;
+	if(rmq_prefetch > 0) {
+		amqp_basic_qos(conn, channel, 0, rmq_prefetch, 0);
+		result = amqp_get_rpc_reply(conn);
+		if(result.reply_type != AMQP_RESPONSE_NORMAL) {
+			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error setting prefetch... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+			return -1;
+		}
+	}
+	amqp_basic_consume(conn, channel, queue, amqp_empty_bytes, 0, rmq_prefetch > 0 ? 0 : 1, 0, amqp_empty_table);
+	result = amqp_get_rpc_reply(conn);
+	if(result.reply_type != AMQP_RESPONSE_NORMAL) {
+		JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error consuming... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+		return -1;
+	}
+	return 0;
+}
+
+int janus_rabbitmq_connect(void) {
+	rmq_client->connected = 0;
+	/* Connect */
+	rmq_client->rmq_conn = amqp_new_connection();
+	rmq_client->rmq_channel = 1;
+	if(janus_rabbitmq_login(rmq_client->rmq_conn, rmq_client->rmq_channel) < 0)
+		return -1;
+	amqp_queue_declare_ok_t *declare = NULL;
+	amqp_rpc_reply_t result;
 	rmq_client->janus_exchange = amqp_empty_bytes;
 	if(janus_exchange != NULL) {
 		JANUS_LOG(LOG_VERB, "Declaring exchange...\n");
@@ -648,12 +764,8 @@ int janus_rabbitmq_connect(void) {
 			}
 		}
 
-		amqp_basic_consume(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->to_janus_queue, amqp_empty_bytes, 0, 1, 0, amqp_empty_table);
-		result = amqp_get_rpc_reply(rmq_client->rmq_conn);
-		if(result.reply_type != AMQP_RESPONSE_NORMAL) {
-			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error consuming... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+		if(janus_rabbitmq_consume(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->to_janus_queue) < 0)
 			return -1;
-		}
 	}
 	rmq_client->admin_api_enabled = FALSE;
 	if(rmq_admin_api_enabled) {
@@ -705,12 +817,8 @@ int janus_rabbitmq_connect(void) {
 			}
 		}
 
-		amqp_basic_consume(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->to_janus_admin_queue, amqp_empty_bytes, 0, 1, 0, amqp_empty_table);
-		result = amqp_get_rpc_reply(rmq_client->rmq_conn);
-		if(result.reply_type != AMQP_RESPONSE_NORMAL) {
-			JANUS_LOG(LOG_FATAL, "Can't connect to RabbitMQ server: error consuming... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+		if(janus_rabbitmq_consume(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->to_janus_admin_queue) < 0)
 			return -1;
-		}
 	}
 
 	rmq_client->connected = 1;
@@ -732,6 +840,14 @@ void janus_rabbitmq_destroy(void) {
 			g_thread_join(rmq_client->in_thread);
 		if(rmq_client->out_thread)
 			g_thread_join(rmq_client->out_thread);
+		guint i = 0;
+		for(i=0; i<rmq_consumers_num && rmq_consumers; i++) {
+			if(rmq_consumers[i].thread)
+				g_thread_join(rmq_consumers[i].thread);
+		}
+		g_free(rmq_consumers);
+		rmq_consumers = NULL;
+		rmq_consumers_num = 0;
 		if(rmq_client->rmq_conn) {
 			amqp_destroy_connection(rmq_client->rmq_conn);
 		}
@@ -810,7 +926,7 @@ int janus_rabbitmq_send_message(janus_transport_session *transport, void *reques
 	/* FIXME Add to the queue of outgoing messages */
 	janus_rabbitmq_response *response = g_malloc(sizeof(janus_rabbitmq_response));
 	response->admin = admin;
-	response->payload = json_dumps(message, json_format);
+	response->payload = janus_json_dumps(message, json_format);
 	json_decref(message);
 	if(response->payload == NULL) {
 		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
@@ -914,6 +1030,77 @@ plugin_response:
 
 
 /* Threads */
+/* Read the rest of a delivery (header and body) after its method frame, and pass it to the core */
+static void janus_rmq_handle_frame(amqp_connection_state_t conn, amqp_frame_t *method, gboolean check_admin) {
+	amqp_frame_t frame = *method;
+	/* We expect method first */
+	JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
+	if(frame.frame_type != AMQP_FRAME_METHOD)
+		return;
+	JANUS_LOG(LOG_VERB, "Method %s\n", amqp_method_name(frame.payload.method.id));
+	gboolean admin = FALSE;
+	amqp_channel_t channel = frame.channel;
+	uint64_t delivery_tag = 0;
+	if(frame.payload.method.id == AMQP_BASIC_DELIVER_METHOD) {
+		amqp_basic_deliver_t *d = (amqp_basic_deliver_t *)frame.payload.method.decoded;
+		delivery_tag = d->delivery_tag;
+		JANUS_LOG(LOG_VERB, "Delivery #%u, %.*s\n", (unsigned) d->delivery_tag, (int) d->routing_key.len, (char *) d->routing_key.bytes);
+		/* Check if this is a Janus or Admin API request */
+		if(check_admin) {
+			char incoming_topic[d->routing_key.len + 2];
+			/* Convert the amqp_bytes_t back to char* */
+			g_strlcpy(incoming_topic, (char *)d->routing_key.bytes, d->routing_key.len + 1);
+			if(strcmp(incoming_topic, to_janus_admin) == 0) {
+				admin = TRUE;
+			}
+		}
+		JANUS_LOG(LOG_VERB, "  -- This is %s API request\n", admin ? "an admin" : "a Janus");
+	}
+	/* Then the header */
+	amqp_simple_wait_frame(conn, &frame);
+	JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
+	if(frame.frame_type != AMQP_FRAME_HEADER)
+		return;
+	amqp_basic_properties_t *p = (amqp_basic_properties_t *)frame.payload.properties.decoded;
+	if(p->_flags & AMQP_BASIC_REPLY_TO_FLAG) {
+		JANUS_LOG(LOG_VERB, "  -- Reply-to: %.*s\n", (int) p->reply_to.len, (char *) p->reply_to.bytes);
+	}
+	char *correlation = NULL;
+	if(p->_flags & AMQP_BASIC_CORRELATION_ID_FLAG) {
+		correlation = g_malloc0(p->correlation_id.len+1);
+		sprintf(correlation, "%.*s", (int) p->correlation_id.len, (char *) p->correlation_id.bytes);
+		JANUS_LOG(LOG_VERB, "  -- Correlation-id: %s\n", correlation);
+	}
+	if(p->_flags & AMQP_BASIC_CONTENT_TYPE_FLAG) {
+		JANUS_LOG(LOG_VERB, "  -- Content-type: %.*s\n", (int) p->content_type.len, (char *) p->content_type.bytes);
+	}
+	/* And the body */
+	uint64_t total = frame.payload.properties.body_size, received = 0;
+	char *payload = g_malloc0(total+1), *index = payload;
+	while(received < total) {
+		amqp_simple_wait_frame(conn, &frame);
+		JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
+		if(frame.frame_type != AMQP_FRAME_BODY)
+			break;
+		sprintf(index, "%.*s", (int) frame.payload.body_fragment.len, (char *) frame.payload.body_fragment.bytes);
+		received += frame.payload.body_fragment.len;
+		index = payload+received;
+	}
+	JANUS_LOG(LOG_VERB, "Got %"SCNu64"/%"SCNu64" bytes from the %s queue (%"SCNu64")\n",
+		received, total, admin ? "admin API" : "Janus API", frame.payload.body_fragment.len);
+	JANUS_LOG(LOG_VERB, "%s\n", payload);
+	/* With a prefetch window we acknowledge deliveries ourselves, as soon as we have them */
+	if(rmq_prefetch > 0 && delivery_tag > 0)
+		amqp_basic_ack(conn, channel, delivery_tag, 0);
+	/* Parse the JSON payload */
+	json_error_t error;
+	json_t *root = json_loadb(payload, received, 0, &error);
+	g_free(payload);
+	/* Notify the core, passing both the object and, since it may be needed, the error
+	 * We also specify the correlation ID as an opaque request identifier: we'll need it later */
+	gateway->incoming_request(&janus_rabbitmq_transport, rmq_session, correlation, admin, root, &error);
+}
+
 void *janus_rmq_in_thread(void *data) {
 	if(rmq_client == NULL) {
 		JANUS_LOG(LOG_ERR, "No RabbitMQ connection??\n");
@@ -961,69 +1148,173 @@ void *janus_rmq_in_thread(void *data) {
 			}
 		}
 
-		/* We expect method first */
-		JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
-		if(frame.frame_type != AMQP_FRAME_METHOD)
-			continue;
-		JANUS_LOG(LOG_VERB, "Method %s\n", amqp_method_name(frame.payload.method.id));
-		gboolean admin = FALSE;
-		if(frame.payload.method.id == AMQP_BASIC_DELIVER_METHOD) {
-			amqp_basic_deliver_t *d = (amqp_basic_deliver_t *)frame.payload.method.decoded;
-			JANUS_LOG(LOG_VERB, "Delivery #%u, %.*s\n", (unsigned) d->delivery_tag, (int) d->routing_key.len, (char *) d->routing_key.bytes);
-			/* Check if this is a Janus or Admin API request */
-			if(rmq_client->admin_api_enabled) {
-				char incoming_topic[d->routing_key.len + 2];
-				/* Convert the amqp_bytes_t back to char* */
-				g_strlcpy(incoming_topic, (char *)d->routing_key.bytes, d->routing_key.len + 1);
-				if(strcmp(incoming_topic, to_janus_admin) == 0) {
-					admin = TRUE;
+		/* Handle the delivery */
+		janus_rmq_handle_frame(rmq_client->rmq_conn, &frame, rmq_client->admin_api_enabled);
+	}
+	JANUS_LOG(LOG_INFO, "Leaving RabbitMQ in thread\n");
+	return NULL;
+}
+
+void *janus_rmq_consumer_thread(void *data) {
+	janus_rabbitmq_consumer *consumer = (janus_rabbitmq_consumer *)data;
+	JANUS_LOG(LOG_VERB, "Joining RabbitMQ consumer thread #%u\n", consumer->index);
+
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = 20000;
+	amqp_frame_t frame;
+	guint rmq_reconnect_backoff = rmq_reconnect_backoff_initial;
+	/* We compete with the in thread for messages on the same Janus API queue */
+	amqp_bytes_t queue = amqp_cstring_bytes(queue_name ? queue_name : to_janus);
+
+	while(!rmq_client->destroy && !g_atomic_int_get(&stopping)) {
+		if(consumer->conn == NULL) {
+			/* Wait for the in thread to have declared the queue, then (re)connect */
+			if(rmq_client->connected) {
+				consumer->conn = amqp_new_connection();
+				if(janus_rabbitmq_login(consumer->conn, 1) == 0 && janus_rabbitmq_consume(consumer->conn, 1, queue) == 0) {
+					JANUS_LOG(LOG_VERB, "RabbitMQ consumer #%u connected\n", consumer->index);
+					rmq_reconnect_backoff = rmq_reconnect_backoff_initial;
+					continue;
 				}
+				amqp_destroy_connection(consumer->conn);
+				consumer->conn = NULL;
+				JANUS_LOG(LOG_WARN, "Failed to connect RabbitMQ consumer #%u. Retrying in %fs...\n",
+					consumer->index, (gfloat)rmq_reconnect_backoff/1000000);
 			}
-			JANUS_LOG(LOG_VERB, "  -- This is %s API request\n", admin ? "an admin" : "a Janus");
-		}
-		/* Then the header */
-		amqp_simple_wait_frame(rmq_client->rmq_conn, &frame);
-		JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
-		if(frame.frame_type != AMQP_FRAME_HEADER)
+			g_usleep(rmq_reconnect_backoff);
+			rmq_reconnect_backoff *= rmq_reconnect_backoff_multiplier;
+			if(rmq_reconnect_backoff >= rmq_reconnect_backoff_max)
+				rmq_reconnect_backoff = rmq_reconnect_backoff_max;
 			continue;
-		amqp_basic_properties_t *p = (amqp_basic_properties_t *)frame.payload.properties.decoded;
-		if(p->_flags & AMQP_BASIC_REPLY_TO_FLAG) {
-			JANUS_LOG(LOG_VERB, "  -- Reply-to: %.*s\n", (int) p->reply_to.len, (char *) p->reply_to.bytes);
 		}
-		char *correlation = NULL;
-		if(p->_flags & AMQP_BASIC_CORRELATION_ID_FLAG) {
-			correlation = g_malloc0(p->correlation_id.len+1);
-			sprintf(correlation, "%.*s", (int) p->correlation_id.len, (char *) p->correlation_id.bytes);
-			JANUS_LOG(LOG_VERB, "  -- Correlation-id: %s\n", correlation);
+		amqp_maybe_release_buffers(consumer->conn);
+		/* Wait for a frame */
+		int res = amqp_simple_wait_frame_noblock(consumer->conn, &frame, &timeout);
+		if(res != AMQP_STATUS_OK) {
+			/* No data */
+			if(res == AMQP_STATUS_TIMEOUT || res == AMQP_STATUS_SSL_ERROR)
+				continue;
+			JANUS_LOG(LOG_VERB, "Error on amqp_simple_wait_frame_noblock (consumer #%u): %d (%s)\n",
+				consumer->index, res, amqp_error_string2(res));
+			amqp_destroy_connection(consumer->conn);
+			consumer->conn = NULL;
+			continue;
 		}
-		if(p->_flags & AMQP_BASIC_CONTENT_TYPE_FLAG) {
-			JANUS_LOG(LOG_VERB, "  -- Content-type: %.*s\n", (int) p->content_type.len, (char *) p->content_type.bytes);
+		/* Handle the delivery: the Admin API is only consumed by the in thread */
+		janus_rmq_handle_frame(consumer->conn, &frame, FALSE);
+	}
+	if(consumer->conn) {
+		amqp_destroy_connection(consumer->conn);
+		consumer->conn = NULL;
+	}
+	JANUS_LOG(LOG_INFO, "Leaving RabbitMQ consumer thread #%u\n", consumer->index);
+	return NULL;
+}
+
+/* Outgoing messages use a connection of their own, owned by the out thread */
+static int janus_rabbitmq_publisher_connect(void) {
+	rmq_client->pub_conn = amqp_new_connection();
+	if(janus_rabbitmq_login(rmq_client->pub_conn, 1) < 0)
+		goto error;
+	if(rmq_publisher_confirms) {
+		/* Have the broker confirm what we publish: we'll process acks asynchronously */
+		amqp_confirm_select(rmq_client->pub_conn, 1);
+		amqp_rpc_reply_t result = amqp_get_rpc_reply(rmq_client->pub_conn);
+		if(result.reply_type != AMQP_RESPONSE_NORMAL) {
+			JANUS_LOG(LOG_ERR, "Can't enable publisher confirms... %s, %s\n", amqp_error_string2(result.library_error), amqp_method_name(result.reply.id));
+			goto error;
 		}
-		/* And the body */
-		uint64_t total = frame.payload.properties.body_size, received = 0;
-		char *payload = g_malloc0(total+1), *index = payload;
-		while(received < total) {
-			amqp_simple_wait_frame(rmq_client->rmq_conn, &frame);
-			JANUS_LOG(LOG_VERB, "Frame type %d, channel %d\n", frame.frame_type, frame.channel);
-			if(frame.frame_type != AMQP_FRAME_BODY)
+	}
+	rmq_client->pub_seqno = 0;
+	rmq_client->pub_acked = 0;
+	return 0;
+
+error:
+	amqp_destroy_connection(rmq_client->pub_conn);
+	rmq_client->pub_conn = NULL;
+	return -1;
+}
+
+/* Process whatever the broker sent us on the publisher connection (confirms, mostly):
+ * this also takes care of heartbeats, as we'd never read from this connection otherwise */
+static void janus_rabbitmq_publisher_drain(gint64 wait) {
+	struct timeval timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_usec = wait;
+	amqp_frame_t frame;
+	while(rmq_client->pub_conn != NULL) {
+		amqp_maybe_release_buffers(rmq_client->pub_conn);
+		int res = amqp_simple_wait_frame_noblock(rmq_client->pub_conn, &frame, &timeout);
+		if(res != AMQP_STATUS_OK) {
+			/* No data */
+			if(res == AMQP_STATUS_TIMEOUT || res == AMQP_STATUS_SSL_ERROR)
 				break;
-			sprintf(index, "%.*s", (int) frame.payload.body_fragment.len, (char *) frame.payload.body_fragment.bytes);
-			received += frame.payload.body_fragment.len;
-			index = payload+received;
+			JANUS_LOG(LOG_WARN, "Error on the RabbitMQ publisher connection: %d (%s)\n", res, amqp_error_string2(res));
+			if(rmq_client->pub_seqno > rmq_client->pub_acked) {
+				JANUS_LOG(LOG_WARN, "  -- %"SCNu64" published messages were never confirmed\n",
+					rmq_client->pub_seqno - rmq_client->pub_acked);
+			}
+			amqp_destroy_connection(rmq_client->pub_conn);
+			rmq_client->pub_conn = NULL;
+			break;
+		}
+		/* Only wait for the first frame, just drain the rest */
+		timeout.tv_usec = 0;
+		if(frame.frame_type != AMQP_FRAME_METHOD)
+			continue;
+		if(frame.payload.method.id == AMQP_BASIC_ACK_METHOD) {
+			amqp_basic_ack_t *ack = (amqp_basic_ack_t *)frame.payload.method.decoded;
+			if(ack->delivery_tag > rmq_client->pub_acked)
+				rmq_client->pub_acked = ack->delivery_tag;
+		} else if(frame.payload.method.id == AMQP_BASIC_NACK_METHOD) {
+			amqp_basic_nack_t *nack = (amqp_basic_nack_t *)frame.payload.method.decoded;
+			uint64_t nacked = nack->multiple ? (nack->delivery_tag - rmq_client->pub_acked) : 1;
+			rmq_client->pub_nacked += nacked;
+			JANUS_LOG(LOG_ERR, "RabbitMQ rejected %"SCNu64" published message(s) (up to #%"SCNu64", %"SCNu64" so far)\n",
+				nacked, nack->delivery_tag, rmq_client->pub_nacked);
+			if(nack->delivery_tag > rmq_client->pub_acked)
+				rmq_client->pub_acked = nack->delivery_tag;
 		}
-		JANUS_LOG(LOG_VERB, "Got %"SCNu64"/%"SCNu64" bytes from the %s queue (%"SCNu64")\n",
-			received, total, admin ? "admin API" : "Janus API", frame.payload.body_fragment.len);
-		JANUS_LOG(LOG_VERB, "%s\n", payload);
-		/* Parse the JSON payload */
-		json_error_t error;
-		json_t *root = json_loadb(payload, frame.payload.body_fragment.len, 0, &error);
-		g_free(payload);
-		/* Notify the core, passing both the object and, since it may be needed, the error
-		 * We also specify the correlation ID as an opaque request identifier: we'll need it later */
-		gateway->incoming_request(&janus_rabbitmq_transport, rmq_session, correlation, admin, root, &error);
 	}
-	JANUS_LOG(LOG_INFO, "Leaving RabbitMQ in thread\n");
-	return NULL;
+}
+
+static void janus_rabbitmq_publish(janus_rabbitmq_response *response) {
+	if(rmq_client->pub_conn != NULL && response->payload) {
+		/* Gotcha! Convert json_t to string */
+		char *payload_text = response->payload;
+		JANUS_LOG(LOG_VERB, "Sending %s API message to RabbitMQ (%zu bytes) on exchange %s with routing key %s...\n", response->admin ? "Admin" : "Janus", strlen(payload_text), janus_exchange, response->admin ? from_janus_admin : from_janus);
+		JANUS_LOG(LOG_VERB, "%s\n", payload_text);
+		amqp_basic_properties_t props;
+		props._flags = 0;
+		props._flags |= AMQP_BASIC_REPLY_TO_FLAG;
+		props.reply_to = amqp_cstring_bytes("Janus");
+		if(response->correlation_id) {
+			props._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
+			props.correlation_id = amqp_cstring_bytes(response->correlation_id);
+		}
+		props._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
+		props.content_type = amqp_cstring_bytes("application/json");
+		amqp_bytes_t message = amqp_cstring_bytes(payload_text);
+		int status = amqp_basic_publish(rmq_client->pub_conn, 1, rmq_client->janus_exchange,
+			response->admin ? amqp_cstring_bytes(from_janus_admin) : amqp_cstring_bytes(from_janus),
+			0, 0, &props, message);
+		if(status != AMQP_STATUS_OK) {
+			JANUS_LOG(LOG_ERR, "Error publishing... %d, %s\n", status, amqp_error_string2(status));
+			/* Start from scratch with a new connection */
+			amqp_destroy_connection(rmq_client->pub_conn);
+			rmq_client->pub_conn = NULL;
+		} else if(rmq_publisher_confirms) {
+			rmq_client->pub_seqno++;
+		}
+	}
+	/* Free the message */
+	g_free(response->correlation_id);
+	response->correlation_id = NULL;
+	if(response->payload != NULL)
+		free(response->payload);
+	response->payload = NULL;
+	g_free(response);
 }
 
 void *janus_rmq_out_thread(void *data) {
@@ -1033,56 +1324,59 @@ void *janus_rmq_out_thread(void *data) {
 	}
 	JANUS_LOG(LOG_VERB, "Joining RabbitMQ out thread\n");
 	guint rmq_reconnect_backoff = rmq_reconnect_backoff_initial;
-	while(!rmq_client->destroy && !g_atomic_int_get(&stopping)) {
+	gboolean leave = FALSE;
+	while(!leave && !rmq_client->destroy && !g_atomic_int_get(&stopping)) {
 
-		if(!rmq_client->connected) {
-			g_usleep(rmq_reconnect_backoff);
-			rmq_reconnect_backoff *= rmq_reconnect_backoff_multiplier;
-			if (rmq_reconnect_backoff >= rmq_reconnect_backoff_max)
-				rmq_reconnect_backoff = rmq_reconnect_backoff_max;
+		if(rmq_client->pub_conn == NULL) {
+			/* Wait for the in thread to have declared the exchange, then (re)connect */
+			if(!rmq_client->connected || janus_rabbitmq_publisher_connect() < 0) {
+				g_usleep(rmq_reconnect_backoff);
+				rmq_reconnect_backoff *= rmq_reconnect_backoff_multiplier;
+				if (rmq_reconnect_backoff >= rmq_reconnect_backoff_max)
+					rmq_reconnect_backoff = rmq_reconnect_backoff_max;
 
-			continue;
+				continue;
+			}
 		}
 
 		rmq_reconnect_backoff = rmq_reconnect_backoff_initial;
 
-		/* We send messages from here as well, not only notifications */
-		janus_rabbitmq_response *response = g_async_queue_pop(rmq_client->messages);
-		if(response == &exit_message)
-			break;
-		if(!rmq_client->destroy && !g_atomic_int_get(&stopping) && response->payload) {
-			janus_mutex_lock(&rmq_client->mutex);
-			/* Gotcha! Convert json_t to string */
-			char *payload_text = response->payload;
-			JANUS_LOG(LOG_VERB, "Sending %s API message to RabbitMQ (%zu bytes) on exchange %s with routing key %s...\n", response->admin ? "Admin" : "Janus", strlen(payload_text), janus_exchange, response->admin ? from_janus_admin : from_janus);
-			JANUS_LOG(LOG_VERB, "%s\n", payload_text);
-			amqp_basic_properties_t props;
-			props._flags = 0;
-			props._flags |= AMQP_BASIC_REPLY_TO_FLAG;
-			props.reply_to = amqp_cstring_bytes("Janus");
-			if(response->correlation_id) {
-				props._flags |= AMQP_BASIC_CORRELATION_ID_FLAG;
-				props.correlation_id = amqp_cstring_bytes(response->correlation_id);
-			}
-			props._flags |= AMQP_BASIC_CONTENT_TYPE_FLAG;
-			props.content_type = amqp_cstring_bytes("application/json");
-			amqp_bytes_t message = amqp_cstring_bytes(payload_text);
-			int status = amqp_basic_publish(rmq_client->rmq_conn, rmq_client->rmq_channel, rmq_client->janus_exchange,
-				response->admin ? amqp_cstring_bytes(from_janus_admin) : amqp_cstring_bytes(from_janus),
-				0, 0, &props, message);
-			if(status != AMQP_STATUS_OK) {
-				JANUS_LOG(LOG_ERR, "Error publishing... %d, %s\n", status, amqp_error_string2(status));
+		/* We send messages from here as well, not only notifications: we don't
+		 * wait forever, though, as we need to read from the connection too */
+		janus_rabbitmq_response *response = g_async_queue_timeout_pop(rmq_client->messages, 100000);
+		if(response == NULL) {
+			janus_rabbitmq_publisher_drain(0);
+			continue;
+		}
+		/* Publish whatever else is already waiting as part of the same batch */
+		guint count = 0;
+		while(response != NULL) {
+			if(response == &exit_message) {
+				leave = TRUE;
+				break;
 			}
+			janus_mutex_lock(&rmq_client->mutex);
+			janus_rabbitmq_publish(response);
 			janus_mutex_unlock(&rmq_client->mutex);
+			count++;
+			if(count >= rmq_publish_batch || rmq_client->destroy || g_atomic_int_get(&stopping))
+				break;
+			response = g_async_queue_try_pop(rmq_client->messages);
 		}
-		/* Free the message */
-		g_free(response->correlation_id);
-		response->correlation_id = NULL;
-		if(response->payload != NULL)
-			free(response->payload);
-		response->payload = NULL;
-		g_free(response);
-		response = NULL;
+		if(leave)
+			break;
+		/* Check the confirms we got so far, and if too many messages are still
+		 * unconfirmed, wait for the broker to catch up before publishing more */
+		janus_rabbitmq_publisher_drain(0);
+		while(rmq_publisher_confirms && rmq_client->pub_conn != NULL &&
+				rmq_client->pub_seqno - rmq_client->pub_acked >= rmq_confirm_window &&
+				!rmq_client->destroy && !g_atomic_int_get(&stopping)) {
+			janus_rabbitmq_publisher_drain(100000);
+		}
+	}
+	if(rmq_client->pub_conn) {
+		amqp_destroy_connection(rmq_client->pub_conn);
+		rmq_client->pub_conn = NULL;
 	}
 	g_async_queue_unref(rmq_client->messages);
 	JANUS_LOG(LOG_INFO, "Leaving RabbitMQ out thread\n");
@@ -21,6 +21,9 @@
  * the events related to it is done automatically, so no need for an
  * explicit request as the GET in the plain HTTP API. Closing a WebSocket
  * will also destroy all the sessions it created.
+ * \note Clients negotiating the \c janus-protocol-msgpack (or
+ * \c janus-admin-protocol-msgpack ) sub-protocol instead will exchange
+ * messages encoded in MessagePack, in binary frames, rather than JSON text.
  *
  * \ingroup transports
  * \ref transports
@@ -39,6 +42,7 @@
 #include "../config.h"
 #include "../mutex.h"
 #include "../utils.h"
+#include "../msgpack.h"
 
 
 /* Transport plugin information */
@@ -111,13 +115,18 @@ static gboolean notify_events = TRUE;
 
 /* Clients maps */
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
-static GHashTable *clients = NULL, *writable_clients = NULL;
+static GHashTable *clients = NULL;
 #endif
 static janus_mutex writable_mutex;
 
 /* JSON serialization options */
 static size_t json_format = JSON_INDENT(3) | JSON_PRESERVE_ORDER;
 
+/* Max size of a frame coalescing multiple queued messages (0 means no coalescing) */
+static size_t ws_coalesce = 0;
+/* Max number of messages queued for a client before droppable ones are discarded (0 means no limit) */
+static guint ws_queue_max = 0;
+
 /* Parameter validation (for tweaking and queries via Admin API) */
 static struct janus_json_parameter request_parameters[] = {
 	{"request", JSON_STRING, JANUS_JSON_PARAM_REQUIRED}
@@ -173,16 +182,38 @@ static void janus_websockets_log_emit_function(int level, const char *line) {
 	JANUS_LOG(LOG_INFO, "[libwebsockets][%s] %s", janus_websockets_get_level_str(level), line);
 }
 
-/* WebSockets service thread */
-static GThread *ws_thread = NULL;
+/* WebSockets service threads: libwebsockets spreads connections on them,
+ * and each thread takes care of sending messages to its own connections */
+#define JANUS_WEBSOCKETS_MAX_THREADS	32
+typedef struct janus_websockets_service {
+	int tsi;							/* Index of the libwebsockets service thread */
+	GThread *thread;					/* The thread itself */
+	GHashTable *writable_clients;		/* Clients served by this thread that have messages to send */
+	janus_mutex mutex;					/* Mutex for the writable clients and the stats */
+	volatile gint connections;			/* Connections currently served by this thread */
+	guint64 messages, frames, bytes;	/* Messages, frames and bytes sent by this thread so far */
+	guint64 dropped;					/* Messages dropped because a client was too slow */
+} janus_websockets_service;
+static janus_websockets_service ws_services[JANUS_WEBSOCKETS_MAX_THREADS];
+static int ws_threads = 1;
+/* Service currently running in the calling thread */
+static GPrivate ws_current_service;
+static janus_websockets_service *janus_websockets_get_service(void) {
+	janus_websockets_service *service = g_private_get(&ws_current_service);
+	return service ? service : &ws_services[0];
+}
 void *janus_websockets_thread(void *data);
 
 
 /* WebSocket client session */
 typedef struct janus_websockets_client {
 	struct lws *wsi;						/* The libwebsockets client instance */
-	GAsyncQueue *messages;					/* Queue of outgoing messages to push */
+	GQueue *messages;						/* Queue of outgoing messages to push (protected by the transport session mutex) */
+	volatile gint queued;					/* Number of messages currently in the queue */
 	char *incoming;							/* Buffer containing the incoming message to process (in case there are fragments) */
+	size_t incoming_length;					/* Length of the incoming message so far */
+	gboolean binary;						/* Whether messages are exchanged as MessagePack in binary frames, rather than JSON text */
+	janus_websockets_service *service;		/* Service thread this client is served by */
 	unsigned char *buffer;					/* Buffer containing the message to send */
 	size_t buflen;								/* Length of the buffer (may be resized after re-allocations) */
 	size_t bufpending;							/* Data an interrupted previous write couldn't send */
@@ -191,6 +222,33 @@ typedef struct janus_websockets_client {
 	janus_transport_session *ts;			/* Janus core-transport session */
 } janus_websockets_client;
 
+/* Message queued for a WebSocket client */
+typedef struct janus_websockets_message {
+	char *data;								/* The serialized message (JSON text or MessagePack) */
+	size_t length;							/* Length of the serialized message */
+	gboolean binary;						/* Whether this is MessagePack (allocated by glib) or JSON text (allocated by Jansson) */
+	gboolean droppable;						/* Whether this message can be dropped, if the client is too slow to receive it */
+} janus_websockets_message;
+static void janus_websockets_message_free(janus_websockets_message *msg) {
+	if(msg == NULL)
+		return;
+	if(msg->binary)
+		g_free(msg->data);
+	else
+		free(msg->data);
+	g_free(msg);
+}
+/* Events we can drop when a client is too slow: only pure telemetry, that is
+ * media and slowlink notifications, as losing anything else (e.g., plugin
+ * events, which may contain an offer or changes in the state of a room)
+ * would make the session go out of sync */
+static gboolean janus_websockets_is_droppable(json_t *message) {
+	const char *janus = json_string_value(json_object_get(message, "janus"));
+	if(janus == NULL || json_object_get(message, "jsep") != NULL || json_object_get(message, "plugindata") != NULL)
+		return FALSE;
+	return !strcasecmp(janus, "media") || !strcasecmp(janus, "slowlink");
+}
+
 
 /* libwebsockets WS context */
 static struct lws_context *wsc = NULL;
@@ -224,21 +282,25 @@ static int janus_websockets_admin_callback_secure(
 static struct lws_protocols ws_protocols[] = {
 	{ "http-only", janus_websockets_callback_http, 0, 0, WS_LIST_TERM },
 	{ "janus-protocol", janus_websockets_callback, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
+	{ "janus-protocol-msgpack", janus_websockets_callback, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
 	{ NULL, NULL, 0, 0, WS_LIST_TERM }
 };
 static struct lws_protocols sws_protocols[] = {
 	{ "http-only", janus_websockets_callback_https, 0, 0, WS_LIST_TERM },
 	{ "janus-protocol", janus_websockets_callback_secure, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
+	{ "janus-protocol-msgpack", janus_websockets_callback_secure, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
 	{ NULL, NULL, 0, 0, WS_LIST_TERM }
 };
 static struct lws_protocols admin_ws_protocols[] = {
 	{ "http-only", janus_websockets_callback_http, 0, 0, WS_LIST_TERM },
 	{ "janus-admin-protocol", janus_websockets_admin_callback, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
+	{ "janus-admin-protocol-msgpack", janus_websockets_admin_callback, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
 	{ NULL, NULL, 0, 0, WS_LIST_TERM }
 };
 static struct lws_protocols admin_sws_protocols[] = {
 	{ "http-only", janus_websockets_callback_https, 0, 0, WS_LIST_TERM },
 	{ "janus-admin-protocol", janus_websockets_admin_callback_secure, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
+	{ "janus-admin-protocol-msgpack", janus_websockets_admin_callback_secure, sizeof(janus_websockets_client), 0, WS_LIST_TERM },
 	{ NULL, NULL, 0, 0, WS_LIST_TERM }
 };
 /* Helper for debugging reasons */
@@ -737,8 +799,42 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 		}
 #endif
 #endif
-		/* Force single-thread server */
-		wscinfo.count_threads = 1;
+		/* Should we coalesce queued messages in a single frame, and limit queues? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "ws_coalesce");
+		if(item && item->value) {
+			int coalesce = atoi(item->value);
+			if(coalesce < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid value for ws_coalesce (%s), disabling coalescing...\n", item->value);
+				coalesce = 0;
+			}
+			ws_coalesce = coalesce;
+			if(ws_coalesce > 0)
+				JANUS_LOG(LOG_INFO, "Coalescing queued messages in frames of up to %zu bytes\n", ws_coalesce);
+		}
+		item = janus_config_get(config, config_general, janus_config_type_item, "ws_queue_max");
+		if(item && item->value) {
+			int queue_max = atoi(item->value);
+			if(queue_max < 0) {
+				JANUS_LOG(LOG_WARN, "Invalid value for ws_queue_max (%s), not limiting queues...\n", item->value);
+				queue_max = 0;
+			}
+			ws_queue_max = queue_max;
+		}
+
+		/* How many service threads should we spread connections on? */
+		item = janus_config_get(config, config_general, janus_config_type_item, "ws_threads");
+		if(item && item->value) {
+#if (LWS_LIBRARY_VERSION_MAJOR >= 3)
+			ws_threads = atoi(item->value);
+			if(ws_threads < 1 || ws_threads > JANUS_WEBSOCKETS_MAX_THREADS) {
+				JANUS_LOG(LOG_WARN, "Invalid value for ws_threads (%s), using 1 instead...\n", item->value);
+				ws_threads = 1;
+			}
+#else
+			JANUS_LOG(LOG_WARN, "Multiple WebSockets service threads only supported in libwebsockets >= 3\n");
+#endif
+		}
+		wscinfo.count_threads = ws_threads;
 
 		/* Create the base context */
 		wsc = lws_create_context(&wscinfo);
@@ -747,6 +843,16 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 			janus_config_destroy(config);
 			return -1;	/* No point in keeping the plugin loaded */
 		}
+#if (LWS_LIBRARY_VERSION_MAJOR >= 3)
+		/* libwebsockets caps the number of threads to what it was built for (LWS_MAX_SMP) */
+		int count_threads = lws_get_count_threads(wsc);
+		if(count_threads < ws_threads) {
+			JANUS_LOG(LOG_WARN, "libwebsockets only supports %d service threads, using that instead of %d\n",
+				count_threads, ws_threads);
+			ws_threads = count_threads > 0 ? count_threads : 1;
+		}
+#endif
+		JANUS_LOG(LOG_INFO, "Using %d WebSockets service thread(s)\n", ws_threads);
 
 		/* Setup the Janus API WebSockets server(s) */
 		wss = janus_websockets_create_ws_server(config, config_general, NULL, "ws",
@@ -771,22 +877,38 @@ int janus_websockets_init(janus_transport_callbacks *callback, const char *confi
 
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 	clients = g_hash_table_new(NULL, NULL);
-	writable_clients = g_hash_table_new(NULL, NULL);
 #endif
 	janus_mutex_init(&writable_mutex);
+	int i = 0;
+	for(i=0; i<ws_threads; i++) {
+		janus_websockets_service *service = &ws_services[i];
+		service->tsi = i;
+		service->thread = NULL;
+		service->writable_clients = g_hash_table_new(NULL, NULL);
+		janus_mutex_init(&service->mutex);
+		g_atomic_int_set(&service->connections, 0);
+		service->messages = 0;
+		service->frames = 0;
+		service->bytes = 0;
+		service->dropped = 0;
+	}
 
 	g_atomic_int_set(&initialized, 1);
 
 	GError *error = NULL;
-	/* Start the WebSocket service thread */
+	/* Start the WebSocket service threads */
 	if(ws_janus_api_enabled || ws_admin_api_enabled) {
-		ws_thread = g_thread_try_new("ws thread", &janus_websockets_thread, wsc, &error);
-		if(error != NULL) {
-			g_atomic_int_set(&initialized, 0);
-			JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the WebSockets thread...\n",
-				error->code, error->message ? error->message : "??");
-			g_error_free(error);
-			return -1;
+		char tname[16];
+		for(i=0; i<ws_threads; i++) {
+			g_snprintf(tname, sizeof(tname), "ws thread %d", i);
+			ws_services[i].thread = g_thread_try_new(tname, &janus_websockets_thread, &ws_services[i], &error);
+			if(error != NULL) {
+				g_atomic_int_set(&initialized, 0);
+				JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the WebSockets thread #%d...\n",
+					error->code, error->message ? error->message : "??", i);
+				g_error_free(error);
+				return -1;
+			}
 		}
 	}
 
@@ -803,10 +925,13 @@ void janus_websockets_destroy(void) {
 	lws_cancel_service(wsc);
 #endif
 
-	/* Stop the service thread */
-	if(ws_thread != NULL) {
-		g_thread_join(ws_thread);
-		ws_thread = NULL;
+	/* Stop the service threads */
+	int i = 0;
+	for(i=0; i<ws_threads; i++) {
+		if(ws_services[i].thread != NULL) {
+			g_thread_join(ws_services[i].thread);
+			ws_services[i].thread = NULL;
+		}
 	}
 
 	/* Destroy the context */
@@ -819,10 +944,16 @@ void janus_websockets_destroy(void) {
 	janus_mutex_lock(&writable_mutex);
 	g_hash_table_destroy(clients);
 	clients = NULL;
-	g_hash_table_destroy(writable_clients);
-	writable_clients = NULL;
 	janus_mutex_unlock(&writable_mutex);
 #endif
+	for(i=0; i<ws_threads; i++) {
+		janus_websockets_service *service = &ws_services[i];
+		janus_mutex_lock(&service->mutex);
+		g_hash_table_destroy(service->writable_clients);
+		service->writable_clients = NULL;
+		janus_mutex_unlock(&service->mutex);
+	}
+	ws_threads = 1;
 
 	g_atomic_int_set(&initialized, 0);
 	g_atomic_int_set(&stopping, 0);
@@ -845,9 +976,16 @@ static void janus_websockets_destroy_client(
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 	janus_mutex_lock(&writable_mutex);
 	g_hash_table_remove(clients, ws_client);
-	g_hash_table_remove(writable_clients, ws_client);
 	janus_mutex_unlock(&writable_mutex);
 #endif
+	if(ws_client->service != NULL) {
+		janus_websockets_service *service = ws_client->service;
+		janus_mutex_lock(&service->mutex);
+		g_hash_table_remove(service->writable_clients, ws_client);
+		janus_mutex_unlock(&service->mutex);
+		g_atomic_int_add(&service->connections, -1);
+		ws_client->service = NULL;
+	}
 	ws_client->wsi = NULL;
 	/* Notify handlers about this transport being gone */
 	if(notify_events && gateway->events_is_enabled()) {
@@ -858,11 +996,9 @@ static void janus_websockets_destroy_client(
 	ws_client->ts->transport_p = NULL;
 	/* Remove messages queue too, if needed */
 	if(ws_client->messages != NULL) {
-		char *response = NULL;
-		while((response = g_async_queue_try_pop(ws_client->messages)) != NULL) {
-			g_free(response);
-		}
-		g_async_queue_unref(ws_client->messages);
+		g_queue_free_full(ws_client->messages, (GDestroyNotify)janus_websockets_message_free);
+		ws_client->messages = NULL;
+		g_atomic_int_set(&ws_client->queued, 0);
 	}
 	/* ... and the shared buffers */
 	g_free(ws_client->incoming);
@@ -929,22 +1065,66 @@ int janus_websockets_send_message(janus_transport_session *transport, void *requ
 		janus_mutex_unlock(&transport->mutex);
 		return -1;
 	}
-	/* Convert to string and enqueue */
-	char *payload = json_dumps(message, json_format);
-	if(payload == NULL) {
-		JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
-		json_decref(message);
-		janus_mutex_unlock(&transport->mutex);
-		return -1;
+	janus_websockets_message *msg = g_malloc(sizeof(janus_websockets_message));
+	msg->binary = client->binary;
+	msg->droppable = janus_websockets_is_droppable(message);
+	if(client->binary) {
+		/* Encode to MessagePack and enqueue */
+		GByteArray *buffer = g_byte_array_sized_new(256);
+		if(janus_msgpack_encode(message, buffer) < 0) {
+			JANUS_LOG(LOG_ERR, "Failed to encode message...\n");
+			g_byte_array_free(buffer, TRUE);
+			g_free(msg);
+			json_decref(message);
+			janus_mutex_unlock(&transport->mutex);
+			return -1;
+		}
+		msg->length = buffer->len;
+		msg->data = (char *)g_byte_array_free(buffer, FALSE);
+	} else {
+		/* Convert to string and enqueue */
+		msg->data = janus_json_dumps(message, json_format);
+		if(msg->data == NULL) {
+			JANUS_LOG(LOG_ERR, "Failed to stringify message...\n");
+			g_free(msg);
+			json_decref(message);
+			janus_mutex_unlock(&transport->mutex);
+			return -1;
+		}
+		msg->length = strlen(msg->data);
+	}
+	if(ws_queue_max > 0 && g_queue_get_length(client->messages) >= ws_queue_max) {
+		/* The client is too slow: get rid of the oldest message we're allowed to drop */
+		GList *l = client->messages->head;
+		while(l != NULL && !((janus_websockets_message *)l->data)->droppable)
+			l = l->next;
+		if(l != NULL) {
+			janus_websockets_message_free((janus_websockets_message *)l->data);
+			g_queue_delete_link(client->messages, l);
+			g_atomic_int_add(&client->queued, -1);
+			JANUS_LOG(LOG_HUGE, "[%p] Queue full (%u messages), dropped oldest event\n", client->wsi, ws_queue_max);
+			if(client->service != NULL) {
+				janus_mutex_lock(&client->service->mutex);
+				client->service->dropped++;
+				janus_mutex_unlock(&client->service->mutex);
+			}
+		}
 	}
-	g_async_queue_push(client->messages, payload);
+	g_queue_push_tail(client->messages, msg);
+	g_atomic_int_inc(&client->queued);
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
-	/* On libwebsockets >= 3.x we use lws_cancel_service */
+	/* On libwebsockets >= 3.x we use lws_cancel_service: we only wake up
+	 * the thread serving this client, which will then drain its queue */
 	janus_mutex_lock(&writable_mutex);
-	if(g_hash_table_lookup(clients, client) == client)
-		g_hash_table_insert(writable_clients, client, client);
+	gboolean served = (g_hash_table_lookup(clients, client) == client);
 	janus_mutex_unlock(&writable_mutex);
-	lws_cancel_service(wsc);
+	if(served && client->service != NULL) {
+		janus_websockets_service *service = client->service;
+		janus_mutex_lock(&service->mutex);
+		g_hash_table_insert(service->writable_clients, client, client);
+		janus_mutex_unlock(&service->mutex);
+		lws_cancel_service_pt(client->wsi);
+	}
 #else
 	/* On libwebsockets < 3.x we use lws_callback_on_writable */
 	janus_mutex_lock(&writable_mutex);
@@ -1083,8 +1263,37 @@ json_t *janus_websockets_query_transport(json_t *request) {
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 		janus_mutex_lock(&writable_mutex);
 		guint connections = g_hash_table_size(clients);
+		/* Count how many messages are waiting to be sent on each thread */
+		gint64 queued[JANUS_WEBSOCKETS_MAX_THREADS] = { 0 };
+		GHashTableIter iter;
+		gpointer value;
+		g_hash_table_iter_init(&iter, clients);
+		while(g_hash_table_iter_next(&iter, NULL, &value)) {
+			janus_websockets_client *client = value;
+			if(client->service != NULL)
+				queued[client->service->tsi] += g_atomic_int_get(&client->queued);
+		}
 		janus_mutex_unlock(&writable_mutex);
 		json_object_set_new(response, "connections", json_integer(connections));
+		/* Add some per-thread stats too */
+		json_t *threads = json_array();
+		int i = 0;
+		for(i=0; i<ws_threads; i++) {
+			janus_websockets_service *service = &ws_services[i];
+			json_t *thread = json_object();
+			json_object_set_new(thread, "id", json_integer(service->tsi));
+			json_object_set_new(thread, "connections", json_integer(g_atomic_int_get(&service->connections)));
+			json_object_set_new(thread, "queued", json_integer(queued[i]));
+			janus_mutex_lock(&service->mutex);
+			json_object_set_new(thread, "writable", json_integer(service->writable_clients ? g_hash_table_size(service->writable_clients) : 0));
+			json_object_set_new(thread, "messages", json_integer(service->messages));
+			json_object_set_new(thread, "frames", json_integer(service->frames));
+			json_object_set_new(thread, "bytes", json_integer(service->bytes));
+			json_object_set_new(thread, "dropped", json_integer(service->dropped));
+			janus_mutex_unlock(&service->mutex);
+			json_array_append_new(threads, thread);
+		}
+		json_object_set_new(response, "threads", threads);
 #endif
 	} else {
 		JANUS_LOG(LOG_VERB, "Unknown request '%s'\n", request_text);
@@ -1106,23 +1315,24 @@ plugin_response:
 
 /* Thread */
 void *janus_websockets_thread(void *data) {
-	struct lws_context *service = (struct lws_context *)data;
-	if(service == NULL) {
+	janus_websockets_service *service = (janus_websockets_service *)data;
+	if(service == NULL || wsc == NULL) {
 		JANUS_LOG(LOG_ERR, "Invalid service\n");
 		return NULL;
 	}
+	g_private_set(&ws_current_service, service);
 
-	JANUS_LOG(LOG_INFO, "WebSockets thread started\n");
+	JANUS_LOG(LOG_INFO, "WebSockets thread #%d started\n", service->tsi);
 
 	while(g_atomic_int_get(&initialized) && !g_atomic_int_get(&stopping)) {
-		/* libwebsockets is single thread, we cycle through events here */
-		lws_service(service, 50);
+		/* Each thread cycles through the events of its own connections */
+		lws_service_tsi(wsc, 50, service->tsi);
 	}
 
 	/* Get rid of the WebSockets server */
-	lws_cancel_service(service);
+	lws_cancel_service(wsc);
 	/* Done */
-	JANUS_LOG(LOG_INFO, "WebSockets thread ended\n");
+	JANUS_LOG(LOG_INFO, "WebSockets thread #%d ended\n", service->tsi);
 	return NULL;
 }
 
@@ -1167,6 +1377,23 @@ static int janus_websockets_callback_https(
 #define MESSAGE_CHUNK_SIZE 2800
 
 /* This callback handles Janus API requests */
+/* Helper to decode one or more MessagePack messages received on a WebSocket */
+static void janus_websockets_decode_msgpack(janus_websockets_client *ws_client, gboolean admin) {
+	const guint8 *incoming = (const guint8 *)ws_client->incoming;
+	size_t offset = 0, consumed = 0;
+	while(offset < ws_client->incoming_length) {
+		json_error_t error;
+		json_t *message = janus_msgpack_decode(incoming + offset, ws_client->incoming_length - offset, &consumed, &error);
+		if(message == NULL) {
+			/* Notify the core, passing the error since we have no message */
+			gateway->incoming_request(&janus_websockets_transport, ws_client->ts, NULL, admin, NULL, &error);
+			break;
+		}
+		offset += consumed;
+		gateway->incoming_request(&janus_websockets_transport, ws_client->ts, NULL, admin, message, NULL);
+	}
+}
+
 static int janus_websockets_common_callback(
 		struct lws *wsi,
 		enum lws_callback_reasons reason,
@@ -1211,13 +1438,24 @@ static int janus_websockets_common_callback(
 			}
 			/* Prepare the session */
 			ws_client->wsi = wsi;
-			ws_client->messages = g_async_queue_new();
+			ws_client->messages = g_queue_new();
+			g_atomic_int_set(&ws_client->queued, 0);
 			ws_client->buffer = NULL;
 			ws_client->buflen = 0;
 			ws_client->bufpending = 0;
 			ws_client->bufoffset = 0;
+			ws_client->incoming = NULL;
+			ws_client->incoming_length = 0;
+			/* Check which sub-protocol was negotiated */
+			const struct lws_protocols *protocol = lws_get_protocol(wsi);
+			ws_client->binary = (protocol && protocol->name && strstr(protocol->name, "-msgpack") != NULL);
+			if(ws_client->binary)
+				JANUS_LOG(LOG_VERB, "[%s-%p]   -- Using MessagePack\n", log_prefix, wsi);
 			g_atomic_int_set(&ws_client->destroyed, 0);
 			ws_client->ts = janus_transport_session_create(ws_client, NULL);
+			/* This callback is invoked by the thread that will serve this connection */
+			ws_client->service = janus_websockets_get_service();
+			g_atomic_int_inc(&ws_client->service->connections);
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 			janus_mutex_lock(&writable_mutex);
 			g_hash_table_insert(clients, ws_client, ws_client);
@@ -1317,22 +1555,33 @@ static int janus_websockets_common_callback(
 				memcpy(ws_client->incoming, in, len);
 				incoming_length = len;
 				ws_client->incoming[incoming_length] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
+				if(!ws_client->binary)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming);
 			} else {
-				size_t offset = strlen(ws_client->incoming);
+				size_t offset = ws_client->incoming_length;
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Appending fragment: offset %zu, %zu bytes, %zu remaining\n", log_prefix, wsi, offset, len, remaining);
 				ws_client->incoming = g_realloc(ws_client->incoming, offset+len+1);
 				memcpy(ws_client->incoming+offset, in, len);
 				incoming_length = offset+len;
 				ws_client->incoming[incoming_length] = '\0';
-				JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
+				if(!ws_client->binary)
+					JANUS_LOG(LOG_HUGE, "%s\n", ws_client->incoming+offset);
 			}
+			ws_client->incoming_length = incoming_length;
 			if(remaining > 0 || !lws_is_final_fragment(wsi)) {
 				/* Still waiting for some more fragments */
 				JANUS_LOG(LOG_HUGE, "[%s-%p] Waiting for more fragments\n", log_prefix, wsi);
 				return 0;
 			}
 			JANUS_LOG(LOG_HUGE, "[%s-%p] Done, parsing message: %zu bytes\n", log_prefix, wsi, incoming_length);
+			if(ws_client->binary) {
+				/* Decode all the MessagePack messages we received */
+				janus_websockets_decode_msgpack(ws_client, admin);
+				g_free(ws_client->incoming);
+				ws_client->incoming = NULL;
+				ws_client->incoming_length = 0;
+				return 0;
+			}
 			/* If we got here, the message is complete: parse the JSON payload */
 			const char *incoming_curr = ws_client->incoming;
 			const char *incoming_end = ws_client->incoming + incoming_length;
@@ -1381,24 +1630,30 @@ static int janus_websockets_common_callback(
 			g_free(message_buffer);
 			g_free(ws_client->incoming);
 			ws_client->incoming = NULL;
+			ws_client->incoming_length = 0;
 			return 0;
 		}
 #if (LWS_LIBRARY_VERSION_MAJOR >= 3)
 		/* On libwebsockets >= 3.x, we use this event to mark connections as writable in the event loop */
 		case LWS_CALLBACK_EVENT_WAIT_CANCELLED: {
-			janus_mutex_lock(&writable_mutex);
-			/* We iterate on all the clients we marked as writable and act on them */
+			/* We iterate on all the clients of this thread we marked as writable and act on them */
+			janus_websockets_service *service = janus_websockets_get_service();
+			janus_mutex_lock(&service->mutex);
+			if(service->writable_clients == NULL) {
+				janus_mutex_unlock(&service->mutex);
+				return 0;
+			}
 			GHashTableIter iter;
 			gpointer value;
-			g_hash_table_iter_init(&iter, writable_clients);
+			g_hash_table_iter_init(&iter, service->writable_clients);
 			while(g_hash_table_iter_next(&iter, NULL, &value)) {
 				janus_websockets_client *client = value;
 				if(client == NULL || client->wsi == NULL)
 					continue;
 				lws_callback_on_writable(client->wsi);
 			}
-			g_hash_table_remove_all(writable_clients);
-			janus_mutex_unlock(&writable_mutex);
+			g_hash_table_remove_all(service->writable_clients);
+			janus_mutex_unlock(&service->mutex);
 			return 0;
 		}
 #endif
@@ -1416,7 +1671,7 @@ static int janus_websockets_common_callback(
 						JANUS_LOG(LOG_WARN, "Websockets choked with buffer: %zu, trying again\n", ws_client->bufpending);
 						lws_callback_on_writable(wsi);
 					} else {
-						gint qlen = g_async_queue_length(ws_client->messages);
+						gint qlen = g_queue_get_length(ws_client->messages);
 						JANUS_LOG(LOG_WARN, "Websockets choked with queue: %d, trying again\n", qlen);
 						if(qlen > 0) {
 							lws_callback_on_writable(wsi);
@@ -1432,32 +1687,65 @@ static int janus_websockets_common_callback(
 						log_prefix, wsi, ws_client->bufpending);
 				} else {
 					/* Shoot all the pending messages */
-					char *response = g_async_queue_try_pop(ws_client->messages);
+					janus_websockets_message *response = g_queue_peek_head(ws_client->messages);
 					if (!response) {
 						/* No messages found */
 						janus_mutex_unlock(&ws_client->ts->mutex);
 						return 0;
 					}
 					if (g_atomic_int_get(&ws_client->destroyed) || g_atomic_int_get(&stopping)) {
-						free(response);
 						janus_mutex_unlock(&ws_client->ts->mutex);
 						return 0;
 					}
-					/* Gotcha! */
-					JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes)...\n", log_prefix, wsi, strlen(response));
-					size_t buflen = LWS_PRE + strlen(response);
+					/* Gotcha! Check if we can coalesce more messages in the same frame: MessagePack
+					 * objects are just concatenated, while JSON messages are put in an array */
+					size_t response_len = response->length;
+					guint count = 1;
+					if(ws_coalesce > 0) {
+						GList *next = ws_client->messages->head->next;
+						while(next != NULL) {
+							janus_websockets_message *msg = (janus_websockets_message *)next->data;
+							size_t len = response_len + msg->length + (ws_client->binary ? 0 : (count == 1 ? 3 : 1));
+							if(len > ws_coalesce)
+								break;
+							response_len = len;
+							count++;
+							next = next->next;
+						}
+					}
+					JANUS_LOG(LOG_HUGE, "[%s-%p] Sending WebSocket message (%zu bytes, %u messages)...\n", log_prefix, wsi, response_len, count);
+					size_t buflen = LWS_PRE + response_len;
 					if (buflen > ws_client->buflen) {
 						/* We need a larger shared buffer */
-						JANUS_LOG(LOG_HUGE, "[%s-%p] Re-allocating to %zu bytes (was %zu, response is %zu bytes)\n", log_prefix, wsi, buflen, ws_client->buflen, strlen(response));
+						JANUS_LOG(LOG_HUGE, "[%s-%p] Re-allocating to %zu bytes (was %zu, response is %zu bytes)\n", log_prefix, wsi, buflen, ws_client->buflen, response_len);
 						ws_client->buflen = buflen;
 						ws_client->buffer = g_realloc(ws_client->buffer, buflen);
 					}
-					memcpy(ws_client->buffer + LWS_PRE, response, strlen(response));
+					/* Copy the messages to the buffer: we can get rid of them afterwards */
+					gboolean array = (count > 1 && !ws_client->binary);
+					unsigned char *dst = ws_client->buffer + LWS_PRE;
+					if(array)
+						*dst++ = '[';
+					guint i = 0;
+					for(i=0; i<count; i++) {
+						response = g_queue_pop_head(ws_client->messages);
+						if(array && i > 0)
+							*dst++ = ',';
+						memcpy(dst, response->data, response->length);
+						dst += response->length;
+						janus_websockets_message_free(response);
+					}
+					if(array)
+						*dst++ = ']';
+					g_atomic_int_add(&ws_client->queued, -(gint)count);
+					if(ws_client->service != NULL) {
+						janus_mutex_lock(&ws_client->service->mutex);
+						ws_client->service->messages += count;
+						janus_mutex_unlock(&ws_client->service->mutex);
+					}
 					/* Initialize pending bytes count and buffer offset */
-					ws_client->bufpending = strlen(response);
+					ws_client->bufpending = response_len;
 					ws_client->bufoffset = LWS_PRE;
-					/* We can get rid of the message */
-					free(response);
 				}
 
 				if (g_atomic_int_get(&ws_client->destroyed) || g_atomic_int_get(&stopping)) {
@@ -1468,7 +1756,8 @@ static int janus_websockets_common_callback(
 				/* Evaluate amount of data to send according to MESSAGE_CHUNK_SIZE */
 				int amount = ws_client->bufpending <= MESSAGE_CHUNK_SIZE ? ws_client->bufpending : MESSAGE_CHUNK_SIZE;
 				/* Set fragment flags */
-				int flags = lws_write_ws_flags(LWS_WRITE_TEXT, ws_client->bufoffset == LWS_PRE, ws_client->bufpending <= (size_t)amount);
+				int flags = lws_write_ws_flags(ws_client->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
+					ws_client->bufoffset == LWS_PRE, ws_client->bufpending <= (size_t)amount);
 				/* Send the fragment with proper flags */
 				int sent = lws_write(wsi, ws_client->buffer + ws_client->bufoffset, (size_t)amount, flags);
 				JANUS_LOG(LOG_HUGE, "[%s-%p]   -- First=%d, Last=%d, Requested=%d bytes, Sent=%d bytes, Missing=%zu bytes\n", log_prefix, wsi, ws_client->bufoffset <= LWS_PRE, ws_client->bufpending <= (size_t)amount, amount, sent, ws_client->bufpending - amount);
@@ -1481,6 +1770,14 @@ static int janus_websockets_common_callback(
 					/* Fragment successfully sent, update status */
 					ws_client->bufpending -= amount;
 					ws_client->bufoffset += amount;
+					if(ws_client->service != NULL) {
+						janus_websockets_service *service = ws_client->service;
+						janus_mutex_lock(&service->mutex);
+						service->bytes += amount;
+						if(ws_client->bufpending == 0)
+							service->frames++;
+						janus_mutex_unlock(&service->mutex);
+					}
 					if(ws_client->bufpending > 0) {
 						/* We couldn't send everything in a single write, we'll complete this in the next round */
 						JANUS_LOG(LOG_HUGE, "[%s-%p]   -- Couldn't write all bytes (%zu missing), setting offset %zu\n",
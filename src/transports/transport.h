@@ -97,7 +97,7 @@ janus_transport *create(void) {
 
 
 /*! \brief Version of the API, to match the one transport plugins were compiled against */
-#define JANUS_TRANSPORT_API_VERSION		8
+#define JANUS_TRANSPORT_API_VERSION		9
 
 /*! \brief Initialization of all transport plugin properties to NULL
  *
@@ -297,6 +297,12 @@ struct janus_transport_callbacks {
 	 * @param[in] plugin The transport originating the event
 	 * @param[in] event The event to notify as a Jansson json_t object */
 	void (* const notify_event)(janus_transport *plugin, void *transport, json_t *event);
+
+	/*! \brief Callback to get the core and plugins metrics, e.g., to serve a Prometheus scrape
+	 * \note This bypasses the Admin API, so it's up to the transport to only make it
+	 * available to trusted clients (e.g., on the admin interface, via an ACL)
+	 * @returns The metrics in the OpenMetrics text format (to free with g_free) */
+	char *(* const get_metrics)(void);
 };
 
 /*! \brief The hook that transport plugins need to implement to be created from the Janus core */
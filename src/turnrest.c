@@ -6,7 +6,12 @@
  * draft, that is a REST API that can be used to access TURN services,
  * more specifically credentials to use. Currently implemented in both
  * rfc5766-turn-server and coturn, and so should be generic enough to
- * be usable here.
+ * be usable here. Credentials are cached per username, for as long as
+ * the TTL the backend returned allows: a cached entry that is close to
+ * expiring is refreshed in the background the next time it's used, and
+ * credentials can be prefetched (e.g., when a handle is created) so that
+ * setting up a PeerConnection doesn't need to wait for the backend. All
+ * requests share connections (and DNS lookups) to the backend via libcurl.
  * \note This implementation depends on \c libcurl and is optional.
  *
  * \ingroup core
@@ -34,6 +39,39 @@ static gboolean api_http_get = FALSE;
 static uint api_timeout;
 static janus_mutex api_mutex = JANUS_MUTEX_INITIALIZER;
 
+/* Connections and DNS lookups are shared by all the requests */
+static CURLSH *api_share = NULL;
+static janus_mutex share_mutex[CURL_LOCK_DATA_LAST];
+static void janus_turnrest_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+	janus_mutex_lock(&share_mutex[data]);
+}
+static void janus_turnrest_share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	janus_mutex_unlock(&share_mutex[data]);
+}
+
+/* Cache of credentials, indexed by username */
+typedef struct janus_turnrest_cache_entry {
+	/* Last credentials we got, if any */
+	janus_turnrest_response *response;
+	/* When the credentials should be refreshed, and when they can't be used anymore */
+	gint64 refresh, expires;
+	/* Whether a request to the backend is in progress for this user */
+	gboolean fetching;
+} janus_turnrest_cache_entry;
+static GHashTable *cache = NULL;
+static guint cache_generation = 0;
+static gint64 cache_last_sweep = 0;
+static janus_mutex cache_mutex = JANUS_MUTEX_INITIALIZER;
+static janus_condition cache_cond;
+/* Threads fetching credentials in the background */
+#define JANUS_TURNREST_FETCHERS	4
+static GThreadPool *fetchers = NULL;
+typedef struct janus_turnrest_job {
+	char *user;
+	guint generation;
+} janus_turnrest_job;
+static void janus_turnrest_fetcher(gpointer data, gpointer user_data);
+
 
 /* Buffer we use to receive the response via libcurl */
 typedef struct janus_turnrest_buffer {
@@ -56,12 +94,54 @@ static size_t janus_turnrest_callback(void *payload, size_t size, size_t nmemb,
 }
 
 
+static void janus_turnrest_cache_entry_destroy(gpointer data) {
+	janus_turnrest_cache_entry *entry = (janus_turnrest_cache_entry *)data;
+	if(entry == NULL)
+		return;
+	janus_turnrest_response_destroy(entry->response);
+	g_free(entry);
+}
+
 void janus_turnrest_init(void) {
 	/* Initialize libcurl, needed for contacting the TURN REST API backend */
 	curl_global_init(CURL_GLOBAL_ALL);
+	int i = 0;
+	for(i=0; i<CURL_LOCK_DATA_LAST; i++)
+		janus_mutex_init(&share_mutex[i]);
+	api_share = curl_share_init();
+	if(api_share != NULL) {
+		curl_share_setopt(api_share, CURLSHOPT_LOCKFUNC, janus_turnrest_share_lock);
+		curl_share_setopt(api_share, CURLSHOPT_UNLOCKFUNC, janus_turnrest_share_unlock);
+		curl_share_setopt(api_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(api_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+		curl_share_setopt(api_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	}
+	janus_condition_init(&cache_cond);
+	cache = g_hash_table_new_full(g_str_hash, g_str_equal, (GDestroyNotify)g_free, janus_turnrest_cache_entry_destroy);
+	GError *error = NULL;
+	fetchers = g_thread_pool_new(janus_turnrest_fetcher, NULL, JANUS_TURNREST_FETCHERS, FALSE, &error);
+	if(error != NULL) {
+		/* Credentials will only be fetched when needed, then */
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to launch the TURN REST API fetchers...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		fetchers = NULL;
+	}
 }
 
 void janus_turnrest_deinit(void) {
+	if(fetchers != NULL)
+		g_thread_pool_free(fetchers, TRUE, TRUE);
+	fetchers = NULL;
+	janus_mutex_lock(&cache_mutex);
+	g_hash_table_destroy(cache);
+	cache = NULL;
+	janus_mutex_unlock(&cache_mutex);
+	if(api_share != NULL)
+		curl_share_cleanup(api_share);
+	api_share = NULL;
 	/* Cleanup the libcurl initialization */
 	curl_global_cleanup();
 	janus_mutex_lock(&api_mutex);
@@ -97,6 +177,13 @@ void janus_turnrest_set_backend(const char *server, const char *key, const char
 		api_timeout = timeout;
 	}
 	janus_mutex_unlock(&api_mutex);
+	/* Credentials we cached came from the previous backend, get rid of them */
+	janus_mutex_lock(&cache_mutex);
+	if(cache != NULL)
+		g_hash_table_remove_all(cache);
+	cache_generation++;
+	janus_condition_broadcast(&cache_cond);
+	janus_mutex_unlock(&cache_mutex);
 }
 
 const char *janus_turnrest_get_backend(void) {
@@ -120,7 +207,30 @@ void janus_turnrest_response_destroy(janus_turnrest_response *response) {
 	g_free(response);
 }
 
-janus_turnrest_response *janus_turnrest_request(const char *user) {
+static janus_turnrest_response *janus_turnrest_response_copy(janus_turnrest_response *response) {
+	if(response == NULL)
+		return NULL;
+	janus_turnrest_response *copy = g_malloc(sizeof(janus_turnrest_response));
+	copy->username = g_strdup(response->username);
+	copy->password = g_strdup(response->password);
+	copy->ttl = response->ttl;
+	copy->servers = NULL;
+	GList *temp = response->servers;
+	while(temp) {
+		janus_turnrest_instance *instance = (janus_turnrest_instance *)temp->data;
+		janus_turnrest_instance *instance_copy = g_malloc(sizeof(janus_turnrest_instance));
+		instance_copy->server = g_strdup(instance->server);
+		instance_copy->port = instance->port;
+		instance_copy->transport = instance->transport;
+		copy->servers = g_list_append(copy->servers, instance_copy);
+		temp = temp->next;
+	}
+	return copy;
+}
+
+/* Contact the backend: this is blocking, so it's only done either by the fetchers,
+ * or by the first thread needing credentials we don't have for a user yet */
+static janus_turnrest_response *janus_turnrest_fetch(const char *user) {
 	janus_mutex_lock(&api_mutex);
 	if(api_server == NULL) {
 		janus_mutex_unlock(&api_mutex);
@@ -134,6 +244,8 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 		JANUS_LOG(LOG_ERR, "libcurl error\n");
 		return NULL;
 	}
+	if(api_share != NULL)
+		curl_easy_setopt(curl, CURLOPT_SHARE, api_share);
 	/* Prepare the request URI */
 	char query_string[512];
 	g_snprintf(query_string, 512, "service=turn");
@@ -172,6 +284,7 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, query_string);
 	}
 	curl_easy_setopt(curl, CURLOPT_TIMEOUT, api_timeout);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
 	/* For getting data, we use an helper struct and the libcurl callback */
 	janus_turnrest_buffer data;
 	data.buffer = g_malloc0(1);
@@ -203,33 +316,40 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 	json_t *username = json_object_get(root, "username");
 	if(!username) {
 		JANUS_LOG(LOG_ERR, "Invalid response: missing username\n");
+		json_decref(root);
 		return NULL;
 	}
 	if(!json_is_string(username)) {
 		JANUS_LOG(LOG_ERR, "Invalid response: username should be a string\n");
+		json_decref(root);
 		return NULL;
 	}
 	json_t *password = json_object_get(root, "password");
 	if(!password) {
 		JANUS_LOG(LOG_ERR, "Invalid response: missing password\n");
+		json_decref(root);
 		return NULL;
 	}
 	if(!json_is_string(password)) {
 		JANUS_LOG(LOG_ERR, "Invalid response: password should be a string\n");
+		json_decref(root);
 		return NULL;
 	}
 	json_t *ttl = json_object_get(root, "ttl");
 	if(ttl && (!json_is_integer(ttl) || json_integer_value(ttl) < 0)) {
 		JANUS_LOG(LOG_ERR, "Invalid response: ttl should be a positive integer\n");
+		json_decref(root);
 		return NULL;
 	}
 	json_t *uris = json_object_get(root, "uris");
 	if(!uris) {
 		JANUS_LOG(LOG_ERR, "Invalid response: missing uris\n");
+		json_decref(root);
 		return NULL;
 	}
 	if(!json_is_array(uris) || json_array_size(uris) == 0) {
 		JANUS_LOG(LOG_ERR, "Invalid response: uris should be a non-empty array\n");
+		json_decref(root);
 		return NULL;
 	}
 	/* Turn the response into a janus_turnrest_response object we can use */
@@ -291,6 +411,7 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 		/* Add the server to the list */
 		response->servers = g_list_append(response->servers, instance);
 	}
+	json_decref(root);
 	if(response->servers == NULL) {
 		JANUS_LOG(LOG_ERR, "Couldn't find any valid TURN URI in the response...\n");
 		janus_turnrest_response_destroy(response);
@@ -300,4 +421,139 @@ janus_turnrest_response *janus_turnrest_request(const char *user) {
 	return response;
 }
 
+/* Update the cache with the result of a request to the backend (cache_mutex must be locked) */
+static void janus_turnrest_cache_update(const char *user, guint generation, janus_turnrest_response *response) {
+	if(cache == NULL || generation != cache_generation) {
+		/* The backend changed in the meanwhile, ignore these credentials */
+		return;
+	}
+	janus_turnrest_cache_entry *entry = g_hash_table_lookup(cache, user);
+	if(entry == NULL)
+		return;
+	entry->fetching = FALSE;
+	gint64 now = janus_get_monotonic_time();
+	if(response != NULL && response->ttl > 0) {
+		/* Refresh when three quarters of the TTL are gone, and stop using the
+		 * credentials a bit before they actually expire (at most a minute) */
+		gint64 ttl = (gint64)response->ttl * G_USEC_PER_SEC;
+		janus_turnrest_response_destroy(entry->response);
+		entry->response = janus_turnrest_response_copy(response);
+		entry->refresh = now + ttl*3/4;
+		entry->expires = now + ttl - MIN(ttl/10, 60*G_USEC_PER_SEC);
+	} else if(entry->response == NULL || now >= entry->expires) {
+		/* Nothing we can cache (request failed, or no TTL) */
+		g_hash_table_remove(cache, user);
+	}
+	janus_condition_broadcast(&cache_cond);
+}
+
+/* Get rid of credentials that expired and no one refreshed (cache_mutex must be locked) */
+static void janus_turnrest_cache_sweep(gint64 now) {
+	if(now - cache_last_sweep < 10*G_USEC_PER_SEC)
+		return;
+	cache_last_sweep = now;
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init(&iter, cache);
+	while(g_hash_table_iter_next(&iter, NULL, &value)) {
+		janus_turnrest_cache_entry *entry = (janus_turnrest_cache_entry *)value;
+		if(!entry->fetching && (entry->response == NULL || now >= entry->expires))
+			g_hash_table_iter_remove(&iter);
+	}
+}
+
+/* Ask the fetchers to get credentials for a user (cache_mutex must be locked) */
+static void janus_turnrest_cache_schedule(const char *user) {
+	janus_turnrest_job *job = g_malloc(sizeof(janus_turnrest_job));
+	job->user = g_strdup(user);
+	job->generation = cache_generation;
+	GError *error = NULL;
+	g_thread_pool_push(fetchers, job, &error);
+	if(error != NULL) {
+		JANUS_LOG(LOG_ERR, "Got error %d (%s) trying to fetch TURN REST API credentials...\n",
+			error->code, error->message ? error->message : "??");
+		g_error_free(error);
+		janus_turnrest_cache_update(user, job->generation, NULL);
+		g_free(job->user);
+		g_free(job);
+	}
+}
+
+static void janus_turnrest_fetcher(gpointer data, gpointer user_data) {
+	janus_turnrest_job *job = (janus_turnrest_job *)data;
+	janus_turnrest_response *response = janus_turnrest_fetch(*job->user ? job->user : NULL);
+	janus_mutex_lock(&cache_mutex);
+	janus_turnrest_cache_update(job->user, job->generation, response);
+	janus_mutex_unlock(&cache_mutex);
+	janus_turnrest_response_destroy(response);
+	g_free(job->user);
+	g_free(job);
+}
+
+void janus_turnrest_prefetch(const char *user) {
+	if(api_server == NULL)
+		return;
+	const char *key = user ? user : "";
+	janus_mutex_lock(&cache_mutex);
+	if(cache == NULL || fetchers == NULL || g_hash_table_lookup(cache, key) != NULL) {
+		/* Either we can't, or we already have (or are getting) credentials for this user */
+		janus_mutex_unlock(&cache_mutex);
+		return;
+	}
+	janus_turnrest_cache_sweep(janus_get_monotonic_time());
+	janus_turnrest_cache_entry *entry = g_malloc0(sizeof(janus_turnrest_cache_entry));
+	entry->fetching = TRUE;
+	g_hash_table_insert(cache, g_strdup(key), entry);
+	janus_turnrest_cache_schedule(key);
+	janus_mutex_unlock(&cache_mutex);
+}
+
+janus_turnrest_response *janus_turnrest_request(const char *user) {
+	if(api_server == NULL)
+		return NULL;
+	const char *key = user ? user : "";
+	janus_turnrest_response *response = NULL;
+	janus_mutex_lock(&cache_mutex);
+	if(cache == NULL) {
+		janus_mutex_unlock(&cache_mutex);
+		return NULL;
+	}
+	gint64 now = janus_get_monotonic_time(), deadline = now + (gint64)(api_timeout+1) * G_USEC_PER_SEC;
+	janus_turnrest_cache_sweep(now);
+	while(cache != NULL) {
+		janus_turnrest_cache_entry *entry = g_hash_table_lookup(cache, key);
+		now = janus_get_monotonic_time();
+		if(entry != NULL && entry->response != NULL && now < entry->expires) {
+			/* We have valid credentials: if they're about to expire, refresh them in the background */
+			response = janus_turnrest_response_copy(entry->response);
+			if(now >= entry->refresh && !entry->fetching && fetchers != NULL) {
+				entry->fetching = TRUE;
+				janus_turnrest_cache_schedule(key);
+			}
+			break;
+		}
+		if(entry != NULL && entry->fetching) {
+			/* Someone is already asking the backend for these credentials, wait for them */
+			if(now >= deadline)
+				break;
+			janus_condition_wait_until(&cache_cond, &cache_mutex, deadline);
+			continue;
+		}
+		/* We have nothing we can use, ask the backend ourselves */
+		if(entry == NULL) {
+			entry = g_malloc0(sizeof(janus_turnrest_cache_entry));
+			g_hash_table_insert(cache, g_strdup(key), entry);
+		}
+		entry->fetching = TRUE;
+		guint generation = cache_generation;
+		janus_mutex_unlock(&cache_mutex);
+		response = janus_turnrest_fetch(user);
+		janus_mutex_lock(&cache_mutex);
+		janus_turnrest_cache_update(key, generation, response);
+		break;
+	}
+	janus_mutex_unlock(&cache_mutex);
+	return response;
+}
+
 #endif
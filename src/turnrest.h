@@ -66,10 +66,17 @@ void janus_turnrest_response_destroy(janus_turnrest_response *response);
 
 
 /*! \brief Retrieve address and credentials for one or more TURN servers
- * @note Use janus_turnrest_response_destroy to get rid of the response, once done
+ * @note Use janus_turnrest_response_destroy to get rid of the response, once done.
+ * Credentials are returned from the cache, when available and not expired: if
+ * not, and someone else is already asking the backend for the same user, this
+ * waits for that request to complete, rather than sending a new one
  * @param[in] user Username to provide in the TURN REST API request
  * @returns A valid janus_turnrest_response instance, if successful, NULL otherwise */
 janus_turnrest_response *janus_turnrest_request(const char *user);
+/*! \brief Start fetching credentials for a user in the background, if they're not cached
+ * already, so that a later janus_turnrest_request doesn't need to wait for the backend
+ * @param[in] user Username to provide in the TURN REST API request */
+void janus_turnrest_prefetch(const char *user);
 
 #endif
 
@@ -9,6 +9,7 @@
  * \ref core
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -19,6 +20,8 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include <zlib.h>
 #include <openssl/rand.h>
@@ -37,6 +40,36 @@ gint64 janus_get_monotonic_time(void) {
 	return (ts.tv_sec*G_GINT64_CONSTANT(1000000)) + (ts.tv_nsec/G_GINT64_CONSTANT(1000));
 }
 
+gint64 janus_get_monotonic_time_coarse(void) {
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+#endif
+	return (ts.tv_sec*G_GINT64_CONSTANT(1000000)) + (ts.tv_nsec/G_GINT64_CONSTANT(1000));
+}
+
+/* Monotonic time cached by each thread (0 if none) */
+static GPrivate janus_monotonic_time_thread = G_PRIVATE_INIT(g_free);
+gint64 janus_get_monotonic_time_cached(void) {
+	gint64 *cached = g_private_get(&janus_monotonic_time_thread);
+	if(cached != NULL && *cached > 0)
+		return *cached;
+	return janus_get_monotonic_time();
+}
+
+void janus_monotonic_time_cache_set(gint64 now) {
+	gint64 *cached = g_private_get(&janus_monotonic_time_thread);
+	if(cached == NULL) {
+		if(now == 0)
+			return;
+		cached = g_malloc(sizeof(gint64));
+		g_private_set(&janus_monotonic_time_thread, cached);
+	}
+	*cached = now;
+}
+
 gint64 janus_get_real_time(void) {
 	struct timespec ts;
 	clock_gettime (CLOCK_REALTIME, &ts);
@@ -563,6 +596,89 @@ int janus_pidfile_remove(void) {
 	return 0;
 }
 
+/* CPU affinity and NUMA helpers */
+int janus_cpu_count(void) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (int)cpus : 1;
+}
+
+int janus_cpu_numa_node(int cpu) {
+	if(cpu < 0)
+		return -1;
+	/* The sysfs folder of each CPU has a link to the NUMA node it belongs to */
+	char path[64];
+	g_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(dir == NULL)
+		return -1;
+	int node = -1;
+	const char *name = NULL;
+	while((name = g_dir_read_name(dir)) != NULL) {
+		if(strncmp(name, "node", 4) == 0 && g_ascii_isdigit(name[4])) {
+			node = atoi(name+4);
+			break;
+		}
+	}
+	g_dir_close(dir);
+	return node;
+}
+
+GArray *janus_cpu_list_parse(const char *list) {
+	if(list == NULL)
+		return NULL;
+	GArray *cpus = g_array_new(FALSE, FALSE, sizeof(int));
+	gchar **items = g_strsplit(list, ",", -1);
+	int i = 0;
+	for(i=0; items[i] != NULL; i++) {
+		char *item = g_strstrip(items[i]);
+		if(*item == '\0')
+			continue;
+		int first = -1, last = -1;
+		char *dash = strchr(item, '-');
+		if(dash != NULL) {
+			*dash = '\0';
+			first = atoi(item);
+			last = atoi(dash+1);
+		} else {
+			first = last = atoi(item);
+		}
+		if(!g_ascii_isdigit(*item) || first < 0 || last < first) {
+			JANUS_LOG(LOG_ERR, "Invalid CPU list item '%s'\n", item);
+			g_array_free(cpus, TRUE);
+			cpus = NULL;
+			break;
+		}
+		int cpu = 0;
+		for(cpu=first; cpu<=last; cpu++)
+			g_array_append_val(cpus, cpu);
+	}
+	g_strfreev(items);
+	if(cpus != NULL && cpus->len == 0) {
+		g_array_free(cpus, TRUE);
+		cpus = NULL;
+	}
+	return cpus;
+}
+
+int janus_thread_set_cpu(int cpu) {
+	if(cpu < 0)
+		return -1;
+#ifdef HAVE_PTHREAD_SETAFFINITY
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int res = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if(res != 0) {
+		JANUS_LOG(LOG_ERR, "Error pinning thread to CPU %d: %d (%s)\n", cpu, res, g_strerror(res));
+		return -1;
+	}
+	return 0;
+#else
+	JANUS_LOG(LOG_WARN, "Thread affinity not supported on this platform\n");
+	return -1;
+#endif
+}
+
 /* Protected folders management */
 static GList *protected_folders = NULL;
 static janus_mutex pf_mutex = JANUS_MUTEX_INITIALIZER;
@@ -855,17 +971,18 @@ gboolean janus_vp9_is_keyframe(const char *buffer, int len) {
 	return FALSE;
 }
 
-static gboolean janus_h264_contains_nal(const char *buffer, int len, int val) {
+guint32 janus_h264_nal_types(const char *buffer, int len) {
 	if(!buffer || len < 6)
-		return FALSE;
+		return 0;
 	/* Parse H264 header now */
 	uint8_t fragment = *buffer & 0x1F;
 	uint8_t nal = *(buffer+1) & 0x1F;
-	if(fragment == val || ((fragment == 28 || fragment == 29) && nal == val && (*(buffer+1) & 0x80))) {
-		JANUS_LOG(LOG_HUGE, "Got an H264 NAL %d\n", val);
-		return TRUE;
+	guint32 types = (1 << fragment);
+	if((fragment == 28 || fragment == 29) && (*(buffer+1) & 0x80)) {
+		/* First fragment of a FU-A/FU-B, which tells us what's fragmented */
+		types |= (1 << nal);
 	} else if(fragment == 24) {
-		/* May we find it in this STAP-A? */
+		/* STAP-A: walk the aggregated NALs once, jumping from size to size */
 		buffer++;
 		len--;
 		uint16_t psize = 0;
@@ -875,15 +992,21 @@ static gboolean janus_h264_contains_nal(const char *buffer, int len, int val) {
 			psize = ntohs(psize);
 			buffer += 2;
 			len -= 2;
-			int nal = *buffer & 0x1F;
-			if(nal == val) {
-				JANUS_LOG(LOG_HUGE, "Got an H264 NAL %d\n", val);
-				return TRUE;
-			}
+			types |= (1 << (*buffer & 0x1F));
+			if(psize > len)
+				break;
 			buffer += psize;
 			len -= psize;
 		}
 	}
+	return types;
+}
+
+static gboolean janus_h264_contains_nal(const char *buffer, int len, int val) {
+	if(janus_h264_nal_types(buffer, len) & (1 << val)) {
+		JANUS_LOG(LOG_HUGE, "Got an H264 NAL %d\n", val);
+		return TRUE;
+	}
 	/* If we got here we didn't find it */
 	return FALSE;
 }
@@ -1218,17 +1341,30 @@ int janus_vp9_parse_svc(char *buffer, int len, gboolean *found, janus_vp9_svc_in
 
 /* RED parsing and building utilities */
 GList *janus_red_parse_blocks(char *buffer, int len) {
-	if(buffer == NULL || len < 0)
+	janus_red_block rbs[JANUS_RED_MAX_BLOCKS];
+	int count = janus_red_parse_blocks_array(buffer, len, rbs, JANUS_RED_MAX_BLOCKS);
+	if(count <= 0)
 		return NULL;
+	GList *blocks = NULL;
+	int i = 0;
+	for(i=count-1; i>=0; i--) {
+		janus_red_block *rb = g_malloc(sizeof(janus_red_block));
+		*rb = rbs[i];
+		blocks = g_list_prepend(blocks, rb);
+	}
+	return blocks;
+}
+int janus_red_parse_blocks_array(char *buffer, int len, janus_red_block *blocks, int max) {
+	if(buffer == NULL || len < 0 || blocks == NULL || max < 1)
+		return -1;
 	/* TODO This whole method should be fuzzed */
 	char *payload = buffer;
 	int plen = len;
 	/* Find out how many generations are in the RED packet */
-	int gens = 0;
+	int gens = 0, count = 0;
 	uint32_t red_block;
 	uint8_t follow = 0, block_pt = 0;
 	uint16_t ts_offset = 0, block_len = 0;
-	GList *blocks = NULL;
 	janus_red_block *rb = NULL;
 	/* Parse the header */
 	while(payload != NULL && plen > 0) {
@@ -1238,17 +1374,22 @@ GList *janus_red_parse_blocks(char *buffer, int len) {
 		block_pt = (*payload) & 0x7F;
 		if(follow && plen > 3) {
 			/* Read the rest of the header */
+			if(count == max - 1) {
+				/* We need to leave room for the primary data */
+				JANUS_LOG(LOG_WARN, "Too many RED blocks (more than %d)\n", max);
+				return -2;
+			}
 			memcpy(&red_block, payload, sizeof(red_block));
 			red_block = ntohl(red_block);
 			ts_offset = (red_block & 0x00FFFC00) >> 10;
 			block_len = (red_block & 0x000003FF);
 			JANUS_LOG(LOG_HUGE, "  [%d] f=%u, pt=%u, tsoff=%"SCNu16", blen=%"SCNu16"\n",
 				gens, follow, block_pt, ts_offset, block_len);
-			rb = g_malloc0(sizeof(janus_red_block));
+			rb = &blocks[count++];
 			rb->pt = block_pt;
 			rb->ts_offset = ts_offset;
+			rb->data = NULL;
 			rb->length = block_len;
-			blocks = g_list_append(blocks, rb);
 			payload += 4;
 			plen -= 4;
 		} else {
@@ -1261,62 +1402,65 @@ GList *janus_red_parse_blocks(char *buffer, int len) {
 		}
 	}
 	/* Go through the blocks, iterating on the lengths to get a pointer to the data */
-	if(blocks != NULL) {
-		int tot_gens = gens;
-		gens = 0;
-		uint16_t length = 0;
-		GList *temp = blocks;
-		while(temp != NULL) {
-			gens++;
-			tot_gens--;
-			rb = (janus_red_block *)temp->data;
-			length = rb->length;
-			if(length > plen) {
-				JANUS_LOG(LOG_WARN, "  >> [%d] Broken red payload:\n", gens);
-				g_list_free_full(blocks, (GDestroyNotify)g_free);
-				return NULL;
-			}
-			if(length > 0) {
-				/* Redundant data, take note of where the block is */
-				JANUS_LOG(LOG_HUGE, "  >> [%d] plen=%"SCNu16"\n", gens, length);
-				rb->data = (uint8_t *)payload;
-				payload += length;
-				plen -= length;
-			}
-			temp = temp->next;
+	int i = 0;
+	for(i=0; i<count; i++) {
+		rb = &blocks[i];
+		if(rb->length > plen) {
+			JANUS_LOG(LOG_WARN, "  >> [%d] Broken red payload:\n", i+1);
+			return -3;
+		}
+		if(rb->length > 0) {
+			/* Redundant data, take note of where the block is */
+			JANUS_LOG(LOG_HUGE, "  >> [%d] plen=%"SCNu16"\n", i+1, rb->length);
+			rb->data = (uint8_t *)payload;
+			payload += rb->length;
+			plen -= rb->length;
 		}
 	}
 	if(plen > 0) {
 		/* The last block is the primary data, add it to the list */
-		gens++;
-		JANUS_LOG(LOG_HUGE, "  >> [%d] plen=%d\n", gens, plen);
-		rb = g_malloc0(sizeof(janus_red_block));
+		JANUS_LOG(LOG_HUGE, "  >> [%d] plen=%d\n", count+1, plen);
+		rb = &blocks[count++];
 		rb->pt = block_pt;
+		rb->ts_offset = 0;
 		rb->length = plen;
 		rb->data = (uint8_t *)payload;
-		blocks = g_list_append(blocks, rb);
 	}
-
-	return blocks;
+	return count;
 }
 int janus_red_pack_blocks(char *buffer, int len, GList *blocks) {
 	if(buffer == NULL || len < 0)
 		return 1;
-	int required = 0, written = 0;
+	janus_red_block rbs[JANUS_RED_MAX_BLOCKS];
+	int count = 0;
+	GList *temp = blocks;
+	while(temp != NULL) {
+		if(count == JANUS_RED_MAX_BLOCKS) {
+			JANUS_LOG(LOG_ERR, "Too many RED blocks (more than %d)\n", JANUS_RED_MAX_BLOCKS);
+			return -3;
+		}
+		rbs[count++] = *((janus_red_block *)temp->data);
+		temp = temp->next;
+	}
+	return janus_red_pack_blocks_array(buffer, len, rbs, count);
+}
+int janus_red_pack_blocks_array(char *buffer, int len, janus_red_block *blocks, int count) {
+	if(buffer == NULL || len < 0 || (blocks == NULL && count > 0))
+		return -1;
+	int required = 0, written = 0, i = 0;
 	janus_red_block *rb = NULL;
 	/* Write all headers to the buffer */
 	uint32_t red_block = 0;
 	uint8_t *payload = (uint8_t *)buffer;
-	GList *temp = blocks;
-	while(temp != NULL) {
-		rb = (janus_red_block *)temp->data;
-		required += (temp->next ? 4 : 1);
+	for(i=0; i<count; i++) {
+		rb = &blocks[i];
+		required += (i < count-1 ? 4 : 1);
 		required += rb->length;
 		if(len < required) {
 			JANUS_LOG(LOG_ERR, "RED buffer too small (%d bytes, at least %d needed)\n", len, required);
 			return -2;
 		}
-		if(temp->next != NULL) {
+		if(i < count-1) {
 			/* There's going to be a follow-up, write 4 bytes (F=1 and info) */
 			red_block =
 				0x80000000 +							/* F=1 */
@@ -1332,16 +1476,13 @@ int janus_red_pack_blocks(char *buffer, int len, GList *blocks) {
 			*(payload + written) = pt;
 			written++;
 		}
-		temp = temp->next;
 	}
 	/* Now write all data to the buffer too */
-	temp = blocks;
-	while(temp != NULL) {
-		rb = (janus_red_block *)temp->data;
+	for(i=0; i<count; i++) {
+		rb = &blocks[i];
 		/* Write the data itself */
 		memcpy(payload + written, rb->data, rb->length);
 		written += rb->length;
-		temp = temp->next;
 	}
 	return written;
 }
@@ -1411,6 +1552,252 @@ uint32_t janus_bitstream_getbits(uint8_t *base, uint8_t num, uint32_t *offset) {
 	return res;
 }
 
+void janus_bitstream_reader_init(janus_bitstream_reader *reader, const uint8_t *data, size_t len) {
+	if(reader == NULL)
+		return;
+	reader->data = data;
+	reader->len = data ? len : 0;
+	reader->pos = 0;
+	reader->cache = 0;
+	reader->cached = 0;
+	reader->overflow = FALSE;
+}
+
+/* Top up the cached word: when at least 8 bytes are left, we load them all at once
+ * and only keep the whole bytes that fit, which needs no loop and no branches. The
+ * bits of the partial byte that end up in the cache are the same ones the next
+ * refill will write there again, so OR-ing them twice is harmless */
+static void janus_bitstream_reader_refill(janus_bitstream_reader *reader) {
+	if(reader->len - reader->pos >= 8) {
+		uint64_t word = 0;
+		memcpy(&word, reader->data + reader->pos, sizeof(word));
+		reader->cache |= GUINT64_FROM_BE(word) >> reader->cached;
+		reader->pos += (63 - reader->cached) >> 3;
+		reader->cached |= 56;
+	} else {
+		/* Close to the end, go byte by byte */
+		while(reader->cached <= 56 && reader->pos < reader->len) {
+			reader->cache |= (uint64_t)reader->data[reader->pos] << (56 - reader->cached);
+			reader->pos++;
+			reader->cached += 8;
+		}
+	}
+}
+
+uint32_t janus_bitstream_reader_get(janus_bitstream_reader *reader, uint8_t num) {
+	if(reader == NULL || num == 0 || num > 32)
+		return 0;
+	if(reader->cached < num) {
+		janus_bitstream_reader_refill(reader);
+		if(reader->cached < num) {
+			/* Not enough data */
+			reader->overflow = TRUE;
+			reader->cache = 0;
+			reader->cached = 0;
+			reader->pos = reader->len;
+			return 0;
+		}
+	}
+	uint32_t value = (uint32_t)(reader->cache >> (64 - num));
+	reader->cache <<= num;
+	reader->cached -= num;
+	return value;
+}
+
+size_t janus_bitstream_reader_left(janus_bitstream_reader *reader) {
+	if(reader == NULL || reader->overflow)
+		return 0;
+	return (reader->len - reader->pos) * 8 + reader->cached;
+}
+
+/* Shared JSON payloads */
+#define JANUS_JSON_SHARED_MAX		256
+#define JANUS_JSON_SHARED_FORMATS	4
+/* Serialized payload, shared by the cache and all the events being serialized
+ * with it (we don't use janus_refcount here, as tools link utils.c too) */
+typedef struct janus_json_shared_text {
+	size_t len;
+	volatile gint refs;
+	char text[];
+} janus_json_shared_text;
+static void janus_json_shared_text_unref(janus_json_shared_text *text) {
+	if(text != NULL && g_atomic_int_dec_and_test(&text->refs))
+		g_free(text);
+}
+typedef struct janus_json_shared {
+	json_t *payload;
+	guint pushes;
+	size_t flags[JANUS_JSON_SHARED_FORMATS];
+	janus_json_shared_text *text[JANUS_JSON_SHARED_FORMATS];
+} janus_json_shared;
+static GHashTable *json_shared = NULL;
+static janus_mutex json_shared_mutex = JANUS_MUTEX_INITIALIZER;
+static char json_shared_placeholder[48], json_shared_quoted[50];
+static size_t json_shared_quoted_len = 0;
+
+static void janus_json_shared_free(janus_json_shared *shared) {
+	int i = 0;
+	for(i=0; i<JANUS_JSON_SHARED_FORMATS; i++)
+		janus_json_shared_text_unref(shared->text[i]);
+	json_decref(shared->payload);
+	g_free(shared);
+}
+
+static gboolean janus_json_shared_unused(gpointer key, gpointer value, gpointer user_data) {
+	janus_json_shared *shared = (janus_json_shared *)value;
+	/* If we're the only ones holding a reference, nobody will send this payload anymore */
+	return shared->payload->refcount <= 1;
+}
+
+void janus_json_shared_track(json_t *payload) {
+	if(payload == NULL)
+		return;
+	janus_mutex_lock(&json_shared_mutex);
+	if(json_shared == NULL) {
+		json_shared = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)janus_json_shared_free);
+		/* The placeholder is random, so that it can't appear in any other string */
+		g_snprintf(json_shared_placeholder, sizeof(json_shared_placeholder),
+			"janus-shared-%016"SCNx64"%016"SCNx64, janus_random_uint64_full(), janus_random_uint64_full());
+		g_snprintf(json_shared_quoted, sizeof(json_shared_quoted), "\"%s\"", json_shared_placeholder);
+		json_shared_quoted_len = strlen(json_shared_quoted);
+	}
+	janus_json_shared *shared = g_hash_table_lookup(json_shared, payload);
+	if(shared != NULL) {
+		shared->pushes++;
+		janus_mutex_unlock(&json_shared_mutex);
+		return;
+	}
+	if(g_hash_table_size(json_shared) >= JANUS_JSON_SHARED_MAX) {
+		g_hash_table_foreach_remove(json_shared, janus_json_shared_unused, NULL);
+		if(g_hash_table_size(json_shared) >= JANUS_JSON_SHARED_MAX) {
+			janus_mutex_unlock(&json_shared_mutex);
+			return;
+		}
+	}
+	shared = g_malloc0(sizeof(janus_json_shared));
+	shared->payload = json_incref(payload);
+	shared->pushes = 1;
+	g_hash_table_insert(json_shared, payload, shared);
+	janus_mutex_unlock(&json_shared_mutex);
+}
+
+/* Returns a reference to the serialized payload, if it's shared by more than one message */
+static janus_json_shared_text *janus_json_shared_get(json_t *payload, size_t flags) {
+	janus_mutex_lock(&json_shared_mutex);
+	janus_json_shared *shared = json_shared ? g_hash_table_lookup(json_shared, payload) : NULL;
+	if(shared == NULL || shared->pushes < 2) {
+		janus_mutex_unlock(&json_shared_mutex);
+		return NULL;
+	}
+	int i = 0;
+	for(i=0; i<JANUS_JSON_SHARED_FORMATS; i++) {
+		if(shared->text[i] != NULL && shared->flags[i] == flags) {
+			janus_json_shared_text *text = shared->text[i];
+			g_atomic_int_inc(&text->refs);
+			janus_mutex_unlock(&json_shared_mutex);
+			return text;
+		}
+	}
+	janus_mutex_unlock(&json_shared_mutex);
+	/* Not serialized with these flags yet, do it now */
+	char *dump = json_dumps(payload, flags);
+	if(dump == NULL)
+		return NULL;
+	size_t len = strlen(dump);
+	janus_json_shared_text *text = g_malloc(sizeof(janus_json_shared_text) + len + 1);
+	text->len = len;
+	memcpy(text->text, dump, len+1);
+	free(dump);
+	text->refs = 1;
+	janus_mutex_lock(&json_shared_mutex);
+	/* Check again, as the payload may have been evicted in the meanwhile */
+	shared = json_shared ? g_hash_table_lookup(json_shared, payload) : NULL;
+	if(shared != NULL) {
+		for(i=0; i<JANUS_JSON_SHARED_FORMATS; i++) {
+			if(shared->text[i] == NULL) {
+				/* The cache holds a reference too */
+				g_atomic_int_inc(&text->refs);
+				shared->flags[i] = flags;
+				shared->text[i] = text;
+				break;
+			}
+			if(shared->flags[i] == flags)
+				break;
+		}
+	}
+	janus_mutex_unlock(&json_shared_mutex);
+	return text;
+}
+
+char *janus_json_dumps(json_t *json, size_t flags) {
+	json_t *plugindata = json_object_get(json, "plugindata");
+	json_t *payload = json_object_get(plugindata, "data");
+	if(payload == NULL || !json_is_object(payload))
+		return json_dumps(json, flags);
+	janus_json_shared_text *text = janus_json_shared_get(payload, flags);
+	if(text == NULL)
+		return json_dumps(json, flags);
+	/* Serialize everything else, using a placeholder for the payload */
+	json_t *copy = json_copy(json);
+	json_t *pd = json_copy(plugindata);
+	json_object_set_new(pd, "data", json_string(json_shared_placeholder));
+	json_object_set_new(copy, "plugindata", pd);
+	char *outer = json_dumps(copy, flags);
+	json_decref(copy);
+	char *start = outer ? strstr(outer, json_shared_quoted) : NULL;
+	if(start == NULL) {
+		/* Shouldn't happen, fallback to a regular serialization */
+		free(outer);
+		janus_json_shared_text_unref(text);
+		return json_dumps(json, flags);
+	}
+	/* The payload was serialized on its own: if the output is indented, each
+	 * of its lines needs the same indentation as the line it's nested in.
+	 * Newlines within strings are always escaped, so any newline we find in
+	 * the serialized payload is one jansson added to indent the output */
+	size_t indent = 0, newlines = 0, i = 0;
+	char *line = start;
+	while(line > outer && *(line-1) != '\n')
+		line--;
+	while(line + indent < start && line[indent] == ' ')
+		indent++;
+	if(indent > 0) {
+		for(i=0; i<text->len; i++) {
+			if(text->text[i] == '\n')
+				newlines++;
+		}
+	}
+	/* Replace the placeholder with the serialized payload */
+	size_t prefix = start - outer, olen = strlen(outer);
+	size_t suffix = olen - prefix - json_shared_quoted_len;
+	size_t len = text->len + newlines*indent;
+	char *result = malloc(prefix + len + suffix + 1);
+	memcpy(result, outer, prefix);
+	if(newlines == 0) {
+		memcpy(result + prefix, text->text, text->len);
+	} else {
+		char *dst = result + prefix;
+		for(i=0; i<text->len; i++) {
+			*dst++ = text->text[i];
+			if(text->text[i] == '\n') {
+				memset(dst, ' ', indent);
+				dst += indent;
+			}
+		}
+	}
+	memcpy(result + prefix + len, start + json_shared_quoted_len, suffix);
+	result[prefix + len + suffix] = '\0';
+	free(outer);
+	janus_json_shared_text_unref(text);
+	return result;
+}
+
+void janus_json_shared_deinit(void) {
+	janus_mutex_lock(&json_shared_mutex);
+	g_clear_pointer(&json_shared, g_hash_table_destroy);
+	janus_mutex_unlock(&json_shared_mutex);
+}
+
 #ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
 size_t janus_gzip_compress(int compression, char *text, size_t tlen, char *compressed, size_t zlen) {
 	if(text == NULL || tlen < 1 || compressed == NULL || zlen < 1)
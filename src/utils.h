@@ -37,6 +37,28 @@ struct janus_json_parameter {
  * @returns The system monotonic time */
 gint64 janus_get_monotonic_time(void);
 
+/*! \brief Helper to retrieve a coarse system monotonic time, which is
+ * cheaper to read than janus_get_monotonic_time, but only has a resolution
+ * of a few milliseconds (the kernel tick): meant for timeouts, activity
+ * tracking and anything else where precision doesn't matter
+ * \note Falls back to the precise clock where a coarse one is not available
+ * @returns The coarse system monotonic time */
+gint64 janus_get_monotonic_time_coarse(void);
+
+/*! \brief Helper to retrieve the monotonic time cached by the current thread,
+ * e.g., by an event loop before serving a batch of packets, so that the code
+ * handling each packet doesn't need to read the clock again
+ * \note When the current thread hasn't cached any time, the clock is read
+ * as janus_get_monotonic_time would do
+ * @returns The cached monotonic time, if any, or the system monotonic time otherwise */
+gint64 janus_get_monotonic_time_cached(void);
+
+/*! \brief Helper to cache the monotonic time in the current thread
+ * \note Make sure the cache is reset (passing 0) as soon as the batch of work
+ * it was set for is over, or other code in the same thread will get a stale time
+ * @param[in] now The monotonic time to cache, or 0 to stop caching */
+void janus_monotonic_time_cache_set(gint64 now);
+
 /*! \brief Helper to retrieve the system real time, as Glib's
  * g_get_real_time may not be available (only since 2.28)
  * @returns The system real time */
@@ -210,6 +232,26 @@ int janus_pidfile_create(const char *file);
  * @returns 0 if successful, a negative integer otherwise */
 int janus_pidfile_remove(void);
 
+/** @name CPU affinity and NUMA helpers
+ */
+///@{
+/*! \brief Get the number of online CPUs
+ * @returns The number of online CPUs (at least 1) */
+int janus_cpu_count(void);
+/*! \brief Get the NUMA node a CPU belongs to
+ * @param cpu The CPU to check
+ * @returns The NUMA node of the CPU, or -1 if unknown */
+int janus_cpu_numa_node(int cpu);
+/*! \brief Parse a list of CPUs, in the same format \c taskset uses (e.g., "0-3,8,10-11")
+ * @param list The list to parse
+ * @returns A GArray of int CPU numbers, to be freed with g_array_free(), or NULL on errors */
+GArray *janus_cpu_list_parse(const char *list);
+/*! \brief Pin the calling thread to a CPU
+ * @param cpu The CPU to pin the thread to
+ * @returns 0 if successful, a negative integer otherwise */
+int janus_thread_set_cpu(int cpu);
+///@}
+
 /*! \brief Add a folder to the protected list (meaning we won't create
  * files there, like recordings or pcap dumps)
  * @param folder Folder to protect */
@@ -325,6 +367,15 @@ gboolean janus_vp8_is_keyframe(const char *buffer, int len);
  * @returns TRUE if it's a keyframe, FALSE otherwise */
 gboolean janus_vp9_is_keyframe(const char *buffer, int len);
 
+/*! \brief Helper method to get all the NAL types an H.264 RTP payload contains, in a single
+ * pass (looking at all the NALs of a STAP-A, and at what's fragmented in the first packet of a FU)
+ * @note This is useful when more than one NAL type needs checking, as each of the
+ * janus_h264_is_keyframe, janus_h264_is_i_frame, etc. methods scans the payload again
+ * @param[in] buffer The RTP payload to process
+ * @param[in] len The length of the RTP payload
+ * @returns A bitmask of the NAL types found (e.g., bit 7 for SPS), or 0 if none was found */
+guint32 janus_h264_nal_types(const char *buffer, int len);
+
 /*! \brief Helper method to check if an H.264 frame is a keyframe or not
  * @note This checks the presence of an SPS NAL (7), nor an I-Frame (5),
  * since SPS/PPS are what's needed for a browser to actually be able to
@@ -410,18 +461,37 @@ typedef struct janus_red_block {
 	uint8_t *data;
 	uint16_t length;
 } janus_red_block;
+/*! \brief Max number of blocks (redundant and primary) we handle in a RED payload */
+#define JANUS_RED_MAX_BLOCKS	16
 /*! \brief Helper method to parse an RTP payload to return a list of RED blocks
- * \note The returned list is owned by the caller, and must be freed
+ * \note The returned list is owned by the caller, and must be freed: on
+ * the media path, janus_red_parse_blocks_array should be preferred
  * @param[in] buffer The RTP payload to process
  * @param[in] len The length of the RTP payload
  * @returns An allocated GList of janus_red_block, if successful, NULL otherwise */
 GList *janus_red_parse_blocks(char *buffer, int len);
+/*! \brief Helper method to parse an RTP payload in an array of RED blocks, without allocating anything
+ * \note The blocks point to the data in the provided buffer, and the
+ * primary data, if any, is always the last block
+ * @param[in] buffer The RTP payload to process
+ * @param[in] len The length of the RTP payload
+ * @param[out] blocks Array to fill with the blocks
+ * @param[in] max Size of the array (e.g., JANUS_RED_MAX_BLOCKS)
+ * @returns The number of blocks in case of success, a negative integer otherwise */
+int janus_red_parse_blocks_array(char *buffer, int len, janus_red_block *blocks, int max);
 /*! \brief Helper method to pack multiple buffers in a RED payload
  * @param[in] buffer The RTP payload to write to
  * @param[in] len The size of the RTP payload buffer
  * @param[in] blocks Linked list of janus_red_block instances to add to the payload
  * @returns The size of the RED payload in case of success, a negative integer otherwise */
 int janus_red_pack_blocks(char *buffer, int len, GList *blocks);
+/*! \brief Helper method to pack an array of buffers in a RED payload
+ * @param[in] buffer The RTP payload to write to
+ * @param[in] len The size of the RTP payload buffer
+ * @param[in] blocks Array of blocks to add to the payload, with the primary data last
+ * @param[in] count Number of blocks in the array
+ * @returns The size of the RED payload in case of success, a negative integer otherwise */
+int janus_red_pack_blocks_array(char *buffer, int len, janus_red_block *blocks, int count);
 /*! \brief Helper method to overwrite all RTP payload types in RED blocks
  * @param[in] buffer The RED block payload to update
  * @param[in] len The size of the payload buffer
@@ -476,6 +546,36 @@ uint8_t janus_bitstream_getbit(uint8_t *base, uint32_t offset);
  * @returns The value of the bits */
 uint32_t janus_bitstream_getbits(uint8_t *base, uint8_t num, uint32_t *offset);
 
+/*! \brief Buffered reader for bitstreams (most significant bit first), e.g., for codec descriptors
+ * \note Unlike janus_bitstream_getbits, this never reads past the end of the data: trying to
+ * read more bits than available returns 0 and sets the \c overflow property instead */
+typedef struct janus_bitstream_reader {
+	/*! \brief The bitstream, and its size in bytes */
+	const uint8_t *data;
+	size_t len;
+	/*! \brief Offset of the next byte to load */
+	size_t pos;
+	/*! \brief Cached bits (left aligned), and how many of them are valid */
+	uint64_t cache;
+	uint8_t cached;
+	/*! \brief Whether we tried to read past the end of the bitstream */
+	gboolean overflow;
+} janus_bitstream_reader;
+/*! \brief Initialize a bitstream reader
+ * @param[in] reader The janus_bitstream_reader instance to initialize
+ * @param[in] data Pointer to the start of the bitstream
+ * @param[in] len Size of the bitstream, in bytes */
+void janus_bitstream_reader_init(janus_bitstream_reader *reader, const uint8_t *data, size_t len);
+/*! \brief Read a group of bits from a bitstream reader
+ * @param[in] reader The janus_bitstream_reader instance to read from
+ * @param[in] num The number of bits to read (at most 32)
+ * @returns The value of the bits, or 0 if there weren't enough bits left */
+uint32_t janus_bitstream_reader_get(janus_bitstream_reader *reader, uint8_t num);
+/*! \brief Get how many bits can still be read from a bitstream reader
+ * @param[in] reader The janus_bitstream_reader instance to check
+ * @returns The number of bits left */
+size_t janus_bitstream_reader_left(janus_bitstream_reader *reader);
+
 /*! \brief Helper method to compress a string to gzip (using zlib)
  * \note It's up to you to provide a buffer large enough for the compressed
  * data: in case the buffer isn't large enough, the request will fail
@@ -488,4 +588,30 @@ uint32_t janus_bitstream_getbits(uint8_t *base, uint8_t num, uint32_t *offset);
  */
 size_t janus_gzip_compress(int compression, char *text, size_t tlen, char *compressed, size_t zlen);
 
+/** @name Shared JSON payloads
+ * Plugins often send the same payload to many recipients (e.g., to notify
+ * all the participants in a room about something): each recipient gets a
+ * different event, but they all contain the same plugin data. The core
+ * keeps track of the payloads it sends, so that transports serializing
+ * events with janus_json_dumps() only really serialize a shared payload
+ * once per format, and reuse that serialization for all other recipients.
+ * \note Payloads are tracked by their json_t pointer, and their
+ * serializations are never invalidated: as already happens for transports
+ * queueing events for later, a plugin must not modify a payload after it
+ * passed it to the core (see \c push_event in plugin.h).
+ */
+///@{
+/*! \brief Keep track of a payload that is about to be sent in an event
+ * @param[in] payload The payload to track */
+void janus_json_shared_track(json_t *payload);
+/*! \brief Serialize a JSON event, reusing the serialization of its
+ * plugin data if that's a payload shared by multiple events
+ * @param[in] json The event to serialize
+ * @param[in] flags The same flags json_dumps() expects
+ * @returns The serialized event, to be freed with free(), or NULL if an error occurred */
+char *janus_json_dumps(json_t *json, size_t flags);
+/*! \brief Get rid of all the tracked payloads */
+void janus_json_shared_deinit(void);
+///@}
+
 #endif
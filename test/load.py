@@ -0,0 +1,270 @@
+import argparse
+import asyncio
+import csv
+import logging
+import os
+import random
+import sys
+import time
+
+import websockets as ws
+
+from aiortc import RTCPeerConnection, RTCSessionDescription
+from aiortc.mediastreams import AudioStreamTrack, VideoStreamTrack
+from aiortc.contrib.media import MediaPlayer
+
+from echo import WebSocketClient, JanusSession
+
+
+logger = logging.getLogger('load')
+
+
+class AdminClient(WebSocketClient):
+    """Client for the Admin API, used to sample the event loops stats"""
+
+    def __init__(self, url='ws://localhost:7188/', secret=None):
+        super().__init__(url)
+        self._secret = secret
+
+    async def connect(self):
+        self.connection = await ws.connect(self._url,
+                                           subprotocols=['janus-admin-protocol'],
+                                           ping_interval=10,
+                                           ping_timeout=10,
+                                           compression=None)
+        if self.connection.open:
+            asyncio.ensure_future(self.receiveMessage())
+            logger.info('Admin WebSocket connected')
+            return self
+
+    async def request(self, request):
+        message = {'janus': request}
+        if self._secret:
+            message['admin_secret'] = self._secret
+        return await self.send(message)
+
+
+class Peer:
+    """A WebRTC peer, with its own Janus session and handle"""
+
+    def __init__(self, url, player=None):
+        self.session = JanusSession(url)
+        self.pc = RTCPeerConnection()
+        self.player = player
+        self.plugin = None
+
+    def add_tracks(self):
+        if self.player and self.player.audio:
+            self.pc.addTrack(self.player.audio)
+        else:
+            self.pc.addTrack(AudioStreamTrack())
+        if self.player and self.player.video:
+            self.pc.addTrack(self.player.video)
+        else:
+            self.pc.addTrack(VideoStreamTrack())
+
+    async def attach(self, plugin):
+        await self.session.create()
+        self.plugin = await self.session.attach(plugin)
+
+    async def offer(self, body):
+        await self.pc.setLocalDescription(await self.pc.createOffer())
+        response = await self.plugin.sendMessage({
+            'body': body,
+            'jsep': {
+                'sdp': self.pc.localDescription.sdp,
+                'trickle': False,
+                'type': self.pc.localDescription.type,
+            },
+        })
+        await self.pc.setRemoteDescription(RTCSessionDescription(
+            sdp=response['jsep']['sdp'], type=response['jsep']['type']))
+        return response
+
+    async def answer(self, response, body):
+        await self.pc.setRemoteDescription(RTCSessionDescription(
+            sdp=response['jsep']['sdp'], type=response['jsep']['type']))
+        await self.pc.setLocalDescription(await self.pc.createAnswer())
+        return await self.plugin.sendMessage({
+            'body': body,
+            'jsep': {
+                'sdp': self.pc.localDescription.sdp,
+                'trickle': False,
+                'type': self.pc.localDescription.type,
+            },
+        })
+
+    async def rtp_stats(self):
+        received, lost = 0, 0
+        for stat in (await self.pc.getStats()).values():
+            if stat.type == 'inbound-rtp':
+                received += stat.packetsReceived
+                lost += max(0, stat.packetsLost)
+        return received, lost
+
+    async def close(self):
+        await self.pc.close()
+        await self.session.destroy()
+
+
+async def add_echotest(args, peers):
+    peer = Peer(args.url, open_player(args))
+    peer.add_tracks()
+    await peer.attach('janus.plugin.echotest')
+    await peer.offer({'audio': True, 'video': True, 'bitrate': args.bitrate})
+    peers.append(peer)
+    # Audio and video, both ways
+    return 4
+
+
+async def add_videoroom(args, peers, room):
+    # Create the room with the first publisher
+    publisher = Peer(args.url, open_player(args))
+    publisher.add_tracks()
+    await publisher.attach('janus.plugin.videoroom')
+    response = await publisher.plugin.sendMessage({'body': {
+        'request': 'create', 'room': room, 'publishers': 1,
+        'bitrate': args.bitrate, 'permanent': False}})
+    assert response['plugindata']['data']['videoroom'] == 'created'
+    response = await publisher.plugin.sendMessage({'body': {
+        'request': 'join', 'ptype': 'publisher', 'room': room}})
+    feed = response['plugindata']['data']['id']
+    await publisher.offer({'request': 'publish', 'audio': True, 'video': True})
+    peers.append(publisher)
+    # Now subscribe the viewers
+    for i in range(args.viewers):
+        viewer = Peer(args.url)
+        await viewer.attach('janus.plugin.videoroom')
+        response = await viewer.plugin.sendMessage({'body': {
+            'request': 'join', 'ptype': 'subscriber', 'room': room,
+            'streams': [{'feed': feed}]}})
+        await viewer.answer(response, {'request': 'start'})
+        peers.append(viewer)
+    # Audio and video from the publisher, and to each viewer
+    return 2 * (1 + args.viewers)
+
+
+def open_player(args):
+    if not args.play_from:
+        return None
+    return MediaPlayer(args.play_from)
+
+
+def cpu_time(pid):
+    """Time (in seconds) the server spent on the CPU, in user and kernel space"""
+    with open(f'/proc/{pid}/stat') as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+async def loops_stats(admin):
+    """Worst dispatch and queue wait times (p99, in us) across the static event loops"""
+    if not admin:
+        return None, None
+    response = await admin.request('loops_info')
+    dispatch, wait = 0, 0
+    for loop in response.get('loops', []):
+        stats = loop.get('stats', {})
+        dispatch = max(dispatch, stats.get('dispatch-p99', 0))
+        wait = max(wait, stats.get('queue-wait-p99', 0))
+    return dispatch, wait
+
+
+async def run(args):
+    admin = None
+    if args.admin:
+        admin = await AdminClient(args.admin, args.admin_secret).connect()
+        if not (await admin.request('loops_info')).get('loops'):
+            logger.warning('Static event loops are disabled, no loop latency will be reported')
+    writer = csv.writer(sys.stdout)
+    writer.writerow(['units', 'peers', 'streams', 'cpu_percent', 'cpu_per_stream',
+                     'loop_dispatch_p99_us', 'loop_wait_p99_us',
+                     'packets_received', 'packets_lost', 'loss_percent'])
+    peers = []
+    streams, units = 0, 0
+    room = random.randint(1000000, 9999999)
+    try:
+        while units < args.units:
+            # Add the next step of load
+            step = min(args.step, args.units - units)
+            for i in range(step):
+                if args.plugin == 'videoroom':
+                    streams += await add_videoroom(args, peers, room + units)
+                else:
+                    streams += await add_echotest(args, peers)
+                units += 1
+            logger.info(f'Added {step} units ({len(peers)} peers), waiting {args.settle}s')
+            await asyncio.sleep(args.settle)
+            # Sample the server and the peers for a while
+            before = [await peer.rtp_stats() for peer in peers]
+            cpu_before, start = (cpu_time(args.pid), time.monotonic()) if args.pid else (None, None)
+            await asyncio.sleep(args.duration)
+            cpu = None
+            if args.pid:
+                cpu = 100 * (cpu_time(args.pid) - cpu_before) / (time.monotonic() - start)
+            received, lost = 0, 0
+            for peer, (r, l) in zip(peers, before):
+                after = await peer.rtp_stats()
+                received += after[0] - r
+                lost += after[1] - l
+            dispatch, wait = await loops_stats(admin)
+            loss = 100 * lost / (received + lost) if received + lost else 0
+            writer.writerow([units, len(peers), streams,
+                             f'{cpu:.1f}' if cpu is not None else '',
+                             f'{cpu / streams:.3f}' if cpu is not None else '',
+                             dispatch if dispatch is not None else '',
+                             wait if wait is not None else '',
+                             received, lost, f'{loss:.2f}'])
+            sys.stdout.flush()
+            if args.max_loss and loss > args.max_loss:
+                logger.warning(f'Packet loss is {loss:.2f}%, stopping here')
+                break
+    finally:
+        for peer in peers:
+            await peer.close()
+        if admin:
+            await admin.close()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Janus load test')
+    parser.add_argument('url',
+                        help='Janus root URL, e.g. ws://localhost:8188/')
+    parser.add_argument('--plugin', choices=['echotest', 'videoroom'], default='echotest',
+                        help='Plugin to load: each unit is an EchoTest peer, or a VideoRoom publisher with its viewers')
+    parser.add_argument('--units', type=int, default=10,
+                        help='How many units to create in total')
+    parser.add_argument('--step', type=int, default=1,
+                        help='How many units to add before each sample')
+    parser.add_argument('--viewers', type=int, default=1,
+                        help='How many viewers to subscribe to each VideoRoom publisher')
+    parser.add_argument('--bitrate', type=int, default=512000,
+                        help='Bitrate cap for the video of each publisher')
+    parser.add_argument('--play-from',
+                        help='Read the media from a file and send it (e.g., a recording converted with janus-pp-rec)')
+    parser.add_argument('--pid', type=int,
+                        help='PID of the Janus process, to report the server CPU usage (same host only)')
+    parser.add_argument('--admin',
+                        help='Janus Admin API WebSocket URL, to report the event loops latency, e.g. ws://localhost:7188/')
+    parser.add_argument('--admin-secret', help='Admin API secret')
+    parser.add_argument('--settle', type=float, default=5,
+                        help='Seconds to wait after each step, before sampling')
+    parser.add_argument('--duration', type=float, default=10,
+                        help='Seconds each sample lasts')
+    parser.add_argument('--max-loss', type=float,
+                        help='Stop adding load when the packet loss (percent) goes beyond this')
+    parser.add_argument('--verbose', '-v', action='count')
+    args = parser.parse_args()
+
+    if args.verbose:
+        logging.basicConfig(level=logging.DEBUG)
+    else:
+        logging.basicConfig(level=logging.WARNING)
+
+    loop = asyncio.get_event_loop()
+    try:
+        loop.run_until_complete(run(args))
+        sys.exit(0)
+    except Exception:
+        logger.exception('Load test failed')
+        sys.exit(1)